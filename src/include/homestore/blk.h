@@ -20,9 +20,11 @@
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <memory>
 #include <sstream>
+#include <type_traits>
 
 #include <boost/icl/interval_map.hpp>
 #include <sisl/utility/enum.hpp>
@@ -41,6 +43,11 @@ static constexpr size_t max_addressable_chunks() { return 1UL << (8 * sizeof(chu
 static constexpr size_t max_blks_per_chunk() { return 1UL << (8 * sizeof(blk_num_t)); }
 static constexpr size_t max_blks_per_blkid() { return (1UL << (8 * sizeof(blk_count_t))) - 1; }
 
+// Format of the MultiBlkId as persisted. Fixed is the in memory layout of the pieces. Compact is the number of pieces
+// and the shared chunk_num followed by every piece, its blk_num as a varint delta (zigzag) from the first piece's and
+// its blk count as a varint, which is a fraction of the fixed size for a fragmented blkid.
+VENUM(blkid_format_t, uint8_t, fixed = 0, compact = 1);
+
 #pragma pack(1)
 struct BlkId {
 protected:
@@ -89,6 +96,11 @@ public:
 };
 #pragma pack()
 
+//
+// MultiBlkId holds all of its pieces (upto max_pieces, all of the same chunk) inline and is trivially copyable, so it
+// is passed around the write path (repl_req_ctx, futures, listener callbacks) as a plain copy of its bytes, with no
+// allocation or pointer to chase. Pieces are iterated by index, either in a range for over pieces() or with next().
+//
 #pragma pack(1)
 struct MultiBlkId : public BlkId {
     static constexpr uint32_t max_addln_pieces{5};
@@ -129,11 +141,27 @@ public:
     uint32_t serialized_size() const;
     void deserialize(sisl::blob const& b, bool copy);
 
+    /// @brief Serialize in the given format to buf, which has room for serialized_size(format) bytes
+    /// @return Number of bytes written
+    uint32_t serialize_to(uint8_t* buf, blkid_format_t format) const;
+    uint32_t serialized_size(blkid_format_t format) const;
+
+    /// @brief Deserialize from b in the given format, bytes beyond the blkid in b are ignored
+    void deserialize(sisl::blob const& b, blkid_format_t format);
+
     bool has_room() const;
     BlkId to_single_blkid() const;
 
+    /// @brief idx'th piece, idx < num_pieces()
+    BlkId piece(uint16_t idx) const {
+        if (idx == 0) { return BlkId{blk_num(), BlkId::blk_count(), chunk_num()}; }
+        auto const cbid = addln_pieces[idx - 1];
+        return BlkId{cbid.m_blk_num, cbid.m_nblks, chunk_num()};
+    }
+
     static uint32_t expected_serialized_size(uint16_t num_pieces);
     static uint32_t max_serialized_size();
+    static uint32_t max_serialized_size(blkid_format_t format);
     static int compare(MultiBlkId const& one, MultiBlkId const& two);
 
     struct iterator {
@@ -142,25 +170,55 @@ public:
 
         iterator(MultiBlkId const& mb) : mbid_{mb} {}
         std::optional< BlkId > next() {
-            if (next_blk_ == 0) {
-                auto bid = r_cast< BlkId const& >(mbid_);
-                ++next_blk_;
-                return (bid.is_valid()) ? std::make_optional(BlkId{bid.blk_num(), bid.blk_count(), bid.chunk_num()})
-                                        : std::nullopt;
-            } else if (next_blk_ < mbid_.num_pieces()) {
-                auto cbid = mbid_.addln_pieces[next_blk_ - 1];
-                ++next_blk_;
-                return std::make_optional(BlkId{cbid.m_blk_num, cbid.m_nblks, mbid_.chunk_num()});
-            } else {
-                return std::nullopt;
-            }
+            if (next_blk_ >= mbid_.num_pieces()) { return std::nullopt; }
+            return std::make_optional(mbid_.piece(next_blk_++));
         }
     };
 
     iterator iterate() const;
+
+    class piece_iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = BlkId;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = BlkId;
+
+        piece_iterator() = default;
+        piece_iterator(MultiBlkId const* mbid, uint16_t idx) : m_mbid{mbid}, m_idx{idx} {}
+
+        BlkId operator*() const { return m_mbid->piece(m_idx); }
+        piece_iterator& operator++() {
+            ++m_idx;
+            return *this;
+        }
+        piece_iterator operator++(int) {
+            auto const it = *this;
+            ++m_idx;
+            return it;
+        }
+        bool operator==(piece_iterator const& other) const { return (m_idx == other.m_idx); }
+
+    private:
+        MultiBlkId const* m_mbid{nullptr};
+        uint16_t m_idx{0};
+    };
+
+    struct piece_range {
+        MultiBlkId const* mbid;
+        piece_iterator begin() const { return piece_iterator{mbid, 0}; }
+        piece_iterator end() const { return piece_iterator{mbid, mbid->num_pieces()}; }
+    };
+
+    /// @brief Pieces in order, as BlkIds, for a range for
+    piece_range pieces() const { return piece_range{this}; }
 };
 #pragma pack()
 
+static_assert(std::is_trivially_copyable_v< MultiBlkId >, "MultiBlkId is expected to be copied as plain bytes");
+static_assert(sizeof(MultiBlkId) <= 40, "MultiBlkId is expected to be small enough to copy cheaply");
+
 } // namespace homestore
 
 ///////////////////// hash function definitions /////////////////////
@@ -175,9 +233,8 @@ struct hash< homestore::MultiBlkId > {
     size_t operator()(const homestore::MultiBlkId& mbid) const noexcept {
         static constexpr size_t s_start_seed = 0xB504F333;
         size_t seed = s_start_seed;
-        auto it = mbid.iterate();
-        while (auto b = it.next()) {
-            boost::hash_combine(seed, b->to_integer());
+        for (auto const b : mbid.pieces()) {
+            boost::hash_combine(seed, b.to_integer());
         }
         return seed;
     }
@@ -252,6 +309,8 @@ struct blk_alloc_hints {
     std::optional< uint32_t > pdev_id_hint;      // which physical device to pick (hint if any) -1 for don't care
     std::optional< chunk_num_t > chunk_id_hint;  // any specific chunk id to pick for this allocation
     std::optional< stream_id_t > stream_id_hint; // any specific stream to pick
+    std::optional< BlkId > neighbor_blkid_hint;  // try to place the blks right after this blkid (e.g. previous blks of
+                                                 // the same object), to keep them contiguous across allocations
     bool can_look_for_other_chunk{true};         // If alloc on device not available can I pick other device
     bool is_contiguous{true};                    // Should the entire allocation be one contiguous block
     bool partial_alloc_ok{false};   // ok to allocate only portion of nblks? Mutually exclusive with is_contiguous
@@ -16,6 +16,9 @@
 #pragma once
 #include <sys/uio.h>
 #include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
 
 #include <folly/small_vector.h>
 #include <folly/futures/Future.h>
@@ -33,11 +36,28 @@ class VirtualDev;
 struct vdev_info;
 struct stream_info_t;
 class BlkReadTracker;
+class BlkFreeEpoch;
+class BlkCsumTable;
+class BlkReadCache;
+class BlkWriteStamps;
+class BlkDataSvcMetrics;
+struct pending_free_t;
 struct blk_alloc_hints;
 class ChunkSelector;
+class AppendChunkGC;
+class BlkDataStreamWriter;
 
 class BlkDataService {
 public:
+    /// @brief Gc callback: blkids in the chunk which are still referenced by the consumer. Consumer is expected to stop
+    /// placing new writes on the chunk, before it returns.
+    using gc_live_blks_cb_t = std::function< std::vector< MultiBlkId >(chunk_num_t) >;
+
+    /// @brief Gc callback: old -> new blkids of all the live blks copied out of the chunk. Consumer switches its index
+    /// to the new blkids and returns true, after which the chunk is reset. On false, the new blkids are freed instead.
+    using gc_relocate_cb_t =
+        std::function< bool(chunk_num_t, std::vector< std::pair< MultiBlkId, MultiBlkId > > const&) >;
+
     /**
      * @brief Constructs a new BlkDataService object with the given custom chunk selector.
      *
@@ -64,9 +84,11 @@ public:
      * @param alloc_type The type of block allocator to use for the virtual device.
      * @param chunk_sel_type The type of chunk selector to use for the virtual device.
      * @param num_chunks The number of chunks to use for the virtual device.
+     * @param fast_tier_size If non-zero, size of an additional virtual device on the fast devices, on which new writes
+     * are placed first (see async_migrate_to_capacity_tier).
      */
     void create_vdev(uint64_t size, HSDevType devType, uint32_t blk_size, blk_allocator_type_t alloc_type,
-                     chunk_selector_type_t chunk_sel_type, uint32_t num_chunks);
+                     chunk_selector_type_t chunk_sel_type, uint32_t num_chunks, uint64_t fast_tier_size = 0);
 
     /**
      * @brief Opens a virtual device with the specified virtual device information.
@@ -85,10 +107,30 @@ public:
      * @param out_blkids The ID(s) of the block(s) that were allocated and written to.
      * @param part_of_batch Whether this operation is part of a batch of operations.
      * @return A Future that will contain an error code indicating the success or failure of the operation.
+     *
+     * With data_compress_writes, the data could be written compressed, in which case out_blkids has fewer blks than
+     * sgs.size. Compressed blks start with a crc protected header (see compressed_blk_hdr), so reading back
+     * out_blkids, with sgs.size or any prefix of it, decompresses it transparently.
      */
     folly::Future< std::error_code > async_alloc_write(sisl::sg_list const& sgs, blk_alloc_hints const& hints,
                                                        MultiBlkId& out_blkids, bool part_of_batch = false);
 
+    /**
+     * @brief Same as above, except that large writes (atleast stripe_min_io_kb) are striped across the pdevs of the
+     * data vdev, one blkid per pdev in the order of the data, written in parallel. Smaller writes, or writes which
+     * can't be striped, are allocated a single blkid. Written uncompressed. Read them back with the batch async_read,
+     * each blkid with its part of the data.
+     *
+     * @param sgs The scatter-gather list containing the data to write.
+     * @param hints Hints for allocating the block(s) to write to, chunk_id_hint disables the striping.
+     * @param out_blkids The ID(s) of the block(s) that were allocated and written to are appended here.
+     * @param part_of_batch Whether this operation is part of a batch of operations.
+     * @return A Future that will contain an error code indicating the success or failure of the operation.
+     */
+    folly::Future< std::error_code > async_alloc_write(sisl::sg_list const& sgs, blk_alloc_hints const& hints,
+                                                       std::vector< MultiBlkId >& out_blkids,
+                                                       bool part_of_batch = false);
+
     /**
      * @brief Asynchronously writes the given buffer to the specified block ID.
      *
@@ -119,7 +161,8 @@ public:
      * @param buf The buffer to read data into.
      * @param size The number of bytes to read.
      * @param part_of_batch Whether this read is part of a batch operation.
-     * @return A Future that will resolve to an error code indicating the result of the operation.
+     * @return A Future that will resolve to an error code indicating the result of the operation. With
+     * data_csum_enabled, it is std::errc::bad_message if the data read doesn't match the csum of what was written.
      */
     folly::Future< std::error_code > async_read(MultiBlkId const& bid, uint8_t* buf, uint32_t size,
                                                 bool part_of_batch = false);
@@ -137,6 +180,33 @@ public:
     folly::Future< std::error_code > async_read(MultiBlkId const& bid, sisl::sg_list& sgs, uint32_t size,
                                                 bool part_of_batch = false);
 
+    /**
+     * @brief Asynchronously reads several block IDs, each into its own scatter-gather list, as one batch. Pieces of
+     * all the block IDs which are physically adjacent on the device are coalesced into a single IO.
+     *
+     * @param reqs List of block ID and the scatter-gather list to read it into. Size of the read is the size of the
+     * scatter-gather list.
+     * @param part_of_batch Whether this read is part of a batch.
+     *
+     * @return A `folly::Future` that will contain the first error of any of the reads, once all of them complete.
+     */
+    folly::Future< std::error_code > async_read(std::vector< std::pair< MultiBlkId, sisl::sg_list > > const& reqs,
+                                                bool part_of_batch = false);
+
+    /**
+     * @brief Submit the reads and writes which were queued with part_of_batch = true.
+     */
+    void submit_io_batch();
+
+    /**
+     * @brief Open a writer to write a large object piece by piece, as its data arrives (see BlkDataStreamWriter).
+     *
+     * @param hints Hints to allocate the blks of every piece.
+     * @param max_inflight Max pieces written concurrently, 0 means data_stream_max_inflight_writes.
+     * @return The writer, which closes (with BlkDataStreamWriter::close) to get the blkids of the object.
+     */
+    shared< BlkDataStreamWriter > open_stream_writer(blk_alloc_hints const& hints, uint32_t max_inflight = 0);
+
     /**
      * @brief Commits the block with the given MultiBlkId.
      *
@@ -144,6 +214,56 @@ public:
      */
     BlkAllocStatus commit_blk(MultiBlkId const& bid);
 
+    /**
+     * @brief Marks the blocks allocated and committed, when their data is copied as is from another replica, instead
+     * of being allocated with alloc_blks. Blocks already allocated are left as is, either all others are reserved or
+     * none of them.
+     *
+     * @param bid The BlkId of the blocks to reserve.
+     * @param out_reserved Appended with the blocks reserved by this call, to release with unreserve_blk if the copy
+     * fails.
+     */
+    BlkAllocStatus reserve_blk(BlkId const& bid, std::vector< BlkId >& out_reserved);
+
+    /**
+     * @brief Releases the blocks reserved by reserve_blk right away.
+     */
+    void unreserve_blk(BlkId const& bid);
+
+    /**
+     * @brief Checks if the block is allocated (committed or not).
+     */
+    bool is_blk_alloced(BlkId const& bid) const;
+
+    /**
+     * @brief Number of blocks of the given chunk of this data service.
+     */
+    blk_num_t num_blks_of_chunk(chunk_num_t chunk_num) const;
+
+    /**
+     * @brief Estimate of the tail latency of recent reads of the drive the block is on, in micro seconds.
+     */
+    uint64_t read_tail_latency_us(BlkId const& bid) const;
+
+    /**
+     * @brief Set the share of the device ios of the tenant (like a replication group, see ReplDev::io_tenant),
+     * relative to the other tenants, once the data vdev is contended (see fair_share_max_inflight_ios).
+     *
+     * @param tenant The tenant, as tagged with io_tenant_guard by the threads submitting its ios.
+     * @param weight Relative weight of the tenant, 0 resets it to fair_share_default_weight.
+     */
+    void set_io_tenant_weight(io_tenant_t tenant, uint32_t weight);
+
+    /**
+     * @brief Drop the accounting and the weight of the tenant, once it is gone.
+     */
+    void remove_io_tenant(io_tenant_t tenant);
+
+    /**
+     * @brief Ios and bytes read and written so far by each tenant, and the ios it had queued for its fair share.
+     */
+    nlohmann::json io_tenant_usage() const;
+
     /**
      * @brief Allocates a contiguous block of disk space of the given size.
      *
@@ -157,7 +277,7 @@ public:
     /**
      * @brief Asynchronously frees the specified block IDs.
      * It is asynchronous because it might need to wait for pending read to complete if same block is being read and not
-     * completed yet;
+     * completed yet; With data_epoch_based_free, it instead waits for all the reads issued before it to complete.
      *
      * @param bid The block IDs to free.
      * @return A Future that will resolve to an error code indicating the result of the operation.
@@ -198,6 +318,46 @@ public:
 
     uint64_t get_used_capacity() const;
 
+    /**
+     * @brief Is the data service configured with a fast tier, in addition to the capacity tier
+     */
+    bool has_fast_tier() const { return (m_fast_vdev != nullptr); }
+
+    /**
+     * @brief Does the given blkid reside on the fast tier
+     */
+    bool is_in_fast_tier(MultiBlkId const& bid) const;
+
+    /**
+     * @brief Copy the data of the blkids on the fast tier to newly allocated blks on the capacity tier.
+     *
+     * The data service doesn't own the mapping of the consumer's data to blkids, so the caller is expected to
+     * update its index to point to out_blkids (and persist it) and then call async_free_blk on the source blkids.
+     * Until then, both copies are valid and reads on the source blkids continue to be served from fast tier.
+     *
+     * @param src_bid The blkids on the fast tier to migrate.
+     * @param out_blkids The blkids allocated on the capacity tier. They are freed by this method on failure.
+     * @return A Future that will resolve to an error code indicating the result of the migration.
+     */
+    folly::Future< std::error_code > async_migrate_to_capacity_tier(MultiBlkId const& src_bid, MultiBlkId& out_blkids);
+
+    /**
+     * @brief Start background gc of the chunks of the data vdev, which is expected to be with append blk allocator.
+     *
+     * Chunks whose freeable blks cross data_gc_min_freeable_pct are compacted by copying their live blks (as reported
+     * by live_blks_cb) into another chunk and the chunk is reset once relocate_cb accepts the new blkids. Both the
+     * callbacks are called from the gc thread.
+     *
+     * @param live_blks_cb Callback to get the live blkids of a chunk.
+     * @param relocate_cb Callback to switch consumer over to the relocated blkids.
+     */
+    void start_append_gc(gc_live_blks_cb_t live_blks_cb, gc_relocate_cb_t relocate_cb);
+
+    /**
+     * @brief Stop the background gc, waiting for the chunk being compacted (if any) to complete or abort.
+     */
+    void stop_append_gc();
+
 private:
     /**
      * @brief Initializes the block data service.
@@ -217,10 +377,44 @@ private:
      */
     static void process_data_completion(std::error_condition ec, void* cookie);
 
+    VirtualDev* vdev_of(BlkId const& bid) const;
+    bool should_place_on_fast_tier(blk_alloc_hints const& hints) const;
+    void release_deferred_frees(std::vector< pending_free_t >&& frees);
+    folly::Future< std::error_code > wait_for_reads(std::vector< MultiBlkId > const& bids); // Reads in flight on bids
+    bool has_compressed_blks(BlkId const& bid) const; // Of the chunk of bid, see compressed_blk_hdr
+    void set_has_compressed_blks(BlkId const& bid);
+    bool read_from_cache(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size);
+    uint64_t write_stamp_now() const; // To be taken before a read is issued, see on_read_completion
+    std::error_code on_read_completion(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size,
+                                       uint64_t write_stamp, std::error_code ec);
+    void on_blks_written(MultiBlkId const& blkid); // On both submit and completion of a write
+    folly::Future< std::error_code > async_read_compressed(MultiBlkId const& blkid, sisl::sg_iovs_t iovs, uint32_t size,
+                                                           bool part_of_batch);
+    folly::Future< std::error_code > decompress_if_needed(folly::Future< std::error_code >&& f,
+                                                          MultiBlkId const& blkid, sisl::sg_iovs_t iovs, uint32_t size);
+    // Read of the blks as they are on the device, compressed or not
+    folly::Future< std::error_code > read_as_is(MultiBlkId const& blkid, uint8_t* buf, uint32_t size,
+                                                bool part_of_batch);
+    folly::Future< std::error_code > read_as_is(MultiBlkId const& blkid, sisl::sg_list const& sgs, uint32_t size,
+                                                bool part_of_batch);
+    folly::Future< std::error_code > write_to_vdev(const char* buf, uint32_t size, MultiBlkId const& blkid,
+                                                   bool part_of_batch);
+    folly::Future< std::error_code > on_write_submitted(folly::Future< std::error_code >&& f, MultiBlkId const& blkid,
+                                                        sisl::sg_iovs_t iovs, Clock::time_point start_time);
+    BlkDataSvcMetrics& metrics_of(BlkId const& bid) const;
+
 private:
     std::shared_ptr< VirtualDev > m_vdev;
+    std::shared_ptr< VirtualDev > m_fast_vdev; // Optional fast tier, new writes land here first
     std::unique_ptr< BlkReadTracker > m_blk_read_tracker;
+    std::unique_ptr< BlkFreeEpoch > m_free_epoch; // Only with data_epoch_based_free, in place of read tracking
+    std::unique_ptr< BlkCsumTable > m_csum_table; // Only with data_csum_enabled
+    std::unique_ptr< BlkReadCache > m_read_cache; // Only with data_read_cache_enabled
+    std::unique_ptr< BlkWriteStamps > m_write_stamps; // Only with either of csum or read cache
     std::shared_ptr< ChunkSelector > m_custom_chunk_selector;
+    std::unique_ptr< AppendChunkGC > m_append_gc;
+    std::unique_ptr< BlkDataSvcMetrics > m_metrics;      // Metrics of writes landing on the capacity tier
+    std::unique_ptr< BlkDataSvcMetrics > m_fast_metrics; // Metrics of writes landing on the fast tier
     uint32_t m_blk_size;
 };
 
@@ -0,0 +1,97 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <system_error>
+#include <vector>
+
+#include <folly/futures/Future.h>
+#include <sisl/fds/buffer.hpp>
+
+#include <homestore/homestore_decl.hpp>
+#include <homestore/blk.h>
+
+namespace homestore {
+/**
+ * @brief Writes a large object into the data service piece by piece, as its data arrives, instead of allocating blks
+ * for and holding the whole object in memory at once. Obtained through BlkDataService::open_stream_writer.
+ *
+ * Blks of each piece are allocated only when it is written and at most max_inflight pieces are being written at any
+ * time. Pieces appended beyond that wait in order for a slot, so a caller who recycles its buffers as the append
+ * futures complete ingests the object with a constant memory of max_inflight buffers.
+ *
+ * Pieces are independent writes, blkids of each piece (in the order appended) are returned by close and each of them
+ * is to be read back with the size of its piece. Writer is expected to be used from one thread at a time.
+ */
+class BlkDataStreamWriter : public std::enable_shared_from_this< BlkDataStreamWriter > {
+public:
+    BlkDataStreamWriter(blk_alloc_hints const& hints, uint32_t max_inflight);
+    BlkDataStreamWriter(const BlkDataStreamWriter&) = delete;
+    BlkDataStreamWriter(BlkDataStreamWriter&&) noexcept = delete;
+    BlkDataStreamWriter& operator=(const BlkDataStreamWriter&) = delete;
+    BlkDataStreamWriter& operator=(BlkDataStreamWriter&&) noexcept = delete;
+    ~BlkDataStreamWriter() = default;
+
+    /**
+     * @brief Write the next piece of the object.
+     *
+     * @param sgs Data of the piece. Buffers are to be kept intact until the returned future completes.
+     * @return A Future that completes once the piece is written and its buffers can be reused. Once any piece fails,
+     * all further appends fail with the same error.
+     */
+    folly::Future< std::error_code > append(sisl::sg_list const& sgs);
+
+    /**
+     * @brief Wait for all the appended pieces to be written. No appends are accepted after close.
+     *
+     * @param out_blkids Blkids of the pieces in the order they were appended, filled upon success. It needs to be
+     * valid until the returned future completes.
+     * @return A Future with the first error of any piece. On error, blks of all the pieces written are freed.
+     */
+    folly::Future< std::error_code > close(std::vector< MultiBlkId >& out_blkids);
+
+    /// @brief Total bytes appended so far
+    uint64_t appended_size() const { return m_appended_size; }
+
+private:
+    struct piece {
+        sisl::sg_list sgs;
+        size_t idx;
+        folly::Promise< std::error_code > promise;
+    };
+
+    void issue(piece&& p);
+    void on_piece_written(size_t idx, MultiBlkId const& bid, std::error_code ec,
+                          folly::Promise< std::error_code >&& promise);
+    void complete_close();
+
+private:
+    blk_alloc_hints const m_hints;
+    uint32_t const m_max_inflight;
+    std::mutex m_mtx;
+    uint32_t m_inflight{0};
+    std::deque< piece > m_waiting;        // Appended pieces waiting for an inflight slot
+    std::vector< MultiBlkId > m_blkids;   // Blkids of all the pieces, invalid until the piece is written
+    std::error_code m_error;              // First error of any piece
+    uint64_t m_appended_size{0};
+    bool m_closed{false};
+    folly::Promise< std::error_code > m_close_promise;
+    std::vector< MultiBlkId >* m_close_out{nullptr};
+};
+} // namespace homestore
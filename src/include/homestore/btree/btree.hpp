@@ -26,6 +26,10 @@
 #include "btree_kv.hpp"
 #include <homestore/btree/detail/btree_internal.hpp>
 #include <homestore/btree/detail/btree_node.hpp>
+#include <homestore/btree/detail/btree_node_reclaimer.hpp>
+#include <homestore/btree/detail/btree_root_lock.hpp>
+#include <homestore/btree/detail/btree_leaf_filter.hpp>
+#include <homestore/tracer.hpp>
 
 SISL_LOGGING_DECL(btree)
 
@@ -68,7 +72,7 @@ struct BTREE_FLIPS {
 template < typename K, typename V >
 class Btree {
 protected:
-    mutable iomgr::FiberManagerLib::shared_mutex m_btree_lock;
+    mutable BtreeRootLock m_btree_lock; // Guards the root, readers of a thread touch only the slot of the thread
     BtreeLinkInfo m_root_node_info;
 
     BtreeMetrics m_metrics;
@@ -78,6 +82,10 @@ protected:
 #ifndef NDEBUG
     std::atomic< uint64_t > m_req_id{0};
 #endif
+
+    // Nodes freed while optimistic readers could be reading them, so that what they read stays valid memory
+    mutable BtreeNodeReclaimer m_reclaimer;
+    mutable BtreeLeafFilters m_leaf_filters; // Used only if enabled in config
 #ifdef _PRERELEASE
     BTREE_FLIPS m_flips;
 #endif
@@ -110,6 +118,12 @@ public:
 
     btree_status_t query(BtreeQueryRequest< K >& query_req, std::vector< std::pair< K, V > >& out_values) const;
 
+    // Visits the entries in the range of the request in order, upto its batch size, without copying them out. Key and
+    // value passed to the callback are views into the leaf, which is locked only for the duration of the visit of its
+    // entries. Request is left to resume after the last entry visited, returns has_more if the visit stopped before
+    // the end of the range (batch size is reached or the callback returned false).
+    btree_status_t query(BtreeQueryRequest< K >& query_req, query_visit_cb_t const& visit_cb) const;
+
     // bool verify_tree(bool update_debug_bm) const;
     virtual std::pair< btree_status_t, uint64_t > destroy_btree(void* context);
     nlohmann::json get_status(int log_level) const;
@@ -141,6 +155,14 @@ protected:
     virtual BtreeNodePtr alloc_node(bool is_leaf) = 0;
     virtual BtreeNode* init_node(uint8_t* node_buf, bnodeid_t id, bool init_buf, bool is_leaf) const;
     virtual btree_status_t read_node_impl(bnodeid_t id, BtreeNodePtr& node) const = 0;
+    // Read the child at child_idx of the parent, store can override this to keep direct pointers to children
+    virtual btree_status_t read_child_node_impl(const BtreeNodePtr& /* parent */, uint32_t /* child_idx */,
+                                                bnodeid_t id, BtreeNodePtr& node) const {
+        return read_node_impl(id, node);
+    }
+    // Hint that the children of parent from start_idx to end_idx (edge if total_entries) are going to be read shortly
+    virtual void read_ahead_children(const BtreeNodePtr& /* parent */, uint32_t /* start_idx */,
+                                     uint32_t /* end_idx */) const {}
     virtual btree_status_t write_node_impl(const BtreeNodePtr& node, void* context) = 0;
     virtual btree_status_t refresh_node(const BtreeNodePtr& node, bool for_read_modify_write, void* context) const = 0;
     virtual void free_node_impl(const BtreeNodePtr& node, void* context) = 0;
@@ -149,6 +171,12 @@ protected:
                                           void* context) = 0;
     virtual btree_status_t on_root_changed(BtreeNodePtr const& root, void* context) = 0;
     virtual std::string btree_store_type() const = 0;
+    // Whether a node the store returned could be read without its lock, which requires that the buffer of the node is
+    // never swapped underneath nor released before free_node_impl. Nodes are then freed to the store some time after
+    // the btree frees them, without the context of the op which freed them
+    virtual bool supports_optimistic_reads() const { return false; }
+    // Hint that the node is about to be read, so that the store could get it into the cpu cache ahead of it
+    virtual void prefetch_node(bnodeid_t) const {}
 
     /////////////////////////// Methods the application use case is expected to handle ///////////////////////////
 
@@ -161,9 +189,15 @@ protected:
     void read_node_or_fail(bnodeid_t id, BtreeNodePtr& node) const;
     btree_status_t write_node(const BtreeNodePtr& node, void* context);
     void free_node(const BtreeNodePtr& node, locktype_t cur_lock, void* context);
+    bool is_optimistic_read_enabled() const;
+    void build_leaf_filter(const BtreeNodePtr& leaf) const;
+    void drop_leaf_filter(const BtreeNodePtr& node) const;
     BtreeNodePtr alloc_leaf_node();
     BtreeNodePtr alloc_interior_node();
 
+    btree_status_t read_and_lock_child(const BtreeNodePtr& parent, uint32_t index, bnodeid_t id,
+                                       BtreeNodePtr& child_node, locktype_t int_lock_type, locktype_t leaf_lock_type,
+                                       void* context) const;
     btree_status_t get_child_and_lock_node(const BtreeNodePtr& node, uint32_t index, BtreeLinkInfo& child_info,
                                            BtreeNodePtr& child_node, locktype_t int_lock_type,
                                            locktype_t leaf_lock_type, void* context) const;
@@ -230,6 +264,9 @@ protected:
 
     btree_status_t merge_nodes(const BtreeNodePtr& parent_node, const BtreeNodePtr& leftmost_node, uint32_t start_indx,
                                uint32_t end_indx, void* context);
+    btree_status_t detach_covered_children(const BtreeNodePtr& node, locktype_t& cur_lock, uint32_t start_idx,
+                                           uint32_t end_idx, std::vector< bnodeid_t >& detached_ids, void* context);
+    void free_subtree(bnodeid_t id, void* context);
     bool remove_extents_in_leaf(const BtreeNodePtr& node, BtreeRangeRemoveRequest< K >& rrreq);
 
     ///////// Query Impl Methods
@@ -237,6 +274,8 @@ protected:
                                   std::vector< std::pair< K, V > >& out_values) const;
     btree_status_t do_traversal_query(const BtreeNodePtr& my_node, BtreeQueryRequest< K >& qreq,
                                       std::vector< std::pair< K, V > >& out_values) const;
+    btree_status_t do_sweep_visit(BtreeNodePtr& my_node, BtreeQueryRequest< K >& qreq,
+                                  query_visit_cb_t const& visit_cb) const;
 #ifdef SERIALIZABLE_QUERY_IMPLEMENTATION
     btree_status_t do_serialzable_query(const BtreeNodePtr& my_node, BtreeSerializableQueryRequest& qreq,
                                         std::vector< std::pair< K, V > >& out_values);
@@ -248,5 +287,14 @@ protected:
     ///////// Get Impl Methods
     template < typename ReqT >
     btree_status_t do_get(const BtreeNodePtr& my_node, ReqT& greq) const;
+
+    btree_status_t do_batch_get(const BtreeNodePtr& my_node, BtreeBatchGetRequest< K >& greq,
+                                const K* upto_key) const;
+
+    template < typename ReqT >
+    btree_status_t do_optimistic_get(ReqT& greq) const;
+
+    template < typename ReqT >
+    btree_status_t optimistic_get_attempt(ReqT& greq) const;
 };
 } // namespace homestore
@@ -37,7 +37,10 @@
 namespace homestore {
 template < typename K, typename V >
 Btree< K, V >::Btree(const BtreeConfig& cfg) :
-        m_metrics{cfg.name().c_str()}, m_node_size{cfg.node_size()}, m_bt_cfg{cfg} {
+        m_metrics{cfg.name().c_str()},
+        m_node_size{cfg.node_size()},
+        m_reclaimer{[this](BtreeNodePtr const& node) { free_node_impl(node, nullptr); }},
+        m_bt_cfg{cfg} {
     m_bt_cfg.set_node_data_size(cfg.node_size() - sizeof(persistent_hdr_t));
 }
 
@@ -61,6 +64,7 @@ std::pair< btree_status_t, uint64_t > Btree< K, V >::destroy_btree(void* context
     }
     ret = do_destroy(n_freed_nodes, context);
     if (ret == btree_status_t::success) {
+        m_reclaimer.reclaim_all(); // No one could be reading the btree being destroyed
         BT_LOG(DEBUG, "btree(root: {}) {} nodes destroyed successfully", m_root_node_info.bnode_id(), n_freed_nodes);
     } else {
         m_destroyed = false;
@@ -73,8 +77,13 @@ std::pair< btree_status_t, uint64_t > Btree< K, V >::destroy_btree(void* context
 template < typename K, typename V >
 template < typename ReqT >
 btree_status_t Btree< K, V >::put(ReqT& put_req) {
-    static_assert(std::is_same_v< ReqT, BtreeSinglePutRequest > || std::is_same_v< ReqT, BtreeRangePutRequest< K > >,
+    static_assert(std::is_same_v< ReqT, BtreeSinglePutRequest > || std::is_same_v< ReqT, BtreeRangePutRequest< K > > ||
+                      std::is_same_v< ReqT, BtreeBatchPutRequest< K > >,
                   "put api is called with non put request type");
+    if constexpr (std::is_same_v< ReqT, BtreeBatchPutRequest< K > >) {
+        if (put_req.is_done()) { return btree_status_t::success; }
+    }
+    TraceSpan trace_span{"btree_put"};
     COUNTER_INCREMENT(m_metrics, btree_write_ops_count, 1);
     auto acq_lock = locktype_t::READ;
     bool is_leaf = false;
@@ -86,8 +95,10 @@ retry:
 #ifndef NDEBUG
     check_lock_debug();
 #endif
-    BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
-    BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+    if constexpr (btree_track_node_locks) {
+        BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
+        BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+    }
 
     BtreeNodePtr root;
     ret = read_and_lock_node(m_root_node_info.bnode_id(), root, acq_lock, acq_lock, put_req.m_op_context);
@@ -99,8 +110,10 @@ retry:
         unlock_node(root, acq_lock);
         m_btree_lock.unlock_shared();
         ret = check_split_root(put_req);
-        BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
-        BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+        if constexpr (btree_track_node_locks) {
+            BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
+            BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+        }
 
         // We must have gotten a new root, need to start from scratch.
         m_btree_lock.lock_shared();
@@ -116,13 +129,17 @@ retry:
         acq_lock = locktype_t::WRITE;
         goto retry;
     } else {
+        if constexpr (std::is_same_v< ReqT, BtreeBatchPutRequest< K > >) { put_req.reset_leaf_end(); }
         ret = do_put(root, acq_lock, put_req);
         if ((ret == btree_status_t::retry) || (ret == btree_status_t::has_more)) {
-            // Need to start from top down again, since there was a split or we have more to insert in case of range put
+            // Need to start from top down again, since there was a split or we have more to insert in case of range
+            // or batch put
             acq_lock = locktype_t::READ;
             BT_LOG(TRACE, "retrying put operation");
-            BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
-            BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+            if constexpr (btree_track_node_locks) {
+                BT_LOG_ASSERT_EQ(bt_thread_vars()->rd_locked_nodes.size(), 0);
+                BT_LOG_ASSERT_EQ(bt_thread_vars()->wr_locked_nodes.size(), 0);
+            }
             goto retry;
         }
     }
@@ -143,18 +160,33 @@ out:
 template < typename K, typename V >
 template < typename ReqT >
 btree_status_t Btree< K, V >::get(ReqT& greq) const {
-    static_assert(std::is_same_v< BtreeSingleGetRequest, ReqT > || std::is_same_v< BtreeGetAnyRequest< K >, ReqT >,
+    static_assert(std::is_same_v< BtreeSingleGetRequest, ReqT > || std::is_same_v< BtreeGetAnyRequest< K >, ReqT > ||
+                      std::is_same_v< BtreeBatchGetRequest< K >, ReqT >,
                   "get api is called with non get request type");
 
+    TraceSpan trace_span{"btree_get"};
     btree_status_t ret = btree_status_t::success;
 
     m_btree_lock.lock_shared();
     BtreeNodePtr root;
 
+    if constexpr (std::is_same_v< BtreeBatchGetRequest< K >, ReqT >) {
+        if (greq.is_done()) { goto out; }
+    } else {
+        if (is_optimistic_read_enabled()) {
+            ret = do_optimistic_get(greq);
+            goto out;
+        }
+    }
+
     ret = read_and_lock_node(m_root_node_info.bnode_id(), root, locktype_t::READ, locktype_t::READ, greq.m_op_context);
     if (ret != btree_status_t::success) { goto out; }
 
-    ret = do_get(root, greq);
+    if constexpr (std::is_same_v< BtreeBatchGetRequest< K >, ReqT >) {
+        ret = do_batch_get(root, greq, nullptr /* upto_key */); // Keys not found are tracked in the request
+    } else {
+        ret = do_get(root, greq);
+    }
 out:
     m_btree_lock.unlock_shared();
 
@@ -169,9 +201,14 @@ template < typename ReqT >
 btree_status_t Btree< K, V >::remove(ReqT& req) {
     static_assert(std::is_same_v< ReqT, BtreeSingleRemoveRequest > ||
                       std::is_same_v< ReqT, BtreeRangeRemoveRequest< K > > ||
-                      std::is_same_v< ReqT, BtreeRemoveAnyRequest< K > >,
+                      std::is_same_v< ReqT, BtreeRemoveAnyRequest< K > > ||
+                      std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >,
                   "remove api is called with non remove request type");
+    if constexpr (std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >) {
+        if (req.is_done()) { return btree_status_t::success; }
+    }
 
+    TraceSpan trace_span{"btree_remove"};
     locktype_t acq_lock = locktype_t::READ;
     m_btree_lock.lock_shared();
 
@@ -209,12 +246,21 @@ retry:
         acq_lock = locktype_t::WRITE;
         goto retry;
     } else {
+        if constexpr (std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >) { req.reset_leaf_end(); }
         ret = do_remove(root, acq_lock, req);
         if (ret == btree_status_t::retry) {
             // Need to start from top down again, since there was a merge nodes in-between
             acq_lock = locktype_t::READ;
             goto retry;
         }
+        if constexpr (std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >) {
+            // Keys not found are tracked in the request, walk down again for the keys of the next leaves
+            if (ret == btree_status_t::not_found) { ret = btree_status_t::success; }
+            if ((ret == btree_status_t::success) && !req.is_done()) {
+                acq_lock = locktype_t::READ;
+                goto retry;
+            }
+        }
     }
     m_btree_lock.unlock_shared();
 
@@ -275,6 +321,29 @@ out:
     return ret;
 }
 
+template < typename K, typename V >
+btree_status_t Btree< K, V >::query(BtreeQueryRequest< K >& qreq, query_visit_cb_t const& visit_cb) const {
+    COUNTER_INCREMENT(m_metrics, btree_query_ops_count, 1);
+
+    btree_status_t ret = btree_status_t::success;
+    if (qreq.batch_size() == 0) { return ret; }
+
+    m_btree_lock.lock_shared();
+    BtreeNodePtr root = nullptr;
+    ret = read_and_lock_node(m_root_node_info.bnode_id(), root, locktype_t::READ, locktype_t::READ, qreq.m_op_context);
+    if (ret == btree_status_t::success) { ret = do_sweep_visit(root, qreq, visit_cb); }
+
+    m_btree_lock.unlock_shared();
+#ifndef NDEBUG
+    check_lock_debug();
+#endif
+    if ((ret != btree_status_t::success) && (ret != btree_status_t::has_more)) {
+        BT_LOG(ERROR, "btree query failed {}", ret);
+        COUNTER_INCREMENT(m_metrics, query_err_cnt, 1);
+    }
+    return ret;
+}
+
 #if 0
 /**
  * @brief : verify btree is consistent and no corruption;
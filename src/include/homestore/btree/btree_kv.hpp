@@ -15,6 +15,7 @@
  *********************************************************************************/
 #pragma once
 
+#include <concepts>
 #include <string>
 #include <vector>
 #include <fmt/format.h>
@@ -57,6 +58,15 @@ public:
     virtual bool is_interval_key() const { return false; }
 };
 
+// A key could optionally provide normalized_prefix of its serialized form, an integer which orders the keys like
+// compare does, except that different keys could have the same prefix (prefix(a) < prefix(b) only if a < b). Variable
+// size nodes keep it in the record of each key, so that a search compares the keys on their records, the keys
+// themselves only if their prefixes are same.
+template < typename K >
+concept KeyWithPrefix = requires(sisl::blob const& b) {
+    { K::normalized_prefix(b) } -> std::same_as< uint32_t >;
+};
+
 // An extension of BtreeKey where each key is part of an interval range. Keys are not neccessarily only needs to be
 // integers, but it needs to be able to get next or prev key from a given key in the key range
 class BtreeIntervalKey : public BtreeKey {
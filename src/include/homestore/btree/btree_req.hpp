@@ -14,6 +14,9 @@
  *
  *********************************************************************************/
 #pragma once
+#include <algorithm>
+#include <numeric>
+
 #include <sisl/fds/buffer.hpp>
 #include <homestore/btree/btree_kv.hpp>
 
@@ -144,6 +147,9 @@ template < typename K >
 struct BtreeRangeRemoveRequest : public BtreeRangeRequest< K > {
 public:
     remove_filter_cb_t m_filter_cb;
+    // Children of an interior node, which are wholly within the range, are detached and their subtrees freed,
+    // without removing their keys one leaf at a time. Not applicable with a filter
+    bool m_free_subtrees{false};
 
 public:
     BtreeRangeRemoveRequest(BtreeKeyRange< K >&& inp_range, void* app_context = nullptr,
@@ -198,6 +204,7 @@ ENUM(BtreeQueryType, uint8_t,
      SERIALIZABLE_QUERY)
 
 using get_filter_cb_t = std::function< bool(BtreeKey const&, BtreeValue const&) >;
+using query_visit_cb_t = std::function< bool(BtreeKey const&, BtreeValue const&) >; // false to stop the visit
 
 template < typename K >
 struct BtreeQueryRequest : public BtreeRangeRequest< K > {
@@ -221,6 +228,120 @@ protected:
     get_filter_cb_t m_filter_cb;
 };
 
+/////////////////////////// 5 Batch Operations /////////////////////////////////////
+// Base class for operations on a sorted list of keys. Keys are applied a leaf at a time, all the keys landing in a leaf
+// under one lock of it, before walking down again for the rest of them.
+template < typename K >
+struct BtreeBatchRequest : public BtreeRequest {
+public:
+    const BtreeKey& key() const { return *m_keys[m_cur]; }
+    bool is_done() const { return (m_cur == m_keys.size()); }
+    size_t num_keys() const { return m_keys.size(); }
+
+    // Keys which could not be applied (put failed as per put type or filter, remove did not find the key)
+    bool is_failed(size_t idx) const { return m_failed[idx]; }
+    uint32_t num_failed() const { return m_num_failed; }
+
+    void next(bool applied) {
+        if (!applied) {
+            m_failed[m_cur] = true;
+            ++m_num_failed;
+        }
+        ++m_cur;
+    }
+
+    // Last key (inclusive) of the leaf being walked down to, unbounded if it is reached through the edges only
+    void reset_leaf_end() { m_has_leaf_end = false; }
+    void set_leaf_end(K&& end_key) {
+        m_leaf_end = std::move(end_key);
+        m_has_leaf_end = true;
+    }
+    bool in_leaf_range() const { return !m_has_leaf_end || (key().compare(m_leaf_end) <= 0); }
+
+protected:
+    BtreeBatchRequest(std::vector< const BtreeKey* >&& keys, void* app_context) :
+            BtreeRequest{app_context, nullptr}, m_keys{std::move(keys)}, m_failed(m_keys.size(), false) {}
+
+    std::vector< const BtreeKey* > m_keys;
+    size_t m_cur{0}; // Next key to be applied
+
+private:
+    std::vector< bool > m_failed;
+    uint32_t m_num_failed{0};
+    K m_leaf_end;
+    bool m_has_leaf_end{false};
+};
+
+template < typename K >
+struct BtreeBatchPutRequest : public BtreeBatchRequest< K > {
+public:
+    BtreeBatchPutRequest(std::vector< const BtreeKey* >&& keys, std::vector< const BtreeValue* >&& values,
+                         btree_put_type put_type, void* app_context = nullptr, put_filter_cb_t filter_cb = nullptr) :
+            BtreeBatchRequest< K >(std::move(keys), app_context),
+            m_values{std::move(values)},
+            m_put_type{put_type},
+            m_filter_cb{std::move(filter_cb)} {
+        DEBUG_ASSERT_EQ(this->m_keys.size(), m_values.size(), "Batch put needs a value for every key");
+    }
+
+    const BtreeValue& value() const { return *m_values[this->m_cur]; }
+
+    std::vector< const BtreeValue* > m_values;
+    const btree_put_type m_put_type;
+    put_filter_cb_t m_filter_cb;
+};
+
+template < typename K >
+struct BtreeBatchRemoveRequest : public BtreeBatchRequest< K > {
+public:
+    BtreeBatchRemoveRequest(std::vector< const BtreeKey* >&& keys, void* app_context = nullptr) :
+            BtreeBatchRequest< K >(std::move(keys), app_context) {}
+};
+
+// Looks up the keys, in any order, into the values given for each of them. Keys are sorted by the request, so that the
+// lookups share the walk down as far as their paths are common.
+template < typename K >
+struct BtreeBatchGetRequest : public BtreeBatchRequest< K > {
+public:
+    BtreeBatchGetRequest(std::vector< const BtreeKey* >&& keys, std::vector< BtreeValue* >&& out_values,
+                         void* app_context = nullptr) :
+            BtreeBatchRequest< K >(std::move(keys), app_context),
+            m_outvals{std::move(out_values)},
+            m_sorted_pos(this->m_keys.size()) {
+        DEBUG_ASSERT_EQ(this->m_keys.size(), m_outvals.size(), "Batch get needs a value for every key");
+        std::vector< uint32_t > order(this->m_keys.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::sort(order.begin(), order.end(),
+                  [this](uint32_t a, uint32_t b) { return this->m_keys[a]->compare(*this->m_keys[b]) < 0; });
+
+        std::vector< const BtreeKey* > keys_sorted(order.size());
+        std::vector< BtreeValue* > outvals_sorted(order.size());
+        for (uint32_t pos{0}; pos < order.size(); ++pos) {
+            keys_sorted[pos] = this->m_keys[order[pos]];
+            outvals_sorted[pos] = m_outvals[order[pos]];
+            m_sorted_pos[order[pos]] = pos;
+        }
+        this->m_keys.swap(keys_sorted);
+        m_outvals.swap(outvals_sorted);
+    }
+
+    BtreeValue* value() const { return m_outvals[this->m_cur]; }
+
+    // Whether the idx'th key, in the order given by the caller, is found
+    bool is_found(size_t idx) const { return !this->is_failed(m_sorted_pos[idx]); }
+
+    // First of the keys yet to be looked up which is after the given key, nullptr if there is none
+    const BtreeKey* first_key_after(const BtreeKey& key) const {
+        auto const it = std::partition_point(this->m_keys.begin() + this->m_cur, this->m_keys.end(),
+                                             [&key](const BtreeKey* k) { return k->compare(key) <= 0; });
+        return (it == this->m_keys.end()) ? nullptr : *it;
+    }
+
+private:
+    std::vector< BtreeValue* > m_outvals;
+    std::vector< uint32_t > m_sorted_pos; // Position of the caller's idx'th key in the sorted keys
+};
+
 /* This class is a top level class to keep track of the locks that are held currently. It is
  * used for serializabke query to unlock all nodes in right order at the end of the lock */
 class BtreeLockTracker {
@@ -30,6 +30,7 @@ btree_status_t Btree< K, V >::do_get(const BtreeNodePtr& my_node, ReqT& greq) co
                 to_variant_node(my_node)->get_any(greq.m_range, greq.m_outkey, greq.m_outval, true, true);
         } else if constexpr (std::is_same_v< BtreeSingleGetRequest, ReqT >) {
             std::tie(found, idx) = my_node->find(greq.key(), greq.m_outval, true);
+            if (!found && m_bt_cfg.m_leaf_filters) { build_leaf_filter(my_node); }
         }
         if (!found) {
             ret = btree_status_t::not_found;
@@ -50,8 +51,19 @@ btree_status_t Btree< K, V >::do_get(const BtreeNodePtr& my_node, ReqT& greq) co
     if (greq.route_tracing) { append_route_trace(greq, my_node, btree_event_t::READ, idx, idx); }
 
     ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
+    if constexpr (std::is_same_v< BtreeSingleGetRequest, ReqT >) {
+        // Child can't be split or freed while this node is locked, so its filter can't be missing keys moved into it
+        if (m_bt_cfg.m_leaf_filters && (my_node->level() == 1) &&
+            !m_leaf_filters.may_contain(child_info.bnode_id(), greq.key())) {
+            COUNTER_INCREMENT(m_metrics, btree_leaf_filter_negatives, 1);
+            unlock_node(my_node, locktype_t::READ);
+            return btree_status_t::not_found;
+        }
+    }
+
     BtreeNodePtr child_node;
-    ret = read_and_lock_node(child_info.bnode_id(), child_node, locktype_t::READ, locktype_t::READ, greq.m_op_context);
+    ret = read_and_lock_child(my_node, idx, child_info.bnode_id(), child_node, locktype_t::READ, locktype_t::READ,
+                              greq.m_op_context);
     if (ret != btree_status_t::success) { goto out; }
 
     unlock_node(my_node, locktype_t::READ);
@@ -61,4 +73,130 @@ out:
     unlock_node(my_node, locktype_t::READ);
     return ret;
 }
+
+// Looks up the keys of the batch, from the one it is at upto (inclusive) the given key, all of which are within the
+// subtree of the node. Each child is walked down once for all of its keys, while keeping the node locked, and the child
+// for the keys after is prefetched before walking down.
+template < typename K, typename V >
+btree_status_t Btree< K, V >::do_batch_get(const BtreeNodePtr& my_node, BtreeBatchGetRequest< K >& greq,
+                                           const K* upto_key) const {
+    auto const in_range = [&greq, upto_key]() {
+        return !greq.is_done() && ((upto_key == nullptr) || (greq.key().compare(*upto_key) <= 0));
+    };
+
+    if (my_node->is_leaf()) {
+        while (in_range()) {
+            auto const [found, idx] = my_node->find(greq.key(), greq.value(), true);
+            if (found && greq.route_tracing) { append_route_trace(greq, my_node, btree_event_t::READ, idx, idx); }
+            greq.next(found);
+        }
+        unlock_node(my_node, locktype_t::READ);
+        return btree_status_t::success;
+    }
+
+    btree_status_t ret{btree_status_t::success};
+    while (in_range()) {
+        BtreeLinkInfo child_info;
+        auto const [found, idx] = my_node->find(greq.key(), &child_info, true);
+        ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
+        if (greq.route_tracing) { append_route_trace(greq, my_node, btree_event_t::READ, idx, idx); }
+
+        // Keys of the child are upto its key in this node, the edge has the same upper bound as this node
+        K child_end;
+        bool const is_edge = (idx == my_node->total_entries());
+        if (!is_edge) {
+            child_end = my_node->get_nth_key< K >(idx, true);
+            if (auto const next_key = greq.first_key_after(child_end);
+                (next_key != nullptr) && ((upto_key == nullptr) || (next_key->compare(*upto_key) <= 0))) {
+                BtreeLinkInfo next_info;
+                my_node->find(*next_key, &next_info, true);
+                prefetch_node(next_info.bnode_id());
+            }
+        }
+
+        BtreeNodePtr child_node;
+        ret = read_and_lock_child(my_node, idx, child_info.bnode_id(), child_node, locktype_t::READ, locktype_t::READ,
+                                  greq.m_op_context);
+        if (ret != btree_status_t::success) { break; }
+
+        ret = do_batch_get(child_node, greq, is_edge ? upto_key : &child_end);
+        if (ret != btree_status_t::success) { break; }
+    }
+    unlock_node(my_node, locktype_t::READ);
+    return ret;
+}
+
+// Optimistic get reads the interior nodes without their lock, validating each against its version once the next level
+// is read from it, and locks (read) only the leaf. A write of an interior node on the way restarts the get from the
+// root, after a few of which it falls back to the locked get. It doesn't wait on a write locked node to be unlocked,
+// since the writer could be a fiber of this same thread.
+template < typename K, typename V >
+template < typename ReqT >
+btree_status_t Btree< K, V >::do_optimistic_get(ReqT& greq) const {
+    static constexpr uint32_t max_optimistic_attempts{4};
+
+    btree_status_t ret{btree_status_t::retry};
+    auto const epoch = m_reclaimer.enter();
+    for (uint32_t attempt{0}; (ret == btree_status_t::retry) && (attempt < max_optimistic_attempts); ++attempt) {
+        if (attempt != 0) { COUNTER_INCREMENT(m_metrics, btree_optimistic_read_retries, 1); }
+        ret = optimistic_get_attempt(greq);
+    }
+    m_reclaimer.exit(epoch);
+    if (ret != btree_status_t::retry) { return ret; }
+
+    BtreeNodePtr root;
+    ret = read_and_lock_node(m_root_node_info.bnode_id(), root, locktype_t::READ, locktype_t::READ, greq.m_op_context);
+    if (ret != btree_status_t::success) { return ret; }
+    return do_get(root, greq);
+}
+
+template < typename K, typename V >
+template < typename ReqT >
+btree_status_t Btree< K, V >::optimistic_get_attempt(ReqT& greq) const {
+    using interior_node_t = SimpleNode< K, BtreeLinkInfo >;
+    BtreeKey const* key;
+    if constexpr (std::is_same_v< BtreeGetAnyRequest< K >, ReqT >) {
+        key = &greq.m_range.start_key();
+    } else {
+        key = &greq.key();
+    }
+
+    BtreeNodePtr node;
+    auto ret = read_node_impl(m_root_node_info.bnode_id(), node);
+    if (node == nullptr) { return ret; }
+    if (node->is_leaf()) {
+        ret = lock_node(node, locktype_t::READ, greq.m_op_context);
+        return (ret == btree_status_t::success) ? do_get(node, greq) : ret;
+    }
+
+    uint64_t version;
+    if (!node->optimistic_read_begin(version)) { return btree_status_t::retry; }
+    while (true) {
+        auto const child_id = static_cast< interior_node_t const* >(node.get())->optimistic_child_id(*key);
+        if (!node->optimistic_read_validate(version)) { return btree_status_t::retry; }
+
+        BtreeNodePtr child;
+        ret = read_node_impl(child_id, child);
+        if (child == nullptr) { return ret; }
+
+        if (child->is_leaf()) {
+            ret = lock_node(child, locktype_t::READ, greq.m_op_context);
+            if (ret != btree_status_t::success) { return ret; }
+
+            // Leaf is still the one for the key only if its parent is not written (split or merge) till it is locked
+            if (!node->optimistic_read_validate(version)) {
+                unlock_node(child, locktype_t::READ);
+                return btree_status_t::retry;
+            }
+            return do_get(child, greq);
+        }
+
+        uint64_t child_version;
+        if (!child->optimistic_read_begin(child_version) || !node->optimistic_read_validate(version)) {
+            return btree_status_t::retry;
+        }
+        node = std::move(child);
+        version = child_version;
+    }
+}
 } // namespace homestore
@@ -21,6 +21,7 @@
 #include <boost/vmd/is_empty.hpp>
 #include <sisl/fds/utils.hpp>
 #include <sisl/metrics/metrics.hpp>
+#include <homestore/probes.hpp>
 
 namespace homestore {
 
@@ -240,9 +241,13 @@ struct BtreeConfig {
     uint8_t m_ideal_fill_pct{90};
     uint8_t m_suggested_min_pct{30};
     uint8_t m_split_pct{50};
+    uint8_t m_merge_fill_pct{70}; // Merged nodes are filled only upto this, to leave them room before their next split
     uint32_t m_max_merge_nodes{3};
     bool m_rebalance_turned_on{false};
     bool m_merge_turned_on{true};
+    uint32_t m_pinned_levels{0}; // Top levels kept resident with direct child pointers, if store supports it
+    bool m_optimistic_reads{false}; // Get traverses interior nodes without locking them, if store supports it
+    bool m_leaf_filters{false};     // Get of a key not in a leaf is answered with an in-memory bloom filter of the leaf
 
     btree_node_type m_leaf_node_type{btree_node_type::VAR_OBJECT};
     btree_node_type m_int_node_type{btree_node_type::VAR_KEY};
@@ -251,6 +256,7 @@ struct BtreeConfig {
 private:
     uint32_t m_suggested_min_size; // Precomputed values
     uint32_t m_ideal_fill_size;
+    uint32_t m_merge_fill_size;
 
 public:
     BtreeConfig(uint32_t node_size, const std::string& btree_name = "") :
@@ -265,11 +271,13 @@ public:
         m_node_data_size = data_size;
         m_ideal_fill_size = (uint32_t)(m_node_data_size * m_ideal_fill_pct) / 100; // Recompute the values
         m_suggested_min_size = (uint32_t)(m_node_data_size * m_suggested_min_pct) / 100;
+        m_merge_fill_size = (uint32_t)(m_node_data_size * m_merge_fill_pct) / 100;
     }
 
     uint32_t split_size(uint32_t filled_size) const { return uint32_cast(filled_size * m_split_pct) / 100; }
     uint32_t ideal_fill_size() const { return m_ideal_fill_size; }
     uint32_t suggested_min_size() const { return m_suggested_min_size; }
+    uint32_t merge_fill_size() const { return m_merge_fill_size; }
     uint32_t node_data_size() const { return m_node_data_size; }
 
     void set_ideal_fill_pct(uint8_t pct) {
@@ -282,6 +290,11 @@ public:
         m_suggested_min_size = (uint32_t)(node_data_size() * m_suggested_min_pct) / 100;
     }
 
+    void set_merge_fill_pct(uint8_t pct) {
+        m_merge_fill_pct = pct;
+        m_merge_fill_size = (uint32_t)(node_data_size() * m_merge_fill_pct) / 100;
+    }
+
     const std::string& name() const { return m_btree_name; }
     btree_node_type leaf_node_type() const { return m_leaf_node_type; }
     btree_node_type interior_node_type() const { return m_int_node_type; }
@@ -297,6 +310,14 @@ public:
                          {"node_type", "interior"}, _publish_as::publish_as_gauge);
         REGISTER_COUNTER(btree_split_count, "Total number of btree node splits");
         REGISTER_COUNTER(btree_merge_count, "Total number of btree node merges");
+        REGISTER_COUNTER(btree_leaf_split_count, "Btree leaf node splits", "btree_splits", {"node_type", "leaf"});
+        REGISTER_COUNTER(btree_int_split_count, "Btree interior node splits", "btree_splits",
+                         {"node_type", "interior"});
+        REGISTER_COUNTER(btree_leaf_merge_count, "Btree leaf node merges", "btree_merges", {"node_type", "leaf"});
+        REGISTER_COUNTER(btree_int_merge_count, "Btree interior node merges", "btree_merges",
+                         {"node_type", "interior"});
+        REGISTER_COUNTER(btree_merge_skipped_count, "Number of merges skipped for not saving a node at merge fill");
+        REGISTER_COUNTER(btree_subtrees_freed, "Total number of subtrees detached and freed by range removes");
         REGISTER_COUNTER(btree_depth, "Depth of btree", _publish_as::publish_as_gauge);
 
         REGISTER_COUNTER(btree_int_node_writes, "Total number of btree interior node writes", "btree_node_writes",
@@ -310,6 +331,8 @@ public:
         REGISTER_HISTOGRAM(btree_leaf_node_occupancy, "Leaf node occupancy", "btree_node_occupancy",
                            {"node_type", "leaf"}, HistogramBucketsType(LinearUpto128Buckets));
         REGISTER_COUNTER(btree_retry_count, "number of retries");
+        REGISTER_COUNTER(btree_optimistic_read_retries, "Number of optimistic gets restarted on a concurrent write");
+        REGISTER_COUNTER(btree_leaf_filter_negatives, "Number of gets answered not found by the leaf filter");
         REGISTER_COUNTER(write_err_cnt, "number of errors in write");
         REGISTER_COUNTER(query_err_cnt, "number of errors in query");
         REGISTER_COUNTER(read_node_count_in_write_ops, "number of nodes read in write_op");
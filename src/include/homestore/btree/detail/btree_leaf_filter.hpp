@@ -0,0 +1,127 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <homestore/btree/btree_kv.hpp>
+#include <homestore/btree/detail/btree_internal.hpp>
+
+namespace homestore {
+
+//
+// BtreeLeafFilter is a bloom filter of the keys of a leaf, built from all the keys the leaf had at a point in time. It
+// is never updated after, so it is valid only for as long as the leaf is not modified.
+//
+class BtreeLeafFilter {
+public:
+    explicit BtreeLeafFilter(uint32_t num_keys) {
+        uint64_t nbits{min_bits};
+        while (nbits < s_cast< uint64_t >(num_keys) * bits_per_key) {
+            nbits <<= 1;
+        }
+        m_words.resize(nbits / 64, 0);
+        m_mask = nbits - 1;
+    }
+
+    void add(BtreeKey const& key) {
+        auto [h1, h2] = hashes_of(key);
+        for (uint32_t i{0}; i < num_probes; ++i, h1 += h2) {
+            m_words[(h1 & m_mask) >> 6] |= (uint64_t{1} << (h1 & 63));
+        }
+    }
+
+    bool may_contain(BtreeKey const& key) const {
+        auto [h1, h2] = hashes_of(key);
+        for (uint32_t i{0}; i < num_probes; ++i, h1 += h2) {
+            if ((m_words[(h1 & m_mask) >> 6] & (uint64_t{1} << (h1 & 63))) == 0) { return false; }
+        }
+        return true;
+    }
+
+private:
+    static constexpr uint32_t bits_per_key{10};
+    static constexpr uint32_t num_probes{4};
+    static constexpr uint64_t min_bits{64};
+
+    static std::pair< uint64_t, uint64_t > hashes_of(BtreeKey const& key) {
+        auto const b = key.serialize();
+        std::string_view const bytes{r_cast< const char* >(b.cbytes()), b.size()};
+        uint64_t const h = std::hash< std::string_view >()(bytes);
+        return {h, ((h >> 32) | (h << 32)) | 1};
+    }
+
+private:
+    std::vector< uint64_t > m_words;
+    uint64_t m_mask;
+};
+
+//
+// BtreeLeafFilters holds the filters of the leaves by their node id, in memory only, so that a get of a key which is
+// not in a leaf is answered at its parent, without reading the leaf. Filter of a leaf is built, under its read lock, by
+// a get which didn't find its key in the leaf and is dropped, under its write lock, whenever the leaf is written or
+// freed. So a filter which is found always has all the keys of the leaf.
+//
+class BtreeLeafFilters {
+public:
+    /// @brief Returns false only if the leaf has a filter and the key is not in it
+    bool may_contain(bnodeid_t leaf_id, BtreeKey const& key) const {
+        auto const filter = get(leaf_id);
+        return (filter == nullptr) || filter->may_contain(key);
+    }
+
+    bool exists(bnodeid_t leaf_id) const { return (get(leaf_id) != nullptr); }
+
+    void set(bnodeid_t leaf_id, std::shared_ptr< const BtreeLeafFilter > filter) {
+        auto& s = shard_of(leaf_id);
+        std::unique_lock lg{s.mtx};
+        s.filters[leaf_id] = std::move(filter);
+    }
+
+    void erase(bnodeid_t leaf_id) {
+        auto& s = shard_of(leaf_id);
+        std::unique_lock lg{s.mtx};
+        s.filters.erase(leaf_id);
+    }
+
+private:
+    static constexpr uint32_t num_shards{16};
+
+    struct shard {
+        mutable std::mutex mtx;
+        std::unordered_map< bnodeid_t, std::shared_ptr< const BtreeLeafFilter > > filters;
+    };
+
+    std::shared_ptr< const BtreeLeafFilter > get(bnodeid_t leaf_id) const {
+        auto const& s = shard_of(leaf_id);
+        std::unique_lock lg{s.mtx};
+        auto const it = s.filters.find(leaf_id);
+        return (it == s.filters.end()) ? nullptr : it->second;
+    }
+
+    shard& shard_of(bnodeid_t id) { return m_shards[std::hash< bnodeid_t >()(id) % num_shards]; }
+    shard const& shard_of(bnodeid_t id) const { return m_shards[std::hash< bnodeid_t >()(id) % num_shards]; }
+
+private:
+    std::array< shard, num_shards > m_shards;
+};
+} // namespace homestore
@@ -63,6 +63,12 @@ retry:
         auto const [found, idx] = my_node->find(req.key(), nullptr, true);
         ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
         end_idx = start_idx = idx;
+    } else if constexpr (std::is_same_v< ReqT, BtreeBatchPutRequest< K > >) {
+        // Walk down for the next key, the rest of the keys upto the child's last key are applied along with it
+        auto const [found, idx] = my_node->find(req.key(), nullptr, true);
+        ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
+        end_idx = start_idx = idx;
+        if (idx < my_node->total_entries()) { req.set_leaf_end(my_node->get_nth_key< K >(idx, true)); }
     }
 
     BT_NODE_DBG_ASSERT((curlock == locktype_t::READ || curlock == locktype_t::WRITE), my_node, "unexpected locktype {}",
@@ -107,6 +113,8 @@ retry:
 
             if (req.route_tracing) { append_route_trace(req, child_node, btree_event_t::SPLIT); }
             COUNTER_INCREMENT(m_metrics, btree_split_count, 1);
+            COUNTER_INCREMENT_IF_ELSE(m_metrics, child_node->is_leaf(), btree_leaf_split_count, btree_int_split_count,
+                                      1);
             goto retry; // After split, retry search and walk down.
         }
 
@@ -187,6 +195,16 @@ btree_status_t Btree< K, V >::mutate_write_leaf_node(const BtreeNodePtr& my_node
             ret = btree_status_t::put_failed;
         }
         COUNTER_INCREMENT(m_metrics, btree_obj_count, 1);
+    } else if constexpr (std::is_same_v< ReqT, BtreeBatchPutRequest< K > >) {
+        // Split check on the way down ensures there is room for the first key, rest are applied as long as they fit
+        uint32_t count{0};
+        while (!req.is_done() && req.in_leaf_range() &&
+               my_node->has_room_for_entry(req.m_put_type, req.key(), req.value())) {
+            req.next(to_variant_node(my_node)->put(req.key(), req.value(), req.m_put_type, nullptr, req.m_filter_cb));
+            ++count;
+        }
+        if (!req.is_done()) { ret = btree_status_t::has_more; }
+        COUNTER_INCREMENT(m_metrics, btree_obj_count, count);
     }
 
     if ((ret == btree_status_t::success) || (ret == btree_status_t::has_more)) {
@@ -243,6 +261,8 @@ btree_status_t Btree< K, V >::check_split_root(ReqT& req) {
     } else {
         if (req.route_tracing) { append_route_trace(req, child_node, btree_event_t::SPLIT); }
         m_root_node_info = BtreeLinkInfo{root->node_id(), root->link_version()};
+        COUNTER_INCREMENT(m_metrics, btree_split_count, 1);
+        COUNTER_INCREMENT_IF_ELSE(m_metrics, child_node->is_leaf(), btree_leaf_split_count, btree_int_split_count, 1);
         unlock_node(child_node, locktype_t::WRITE);
         COUNTER_INCREMENT(m_metrics, btree_depth, 1);
     }
@@ -260,6 +280,7 @@ btree_status_t Btree< K, V >::split_node(const BtreeNodePtr& parent_node, const
     child_node2.reset(child_node1->is_leaf() ? alloc_leaf_node().get() : alloc_interior_node().get());
 
     if (child_node2 == nullptr) { return (btree_status_t::space_not_avail); }
+    HS_PROBE(btree_split, child_node1->node_id(), child_node1->level(), child_node1->total_entries());
 
     btree_status_t ret = btree_status_t::success;
 
@@ -292,6 +313,7 @@ btree_status_t Btree< K, V >::split_node(const BtreeNodePtr& parent_node, const
     BT_NODE_LOG(DEBUG, child_node1, "Left child");
     BT_NODE_LOG(DEBUG, child_node2, "Right child");
 
+    drop_leaf_filter(child_node1); // Store could write the nodes it transacts without write_node
     ret = transact_nodes({child_node2}, {}, child_node1, parent_node, context);
 
     // NOTE: Do not access parentInd after insert, since insert would have
@@ -306,8 +328,9 @@ bool Btree< K, V >::is_split_needed(const BtreeNodePtr& node, ReqT& req) const {
         return !node->has_room_for_put(btree_put_type::UPSERT, K::get_max_size(), BtreeLinkInfo::get_fixed_size());
     } else if constexpr (std::is_same_v< ReqT, BtreeRangePutRequest< K > >) {
         return !node->has_room_for_put(req.m_put_type, req.first_key_size(), req.m_newval->serialized_size());
-    } else if constexpr (std::is_same_v< ReqT, BtreeSinglePutRequest >) {
-        return !node->has_room_for_put(req.m_put_type, req.key().serialized_size(), req.value().serialized_size());
+    } else if constexpr (std::is_same_v< ReqT, BtreeSinglePutRequest > ||
+                         std::is_same_v< ReqT, BtreeBatchPutRequest< K > >) {
+        return !node->has_room_for_entry(req.m_put_type, req.key(), req.value());
     } else {
         return false;
     }
@@ -15,7 +15,10 @@
  *********************************************************************************/
 
 #pragma once
+#include <array>
+#include <atomic>
 #include <iostream>
+#include <limits>
 #include <queue>
 #include <iomgr/fiber_lib.hpp>
 
@@ -41,8 +44,13 @@ struct transient_hdr_t {
 };
 #pragma pack()
 
-static constexpr uint8_t BTREE_NODE_VERSION = 1;
+// Nodes of version 1 are checksummed with crc16_t10dif, from version 2 with crc32c (hardware accelerated in isa-l and
+// on ARMv8), which is split into checksum and checksum_hi of the header. Nodes of version 1 are upgraded on their
+// write.
+static constexpr uint8_t BTREE_NODE_VERSION_CRC16 = 1;
+static constexpr uint8_t BTREE_NODE_VERSION = 2;
 static constexpr uint8_t BTREE_NODE_MAGIC = 0xab;
+static constexpr uint32_t bt_init_crc_32 = 0x8005;
 
 #pragma pack(1)
 struct persistent_hdr_t {
@@ -65,14 +73,19 @@ struct persistent_hdr_t {
     uint16_t level;               // offset=64: Level of the node within the tree
     uint16_t node_size;           // offset=66: Size of node, max 64K
     uint8_t node_type;            // offset=68: Type of the node (simple vs varlen etc..)
-    uint8_t reserved[3]{0, 0, 0}; // offset=69-72: Reserved
+    uint16_t checksum_hi{0};      // offset=69: Upper half of the crc32c checksum, of version 2 onwards
+    uint8_t reserved[1]{0};       // offset=71-72: Reserved
 
     persistent_hdr_t() : nentries{0}, leaf{0}, node_deleted{0} {}
+
+    uint32_t full_checksum() const {
+        return (version == BTREE_NODE_VERSION_CRC16) ? checksum : (uint32_cast(checksum_hi) << 16) | checksum;
+    }
     std::string to_string() const {
         return fmt::format("magic={} version={} csum={} node_id={} next_node={} nentries={} node_type={} is_leaf={} "
                            "node_deleted={} node_gen={} modified_cp_id={} link_version={} edge_nodeid={}, "
                            "edge_link_version={} level={} ",
-                           magic, version, checksum, node_id, next_node, nentries, node_type, leaf, node_deleted,
+                           magic, version, full_checksum(), node_id, next_node, nentries, node_type, leaf, node_deleted,
                            node_gen, modified_cp_id, link_version, edge_info.m_bnodeid, edge_info.m_link_version,
                            level);
     }
@@ -90,8 +103,16 @@ class BtreeNode : public sisl::ObjLifeCounter< BtreeNode > {
 public:
     sisl::atomic_counter< int32_t > m_refcount{0};
     transient_hdr_t m_trans_hdr;
+    mutable std::atomic< uint64_t > m_lock_version{0}; // Bumped on write lock and unlock, odd while write locked
     uint8_t* m_phys_node_buf;
 
+    // Upto this size, updates in place keep the checksum up instead of it being computed all over on set_checksum
+    static constexpr uint32_t max_incr_csum_range{128};
+
+private:
+    mutable uint32_t m_csum{0};                  // crc32c of the data area as of m_csum_gen
+    mutable uint64_t m_csum_gen{std::numeric_limits< uint64_t >::max()};
+
 public:
     BtreeNode(uint8_t* node_buf, bnodeid_t id, bool init_buf, bool is_leaf, BtreeConfig const& cfg) :
             m_phys_node_buf{node_buf} {
@@ -103,7 +124,7 @@ public:
         } else {
             DEBUG_ASSERT_EQ(node_id(), id);
             DEBUG_ASSERT_EQ(magic(), BTREE_NODE_MAGIC);
-            DEBUG_ASSERT_EQ(version(), BTREE_NODE_VERSION);
+            DEBUG_ASSERT_LE(version(), BTREE_NODE_VERSION);
         }
         m_trans_hdr.leaf_node = is_leaf;
     }
@@ -118,17 +139,25 @@ public:
 
     static bool is_valid_node(sisl::blob const& buf) {
         auto phdr = r_cast< persistent_hdr_t const* >(buf.cbytes());
-        if ((phdr->magic != BTREE_NODE_MAGIC) || (phdr->version != BTREE_NODE_VERSION)) { return false; }
+        if ((phdr->magic != BTREE_NODE_MAGIC) || (phdr->version < BTREE_NODE_VERSION_CRC16) ||
+            (phdr->version > BTREE_NODE_VERSION)) {
+            return false;
+        }
         if ((uint32_cast(phdr->node_size) + 1) != buf.size()) { return false; }
         if (phdr->node_id == empty_bnodeid) { return false; }
 
-        auto const exp_checksum = crc16_t10dif(bt_init_crc_16, (buf.cbytes() + sizeof(persistent_hdr_t)),
-                                               buf.size() - sizeof(persistent_hdr_t));
-        if (phdr->checksum != exp_checksum) { return false; }
+        auto const exp_checksum = compute_checksum(phdr->version, (buf.cbytes() + sizeof(persistent_hdr_t)),
+                                                   buf.size() - sizeof(persistent_hdr_t));
+        if (phdr->full_checksum() != exp_checksum) { return false; }
 
         return true;
     }
 
+    static uint32_t compute_checksum(uint8_t version, uint8_t const* data, uint64_t size) {
+        if (version == BTREE_NODE_VERSION_CRC16) { return crc16_t10dif(bt_init_crc_16, data, size); }
+        return crc32_iscsi(const_cast< unsigned char* >(data), s_cast< int >(size), bt_init_crc_32);
+    }
+
     static void revert_node_delete(uint8_t* buf) {
         auto phdr = r_cast< persistent_hdr_t* >(buf);
         phdr->node_deleted = 0x0;
@@ -326,6 +355,8 @@ public:
             m_trans_hdr.lock.lock_shared();
         } else if (l == locktype_t::WRITE) {
             m_trans_hdr.lock.lock();
+            m_lock_version.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
         }
     }
 
@@ -333,10 +364,25 @@ public:
         if (l == locktype_t::READ) {
             m_trans_hdr.lock.unlock_shared();
         } else if (l == locktype_t::WRITE) {
+            m_lock_version.fetch_add(1, std::memory_order_release);
             m_trans_hdr.lock.unlock();
         }
     }
 
+    /// @brief Starts an optimistic read of the node, that is reading it without any lock.
+    /// @return false if the node is write locked, in which case it can't be read optimistically
+    bool optimistic_read_begin(uint64_t& version) const {
+        version = m_lock_version.load(std::memory_order_acquire);
+        return ((version & 1) == 0);
+    }
+
+    /// @brief Whether the node was not write locked since optimistic_read_begin returned the version, only then what
+    /// was read from the node in between is consistent
+    bool optimistic_read_validate(uint64_t version) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (m_lock_version.load(std::memory_order_relaxed) == version);
+    }
+
     void lock_upgrade() {
         m_trans_hdr.upgraders.increment(1);
         this->unlock(locktype_t::READ);
@@ -368,6 +414,12 @@ public:
 
     virtual uint32_t available_size() const = 0;
     virtual bool has_room_for_put(btree_put_type put_type, uint32_t key_size, uint32_t value_size) const = 0;
+
+    // Room for the put of this key/value. Nodes whose entry size depends on the content of the entry (and not only on
+    // its size) check it exactly.
+    virtual bool has_room_for_entry(btree_put_type put_type, const BtreeKey& key, const BtreeValue& val) const {
+        return has_room_for_put(put_type, key.serialized_size(), val.serialized_size());
+    }
     virtual uint32_t num_entries_by_size(uint32_t start_idx, uint32_t size) const = 0;
 
     virtual int compare_nth_key(const BtreeKey& cmp_key, uint32_t ind) const = 0;
@@ -387,7 +439,9 @@ public:
     virtual std::string to_string_keys(bool print_friendly = false) const = 0;
 
 protected:
-    node_find_result_t bsearch_node(const BtreeKey& key) const {
+    // Nodes which could search their keys without deserializing them through the virtual compare_nth_key, override
+    // this, it is called once per search rather than per probe
+    virtual node_find_result_t bsearch_node(const BtreeKey& key) const {
         DEBUG_ASSERT_EQ(magic(), BTREE_NODE_MAGIC);
         auto [found, idx] = bsearch(-1, total_entries(), key);
         if (found) { DEBUG_ASSERT_LT(idx, total_entries()); }
@@ -432,19 +486,54 @@ public:
     void set_magic() { get_persistent_header()->magic = BTREE_NODE_MAGIC; }
 
     uint8_t version() const { return get_persistent_header_const()->version; }
-    uint16_t checksum() const { return get_persistent_header_const()->checksum; }
-    void init_checksum() { get_persistent_header()->checksum = 0; }
+    uint32_t checksum() const { return get_persistent_header_const()->full_checksum(); }
+    void init_checksum() {
+        get_persistent_header()->checksum = 0;
+        get_persistent_header()->checksum_hi = 0;
+    }
 
     void set_node_id(bnodeid_t id) { get_persistent_header()->node_id = id; }
     bnodeid_t node_id() const { return get_persistent_header_const()->node_id; }
 
+    // Checksum is of the current version always. Checksum kept up by the updates in place since the last one (see
+    // update_checksum_range) is taken as is, if no other update went in since (it would have moved the gen).
     void set_checksum() {
-        get_persistent_header()->checksum = crc16_t10dif(bt_init_crc_16, node_data_area_const(), node_data_size());
+        auto* phdr = get_persistent_header();
+        phdr->version = BTREE_NODE_VERSION;
+        if (m_csum_gen != node_gen()) {
+            m_csum = compute_checksum(BTREE_NODE_VERSION, node_data_area_const(), node_data_size());
+            m_csum_gen = node_gen();
+        }
+        phdr->checksum = s_cast< uint16_t >(m_csum & 0xFFFF);
+        phdr->checksum_hi = s_cast< uint16_t >(m_csum >> 16);
     }
 
     bool verify_node() const {
-        auto exp_checksum = crc16_t10dif(bt_init_crc_16, node_data_area_const(), node_data_size());
-        return ((magic() == BTREE_NODE_MAGIC) && (checksum() == exp_checksum));
+        auto const exp_checksum = compute_checksum(version(), node_data_area_const(), node_data_size());
+        if ((magic() != BTREE_NODE_MAGIC) || (checksum() != exp_checksum)) { return false; }
+        if (version() == BTREE_NODE_VERSION) {
+            m_csum = exp_checksum;
+            m_csum_gen = node_gen();
+        }
+        return true;
+    }
+
+    /**
+     * @brief Keep the checksum up with an update in place of len bytes at data_off of the data area, which took the
+     * node from prev_gen to the current gen. It is a crc of just the changed bytes, instead of the whole node on
+     * set_checksum. Nothing to do if the checksum isn't known as of prev_gen, set_checksum computes it all then.
+     */
+    void update_checksum_range(uint32_t data_off, uint8_t const* old_bytes, uint32_t len, uint64_t prev_gen) {
+        if ((m_csum_gen != prev_gen) || (prev_gen == node_gen())) { return; }
+
+        std::array< uint8_t, max_incr_csum_range > delta;
+        if (len > delta.size()) { return; }
+        uint8_t const* cur = node_data_area_const() + data_off;
+        for (uint32_t i{0}; i < len; ++i) {
+            delta[i] = old_bytes[i] ^ cur[i];
+        }
+        m_csum ^= crc32c_shift(crc32_iscsi(delta.data(), s_cast< int >(len), 0), node_data_size() - data_off - len);
+        m_csum_gen = node_gen();
     }
 
     bool is_leaf() const { return get_persistent_header_const()->leaf; }
@@ -518,6 +607,15 @@ public:
     }
 };
 
+// Tracking the nodes locked by each fiber, to assert that an op leaves none of them locked and to measure how long a
+// node is held locked, costs a lookup of the fiber and a push/pop of a vector on every lock and unlock of a node. It is
+// compiled in to the debug builds and to the release builds only with HS_BTREE_TRACK_NODE_LOCKS defined.
+#if !defined(NDEBUG) || defined(HS_BTREE_TRACK_NODE_LOCKS)
+static constexpr bool btree_track_node_locks{true};
+#else
+static constexpr bool btree_track_node_locks{false};
+#endif
+
 struct btree_locked_node_info {
     BtreeNode* node;
     Clock::time_point start_time;
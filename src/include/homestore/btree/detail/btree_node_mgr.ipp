@@ -19,6 +19,7 @@
 #include <homestore/btree/detail/simple_node.hpp>
 #include <homestore/btree/detail/varlen_node.hpp>
 #include <homestore/btree/detail/prefix_node.hpp>
+#include <homestore/btree/detail/compact_node.hpp>
 #include <sisl/fds/utils.hpp>
 // #include <iomgr/iomgr_flip.hpp>
 
@@ -85,7 +86,29 @@ btree_status_t Btree< K, V >::get_child_and_lock_node(const BtreeNodePtr& node,
         node->get_nth_value(index, &child_info, false /* copy */);
     }
 
-    return (read_and_lock_node(child_info.bnode_id(), child_node, int_lock_type, leaf_lock_type, context));
+    return (read_and_lock_child(node, index, child_info.bnode_id(), child_node, int_lock_type, leaf_lock_type,
+                                context));
+}
+
+/*
+ * Same as read_and_lock_node, but for the child at the given index of the parent, which lets the store skip the
+ * lookup by id for the children it keeps direct pointers to.
+ */
+template < typename K, typename V >
+btree_status_t Btree< K, V >::read_and_lock_child(const BtreeNodePtr& parent, uint32_t index, bnodeid_t id,
+                                                  BtreeNodePtr& child_node, locktype_t int_lock_type,
+                                                  locktype_t leaf_lock_type, void* context) const {
+    auto ret = read_child_node_impl(parent, index, id, child_node);
+    if (child_node == nullptr) {
+        BT_LOG(ERROR, "read failed, reason: {}", ret);
+        return ret;
+    }
+
+    auto acq_lock = (child_node->is_leaf()) ? leaf_lock_type : int_lock_type;
+    ret = lock_node(child_node, acq_lock, context);
+    if (ret != btree_status_t::success) { BT_LOG(ERROR, "Node lock and refresh failed"); }
+
+    return ret;
 }
 
 template < typename K, typename V >
@@ -94,6 +117,7 @@ btree_status_t Btree< K, V >::write_node(const BtreeNodePtr& node, void* context
     HISTOGRAM_OBSERVE_IF_ELSE(m_metrics, node->is_leaf(), btree_leaf_node_occupancy, btree_int_node_occupancy,
                               ((m_node_size - node->available_size()) * 100) / m_node_size);
 
+    drop_leaf_filter(node);
     return (write_node_impl(node, context));
 }
 
@@ -205,15 +229,15 @@ btree_status_t Btree< K, V >::upgrade_node_lock(const BtreeNodePtr& node, lockty
 }
 
 template < typename K, typename V >
-btree_status_t Btree< K, V >::_lock_node(const BtreeNodePtr& node, locktype_t type, void* context, const char* fname,
-                                         int line) const {
-    _start_of_lock(node, type, fname, line);
+btree_status_t Btree< K, V >::_lock_node(const BtreeNodePtr& node, locktype_t type, void* context,
+                                         [[maybe_unused]] const char* fname, [[maybe_unused]] int line) const {
+    if constexpr (btree_track_node_locks) { _start_of_lock(node, type, fname, line); }
     node->lock(type);
 
     auto ret = refresh_node(node, (type == locktype_t::WRITE), context);
     if (ret != btree_status_t::success) {
         node->unlock(type);
-        end_of_lock(node, type);
+        if constexpr (btree_track_node_locks) { end_of_lock(node, type); }
         return ret;
     }
 
@@ -223,8 +247,10 @@ btree_status_t Btree< K, V >::_lock_node(const BtreeNodePtr& node, locktype_t ty
 template < typename K, typename V >
 void Btree< K, V >::unlock_node(const BtreeNodePtr& node, locktype_t type) const {
     node->unlock(type);
-    auto time_spent = end_of_lock(node, type);
-    observe_lock_time(node, type, time_spent);
+    if constexpr (btree_track_node_locks) {
+        auto time_spent = end_of_lock(node, type);
+        observe_lock_time(node, type, time_spent);
+    }
 }
 
 template < typename K, typename V >
@@ -284,6 +310,12 @@ BtreeNode* Btree< K, V >::init_node(uint8_t* node_buf, bnodeid_t id, bool init_b
                     : create_node< FixedPrefixNode< K, BtreeLinkInfo > >(node_buf, id, init_buf, false, this->m_bt_cfg);
         break;
 
+    case btree_node_type::COMPACT:
+        // Only leaves are compacted, interior nodes are FIXED
+        n = is_leaf ? create_node< CompactNode< K, V > >(node_buf, id, init_buf, true, this->m_bt_cfg)
+                    : create_node< SimpleNode< K, BtreeLinkInfo > >(node_buf, id, init_buf, false, this->m_bt_cfg);
+        break;
+
     default:
         BT_REL_ASSERT(false, "Unsupported node type {}", node_type);
         break;
@@ -297,6 +329,7 @@ void Btree< K, V >::free_node(const BtreeNodePtr& node, locktype_t cur_lock, voi
     BT_NODE_LOG(TRACE, node, "Freeing node");
 
     COUNTER_DECREMENT_IF_ELSE(m_metrics, node->is_leaf(), btree_leaf_node_count, btree_int_node_count, 1);
+    drop_leaf_filter(node);
     if (cur_lock != locktype_t::NONE) {
         BT_NODE_DBG_ASSERT_NE(cur_lock, locktype_t::READ, node, "We can't free a node with read lock type right?");
         node->set_node_deleted();
@@ -304,10 +337,43 @@ void Btree< K, V >::free_node(const BtreeNodePtr& node, locktype_t cur_lock, voi
     }
     --m_total_nodes;
 
-    free_node_impl(node, context);
+    // A reader in flight could have read the id of this node before it was unlinked from its parent, so it is freed
+    // to the store only once none of them could be reading it
+    if (is_optimistic_read_enabled()) {
+        m_reclaimer.retire(node);
+    } else {
+        free_node_impl(node, context);
+    }
     // intrusive_ptr_release(node.get());
 }
 
+// Optimistic reads need the interior nodes to be FIXED, where anything read from a node changing underneath is within
+// its buffer and safe to deserialize
+template < typename K, typename V >
+bool Btree< K, V >::is_optimistic_read_enabled() const {
+    auto const int_node_type = m_bt_cfg.m_int_node_type;
+    return m_bt_cfg.m_optimistic_reads && supports_optimistic_reads() &&
+        ((int_node_type == btree_node_type::FIXED) || (int_node_type == btree_node_type::COMPACT));
+}
+
+// Called with the leaf read locked, no one could be adding keys to it while its filter is built
+template < typename K, typename V >
+void Btree< K, V >::build_leaf_filter(const BtreeNodePtr& leaf) const {
+    if (leaf->is_node_deleted() || m_leaf_filters.exists(leaf->node_id())) { return; }
+
+    auto filter = std::make_shared< BtreeLeafFilter >(leaf->total_entries());
+    for (uint32_t i{0}; i < leaf->total_entries(); ++i) {
+        filter->add(leaf->get_nth_key< K >(i, false /* copy */));
+    }
+    m_leaf_filters.set(leaf->node_id(), std::move(filter));
+}
+
+// Called with the node write locked, whenever its keys could have changed
+template < typename K, typename V >
+void Btree< K, V >::drop_leaf_filter(const BtreeNodePtr& node) const {
+    if (m_bt_cfg.m_leaf_filters && node->is_leaf()) { m_leaf_filters.erase(node->node_id()); }
+}
+
 template < typename K, typename V >
 void Btree< K, V >::observe_lock_time(const BtreeNodePtr& node, locktype_t type, uint64_t time_spent) const {
     if (time_spent == 0) { return; }
@@ -0,0 +1,119 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+#include <homestore/btree/detail/btree_node.hpp>
+
+namespace homestore {
+
+//
+// BtreeNodeReclaimer holds the nodes freed from a btree, which optimistic readers (reading without locks) could still
+// be reading, and frees them (through the callback) only once none of them could be. It is an epoch based reclamation
+// of two epochs: a reader enters the current epoch and a freed node is retired in the current epoch. Nodes retired in
+// the previous epoch are freed once the readers of the previous epoch are done, at which point the epoch advances (if
+// any node is retired in the current one). A reader which entered after a node was retired can't reach it, since it
+// was unlinked from the btree before it was retired. New readers are always in the current epoch, so the previous one
+// drains even if there are always readers in flight.
+//
+class BtreeNodeReclaimer {
+public:
+    using free_cb_t = std::function< void(boost::intrusive_ptr< BtreeNode > const&) >;
+
+    explicit BtreeNodeReclaimer(free_cb_t free_cb) : m_free_cb{std::move(free_cb)} {}
+    BtreeNodeReclaimer(BtreeNodeReclaimer const&) = delete;
+    BtreeNodeReclaimer& operator=(BtreeNodeReclaimer const&) = delete;
+
+    /// @brief Enter as a reader, returns the epoch to exit with
+    uint64_t enter() {
+        while (true) {
+            auto const e = m_epoch.load();
+            m_readers[e & 1].fetch_add(1);
+            if (m_epoch.load() == e) { return e; }
+            m_readers[e & 1].fetch_sub(1); // Epoch advanced in between, enter the new one
+        }
+    }
+
+    void exit(uint64_t epoch) {
+        m_readers[epoch & 1].fetch_sub(1);
+        if (m_num_retired.load(std::memory_order_relaxed) != 0) { try_reclaim(false /* wait_for_lock */); }
+    }
+
+    void retire(boost::intrusive_ptr< BtreeNode > node) {
+        {
+            std::unique_lock lg{m_mtx};
+            m_retired[m_epoch.load() & 1].push_back(std::move(node));
+            m_num_retired.fetch_add(1, std::memory_order_relaxed);
+        }
+        try_reclaim(true /* wait_for_lock */);
+    }
+
+    /// @brief Free all the retired nodes, caller ensures that there are no readers
+    void reclaim_all() {
+        std::array< std::vector< boost::intrusive_ptr< BtreeNode > >, 2 > nodes;
+        {
+            std::unique_lock lg{m_mtx};
+            nodes.swap(m_retired);
+            m_num_retired.store(0, std::memory_order_relaxed);
+        }
+        for (auto const& v : nodes) {
+            for (auto const& n : v) {
+                m_free_cb(n);
+            }
+        }
+    }
+
+    uint64_t num_retired() const { return m_num_retired.load(std::memory_order_relaxed); }
+
+private:
+    void try_reclaim(bool wait_for_lock) {
+        std::vector< boost::intrusive_ptr< BtreeNode > > nodes;
+        {
+            std::unique_lock lg{m_mtx, std::defer_lock};
+            if (wait_for_lock) {
+                lg.lock();
+            } else if (!lg.try_lock()) {
+                return; // Someone else is at it
+            }
+
+            auto const e = m_epoch.load();
+            auto const prev = (e + 1) & 1;
+            if (m_readers[prev].load() != 0) { return; }
+
+            nodes.swap(m_retired[prev]);
+            m_num_retired.fetch_sub(nodes.size(), std::memory_order_relaxed);
+            if (!m_retired[e & 1].empty()) { m_epoch.store(e + 1); }
+        }
+        for (auto const& n : nodes) {
+            m_free_cb(n);
+        }
+    }
+
+private:
+    free_cb_t m_free_cb;
+    std::atomic< uint64_t > m_epoch{0};
+    std::array< std::atomic< uint64_t >, 2 > m_readers{};
+    std::atomic< uint64_t > m_num_retired{0};
+    std::mutex m_mtx;
+    std::array< std::vector< boost::intrusive_ptr< BtreeNode > >, 2 > m_retired;
+};
+} // namespace homestore
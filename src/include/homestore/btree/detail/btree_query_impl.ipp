@@ -71,14 +71,97 @@ btree_status_t Btree< K, V >::do_sweep_query(BtreeNodePtr& my_node, BtreeQueryRe
     ASSERT_IS_VALID_INTERIOR_CHILD_INDX(isfound, idx, my_node);
     if (qreq.route_tracing) { append_route_trace(qreq, my_node, btree_event_t::READ, idx, idx); }
 
+    // Sweep goes through the sibling leaves of the range, which are the next children of the lowest interior node
+    if (my_node->level() == 1) {
+        auto [end_found, end_idx] = my_node->find(qreq.input_range().end_key(), nullptr, false);
+        if ((end_idx == my_node->total_entries()) && !my_node->has_valid_edge()) { --end_idx; }
+        if (end_idx > idx) { read_ahead_children(my_node, idx + 1, end_idx); }
+    }
+
     BtreeNodePtr child_node;
-    ret = read_and_lock_node(start_child_info.bnode_id(), child_node, locktype_t::READ, locktype_t::READ,
-                             qreq.m_op_context);
+    ret = read_and_lock_child(my_node, idx, start_child_info.bnode_id(), child_node, locktype_t::READ,
+                              locktype_t::READ, qreq.m_op_context);
     unlock_node(my_node, locktype_t::READ);
     if (ret != btree_status_t::success) { return ret; }
     return (do_sweep_query(child_node, qreq, out_values));
 }
 
+// Same walk as the sweep query, but hands each entry of the leaves to the callback, in place. Working range of the
+// request is shifted past the entries of a leaf as they are visited, including the ones the filter skips.
+template < typename K, typename V >
+btree_status_t Btree< K, V >::do_sweep_visit(BtreeNodePtr& my_node, BtreeQueryRequest< K >& qreq,
+                                             query_visit_cb_t const& visit_cb) const {
+    btree_status_t ret = btree_status_t::success;
+    if (my_node->is_leaf()) {
+        uint32_t count{0};
+        while (true) {
+            uint32_t start_idx{0};
+            uint32_t end_idx{0};
+            bool stopped{false};
+            if (my_node->match_range< K >(qreq.working_range(), start_idx, end_idx)) {
+                auto const vnode = to_variant_node(my_node);
+                auto idx = start_idx;
+                while ((idx <= end_idx) && (count < qreq.batch_size()) && !stopped) {
+                    K const key = vnode->get_nth_key< K >(idx, false /* copy */);
+                    V const val = vnode->get_nth_value(idx, false /* copy */);
+                    if (!qreq.filter() || qreq.filter()(key, val)) {
+                        ++count;
+                        stopped = !visit_cb(key, val);
+                    }
+                    ++idx;
+                }
+
+                if (idx > start_idx) {
+                    if (qreq.route_tracing) { append_route_trace(qreq, my_node, btree_event_t::READ, start_idx, idx); }
+                    qreq.shift_working_range(my_node->get_nth_key< K >(idx - 1, true /* copy */), false /* incl */);
+                }
+                if (stopped || (idx <= end_idx)) {
+                    ret = btree_status_t::has_more;
+                    break;
+                }
+            }
+
+            if (count >= qreq.batch_size()) {
+                ret = btree_status_t::has_more;
+                break;
+            }
+            if ((my_node->total_entries() != 0) &&
+                (my_node->get_last_key< K >().compare(qreq.input_range().end_key()) >= 0)) {
+                break;
+            }
+            if (my_node->next_bnode() == empty_bnodeid) { break; }
+
+            BtreeNodePtr next_node;
+            ret = read_and_lock_node(my_node->next_bnode(), next_node, locktype_t::READ, locktype_t::READ,
+                                     qreq.m_op_context);
+            if (ret != btree_status_t::success) { break; }
+            unlock_node(my_node, locktype_t::READ);
+            my_node = std::move(next_node);
+        }
+
+        unlock_node(my_node, locktype_t::READ);
+        return ret;
+    }
+
+    BtreeLinkInfo start_child_info;
+    [[maybe_unused]] const auto [isfound, idx] = my_node->find(qreq.first_key(), &start_child_info, false);
+    ASSERT_IS_VALID_INTERIOR_CHILD_INDX(isfound, idx, my_node);
+    if (qreq.route_tracing) { append_route_trace(qreq, my_node, btree_event_t::READ, idx, idx); }
+
+    if (my_node->level() == 1) {
+        auto [end_found, end_idx] = my_node->find(qreq.input_range().end_key(), nullptr, false);
+        if ((end_idx == my_node->total_entries()) && !my_node->has_valid_edge()) { --end_idx; }
+        if (end_idx > idx) { read_ahead_children(my_node, idx + 1, end_idx); }
+    }
+
+    BtreeNodePtr child_node;
+    ret = read_and_lock_child(my_node, idx, start_child_info.bnode_id(), child_node, locktype_t::READ,
+                              locktype_t::READ, qreq.m_op_context);
+    unlock_node(my_node, locktype_t::READ);
+    if (ret != btree_status_t::success) { return ret; }
+    return do_sweep_visit(child_node, qreq, visit_cb);
+}
+
 template < typename K, typename V >
 btree_status_t Btree< K, V >::do_traversal_query(const BtreeNodePtr& my_node, BtreeQueryRequest< K >& qreq,
                                                  std::vector< std::pair< K, V > >& out_values) const {
@@ -118,12 +201,14 @@ btree_status_t Btree< K, V >::do_traversal_query(const BtreeNodePtr& my_node, Bt
     idx = start_idx;
 
     if (qreq.route_tracing) { append_route_trace(qreq, my_node, btree_event_t::READ, start_idx, end_idx); }
+    if (end_idx > start_idx) { read_ahead_children(my_node, start_idx + 1, end_idx); }
     while (idx <= end_idx) {
         BtreeLinkInfo child_info;
         my_node->get_nth_value(idx, &child_info, false);
         BtreeNodePtr child_node = nullptr;
         locktype_t child_cur_lock = locktype_t::READ;
-        ret = read_and_lock_node(child_info.bnode_id(), child_node, child_cur_lock, child_cur_lock, nullptr);
+        ret = read_and_lock_child(my_node, idx, child_info.bnode_id(), child_node, child_cur_lock, child_cur_lock,
+                                  nullptr);
         if (ret != btree_status_t::success) { break; }
 
         if (idx == end_idx) {
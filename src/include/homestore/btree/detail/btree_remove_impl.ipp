@@ -39,6 +39,13 @@ btree_status_t Btree< K, V >::do_remove(const BtreeNodePtr& my_node, locktype_t
             req.shift_working_range();
         } else if constexpr (std::is_same_v< ReqT, BtreeRemoveAnyRequest< K > >) {
             if ((modified = my_node->remove_any(req.m_range, req.m_outkey, req.m_outval))) { ++removed_count; }
+        } else if constexpr (std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >) {
+            while (!req.is_done() && req.in_leaf_range()) {
+                bool const removed = my_node->remove_one(req.key(), nullptr, nullptr);
+                if (removed) { ++removed_count; }
+                req.next(removed);
+            }
+            modified = (removed_count != 0);
         }
 #ifndef NDEBUG
         my_node->validate_key_order< K >();
@@ -53,6 +60,8 @@ btree_status_t Btree< K, V >::do_remove(const BtreeNodePtr& my_node, locktype_t
         return modified ? btree_status_t::success : btree_status_t::not_found;
     }
 
+    std::vector< bnodeid_t > detached_ids;
+
 retry:
     locktype_t child_cur_lock = locktype_t::NONE;
     uint32_t curr_idx;
@@ -70,12 +79,26 @@ retry:
         ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
         end_idx = start_idx = idx;
         if (false) { goto out_return; } // Please the compiler
+    } else if constexpr (std::is_same_v< ReqT, BtreeBatchRemoveRequest< K > >) {
+        auto const [found, idx] = my_node->find(req.key(), nullptr, false);
+        ASSERT_IS_VALID_INTERIOR_CHILD_INDX(found, idx, my_node);
+        end_idx = start_idx = idx;
+        if (idx < my_node->total_entries()) { req.set_leaf_end(my_node->get_nth_key< K >(idx, true)); }
+        if (false) { goto out_return; } // Please the compiler
     } else if constexpr (std::is_same_v< ReqT, BtreeRangeRemoveRequest< K > >) {
         auto const matched = my_node->match_range< K >(req.working_range(), start_idx, end_idx);
         if (!matched) {
             ret = btree_status_t::not_found;
             goto out_return;
         }
+
+        // Only the children at the boundaries of the range need to be walked down
+        if (req.m_free_subtrees && !req.m_filter_cb && (end_idx > start_idx + 1)) {
+            ret = detach_covered_children(my_node, curlock, start_idx, end_idx, detached_ids, req.m_op_context);
+            if (ret != btree_status_t::success) { goto out_return; }
+            at_least_one_child_modified = true;
+            end_idx = start_idx + 1;
+        }
     } else if constexpr (std::is_same_v< ReqT, BtreeRemoveAnyRequest< K > >) {
         auto const matched = my_node->match_range< K >(req.m_range, start_idx, end_idx);
         if (!matched) {
@@ -116,6 +139,8 @@ retry:
                     if (req.route_tracing) { append_route_trace(req, child_node, btree_event_t::MERGE); }
                     unlock_lambda(child_node, child_cur_lock);
                     COUNTER_INCREMENT(m_metrics, btree_merge_count, 1);
+                    COUNTER_INCREMENT_IF_ELSE(m_metrics, child_node->is_leaf(), btree_leaf_merge_count,
+                                              btree_int_merge_count, 1);
                     goto retry;
                 } else if (ret == btree_status_t::merge_not_required) {
                     BT_NODE_LOG(DEBUG, my_node, "merge is not required for child = {} keys: {}", curr_idx,
@@ -171,9 +196,55 @@ out_return:
     // Warning: Do not access childNode or myNode beyond this point, since it would
     // have been unlocked by the recursive function and it could also been deleted.
     if (curlock != locktype_t::NONE) { unlock_lambda(my_node, curlock); }
+    for (auto const id : detached_ids) {
+        free_subtree(id, req.m_op_context);
+    }
     return (at_least_one_child_modified) ? btree_status_t::success : ret;
 }
 
+// Removes the children after start_idx and before end_idx, all of whose keys are within the range being removed. The
+// ranges they covered fold into the child at end_idx, which is left with none of those keys.
+template < typename K, typename V >
+btree_status_t Btree< K, V >::detach_covered_children(const BtreeNodePtr& node, locktype_t& cur_lock,
+                                                      uint32_t start_idx, uint32_t end_idx,
+                                                      std::vector< bnodeid_t >& detached_ids, void* context) {
+    if (cur_lock != locktype_t::WRITE) {
+        auto const ret = upgrade_node_lock(node, cur_lock, context);
+        if (ret != btree_status_t::success) { return ret; }
+    }
+
+    for (auto idx = start_idx + 1; idx < end_idx; ++idx) {
+        BtreeLinkInfo child_info;
+        node->get_nth_value(idx, &child_info, false /* copy */);
+        detached_ids.push_back(child_info.bnode_id());
+    }
+    node->remove(start_idx + 1, end_idx - 1);
+    write_node(node, context);
+    COUNTER_INCREMENT(m_metrics, btree_subtrees_freed, end_idx - start_idx - 1);
+    BT_NODE_LOG(DEBUG, node, "Detached {} children between idx={} and idx={}", end_idx - start_idx - 1, start_idx,
+                end_idx);
+    return btree_status_t::success;
+}
+
+// Frees all the nodes of a subtree detached from the btree. Anyone already in the subtree is done with a node by the
+// time it is write locked here, since the parent is always locked before its children.
+template < typename K, typename V >
+void Btree< K, V >::free_subtree(bnodeid_t id, void* context) {
+    BtreeNodePtr node;
+    auto ret = read_and_lock_node(id, node, locktype_t::WRITE, locktype_t::WRITE, context);
+    if (ret != btree_status_t::success) {
+        BT_LOG(ERROR, "Unable to read the detached node={} to free its subtree, ret={}", id, ret);
+        return;
+    }
+
+    ret = post_order_traversal(node, locktype_t::WRITE, [this, context](const auto& n, bool is_leaf) -> btree_status_t {
+        if (is_leaf) { COUNTER_DECREMENT(m_metrics, btree_obj_count, n->total_entries()); }
+        free_node(n, locktype_t::WRITE, context);
+        return btree_status_t::node_freed;
+    });
+    if (ret != btree_status_t::node_freed) { unlock_node(node, locktype_t::WRITE); }
+}
+
 template < typename K, typename V >
 template < typename ReqT >
 btree_status_t Btree< K, V >::check_collapse_root(ReqT& req) {
@@ -222,6 +293,7 @@ template < typename K, typename V >
 btree_status_t Btree< K, V >::merge_nodes(const BtreeNodePtr& parent_node, const BtreeNodePtr& leftmost_node,
                                           uint32_t start_idx, uint32_t end_idx, void* context) {
     if (!m_bt_cfg.m_merge_turned_on) { return btree_status_t::merge_not_required; }
+    HS_PROBE(btree_merge, leftmost_node->node_id(), start_idx, end_idx);
     btree_status_t ret{btree_status_t::success};
     BtreeNodeList old_nodes;
     BtreeNodeList new_nodes;
@@ -265,11 +337,13 @@ btree_status_t Btree< K, V >::merge_nodes(const BtreeNodePtr& parent_node, const
     }
 
     // Determine if packing the nodes would result in reducing the number of nodes, if so go with that. If else
-    // we revert back to rebalancing the nodes.
-    num_nodes = (total_size == 0) ? 1 : (total_size - 1) / m_bt_cfg.ideal_fill_size() + 1;
+    // we revert back to rebalancing the nodes. Nodes are packed only upto the merge fill, which is below the ideal
+    // fill, so that a merge is not undone by the next few inserts splitting the merged node again.
+    num_nodes = (total_size == 0) ? 1 : (total_size - 1) / m_bt_cfg.merge_fill_size() + 1;
     if (num_nodes >= (old_nodes.size() + 1)) {
         // Only option is to rebalance the nodes across. If we are asked not to do so, skip it.
         if (!m_bt_cfg.m_rebalance_turned_on) {
+            COUNTER_INCREMENT(m_metrics, btree_merge_skipped_count, 1);
             ret = btree_status_t::merge_not_required;
             goto out;
         }
@@ -477,6 +551,7 @@ btree_status_t Btree< K, V >::merge_nodes(const BtreeNodePtr& parent_node, const
         }
 #endif
 
+        drop_leaf_filter(leftmost_node); // Store could write the nodes it transacts without write_node
         ret = transact_nodes(new_nodes, old_nodes, leftmost_node, parent_node, context);
     }
 
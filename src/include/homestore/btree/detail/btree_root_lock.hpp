@@ -0,0 +1,92 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+#include <boost/fiber/operations.hpp>
+#include <iomgr/fiber_lib.hpp>
+
+namespace homestore {
+
+//
+// BtreeRootLock guards the root of the btree, which every operation reads to start its descent but which changes only
+// on a root split or collapse (and on a destroy or bulk load). It is a reader writer lock whose readers count
+// themselves in the slot of their thread (a cache line of its own), so that the readers of different threads don't
+// write to any shared state, and a writer waits for the readers of all the slots to drain. A reader which finds a
+// writer in, steps back out of its slot until the writer is done.
+//
+// Urcu (as CPManager uses it for the current cp) doesn't fit here, since a reader could yield its fiber for a node
+// read in the middle of a descent. A writer waiting for a grace period on the same thread would then never let it
+// finish, whereas here the writer yields its fiber as it waits.
+//
+class BtreeRootLock {
+public:
+    static constexpr uint32_t num_slots{32};
+
+    BtreeRootLock() = default;
+    BtreeRootLock(BtreeRootLock const&) = delete;
+    BtreeRootLock& operator=(BtreeRootLock const&) = delete;
+
+    void lock_shared() {
+        auto& readers = my_slot().readers;
+        while (true) {
+            readers.fetch_add(1); // Seq cst, so that a writer coming in either sees it or it sees the writer
+            if (!m_writer.load()) { return; }
+            readers.fetch_sub(1);
+            while (m_writer.load(std::memory_order_relaxed)) {
+                boost::this_fiber::yield();
+            }
+        }
+    }
+
+    void unlock_shared() { my_slot().readers.fetch_sub(1, std::memory_order_release); }
+
+    void lock() {
+        m_writer_mtx.lock();
+        m_writer.store(true);
+        for (auto& slot : m_slots) {
+            while (slot.readers.load() != 0) {
+                boost::this_fiber::yield();
+            }
+        }
+    }
+
+    void unlock() {
+        m_writer.store(false);
+        m_writer_mtx.unlock();
+    }
+
+private:
+    struct alignas(64) reader_slot {
+        std::atomic< uint64_t > readers{0};
+    };
+
+    reader_slot& my_slot() {
+        static std::atomic< uint32_t > s_next_thread{0};
+        thread_local uint32_t t_slot{s_next_thread.fetch_add(1, std::memory_order_relaxed) % num_slots};
+        return m_slots[t_slot];
+    }
+
+private:
+    std::array< reader_slot, num_slots > m_slots;
+    std::atomic< bool > m_writer{false};
+    iomgr::FiberManagerLib::mutex m_writer_mtx; // Writers in turn
+};
+} // namespace homestore
@@ -0,0 +1,446 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include <homestore/btree/btree_kv.hpp>
+#include <homestore/btree/detail/variant_node.hpp>
+#include <homestore/btree/detail/btree_internal.hpp>
+#include "homestore/index/index_internal.hpp"
+
+SISL_LOGGING_DECL(btree)
+
+namespace homestore {
+
+// CompactNode is a leaf node of fixed size keys and values, which stores only the bytes of the serialized key/value
+// (object) which vary across the entries of the node. The bytes which are same in all the entries are stored once, as
+// part of the base object. For integer keys of a leaf, which are in a narrow range, the upper bytes of the key (and
+// of values like ids or counts) are same and hence not repeated in every entry. Entries are decoded on access.
+//
+// Internal format of the node:
+// [Persistent Header][compact_node_header][varying bytes bitmap][Base object][Entry 0][Entry 1] ...
+//
+// An entry which differs from the base at a byte, which is not varying yet, widens all the entries of the node. Hence
+// the room for a put depends on its key/value (has_room_for_entry). Sizes used for merging the nodes
+// (occupied_size and num_entries_by_size) are uncompressed, so that entries merged into a node always fit irrespective
+// of how much they widen it.
+//
+// It is only a leaf node type, interior nodes of a btree configured with COMPACT are FIXED nodes.
+template < typename K, typename V >
+class CompactNode : public VariantNode< K, V > {
+public:
+    using BtreeNode::get_nth_key_internal;
+    using BtreeNode::get_nth_key_size;
+    using BtreeNode::get_nth_obj_size;
+    using BtreeNode::get_nth_value;
+    using BtreeNode::get_nth_value_size;
+    using BtreeNode::to_string;
+    using VariantNode< K, V >::get_nth_value;
+
+private:
+    static constexpr uint32_t max_obj_size{256};
+    using obj_buf_t = std::array< uint8_t, max_obj_size >;
+
+#pragma pack(1)
+    struct compact_node_header {
+        uint16_t entry_size{0}; // Number of varying bytes of the object, which is what each entry stores
+        // Followed by bitmap of varying bytes and the base object
+    };
+#pragma pack()
+
+    uint32_t m_key_size;
+    uint32_t m_value_size;
+    uint32_t m_obj_size;
+
+public:
+    CompactNode(uint8_t* node_buf, bnodeid_t id, bool init, bool is_leaf, const BtreeConfig& cfg) :
+            VariantNode< K, V >(node_buf, id, init, is_leaf, cfg),
+            m_key_size{dummy_key< K >.serialized_size()},
+            m_value_size{dummy_value< V >.serialized_size()},
+            m_obj_size{m_key_size + m_value_size} {
+        this->set_node_type(btree_node_type::COMPACT);
+        DEBUG_ASSERT_EQ(is_leaf, true, "Compact node is supported only as leaf node");
+        RELEASE_ASSERT(K::is_fixed_size(), "Compact node is supported only for fixed size keys");
+        RELEASE_ASSERT_LE(m_obj_size, max_obj_size, "Key/Value is too big for compact node");
+        if (init) { reset(); }
+    }
+
+    btree_status_t insert(uint32_t ind, const BtreeKey& key, const BtreeValue& val) override {
+        obj_buf_t obj;
+        serialize_obj(key, val, obj.data());
+
+        auto const n = this->total_entries();
+        auto const new_entry_size = entry_size_with(obj.data());
+        if ((n + 1) * new_entry_size > capacity()) { return btree_status_t::space_not_avail; }
+
+        if (n == 0) {
+            set_base(obj.data());
+        } else {
+            widen(obj.data(), new_entry_size);
+        }
+        auto const w = entry_size();
+        uint8_t* e = entries_area() + (ind * w);
+        if (ind < n) { std::memmove(e + w, e, (n - ind) * w); }
+        encode(varying_bitmap(), obj.data(), e);
+        this->inc_entries();
+        this->inc_gen();
+
+#ifndef NDEBUG
+        validate_sanity();
+#endif
+        return btree_status_t::success;
+    }
+
+    void update(uint32_t ind, const BtreeValue& val) override {
+        obj_buf_t obj;
+        decode(ind, obj.data(), m_obj_size);
+        sisl::blob const vb = val.serialize();
+        std::memcpy(obj.data() + m_key_size, vb.cbytes(), m_value_size);
+        update_obj(ind, obj.data());
+    }
+
+    void update(uint32_t ind, const BtreeKey& key, const BtreeValue& val) override {
+        DEBUG_ASSERT_LT(ind, this->total_entries(), "Compact node is a leaf, it has no edge to update");
+        obj_buf_t obj;
+        serialize_obj(key, val, obj.data());
+        update_obj(ind, obj.data());
+    }
+
+    // ind_s and ind_e are inclusive
+    void remove(uint32_t ind_s, uint32_t ind_e) override {
+        auto const n = this->total_entries();
+        DEBUG_ASSERT_LT(ind_e, n, "node={}", to_string());
+        DEBUG_ASSERT_LE(ind_s, ind_e, "node={}", to_string());
+
+        auto const w = entry_size();
+        if (ind_e + 1 < n) {
+            std::memmove(entries_area() + (ind_s * w), entries_area() + ((ind_e + 1) * w), (n - ind_e - 1) * w);
+        }
+        this->sub_entries(ind_e - ind_s + 1);
+        if (this->total_entries() == 0) { reset(); }
+        this->inc_gen();
+#ifndef NDEBUG
+        validate_sanity();
+#endif
+    }
+
+    void remove_all(const BtreeConfig&) override {
+        this->sub_entries(this->total_entries());
+        this->invalidate_edge();
+        reset();
+        this->inc_gen();
+    }
+
+    uint32_t move_out_to_right_by_entries(const BtreeConfig&, BtreeNode& o, uint32_t nentries) override {
+        auto& other = s_cast< CompactNode< K, V >& >(o);
+        auto const n = this->total_entries();
+        nentries = std::min(nentries, n);
+        if (nentries == 0) { return 0; }
+
+        // Entries of both are encoded on their own base, so the other node is rebuilt with the entries moved to it
+        // followed by its own. If they don't fit, less of this node's entries are moved.
+        auto const other_n = other.total_entries();
+        std::vector< uint8_t > objs((nentries + other_n) * m_obj_size);
+        for (uint32_t i{0}; i < nentries; ++i) {
+            decode(n - nentries + i, &objs[i * m_obj_size], m_obj_size);
+        }
+        for (uint32_t i{0}; i < other_n; ++i) {
+            other.decode(i, &objs[(nentries + i) * m_obj_size], m_obj_size);
+        }
+
+        uint32_t skip{0};
+        while ((skip < nentries) &&
+               ((nentries - skip + other_n) * entries_size_of(&objs[skip * m_obj_size], nentries - skip + other_n) >
+                other.capacity())) {
+            ++skip;
+        }
+        nentries -= skip;
+        if (nentries == 0) { return 0; }
+
+        other.rebuild(&objs[skip * m_obj_size], nentries + other_n);
+        this->sub_entries(nentries);
+        recompact();
+
+        other.inc_gen();
+        this->inc_gen();
+
+#ifndef NDEBUG
+        validate_sanity();
+#endif
+        return nentries;
+    }
+
+    uint32_t move_out_to_right_by_size(const BtreeConfig& cfg, BtreeNode& o, uint32_t size) override {
+        auto const w = std::max(entry_size(), 1u);
+        return w * move_out_to_right_by_entries(cfg, o, size / w);
+    }
+
+    uint32_t num_entries_by_size(uint32_t start_idx, uint32_t size) const override {
+        return std::min(size / m_obj_size, this->total_entries() - start_idx);
+    }
+
+    uint32_t copy_by_size(const BtreeConfig& cfg, const BtreeNode& o, uint32_t start_idx, uint32_t size) override {
+        auto& other = s_cast< const CompactNode< K, V >& >(o);
+        return copy_by_entries(cfg, o, start_idx, other.num_entries_by_size(start_idx, size));
+    }
+
+    uint32_t copy_by_entries(const BtreeConfig&, const BtreeNode& o, uint32_t start_idx,
+                             uint32_t nentries) override {
+        auto& other = s_cast< const CompactNode< K, V >& >(o);
+        nentries = std::min(nentries, other.total_entries() - start_idx);
+
+        obj_buf_t obj;
+        uint32_t copied{0};
+        for (; copied < nentries; ++copied) {
+            other.decode(start_idx + copied, obj.data(), m_obj_size);
+            auto const n = this->total_entries();
+            auto const new_entry_size = entry_size_with(obj.data());
+            if ((n + 1) * new_entry_size > capacity()) { break; }
+
+            if (n == 0) {
+                set_base(obj.data());
+            } else {
+                widen(obj.data(), new_entry_size);
+            }
+            encode(varying_bitmap(), obj.data(), entries_area() + (n * entry_size()));
+            this->inc_entries();
+        }
+        this->inc_gen();
+
+        // If we copied everything from start_idx till end and if its an edge node, need to copy the edge id as well.
+        if (other.has_valid_edge() && ((start_idx + copied) == other.total_entries())) {
+            this->set_edge_info(other.edge_info());
+        }
+        return copied;
+    }
+
+    uint32_t available_size() const override { return capacity() - (this->total_entries() * entry_size()); }
+
+    // Uncompressed size of the entries, see the note on merging above
+    uint32_t occupied_size() const override { return this->total_entries() * m_obj_size; }
+
+    // Without the key/value, room is assured only if all the entries could be of uncompressed size
+    bool has_room_for_put(btree_put_type put_type, uint32_t, uint32_t) const override {
+        auto const n = (put_type == btree_put_type::UPDATE) ? this->total_entries() : this->total_entries() + 1;
+        return (n * m_obj_size) <= capacity();
+    }
+
+    bool has_room_for_entry(btree_put_type put_type, const BtreeKey& key, const BtreeValue& val) const override {
+        obj_buf_t obj;
+        serialize_obj(key, val, obj.data());
+        auto const n = (put_type == btree_put_type::UPDATE) ? this->total_entries() : this->total_entries() + 1;
+        return (n * entry_size_with(obj.data())) <= capacity();
+    }
+
+    void get_nth_key_internal(uint32_t ind, BtreeKey& out_key, bool) const override {
+        DEBUG_ASSERT_LT(ind, this->total_entries(), "node={}", to_string());
+        obj_buf_t obj;
+        decode(ind, obj.data(), m_key_size);
+        out_key.deserialize(sisl::blob{obj.data(), m_key_size}, true /* copy */); // Decoded object is transient
+    }
+
+    void get_nth_value(uint32_t ind, BtreeValue* out_val, bool) const override {
+        DEBUG_ASSERT_LT(ind, this->total_entries(), "node={}", to_string());
+        obj_buf_t obj;
+        decode(ind, obj.data(), m_obj_size);
+        out_val->deserialize(sisl::blob{obj.data() + m_key_size, m_value_size}, true /* copy */);
+    }
+
+    uint32_t get_nth_key_size(uint32_t) const override { return m_key_size; }
+    uint32_t get_nth_value_size(uint32_t) const override { return m_value_size; }
+
+    std::string to_string(bool print_friendly = false) const override {
+        auto str = fmt::format("{}id={} level={} nEntries={} {} next_node={} entry_size={}/{} ",
+                               (print_friendly ? "------------------------------------------------------------\n" : ""),
+                               this->node_id(), this->level(), this->total_entries(),
+                               (this->is_leaf() ? "LEAF" : "INTERIOR"), this->next_bnode(), entry_size(), m_obj_size);
+        for (uint32_t i{0}; i < this->total_entries(); ++i) {
+            fmt::format_to(std::back_inserter(str), "{}Entry{} [Key={} Val={}]", (print_friendly ? "\n\t" : " "), i + 1,
+                           BtreeNode::get_nth_key< K >(i, false).to_string(),
+                           this->get_nth_value(i, false).to_string());
+        }
+        return str;
+    }
+
+    std::string to_string_keys(bool = false) const override { return ""; }
+
+#ifndef NDEBUG
+    void validate_sanity() {
+        if (this->total_entries() == 0) { return; }
+
+        // validate if keys are in ascending order
+        K prevKey = BtreeNode::get_nth_key< K >(0, false);
+        for (uint32_t i{1}; i < this->total_entries(); ++i) {
+            K key = BtreeNode::get_nth_key< K >(i, false);
+            if (prevKey.compare(key) > 0) {
+                LOGINFO("non sorted entry : {} -> {} ", prevKey.to_string(), key.to_string());
+                DEBUG_ASSERT(false, "node={}", to_string());
+            }
+            prevKey = key;
+        }
+    }
+#endif
+
+private:
+    compact_node_header* get_header() { return r_cast< compact_node_header* >(this->node_data_area()); }
+    const compact_node_header* get_header_const() const {
+        return r_cast< const compact_node_header* >(this->node_data_area_const());
+    }
+
+    uint32_t bitmap_size() const { return (m_obj_size + 7) / 8; }
+    uint8_t* varying_bitmap() { return this->node_data_area() + sizeof(compact_node_header); }
+    const uint8_t* varying_bitmap() const { return this->node_data_area_const() + sizeof(compact_node_header); }
+    uint8_t* base_obj() { return varying_bitmap() + bitmap_size(); }
+    const uint8_t* base_obj() const { return varying_bitmap() + bitmap_size(); }
+    uint8_t* entries_area() { return base_obj() + m_obj_size; }
+    const uint8_t* entries_area() const { return base_obj() + m_obj_size; }
+
+    uint32_t capacity() const {
+        return this->node_data_size() - (sizeof(compact_node_header) + bitmap_size() + m_obj_size);
+    }
+    uint32_t entry_size() const { return get_header_const()->entry_size; }
+
+    static bool is_varying(const uint8_t* bitmap, uint32_t pos) { return (bitmap[pos / 8] & (1u << (pos % 8))) != 0; }
+
+    void reset() {
+        get_header()->entry_size = 0;
+        std::memset(varying_bitmap(), 0, bitmap_size());
+    }
+
+    void set_base(const uint8_t* obj) {
+        reset();
+        std::memcpy(base_obj(), obj, m_obj_size);
+    }
+
+    void serialize_obj(const BtreeKey& key, const BtreeValue& val, uint8_t* obj) const {
+        sisl::blob const kb = key.serialize();
+        sisl::blob const vb = val.serialize();
+        DEBUG_ASSERT_EQ(kb.size(), m_key_size, "Compact node expects fixed size keys");
+        DEBUG_ASSERT_EQ(vb.size(), m_value_size, "Compact node expects fixed size values");
+        std::memcpy(obj, kb.cbytes(), m_key_size);
+        std::memcpy(obj + m_key_size, vb.cbytes(), m_value_size);
+    }
+
+    // Decodes the first upto bytes of the nth object
+    void decode(uint32_t ind, uint8_t* obj, uint32_t upto) const {
+        decode(varying_bitmap(), entries_area() + (ind * entry_size()), obj, upto);
+    }
+
+    void decode(const uint8_t* bitmap, const uint8_t* e, uint8_t* obj, uint32_t upto) const {
+        const uint8_t* base = base_obj();
+        for (uint32_t p{0}; p < upto; ++p) {
+            obj[p] = is_varying(bitmap, p) ? *(e++) : base[p];
+        }
+    }
+
+    void encode(const uint8_t* bitmap, const uint8_t* obj, uint8_t* e) const {
+        for (uint32_t p{0}; p < m_obj_size; ++p) {
+            if (is_varying(bitmap, p)) { *(e++) = obj[p]; }
+        }
+    }
+
+    // Entry size of the node once the obj is added to it
+    uint32_t entry_size_with(const uint8_t* obj) const {
+        if (this->total_entries() == 0) { return 0; }
+        const uint8_t* bitmap = varying_bitmap();
+        const uint8_t* base = base_obj();
+        uint32_t sz{0};
+        for (uint32_t p{0}; p < m_obj_size; ++p) {
+            if (is_varying(bitmap, p) || (obj[p] != base[p])) { ++sz; }
+        }
+        return sz;
+    }
+
+    // Entry size of the count objects, if encoded on the first of them as base
+    uint32_t entries_size_of(const uint8_t* objs, uint32_t count) const {
+        uint32_t sz{0};
+        for (uint32_t p{0}; p < m_obj_size; ++p) {
+            for (uint32_t i{1}; i < count; ++i) {
+                if (objs[(i * m_obj_size) + p] != objs[p]) {
+                    ++sz;
+                    break;
+                }
+            }
+        }
+        return sz;
+    }
+
+    // Makes the bytes of obj which differ from the base varying, re-encoding the entries. Entries only grow, so they
+    // are re-encoded from the last one, each to an offset at or beyond its current one.
+    void widen(const uint8_t* obj, uint32_t new_entry_size) {
+        auto const old_entry_size = entry_size();
+        if (new_entry_size == old_entry_size) { return; }
+
+        std::array< uint8_t, (max_obj_size + 7) / 8 > old_bitmap;
+        std::memcpy(old_bitmap.data(), varying_bitmap(), bitmap_size());
+        uint8_t* bitmap = varying_bitmap();
+        const uint8_t* base = base_obj();
+        for (uint32_t p{0}; p < m_obj_size; ++p) {
+            if (obj[p] != base[p]) { bitmap[p / 8] |= (1u << (p % 8)); }
+        }
+        get_header()->entry_size = s_cast< uint16_t >(new_entry_size);
+
+        obj_buf_t tmp;
+        for (auto i = this->total_entries(); i > 0; --i) {
+            decode(old_bitmap.data(), entries_area() + ((i - 1) * old_entry_size), tmp.data(), m_obj_size);
+            encode(bitmap, tmp.data(), entries_area() + ((i - 1) * new_entry_size));
+        }
+    }
+
+    void update_obj(uint32_t ind, const uint8_t* obj) {
+        auto const new_entry_size = entry_size_with(obj);
+        RELEASE_ASSERT_LE(this->total_entries() * new_entry_size, capacity(), "No room to update entry in node={}",
+                          to_string());
+        widen(obj, new_entry_size);
+        encode(varying_bitmap(), obj, entries_area() + (ind * entry_size()));
+        this->inc_gen();
+    }
+
+    // Encodes the node afresh with the count objects
+    void rebuild(const uint8_t* objs, uint32_t count) {
+        reset();
+        if (count != 0) {
+            std::memcpy(base_obj(), objs, m_obj_size);
+            uint8_t* bitmap = varying_bitmap();
+            for (uint32_t p{0}; p < m_obj_size; ++p) {
+                for (uint32_t i{1}; i < count; ++i) {
+                    if (objs[(i * m_obj_size) + p] != objs[p]) {
+                        bitmap[p / 8] |= (1u << (p % 8));
+                        break;
+                    }
+                }
+            }
+            get_header()->entry_size = s_cast< uint16_t >(entries_size_of(objs, count));
+            for (uint32_t i{0}; i < count; ++i) {
+                encode(bitmap, &objs[i * m_obj_size], entries_area() + (i * entry_size()));
+            }
+        }
+        this->set_total_entries(count);
+    }
+
+    // Re-encodes the remaining entries, so that the bytes which no longer vary are not stored in every entry
+    void recompact() {
+        auto const n = this->total_entries();
+        std::vector< uint8_t > objs(n * m_obj_size);
+        for (uint32_t i{0}; i < n; ++i) {
+            decode(i, &objs[i * m_obj_size], m_obj_size);
+        }
+        rebuild(objs.data(), n);
+    }
+};
+} // namespace homestore
@@ -0,0 +1,117 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace homestore {
+
+//
+// MemBtreeNodeArena hands out the node buffers of a MemBtree, all of the same node size. Buffers are carved out of
+// chunks of 2MB (or a node, whichever is larger), mapped as anonymous memory and advised to be backed by huge pages,
+// so that a large in-memory btree is in fewer pages. Freed buffers go to the free list of a shard picked by the calling
+// thread, from where it allocates first, so threads mostly reuse the buffers they freed without contending with each
+// other. Chunks are unmapped only when the arena is destroyed.
+//
+class MemBtreeNodeArena {
+public:
+    explicit MemBtreeNodeArena(uint32_t node_size) :
+            m_node_size{node_size}, m_chunk_size{std::max(chunk_size, round_up(node_size, page_size))} {}
+    MemBtreeNodeArena(MemBtreeNodeArena const&) = delete;
+    MemBtreeNodeArena& operator=(MemBtreeNodeArena const&) = delete;
+
+    ~MemBtreeNodeArena() {
+        for (auto* chunk : m_chunks) {
+            ::munmap(chunk, m_chunk_size);
+        }
+    }
+
+    uint8_t* alloc() {
+        auto& s = my_shard();
+        {
+            std::unique_lock lg{s.mtx};
+            if (!s.free_bufs.empty()) {
+                auto* buf = s.free_bufs.back();
+                s.free_bufs.pop_back();
+                return buf;
+            }
+        }
+        return carve();
+    }
+
+    void free(uint8_t* buf) {
+        auto& s = my_shard();
+        std::unique_lock lg{s.mtx};
+        s.free_bufs.push_back(buf);
+    }
+
+    uint64_t num_chunks() const {
+        std::unique_lock lg{m_chunk_mtx};
+        return m_chunks.size();
+    }
+
+private:
+    static constexpr uint32_t num_shards{16};
+    static constexpr uint64_t chunk_size{2 * 1024 * 1024};
+    static constexpr uint64_t page_size{4096};
+
+    struct shard {
+        std::mutex mtx;
+        std::vector< uint8_t* > free_bufs;
+    };
+
+    static uint64_t round_up(uint64_t n, uint64_t align) { return ((n + align - 1) / align) * align; }
+
+    shard& my_shard() { return m_shards[std::hash< std::thread::id >()(std::this_thread::get_id()) % num_shards]; }
+
+    uint8_t* carve() {
+        std::unique_lock lg{m_chunk_mtx};
+        if (m_chunk_remaining < m_node_size) {
+            void* chunk = ::mmap(nullptr, m_chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (chunk == MAP_FAILED) { throw std::bad_alloc(); }
+#ifdef MADV_HUGEPAGE
+            ::madvise(chunk, m_chunk_size, MADV_HUGEPAGE); // Only a hint, chunk is usable with regular pages as well
+#endif
+            m_chunks.push_back(static_cast< uint8_t* >(chunk));
+            m_chunk_cur = static_cast< uint8_t* >(chunk);
+            m_chunk_remaining = m_chunk_size;
+        }
+        auto* buf = m_chunk_cur;
+        m_chunk_cur += m_node_size;
+        m_chunk_remaining -= m_node_size;
+        return buf;
+    }
+
+private:
+    uint32_t const m_node_size;
+    uint64_t const m_chunk_size;
+    std::array< shard, num_shards > m_shards;
+
+    mutable std::mutex m_chunk_mtx;
+    std::vector< uint8_t* > m_chunks;
+    uint8_t* m_chunk_cur{nullptr};
+    uint64_t m_chunk_remaining{0};
+};
+} // namespace homestore
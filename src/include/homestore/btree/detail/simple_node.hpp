@@ -60,11 +60,20 @@ public:
     }
 
     void update(uint32_t ind, const BtreeValue& val) override {
+        // Value is overwritten in place, so the checksum is kept up for just its bytes
+        auto const prev_gen = this->node_gen();
+        auto const val_off = (get_nth_obj_size(ind) * ind) + get_nth_key_size(ind);
+        auto const val_size = get_nth_value_size(ind);
+        bool const incr_csum = (ind < this->total_entries()) && (val_size <= BtreeNode::max_incr_csum_range);
+        std::array< uint8_t, BtreeNode::max_incr_csum_range > old_val;
+        if (incr_csum) { std::memcpy(old_val.data(), this->node_data_area_const() + val_off, val_size); }
+
         set_nth_value(ind, val);
 
         // TODO: Check if we need to upgrade the gen and impact of doing  so with performance. It is especially
         // needed for non similar key/value pairs
         this->inc_gen();
+        if (incr_csum) { this->update_checksum_range(val_off, old_val.data(), val_size, prev_gen); }
 #ifndef NDEBUG
         validate_sanity();
 #endif
@@ -316,6 +325,53 @@ public:
         return get_nth_key(ind, false).compare_range(range);
     }*/
 
+protected:
+    // Keys are of fixed size and stride, so a probe deserializes K in place and compares it with non-virtual calls. The
+    // search is a branchless lower bound, whose probes don't depend on the outcome of the previous compare being
+    // predicted, which makes it miss less than the generic bsearch on the random keys of a lookup.
+    BtreeNode::node_find_result_t bsearch_node(const BtreeKey& key) const override {
+        DEBUG_ASSERT_EQ(this->magic(), BTREE_NODE_MAGIC);
+        auto const n = this->total_entries();
+        if (n == 0) { return std::make_pair(false, 0u); }
+
+        uint32_t const key_size = dummy_key< K >.serialized_size();
+        uint32_t const obj_size = key_size + dummy_value< V >.serialized_size();
+        uint8_t const* keys = this->node_data_area_const();
+        K nth_key;
+        auto const compare_nth = [&](uint32_t ind) {
+            nth_key.K::deserialize(sisl::blob{keys + (ind * obj_size), key_size}, false /* copy */);
+            return nth_key.K::compare(key);
+        };
+
+        uint32_t lo{0};
+        uint32_t len{n};
+        while (len > 1) {
+            auto const half = len / 2;
+            lo += (compare_nth(lo + half - 1) < 0) ? half : 0;
+            len -= half;
+        }
+        auto const x = compare_nth(lo);
+        if (x >= 0) { return std::make_pair(x == 0, lo); }
+        ++lo;
+        return std::make_pair((lo < n) && (compare_nth(lo) == 0), lo);
+    }
+
+public:
+    /// @brief Child of the interior node for the key, as found by an optimistic reader (without the lock of the node).
+    /// Node could be changing underneath, so unlike find, nothing of what is read is asserted, reader validates it all
+    /// against the version of the node instead.
+    bnodeid_t optimistic_child_id(const BtreeKey& key) const {
+        auto const idx = bsearch_node(key).second;
+        if (idx >= this->total_entries()) { return this->edge_id(); }
+
+        BtreeLinkInfo child_info;
+        child_info.deserialize(sisl::blob{this->node_data_area_const() + (get_nth_obj_size(idx) * idx) +
+                                              dummy_key< K >.serialized_size(),
+                                          BtreeLinkInfo::get_fixed_size()},
+                               true /* copy */);
+        return child_info.bnode_id();
+    }
+
     /////////////// Other Internal Methods /////////////
     void set_nth_obj(uint32_t ind, const BtreeKey& k, const BtreeValue& v) {
         if (ind > this->total_entries()) {
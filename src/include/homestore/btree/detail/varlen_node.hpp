@@ -46,6 +46,9 @@ struct var_node_header {
 // Internal format of variable node:
 // [Persistent Header][var node header][Record][Record].. ...  ... [key][value][key][value]
 //
+// If the key has a normalized prefix (KeyWithPrefix), each record ends with the prefix of its key, so that most of the
+// probes of bsearch stay within the array of records.
+//
 template < typename K, typename V >
 class VariableNode : public VariantNode< K, V > {
 public:
@@ -71,6 +74,8 @@ public:
 
     virtual ~VariableNode() = default;
 
+    static constexpr uint32_t key_prefix_size{KeyWithPrefix< K > ? sizeof(uint32_t) : 0};
+
     uint32_t occupied_size() const override {
         return (get_var_node_header_const()->m_init_available_space - sizeof(var_node_header) - available_size());
     }
@@ -150,6 +155,7 @@ public:
             if (val_ptr != vblob.cbytes()) { std::memcpy(val_ptr, vblob.cbytes(), vblob.size()); }
             set_nth_key_len(get_nth_record_mutable(ind), kblob.size());
             set_nth_value_len(get_nth_record_mutable(ind), vblob.size());
+            set_key_prefix(get_nth_record_mutable(ind), kblob);
             get_var_node_header()->m_available_space += cur_obj_size - new_obj_size;
             this->inc_gen();
         } else {
@@ -457,6 +463,7 @@ public:
         assert(ind < this->total_entries());
         assert(kb.size() == get_nth_key_size(ind));
         memcpy(uintptr_cast(get_nth_obj(ind)), kb.cbytes(), kb.size());
+        set_key_prefix(get_nth_record_mutable(ind), kb);
     }
 
     bool has_room_for_put(btree_put_type put_type, uint32_t key_size, uint32_t value_size) const override {
@@ -573,6 +580,31 @@ public:
     }*/
 
 protected:
+    BtreeNode::node_find_result_t bsearch_node(const BtreeKey& key) const override {
+        if constexpr (KeyWithPrefix< K >) {
+            // Same as BtreeNode::bsearch, except that a probe compares the key only if its prefix is same
+            uint32_t const rec_size = this->get_record_size();
+            uint32_t const key_prefix = K::normalized_prefix(key.serialize());
+            int start{-1};
+            int end = int_cast(this->total_entries());
+            while ((end - start) > 1) {
+                int const mid = start + (end - start) / 2;
+                uint32_t const nth_prefix = get_nth_key_prefix(mid, rec_size);
+                int const x = (nth_prefix == key_prefix) ? this->compare_nth_key(key, mid)
+                                                         : ((nth_prefix < key_prefix) ? -1 : 1);
+                if (x == 0) { return std::make_pair(true, uint32_cast(mid)); }
+                if (x > 0) {
+                    end = mid;
+                } else {
+                    start = mid;
+                }
+            }
+            return std::make_pair(false, uint32_cast(end));
+        } else {
+            return BtreeNode::bsearch_node(key);
+        }
+    }
+
     uint32_t insert(uint32_t ind, const sisl::blob& key_blob, const sisl::blob& val_blob) {
         assert(ind <= this->total_entries());
         LOGTRACEMOD(btree, "{}:{}:{}:{}", ind, get_var_node_header()->tail_offset(), get_arena_free_space(),
@@ -606,6 +638,7 @@ protected:
         set_nth_key_len(rec_ptr, key_blob.size());
         set_nth_value_len(rec_ptr, val_blob.size());
         set_record_data_offset(rec_ptr, get_var_node_header()->m_tail_arena_offset);
+        set_key_prefix(rec_ptr, key_blob);
 
         // Copy the contents of key and value in the offset
         uint8_t* raw_data_ptr = offset_to_ptr_mutable(get_var_node_header()->m_tail_arena_offset);
@@ -713,6 +746,21 @@ protected:
         r->m_obj_offset = offset;
     }
 
+    // Prefix is the last key_prefix_size bytes of the record
+    void set_key_prefix(uint8_t* rec_ptr, const sisl::blob& key_blob) {
+        if constexpr (KeyWithPrefix< K >) {
+            uint32_t const prefix = K::normalized_prefix(key_blob);
+            std::memcpy(rec_ptr + this->get_record_size() - key_prefix_size, &prefix, key_prefix_size);
+        }
+    }
+
+    uint32_t get_nth_key_prefix(uint32_t ind, uint32_t rec_size) const {
+        uint8_t const* rec_ptr = this->node_data_area_const() + sizeof(var_node_header) + (ind * rec_size);
+        uint32_t prefix;
+        std::memcpy(&prefix, rec_ptr + rec_size - key_prefix_size, sizeof(prefix));
+        return prefix;
+    }
+
     uint8_t* offset_to_ptr_mutable(uint16_t offset) { return this->node_data_area() + offset; }
 
     const uint8_t* offset_to_ptr(uint16_t offset) const { return this->node_data_area_const() + offset; }
@@ -743,7 +791,9 @@ public:
         return r_cast< const var_key_record* >(this->get_nth_record(ind))->m_key_len;
     }
     uint32_t get_nth_value_size(uint32_t ind) const override { return dummy_value< V >.serialized_size(); }
-    uint32_t get_record_size() const override { return sizeof(var_key_record); }
+    uint32_t get_record_size() const override {
+        return sizeof(var_key_record) + VariableNode< K, V >::key_prefix_size;
+    }
 
     void set_nth_key_len(uint8_t* rec_ptr, uint32_t key_len) override {
         r_cast< var_key_record* >(rec_ptr)->m_key_len = key_len;
@@ -775,7 +825,9 @@ public:
     uint32_t get_nth_value_size(uint32_t ind) const override {
         return r_cast< const var_value_record* >(this->get_nth_record(ind))->m_value_len;
     }
-    uint32_t get_record_size() const override { return sizeof(var_value_record); }
+    uint32_t get_record_size() const override {
+        return sizeof(var_value_record) + VariableNode< K, V >::key_prefix_size;
+    }
 
     void set_nth_key_len(uint8_t* rec_ptr, uint32_t key_len) override {
         assert(key_len == dummy_key< K >.serialized_size());
@@ -809,7 +861,9 @@ public:
     uint32_t get_nth_value_size(uint32_t ind) const override {
         return r_cast< const var_obj_record* >(this->get_nth_record(ind))->m_value_len;
     }
-    uint32_t get_record_size() const override { return sizeof(var_obj_record); }
+    uint32_t get_record_size() const override {
+        return sizeof(var_obj_record) + VariableNode< K, V >::key_prefix_size;
+    }
 
     void set_nth_key_len(uint8_t* rec_ptr, uint32_t key_len) override {
         r_cast< var_obj_record* >(rec_ptr)->m_key_len = key_len;
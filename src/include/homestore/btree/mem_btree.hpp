@@ -20,16 +20,27 @@
 
 #define StoreSpecificBtreeNode BtreeNode
 
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+#include <vector>
+
 #include "btree.ipp"
+#include <homestore/btree/detail/mem_btree_node_arena.hpp>
 
 namespace homestore {
 template < typename K, typename V >
 class MemBtree : public Btree< K, V > {
 private:
-    std::vector< std::shared_ptr< uint8_t[] > > node_buf_ptr_vec;
+    MemBtreeNodeArena m_node_arena;
+
+    // Nodes freed from the btree, whose buffers go back to the arena once no one else holds the node. Declared after
+    // the arena, so that whatever is left is released before the arena goes away.
+    std::mutex m_free_mtx;
+    std::vector< BtreeNodePtr > m_pending_free;
 
 public:
-    MemBtree(const BtreeConfig& cfg) : Btree< K, V >(cfg) {
+    MemBtree(const BtreeConfig& cfg) : Btree< K, V >(cfg), m_node_arena{cfg.node_size()} {
         BT_LOG(INFO, "New {} being created: Node size {}", btree_store_type(), cfg.node_size());
         auto const status = this->create_root_node(nullptr);
         if (status != btree_status_t::success) { throw std::runtime_error(fmt::format("Unable to create root node")); }
@@ -42,12 +53,15 @@ public:
 
     std::string btree_store_type() const override { return "MEM_BTREE"; }
 
+    // Node buffers are never swapped and are released only in free_node_impl
+    bool supports_optimistic_reads() const override { return true; }
+
+    // Id of the node is its address, the first lines of which have its lock and header pointer
+    void prefetch_node(bnodeid_t id) const override { __builtin_prefetch(r_cast< const void* >(id)); }
+
 private:
     BtreeNodePtr alloc_node(bool is_leaf) override {
-        std::shared_ptr< uint8_t[] > ptr(new uint8_t[this->m_bt_cfg.node_size()]);
-        node_buf_ptr_vec.emplace_back(ptr);
-
-        auto new_node = this->init_node(ptr.get(), bnodeid_t{0}, true, is_leaf);
+        auto new_node = this->init_node(m_node_arena.alloc(), bnodeid_t{0}, true, is_leaf);
         new_node->set_node_id(bnodeid_t{r_cast< std::uintptr_t >(new_node)});
         new_node->m_refcount.increment();
         return BtreeNodePtr{new_node};
@@ -64,7 +78,27 @@ private:
         return btree_status_t::success;
     }
 
-    void free_node_impl(const BtreeNodePtr& node, void* context) override { intrusive_ptr_release(node.get()); }
+    // Node is unlinked from the btree by now (and optimistic readers are done with it), but an op which got hold of it
+    // before could still be waiting on its lock, upon which it reads the node deleted off its buffer. So the buffer
+    // goes back to the arena only once the node is held by none other than the pending list.
+    void free_node_impl(const BtreeNodePtr& node, void*) override {
+        std::vector< BtreeNodePtr > to_free;
+        {
+            std::unique_lock lg{m_free_mtx};
+            m_pending_free.push_back(node);
+            intrusive_ptr_release(node.get()); // Ref taken in alloc_node
+            auto it = std::partition(m_pending_free.begin(), m_pending_free.end(),
+                                     [](BtreeNodePtr const& n) { return !n->m_refcount.test_le(1); });
+            std::move(it, m_pending_free.end(), std::back_inserter(to_free));
+            m_pending_free.erase(it, m_pending_free.end());
+        }
+
+        for (auto& n : to_free) {
+            auto* buf = n->m_phys_node_buf;
+            n.reset();
+            m_node_arena.free(buf);
+        }
+    }
 
     btree_status_t transact_nodes(const BtreeNodeList& new_nodes, const BtreeNodeList& freed_nodes,
                                   const BtreeNodePtr& left_child_node, const BtreeNodePtr& parent_node,
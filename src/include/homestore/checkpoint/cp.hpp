@@ -29,7 +29,9 @@
  * consequences in btree.
  * 1. It doesn't allow a cp to start if io is still in cp critical section. CP critical section is code between
  * cp_io_enter() and cp_io_exit().
- * 2. It doesn't allow two cps to start simultanously. second CP doesn't start until cp_done is not called in first cp.
+ * 2. It doesn't allow two cps to start simultanously. second CP doesn't start until cp_done is not called in first cp,
+ * unless all the consumers which are still flushing the first cp allow overlapped flushes. Even then, each consumer
+ * flushes the second cp only after it is done with the first and the second cp is done only after the first.
  * 3. It call cp prepare. Purpose of this function is to create new cp and also to decide what operations we want to do
  * in that CP.
  * 4. New cp doesn't start until cp prepare is not called on a current cp.
@@ -77,13 +79,33 @@ VENUM(cp_consumer_t, uint8_t,
       SENTINEL = 4         // Should always be the last in this list
 );
 
+struct cp_enter_shard {
+    alignas(64) std::atomic< int64_t > val{0};
+};
+static constexpr uint32_t cp_num_enter_shards{64};
+static constexpr int64_t cp_enter_cnt_bias{int64_t{1} << 48};
+
 struct CP {
     std::atomic< cp_status_t > m_cp_status{cp_status_t::cp_unknown};
-    sisl::atomic_counter< int64_t > m_enter_cnt;
+
+    // IOs in the critical section of the cp. Until the cp is switched over, each thread counts its ios on its own
+    // shard, so entering the cp doesn't contend on a shared counter. At switchover, CPManager flips the counting to
+    // m_enter_cnt (under rcu) and folds the shards into it, after which the drain is detected on m_enter_cnt. Till the
+    // shards are folded in, m_enter_cnt carries a bias, so the ios exiting meanwhile can't take it to zero early.
+    std::array< cp_enter_shard, cp_num_enter_shards > m_enter_shards;
+    std::atomic< bool > m_enter_sharded{true};
+    sisl::atomic_counter< int64_t > m_enter_cnt{cp_enter_cnt_bias};
     CPManager* m_cp_mgr;
     cp_id_t m_cp_id;
     std::array< std::unique_ptr< CPContext >, (size_t)cp_consumer_t::SENTINEL > m_contexts;
     folly::SharedPromise< bool > m_comp_promise;
+    std::array< folly::SharedPromise< bool >, (size_t)cp_consumer_t::SENTINEL > m_consumer_flush_comp;
+    std::array< bool, (size_t)cp_consumer_t::SENTINEL > m_consumer_skip{}; // Consumers carrying this cp over to next
+    CP* m_next_cp{nullptr};                                                 // CP switched over to from this one
+    Clock::time_point m_trigger_time;
+    Clock::time_point m_flush_start_time; // Once all ios exited the critical section of the cp
+    std::array< Clock::time_point, (size_t)cp_consumer_t::SENTINEL > m_consumer_start_time; // Started to flush
+    std::array< uint64_t, (size_t)cp_consumer_t::SENTINEL > m_consumer_flush_us{};          // Took to flush
 #ifdef _PRERELEASE
     std::atomic< bool > m_abrupt_cp{false};
 #endif
@@ -98,8 +120,17 @@ public:
         m_contexts[(size_t)consumer] = std::move(context);
     }
 
+    int64_t enter_count() const {
+        if (!m_enter_sharded.load()) { return m_enter_cnt.get(); }
+        int64_t cnt{0};
+        for (auto const& shard : m_enter_shards) {
+            cnt += shard.val.load(std::memory_order_relaxed);
+        }
+        return cnt;
+    }
+
     std::string to_string() const {
-        return fmt::format("CP={}: status={}, enter_count={}", m_cp_id, enum_name(get_status()), m_enter_cnt.get());
+        return fmt::format("CP={}: status={}, enter_count={}", m_cp_id, enum_name(get_status()), enter_count());
     }
 };
 } // namespace homestore
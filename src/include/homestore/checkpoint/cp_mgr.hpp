@@ -16,9 +16,11 @@
 #pragma once
 #include <atomic>
 #include <array>
+#include <deque>
 #include <mutex>
 #include <memory>
 #include <functional>
+#include <vector>
 
 #include <iomgr/iomgr.hpp>
 #include <sisl/metrics/metrics.hpp>
@@ -29,13 +31,20 @@
 
 namespace homestore {
 static constexpr size_t MAX_CP_COUNT{2};
+static constexpr size_t MAX_FLUSHING_CP_COUNT{2}; // CPs in flush at a time, when flushes overlap
 
 class CPMgrMetrics : public sisl::MetricsGroup {
 public:
     explicit CPMgrMetrics() : sisl::MetricsGroup("CPMgr") {
         REGISTER_COUNTER(back_to_back_cps, "back to back cp");
         REGISTER_COUNTER(cp_cnt, "cp cnt");
+        REGISTER_COUNTER(overlapped_cps, "cps triggered while previous cp is flushing");
+        REGISTER_COUNTER(partial_cps, "cps in which some consumers carried their dirty state over to next cp");
+        REGISTER_COUNTER(slow_cps, "cps which took more than cp_slow_flush_threshold_ms");
+        REGISTER_GAUGE(cp_flush_progress_pct, "flush progress of the oldest cp in flush, averaged across consumers");
         REGISTER_HISTOGRAM(cp_latency, "cp latency (in us)");
+        REGISTER_HISTOGRAM(cp_drain_latency, "time (in us) from cp trigger till ios exit its critical section");
+        REGISTER_HISTOGRAM(cp_flush_latency, "time (in us) from start of cp flush till all consumers are done");
         register_me_to_farm();
     }
 
@@ -46,10 +55,30 @@ public:
     ~CPMgrMetrics() { deregister_me_from_farm(); }
 };
 
+class CPConsumerMetrics : public sisl::MetricsGroup {
+public:
+    explicit CPConsumerMetrics(cp_consumer_t consumer) : sisl::MetricsGroup("CPConsumer", enum_name(consumer)) {
+        REGISTER_COUNTER(cp_consumer_slow_cps, "slow cps in which this consumer took the longest");
+        REGISTER_HISTOGRAM(cp_consumer_wait_latency,
+                           "time (in us) the consumer waited on previous cp and its dependencies to start flush");
+        REGISTER_HISTOGRAM(cp_consumer_flush_latency, "time (in us) the consumer took to flush a cp");
+        REGISTER_HISTOGRAM(cp_consumer_flush_bytes, "bytes the consumer wrote to flush a cp",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        register_me_to_farm();
+    }
+
+    CPConsumerMetrics(const CPConsumerMetrics&) = delete;
+    CPConsumerMetrics(CPConsumerMetrics&&) noexcept = delete;
+    CPConsumerMetrics& operator=(const CPConsumerMetrics&) = delete;
+    CPConsumerMetrics& operator=(const CPConsumerMetrics&&) noexcept = delete;
+    ~CPConsumerMetrics() { deregister_me_from_farm(); }
+};
+
 class CPContext {
 protected:
     CP* m_cp;
     folly::Promise< bool > m_flush_comp;
+    std::atomic< uint64_t > m_flushed_bytes{0}; // Written by the consumer so far, to flush the cp
 
 public:
     CPContext(CP* cp) : m_cp{cp} {}
@@ -64,6 +93,8 @@ public:
     bool is_abrupt() { return m_cp->m_abrupt_cp.load(); }
 #endif
     folly::Future< bool > get_future() { return m_flush_comp.getFuture(); }
+    void add_flushed_bytes(uint64_t bytes) { m_flushed_bytes.fetch_add(bytes, std::memory_order_relaxed); }
+    uint64_t flushed_bytes() const { return m_flushed_bytes.load(std::memory_order_relaxed); }
 
     virtual ~CPContext() = default;
 };
@@ -86,6 +117,21 @@ public:
     /// @param done_cb Callback after cp is done
     virtual folly::Future< bool > cp_flush(CP* cp) = 0;
 
+    /// @brief Instead of cp_flush, CPManager calls this method on the CPs this consumer skips (see cp_flush_interval),
+    /// once all IOs of the CP are done. Consumer is expected to carry the dirty state gathered in the CP over to the
+    /// next CP, so that it is flushed along with it. Required for consumers with cp_flush_interval more than 1.
+    /// @param cp CP which is skipped
+    /// @param next_cp CP which was switched over to from the skipped one
+    virtual void cp_carry_over(CP*, CP*) {}
+
+    /// @brief Flush only every nth CP and skip the rest, unless the CP is flushed by a consumer which depends on this
+    /// one or it is the CP flushed at shutdown.
+    virtual uint32_t cp_flush_interval() const { return 1; }
+
+    /// @brief Consumers whose flush of a CP has to be done before this consumer starts flushing the same CP. Any CP
+    /// this consumer flushes is flushed by them as well. Dependencies can't form a cycle.
+    virtual std::vector< cp_consumer_t > cp_flush_depends_on() const { return {}; }
+
     /// @brief After all consumers flushed the CP, CPManager calls this method to clean up any CP related structures
     /// @param cp
     virtual void cp_cleanup(CP* cp) = 0;
@@ -97,9 +143,15 @@ public:
     /// @brief In case CP is not progressing at all, CPManager calls this method to attempt the consumer to push harder
     /// to flush. Consumers are expected to increase any flow control to ensure flush goes faster.
     virtual void repair_slow_cp() {}
+
+    /// @brief Can the next CP be triggered while this consumer is still flushing the current one. Its flush of the next
+    /// CP is started only after it is done with the current one. Consumers which expect IOs only on the CP being
+    /// flushed and the CP after it (like index write back cache) should not allow it.
+    virtual bool supports_overlapped_flush() const { return false; }
 };
 
 class CPWatchdog;
+class CPTriggerPolicy;
 
 static constexpr uint64_t cp_sb_magic{0xc0c0c01a};
 static constexpr uint32_t cp_sb_version{0x1};
@@ -149,18 +201,24 @@ public:
  */
 class CPManager {
     friend class CPGuard;
+    friend class CPTriggerPolicy;
+    friend class CPWatchdog;
 
 private:
     CP* m_cur_cp{nullptr}; // Current CP information
     std::unique_ptr< CPMgrMetrics > m_metrics;
     std::mutex m_trigger_cp_mtx;
     std::array< std::unique_ptr< CPCallbacks >, (size_t)cp_consumer_t::SENTINEL > m_cp_cb_table;
+    std::array< std::unique_ptr< CPConsumerMetrics >, (size_t)cp_consumer_t::SENTINEL > m_consumer_metrics;
     std::unique_ptr< CPWatchdog > m_wd_cp;
+    std::unique_ptr< CPTriggerPolicy > m_trigger_policy;
+    std::array< cp_enter_shard, cp_num_enter_shards > m_io_enter_cnts; // Foreground ios, for trigger policy
     superblk< cp_mgr_super_block > m_sb;
     std::vector< iomgr::io_fiber_t > m_cp_io_fibers;
     iomgr::timer_handle_t m_cp_timer_hdl;
     bool m_cp_shutdown_initiated{false};
-    bool m_in_flush_phase{false};
+    std::deque< CP* > m_flushing_cps; // CPs triggered and not done with flush yet, oldest first
+    std::array< uint32_t, (size_t)cp_consumer_t::SENTINEL > m_cps_skipped{}; // CPs skipped since last flush
     bool m_pending_trigger_cp{false}; // Is there is a waiter for a cp flush to start
     folly::SharedPromise< bool > m_pending_trigger_cp_comp;
 
@@ -224,8 +282,14 @@ public:
 private:
     void cp_ref(CP* cp);
     void create_first_cp();
+    bool is_flushing();
+    bool can_overlap_flush(bool flush_on_shutdown) const;
+    void plan_consumer_flushes(CP* cp, bool flush_all);
+    bool depends_on(size_t consumer_idx, size_t other_idx, size_t depth) const;
     void cp_start_flush(CP* cp);
     void on_cp_flush_done(CP* cp);
+    void report_flush_stats(CP* cp);
+    void update_flush_progress();
     void cleanup_cp(CP* cp);
     void on_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie);
     void start_cp_thread();
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+
 // Only x86 and x86_64 supported by Intel Storage Acceleration library
 #ifndef NO_ISAL
 #include <isa-l/crc.h>
@@ -12,5 +15,53 @@ uint16_t crc16_t10dif(uint16_t seed, const unsigned char* buf, uint64_t len);
 
 // crc32_ieee reference function, slow crc32 from the definition.
 uint32_t crc32_ieee(uint32_t seed, const unsigned char* buf, uint64_t len);
+
+// crc32_iscsi (crc32c) reference function, slow crc32c from the definition.
+unsigned int crc32_iscsi(unsigned char* buffer, int len, unsigned int init_crc);
 }
 #endif
+
+namespace homestore {
+namespace crc_detail {
+static constexpr uint32_t crc32c_poly{0x82F63B78}; // castagnoli, reflected
+
+// Product of a and b modulo the polynomial, both being polynomials of the reflected crc (a is not 0)
+constexpr uint32_t crc32c_multmodp(uint32_t a, uint32_t b) {
+    uint32_t m = uint32_t{1} << 31;
+    uint32_t p{0};
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) { break; }
+        }
+        m >>= 1;
+        b = (b & 1) ? ((b >> 1) ^ crc32c_poly) : (b >> 1);
+    }
+    return p;
+}
+
+// x^(2^k) modulo the polynomial, by k
+constexpr std::array< uint32_t, 32 > make_crc32c_x2n_table() {
+    std::array< uint32_t, 32 > t{};
+    uint32_t p = uint32_t{1} << 30; // x^1
+    t[0] = p;
+    for (uint32_t k{1}; k < 32; ++k) {
+        p = crc32c_multmodp(p, p);
+        t[k] = p;
+    }
+    return t;
+}
+inline constexpr auto crc32c_x2n_table = make_crc32c_x2n_table();
+} // namespace crc_detail
+
+/// @brief crc32c of whatever crc is of, followed by len zero bytes, without going over them (as in zlib crc32_combine).
+/// Same as crc32_iscsi, no inversion. Since crc is linear, crc32_iscsi of data with some of its bytes changed is its
+/// earlier crc ^ crc32c_shift(crc32_iscsi(old ^ new bytes, 0), bytes after them).
+inline uint32_t crc32c_shift(uint32_t crc, uint64_t len) {
+    uint32_t xp = uint32_t{1} << 31; // x^0
+    for (uint32_t k{3}; len != 0; len >>= 1, ++k) { // x^(8 * len)
+        if (len & 1) { xp = crc_detail::crc32c_multmodp(crc_detail::crc32c_x2n_table[k & 31], xp); }
+    }
+    return crc_detail::crc32c_multmodp(xp, crc);
+}
+} // namespace homestore
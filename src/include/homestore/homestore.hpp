@@ -127,6 +127,11 @@ private:
     HS_SERVICE m_services; // Services homestore is starting with
     hs_before_services_starting_cb_t m_before_services_starting_cb{nullptr};
     std::atomic< bool > m_init_done{false};
+    std::vector< std::pair< std::string, uint64_t > > m_svc_start_times_ms; // Time each service took to start
+    uint64_t m_dev_load_ms{0};                                              // Time loading the devices took
+    Clock::time_point m_start_time;                                         // When start() was called
+    std::vector< hs_start_phase > m_start_phases;                           // In the order they started
+    uint64_t m_start_total_ms{0}; // From start() till homestore is ready to take io
 
 public:
     HomeStore() = default;
@@ -157,6 +162,25 @@ public:
     bool is_first_time_boot() const;
     bool is_initializing() const { return !m_init_done; }
 
+    /// @brief Time in ms each of the services (meta, cp, index, data, log, repl) took to start (recover) on this boot,
+    /// preceded by the time loading the devices took (devices), if they were not formatted on this boot
+    std::vector< std::pair< std::string, uint64_t > > const& service_start_times_ms() const {
+        return m_svc_start_times_ms;
+    }
+
+    /// @brief All the phases of the start on this boot: services (creating them), devices (discovering and loading
+    /// them), format (on first boot), before_services_cb (if given), the start of each of the services as in
+    /// service_start_times_ms and ready (timers started), in the order they started, with start_ms since start().
+    std::vector< hs_start_phase > const& start_phases() const { return m_start_phases; }
+
+    /// @brief Time in ms from start() till homestore is ready to take io (including the time till format_and_start
+    /// was called on first boot)
+    uint64_t start_total_ms() const { return m_start_total_ms; }
+
+    /// @brief Capacity of each vdev with its write and space burn rates, over the samples of the last
+    /// capacity_history_samples intervals or, if recent, over the last interval alone. Empty until 2 samples are taken.
+    std::vector< vdev_capacity_rate > capacity_rates(bool recent = false) const;
+
     // Getters
     bool has_index_service() const;
     bool has_data_service() const;
@@ -185,6 +209,7 @@ private:
     shared< VirtualDev > create_vdev_cb(const vdev_info& vinfo, bool load_existing);
     uint64_t pct_to_size(float pct, HSDevType dev_type) const;
     void do_start();
+    void add_start_phase(std::string const& name, Clock::time_point phase_start, Clock::time_point phase_end);
 };
 
 static HomeStore* hs() { return HomeStore::instance(); }
@@ -97,18 +97,68 @@ ENUM(io_flag, uint8_t,
      DIRECT_IO,   // recommended mode
      READ_ONLY    // Read-only mode for post-mortem checks
 );
-ENUM(blk_allocator_type_t, uint8_t, none, fixed, varsize, append);
+ENUM(blk_allocator_type_t, uint8_t, none, fixed, varsize, append, extent);
 ENUM(chunk_selector_type_t, uint8_t, // What are the options to select chunk to allocate a block
      NONE,                           // Caller want nothing to be set
      ROUND_ROBIN,                    // Pick round robin
      CUSTOM,                         // Controlled by the upper layer
      RANDOM,                         // Pick any chunk in uniformly random fashion
      MOST_AVAILABLE_SPACE,           // Pick the most available space
-     ALWAYS_CALLER_CONTROLLED        // Expect the caller to always provide the specific chunkid
+     ALWAYS_CALLER_CONTROLLED,       // Expect the caller to always provide the specific chunkid
+     LOAD_AWARE                      // Pick based on queue depth, latency of the pdev and free space of the chunk
 );
 
 ENUM(vdev_size_type_t, uint8_t, VDEV_SIZE_STATIC, VDEV_SIZE_DYNAMIC);
 
+// Priority class of device ios. Anything other than foreground is subject to the device's throttle of its class.
+ENUM(io_priority_t, uint8_t,
+     foreground, // Latency critical consumer ios
+     background, // Gc, tiering and other internal work which could be paced
+     recovery,   // Resync and data fetched for (or served to) other replicas
+     cp_flush    // Index buffers and allocator bitmaps written by cp flush
+);
+
+/// @brief Priority of the ios submitted by the current thread
+inline io_priority_t& thread_io_priority() {
+    static thread_local io_priority_t s_prio{io_priority_t::foreground};
+    return s_prio;
+}
+
+/// @brief Tag the ios submitted by the current thread, until the guard goes out of scope, with the given priority
+class io_priority_guard {
+public:
+    explicit io_priority_guard(io_priority_t prio) : m_prev{thread_io_priority()} { thread_io_priority() = prio; }
+    io_priority_guard(io_priority_guard const&) = delete;
+    io_priority_guard& operator=(io_priority_guard const&) = delete;
+    ~io_priority_guard() { thread_io_priority() = m_prev; }
+
+private:
+    io_priority_t m_prev;
+};
+
+// Tenant (like a replication group) the device ios are accounted to and fair shared between. 0 is untagged, which
+// is all the internal ios not issued on behalf of any tenant.
+using io_tenant_t = uint64_t;
+static constexpr io_tenant_t untagged_io_tenant{0};
+
+/// @brief Tenant of the ios submitted by the current thread
+inline io_tenant_t& thread_io_tenant() {
+    static thread_local io_tenant_t s_tenant{untagged_io_tenant};
+    return s_tenant;
+}
+
+/// @brief Tag the ios submitted by the current thread, until the guard goes out of scope, with the given tenant
+class io_tenant_guard {
+public:
+    explicit io_tenant_guard(io_tenant_t tenant) : m_prev{thread_io_tenant()} { thread_io_tenant() = tenant; }
+    io_tenant_guard(io_tenant_guard const&) = delete;
+    io_tenant_guard& operator=(io_tenant_guard const&) = delete;
+    ~io_tenant_guard() { thread_io_tenant() = m_prev; }
+
+private:
+    io_tenant_t m_prev;
+};
+
 ////////////// All structs ///////////////////
 struct dev_info {
     explicit dev_info(std::string name, HSDevType type = HSDevType::Data) : dev_name{std::move(name)}, dev_type{type} {}
@@ -157,6 +207,7 @@ struct hs_format_params {
     vdev_size_type_t vdev_size_type{vdev_size_type_t::VDEV_SIZE_STATIC};
     blk_allocator_type_t alloc_type{blk_allocator_type_t::varsize};
     chunk_selector_type_t chunk_sel_type{chunk_selector_type_t::ROUND_ROBIN};
+    float fast_tier_size_pct{0}; // Data service only: size pct of fast device to use as write tier, 0 to disable
 };
 
 struct hs_input_params {
@@ -206,6 +257,26 @@ struct cap_attrs {
 };
 #endif
 
+// Phase of the homestore start, with when it started (since HomeStore::start was called) and the time it took
+struct hs_start_phase {
+    std::string name;
+    uint64_t start_ms{0};
+    uint64_t took_ms{0};
+};
+
+// Capacity of a vdev and its rates of change, across the samples of resource_limits.capacity_sample_interval_ms
+struct vdev_capacity_rate {
+    std::string name;
+    uint64_t size{0};
+    uint64_t used_size{0};   // As of the latest sample
+    double write_bytes_ps{0}; // Bytes written to the vdev per sec
+    double used_bytes_ps{0};  // Growth of the used size per sec, negative while space is freed faster than used
+    uint64_t secs_to_full{0}; // At used_bytes_ps, 0 if the used size is not growing
+    bool is_journal{false};   // Journal vdev, whose used_bytes_ps is the journal growth
+
+    nlohmann::json to_json() const;
+};
+
 } // namespace homestore
 
 ////////////// Misc ///////////////////
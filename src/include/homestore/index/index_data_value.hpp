@@ -0,0 +1,84 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <folly/futures/Future.h>
+#include <homestore/blk.h>
+#include <homestore/btree/btree_kv.hpp>
+
+namespace homestore {
+
+//
+// IndexDataValue is a value of an index for a payload, which is kept in the leaf itself if it is upto
+// btree.index_inline_value_max_bytes, else in the data service with the value referring to its blks. Small payloads
+// are then read by the lookup of the index alone, without a read of the data. It is of variable size, so it is meant
+// for the VAR_OBJECT (or VAR_VALUE) leaves.
+//
+// write() decides on it by the size of the payload, so a payload which grows past the inline size spills over to the
+// data service on its next write (and one which shrinks moves back into the leaf). Blks of the value it replaces are
+// for the caller to free (free_data), once the index is updated with the new one.
+//
+class IndexDataValue : public BtreeValue {
+public:
+    IndexDataValue() = default;
+    IndexDataValue(IndexDataValue const& other) = default;
+    IndexDataValue& operator=(IndexDataValue const& other) = default;
+    IndexDataValue(sisl::blob const& b, bool copy) : BtreeValue() { deserialize(b, copy); }
+    ~IndexDataValue() override = default;
+
+    /// @brief Value of the payload, inline or written to the data service
+    /// @return Future of the error of the write, the value (which has to stay valid until then) is set once it succeeds
+    static folly::Future< std::error_code > write(uint8_t const* data, uint32_t size, IndexDataValue& out_value);
+
+    /// @brief Read the payload to buf, which has room for data_size() bytes. Inline payload is copied right away.
+    folly::Future< std::error_code > read(uint8_t* buf) const;
+
+    /// @brief Free the blks of the payload, if it is in the data service
+    folly::Future< std::error_code > free_data() const;
+
+    bool is_inline() const { return !m_bytes.empty() && (hdr()->is_inline != 0); }
+    uint32_t data_size() const { return m_bytes.empty() ? 0 : hdr()->data_size; }
+
+    /// @brief Blks of the payload, valid only if it is not inline
+    MultiBlkId blkid() const;
+
+    sisl::blob serialize() const override { return sisl::blob{m_bytes.data(), uint32_cast(m_bytes.size())}; }
+    uint32_t serialized_size() const override { return uint32_cast(m_bytes.size()); }
+    static uint32_t get_fixed_size() { return 0; }
+    void deserialize(sisl::blob const& b, bool) override { m_bytes.assign(b.cbytes(), b.cbytes() + b.size()); }
+    std::string to_string() const override;
+
+    bool operator==(IndexDataValue const& other) const { return (m_bytes == other.m_bytes); }
+
+private:
+#pragma pack(1)
+    struct value_hdr {
+        uint8_t is_inline;
+        uint32_t data_size;
+    };
+#pragma pack()
+
+    value_hdr const* hdr() const { return r_cast< value_hdr const* >(m_bytes.data()); }
+    void set(bool is_inline, uint32_t data_size, uint8_t const* bytes, uint32_t nbytes);
+
+private:
+    std::vector< uint8_t > m_bytes; // Header followed by the payload (if inline) or the serialized blkid
+};
+} // namespace homestore
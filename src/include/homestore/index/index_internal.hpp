@@ -15,8 +15,14 @@
  *********************************************************************************/
 #pragma once
 
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
+#include <folly/SharedMutex.h>
+#include <sisl/metrics/metrics.hpp>
 #include <sisl/utility/atomic_counter.hpp>
 #include <homestore/blk.h>
 #include <homestore/homestore_decl.hpp>
@@ -63,7 +69,36 @@ struct IndexBuffer;
 using IndexBufferPtr = std::shared_ptr< IndexBuffer >;
 using IndexBufferPtrList = folly::small_vector< IndexBufferPtr, 3 >;
 
+// Point in time view of an index table, which a scan of it reads as of, no matter the writes after it is taken
+struct IndexSnapshot {
+    uint64_t seq;      // Order of the snapshots of the table
+    bnodeid_t root_id; // Root of the table as of the snapshot
+};
+using IndexSnapshotPtr = std::shared_ptr< IndexSnapshot const >;
+
 // An Empty base class to have the IndexService not having to template and refer the IndexTable virtual class
+class IndexTableMetrics : public sisl::MetricsGroup {
+public:
+    explicit IndexTableMetrics(const char* inst_name) : sisl::MetricsGroup("IndexTable", inst_name) {
+        REGISTER_COUNTER(index_node_cache_hits, "Number of nodes of the index found in the cache");
+        REGISTER_COUNTER(index_node_cache_misses, "Number of nodes of the index read from the device on a cache miss");
+        REGISTER_HISTOGRAM(index_cp_dirty_nodes, "Number of nodes of the index dirtied by a cp",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(index_cp_flush_bytes, "Bytes of the nodes of the index written by a cp",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(index_cp_flush_latency_us,
+                           "Time from the start of a cp flush until all the nodes of the index are written (us)");
+        REGISTER_COUNTER(index_snapshot_node_copies, "Number of nodes copied on their first write after a snapshot");
+        register_me_to_farm();
+    }
+
+    IndexTableMetrics(const IndexTableMetrics&) = delete;
+    IndexTableMetrics(IndexTableMetrics&&) noexcept = delete;
+    IndexTableMetrics& operator=(const IndexTableMetrics&) = delete;
+    IndexTableMetrics& operator=(IndexTableMetrics&&) noexcept = delete;
+    ~IndexTableMetrics() { deregister_me_from_farm(); }
+};
+
 class IndexTableBase {
 public:
     virtual ~IndexTableBase() = default;
@@ -73,6 +108,9 @@ public:
     virtual void destroy() = 0;
     virtual void repair_node(IndexBufferPtr const& buf) = 0;
     virtual void repair_root(IndexBufferPtr const& buf) = 0;
+    virtual uint32_t num_pending_repairs() const = 0;
+    virtual void repair_pending_nodes() = 0;
+    virtual IndexTableMetrics& index_metrics() = 0;
 };
 
 enum class index_buf_state_t : uint8_t {
@@ -106,11 +144,16 @@ struct IndexBuffer : public sisl::ObjLifeCounter< IndexBuffer > {
     void set_crash_flag() { m_crash_flag_on = true; }
 #endif
 
-    uint32_t m_index_ordinal{0};  // Ordinal of the index table this buffer belongs to, used only during recovery
+    uint32_t m_index_ordinal{0};  // Ordinal of the index table this buffer belongs to, set once it is dirtied
     uint8_t m_is_meta_buf{false}; // Is the index buffer writing to metablk?
     bool m_node_freed{false};
+    bool m_delta_flushed{false}; // Was this buffer persisted as a delta in cp journal instead of writing it
+
+    // Image of the node as it is on disk, which deltas are taken against. Kept only for leaf nodes in delta mode and
+    // shared by the copies of the buffer made across cps.
+    std::shared_ptr< uint8_t[] > m_disk_image;
 
-    IndexBuffer(BlkId blkid, uint32_t buf_size, uint32_t align_size);
+    IndexBuffer(BlkId blkid, uint32_t buf_size, uint32_t align_size, int numa_node = -1);
     IndexBuffer(uint8_t* raw_bytes, BlkId blkid);
     virtual ~IndexBuffer();
 
@@ -145,6 +188,37 @@ public:
 
     void attach_buf(IndexBufferPtr const& buf) { m_idx_buf = buf; }
     uint8_t* raw_buffer() { return m_idx_buf->raw_buffer(); }
+
+    /// @brief Get the pinned child at the child index, as long as it is still the child of that id and not freed
+    bool get_pinned_child(uint32_t idx, bnodeid_t id, boost::intrusive_ptr< BtreeNode >& child) {
+        if (!m_has_pinned.load(std::memory_order_acquire)) { return false; }
+        std::shared_lock lg{m_pinned_mtx};
+        if (idx >= m_pinned_children.size()) { return false; }
+        auto const& [child_id, child_node] = m_pinned_children[idx];
+        if ((child_id != id) || (child_node == nullptr) || child_node->is_node_deleted()) { return false; }
+        child = child_node;
+        return true;
+    }
+
+    void pin_child(uint32_t idx, boost::intrusive_ptr< BtreeNode > const& child) {
+        std::unique_lock lg{m_pinned_mtx};
+        if (idx >= m_pinned_children.size()) { m_pinned_children.resize(idx + 1); }
+        m_pinned_children[idx] = {child->node_id(), child};
+        m_has_pinned.store(true, std::memory_order_release);
+    }
+
+    void unpin_children() {
+        if (!m_has_pinned.load(std::memory_order_acquire) || !m_has_pinned.exchange(false)) { return; }
+        std::unique_lock lg{m_pinned_mtx};
+        m_pinned_children.clear();
+    }
+
+private:
+    // Direct pointers to the children by their index in this node, held only while the node is in the pinned top
+    // levels of its table. Entries go stale as the node changes and are then refilled on the next read of that index.
+    folly::SharedMutex m_pinned_mtx;
+    std::vector< std::pair< bnodeid_t, boost::intrusive_ptr< BtreeNode > > > m_pinned_children;
+    std::atomic< bool > m_has_pinned{false};
 };
 
 } // namespace homestore
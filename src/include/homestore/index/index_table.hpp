@@ -17,6 +17,15 @@
 
 #include <vector>
 #include <atomic>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <optional>
+#include <boost/fiber/condition_variable.hpp>
+#include <boost/fiber/mutex.hpp>
+#include <folly/futures/Future.h>
+#include <iomgr/iomgr.hpp>
 #include <homestore/index/index_internal.hpp>
 #include <homestore/btree/btree.ipp>
 #include <homestore/superblk_handler.hpp>
@@ -35,10 +44,44 @@ class IndexTable : public IndexTableBase, public Btree< K, V > {
 private:
     superblk< index_table_sb > m_sb;
     shared< MetaIndexBuffer > m_sb_buffer;
+    mutable IndexTableMetrics m_index_metrics;
+
+    // Root of the pinned top levels (m_bt_cfg.m_pinned_levels), each pinned node holds direct pointers to its pinned
+    // children, which keeps all of them resident in the cache.
+    mutable folly::SharedMutex m_pinned_root_mtx;
+    mutable BtreeNodePtr m_pinned_root;
+    mutable std::atomic< uint16_t > m_pinned_root_level{0};
+
+    mutable std::atomic< uint32_t > m_next_io_fiber{0}; // Round robin of the sync io fibers to run async ops on
+
+    // Nodes the recovery found to be repaired, each is repaired on its first read or by the background repair,
+    // whichever is first. The cp which recovered them is held until all of them are repaired, so that the repairs are
+    // persisted by it, same as if they were repaired during recovery. The lock only guards the pending list, a node
+    // is marked in progress while it is repaired, so that reads of it by others wait on the cv for it to be done.
+    struct pending_repair {
+        IndexBufferPtr buf;
+        bool in_progress{false};
+    };
+    mutable boost::fibers::mutex m_repair_mtx; // Fiber aware, since reads waiting for a repair could be on fibers
+    mutable boost::fibers::condition_variable m_repair_cv;
+    mutable std::unordered_map< bnodeid_t, pending_repair > m_pending_repairs;
+    mutable std::atomic< uint32_t > m_num_pending_repairs{0};
+    mutable std::unique_ptr< CPGuard > m_repair_cpg;
+
+    // Snapshots open (by their seq) and the images of the nodes written since. Image of a node is saved on its first
+    // write after a snapshot, under the seq of the latest snapshot open, and is the node as of all the snapshots after
+    // the previous image of the node upto that seq.
+    mutable std::mutex m_snap_mtx;
+    std::multiset< uint64_t > m_snapshots;
+    mutable std::unordered_map< bnodeid_t, std::vector< std::pair< uint64_t, BtreeNodePtr > > > m_snap_images;
+    mutable std::atomic< uint32_t > m_num_snapshots{0};
+    uint64_t m_last_snap_seq{0};
 
 public:
     IndexTable(uuid_t uuid, uuid_t parent_uuid, uint32_t user_sb_size, const BtreeConfig& cfg) :
-            Btree< K, V >{cfg}, m_sb{"index"} {
+            Btree< K, V >{cfg}, m_sb{"index"}, m_index_metrics{cfg.name().c_str()} {
+        validate_node_size();
+
         // Create a superblk for the index table and create MetaIndexBuffer corresponding to that
         m_sb.create(sizeof(index_table_sb));
         m_sb->uuid = uuid;
@@ -54,13 +97,16 @@ public:
         if (status != btree_status_t::success) { throw std::runtime_error(fmt::format("Unable to create root node")); }
     }
 
-    IndexTable(superblk< index_table_sb >&& sb, const BtreeConfig& cfg) : Btree< K, V >{cfg}, m_sb{std::move(sb)} {
+    IndexTable(superblk< index_table_sb >&& sb, const BtreeConfig& cfg) :
+            Btree< K, V >{cfg}, m_sb{std::move(sb)}, m_index_metrics{cfg.name().c_str()} {
+        validate_node_size();
         m_sb_buffer = std::make_shared< MetaIndexBuffer >(m_sb);
         this->set_root_node_info(BtreeLinkInfo{m_sb->root_node, m_sb->root_link_version});
     }
 
     void destroy() override {
         Btree< K, V >::destroy_btree(nullptr);
+        pin_root(nullptr);
         m_sb.destroy();
     }
 
@@ -73,6 +119,7 @@ public:
 
     template < typename ReqT >
     btree_status_t put(ReqT& put_req) {
+        hs()->index_service().throttle_writer();
         auto ret = btree_status_t::success;
         do {
             auto cpg = cp_mgr().cp_guard();
@@ -85,6 +132,7 @@ public:
 
     template < typename ReqT >
     btree_status_t remove(ReqT& remove_req) {
+        hs()->index_service().throttle_writer();
         auto ret = btree_status_t::success;
         do {
             auto cpg = cp_mgr().cp_guard();
@@ -95,12 +143,161 @@ public:
         return ret;
     }
 
-    void repair_node(IndexBufferPtr const& idx_buf) override {
-        BtreeNode* n = this->init_node(idx_buf->raw_buffer(), idx_buf->blkid().to_integer(), true,
-                                       BtreeNode::identify_leaf_node(idx_buf->raw_buffer()));
-        static_cast< IndexBtreeNode* >(n)->attach_buf(idx_buf);
+    /// @brief Async versions of the btree operations. Nodes missing the cache are read synchronously, which suspends
+    /// only the fiber if it is sync io capable, so the operation is run on one of the sync io fibers of the reactor,
+    /// if not called from one. Request (and the output of query) must stay valid until the future is completed.
+    template < typename ReqT >
+    folly::Future< btree_status_t > async_put(ReqT& put_req) {
+        return run_on_io_fiber([this, &put_req]() { return put(put_req); });
+    }
+
+    template < typename ReqT >
+    folly::Future< btree_status_t > async_remove(ReqT& remove_req) {
+        return run_on_io_fiber([this, &remove_req]() { return remove(remove_req); });
+    }
+
+    template < typename ReqT >
+    folly::Future< btree_status_t > async_get(ReqT& get_req) const {
+        return run_on_io_fiber([this, &get_req]() { return Btree< K, V >::get(get_req); });
+    }
+
+    folly::Future< btree_status_t > async_query(BtreeQueryRequest< K >& query_req,
+                                                std::vector< std::pair< K, V > >& out_values) const {
+        return run_on_io_fiber(
+            [this, &query_req, &out_values]() { return Btree< K, V >::query(query_req, out_values); });
+    }
+
+    /// @brief Build the index bottom up from the key/values returned by next_kv, until it returns false. Keys are
+    /// expected in sorted order without duplicates and the index to be empty. Nodes are packed upto the ideal fill size
+    /// and the new tree is made visible by the cp it is built in, so all of its nodes stay dirty until then.
+    btree_status_t bulk_load(std::function< bool(K&, V&) > const& next_kv) {
+        std::unique_lock lg{this->m_btree_lock};
         auto cpg = cp_mgr().cp_guard();
-        repair_links(BtreeNodePtr{n}, (void*)cpg.context(cp_consumer_t::INDEX_SVC));
+        auto context = (void*)cpg.context(cp_consumer_t::INDEX_SVC);
+
+        BtreeNodePtr old_root;
+        auto ret = this->read_node_impl(this->m_root_node_info.bnode_id(), old_root);
+        if (ret != btree_status_t::success) { return ret; }
+        if (!old_root->is_leaf() || (old_root->total_entries() != 0)) {
+            BT_LOG(ERROR, "Bulk load is supported only on an empty index");
+            return btree_status_t::not_supported;
+        }
+
+        std::vector< BtreeNodePtr > nodes;
+        ret = build_bulk_levels(next_kv, nodes);
+        if ((ret != btree_status_t::success) || nodes.empty()) {
+            for (auto const& n : nodes) {
+                this->free_node(n, locktype_t::NONE, context);
+            }
+            return ret;
+        }
+
+        // Last node built is the root, rest are linked to be flushed ahead of the superblk pointing to the root
+        IndexBufferPtrList new_bufs;
+        for (auto const& n : nodes) {
+            this->write_node(n, context);
+            if (n != nodes.back()) { new_bufs.push_back(static_cast< IndexBtreeNode* >(n.get())->m_idx_buf); }
+        }
+
+        auto const& root = nodes.back();
+        this->m_root_node_info = BtreeLinkInfo{root->node_id(), root->link_version()};
+        ret = on_root_changed(root, context);
+        if (ret != btree_status_t::success) {
+            this->m_root_node_info = BtreeLinkInfo{old_root->node_id(), old_root->link_version()};
+            for (auto const& n : nodes) {
+                this->free_node(n, locktype_t::NONE, context);
+            }
+            return ret;
+        }
+        wb_cache().transact_new_bufs(ordinal(), static_cast< IndexBtreeNode* >(root.get())->m_idx_buf, new_bufs,
+                                     r_cast< CPContext* >(context));
+        this->free_node(old_root, locktype_t::NONE, context);
+
+        BT_LOG(INFO, "Bulk loaded index with {} nodes upto level {}", nodes.size(), root->level());
+        return btree_status_t::success;
+    }
+
+    /// @brief Take a point in time snapshot of the index, which query_snapshot reads as of. Writers are held off only
+    /// while it is taken, for the ops in flight to finish; from then on a node is copied on its first write, until the
+    /// snapshot is released with its last reference. Index has to outlive its snapshots.
+    IndexSnapshotPtr take_snapshot() {
+        std::unique_lock lg{this->m_btree_lock};
+        std::unique_lock slg{m_snap_mtx};
+        auto snap = new IndexSnapshot{.seq = ++m_last_snap_seq, .root_id = this->m_root_node_info.bnode_id()};
+        m_snapshots.insert(snap->seq);
+        m_num_snapshots.store(uint32_cast(m_snapshots.size()), std::memory_order_release);
+        return IndexSnapshotPtr{snap, [this](IndexSnapshot const* s) {
+                                    release_snapshot(s->seq);
+                                    delete s;
+                                }};
+    }
+
+    /// @brief Range query of the index as of the snapshot, same as query otherwise. Nodes are not locked leaf to leaf,
+    /// a node not written since the snapshot is read locked only while its entries are read, others are read from
+    /// their images.
+    btree_status_t query_snapshot(IndexSnapshot const& snap, BtreeQueryRequest< K >& qreq,
+                                  std::vector< std::pair< K, V > >& out_values) const {
+        if (qreq.batch_size() == 0) { return btree_status_t::success; }
+
+        BtreeNodePtr node;
+        bool live{false};
+        auto ret = read_snapshot_node(snap, snap.root_id, node, live);
+        while ((ret == btree_status_t::success) && !node->is_leaf()) {
+            BtreeLinkInfo child_info;
+            node->find(qreq.first_key(), &child_info, false);
+            release_snapshot_node(node, live);
+            ret = read_snapshot_node(snap, child_info.bnode_id(), node, live);
+        }
+
+        uint32_t count{0};
+        while (ret == btree_status_t::success) {
+            uint32_t start_idx{0};
+            uint32_t end_idx{0};
+            count += to_variant_node(node)->multi_get(qreq.working_range(), qreq.batch_size() - count, start_idx,
+                                                      end_idx, &out_values, qreq.filter());
+            auto const next_id = node->next_bnode();
+            bool const at_end = (node->total_entries() != 0) &&
+                (node->template get_last_key< K >().compare(qreq.input_range().end_key()) >= 0);
+            release_snapshot_node(node, live);
+
+            if (count >= qreq.batch_size()) {
+                ret = btree_status_t::has_more;
+                break;
+            }
+            if (at_end || (next_id == empty_bnodeid)) { break; }
+            ret = read_snapshot_node(snap, next_id, node, live);
+        }
+
+        if (!out_values.empty() && ((ret == btree_status_t::success) || (ret == btree_status_t::has_more))) {
+            K out_last_key = out_values.back().first;
+            if (out_last_key.compare(qreq.input_range().end_key()) >= 0) { ret = btree_status_t::success; }
+            qreq.shift_working_range(std::move(out_last_key), false /* non inclusive*/);
+        }
+        return ret;
+    }
+
+    // Called by the recovery, which only queues up the node to be repaired, see repair_if_pending()
+    void repair_node(IndexBufferPtr const& idx_buf) override {
+        std::unique_lock lg{m_repair_mtx};
+        if (m_repair_cpg == nullptr) { m_repair_cpg = std::make_unique< CPGuard >(cp_mgr().cp_guard()); }
+        m_pending_repairs.insert_or_assign(idx_buf->blkid().to_integer(), pending_repair{idx_buf});
+        m_num_pending_repairs.store(uint32_cast(m_pending_repairs.size()));
+    }
+
+    uint32_t num_pending_repairs() const override { return m_num_pending_repairs.load(); }
+    IndexTableMetrics& index_metrics() override { return m_index_metrics; }
+
+    void repair_pending_nodes() override {
+        while (m_num_pending_repairs.load() != 0) {
+            bnodeid_t id;
+            {
+                std::unique_lock lg{m_repair_mtx};
+                if (m_pending_repairs.empty()) { break; }
+                id = m_pending_repairs.begin()->first;
+            }
+            repair_if_pending(id);
+        }
+        BT_LOG(INFO, "Repaired all the nodes found by recovery");
     }
 
     void repair_root(IndexBufferPtr const& root_buf) override {
@@ -112,9 +309,30 @@ public:
     }
 
 protected:
+    // Callers off the io reactors can block, same as the sync io fibers which suspend on node reads, so they run it
+    // inline. Only the rest (the main fiber of the reactor) hands it over.
+    folly::Future< btree_status_t > run_on_io_fiber(std::function< btree_status_t() >&& op) const {
+        if (!iomanager.am_i_io_reactor() || iomanager.am_i_sync_io_capable()) { return folly::makeFuture(op()); }
+
+        auto const fibers = iomanager.sync_io_capable_fibers();
+        if (fibers.empty()) { return folly::makeFuture(op()); }
+        auto promise = std::make_shared< folly::Promise< btree_status_t > >();
+        auto fut = promise->getFuture();
+        iomanager.run_on_forget(fibers[m_next_io_fiber.fetch_add(1) % fibers.size()],
+                                [op = std::move(op), promise]() { promise->setValue(op()); });
+        return fut;
+    }
+
+    void validate_node_size() const {
+        if (!hs()->index_service().is_node_size_supported(this->m_node_size)) {
+            throw std::runtime_error(fmt::format("Index node size={} is not supported by the index vdev of blk size={}",
+                                                 this->m_node_size, hs()->index_service().node_size()));
+        }
+    }
+
     ////////////////// Override Implementation of underlying store requirements //////////////////
     BtreeNodePtr alloc_node(bool is_leaf) override {
-        return wb_cache().alloc_buf([this, is_leaf](const IndexBufferPtr& idx_buf) -> BtreeNodePtr {
+        return wb_cache().alloc_buf(this->m_node_size, [this, is_leaf](const IndexBufferPtr& idx_buf) -> BtreeNodePtr {
             BtreeNode* n = this->init_node(idx_buf->raw_buffer(), idx_buf->blkid().to_integer(), true, is_leaf);
             static_cast< IndexBtreeNode* >(n)->attach_buf(idx_buf);
             return BtreeNodePtr{n};
@@ -130,6 +348,7 @@ protected:
             // It was clean before, dirtying it first time, add it to the wb_cache list to flush
             BT_DBG_ASSERT_EQ(idx_node->m_idx_buf->m_dirtied_cp_id, cp_ctx->id(),
                              "Writing a node which was not acquired by this cp");
+            idx_node->m_idx_buf->m_index_ordinal = ordinal();
             wb_cache().write_buf(node, idx_node->m_idx_buf, cp_ctx);
             LOGTRACEMOD(wbcache, "add to dirty list cp {} {}", cp_ctx->id(), idx_node->m_idx_buf->to_string());
         } else {
@@ -168,27 +387,118 @@ protected:
         return btree_status_t::success;
     }
 
+    // Repairs the node before its first read, if the recovery found it to be repaired. The node is kept pending until
+    // it is repaired, so that a concurrent read of it waits for the repair. Repair of a node reads its children, which
+    // are repaired first in turn by the same fiber, so the lock is never held across the repair and its reads.
+    void repair_if_pending(bnodeid_t id) const {
+        if (m_num_pending_repairs.load() == 0) { return; }
+
+        IndexBufferPtr idx_buf;
+        std::optional< CPGuard > cpg;
+        {
+            std::unique_lock lg{m_repair_mtx};
+            auto it = m_pending_repairs.find(id);
+            while ((it != m_pending_repairs.end()) && it->second.in_progress) {
+                m_repair_cv.wait(lg);
+                it = m_pending_repairs.find(id);
+            }
+            if (it == m_pending_repairs.end()) { return; }
+
+            it->second.in_progress = true;
+            idx_buf = it->second.buf;
+            cpg.emplace(*m_repair_cpg);
+        }
+
+        BtreeNode* n = this->init_node(idx_buf->raw_buffer(), idx_buf->blkid().to_integer(), true,
+                                       BtreeNode::identify_leaf_node(idx_buf->raw_buffer()));
+        static_cast< IndexBtreeNode* >(n)->attach_buf(idx_buf);
+        const_cast< IndexTable* >(this)->repair_links(BtreeNodePtr{n}, (void*)cpg->context(cp_consumer_t::INDEX_SVC));
+        cpg.reset();
+
+        // Last repair releases the cp of the recovery, outside the lock
+        std::unique_ptr< CPGuard > recovery_cpg;
+        {
+            std::unique_lock lg{m_repair_mtx};
+            m_pending_repairs.erase(id);
+            m_num_pending_repairs.store(uint32_cast(m_pending_repairs.size()));
+            if (m_pending_repairs.empty()) { recovery_cpg = std::move(m_repair_cpg); }
+        }
+        m_repair_cv.notify_all();
+    }
+
     btree_status_t read_node_impl(bnodeid_t id, BtreeNodePtr& node) const override {
+        repair_if_pending(id);
+        if (this->m_bt_cfg.m_pinned_levels && get_pinned_root(id, node)) { return btree_status_t::success; }
         try {
-            wb_cache().read_buf(id, node, [this](const IndexBufferPtr& idx_buf) mutable -> BtreeNodePtr {
-                bool is_leaf = BtreeNode::identify_leaf_node(idx_buf->raw_buffer());
-                BtreeNode* n = this->init_node(idx_buf->raw_buffer(), idx_buf->blkid().to_integer(),
-                                               false /* init_buf */, is_leaf);
-                static_cast< IndexBtreeNode* >(n)->attach_buf(idx_buf);
-                return BtreeNodePtr{n};
-            });
+            auto const trace_id = Tracer::current();
+            auto const start_time = (trace_id != invalid_trace_id) ? Clock::now() : Clock::time_point{};
+            if (wb_cache().read_buf(id, node, read_node_initializer())) {
+                COUNTER_INCREMENT(m_index_metrics, index_node_cache_hits, 1);
+            } else {
+                COUNTER_INCREMENT(m_index_metrics, index_node_cache_misses, 1);
+                Tracer::record(trace_id, "index_node_read", start_time, id);
+            }
+            if (this->m_bt_cfg.m_pinned_levels && (id == this->m_root_node_info.bnode_id())) { pin_root(node); }
             return btree_status_t::success;
         } catch (std::exception& e) { return btree_status_t::node_read_failed; }
     }
 
+    // Reads ahead a window of the children, unless they are pinned already
+    void read_ahead_children(BtreeNodePtr const& parent, uint32_t start_idx, uint32_t end_idx) const override {
+        auto const max_nodes = wb_cache().prefetch_window();
+        if ((max_nodes == 0) || is_pinned_level(parent->level() - 1)) { return; }
+
+        std::vector< bnodeid_t > ids;
+        end_idx = std::min(end_idx, start_idx + max_nodes - 1);
+        for (auto i = start_idx; i <= end_idx; ++i) {
+            BtreeLinkInfo child_info;
+            if (i < parent->total_entries()) {
+                parent->get_nth_value(i, &child_info, false);
+            } else if (parent->has_valid_edge()) {
+                child_info = parent->get_edge_value();
+            } else {
+                break;
+            }
+            ids.push_back(child_info.bnode_id());
+        }
+        if (!ids.empty()) { wb_cache().prefetch_bufs(ids, read_node_initializer()); }
+    }
+
+    node_initializer_t read_node_initializer() const {
+        return [this](const IndexBufferPtr& idx_buf) -> BtreeNodePtr {
+            bool is_leaf = BtreeNode::identify_leaf_node(idx_buf->raw_buffer());
+            BtreeNode* n = this->init_node(idx_buf->raw_buffer(), idx_buf->blkid().to_integer(), false /* init_buf */,
+                                           is_leaf);
+            static_cast< IndexBtreeNode* >(n)->attach_buf(idx_buf);
+            return BtreeNodePtr{n};
+        };
+    }
+
+    btree_status_t read_child_node_impl(BtreeNodePtr const& parent, uint32_t child_idx, bnodeid_t id,
+                                        BtreeNodePtr& node) const override {
+        auto idx_parent = static_cast< IndexBtreeNode* >(parent.get());
+        if (!is_pinned_level(parent->level() - 1)) {
+            // Tree could have grown taller since this node had pinned its children
+            idx_parent->unpin_children();
+            return read_node_impl(id, node);
+        }
+
+        if (idx_parent->get_pinned_child(child_idx, id, node)) { return btree_status_t::success; }
+        auto const ret = read_node_impl(id, node);
+        if (ret == btree_status_t::success) { idx_parent->pin_child(child_idx, node); }
+        return ret;
+    }
+
     btree_status_t refresh_node(const BtreeNodePtr& node, bool for_read_modify_write, void* context) const override {
         if (context == nullptr || !for_read_modify_write) { return btree_status_t::success; }
+        if (m_num_snapshots.load(std::memory_order_acquire) != 0) { save_snapshot_image(node); }
         return wb_cache().get_writable_buf(node, r_cast< CPContext* >(context)) ? btree_status_t::success
                                                                                 : btree_status_t::cp_mismatch;
     }
 
     void free_node_impl(const BtreeNodePtr& node, void* context) override {
         auto n = static_cast< IndexBtreeNode* >(node.get());
+        n->unpin_children();
         wb_cache().free_buf(n->m_idx_buf, r_cast< CPContext* >(context));
     }
 
@@ -202,6 +512,155 @@ protected:
 
         auto& root_buf = static_cast< IndexBtreeNode* >(new_root.get())->m_idx_buf;
         wb_cache().transact_bufs(ordinal(), m_sb_buffer, root_buf, {}, {}, r_cast< CPContext* >(context));
+        if (this->m_bt_cfg.m_pinned_levels) { pin_root(new_root); }
+        return btree_status_t::success;
+    }
+
+    // Called with the node write locked, before it is written (or freed)
+    void save_snapshot_image(BtreeNodePtr const& node) const {
+        std::unique_lock lg{m_snap_mtx};
+        if (m_snapshots.empty()) { return; }
+        auto const seq = *m_snapshots.rbegin();
+        auto& images = m_snap_images[node->node_id()];
+        if (!images.empty() && (images.back().first >= seq)) { return; } // Saved already since the latest snapshot
+
+        // Image is only read in memory, it is never written to the device
+        auto const& cur_buf = static_cast< IndexBtreeNode* >(node.get())->m_idx_buf;
+        auto img_buf = std::make_shared< IndexBuffer >(cur_buf->m_blkid, this->m_node_size, sizeof(uint64_t));
+        std::memcpy(img_buf->raw_buffer(), cur_buf->raw_buffer(), this->m_node_size);
+        BtreeNode* n = this->init_node(img_buf->raw_buffer(), node->node_id(), false /* init_buf */, node->is_leaf());
+        static_cast< IndexBtreeNode* >(n)->attach_buf(img_buf);
+        images.emplace_back(seq, BtreeNodePtr{n});
+        COUNTER_INCREMENT(m_index_metrics, index_snapshot_node_copies, 1);
+    }
+
+    bool find_snapshot_image(uint64_t seq, bnodeid_t id, BtreeNodePtr& node) const {
+        std::unique_lock lg{m_snap_mtx};
+        auto const it = m_snap_images.find(id);
+        if (it == m_snap_images.end()) { return false; }
+        for (auto const& [img_seq, img] : it->second) {
+            if (img_seq >= seq) {
+                node = img;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Node as of the snapshot, which is the node itself (read locked, live) if it is not written since
+    btree_status_t read_snapshot_node(IndexSnapshot const& snap, bnodeid_t id, BtreeNodePtr& node, bool& live) const {
+        live = false;
+        if (find_snapshot_image(snap.seq, id, node)) { return btree_status_t::success; }
+
+        BtreeNodePtr cur_node;
+        auto ret = read_node_impl(id, cur_node);
+        if (ret != btree_status_t::success) { return ret; }
+        ret = this->lock_node(cur_node, locktype_t::READ, nullptr);
+        if (ret != btree_status_t::success) { return ret; }
+
+        // Could have been written in between the lookup and the lock, in which case its image is saved by now
+        if (find_snapshot_image(snap.seq, id, node)) {
+            this->unlock_node(cur_node, locktype_t::READ);
+            return btree_status_t::success;
+        }
+        node = std::move(cur_node);
+        live = true;
+        return btree_status_t::success;
+    }
+
+    void release_snapshot_node(BtreeNodePtr& node, bool live) const {
+        if (live) { this->unlock_node(node, locktype_t::READ); }
+        node.reset();
+    }
+
+    void release_snapshot(uint64_t seq) {
+        std::unique_lock lg{m_snap_mtx};
+        m_snapshots.erase(m_snapshots.find(seq));
+        m_num_snapshots.store(uint32_cast(m_snapshots.size()), std::memory_order_release);
+
+        // Images which none of the snapshots open is as of are dropped
+        for (auto it = m_snap_images.begin(); it != m_snap_images.end();) {
+            std::vector< std::pair< uint64_t, BtreeNodePtr > > kept;
+            uint64_t prev_seq{0};
+            for (auto& [img_seq, img] : it->second) {
+                auto const snap_it = m_snapshots.upper_bound(prev_seq);
+                if ((snap_it != m_snapshots.end()) && (*snap_it <= img_seq)) {
+                    kept.emplace_back(img_seq, std::move(img));
+                }
+                prev_seq = img_seq;
+            }
+            if (kept.empty()) {
+                it = m_snap_images.erase(it);
+            } else {
+                it->second = std::move(kept);
+                ++it;
+            }
+        }
+    }
+
+    bool get_pinned_root(bnodeid_t id, BtreeNodePtr& node) const {
+        std::shared_lock lg{m_pinned_root_mtx};
+        if ((m_pinned_root == nullptr) || (m_pinned_root->node_id() != id) || m_pinned_root->is_node_deleted()) {
+            return false;
+        }
+        node = m_pinned_root;
+        return true;
+    }
+
+    void pin_root(BtreeNodePtr const& root) const {
+        std::unique_lock lg{m_pinned_root_mtx};
+        m_pinned_root = root;
+        if (root) { m_pinned_root_level.store(root->level(), std::memory_order_relaxed); }
+    }
+
+    // Levels are counted from the leaves, so the top K levels are the ones within K of the root level
+    bool is_pinned_level(uint32_t level) const {
+        if (this->m_bt_cfg.m_pinned_levels == 0) { return false; }
+        return (level + this->m_bt_cfg.m_pinned_levels) > m_pinned_root_level.load(std::memory_order_relaxed);
+    }
+
+    // Builds the nodes of bulk load level by level, each level linked by next_bnode and its last node taking the last
+    // child as edge. All the nodes built are returned, last of them being the root.
+    btree_status_t build_bulk_levels(std::function< bool(K&, V&) > const& next_kv, std::vector< BtreeNodePtr >& nodes) {
+        std::vector< BtreeNodePtr > level_nodes;
+        auto const start_node = [this, &level_nodes, &nodes](bool is_leaf, uint16_t level) {
+            auto n = is_leaf ? this->alloc_leaf_node() : this->alloc_interior_node();
+            if (n == nullptr) { return false; }
+            n->set_level(level);
+            if (!level_nodes.empty()) { level_nodes.back()->set_next_bnode(n->node_id()); }
+            level_nodes.push_back(n);
+            nodes.push_back(std::move(n));
+            return true;
+        };
+        auto const is_packed = [this](BtreeNodePtr const& n, BtreeKey const& key, BtreeValue const& value) {
+            return !n->has_room_for_entry(btree_put_type::INSERT, key, value) ||
+                ((n->node_data_size() - n->available_size()) >= this->m_bt_cfg.ideal_fill_size());
+        };
+
+        K key;
+        V value;
+        while (next_kv(key, value)) {
+            if (level_nodes.empty() || is_packed(level_nodes.back(), key, value)) {
+                if (!start_node(true /* is_leaf */, 0u)) { return btree_status_t::space_not_avail; }
+            }
+            auto& leaf = level_nodes.back();
+            leaf->insert(leaf->total_entries(), key, value);
+        }
+
+        while (level_nodes.size() > 1) {
+            auto const children = std::move(level_nodes);
+            level_nodes.clear();
+            auto const level = s_cast< uint16_t >(children.front()->level() + 1);
+            for (size_t i{0}; i < children.size() - 1; ++i) {
+                auto const last_key = children[i]->get_last_key< K >();
+                if (level_nodes.empty() || is_packed(level_nodes.back(), last_key, children[i]->link_info())) {
+                    if (!start_node(false /* is_leaf */, level)) { return btree_status_t::space_not_avail; }
+                }
+                auto& parent = level_nodes.back();
+                parent->insert(parent->total_entries(), last_key, children[i]->link_info());
+            }
+            level_nodes.back()->set_edge_value(children.back()->link_info());
+        }
         return btree_status_t::success;
     }
 
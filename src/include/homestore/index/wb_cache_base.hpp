@@ -16,6 +16,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 #include <sisl/utility/atomic_counter.hpp>
 #include <homestore/blk.h>
@@ -36,16 +37,29 @@ public:
 
     /// @brief Allocate the buffer and initialize the btree node. It adds the node to the wb cache.
     /// @tparam K Key type of the Index
+    /// @param node_size Size of the node, a multiple of the index blk size, allocated as contiguous blks
     /// @param node_initializer Callback to be called upon which buffer is turned into btree node
     /// @return Node which was created by the node_initializer
-    virtual BtreeNodePtr alloc_buf(node_initializer_t&& node_initializer) = 0;
+    virtual BtreeNodePtr alloc_buf(uint32_t node_size, node_initializer_t&& node_initializer) = 0;
 
     /// @brief Write buffer
     /// @param buf
     /// @param context
     virtual void write_buf(const BtreeNodePtr& node, const IndexBufferPtr& buf, CPContext* context) = 0;
 
-    virtual void read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) = 0;
+    /// @brief Read the buffer from the cache, else from the device and add it to the cache
+    /// @return true if the buffer was found in the cache
+    virtual bool read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) = 0;
+
+    /// @brief Issue async reads for the bufs not in the cache, which are added to the cache on completion. It is only a
+    /// hint, read_buf of the same id meanwhile does not wait for it.
+    virtual void prefetch_bufs(std::vector< bnodeid_t > const& ids, node_initializer_t&& node_initializer) = 0;
+
+    /// @brief Max number of bufs to be read ahead at a time, 0 if read ahead is disabled
+    virtual uint32_t prefetch_window() const = 0;
+
+    /// @brief Number of the nodes persisted as hot by the last cp before restart, which are read back into the cache
+    virtual uint32_t num_warmed_bufs() const = 0;
 
     virtual bool get_writable_buf(const BtreeNodePtr& node, CPContext* context) = 0;
 
@@ -55,6 +69,11 @@ public:
                                IndexBufferPtr const& child_buf, IndexBufferPtrList const& new_node_bufs,
                                IndexBufferPtrList const& freed_node_bufs, CPContext* cp_ctx) = 0;
 
+    /// @brief Link the buffers created in this cp to be flushed ahead of the up_buf chain and journal them as new
+    /// children of up_buf. Used when a whole subtree is created under a new root in one cp.
+    virtual void transact_new_bufs(uint32_t index_ordinal, IndexBufferPtr const& up_buf,
+                                   IndexBufferPtrList const& new_bufs, CPContext* cp_ctx) = 0;
+
     /// @brief Free the buffer allocated and remove it from wb cache
     /// @param buf
     /// @param context
@@ -15,6 +15,7 @@
  *********************************************************************************/
 #pragma once
 #include <memory>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 
@@ -47,11 +48,14 @@ private:
     std::shared_ptr< VirtualDev > m_vdev;
     std::pair< meta_blk*, sisl::byte_view > m_wbcache_sb{
         std::pair< meta_blk*, sisl::byte_view >{nullptr, sisl::byte_view{}}};
+    std::pair< meta_blk*, sisl::byte_view > m_warmup_sb{
+        std::pair< meta_blk*, sisl::byte_view >{nullptr, sisl::byte_view{}}};
     std::unique_ptr< sisl::IDReserver > m_ordinal_reserver;
 
     mutable std::mutex m_index_map_mtx;
     std::map< uuid_t, std::shared_ptr< IndexTableBase > > m_index_map;
     std::unordered_map< uint32_t, std::shared_ptr< IndexTableBase > > m_ordinal_index_map;
+    std::vector< std::thread > m_repair_threads; // Repair the nodes found by recovery, one per index table
 
 public:
     IndexService(std::unique_ptr< IndexServiceCallbacks > cbs);
@@ -79,11 +83,19 @@ public:
 
     uint64_t used_size() const;
     uint32_t node_size() const;
+
+    // Whether an index table could have nodes of this size on the index vdev. Nodes larger than node_size() need the
+    // vdev to be created with btree.index_mixed_node_sizes
+    bool is_node_size_supported(uint32_t node_size) const;
     void repair_index_node(uint32_t ordinal, IndexBufferPtr const& node_buf);
     void repair_index_root(uint32_t ordinal, IndexBufferPtr const& root_buf);
 
     IndexWBCacheBase& wb_cache() { return *m_wb_cache; }
 
+    // Applies the backpressure of dirty buffers on an index writer. Must be called without holding a cp guard, so
+    // that the cp it is waiting on can switch
+    void throttle_writer();
+
 private:
     void itable_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie);
 };
@@ -0,0 +1,470 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <sisl/fds/buffer.hpp>
+#include <nlohmann/json.hpp>
+
+namespace homestore {
+
+/*
+ * LogRecordTracker: Tracks the in-memory records of a log stream by idx, which are created (issued), completed
+ * (flushed) and then truncated from the head. Records are kept in fixed size segments of SegmentSlots records, each
+ * with its own created/completed bitmaps, so growing the stream only adds a segment to the directory and never copies
+ * or moves the records already in it. Segments truncated from the head (or rolled back from the tail) are recycled
+ * through a process wide pool of free segments.
+ *
+ * Create, update, complete and the lookups take the directory lock in shared mode and set the bits atomically, so they
+ * run in parallel to each other. Only adding or removing a segment takes it exclusively, which is O(1) per segment;
+ * the records of the truncated segments are destroyed outside the lock.
+ *
+ * The memory held by the tracker (segments and the directory) is accounted in memory_bytes().
+ */
+template < typename T, uint32_t SegmentSlots = 1024 >
+class LogRecordTracker {
+    static_assert((SegmentSlots % 64) == 0, "Segment slots should be multiple of 64");
+    static constexpr uint32_t words_per_segment{SegmentSlots / 64};
+    using bits_t = std::array< std::atomic< uint64_t >, words_per_segment >;
+
+    struct segment {
+        bits_t created;
+        bits_t completed;
+        alignas(T) std::byte slots[sizeof(T) * SegmentSlots];
+
+        T* slot(uint32_t off) { return std::launder(reinterpret_cast< T* >(slots) + off); }
+        static bool is_set(const bits_t& bits, uint32_t off) {
+            return (bits[off / 64].load(std::memory_order_acquire) & (1ull << (off % 64))) != 0;
+        }
+        static void set(bits_t& bits, uint32_t off) {
+            bits[off / 64].fetch_or(1ull << (off % 64), std::memory_order_acq_rel);
+        }
+        static void reset(bits_t& bits, uint32_t off) {
+            bits[off / 64].fetch_and(~(1ull << (off % 64)), std::memory_order_acq_rel);
+        }
+
+        // Destroys the records created in [from, to] offsets of the segment and resets their bits
+        void destroy(uint32_t from, uint32_t to) {
+            for (auto off = from; off <= to; ++off) {
+                if (is_set(created, off)) {
+                    slot(off)->~T();
+                    reset(created, off);
+                }
+                reset(completed, off);
+            }
+        }
+    };
+
+    // Free segments retained for reuse, shared by all the trackers of the same record type
+    class segment_pool {
+    public:
+        static constexpr size_t max_free_segments{64};
+
+        static segment_pool& instance() {
+            static segment_pool s_pool;
+            return s_pool;
+        }
+
+        ~segment_pool() {
+            for (auto* seg : m_free) {
+                delete seg;
+            }
+        }
+
+        segment* alloc() {
+            {
+                std::unique_lock lg{m_mtx};
+                if (!m_free.empty()) {
+                    auto* seg = m_free.back();
+                    m_free.pop_back();
+                    return seg;
+                }
+            }
+            return new segment;
+        }
+
+        // Released segments are expected to have no records in it
+        void release(segment* seg) {
+            {
+                std::unique_lock lg{m_mtx};
+                if (m_free.size() < max_free_segments) {
+                    m_free.push_back(seg);
+                    return;
+                }
+            }
+            delete seg;
+        }
+
+    private:
+        std::mutex m_mtx;
+        std::vector< segment* > m_free;
+    };
+
+public:
+    struct status_t {
+        bool is_out_of_range{false}; // Already truncated
+        bool is_hole{false};         // Not created yet
+        bool is_active{false};       // Created, but not completed yet
+        bool is_completed{false};
+    };
+
+    /**
+     * @brief Construct the tracker for a stream, which is empty and truncated upto (inclusive) the given idx.
+     */
+    explicit LogRecordTracker(std::string name = "LogRecordTracker", int64_t truncated_upto = -1) :
+            m_name{std::move(name)} {
+        reset_to(truncated_upto + 1);
+    }
+    LogRecordTracker(const LogRecordTracker&) = delete;
+    LogRecordTracker(LogRecordTracker&&) noexcept = delete;
+    LogRecordTracker& operator=(const LogRecordTracker&) = delete;
+    LogRecordTracker& operator=(LogRecordTracker&&) noexcept = delete;
+
+    ~LogRecordTracker() {
+        for (auto* seg : m_segs) {
+            seg->destroy(0, SegmentSlots - 1);
+            segment_pool::instance().release(seg);
+        }
+    }
+
+    /**
+     * @brief Create the record at idx by constructing it with args. Idx should not be truncated.
+     */
+    template < typename... Args >
+    void create(int64_t idx, Args&&... args) {
+        do_create(idx, false /* complete */, std::forward< Args >(args)...);
+    }
+
+    template < typename... Args >
+    void create_and_complete(int64_t idx, Args&&... args) {
+        do_create(idx, true /* complete */, std::forward< Args >(args)...);
+    }
+
+    /**
+     * @brief Update the record at idx in place, which is marked completed if the callback returns true.
+     *
+     * Throws: std::out_of_range exception if idx is truncated or was never created
+     */
+    void update(int64_t idx, const std::function< bool(T&) >& cb) {
+        std::shared_lock lg{m_mtx};
+        auto [seg, off] = created_slot(idx);
+        if (cb(*seg->slot(off))) { segment::set(seg->completed, off); }
+    }
+
+    /**
+     * @brief Mark the records in [from, to] as completed
+     */
+    void complete(int64_t from, int64_t to) {
+        std::shared_lock lg{m_mtx};
+        for (auto idx = std::max(from, m_first_idx); idx <= to; ++idx) {
+            auto [seg, off] = locate(idx);
+            if (seg == nullptr) { break; }
+            segment::set(seg->completed, off);
+        }
+    }
+
+    /**
+     * @brief Get the record at idx. The reference is valid until it is truncated or rolled back.
+     *
+     * Throws: std::out_of_range exception if idx is truncated or was never created
+     */
+    T& at(int64_t idx) const {
+        std::shared_lock lg{m_mtx};
+        auto [seg, off] = created_slot(idx);
+        return *seg->slot(off);
+    }
+
+    status_t status(int64_t idx) const {
+        status_t s;
+        std::shared_lock lg{m_mtx};
+        if (idx < m_first_idx) {
+            s.is_out_of_range = true;
+            return s;
+        }
+        auto [seg, off] = locate(idx);
+        if ((seg == nullptr) || !segment::is_set(seg->created, off)) {
+            s.is_hole = true;
+            return s;
+        }
+        s.is_completed = segment::is_set(seg->completed, off);
+        s.is_active = !s.is_completed;
+        return s;
+    }
+
+    /**
+     * @brief Get the last idx upto which all the records from the given idx are created (from - 1 if it is not
+     * created). Truncated idx are considered created, so the search starts from the first idx which is not truncated.
+     */
+    int64_t active_upto(int64_t from = std::numeric_limits< int64_t >::min()) const {
+        std::shared_lock lg{m_mtx};
+        return upto(&segment::created, from);
+    }
+
+    /**
+     * @brief Same as active_upto, but for the completed records.
+     */
+    int64_t completed_upto(int64_t from = std::numeric_limits< int64_t >::min()) const {
+        std::shared_lock lg{m_mtx};
+        return upto(&segment::completed, from);
+    }
+
+    /**
+     * @brief Call the cb with (idx, last contiguous created idx, record) for the contiguous created records starting
+     * from start_idx, until the cb returns false. Returns the number of records called back.
+     */
+    int64_t foreach_contiguous_active(int64_t start_idx, const std::function< bool(int64_t, int64_t, T&) >& cb) {
+        return foreach_contiguous(&segment::created, start_idx, cb);
+    }
+
+    int64_t foreach_contiguous_completed(int64_t start_idx,
+                                         const std::function< bool(int64_t, int64_t, const T&) >& cb) {
+        return foreach_contiguous(&segment::completed, start_idx,
+                                  [&cb](int64_t idx, int64_t max_idx, T& rec) { return cb(idx, max_idx, rec); });
+    }
+
+    /**
+     * @brief Call the cb with (idx, record) for all the completed records from start_idx, skipping the ones which are
+     * not, until the cb returns false.
+     */
+    void foreach_all_completed(int64_t start_idx, const std::function< bool(int64_t, T&) >& cb) {
+        std::shared_lock lg{m_mtx};
+        auto idx = std::max(start_idx, m_first_idx);
+        for (auto [seg, off] = locate(idx); seg != nullptr; std::tie(seg, off) = locate(idx)) {
+            auto const word_off = off - (off % 64);
+            auto bits = seg->completed[off / 64].load(std::memory_order_acquire) & (~0ull << (off % 64));
+            while (bits != 0) {
+                auto const bit = uint32_cast(std::countr_zero(bits));
+                bits &= (bits - 1);
+                if (!cb(idx - off + word_off + bit, *seg->slot(word_off + bit))) { return; }
+            }
+            idx += 64 - (off % 64);
+        }
+    }
+
+    /**
+     * @brief Truncate all the records upto idx (inclusive), irrespective of whether they are completed or not.
+     * Returns the idx upto which it is truncated.
+     */
+    int64_t truncate(int64_t idx) {
+        std::vector< segment* > freed;
+        {
+            std::unique_lock lg{m_mtx};
+            if (idx < m_first_idx) { return m_first_idx - 1; }
+
+            // Whole segments are detached here and their records destroyed outside the lock
+            while (!m_segs.empty() && (m_base_idx + SegmentSlots - 1 <= idx)) {
+                freed.push_back(m_segs.front());
+                m_segs.pop_front();
+                m_base_idx += SegmentSlots;
+            }
+            if (m_segs.empty()) {
+                m_base_idx = segment_base(idx + 1);
+            } else if (idx >= m_base_idx) {
+                m_segs.front()->destroy(uint32_cast(std::max(m_first_idx, m_base_idx) - m_base_idx),
+                                        uint32_cast(idx - m_base_idx));
+            }
+            m_first_idx = idx + 1;
+            update_mem_bytes();
+        }
+
+        for (auto* seg : freed) {
+            seg->destroy(0, SegmentSlots - 1);
+            segment_pool::instance().release(seg);
+        }
+        return idx;
+    }
+
+    /**
+     * @brief Remove all the records beyond new_end_idx, as if they were never created.
+     */
+    void rollback(int64_t new_end_idx) {
+        std::vector< segment* > freed;
+        {
+            std::unique_lock lg{m_mtx};
+            new_end_idx = std::max(new_end_idx, m_first_idx - 1);
+
+            // Trailing segments entirely beyond the new end are detached, but never the one with the first idx
+            while ((m_segs.size() > 1) &&
+                   (m_base_idx + s_cast< int64_t >((m_segs.size() - 1) * SegmentSlots) > new_end_idx)) {
+                freed.push_back(m_segs.back());
+                m_segs.pop_back();
+            }
+            if (auto [seg, off] = locate(new_end_idx + 1); seg != nullptr) { seg->destroy(off, SegmentSlots - 1); }
+            update_mem_bytes();
+        }
+
+        for (auto* seg : freed) {
+            seg->destroy(0, SegmentSlots - 1);
+            segment_pool::instance().release(seg);
+        }
+    }
+
+    /**
+     * @brief Drop all the records and restart the stream from the given idx.
+     */
+    void reinit(int64_t first_idx) {
+        std::vector< segment* > freed;
+        {
+            std::unique_lock lg{m_mtx};
+            freed.assign(m_segs.begin(), m_segs.end());
+            m_segs.clear();
+            reset_to(first_idx);
+        }
+        for (auto* seg : freed) {
+            seg->destroy(0, SegmentSlots - 1);
+            segment_pool::instance().release(seg);
+        }
+    }
+
+    uint64_t memory_bytes() const { return m_mem_bytes.load(std::memory_order_relaxed); }
+
+    nlohmann::json get_status(int verbosity) const {
+        nlohmann::json js;
+        std::shared_lock lg{m_mtx};
+        js["name"] = m_name;
+        js["first_idx"] = m_first_idx;
+        js["active_upto"] = upto(&segment::created, m_first_idx);
+        js["completed_upto"] = upto(&segment::completed, m_first_idx);
+        js["num_segments"] = m_segs.size();
+        js["memory_bytes"] = memory_bytes();
+        if (verbosity == 2) {
+            js["segment_slots"] = SegmentSlots;
+            js["segment_size"] = sizeof(segment);
+        }
+        return js;
+    }
+
+private:
+    static int64_t segment_base(int64_t idx) {
+        auto const rem = idx % s_cast< int64_t >(SegmentSlots);
+        return (rem < 0) ? (idx - rem - SegmentSlots) : (idx - rem);
+    }
+
+    void reset_to(int64_t first_idx) {
+        m_first_idx = first_idx;
+        m_base_idx = segment_base(first_idx);
+        update_mem_bytes();
+    }
+
+    void update_mem_bytes() {
+        m_mem_bytes.store(sizeof(*this) + (m_segs.size() * (sizeof(segment) + sizeof(segment*))),
+                          std::memory_order_relaxed);
+    }
+
+    // Segment and the offset in it for idx, nullptr if the segment is not added yet. Needs the lock in any mode.
+    std::pair< segment*, uint32_t > locate(int64_t idx) const {
+        if (idx < m_base_idx) { return {nullptr, 0}; }
+        auto const seg_num = s_cast< uint64_t >(idx - m_base_idx) / SegmentSlots;
+        if (seg_num >= m_segs.size()) { return {nullptr, 0}; }
+        return {m_segs[seg_num], uint32_cast(s_cast< uint64_t >(idx - m_base_idx) % SegmentSlots)};
+    }
+
+    std::pair< segment*, uint32_t > created_slot(int64_t idx) const {
+        if (idx < m_first_idx) { throw std::out_of_range(m_name + ": idx " + std::to_string(idx) + " truncated"); }
+        auto const [seg, off] = locate(idx);
+        if ((seg == nullptr) || !segment::is_set(seg->created, off)) {
+            throw std::out_of_range(m_name + ": idx " + std::to_string(idx) + " not created");
+        }
+        return {seg, off};
+    }
+
+    // Adds the segments upto the one containing idx. A segment is allocated before taking the lock, so that it is held
+    // only to add it to the directory.
+    void grow_to(int64_t idx) {
+        auto* seg = segment_pool::instance().alloc();
+        {
+            std::unique_lock lg{m_mtx};
+            if (idx >= m_base_idx) {
+                auto const needed = (s_cast< uint64_t >(idx - m_base_idx) / SegmentSlots) + 1;
+                while (m_segs.size() < needed) {
+                    m_segs.push_back(seg ? seg : segment_pool::instance().alloc());
+                    seg = nullptr;
+                }
+                update_mem_bytes();
+            }
+        }
+        if (seg) { segment_pool::instance().release(seg); }
+    }
+
+    // Records already truncated are ignored, since they could be found again during recovery
+    template < typename... Args >
+    void do_create(int64_t idx, bool complete, Args&&... args) {
+        while (true) {
+            {
+                std::shared_lock lg{m_mtx};
+                if (idx < m_first_idx) { return; }
+                if (auto [seg, off] = locate(idx); seg != nullptr) {
+                    if (segment::is_set(seg->created, off)) { seg->slot(off)->~T(); }
+                    new (seg->slots + (sizeof(T) * off)) T(std::forward< Args >(args)...);
+                    if (complete) { segment::set(seg->completed, off); }
+                    segment::set(seg->created, off);
+                    return;
+                }
+            }
+            grow_to(idx);
+        }
+    }
+
+    int64_t upto(bits_t segment::*bits_of, int64_t from) const {
+        auto idx = std::max(from, m_first_idx);
+        for (auto [seg, off] = locate(idx); seg != nullptr; std::tie(seg, off) = locate(idx)) {
+            auto const shift = off % 64;
+            auto const n = std::countr_one((seg->*bits_of)[off / 64].load(std::memory_order_acquire) >> shift);
+            idx += n;
+            if (n < s_cast< int >(64 - shift)) { break; }
+        }
+        return idx - 1;
+    }
+
+    int64_t foreach_contiguous(bits_t segment::*bits_of, int64_t start_idx,
+                               const std::function< bool(int64_t, int64_t, T&) >& cb) {
+        std::shared_lock lg{m_mtx};
+        auto const from = std::max(start_idx, m_first_idx);
+        auto const max_idx = upto(bits_of, from);
+        int64_t count{0};
+        for (auto idx = from; idx <= max_idx; ++idx) {
+            auto [seg, off] = locate(idx);
+            ++count;
+            if (!cb(idx, max_idx, *seg->slot(off))) { break; }
+        }
+        return count;
+    }
+
+private:
+    std::string m_name;
+    mutable std::shared_mutex m_mtx; // Protects the segment directory, not the records
+    std::deque< segment* > m_segs;
+    int64_t m_base_idx{0};  // Idx of the first slot of the first segment, a multiple of SegmentSlots
+    int64_t m_first_idx{0}; // First idx which is not truncated
+    std::atomic< uint64_t > m_mem_bytes{0};
+};
+} // namespace homestore
@@ -20,22 +20,26 @@
 #include <cstdint>
 #include <functional>
 #include <limits>
+#include <map>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <set>
 #include <unordered_map>
 #include <vector>
 
 #include <sisl/fds/buffer.hpp>
-#include <sisl/fds/stream_tracker.hpp>
 #include <folly/Synchronized.h>
+#include <folly/futures/Future.h>
 #include <nlohmann/json.hpp>
 
+#include <homestore/logstore/log_record_tracker.hpp>
 #include <homestore/logstore/log_store_internal.hpp>
 
 namespace homestore {
 
 class LogDev;
+class LogPartitionWorkers;
 class LogStoreServiceMetrics;
 
 static constexpr logstore_seq_num_t invalid_lsn() { return std::numeric_limits< logstore_seq_num_t >::min(); }
@@ -48,7 +52,7 @@ public:
     HomeLogStore(HomeLogStore&&) noexcept = delete;
     HomeLogStore& operator=(const HomeLogStore&) = delete;
     HomeLogStore& operator=(HomeLogStore&&) noexcept = delete;
-    ~HomeLogStore() = default;
+    ~HomeLogStore();
 
     /**
      * @brief Register default request completion callback. In case every write does not carry a callback, this
@@ -63,7 +67,21 @@ public:
      *
      * @param cb
      */
-    void register_log_found_cb(const log_found_cb_t& cb) { m_found_cb = cb; }
+    void register_log_found_cb(const log_found_cb_t& cb) {
+        m_found_cb = cb;
+        m_found_partition_fn = nullptr;
+    }
+
+    /**
+     * @brief Register callback upon a new log entry is found during recovery, called on a pool of
+     * logstore.replay_partition_workers threads instead of the replay thread. Records of the same partition (as
+     * returned by partition_fn, called in the replay thread) are called back in the lsn order, while those of different
+     * partitions could be called back concurrently. All the records found are called back before the replay done cb.
+     *
+     * @param cb
+     * @param partition_fn
+     */
+    void register_log_found_cb(const log_found_cb_t& cb, const log_partition_fn_t& partition_fn);
 
     /**
      * @brief Register callback to indicate the replay is done during recovery. Failing to register for log_replay
@@ -113,13 +131,27 @@ public:
     void write_async(logstore_seq_num_t seq_num, const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& cb,
                      bool flush_wait = false);
 
+    /**
+     * @brief Write a record of given size at the user specified seq number, without the caller building it in a
+     * buffer first. The serializer is called at the time of flush with the space reserved for the record within the
+     * log group buffer, which it has to fill completely. Anything the serializer refers to has to stay valid until the
+     * completion callback, which is called with a blob of the given size, but no data.
+     *
+     * @param seq_num: Seq number to write to
+     * @param size : Size of the serialized record
+     * @param serializer : Serializes the record in place
+     * @param cookie : Any cookie or context which will passed back in the callback
+     * @param cb Callback upon completion which is called with the status, seq_num and cookie that was passed.
+     */
+    void write_async(logstore_seq_num_t seq_num, uint32_t size, log_serialize_cb_t&& serializer, void* cookie,
+                     const log_write_comp_cb_t& cb, bool flush_wait = false);
+
     /**
      * @brief This method appends the blob into the log and it returns the generated seq number
      *
      * @param b Blob of data to append
-     * @return logstore_seq_num_t Returns the seqnum generated by the log
+     * @return logstore_seq_num_t Returns the seqnum generated by the log, invalid_lsn() if the write failed
      */
-    // This method is not implemented yet
     logstore_seq_num_t append_sync(const sisl::io_blob& b);
 
     /**
@@ -132,6 +164,13 @@ public:
      */
     logstore_seq_num_t append_async(const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& completion_cb);
 
+    /**
+     * @brief Append a record of given size which is serialized in place into the log group buffer at the time of flush
+     * (see write_async with serializer) and returns the generated seq number.
+     */
+    logstore_seq_num_t append_async(uint32_t size, log_serialize_cb_t&& serializer, void* cookie,
+                                    const log_write_comp_cb_t& completion_cb);
+
     /**
      * @brief Read the log provided the sequence number synchronously. This is not the most efficient way to read
      * as reader will be blocked until read is completed. In addition, it is built on-top of async system by doing
@@ -144,6 +183,19 @@ public:
      */
     log_buffer read_sync(logstore_seq_num_t seq_num);
 
+    /**
+     * @brief Read all the logs in the range [start_seq_num, end_seq_num) asynchronously, issuing one read per log
+     * group that the range spans instead of one per log. Returned buffers are views into the group buffers, in order of
+     * seq num. If any seq num in the range is issued but not flushed yet, it is flushed first. The range is cut short
+     * at the first seq num which is not written.
+     *
+     * Throws: std::out_of_range exception if start_seq_num is already truncated or never inserted before
+     *
+     * @return future of the buffers of each log in the range. It fails with std::system_error upon read error.
+     */
+    folly::Future< std::vector< log_buffer > > read_range_async(logstore_seq_num_t start_seq_num,
+                                                               logstore_seq_num_t end_seq_num);
+
     /**
      * @brief Read the log based on the logstore_req prepared. In case callback is supplied, it uses the callback
      * to provide the data it has read. If not overridden, use default callback registered during initialization.
@@ -213,7 +265,7 @@ public:
         return (ts == std::numeric_limits< logstore_seq_num_t >::max()) ? -1 : ts;
     }
 
-    sisl::StreamTracker< logstore_record >& log_records() { return m_records; }
+    LogRecordTracker< logstore_record >& log_records() { return m_records; }
 
     /**
      * @brief iterator to get all the log buffers;
@@ -224,6 +276,18 @@ public:
      */
     void foreach (int64_t start_idx, const std::function< bool(logstore_seq_num_t, log_buffer) >& cb);
 
+    /**
+     * @brief iterator to get all the log buffers, called back on a pool of logstore.replay_partition_workers threads.
+     * Buffers of the same partition (as returned by partition_fn) are called back in the idx order, while those of
+     * different partitions could be called back concurrently. Returns once all of them are called back.
+     *
+     * @param start_idx  idx to start with;
+     * @param partition_fn called with current idx and log buffer, in the caller's thread, to get its partition.
+     * @param cb called with current idx and log buffer.
+     */
+    void foreach_partitioned(int64_t start_idx, const log_partition_fn_t& partition_fn,
+                             const std::function< void(logstore_seq_num_t, log_buffer) >& cb);
+
     /**
      * @brief Get the store id of this HomeLogStore
      *
@@ -261,7 +325,9 @@ public:
     void flush_sync(logstore_seq_num_t upto_seq_num = invalid_lsn());
 
     /**
-     * @brief Rollback the given instance to the given sequence number
+     * @brief Rollback the given instance to the given sequence number. Rollback is persisted in the rollback superblk
+     * of the logdev, while its flush is locked, or with logstore.rollback_marker_in_log, as a marker record in the
+     * log stream without locking the flush. Either way, cb is called once it is persisted.
      *
      * @param seq_num Sequence number back which logs are to be rollbacked
      * @return True on success
@@ -279,9 +345,9 @@ public:
     /**
      * Retrieves the truncation information before device truncation.
      *
-     * @return A constant reference to the truncation_info object representing the truncation information.
+     * @return A snapshot of the truncation information, as of now. Flushes could go on in parallel.
      */
-    const truncation_info& pre_device_truncation();
+    truncation_snapshot pre_device_truncation();
 
     /**
      * \brief post device truncation processing.
@@ -327,6 +393,12 @@ public:
      */
     void on_log_found(logstore_seq_num_t seq_num, const logdev_key& ld_key, const logdev_key& flush_ld_key,
                       log_buffer buf);
+
+    /**
+     * @brief Waits for the records found during recovery to be called back, if they are called back on a pool of
+     * threads (partitioned log found cb). LogDev calls it once its replay is done, ahead of the replay done cb.
+     */
+    void drain_log_found_workers();
     /**
      * @brief Handles the completion of a batch flush operation to update internal state.
      *
@@ -349,13 +421,24 @@ private:
 
     int search_max_le(logstore_seq_num_t input_sn);
 
+    // Tail cache of the recently written records, trimmed from the oldest once over tail_cache_size_per_store. Trim
+    // drops the records upto seq_num (truncation), or the ones beyond it if from_tail (rollback).
+    void cache_tail(logstore_seq_num_t seq_num, const sisl::io_blob& data);
+    std::optional< log_buffer > read_tail_cache(logstore_seq_num_t seq_num);
+    void trim_tail_cache(logstore_seq_num_t seq_num, bool from_tail);
+
+    // Truncation barriers of the lsns beyond to_lsn are not valid anymore upon its rollback
+    void remove_rolled_back_barriers(logstore_seq_num_t to_lsn);
+
 private:
     logstore_id_t m_store_id;
     std::shared_ptr< LogDev > m_logdev;
-    sisl::StreamTracker< logstore_record > m_records;
+    LogRecordTracker< logstore_record > m_records;
     bool m_append_mode{false};
     log_req_comp_cb_t m_comp_cb;
     log_found_cb_t m_found_cb;
+    log_partition_fn_t m_found_partition_fn;
+    std::unique_ptr< LogPartitionWorkers > m_found_workers; // Created on the first log found, if partitioned
     log_replay_done_cb_t m_replay_done_cb;
     std::atomic< logstore_seq_num_t > m_seq_num;
     std::string m_fq_name;
@@ -370,7 +453,14 @@ private:
     std::mutex m_sync_flush_mtx;
     std::condition_variable m_sync_flush_cv;
 
+    // Truncation barriers and boundary are updated by flush completions, truncate and device truncation, all of which
+    // could run in parallel, as truncation does not lock the flush of logdev
+    std::mutex m_trunc_mtx;
     std::vector< seq_ld_key_pair > m_truncation_barriers; // List of truncation barriers
     truncation_info m_safe_truncation_boundary;
+
+    std::mutex m_tail_cache_mtx;
+    std::map< logstore_seq_num_t, log_buffer > m_tail_cache;
+    uint64_t m_tail_cache_size{0};
 };
 } // namespace homestore
@@ -30,6 +30,7 @@
 #include <sisl/fds/obj_allocator.hpp>
 #include <folly/Synchronized.h>
 #include <nlohmann/json.hpp>
+#include <homestore/tracer.hpp>
 
 namespace homestore {
 
@@ -47,7 +48,9 @@ typedef uint32_t logdev_id_t;
 
 typedef std::function< void(logstore_req*, logdev_key) > log_req_comp_cb_t;
 typedef std::function< void(logstore_seq_num_t, sisl::io_blob&, logdev_key, void*) > log_write_comp_cb_t;
+typedef std::function< void(uint8_t*, uint32_t) > log_serialize_cb_t;
 typedef std::function< void(logstore_seq_num_t, log_buffer, void*) > log_found_cb_t;
+typedef std::function< uint64_t(logstore_seq_num_t, const log_buffer&) > log_partition_fn_t;
 typedef std::function< void(std::shared_ptr< HomeLogStore >) > log_store_opened_cb_t;
 typedef std::function< void(std::shared_ptr< HomeLogStore >, logstore_seq_num_t) > log_replay_done_cb_t;
 typedef std::function< void(const std::unordered_map< logdev_id_t, logdev_key >&) > device_truncate_cb_t;
@@ -126,6 +129,8 @@ struct logstore_req {
     log_req_comp_cb_t cb;       // Callback upon completion of write (overridden than default)
     Clock::time_point start_time;
     bool flush_wait{false}; // Wait for the flush to happen
+    log_serialize_cb_t serializer{nullptr}; // Serializes data in place into the log group, if data is not prebuilt
+    trace_id_t trace_id{invalid_trace_id};  // Trace of the request it is written for, if that is sampled
 
     logstore_req(const logstore_req&) = delete;
     logstore_req& operator=(const logstore_req&) = delete;
@@ -177,6 +182,14 @@ struct truncation_info {
     bool active_writes_not_part_of_truncation{false};
 };
 
+// Copy of the truncation_info of a log store at a point in time, which device truncation computes the safe point from
+struct truncation_snapshot {
+    logdev_key ld_key;
+    logstore_seq_num_t seq_num{-1};
+    bool pending_dev_truncation{false};
+    bool active_writes_not_part_of_truncation{false};
+};
+
 #pragma pack(1)
 struct logstore_superblk {
     logstore_superblk(const logstore_seq_num_t seq_num = 0) : m_first_seq_num{seq_num} {}
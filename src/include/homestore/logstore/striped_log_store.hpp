@@ -0,0 +1,148 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <homestore/logstore/log_store.hpp>
+
+namespace homestore {
+
+typedef std::function< void(logstore_seq_num_t) > striped_log_replay_done_cb_t;
+
+/*
+ * StripedLogStore: A log store whose records are spread round robin across K HomeLogStores, each on its own logdev
+ * (and hence its own journal descriptor, whose chunks could be on different pdevs), so that a single hot log could use
+ * the write bandwidth of more than one journal stream. Seq num n lives in stripe (n % K), as seq num (n / K) of that
+ * stripe, so no extra metadata is needed per record. Caller persists stripe_ids() to open it again, in the same order.
+ *
+ * Records are flushed by each stripe independently, so completions are in order within a stripe only. Read, flush and
+ * truncate are routed to the stripes by seq num. On recovery, records found in all the stripes are merged by seq num
+ * and then replayed in order, once every stripe has completed its replay. Replay stops at the first seq num missing
+ * (a crash can leave later seq nums flushed on the other stripes), the records after it are rolled back.
+ */
+class StripedLogStore {
+public:
+    using stripe_id_t = std::pair< logdev_id_t, logstore_id_t >;
+
+    StripedLogStore(uint32_t nstripes, bool append_mode);
+    StripedLogStore(const StripedLogStore&) = delete;
+    StripedLogStore(StripedLogStore&&) noexcept = delete;
+    StripedLogStore& operator=(const StripedLogStore&) = delete;
+    StripedLogStore& operator=(StripedLogStore&&) noexcept = delete;
+    ~StripedLogStore() = default;
+
+    /**
+     * @brief Register callback upon a log entry is found during recovery. Entries are called back in the order of seq
+     * num, after all stripes are replayed. It needs to be registered in the continuation of the open, to not miss them.
+     */
+    void register_log_found_cb(const log_found_cb_t& cb) { m_found_cb = cb; }
+
+    /**
+     * @brief Register callback to indicate the replay is done during recovery, called with the last seq num found
+     * before the first one missing.
+     */
+    void register_log_replay_done_cb(const striped_log_replay_done_cb_t& cb) { m_replay_done_cb = cb; }
+
+    /**
+     * @brief Write the blob at the user specified seq number into its stripe. See HomeLogStore::write_async
+     */
+    void write_async(logstore_seq_num_t seq_num, const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& cb,
+                     bool flush_wait = false);
+
+    /**
+     * @brief Append the blob into the log with the next seq number, which is returned. Only in append mode.
+     */
+    logstore_seq_num_t append_async(const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& completion_cb);
+
+    /**
+     * @brief Read the log of given seq num synchronously from its stripe (flushing it first, if not flushed yet).
+     *
+     * Throws: std::out_of_range exception if seq_num is already truncated or never inserted before
+     */
+    log_buffer read_sync(logstore_seq_num_t seq_num);
+
+    /**
+     * @brief Flush all stripes upto seq num, if provided, else all the seq nums issued prior.
+     */
+    void flush_sync(logstore_seq_num_t upto_seq_num = invalid_lsn());
+
+    /**
+     * @brief Truncate all stripes upto seq num (inclusive). See HomeLogStore::truncate
+     */
+    void truncate(logstore_seq_num_t upto_seq_num, bool in_memory_truncate_only = true);
+
+    /**
+     * @brief Get the seq num upto which all seq nums from the given one are completed (exclusive of from) across
+     * all the stripes.
+     */
+    logstore_seq_num_t get_contiguous_completed_seq_num(logstore_seq_num_t from) const;
+
+    /**
+     * @brief Get the seq num upto which all seq nums from the given one are issued (exclusive of from) across all the
+     * stripes.
+     */
+    logstore_seq_num_t get_contiguous_issued_seq_num(logstore_seq_num_t from) const;
+
+    logstore_seq_num_t truncated_upto() const;
+    logstore_seq_num_t seq_num() const { return m_seq_num.load(std::memory_order_acquire); }
+    uint32_t num_stripes() const { return m_nstripes; }
+    std::vector< stripe_id_t > stripe_ids() const;
+    const std::vector< shared< HomeLogStore > >& stripes() const { return m_stripes; }
+
+    nlohmann::json get_status(int verbosity) const;
+
+    // Installs the home log store of the given stripe, upon create or open of it
+    void set_stripe(uint32_t idx, shared< HomeLogStore > store);
+
+private:
+    uint32_t stripe_of(logstore_seq_num_t seq_num) const { return uint32_cast(seq_num % m_nstripes); }
+    logstore_seq_num_t to_stripe_seq_num(logstore_seq_num_t seq_num) const { return seq_num / m_nstripes; }
+    logstore_seq_num_t to_seq_num(uint32_t idx, logstore_seq_num_t stripe_seq_num) const {
+        return (stripe_seq_num * m_nstripes) + idx;
+    }
+    // Last seq num of the stripe which is at or before the given seq num, -1 if there is none
+    logstore_seq_num_t stripe_seq_num_upto(uint32_t idx, logstore_seq_num_t seq_num) const {
+        return (seq_num >= s_cast< logstore_seq_num_t >(idx)) ? ((seq_num - idx) / m_nstripes) : -1;
+    }
+    logstore_seq_num_t merge_contiguous(const std::function< logstore_seq_num_t(uint32_t) >& stripe_upto) const;
+
+    void on_stripe_log_found(uint32_t idx, logstore_seq_num_t stripe_seq_num, log_buffer buf);
+    void on_stripe_replay_done(uint32_t idx, logstore_seq_num_t last_stripe_seq_num);
+
+private:
+    uint32_t m_nstripes;
+    bool m_append_mode;
+    std::vector< shared< HomeLogStore > > m_stripes;
+    std::atomic< logstore_seq_num_t > m_seq_num{0};
+
+    log_found_cb_t m_found_cb;
+    striped_log_replay_done_cb_t m_replay_done_cb;
+
+    // Records found in replay are held until all stripes are replayed, to call them back in the order of seq num
+    std::mutex m_replay_mtx;
+    std::map< logstore_seq_num_t, log_buffer > m_replayed;
+    uint32_t m_nstripes_replayed{0};
+    std::vector< logstore_seq_num_t > m_stripe_last_replayed; // Last stripe seq num found in each stripe
+};
+} // namespace homestore
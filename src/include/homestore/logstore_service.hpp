@@ -29,6 +29,7 @@
 
 #include <homestore/homestore_decl.hpp>
 #include <homestore/logstore/log_store.hpp>
+#include <homestore/logstore/striped_log_store.hpp>
 #include <homestore/superblk_handler.hpp>
 
 namespace homestore {
@@ -52,13 +53,17 @@ struct log_dump_req;
 struct logdev_superblk;
 
 static constexpr uint64_t logstore_service_sb_magic{0xb0b0c01b};
-static constexpr uint32_t logstore_service_sb_version{0x1};
+static constexpr uint32_t logstore_service_sb_version{0x2};
+static constexpr uint32_t max_shared_logdevs{32};
 
 #pragma pack(1)
 struct logstore_service_super_block {
     uint64_t magic{logstore_service_sb_magic};
     uint32_t version{logstore_service_sb_version};
     uint32_t m_last_logdev_id{0};
+    // Logdevs shared by the log stores created with create_new_shared_log_store (added in version 2)
+    uint32_t m_num_shared_logdevs{0};
+    logdev_id_t m_shared_logdevs[max_shared_logdevs]{};
 };
 #pragma pack()
 
@@ -122,6 +127,18 @@ public:
      */
     std::shared_ptr< HomeLogStore > create_new_log_store(logdev_id_t logdev_id, bool append_mode = false);
 
+    /**
+     * @brief Create a brand new log store on one of the logdevs shared by small log stores, instead of on a logdev of
+     * its own. Upto shared_logdev_pool_size shared logdevs are created on demand, after which the one with the fewest
+     * log stores is picked. Shared logdevs are opened by the service itself upon recovery. Caller is expected to
+     * persist the logdev id (get_logdev()->get_id()) along with the store id, to open the log store later.
+     *
+     * @param append_mode: See create_new_log_store
+     *
+     * @return std::shared_ptr< HomeLogStore >
+     */
+    std::shared_ptr< HomeLogStore > create_new_shared_log_store(bool append_mode = false);
+
     /**
      * @brief Open an existing log store and does a recovery. It then creates an instance of this logstore and
      * returns
@@ -134,6 +151,34 @@ public:
     folly::Future< shared< HomeLogStore > > open_log_store(logdev_id_t logdev_id, logstore_id_t store_id,
                                                            bool append_mode);
 
+    /**
+     * @brief Create a brand new striped log store, with one stripe (a new log store) on each of the given logdevs, in
+     * that order. Caller is expected to persist its stripe_ids() to open it later.
+     *
+     * @param logdev_ids: Logdevs to stripe the log store across
+     * @param append_mode: Whether the striped log store generates the seq nums. See create_new_log_store
+     *
+     * @return std::shared_ptr< StripedLogStore >
+     */
+    std::shared_ptr< StripedLogStore > create_new_striped_log_store(const std::vector< logdev_id_t >& logdev_ids,
+                                                                    bool append_mode = false);
+
+    /**
+     * @brief Open an existing striped log store, given its stripe ids in the order it was created with. Its log found
+     * and replay done callbacks need to be registered in the continuation of the returned future.
+     *
+     * @param stripe_ids: Logdev id and store id of each of the stripes
+     * @param append_mode: Append or not.
+     * @return std::shared_ptr< StripedLogStore >
+     */
+    folly::Future< shared< StripedLogStore > >
+    open_striped_log_store(const std::vector< StripedLogStore::stripe_id_t >& stripe_ids, bool append_mode);
+
+    /**
+     * @brief Remove all the stripes of a striped log store. See remove_log_store
+     */
+    void remove_striped_log_store(const std::vector< StripedLogStore::stripe_id_t >& stripe_ids);
+
     /**
      * @brief Close the log store instance and free-up the resources
      * @param logdev_id: Logdev ID of the log store to close
@@ -170,6 +215,16 @@ public:
     std::shared_ptr< LogDev > get_logdev(logdev_id_t id);
 
     nlohmann::json dump_log_store(const log_dump_req& dum_req);
+
+    /**
+     * @brief Dump the log groups found in the journal of the given logdev, with their records upto the verbosity of the
+     * request, reading them directly off the journal. As such, it works on a logdev whose stores are not opened (or
+     * replayed) yet. Records are filtered by the seq num range of the request, and its store if any. The journal is
+     * streamed through a bounded window, so memory used is that of the window and the dump upto max_groups. Scan
+     * starts from the group containing from_log_idx if given, else from the start of the journal.
+     */
+    nlohmann::json dump_journal(logdev_id_t logdev_id, const log_dump_req& dump_req, uint64_t max_groups = 1000,
+                                logid_t from_log_idx = -1);
     nlohmann::json get_status(int verbosity) const;
 
     LogStoreServiceMetrics& metrics() { return m_metrics; }
@@ -187,14 +242,26 @@ public:
 
     void delete_unopened_logdevs();
 
+    std::vector< logdev_id_t > shared_logdevs();
+
+    /**
+     * @brief Queue the logdev to be flushed upon next tick of the shared flush timer (if shared_flush_timer is set).
+     * Logdev is expected to queue itself only once until it is called back.
+     */
+    void queue_shared_flush(logdev_id_t logdev_id);
+
 private:
     std::shared_ptr< LogDev > create_new_logdev_internal(logdev_id_t logdev_id);
     void on_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie);
     logdev_id_t get_next_logdev_id();
     void logdev_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
     void rollback_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
+    void group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
     void start_threads();
     void flush_if_needed();
+    void start_shared_flush_timer();
+    void stop_shared_flush_timer();
+    void on_shared_flush_timer();
 
 private:
     std::unordered_map< logdev_id_t, std::shared_ptr< LogDev > > m_id_logdev_map;
@@ -206,6 +273,11 @@ private:
     LogStoreServiceMetrics m_metrics;
     std::unordered_set< logdev_id_t > m_unopened_logdev;
     superblk< logstore_service_super_block > m_sb;
+
+    // Shared flush timer and the logdevs queued to it, in order
+    iomgr::timer_handle_t m_shared_flush_timer_hdl{iomgr::null_timer_handle};
+    std::mutex m_shared_flush_mtx;
+    std::vector< logdev_id_t > m_shared_flush_queue;
 };
 
 extern LogStoreService& logstore_service();
@@ -17,6 +17,7 @@
 
 #include <cstdint>
 #include <functional>
+#include <list>
 #include <map>
 #include <unordered_map>
 #include <memory>
@@ -26,6 +27,8 @@
 #include <vector>
 #include <optional>
 
+#include <folly/futures/Future.h>
+#include <iomgr/iomgr.hpp>
 #include <sisl/fds/buffer.hpp>
 #include <sisl/metrics/metrics.hpp>
 #include <nlohmann/json.hpp>
@@ -61,8 +64,19 @@ public:
         REGISTER_COUNTER(compress_success_cnt, "compression successful cnt");
         REGISTER_COUNTER(compress_backoff_memory_cnt, "compression back-off cnt because of exceending memory limit")
         REGISTER_COUNTER(compress_backoff_ratio_cnt, "compression back-off cnt because of exceeding ratio limit");
+        REGISTER_COUNTER(compress_backoff_sample_cnt, "compression back-off cnt because of the ratio of a sample");
+        REGISTER_COUNTER(compress_skip_type_cnt, "compression skipped cnt because the sub type is incompressible");
+
+        REGISTER_COUNTER(context_cache_hits, "sub sb reads of overflow context served from the context cache");
+        REGISTER_COUNTER(context_cache_misses, "sub sb reads of overflow context which had to read the overflow blks");
+        REGISTER_COUNTER(lazy_load_skipped_cnt, "sub sbs called back without their context at recovery");
+
+        REGISTER_COUNTER(async_sb_writes_cnt, "sub sb adds/updates requested through the async apis");
+        REGISTER_COUNTER(async_sb_merged_cnt, "async sub sb updates merged into a pending update of the same sb");
 
         REGISTER_HISTOGRAM(compress_ratio_percent, "compression ration percentage");
+        REGISTER_HISTOGRAM(async_sb_batch_size, "sub sbs written in one pass of the async writes",
+                           HistogramBucketsType(LinearUpto128Buckets));
         register_me_to_farm();
     }
 
@@ -75,8 +89,11 @@ public:
 };
 
 struct meta_vdev_context;
+class MetaLogStore;
 
 class MetaBlkService {
+    friend class MetaLogStore;
+
 private:
     static bool s_self_recover;
     std::shared_ptr< VirtualDev > m_sb_vdev; // super block vdev
@@ -88,11 +105,37 @@ private:
     std::unique_ptr< BlkId > m_last_mblk_id; // last meta blk;
     meta_blk_sb* m_ssb{nullptr};             // meta super super blk;
     sisl::blob m_compress_info;
-    MetablkMetrics m_metrics;
+    mutable MetablkMetrics m_metrics;
     bool m_inited{false};
     std::unique_ptr< meta_vdev_context > m_meta_vdev_context;
     subtype_graph_t m_dep_topo_graph;
 
+    // Sub sb adds/updates requested through the async apis, in order, yet to be written
+    struct pending_sb_write {
+        meta_sub_type type;   // Only for add
+        void* cookie{nullptr}; // Sb being updated, null for add
+        sisl::io_blob_safe buf;
+        std::vector< folly::Promise< void* > > promises; // Fulfilled with the cookie, once the sb is written
+    };
+    std::mutex m_pending_mtx;
+    std::vector< pending_sb_write > m_pending_writes;
+    bool m_pending_writes_scheduled{false};
+    iomgr::io_fiber_t m_sb_write_fiber{nullptr};
+
+    std::unique_ptr< MetaLogStore > m_log; // Backend of the log structured sub types
+
+    // Overflow contexts (as on disk) of meta blks, recently read or written, up to metablk.context_cache_size_mb
+    struct cached_context {
+        uint32_t gen_cnt; // of the meta blk when its context is cached
+        sisl::byte_array buf;
+        std::list< uint64_t >::iterator lru_it;
+    };
+    mutable std::mutex m_ctx_cache_mtx;
+    mutable std::unordered_map< uint64_t, cached_context > m_ctx_cache; // By meta blk id
+    mutable std::list< uint64_t > m_ctx_cache_lru;                      // Most recent at the front
+    mutable uint64_t m_ctx_cache_size{0};
+    bool m_log_compaction_scheduled{false};
+
 public:
     MetaBlkService(const char* name = "MetaBlkStore");
     MetaBlkService(const MetaBlkService&) = delete;
@@ -100,7 +143,7 @@ public:
     MetaBlkService& operator=(const MetaBlkService&) = delete;
     MetaBlkService& operator=(MetaBlkService&&) noexcept = delete;
 
-    ~MetaBlkService() = default;
+    ~MetaBlkService();
 
     // Creates the vdev that is needed to initialize the device
     void create_vdev(uint64_t size, HSDevType devType, uint32_t num_chunks);
@@ -124,9 +167,12 @@ public:
      * @brief : Register subsystem callbacks
      * @param type : subsystem type
      * @param cb : subsystem cb
+     * @param log_structured : sbs added from now on are appended to the meta log instead of being meta blks, for
+     * types with many sbs which are updated often. Cookies and callbacks are the same for either of them.
      */
     void register_handler(meta_sub_type type, const meta_blk_found_cb_t& cb, const meta_blk_recover_comp_cb_t& comp_cb,
-                          bool do_crc = true, std::optional< meta_subtype_vec_t > deps = std::nullopt);
+                          bool do_crc = true, std::optional< meta_subtype_vec_t > deps = std::nullopt,
+                          bool log_structured = false);
 
     /**
      * @brief
@@ -166,9 +212,39 @@ public:
      */
     void update_sub_sb(const uint8_t* context_data, uint64_t sz, void* cookie);
 
+    /**
+     * @brief : async version of add_sub_sb. Context data is copied before returning. Adds and updates requested
+     * asynchronously are written in order, in a pass under one acquisition of the meta lock and updates of a sb pending
+     * in that pass are merged into one write of the latest of them. Sync apis write the pending ones first.
+     *
+     * @return : future with the cookie of the sb, once it is written;
+     */
+    folly::Future< void* > async_add_sub_sb(meta_sub_type type, const uint8_t* context_data, uint64_t sz);
+
+    /**
+     * @brief : async version of update_sub_sb, see async_add_sub_sb. Cookie should be removed only once it is done.
+     *
+     * @return : future which is set once the update (or a later update of the same sb merged with it) is written;
+     */
+    folly::Future< bool > async_update_sub_sb(const uint8_t* context_data, uint64_t sz, void* cookie);
+
     // size_t read_sub_sb(const meta_sub_type type, sisl::byte_view& buf);
     void read_sub_sb(meta_sub_type type);
 
+    /**
+     * @brief : Sbs of the type whose context is at least min_size are called back at recovery with an empty buffer and
+     * size 0, instead of their context being read, which the consumer reads later (if at all) with load_sub_sb. It is
+     * for types whose large blobs are not needed to start. Should be called after register_handler, before recovery.
+     */
+    void enable_lazy_load(meta_sub_type type, uint64_t min_size);
+
+    /**
+     * @brief : read the context of the sb, decompressed and crc checked (if the type does crc)
+     *
+     * @param cookie : handle of the sb, the one called back at recovery or returned by add_sub_sb
+     */
+    sisl::byte_array load_sub_sb(const void* cookie);
+
     /**
      * @brief :
      *
@@ -234,6 +310,30 @@ private:
      */
     bool is_sub_type_valid(meta_sub_type type);
 
+    void add_sub_sb_internal(meta_sub_type type, const uint8_t* context_data, uint64_t sz, void*& cookie);
+    void update_sub_sb_internal(const uint8_t* context_data, uint64_t sz, void* cookie);
+
+    /**
+     * @brief : queue an async add/update and schedule a pass to write the pending ones, if not already
+     */
+    folly::Future< void* > queue_sb_write(meta_sub_type type, void* cookie, const uint8_t* context_data, uint64_t sz);
+
+    /**
+     * @brief : write all the pending async adds/updates in one pass, then fulfill their promises
+     */
+    void write_pending_sbs();
+    void start_sb_write_thread();
+
+    /**
+     * @brief : load the meta log from its anchor, which is scanned by now, before the sub types are recovered
+     */
+    void load_meta_log();
+
+    /**
+     * @brief : schedule compaction of the meta log on the sb writer, if it needs one, caller holds the meta lock
+     */
+    void schedule_meta_log_compaction();
+
     /**
      * @brief : write in-memory copy of meta_blk to disk;
      *
@@ -330,9 +430,22 @@ private:
      */
     sisl::byte_array read_sub_sb_internal(const meta_blk* mblk) const;
 
+    /**
+     * @brief : same as read_sub_sb_internal for each of the meta blks, but the data blks of all of them are read in
+     * parallel
+     */
+    std::vector< sisl::byte_array > read_sub_sbs(std::vector< meta_blk* > const& mblks) const;
+
     void free_compress_buf();
     void alloc_compress_buf(size_t size);
 
+    /**
+     * @brief : whether compression of this sb is skipped, because its sub type is found to be incompressible lately
+     * or a sample of it is not compressed to within the ratio limit
+     */
+    bool skip_compress(MetaSubRegInfo* info, const uint8_t* context_data, uint64_t sz);
+    void track_compress_ratio(MetaSubRegInfo* info, uint32_t ratio_percent, bool compressed);
+
     uint64_t min_compress_size() const;
     uint64_t max_compress_memory_size() const;
     uint64_t init_compress_memory_size() const;
@@ -363,6 +476,16 @@ private:
                                  client_info_map_t& sub_info);
 
     void recover_meta_block(meta_blk* meta_block);
+    void recover_meta_block(meta_blk* meta_block, sisl::byte_array buf);
+    bool is_lazy_loaded(const meta_blk* mblk) const;
+    sisl::byte_array decompress_context(const meta_blk* mblk, const sisl::byte_array& buf) const;
+
+    /**
+     * @brief : context cache, see m_ctx_cache. Cached context is copied out, so that consumers can't modify it.
+     */
+    sisl::byte_array cached_context_of(const meta_blk* mblk) const;
+    void cache_context(const meta_blk* mblk, const uint8_t* data, uint64_t sz) const;
+    void uncache_context(const BlkId& bid) const;
     void recover_meta_sub_type(bool do_comp_cb, const meta_sub_type&);
 
 public:
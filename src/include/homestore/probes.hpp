@@ -0,0 +1,49 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+//
+// USDT (user level statically defined tracing) probes of the provider "homestore" on the hot paths, to be attached by
+// bpftrace, perf or systemtap on a running production binary, for instance
+//   bpftrace -e 'usdt:/path/to/binary:homestore:pdev_io_complete { @lat_us[str(arg0), arg1] = hist(arg2); }'
+//
+// A probe is a single nop in the code along with a note in the binary, so it costs next to nothing until a tracer
+// attaches to it. Its args are only materialized into registers, so they are kept to the values already at hand.
+// Probes are compiled in when <sys/sdt.h> (systemtap-sdt-dev) is available, unless HS_DISABLE_USDT is defined, and
+// are no-ops otherwise.
+//
+// Probes and their args:
+//   pdev_io_submit(devname, op, size, write_stream)    pdev_io_complete(devname, op, lat_us, err)
+//   logdev_flush_start(logdev_id, nrecords, size)      logdev_flush_end(logdev_id, nrecords, lat_us)
+//   cp_switchover(cp_id, next_cp_id)                   cp_flush_start(cp_id)
+//   cp_consumer_flush_done(cp_id, consumer, lat_us)    cp_flush_done(cp_id, lat_us)
+//   blk_alloc(chunk_id, nblks, status)                 blk_free(chunk_num, blk_num, nblks)
+//   btree_split(node_id, level, nentries)              btree_merge(node_id, start_idx, end_idx)
+//   repl_commit(lsn, dsn)
+//
+#if !defined(HS_DISABLE_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define HS_USDT_ENABLED 1
+#endif
+#endif
+
+#ifdef HS_USDT_ENABLED
+#define HS_PROBE(name, ...) STAP_PROBEV(homestore, name, ##__VA_ARGS__)
+#else
+#define HS_PROBE(name, ...)                                                                                            \
+    do {                                                                                                               \
+    } while (0)
+#endif
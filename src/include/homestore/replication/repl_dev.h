@@ -1,16 +1,23 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <optional>
+#include <span>
 #include <variant>
 
 #include <boost/intrusive_ptr.hpp>
-#include <boost/smart_ptr/intrusive_ref_counter.hpp>
 #include <flatbuffers/flatbuffers.h>
+#include <folly/executors/InlineExecutor.h>
 #include <folly/futures/Future.h>
+#include <folly/futures/SharedPromise.h>
 #include <sisl/fds/buffer.hpp>
 #include <sisl/fds/utils.hpp>
+#include <sisl/utility/atomic_counter.hpp>
 #include <sisl/grpc/generic_service.hpp>
 #include <sisl/grpc/rpc_client.hpp>
 #include <homestore/replication/repl_decls.h>
+#include <homestore/tracer.hpp>
 #include <libnuraft/snapshot.hxx>
 
 namespace nuraft {
@@ -37,10 +44,30 @@ VENUM(repl_req_state_t, uint32_t,
       ERRORED = 1 << 5        // Error has happened and cleaned up
 )
 
+// Stages of a request through the replication pipeline, which the request records the time of reaching
+VENUM(repl_req_stage_t, uint8_t,
+      PROPOSED = 0,     // Journal entry is proposed to raft, only on the proposer
+      DATA_PUSHED = 1,  // Data is pushed to all the followers, only on the proposer
+      LOG_FLUSHED = 2,  // Journal entry is durable (on the proposer, as of its commit)
+      COMMITTED = 3,    // Entry is committed by raft, that is after the majority acked it to the leader
+      COMMIT_DONE = 4,  // Listener is done with the commit
+      DATA_WRITTEN = 5, // Data is written locally
+      COUNT = 6         // Number of stages, not a stage
+)
+
+// clang-format off
+VENUM(repl_read_consistency_t, uint8_t,
+      LOCAL = 0,  // As of the last commit on this replica, which could be behind the leader
+      LEASE = 1,  // As of the leader's commit lsn known from its last append/heartbeat, while the leader is alive
+      LEADER = 2  // Served only by the leader
+);
+// clang-format on
+
 VENUM(journal_type_t, uint16_t,
       HS_DATA_LINKED = 0,  // Linked data where each entry will store physical blkid where data reside
       HS_DATA_INLINED = 1, // Data is inlined in the header of journal entry
-      HS_CTRL_DESTROY = 2  // Control message to destroy the repl_dev
+      HS_CTRL_DESTROY = 2, // Control message to destroy the repl_dev
+      HS_DATA_EMBEDDED = 3 // Small data is embedded in the journal entry, after the slot of the blkid it is written to
 )
 
 struct repl_key {
@@ -65,13 +92,21 @@ struct repl_snapshot {
 };
 
 struct repl_journal_entry;
-struct repl_req_ctx : public boost::intrusive_ref_counter< repl_req_ctx, boost::thread_safe_counter >,
-                      sisl::ObjLifeCounter< repl_req_ctx > {
+struct repl_req_ctx : public sisl::ObjLifeCounter< repl_req_ctx > {
     friend class SoloReplDev;
 
 public:
     repl_req_ctx() { m_start_time = Clock::now(); }
     virtual ~repl_req_ctx();
+
+    /// @brief Request from the pool of this thread, which it goes back to (reset) once it is released. Requests
+    /// created otherwise, including all the ones of a derived type, are deleted as usual.
+    static repl_req_ptr_t make_pooled();
+
+    friend void intrusive_ptr_add_ref(repl_req_ctx const* req) { req->m_ref_cnt.increment(1); }
+    friend void intrusive_ptr_release(repl_req_ctx const* req) {
+        if (req->m_ref_cnt.decrement_testz(1)) { free_req(const_cast< repl_req_ctx* >(req)); }
+    }
     void init(repl_key rkey, journal_type_t op_code, bool is_proposer, sisl::blob const& user_header,
               sisl::blob const& key, uint32_t data_size);
 
@@ -94,7 +129,12 @@ public:
     uint32_t journal_entry_size() const;
     bool is_localize_pending() const { return m_is_jentry_localize_pending; }
     bool is_data_inlined() const { return (m_op_code == journal_type_t::HS_DATA_INLINED); }
-    bool has_linked_data() const { return (m_op_code == journal_type_t::HS_DATA_LINKED); }
+    /// @brief Data is written to local blks, whether it came over the data channel or embedded in the journal entry
+    bool has_linked_data() const {
+        return (m_op_code == journal_type_t::HS_DATA_LINKED) || (m_op_code == journal_type_t::HS_DATA_EMBEDDED);
+    }
+    bool has_embedded_data() const { return (m_op_code == journal_type_t::HS_DATA_EMBEDDED); }
+    uint32_t data_size() const { return m_data_size; }
 
     raft_buf_ptr_t& raft_journal_buf();
     uint8_t* raw_journal_buf();
@@ -103,6 +143,12 @@ public:
     std::string to_string() const;
     std::string to_compact_string() const;
     Clock::time_point created_time() const { return m_start_time; }
+    trace_id_t trace_id() const { return m_trace_id; }
+
+    /// @brief Time from the creation of the request to when it reached the stage, in us, 0 if it didn't reach it yet
+    uint64_t stage_time_us(repl_req_stage_t s) const {
+        return m_stage_us[s_cast< size_t >(s)].load(std::memory_order_relaxed);
+    }
     bool is_expired() const;
 
     /////////////////////// All Modifiers methods //////////////////
@@ -146,22 +192,46 @@ public:
     /// @return true if the request didn't receive the data already, false otherwise
     bool save_fetched_data(sisl::GenericClientResponse const& fetched_data, uint8_t const* data, uint32_t data_size);
 
+    /// @brief Save the data to be embedded in the journal entry (on the proposer) or found embedded in it (on the
+    /// applier). Data is always copied (padded upto the blk), as it is small and has to outlive the buffers it is from.
+    /// @param data Data to be saved
+    /// @return true if the request didn't receive the data already, false otherwise
+    bool save_embedded_data(sisl::sg_list const& data);
+
+    /// @brief Save the data which was received compressed, decompressed by the caller into buf
+    /// @param buf Data decompressed, aligned to the data service so that it can be written as is
+    /// @return true if the request didn't receive the data already, false otherwise
+    bool save_decompressed_data(sisl::io_blob_safe&& buf);
+
+    /// @brief Buffer for the data of this request compressed to be sent over the wire, kept until it is reset
+    sisl::io_blob_safe& wire_buf() { return m_wire_buf; }
+
     void set_remote_blkid(RemoteBlkId const& rbid) { m_remote_blkid = rbid; }
     void set_local_blkid(MultiBlkId const& lbid) { m_local_blkid = lbid; } // Only used during recovery
     void set_lsn(int64_t lsn);
     void add_state(repl_req_state_t s);
+    void mark_stage(repl_req_stage_t s);
+    void set_trace_id(trace_id_t id) { m_trace_id = id; }
     bool add_state_if_not_already(repl_req_state_t s);
     void clear();
-    flatbuffers::FlatBufferBuilder& create_fb_builder() { return m_fb_builder; }
-    void release_fb_builder() { m_fb_builder.Release(); }
+
+    /// @brief Builder for the rpc of this request, from the pool of this thread, until release_fb_builder
+    flatbuffers::FlatBufferBuilder& create_fb_builder();
+    void release_fb_builder();
+
+private:
+    static void free_req(repl_req_ctx* req);
+    void reset();
+    void release_journal_buf();
 
 public:
     // IMPORTANT: Avoid declaring variables public, since this structure carries various entries and try to work in
     // lockless way. As a result, we keep only those which are considered thread safe and others are accessed with
     // methods.
     folly::Promise< folly::Unit > m_data_received_promise; // Promise to be fulfilled when data is received
-    folly::Promise< folly::Unit > m_data_written_promise;  // Promise to be fulfilled when data is written
-    sisl::io_blob_list_t m_pkts;                           // Pkts used for sending data
+    // Promise to be fulfilled when data is written, waited on by the commit and the fetch of the data as well
+    folly::SharedPromise< folly::Unit > m_data_written_promise;
+    sisl::io_blob_list_t m_pkts; // Pkts used for sending data
     std::mutex m_state_mtx;
 
 private:
@@ -171,12 +241,14 @@ private:
     int64_t m_lsn{-1};                                         // Lsn for this replication req
     bool m_is_proposer{false};                                 // Is the repl_req proposed by this node
     Clock::time_point m_start_time;                            // Start time of the request
+    trace_id_t m_trace_id{invalid_trace_id};                   // Trace of the request if it is sampled
     journal_type_t m_op_code{journal_type_t::HS_DATA_INLINED}; // Operation code for this request
 
     /////////////// Data related section /////////////////
     MultiBlkId m_local_blkid;   // Local BlkId for the data
     RemoteBlkId m_remote_blkid; // Corresponding remote blkid for the data
     uint8_t const* m_data;      // Raw data pointer containing the actual data
+    uint32_t m_data_size{0};    // Size of the data, if it has linked data
 
     /////////////// Journal/Buf related section /////////////////
     std::variant< std::unique_ptr< uint8_t[] >, raft_buf_ptr_t > m_journal_buf; // Buf for the journal entry
@@ -185,12 +257,27 @@ private:
 
     /////////////// Replication state related section /////////////////
     std::atomic< uint32_t > m_state{uint32_cast(repl_req_state_t::INIT)}; // State of the replication request
+    std::array< std::atomic< uint64_t >, s_cast< size_t >(repl_req_stage_t::COUNT) > m_stage_us{}; // By stage
 
     /////////////// Communication packet/builder section /////////////////
-    flatbuffers::FlatBufferBuilder m_fb_builder;
+    std::unique_ptr< flatbuffers::FlatBufferBuilder > m_fb_builder;
     sisl::io_blob_safe m_buf_for_unaligned_data;
+    sisl::io_blob_safe m_wire_buf;
     intrusive< sisl::GenericRpcData > m_pushed_data;
     sisl::GenericClientResponse m_fetched_data;
+
+    /////////////// Lifecycle section /////////////////
+    mutable sisl::atomic_counter< int32_t > m_ref_cnt{0};
+    bool m_pooled{false}; // Created by make_pooled, goes back to the pool once released
+};
+
+// A log entry committed, as passed to ReplDevListener::on_commit_batch
+struct repl_commit_record {
+    int64_t lsn;
+    sisl::blob header;
+    sisl::blob key;
+    MultiBlkId blkids;
+    repl_req_ptr_t ctx;
 };
 
 //
@@ -217,6 +304,29 @@ public:
     virtual void on_commit(int64_t lsn, sisl::blob const& header, sisl::blob const& key, MultiBlkId const& blkids,
                            cintrusive< repl_req_ctx >& ctx) = 0;
 
+    /// @brief Called instead of on_commit, with all the log entries committed in one round of raft commits (upto
+    /// consensus.commit_batch_max_entries of them), so that the cost of applying them (locks, CP guards etc) can be
+    /// shared across all of them. It has the same thread and ordering guarantees as on_commit, with the records in the
+    /// increasing order of lsn. Default applies them one by one through on_commit.
+    ///
+    /// @param records - Log entries committed
+    ///
+    virtual void on_commit_batch(std::span< repl_commit_record const > records) {
+        for (auto const& r : records) {
+            on_commit(r.lsn, r.header, r.key, r.blkids, r.ctx);
+        }
+    }
+
+    /// @brief Ordering key of a log entry, to apply commits in parallel on the commit threads (see
+    /// consensus.commit_apply_threads). on_commit of entries with the same key is called in the order of their lsn,
+    /// while the ones with different keys could be called concurrently. An entry with no key (default) is applied once
+    /// all the entries before it are done, and the entries after it wait for it.
+    ///
+    /// @param header - Header originally passed with repl_dev::write() api
+    /// @param key - Key originally passed with repl_dev::write() api
+    /// @return Key, which needs to be the same for all the entries which conflict with each other
+    virtual std::optional< uint64_t > commit_order_key(sisl::blob const&, sisl::blob const&) { return std::nullopt; }
+
     /// @brief Called when the log entry has been received by the replica dev.
     ///
     /// On recovery, this is called from a random worker thread before the raft server is started. It is
@@ -288,6 +398,31 @@ public:
     /// @brief Called when the snapshot is being created by nuraft;
     virtual AsyncReplResult<> create_snapshot(repl_snapshot& s) = 0;
 
+    /// @brief Chunks of the data service which hold the data of this repl dev, listed in the same order on all the
+    /// replicas. A snapshot sent to a new replica then streams the allocated blks of these chunks as is, each one to
+    /// the chunk at the same position on the new replica and at the same blk numbers, followed by the objects of
+    /// read_snapshot_obj. This is a HomeStore native snapshot. Empty (default) means no native snapshot.
+    virtual std::vector< chunk_num_t > snapshot_data_chunks() { return {}; }
+
+    /// @brief Reads the obj_seq'th object of listener's own state (index etc) for a native snapshot, which is sent
+    /// after all the data of snapshot_data_chunks. Called on the replica sending the snapshot.
+    ///
+    /// @param s - Snapshot being sent
+    /// @param obj_seq - Sequence of the object, starting from 0
+    /// @param out - Object read, empty if there is nothing to send
+    /// @param is_last - Set if it is the last object
+    virtual void read_snapshot_obj(repl_snapshot const&, uint64_t, sisl::io_blob_safe&, bool& is_last) {
+        is_last = true;
+    }
+
+    /// @brief Writes an object of read_snapshot_obj on the new replica. Objects are written in the order of obj_seq,
+    /// though an object could be written again if the snapshot is resumed.
+    virtual void write_snapshot_obj(repl_snapshot const&, uint64_t, sisl::blob const&) {}
+
+    /// @brief Called on the new replica once all of a native snapshot is written, before any log entry after it is
+    /// committed.
+    virtual void on_snapshot_applied(repl_snapshot const&) {}
+
 private:
     std::weak_ptr< ReplDev > m_repl_dev;
 };
@@ -330,6 +465,47 @@ public:
     virtual folly::Future< std::error_code > async_read(MultiBlkId const& blkid, sisl::sg_list& sgs, uint32_t size,
                                                         bool part_of_batch = false) = 0;
 
+    /// @brief Waits until this replica can serve a read with the given consistency, that is until it has committed
+    /// everything the consistency needs it to. Consumer then reads its own state (index etc) and the data. With LEASE,
+    /// reads are spread across all replicas, instead of all of them going to the leader.
+    /// @param consistency Consistency the read needs
+    /// @return OK once ready, NOT_LEADER if this replica can't serve it (read from leader) or TIMEOUT if it is too far
+    /// behind the leader
+    virtual AsyncReplResult<> wait_for_consistent_read(repl_read_consistency_t) {
+        return folly::makeSemiFuture< ReplResult< folly::Unit > >(folly::Unit{});
+    }
+
+    /// @brief Reads the data once this replica can serve a read with the given consistency (see
+    /// wait_for_consistent_read)
+    /// @return A Future with std::error_code, which is resource_unavailable_try_again if the read needs to be served
+    /// by another replica (leader) and timed_out if this replica is too far behind
+    folly::Future< std::error_code > async_read(MultiBlkId const& blkid, sisl::sg_list& sgs, uint32_t size,
+                                                repl_read_consistency_t consistency, bool part_of_batch = false) {
+        return wait_for_consistent_read(consistency)
+            .via(&folly::InlineExecutor::instance())
+            .thenValue([this, blkid, &sgs, size, part_of_batch](auto&& r) {
+                if (r.hasError()) {
+                    return folly::makeFuture< std::error_code >(
+                        std::make_error_code((r.error() == ReplServiceError::TIMEOUT)
+                                                 ? std::errc::timed_out
+                                                 : std::errc::resource_unavailable_try_again));
+                }
+                return async_read(blkid, sgs, size, part_of_batch);
+            });
+    }
+
+    /// @brief Reads the data, hedged with a read of the same data off another replica: if the local read is not done
+    /// within the tail latency of recent reads of the local drive, the data is fetched from the replica as well and
+    /// whichever of them is first fills sgs. Unlike async_read, the local read is to a buffer of its own (copied to
+    /// sgs once done), so that sgs is not written to after the future completes.
+    /// @param remote Replica which has the data and the blkid of it there, like the remote_blkid of the request saved
+    /// by the listener on its commit. Reads are not hedged if it is this replica.
+    /// @param lsn LSN of the entry which wrote the data. Replica serves it only if the blkid is still of that entry's.
+    virtual folly::Future< std::error_code > async_read_hedged(MultiBlkId const& blkid, sisl::sg_list& sgs,
+                                                               uint32_t size, RemoteBlkId const&, int64_t) {
+        return async_read(blkid, sgs, size);
+    }
+
     /// @brief After data is replicated and on_commit to the listener is called. the blkids can be freed.
     ///
     /// @param lsn - LSN of the old blkids that is being freed
@@ -359,6 +535,11 @@ public:
     /// @return Block size
     virtual uint32_t get_blk_size() const = 0;
 
+    /// @brief Gets the tenant the data ios of this repl dev are accounted to and fair shared as, on the data vdev
+    /// (see BlkDataService::set_io_tenant_weight)
+    /// @return io tenant, untagged if the repl dev doesn't tag its ios
+    virtual io_tenant_t io_tenant() const { return untagged_io_tenant; }
+
     virtual void attach_listener(shared< ReplDevListener > listener) { m_listener = std::move(listener); }
 
     virtual void detach_listener() {
@@ -15,7 +15,9 @@
  *********************************************************************************/
 #pragma once
 #include <atomic>
+#include <cstring>
 #include <string>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 #include <sisl/fds/buffer.hpp>
@@ -115,6 +117,16 @@ public:
         }
     }
 
+    /// @brief Write the sb along with the other pending async sb writes. Sb is copied before returning, so it can be
+    /// modified right after. First write of the sb is done synchronously, since its cookie is needed for the next.
+    folly::Future< bool > async_write() {
+        if (m_meta_blk == nullptr) {
+            write();
+            return folly::makeFuture< bool >(true);
+        }
+        return meta_service().async_update_sub_sb(m_raw_buf->cbytes(), m_raw_buf->size(), m_meta_blk);
+    }
+
     bool is_empty() const { return (m_sb == nullptr); }
     T* get() { return m_sb; }
     T* operator->() { return m_sb; }
@@ -198,7 +210,86 @@ public:
         }
     }
 
+    /// @brief Write the sb along with the other pending async sb writes, same as superblk::async_write
+    folly::Future< bool > async_write() {
+        if (m_meta_blk == nullptr) {
+            write();
+            return folly::makeFuture< bool >(true);
+        }
+        auto const packed_data = nlohmann::json::to_msgpack(m_json_sb);
+        return meta_service().async_update_sub_sb(r_cast< uint8_t const* >(packed_data.data()), packed_data.size(),
+                                                  m_meta_blk);
+    }
+
     nlohmann::json& operator*() { return m_json_sb; }
 };
 
+// Same as json_superblk, but the content is opaque bytes the consumer encodes itself (say as a flatbuffer), which
+// saves the cost of building and msgpack packing a json on every write of a frequently updated superblk.
+class binary_superblk {
+private:
+    void* m_meta_blk{nullptr};
+    std::vector< uint8_t > m_data;
+    std::string m_meta_sub_name;
+
+public:
+    binary_superblk(const std::string& sub_name = "") { set_name(sub_name); }
+
+    void set_name(const std::string& sub_name) {
+        if (sub_name.empty()) {
+            m_meta_sub_name = "meta_blk_" + std::to_string(json_superblk::next_count());
+        } else {
+            m_meta_sub_name = sub_name;
+        }
+    }
+
+    std::vector< uint8_t >& load(const sisl::byte_view& buf, void* meta_blk) {
+        m_meta_blk = voidptr_cast(meta_blk);
+        m_data.assign(buf.bytes(), buf.bytes() + buf.size());
+        return m_data;
+    }
+
+    std::vector< uint8_t >& create() { return m_data; }
+
+    void destroy() {
+        if (m_meta_blk) {
+            meta_service().remove_sub_sb(m_meta_blk);
+            m_meta_blk = nullptr;
+        }
+        m_data.clear();
+    }
+
+    uint32_t size() const { return uint32_cast(m_data.size()); }
+
+    void write() {
+        auto do_write = [this](sisl::blob const& b) {
+            if (m_meta_blk) {
+                meta_service().update_sub_sb(b.cbytes(), b.size(), m_meta_blk);
+            } else {
+                meta_service().add_sub_sb(m_meta_sub_name, b.cbytes(), b.size(), m_meta_blk);
+            }
+        };
+
+        auto const size = m_data.size();
+        if (meta_service().is_aligned_buf_needed(size)) {
+            sisl::io_blob_safe buffer(size, meta_service().align_size());
+            std::memcpy(buffer.bytes(), m_data.data(), size);
+            do_write(buffer);
+        } else {
+            do_write(sisl::blob{m_data.data(), uint32_cast(size)});
+        }
+    }
+
+    /// @brief Write the sb along with the other pending async sb writes, same as superblk::async_write
+    folly::Future< bool > async_write() {
+        if (m_meta_blk == nullptr) {
+            write();
+            return folly::makeFuture< bool >(true);
+        }
+        return meta_service().async_update_sub_sb(m_data.data(), m_data.size(), m_meta_blk);
+    }
+
+    std::vector< uint8_t >& operator*() { return m_data; }
+};
+
 } // namespace homestore
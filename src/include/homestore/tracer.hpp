@@ -0,0 +1,104 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+using trace_id_t = uint64_t;
+static constexpr trace_id_t invalid_trace_id{0};
+
+struct trace_span {
+    trace_id_t trace_id{invalid_trace_id};
+    char const* name{nullptr}; // Static string naming the point in the path
+    uint64_t start_ns{0};      // Unix time, as OpenTelemetry expects
+    uint64_t end_ns{0};
+    uint64_t arg{0};           // Detail of the span, like the lsn, size or node id
+    uint32_t thread{0};        // Index of the thread which recorded it
+};
+
+//
+// Tracer follows a sampled request through the layers (replication, log store, data service and index), as spans
+// recorded in a ring buffer of each thread. A request is sampled (given a trace id) where it enters HomeStore, every
+// trace_sample_every of them (hotswap, 0 disables). The trace id is carried along in the request across the async
+// parts of its path, and in the thread (TraceScope) across the synchronous calls into the other layers, which record
+// their spans against it. Requests not sampled cost only checking the trace id.
+//
+// Recent traces are dumped through the status of "Tracer" (get_status). Spans could also be exported as they are
+// recorded, for instance to an OpenTelemetry span processor, through the export cb.
+//
+class Tracer {
+public:
+    using export_cb_t = std::function< void(trace_span const&) >;
+
+    /// @brief Trace id for a new request if it is to be sampled, invalid_trace_id otherwise
+    static trace_id_t sample();
+
+    /// @brief Trace id of the request this thread is working on
+    static trace_id_t current() { return t_current; }
+
+    /// @brief Record the span from start until now, if it is of a sampled request
+    static void record(trace_id_t id, char const* name, Clock::time_point start, uint64_t arg = 0) {
+        if (id != invalid_trace_id) { record_span(id, name, start, Clock::now(), arg); }
+    }
+
+    /// @brief Upto max_traces of the most recent traces, each with its spans in the order of their start
+    static nlohmann::json dump(uint32_t max_traces);
+
+    /// @brief Set the cb (nullptr to reset) called on every span recorded, from the thread which recorded it
+    static void set_export_cb(export_cb_t cb);
+
+private:
+    friend class TraceScope;
+    static void record_span(trace_id_t id, char const* name, Clock::time_point start, Clock::time_point end,
+                            uint64_t arg);
+
+    static thread_local trace_id_t t_current;
+};
+
+// Makes the trace id current on this thread for the scope, so that the layers called synchronously record against it
+class TraceScope {
+public:
+    explicit TraceScope(trace_id_t id) : m_prev{Tracer::t_current} { Tracer::t_current = id; }
+    TraceScope(TraceScope const&) = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+    ~TraceScope() { Tracer::t_current = m_prev; }
+
+private:
+    trace_id_t m_prev;
+};
+
+// Span of the scope, recorded against the current trace id of the thread
+class TraceSpan {
+public:
+    explicit TraceSpan(char const* name, uint64_t arg = 0) : m_id{Tracer::current()}, m_name{name}, m_arg{arg} {
+        if (m_id != invalid_trace_id) { m_start = Clock::now(); }
+    }
+    TraceSpan(TraceSpan const&) = delete;
+    TraceSpan& operator=(TraceSpan const&) = delete;
+    ~TraceSpan() { Tracer::record(m_id, m_name, m_start, m_arg); }
+
+    void set_arg(uint64_t arg) { m_arg = arg; }
+
+private:
+    trace_id_t m_id;
+    char const* m_name;
+    uint64_t m_arg;
+    Clock::time_point m_start;
+};
+} // namespace homestore
@@ -21,6 +21,27 @@
 namespace homestore {
 class Chunk;
 
+/// @brief Usage of a chunk, to drive the GC and placement decisions. Totals are since the chunk was loaded, rates are
+/// per second, averaged over its recent samples.
+struct chunk_usage {
+    uint64_t read_ios{0};
+    uint64_t read_bytes{0};
+    uint64_t write_ios{0};
+    uint64_t write_bytes{0};
+    uint64_t alloced_blks{0};
+    uint64_t freed_blks{0};
+
+    double read_iops{0};
+    double write_iops{0};
+    double read_bytes_ps{0};
+    double write_bytes_ps{0};
+    double alloc_blks_ps{0};
+
+    blk_num_t available_blks{0};
+    blk_num_t defrag_nblks{0}; // 0 if the allocator doesn't track it
+    double fragmentation{0};   // defrag_nblks relative to the used blks
+};
+
 class VChunk {
 public:
     VChunk(cshared< Chunk > const&);
@@ -32,6 +53,7 @@ public:
     blk_num_t get_total_blks() const;
     blk_num_t available_blks() const;
     blk_num_t get_defrag_nblks() const;
+    chunk_usage get_usage() const;
     uint32_t get_pdev_id() const;
     uint16_t get_chunk_id() const;
     cshared< Chunk > get_internal_chunk() const;
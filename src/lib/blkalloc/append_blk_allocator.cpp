@@ -13,6 +13,8 @@
  * specific language governing permissions and limitations under the License.
  * *
  * *********************************************************************************/
+#include <algorithm>
+
 #include <homestore/checkpoint/cp_mgr.hpp>
 #include <homestore/checkpoint/cp.hpp>
 #include <homestore/meta_service.hpp>
@@ -29,6 +31,12 @@ AppendBlkAllocator::AppendBlkAllocator(const BlkAllocConfig& cfg, bool need_form
         [this](meta_blk* mblk, sisl::byte_view buf, size_t size) { on_meta_blk_found(std::move(buf), (void*)mblk); },
         nullptr);
 
+    m_num_streams = HS_DYNAMIC_CONFIG(blkallocator.append_num_stream_heads);
+    if (m_num_streams > 0) {
+        m_stream_reserve_blks = std::max(HS_DYNAMIC_CONFIG(blkallocator.append_stream_reserve_blks), 1u);
+        m_stream_heads = std::make_unique< stream_head[] >(m_num_streams);
+    }
+
     if (need_format) {
         m_freeable_nblks = 0;
         m_last_append_offset = 0;
@@ -63,10 +71,13 @@ void AppendBlkAllocator::on_meta_blk_found(const sisl::byte_view& buf, void* met
 BlkAllocStatus AppendBlkAllocator::alloc_contiguous(BlkId& bid) { return alloc(1, blk_alloc_hints{}, bid); }
 
 //
-// For append blk allocator, the assumption is only one writer will append data on one chunk.
+// For append blk allocator, the assumption is only one writer will append data on one chunk, unless stream heads are
+// configured, in which case each stream appends within its own reserved range.
 // If we want to change above design, we can open this api for vector allocation;
 //
 BlkAllocStatus AppendBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hints& hint, BlkId& out_bid) {
+    if (m_num_streams > 0) { return alloc_in_stream(nblks, hint, out_bid); }
+
     if (available_blks() < nblks) {
         COUNTER_INCREMENT(m_metrics, num_alloc_failure, 1);
         LOGERROR("No space left to serve request nblks: {}, available_blks: {}", nblks, available_blks());
@@ -86,6 +97,84 @@ BlkAllocStatus AppendBlkAllocator::alloc(blk_count_t nblks, const blk_alloc_hint
     return BlkAllocStatus::SUCCESS;
 }
 
+uint32_t AppendBlkAllocator::pick_stream(blk_alloc_hints const& hints) const {
+    if (hints.stream_id_hint) { return *hints.stream_id_hint % m_num_streams; }
+
+    // Each allocating thread (reactor) sticks to one head
+    static std::atomic< uint32_t > s_next_thread_stream{0};
+    static thread_local uint32_t t_stream{s_next_thread_stream.fetch_add(1, std::memory_order_relaxed)};
+    return t_stream % m_num_streams;
+}
+
+BlkAllocStatus AppendBlkAllocator::alloc_in_stream(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_bid) {
+    if (nblks > max_blks_per_blkid()) {
+        COUNTER_INCREMENT(m_metrics, num_alloc_failure, 1);
+        LOGERROR("Can't serve request nblks: {} larger than max_blks_in_op: {}", nblks, max_blks_per_blkid());
+        return BlkAllocStatus::FAILED;
+    }
+
+    auto& head = m_stream_heads[pick_stream(hints)];
+    auto cur_range = head.range.load(std::memory_order_acquire);
+    while (true) {
+        auto const next = range_next(cur_range);
+        auto const end = range_end(cur_range);
+        if (next + nblks <= end) {
+            if (!head.range.compare_exchange_weak(cur_range, pack_range(next + nblks, end),
+                                                  std::memory_order_acq_rel)) {
+                continue;
+            }
+            out_bid = BlkId{next, nblks, m_chunk_id};
+            break;
+        }
+
+        // Range of this head is exhausted, reserve a fresh one from the chunk
+        blk_num_t rstart, rnblks;
+        if (!reserve_range(nblks, rstart, rnblks)) {
+            COUNTER_INCREMENT(m_metrics, num_alloc_failure, 1);
+            LOGERROR("No space left to serve request nblks: {}, available_blks: {}", nblks, available_blks());
+            return BlkAllocStatus::SPACE_FULL;
+        }
+
+        if (head.range.compare_exchange_strong(cur_range, pack_range(rstart + nblks, rstart + rnblks),
+                                               std::memory_order_acq_rel)) {
+            // Tail of the previous range is never going to be written, so it is as good as freed in the middle
+            if (end > next) { m_freeable_nblks.fetch_add(end - next); }
+        } else {
+            // Some other allocation refreshed the head meanwhile, use the fresh range only for this allocation
+            if (rnblks > nblks) { m_freeable_nblks.fetch_add(rnblks - nblks); }
+        }
+        out_bid = BlkId{rstart, nblks, m_chunk_id};
+        break;
+    }
+
+    COUNTER_INCREMENT(m_metrics, num_alloc, 1);
+    return BlkAllocStatus::SUCCESS;
+}
+
+bool AppendBlkAllocator::reserve_range(blk_count_t min_nblks, blk_num_t& out_start, blk_num_t& out_nblks) {
+    auto cur_offset = m_last_append_offset.load();
+    do {
+        if (cur_offset + min_nblks > get_total_blks()) { return false; }
+        out_nblks = std::min(std::max< blk_num_t >(m_stream_reserve_blks, min_nblks), get_total_blks() - cur_offset);
+    } while (!m_last_append_offset.compare_exchange_weak(cur_offset, cur_offset + out_nblks));
+
+    out_start = cur_offset;
+    COUNTER_INCREMENT(m_metrics, num_stream_reserves, 1);
+    return true;
+}
+
+// Blks reserved by stream heads but not yet allocated, which are below the given offset. If we crash, recovery resumes
+// appending from the commit offset, so these blks become holes which can only be reclaimed by defrag.
+blk_num_t AppendBlkAllocator::unwritten_stream_blks(blk_num_t upto_offset) const {
+    blk_num_t count{0};
+    for (uint32_t i{0}; i < m_num_streams; ++i) {
+        auto const r = m_stream_heads[i].range.load(std::memory_order_acquire);
+        auto const end = std::min(range_end(r), upto_offset);
+        if (end > range_next(r)) { count += end - range_next(r); }
+    }
+    return count;
+}
+
 // Reserve on disk will update the commit_offset with the new_offset, if its above the current commit_offset.
 BlkAllocStatus AppendBlkAllocator::reserve_on_disk(BlkId const& blkid) {
     HS_DBG_ASSERT(is_blk_alloced(blkid), "Trying to reserve on disk for unallocated blkid={}", blkid);
@@ -120,7 +209,7 @@ void AppendBlkAllocator::cp_flush(CP* cp) {
     // check if current cp's context has dirty buffer already
     if (m_is_dirty.exchange(false)) {
         m_sb->commit_offset = m_commit_offset.load();
-        m_sb->freeable_nblks = m_freeable_nblks.load();
+        m_sb->freeable_nblks = m_freeable_nblks.load() + unwritten_stream_blks(m_sb->commit_offset);
 
         // write to metablk;
         m_sb.write();
@@ -133,6 +222,13 @@ void AppendBlkAllocator::cp_flush(CP* cp) {
 // 2. if the blk being freed happens to be last block, move last_append_offset backwards accordingly;
 //
 void AppendBlkAllocator::free(const BlkId& bid) {
+    if (m_num_streams > 0) {
+        // Other streams could have appended past this blk, so the offset can never be moved back
+        m_freeable_nblks.fetch_add(bid.blk_count());
+        m_is_dirty.store(true);
+        return;
+    }
+
     // If we are freeing the last block, just move the offset back
     blk_num_t cur_last_offset = m_last_append_offset.load();
     auto const input_last_offset = bid.blk_num() + bid.blk_count();
@@ -157,6 +253,37 @@ void AppendBlkAllocator::free(const BlkId& bid) {
     m_is_dirty.store(true);
 }
 
+void AppendBlkAllocator::free_batch(std::span< BlkId const > bids) {
+    if (m_num_streams > 0) {
+        blk_num_t nblks{0};
+        for (auto const& b : bids) {
+            nblks += b.blk_count();
+        }
+        m_freeable_nblks.fetch_add(nblks);
+        m_is_dirty.store(true);
+        return;
+    }
+
+    // Free from the highest offset first, so that a run of blks at the tail moves the append offset back entirely,
+    // instead of all but the last one of them getting accounted as freeable
+    std::vector< BlkId > sorted{bids.begin(), bids.end()};
+    std::sort(sorted.begin(), sorted.end(), [](BlkId const& a, BlkId const& b) { return a.blk_num() > b.blk_num(); });
+    for (auto const& b : sorted) {
+        free(b);
+    }
+}
+
+void AppendBlkAllocator::reset() {
+    for (uint32_t i{0}; i < m_num_streams; ++i) {
+        m_stream_heads[i].range.store(0, std::memory_order_release);
+    }
+    m_last_append_offset.store(0);
+    m_commit_offset.store(0);
+    m_freeable_nblks.store(0);
+    m_is_dirty.store(true);
+    BLKALLOC_LOG(INFO, "Chunk={} is reset, all its blks are reclaimed", m_chunk_id);
+}
+
 bool AppendBlkAllocator::is_blk_alloced(const BlkId& in_bid, bool) const {
     // blk_num starts from 0;
     return in_bid.blk_num() < get_used_blks();
@@ -185,6 +312,7 @@ nlohmann::json AppendBlkAllocator::get_status(int log_level) const {
     j["next_append_blk_num"] = m_last_append_offset.load(std::memory_order_relaxed);
     j["commit_offset"] = m_commit_offset.load(std::memory_order_relaxed);
     j["freeable_nblks"] = m_freeable_nblks.load(std::memory_order_relaxed);
+    j["num_stream_heads"] = m_num_streams;
     return j;
 }
 } // namespace homestore
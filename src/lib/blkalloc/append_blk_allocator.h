@@ -43,6 +43,7 @@ public:
     explicit AppendBlkAllocMetrics(const char* inst_name) : sisl::MetricsGroup("AppendBlkAlloc", inst_name) {
         REGISTER_COUNTER(num_alloc, "Number of blks alloc attempts");
         REGISTER_COUNTER(num_alloc_failure, "Number of blk alloc failures");
+        REGISTER_COUNTER(num_stream_reserves, "Number of sub-range reservations by append stream heads");
 
         register_me_to_farm();
     }
@@ -77,6 +78,7 @@ public:
     BlkAllocStatus alloc_contiguous(BlkId& bid) override;
     BlkAllocStatus alloc(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_blkid) override;
     void free(BlkId const& b) override;
+    void free_batch(std::span< BlkId const > bids) override;
     BlkAllocStatus reserve_on_disk(BlkId const& in_bid) override;
     BlkAllocStatus reserve_on_cache(BlkId const& b) override;
 
@@ -112,10 +114,27 @@ public:
 
     nlohmann::json get_status(int log_level) const override;
 
+    uint32_t num_stream_heads() const { return m_num_streams; }
+
+    /**
+     * @brief : reclaim the whole chunk, once all its live blks are relocated elsewhere (by GC). Caller has to ensure
+     * no new allocs are happening on this chunk, while it is being reset. It is persisted on next cp_flush.
+     */
+    void reset();
+
 private:
     std::string get_name() const;
     void on_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie);
 
+    uint32_t pick_stream(blk_alloc_hints const& hints) const;
+    BlkAllocStatus alloc_in_stream(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_bid);
+    bool reserve_range(blk_count_t min_nblks, blk_num_t& out_start, blk_num_t& out_nblks);
+    blk_num_t unwritten_stream_blks(blk_num_t upto_offset) const;
+
+    static uint64_t pack_range(blk_num_t next, blk_num_t end) { return (uint64_cast(end) << 32) | next; }
+    static blk_num_t range_next(uint64_t r) { return s_cast< blk_num_t >(r & 0xFFFFFFFF); }
+    static blk_num_t range_end(uint64_t r) { return s_cast< blk_num_t >(r >> 32); }
+
 private:
     std::atomic< blk_num_t > m_last_append_offset{0}; // last appended offset in blocks in memory
     std::atomic< blk_num_t > m_freeable_nblks{0};     // count of blks fragmentedly freed (both on-disk and in-memory)
@@ -123,6 +142,16 @@ private:
     std::atomic< bool > m_is_dirty{false};
     AppendBlkAllocMetrics m_metrics;
     superblk< append_blk_sb_t > m_sb; // only cp will be writing to this disk
+
+    // Per stream append head: sub-range of the chunk reserved for the stream, packed as {end (high 32 bits), next
+    // (low 32 bits)}, so that allocating within the range is a single CAS. m_last_append_offset is then the high
+    // water mark of all reserved ranges.
+    struct alignas(64) stream_head {
+        std::atomic< uint64_t > range{0};
+    };
+    uint32_t m_num_streams{0};
+    blk_num_t m_stream_reserve_blks{0};
+    std::unique_ptr< stream_head[] > m_stream_heads;
 };
 
 } // namespace homestore
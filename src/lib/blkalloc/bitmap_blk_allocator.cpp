@@ -12,6 +12,8 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+
 #include <homestore/homestore.hpp>
 #include <homestore/meta_service.hpp>
 #include <homestore/checkpoint/cp_mgr.hpp>
@@ -149,6 +151,30 @@ void BitmapBlkAllocator::free_on_disk(BlkId const& bid) {
     }
 }
 
+void BitmapBlkAllocator::free_on_disk(std::span< BlkId const > bids) {
+    DEBUG_ASSERT_EQ(is_persistent(), true, "free_on_disk called for non-persistent blk allocator");
+
+    // Batches from vdev cp flush are already sorted, copy and sort only when needed
+    auto const by_blk_num = [](BlkId const& a, BlkId const& b) { return a.blk_num() < b.blk_num(); };
+    std::vector< BlkId > sorted_copy;
+    std::span< BlkId const > sorted{bids};
+    if (!std::is_sorted(bids.begin(), bids.end(), by_blk_num)) {
+        sorted_copy.assign(bids.begin(), bids.end());
+        std::sort(sorted_copy.begin(), sorted_copy.end(), by_blk_num);
+        sorted = sorted_copy;
+    }
+
+    size_t i{0};
+    while (i < sorted.size()) {
+        auto const portion_num = blknum_to_portion_num(sorted[i].blk_num());
+        BlkAllocPortion& portion = get_blk_portion(portion_num);
+        auto lock{portion.portion_auto_lock()};
+        for (; (i < sorted.size()) && (blknum_to_portion_num(sorted[i].blk_num()) == portion_num); ++i) {
+            m_disk_bm->reset_bits(sorted[i].blk_num(), sorted[i].blk_count());
+        }
+    }
+}
+
 sisl::byte_array BitmapBlkAllocator::acquire_underlying_buffer() {
     // prepare and temporary alloc list, where blkalloc is accumulated till underlying buffer is released.
     // RCU will wait for all I/Os that are still in critical section (allocating on disk bm) to complete and exit;
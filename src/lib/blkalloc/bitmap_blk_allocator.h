@@ -14,10 +14,12 @@
  *********************************************************************************/
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -43,6 +45,7 @@ private:
     mutable std::mutex m_blk_lock;
     blk_num_t m_portion_num;
     blk_temp_t m_temperature;
+    std::atomic< blk_num_t > m_free_blks{0}; // Free blks in cache bitmap of this portion, updated under portion lock
 
 public:
     BlkAllocPortion(blk_temp_t temp = default_temperature()) : m_temperature(temp) {}
@@ -56,6 +59,13 @@ public:
     blk_num_t get_portion_num() const { return m_portion_num; }
     blk_temp_t temperature() const { return m_temperature; }
 
+    /// @brief Number of free blks in the portion, as tracked by allocators which maintain it. It can be read without
+    /// the portion lock to skip portions which cannot satisfy a request, without scanning their bitmap.
+    blk_num_t free_blks() const { return m_free_blks.load(std::memory_order_relaxed); }
+    void set_free_blks(blk_num_t nblks) { m_free_blks.store(nblks, std::memory_order_relaxed); }
+    void decr_free_blks(blk_num_t nblks) { m_free_blks.fetch_sub(nblks, std::memory_order_relaxed); }
+    void incr_free_blks(blk_num_t nblks) { m_free_blks.fetch_add(nblks, std::memory_order_relaxed); }
+
     void set_portion_num(blk_num_t portion_num) { m_portion_num = portion_num; }
     void set_temperature(const blk_temp_t temp) { m_temperature = temp; }
     static constexpr blk_temp_t default_temperature() { return 1; }
@@ -95,13 +105,16 @@ public:
     /* Get status */
     nlohmann::json get_status(int log_level) const override;
 
-    void incr_alloced_blk_count(blk_count_t nblks) { m_alloced_blk_count.fetch_add(nblks, std::memory_order_relaxed); }
-    void decr_alloced_blk_count(blk_count_t nblks) { m_alloced_blk_count.fetch_sub(nblks, std::memory_order_relaxed); }
+    void incr_alloced_blk_count(blk_num_t nblks) { m_alloced_blk_count.fetch_add(nblks, std::memory_order_relaxed); }
+    void decr_alloced_blk_count(blk_num_t nblks) { m_alloced_blk_count.fetch_sub(nblks, std::memory_order_relaxed); }
     int64_t get_alloced_blk_count() const { return m_alloced_blk_count.load(std::memory_order_acquire); }
 
 protected:
     void free_on_disk(BlkId const& b);
 
+    /// @brief Free the blkids (individual pieces) on disk bitmap, taking each portion lock once for the batch
+    void free_on_disk(std::span< BlkId const > bids);
+
 private:
     void do_init();
     sisl::ThreadVector< MultiBlkId >* get_alloc_blk_list();
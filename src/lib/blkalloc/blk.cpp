@@ -17,6 +17,42 @@
 #include "common/homestore_assert.hpp"
 
 namespace homestore {
+namespace {
+constexpr uint32_t max_varint_size(uint32_t bits) { return (bits + 6) / 7; }
+
+uint32_t varint_size(uint64_t v) {
+    uint32_t n{1};
+    while (v >= 0x80) {
+        v >>= 7;
+        ++n;
+    }
+    return n;
+}
+
+uint8_t* put_varint(uint8_t* p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = s_cast< uint8_t >(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = s_cast< uint8_t >(v);
+    return p;
+}
+
+uint64_t get_varint(uint8_t const*& p, uint8_t const* end) {
+    uint64_t v{0};
+    for (uint32_t shift{0};; shift += 7) {
+        RELEASE_ASSERT((p < end) && (shift < 64), "Truncated or corrupted compact blkid");
+        auto const b = *p++;
+        v |= uint64_cast(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) { return v; }
+    }
+}
+
+// Deltas of either sign as small unsigned ints: 0, -1, 1, -2, ... to 0, 1, 2, 3, ...
+uint64_t zigzag(int64_t v) { return (uint64_cast(v) << 1) ^ uint64_cast(v >> 63); }
+int64_t unzigzag(uint64_t v) { return s_cast< int64_t >(v >> 1) ^ -s_cast< int64_t >(v & 1); }
+} // namespace
+
 BlkId::BlkId(uint64_t id_int) {
     *r_cast< uint64_t* >(&s) = id_int;
     DEBUG_ASSERT_EQ(is_multi(), 0, "MultiBlkId is set on BlkId constructor");
@@ -110,6 +146,63 @@ void MultiBlkId::deserialize(sisl::blob const& b, bool copy) {
     }
 }
 
+uint32_t MultiBlkId::serialized_size(blkid_format_t format) const {
+    if (format == blkid_format_t::fixed) { return serialized_size(); }
+
+    uint32_t sz{1}; // Number of pieces
+    if (!BlkId::is_valid()) { return sz; }
+    sz += varint_size(chunk_num()) + varint_size(blk_num()) + varint_size(BlkId::blk_count());
+    for (uint16_t i{0}; i < n_addln_piece; ++i) {
+        sz += varint_size(zigzag(int64_t{addln_pieces[i].m_blk_num} - int64_t{blk_num()})) +
+            varint_size(addln_pieces[i].m_nblks);
+    }
+    return sz;
+}
+
+uint32_t MultiBlkId::serialize_to(uint8_t* buf, blkid_format_t format) const {
+    if (format == blkid_format_t::fixed) {
+        auto const b = serialize();
+        std::memcpy(buf, b.cbytes(), b.size());
+        return b.size();
+    }
+
+    uint8_t* p = buf;
+    *p++ = s_cast< uint8_t >(num_pieces());
+    if (BlkId::is_valid()) {
+        p = put_varint(p, chunk_num());
+        p = put_varint(p, blk_num());
+        p = put_varint(p, BlkId::blk_count());
+        for (uint16_t i{0}; i < n_addln_piece; ++i) {
+            p = put_varint(p, zigzag(int64_t{addln_pieces[i].m_blk_num} - int64_t{blk_num()}));
+            p = put_varint(p, addln_pieces[i].m_nblks);
+        }
+    }
+    return uint32_cast(p - buf);
+}
+
+void MultiBlkId::deserialize(sisl::blob const& b, blkid_format_t format) {
+    if (format == blkid_format_t::fixed) {
+        deserialize(b, true /* copy */);
+        return;
+    }
+
+    RELEASE_ASSERT_GT(b.size(), 0, "Empty compact blkid");
+    uint8_t const* p = b.cbytes();
+    uint8_t const* const end = p + b.size();
+    auto const npieces = *p++;
+    RELEASE_ASSERT_LE(npieces, max_pieces, "Compact blkid of more pieces than supported, corrupted?");
+
+    *this = MultiBlkId{};
+    if (npieces == 0) { return; }
+    auto const cnum = s_cast< chunk_num_t >(get_varint(p, end));
+    auto const first_blk_num = s_cast< blk_num_t >(get_varint(p, end));
+    add(first_blk_num, s_cast< blk_count_t >(get_varint(p, end)), cnum);
+    for (uint32_t i{1}; i < npieces; ++i) {
+        auto const bnum = s_cast< blk_num_t >(int64_t{first_blk_num} + unzigzag(get_varint(p, end)));
+        add(bnum, s_cast< blk_count_t >(get_varint(p, end)), cnum);
+    }
+}
+
 uint32_t MultiBlkId::expected_serialized_size(uint16_t num_pieces) {
     uint32_t sz = BlkId::expected_serialized_size();
     if (num_pieces > 1) { sz += sizeof(uint16_t) + ((num_pieces - 1) * sizeof(chain_blkid)); }
@@ -118,6 +211,12 @@ uint32_t MultiBlkId::expected_serialized_size(uint16_t num_pieces) {
 
 uint32_t MultiBlkId::max_serialized_size() { return expected_serialized_size(max_pieces); }
 
+uint32_t MultiBlkId::max_serialized_size(blkid_format_t format) {
+    if (format == blkid_format_t::fixed) { return max_serialized_size(); }
+    return 1 + max_varint_size(8 * sizeof(chunk_num_t)) +
+        max_pieces * (max_varint_size(8 * sizeof(blk_num_t)) + max_varint_size(8 * sizeof(blk_count_t)));
+}
+
 uint16_t MultiBlkId::num_pieces() const { return BlkId::is_valid() ? n_addln_piece + 1 : 0; }
 
 bool MultiBlkId::has_room() const { return (n_addln_piece < max_addln_pieces); }
@@ -126,19 +225,18 @@ MultiBlkId::iterator MultiBlkId::iterate() const { return MultiBlkId::iterator{*
 
 std::string MultiBlkId::to_string() const {
     std::string str = "[";
-    auto it = iterate();
-    while (auto const b = it.next()) {
-        str += "{" + (b->to_string() + "},");
+    for (auto const b : pieces()) {
+        str += "{" + (b.to_string() + "},");
     }
     str += std::string("]");
     return str;
 }
 
 blk_count_t MultiBlkId::blk_count() const {
-    blk_count_t nblks{0};
-    auto it = iterate();
-    while (auto b = it.next()) {
-        nblks += b->blk_count();
+    if (!BlkId::is_valid()) { return 0; }
+    blk_count_t nblks{BlkId::blk_count()};
+    for (uint16_t i{0}; i < n_addln_piece; ++i) {
+        nblks += addln_pieces[i].m_nblks;
     }
     return nblks;
 }
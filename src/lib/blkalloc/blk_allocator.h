@@ -18,6 +18,7 @@
 #include <cstdint>
 #include <memory>
 #include <mutex>
+#include <span>
 #include <sstream>
 #include <string>
 #include <thread>
@@ -155,8 +156,40 @@ public:
 
     virtual void free(BlkId const& id) = 0;
 
+    /**
+     * @brief : allocate a separate blkid for each of the sizes with the same hints. Allocators which can amortize
+     * the locking and bookkeeping across the batch override this.
+     * @return : SUCCESS only if all of them are allocated. On failure, out_blkids has the ones allocated so far, which
+     * caller is expected to either use or free.
+     */
+    virtual BlkAllocStatus alloc_batch(std::span< blk_count_t const > sizes, blk_alloc_hints const& hints,
+                                       std::vector< MultiBlkId >& out_blkids) {
+        out_blkids.reserve(out_blkids.size() + sizes.size());
+        for (auto const nblks : sizes) {
+            MultiBlkId mbid;
+            auto const status = alloc(nblks, hints, mbid);
+            if (status != BlkAllocStatus::SUCCESS) {
+                if (status == BlkAllocStatus::PARTIAL) { free(mbid); }
+                return status;
+            }
+            out_blkids.push_back(mbid);
+        }
+        return BlkAllocStatus::SUCCESS;
+    }
+
+    /**
+     * @brief : free all the blkids (individual pieces, not MultiBlkId), updating the cache and on-disk versions once
+     * per batch instead of once per blkid, where the allocator supports it.
+     */
+    virtual void free_batch(std::span< BlkId const > bids) {
+        for (auto const& b : bids) {
+            free(b);
+        }
+    }
+
     virtual blk_num_t available_blks() const = 0;
     virtual blk_num_t get_defrag_nblks() const = 0;
+    virtual bool is_defrag_tracked() const { return true; } // Whether get_defrag_nblks is supported
     virtual blk_num_t get_used_blks() const = 0;
     virtual bool is_blk_alloced(BlkId const& b, bool use_lock = false) const = 0;
     virtual bool is_blk_alloced_on_disk(BlkId const& b, bool use_lock = false) const = 0;
@@ -15,10 +15,12 @@
  *********************************************************************************/
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <cstdint>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <sisl/fds/bitword.hpp>
@@ -177,6 +179,7 @@ namespace homestore {
 struct blk_cache_fill_session {
     uint64_t session_id;
     std::vector< blk_cache_refill_status > slab_requirements; // A slot for each slab about count of required/refilled
+    std::vector< std::pair< slab_idx_t, blk_num_t > > starving_slabs; // Slabs to fill first and their entries quota
     blk_num_t overall_refilled_num_blks{0};
     bool overall_refill_done{false};
     std::atomic< blk_num_t > urgent_refill_blks_count{0}; // Send notification after approx this much blks refilled
@@ -205,6 +208,16 @@ struct blk_cache_fill_session {
         return ((urgent_count > 0) && ((overall_refilled_num_blks >= urgent_count) || overall_refill_done));
     }
 
+    [[nodiscard]] bool any_refill_needed() const {
+        return std::any_of(slab_requirements.cbegin(), slab_requirements.cend(),
+                           [](auto const& r) { return r.need_refill(); });
+    }
+
+    [[nodiscard]] bool all_refill_done() const {
+        return std::all_of(slab_requirements.cbegin(), slab_requirements.cend(),
+                           [](auto const& r) { return r.is_refill_done(); });
+    }
+
     void set_urgent_satisfied() { urgent_refill_blks_count.store(0, std::memory_order_release); }
 
     [[nodiscard]] bool is_urgent_req_pending() const {
@@ -214,6 +227,7 @@ struct blk_cache_fill_session {
     void reset() {
         session_id = gen_session_id();
         slab_requirements.clear();
+        starving_slabs.clear();
         overall_refill_done = false;
         overall_refilled_num_blks = 0;
         urgent_refill_blks_count.store(0, std::memory_order_release);
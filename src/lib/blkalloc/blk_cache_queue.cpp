@@ -13,6 +13,9 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <limits>
+
 #include "common/homestore_assert.hpp"
 #include "varsize_blk_allocator.h"
 #include "blk_cache_queue.h"
@@ -57,6 +60,7 @@ BlkAllocStatus FreeBlkCacheQueue::try_alloc_blks(const blk_cache_alloc_req& req,
     BlkAllocStatus status = try_alloc_in_slab(slab_idx, req, resp);
     if (status == BlkAllocStatus::SUCCESS) {
         BLKALLOC_LOG(TRACE, "Alloced in slab {}", resp.out_blks.front().to_string());
+        HISTOGRAM_OBSERVE(slab_metrics(slab_idx), slab_alloc_pieces, resp.out_blks.size());
         return status;
     } else {
         // free any partial result if contiguous
@@ -71,6 +75,7 @@ BlkAllocStatus FreeBlkCacheQueue::try_alloc_blks(const blk_cache_alloc_req& req,
     if (status == BlkAllocStatus::SUCCESS) {
         BLKALLOC_LOG(TRACE, "Alloced break up {}", resp.out_blks.front().to_string());
         COUNTER_INCREMENT(slab_metrics(slab_idx), num_slab_alloc_with_split, 1);
+        HISTOGRAM_OBSERVE(slab_metrics(slab_idx), slab_alloc_pieces, resp.out_blks.size());
         return status;
     }
 
@@ -80,6 +85,7 @@ BlkAllocStatus FreeBlkCacheQueue::try_alloc_blks(const blk_cache_alloc_req& req,
         if (status == BlkAllocStatus::SUCCESS) {
             BLKALLOC_LOG(TRACE, "Alloced merge down {}", resp.out_blks.front().to_string());
             COUNTER_INCREMENT(slab_metrics(slab_idx), num_slab_alloc_with_merge, 1);
+            HISTOGRAM_OBSERVE(slab_metrics(slab_idx), slab_alloc_pieces, resp.out_blks.size());
             return status;
         }
     }
@@ -130,43 +136,58 @@ blk_count_t FreeBlkCacheQueue::try_free_blks(const std::vector< blk_cache_entry
 }
 
 blk_num_t FreeBlkCacheQueue::try_fill_cache(const blk_cache_fill_req& fill_req, blk_cache_fill_session& fill_session) {
-    blk_num_t nblks_added{0};
-    slab_idx_t slabs_pending_refill{static_cast< slab_idx_t >(m_slab_queues.size())};
-
-    auto slab_idx{FreeBlkCache::find_slab(fill_req.nblks)};
-    if (slab_idx >= m_slab_queues.size()) { slab_idx = m_slab_queues.size() - 1; }
-
-    // Try to fill from the maximum blocks.
     auto blk_num{fill_req.start_blk_num};
     auto nblks_remain{fill_req.nblks};
 
-    do {
-        const auto slab_size{m_slab_queues[slab_idx]->slab_size()};
-        while ((nblks_remain >= slab_size) && fill_session.slab_requirements[slab_idx].need_refill()) {
-            // Try to push the cache entry to slab and keep accounting as to how much
-            const blk_cache_entry e{blk_num, slab_size, fill_req.preferred_level};
-            if (!push_slab(slab_idx, e, fill_req.only_this_level)) {
-                fill_session.slab_requirements[slab_idx].mark_refill_done();
-                break;
-            }
+    // Slabs which are close to starvation get their share carved out first, ahead of the larger slabs. Otherwise a
+    // large free run would always go to the biggest slab and small allocations keep waiting on the sweep.
+    for (auto& [starving_idx, quota] : fill_session.starving_slabs) {
+        if (quota == 0) { continue; }
+        quota -= fill_slab(starving_idx, quota, fill_req, fill_session, blk_num, nblks_remain);
+        if (nblks_remain == 0) { break; }
+    }
 
-            COUNTER_INCREMENT(slab_metrics(slab_idx), num_slab_refills, 1);
-            ++(fill_session.slab_requirements[slab_idx].slab_refilled_count);
-            fill_session.overall_refilled_num_blks += slab_size;
-            nblks_remain -= slab_size;
-            blk_num += slab_size;
-        }
+    // Try to fill from the maximum blocks.
+    auto slab_idx{FreeBlkCache::find_slab(nblks_remain ? nblks_remain : 1)};
+    if (slab_idx >= m_slab_queues.size()) { slab_idx = m_slab_queues.size() - 1; }
 
-        if (fill_session.slab_requirements[slab_idx].is_refill_done()) { --slabs_pending_refill; }
-    } while ((slab_idx-- > 0) && nblks_remain);
+    while (nblks_remain) {
+        fill_slab(slab_idx, std::numeric_limits< blk_num_t >::max(), fill_req, fill_session, blk_num, nblks_remain);
+        if (slab_idx-- == 0) { break; }
+    }
 
-    fill_session.overall_refill_done = (slabs_pending_refill == 0);
+    fill_session.overall_refill_done = fill_session.all_refill_done();
 
     BLKALLOC_LOG(DEBUG, "Refill session now: [{}], fill_req range: [{}-{}], nblks_remain={}", fill_session.to_string(),
                  fill_req.start_blk_num, fill_req.start_blk_num + fill_req.nblks, nblks_remain);
     return (fill_req.nblks - nblks_remain);
 }
 
+blk_num_t FreeBlkCacheQueue::fill_slab(const slab_idx_t slab_idx, const blk_num_t max_entries,
+                                       const blk_cache_fill_req& fill_req, blk_cache_fill_session& fill_session,
+                                       blk_num_t& blk_num, blk_num_t& nblks_remain) {
+    auto& req{fill_session.slab_requirements[slab_idx]};
+    const auto slab_size{m_slab_queues[slab_idx]->slab_size()};
+    blk_num_t nentries{0};
+
+    while ((nentries < max_entries) && (nblks_remain >= slab_size) && req.need_refill()) {
+        // Try to push the cache entry to slab and keep accounting as to how much
+        const blk_cache_entry e{blk_num, slab_size, fill_req.preferred_level};
+        if (!push_slab(slab_idx, e, fill_req.only_this_level)) {
+            req.mark_refill_done();
+            break;
+        }
+
+        COUNTER_INCREMENT(slab_metrics(slab_idx), num_slab_refills, 1);
+        ++req.slab_refilled_count;
+        ++nentries;
+        fill_session.overall_refilled_num_blks += slab_size;
+        nblks_remain -= slab_size;
+        blk_num += slab_size;
+    }
+    return nentries;
+}
+
 blk_num_t FreeBlkCacheQueue::total_free_blks() const {
     blk_num_t count{0};
     for (const auto& sq : m_slab_queues) {
@@ -214,7 +235,10 @@ BlkAllocStatus FreeBlkCacheQueue::try_alloc_in_slab(const slab_idx_t slab_idx, c
             num_allocated += m_slab_queues[slab_idx]->slab_size();
 
             // If we didn't get the level we requested for, its time to refill this slab
-            if (popped_level.value() != req.preferred_level) { resp.need_refill = true; }
+            if (popped_level.value() != req.preferred_level) {
+                COUNTER_INCREMENT(slab_metrics(slab_idx), num_slab_level_fallbacks, 1);
+                resp.need_refill = true;
+            }
         } else {
             free_excess(num_allocated);
             return ((i == 0) && (num_allocated == 0)) ? BlkAllocStatus::FAILED : BlkAllocStatus::PARTIAL;
@@ -259,9 +283,22 @@ BlkAllocStatus FreeBlkCacheQueue::merge_down(const slab_idx_t slab_idx, const bl
 
 std::shared_ptr< blk_cache_fill_session > FreeBlkCacheQueue::create_cache_fill_session(const bool fill_entire_cache) {
     const auto ptr{std::make_shared< blk_cache_fill_session >(m_slab_queues.size(), fill_entire_cache)};
-    for (auto& sq : m_slab_queues) {
+    std::vector< std::pair< float, slab_idx_t > > starving;
+    for (slab_idx_t i{0}; i < m_slab_queues.size(); ++i) {
+        auto& sq{m_slab_queues[i]};
+        // Every slab gets a slot (even if it needs nothing), since the requirements are indexed by slab_idx
         const auto needed_count{sq->open_session(ptr->session_id, fill_entire_cache)};
-        if (needed_count > 0) { ptr->slab_requirements.push_back(blk_cache_refill_status{needed_count, 0}); }
+        ptr->slab_requirements.push_back(blk_cache_refill_status{needed_count, 0});
+
+        if ((needed_count > 0) && (sq->starving_entries() > 0)) {
+            starving.emplace_back(s_cast< float >(sq->entry_count()) / sq->entry_capacity(), i);
+        }
+    }
+
+    // Most starved slab (least filled in proportion to its capacity) goes first
+    std::sort(starving.begin(), starving.end());
+    for (auto const& [fill_ratio, slab_idx] : starving) {
+        ptr->starving_slabs.emplace_back(slab_idx, m_slab_queues[slab_idx]->starving_entries());
     }
     return ptr;
 }
@@ -334,7 +371,8 @@ std::optional< blk_temp_t > SlabCacheQueue::pop(const blk_temp_t input_level, co
             popped = m_level_queues[level]->read(out_entry);
         } while (!popped);
     }
-    return popped ? std::optional< blk_temp_t >{start_level} : std::nullopt;
+    // Return the level it was actually popped from, so that caller knows when it had to fall back to other levels
+    return popped ? std::optional< blk_temp_t >{level} : std::nullopt;
 }
 
 blk_num_t SlabCacheQueue::entry_count() const {
@@ -364,6 +402,11 @@ blk_num_t SlabCacheQueue::open_session(const uint64_t session_id, const bool fil
     return count;
 }
 
+blk_num_t SlabCacheQueue::starving_entries() const {
+    const auto nentries{entry_count()};
+    return ((nentries * 2) < m_refill_threshold_limits) ? (m_refill_threshold_limits - nentries) : 0;
+}
+
 void SlabCacheQueue::close_session(const uint64_t session_id) {
     uint64_t expected_session_id{session_id};
     m_refill_session.compare_exchange_strong(expected_session_id, 0, std::memory_order_acq_rel);
@@ -379,6 +422,10 @@ SlabMetrics::SlabMetrics(const blk_count_t slab_size, SlabCacheQueue* const slab
     REGISTER_COUNTER(num_slab_splits, "Number of split in this slab to serve lower slab alloc");
     REGISTER_COUNTER(num_slab_merges, "Number of merges in this slab to serve higher slab alloc");
     REGISTER_COUNTER(num_slab_refills, "Number of entries refilled in this slab");
+    REGISTER_COUNTER(num_slab_level_fallbacks, "Number of entries served from a level other than the requested temp");
+
+    REGISTER_HISTOGRAM(slab_alloc_pieces, "Number of cache entries an alloc in this slab got served with",
+                       HistogramBucketsType(LinearUpto64Buckets));
 
     REGISTER_GAUGE(slab_available_entries, "Available entries in the slab for allocation");
     REGISTER_GAUGE(slab_total_entries, "Total entries possible in the slab for allocation");
@@ -67,6 +67,10 @@ public:
     void refilled();
 
     [[nodiscard]] blk_num_t open_session(const uint64_t session_id, const bool fill_entire_cache);
+
+    /// @brief Slab is starving if it has gone below half of its refill threshold. Returns number of entries needed
+    /// to bring it back to the refill threshold, 0 if not starving.
+    [[nodiscard]] blk_num_t starving_entries() const;
     void close_session(const uint64_t session_id);
 
     [[nodiscard]] SlabMetrics& metrics() { return m_metrics; }
@@ -112,6 +116,9 @@ private:
     std::optional< blk_temp_t > pop_slab(const slab_idx_t slab_idx, const blk_temp_t level, const bool only_this_level,
                                          blk_cache_entry& out_entry);
 
+    blk_num_t fill_slab(const slab_idx_t slab_idx, const blk_num_t max_entries, const blk_cache_fill_req& fill_req,
+                        blk_cache_fill_session& fill_session, blk_num_t& blk_num, blk_num_t& nblks_remain);
+
     inline SlabMetrics& slab_metrics(const slab_idx_t slab_idx) const { return m_slab_queues[slab_idx]->metrics(); }
 
     std::string get_name() { return m_cfg.get_name(); }
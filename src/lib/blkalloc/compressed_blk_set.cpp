@@ -0,0 +1,290 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "common/homestore_assert.hpp"
+#include "compressed_blk_set.h"
+
+namespace homestore {
+CompressedBlkSet::CompressedBlkSet(blk_num_t nblks) :
+        m_nblks{nblks},
+        m_num_containers{uint32_cast((uint64_cast(nblks) + container_nblks - 1) / container_nblks)},
+        m_containers{std::make_unique< container[] >(m_num_containers)} {
+    for (uint32_t i{0}; i < m_num_containers; ++i) {
+        m_containers[i].nblks = std::min(container_nblks, nblks - (i * container_nblks));
+    }
+}
+
+bool CompressedBlkSet::add(blk_num_t blk_num) {
+    HS_DBG_ASSERT_LT(blk_num, m_nblks, "blk_num out of range of compressed blk set");
+    auto& c = get_container(blk_num);
+    std::unique_lock lg{c.mtx};
+    if (!c.add(to_offset(blk_num))) { return false; }
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void CompressedBlkSet::add_range(blk_num_t start, blk_num_t nblks) {
+    HS_DBG_ASSERT_LE(uint64_cast(start) + nblks, m_nblks, "blk range out of range of compressed blk set");
+    while (nblks > 0) {
+        auto& c = get_container(start);
+        auto const off = to_offset(start);
+        auto const len = std::min(nblks, c.nblks - off);
+
+        blk_num_t added{0};
+        {
+            std::unique_lock lg{c.mtx};
+            if ((off == 0) && (len == c.nblks) && (c.card.load(std::memory_order_relaxed) == 0)) {
+                c.set_full();
+                added = len;
+            } else {
+                for (blk_num_t i{0}; i < len; ++i) {
+                    if (c.add(s_cast< uint16_t >(off + i))) { ++added; }
+                }
+            }
+        }
+        m_count.fetch_add(added, std::memory_order_relaxed);
+        start += len;
+        nblks -= len;
+    }
+}
+
+bool CompressedBlkSet::remove(blk_num_t blk_num) {
+    HS_DBG_ASSERT_LT(blk_num, m_nblks, "blk_num out of range of compressed blk set");
+    auto& c = get_container(blk_num);
+    std::unique_lock lg{c.mtx};
+    if (!c.remove(to_offset(blk_num))) { return false; }
+    m_count.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+}
+
+std::optional< blk_num_t > CompressedBlkSet::pop() {
+    if (m_num_containers == 0) { return std::nullopt; }
+
+    auto const start = m_pop_cursor.load(std::memory_order_relaxed);
+    for (uint32_t i{0}; i < m_num_containers; ++i) {
+        auto const idx = (start + i) % m_num_containers;
+        auto& c = m_containers[idx];
+        if (c.card.load(std::memory_order_relaxed) == 0) { continue; }
+
+        std::unique_lock lg{c.mtx};
+        if (c.card.load(std::memory_order_relaxed) == 0) { continue; }
+        auto const off = c.pop();
+        m_count.fetch_sub(1, std::memory_order_relaxed);
+        if (i != 0) { m_pop_cursor.store(idx, std::memory_order_relaxed); }
+        return (idx * container_nblks) + off;
+    }
+    return std::nullopt;
+}
+
+bool CompressedBlkSet::contains(blk_num_t blk_num) const {
+    if (blk_num >= m_nblks) { return false; }
+    auto const& c = get_container(blk_num);
+    std::unique_lock lg{c.mtx};
+    return c.contains(to_offset(blk_num));
+}
+
+size_t CompressedBlkSet::mem_bytes() const {
+    size_t sz{sizeof(CompressedBlkSet) + (sizeof(container) * m_num_containers)};
+    for (uint32_t i{0}; i < m_num_containers; ++i) {
+        std::unique_lock lg{m_containers[i].mtx};
+        sz += m_containers[i].mem_bytes();
+    }
+    return sz;
+}
+
+///////////////////////////////////// container //////////////////////////////////////
+bool CompressedBlkSet::container::contains(uint16_t off) const {
+    switch (type) {
+    case ctype_t::ARRAY:
+        return std::binary_search(arr.begin(), arr.end(), off);
+    case ctype_t::INVERTED:
+        return !std::binary_search(arr.begin(), arr.end(), off);
+    case ctype_t::BITMAP:
+    default:
+        return (bits[off >> 6] & (1ull << (off & 63))) != 0;
+    }
+}
+
+bool CompressedBlkSet::container::add(uint16_t off) {
+    switch (type) {
+    case ctype_t::ARRAY: {
+        // Fast path for the blks added in ascending order (initial load)
+        if (arr.empty() || (arr.back() < off)) {
+            arr.push_back(off);
+        } else {
+            auto it = std::lower_bound(arr.begin(), arr.end(), off);
+            if (*it == off) { return false; }
+            arr.insert(it, off);
+        }
+        break;
+    }
+    case ctype_t::INVERTED: {
+        auto it = std::lower_bound(arr.begin(), arr.end(), off);
+        if ((it == arr.end()) || (*it != off)) { return false; }
+        arr.erase(it);
+        break;
+    }
+    case ctype_t::BITMAP:
+    default: {
+        auto& w = bits[off >> 6];
+        auto const mask = 1ull << (off & 63);
+        if (w & mask) { return false; }
+        w |= mask;
+        break;
+    }
+    }
+    card.fetch_add(1, std::memory_order_relaxed);
+    maybe_convert();
+    return true;
+}
+
+bool CompressedBlkSet::container::remove(uint16_t off) {
+    switch (type) {
+    case ctype_t::ARRAY: {
+        auto it = std::lower_bound(arr.begin(), arr.end(), off);
+        if ((it == arr.end()) || (*it != off)) { return false; }
+        arr.erase(it);
+        break;
+    }
+    case ctype_t::INVERTED: {
+        auto it = std::lower_bound(arr.begin(), arr.end(), off);
+        if ((it != arr.end()) && (*it == off)) { return false; }
+        arr.insert(it, off);
+        break;
+    }
+    case ctype_t::BITMAP:
+    default: {
+        auto& w = bits[off >> 6];
+        auto const mask = 1ull << (off & 63);
+        if (!(w & mask)) { return false; }
+        w &= ~mask;
+        break;
+    }
+    }
+    card.fetch_sub(1, std::memory_order_relaxed);
+    maybe_convert();
+    return true;
+}
+
+uint16_t CompressedBlkSet::container::pop() {
+    uint16_t off{0};
+    switch (type) {
+    case ctype_t::ARRAY:
+        off = arr.back();
+        arr.pop_back();
+        break;
+    case ctype_t::INVERTED: {
+        // Smallest offset which is not in the sorted list of non-members
+        size_t i{0};
+        while ((i < arr.size()) && (arr[i] == off)) {
+            ++i;
+            ++off;
+        }
+        arr.insert(arr.begin() + i, off);
+        break;
+    }
+    case ctype_t::BITMAP:
+    default: {
+        uint32_t const nwords = (nblks + 63) / 64;
+        for (uint32_t i{0}; i < nwords; ++i) {
+            auto const w = (word_hint + i) % nwords;
+            if (bits[w] != 0) {
+                auto const bit = std::countr_zero(bits[w]);
+                bits[w] &= ~(1ull << bit);
+                word_hint = w;
+                off = s_cast< uint16_t >((w * 64) + bit);
+                break;
+            }
+        }
+        break;
+    }
+    }
+    card.fetch_sub(1, std::memory_order_relaxed);
+    maybe_convert();
+    return off;
+}
+
+void CompressedBlkSet::container::set_full() {
+    type = ctype_t::INVERTED;
+    arr.clear();
+    arr.shrink_to_fit();
+    bits.reset();
+    card.store(nblks, std::memory_order_relaxed);
+}
+
+void CompressedBlkSet::container::maybe_convert() {
+    // Array of 16 bit offsets is smaller than the bitmap, as long as it has less than 1 entry per 16 blks. Going
+    // back from bitmap happens only at half of that, so that a container at the boundary doesn't flip on every op.
+    uint32_t const arr_max = std::max(nblks / 16, 1u);
+    uint32_t const members = card.load(std::memory_order_relaxed);
+    uint32_t const non_members = nblks - members;
+
+    switch (type) {
+    case ctype_t::ARRAY:
+    case ctype_t::INVERTED: {
+        if (arr.empty()) { arr.shrink_to_fit(); } // Empty or full container shouldn't hold on to any memory
+        if (((type == ctype_t::ARRAY) ? members : non_members) <= arr_max) { return; }
+        if (non_members <= arr_max) {
+            to_array(ctype_t::INVERTED);
+        } else if (members <= arr_max) {
+            to_array(ctype_t::ARRAY);
+        } else {
+            to_bitmap();
+        }
+        break;
+    }
+    case ctype_t::BITMAP:
+    default:
+        if (members <= arr_max / 2) {
+            to_array(ctype_t::ARRAY);
+        } else if (non_members <= arr_max / 2) {
+            to_array(ctype_t::INVERTED);
+        }
+        break;
+    }
+}
+
+void CompressedBlkSet::container::to_bitmap() {
+    uint32_t const nwords = (nblks + 63) / 64;
+    auto new_bits = std::make_unique< uint64_t[] >(nwords);
+    std::memset(new_bits.get(), 0, nwords * sizeof(uint64_t));
+    for (uint32_t off{0}; off < nblks; ++off) {
+        if (contains(s_cast< uint16_t >(off))) { new_bits[off >> 6] |= (1ull << (off & 63)); }
+    }
+    type = ctype_t::BITMAP;
+    bits = std::move(new_bits);
+    word_hint = 0;
+    arr.clear();
+    arr.shrink_to_fit();
+}
+
+void CompressedBlkSet::container::to_array(ctype_t target) {
+    std::vector< uint16_t > new_arr;
+    bool const want_members = (target == ctype_t::ARRAY);
+    for (uint32_t off{0}; off < nblks; ++off) {
+        if (contains(s_cast< uint16_t >(off)) == want_members) { new_arr.push_back(s_cast< uint16_t >(off)); }
+    }
+    type = target;
+    arr = std::move(new_arr);
+    bits.reset();
+}
+
+size_t CompressedBlkSet::container::mem_bytes() const {
+    return (arr.capacity() * sizeof(uint16_t)) + (bits ? (((nblks + 63) / 64) * sizeof(uint64_t)) : 0);
+}
+} // namespace homestore
@@ -0,0 +1,103 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <homestore/blk.h>
+
+namespace homestore {
+/* CompressedBlkSet is a roaring style compressed set of blk numbers. Blk number space is split into containers of
+ * 64K blks and each container picks the cheapest representation for its current cardinality:
+ *
+ * ARRAY    - Sorted array of the 16 bit offsets which are members (sparse container; empty container costs nothing)
+ * INVERTED - Sorted array of the 16 bit offsets which are NOT members (dense container; full container costs nothing)
+ * BITMAP   - Plain 8KB bitmap, used only when neither of the arrays would be smaller
+ *
+ * So memory is never more than a plain bitmap and for chunks which are either mostly free or mostly full, it is a
+ * small fraction of it. Each container has its own lock, and the total count is maintained atomically.
+ */
+class CompressedBlkSet {
+public:
+    static constexpr uint32_t container_bits{16};
+    static constexpr uint32_t container_nblks{1u << container_bits};
+
+    explicit CompressedBlkSet(blk_num_t nblks);
+    CompressedBlkSet(CompressedBlkSet const&) = delete;
+    CompressedBlkSet(CompressedBlkSet&&) noexcept = delete;
+    CompressedBlkSet& operator=(CompressedBlkSet const&) = delete;
+    CompressedBlkSet& operator=(CompressedBlkSet&&) noexcept = delete;
+    ~CompressedBlkSet() = default;
+
+    /// @brief Add a blk to the set. Returns false if it is already a member
+    bool add(blk_num_t blk_num);
+
+    /// @brief Add a range of blks to the set. Containers which are fully covered by the range and empty before, are
+    /// turned into full containers directly.
+    void add_range(blk_num_t start, blk_num_t nblks);
+
+    /// @brief Remove a blk from the set. Returns false if it was not a member
+    bool remove(blk_num_t blk_num);
+
+    /// @brief Remove and return any member of the set, nullopt if the set is empty
+    std::optional< blk_num_t > pop();
+
+    bool contains(blk_num_t blk_num) const;
+    blk_num_t size() const { return m_count.load(std::memory_order_relaxed); }
+    blk_num_t capacity() const { return m_nblks; }
+
+    /// @brief Approximate number of bytes used to hold the set
+    size_t mem_bytes() const;
+
+private:
+    enum class ctype_t : uint8_t { ARRAY, INVERTED, BITMAP };
+
+    struct container {
+        mutable std::mutex mtx;
+        ctype_t type{ctype_t::ARRAY};
+        uint32_t nblks{0};                  // Number of blks this container covers (last one could be short)
+        std::atomic< uint32_t > card{0};    // Number of members, readable without lock
+        std::vector< uint16_t > arr;        // Members (ARRAY) or non-members (INVERTED)
+        std::unique_ptr< uint64_t[] > bits; // BITMAP
+        uint32_t word_hint{0};              // BITMAP word to start looking for a member on pop
+
+        bool contains(uint16_t off) const;
+        bool add(uint16_t off);
+        bool remove(uint16_t off);
+        uint16_t pop();
+        void set_full();
+        void maybe_convert();
+        void to_bitmap();
+        void to_array(ctype_t target);
+        size_t mem_bytes() const;
+    };
+
+    container& get_container(blk_num_t blk_num) { return m_containers[blk_num >> container_bits]; }
+    container const& get_container(blk_num_t blk_num) const { return m_containers[blk_num >> container_bits]; }
+    static uint16_t to_offset(blk_num_t blk_num) { return static_cast< uint16_t >(blk_num & (container_nblks - 1)); }
+
+private:
+    blk_num_t m_nblks;
+    uint32_t m_num_containers;
+    std::unique_ptr< container[] > m_containers;
+    std::atomic< blk_num_t > m_count{0};
+    std::atomic< uint32_t > m_pop_cursor{0}; // Container to start looking for a member on pop
+};
+} // namespace homestore
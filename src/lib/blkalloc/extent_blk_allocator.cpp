@@ -0,0 +1,334 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <iterator>
+
+#include <iomgr/iomgr_flip.hpp>
+
+#include "common/homestore_assert.hpp"
+#include "extent_blk_allocator.h"
+
+namespace homestore {
+ExtentBlkAllocator::ExtentBlkAllocator(BlkAllocConfig const& cfg, bool is_fresh, chunk_num_t chunk_id) :
+        BitmapBlkAllocator(cfg, is_fresh, chunk_id), m_metrics{get_name().c_str()} {
+    LOGINFO("ExtentBlkAllocator total blks: {}", get_total_blks());
+    if (is_fresh || !is_persistent()) { load(); }
+}
+
+void ExtentBlkAllocator::load() {
+    std::lock_guard lg{m_mtx};
+    m_by_offset.clear();
+    m_by_size.clear();
+    m_free_blks = 0;
+
+    auto const* disk_bm = get_disk_bitmap();
+    if (disk_bm == nullptr) {
+        add_extent(0, get_total_blks());
+    } else {
+        // Every run of free blks in the on-disk bitmap becomes a free extent
+        blk_num_t cur_blk{0};
+        while (cur_blk < get_total_blks()) {
+            auto const b =
+                disk_bm->get_next_contiguous_n_reset_bits(cur_blk, get_total_blks() - 1, 1, get_total_blks() - cur_blk);
+            if (b.nbits == 0) { break; }
+            add_extent(b.start_bit, b.nbits);
+            cur_blk = b.start_bit + b.nbits;
+        }
+    }
+    BLKALLOC_LOG(INFO, "ExtentBlkAllocator loaded free_blks={} in free_extents={} largest_extent={}", m_free_blks,
+                 m_by_offset.size(), m_by_size.empty() ? 0 : m_by_size.rbegin()->first);
+}
+
+BlkAllocStatus ExtentBlkAllocator::alloc_contiguous(BlkId& out_blkid) { return alloc(1, blk_alloc_hints{}, out_blkid); }
+
+BlkAllocStatus ExtentBlkAllocator::alloc(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_blkid) {
+#ifdef _PRERELEASE
+    if (iomgr_flip::instance()->test_flip("extent_blkalloc_no_blks", nblks)) { return BlkAllocStatus::SPACE_FULL; }
+#endif
+
+    if (!hints.is_contiguous && !out_blkid.is_multi()) {
+        HS_DBG_ASSERT(false, "Invalid Input: Non contiguous allocation needs MultiBlkId to store");
+        return BlkAllocStatus::INVALID_INPUT;
+    }
+    COUNTER_INCREMENT(m_metrics, num_alloc, 1);
+
+    MultiBlkId tmp_blkid;
+    MultiBlkId& out_mbid = out_blkid.is_multi() ? r_cast< MultiBlkId& >(out_blkid) : tmp_blkid;
+    blk_count_t const max_piece = hints.is_contiguous
+        ? nblks
+        : s_cast< blk_count_t >(std::min< uint32_t >({nblks, hints.max_blks_per_piece, max_blks_per_blkid()}));
+    blk_count_t const min_piece =
+        hints.is_contiguous ? nblks : std::min< blk_count_t >(nblks, hints.min_blks_per_piece);
+    blk_count_t nblks_remain = nblks;
+
+    {
+        std::lock_guard lg{m_mtx};
+        if (hints.neighbor_blkid_hint && (hints.neighbor_blkid_hint->chunk_num() == m_chunk_id)) {
+            // Prefer the first free extent after the neighbor over the best fit, to keep the blks of an object close
+            auto const& nb = *hints.neighbor_blkid_hint;
+            blk_count_t const want = std::min(nblks_remain, max_piece);
+            auto oit = m_by_offset.lower_bound(nb.blk_num() + nb.blk_count());
+            if ((oit != m_by_offset.end()) && (oit->second >= want)) {
+                auto const start = oit->first;
+                take_from_extent(oit, start, want);
+                out_mbid.add(start, want, m_chunk_id);
+                nblks_remain -= want;
+                COUNTER_INCREMENT(m_metrics, num_neighbor_hint_hits, 1);
+            } else {
+                COUNTER_INCREMENT(m_metrics, num_neighbor_hint_misses, 1);
+            }
+        }
+
+        while (nblks_remain && out_mbid.has_room()) {
+            blk_count_t const want = std::min(nblks_remain, max_piece);
+
+            // Best fit: smallest free extent which can hold the entire piece
+            auto sit = m_by_size.lower_bound({want, 0});
+            blk_count_t got{want};
+            if (sit == m_by_size.end()) {
+                // No extent can hold it, for scattered allocation settle for the largest one available
+                if (hints.is_contiguous || m_by_size.empty()) { break; }
+                sit = std::prev(m_by_size.end());
+                if (sit->first < std::min(min_piece, nblks_remain)) { break; }
+                got = s_cast< blk_count_t >(sit->first);
+            }
+
+            auto const start = sit->second;
+            take_from_extent(m_by_offset.find(start), start, got);
+            out_mbid.add(start, got, m_chunk_id);
+            nblks_remain -= got;
+        }
+    }
+
+    BlkAllocStatus status;
+    if (nblks_remain == 0) {
+        status = BlkAllocStatus::SUCCESS;
+    } else if ((nblks_remain != nblks) && hints.partial_alloc_ok) {
+        COUNTER_INCREMENT(m_metrics, num_alloc_partial, 1);
+        status = BlkAllocStatus::PARTIAL;
+    } else {
+        if (nblks_remain != nblks) {
+            std::lock_guard lg{m_mtx};
+            auto it = out_mbid.iterate();
+            while (auto const b = it.next()) {
+                free_extent(b->blk_num(), b->blk_count());
+            }
+        }
+        COUNTER_INCREMENT(m_metrics, num_alloc_failure, 1);
+        out_mbid = MultiBlkId{};
+        status = hints.is_contiguous ? BlkAllocStatus::FAILED : BlkAllocStatus::SPACE_FULL;
+    }
+
+    if ((status == BlkAllocStatus::SUCCESS) || (status == BlkAllocStatus::PARTIAL)) {
+        incr_alloced_blk_count(nblks - nblks_remain);
+        HISTOGRAM_OBSERVE(m_metrics, alloc_pieces, out_mbid.num_pieces());
+        BLKALLOC_LOG(TRACE, "Alloced blks [{}] for nblks={}", out_mbid.to_string(), nblks);
+    }
+
+    if (!out_blkid.is_multi()) { out_blkid = out_mbid.to_single_blkid(); }
+    return status;
+}
+
+// Called only during recovery, to mark the blks which are committed after the last persisted on-disk bitmap.
+BlkAllocStatus ExtentBlkAllocator::reserve_on_cache(BlkId const& bid) {
+    std::lock_guard lg{m_mtx};
+    auto const do_reserve = [this](BlkId const& b) { incr_alloced_blk_count(carve_range(b.blk_num(), b.blk_count())); };
+
+    if (bid.is_multi()) {
+        auto it = r_cast< MultiBlkId const& >(bid).iterate();
+        while (auto const b = it.next()) {
+            do_reserve(*b);
+        }
+    } else {
+        do_reserve(bid);
+    }
+    return BlkAllocStatus::SUCCESS;
+}
+
+void ExtentBlkAllocator::free(BlkId const& bid) {
+    blk_count_t n_freed{0};
+    {
+        std::lock_guard lg{m_mtx};
+        auto const do_free = [this, &n_freed](BlkId const& b) {
+            BLKALLOC_REL_ASSERT(is_range_alloced(b.blk_num(), b.blk_count()), "Expected blks {} to be allocated",
+                                b.to_string());
+            free_extent(b.blk_num(), b.blk_count());
+            n_freed += b.blk_count();
+        };
+
+        if (bid.is_multi()) {
+            auto it = r_cast< MultiBlkId const& >(bid).iterate();
+            while (auto const b = it.next()) {
+                do_free(*b);
+            }
+        } else {
+            do_free(bid);
+        }
+    }
+
+    if (is_persistent()) { free_on_disk(bid); }
+    decr_alloced_blk_count(n_freed);
+    BLKALLOC_LOG(TRACE, "Freed blkid={}", bid.to_string());
+}
+
+void ExtentBlkAllocator::free_batch(std::span< BlkId const > bids) {
+    blk_num_t n_freed{0};
+    {
+        std::lock_guard lg{m_mtx};
+        for (auto const& b : bids) {
+            BLKALLOC_REL_ASSERT(is_range_alloced(b.blk_num(), b.blk_count()), "Expected blks {} to be allocated",
+                                b.to_string());
+            free_extent(b.blk_num(), b.blk_count());
+            n_freed += b.blk_count();
+        }
+    }
+
+    if (is_persistent()) { free_on_disk(bids); }
+    decr_alloced_blk_count(n_freed);
+    BLKALLOC_LOG(TRACE, "Freed batch of {} blkids nblks={}", bids.size(), n_freed);
+}
+
+bool ExtentBlkAllocator::is_blk_alloced(BlkId const& bid, bool) const {
+    std::lock_guard lg{m_mtx};
+    if (bid.is_multi()) {
+        auto it = r_cast< MultiBlkId const& >(bid).iterate();
+        while (auto const b = it.next()) {
+            if (!is_range_alloced(b->blk_num(), b->blk_count())) { return false; }
+        }
+        return true;
+    }
+    return is_range_alloced(bid.blk_num(), bid.blk_count());
+}
+
+blk_num_t ExtentBlkAllocator::available_blks() const {
+    std::lock_guard lg{m_mtx};
+    return m_free_blks;
+}
+
+blk_num_t ExtentBlkAllocator::get_used_blks() const { return get_total_blks() - available_blks(); }
+
+blk_num_t ExtentBlkAllocator::get_defrag_nblks() const {
+    std::lock_guard lg{m_mtx};
+    return m_by_size.empty() ? 0 : (m_free_blks - m_by_size.rbegin()->first);
+}
+
+blk_num_t ExtentBlkAllocator::largest_free_extent() const {
+    std::lock_guard lg{m_mtx};
+    return m_by_size.empty() ? 0 : m_by_size.rbegin()->first;
+}
+
+size_t ExtentBlkAllocator::num_free_extents() const {
+    std::lock_guard lg{m_mtx};
+    return m_by_offset.size();
+}
+
+std::string ExtentBlkAllocator::to_string() const {
+    std::lock_guard lg{m_mtx};
+    return fmt::format("BlkAllocator={} total_blks={} free_blks={} free_extents={} largest_extent={}", get_name(),
+                       get_total_blks(), m_free_blks, m_by_offset.size(),
+                       m_by_size.empty() ? 0 : m_by_size.rbegin()->first);
+}
+
+nlohmann::json ExtentBlkAllocator::get_status(int) const {
+    std::lock_guard lg{m_mtx};
+    nlohmann::json j;
+    j["total_blks"] = get_total_blks();
+    j["free_blks"] = m_free_blks;
+    j["free_extents"] = m_by_offset.size();
+    j["largest_free_extent"] = m_by_size.empty() ? 0 : m_by_size.rbegin()->first;
+    return j;
+}
+
+///////////////////////////// Extent tree maintenance, all of them called under m_mtx /////////////////////////////
+void ExtentBlkAllocator::add_extent(blk_num_t start, blk_num_t nblks) {
+    if (nblks == 0) { return; }
+    m_by_offset.emplace(start, nblks);
+    m_by_size.emplace(nblks, start);
+    m_free_blks += nblks;
+}
+
+ExtentBlkAllocator::offset_map_t::iterator ExtentBlkAllocator::remove_extent(offset_map_t::iterator it) {
+    m_by_size.erase({it->second, it->first});
+    m_free_blks -= it->second;
+    return m_by_offset.erase(it);
+}
+
+// Take [start, start + nblks) out of the extent pointed by it, putting back the remaining portions on either side
+void ExtentBlkAllocator::take_from_extent(offset_map_t::iterator it, blk_num_t start, blk_num_t nblks) {
+    HS_DBG_ASSERT(it != m_by_offset.end(), "Extent to take blks from is missing");
+    auto const ext_start = it->first;
+    auto const ext_end = it->first + it->second;
+    HS_DBG_ASSERT((start >= ext_start) && ((start + nblks) <= ext_end), "Blks to take are not within the extent");
+
+    remove_extent(it);
+    add_extent(ext_start, start - ext_start);
+    add_extent(start + nblks, ext_end - (start + nblks));
+}
+
+// Remove whatever portion of [start, start + nblks) is free and return the number of blks removed
+blk_count_t ExtentBlkAllocator::carve_range(blk_num_t start, blk_num_t nblks) {
+    blk_count_t ncarved{0};
+    auto const end = start + nblks;
+
+    auto it = m_by_offset.upper_bound(start);
+    if (it != m_by_offset.begin()) { it = std::prev(it); }
+    while ((it != m_by_offset.end()) && (it->first < end)) {
+        auto const ov_start = std::max(start, it->first);
+        auto const ov_end = std::min(end, it->first + it->second);
+        if (ov_start >= ov_end) {
+            ++it;
+            continue;
+        }
+        take_from_extent(it, ov_start, ov_end - ov_start);
+        ncarved += ov_end - ov_start;
+        it = m_by_offset.lower_bound(ov_end);
+    }
+    return ncarved;
+}
+
+// Put back [start, start + nblks) as free, merging it with the adjacent free extents if any
+void ExtentBlkAllocator::free_extent(blk_num_t start, blk_num_t nblks) {
+    bool merged{false};
+    auto next = m_by_offset.lower_bound(start);
+    if ((next != m_by_offset.end()) && (next->first == start + nblks)) {
+        nblks += next->second;
+        next = remove_extent(next);
+        merged = true;
+    }
+
+    if (next != m_by_offset.begin()) {
+        auto prev = std::prev(next);
+        if ((prev->first + prev->second) == start) {
+            start = prev->first;
+            nblks += prev->second;
+            remove_extent(prev);
+            merged = true;
+        }
+    }
+
+    add_extent(start, nblks);
+    if (merged) { COUNTER_INCREMENT(m_metrics, num_free_merges, 1); }
+}
+
+bool ExtentBlkAllocator::is_range_alloced(blk_num_t start, blk_num_t nblks) const {
+    auto it = m_by_offset.upper_bound(start);
+    if ((it != m_by_offset.end()) && (it->first < (start + nblks))) { return false; }
+    if (it != m_by_offset.begin()) {
+        auto const prev = std::prev(it);
+        if ((prev->first + prev->second) > start) { return false; }
+    }
+    return true;
+}
+} // namespace homestore
@@ -0,0 +1,105 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+
+#include <sisl/metrics/metrics.hpp>
+#include "bitmap_blk_allocator.h"
+
+namespace homestore {
+class ExtentBlkAllocMetrics : public sisl::MetricsGroup {
+public:
+    explicit ExtentBlkAllocMetrics(const char* inst_name) : sisl::MetricsGroup("ExtentBlkAlloc", inst_name) {
+        REGISTER_COUNTER(num_alloc, "Number of blks alloc attempts");
+        REGISTER_COUNTER(num_alloc_failure, "Number of blk alloc failures");
+        REGISTER_COUNTER(num_alloc_partial, "Number of blk alloc partial allocations");
+        REGISTER_COUNTER(num_free_merges, "Number of frees which got merged with neighbouring free extents");
+        REGISTER_COUNTER(num_neighbor_hint_hits, "Number of allocs placed in the extent following the hinted blkid");
+        REGISTER_COUNTER(num_neighbor_hint_misses, "Number of allocs which couldn't be placed near the hinted blkid");
+        REGISTER_HISTOGRAM(alloc_pieces, "Number of pieces in an allocated blkid",
+                           HistogramBucketsType(LinearUpto64Buckets));
+
+        register_me_to_farm();
+    }
+
+    ExtentBlkAllocMetrics(const ExtentBlkAllocMetrics&) = delete;
+    ExtentBlkAllocMetrics(ExtentBlkAllocMetrics&&) noexcept = delete;
+    ExtentBlkAllocMetrics& operator=(const ExtentBlkAllocMetrics&) = delete;
+    ExtentBlkAllocMetrics& operator=(ExtentBlkAllocMetrics&&) noexcept = delete;
+    ~ExtentBlkAllocMetrics() { deregister_me_from_farm(); }
+};
+
+/* ExtentBlkAllocator keeps the free space of the chunk as a tree of free extents, indexed both by their start blk (to
+ * merge with neighbours on free) and by their size (to find the best fit in O(log n)). A request is carved out of the
+ * smallest free extent which can hold it entirely, so large sequential writes get a single piece as long as there is
+ * a free extent big enough. Only if the request is not contiguous, and no extent can fit it, it is split across the
+ * largest extents available.
+ *
+ * On-disk state is the same bitmap as the other bitmap allocators, persisted as part of cp_flush. On load the extent
+ * tree is rebuilt from the on-disk bitmap.
+ */
+class ExtentBlkAllocator : public BitmapBlkAllocator {
+public:
+    ExtentBlkAllocator(BlkAllocConfig const& cfg, bool is_fresh, chunk_num_t chunk_id);
+    ExtentBlkAllocator(ExtentBlkAllocator const&) = delete;
+    ExtentBlkAllocator(ExtentBlkAllocator&&) noexcept = delete;
+    ExtentBlkAllocator& operator=(ExtentBlkAllocator const&) = delete;
+    ExtentBlkAllocator& operator=(ExtentBlkAllocator&&) noexcept = delete;
+    virtual ~ExtentBlkAllocator() = default;
+
+    void load() override;
+
+    BlkAllocStatus alloc_contiguous(BlkId& bid) override;
+    BlkAllocStatus alloc(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_blkid) override;
+    BlkAllocStatus reserve_on_cache(BlkId const& b) override;
+    void free(BlkId const& b) override;
+    void free_batch(std::span< BlkId const > bids) override;
+
+    blk_num_t available_blks() const override;
+    blk_num_t get_used_blks() const override;
+
+    /// @brief Number of free blks which are not part of the largest free extent
+    blk_num_t get_defrag_nblks() const override;
+    bool is_blk_alloced(BlkId const& in_bid, bool use_lock = false) const override;
+    std::string to_string() const override;
+    nlohmann::json get_status(int log_level) const override;
+
+    /// @brief Size of the largest contiguous allocation which could be served right now
+    blk_num_t largest_free_extent() const;
+    size_t num_free_extents() const;
+
+private:
+    using offset_map_t = std::map< blk_num_t, blk_num_t >;              // start blk -> nblks
+    using size_set_t = std::set< std::pair< blk_num_t, blk_num_t > >; // {nblks, start blk}
+
+    void add_extent(blk_num_t start, blk_num_t nblks);
+    offset_map_t::iterator remove_extent(offset_map_t::iterator it);
+    void take_from_extent(offset_map_t::iterator it, blk_num_t start, blk_num_t nblks);
+    blk_count_t carve_range(blk_num_t start, blk_num_t nblks);
+    void free_extent(blk_num_t start, blk_num_t nblks);
+    bool is_range_alloced(blk_num_t start, blk_num_t nblks) const;
+
+private:
+    mutable std::mutex m_mtx; // Protects both the indexes below
+    offset_map_t m_by_offset;
+    size_set_t m_by_size;
+    blk_num_t m_free_blks{0};
+    ExtentBlkAllocMetrics m_metrics;
+};
+} // namespace homestore
@@ -13,6 +13,7 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cassert>
 #include <iomgr/iomgr_flip.hpp>
 
@@ -21,8 +22,13 @@
 
 namespace homestore {
 FixedBlkAllocator::FixedBlkAllocator(BlkAllocConfig const& cfg, bool is_fresh, chunk_num_t chunk_id) :
-        BitmapBlkAllocator(cfg, is_fresh, chunk_id), m_free_blk_q{get_total_blks()} {
-    LOGINFO("FixedBlkAllocator total blks: {}", get_total_blks());
+        BitmapBlkAllocator(cfg, is_fresh, chunk_id) {
+    if (HS_DYNAMIC_CONFIG(blkallocator.fixed_compressed_free_set)) {
+        m_free_blk_set = std::make_unique< CompressedBlkSet >(get_total_blks());
+    } else {
+        m_free_blk_q = std::make_unique< folly::MPMCQueue< blk_num_t > >(get_total_blks());
+    }
+    LOGINFO("FixedBlkAllocator total blks: {} compressed_free_set={}", get_total_blks(), (m_free_blk_set != nullptr));
     if (is_fresh || !is_persistent()) { load(); }
 }
 
@@ -34,6 +40,7 @@ void FixedBlkAllocator::load() {
 }
 
 blk_num_t FixedBlkAllocator::init_portion(BlkAllocPortion& portion, blk_num_t start_blk_num) {
+    if (m_free_blk_set) { return init_portion_set(portion, start_blk_num); }
     auto lock{portion.portion_auto_lock()};
 
     auto blk_num = start_blk_num;
@@ -42,8 +49,7 @@ blk_num_t FixedBlkAllocator::init_portion(BlkAllocPortion& portion, blk_num_t st
         if (portion.get_portion_num() != cur_portion.get_portion_num()) break;
 
         if (!is_persistent() || get_disk_bitmap()->is_bits_reset(blk_num, 1)) {
-            const auto pushed = m_free_blk_q.write(blk_num);
-            HS_DBG_ASSERT_EQ(pushed, true, "Expected to be able to push the blk on fixed capacity Q");
+            push_free_blk(blk_num);
         }
         ++blk_num;
     }
@@ -51,23 +57,73 @@ blk_num_t FixedBlkAllocator::init_portion(BlkAllocPortion& portion, blk_num_t st
     return blk_num;
 }
 
-bool FixedBlkAllocator::is_blk_alloced(BlkId const& b, bool use_lock) const { return true; }
+blk_num_t FixedBlkAllocator::init_portion_set(BlkAllocPortion& portion, blk_num_t start_blk_num) {
+    auto lock{portion.portion_auto_lock()};
+
+    // Add the free runs of the portion as ranges, so that entirely free containers are represented without any memory
+    blk_num_t const end_blk_num =
+        std::min(get_total_blks(), (portion.get_portion_num() + 1) * get_blks_per_portion());
+    if (!is_persistent()) {
+        m_free_blk_set->add_range(start_blk_num, end_blk_num - start_blk_num);
+        return end_blk_num;
+    }
+
+    blk_num_t blk_num{start_blk_num};
+    while (blk_num < end_blk_num) {
+        auto const b = get_disk_bitmap()->get_next_contiguous_n_reset_bits(blk_num, end_blk_num - 1, 1,
+                                                                           end_blk_num - blk_num);
+        if (b.nbits == 0) { break; }
+        m_free_blk_set->add_range(b.start_bit, b.nbits);
+        blk_num = b.start_bit + b.nbits;
+    }
+    return end_blk_num;
+}
+
+void FixedBlkAllocator::push_free_blk(blk_num_t blk_num) {
+    if (m_free_blk_set) {
+        [[maybe_unused]] auto const added = m_free_blk_set->add(blk_num);
+        HS_DBG_ASSERT_EQ(added, true, "Freeing blk_num={} which is already free", blk_num);
+    } else {
+        const auto pushed = m_free_blk_q->write(blk_num);
+        HS_DBG_ASSERT_EQ(pushed, true, "Expected to be able to push the blk on fixed capacity Q");
+    }
+}
+
+bool FixedBlkAllocator::pop_free_blk(blk_num_t& blk_num) {
+    if (m_free_blk_set) {
+        auto const b = m_free_blk_set->pop();
+        if (!b) { return false; }
+        blk_num = *b;
+        return true;
+    }
+    return m_free_blk_q->read(blk_num);
+}
+
+bool FixedBlkAllocator::is_blk_alloced(BlkId const& b, bool use_lock) const {
+    // Queue can't be looked up, so only the compressed set can really tell
+    return m_free_blk_set ? !m_free_blk_set->contains(b.blk_num()) : true;
+}
 
 BlkAllocStatus FixedBlkAllocator::alloc([[maybe_unused]] blk_count_t nblks, blk_alloc_hints const&, BlkId& out_blkid) {
     if (m_state == state_t::RECOVERING) {
         // Possibly first few attempts to allocate; under lock, remove all the blks which are marked to be removed from
         // the free list
         std::lock_guard lg(m_mark_blk_mtx);
-        if (!m_marked_blks.empty()) {
+        if (m_free_blk_set) {
+            for (auto const blk_num : m_marked_blks) {
+                m_free_blk_set->remove(blk_num);
+            }
+            m_marked_blks.clear();
+        } else if (!m_marked_blks.empty()) {
             auto const count = available_blks();
             for (uint64_t i{0}; ((i < count) && !m_marked_blks.empty()); ++i) {
                 blk_num_t blk_num;
-                if (!m_free_blk_q.read(blk_num)) { break; }
+                if (!m_free_blk_q->read(blk_num)) { break; }
 
                 if (m_marked_blks.find(blk_num) != m_marked_blks.end()) {
                     m_marked_blks.erase(blk_num); // This blk needs to be skipped
                 } else {
-                    m_free_blk_q.write(blk_num); // This blk is not marked, put it back at the end of queue
+                    m_free_blk_q->write(blk_num); // This blk is not marked, put it back at the end of queue
                 }
             }
             HS_DBG_ASSERT(m_marked_blks.empty(), "All marked blks should have been removed from free list");
@@ -79,7 +135,7 @@ BlkAllocStatus FixedBlkAllocator::alloc([[maybe_unused]] blk_count_t nblks, blk_
     if (iomgr_flip::instance()->test_flip("fixed_blkalloc_no_blks")) { return BlkAllocStatus::SPACE_FULL; }
 #endif
     blk_num_t blk_num;
-    if (!m_free_blk_q.read(blk_num)) { return BlkAllocStatus::SPACE_FULL; }
+    if (!pop_free_blk(blk_num)) { return BlkAllocStatus::SPACE_FULL; }
 
     out_blkid = BlkId{blk_num, 1, m_chunk_id};
     return BlkAllocStatus::SUCCESS;
@@ -96,24 +152,30 @@ BlkAllocStatus FixedBlkAllocator::reserve_on_cache(BlkId const& b) {
 
 void FixedBlkAllocator::free(BlkId const& b) {
     HS_DBG_ASSERT_EQ(b.blk_count(), 1, "Multiple blk free for FixedBlkAllocator? allocated by different allocator?");
-
-    const auto pushed = m_free_blk_q.write(b.blk_num());
-    HS_DBG_ASSERT_EQ(pushed, true, "Expected to be able to push the blk on fixed capacity Q");
+    push_free_blk(b.blk_num());
 
     if (is_persistent()) { free_on_disk(b); }
 }
 
-blk_num_t FixedBlkAllocator::available_blks() const { return m_free_blk_q.sizeGuess(); }
+void FixedBlkAllocator::free_batch(std::span< BlkId const > bids) {
+    for (auto const& b : bids) {
+        HS_DBG_ASSERT_EQ(b.blk_count(), 1, "Multiple blk free for FixedBlkAllocator?");
+        push_free_blk(b.blk_num());
+    }
+    if (is_persistent()) { free_on_disk(bids); }
+}
 
-blk_num_t FixedBlkAllocator::get_defrag_nblks() const {
-    // TODO: implement this
-    HS_DBG_ASSERT_EQ(false, true, "FixedBlkAllocator get_defrag_nblks Not implemented");
-    return 0;
+blk_num_t FixedBlkAllocator::available_blks() const {
+    return m_free_blk_set ? m_free_blk_set->size() : m_free_blk_q->sizeGuess();
 }
 
+// All blks are of the same size, any free blk could be allocated
+blk_num_t FixedBlkAllocator::get_defrag_nblks() const { return 0; }
+
 blk_num_t FixedBlkAllocator::get_used_blks() const { return get_total_blks() - available_blks(); }
 
 std::string FixedBlkAllocator::to_string() const {
-    return fmt::format("Total Blks={} Available_Blks={}", get_total_blks(), available_blks());
+    return fmt::format("Total Blks={} Available_Blks={} FreeSetMemBytes={}", get_total_blks(), available_blks(),
+                       m_free_blk_set ? m_free_blk_set->mem_bytes() : 0);
 }
 } // namespace homestore
@@ -15,11 +15,15 @@
 #pragma once
 
 #include "bitmap_blk_allocator.h"
+#include "compressed_blk_set.h"
 
 namespace homestore {
 /* FixedBlkAllocator is a fast allocator where it allocates only 1 size block and ALL free blocks are cached instead
  * of selectively caching few blks which are free. Thus there is no sweeping of bitmap or other to refill the cache.
  * It does not support temperature of blocks and allocates simply on first come first serve basis
+ *
+ * Free blks are cached either in a lock free queue (an entry per free blk) or, if fixed_compressed_free_set is
+ * enabled, in a CompressedBlkSet which needs far less memory for chunks with tiny blks (e.g index nodes).
  */
 class FixedBlkAllocator : public BitmapBlkAllocator {
 public:
@@ -36,6 +40,7 @@ public:
     BlkAllocStatus alloc(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_blkid) override;
     BlkAllocStatus reserve_on_cache(BlkId const& b) override;
     void free(BlkId const& b) override;
+    void free_batch(std::span< BlkId const > bids) override;
 
     blk_num_t available_blks() const override;
     blk_num_t get_used_blks() const override;
@@ -45,6 +50,9 @@ public:
 
 private:
     blk_num_t init_portion(BlkAllocPortion& portion, blk_num_t start_blk_num);
+    blk_num_t init_portion_set(BlkAllocPortion& portion, blk_num_t start_blk_num);
+    void push_free_blk(blk_num_t blk_num);
+    bool pop_free_blk(blk_num_t& blk_num);
 
 private:
     enum class state_t : uint8_t { RECOVERING, ACTIVE };
@@ -52,6 +60,7 @@ private:
     state_t m_state{state_t::RECOVERING};
     std::unordered_set< blk_num_t > m_marked_blks; // Keep track of all blks which are marked as allocated
     std::mutex m_mark_blk_mtx;                     // Mutex used while removing marked_blks from blk_q
-    folly::MPMCQueue< blk_num_t > m_free_blk_q;
+    std::unique_ptr< folly::MPMCQueue< blk_num_t > > m_free_blk_q; // Either of the queue or the set is used
+    std::unique_ptr< CompressedBlkSet > m_free_blk_set;
 };
 } // namespace homestore
@@ -13,8 +13,12 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <condition_variable>
+#include <cstring>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <thread>
 
@@ -22,8 +26,12 @@
 #include <sisl/logging/logging.h>
 #include <sisl/utility/thread_factory.hpp>
 #include <sisl/utility/thread_buffer.hpp>
+#include <iomgr/io_environment.hpp>
 #include <iomgr/iomgr_flip.hpp>
+#include <homestore/meta_service.hpp>
 
+#include "meta/meta_sb.hpp"
+#include "common/thread_affinity.hpp"
 #include "blk_cache_queue.h"
 
 #include "varsize_blk_allocator.h"
@@ -43,6 +51,7 @@ namespace homestore {
 // initialize static variables
 std::atomic< size_t > VarsizeBlkAllocator::s_sweeper_thread_references{0};
 std::vector< std::thread > VarsizeBlkAllocator::s_sweeper_threads;
+std::atomic< size_t > VarsizeBlkAllocator::s_num_sweeper_threads{0};
 std::mutex VarsizeBlkAllocator::s_sweeper_mutex;
 std::mutex VarsizeBlkAllocator::s_sweeper_create_delete_mutex;
 std::atomic< bool > VarsizeBlkAllocator::s_sweeper_threads_stop{false};
@@ -82,6 +91,27 @@ VarsizeBlkAllocator::VarsizeBlkAllocator(VarsizeBlkAllocConfig const& cfg, bool
     if (m_cfg.m_use_slabs) {
         m_fb_cache = std::make_unique< FreeBlkCacheQueue >(cfg.get_slab_config(), &m_metrics);
         LOGINFO("m_fb_cache total free blks: {}", m_fb_cache->total_free_blks());
+
+        // Bulk refill of largest magazine slab should fit in a single cache alloc request. Magazines are not aware
+        // of temperature, so they are not used when blks are segregated by temperature.
+        m_num_temps = std::max< blk_temp_t >(HS_DYNAMIC_CONFIG(blkallocator.num_blk_temperatures), 1);
+        if (m_num_temps == 1) {
+            m_magazine_size = std::min(HS_DYNAMIC_CONFIG(blkallocator.thread_magazine_size),
+                                       uint32_cast(max_blks_per_blkid() >> (max_magazine_slabs - 1)));
+        }
+    }
+
+    for (blk_num_t p{0}; p < get_num_portions(); ++p) {
+        get_blk_portion(p).set_temperature(portion_temperature(p));
+    }
+
+    if (is_persistent() && m_cfg.m_use_slabs) {
+        meta_service().register_handler(
+            snapshot_meta_name(),
+            [this](meta_blk* mblk, sisl::byte_view buf, size_t) {
+                on_free_cache_snapshot_found(voidptr_cast(mblk), buf);
+            },
+            nullptr);
     }
 
     if (is_fresh || !is_persistent()) { do_start(); }
@@ -145,22 +175,43 @@ VarsizeBlkAllocator::~VarsizeBlkAllocator() {
     }
 }
 
+// How often the first sweeper thread checks num_slab_sweeper_threads to resize the pool to
+static constexpr uint64_t sweeper_resize_check_ms{1000};
+
 void VarsizeBlkAllocator::sweeper_thread(size_t thread_num) {
-    const size_t num_sweeper_threads = HS_DYNAMIC_CONFIG(blkallocator.num_slab_sweeper_threads);
+    pin_thread(hs_thread_role_t::blkalloc_sweep);
+    auto const refill_interval = [] {
+        return std::chrono::milliseconds(HS_DYNAMIC_CONFIG(blkallocator.free_blk_cache_refill_frequency_ms));
+    };
+    auto next_refill_time = std::chrono::steady_clock::now() + refill_interval();
 
     while (!s_sweeper_threads_stop) {
+        // First thread stays as long as the pool and sizes the rest of it, which leave once they are beyond the size
+        if (thread_num == 0) { resize_sweeper_threads(); }
+
         VarsizeBlkAllocator* allocator_ptr{nullptr};
         {
             std::unique_lock< std::mutex > lock{s_sweeper_mutex};
-            auto const woken{s_sweeper_cv.wait_for(
-                lock, std::chrono::milliseconds(HS_DYNAMIC_CONFIG(blkallocator.free_blk_cache_refill_frequency_ms)),
-                [&]() { return !s_sweeper_queue.empty() || s_sweeper_threads_stop; })};
+            auto const resize_check_time =
+                std::chrono::steady_clock::now() + std::chrono::milliseconds(sweeper_resize_check_ms);
+            auto const wait_till = (thread_num == 0) ? std::min(next_refill_time, resize_check_time) : next_refill_time;
+            auto const woken{s_sweeper_cv.wait_until(lock, wait_till, [&]() {
+                return !s_sweeper_queue.empty() || s_sweeper_threads_stop || (thread_num >= s_num_sweeper_threads);
+            })};
             if (s_sweeper_threads_stop) continue;
+            if (thread_num >= s_num_sweeper_threads) {
+                // Allocator queued could have woken this thread, pass it on to the ones staying
+                if (!s_sweeper_queue.empty()) { s_sweeper_cv.notify_one(); }
+                break;
+            }
             if (woken) {
                 // pull allocator to process
                 allocator_ptr = s_sweeper_queue.front();
                 s_sweeper_queue.pop();
+            } else if (std::chrono::steady_clock::now() < next_refill_time) {
+                continue; // Woken only to check the pool size
             }
+            next_refill_time = std::chrono::steady_clock::now() + refill_interval();
         }
 
         if (allocator_ptr) {
@@ -196,6 +247,7 @@ void VarsizeBlkAllocator::sweeper_thread(size_t thread_num) {
                 // timed out, so process all block allocators
                 std::unique_lock< std::mutex > lock{s_sweeper_mutex};
                 size_t pos = thread_num;
+                auto const num_sweeper_threads = s_num_sweeper_threads.load();
                 for (auto itr{std::cbegin(s_block_allocators)}; itr != std::cend(s_block_allocators); ++itr, ++pos) {
                     if ((pos % num_sweeper_threads) == 0) { s_sweeper_queue.emplace(*itr); }
                 }
@@ -205,6 +257,40 @@ void VarsizeBlkAllocator::sweeper_thread(size_t thread_num) {
     }
 }
 
+size_t VarsizeBlkAllocator::num_sweeper_threads() {
+    std::unique_lock< std::mutex > create_delete_lock{s_sweeper_create_delete_mutex};
+    return s_sweeper_threads.size();
+}
+
+// Sizes the pool to num_slab_sweeper_threads. Threads beyond it leave by themselves on waking up and are joined here.
+void VarsizeBlkAllocator::resize_sweeper_threads() {
+    // Skipped while the pool is being started or stopped, stop joins the first thread, which is calling this
+    std::unique_lock< std::mutex > create_delete_lock{s_sweeper_create_delete_mutex, std::try_to_lock};
+    if (!create_delete_lock.owns_lock() || s_sweeper_threads_stop) { return; }
+
+    auto const nthreads = s_cast< size_t >(std::max(HS_DYNAMIC_CONFIG(blkallocator.num_slab_sweeper_threads), 1u));
+    if (nthreads == s_sweeper_threads.size()) { return; }
+    BLKALLOC_LOG(INFO, "Resizing blk sweep threads from {} to {}", s_sweeper_threads.size(), nthreads);
+    {
+        std::unique_lock< std::mutex > lock{s_sweeper_mutex};
+        s_num_sweeper_threads.store(nthreads);
+    }
+
+    if (nthreads < s_sweeper_threads.size()) {
+        s_sweeper_cv.notify_all();
+        while (s_sweeper_threads.size() > nthreads) {
+            // Finishes the sweep it is in first
+            if (s_sweeper_threads.back().joinable()) { s_sweeper_threads.back().join(); }
+            s_sweeper_threads.pop_back();
+        }
+    } else {
+        for (size_t thread_num{s_sweeper_threads.size()}; thread_num < nthreads; ++thread_num) {
+            s_sweeper_threads.emplace_back(sisl::named_thread("blkalloc_sweep" + std::to_string(thread_num),
+                                                              VarsizeBlkAllocator::sweeper_thread, thread_num));
+        }
+    }
+}
+
 // returns true if state change, and must be called under external lock
 bool VarsizeBlkAllocator::allocator_state_machine() {
     bool active_state{false};
@@ -241,6 +327,8 @@ void VarsizeBlkAllocator::load() {
 }
 
 void VarsizeBlkAllocator::do_start() {
+    init_portion_free_blks();
+
     // if use slabs then add to sweeper threads queue
     if (m_cfg.m_use_slabs) {
         {
@@ -248,8 +336,10 @@ void VarsizeBlkAllocator::do_start() {
             if (s_sweeper_thread_references++ == 0) {
                 s_sweeper_threads_stop = false;
                 {
-                    for (size_t thread_num{0}; thread_num < HS_DYNAMIC_CONFIG(blkallocator.num_slab_sweeper_threads);
-                         ++thread_num) {
+                    auto const nthreads =
+                        s_cast< size_t >(std::max(HS_DYNAMIC_CONFIG(blkallocator.num_slab_sweeper_threads), 1u));
+                    s_num_sweeper_threads.store(nthreads);
+                    for (size_t thread_num{0}; thread_num < nthreads; ++thread_num) {
                         s_sweeper_threads.emplace_back(sisl::named_thread("blkalloc_sweep" + std::to_string(thread_num),
                                                                           VarsizeBlkAllocator::sweeper_thread,
                                                                           thread_num));
@@ -272,10 +362,28 @@ void VarsizeBlkAllocator::do_start() {
     }
 }
 
-// This runs on per region thread and is at present single threaded.
-/* we are going through the segments which has maximum free blks so that we can ensure that all slabs are populated.
- * We might need to find a efficient way of doing it later. It stop processing the segment when any slab greater
- * then slab_indx is full.
+// Count the free blks of each portion once at start, so that sweeps and direct allocations can skip the portions whose
+// bitmap scan cannot yield anything. Popcount of portion words is way cheaper than looking for free runs in them.
+void VarsizeBlkAllocator::init_portion_free_blks() {
+    blk_num_t total_free{0};
+    for (blk_num_t p{0}; p < get_num_portions(); ++p) {
+        BlkAllocPortion& portion = get_blk_portion(p);
+        auto lock{portion.portion_auto_lock()};
+        auto const start_blk_id = p * get_blks_per_portion();
+        auto const end_blk_id = std::min(start_blk_id + get_blks_per_portion(), get_total_blks()) - 1;
+        auto const nfree = (end_blk_id - start_blk_id + 1) - m_cache_bm->get_set_count(start_blk_id, end_blk_id);
+        portion.set_free_blks(nfree);
+        total_free += nfree;
+    }
+    BLKALLOC_LOG(DEBUG, "Initialized free blks count of {} portions, total free blks={}", get_num_portions(),
+                 total_free);
+}
+
+// This runs on the sweeper thread, which fans out the bitmap scan to a few iomanager workers if configured so.
+/* We go through all the segments (or the one provided), starting from each segment's clock hand. Portions of the
+ * different segments are interleaved, so that parallel workers spread across the segments. Each worker claims the next
+ * portion and scans its bitmap under portion lock (portions are word aligned, so it is safe to scan them in parallel),
+ * while pushing the free blks to the shared fill session is serialized. Sweep stops once all slabs are refilled.
  */
 void VarsizeBlkAllocator::fill_cache(BlkAllocSegment* in_seg, blk_cache_fill_session& fill_session) {
 #ifdef _PRERELEASE
@@ -285,45 +393,88 @@ void VarsizeBlkAllocator::fill_cache(BlkAllocSegment* in_seg, blk_cache_fill_ses
     }
 #endif
 
-    // Pick a segment if scan if not provided
-    BlkAllocSegment* seg = in_seg;
-    if (seg == nullptr) {
-        // For now we are picking segment[0], we need to find a way to track allocation per segment
-        seg = m_segments[0].get();
-#if 0
-        uint64_t max_blks{0};
-        for (uint32_t i{0}; i < m_segments.size(); ++i) {
-            if (m_segments[i]->get_free_blks() > max_blks) {
-                seg = m_segments[i];
-                max_blks = m_segments[i]->get_free_blks();
-            }
-        }
+    // First sweep after restart is served from persisted snapshot, if there is one
+    if (fill_cache_from_snapshot(fill_session) && fill_session.overall_refill_done) {
+        BLKALLOC_LOG(INFO, "Allocator sweep session={} satisfied from free cache snapshot with {} blks",
+                     fill_session.session_id, fill_session.overall_refilled_num_blks);
+        m_fb_cache->close_cache_fill_session(fill_session);
+        return;
+    }
 
-        if (seg == nullptr) {
-            BLKALLOC_LOG(ERROR, "There are no more free blocks in bitset, everything is swept");
-            return;
+    std::vector< BlkAllocSegment* > segs;
+    if (in_seg != nullptr) {
+        segs.push_back(in_seg);
+    } else {
+        // Rotate the starting segment across sweeps, so that no segment is always drained first
+        segs.reserve(m_segments.size());
+        for (size_t i{0}; i < m_segments.size(); ++i) {
+            segs.push_back(m_segments[(m_next_sweep_seg + i) % m_segments.size()].get());
         }
-#endif
+        m_next_sweep_seg = (m_next_sweep_seg + 1) % m_segments.size();
     }
 
-    const blk_num_t start_portion_num = seg->get_seg_num() * m_portions_per_seg + seg->get_clock_hand();
-    auto portion_num = start_portion_num;
+    // Shared with the workers on iomanager reactors, which could get to run only after the sweep is over
+    struct sweep_ctx {
+        std::vector< blk_num_t > portions;
+        std::mutex session_mtx;
+        std::atomic< size_t > next_idx{0};
+        std::atomic< bool > done{false};
+        std::atomic< bool > closed{false}; // Sweep is over, workers which start now mustn't touch the session
+        std::atomic< uint32_t > active{0};
+        std::mutex mtx;
+        std::condition_variable cv;
+    };
+    auto ctx = std::make_shared< sweep_ctx >();
+    auto& portions = ctx->portions;
+    portions.reserve(segs.size() * m_portions_per_seg);
+    for (blk_num_t i{0}; i < m_portions_per_seg; ++i) {
+        for (auto* seg : segs) {
+            portions.push_back(seg->get_seg_num() * m_portions_per_seg +
+                               (seg->get_clock_hand() + i) % m_portions_per_seg);
+        }
+    }
 
-    do {
-        BLKALLOC_LOG_ASSERT_CMP(portion_num, <, get_num_portions());
-        fill_cache_in_portion(portion_num, fill_session);
+    auto const sweep_worker = [this, &fill_session](sweep_ctx& c) {
+        c.active.fetch_add(1);
+        while (!c.closed.load() && !c.done.load(std::memory_order_acquire)) {
+            auto const idx = c.next_idx.fetch_add(1, std::memory_order_acq_rel);
+            if (idx >= c.portions.size()) { break; }
+            BLKALLOC_LOG_ASSERT_CMP(c.portions[idx], <, get_num_portions());
+            // We have fully satisifed this session requirements
+            if (fill_cache_in_portion(c.portions[idx], fill_session, &c.session_mtx)) {
+                c.done.store(true, std::memory_order_release);
+            }
+        }
+        if (c.active.fetch_sub(1) == 1) {
+            std::unique_lock lg{c.mtx};
+            c.cv.notify_all();
+        }
+    };
 
-        // We have fully satisifed this session requirements
-        if (fill_session.overall_refill_done) { break; }
+    // Rest of the scan is fanned out to the iomanager workers. Sweeper doesn't rely on them to get to it, it claims the
+    // portions as well and once it runs out of them, waits only for the workers still scanning one.
+    auto const nworkers = std::min(s_cast< size_t >(std::max(HS_DYNAMIC_CONFIG(blkallocator.num_sweep_workers), 1u)),
+                                   portions.size());
+    for (size_t w{1}; w < nworkers; ++w) {
+        iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [ctx, sweep_worker]() { sweep_worker(*ctx); });
+    }
+    sweep_worker(*ctx);
+    ctx->closed.store(true);
+    {
+        std::unique_lock lg{ctx->mtx};
+        ctx->cv.wait(lg, [&ctx]() { return ctx->active.load() == 0; });
+    }
 
-        // Goto next group within the segment.
-        seg->inc_clock_hand();
-        portion_num = seg->get_clock_hand();
-    } while (portion_num != start_portion_num);
+    // Move the clock hand of each segment past the portions swept in this session
+    auto const nswept = std::min(ctx->next_idx.load(std::memory_order_acquire), portions.size());
+    for (size_t s{0}; s < segs.size(); ++s) {
+        auto const seg_swept = (nswept + segs.size() - 1 - s) / segs.size();
+        segs[s]->set_clock_hand(segs[s]->get_clock_hand() + seg_swept);
+    }
 
     if (fill_session.overall_refilled_num_blks) {
-        BLKALLOC_LOG(DEBUG, "Allocator sweep session={} added {} blks to blk cache", fill_session.session_id,
-                     fill_session.overall_refilled_num_blks);
+        BLKALLOC_LOG(DEBUG, "Allocator sweep session={} added {} blks to blk cache using {} workers",
+                     fill_session.session_id, fill_session.overall_refilled_num_blks, nworkers);
     } else {
         BLKALLOC_LOG(DEBUG, "Allocator sweep session={} failed to add any blocks to blk cache",
                      fill_session.session_id);
@@ -331,7 +482,8 @@ void VarsizeBlkAllocator::fill_cache(BlkAllocSegment* in_seg, blk_cache_fill_ses
     m_fb_cache->close_cache_fill_session(fill_session);
 }
 
-void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache_fill_session& fill_session) {
+bool VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache_fill_session& fill_session,
+                                                std::mutex* session_mtx) {
     auto cur_blk_id = portion_num * get_blks_per_portion();
     auto const end_blk_id = cur_blk_id + get_blks_per_portion() - 1;
 
@@ -341,10 +493,17 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
     BLKALLOC_LOG(TRACE, "Allocator sweep session={} for portion_num={} sweep blk_id_range=[{}-{}]",
                  fill_session.session_id, portion_num, cur_blk_id, end_blk_id);
 
+    auto session_lock = session_mtx ? std::unique_lock< std::mutex >{*session_mtx, std::defer_lock}
+                                    : std::unique_lock< std::mutex >{};
+    bool refill_done{false};
     BlkAllocPortion& portion = get_blk_portion(portion_num);
-    {
+    if (portion.free_blks() == 0) {
+        BLKALLOC_LOG(TRACE, "Allocator sweep session={} skipping fully allocated portion_num={}",
+                     fill_session.session_id, portion_num);
+        COUNTER_INCREMENT(m_metrics, num_portions_skipped, 1);
+    } else {
         auto lock{portion.portion_auto_lock()};
-        while (!fill_session.overall_refill_done && (cur_blk_id <= end_blk_id)) {
+        while (!refill_done && (cur_blk_id <= end_blk_id)) {
             // Get next reset bits and insert to cache and then reset those bits
             auto const b{
                 m_cache_bm->get_next_contiguous_n_reset_bits(cur_blk_id, end_blk_id, 1, end_blk_id - cur_blk_id + 1)};
@@ -361,7 +520,12 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
             fill_req.start_blk_num = b.start_bit;
             fill_req.nblks = b.nbits;
             fill_req.preferred_level = portion.temperature();
-            auto const nblks_added = m_fb_cache->try_fill_cache(fill_req, fill_session);
+
+            if (session_mtx) { session_lock.lock(); }
+            refill_done = fill_session.overall_refill_done;
+            auto const nblks_added = refill_done ? 0 : m_fb_cache->try_fill_cache(fill_req, fill_session);
+            refill_done = fill_session.overall_refill_done;
+            if (session_mtx) { session_lock.unlock(); }
 
             HS_DBG_ASSERT_LE(nblks_added, b.nbits);
 
@@ -369,18 +533,171 @@ void VarsizeBlkAllocator::fill_cache_in_portion(blk_num_t portion_num, blk_cache
                          fill_session.session_id, portion_num, b.start_bit, nblks_added, get_alloced_blk_count());
 
             // Set the bitmap indicating the blocks are allocated
-            if (nblks_added > 0) { m_cache_bm->set_bits(b.start_bit, nblks_added); }
+            if (nblks_added > 0) {
+                m_cache_bm->set_bits(b.start_bit, nblks_added);
+                portion.decr_free_blks(nblks_added);
+            }
             cur_blk_id = b.start_bit + b.nbits;
         }
     }
+
+    if (session_mtx) { session_lock.lock(); }
     if (fill_session.need_notify()) {
         // If we have filled enough to satisfy notification, do so
         fill_session.set_urgent_satisfied();
         m_cv.notify_all();
     }
+    refill_done = fill_session.overall_refill_done;
 
     BLKALLOC_LOG(TRACE, "Allocator Portion num={} sweep session={} completed, so far added {} blks",
                  fill_session.session_id, portion_num, fill_session.overall_refilled_num_blks);
+    return refill_done;
+}
+
+void VarsizeBlkAllocator::cp_flush(CP* cp) {
+    BitmapBlkAllocator::cp_flush(cp);
+
+    auto const interval = HS_DYNAMIC_CONFIG(blkallocator.free_cache_snapshot_cp_interval);
+    if (!is_persistent() || !m_cfg.m_use_slabs || (interval == 0)) { return; }
+    if (++m_cps_since_snapshot >= interval) {
+        m_cps_since_snapshot = 0;
+        write_free_cache_snapshot();
+    }
+}
+
+void VarsizeBlkAllocator::write_free_cache_snapshot() {
+    auto const max_entries = HS_DYNAMIC_CONFIG(blkallocator.free_cache_snapshot_max_entries);
+    auto const* disk_bm = get_disk_bitmap();
+    std::vector< free_cache_snapshot_entry > entries;
+    entries.reserve(max_entries);
+
+    // Walk backwards from each segment's clock hand, interleaving the segments, so that the most recently swept
+    // portions (whose free blks are what the cache is holding) are picked first. Persisted free blks on disk is what
+    // is taken, since blks which are only in cache are yet to be allocated. Number of portions scanned is bounded.
+    blk_num_t nportions_scanned{0};
+    for (blk_num_t i{1}; (i <= m_portions_per_seg) && (entries.size() < max_entries); ++i) {
+        for (auto const& seg : m_segments) {
+            if ((entries.size() >= max_entries) || (nportions_scanned++ >= max_entries)) { break; }
+            auto const portion_num = seg->get_seg_num() * m_portions_per_seg +
+                (seg->get_clock_hand() + m_portions_per_seg - i) % m_portions_per_seg;
+
+            BlkAllocPortion& portion = get_blk_portion(portion_num);
+            auto lock{portion.portion_auto_lock()};
+            auto cur_blk_id = portion_num * get_blks_per_portion();
+            auto const end_blk_id = std::min(cur_blk_id + get_blks_per_portion(), get_total_blks()) - 1;
+            while ((cur_blk_id <= end_blk_id) && (entries.size() < max_entries)) {
+                auto const b = disk_bm->get_next_contiguous_n_reset_bits(cur_blk_id, end_blk_id, 1,
+                                                                         m_cfg.highest_slab_blks_count());
+                if (b.nbits == 0) { break; }
+                entries.push_back(free_cache_snapshot_entry{b.start_bit, s_cast< blk_count_t >(b.nbits)});
+                cur_blk_id = b.start_bit + b.nbits;
+            }
+        }
+    }
+
+    auto const size = sizeof(free_cache_snapshot_hdr) + (m_segments.size() * sizeof(blk_num_t)) +
+        (entries.size() * sizeof(free_cache_snapshot_entry));
+    sisl::io_blob_safe buf{uint32_cast(sisl::round_up(size, meta_service().align_size())),
+                           meta_service().align_size()};
+    auto* hdr = new (buf.bytes()) free_cache_snapshot_hdr{};
+    hdr->nsegments = uint32_cast(m_segments.size());
+    hdr->nentries = uint32_cast(entries.size());
+    auto* hands = r_cast< blk_num_t* >(buf.bytes() + sizeof(free_cache_snapshot_hdr));
+    for (size_t s{0}; s < m_segments.size(); ++s) {
+        hands[s] = m_segments[s]->get_clock_hand();
+    }
+    std::memcpy(r_cast< uint8_t* >(hands + m_segments.size()), entries.data(),
+                entries.size() * sizeof(free_cache_snapshot_entry));
+
+    if (m_snapshot_cookie) {
+        meta_service().update_sub_sb(buf.cbytes(), size, m_snapshot_cookie);
+    } else {
+        meta_service().add_sub_sb(snapshot_meta_name(), buf.cbytes(), size, m_snapshot_cookie);
+    }
+    BLKALLOC_LOG(DEBUG, "Persisted free cache snapshot with {} entries after scanning {} portions", entries.size(),
+                 nportions_scanned);
+}
+
+void VarsizeBlkAllocator::on_free_cache_snapshot_found(void* mblk_cookie, sisl::byte_view const& buf) {
+    m_snapshot_cookie = mblk_cookie;
+    if (buf.size() < sizeof(free_cache_snapshot_hdr)) { return; }
+
+    auto const* hdr = r_cast< free_cache_snapshot_hdr const* >(buf.bytes());
+    auto const expected_size = sizeof(free_cache_snapshot_hdr) + (hdr->nsegments * sizeof(blk_num_t)) +
+        (uint64_cast(hdr->nentries) * sizeof(free_cache_snapshot_entry));
+    if ((hdr->version != free_cache_snapshot_hdr::VERSION) || (hdr->nsegments != m_segments.size()) ||
+        (buf.size() < expected_size)) {
+        // Snapshot is only an optimization, it is fine to ignore it and do a regular sweep
+        BLKALLOC_LOG(WARN, "Ignoring free cache snapshot version={} nsegments={} nentries={} size={}", hdr->version,
+                     hdr->nsegments, hdr->nentries, buf.size());
+        return;
+    }
+
+    auto const* hands = r_cast< blk_num_t const* >(buf.bytes() + sizeof(free_cache_snapshot_hdr));
+    auto const* entries = r_cast< free_cache_snapshot_entry const* >(hands + hdr->nsegments);
+
+    std::unique_lock lg{m_snapshot_mtx};
+    m_snapshot_clock_hands.assign(hands, hands + hdr->nsegments);
+    m_snapshot_entries.assign(entries, entries + hdr->nentries);
+    BLKALLOC_LOG(INFO, "Loaded free cache snapshot with {} entries", hdr->nentries);
+}
+
+blk_num_t VarsizeBlkAllocator::fill_cache_from_snapshot(blk_cache_fill_session& fill_session) {
+    std::vector< free_cache_snapshot_entry > entries;
+    std::vector< blk_num_t > hands;
+    {
+        std::unique_lock lg{m_snapshot_mtx};
+        if (m_snapshot_entries.empty()) { return 0; }
+        entries.swap(m_snapshot_entries);
+        hands.swap(m_snapshot_clock_hands);
+    }
+
+    // Resume sweeping from where it was before restart, the portions behind the clock hands are covered by snapshot
+    for (size_t s{0}; s < hands.size(); ++s) {
+        m_segments[s]->set_clock_hand(hands[s]);
+    }
+
+    blk_cache_fill_req fill_req;
+    blk_num_t nblks_restored{0};
+    for (auto const& e : entries) {
+        if (fill_session.overall_refill_done) { break; }
+        blk_num_t const last_blk = e.blk_num + e.nblks - 1;
+        if ((e.nblks == 0) || (last_blk >= get_total_blks()) ||
+            (blknum_to_portion_num(e.blk_num) != blknum_to_portion_num(last_blk))) {
+            continue;
+        }
+
+        // Blks allocated after the snapshot was taken (persisted later or recovered from journal) are already set in
+        // the cache bitmap, so only the ranges which are still free are taken
+        BlkAllocPortion& portion = blknum_to_portion(e.blk_num);
+        auto lock{portion.portion_auto_lock()};
+        auto cur_blk_id = e.blk_num;
+        while (!fill_session.overall_refill_done && (cur_blk_id <= last_blk)) {
+            auto const b = m_cache_bm->get_next_contiguous_n_reset_bits(cur_blk_id, last_blk, 1,
+                                                                        last_blk - cur_blk_id + 1);
+            if (b.nbits == 0) { break; }
+
+            fill_req.start_blk_num = b.start_bit;
+            fill_req.nblks = b.nbits;
+            fill_req.preferred_level = portion.temperature();
+            auto const nblks_added = m_fb_cache->try_fill_cache(fill_req, fill_session);
+            if (nblks_added > 0) {
+                m_cache_bm->set_bits(b.start_bit, nblks_added);
+                portion.decr_free_blks(nblks_added);
+                nblks_restored += nblks_added;
+            }
+            cur_blk_id = b.start_bit + b.nbits;
+        }
+    }
+
+    if (fill_session.need_notify()) {
+        fill_session.set_urgent_satisfied();
+        m_cv.notify_all();
+    }
+    COUNTER_INCREMENT(m_metrics, num_snapshot_blks_restored, nblks_restored);
+    BLKALLOC_LOG(INFO, "Seeded blk cache with {} blks from {} free cache snapshot entries", nblks_restored,
+                 entries.size());
+    return nblks_restored;
 }
 
 BlkAllocStatus VarsizeBlkAllocator::alloc_contiguous(BlkId& out_blkid) {
@@ -414,6 +731,14 @@ BlkAllocStatus VarsizeBlkAllocator::alloc(blk_count_t nblks, blk_alloc_hints con
     blk_count_t num_allocated{0};
     blk_count_t nblks_remain;
 
+    if (hints.neighbor_blkid_hint && (hints.neighbor_blkid_hint->chunk_num() == m_chunk_id)) {
+        num_allocated = alloc_blks_near(*hints.neighbor_blkid_hint, nblks, out_mbid);
+        if (num_allocated == nblks) {
+            status = BlkAllocStatus::SUCCESS;
+            goto out;
+        }
+    }
+
     if (use_slabs && (nblks <= m_cfg.highest_slab_blks_count())) {
         num_allocated = alloc_blks_slab(nblks, hints, out_mbid);
         if (num_allocated >= nblks) {
@@ -438,6 +763,7 @@ BlkAllocStatus VarsizeBlkAllocator::alloc(blk_count_t nblks, blk_alloc_hints con
 out:
     if ((status == BlkAllocStatus::SUCCESS) || (status == BlkAllocStatus::PARTIAL)) {
         incr_alloced_blk_count(num_allocated);
+        HISTOGRAM_OBSERVE(m_metrics, alloc_pieces_distribution, out_mbid.num_pieces());
 
 #ifdef _PRERELEASE
         alloc_sanity_check(num_allocated, hints, out_mbid);
@@ -490,9 +816,22 @@ blk_count_t VarsizeBlkAllocator::alloc_blks_slab(blk_count_t nblks, blk_alloc_hi
                                                  MultiBlkId& out_blkid) {
     blk_count_t num_allocated{0};
 
+    // Common case of small allocation of exactly a slab size is served from thread's own magazine
+    if (auto const slab_idx = FreeBlkCache::find_slab(nblks);
+        (m_magazine_size > 0) && (slab_idx < max_magazine_slabs) && (slab_idx < m_cfg.get_slab_cnt()) &&
+        ((blk_count_t{1} << slab_idx) == nblks)) {
+        blk_cache_entry e;
+        if (alloc_from_magazine(slab_idx, hint_to_level(hints), e)) {
+            COUNTER_INCREMENT(m_metrics, num_alloc, 1);
+            COUNTER_INCREMENT(m_metrics, num_magazine_alloc, 1);
+            out_blkid.add(e.get_blk_num(), e.blk_count(), m_chunk_id);
+            return e.blk_count();
+        }
+    }
+
     // Allocate from blk cache
     static thread_local blk_cache_alloc_resp s_alloc_resp;
-    const blk_cache_alloc_req alloc_req{nblks, hints.desired_temp, hints.is_contiguous,
+    const blk_cache_alloc_req alloc_req{nblks, hint_to_level(hints), hints.is_contiguous,
                                         FreeBlkCache::find_slab(hints.min_blks_per_piece),
                                         s_cast< slab_idx_t >(m_cfg.get_slab_cnt() - 1)};
     COUNTER_INCREMENT(m_metrics, num_alloc, 1);
@@ -592,7 +931,10 @@ blk_count_t VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, blk_alloc_
         BlkAllocPortion& portion = get_blk_portion(portion_num);
         auto cur_blk_id = portion_num * get_blks_per_portion();
         auto const end_blk_id = cur_blk_id + get_blks_per_portion() - 1;
-        {
+        if (portion.free_blks() < std::min(min_blks, nblks_remain)) {
+            // Not enough free blks in the portion to satisfy even the min piece, no point in scanning its bitmap
+            COUNTER_INCREMENT(m_metrics, num_portions_skipped, 1);
+        } else {
             auto lock{portion.portion_auto_lock()};
             while (nblks_remain && (cur_blk_id <= end_blk_id) && out_blkid.has_room()) {
                 // Get next reset bits and insert to cache and then reset those bits
@@ -613,6 +955,7 @@ blk_count_t VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, blk_alloc_
 
                 // Set the bitmap indicating the blocks are allocated
                 m_cache_bm->set_bits(b.start_bit, b.nbits);
+                portion.decr_free_blks(b.nbits);
                 cur_blk_id = b.start_bit + b.nbits;
             }
         }
@@ -632,6 +975,30 @@ blk_count_t VarsizeBlkAllocator::alloc_blks_direct(blk_count_t nblks, blk_alloc_
     return (nblks - nblks_remain);
 }
 
+blk_count_t VarsizeBlkAllocator::alloc_blks_near(BlkId const& neighbor, blk_count_t nblks, MultiBlkId& out_blkid) {
+    // Look only in the portion where the neighbor ends, so that a miss costs no more than one portion scan. It is
+    // taken only if all nblks are contiguous there, otherwise the regular path would do better than a split here.
+    blk_num_t const start = neighbor.blk_num() + neighbor.blk_count();
+    if (start >= get_total_blks()) { return 0; }
+
+    BlkAllocPortion& portion = blknum_to_portion(start);
+    if (portion.free_blks() >= nblks) {
+        blk_num_t const end_blk_id = std::min(
+            (blknum_to_portion_num(start) + 1) * get_blks_per_portion(), get_total_blks()) - 1;
+        auto lock{portion.portion_auto_lock()};
+        auto const b = m_cache_bm->get_next_contiguous_n_reset_bits(start, end_blk_id, nblks, nblks);
+        if (b.nbits == nblks) {
+            m_cache_bm->set_bits(b.start_bit, b.nbits);
+            portion.decr_free_blks(b.nbits);
+            out_blkid.add(b.start_bit, b.nbits, m_chunk_id);
+            COUNTER_INCREMENT(m_metrics, num_neighbor_hint_hits, 1);
+            return nblks;
+        }
+    }
+    COUNTER_INCREMENT(m_metrics, num_neighbor_hint_misses, 1);
+    return 0;
+}
+
 // since this function will only be called during HS recovery, we can safe to update the cache bitmap directly without
 // touching the slab caches.
 BlkAllocStatus VarsizeBlkAllocator::reserve_on_cache(BlkId const& bid) {
@@ -645,7 +1012,10 @@ BlkAllocStatus VarsizeBlkAllocator::reserve_on_cache(BlkId const& bid) {
         HS_DBG_ASSERT_GE(end_blk_id, (bid.blk_num() + bid.blk_count() - 1),
                          "Expected end bit to be smaller than portion end bit");
 #endif
+        // Recovery could reserve a blk which is already reserved, discount only the bits which are newly set
+        auto const nset_before = m_cache_bm->get_set_count(bid.blk_num(), bid.blk_num() + bid.blk_count() - 1);
         m_cache_bm->set_bits(bid.blk_num(), bid.blk_count());
+        portion.decr_free_blks(bid.blk_count() - nset_before);
         incr_alloced_blk_count(bid.blk_count());
     }
     BLKALLOC_LOG(TRACE, "mark blk alloced directly to portion={} blkid={} set_bits_count={}",
@@ -668,7 +1038,7 @@ blk_count_t VarsizeBlkAllocator::free_blks_slab(MultiBlkId const& bid) {
     excess_blks.clear();
 
     auto const do_free = [this](BlkId const& b) {
-        m_fb_cache->try_free_blks(blkid_to_blk_cache_entry(b, 2), excess_blks);
+        if (!free_to_magazine(b)) { m_fb_cache->try_free_blks(blkid_to_blk_cache_entry(b), excess_blks); }
         return b.blk_count();
     };
 
@@ -690,6 +1060,89 @@ blk_count_t VarsizeBlkAllocator::free_blks_slab(MultiBlkId const& bid) {
     return n_freed;
 }
 
+VarsizeBlkAllocator::blk_magazine& VarsizeBlkAllocator::magazine() {
+    auto& mag = *m_magazines;
+    if (sisl_unlikely(mag.allocator == nullptr)) { mag.allocator = this; }
+    return mag;
+}
+
+VarsizeBlkAllocator::blk_magazine::~blk_magazine() {
+    if (allocator == nullptr) { return; }
+    for (auto& entries : slabs) {
+        allocator->spill_magazine(entries, entries.size());
+    }
+}
+
+bool VarsizeBlkAllocator::alloc_from_magazine(slab_idx_t slab_idx, blk_temp_t temp, blk_cache_entry& out_entry) {
+    auto& entries = magazine().slabs[slab_idx];
+    if (entries.empty()) {
+        // Refill the magazine in bulk with entries of only this slab
+        static thread_local blk_cache_alloc_resp s_refill_resp;
+        s_refill_resp.reset();
+
+        blk_count_t const slab_nblks = blk_count_t{1} << slab_idx;
+        const blk_cache_alloc_req req{s_cast< blk_count_t >(slab_nblks * m_magazine_size), temp,
+                                      false /* is_contiguous */, slab_idx, slab_idx};
+        auto const status = m_fb_cache->try_alloc_blks(req, s_refill_resp);
+        if (s_refill_resp.need_refill) { request_more_blks(nullptr, false /* fill_entire_cache */); }
+        COUNTER_INCREMENT(m_metrics, num_magazine_refills, 1);
+
+        std::vector< blk_cache_entry > leftover;
+        if ((status == BlkAllocStatus::SUCCESS) || (status == BlkAllocStatus::PARTIAL)) {
+            for (auto const& e : s_refill_resp.out_blks) {
+                blk_count_t off{0};
+                for (; (off + slab_nblks) <= e.blk_count(); off += slab_nblks) {
+                    entries.emplace_back(e.get_blk_num() + off, slab_nblks, e.get_temperature());
+                }
+                // Entries merged down from lower slabs could be smaller than the slab, return them back
+                if (off < e.blk_count()) {
+                    leftover.emplace_back(e.get_blk_num() + off, e.blk_count() - off, e.get_temperature());
+                }
+            }
+        } else {
+            leftover = s_refill_resp.out_blks;
+        }
+        leftover.insert(leftover.end(), s_refill_resp.excess_blks.begin(), s_refill_resp.excess_blks.end());
+        spill_magazine(leftover, leftover.size());
+
+        if (entries.empty()) { return false; }
+    }
+
+    out_entry = entries.back();
+    entries.pop_back();
+    return true;
+}
+
+bool VarsizeBlkAllocator::free_to_magazine(BlkId const& b) {
+    if (m_magazine_size == 0) { return false; }
+    auto const [slab_idx, excess] = FreeBlkCache::find_round_down_slab(b.blk_count());
+    if ((excess != 0) || (slab_idx >= max_magazine_slabs) || (slab_idx >= m_cfg.get_slab_cnt())) { return false; }
+
+    auto& entries = magazine().slabs[slab_idx];
+    entries.push_back(blkid_to_blk_cache_entry(b));
+    if (entries.size() > 2 * m_magazine_size) {
+        COUNTER_INCREMENT(m_metrics, num_magazine_spills, 1);
+        spill_magazine(entries, m_magazine_size);
+    }
+    return true;
+}
+
+void VarsizeBlkAllocator::spill_magazine(std::vector< blk_cache_entry >& entries, size_t count) {
+    if (count == 0) { return; }
+
+    // Not using a thread_local scratch here, since this is also called during thread exit
+    std::vector< blk_cache_entry > excess_blks;
+    auto const start = entries.size() - count;
+    for (size_t i{start}; i < entries.size(); ++i) {
+        m_fb_cache->try_free_blks(entries[i], excess_blks);
+    }
+    entries.resize(start);
+
+    for (auto const& e : excess_blks) {
+        free_blks_direct(MultiBlkId{blk_cache_entry_to_blkid(e)});
+    }
+}
+
 blk_count_t VarsizeBlkAllocator::free_blks_direct(MultiBlkId const& bid) {
     auto const do_free = [this](BlkId const& b) {
         BlkAllocPortion& portion = blknum_to_portion(b.blk_num());
@@ -702,6 +1155,7 @@ blk_count_t VarsizeBlkAllocator::free_blks_direct(MultiBlkId const& bid) {
                              "Expected end bit to be smaller than portion end bit");
             BLKALLOC_REL_ASSERT(m_cache_bm->is_bits_set(b.blk_num(), b.blk_count()), "Expected bits to be set");
             m_cache_bm->reset_bits(b.blk_num(), b.blk_count());
+            portion.incr_free_blks(b.blk_count());
         }
         BLKALLOC_LOG(TRACE, "Freeing directly to portion={} blkid={} set_bits_count={}",
                      blknum_to_portion_num(b.blk_num()), b.to_string(), get_alloced_blk_count());
@@ -720,6 +1174,54 @@ blk_count_t VarsizeBlkAllocator::free_blks_direct(MultiBlkId const& bid) {
     return n_freed;
 }
 
+void VarsizeBlkAllocator::free_batch(std::span< BlkId const > bids) {
+    // Blks which fit in slabs go back to the cache in a single call, the rest (along with the excess which cache
+    // could not take) are reset in the cache bitmap taking each portion lock once
+    std::vector< blk_cache_entry > cache_entries;
+    std::vector< blk_cache_entry > excess_blks;
+    std::vector< BlkId > direct_bids;
+    blk_num_t n_freed{0};
+    for (auto const& b : bids) {
+        HS_DBG_ASSERT(!b.is_multi(), "free_batch expects individual pieces, not MultiBlkId");
+        n_freed += b.blk_count();
+        if (m_cfg.m_use_slabs && (b.blk_count() <= m_cfg.highest_slab_blks_count())) {
+            if (!free_to_magazine(b)) { cache_entries.push_back(blkid_to_blk_cache_entry(b)); }
+        } else {
+            direct_bids.push_back(b);
+        }
+    }
+
+    if (!cache_entries.empty()) { m_fb_cache->try_free_blks(cache_entries, excess_blks); }
+    for (auto const& e : excess_blks) {
+        direct_bids.push_back(blk_cache_entry_to_blkid(e));
+    }
+    if (!direct_bids.empty()) { free_blks_direct(direct_bids); }
+
+    if (is_persistent()) { free_on_disk(bids); }
+    decr_alloced_blk_count(n_freed);
+    BLKALLOC_LOG(TRACE, "Freed batch of {} blkids nblks={}", bids.size(), n_freed);
+}
+
+blk_num_t VarsizeBlkAllocator::free_blks_direct(std::vector< BlkId >& bids) {
+    std::sort(bids.begin(), bids.end(), [](BlkId const& a, BlkId const& b) { return a.blk_num() < b.blk_num(); });
+
+    blk_num_t n_freed{0};
+    size_t i{0};
+    while (i < bids.size()) {
+        auto const portion_num = blknum_to_portion_num(bids[i].blk_num());
+        BlkAllocPortion& portion = get_blk_portion(portion_num);
+        auto lock{portion.portion_auto_lock()};
+        for (; (i < bids.size()) && (blknum_to_portion_num(bids[i].blk_num()) == portion_num); ++i) {
+            auto const& b = bids[i];
+            BLKALLOC_REL_ASSERT(m_cache_bm->is_bits_set(b.blk_num(), b.blk_count()), "Expected bits to be set");
+            m_cache_bm->reset_bits(b.blk_num(), b.blk_count());
+            portion.incr_free_blks(b.blk_count());
+            n_freed += b.blk_count();
+        }
+    }
+    return n_freed;
+}
+
 bool VarsizeBlkAllocator::is_blk_alloced(BlkId const& bid, bool use_lock) const {
     auto check_bits_set = [this](BlkId const& b, bool use_lock) {
         if (use_lock) {
@@ -833,7 +1335,7 @@ void VarsizeBlkAllocator::request_more_blks_wait(BlkAllocSegment* seg, blk_count
 bool VarsizeBlkAllocator::prepare_sweep(BlkAllocSegment* seg, bool fill_entire_cache) {
     m_sweep_segment = seg;
     m_cur_fill_session = m_fb_cache->create_cache_fill_session(fill_entire_cache);
-    if (!(m_cur_fill_session->slab_requirements.empty())) {
+    if (m_cur_fill_session->any_refill_needed()) {
         m_state = BlkAllocatorState::SWEEP_SCHEDULED;
         return true;
     } else {
@@ -863,10 +1365,27 @@ BlkId VarsizeBlkAllocator::blk_cache_entry_to_blkid(blk_cache_entry const& e) {
     return BlkId{e.get_blk_num(), e.blk_count(), m_chunk_id};
 }
 
+blk_cache_entry VarsizeBlkAllocator::blkid_to_blk_cache_entry(BlkId const& bid) {
+    // Freed blks go back to the level of the portion they belong to, so that each temperature keeps reusing its own
+    return blkid_to_blk_cache_entry(bid, blknum_to_portion_const(bid.blk_num()).temperature());
+}
+
 blk_cache_entry VarsizeBlkAllocator::blkid_to_blk_cache_entry(BlkId const& bid, blk_temp_t preferred_level) {
     return blk_cache_entry{bid.blk_num(), bid.blk_count(), preferred_level};
 }
 
+blk_temp_t VarsizeBlkAllocator::portion_temperature(blk_num_t portion_num) const {
+    if (m_num_temps <= 1) { return BlkAllocPortion::default_temperature(); }
+    blk_num_t const blks_per_group = std::max(m_cfg.get_blks_per_temp_group(), blk_num_t{1});
+    blk_num_t const group = (portion_num * get_blks_per_portion()) / blks_per_group;
+    return s_cast< blk_temp_t >(1 + std::min< blk_num_t >(group, m_num_temps - 1));
+}
+
+blk_temp_t VarsizeBlkAllocator::hint_to_level(blk_alloc_hints const& hints) const {
+    if (hints.desired_temp == 0) { return BlkAllocPortion::default_temperature(); }
+    return std::min< blk_temp_t >(hints.desired_temp, m_num_temps);
+}
+
 std::string VarsizeBlkAllocator::to_string() const {
     return fmt::format("BlkAllocator={} state={} total_blks={} cached_blks={} alloced_blks={}", get_name(), m_state,
                        get_total_blks(), m_fb_cache->total_free_blks(), get_alloced_blk_count());
@@ -16,6 +16,7 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cmath>
 #include <condition_variable>
@@ -23,11 +24,14 @@
 #include <memory>
 #include <mutex>
 #include <queue>
+#include <span>
 #include <string>
 #include <thread>
 #include <unordered_map>
 #include <vector>
 
+#include <folly/ThreadLocal.h>
+#include <sisl/fds/buffer.hpp>
 #include <sisl/flip/flip.hpp>
 #include <sisl/metrics/metrics.hpp>
 #include <sisl/logging/logging.h>
@@ -178,9 +182,18 @@ public:
         REGISTER_COUNTER(num_alloc_partial, "Number of blk alloc partial allocations");
         REGISTER_COUNTER(num_retries, "Number of times it retried because of empty cache");
         REGISTER_COUNTER(num_blks_alloc_direct, "Number of blks alloc attempt directly because of empty cache");
+        REGISTER_COUNTER(num_magazine_alloc, "Number of blk allocs served from the per thread magazine");
+        REGISTER_COUNTER(num_magazine_refills, "Number of bulk refills of per thread magazine from blk cache");
+        REGISTER_COUNTER(num_magazine_spills, "Number of bulk spills of per thread magazine to blk cache");
+        REGISTER_COUNTER(num_portions_skipped, "Number of portions skipped without bitmap scan for lack of free blks");
+        REGISTER_COUNTER(num_neighbor_hint_hits, "Number of allocs placed next to the neighbor blkid hint");
+        REGISTER_COUNTER(num_neighbor_hint_misses, "Number of allocs which couldn't be placed near the hinted blkid");
+        REGISTER_COUNTER(num_snapshot_blks_restored, "Number of blks seeded into blk cache from free cache snapshot");
 
         REGISTER_HISTOGRAM(frag_pct_distribution, "Distribution of fragmentation percentage",
                            HistogramBucketsType(LinearUpto64Buckets));
+        REGISTER_HISTOGRAM(alloc_pieces_distribution, "Number of pieces an allocated blkid is split into",
+                           HistogramBucketsType(LinearUpto64Buckets));
 
         register_me_to_farm();
     }
@@ -198,6 +211,11 @@ public:
  * 2. Provides the option of allocating blocks based on requested temperature.
  * 3. Caching of available blocks instead of scanning during allocation.
  *
+ * With more than one num_blk_temperatures, the chunk is divided into as many contiguous groups of portions, one per
+ * temperature. Sweeper fills the blks of a portion into the slab level of its temperature and freed blks go back to
+ * the level of the portion they belong to, so allocations with a desired_temp hint are served from the portions of
+ * that temperature, as long as its level has blks. Frequently overwritten (hot) data thus stays clustered and its
+ * frees become contiguous, instead of punching holes all over the chunk.
  */
 class VarsizeBlkAllocator : public BitmapBlkAllocator {
 public:
@@ -216,12 +234,18 @@ public:
     BlkAllocStatus alloc(blk_count_t nblks, blk_alloc_hints const& hints, std::vector< BlkId >& out_blkids);
     BlkAllocStatus reserve_on_cache(BlkId const& b) override;
     void free(BlkId const& blk_id) override;
+    void free_batch(std::span< BlkId const > bids) override;
+    void cp_flush(CP* cp) override;
 
     blk_num_t available_blks() const override;
     blk_num_t get_defrag_nblks() const override;
+    bool is_defrag_tracked() const override { return false; }
     blk_num_t get_used_blks() const override;
     bool is_blk_alloced(BlkId const& in_bid, bool use_lock = false) const override;
     std::string to_string() const override;
+
+    /// @brief Sweeper threads of the pool shared by all the allocators
+    static size_t num_sweeper_threads();
     nlohmann::json get_metrics_in_json();
 
 private:
@@ -229,6 +253,7 @@ private:
     static std::mutex s_sweeper_create_delete_mutex;                      // sweeper threads create/destroy mutex
     static std::atomic< size_t > s_sweeper_thread_references;             // num active sweeper threads
     static std::vector< std::thread > s_sweeper_threads;                  // Sweeper threads
+    static std::atomic< size_t > s_num_sweeper_threads;                   // Threads the pool is being sized to
     static std::atomic< bool > s_sweeper_threads_stop;                    // atomic flag to stop sweeper threads
     static std::mutex s_sweeper_mutex;                                    // Sweeper threads mutex
     static std::condition_variable s_sweeper_cv;                          // sweeper threads cv
@@ -250,6 +275,7 @@ private:
     std::vector< std::unique_ptr< BlkAllocSegment > > m_segments; // Lookup map for segment id - segment
 
     BlkAllocSegment* m_sweep_segment{nullptr};                    // Segment to sweep - if woken up
+    seg_num_t m_next_sweep_seg{0};                                // Segment to start next full sweep from
     std::shared_ptr< blk_cache_fill_session > m_cur_fill_session; // Cache fill requirements while sweeping
 
     std::uniform_int_distribution< blk_num_t > m_rand_portion_num_generator;
@@ -261,15 +287,65 @@ private:
     blk_num_t m_blks_per_seg{1};
     blk_num_t m_portions_per_seg{1};
 
+    // Per thread magazine of blk cache entries for the smallest slabs. Entries in magazine are still marked in the
+    // cache bitmap, same as entries in the slab queues. On thread exit (or allocator destruction) they are spilled
+    // back to the shared cache. Until then other threads can't alloc them: a magazine spills on a free once a slab has
+    // more than 2 * m_magazine_size entries, so each thread strands at most 2 * m_magazine_size * (1 + 2 + 4 + 8) blks.
+    static constexpr slab_idx_t max_magazine_slabs{4};
+    struct blk_magazine {
+        VarsizeBlkAllocator* allocator{nullptr};
+        std::array< std::vector< blk_cache_entry >, max_magazine_slabs > slabs;
+        ~blk_magazine();
+    };
+    uint32_t m_magazine_size{0};
+    blk_temp_t m_num_temps{1}; // Number of blk temperatures, the portions are divided into
+
+    // Free cache snapshot: free extents of the portions swept last (just behind each segment's clock hand) along with
+    // the clock hands, persisted every few cps. On restart, first sweep seeds the blk cache from it and then resumes
+    // from the persisted clock hands, instead of rescanning the chunk from the start.
+#pragma pack(1)
+    struct free_cache_snapshot_hdr {
+        static constexpr uint32_t VERSION{1};
+        uint32_t version{VERSION};
+        uint32_t nsegments{0}; // Followed by clock hand of each segment
+        uint32_t nentries{0};  // and then these many free_cache_snapshot_entry
+    };
+    struct free_cache_snapshot_entry {
+        blk_num_t blk_num;
+        blk_count_t nblks;
+    };
+#pragma pack()
+    std::mutex m_snapshot_mtx; // Protects the loaded snapshot below, which is consumed by first sweep
+    std::vector< blk_num_t > m_snapshot_clock_hands;
+    std::vector< free_cache_snapshot_entry > m_snapshot_entries;
+    void* m_snapshot_cookie{nullptr};
+    uint32_t m_cps_since_snapshot{0};
+
+    folly::ThreadLocal< blk_magazine > m_magazines; // Declared last, so that it is destroyed before cache
+
 private:
     static void sweeper_thread(size_t thread_num);
+    static void resize_sweeper_threads();
     bool allocator_state_machine();
     void do_start();
+    void init_portion_free_blks();
+
+    std::string snapshot_meta_name() const { return get_name() + "_fcache"; }
+    void on_free_cache_snapshot_found(void* mblk_cookie, sisl::byte_view const& buf);
+    void write_free_cache_snapshot();
+    blk_num_t fill_cache_from_snapshot(blk_cache_fill_session& fill_session);
 
     blk_count_t alloc_blks_slab(blk_count_t nblks, blk_alloc_hints const& hints, MultiBlkId& out_blkid);
     blk_count_t alloc_blks_direct(blk_count_t nblks, blk_alloc_hints const& hints, MultiBlkId& out_blkids);
+    blk_count_t alloc_blks_near(BlkId const& neighbor, blk_count_t nblks, MultiBlkId& out_blkid);
     blk_count_t free_blks_slab(MultiBlkId const& b);
     blk_count_t free_blks_direct(MultiBlkId const& b);
+    blk_num_t free_blks_direct(std::vector< BlkId >& bids);
+
+    blk_magazine& magazine();
+    bool alloc_from_magazine(slab_idx_t slab_idx, blk_temp_t temp, blk_cache_entry& out_entry);
+    bool free_to_magazine(BlkId const& b);
+    void spill_magazine(std::vector< blk_cache_entry >& entries, size_t count);
 
 #ifdef _PRERELEASE
     void alloc_sanity_check(blk_count_t nblks, blk_alloc_hints const& hints, MultiBlkId const& out_blkids) const;
@@ -281,7 +357,8 @@ private:
     void request_more_blks_wait(BlkAllocSegment* seg, blk_count_t wait_for_blks_count);
 
     void fill_cache(BlkAllocSegment* seg, blk_cache_fill_session& fill_session);
-    void fill_cache_in_portion(blk_num_t portion_num, blk_cache_fill_session& fill_session);
+    bool fill_cache_in_portion(blk_num_t portion_num, blk_cache_fill_session& fill_session,
+                               std::mutex* session_mtx = nullptr);
 
     void free_on_bitmap(BlkId const& b);
 
@@ -304,6 +381,15 @@ private:
     ///////////////////// Cache Entry related routines ////////////////////////
     // void blk_cache_entries_to_blkids(const std::vector< blk_cache_entry >& entries, MultiBlkId& out_blkids);
     BlkId blk_cache_entry_to_blkid(blk_cache_entry const& e);
-    blk_cache_entry blkid_to_blk_cache_entry(BlkId const& bid, blk_temp_t preferred_level = 1);
+    blk_cache_entry blkid_to_blk_cache_entry(BlkId const& bid);
+    blk_cache_entry blkid_to_blk_cache_entry(BlkId const& bid, blk_temp_t preferred_level);
+
+    ///////////////////// Temperature related routines ////////////////////////
+    /// @brief Temperature of the portion, based on which temperature group of the chunk it falls in
+    blk_temp_t portion_temperature(blk_num_t portion_num) const;
+
+    /// @brief Slab level to allocate from for the hint. Level 0 is the reuse level and 1..num_temps are the
+    /// temperatures; desired_temp of 0 (no preference) maps to the default temperature.
+    blk_temp_t hint_to_level(blk_alloc_hints const& hints) const;
 };
 } // namespace homestore
@@ -0,0 +1,338 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+
+#include <sisl/utility/thread_factory.hpp>
+#include <homestore/homestore.hpp>
+
+#include "device/chunk.h"
+#include "device/physical_dev.hpp"
+#include "device/virtual_dev.hpp"
+#include "device/vdev_io_batch.hpp"
+#include "blkalloc/append_blk_allocator.h"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/resource_mgr.hpp"
+#include "common/thread_affinity.hpp"
+#include "blk_compress.hpp"
+#include "append_chunk_gc.hpp"
+
+namespace homestore {
+
+AppendChunkGC::AppendChunkGC(shared< VirtualDev > vdev, BlkDataService::gc_live_blks_cb_t live_blks_cb,
+                             BlkDataService::gc_relocate_cb_t relocate_cb, drain_reads_cb_t drain_reads_cb,
+                             BlkCsumTable* csum_table) :
+        m_vdev{std::move(vdev)},
+        m_live_blks_cb{std::move(live_blks_cb)},
+        m_relocate_cb{std::move(relocate_cb)},
+        m_drain_reads_cb{std::move(drain_reads_cb)},
+        m_csum_table{csum_table},
+        m_metrics{m_vdev->get_name().c_str()} {}
+
+AppendChunkGC::~AppendChunkGC() { stop(); }
+
+void AppendChunkGC::start() {
+    m_thread = sisl::named_thread("hs_append_gc", [this]() {
+        pin_thread(hs_thread_role_t::data_bg);
+        gc_thread();
+    });
+    LOGINFO("Started append chunk gc on vdev={}", m_vdev->get_name());
+}
+
+void AppendChunkGC::stop() {
+    {
+        std::unique_lock lg{m_mtx};
+        if (m_stopping) { return; }
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_thread.joinable()) { m_thread.join(); }
+}
+
+void AppendChunkGC::gc_thread() {
+    io_priority_guard prio_g{io_priority_t::background}; // Relocation copies yield the device to consumer ios
+    std::unique_lock lg{m_mtx};
+    while (!m_stopping) {
+        m_cv.wait_for(lg, std::chrono::milliseconds(HS_DYNAMIC_CONFIG(generic.data_gc_interval_ms)),
+                      [this]() { return m_stopping; });
+        if (m_stopping) { break; }
+
+        // Keep reclaiming as long as there are eligible chunks, instead of one per interval
+        lg.unlock();
+        while (run_once()) {
+            std::unique_lock stop_lg{m_mtx};
+            if (m_stopping) { break; }
+        }
+        lg.lock();
+    }
+}
+
+bool AppendChunkGC::run_once() {
+    auto victim = pick_victim();
+    if (victim == nullptr) { return false; }
+    return compact(victim);
+}
+
+shared< Chunk > AppendChunkGC::pick_victim() const {
+    shared< Chunk > victim;
+    uint64_t best_pct{0};
+    for (auto const& [id, chunk] : m_vdev->get_chunks()) {
+        auto const* ba = chunk->blk_allocator();
+        auto const total = ba->get_total_blks();
+        if (total == 0) { continue; }
+        auto const pct = (uint64_cast(ba->get_defrag_nblks()) * 100) / total;
+        if ((pct >= HS_DYNAMIC_CONFIG(generic.data_gc_min_freeable_pct)) && (pct > best_pct)) {
+            best_pct = pct;
+            victim = chunk;
+        }
+    }
+    return victim;
+}
+
+shared< Chunk > AppendChunkGC::pick_destination(Chunk const& victim, blk_num_t live_nblks) const {
+    // Prefer an empty chunk, so that the copy is one sequential stream. Among the candidates prefer the victim's pdev,
+    // so that copy doesn't load other devices.
+    shared< Chunk > dest;
+    auto score = [&victim](Chunk const& c) {
+        auto const* ba = c.blk_allocator();
+        bool const empty = (ba->get_used_blks() == 0);
+        bool const same_pdev = (c.physical_dev() == victim.physical_dev());
+        return std::make_tuple(empty, same_pdev, ba->available_blks());
+    };
+
+    for (auto const& [id, chunk] : m_vdev->get_chunks()) {
+        if ((chunk->chunk_id() == victim.chunk_id()) || (chunk->blk_allocator()->available_blks() < live_nblks)) {
+            continue;
+        }
+        if ((dest == nullptr) || (score(*chunk) > score(*dest))) { dest = chunk; }
+    }
+    return dest;
+}
+
+bool AppendChunkGC::compact(shared< Chunk > const& victim) {
+    auto* victim_ba = dynamic_cast< AppendBlkAllocator* >(victim->blk_allocator_mutable());
+    HS_REL_ASSERT(victim_ba != nullptr, "append chunk gc on chunk={} which is not with append blk allocator",
+                  victim->chunk_id());
+    auto const start_time = Clock::now();
+    auto const freeable_nblks = victim_ba->get_defrag_nblks();
+
+    // Consumer is expected to stop placing new writes on this chunk, before it returns the live blks
+    auto ctx = std::make_shared< copy_ctx >();
+    ctx->live_blks = m_live_blks_cb(victim->chunk_id());
+    auto& live_blks = ctx->live_blks;
+    std::sort(live_blks.begin(), live_blks.end(), [](MultiBlkId const& a, MultiBlkId const& b) {
+        return a.to_single_blkid().blk_num() < b.to_single_blkid().blk_num();
+    });
+
+    blk_num_t live_nblks{0};
+    for (auto const& b : live_blks) {
+        live_nblks += b.blk_count();
+    }
+
+    ctx->relocations.reserve(live_blks.size());
+    bool success{true};
+
+    if (live_nblks > 0) {
+        auto const dest = pick_destination(*victim, live_nblks);
+        if (dest == nullptr) {
+            LOGWARN("Append chunk gc skipping chunk={} live_nblks={}, no chunk has enough space to copy into",
+                    victim->chunk_id(), live_nblks);
+            COUNTER_INCREMENT(m_metrics, gc_chunks_aborted, 1);
+            return false;
+        }
+
+        ctx->dest_chunk = dest->chunk_id();
+        ctx->max_batch_nblks = s_cast< blk_count_t >(std::clamp(
+            (HS_DYNAMIC_CONFIG(generic.data_gc_max_io_size_kb) * 1024) / m_vdev->block_size(), 1u,
+            uint32_cast(max_blks_per_blkid())));
+        success = wait_for(copy_from(ctx, 0));
+    }
+
+    // Consumer switches its index to the new blkids. Only after that, the victim's blks can be overwritten.
+    if (success && !m_relocate_cb(victim->chunk_id(), ctx->relocations)) {
+        LOGWARN("Append chunk gc of chunk={} rejected by consumer, discarding the copy", victim->chunk_id());
+        success = false;
+    }
+    if (!success) {
+        undo_copy(ctx->relocations);
+        COUNTER_INCREMENT(m_metrics, gc_chunks_aborted, 1);
+        return false;
+    }
+
+    // Readers which looked up the old blkids before the switch could still be reading the victim
+    wait_for(m_drain_reads_cb(live_blks).thenValue([](std::error_code) { return true; }));
+
+    if (m_csum_table) { m_csum_table->clear_chunk(victim->chunk_id()); }
+    victim_ba->reset();
+    COUNTER_INCREMENT(m_metrics, gc_chunks_reclaimed, 1);
+    COUNTER_INCREMENT(m_metrics, gc_blks_copied, live_nblks);
+    COUNTER_INCREMENT(m_metrics, gc_blks_reclaimed, freeable_nblks);
+    HISTOGRAM_OBSERVE(m_metrics, gc_chunk_latency, get_elapsed_time_ms(start_time));
+    LOGINFO("Append chunk gc reclaimed chunk={} freeable_nblks={} copied live_nblks={} in {} blkids",
+            victim->chunk_id(), freeable_nblks, live_nblks, live_blks.size());
+    return true;
+}
+
+folly::Future< bool > AppendChunkGC::copy_from(shared< copy_ctx > ctx, size_t begin) {
+    auto const& live_blks = ctx->live_blks;
+    if (begin == live_blks.size()) { return folly::makeFuture(true); }
+
+    size_t end{begin};
+    blk_count_t nblks{0};
+    while ((end < live_blks.size()) &&
+           ((end == begin) || ((uint32_cast(nblks) + live_blks[end].blk_count()) <= ctx->max_batch_nblks))) {
+        nblks += live_blks[end].blk_count();
+        ++end;
+    }
+
+    return when_can_issue().thenValue([this, ctx, begin, end, nblks](bool can_issue) {
+        if (!can_issue) { return folly::makeFuture(false); }
+        return copy_batch(ctx, begin, end, nblks).thenValue([this, ctx, end](bool copied) {
+            if (!copied) { return folly::makeFuture(false); }
+            return copy_from(ctx, end);
+        });
+    });
+}
+
+folly::Future< bool > AppendChunkGC::copy_batch(shared< copy_ctx > ctx, size_t begin, size_t end, blk_count_t nblks) {
+    uint32_t const blk_size = m_vdev->block_size();
+    uint32_t const size = uint32_cast(nblks) * blk_size;
+
+    blk_alloc_hints hints;
+    hints.chunk_id_hint = ctx->dest_chunk;
+    hints.is_contiguous = true;
+    MultiBlkId dest_bid;
+    if (m_vdev->alloc_blks(nblks, hints, dest_bid) != BlkAllocStatus::SUCCESS) {
+        LOGWARN("Append chunk gc unable to alloc nblks={} on dest chunk={}", nblks, ctx->dest_chunk);
+        return folly::makeFuture(false);
+    }
+
+    // Live blks are sorted by offset, so adjacent ones get coalesced into a single read
+    auto* buf = hs_utils::iobuf_alloc(size, sisl::buftag::data, m_vdev->align_size());
+    std::vector< folly::Future< std::error_code > > futs;
+    {
+        VDevIOBatch io_batch{*m_vdev};
+        uint8_t* ptr = buf;
+        for (auto i = begin; i < end; ++i) {
+            auto it = ctx->live_blks[i].iterate();
+            while (auto const b = it.next()) {
+                uint32_t const sz = b->blk_count() * blk_size;
+                futs.emplace_back(io_batch.add_read(r_cast< char* >(ptr), sz, *b));
+                ptr += sz;
+            }
+        }
+        io_batch.submit();
+    }
+
+    // Live blkids which are compressed blks, whose header is rebound to the blks they are copied to
+    auto rebound = std::make_shared< std::vector< bool > >(end - begin, false);
+    return folly::collectAllUnsafe(futs)
+        .thenValue([this, ctx, buf, size, begin, end, dest_bid, rebound](auto&& results) {
+            for (auto const& t : results) {
+                if (t.hasException() || t.value()) {
+                    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::io_error));
+                }
+            }
+
+            if (hs()->device_mgr()->get_chunk(ctx->live_blks[begin].chunk_num())->has_compressed_blks()) {
+                uint8_t* ptr = buf;
+                blk_num_t next = dest_bid.to_single_blkid().blk_num();
+                for (auto i = begin; i < end; ++i) {
+                    auto const& src = ctx->live_blks[i];
+                    uint32_t const sz = src.blk_count() * m_vdev->block_size();
+                    (*rebound)[i - begin] =
+                        rebind_compressed_blks(ptr, sz, src.piece(0), BlkId{next, 1, ctx->dest_chunk});
+                    ptr += sz;
+                    next += src.blk_count();
+                }
+                if (std::find(rebound->begin(), rebound->end(), true) != rebound->end()) {
+                    hs()->device_mgr()->get_chunk_mutable(ctx->dest_chunk)->set_has_compressed_blks();
+                }
+            }
+            VDevIOBatch io_batch{*m_vdev};
+            auto f = io_batch.add_write(r_cast< const char* >(buf), size, dest_bid);
+            io_batch.submit();
+            return f;
+        })
+        .thenValue([this, ctx, buf, begin, end, nblks, dest_bid, rebound](std::error_code ec) {
+            if (ec || (m_vdev->commit_blk(dest_bid.to_single_blkid()) != BlkAllocStatus::SUCCESS)) {
+                hs_utils::iobuf_free(buf, sisl::buftag::data);
+                LOGERROR("Append chunk gc failed to copy nblks={} to dest chunk={}", nblks, ctx->dest_chunk);
+                m_vdev->free_blk(dest_bid);
+                return false;
+            }
+
+            uint8_t const* ptr = buf;
+            blk_num_t next = dest_bid.to_single_blkid().blk_num();
+            for (auto i = begin; i < end; ++i) {
+                auto const& src = ctx->live_blks[i];
+                MultiBlkId const dst{next, src.blk_count(), ctx->dest_chunk};
+                if (m_csum_table) {
+                    // Rebound blks are not the same data as the source anymore
+                    if ((*rebound)[i - begin]) {
+                        m_csum_table->update(dst, ptr, m_vdev->block_size());
+                    } else {
+                        m_csum_table->copy(src, dst);
+                    }
+                }
+                ctx->relocations.emplace_back(src, dst);
+                ptr += src.blk_count() * m_vdev->block_size();
+                next += src.blk_count();
+            }
+            hs_utils::iobuf_free(buf, sisl::buftag::data);
+            return true;
+        });
+}
+
+void AppendChunkGC::undo_copy(relocations_t const& relocations) {
+    for (auto const& [old_bid, new_bid] : relocations) {
+        if (m_csum_table) { m_csum_table->clear(new_bid); }
+        m_vdev->free_blk(new_bid);
+    }
+}
+
+folly::Future< bool > AppendChunkGC::when_can_issue() {
+    {
+        std::unique_lock lg{m_mtx};
+        if (m_stopping) { return folly::makeFuture(false); }
+    }
+    if (resource_mgr().can_issue_background_io()) { return folly::makeFuture(true); }
+
+    // Checked again after a while, without holding up the reactor completing the previous batch
+    COUNTER_INCREMENT(m_metrics, gc_throttled, 1);
+    auto p = std::make_shared< folly::Promise< folly::Unit > >();
+    auto f = p->getFuture();
+    iomanager.schedule_global_timer(10 * 1000 * 1000 /* 10ms */, false /* recurring */, nullptr /* cookie */,
+                                    iomgr::reactor_regex::all_worker, [p](void*) { p->setValue(); });
+    return std::move(f).thenValue([this](folly::Unit) { return when_can_issue(); });
+}
+
+bool AppendChunkGC::wait_for(folly::Future< bool >&& f) {
+    std::optional< bool > result;
+    std::move(f).thenTry([this, &result](folly::Try< bool >&& t) {
+        std::unique_lock lg{m_mtx};
+        result = t.hasValue() && t.value();
+        m_cv.notify_all();
+    });
+
+    std::unique_lock lg{m_mtx};
+    m_cv.wait(lg, [&result]() { return result.has_value(); });
+    return *result;
+}
+} // namespace homestore
@@ -0,0 +1,123 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+#include <homestore/blkdata_service.hpp>
+
+namespace homestore {
+class VirtualDev;
+class Chunk;
+class AppendBlkAllocator;
+
+class AppendChunkGCMetrics : public sisl::MetricsGroup {
+public:
+    explicit AppendChunkGCMetrics(const char* inst_name) : sisl::MetricsGroup("AppendChunkGC", inst_name) {
+        REGISTER_COUNTER(gc_chunks_reclaimed, "Number of chunks reclaimed by gc");
+        REGISTER_COUNTER(gc_chunks_aborted, "Number of chunks gc had to give up on (no space/io error/rejected)");
+        REGISTER_COUNTER(gc_blks_copied, "Number of live blks copied by gc");
+        REGISTER_COUNTER(gc_blks_reclaimed, "Number of freeable blks reclaimed by gc");
+        REGISTER_COUNTER(gc_throttled, "Number of times gc paused copying because of foreground io pressure");
+        REGISTER_HISTOGRAM(gc_chunk_latency, "Time taken to compact a chunk (ms)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+
+        register_me_to_farm();
+    }
+
+    AppendChunkGCMetrics(const AppendChunkGCMetrics&) = delete;
+    AppendChunkGCMetrics(AppendChunkGCMetrics&&) noexcept = delete;
+    AppendChunkGCMetrics& operator=(const AppendChunkGCMetrics&) = delete;
+    AppendChunkGCMetrics& operator=(AppendChunkGCMetrics&&) noexcept = delete;
+    ~AppendChunkGCMetrics() { deregister_me_from_farm(); }
+};
+
+/*
+ * AppendChunkGC: Background compaction of the data chunks with append blk allocator. Frees in the middle of an append
+ * chunk are only accounted (freeable blks) and the space is never reused, until the whole chunk is reset.
+ *
+ * Periodically, it picks the chunk with the highest freeable ratio (above data_gc_min_freeable_pct), asks the
+ * consumer for the blkids still live in that chunk, copies them into another chunk with large sequential ios
+ * (live blks are sorted, adjacent ones are coalesced into a single read and written as one contiguous blkid), hands
+ * over the old -> new blkid mapping to the consumer and once consumer has switched over to them, resets the victim
+ * chunk.
+ *
+ * Copy is paused whenever foreground io is building up dirty buffers (see ResourceMgr::can_issue_background_io).
+ * Batches of the copy are chained on the completion of the ios of the previous one, the gc thread only waits for the
+ * whole copy. Before the victim is reset, reads which could still be on its blks (issued by readers which looked up
+ * the old blkids before the consumer switched over) are drained.
+ */
+class AppendChunkGC {
+public:
+    using drain_reads_cb_t = std::function< folly::Future< std::error_code >(std::vector< MultiBlkId > const&) >;
+
+    AppendChunkGC(shared< VirtualDev > vdev, BlkDataService::gc_live_blks_cb_t live_blks_cb,
+                  BlkDataService::gc_relocate_cb_t relocate_cb, drain_reads_cb_t drain_reads_cb,
+                  BlkCsumTable* csum_table = nullptr);
+    AppendChunkGC(const AppendChunkGC&) = delete;
+    AppendChunkGC(AppendChunkGC&&) noexcept = delete;
+    AppendChunkGC& operator=(const AppendChunkGC&) = delete;
+    AppendChunkGC& operator=(AppendChunkGC&&) noexcept = delete;
+    ~AppendChunkGC();
+
+    void start();
+    void stop();
+
+    /// @brief Pick a victim and compact it, waiting for it in the caller thread (which is not to be a reactor).
+    /// @return true if a chunk was reclaimed
+    bool run_once();
+
+private:
+    using relocations_t = std::vector< std::pair< MultiBlkId, MultiBlkId > >;
+
+    // Copy of the live blks of a victim, shared by the batches chained one after the other
+    struct copy_ctx {
+        std::vector< MultiBlkId > live_blks; // Sorted by blk num
+        chunk_num_t dest_chunk;
+        blk_count_t max_batch_nblks;
+        relocations_t relocations; // Of the batches copied so far
+    };
+
+    void gc_thread();
+    shared< Chunk > pick_victim() const;
+    shared< Chunk > pick_destination(Chunk const& victim, blk_num_t live_nblks) const;
+    bool compact(shared< Chunk > const& victim);
+    folly::Future< bool > copy_from(shared< copy_ctx > ctx, size_t begin);
+    folly::Future< bool > copy_batch(shared< copy_ctx > ctx, size_t begin, size_t end, blk_count_t nblks);
+    void undo_copy(relocations_t const& relocations);
+    /// @brief Completes once foreground io pressure comes down, with false if gc is stopped meanwhile.
+    folly::Future< bool > when_can_issue();
+    bool wait_for(folly::Future< bool >&& f);
+
+private:
+    shared< VirtualDev > m_vdev;
+    BlkDataService::gc_live_blks_cb_t m_live_blks_cb;
+    BlkDataService::gc_relocate_cb_t m_relocate_cb;
+    drain_reads_cb_t m_drain_reads_cb;
+    BlkCsumTable* m_csum_table; // Csums are carried over to the copies, the reset chunk is cleared
+
+    std::mutex m_mtx;
+    std::condition_variable m_cv;
+    bool m_stopping{false};
+    std::thread m_thread;
+    AppendChunkGCMetrics m_metrics;
+};
+} // namespace homestore
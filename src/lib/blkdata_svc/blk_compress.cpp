@@ -0,0 +1,161 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <sisl/fds/compress.hpp>
+#include <sisl/logging/logging.h>
+
+#include "common/homestore_utils.hpp"
+#include "blk_compress.hpp"
+
+namespace homestore {
+// Compressor works on contiguous buffers, so data spread over multiple iovs is gathered into (or scattered from) a
+// temporary buffer. Single iov, which is the common case, is used as is.
+static char const* gather(sisl::sg_iovs_t const& iovs, uint32_t size, std::unique_ptr< char[] >& tmp) {
+    if ((iovs.size() == 1) && (iovs[0].iov_len >= size)) { return r_cast< char const* >(iovs[0].iov_base); }
+    tmp = std::make_unique< char[] >(size);
+    uint32_t off{0};
+    for (auto const& iov : iovs) {
+        if (off == size) { break; }
+        auto const len = uint32_cast(std::min(size_t{size - off}, iov.iov_len));
+        std::memcpy(tmp.get() + off, iov.iov_base, len);
+        off += len;
+    }
+    return tmp.get();
+}
+
+std::pair< uint8_t*, uint32_t > compress_to_blks(sisl::sg_iovs_t const& iovs, uint32_t size, uint32_t blk_size,
+                                                 uint32_t align_size) {
+    uint32_t const orig_nblks = sisl::round_up(size, blk_size) / blk_size;
+    if (orig_nblks <= 1) { return {nullptr, 0}; }
+
+    std::unique_ptr< char[] > tmp;
+    auto const* src = gather(iovs, size, tmp);
+
+    uint32_t const max_size =
+        sisl::round_up(uint32_cast(sizeof(compressed_blk_hdr) + sisl::Compress::max_compress_len(size)), blk_size);
+    auto* buf = hs_utils::iobuf_alloc(max_size, sisl::buftag::data, align_size);
+    size_t compressed_size = max_size - sizeof(compressed_blk_hdr);
+    auto const ret = sisl::Compress::compress(src, r_cast< char* >(buf) + sizeof(compressed_blk_hdr), size,
+                                              &compressed_size);
+
+    uint32_t const out_size = sisl::round_up(uint32_cast(sizeof(compressed_blk_hdr) + compressed_size), blk_size);
+    if ((ret != 0) || (out_size >= (orig_nblks * blk_size))) {
+        // Either failed or doesn't save even a blk, not worth paying decompression on every read
+        hs_utils::iobuf_free(buf, sisl::buftag::data);
+        return {nullptr, 0};
+    }
+
+    auto* hdr = new (buf) compressed_blk_hdr();
+    hdr->orig_size = size;
+    hdr->compressed_size = uint32_cast(compressed_size);
+    std::memset(buf + sizeof(compressed_blk_hdr) + compressed_size, 0,
+                out_size - sizeof(compressed_blk_hdr) - compressed_size);
+    return {buf, out_size};
+}
+
+void bind_compressed_blks(uint8_t* buf, BlkId const& first_blk) {
+    auto* hdr = r_cast< compressed_blk_hdr* >(buf);
+    hdr->blk_num = first_blk.blk_num();
+    hdr->chunk_num = first_blk.chunk_num();
+    hdr->hdr_crc = hdr->compute_crc();
+}
+
+bool rebind_compressed_blks(uint8_t* buf, uint32_t size, BlkId const& from, BlkId const& to) {
+    if ((size < sizeof(compressed_blk_hdr)) || !r_cast< compressed_blk_hdr const* >(buf)->is_valid(from)) {
+        return false;
+    }
+    bind_compressed_blks(buf, to);
+    return true;
+}
+
+bool is_compressed_blks(iovec const* iovs, size_t niovs, BlkId const& first_blk) {
+    compressed_blk_hdr hdr;
+    auto* dst = r_cast< uint8_t* >(&hdr);
+    size_t off{0};
+    for (size_t i{0}; (i < niovs) && (off < sizeof(hdr)); ++i) {
+        auto const len = std::min(sizeof(hdr) - off, iovs[i].iov_len);
+        std::memcpy(dst + off, iovs[i].iov_base, len);
+        off += len;
+    }
+    return (off == sizeof(hdr)) && hdr.is_valid(first_blk);
+}
+
+std::error_code decompress_from_blks(uint8_t const* buf, uint32_t buf_size, BlkId const& first_blk,
+                                     sisl::sg_iovs_t const& iovs, uint32_t size) {
+    auto const* hdr = r_cast< compressed_blk_hdr const* >(buf);
+    if ((buf_size < sizeof(compressed_blk_hdr)) || !hdr->is_valid(first_blk) ||
+        (hdr->compressed_size > (buf_size - sizeof(compressed_blk_hdr))) || (hdr->orig_size < size)) {
+        LOGERROR("Blks read are not compressed data of size={}, buf_size={} magic={:#x} orig_size={}", size, buf_size,
+                 hdr->magic, hdr->orig_size);
+        return std::make_error_code(std::errc::bad_message);
+    }
+
+    // Decompressed in full even if only a part of it is read
+    auto const orig_size = hdr->orig_size;
+    bool const direct = (iovs.size() == 1) && (iovs[0].iov_len >= size) && (size == orig_size);
+    std::unique_ptr< char[] > tmp;
+    auto* dst = direct ? r_cast< char* >(iovs[0].iov_base) : (tmp = std::make_unique< char[] >(orig_size)).get();
+
+    size_t decompressed_size = orig_size;
+    auto const ret = sisl::Compress::decompress(r_cast< char const* >(buf) + sizeof(compressed_blk_hdr), dst,
+                                                hdr->compressed_size, &decompressed_size);
+    if ((ret != 0) || (decompressed_size != orig_size)) {
+        LOGERROR("Decompression of blks failed, ret={} decompressed_size={} expected={}", ret, decompressed_size,
+                 orig_size);
+        return std::make_error_code(std::errc::bad_message);
+    }
+
+    if (!direct) {
+        uint32_t off{0};
+        for (auto const& iov : iovs) {
+            if (off == size) { break; }
+            auto const len = uint32_cast(std::min(size_t{size - off}, iov.iov_len));
+            std::memcpy(iov.iov_base, tmp.get() + off, len);
+            off += len;
+        }
+    }
+    return std::error_code{};
+}
+
+uint32_t compress_for_wire(sisl::sg_iovs_t const& iovs, uint32_t size, sisl::io_blob_safe& out) {
+    std::unique_ptr< char[] > tmp;
+    auto const* src = gather(iovs, size, tmp);
+
+    out = sisl::io_blob_safe(uint32_cast(sisl::Compress::max_compress_len(size)));
+    size_t compressed_size = out.size();
+    auto const ret = sisl::Compress::compress(src, r_cast< char* >(out.bytes()), size, &compressed_size);
+    if ((ret != 0) || (compressed_size > (size - (size / 8)))) {
+        // Not worth the cpu of decompressing on the receiver
+        out = sisl::io_blob_safe{};
+        return 0;
+    }
+    return uint32_cast(compressed_size);
+}
+
+std::error_code decompress_from_wire(uint8_t const* buf, uint32_t compressed_size, uint8_t* out, uint32_t size) {
+    size_t decompressed_size = size;
+    auto const ret = sisl::Compress::decompress(r_cast< char const* >(buf), r_cast< char* >(out), compressed_size,
+                                                &decompressed_size);
+    if ((ret != 0) || (decompressed_size != size)) {
+        LOGERROR("Decompression of data received failed, ret={} decompressed_size={} expected={}", ret,
+                 decompressed_size, size);
+        return std::make_error_code(std::errc::bad_message);
+    }
+    return std::error_code{};
+}
+} // namespace homestore
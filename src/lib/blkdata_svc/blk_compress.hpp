@@ -0,0 +1,107 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <sys/uio.h>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+#include <sisl/fds/buffer.hpp>
+#include <homestore/blk.h>
+#include <homestore/crc.h>
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+static constexpr uint64_t compressed_blk_magic{0xc0de1234c0de5678};
+static constexpr uint32_t compressed_blk_version{0x01};
+
+//
+// Data written compressed by the data service is laid out on its blks as this header followed by the compressed
+// bytes, padded up to the blk size. Chunks which were ever written compressed blks are flagged in their chunk info
+// (see Chunk::has_compressed_blks), blks of other chunks are never looked at for the header. Within a flagged chunk,
+// the header is taken to be one only if its crc matches and it names the very blk it is read from, so neither data
+// which just happens to start with the magic nor a copy of compressed blks stored as data elsewhere is taken for it.
+// Compressed blks copied to other blks as is (migration, gc) are bound to their new location with
+// bind_compressed_blks.
+//
+#pragma pack(1)
+struct compressed_blk_hdr {
+    uint64_t magic{compressed_blk_magic};
+    uint32_t version{compressed_blk_version};
+    uint32_t orig_size{0};
+    uint32_t compressed_size{0};
+    blk_num_t blk_num{0};     // First blk of the blkid the data is written to
+    chunk_num_t chunk_num{0}; // and its chunk
+    uint32_t hdr_crc{0};      // Of all the fields above
+
+    uint32_t compute_crc() const {
+        return crc32_ieee(init_crc32, r_cast< unsigned char const* >(this), offsetof(compressed_blk_hdr, hdr_crc));
+    }
+    bool is_valid(BlkId const& first_blk) const {
+        return (magic == compressed_blk_magic) && (version == compressed_blk_version) &&
+            (blk_num == first_blk.blk_num()) && (chunk_num == first_blk.chunk_num()) && (hdr_crc == compute_crc());
+    }
+};
+#pragma pack()
+
+/**
+ * @brief : whether the data read from the blks starting at first_blk into iovs starts with a valid compressed_blk_hdr
+ */
+bool is_compressed_blks(iovec const* iovs, size_t niovs, BlkId const& first_blk);
+
+/**
+ * @brief : compress size bytes of iovs into a newly allocated iobuf of header + compressed data, rounded up to blks.
+ * Header is to be bound to the blks it is written to with bind_compressed_blks before it is written.
+ *
+ * @return : the iobuf and its size, or {nullptr, 0} if the data couldn't be compressed to fewer blks than it has. The
+ * iobuf is to be freed with hs_utils::iobuf_free(buf, sisl::buftag::data).
+ */
+std::pair< uint8_t*, uint32_t > compress_to_blks(sisl::sg_iovs_t const& iovs, uint32_t size, uint32_t blk_size,
+                                                 uint32_t align_size);
+
+/**
+ * @brief : bind the header at the start of buf to the blks starting at first_blk, to which buf is to be written
+ */
+void bind_compressed_blks(uint8_t* buf, BlkId const& first_blk);
+
+/**
+ * @brief : if buf, read from the blks starting at from, is compressed blks, bind it to the blks starting at to
+ *
+ * @return : whether buf is compressed blks
+ */
+bool rebind_compressed_blks(uint8_t* buf, uint32_t size, BlkId const& from, BlkId const& to);
+
+/**
+ * @brief : decompress the blks in buf, read from the blks starting from first_blk, written by compress_to_blks, into
+ * iovs of size bytes. Size could be less than the size of the data compressed, in which case only its first size bytes
+ * are copied.
+ */
+std::error_code decompress_from_blks(uint8_t const* buf, uint32_t buf_size, BlkId const& first_blk,
+                                     sisl::sg_iovs_t const& iovs, uint32_t size);
+
+/**
+ * @brief : compress size bytes of iovs to send them over the wire, into out which is allocated for it. Unlike
+ * compress_to_blks, the compressed bytes are as is, without any header or padding, the size of the data is sent along.
+ *
+ * @return : the compressed size, or 0 if the data couldn't be compressed by atleast 1/8th of it
+ */
+uint32_t compress_for_wire(sisl::sg_iovs_t const& iovs, uint32_t size, sisl::io_blob_safe& out);
+
+/**
+ * @brief : decompress the compressed_size bytes in buf, written by compress_for_wire, into out of size bytes
+ */
+std::error_code decompress_from_wire(uint8_t const* buf, uint32_t compressed_size, uint8_t* out, uint32_t size);
+} // namespace homestore
@@ -0,0 +1,348 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+#include <homestore/crc.h>
+#include <iomgr/iomgr_flip.hpp>
+#include <homestore/meta_service.hpp>
+
+#include "common/homestore_assert.hpp"
+#include "blk_csum_table.hpp"
+
+namespace homestore {
+static constexpr uint32_t init_crc32c{0xFFFFFFFF};
+
+BlkCsumTable::BlkCsumTable(chunk_nblks_cb_t chunk_nblks_cb) : m_chunk_nblks_cb{std::move(chunk_nblks_cb)} {
+    meta_service().register_handler(
+        meta_name(),
+        [this](meta_blk* mblk, sisl::byte_view buf, size_t size) {
+            on_meta_blk_found(std::move(buf), voidptr_cast(mblk));
+        },
+        nullptr);
+    meta_service().register_handler(
+        state_meta_name(),
+        [this](meta_blk* mblk, sisl::byte_view buf, size_t size) {
+            on_state_meta_blk_found(std::move(buf), voidptr_cast(mblk));
+        },
+        nullptr);
+}
+
+void BlkCsumTable::on_meta_blk_found(sisl::byte_view const& buf, void* meta_cookie) {
+    auto seg = std::make_unique< segment >();
+    seg->sb.load(buf, meta_cookie);
+    HS_REL_ASSERT_EQ(seg->sb->magic, blk_csum_sb_magic, "Invalid BlkDataCsum metablk, magic mismatch");
+    HS_REL_ASSERT_EQ(seg->sb->version, blk_csum_sb_version, "Invalid version of BlkDataCsum metablk");
+    HS_REL_ASSERT_GE(seg->sb.size(), blk_csum_sb_t::size_for(seg->sb->nblks), "BlkDataCsum metablk is truncated");
+    HS_REL_ASSERT_EQ(seg->sb->start_blk % blk_csum_segment_nblks, 0u, "BlkDataCsum segment is not aligned");
+    HS_REL_ASSERT_LT(seg->sb->start_blk, seg->sb->chunk_nblks, "BlkDataCsum segment is past its chunk");
+
+    std::unique_lock lg{m_mtx};
+    auto& tbl = m_tables[seg->sb->chunk_num];
+    if (!tbl) { tbl = new_table(seg->sb->chunk_nblks); }
+    tbl->segments[seg->sb->start_blk / blk_csum_segment_nblks] = std::move(seg);
+}
+
+void BlkCsumTable::on_state_meta_blk_found(sisl::byte_view const& buf, void* meta_cookie) {
+    m_state_sb.load(buf, meta_cookie);
+    HS_REL_ASSERT_EQ(m_state_sb->magic, blk_csum_state_sb_magic, "Invalid BlkDataCsumState metablk, magic mismatch");
+    HS_REL_ASSERT_EQ(m_state_sb->version, blk_csum_state_sb_version, "Invalid version of BlkDataCsumState metablk");
+}
+
+void BlkCsumTable::start() {
+    bool const clean = !m_state_sb.is_empty() && (m_state_sb->clean_shutdown != 0);
+    uint64_t nsuspect{0};
+    {
+        std::unique_lock lg{m_mtx};
+        for (auto& [chunk_num, tbl] : m_tables) {
+            for (blk_num_t i{0}; i < tbl->segments.size(); ++i) {
+                auto& seg = tbl->segments[i];
+                if (!seg) {
+                    seg = new_segment(chunk_num, tbl->nblks, i * blk_csum_segment_nblks);
+                    continue;
+                }
+                if (clean) { continue; }
+
+                // Written to the next cp, so that they stay suspect across a clean restart as well
+                auto* csums = seg->sb->csums();
+                for (blk_num_t b{0}; b < seg->sb->nblks; ++b) {
+                    if (csums[b] != unknown_csum) {
+                        csums[b] |= suspect_bit;
+                        ++nsuspect;
+                    }
+                }
+                seg->dirty.store(true, std::memory_order_release);
+            }
+        }
+    }
+    if (!clean) {
+        LOGINFO("Data csums were not persisted on a clean shutdown, csums of {} blks are suspect until read", nsuspect);
+    }
+
+    // Anything recorded from now on could be lost on crash, until shutdown persists it
+    if (m_state_sb.is_empty()) { m_state_sb.create(sizeof(blk_csum_state_sb_t)); }
+    m_state_sb->clean_shutdown = 0;
+    m_state_sb.write();
+}
+
+void BlkCsumTable::shutdown() {
+#ifdef _PRERELEASE
+    if (iomgr_flip::instance()->test_flip("blk_csum_skip_clean_shutdown")) {
+        LOGINFO("Skipping the clean shutdown of data csums, as if it crashed");
+        return;
+    }
+#endif
+    if (m_state_sb.is_empty()) { return; } // Never started
+    flush_dirty_segments();
+    m_state_sb->clean_shutdown = 1;
+    m_state_sb.write();
+}
+
+std::unique_ptr< BlkCsumTable::chunk_table > BlkCsumTable::new_table(blk_num_t nblks) {
+    auto tbl = std::make_unique< chunk_table >();
+    tbl->nblks = nblks;
+    tbl->segments.resize((nblks + blk_csum_segment_nblks - 1) / blk_csum_segment_nblks);
+    return tbl;
+}
+
+std::unique_ptr< BlkCsumTable::segment > BlkCsumTable::new_segment(chunk_num_t chunk_num, blk_num_t chunk_nblks,
+                                                                   blk_num_t start_blk) {
+    auto const nblks = std::min(chunk_nblks - start_blk, blk_csum_segment_nblks);
+    auto seg = std::make_unique< segment >();
+    seg->sb.create(blk_csum_sb_t::size_for(nblks));
+    seg->sb->chunk_num = chunk_num;
+    seg->sb->chunk_nblks = chunk_nblks;
+    seg->sb->start_blk = start_blk;
+    seg->sb->nblks = nblks;
+    std::memset(seg->sb->csums(), 0, nblks * sizeof(uint32_t));
+    return seg;
+}
+
+BlkCsumTable::chunk_table* BlkCsumTable::get_table(chunk_num_t chunk_num, bool create) {
+    {
+        std::shared_lock lg{m_mtx};
+        if (auto it = m_tables.find(chunk_num); it != m_tables.end()) { return it->second.get(); }
+    }
+    if (!create) { return nullptr; }
+
+    std::unique_lock lg{m_mtx};
+    auto& tbl = m_tables[chunk_num];
+    if (!tbl) {
+        tbl = new_table(m_chunk_nblks_cb(chunk_num));
+        for (blk_num_t i{0}; i < tbl->segments.size(); ++i) {
+            tbl->segments[i] = new_segment(chunk_num, tbl->nblks, i * blk_csum_segment_nblks);
+        }
+    }
+    return tbl.get();
+}
+
+void BlkCsumTable::store(segment* seg, uint32_t& entry, uint32_t csum) {
+    std::atomic_ref< uint32_t >{entry}.store(csum, std::memory_order_relaxed);
+    seg->dirty.store(true, std::memory_order_release);
+}
+
+template < typename CB >
+void BlkCsumTable::for_each_blk_csum(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t size,
+                                     uint32_t blk_size, bool create, CB&& cb) {
+    size_t iov_idx{0};
+    size_t iov_off{0};
+    auto it = bids.iterate();
+    while (auto const b = it.next()) {
+        auto* tbl = get_table(b->chunk_num(), create);
+        for (blk_count_t i{0}; i < b->blk_count(); ++i) {
+            if (size < blk_size) { return; }
+            size -= blk_size;
+
+            // A blk could span across iovs, so crc is chained through all its fragments
+            uint32_t crc{init_crc32c};
+            uint32_t remain{blk_size};
+            while ((remain > 0) && (iov_idx < niovs)) {
+                auto const len = uint32_cast(std::min(size_t{remain}, iovs[iov_idx].iov_len - iov_off));
+                crc = crc32_iscsi(r_cast< unsigned char* >(iovs[iov_idx].iov_base) + iov_off, s_cast< int >(len), crc);
+                remain -= len;
+                iov_off += len;
+                if (iov_off == iovs[iov_idx].iov_len) {
+                    ++iov_idx;
+                    iov_off = 0;
+                }
+            }
+            if (remain > 0) { return; } // iovs are shorter than the blks, nothing more to do
+
+            // 0 is reserved for unknown csum and the top bit for suspect ones
+            crc = ~crc & ~suspect_bit;
+            if (crc == unknown_csum) { crc = 1; }
+
+            auto const blk_num = b->blk_num() + i;
+            if ((tbl == nullptr) || (blk_num >= tbl->nblks)) {
+                cb(nullptr, nullptr, crc);
+            } else {
+                cb(tbl->segment_of(blk_num), &tbl->entry(blk_num), crc);
+            }
+        }
+    }
+}
+
+void BlkCsumTable::update(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t blk_size) {
+    for_each_blk_csum(bids, iovs, niovs, UINT32_MAX, blk_size, true /* create */,
+                      [](segment* seg, uint32_t* entry, uint32_t crc) {
+                          if (entry) { store(seg, *entry, crc); }
+                      });
+}
+
+void BlkCsumTable::update(MultiBlkId const& bids, uint8_t const* buf, uint32_t blk_size) {
+    iovec iov{const_cast< uint8_t* >(buf), uint64_cast(bids.blk_count()) * blk_size};
+    update(bids, &iov, 1, blk_size);
+}
+
+bool BlkCsumTable::verify(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t size, uint32_t blk_size) {
+    uint64_t nverified{0};
+    uint64_t nunknown{0};
+    uint64_t nmismatch{0};
+    uint64_t nrelearned{0};
+    for_each_blk_csum(bids, iovs, niovs, size, blk_size, false /* create */,
+                      [&](segment* seg, uint32_t* entry, uint32_t crc) {
+                          uint32_t expected{unknown_csum};
+                          if (entry) { expected = std::atomic_ref< uint32_t >{*entry}.load(std::memory_order_relaxed); }
+                          if (expected == unknown_csum) {
+                              ++nunknown;
+                          } else if ((expected & ~suspect_bit) == crc) {
+                              // Trusted again, no need to persist it right away, it is only less protected if not
+                              if (expected & suspect_bit) {
+                                  std::atomic_ref< uint32_t >{*entry}.compare_exchange_strong(expected, crc);
+                              }
+                              ++nverified;
+                          } else if (expected & suspect_bit) {
+                              // Could be the csum from before an overwrite lost on crash. If it was overwritten
+                              // meanwhile it is left as is.
+                              if (std::atomic_ref< uint32_t >{*entry}.compare_exchange_strong(expected, crc)) {
+                                  seg->dirty.store(true, std::memory_order_release);
+                              }
+                              ++nrelearned;
+                          } else {
+                              ++nmismatch;
+                          }
+                      });
+
+    COUNTER_INCREMENT(m_metrics, csum_blks_verified, nverified);
+    COUNTER_INCREMENT(m_metrics, csum_blks_unknown, nunknown);
+    if (nrelearned) {
+        COUNTER_INCREMENT(m_metrics, csum_blks_relearned, nrelearned);
+        LOGWARN("Data csum possibly stale since crash relearned on read of blkid={}, num_blks={}", bids.to_string(),
+                nrelearned);
+    }
+    if (nmismatch) {
+        COUNTER_INCREMENT(m_metrics, csum_mismatches, nmismatch);
+        LOGERROR("Data csum mismatch on read of blkid={}, num_blks_mismatched={}", bids.to_string(), nmismatch);
+        return false;
+    }
+    return true;
+}
+
+bool BlkCsumTable::verify(MultiBlkId const& bids, uint8_t const* buf, uint32_t size, uint32_t blk_size) {
+    iovec iov{const_cast< uint8_t* >(buf), size};
+    return verify(bids, &iov, 1, size, blk_size);
+}
+
+void BlkCsumTable::copy(MultiBlkId const& from, MultiBlkId const& to) {
+    HS_DBG_ASSERT_EQ(from.blk_count(), to.blk_count(), "Csums copied across blkids of different size");
+    auto from_it = from.iterate();
+    auto to_it = to.iterate();
+    std::optional< BlkId > src;
+    std::optional< BlkId > dst;
+    blk_count_t src_off{0};
+    blk_count_t dst_off{0};
+    while (true) {
+        if (!src || (src_off == src->blk_count())) {
+            src = from_it.next();
+            src_off = 0;
+        }
+        if (!dst || (dst_off == dst->blk_count())) {
+            dst = to_it.next();
+            dst_off = 0;
+        }
+        if (!src || !dst) { break; }
+
+        auto* src_tbl = get_table(src->chunk_num(), false /* create */);
+        auto* dst_tbl = get_table(dst->chunk_num(), true /* create */);
+        auto const n = s_cast< blk_count_t >(std::min(src->blk_count() - src_off, dst->blk_count() - dst_off));
+        for (blk_count_t i{0}; i < n; ++i) {
+            auto const src_blk = src->blk_num() + src_off + i;
+            auto const dst_blk = dst->blk_num() + dst_off + i;
+            if (dst_blk >= dst_tbl->nblks) { break; }
+            uint32_t csum{unknown_csum};
+            if ((src_tbl != nullptr) && (src_blk < src_tbl->nblks)) {
+                csum = std::atomic_ref< uint32_t >{src_tbl->entry(src_blk)}.load(std::memory_order_relaxed);
+            }
+            store(dst_tbl->segment_of(dst_blk), dst_tbl->entry(dst_blk), csum);
+        }
+        src_off += n;
+        dst_off += n;
+    }
+}
+
+void BlkCsumTable::clear(MultiBlkId const& bids) {
+    auto it = bids.iterate();
+    while (auto const b = it.next()) {
+        auto* tbl = get_table(b->chunk_num(), false /* create */);
+        if (tbl == nullptr) { continue; }
+        auto const end = std::min(b->blk_num() + b->blk_count(), tbl->nblks);
+        for (auto blk_num = b->blk_num(); blk_num < end; ++blk_num) {
+            store(tbl->segment_of(blk_num), tbl->entry(blk_num), unknown_csum);
+        }
+    }
+}
+
+void BlkCsumTable::clear_chunk(chunk_num_t chunk_num) {
+    auto* tbl = get_table(chunk_num, false /* create */);
+    if (tbl == nullptr) { return; }
+    for (auto& seg : tbl->segments) {
+        auto* csums = seg->sb->csums();
+        for (blk_num_t b{0}; b < seg->sb->nblks; ++b) {
+            std::atomic_ref< uint32_t >{csums[b]}.store(unknown_csum, std::memory_order_relaxed);
+        }
+        seg->dirty.store(true, std::memory_order_release);
+    }
+}
+
+void BlkCsumTable::cp_flush() {
+#ifdef _PRERELEASE
+    // Segments stay dirty, as if the cp crashed before persisting them
+    if (iomgr_flip::instance()->test_flip("blk_csum_skip_cp_flush")) { return; }
+#endif
+    flush_dirty_segments();
+}
+
+void BlkCsumTable::flush_dirty_segments() {
+    std::vector< segment* > dirty_segments;
+    {
+        std::shared_lock lg{m_mtx};
+        for (auto& [chunk_num, tbl] : m_tables) {
+            for (auto& seg : tbl->segments) {
+                if (seg->dirty.exchange(false, std::memory_order_acq_rel)) { dirty_segments.push_back(seg.get()); }
+            }
+        }
+    }
+
+    // Updates racing with the write are either part of it or mark the segment dirty again for the next cp
+    for (auto* seg : dirty_segments) {
+        seg->sb.write();
+    }
+    COUNTER_INCREMENT(m_metrics, csum_segments_flushed, dirty_segments.size());
+}
+} // namespace homestore
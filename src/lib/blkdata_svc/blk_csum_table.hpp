@@ -0,0 +1,182 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <sys/uio.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <sisl/fds/buffer.hpp>
+#include <sisl/metrics/metrics.hpp>
+#include <homestore/blk.h>
+#include <homestore/superblk_handler.hpp>
+
+namespace homestore {
+static constexpr uint64_t blk_csum_sb_magic{0xc5c5b10cda7a0001};
+static constexpr uint32_t blk_csum_sb_version{0x02};
+static constexpr uint64_t blk_csum_state_sb_magic{0xc5c5b10cda7a57a7};
+static constexpr uint32_t blk_csum_state_sb_version{0x01};
+
+#pragma pack(1)
+// Csums of a segment of a chunk, each segment is a metablk of its own
+struct blk_csum_sb_t {
+    uint64_t magic{blk_csum_sb_magic};
+    uint32_t version{blk_csum_sb_version};
+    chunk_num_t chunk_num{0};
+    uint8_t reserved1[2]{};
+    blk_num_t chunk_nblks{0}; // Of the whole chunk, to size the table of the chunk on recovery
+    blk_num_t start_blk{0};
+    blk_num_t nblks{0};
+    uint8_t reserved2[4]{}; // keep the csums that follow 8 byte aligned
+
+    // Followed by nblks csums, one per blk
+    uint32_t* csums() { return r_cast< uint32_t* >(this + 1); }
+    static uint32_t size_for(blk_num_t nblks) { return sizeof(blk_csum_sb_t) + (nblks * sizeof(uint32_t)); }
+};
+
+struct blk_csum_state_sb_t {
+    uint64_t magic{blk_csum_state_sb_magic};
+    uint32_t version{blk_csum_state_sb_version};
+    uint8_t clean_shutdown{0}; // Cleared on start, set once all the csums are persisted on shutdown
+    uint8_t reserved[3]{};
+};
+#pragma pack()
+
+class BlkCsumMetrics : public sisl::MetricsGroup {
+public:
+    explicit BlkCsumMetrics() : sisl::MetricsGroup("BlkDataCsum", "BlkDataCsum") {
+        REGISTER_COUNTER(csum_blks_verified, "Number of blks whose data csum was verified on read");
+        REGISTER_COUNTER(csum_blks_unknown, "Number of blks read with no csum to verify against");
+        REGISTER_COUNTER(csum_mismatches, "Number of blks whose data didn't match its csum on read");
+        REGISTER_COUNTER(csum_blks_relearned, "Number of blks whose csum, possibly stale after a crash, was relearned");
+        REGISTER_COUNTER(csum_segments_flushed, "Number of csum segments written on cp flush");
+        register_me_to_farm();
+    }
+
+    BlkCsumMetrics(const BlkCsumMetrics&) = delete;
+    BlkCsumMetrics(BlkCsumMetrics&&) noexcept = delete;
+    BlkCsumMetrics& operator=(const BlkCsumMetrics&) = delete;
+    BlkCsumMetrics& operator=(BlkCsumMetrics&&) noexcept = delete;
+    ~BlkCsumMetrics() { deregister_me_from_farm(); }
+};
+
+//
+// BlkCsumTable holds crc32c of every blk written through the data service, as a flat array per chunk. Each chunk's
+// array is split into segments of blk_csum_segment_nblks, each a metablk of its own, which is kept in memory as is
+// and rewritten on cp flush only if it was changed.
+//
+// Csum is computed once the write completes (buffer is still owned by the caller until then) and verified once the
+// read completes, so reads which race with the write of the same blk are not verified. A csum of 0 means unknown: the
+// blk was never written since it was freed, or was written by someone else than the data service. Blks are cleared on
+// free ahead of the cp which persists the free, so a blk reallocated and written after the last cp can never be
+// verified against the csum of its previous life after a restart.
+//
+// Overwriting an already written blk in place has no such protection, its new csum is only persisted on the next cp.
+// So if the previous run didn't shut down cleanly, every csum loaded is suspect (top bit of the entry): a suspect csum
+// which doesn't match is relearned from the data read instead of failing the read, one which matches is trusted again.
+// Suspect bits are persisted along, so that they survive a clean restart before the blks are read.
+//
+class BlkCsumTable {
+public:
+    static constexpr uint32_t unknown_csum{0};
+    static constexpr blk_num_t blk_csum_segment_nblks{16 * 1024}; // 64KB of csums per metablk
+    using chunk_nblks_cb_t = std::function< blk_num_t(chunk_num_t) >;
+
+    explicit BlkCsumTable(chunk_nblks_cb_t chunk_nblks_cb);
+    BlkCsumTable(BlkCsumTable const&) = delete;
+    BlkCsumTable(BlkCsumTable&&) noexcept = delete;
+    BlkCsumTable& operator=(BlkCsumTable const&) = delete;
+    BlkCsumTable& operator=(BlkCsumTable&&) noexcept = delete;
+    ~BlkCsumTable() = default;
+
+    /// @brief Called once the metablks are recovered, before any io. Marks the loaded csums suspect if the previous
+    /// run didn't shut down cleanly.
+    void start();
+
+    /// @brief Persist whatever is left dirty after the last cp and mark the shutdown clean
+    void shutdown();
+
+    /**
+     * @brief : compute and record the csums of the blks, whose data is laid out in the iovs in the order of the pieces.
+     */
+    void update(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t blk_size);
+    void update(MultiBlkId const& bids, uint8_t const* buf, uint32_t blk_size);
+
+    /**
+     * @brief : verify the data read into iovs against the recorded csums. Only the blks fully covered by size are
+     * verified. Returns false if any of the blks did not match.
+     */
+    bool verify(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t size, uint32_t blk_size);
+    bool verify(MultiBlkId const& bids, uint8_t const* buf, uint32_t size, uint32_t blk_size);
+
+    /**
+     * @brief : carry the csums of the blks of from over to the blks of to, in the order of their pieces, as the data
+     * was copied (like by gc). Both should have the same number of blks.
+     */
+    void copy(MultiBlkId const& from, MultiBlkId const& to);
+
+    void clear(MultiBlkId const& bids);
+    void clear_chunk(chunk_num_t chunk_num);
+
+    /// @brief Persist the segments which were changed since the last flush. Called as part of cp flush.
+    void cp_flush();
+
+    static std::string meta_name() { return "BlkDataCsum"; }
+    static std::string state_meta_name() { return "BlkDataCsumState"; }
+
+private:
+    static constexpr uint32_t suspect_bit{0x80000000};
+
+    struct segment {
+        superblk< blk_csum_sb_t > sb{BlkCsumTable::meta_name()};
+        std::atomic< bool > dirty{false};
+    };
+
+    struct chunk_table {
+        blk_num_t nblks{0};
+        std::vector< std::unique_ptr< segment > > segments; // Null only while the metablks are being recovered
+
+        segment* segment_of(blk_num_t blk_num) { return segments[blk_num / blk_csum_segment_nblks].get(); }
+        uint32_t& entry(blk_num_t blk_num) {
+            return segment_of(blk_num)->sb->csums()[blk_num % blk_csum_segment_nblks];
+        }
+    };
+
+    void on_meta_blk_found(sisl::byte_view const& buf, void* meta_cookie);
+    void on_state_meta_blk_found(sisl::byte_view const& buf, void* meta_cookie);
+    chunk_table* get_table(chunk_num_t chunk_num, bool create);
+    static std::unique_ptr< chunk_table > new_table(blk_num_t nblks); // Without any segment
+    static std::unique_ptr< segment > new_segment(chunk_num_t chunk_num, blk_num_t chunk_nblks, blk_num_t start_blk);
+    static void store(segment* seg, uint32_t& entry, uint32_t csum);
+    void flush_dirty_segments();
+
+    // Walk the blks of bids along with their data in iovs, calling cb with the segment, entry and crc of each blk
+    template < typename CB >
+    void for_each_blk_csum(MultiBlkId const& bids, iovec const* iovs, size_t niovs, uint32_t size, uint32_t blk_size,
+                           bool create, CB&& cb);
+
+private:
+    chunk_nblks_cb_t m_chunk_nblks_cb;
+    std::shared_mutex m_mtx; // Protects the map, tables themselves are updated without lock
+    std::unordered_map< chunk_num_t, std::unique_ptr< chunk_table > > m_tables;
+    superblk< blk_csum_state_sb_t > m_state_sb{BlkCsumTable::state_meta_name()};
+    BlkCsumMetrics m_metrics;
+};
+} // namespace homestore
@@ -0,0 +1,77 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include "blk_free_epoch.hpp"
+
+namespace homestore {
+static std::atomic< uint32_t > s_next_shard{0};
+
+BlkFreeEpoch::BlkFreeEpoch(release_cb_t release_cb) : m_release_cb{std::move(release_cb)} {}
+
+BlkFreeEpoch::token BlkFreeEpoch::enter() {
+    static thread_local uint32_t const t_shard = s_next_shard.fetch_add(1) % s_num_counter_shards;
+    while (true) {
+        auto const e = m_epoch.load();
+        auto& cnt = m_readers[e % 2][t_shard].val;
+        cnt.fetch_add(1);
+
+        // Epoch could have moved on between the load and the increment, in which case this counter might already be
+        // seen as drained by the one advancing it. Back off and enter on the new epoch instead.
+        if (m_epoch.load() == e) { return token{e, t_shard}; }
+        exit(token{e, t_shard});
+    }
+}
+
+void BlkFreeEpoch::exit(token const& t) {
+    auto const prev = m_readers[t.epoch % 2][t.shard].val.fetch_sub(1);
+    if ((prev == 1) && (m_num_pending.load() != 0)) { try_advance(); }
+}
+
+void BlkFreeEpoch::defer_free(MultiBlkId const& bids, folly::Promise< std::error_code >&& promise) {
+    {
+        std::unique_lock lg{m_mtx};
+        m_pending[m_epoch.load() % 2].push_back(pending_free_t{bids, std::move(promise)});
+        m_num_pending.fetch_add(1);
+    }
+    try_advance();
+}
+
+bool BlkFreeEpoch::has_readers(uint64_t epoch) const {
+    // Once the epoch has moved past, its counters only drop (other than transient increments of enter() which backs
+    // off), so each shard seen as zero stays zero and summing them without a snapshot is safe.
+    for (auto const& c : m_readers[epoch % 2]) {
+        if (c.val.load() != 0) { return true; }
+    }
+    return false;
+}
+
+void BlkFreeEpoch::try_advance() {
+    std::vector< pending_free_t > released;
+    {
+        std::unique_lock lg{m_mtx};
+        while (m_num_pending.load() != 0) {
+            auto const e = m_epoch.load();
+            if (has_readers(e - 1)) { break; }
+
+            // All readers of e-1 are gone, so are the reads which could be on the blks freed during e-1
+            m_epoch.store(e + 1);
+            auto& q = m_pending[(e - 1) % 2];
+            m_num_pending.fetch_sub(q.size());
+            released.insert(released.end(), std::make_move_iterator(q.begin()), std::make_move_iterator(q.end()));
+            q.clear();
+        }
+    }
+    if (!released.empty()) { m_release_cb(std::move(released)); }
+}
+} // namespace homestore
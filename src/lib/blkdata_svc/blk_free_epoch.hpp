@@ -0,0 +1,100 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <system_error>
+#include <vector>
+
+#include <folly/futures/Future.h>
+#include <homestore/blk.h>
+
+namespace homestore {
+struct pending_free_t {
+    MultiBlkId bids;
+    folly::Promise< std::error_code > promise;
+};
+
+//
+// BlkFreeEpoch is an alternative to BlkReadTracker for making a free wait out the in-flight reads on its blks. Instead
+// of tracking every read by its blkid, reads only enter the current epoch (an atomic increment on a per thread
+// counter) and frees are queued to the epoch current at the time of the free. Frees of an epoch are released only
+// after every reader which entered on that epoch or earlier has exited, which is a superset of the reads on those blks.
+//
+// Only 2 epochs are live at any time. The global epoch E is advanced to E+1 only once all E-1 readers have exited
+// (their counters are reused by E+1), at which point the frees queued on E-1 are released as one batch. Advancing is
+// attempted whenever there are queued frees, by the free itself and by the last reader to exit a counter.
+//
+class BlkFreeEpoch {
+    static constexpr uint32_t s_num_counter_shards = 16;
+
+public:
+    using release_cb_t = std::function< void(std::vector< pending_free_t >&&) >;
+
+    struct token {
+        uint64_t epoch;
+        uint32_t shard;
+    };
+
+    explicit BlkFreeEpoch(release_cb_t release_cb);
+    BlkFreeEpoch(BlkFreeEpoch const&) = delete;
+    BlkFreeEpoch(BlkFreeEpoch&&) noexcept = delete;
+    BlkFreeEpoch& operator=(BlkFreeEpoch const&) = delete;
+    BlkFreeEpoch& operator=(BlkFreeEpoch&&) noexcept = delete;
+    ~BlkFreeEpoch() = default;
+
+    /**
+     * @brief : enter the current epoch before issuing a read. The returned token has to be passed to exit() once the
+     * read completes, which could be on a different thread.
+     */
+    token enter();
+    void exit(token const& t);
+
+    /**
+     * @brief : queue the blkids to be freed once all the reads which could be on them are done. release_cb is called
+     * with these (and any other frees released alongside), possibly inline in this call if there are no reads.
+     */
+    void defer_free(MultiBlkId const& bids, folly::Promise< std::error_code >&& promise);
+
+    /**
+     * @brief : complete the promise once all the reads in flight as of now are done, without freeing anything.
+     */
+    void wait_for_readers(folly::Promise< std::error_code >&& promise) { defer_free(MultiBlkId{}, std::move(promise)); }
+
+    uint64_t current_epoch() const { return m_epoch.load(); }
+    uint64_t num_pending_frees() const { return m_num_pending.load(); }
+
+private:
+    struct alignas(64) padded_counter {
+        std::atomic< int64_t > val{0};
+    };
+    using epoch_counters_t = std::array< padded_counter, s_num_counter_shards >;
+
+    bool has_readers(uint64_t epoch) const;
+    void try_advance();
+
+private:
+    std::atomic< uint64_t > m_epoch{2};
+    std::array< epoch_counters_t, 2 > m_readers;
+    std::atomic< uint64_t > m_num_pending{0};
+
+    std::mutex m_mtx; // Protects the queued frees and advancing the epoch
+    std::array< std::vector< pending_free_t >, 2 > m_pending;
+    release_cb_t m_release_cb;
+};
+} // namespace homestore
@@ -0,0 +1,134 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+#include "blk_read_cache.hpp"
+
+namespace homestore {
+static constexpr uint32_t s_num_cache_buckets{100000};
+
+// Position in the iovs, which moves forward as blks are copied in or out of them
+struct iov_cursor {
+    iovec const* iovs;
+    size_t niovs;
+    size_t idx{0};
+    size_t off{0};
+
+    // Copy len bytes between the iovs and buf, returns false if iovs are shorter than len
+    template < bool ToIovs >
+    bool copy(uint8_t* buf, uint32_t len) {
+        while ((len > 0) && (idx < niovs)) {
+            auto const n = std::min(size_t{len}, iovs[idx].iov_len - off);
+            auto* iov_ptr = r_cast< uint8_t* >(iovs[idx].iov_base) + off;
+            if constexpr (ToIovs) {
+                std::memcpy(iov_ptr, buf, n);
+            } else {
+                std::memcpy(buf, iov_ptr, n);
+            }
+            buf += n;
+            len -= n;
+            off += n;
+            if (off == iovs[idx].iov_len) {
+                ++idx;
+                off = 0;
+            }
+        }
+        return (len == 0);
+    }
+};
+
+BlkReadCache::BlkReadCache(std::shared_ptr< sisl::Evictor > const& evictor, uint32_t blk_size) :
+        m_blk_size{blk_size},
+        m_cache{evictor, s_num_cache_buckets, blk_size,
+                [](cached_blk_ptr const& cb) -> BlkId { return cb->blkid; },
+                [](sisl::CacheRecord const&) -> bool { return true; }} {}
+
+bool BlkReadCache::read(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size) {
+    if (size < (bid.blk_count() * m_blk_size)) {
+        COUNTER_INCREMENT(m_metrics, read_cache_misses, 1);
+        return false;
+    }
+
+    iov_cursor cur{iovs, niovs};
+    for (blk_count_t i{0}; i < bid.blk_count(); ++i) {
+        cached_blk_ptr cb;
+        if (!m_cache.get(BlkId{bid.blk_num() + i, 1, bid.chunk_num()}, cb) ||
+            !cur.copy< true >(cb->data.get(), m_blk_size)) {
+            COUNTER_INCREMENT(m_metrics, read_cache_misses, 1);
+            return false;
+        }
+    }
+    COUNTER_INCREMENT(m_metrics, read_cache_hits, 1);
+    return true;
+}
+
+void BlkReadCache::insert(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size) {
+    iov_cursor cur{iovs, niovs};
+    blk_count_t const nblks = std::min(uint32_cast(bid.blk_count()), size / m_blk_size);
+    for (blk_count_t i{0}; i < nblks; ++i) {
+        auto cb = std::make_shared< cached_blk >();
+        cb->blkid = BlkId{bid.blk_num() + i, 1, bid.chunk_num()};
+        cb->data = std::make_unique< uint8_t[] >(m_blk_size);
+        if (!cur.copy< false >(cb->data.get(), m_blk_size)) { break; }
+
+        // Some other read could have added it already, which is the same data
+        m_cache.upsert(cb);
+    }
+    COUNTER_INCREMENT(m_metrics, read_cache_blks_inserted, nblks);
+}
+
+void BlkReadCache::invalidate(MultiBlkId const& bids) {
+    uint64_t nremoved{0};
+    auto it = bids.iterate();
+    while (auto const b = it.next()) {
+        for (blk_count_t i{0}; i < b->blk_count(); ++i) {
+            cached_blk_ptr cb;
+            if (m_cache.remove(BlkId{b->blk_num() + i, 1, b->chunk_num()}, cb)) { ++nremoved; }
+        }
+    }
+    if (nremoved) { COUNTER_INCREMENT(m_metrics, read_cache_blks_invalidated, nremoved); }
+}
+
+uint32_t BlkWriteStamps::slot_of(chunk_num_t chunk_num, uint64_t blk_group) {
+    // Fibonacci hash of the group, top bits of it are the slot
+    static_assert((s_num_slots & (s_num_slots - 1)) == 0, "Number of write stamp slots must be a power of 2");
+    uint64_t const key = (s_cast< uint64_t >(chunk_num) << 48) ^ blk_group;
+    return s_cast< uint32_t >((key * 0x9E3779B97F4A7C15ull) >> (64 - std::countr_zero(s_num_slots)));
+}
+
+void BlkWriteStamps::on_write(MultiBlkId const& bids) {
+    auto const stamp = m_seq.fetch_add(1) + 1;
+    auto it = bids.iterate();
+    while (auto const b = it.next()) {
+        uint64_t const last_group = (b->blk_num() + b->blk_count() - 1) >> s_blks_per_slot_shift;
+        for (uint64_t g{b->blk_num() >> s_blks_per_slot_shift}; g <= last_group; ++g) {
+            // Another write could have stamped the slot with a later stamp already, stamps never go back
+            auto& slot = m_slots[slot_of(b->chunk_num(), g)];
+            auto cur = slot.load();
+            while ((cur < stamp) && !slot.compare_exchange_weak(cur, stamp)) {}
+        }
+    }
+}
+
+bool BlkWriteStamps::written_since(BlkId const& bid, uint64_t stamp) const {
+    uint64_t const last_group = (bid.blk_num() + bid.blk_count() - 1) >> s_blks_per_slot_shift;
+    for (uint64_t g{bid.blk_num() >> s_blks_per_slot_shift}; g <= last_group; ++g) {
+        if (m_slots[slot_of(bid.chunk_num(), g)].load() > stamp) { return true; }
+    }
+    return false;
+}
+} // namespace homestore
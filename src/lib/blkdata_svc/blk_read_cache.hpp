@@ -0,0 +1,123 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <sys/uio.h>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <sisl/cache/simple_cache.hpp>
+#include <sisl/metrics/metrics.hpp>
+#include <homestore/blk.h>
+
+namespace sisl {
+class Evictor;
+}
+
+namespace homestore {
+class BlkReadCacheMetrics : public sisl::MetricsGroup {
+public:
+    explicit BlkReadCacheMetrics() : sisl::MetricsGroup("BlkReadCache", "BlkReadCache") {
+        REGISTER_COUNTER(read_cache_hits, "Number of reads served entirely from the read cache");
+        REGISTER_COUNTER(read_cache_misses, "Number of reads which had to go to the device");
+        REGISTER_COUNTER(read_cache_blks_inserted, "Number of blks added to the read cache");
+        REGISTER_COUNTER(read_cache_blks_invalidated, "Number of blks removed from the read cache on free/write");
+        register_me_to_farm();
+    }
+
+    BlkReadCacheMetrics(const BlkReadCacheMetrics&) = delete;
+    BlkReadCacheMetrics(BlkReadCacheMetrics&&) noexcept = delete;
+    BlkReadCacheMetrics& operator=(const BlkReadCacheMetrics&) = delete;
+    BlkReadCacheMetrics& operator=(BlkReadCacheMetrics&&) noexcept = delete;
+    ~BlkReadCacheMetrics() { deregister_me_from_farm(); }
+};
+
+struct cached_blk {
+    BlkId blkid; // Always a single blk
+    std::unique_ptr< uint8_t[] > data;
+};
+using cached_blk_ptr = std::shared_ptr< cached_blk >;
+
+//
+// BlkReadCache caches the data of the blks read through the data service, one entry per blk, so that reads of
+// different ranges on the same blks share the entries. It is a sisl::SimpleCache (hash buckets with their own locks)
+// on the homestore evictor, so it shares the cache_size_percent memory budget (and LRU eviction) with the index cache.
+//
+// Data is added only once a read completes, and before the read is released from the read tracker/free epoch, while
+// free invalidates only after the outstanding reads on the blks are released. So a read racing with the free can
+// never add the data of a freed blk after it is invalidated. Overwrites don't wait for the reads on the blks though,
+// so a read issued before an overwrite could complete after the overwrite has invalidated the blks. Such a read is
+// caught by the BlkWriteStamps of its blks and its data is not cached (see BlkDataService::on_read_completion).
+//
+class BlkReadCache {
+public:
+    BlkReadCache(std::shared_ptr< sisl::Evictor > const& evictor, uint32_t blk_size);
+    BlkReadCache(BlkReadCache const&) = delete;
+    BlkReadCache(BlkReadCache&&) noexcept = delete;
+    BlkReadCache& operator=(BlkReadCache const&) = delete;
+    BlkReadCache& operator=(BlkReadCache&&) noexcept = delete;
+    ~BlkReadCache() = default;
+
+    /**
+     * @brief : copy the data of all the blks of bid into iovs. Returns false if any of the blks is not cached, in
+     * which case the iovs could be partially filled.
+     */
+    bool read(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size);
+
+    /// @brief Add the data of the blks of bid, read into iovs, to the cache
+    void insert(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size);
+
+    void invalidate(MultiBlkId const& bids);
+
+private:
+    uint32_t m_blk_size;
+    sisl::SimpleCache< BlkId, cached_blk_ptr > m_cache;
+    BlkReadCacheMetrics m_metrics;
+};
+
+//
+// BlkWriteStamps stamps the blks with a sequence number on every write submitted or completed on them, so that a read
+// can tell whether any write raced with it: the read takes now() before it is issued and its data is from before or
+// after every write on its blks only if none of them is written_since() then. Stamps are kept per group of blks,
+// hashed onto a fixed number of slots, so blks sharing a slot only make each other look written more often.
+//
+class BlkWriteStamps {
+public:
+    BlkWriteStamps() = default;
+    BlkWriteStamps(BlkWriteStamps const&) = delete;
+    BlkWriteStamps(BlkWriteStamps&&) noexcept = delete;
+    BlkWriteStamps& operator=(BlkWriteStamps const&) = delete;
+    BlkWriteStamps& operator=(BlkWriteStamps&&) noexcept = delete;
+    ~BlkWriteStamps() = default;
+
+    uint64_t now() const { return m_seq.load(); }
+
+    /// @brief Stamp the blks as written, has to be done before the cached data of the blks is invalidated
+    void on_write(MultiBlkId const& bids);
+
+    bool written_since(BlkId const& bid, uint64_t stamp) const;
+
+private:
+    static constexpr uint32_t s_num_slots{8192};
+    static constexpr uint32_t s_blks_per_slot_shift{3};
+
+    static uint32_t slot_of(chunk_num_t chunk_num, uint64_t blk_group);
+
+private:
+    std::atomic< uint64_t > m_seq{0};
+    std::array< std::atomic< uint64_t >, s_num_slots > m_slots{};
+};
+} // namespace homestore
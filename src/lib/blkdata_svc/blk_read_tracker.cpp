@@ -12,18 +12,34 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+
 #include "blk_read_tracker.hpp"
 #include "common/homestore_assert.hpp"
 
 namespace homestore {
 static BlkId extract_key(const BlkTrackRecord& rec) { return rec.m_key; }
 
-BlkReadTracker::BlkReadTracker() : m_pending_reads_map(s_expected_num_records, extract_key, nullptr /* access_cb */) {}
+BlkReadTracker::BlkReadTracker(uint32_t num_shards) {
+    num_shards = std::max(num_shards, 1u);
+    m_shards.reserve(num_shards);
+    for (uint32_t i{0}; i < num_shards; ++i) {
+        m_shards.emplace_back(std::make_unique< pending_map_t >(
+            std::max(s_expected_num_records / num_shards, 16u), extract_key, nullptr /* access_cb */));
+    }
+}
 
 BlkReadTracker::~BlkReadTracker() = default;
 
 // BlkReadTrackerMetrics& BlkReadTracker::get_metrics() { return m_metrics; }
 
+BlkReadTracker::pending_map_t& BlkReadTracker::shard_of(BlkId const& base_blkid) {
+    // Adjacent records of the same chunk go to adjacent shards, so that a large read is spread as well
+    auto const idx = (uint64_cast(base_blkid.chunk_num()) * 31 + (base_blkid.blk_num() / entries_per_record())) %
+        m_shards.size();
+    return *m_shards[idx];
+}
+
 void BlkReadTracker::merge(const BlkId& blkid, int64_t new_ref_count,
                            const std::shared_ptr< blk_track_waiter >& waiter) {
     HS_DBG_ASSERT(new_ref_count ? waiter == nullptr : waiter != nullptr, "Invalid waiter");
@@ -39,15 +55,15 @@ void BlkReadTracker::merge(const BlkId& blkid, int64_t new_ref_count,
 
         if (new_ref_count > 0) {
             // This is an insert operation
-            m_pending_reads_map.upsert_or_delete(base_blkid,
-                                                 [&base_blkid, new_ref_count](BlkTrackRecord& rec, bool existing) {
-                                                     if (!existing) { rec.m_key = base_blkid; }
-                                                     rec.m_ref_cnt += new_ref_count;
-                                                     return false;
-                                                 });
+            shard_of(base_blkid).upsert_or_delete(base_blkid,
+                                                  [&base_blkid, new_ref_count](BlkTrackRecord& rec, bool existing) {
+                                                      if (!existing) { rec.m_key = base_blkid; }
+                                                      rec.m_ref_cnt += new_ref_count;
+                                                      return false;
+                                                  });
         } else if (new_ref_count < 0) {
             // This is a remove operation
-            m_pending_reads_map.upsert_or_delete(
+            shard_of(base_blkid).upsert_or_delete(
                 base_blkid, [new_ref_count, &base_blkid](BlkTrackRecord& rec, bool existing) {
                     HS_DBG_ASSERT_EQ(existing, true, "Decrement a ref count (blk: {}) which does not exist in map",
                                      base_blkid.to_string());
@@ -56,7 +72,7 @@ void BlkReadTracker::merge(const BlkId& blkid, int64_t new_ref_count,
                 });
         } else {
             // this is wait_on operation
-            m_pending_reads_map.update(base_blkid, [&waiter_rescheduled, &waiter](BlkTrackRecord& rec) {
+            shard_of(base_blkid).update(base_blkid, [&waiter_rescheduled, &waiter](BlkTrackRecord& rec) {
                 rec.m_waiters.push_back(waiter);
                 waiter_rescheduled = true;
             });
@@ -14,6 +14,8 @@
  *********************************************************************************/
 #pragma once
 #include <functional>
+#include <memory>
+#include <vector>
 
 #include <folly/small_vector.h>
 #include <sisl/cache/simple_hashmap.hpp>
@@ -108,17 +110,26 @@ public:
     ~BlkReadTrackerMetrics() { deregister_me_from_farm(); }
 };
 
+//
+// Pending reads are partitioned into shards, each its own hash map. A record is placed in a shard by its chunk and
+// aligned base blk, so concurrent reads (even on the same chunk) mostly land on different shards and do not contend
+// with each other. Since every operation works record by record, a waiter spanning multiple records across shards
+// still gets called only once the last of them is released.
+//
 class BlkReadTracker {
     static constexpr uint32_t s_expected_num_records = 1000;
     static constexpr uint16_t s_entries_per_record = 8; // this number could be candidate to tune perf;
+    static constexpr uint32_t s_default_num_shards = 32;
+
+    using pending_map_t = sisl::SimpleHashMap< BlkId, BlkTrackRecord >;
 
 private:
-    sisl::SimpleHashMap< BlkId, BlkTrackRecord > m_pending_reads_map;
+    std::vector< std::unique_ptr< pending_map_t > > m_shards;
     BlkReadTrackerMetrics m_metrics;
     uint32_t m_entries_per_record{s_entries_per_record};
 
 public:
-    BlkReadTracker();
+    explicit BlkReadTracker(uint32_t num_shards = s_default_num_shards);
     ~BlkReadTracker();
 
     BlkReadTracker(const BlkReadTracker&) = delete;
@@ -175,5 +186,7 @@ private:
      * @param waiters
      */
     void merge(const BlkId& blkid, int64_t new_ref_count, const std::shared_ptr< blk_track_waiter >& waiters);
+
+    pending_map_t& shard_of(BlkId const& base_blkid);
 };
 } // namespace homestore
@@ -13,32 +13,61 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <optional>
+
 #include <homestore/blkdata_service.hpp>
+#include <homestore/blkdata_stream_writer.hpp>
 #include <homestore/homestore.hpp>
 #include <homestore/chunk_selector.h>
+#include <homestore/tracer.hpp>
 
 #include "device/chunk.h"
 #include "device/virtual_dev.hpp"
 #include "device/physical_dev.hpp"     // vdev_info_block
+#include "device/vdev_io_batch.hpp"
 #include "common/homestore_config.hpp" // is_data_drive_hdd
 #include "common/homestore_assert.hpp"
+#include "common/homestore_utils.hpp"
 #include "common/error.h"
 #include "blk_read_tracker.hpp"
+#include "blk_free_epoch.hpp"
+#include "blk_csum_table.hpp"
+#include "blk_compress.hpp"
+#include "blk_read_cache.hpp"
+#include "blkdata_svc_metrics.hpp"
 #include "data_svc_cp.hpp"
+#include "append_chunk_gc.hpp"
 
 namespace homestore {
 
+static const std::string s_fast_tier_vdev_name{"blkdata_fast"};
+
 BlkDataService& data_service() { return hs()->data_service(); }
 
 BlkDataService::BlkDataService(shared< ChunkSelector > chunk_selector) :
         m_custom_chunk_selector{std::move(chunk_selector)} {
     m_blk_read_tracker = std::make_unique< BlkReadTracker >();
+    if (HS_DYNAMIC_CONFIG(generic.data_epoch_based_free)) {
+        m_free_epoch = std::make_unique< BlkFreeEpoch >(
+            [this](std::vector< pending_free_t >&& frees) { release_deferred_frees(std::move(frees)); });
+    }
+    if (HS_DYNAMIC_CONFIG(generic.data_csum_enabled)) {
+        m_csum_table = std::make_unique< BlkCsumTable >([this](chunk_num_t chunk_num) {
+            auto const* chunk = hs()->device_mgr()->get_chunk(chunk_num);
+            return chunk ? blk_num_t(chunk->size() / m_blk_size) : blk_num_t{0};
+        });
+    }
+}
+BlkDataService::~BlkDataService() {
+    stop_append_gc();
+
+    // Destroyed on shutdown after the final cp
+    if (m_csum_table) { m_csum_table->shutdown(); }
 }
-BlkDataService::~BlkDataService() = default;
 
 // first-time boot path
 void BlkDataService::create_vdev(uint64_t size, HSDevType devType, uint32_t blk_size, blk_allocator_type_t alloc_type,
-                                 chunk_selector_type_t chunk_sel_type, uint32_t num_chunks) {
+                                 chunk_selector_type_t chunk_sel_type, uint32_t num_chunks, uint64_t fast_tier_size) {
     hs_vdev_context vdev_ctx;
     vdev_ctx.type = hs_vdev_type_t::DATA_VDEV;
 
@@ -53,13 +82,37 @@ void BlkDataService::create_vdev(uint64_t size, HSDevType devType, uint32_t blk_
                                                         .chunk_sel_type = chunk_sel_type,
                                                         .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
                                                         .context_data = vdev_ctx.to_blob()});
+
+    if (fast_tier_size > 0) {
+        // Fast tier shares the blk size of the capacity tier, so that blks could be migrated as is
+        m_fast_vdev = hs()->device_mgr()->create_vdev(
+            vdev_parameters{.vdev_name = s_fast_tier_vdev_name,
+                            .vdev_size = fast_tier_size,
+                            .num_chunks = num_chunks,
+                            .blk_size = blk_size,
+                            .dev_type = HSDevType::Fast,
+                            .alloc_type = alloc_type,
+                            .chunk_sel_type = chunk_selector_type_t::ROUND_ROBIN,
+                            .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
+                            .context_data = vdev_ctx.to_blob()});
+    }
 }
 
 // both first_time_boot and recovery path will come here
 shared< VirtualDev > BlkDataService::open_vdev(const vdev_info& vinfo, bool load_existing) {
+    if (vinfo.get_name() == s_fast_tier_vdev_name) {
+        if (!m_fast_vdev) {
+            m_fast_vdev = std::make_shared< VirtualDev >(*(hs()->device_mgr()), vinfo, nullptr,
+                                                         true /* auto_recovery */, nullptr);
+            m_fast_metrics = std::make_unique< BlkDataSvcMetrics >(vinfo.name);
+        }
+        return m_fast_vdev;
+    }
+
     if (m_vdev) return m_vdev;
     m_vdev = std::make_shared< VirtualDev >(*(hs()->device_mgr()), vinfo, nullptr, true /* auto_recovery */,
                                             std::move(m_custom_chunk_selector));
+    m_metrics = std::make_unique< BlkDataSvcMetrics >(vinfo.name);
     m_blk_size = vinfo.blk_size;
     return m_vdev;
 }
@@ -78,13 +131,56 @@ static auto collect_all_futures(std::vector< folly::Future< std::error_code > >&
 
 folly::Future< std::error_code > BlkDataService::async_read(MultiBlkId const& blkid, uint8_t* buf, uint32_t size,
                                                             bool part_of_batch) {
+    if (size > (blkid.blk_count() * m_blk_size)) {
+        return async_read_compressed(blkid, sisl::sg_iovs_t{iovec{buf, size}}, size, part_of_batch);
+    }
+    return decompress_if_needed(read_as_is(blkid, buf, size, part_of_batch), blkid,
+                                sisl::sg_iovs_t{iovec{buf, size}}, size);
+}
+
+folly::Future< std::error_code > BlkDataService::decompress_if_needed(folly::Future< std::error_code >&& f,
+                                                                      MultiBlkId const& blkid, sisl::sg_iovs_t iovs,
+                                                                      uint32_t size) {
+    return std::move(f).thenValue([this, blkid, iovs = std::move(iovs), size](std::error_code ec) {
+        if (ec || !has_compressed_blks(blkid) || !is_compressed_blks(iovs.data(), iovs.size(), blkid.piece(0))) {
+            return folly::makeFuture(ec);
+        }
+
+        // Read with less than what was compressed into the blks, all of them are needed to be able to decompress
+        COUNTER_INCREMENT(metrics_of(blkid), data_compressed_partial_reads, 1);
+        return async_read_compressed(blkid, iovs, size, false /* part_of_batch */);
+    });
+}
+
+folly::Future< std::error_code > BlkDataService::read_as_is(MultiBlkId const& blkid, uint8_t* buf, uint32_t size,
+                                                            bool part_of_batch) {
     auto do_read = [this](BlkId const& bid, uint8_t* buf, uint32_t size, bool part_of_batch) {
+        if (iovec const iov{buf, size}; read_from_cache(bid, &iov, 1, size)) {
+            return folly::makeFuture< std::error_code >(std::error_code{});
+        }
+        auto const stamp = write_stamp_now();
+
+        if (m_free_epoch) {
+            auto const t = m_free_epoch->enter();
+            return vdev_of(bid)
+                ->async_read(r_cast< char* >(buf), size, bid, part_of_batch)
+                .thenValue([this, t, bid, buf, size, stamp](auto&& ec) {
+                    iovec const iov{buf, size};
+                    ec = on_read_completion(bid, &iov, 1, size, stamp, ec);
+                    m_free_epoch->exit(t);
+                    return folly::makeFuture< std::error_code >(std::move(ec));
+                });
+        }
         m_blk_read_tracker->insert(bid);
 
-        return m_vdev->async_read(r_cast< char* >(buf), size, bid, part_of_batch).thenValue([this, bid](auto&& ec) {
-            m_blk_read_tracker->remove(bid);
-            return folly::makeFuture< std::error_code >(std::move(ec));
-        });
+        return vdev_of(bid)
+            ->async_read(r_cast< char* >(buf), size, bid, part_of_batch)
+            .thenValue([this, bid, buf, size, stamp](auto&& ec) {
+                iovec const iov{buf, size};
+                ec = on_read_completion(bid, &iov, 1, size, stamp, ec);
+                m_blk_read_tracker->remove(bid);
+                return folly::makeFuture< std::error_code >(std::move(ec));
+            });
     };
 
     if (blkid.num_pieces() == 1) {
@@ -106,14 +202,37 @@ folly::Future< std::error_code > BlkDataService::async_read(MultiBlkId const& bl
 
 folly::Future< std::error_code > BlkDataService::async_read(MultiBlkId const& blkid, sisl::sg_list& sgs, uint32_t size,
                                                             bool part_of_batch) {
+    if (size > (blkid.blk_count() * m_blk_size)) { return async_read_compressed(blkid, sgs.iovs, size, part_of_batch); }
+    return decompress_if_needed(read_as_is(blkid, sgs, size, part_of_batch), blkid, sgs.iovs, size);
+}
+
+folly::Future< std::error_code > BlkDataService::read_as_is(MultiBlkId const& blkid, sisl::sg_list const& sgs,
+                                                            uint32_t size, bool part_of_batch) {
     // TODO: sg_iovs_t should not be passed by value. We need it pass it as const&, but that is failing because
     // iovs.data() will then return "const iovec*", but unfortunately all the way down to iomgr, we take iovec*
     // instead it can easily take "const iovec*". Until we change this is made as copy by value
     auto do_read = [this](BlkId const& bid, sisl::sg_iovs_t iovs, uint32_t size, bool part_of_batch) {
+        if (read_from_cache(bid, iovs.data(), iovs.size(), size)) {
+            return folly::makeFuture< std::error_code >(std::error_code{});
+        }
+        auto const stamp = write_stamp_now();
+
+        if (m_free_epoch) {
+            auto const t = m_free_epoch->enter();
+            return vdev_of(bid)
+                ->async_readv(iovs.data(), iovs.size(), size, bid, part_of_batch)
+                .thenValue([this, t, bid, iovs, size, stamp](auto&& ec) {
+                    ec = on_read_completion(bid, iovs.data(), iovs.size(), size, stamp, ec);
+                    m_free_epoch->exit(t);
+                    return folly::makeFuture< std::error_code >(std::move(ec));
+                });
+        }
         m_blk_read_tracker->insert(bid);
 
-        return m_vdev->async_readv(iovs.data(), iovs.size(), size, bid, part_of_batch)
-            .thenValue([this, bid](auto&& ec) {
+        return vdev_of(bid)
+            ->async_readv(iovs.data(), iovs.size(), size, bid, part_of_batch)
+            .thenValue([this, bid, iovs, size, stamp](auto&& ec) {
+                ec = on_read_completion(bid, iovs.data(), iovs.size(), size, stamp, ec);
                 m_blk_read_tracker->remove(bid);
                 return folly::makeFuture< std::error_code >(std::move(ec));
             });
@@ -136,9 +255,77 @@ folly::Future< std::error_code > BlkDataService::async_read(MultiBlkId const& bl
     }
 }
 
+folly::Future< std::error_code >
+BlkDataService::async_read(std::vector< std::pair< MultiBlkId, sisl::sg_list > > const& reqs, bool part_of_batch) {
+    std::vector< folly::Future< std::error_code > > futs;
+
+    // One epoch entry covers all the reads of this call, exited only once every one of them is done
+    std::optional< BlkFreeEpoch::token > token;
+    if (m_free_epoch) { token = m_free_epoch->enter(); }
+
+    VDevIOBatch batch{*m_vdev};
+    std::optional< VDevIOBatch > fast_batch;
+    if (m_fast_vdev) { fast_batch.emplace(*m_fast_vdev); }
+
+    std::vector< folly::Future< std::error_code > > req_futs;
+    for (auto const& [blkid, sgs] : reqs) {
+        if (sgs.size > (blkid.blk_count() * m_blk_size)) {
+            futs.emplace_back(async_read_compressed(blkid, sgs.iovs, sgs.size, part_of_batch));
+            continue;
+        }
+
+        req_futs.clear();
+        sisl::sg_iterator sg_it{sgs.iovs};
+        auto blkid_it = blkid.iterate();
+        while (auto const bid = blkid_it.next()) {
+            uint32_t const sz = (blkid.num_pieces() == 1) ? uint32_cast(sgs.size) : bid->blk_count() * m_blk_size;
+            auto iovs = sg_it.next_iovs(sz);
+            if (read_from_cache(*bid, iovs.data(), iovs.size(), sz)) { continue; }
+
+            if (!m_free_epoch) { m_blk_read_tracker->insert(*bid); }
+            auto& b = (vdev_of(*bid) == m_vdev.get()) ? batch : *fast_batch;
+            auto const stamp = write_stamp_now();
+            req_futs.emplace_back(b.add_readv(iovs.data(), iovs.size(), sz, *bid)
+                                      .thenValue([this, bid = *bid, iovs, sz, stamp](std::error_code ec) {
+                                          ec = on_read_completion(bid, iovs.data(), iovs.size(), sz, stamp, ec);
+                                          if (!m_free_epoch) { m_blk_read_tracker->remove(bid); }
+                                          return ec;
+                                      }));
+        }
+        futs.emplace_back(decompress_if_needed(collect_all_futures(req_futs), blkid, sgs.iovs, uint32_cast(sgs.size)));
+    }
+
+    batch.submit(!part_of_batch);
+    if (fast_batch) { fast_batch->submit(!part_of_batch); }
+
+    return collect_all_futures(futs).thenValue([this, token](std::error_code ec) {
+        if (token) { m_free_epoch->exit(*token); }
+        return ec;
+    });
+}
+
 folly::Future< std::error_code > BlkDataService::async_alloc_write(const sisl::sg_list& sgs,
                                                                    const blk_alloc_hints& hints, MultiBlkId& out_blkids,
                                                                    bool part_of_batch) {
+    if (HS_DYNAMIC_CONFIG(generic.data_compress_writes)) {
+        auto const [cbuf, csize] = compress_to_blks(sgs.iovs, sgs.size, m_blk_size, get_align_size());
+        if (cbuf != nullptr) {
+            if (alloc_blks(csize, hints, out_blkids) != BlkAllocStatus::SUCCESS) {
+                hs_utils::iobuf_free(cbuf, sisl::buftag::data);
+                return folly::makeFuture< std::error_code >(
+                    std::make_error_code(std::errc::resource_unavailable_try_again));
+            }
+            set_has_compressed_blks(out_blkids);
+            bind_compressed_blks(cbuf, out_blkids.piece(0));
+            COUNTER_INCREMENT(metrics_of(out_blkids), data_user_write_bytes, sgs.size);
+            return write_to_vdev(r_cast< const char* >(cbuf), csize, out_blkids, part_of_batch)
+                .thenValue([buf = cbuf](std::error_code ec) {
+                    hs_utils::iobuf_free(buf, sisl::buftag::data);
+                    return ec;
+                });
+        }
+    }
+
     const auto status = alloc_blks(sgs.size, hints, out_blkids);
     if (status != BlkAllocStatus::SUCCESS) {
         return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
@@ -146,23 +333,57 @@ folly::Future< std::error_code > BlkDataService::async_alloc_write(const sisl::s
     return async_write(sgs, out_blkids, part_of_batch);
 }
 
+folly::Future< std::error_code > BlkDataService::async_alloc_write(sisl::sg_list const& sgs,
+                                                                   blk_alloc_hints const& hints,
+                                                                   std::vector< MultiBlkId >& out_blkids,
+                                                                   bool part_of_batch) {
+    HS_DBG_ASSERT_EQ(sgs.size % m_blk_size, 0, "Non aligned size requested");
+    size_t const start = out_blkids.size();
+    auto const nblks = s_cast< blk_count_t >(sgs.size / m_blk_size);
+    if (m_vdev->alloc_striped_blks(nblks, hints, out_blkids) != BlkAllocStatus::SUCCESS) {
+        return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+    if (out_blkids.size() == start + 1) { return async_write(sgs, out_blkids.back(), part_of_batch); }
+
+    // Stripes are on different pdevs, issue all of them in one batch so they are written in parallel. Their iovs are
+    // kept until all of them complete, since batched ios are submitted only later.
+    auto stripe_sgs = std::make_shared< std::vector< sisl::sg_list > >();
+    stripe_sgs->reserve(out_blkids.size() - start);
+    std::vector< folly::Future< std::error_code > > futs;
+    sisl::sg_iterator sg_it{sgs.iovs};
+    for (size_t i{start}; i < out_blkids.size(); ++i) {
+        uint64_t const sz = out_blkids[i].blk_count() * m_blk_size;
+        auto& stripe_sg = stripe_sgs->emplace_back();
+        stripe_sg.size = sz;
+        stripe_sg.iovs = sg_it.next_iovs(sz);
+        futs.emplace_back(async_write(stripe_sg, out_blkids[i], true /* part_of_batch */));
+    }
+    if (!part_of_batch) { submit_io_batch(); }
+
+    return collect_all_futures(futs).thenValue([stripe_sgs](std::error_code ec) { return ec; });
+}
+
 folly::Future< std::error_code > BlkDataService::async_write(const char* buf, uint32_t size, MultiBlkId const& blkid,
                                                              bool part_of_batch) {
+    COUNTER_INCREMENT(metrics_of(blkid), data_user_write_bytes, size);
+    return write_to_vdev(buf, size, blkid, part_of_batch);
+}
+
+folly::Future< std::error_code > BlkDataService::write_to_vdev(const char* buf, uint32_t size, MultiBlkId const& blkid,
+                                                               bool part_of_batch) {
+    // Blks are expected to be fresh, unless the consumer overwrites in place, in which case cached data is stale
+    on_blks_written(blkid);
+
+    auto const start_time = Clock::now();
+    auto iovs = m_csum_table ? sisl::sg_iovs_t{iovec{const_cast< char* >(buf), size}} : sisl::sg_iovs_t{};
     if (blkid.num_pieces() == 1) {
         // Shortcut to most common case
-        return m_vdev->async_write(buf, size, blkid.to_single_blkid(), part_of_batch);
+        return on_write_submitted(vdev_of(blkid)->async_write(buf, size, blkid.to_single_blkid(), part_of_batch),
+                                  blkid, std::move(iovs), start_time);
     } else {
-        static thread_local std::vector< folly::Future< std::error_code > > s_futs;
-        s_futs.clear();
-
-        const char* ptr = buf;
-        auto blkid_it = blkid.iterate();
-        while (auto const bid = blkid_it.next()) {
-            uint32_t sz = bid->blk_count() * m_blk_size;
-            s_futs.emplace_back(m_vdev->async_write(ptr, sz, *bid, part_of_batch));
-            ptr += sz;
-        }
-        return collect_all_futures(s_futs);
+        // vdev splits the buffer across the pieces and coalesces the physically contiguous pieces into single io
+        return on_write_submitted(vdev_of(blkid)->async_write(buf, size, blkid, part_of_batch), blkid,
+                                  std::move(iovs), start_time);
     }
 }
 
@@ -171,20 +392,19 @@ folly::Future< std::error_code > BlkDataService::async_write(sisl::sg_list const
     // TODO: Async write should pass this by value the sgs.size parameter as well, currently vdev write routine
     // walks through again all the iovs and then getting the len to pass it down to iomgr. This defeats the purpose of
     // taking size parameters (which was done exactly done to avoid this walk through)
+    on_blks_written(blkid);
+    COUNTER_INCREMENT(metrics_of(blkid), data_user_write_bytes, sgs.size);
+
+    auto const start_time = Clock::now();
+    auto iovs = m_csum_table ? sgs.iovs : sisl::sg_iovs_t{};
     if (blkid.num_pieces() == 1) {
         // Shortcut to most common case
-        return m_vdev->async_writev(sgs.iovs.data(), sgs.iovs.size(), blkid.to_single_blkid(), part_of_batch);
+        return on_write_submitted(
+            vdev_of(blkid)->async_writev(sgs.iovs.data(), sgs.iovs.size(), blkid.to_single_blkid(), part_of_batch),
+            blkid, std::move(iovs), start_time);
     } else {
-        static thread_local std::vector< folly::Future< std::error_code > > s_futs;
-        s_futs.clear();
-        sisl::sg_iterator sg_it{sgs.iovs};
-
-        auto blkid_it = blkid.iterate();
-        while (auto const bid = blkid_it.next()) {
-            const auto iovs = sg_it.next_iovs(bid->blk_count() * m_blk_size);
-            s_futs.emplace_back(m_vdev->async_writev(iovs.data(), iovs.size(), *bid, part_of_batch));
-        }
-        return collect_all_futures(s_futs);
+        return on_write_submitted(vdev_of(blkid)->async_writev(sgs.iovs.data(), sgs.iovs.size(), blkid, part_of_batch),
+                                  blkid, std::move(iovs), start_time);
     }
 }
 
@@ -192,34 +412,85 @@ BlkAllocStatus BlkDataService::alloc_blks(uint32_t size, const blk_alloc_hints&
     HS_DBG_ASSERT_EQ(size % m_blk_size, 0, "Non aligned size requested");
     blk_count_t nblks = static_cast< blk_count_t >(size / m_blk_size);
 
+    if (should_place_on_fast_tier(hints)) {
+        auto const status = m_fast_vdev->alloc_blks(nblks, hints, out_blkids);
+        if (status == BlkAllocStatus::SUCCESS) { return status; }
+        out_blkids = MultiBlkId{};
+    }
     return m_vdev->alloc_blks(nblks, hints, out_blkids);
 }
 
 BlkAllocStatus BlkDataService::commit_blk(MultiBlkId const& blkid) {
     if (blkid.num_pieces() == 1) {
         // Shortcut to most common case
-        return m_vdev->commit_blk(blkid);
+        return vdev_of(blkid)->commit_blk(blkid);
     }
-    auto it = blkid.iterate();
-    while (auto const bid = it.next()) {
-        auto alloc_status = m_vdev->commit_blk(*bid);
+    auto* vdev = vdev_of(blkid);
+    for (auto const bid : blkid.pieces()) {
+        auto alloc_status = vdev->commit_blk(bid);
         if (alloc_status != BlkAllocStatus::SUCCESS) return alloc_status;
     }
     return BlkAllocStatus::SUCCESS;
 }
 
+BlkAllocStatus BlkDataService::reserve_blk(BlkId const& bid, std::vector< BlkId >& out_reserved) {
+    return vdev_of(bid)->reserve_blk(bid, out_reserved);
+}
+
+void BlkDataService::unreserve_blk(BlkId const& bid) { vdev_of(bid)->unreserve_blk(bid); }
+
+bool BlkDataService::is_blk_alloced(BlkId const& bid) const { return vdev_of(bid)->is_blk_alloced(bid); }
+
+blk_num_t BlkDataService::num_blks_of_chunk(chunk_num_t chunk_num) const {
+    return vdev_of(BlkId{0, 1, chunk_num})->num_blks_of_chunk(chunk_num);
+}
+
+uint64_t BlkDataService::read_tail_latency_us(BlkId const& bid) const {
+    auto const* chunk = hs()->device_mgr()->get_chunk(bid.chunk_num());
+    return chunk ? chunk->physical_dev()->read_tail_latency_us() : 0;
+}
+
+void BlkDataService::set_io_tenant_weight(io_tenant_t tenant, uint32_t weight) {
+    m_vdev->set_io_tenant_weight(tenant, weight);
+    if (m_fast_vdev) { m_fast_vdev->set_io_tenant_weight(tenant, weight); }
+}
+
+void BlkDataService::remove_io_tenant(io_tenant_t tenant) {
+    m_vdev->remove_io_tenant(tenant);
+    if (m_fast_vdev) { m_fast_vdev->remove_io_tenant(tenant); }
+}
+
+nlohmann::json BlkDataService::io_tenant_usage() const {
+    auto j = m_vdev->io_tenant_usage();
+    if (m_fast_vdev) { j["fast_tier"] = m_fast_vdev->io_tenant_usage(); }
+    return j;
+}
+
+shared< BlkDataStreamWriter > BlkDataService::open_stream_writer(blk_alloc_hints const& hints,
+                                                                 uint32_t max_inflight) {
+    if (max_inflight == 0) { max_inflight = HS_DYNAMIC_CONFIG(generic.data_stream_max_inflight_writes); }
+    return std::make_shared< BlkDataStreamWriter >(hints, max_inflight);
+}
+
 folly::Future< std::error_code > BlkDataService::async_free_blk(MultiBlkId const& bids) {
     // create blk read waiter instance;
     folly::Promise< std::error_code > promise;
     auto f = promise.getFuture();
 
-    if (!m_vdev->is_blk_exist(bids)) {
+    auto* vdev = vdev_of(bids);
+    if (!vdev->is_blk_exist(bids)) {
         promise.setValue(std::make_error_code(std::errc::resource_unavailable_try_again));
+    } else if (m_free_epoch) {
+        m_free_epoch->defer_free(bids, std::move(promise));
     } else {
-        m_blk_read_tracker->wait_on(bids, [this, bids, p = std::move(promise)]() mutable {
+        m_blk_read_tracker->wait_on(bids, [this, vdev, bids, p = std::move(promise)]() mutable {
             {
                 auto cpg = hs()->cp_mgr().cp_guard();
-                m_vdev->free_blk(bids, s_cast< VDevCPContext* >(cpg.context(cp_consumer_t::BLK_DATA_SVC)));
+                auto ctx = s_cast< VDevCPContext* >(cpg.context(cp_consumer_t::BLK_DATA_SVC));
+                if (vdev == m_fast_vdev.get()) { ctx = s_cast< DataSvcCPContext* >(ctx)->fast_tier_ctx(); }
+                if (m_csum_table) { m_csum_table->clear(bids); }
+                if (m_read_cache) { m_read_cache->invalidate(bids); }
+                vdev->free_blk(bids, ctx);
             }
             p.setValue(std::error_code{});
         });
@@ -228,16 +499,235 @@ folly::Future< std::error_code > BlkDataService::async_free_blk(MultiBlkId const
     return f;
 }
 
+folly::Future< std::error_code > BlkDataService::wait_for_reads(std::vector< MultiBlkId > const& bids) {
+    if (m_free_epoch) {
+        folly::Promise< std::error_code > promise;
+        auto f = promise.getFuture();
+        m_free_epoch->wait_for_readers(std::move(promise));
+        return f;
+    }
+
+    std::vector< folly::Future< std::error_code > > futs;
+    futs.reserve(bids.size());
+    for (auto const& b : bids) {
+        folly::Promise< std::error_code > promise;
+        futs.emplace_back(promise.getFuture());
+        m_blk_read_tracker->wait_on(b, [p = std::move(promise)]() mutable { p.setValue(std::error_code{}); });
+    }
+    return folly::collectAllUnsafe(futs).thenValue([](auto&&) { return std::error_code{}; });
+}
+
+void BlkDataService::release_deferred_frees(std::vector< pending_free_t >&& frees) {
+    // Frees released together are batched per vdev, so that allocator locks are taken once for all of them
+    static thread_local std::vector< BlkId > s_bids;
+    static thread_local std::vector< BlkId > s_fast_bids;
+    s_bids.clear();
+    s_fast_bids.clear();
+    for (auto const& f : frees) {
+        if (!f.bids.is_valid()) { continue; } // Only waiting for the readers, see wait_for_reads
+        if (m_csum_table) { m_csum_table->clear(f.bids); }
+        if (m_read_cache) { m_read_cache->invalidate(f.bids); }
+        auto& bids = (vdev_of(f.bids) == m_fast_vdev.get()) ? s_fast_bids : s_bids;
+        for (auto const b : f.bids.pieces()) {
+            bids.push_back(b);
+        }
+    }
+
+    {
+        auto cpg = hs()->cp_mgr().cp_guard();
+        auto ctx = s_cast< VDevCPContext* >(cpg.context(cp_consumer_t::BLK_DATA_SVC));
+        if (!s_bids.empty()) { m_vdev->free_blks(s_bids, ctx); }
+        if (!s_fast_bids.empty()) {
+            m_fast_vdev->free_blks(s_fast_bids, s_cast< DataSvcCPContext* >(ctx)->fast_tier_ctx());
+        }
+    }
+
+    for (auto& f : frees) {
+        f.promise.setValue(std::error_code{});
+    }
+}
+
+folly::Future< std::error_code > BlkDataService::async_read_compressed(MultiBlkId const& blkid, sisl::sg_iovs_t iovs,
+                                                                       uint32_t size, bool part_of_batch) {
+    // Read all the blks as is (tracked and verified like any other read) and decompress into caller's buffer
+    uint32_t const raw_size = blkid.blk_count() * m_blk_size;
+    auto* raw = hs_utils::iobuf_alloc(raw_size, sisl::buftag::data, get_align_size());
+    return read_as_is(blkid, raw, raw_size, part_of_batch)
+        .thenValue([raw, raw_size, first_blk = blkid.piece(0), iovs = std::move(iovs), size](std::error_code ec) {
+            if (!ec) { ec = decompress_from_blks(raw, raw_size, first_blk, iovs, size); }
+            hs_utils::iobuf_free(raw, sisl::buftag::data);
+            return ec;
+        });
+}
+
+bool BlkDataService::has_compressed_blks(BlkId const& bid) const {
+    auto const* chunk = hs()->device_mgr()->get_chunk(bid.chunk_num());
+    return chunk && chunk->has_compressed_blks();
+}
+
+void BlkDataService::set_has_compressed_blks(BlkId const& bid) {
+    // Once set, it is only an atomic load, persisted once for every chunk
+    auto* chunk = hs()->device_mgr()->get_chunk_mutable(bid.chunk_num());
+    if (!chunk->has_compressed_blks()) { chunk->set_has_compressed_blks(); }
+}
+
+bool BlkDataService::read_from_cache(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size) {
+    if (!m_read_cache || (size > HS_DYNAMIC_CONFIG(generic.data_read_cache_max_io_kb) * 1024)) { return false; }
+    return m_read_cache->read(bid, iovs, niovs, size);
+}
+
+uint64_t BlkDataService::write_stamp_now() const { return m_write_stamps ? m_write_stamps->now() : 0; }
+
+std::error_code BlkDataService::on_read_completion(BlkId const& bid, iovec const* iovs, size_t niovs, uint32_t size,
+                                                   uint64_t write_stamp, std::error_code ec) {
+    if (ec || !m_write_stamps) { return ec; }
+
+    // Read which raced with an overwrite of its blks has the data from before or after it (or a mix of both), which
+    // can neither be verified against the csum of either of them nor cached
+    if (m_write_stamps->written_since(bid, write_stamp)) { return ec; }
+    if (m_csum_table && !m_csum_table->verify(bid, iovs, niovs, size, m_blk_size)) {
+        return std::make_error_code(std::errc::bad_message);
+    }
+
+    // Has to be added while the read still holds off the free of these blks (see BlkReadCache). An overwrite stamps
+    // the blks before invalidating them, so it is seen here if it started after the check above and could have missed
+    // this insert.
+    if (m_read_cache && (size <= HS_DYNAMIC_CONFIG(generic.data_read_cache_max_io_kb) * 1024)) {
+        m_read_cache->insert(bid, iovs, niovs, size);
+        if (m_write_stamps->written_since(bid, write_stamp)) { m_read_cache->invalidate(bid); }
+    }
+    return ec;
+}
+
+void BlkDataService::on_blks_written(MultiBlkId const& blkid) {
+    if (m_write_stamps) { m_write_stamps->on_write(blkid); }
+    if (m_read_cache) { m_read_cache->invalidate(blkid); }
+}
+
+folly::Future< std::error_code > BlkDataService::on_write_submitted(folly::Future< std::error_code >&& f,
+                                                                    MultiBlkId const& blkid, sisl::sg_iovs_t iovs,
+                                                                    Clock::time_point start_time) {
+    // Buffer is owned by the caller until the write completes, so csum is computed on completion instead of delaying
+    // the submission. Caller sees the write complete only after the csum is in place.
+    return std::move(f).thenValue([this, blkid, iovs = std::move(iovs), start_time,
+                                   trace_id = Tracer::current()](std::error_code ec) {
+        auto& metrics = metrics_of(blkid);
+        auto const io_done_time = Clock::now();
+        HISTOGRAM_OBSERVE(metrics, data_write_io_latency_us, get_elapsed_time_us(start_time, io_done_time));
+        if (!ec && m_csum_table) { m_csum_table->update(blkid, iovs.data(), iovs.size(), m_blk_size); }
+
+        // A read which raced with the write could have cached what it read before the write landed (or whatever is
+        // left there if the write failed), the stamp keeps the reads still in flight from caching it as well
+        on_blks_written(blkid);
+        HISTOGRAM_OBSERVE(metrics, data_write_comp_latency_us, get_elapsed_time_us(io_done_time));
+        Tracer::record(trace_id, "data_write", start_time, uint64_cast(blkid.blk_count()));
+        return ec;
+    });
+}
+
 void BlkDataService::start() {
+    // Evictor is created by homestore only at start, after the services are constructed
+    if (HS_DYNAMIC_CONFIG(generic.data_read_cache_enabled)) {
+        m_read_cache = std::make_unique< BlkReadCache >(hs()->evictor(), m_blk_size);
+    }
+    if (m_read_cache || m_csum_table) { m_write_stamps = std::make_unique< BlkWriteStamps >(); }
+    if (m_csum_table) { m_csum_table->start(); }
+
     // Register to CP for flush dirty buffers underlying virtual device layer;
     hs()->cp_mgr().register_consumer(cp_consumer_t::BLK_DATA_SVC,
-                                     std::move(std::make_unique< DataSvcCPCallbacks >(m_vdev)));
+                                     std::move(std::make_unique< DataSvcCPCallbacks >(m_vdev, m_fast_vdev,
+                                                                                      m_csum_table.get())));
+}
+
+uint64_t BlkDataService::get_total_capacity() const {
+    return m_vdev->size() + (m_fast_vdev ? m_fast_vdev->size() : 0);
+}
+
+uint64_t BlkDataService::get_used_capacity() const {
+    return m_vdev->used_size() + (m_fast_vdev ? m_fast_vdev->used_size() : 0);
 }
 
-uint64_t BlkDataService::get_total_capacity() const { return m_vdev->size(); }
+bool BlkDataService::is_in_fast_tier(MultiBlkId const& bid) const { return (vdev_of(bid) == m_fast_vdev.get()); }
+
+BlkDataSvcMetrics& BlkDataService::metrics_of(BlkId const& bid) const {
+    return (vdev_of(bid) == m_fast_vdev.get()) ? *m_fast_metrics : *m_metrics;
+}
 
-uint64_t BlkDataService::get_used_capacity() const { return m_vdev->used_size(); }
+VirtualDev* BlkDataService::vdev_of(BlkId const& bid) const {
+    if (m_fast_vdev) {
+        auto const* chunk = hs()->device_mgr()->get_chunk(bid.chunk_num());
+        if (chunk && (chunk->vdev_id() == m_fast_vdev->info().vdev_id)) { return m_fast_vdev.get(); }
+    }
+    return m_vdev.get();
+}
+
+bool BlkDataService::should_place_on_fast_tier(blk_alloc_hints const& hints) const {
+    // A specific chunk requested by the consumer (with custom chunk selector) is always honored as is
+    if (!m_fast_vdev || hints.chunk_id_hint) { return false; }
+    auto const max_used = (m_fast_vdev->size() * HS_DYNAMIC_CONFIG(generic.data_fast_tier_max_used_pct)) / 100;
+    return (m_fast_vdev->used_size() < max_used);
+}
+
+folly::Future< std::error_code > BlkDataService::async_migrate_to_capacity_tier(MultiBlkId const& src_bid,
+                                                                                MultiBlkId& out_blkids) {
+    if (!is_in_fast_tier(src_bid)) {
+        return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::invalid_argument));
+    }
+
+    uint32_t const size = src_bid.blk_count() * m_blk_size;
+    blk_alloc_hints hints;
+    hints.is_contiguous = false;
+    if (m_vdev->alloc_blks(src_bid.blk_count(), hints, out_blkids) != BlkAllocStatus::SUCCESS) {
+        return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::no_space_on_device));
+    }
+
+    auto* buf = hs_utils::iobuf_alloc(size, sisl::buftag::data, m_vdev->align_size(), m_vdev->numa_node());
+    auto free_on_error = [this, buf, dst = out_blkids](std::error_code ec) {
+        hs_utils::iobuf_free(buf, sisl::buftag::data);
+        if (ec) { m_vdev->free_blk(dst); }
+        return ec;
+    };
+
+    // Migration is not in the path of any consumer io, let it yield the device to them
+    io_priority_guard g{io_priority_t::background};
+    return read_as_is(src_bid, buf, size, false /* part_of_batch */)
+        .thenValue([this, buf, size, src_bid, dst = out_blkids, free_on_error](std::error_code ec) {
+            if (ec) { return folly::makeFuture< std::error_code >(free_on_error(ec)); }
+
+            // Compressed blks are copied as is, except that their header has to name the blks they are copied to
+            if (has_compressed_blks(src_bid) && rebind_compressed_blks(buf, size, src_bid.piece(0), dst.piece(0))) {
+                set_has_compressed_blks(dst);
+            }
+            io_priority_guard g{io_priority_t::background};
+            return m_vdev->async_write(r_cast< const char* >(buf), size, dst, false /* part_of_batch */)
+                .thenValue([this, buf, dst, free_on_error](std::error_code ec) {
+                    if (!ec && m_csum_table) { m_csum_table->update(dst, buf, m_blk_size); }
+                    return free_on_error(ec);
+                });
+        });
+}
 
 uint32_t BlkDataService::get_align_size() const { return m_vdev->align_size(); }
 
+void BlkDataService::submit_io_batch() {
+    m_vdev->submit_batch();
+    if (m_fast_vdev) { m_fast_vdev->submit_batch(); }
+}
+
+void BlkDataService::start_append_gc(gc_live_blks_cb_t live_blks_cb, gc_relocate_cb_t relocate_cb) {
+    HS_REL_ASSERT(m_vdev->info().alloc_type == s_cast< uint8_t >(blk_allocator_type_t::append),
+                  "append gc started on data vdev without append blk allocator");
+    HS_REL_ASSERT(!m_append_gc, "append gc is already started");
+    m_append_gc = std::make_unique< AppendChunkGC >(
+        m_vdev, std::move(live_blks_cb), std::move(relocate_cb),
+        [this](std::vector< MultiBlkId > const& bids) { return wait_for_reads(bids); }, m_csum_table.get());
+    m_append_gc->start();
+}
+
+void BlkDataService::stop_append_gc() {
+    if (m_append_gc) {
+        m_append_gc->stop();
+        m_append_gc.reset();
+    }
+}
 } // namespace homestore
@@ -0,0 +1,126 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+
+#include <homestore/blkdata_service.hpp>
+#include <homestore/blkdata_stream_writer.hpp>
+#include "common/homestore_assert.hpp"
+
+namespace homestore {
+BlkDataStreamWriter::BlkDataStreamWriter(blk_alloc_hints const& hints, uint32_t max_inflight) :
+        m_hints{hints}, m_max_inflight{std::max(max_inflight, 1u)} {}
+
+folly::Future< std::error_code > BlkDataStreamWriter::append(sisl::sg_list const& sgs) {
+    std::unique_lock lg{m_mtx};
+    HS_DBG_ASSERT(!m_closed, "append on stream writer after close");
+    if (m_closed) { return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::invalid_argument)); }
+    if (m_error) { return folly::makeFuture< std::error_code >(std::error_code{m_error}); }
+
+    piece p{sgs, m_blkids.size(), folly::Promise< std::error_code >{}};
+    auto f = p.promise.getFuture();
+    m_blkids.emplace_back();
+    m_appended_size += sgs.size;
+
+    if (m_inflight >= m_max_inflight) {
+        m_waiting.push_back(std::move(p));
+        return f;
+    }
+    ++m_inflight;
+    lg.unlock();
+
+    issue(std::move(p));
+    return f;
+}
+
+void BlkDataStreamWriter::issue(piece&& p) {
+    // Blks are allocated right as the piece is written, so the object never holds more than what it has written
+    MultiBlkId bid;
+    auto f = data_service().async_alloc_write(p.sgs, m_hints, bid);
+    std::move(f).thenValue([this, self = shared_from_this(), idx = p.idx, bid,
+                            promise = std::move(p.promise)](std::error_code ec) mutable {
+        on_piece_written(idx, bid, ec, std::move(promise));
+    });
+}
+
+void BlkDataStreamWriter::on_piece_written(size_t idx, MultiBlkId const& bid, std::error_code ec,
+                                           folly::Promise< std::error_code >&& promise) {
+    std::optional< piece > next;
+    std::vector< piece > failed;
+    std::error_code first_err;
+    bool finish{false};
+    {
+        std::unique_lock lg{m_mtx};
+        if (!ec) {
+            m_blkids[idx] = bid;
+        } else if (!m_error) {
+            m_error = ec;
+        }
+        --m_inflight;
+        first_err = m_error;
+
+        if (m_error) {
+            // No point writing the rest of the object, all of it is going to be freed anyways
+            while (!m_waiting.empty()) {
+                failed.push_back(std::move(m_waiting.front()));
+                m_waiting.pop_front();
+            }
+        } else if (!m_waiting.empty()) {
+            next.emplace(std::move(m_waiting.front()));
+            m_waiting.pop_front();
+            ++m_inflight;
+        }
+        finish = m_closed && (m_inflight == 0) && m_waiting.empty();
+    }
+
+    promise.setValue(ec);
+    for (auto& p : failed) {
+        p.promise.setValue(first_err);
+    }
+    if (next) { issue(std::move(*next)); }
+    if (finish) { complete_close(); }
+}
+
+folly::Future< std::error_code > BlkDataStreamWriter::close(std::vector< MultiBlkId >& out_blkids) {
+    bool finish{false};
+    folly::Future< std::error_code > f = folly::Future< std::error_code >::makeEmpty();
+    {
+        std::unique_lock lg{m_mtx};
+        HS_DBG_ASSERT(!m_closed, "stream writer closed twice");
+        if (m_closed) {
+            return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::invalid_argument));
+        }
+        m_closed = true;
+        m_close_out = &out_blkids;
+        f = m_close_promise.getFuture();
+        finish = (m_inflight == 0) && m_waiting.empty();
+    }
+    if (finish) { complete_close(); }
+    return f;
+}
+
+void BlkDataStreamWriter::complete_close() {
+    // All pieces are done by now, nothing else touches the state
+    if (m_error) {
+        for (auto const& bid : m_blkids) {
+            if (bid.is_valid()) { data_service().async_free_blk(bid); }
+        }
+        m_blkids.clear();
+        m_close_promise.setValue(m_error);
+    } else {
+        *m_close_out = std::move(m_blkids);
+        m_close_promise.setValue(std::error_code{});
+    }
+}
+} // namespace homestore
@@ -0,0 +1,44 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <sisl/metrics/metrics.hpp>
+
+namespace homestore {
+//
+// Per vdev (tier) metrics of the data service. Blk alloc latency and the bytes actually written to the devices are
+// tracked by the vdev itself (vdev_alloc_latency_us, vdev_write_bytes), so write amplification of a tier is its
+// vdev_write_bytes over data_user_write_bytes here.
+//
+class BlkDataSvcMetrics : public sisl::MetricsGroup {
+public:
+    explicit BlkDataSvcMetrics(const char* inst_name) : sisl::MetricsGroup("BlkDataService", inst_name) {
+        REGISTER_COUNTER(data_user_write_bytes, "Bytes written by the consumers of data service");
+        REGISTER_COUNTER(data_compressed_partial_reads,
+                         "Reads of compressed blks with less than their original size, re-read to decompress");
+        REGISTER_HISTOGRAM(data_write_io_latency_us, "Data write latency from submit to device completion (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(data_write_comp_latency_us,
+                           "Data write latency from device completion to completing the caller's future (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        register_me_to_farm();
+    }
+
+    BlkDataSvcMetrics(const BlkDataSvcMetrics&) = delete;
+    BlkDataSvcMetrics(BlkDataSvcMetrics&&) noexcept = delete;
+    BlkDataSvcMetrics& operator=(const BlkDataSvcMetrics&) = delete;
+    BlkDataSvcMetrics& operator=(BlkDataSvcMetrics&&) noexcept = delete;
+    ~BlkDataSvcMetrics() { deregister_me_from_farm(); }
+};
+} // namespace homestore
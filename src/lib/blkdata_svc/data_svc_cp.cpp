@@ -16,12 +16,16 @@
 #include <homestore/homestore.hpp>
 #include "data_svc_cp.hpp"
 #include "device/virtual_dev.hpp"
+#include "common/homestore_config.hpp"
 
 namespace homestore {
 
-DataSvcCPCallbacks::DataSvcCPCallbacks(shared< VirtualDev > vdev) : m_vdev{vdev} {}
+DataSvcCPCallbacks::DataSvcCPCallbacks(shared< VirtualDev > vdev, shared< VirtualDev > fast_vdev,
+                                       BlkCsumTable* csum_table) :
+        m_vdev{vdev}, m_fast_vdev{fast_vdev}, m_csum_table{csum_table} {}
 
 std::unique_ptr< CPContext > DataSvcCPCallbacks::on_switchover_cp(CP* cur_cp, CP* new_cp) {
+    if (m_fast_vdev) { return std::make_unique< DataSvcCPContext >(new_cp, m_fast_vdev->create_cp_context(new_cp)); }
     return m_vdev->create_cp_context(new_cp);
 }
 
@@ -29,7 +33,13 @@ folly::Future< bool > DataSvcCPCallbacks::cp_flush(CP* cp) {
     // Pick a CP Manager blocking IO fiber to execute the cp flush of vdev
     // iomanager.run_on_forget(hs()->cp_mgr().pick_blocking_io_fiber(), [this, cp]() {
     auto cp_ctx = s_cast< VDevCPContext* >(cp->context(cp_consumer_t::BLK_DATA_SVC));
+    io_priority_guard g{io_priority_t::cp_flush};
     m_vdev->cp_flush(cp_ctx); // this is a blocking io call
+    if (m_fast_vdev) { m_fast_vdev->cp_flush(s_cast< DataSvcCPContext* >(cp_ctx)->fast_tier_ctx()); }
+
+    // Csums are cleared on free before the free reaches the vdev, so the table written after the vdev flush has the
+    // frees of this cp cleared as well
+    if (m_csum_table) { m_csum_table->cp_flush(); }
     cp_ctx->complete(true);
     //});
 
@@ -38,6 +48,29 @@ folly::Future< bool > DataSvcCPCallbacks::cp_flush(CP* cp) {
 
 void DataSvcCPCallbacks::cp_cleanup(CP* cp) {}
 
-int DataSvcCPCallbacks::cp_progress_percent() { return m_vdev->cp_progress_percent(); }
+void DataSvcCPCallbacks::cp_carry_over(CP* cp, CP* next_cp) {
+    // Frees of the skipped cp are applied to the allocators along with the ones of next cp. Next cp takes IOs already,
+    // but free list is a concurrent insert vector.
+    auto carry_frees = [](VDevCPContext* from, VDevCPContext* to) {
+        for (auto const& b : from->m_free_blkid_list) {
+            to->m_free_blkid_list.push_back(b);
+        }
+    };
+
+    auto cp_ctx = s_cast< VDevCPContext* >(cp->context(cp_consumer_t::BLK_DATA_SVC));
+    auto next_ctx = s_cast< VDevCPContext* >(next_cp->context(cp_consumer_t::BLK_DATA_SVC));
+    carry_frees(cp_ctx, next_ctx);
+    if (m_fast_vdev) {
+        carry_frees(s_cast< DataSvcCPContext* >(cp_ctx)->fast_tier_ctx(),
+                    s_cast< DataSvcCPContext* >(next_ctx)->fast_tier_ctx());
+    }
+}
+
+uint32_t DataSvcCPCallbacks::cp_flush_interval() const { return HS_DYNAMIC_CONFIG(generic.data_svc_cp_flush_interval); }
+
+int DataSvcCPCallbacks::cp_progress_percent() {
+    auto const pct = m_vdev->cp_progress_percent();
+    return m_fast_vdev ? std::min(pct, m_fast_vdev->cp_progress_percent()) : pct;
+}
 
 } // namespace homestore
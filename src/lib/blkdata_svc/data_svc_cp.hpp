@@ -17,12 +17,28 @@
 #include <homestore/checkpoint/cp_mgr.hpp>
 #include <homestore/checkpoint/cp.hpp>
 #include <homestore/homestore_decl.hpp>
+#include "device/virtual_dev.hpp"
+#include "blk_csum_table.hpp"
 
 namespace homestore {
 
+// CP context of data service with a fast tier, which carries the context of fast tier vdev along with capacity tier
+class DataSvcCPContext : public VDevCPContext {
+public:
+    DataSvcCPContext(CP* cp, std::unique_ptr< CPContext > fast_tier_ctx) :
+            VDevCPContext(cp), m_fast_tier_ctx{std::move(fast_tier_ctx)} {}
+    virtual ~DataSvcCPContext() = default;
+
+    VDevCPContext* fast_tier_ctx() { return s_cast< VDevCPContext* >(m_fast_tier_ctx.get()); }
+
+private:
+    std::unique_ptr< CPContext > m_fast_tier_ctx;
+};
+
 class DataSvcCPCallbacks : public CPCallbacks {
 public:
-    DataSvcCPCallbacks(shared< VirtualDev > vdev);
+    DataSvcCPCallbacks(shared< VirtualDev > vdev, shared< VirtualDev > fast_vdev = nullptr,
+                       BlkCsumTable* csum_table = nullptr);
     virtual ~DataSvcCPCallbacks() = default;
 
 public:
@@ -30,9 +46,16 @@ public:
     folly::Future< bool > cp_flush(CP* cp) override;
     void cp_cleanup(CP* cp) override;
     int cp_progress_percent() override;
+    void cp_carry_over(CP* cp, CP* next_cp) override;
+    uint32_t cp_flush_interval() const override;
+
+    // Frees are collected in the context of each cp and flush of a cp is complete once cp_flush returns
+    bool supports_overlapped_flush() const override { return true; }
 
 private:
     shared< VirtualDev > m_vdev;
+    shared< VirtualDev > m_fast_vdev;
+    BlkCsumTable* m_csum_table;
 };
 
 } // namespace homestore
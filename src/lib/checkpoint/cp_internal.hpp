@@ -15,6 +15,7 @@
  *********************************************************************************/
 #pragma once
 #include <atomic>
+#include <chrono>
 #include <array>
 #include <memory>
 #include <mutex>
@@ -42,4 +43,34 @@ private:
     iomgr::timer_handle_t m_timer_hdl;
     uint32_t m_progress_pct{0};
 };
+
+//
+// CPTriggerPolicy starts cps ahead of the cp timer and the dirty buffer limit, based on the load. On every tick, it
+// takes the dirty buffers and the journal space used, as a fraction of their limits, and starts a cp once the larger
+// one crosses a threshold. Threshold rises from cp_trigger_idle_pct with no foreground io, to cp_trigger_busy_pct at
+// the peak io rate seen recently, so cps are done early while idle and pushed out while busy. Regardless of the load,
+// it starts a cp if the limit would be hit (at the current rate of growth) before a cp, taking as long as the recent
+// ones, gets done.
+//
+class CPTriggerPolicy {
+public:
+    CPTriggerPolicy(CPManager* cp_mgr);
+    void start();
+    void stop();
+    void on_cp_flush_done(uint64_t flush_duration_us);
+
+private:
+    void tick();
+
+private:
+    CPManager* m_cp_mgr;
+    iomgr::timer_handle_t m_timer_hdl{iomgr::null_timer_handle};
+    std::mutex m_mtx;
+    Clock::time_point m_last_tick_time;
+    bool m_sampled{false};
+    uint64_t m_last_io_cnt{0};
+    double m_peak_io_rate{0};
+    double m_last_pressure{0};
+    double m_flush_duration_us{0}; // Moving average of recent cp flush durations
+};
 } // namespace homestore
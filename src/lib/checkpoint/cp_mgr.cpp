@@ -13,33 +13,43 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <iterator>
 #include <urcu.h>
 
 #include <homestore/homestore.hpp>
 #include <homestore/meta_service.hpp>
 #include <homestore/checkpoint/cp_mgr.hpp>
+#include <homestore/probes.hpp>
 #include <homestore/homestore.hpp>
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
 #include "common/resource_mgr.hpp"
+#include "common/thread_affinity.hpp"
 #include "cp_internal.hpp"
 
 namespace homestore {
 thread_local std::stack< CP* > CPGuard::t_cp_stack;
+static std::atomic< uint32_t > s_next_enter_shard{0};
+static thread_local uint32_t const t_enter_shard = s_next_enter_shard.fetch_add(1) % cp_num_enter_shards;
 
 CPManager& cp_mgr() { return hs()->cp_mgr(); }
 
 CPManager::CPManager() :
         m_metrics{std::make_unique< CPMgrMetrics >()},
         m_wd_cp{std::make_unique< CPWatchdog >(this)},
+        m_trigger_policy{std::make_unique< CPTriggerPolicy >(this)},
         m_sb{"CPSuperBlock"} {
     meta_service().register_handler(
         "CPSuperBlock",
         [this](meta_blk* mblk, sisl::byte_view buf, size_t size) { on_meta_blk_found(std::move(buf), (void*)mblk); },
         nullptr);
 
-    resource_mgr().register_dirty_buf_exceed_cb(
-        [this]([[maybe_unused]] int64_t dirty_buf_count, bool critical) { this->trigger_cp_flush(false /* force */); });
+    // Trigger policy, when on, starts the cps for dirty buffers (ahead or past the trigger pct, as per load) and this
+    // callback is left only as the backstop at the limit
+    resource_mgr().register_dirty_buf_exceed_cb([this]([[maybe_unused]] int64_t dirty_buf_count, bool critical) {
+        if (critical || !HS_DYNAMIC_CONFIG(generic.cp_trigger_policy_enabled)) { this->trigger_cp_flush(false); }
+    });
 
     start_cp_thread();
 }
@@ -59,6 +69,7 @@ void CPManager::start_timer() {
     m_cp_timer_hdl = iomanager.schedule_global_timer(
         HS_DYNAMIC_CONFIG(generic.cp_timer_us) * 1000, true, nullptr /*cookie*/, iomgr::reactor_regex::all_worker,
         [this](void*) { trigger_cp_flush(false /* false */); }, true /* wait_to_schedule */);
+    m_trigger_policy->start();
 }
 
 void CPManager::on_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie) {
@@ -78,6 +89,7 @@ void CPManager::shutdown() {
     LOGINFO("Stopping cp timer");
     iomanager.cancel_timer(m_cp_timer_hdl, true);
     m_cp_timer_hdl = iomgr::null_timer_handle;
+    m_trigger_policy->stop();
 
     {
         std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
@@ -100,9 +112,14 @@ void CPManager::shutdown() {
 }
 
 void CPManager::register_consumer(cp_consumer_t consumer_id, std::unique_ptr< CPCallbacks > callbacks) {
+    // Services starting concurrently register at the same time, also keeps the registration off a cp switchover
+    std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
     size_t idx = (size_t)consumer_id;
     m_cp_cb_table[idx] = std::move(callbacks);
+    HS_REL_ASSERT(!m_cp_cb_table[idx] || !depends_on(idx, idx, 0), "CP flush dependencies of consumer={} form a cycle",
+                  idx);
     if (m_cp_cb_table[idx]) {
+        if (!m_consumer_metrics[idx]) { m_consumer_metrics[idx] = std::make_unique< CPConsumerMetrics >(consumer_id); }
         m_cur_cp->m_contexts[idx] = std::move(m_cp_cb_table[idx]->on_switchover_cp(nullptr, m_cur_cp));
     }
 }
@@ -119,13 +136,22 @@ CP* CPManager::cp_io_enter() {
         return nullptr;
     }
     cp_ref(cp);
+    m_io_enter_cnts[t_enter_shard].val.fetch_add(1, std::memory_order_relaxed);
     rcu_read_unlock();
 
     return cp;
 }
 
 void CPManager::cp_ref(CP* cp) {
-    cp->m_enter_cnt.increment(1);
+    // Sharded counting is flipped off in the trigger before a synchronize_rcu, so a ref which sees it on is done
+    // before the trigger folds the shards
+    rcu_read_lock();
+    if (cp->m_enter_sharded.load()) {
+        cp->m_enter_shards[t_enter_shard].val.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        cp->m_enter_cnt.increment(1);
+    }
+    rcu_read_unlock();
 #ifndef NDEBUG
     auto status = cp->m_cp_status.load();
     HS_DBG_ASSERT((status == cp_status_t::cp_io_ready || status == cp_status_t::cp_trigger ||
@@ -136,8 +162,17 @@ void CPManager::cp_ref(CP* cp) {
 
 void CPManager::cp_io_exit(CP* cp) {
     HS_DBG_ASSERT_NE(cp->m_cp_status, cp_status_t::cp_flushing);
+
+    // Exit can be on a thread other than the enter, so a shard can go negative, only the sum of them is the count
+    rcu_read_lock();
+    if (cp->m_enter_sharded.load()) {
+        cp->m_enter_shards[t_enter_shard].val.fetch_sub(1, std::memory_order_relaxed);
+        rcu_read_unlock();
+        return;
+    }
+    rcu_read_unlock();
+
     if (cp->m_enter_cnt.decrement_testz(1) && (cp->m_cp_status == cp_status_t::cp_flush_prepare)) {
-        m_wd_cp->set_cp(cp);
         cp_start_flush(cp);
     }
 }
@@ -154,7 +189,7 @@ folly::Future< bool > CPManager::trigger_cp_flush(bool force) {
 folly::Future< bool > CPManager::do_trigger_cp_flush(bool force, bool flush_on_shutdown) {
     std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
 
-    if (m_in_flush_phase) {
+    if (!m_flushing_cps.empty() && !can_overlap_flush(flush_on_shutdown)) {
         // If we are already flushing, we create a back-to-back CP queue only if force is set and if we are not in
         // shutdown phase. Triggering a back-2-back CP in shutdown state is dangerous, as it can cause the CPManager to
         // be destructed while back-2-back CP is triggered.
@@ -170,20 +205,27 @@ folly::Future< bool > CPManager::do_trigger_cp_flush(bool force, bool flush_on_s
             return folly::makeFuture< bool >(false);
         }
     }
-    m_in_flush_phase = true;
-
     folly::Future< bool > ret_fut = folly::Future< bool >::makeEmpty();
     auto cur_cp = cp_guard();
     cur_cp->m_cp_status = cp_status_t::cp_trigger;
+    cur_cp->m_trigger_time = Clock::now();
     HS_PERIODIC_LOG(INFO, cp, "<<<<<<<<<<< Triggering flush of the CP {}", cur_cp->to_string());
     COUNTER_INCREMENT(*m_metrics, cp_cnt, 1);
-    m_wd_cp->set_cp(cur_cp.get());
+    if (m_flushing_cps.empty()) {
+        m_wd_cp->set_cp(cur_cp.get()); // Watchdog tracks the oldest cp in flush
+    } else {
+        HS_PERIODIC_LOG(INFO, cp, "CP {} overlaps with flush of CP {}", cur_cp->id(), m_flushing_cps.back()->id());
+        COUNTER_INCREMENT(*m_metrics, overlapped_cps, 1);
+    }
+    m_flushing_cps.push_back(cur_cp.get());
 
     // allocate a new cp and ask consumers to switchover to new cp
     auto new_cp = new CP(this);
     new_cp->m_cp_id = cur_cp->m_cp_id + 1;
 
     HS_PERIODIC_LOG(DEBUG, cp, "Create New CP session", new_cp->id());
+    cur_cp->m_next_cp = new_cp;
+    plan_consumer_flushes(cur_cp.get(), m_cp_shutdown_initiated /* flush_all */); // Nothing is carried over at shutdown
     size_t idx{0};
     for (auto& consumer : m_cp_cb_table) {
         if (consumer) { new_cp->m_contexts[idx] = std::move(consumer->on_switchover_cp(cur_cp.get(), new_cp)); }
@@ -202,8 +244,18 @@ folly::Future< bool > CPManager::do_trigger_cp_flush(bool force, bool flush_on_s
 
     cur_cp->m_cp_status = cp_status_t::cp_flush_prepare;
     new_cp->m_cp_status = cp_status_t::cp_io_ready;
+    cur_cp->m_enter_sharded.store(false);
     rcu_xchg_pointer(&m_cur_cp, new_cp);
     synchronize_rcu();
+    HS_PROBE(cp_switchover, cur_cp->id(), new_cp->id());
+
+    // Every ref and exit on the shards of the cp is done by now and the ones after count on m_enter_cnt, so the shards
+    // can be folded into it (taking away the bias). Our own guard holds the cp, so it doesn't reach zero here.
+    int64_t sharded_cnt{0};
+    for (auto const& shard : cur_cp->m_enter_shards) {
+        sharded_cnt += shard.val.load(std::memory_order_relaxed);
+    }
+    cur_cp->m_enter_cnt.decrement(cp_enter_cnt_bias - sharded_cnt);
 
     // At this point we are sure that there is no thread working on prev_cp without incrementing the cp_enter count
     // We need to unlock the trigger mtx section before cp_guard goes out of context, because exit cp critical section
@@ -214,13 +266,115 @@ folly::Future< bool > CPManager::do_trigger_cp_flush(bool force, bool flush_on_s
     return ret_fut;
 }
 
+bool CPManager::is_flushing() {
+    std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
+    return !m_flushing_cps.empty();
+}
+
+bool CPManager::can_overlap_flush(bool flush_on_shutdown) const {
+    if (!HS_DYNAMIC_CONFIG(generic.cp_overlap_flush) || (m_flushing_cps.size() >= MAX_FLUSHING_CP_COUNT)) {
+        return false;
+    }
+
+    // Same as back-to-back cp, don't overlap a cp with the flush in shutdown phase, unless it is the shutdown flush
+    if (m_cp_shutdown_initiated && !flush_on_shutdown) { return false; }
+
+    // Every consumer yet to finish the flush of a cp has to be fine with next cp getting triggered
+    for (auto const* cp : m_flushing_cps) {
+        for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+            auto const& consumer = m_cp_cb_table[idx];
+            if (consumer && !consumer->supports_overlapped_flush() && !cp->m_consumer_flush_comp[idx].isFulfilled()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void CPManager::plan_consumer_flushes(CP* cp, bool flush_all) {
+    std::array< bool, (size_t)cp_consumer_t::SENTINEL > flush{};
+    for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+        auto const& consumer = m_cp_cb_table[idx];
+        if (consumer) { flush[idx] = flush_all || (m_cps_skipped[idx] + 1 >= consumer->cp_flush_interval()); }
+    }
+
+    // Consumer flushing the cp needs the consumers it depends on to flush it too. Dependencies are acyclic, so flush
+    // propagates down any chain of them in as many rounds as the number of consumers.
+    for (size_t round{0}; round < m_cp_cb_table.size(); ++round) {
+        for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+            if (!flush[idx]) { continue; }
+            for (auto const dep : m_cp_cb_table[idx]->cp_flush_depends_on()) {
+                if (m_cp_cb_table[(size_t)dep]) { flush[(size_t)dep] = true; }
+            }
+        }
+    }
+
+    bool partial{false};
+    for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+        if (!m_cp_cb_table[idx]) { continue; }
+        cp->m_consumer_skip[idx] = !flush[idx];
+        m_cps_skipped[idx] = flush[idx] ? 0 : (m_cps_skipped[idx] + 1);
+        partial = partial || !flush[idx];
+    }
+    if (partial) { COUNTER_INCREMENT(*m_metrics, partial_cps, 1); }
+}
+
+bool CPManager::depends_on(size_t consumer_idx, size_t other_idx, size_t depth) const {
+    if (depth > m_cp_cb_table.size()) { return true; } // Deeper than the number of consumers, has to be a cycle
+    for (auto const dep : m_cp_cb_table[consumer_idx]->cp_flush_depends_on()) {
+        auto const dep_idx = (size_t)dep;
+        if (dep_idx == other_idx) { return true; }
+        if (m_cp_cb_table[dep_idx] && depends_on(dep_idx, other_idx, depth + 1)) { return true; }
+    }
+    return false;
+}
+
 void CPManager::cp_start_flush(CP* cp) {
     std::vector< folly::Future< bool > > futs;
+    std::vector< folly::Future< bool > > prev_flush_futs;
     HS_PERIODIC_LOG(INFO, cp, "Starting CP {} flush", cp->id());
     cp->m_cp_status = cp_status_t::cp_flushing;
+    cp->m_flush_start_time = Clock::now();
+    HS_PROBE(cp_flush_start, cp->id());
 
-    for (auto& consumer : m_cp_cb_table) {
-        if (consumer) { futs.emplace_back(std::move(consumer->cp_flush(cp))); }
+    // If the previous cp is still flushing (overlapped), each consumer flushes this cp only after it is done with the
+    // previous one and this cp is done only after the previous one is done, so the cps are persisted in order.
+    // Within the cp, a consumer flushes it only after the consumers it depends on are done with it.
+    {
+        std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
+        auto it = std::find(m_flushing_cps.begin(), m_flushing_cps.end(), cp);
+        CP* prev_cp = (it == m_flushing_cps.begin()) ? nullptr : *std::prev(it);
+        if (prev_cp == nullptr) { m_wd_cp->set_cp(cp); }
+        for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+            prev_flush_futs.emplace_back((prev_cp && m_cp_cb_table[idx])
+                                             ? prev_cp->m_consumer_flush_comp[idx].getFuture()
+                                             : folly::makeFuture< bool >(true));
+        }
+        if (prev_cp) { futs.emplace_back(prev_cp->m_comp_promise.getFuture()); }
+    }
+
+    for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+        auto* consumer = m_cp_cb_table[idx].get();
+        if (consumer == nullptr) { continue; }
+        std::vector< folly::Future< bool > > waits;
+        waits.emplace_back(std::move(prev_flush_futs[idx]));
+        for (auto const dep : consumer->cp_flush_depends_on()) {
+            if (m_cp_cb_table[(size_t)dep]) { waits.emplace_back(cp->m_consumer_flush_comp[(size_t)dep].getFuture()); }
+        }
+
+        futs.emplace_back(folly::collectAllUnsafe(waits)
+                              .thenValue([consumer, cp, idx](auto) {
+                                  cp->m_consumer_start_time[idx] = Clock::now();
+                                  if (!cp->m_consumer_skip[idx]) { return consumer->cp_flush(cp); }
+                                  consumer->cp_carry_over(cp, cp->m_next_cp);
+                                  return folly::makeFuture< bool >(true);
+                              })
+                              .thenValue([cp, idx](bool success) {
+                                  cp->m_consumer_flush_us[idx] = get_elapsed_time_us(cp->m_consumer_start_time[idx]);
+                                  HS_PROBE(cp_consumer_flush_done, cp->id(), idx, cp->m_consumer_flush_us[idx]);
+                                  cp->m_consumer_flush_comp[idx].setValue(success);
+                                  return success;
+                              }));
     }
 
     folly::collectAllUnsafe(futs).thenValue([this, cp](auto) {
@@ -232,6 +386,11 @@ void CPManager::cp_start_flush(CP* cp) {
 void CPManager::on_cp_flush_done(CP* cp) {
     HS_DBG_ASSERT_EQ(cp->m_cp_status, cp_status_t::cp_flushing);
     cp->m_cp_status = cp_status_t::cp_flush_done;
+    auto const flush_duration_us = get_elapsed_time_us(cp->m_trigger_time);
+    HS_PROBE(cp_flush_done, cp->id(), flush_duration_us);
+    HISTOGRAM_OBSERVE(*m_metrics, cp_latency, flush_duration_us);
+    m_trigger_policy->on_cp_flush_done(flush_duration_us);
+    report_flush_stats(cp);
 
     iomanager.run_on_forget(pick_blocking_io_fiber(), [this, cp]() {
         // Persist the superblock with this flushed cp information
@@ -240,20 +399,25 @@ void CPManager::on_cp_flush_done(CP* cp) {
 
         cleanup_cp(cp);
 
-        // Setting promise will cause the CP manager destructor to cleanup before getting a chance to do the
-        // checking if shutdown has been initiated or not.
-        auto promise = std::move(cp->m_comp_promise);
-        m_wd_cp->reset_cp();
-        delete cp;
-
         bool trigger_back_2_back_cp{false};
-
         {
             std::unique_lock< std::mutex > lk(m_trigger_cp_mtx);
-            m_in_flush_phase = false;
+            HS_DBG_ASSERT_EQ((void*)m_flushing_cps.front(), (void*)cp, "CP flush is done out of order");
+            m_flushing_cps.pop_front();
+            if (m_flushing_cps.empty()) {
+                m_wd_cp->reset_cp();
+            } else {
+                m_wd_cp->set_cp(m_flushing_cps.front());
+            }
             trigger_back_2_back_cp = m_pending_trigger_cp;
         }
 
+        // Setting promise will cause the CP manager destructor to cleanup before getting a chance to do the
+        // checking if shutdown has been initiated or not. The promise is taken only once the cp is out of flushing
+        // list, since the cp overlapping with this one waits on it.
+        auto promise = std::move(cp->m_comp_promise);
+        delete cp;
+
         promise.setValue(true);
 
         // Dont access any cp state after this, in case trigger_back_2_back_cp is false, because its false on
@@ -266,6 +430,52 @@ void CPManager::on_cp_flush_done(CP* cp) {
     });
 }
 
+void CPManager::report_flush_stats(CP* cp) {
+    auto const drain_us = get_elapsed_time_us(cp->m_trigger_time, cp->m_flush_start_time);
+    auto const flush_us = get_elapsed_time_us(cp->m_flush_start_time);
+    HISTOGRAM_OBSERVE(*m_metrics, cp_drain_latency, drain_us);
+    HISTOGRAM_OBSERVE(*m_metrics, cp_flush_latency, flush_us);
+
+    // Time a consumer took is the time it flushed, since the time it waited is the previous cp or its dependencies
+    int64_t slowest{-1};
+    std::string breakdown;
+    for (size_t idx{0}; idx < m_cp_cb_table.size(); ++idx) {
+        if (!m_cp_cb_table[idx] || !m_consumer_metrics[idx]) { continue; }
+        auto& metrics = *m_consumer_metrics[idx];
+        auto const wait_us = get_elapsed_time_us(cp->m_flush_start_time, cp->m_consumer_start_time[idx]);
+        auto const bytes = cp->m_contexts[idx] ? cp->m_contexts[idx]->flushed_bytes() : 0;
+        HISTOGRAM_OBSERVE(metrics, cp_consumer_wait_latency, wait_us);
+        if (!cp->m_consumer_skip[idx]) {
+            HISTOGRAM_OBSERVE(metrics, cp_consumer_flush_latency, cp->m_consumer_flush_us[idx]);
+            HISTOGRAM_OBSERVE(metrics, cp_consumer_flush_bytes, bytes);
+        }
+        if ((slowest < 0) || (cp->m_consumer_flush_us[idx] > cp->m_consumer_flush_us[slowest])) { slowest = idx; }
+        fmt::format_to(std::back_inserter(breakdown), "{}[{}wait={}ms flush={}ms bytes={}] ",
+                       enum_name(cp_consumer_t(idx)), cp->m_consumer_skip[idx] ? "skipped " : "", wait_us / 1000,
+                       cp->m_consumer_flush_us[idx] / 1000, bytes);
+    }
+
+    auto const slow_ms = uint64_cast(HS_DYNAMIC_CONFIG(generic.cp_slow_flush_threshold_ms));
+    if ((slow_ms == 0) || ((drain_us + flush_us) < slow_ms * 1000) || (slowest < 0)) { return; }
+    COUNTER_INCREMENT(*m_metrics, slow_cps, 1);
+    COUNTER_INCREMENT(*m_consumer_metrics[slowest], cp_consumer_slow_cps, 1);
+    LOGWARN("CP {} is slow, took {}ms (drain={}ms flush={}ms), slowest consumer={} flush={}ms. Consumers: {}",
+            cp->id(), (drain_us + flush_us) / 1000, drain_us / 1000, flush_us / 1000,
+            enum_name(cp_consumer_t(slowest)), cp->m_consumer_flush_us[slowest] / 1000, breakdown);
+}
+
+void CPManager::update_flush_progress() {
+    uint32_t cum_pct{0};
+    uint32_t count{0};
+    for (auto& consumer : m_cp_cb_table) {
+        if (consumer) {
+            ++count;
+            cum_pct += consumer->cp_progress_percent();
+        }
+    }
+    if (count) { GAUGE_UPDATE(*m_metrics, cp_flush_progress_pct, cum_pct / count); }
+}
+
 void CPManager::cleanup_cp(CP* cp) {
     cp->m_cp_status = cp_status_t::cp_cleaning;
     for (auto& consumer : m_cp_cb_table) {
@@ -285,6 +495,7 @@ void CPManager::start_cp_thread() {
     // Start a reactor with 9 fibers (8 for sync io)
     iomanager.create_reactor("cp_io", iomgr::INTERRUPT_LOOP, 8u, [this, ctx](bool is_started) {
         if (is_started) {
+            pin_thread(hs_thread_role_t::cp);
             {
                 std::unique_lock< std::mutex > lk{ctx->mtx};
                 auto v = iomanager.sync_io_capable_fibers();
@@ -393,6 +604,7 @@ void CPWatchdog::cp_watchdog_timer() {
     // check if any cp to track
     if (m_cp == nullptr) { return; }
     const auto status = m_cp->get_status();
+    if (status == cp_status_t::cp_flushing) { m_cp_mgr->update_flush_progress(); }
     if ((status != cp_status_t::cp_flush_prepare) || (status != cp_status_t::cp_flushing)) { return; }
 
     uint32_t cum_pct{0};
@@ -436,4 +648,72 @@ void CPWatchdog::cp_watchdog_timer() {
 
 cp_id_t CPContext::id() const { return m_cp->id(); }
 
+//////////////////////////////////////// CP Trigger Policy class //////////////////////////////////////////
+CPTriggerPolicy::CPTriggerPolicy(CPManager* cp_mgr) : m_cp_mgr{cp_mgr}, m_last_tick_time{Clock::now()} {}
+
+void CPTriggerPolicy::start() {
+    auto const tick_ms = HS_DYNAMIC_CONFIG(generic.cp_trigger_policy_tick_ms);
+    if (tick_ms == 0) { return; }
+    m_timer_hdl = iomanager.schedule_global_timer(uint64_cast(tick_ms) * 1000 * 1000, true, nullptr,
+                                                  iomgr::reactor_regex::all_worker, [this](void*) { tick(); });
+}
+
+void CPTriggerPolicy::stop() {
+    if (m_timer_hdl == iomgr::null_timer_handle) { return; }
+    iomanager.cancel_timer(m_timer_hdl, true);
+    m_timer_hdl = iomgr::null_timer_handle;
+}
+
+void CPTriggerPolicy::on_cp_flush_done(uint64_t flush_duration_us) {
+    std::unique_lock lg{m_mtx};
+    m_flush_duration_us = (m_flush_duration_us == 0) ? double(flush_duration_us)
+                                                     : (0.75 * m_flush_duration_us + 0.25 * double(flush_duration_us));
+}
+
+void CPTriggerPolicy::tick() {
+    static constexpr double peak_io_rate_decay{0.99}; // Per tick, so that busy is relative to recent peak
+
+    // Fraction of the dirty buffer limit and the journal high watermark used, the larger of which is the pressure
+    auto& rmgr = resource_mgr();
+    double const dirty = double(rmgr.dirty_buf_pct()) / 100.0;
+    double const journal = double(rmgr.journal_vdev_used_pct()) / std::max(1u, rmgr.get_journal_vdev_size_limit());
+    double const pressure = std::max(dirty, journal);
+
+    bool trigger{false};
+    {
+        std::unique_lock lg{m_mtx};
+        auto const now = Clock::now();
+        double const secs = std::max(1e-3, std::chrono::duration< double >(now - m_last_tick_time).count());
+        uint64_t io_cnt{0};
+        for (auto const& shard : m_cp_mgr->m_io_enter_cnts) {
+            io_cnt += shard.val.load(std::memory_order_relaxed);
+        }
+        double const io_rate = double(io_cnt - m_last_io_cnt) / secs;
+        double const growth = m_sampled ? ((pressure - m_last_pressure) / secs) : 0.0;
+        m_sampled = true;
+        m_last_tick_time = now;
+        m_last_io_cnt = io_cnt;
+        m_last_pressure = pressure;
+        m_peak_io_rate = std::max(io_rate, m_peak_io_rate * peak_io_rate_decay);
+
+        if (!HS_DYNAMIC_CONFIG(generic.cp_trigger_policy_enabled)) { return; }
+
+        double const busy = (m_peak_io_rate > 0) ? std::min(1.0, io_rate / m_peak_io_rate) : 0.0;
+        double const idle_th = HS_DYNAMIC_CONFIG(generic.cp_trigger_idle_pct) / 100.0;
+        double const busy_th = HS_DYNAMIC_CONFIG(generic.cp_trigger_busy_pct) / 100.0;
+        double const threshold = idle_th + (busy_th - idle_th) * busy;
+        double const pressure_at_flush_end = pressure + (std::max(growth, 0.0) * m_flush_duration_us / 1000000.0);
+
+        trigger = (pressure > 0) && ((pressure >= threshold) || (pressure_at_flush_end >= 1.0));
+        if (trigger) {
+            HS_PERIODIC_LOG(DEBUG, cp,
+                            "Trigger policy starts cp: pressure={:.2f} (dirty={:.2f} journal={:.2f}) threshold={:.2f} "
+                            "busy={:.2f} at_flush_end={:.2f}",
+                            pressure, dirty, journal, threshold, busy, pressure_at_flush_end);
+        }
+    }
+
+    // Dirty buffers and journal are released only when the cp in flush is done, don't pile up cps meanwhile
+    if (trigger && !m_cp_mgr->is_flushing()) { m_cp_mgr->trigger_cp_flush(false /* force */); }
+}
 } // namespace homestore
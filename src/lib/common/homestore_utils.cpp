@@ -13,12 +13,37 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <filesystem>
+#include <fstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+
 #include <boost/uuid/random_generator.hpp>
 #include "homestore_utils.hpp"
 #include "homestore_assert.hpp"
+#include "iobuf_pool.hpp"
 
 namespace homestore {
 uint8_t* hs_utils::iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment) {
+    auto buf = IOBufPool::instance().alloc(size, alignment);
+    return (buf != nullptr) ? buf : unpooled_iobuf_alloc(size, tag, alignment);
+}
+
+uint8_t* hs_utils::iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment,
+                               const int numa_node) {
+    if ((numa_node < 0) || !HS_DYNAMIC_CONFIG(device->numa_aware_placement)) {
+        return iobuf_alloc(size, tag, alignment);
+    }
+
+    // Pool of the node binds each of its slabs to the node once. Only the sizes it doesn't serve, which are few and
+    // long lived (like the log group buffers), are bound one by one.
+    if (auto buf = IOBufPool::instance(numa_node).alloc(size, alignment); buf != nullptr) { return buf; }
+    auto buf = unpooled_iobuf_alloc(size, tag, alignment);
+    bind_to_numa_node(buf, size, numa_node);
+    return buf;
+}
+
+uint8_t* hs_utils::unpooled_iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment) {
     if (tag == sisl::buftag::btree_node) {
         HS_DBG_ASSERT_EQ(size, m_btree_mempool_size);
         auto buf = iomanager.iobuf_pool_alloc(alignment, size, tag);
@@ -32,7 +57,58 @@ uint8_t* hs_utils::iobuf_alloc(const size_t size, const sisl::buftag tag, const
 
 uuid_t hs_utils::gen_random_uuid() { return boost::uuids::random_generator()(); }
 
+int hs_utils::cur_numa_node() {
+    // Reactors are pinned to their cpus by iomgr, so the node is looked up only on the first call of the thread
+    static thread_local int const t_node = []() {
+        unsigned int cpu, node;
+        if (::syscall(SYS_getcpu, &cpu, &node, nullptr) != 0) { return -1; }
+        return s_cast< int >(node);
+    }();
+    return t_node;
+}
+
+int hs_utils::dev_numa_node(const std::string& devname) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+
+    auto const dev_path = fs::canonical(devname, ec);
+    if (ec) { return -1; }
+
+    // Walk up the sysfs device hierarchy of the block device (which handles partitions and nvme namespaces) until
+    // we find the bus device which reports the numa node.
+    auto sys_path = fs::canonical(fs::path{"/sys/class/block"} / dev_path.filename(), ec);
+    if (ec) { return -1; }
+
+    for (; !sys_path.empty() && (sys_path != sys_path.root_path()); sys_path = sys_path.parent_path()) {
+        std::ifstream ifs{sys_path / "numa_node"};
+        int node{-1};
+        if (ifs && (ifs >> node)) { return (node < 0) ? -1 : node; }
+    }
+    return -1;
+}
+
+void hs_utils::bind_to_numa_node(void* buf, const size_t size, const int numa_node) {
+    // Values from linux/mempolicy.h, avoiding libnuma dependency
+    static constexpr int mpol_preferred{1};
+    static constexpr unsigned mpol_mf_move{1u << 1};
+    static constexpr int max_nodes{sizeof(unsigned long) * 8};
+
+    if ((numa_node < 0) || (numa_node >= max_nodes) || !HS_DYNAMIC_CONFIG(device->numa_aware_placement)) { return; }
+
+    // mbind works at page granularity and we don't want to change the policy of pages shared with other buffers
+    static size_t const page_size = ::sysconf(_SC_PAGESIZE);
+    auto const start = sisl::round_up(r_cast< uintptr_t >(buf), page_size);
+    auto const end = sisl::round_down(r_cast< uintptr_t >(buf) + size, page_size);
+    if (end <= start) { return; }
+
+    unsigned long nodemask = (1ul << numa_node);
+    if (::syscall(SYS_mbind, start, end - start, mpol_preferred, &nodemask, max_nodes + 1, mpol_mf_move) != 0) {
+        LOGDEBUG("mbind of buf={} size={} to numa_node={} failed, errno={}", buf, size, numa_node, errno);
+    }
+}
+
 void hs_utils::iobuf_free(uint8_t* const ptr, const sisl::buftag tag) {
+    if (IOBufPool::free_any(ptr)) { return; }
     if (tag == sisl::buftag::btree_node) {
         iomanager.iobuf_pool_free(ptr, m_btree_mempool_size, tag);
     } else {
@@ -27,8 +27,13 @@ std::string to_hex(T i) {
 class hs_utils {
     static size_t m_btree_mempool_size;
 
+    static uint8_t* unpooled_iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment);
+
 public:
+    /// @brief Aligned io buffer, from the pool of io buffers (see IOBufPool) for the sizes and alignments it serves.
+    /// Has to be freed with iobuf_free.
     static uint8_t* iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment);
+    static uint8_t* iobuf_alloc(const size_t size, const sisl::buftag tag, const size_t alignment, const int numa_node);
     static void iobuf_free(uint8_t* const ptr, const sisl::buftag tag);
     static void set_btree_mempool_size(const size_t size);
     static void iobuf_free(uint8_t* const ptr, const sisl::buftag tag, const size_t size);
@@ -44,6 +49,16 @@ public:
                                             const size_t alignment);
     static uuid_t gen_random_uuid();
 
+    /// @brief NUMA node of the cpu this thread ran on at its first call, -1 if it cannot be determined
+    static int cur_numa_node();
+
+    /// @brief Get the NUMA node the given device (block device path) is attached to, -1 if not known
+    static int dev_numa_node(const std::string& devname);
+
+    /// @brief Set the memory policy of the pages fully covered by the buffer to prefer the given NUMA node. Pages which
+    /// are already faulted in are migrated. No-op if numa_node is -1 or numa aware placement is disabled.
+    static void bind_to_numa_node(void* buf, const size_t size, const int numa_node);
+
     /**
      * @brief  given a DAG graph , build the partial order sequence.
      *
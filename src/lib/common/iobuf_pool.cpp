@@ -0,0 +1,404 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstdlib>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/mman.h>
+
+#include <sisl/logging/logging.h>
+#include "iobuf_pool.hpp"
+#include "homestore_config.hpp"
+#include "homestore_utils.hpp"
+
+namespace homestore {
+static std::atomic< uint64_t > s_next_pool_id{0};
+
+// Pools of the numa nodes, created on first use and never destroyed, same as the instance()
+static std::array< std::atomic< IOBufPool* >, IOBufPool::max_numa_nodes > s_node_pools{};
+static std::atomic< int > s_max_pooled_node{-1}; // Highest node with a pool, so that frees look only upto it
+
+// Free buffers of each class the thread holds for a pool, returned to the pool when the thread exits
+struct IOBufPool::thread_cache {
+    IOBufPool* pool;
+    uint64_t pool_id;
+    std::array< std::vector< uint8_t* >, num_classes > bufs;
+
+    void flush() {
+        for (uint32_t cls{0}; cls < num_classes; ++cls) {
+            pool->release(bufs[cls], cls, bufs[cls].size());
+        }
+    }
+
+    struct holder {
+        std::vector< std::unique_ptr< thread_cache > > caches;
+        ~holder() {
+            for (auto& tc : caches) {
+                tc->flush();
+            }
+            s_last = nullptr;
+            s_exited = true;
+        }
+    };
+    static thread_local holder s_holder;
+    static thread_local thread_cache* s_last; // Cache of the pool last used on this thread
+    static thread_local bool s_exited;        // Caches are gone, buffers freed by the exiting thread go to the pool
+};
+thread_local IOBufPool::thread_cache::holder IOBufPool::thread_cache::s_holder;
+thread_local IOBufPool::thread_cache* IOBufPool::thread_cache::s_last{nullptr};
+thread_local bool IOBufPool::thread_cache::s_exited{false};
+
+IOBufPool& IOBufPool::instance() {
+    // Never destroyed, as buffers could be freed by static objects or by threads exiting upto the very end
+    static IOBufPool* s_inst =
+        new IOBufPool(uint32_cast(HS_DYNAMIC_CONFIG(generic->iobuf_pool_max_mb) * 1024ul * 1024ul / slab_size),
+                      HS_DYNAMIC_CONFIG(generic->iobuf_pool_huge_pages),
+                      HS_DYNAMIC_CONFIG(generic->iobuf_pool_thread_cache_cnt));
+    return *s_inst;
+}
+
+IOBufPool& IOBufPool::instance(int numa_node) {
+    if ((numa_node < 0) || (numa_node >= max_numa_nodes)) { return instance(); }
+    if (auto* pool = s_node_pools[numa_node].load(std::memory_order_acquire); pool != nullptr) { return *pool; }
+
+    static std::mutex s_create_mtx;
+    std::unique_lock lg{s_create_mtx};
+    auto* pool = s_node_pools[numa_node].load(std::memory_order_acquire);
+    if (pool == nullptr) {
+        pool = new IOBufPool(uint32_cast(HS_DYNAMIC_CONFIG(generic->iobuf_pool_max_mb) * 1024ul * 1024ul / slab_size),
+                             HS_DYNAMIC_CONFIG(generic->iobuf_pool_huge_pages),
+                             HS_DYNAMIC_CONFIG(generic->iobuf_pool_thread_cache_cnt), numa_node);
+        s_node_pools[numa_node].store(pool, std::memory_order_release);
+        if (numa_node > s_max_pooled_node.load()) { s_max_pooled_node.store(numa_node, std::memory_order_release); }
+    }
+    return *pool;
+}
+
+void IOBufPool::release_idle_slabs_all(uint64_t idle_ms) {
+    instance().release_idle_slabs(idle_ms);
+    auto const max_node = s_max_pooled_node.load(std::memory_order_acquire);
+    for (int node{0}; node <= max_node; ++node) {
+        if (auto* pool = s_node_pools[node].load(std::memory_order_acquire); pool != nullptr) {
+            pool->release_idle_slabs(idle_ms);
+        }
+    }
+}
+
+bool IOBufPool::free_any(uint8_t* buf) {
+    if (instance().free(buf)) { return true; }
+    auto const max_node = s_max_pooled_node.load(std::memory_order_acquire);
+    for (int node{0}; node <= max_node; ++node) {
+        auto* pool = s_node_pools[node].load(std::memory_order_acquire);
+        if ((pool != nullptr) && pool->free(buf)) { return true; }
+    }
+    return false;
+}
+
+IOBufPool::IOBufPool(uint32_t max_slabs, bool huge_pages, uint32_t thread_cache_cnt, int numa_node) :
+        m_max_slabs{max_slabs},
+        m_huge_pages{huge_pages},
+        m_thread_cache_cnt{thread_cache_cnt},
+        m_id{s_next_pool_id.fetch_add(1)},
+        m_numa_node{numa_node},
+        m_metrics{(numa_node < 0) ? std::string{"IOBufPool"} : fmt::format("IOBufPool_node{}", numa_node)} {
+    // Table is kept atmost half full, so that probes are short
+    m_slab_tbl_size = 16;
+    while (m_slab_tbl_size < (2 * m_max_slabs)) {
+        m_slab_tbl_size *= 2;
+    }
+    m_slab_tbl = std::make_unique< std::atomic< uintptr_t >[] >(m_slab_tbl_size);
+    for (uint32_t i{0}; i < m_slab_tbl_size; ++i) {
+        m_slab_tbl[i].store(0, std::memory_order_relaxed);
+    }
+    m_slabs.reserve(m_max_slabs);
+}
+
+IOBufPool::~IOBufPool() {
+    // Buffers cached by this thread are freed along with the slabs
+    thread_cache::s_last = nullptr;
+    auto& caches = thread_cache::s_holder.caches;
+    caches.erase(std::remove_if(caches.begin(), caches.end(), [this](auto const& tc) { return tc->pool_id == m_id; }),
+                 caches.end());
+
+    for (auto const& [slab, huge_page] : m_slabs) {
+        free_slab(slab, huge_page);
+    }
+}
+
+void IOBufPool::free_slab(uint8_t* slab, bool huge_page) {
+    if (huge_page) {
+        ::munmap(slab, slab_size);
+    } else {
+        std::free(slab);
+    }
+}
+
+int IOBufPool::size_class(size_t size, size_t alignment) {
+    if ((size == 0) || (size > max_class_size)) { return -1; }
+    if ((alignment & (alignment - 1)) != 0) { return -1; }
+
+    uint32_t cls{0};
+    while (class_size(cls) < size) {
+        ++cls;
+    }
+    // Buffers are aligned to their class size
+    return (alignment <= class_size(cls)) ? s_cast< int >(cls) : -1;
+}
+
+uint8_t* IOBufPool::alloc(size_t size, size_t alignment) {
+    if (m_max_slabs == 0) { return nullptr; }
+    auto const c = size_class(size, alignment);
+    if (c < 0) { return nullptr; }
+    auto const cls = s_cast< uint32_t >(c);
+
+    uint8_t* buf{nullptr};
+    auto* tc = my_cache();
+    if (tc == nullptr) {
+        std::unique_lock lg{m_mtx};
+        auto& free_bufs = m_free_bufs[cls];
+        if (!free_bufs.empty() || add_slab_locked(cls)) {
+            buf = free_bufs.back();
+            free_bufs.pop_back();
+            note_free_locked(cls);
+        }
+    } else if (!tc->bufs[cls].empty() || refill(*tc, cls)) {
+        buf = tc->bufs[cls].back();
+        tc->bufs[cls].pop_back();
+    }
+
+    if (buf == nullptr) {
+        COUNTER_INCREMENT(m_metrics, iobuf_pool_misses, 1);
+        return nullptr;
+    }
+    COUNTER_INCREMENT(m_metrics, iobuf_pool_allocs, 1);
+    return buf;
+}
+
+bool IOBufPool::free(uint8_t* buf) {
+    auto const c = slab_class(buf);
+    if (c < 0) { return false; }
+    auto const cls = s_cast< uint32_t >(c);
+
+    auto* tc = my_cache();
+    if (tc == nullptr) {
+        std::unique_lock lg{m_mtx};
+        m_free_bufs[cls].push_back(buf);
+        return true;
+    }
+
+    auto& bufs = tc->bufs[cls];
+    bufs.push_back(buf);
+    if (bufs.size() > m_thread_cache_cnt) {
+        // Keep half of the cache, so that a thread alternating allocs and frees doesn't move buffers on every op
+        release(bufs, cls, bufs.size() - (m_thread_cache_cnt / 2));
+    }
+    return true;
+}
+
+void IOBufPool::set_slab_cb(slab_cb_t cb, slab_cb_t release_cb) {
+    std::unique_lock lg{m_mtx};
+    m_slab_cb = std::move(cb);
+    m_slab_release_cb = std::move(release_cb);
+    if (m_slab_cb) {
+        for (auto const& [slab, huge_page] : m_slabs) {
+            m_slab_cb(slab, slab_size);
+        }
+    }
+}
+
+IOBufPool::thread_cache* IOBufPool::my_cache() {
+    auto* last = thread_cache::s_last;
+    if (last && (last->pool_id == m_id)) { return last; }
+    if (thread_cache::s_exited) { return nullptr; }
+
+    auto& caches = thread_cache::s_holder.caches;
+    auto it = std::find_if(caches.begin(), caches.end(), [this](auto const& tc) { return tc->pool_id == m_id; });
+    if (it == caches.end()) {
+        auto tc = std::make_unique< thread_cache >();
+        tc->pool = this;
+        tc->pool_id = m_id;
+        for (auto& bufs : tc->bufs) {
+            bufs.reserve(m_thread_cache_cnt + 1);
+        }
+        caches.push_back(std::move(tc));
+        it = std::prev(caches.end());
+    }
+    thread_cache::s_last = it->get();
+    return thread_cache::s_last;
+}
+
+bool IOBufPool::refill(thread_cache& tc, uint32_t cls) {
+    std::unique_lock lg{m_mtx};
+    auto& free_bufs = m_free_bufs[cls];
+    if (free_bufs.empty() && !add_slab_locked(cls)) { return false; }
+
+    auto const n = std::min(free_bufs.size(), s_cast< size_t >(std::max(m_thread_cache_cnt / 2, 1u)));
+    tc.bufs[cls].insert(tc.bufs[cls].end(), free_bufs.end() - n, free_bufs.end());
+    free_bufs.resize(free_bufs.size() - n);
+    note_free_locked(cls);
+    COUNTER_INCREMENT(m_metrics, iobuf_pool_refills, 1);
+    return true;
+}
+
+// Buffers of a class which stayed free all through the idle period are more than what the pool needed, so upto as
+// many slabs worth of them are released, each only if all of its buffers are free (none of them held by a thread cache
+// or in use). Looking for such slabs goes through the free list, which is done only if there could be any.
+uint32_t IOBufPool::release_idle_slabs(uint64_t idle_ms) {
+    std::vector< std::pair< uint8_t*, bool > > released;
+    {
+        std::unique_lock lg{m_mtx};
+        auto const now = std::chrono::steady_clock::now();
+        if (std::chrono::duration_cast< std::chrono::milliseconds >(now - m_last_idle_check).count() <
+            s_cast< int64_t >(idle_ms)) {
+            return 0;
+        }
+        m_last_idle_check = now;
+
+        for (uint32_t cls{0}; cls < num_classes; ++cls) {
+            auto& free_bufs = m_free_bufs[cls];
+            auto const per_slab = slab_size / class_size(cls);
+            auto const max_release = m_low_free[cls] / per_slab;
+            m_low_free[cls] = free_bufs.size();
+            if (max_release == 0) { continue; }
+
+            std::unordered_map< uintptr_t, size_t > nfree; // By slab base
+            for (auto* buf : free_bufs) {
+                ++nfree[r_cast< uintptr_t >(buf) & ~(slab_size - 1)];
+            }
+            std::unordered_set< uintptr_t > to_release;
+            for (auto const& [base, n] : nfree) {
+                if ((n == per_slab) && (to_release.size() < max_release)) { to_release.insert(base); }
+            }
+            if (to_release.empty()) { continue; }
+
+            free_bufs.erase(std::remove_if(free_bufs.begin(), free_bufs.end(),
+                                           [&to_release](uint8_t* buf) {
+                                               return to_release.count(r_cast< uintptr_t >(buf) & ~(slab_size - 1));
+                                           }),
+                            free_bufs.end());
+            m_low_free[cls] = free_bufs.size();
+            for (auto it = m_slabs.begin(); it != m_slabs.end();) {
+                if (to_release.count(r_cast< uintptr_t >(it->first))) {
+                    remove_slab_locked(it->first);
+                    if (m_slab_release_cb) { m_slab_release_cb(it->first, slab_size); }
+                    released.push_back(*it);
+                    it = m_slabs.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        if (!released.empty()) {
+            GAUGE_UPDATE(m_metrics, iobuf_pool_slab_mb, m_slabs.size() * (slab_size / (1024 * 1024)));
+        }
+    }
+
+    for (auto const& [slab, huge_page] : released) {
+        free_slab(slab, huge_page);
+    }
+    COUNTER_INCREMENT(m_metrics, iobuf_pool_slabs_released, released.size());
+    return uint32_cast(released.size());
+}
+
+void IOBufPool::release(std::vector< uint8_t* >& bufs, uint32_t cls, size_t nbufs) {
+    if (nbufs == 0) { return; }
+    std::unique_lock lg{m_mtx};
+    m_free_bufs[cls].insert(m_free_bufs[cls].end(), bufs.end() - nbufs, bufs.end());
+    bufs.resize(bufs.size() - nbufs);
+}
+
+bool IOBufPool::add_slab_locked(uint32_t cls) {
+    if (m_slabs.size() >= m_max_slabs) { return false; }
+
+    bool huge_page{false};
+    auto* slab = alloc_slab(huge_page);
+    if (slab == nullptr) { return false; }
+    if (m_numa_node >= 0) { hs_utils::bind_to_numa_node(slab, slab_size, m_numa_node); }
+
+    // Carved in the reverse, so that the buffers are handed out from the start of the slab
+    auto& free_bufs = m_free_bufs[cls];
+    for (size_t off{slab_size}; off > 0; off -= class_size(cls)) {
+        free_bufs.push_back(slab + off - class_size(cls));
+    }
+    m_slabs.emplace_back(slab, huge_page);
+    insert_slab_locked(slab, cls);
+    GAUGE_UPDATE(m_metrics, iobuf_pool_slab_mb, m_slabs.size() * (slab_size / (1024 * 1024)));
+
+    if (m_slab_cb) { m_slab_cb(slab, slab_size); }
+    return true;
+}
+
+uint8_t* IOBufPool::alloc_slab(bool& huge_page) {
+    if (m_huge_pages) {
+        // hugetlb mappings are aligned to the huge page size, which is the slab size
+        void* p = ::mmap(nullptr, slab_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            huge_page = true;
+            return r_cast< uint8_t* >(p);
+        }
+        LOGDEBUG("No huge pages for io buf pool slab, errno={}, falling back to regular pages", errno);
+    }
+
+    void* p = std::aligned_alloc(slab_size, slab_size);
+    if (p == nullptr) { return nullptr; }
+    ::madvise(p, slab_size, MADV_HUGEPAGE); // Best effort, transparent huge pages could be disabled
+    huge_page = false;
+    return r_cast< uint8_t* >(p);
+}
+
+static uint32_t slab_hash(uintptr_t base, uint32_t tbl_size) {
+    return uint32_cast(((base / IOBufPool::slab_size) * 0x9E3779B97F4A7C15ull) >> 32) & (tbl_size - 1);
+}
+
+void IOBufPool::insert_slab_locked(uint8_t* slab, uint32_t cls) {
+    auto const base = r_cast< uintptr_t >(slab);
+    for (auto i = slab_hash(base, m_slab_tbl_size);; i = (i + 1) & (m_slab_tbl_size - 1)) {
+        auto const v = m_slab_tbl[i].load(std::memory_order_relaxed);
+        if ((v == 0) || (v == slab_tombstone)) {
+            m_slab_tbl[i].store(base | (cls + 1), std::memory_order_release);
+            break;
+        }
+    }
+    m_nslabs.fetch_add(1, std::memory_order_release);
+}
+
+void IOBufPool::remove_slab_locked(uint8_t* slab) {
+    auto const base = r_cast< uintptr_t >(slab);
+    for (auto i = slab_hash(base, m_slab_tbl_size);; i = (i + 1) & (m_slab_tbl_size - 1)) {
+        if ((m_slab_tbl[i].load(std::memory_order_relaxed) & ~(slab_size - 1)) == base) {
+            m_slab_tbl[i].store(slab_tombstone, std::memory_order_release);
+            break;
+        }
+    }
+    m_nslabs.fetch_sub(1, std::memory_order_release);
+}
+
+int IOBufPool::slab_class(uint8_t const* buf) const {
+    if (m_nslabs.load(std::memory_order_acquire) == 0) { return -1; }
+
+    // Table could be left with no empty slot, of the tombstones which are not reused yet
+    auto const base = r_cast< uintptr_t >(buf) & ~(slab_size - 1);
+    auto i = slab_hash(base, m_slab_tbl_size);
+    for (uint32_t n{0}; n < m_slab_tbl_size; ++n, i = (i + 1) & (m_slab_tbl_size - 1)) {
+        auto const v = m_slab_tbl[i].load(std::memory_order_acquire);
+        if (v == 0) { return -1; }
+        if ((v != slab_tombstone) && ((v & ~(slab_size - 1)) == base)) {
+            return s_cast< int >(v & (slab_size - 1)) - 1;
+        }
+    }
+    return -1;
+}
+} // namespace homestore
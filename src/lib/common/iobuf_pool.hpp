@@ -0,0 +1,156 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+
+namespace homestore {
+class IOBufPoolMetrics : public sisl::MetricsGroup {
+public:
+    explicit IOBufPoolMetrics(std::string const& name) : sisl::MetricsGroup("IOBufPool", name) {
+        REGISTER_COUNTER(iobuf_pool_allocs, "Number of io buffers allocated from the pool");
+        REGISTER_COUNTER(iobuf_pool_misses, "Number of io buffers of pooled sizes not served as the pool is full");
+        REGISTER_COUNTER(iobuf_pool_refills, "Number of times a thread cache refilled from the shared free lists");
+        REGISTER_COUNTER(iobuf_pool_slabs_released, "Number of slabs released after staying unused");
+        REGISTER_GAUGE(iobuf_pool_slab_mb, "Memory allocated for the slabs of the pool in MB");
+        register_me_to_farm();
+    }
+
+    IOBufPoolMetrics(const IOBufPoolMetrics&) = delete;
+    IOBufPoolMetrics(IOBufPoolMetrics&&) noexcept = delete;
+    IOBufPoolMetrics& operator=(const IOBufPoolMetrics&) = delete;
+    IOBufPoolMetrics& operator=(IOBufPoolMetrics&&) noexcept = delete;
+    ~IOBufPoolMetrics() { deregister_me_from_farm(); }
+};
+
+//
+// IOBufPool serves the aligned io buffers of 4K to 64K (power of 2 size classes) out of 2MB slabs, each slab carved
+// into the buffers of a single class. Every thread caches upto thread_cache_cnt free buffers of each class and moves
+// them to and from the shared free list of the class in batches, so that most of the allocs and frees touch only the
+// cache of the thread. Buffer is aligned to its class size, so any alignment upto the class size is honoured.
+//
+// Pool (never the instance(), which lives till the end) has to outlive the threads using it. Slabs are released while
+// the pool lives only by release_idle_slabs, once they are unused: all their buffers are in the shared free list and
+// atleast as many buffers of their class stayed free all through the idle period. A free tells the buffers of the
+// pool apart by their slab (2MB frame of the address), which is looked up in a lock free open addressed table, so that
+// buffers not from the pool (allocated beyond the cap of the pool or of the sizes it does not serve) are handed back
+// to the caller to free as usual.
+//
+// Besides the instance(), there is a pool per numa node (created on its first use), whose slabs are bound to the node
+// as they are allocated, so that the buffers placed on a node don't cost an mbind each.
+//
+class IOBufPool {
+public:
+    static constexpr size_t slab_size{2 * 1024 * 1024};
+    static constexpr size_t min_class_size{4096};
+    static constexpr size_t max_class_size{64 * 1024};
+    static constexpr uint32_t num_classes{5}; // 4K, 8K, 16K, 32K and 64K
+    static constexpr int max_numa_nodes{64};   // Nodes the slabs can be bound to, see hs_utils::bind_to_numa_node
+
+    // Called for every slab as it is allocated, along with the slabs allocated so far when it is set
+    using slab_cb_t = std::function< void(uint8_t* slab, uint64_t size) >;
+
+    static IOBufPool& instance();
+
+    /// @brief Pool of the buffers bound to the numa node, instance() if the node is unknown (-1) or out of range
+    static IOBufPool& instance(int numa_node);
+
+    /// @brief Free the buffer if it is from instance() or from any of the pools of the numa nodes
+    /// @return false if the buffer is not from any of them, which the caller has to free
+    static bool free_any(uint8_t* buf);
+
+    /// @brief release_idle_slabs of instance() and of the pools of the numa nodes
+    static void release_idle_slabs_all(uint64_t idle_ms);
+
+    IOBufPool(uint32_t max_slabs, bool huge_pages, uint32_t thread_cache_cnt, int numa_node = -1);
+    IOBufPool(const IOBufPool&) = delete;
+    IOBufPool(IOBufPool&&) noexcept = delete;
+    IOBufPool& operator=(const IOBufPool&) = delete;
+    IOBufPool& operator=(IOBufPool&&) noexcept = delete;
+    ~IOBufPool();
+
+    /// @brief Allocate an io buffer of atleast size bytes, aligned to alignment
+    /// @return Buffer or nullptr if the size or the alignment is not served by the pool or the pool is full
+    uint8_t* alloc(size_t size, size_t alignment);
+
+    /// @brief Free the buffer if it is from the pool
+    /// @return false if the buffer is not from the pool, which the caller has to free
+    bool free(uint8_t* buf);
+
+    bool is_pooled(uint8_t const* buf) const { return slab_class(buf) >= 0; }
+
+    /// @brief Set the callback (nullptr to reset) called on every slab, to register them with the devices, and the one
+    /// called on a slab before it is released
+    void set_slab_cb(slab_cb_t cb, slab_cb_t release_cb = nullptr);
+
+    /// @brief Release the slabs unused since the last call, if it was atleast idle_ms ago
+    /// @return Number of slabs released
+    uint32_t release_idle_slabs(uint64_t idle_ms);
+
+    uint32_t num_slabs() const { return m_nslabs.load(std::memory_order_relaxed); }
+    uint32_t max_slabs() const { return m_max_slabs; }
+
+private:
+    struct thread_cache;
+
+    static int size_class(size_t size, size_t alignment);
+    static size_t class_size(uint32_t cls) { return min_class_size << cls; }
+
+    thread_cache* my_cache();
+    bool refill(thread_cache& tc, uint32_t cls);
+    void release(std::vector< uint8_t* >& bufs, uint32_t cls, size_t nbufs);
+    bool add_slab_locked(uint32_t cls);
+    uint8_t* alloc_slab(bool& huge_page);
+    void insert_slab_locked(uint8_t* slab, uint32_t cls);
+    void remove_slab_locked(uint8_t* slab);
+    void free_slab(uint8_t* slab, bool huge_page);
+    int slab_class(uint8_t const* buf) const;
+    void note_free_locked(uint32_t cls) { m_low_free[cls] = std::min(m_low_free[cls], m_free_bufs[cls].size()); }
+
+private:
+    uint32_t const m_max_slabs;
+    bool const m_huge_pages;
+    uint32_t const m_thread_cache_cnt;
+    uint64_t const m_id;   // Tells apart the thread caches of different pools
+    int const m_numa_node; // Slabs are bound to this node as they are allocated, -1 if they are not
+
+    // Slabs by their address: slab base | (cls + 1) in the slot of hash of the base, linear probed. Slab removed leaves
+    // a tombstone, reused by the slabs inserted later.
+    static constexpr uintptr_t slab_tombstone{1};
+    uint32_t m_slab_tbl_size;
+    std::unique_ptr< std::atomic< uintptr_t >[] > m_slab_tbl;
+    std::atomic< uint32_t > m_nslabs{0};
+
+    std::mutex m_mtx;
+    std::array< std::vector< uint8_t* >, num_classes > m_free_bufs; // Shared free lists, by class
+    std::vector< std::pair< uint8_t*, bool > > m_slabs;             // Slab and if it is a hugetlb mapping
+    std::array< size_t, num_classes > m_low_free{};                 // Fewest free buffers since the last idle check
+    std::chrono::steady_clock::time_point m_last_idle_check{std::chrono::steady_clock::now()};
+    slab_cb_t m_slab_cb;
+    slab_cb_t m_slab_release_cb;
+    IOBufPoolMetrics m_metrics;
+};
+} // namespace homestore
@@ -13,12 +13,18 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <homestore/homestore.hpp>
 #include <homestore/logstore_service.hpp>
 #include <homestore/replication_service.hpp>
+#include <boost/fiber/operations.hpp>
 #include <iomgr/iomgr_flip.hpp>
 #include "resource_mgr.hpp"
 #include "homestore_assert.hpp"
+#include "iobuf_pool.hpp"
+#include "device/device.h"
+#include "device/journal_vdev.hpp"
+#include "device/virtual_dev.hpp"
 #include "replication/repl_dev/raft_repl_dev.h"
 
 namespace homestore {
@@ -33,6 +39,10 @@ void ResourceMgr::stop() {
     LOGINFO("Cancel resource manager timer.");
     if (m_res_audit_timer_hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(m_res_audit_timer_hdl); }
     m_res_audit_timer_hdl = iomgr::null_timer_handle;
+    if (m_mem_rebalance_timer_hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(m_mem_rebalance_timer_hdl); }
+    m_mem_rebalance_timer_hdl = iomgr::null_timer_handle;
+    if (m_capacity_timer_hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(m_capacity_timer_hdl); }
+    m_capacity_timer_hdl = iomgr::null_timer_handle;
 }
 
 //
@@ -64,6 +74,21 @@ void ResourceMgr::trigger_truncate() {
 }
 
 void ResourceMgr::start_timer() {
+    auto const rebalance_ms = HS_DYNAMIC_CONFIG(resource_limits.mem_rebalance_interval_ms);
+    if (rebalance_ms != 0) {
+        m_mem_rebalance_timer_hdl = iomanager.schedule_global_timer(
+            uint64_cast(rebalance_ms) * 1000 * 1000, true /* recurring */, nullptr /* cookie */,
+            iomgr::reactor_regex::all_worker, [this](void*) { rebalance_mem(); }, true /* wait_to_schedule */);
+    }
+
+    auto const capacity_ms = HS_DYNAMIC_CONFIG(resource_limits.capacity_sample_interval_ms);
+    if (capacity_ms != 0) {
+        sample_capacity(); // Rates are then available after the first interval
+        m_capacity_timer_hdl = iomanager.schedule_global_timer(
+            uint64_cast(capacity_ms) * 1000 * 1000, true /* recurring */, nullptr /* cookie */,
+            iomgr::reactor_regex::all_worker, [this](void*) { sample_capacity(); }, true /* wait_to_schedule */);
+    }
+
     auto const res_mgr_timer_ms = HS_DYNAMIC_CONFIG(resource_limits.resource_audit_timer_ms);
     LOGINFO("resource audit timer is set to {} usec", res_mgr_timer_ms);
     if (res_mgr_timer_ms == 0) {
@@ -85,8 +110,11 @@ void ResourceMgr::inc_dirty_buf_size(const uint32_t size) {
     HS_REL_ASSERT_GT(size, 0);
     const auto dirty_buf_cnt = m_hs_dirty_buf_cnt.fetch_add(size, std::memory_order_relaxed);
     COUNTER_INCREMENT(m_metrics, dirty_buf_cnt, size);
-    if (m_dirty_buf_exceed_cb && ((dirty_buf_cnt + size) > get_dirty_buf_limit())) {
-        m_dirty_buf_exceed_cb(dirty_buf_cnt + size, false /* critical */);
+    if (m_dirty_buf_exceed_cb) {
+        auto const limit = get_dirty_buf_limit();
+        if ((dirty_buf_cnt + size) > (limit * HS_DYNAMIC_CONFIG(resource_limits.dirty_buf_cp_trigger_pct)) / 100) {
+            m_dirty_buf_exceed_cb(dirty_buf_cnt + size, (dirty_buf_cnt + size) > limit /* critical */);
+        }
     }
 }
 
@@ -99,6 +127,33 @@ void ResourceMgr::dec_dirty_buf_size(const uint32_t size) {
 
 void ResourceMgr::register_dirty_buf_exceed_cb(exceed_limit_cb_t cb) { m_dirty_buf_exceed_cb = std::move(cb); }
 
+uint64_t ResourceMgr::dirty_buf_throttle_delay_us() const {
+    auto const limit = get_dirty_buf_limit();
+    auto const start = (limit * HS_DYNAMIC_CONFIG(resource_limits.dirty_buf_throttle_start_pct)) / 100;
+    auto const end = 2 * limit;
+    auto const cnt = m_hs_dirty_buf_cnt.load(std::memory_order_relaxed);
+    if ((cnt <= start) || (start >= end)) { return 0; }
+
+    auto const max_us = uint64_cast(HS_DYNAMIC_CONFIG(resource_limits.dirty_buf_throttle_max_us));
+    if (cnt >= end) { return max_us; }
+    return (max_us * uint64_cast(cnt - start)) / uint64_cast(end - start);
+}
+
+uint32_t ResourceMgr::dirty_buf_pct() const {
+    auto const limit = get_dirty_buf_limit();
+    if (limit <= 0) { return 0; }
+    return uint32_cast((100 * std::max(m_hs_dirty_buf_cnt.load(std::memory_order_relaxed), int64_t{0})) / limit);
+}
+
+void ResourceMgr::throttle_dirty_buf_writer() {
+    auto const delay_us = dirty_buf_throttle_delay_us();
+    if (delay_us == 0) { return; }
+
+    COUNTER_INCREMENT(m_metrics, dirty_buf_throttled_cnt, 1);
+    HISTOGRAM_OBSERVE(m_metrics, dirty_buf_throttle_delay_us, delay_us);
+    boost::this_fiber::sleep_for(std::chrono::microseconds{delay_us});
+}
+
 /* monitor free blk cnt */
 void ResourceMgr::inc_free_blk(int size) {
     // trigger hs cp when either one of the limit is reached
@@ -119,6 +174,11 @@ void ResourceMgr::dec_free_blk(int size) {
 
 void ResourceMgr::register_free_blks_exceed_cb(exceed_limit_cb_t cb) { m_free_blks_exceed_cb = std::move(cb); }
 
+bool ResourceMgr::can_issue_background_io() const {
+    return m_hs_dirty_buf_cnt.load(std::memory_order_relaxed) <
+        (get_dirty_buf_limit() * HS_DYNAMIC_CONFIG(generic.data_gc_dirty_buf_pause_pct)) / 100;
+}
+
 bool ResourceMgr::can_add_free_blk(int cnt) const {
     if ((cur_free_blk_cnt() + cnt) > get_free_blk_cnt_limit() || (cur_free_blk_size()) > get_free_blk_size_limit()) {
         return false;
@@ -164,12 +224,100 @@ uint64_t ResourceMgr::get_cache_size() const {
     return ((HS_STATIC_CONFIG(input.io_mem_size()) * HS_DYNAMIC_CONFIG(resource_limits.cache_size_percent)) / 100);
 }
 
+uint64_t ResourceMgr::get_index_cache_size() const {
+    return ((get_cache_size() * HS_DYNAMIC_CONFIG(cache.index_cache_percent)) / 100);
+}
+
+/* monitor memory used by each of the consumers of the cache memory */
+void ResourceMgr::inc_mem_usage(mem_consumer_t consumer, uint64_t size) {
+    m_mem_usage[s_cast< size_t >(consumer)].fetch_add(size, std::memory_order_relaxed);
+}
+
+// Saturates at 0, since thread local pools (repl reqs) could release what they had taken before a restart of homestore
+void ResourceMgr::dec_mem_usage(mem_consumer_t consumer, uint64_t size) {
+    auto& usage = m_mem_usage[s_cast< size_t >(consumer)];
+    auto cur = usage.load(std::memory_order_relaxed);
+    while (!usage.compare_exchange_weak(cur, (cur > size) ? (cur - size) : 0, std::memory_order_relaxed)) {}
+}
+
+uint64_t ResourceMgr::mem_usage(mem_consumer_t consumer) const {
+    return m_mem_usage[s_cast< size_t >(consumer)].load(std::memory_order_relaxed);
+}
+
+uint64_t ResourceMgr::mem_quota(mem_consumer_t consumer) const {
+    switch (consumer) {
+    case mem_consumer_t::log_tail_cache:
+        return (get_cache_size() * HS_DYNAMIC_CONFIG(resource_limits.log_tail_cache_mem_percent)) / 100;
+    case mem_consumer_t::repl_reqs:
+        return (get_cache_size() * HS_DYNAMIC_CONFIG(resource_limits.repl_req_mem_percent)) / 100;
+    case mem_consumer_t::index_cache:
+    default: {
+        auto const index_size = get_index_cache_size();
+        auto const min_size = (index_size * HS_DYNAMIC_CONFIG(resource_limits.index_cache_min_pct)) / 100;
+        auto const others = mem_usage(mem_consumer_t::log_tail_cache) + mem_usage(mem_consumer_t::repl_reqs);
+        return (others >= index_size - min_size) ? min_size : (index_size - others);
+    }
+    }
+}
+
+bool ResourceMgr::can_add_mem(mem_consumer_t consumer, uint64_t size) const {
+    return (mem_usage(consumer) + size) <= mem_quota(consumer);
+}
+
+void ResourceMgr::register_mem_quota_cb(mem_consumer_t consumer, mem_quota_cb_t cb) {
+    std::unique_lock lg{m_mem_quota_mtx};
+    m_mem_quota_applied[s_cast< size_t >(consumer)] = 0;
+    m_mem_quota_cbs[s_cast< size_t >(consumer)] = std::move(cb);
+}
+
+void ResourceMgr::unregister_mem_quota_cb(mem_consumer_t consumer) {
+    std::unique_lock lg{m_mem_quota_mtx};
+    m_mem_quota_cbs[s_cast< size_t >(consumer)] = nullptr;
+}
+
+void ResourceMgr::rebalance_mem() {
+    if (auto const idle_secs = HS_DYNAMIC_CONFIG(generic.iobuf_pool_idle_release_secs); idle_secs != 0) {
+        IOBufPool::release_idle_slabs_all(uint64_cast(idle_secs) * 1000);
+    }
+
+    GAUGE_UPDATE(m_metrics, index_cache_mem, mem_usage(mem_consumer_t::index_cache));
+    GAUGE_UPDATE(m_metrics, log_tail_cache_mem, mem_usage(mem_consumer_t::log_tail_cache));
+    GAUGE_UPDATE(m_metrics, repl_req_mem, mem_usage(mem_consumer_t::repl_reqs));
+    GAUGE_UPDATE(m_metrics, index_cache_mem_quota, mem_quota(mem_consumer_t::index_cache));
+
+    std::unique_lock lg{m_mem_quota_mtx};
+    for (size_t i{0}; i < num_mem_consumers; ++i) {
+        if (!m_mem_quota_cbs[i]) { continue; }
+
+        // Resized only if the quota moved by more than a percent, so that small fluctuations don't churn the consumer
+        auto const quota = mem_quota(s_cast< mem_consumer_t >(i));
+        auto const applied = m_mem_quota_applied[i];
+        auto const diff = (quota > applied) ? (quota - applied) : (applied - quota);
+        if ((applied != 0) && (diff * 100 <= applied)) { continue; }
+
+        HS_PERIODIC_LOG(INFO, base, "Memory quota of consumer={} changed from {} to {}, usage={}",
+                        enum_name(s_cast< mem_consumer_t >(i)), applied, quota, mem_usage(s_cast< mem_consumer_t >(i)));
+        m_mem_quota_applied[i] = quota;
+        m_mem_quota_cbs[i](quota);
+    }
+}
+
 bool ResourceMgr::check_journal_descriptor_size(const uint64_t used_size) const {
     return (used_size >= get_journal_descriptor_size_limit());
 }
 
 /* monitor journal vdev size */
 bool ResourceMgr::check_journal_vdev_size(const uint64_t used_size, const uint64_t total_size) {
+    if (total_size != 0) { m_journal_vdev_used_pct.store(uint32_cast(100 * used_size / total_size)); }
+    if (std::unique_lock lg{m_journal_rate_mtx, std::try_to_lock}; lg.owns_lock()) {
+        // Whether truncation frees the journal faster than appends fill it, as of the last window
+        if (get_elapsed_time_ms(m_journal_rate_sample_time) >=
+            HS_DYNAMIC_CONFIG(resource_limits.journal_throttle_rate_window_ms)) {
+            m_journal_shrinking.store(used_size < m_journal_rate_sample_used, std::memory_order_relaxed);
+            m_journal_rate_sample_used = used_size;
+            m_journal_rate_sample_time = Clock::now();
+        }
+    }
     if (m_journal_vdev_exceed_cb) {
         const uint32_t used_pct = (100 * used_size / total_size);
         if (used_pct >= get_journal_vdev_size_limit()) {
@@ -184,6 +332,30 @@ bool ResourceMgr::check_journal_vdev_size(const uint64_t used_size, const uint64
 
 void ResourceMgr::register_journal_vdev_exceed_cb(exceed_limit_cb_t cb) { m_journal_vdev_exceed_cb = std::move(cb); }
 
+uint64_t ResourceMgr::journal_throttle_delay_us() const {
+    auto const start = HS_DYNAMIC_CONFIG(resource_limits.journal_throttle_start_pct);
+    auto const end = get_journal_vdev_size_critical_limit();
+    auto const used = journal_vdev_used_pct();
+    if ((used <= start) || (start >= end)) { return 0; }
+
+    auto const max_us = uint64_cast(HS_DYNAMIC_CONFIG(resource_limits.journal_throttle_max_us));
+    if (used >= end) { return max_us; }
+
+    // Linear in the fullness while the journal grows, quadratic (far smaller until close to critical) while it shrinks
+    auto delay_us = (max_us * (used - start)) / (end - start);
+    if (m_journal_shrinking.load(std::memory_order_relaxed)) { delay_us = (delay_us * (used - start)) / (end - start); }
+    return delay_us;
+}
+
+uint64_t ResourceMgr::throttle_journal_writer() {
+    auto const delay_us = journal_throttle_delay_us();
+    if (delay_us == 0) { return 0; }
+
+    COUNTER_INCREMENT(m_metrics, journal_throttled_cnt, 1);
+    HISTOGRAM_OBSERVE(m_metrics, journal_throttle_delay_us, delay_us);
+    return delay_us;
+}
+
 uint32_t ResourceMgr::get_journal_descriptor_size_limit() const {
     return HS_DYNAMIC_CONFIG(resource_limits.journal_descriptor_size_threshold_mb) * 1024 * 1024;
 }
@@ -213,6 +385,83 @@ void ResourceMgr::reset_dirty_buf_qd() {
     m_flush_dirty_buf_q_depth = HS_DYNAMIC_CONFIG(generic.cache_max_throttle_cnt);
 }
 
+void ResourceMgr::sample_capacity() {
+    capacity_sample sample{.time = Clock::now(), .vdevs = {}};
+    for (auto const& vdev : hs()->device_mgr()->get_vdevs()) {
+        sample.vdevs.push_back(
+            vdev_capacity_sample{.name = vdev->info().get_name(),
+                                 .size = vdev->size(),
+                                 .used_size = vdev->used_size(),
+                                 .written_bytes = vdev->written_bytes(),
+                                 .is_journal = (std::dynamic_pointer_cast< JournalVirtualDev >(vdev) != nullptr)});
+    }
+
+    auto const max_samples = std::max(HS_DYNAMIC_CONFIG(resource_limits.capacity_history_samples), 2u);
+    std::unique_lock lg{m_capacity_mtx};
+    m_capacity_samples.push_back(std::move(sample));
+    while (m_capacity_samples.size() > max_samples) {
+        m_capacity_samples.pop_front();
+    }
+}
+
+std::vector< vdev_capacity_rate > ResourceMgr::capacity_rates_between(capacity_sample const& from,
+                                                                     capacity_sample const& to) {
+    auto const secs = std::max(get_elapsed_time_us(from.time, to.time), uint64_t{1}) / (1000.0 * 1000.0);
+    std::vector< vdev_capacity_rate > rates;
+    for (auto const& v : to.vdevs) {
+        auto const it =
+            std::find_if(from.vdevs.begin(), from.vdevs.end(), [&v](auto const& f) { return f.name == v.name; });
+        if (it == from.vdevs.end()) { continue; } // Created after the earlier sample
+
+        vdev_capacity_rate rate{.name = v.name, .size = v.size, .used_size = v.used_size, .is_journal = v.is_journal};
+        rate.write_bytes_ps = (v.written_bytes - it->written_bytes) / secs;
+        rate.used_bytes_ps = (s_cast< double >(v.used_size) - s_cast< double >(it->used_size)) / secs;
+        if ((rate.used_bytes_ps > 0) && (v.size > v.used_size)) {
+            rate.secs_to_full = uint64_cast((v.size - v.used_size) / rate.used_bytes_ps);
+        }
+        rates.push_back(std::move(rate));
+    }
+    return rates;
+}
+
+std::vector< vdev_capacity_rate > ResourceMgr::capacity_rates(bool recent) const {
+    std::unique_lock lg{m_capacity_mtx};
+    if (m_capacity_samples.size() < 2) { return {}; }
+    auto const& from = recent ? m_capacity_samples[m_capacity_samples.size() - 2] : m_capacity_samples.front();
+    return capacity_rates_between(from, m_capacity_samples.back());
+}
+
+nlohmann::json ResourceMgr::capacity_status(int verbosity) const {
+    auto const to_json = [](std::vector< vdev_capacity_rate > const& rates) {
+        nlohmann::json j = nlohmann::json::array();
+        double journal_growth{0};
+        for (auto const& r : rates) {
+            j.push_back(r.to_json());
+            if (r.is_journal) { journal_growth += r.used_bytes_ps; }
+        }
+        return nlohmann::json{{"vdevs", std::move(j)}, {"journal_growth_bytes_ps", journal_growth}};
+    };
+
+    nlohmann::json j;
+    j["sample_interval_ms"] = HS_DYNAMIC_CONFIG(resource_limits.capacity_sample_interval_ms);
+    j["window"] = to_json(capacity_rates(false));
+    j["recent"] = to_json(capacity_rates(true));
+    if (verbosity > 0) {
+        std::unique_lock lg{m_capacity_mtx};
+        auto& samples = j["samples"];
+        samples = nlohmann::json::array();
+        for (auto const& s : m_capacity_samples) {
+            nlohmann::json vdevs = nlohmann::json::array();
+            for (auto const& v : s.vdevs) {
+                vdevs.push_back(
+                    nlohmann::json{{"name", v.name}, {"used_size", v.used_size}, {"written_bytes", v.written_bytes}});
+            }
+            samples.push_back(nlohmann::json{{"age_ms", get_elapsed_time_ms(s.time)}, {"vdevs", std::move(vdevs)}});
+        }
+    }
+    return j;
+}
+
 int64_t ResourceMgr::get_dirty_buf_limit() const {
     return int64_cast((HS_DYNAMIC_CONFIG(resource_limits.dirty_buf_percent) * HS_STATIC_CONFIG(input.io_mem_size())) /
                       100);
@@ -14,8 +14,18 @@
  *
  *********************************************************************************/
 #pragma once
+#include <array>
 #include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <sisl/fds/utils.hpp>
 #include <sisl/metrics/metrics.hpp>
+#include <sisl/utility/enum.hpp>
+#include <homestore/homestore_decl.hpp>
 #include "homestore_config.hpp"
 
 namespace homestore {
@@ -23,12 +33,22 @@ class RsrcMgrMetrics : public sisl::MetricsGroup {
 public:
     explicit RsrcMgrMetrics() : sisl::MetricsGroup("resource_mgr", "resource_mgr") {
         REGISTER_COUNTER(dirty_buf_cnt, "Total wb cache dirty buffer cnt", sisl::_publish_as::publish_as_gauge);
+        REGISTER_COUNTER(dirty_buf_throttled_cnt, "Total writes delayed for the dirty buffers");
+        REGISTER_HISTOGRAM(dirty_buf_throttle_delay_us, "Delay of the writes throttled for the dirty buffers",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
         REGISTER_COUNTER(free_blk_size_in_cp, "Total free blks size accumulated in a cp",
                          sisl::_publish_as::publish_as_gauge);
         REGISTER_COUNTER(free_blk_cnt_in_cp, "Total free blks cnt accumulated in a cp",
                          sisl::_publish_as::publish_as_gauge);
         REGISTER_COUNTER(alloc_blk_cnt_in_cp, "Total alloc blks cnt accumulated in a cp",
                          sisl::_publish_as::publish_as_gauge);
+        REGISTER_COUNTER(journal_throttled_cnt, "Total log appends delayed for the journal space");
+        REGISTER_HISTOGRAM(journal_throttle_delay_us, "Delay of the log appends throttled for the journal space",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_GAUGE(index_cache_mem, "Memory used by the index node cache");
+        REGISTER_GAUGE(log_tail_cache_mem, "Memory used by the tail caches of all the log stores");
+        REGISTER_GAUGE(repl_req_mem, "Memory held by the pooled repl req buffers");
+        REGISTER_GAUGE(index_cache_mem_quota, "Memory the index node cache is currently allowed upto");
         register_me_to_farm();
     }
 
@@ -42,6 +62,10 @@ public:
 typedef std::function< void(int64_t /* dirty_buf_cnt */, bool /* critical */) > exceed_limit_cb_t;
 const uint32_t max_qd_multiplier = 32;
 
+// Consumers of the cache memory (get_cache_size), which share it as per their quota
+ENUM(mem_consumer_t, uint8_t, index_cache, log_tail_cache, repl_reqs);
+typedef std::function< void(uint64_t /* quota */) > mem_quota_cb_t;
+
 class ResourceMgr {
 public:
     void start(uint64_t total_cap);
@@ -52,6 +76,18 @@ public:
     void dec_dirty_buf_size(const uint32_t size);
     void register_dirty_buf_exceed_cb(exceed_limit_cb_t cb);
 
+    /* Delay the writer (suspending the fiber, if on one) as per the dirty buffers above the throttle start, so that
+     * writers slow down smoothly while a cp catches up, instead of dirty buffers growing unbounded */
+    void throttle_dirty_buf_writer();
+    uint64_t dirty_buf_throttle_delay_us() const;
+
+    /* Dirty buffers as a percentage of the limit */
+    uint32_t dirty_buf_pct() const;
+
+    /* Background io (e.g. data gc) is allowed only while dirty buffers are well below the limit, so that it doesn't
+     * compete with foreground io for a cp */
+    bool can_issue_background_io() const;
+
     /* monitor free blk cnt */
     void inc_free_blk(int size);
 
@@ -76,6 +112,44 @@ public:
     /* get cache size */
     uint64_t get_cache_size() const;
 
+    /* get the share of cache size used by the index node cache */
+    uint64_t get_index_cache_size() const;
+
+    /* monitor memory used by each of the consumers of the cache memory */
+    void inc_mem_usage(mem_consumer_t consumer, uint64_t size);
+    void dec_mem_usage(mem_consumer_t consumer, uint64_t size);
+    uint64_t mem_usage(mem_consumer_t consumer) const;
+
+    /**
+     * @brief Memory the consumer is allowed upto. Log tail caches and repl req buffers are capped at their own
+     * percentage of the cache memory. Whatever they use is taken out of the share of the index node cache, which
+     * shrinks down to index_cache_min_pct of it under such pressure and grows back as they release it.
+     */
+    uint64_t mem_quota(mem_consumer_t consumer) const;
+
+    /* Whether the consumer can take size more memory without going over its quota */
+    bool can_add_mem(mem_consumer_t consumer, uint64_t size) const;
+
+    /**
+     * @brief Registers the callback to resize the consumer to its quota, called whenever the quota changes upon a
+     * rebalance of the memory across the consumers
+     */
+    void register_mem_quota_cb(mem_consumer_t consumer, mem_quota_cb_t cb);
+    void unregister_mem_quota_cb(mem_consumer_t consumer);
+
+    /* Recompute the quotas of the consumers as per their usage and resize the ones whose quota changed */
+    void rebalance_mem();
+
+    /* Sample the used size and the bytes written of each vdev, into the window of the last capacity_history_samples
+     * which the capacity rates are computed over. Called every capacity_sample_interval_ms */
+    void sample_capacity();
+
+    /* Capacity and rates of each vdev over the window of samples, or over the last interval alone if recent */
+    std::vector< vdev_capacity_rate > capacity_rates(bool recent = false) const;
+
+    /* Rates over the window and over the last interval, along with the samples on a higher verbosity */
+    nlohmann::json capacity_status(int verbosity) const;
+
     /**
      * @brief Checks if the journal virtual device (vdev) size is within the specified limits.
      *
@@ -109,6 +183,16 @@ public:
      */
     void register_journal_vdev_exceed_cb(exceed_limit_cb_t cb);
 
+    /* Used percentage of journal vdev, as of its last check_journal_vdev_size */
+    uint32_t journal_vdev_used_pct() const { return m_journal_vdev_used_pct.load(std::memory_order_relaxed); }
+
+    /* Delay the log appender is to be deferred by, as per the journal vdev fullness above the throttle start, growing
+     * upto the critical limit, and more gently while truncation is freeing the journal faster than it is filled. So
+     * that appenders slow down gradually as the journal fills up, instead of stalling once it is full. Appender is
+     * counted as throttled if it is non zero, it is upto the caller to defer the append without blocking. */
+    uint64_t throttle_journal_writer();
+    uint64_t journal_throttle_delay_us() const;
+
     uint32_t get_journal_vdev_size_limit() const;
     uint32_t get_journal_vdev_size_critical_limit() const;
     uint32_t get_journal_descriptor_size_limit() const;
@@ -136,13 +220,36 @@ private:
      */
     void start_timer();
 
+    struct vdev_capacity_sample {
+        std::string name;
+        uint64_t size;
+        uint64_t used_size;
+        uint64_t written_bytes;
+        bool is_journal;
+    };
+
+    struct capacity_sample {
+        Clock::time_point time;
+        std::vector< vdev_capacity_sample > vdevs;
+    };
+
+    static std::vector< vdev_capacity_rate > capacity_rates_between(capacity_sample const& from,
+                                                                    capacity_sample const& to);
+
 private:
+    static constexpr size_t num_mem_consumers{3};
+
     std::atomic< int64_t > m_hs_dirty_buf_cnt;
     std::atomic< int64_t > m_hs_fb_cnt;  // free count
     std::atomic< int64_t > m_hs_fb_size; // free size
     std::atomic< int64_t > m_hs_ab_cnt;  // alloc count
     std::atomic< int64_t > m_memory_used_in_recovery;
     std::atomic< uint32_t > m_flush_dirty_buf_q_depth{64};
+    std::atomic< uint32_t > m_journal_vdev_used_pct{0};
+    std::atomic< bool > m_journal_shrinking{false}; // Used size of journal vdev went down over the last rate window
+    std::mutex m_journal_rate_mtx;
+    Clock::time_point m_journal_rate_sample_time{Clock::now()};
+    uint64_t m_journal_rate_sample_used{0};
     uint64_t m_total_cap;
 
     // TODO: make it event_cb
@@ -152,6 +259,16 @@ private:
     RsrcMgrMetrics m_metrics;
 
     iomgr::timer_handle_t m_res_audit_timer_hdl{iomgr::null_timer_handle};
+    iomgr::timer_handle_t m_mem_rebalance_timer_hdl{iomgr::null_timer_handle};
+    iomgr::timer_handle_t m_capacity_timer_hdl{iomgr::null_timer_handle};
+
+    mutable std::mutex m_capacity_mtx;
+    std::deque< capacity_sample > m_capacity_samples; // Oldest first
+
+    std::array< std::atomic< uint64_t >, num_mem_consumers > m_mem_usage{}; // By mem_consumer_t
+    std::mutex m_mem_quota_mtx;
+    std::array< mem_quota_cb_t, num_mem_consumers > m_mem_quota_cbs;
+    std::array< uint64_t, num_mem_consumers > m_mem_quota_applied{}; // Quota each consumer was last resized to
 };
 
 extern ResourceMgr& resource_mgr();
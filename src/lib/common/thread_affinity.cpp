@@ -0,0 +1,117 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <pthread.h>
+#include <sched.h>
+#include <sstream>
+#include <string_view>
+
+#include <sisl/logging/logging.h>
+#include "thread_affinity.hpp"
+#include "homestore_config.hpp"
+
+namespace homestore {
+static bool parse_uint(std::string_view s, uint32_t& val) {
+    auto const [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), val);
+    return (ec == std::errc{}) && (ptr == s.data() + s.size()) && !s.empty();
+}
+
+std::vector< uint32_t > parse_cpu_list(std::string const& cpus) {
+    std::vector< uint32_t > ret;
+    std::stringstream ss{cpus};
+    std::string tok;
+    while (std::getline(ss, tok, ',')) {
+        tok.erase(std::remove_if(tok.begin(), tok.end(), [](unsigned char c) { return std::isspace(c); }), tok.end());
+        if (tok.empty()) { continue; }
+
+        uint32_t first, last;
+        if (tok.starts_with("node")) {
+            if (!parse_uint(std::string_view{tok}.substr(4), first)) { return {}; }
+            std::ifstream ifs{fmt::format("/sys/devices/system/node/node{}/cpulist", first)};
+            std::string node_cpus;
+            if (!ifs || !std::getline(ifs, node_cpus)) {
+                LOGWARN("Cpus of numa node={} are not known", first);
+                return {};
+            }
+            auto const v = parse_cpu_list(node_cpus);
+            if (v.empty()) { return {}; }
+            ret.insert(ret.end(), v.begin(), v.end());
+            continue;
+        }
+
+        auto const dash = tok.find('-');
+        if (dash == std::string::npos) {
+            if (!parse_uint(tok, first)) { return {}; }
+            last = first;
+        } else if (!parse_uint(std::string_view{tok}.substr(0, dash), first) ||
+                   !parse_uint(std::string_view{tok}.substr(dash + 1), last) || (last < first)) {
+            return {};
+        }
+        for (auto cpu = first; cpu <= last; ++cpu) {
+            ret.push_back(cpu);
+        }
+    }
+
+    std::sort(ret.begin(), ret.end());
+    ret.erase(std::unique(ret.begin(), ret.end()), ret.end());
+    return ret;
+}
+
+static std::string role_cpus(hs_thread_role_t role) {
+    switch (role) {
+    case hs_thread_role_t::logstore:
+        return HS_DYNAMIC_CONFIG(affinity->logstore_cpus);
+    case hs_thread_role_t::index_flush:
+        return HS_DYNAMIC_CONFIG(affinity->index_flush_cpus);
+    case hs_thread_role_t::cp:
+        return HS_DYNAMIC_CONFIG(affinity->cp_cpus);
+    case hs_thread_role_t::blkalloc_sweep:
+        return HS_DYNAMIC_CONFIG(affinity->blkalloc_sweep_cpus);
+    case hs_thread_role_t::repl:
+        return HS_DYNAMIC_CONFIG(affinity->repl_cpus);
+    case hs_thread_role_t::meta:
+        return HS_DYNAMIC_CONFIG(affinity->meta_cpus);
+    case hs_thread_role_t::data_bg:
+        return HS_DYNAMIC_CONFIG(affinity->data_bg_cpus);
+    }
+    return std::string{};
+}
+
+void pin_thread(hs_thread_role_t role) {
+    auto cpus = role_cpus(role);
+    if (cpus.empty()) { cpus = HS_DYNAMIC_CONFIG(affinity->background_cpus); }
+    if (cpus.empty()) { return; }
+
+    auto const cpu_ids = parse_cpu_list(cpus);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto const cpu : cpu_ids) {
+        if (cpu < CPU_SETSIZE) { CPU_SET(cpu, &set); }
+    }
+    if (CPU_COUNT(&set) == 0) {
+        LOGWARN("Invalid cpus=[{}] for the threads of {}, leaving them unpinned", cpus, enum_name(role));
+        return;
+    }
+
+    if (auto const ret = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); ret != 0) {
+        LOGWARN("Pinning a thread of {} to cpus=[{}] failed, error={}", enum_name(role), cpus, ret);
+        return;
+    }
+    LOGINFO("Pinned a thread of {} to cpus=[{}]", enum_name(role), cpus);
+}
+} // namespace homestore
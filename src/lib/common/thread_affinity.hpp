@@ -0,0 +1,42 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <sisl/utility/enum.hpp>
+
+namespace homestore {
+// Background services, whose threads (and the fibers on them) could be pinned to cpus of their own
+VENUM(hs_thread_role_t, uint8_t, logstore = 0, index_flush = 1, cp = 2, blkalloc_sweep = 3, repl = 4, meta = 5,
+      data_bg = 6);
+
+//
+// Threads of the background services are started by HomeStore (reactors or plain threads), which otherwise end up
+// wherever iomgr or the kernel puts them, sharing the cpus of the foreground reactors. Each of them calls pin_thread
+// as it starts, which pins it to the cpus of its service in the affinity settings, or else to the background cpus.
+//
+
+/// @brief Cpus of the cpu list, which is comma separated cpus ("12"), ranges of them ("2-5") and NUMA nodes ("node1"
+/// for all the cpus of the node)
+/// @return Cpus in ascending order, empty if the list is not valid
+std::vector< uint32_t > parse_cpu_list(std::string const& cpus);
+
+/// @brief Pin the calling thread to the cpus of the role in the affinity settings. No-op if the role nor the
+/// background has any cpus set.
+void pin_thread(hs_thread_role_t role);
+} // namespace homestore
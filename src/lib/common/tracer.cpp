@@ -0,0 +1,188 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include <homestore/tracer.hpp>
+#include "homestore_config.hpp"
+
+namespace homestore {
+namespace {
+// Spans recorded by a thread, the oldest overwritten. Lock is contended only by a dump.
+struct span_ring {
+    std::mutex mtx;
+    std::vector< trace_span > spans;
+    uint64_t nspans{0}; // Recorded so far, next one goes to nspans % size
+    uint32_t thread;
+};
+
+struct tracer_state {
+    std::mutex mtx;
+    std::vector< std::shared_ptr< span_ring > > rings;
+    uint32_t next_thread{0};
+
+    std::atomic< bool > has_export_cb{false};
+    std::shared_ptr< Tracer::export_cb_t > export_cb;
+
+    std::atomic< trace_id_t > next_id;
+    int64_t steady_to_unix_ns; // Offset of the unix time from the steady clock
+
+    tracer_state() {
+        std::random_device rd;
+        next_id.store((uint64_t{rd()} << 32) | rd());
+        auto const unix_ns = std::chrono::duration_cast< std::chrono::nanoseconds >(
+                                 std::chrono::system_clock::now().time_since_epoch())
+                                 .count();
+        auto const steady_ns =
+            std::chrono::duration_cast< std::chrono::nanoseconds >(Clock::now().time_since_epoch()).count();
+        steady_to_unix_ns = unix_ns - steady_ns;
+    }
+};
+
+// Never destroyed, as threads could record spans upto the very end
+tracer_state& state() {
+    static tracer_state* s = new tracer_state();
+    return *s;
+}
+
+span_ring& my_ring() {
+    thread_local std::shared_ptr< span_ring > t_ring;
+    if (t_ring == nullptr) {
+        auto ring = std::make_shared< span_ring >();
+        ring->spans.resize(std::max(HS_DYNAMIC_CONFIG(generic->trace_ring_spans), 1u));
+
+        auto& st = state();
+        std::unique_lock lg{st.mtx};
+        ring->thread = st.next_thread++;
+        // Rings of the threads exited are dropped, only the tracer holds them
+        st.rings.erase(std::remove_if(st.rings.begin(), st.rings.end(),
+                                      [](auto const& r) { return r.use_count() == 1; }),
+                       st.rings.end());
+        st.rings.push_back(ring);
+        t_ring = std::move(ring);
+    }
+    return *t_ring;
+}
+
+uint64_t to_unix_ns(Clock::time_point t) {
+    return uint64_cast(std::chrono::duration_cast< std::chrono::nanoseconds >(t.time_since_epoch()).count() +
+                       state().steady_to_unix_ns);
+}
+} // namespace
+
+thread_local trace_id_t Tracer::t_current{invalid_trace_id};
+
+trace_id_t Tracer::sample() {
+    auto const every = HS_DYNAMIC_CONFIG(generic->trace_sample_every);
+    if (every == 0) { return invalid_trace_id; }
+
+    thread_local uint64_t t_nreqs{0};
+    if ((++t_nreqs % every) != 0) { return invalid_trace_id; }
+
+    trace_id_t id;
+    do {
+        id = state().next_id.fetch_add(1, std::memory_order_relaxed);
+    } while (id == invalid_trace_id);
+    return id;
+}
+
+void Tracer::record_span(trace_id_t id, char const* name, Clock::time_point start, Clock::time_point end,
+                         uint64_t arg) {
+    auto& ring = my_ring();
+    trace_span span{.trace_id = id,
+                    .name = name,
+                    .start_ns = to_unix_ns(start),
+                    .end_ns = to_unix_ns(end),
+                    .arg = arg,
+                    .thread = ring.thread};
+    {
+        std::unique_lock lg{ring.mtx};
+        ring.spans[ring.nspans++ % ring.spans.size()] = span;
+    }
+
+    auto& st = state();
+    if (st.has_export_cb.load(std::memory_order_acquire)) {
+        std::shared_ptr< export_cb_t > cb;
+        {
+            std::unique_lock lg{st.mtx};
+            cb = st.export_cb;
+        }
+        if (cb) { (*cb)(span); }
+    }
+}
+
+void Tracer::set_export_cb(export_cb_t cb) {
+    auto& st = state();
+    std::unique_lock lg{st.mtx};
+    st.export_cb = cb ? std::make_shared< export_cb_t >(std::move(cb)) : nullptr;
+    st.has_export_cb.store(st.export_cb != nullptr, std::memory_order_release);
+}
+
+nlohmann::json Tracer::dump(uint32_t max_traces) {
+    std::map< trace_id_t, std::vector< trace_span > > traces;
+    {
+        auto& st = state();
+        std::unique_lock lg{st.mtx};
+        for (auto const& ring : st.rings) {
+            std::unique_lock rlg{ring->mtx};
+            auto const n = std::min(ring->nspans, uint64_cast(ring->spans.size()));
+            for (uint64_t i{0}; i < n; ++i) {
+                auto const& span = ring->spans[i];
+                traces[span.trace_id].push_back(span);
+            }
+        }
+    }
+
+    // Most recent first, by the end of their last span
+    struct trace_info {
+        trace_id_t id;
+        uint64_t start_ns;
+        uint64_t end_ns;
+    };
+    std::vector< trace_info > infos;
+    infos.reserve(traces.size());
+    for (auto& [id, spans] : traces) {
+        std::sort(spans.begin(), spans.end(), [](auto const& a, auto const& b) { return a.start_ns < b.start_ns; });
+        auto const end_it = std::max_element(spans.begin(), spans.end(),
+                                             [](auto const& a, auto const& b) { return a.end_ns < b.end_ns; });
+        infos.push_back(trace_info{id, spans.front().start_ns, end_it->end_ns});
+    }
+    std::sort(infos.begin(), infos.end(), [](auto const& a, auto const& b) { return a.end_ns > b.end_ns; });
+    if (infos.size() > max_traces) { infos.resize(max_traces); }
+
+    nlohmann::json j = nlohmann::json::array();
+    for (auto const& info : infos) {
+        nlohmann::json spans_j = nlohmann::json::array();
+        for (auto const& span : traces[info.id]) {
+            spans_j.push_back(nlohmann::json{{"name", span.name},
+                                             {"start_us", (span.start_ns - info.start_ns) / 1000},
+                                             {"duration_us", (span.end_ns - span.start_ns) / 1000},
+                                             {"arg", span.arg},
+                                             {"thread", span.thread}});
+        }
+        j.push_back(nlohmann::json{{"trace_id", fmt::format("{:016x}", info.id)},
+                                   {"start_unix_ns", info.start_ns},
+                                   {"duration_us", (info.end_ns - info.start_ns) / 1000},
+                                   {"spans", std::move(spans_j)}});
+    }
+    return j;
+}
+} // namespace homestore
@@ -1,43 +1,133 @@
 // Only x86 and x86_64 supported by Intel Storage Acceleration library
 #ifdef NO_ISAL
 
+#include <array>
 #include <cstdint>
 #include <cstddef>
-extern "C" {
-#define MAX_ITER 8
+#include <cstring>
 
-// crc16_t10dif reference function, slow crc16 from the definition.
-uint16_t crc16_t10dif(uint16_t seed, const unsigned char* buf, uint64_t len) {
-    size_t rem = seed;
-    unsigned int i, j;
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+//
+// Fallbacks are table driven, slicing-by-8: each table k gives the crc of a byte followed by k zero bytes, so 8 bytes
+// are folded into the crc with 8 independent lookups instead of 64 bit steps. crc32c (reflected) uses the crc
+// instructions of ARMv8 where available. These instructions compute only reflected crcs, so t10dif and ieee (msb first)
+// stay on tables.
+//
+namespace {
+constexpr uint32_t num_slices{8};
+template < typename T >
+using slice_tables_t = std::array< std::array< T, 256 >, num_slices >;
 
-    uint16_t poly = 0x8bb7; // t10dif standard
+// Msb first crc of the width of T, from the definition
+template < typename T >
+constexpr slice_tables_t< T > make_msb_tables(T poly) {
+    constexpr uint32_t width{sizeof(T) * 8};
+    constexpr T top_bit = T(T(1) << (width - 1));
+    slice_tables_t< T > t{};
+    for (uint32_t i{0}; i < 256; ++i) {
+        T crc = T(T(i) << (width - 8));
+        for (uint32_t j{0}; j < 8; ++j) {
+            crc = (crc & top_bit) ? T(T(crc << 1) ^ poly) : T(crc << 1);
+        }
+        t[0][i] = crc;
+    }
+    for (uint32_t k{1}; k < num_slices; ++k) {
+        for (uint32_t i{0}; i < 256; ++i) {
+            t[k][i] = T(T(t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> (width - 8)]);
+        }
+    }
+    return t;
+}
 
-    for (i = 0; i < len; i++) {
-        rem = rem ^ (buf[i] << 8);
-        for (j = 0; j < MAX_ITER; j++) {
-            rem = rem << 1;
-            rem = (rem & 0x10000) ? rem ^ poly : rem;
+#if !defined(__ARM_FEATURE_CRC32)
+// Reflected (lsb first) crc32
+constexpr slice_tables_t< uint32_t > make_refl_tables(uint32_t poly) {
+    slice_tables_t< uint32_t > t{};
+    for (uint32_t i{0}; i < 256; ++i) {
+        uint32_t crc = i;
+        for (uint32_t j{0}; j < 8; ++j) {
+            crc = (crc & 1) ? ((crc >> 1) ^ poly) : (crc >> 1);
+        }
+        t[0][i] = crc;
+    }
+    for (uint32_t k{1}; k < num_slices; ++k) {
+        for (uint32_t i{0}; i < 256; ++i) {
+            t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xFF];
         }
     }
-    return rem;
+    return t;
+}
+#endif
+
+constexpr auto t10dif_tables = make_msb_tables< uint16_t >(0x8bb7);   // t10dif standard
+constexpr auto ieee_tables = make_msb_tables< uint32_t >(0x04C11DB7); // IEEE standard
+#if !defined(__ARM_FEATURE_CRC32)
+constexpr auto iscsi_tables = make_refl_tables(0x82F63B78); // castagnoli, reflected
+#endif
+} // namespace
+
+extern "C" {
+// crc16_t10dif, msb first, no inversion of the seed or the result
+uint16_t crc16_t10dif(uint16_t seed, const unsigned char* buf, uint64_t len) {
+    auto const& t = t10dif_tables;
+    uint16_t crc = seed;
+    for (; len >= num_slices; len -= num_slices, buf += num_slices) {
+        uint16_t const hi = crc ^ uint16_t((buf[0] << 8) | buf[1]);
+        crc = t[7][hi >> 8] ^ t[6][hi & 0xFF] ^ t[5][buf[2]] ^ t[4][buf[3]] ^ t[3][buf[4]] ^ t[2][buf[5]] ^
+            t[1][buf[6]] ^ t[0][buf[7]];
+    }
+    for (; len > 0; --len, ++buf) {
+        crc = uint16_t(crc << 8) ^ t[0][((crc >> 8) ^ *buf) & 0xFF];
+    }
+    return crc;
 }
 
-// crc32_ieee reference function, slow crc32 from the definition.
+// crc32_ieee, msb first, with inversion of the seed and the result
 uint32_t crc32_ieee(uint32_t seed, const unsigned char* buf, uint64_t len) {
-    uint64_t rem = ~seed;
-    unsigned int i, j;
+    auto const& t = ieee_tables;
+    uint32_t crc = ~seed;
+    for (; len >= num_slices; len -= num_slices, buf += num_slices) {
+        uint32_t const hi =
+            crc ^ ((uint32_t(buf[0]) << 24) | (uint32_t(buf[1]) << 16) | (uint32_t(buf[2]) << 8) | buf[3]);
+        crc = t[7][hi >> 24] ^ t[6][(hi >> 16) & 0xFF] ^ t[5][(hi >> 8) & 0xFF] ^ t[4][hi & 0xFF] ^ t[3][buf[4]] ^
+            t[2][buf[5]] ^ t[1][buf[6]] ^ t[0][buf[7]];
+    }
+    for (; len > 0; --len, ++buf) {
+        crc = (crc << 8) ^ t[0][((crc >> 24) ^ *buf) & 0xFF];
+    }
+    return ~crc;
+}
 
-    uint32_t poly = 0x04C11DB7; // IEEE standard
+// crc32_iscsi, crc32c (reflected). Same as isa-l, no inversion of the init crc or the result.
+unsigned int crc32_iscsi(unsigned char* buffer, int len, unsigned int init_crc) {
+    uint32_t crc = init_crc;
+    size_t n = (len > 0) ? size_t(len) : 0;
 
-    for (i = 0; i < len; i++) {
-        rem = rem ^ ((uint64_t)buf[i] << 24);
-        for (j = 0; j < MAX_ITER; j++) {
-            rem = rem << 1;
-            rem = (rem & 0x100000000ULL) ? rem ^ poly : rem;
-        }
+#if defined(__ARM_FEATURE_CRC32)
+    for (; n >= sizeof(uint64_t); n -= sizeof(uint64_t), buffer += sizeof(uint64_t)) {
+        uint64_t v;
+        std::memcpy(&v, buffer, sizeof(v));
+        crc = __crc32cd(crc, v);
+    }
+    for (; n > 0; --n, ++buffer) {
+        crc = __crc32cb(crc, *buffer);
     }
-    return ~rem;
+#else
+    auto const& t = iscsi_tables;
+    for (; n >= num_slices; n -= num_slices, buffer += num_slices) {
+        uint32_t const lo =
+            crc ^ (buffer[0] | (uint32_t(buffer[1]) << 8) | (uint32_t(buffer[2]) << 16) | (uint32_t(buffer[3]) << 24));
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+            t[3][buffer[4]] ^ t[2][buffer[5]] ^ t[1][buffer[6]] ^ t[0][buffer[7]];
+    }
+    for (; n > 0; --n, ++buffer) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *buffer) & 0xFF];
+    }
+#endif
+    return crc;
 }
 }
 #endif
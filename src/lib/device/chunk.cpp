@@ -12,15 +12,27 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <memory>
+
+#include <boost/fiber/future.hpp>
+
 #include "device/chunk.h"
 #include "device/device.h"
 #include "device/physical_dev.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_utils.hpp"
 #include "blkalloc/blk_allocator.h"
 
 namespace homestore {
 Chunk::Chunk(PhysicalDev* pdev, const chunk_info& cinfo, uint32_t chunk_slot) :
-        m_chunk_info{cinfo}, m_pdev{pdev}, m_chunk_slot{chunk_slot}, m_stream_id{pdev->chunk_to_stream_id(cinfo)} {}
+        m_zeroed_upto{cinfo.zero_pending ? cinfo.zeroed_upto : cinfo.chunk_size},
+        m_compressed_blks{cinfo.compressed_blks != 0x00},
+        m_chunk_info{cinfo},
+        m_pdev{pdev},
+        m_chunk_slot{chunk_slot},
+        m_stream_id{pdev->chunk_to_stream_id(cinfo)} {}
 
 std::string Chunk::to_string() const {
     return fmt::format("chunk_id={}, vdev_id={}, start_offset={}, size={}, slot_num_in_pdev={} "
@@ -36,6 +48,116 @@ void Chunk::set_user_private(const sisl::blob& data) {
     write_chunk_info();
 }
 
+void Chunk::set_has_compressed_blks() {
+    std::unique_lock lg{m_mgmt_mutex};
+    if (m_chunk_info.compressed_blks) { return; }
+    m_chunk_info.compressed_blks = 0x01;
+    m_chunk_info.compute_checksum();
+    write_chunk_info();
+    m_compressed_blks.store(true, std::memory_order_release);
+}
+
+void Chunk::start_lazy_zero() {
+    std::unique_lock zlg{m_zero_mutex};
+    std::unique_lock lg{m_mgmt_mutex};
+    m_chunk_info.zero_pending = 0x01;
+    m_chunk_info.zeroed_upto = 0;
+    m_chunk_info.compute_checksum();
+    write_chunk_info();
+    m_zeroed_upto.store(0, std::memory_order_release);
+}
+
+folly::Future< std::error_code > Chunk::async_zero_upto(uint64_t offset_in_chunk) {
+    return add_zero_waiter(offset_in_chunk, false /* sync */);
+}
+
+std::error_code Chunk::zero_upto(uint64_t offset_in_chunk) {
+    auto f = add_zero_waiter(offset_in_chunk, true /* sync */);
+    if (f.isReady()) { return std::move(f).value(); }
+
+    // Zeroing in flight was issued by an async write and is completed on its reactor, which could be the reactor of
+    // the caller too
+    auto done = std::make_shared< boost::fibers::promise< std::error_code > >();
+    auto done_f = done->get_future();
+    std::move(f).thenValue([done](std::error_code err) { done->set_value(err); });
+    return done_f.get();
+}
+
+folly::Future< std::error_code > Chunk::add_zero_waiter(uint64_t offset_in_chunk, bool sync) {
+    folly::Future< std::error_code > f = folly::makeFuture< std::error_code >(std::error_code{});
+    {
+        std::unique_lock zlg{m_zero_mutex};
+        if (offset_in_chunk <= m_zeroed_upto.load(std::memory_order_acquire)) { return f; }
+        f = m_zero_waiters.emplace_back(offset_in_chunk, folly::Promise< std::error_code >{}).second.getFuture();
+        if (m_zero_inflight) { return f; } // Zeroed for once the zeroing in flight completes
+        m_zero_inflight = true;
+    }
+
+    // Sync callers zero in their own context, so that they are never waiting for a reactor to complete their zeroing
+    issue_zero(sync);
+    return f;
+}
+
+void Chunk::issue_zero(bool sync) {
+    uint64_t cur;
+    uint64_t target{0};
+    {
+        std::unique_lock zlg{m_zero_mutex};
+        cur = m_zeroed_upto.load(std::memory_order_acquire);
+        for (auto const& [offset, _] : m_zero_waiters) {
+            target = std::max(target, offset);
+        }
+    }
+
+    // Zero in steps, so that a sequence of small writes doesn't cause a zero io and chunk info write every time
+    auto const step = uint64_cast(HS_DYNAMIC_CONFIG(device->lazy_zero_step_size_mb)) * 1024 * 1024;
+    auto const new_upto = std::min(sisl::round_up(target, step), size());
+    if (sync) {
+        on_zeroed(new_upto, physical_dev_mutable()->sync_write_zero(new_upto - cur, start_offset() + cur), sync);
+    } else {
+        physical_dev_mutable()
+            ->async_write_zero(new_upto - cur, start_offset() + cur)
+            .thenValue([this, new_upto](std::error_code err) { on_zeroed(new_upto, err, false /* sync */); });
+    }
+}
+
+void Chunk::on_zeroed(uint64_t new_upto, std::error_code err, bool sync) {
+    if (err) {
+        LOGERROR("Lazy zeroing of chunk={} from offset={} to {} failed, error={}", chunk_id(), zeroed_upto(),
+                 new_upto, err.message());
+    } else {
+        // Persist the watermark before anyone can write below it, otherwise after a crash background zeroing could
+        // wipe the data written
+        {
+            std::unique_lock lg{m_mgmt_mutex};
+            m_chunk_info.zeroed_upto = new_upto;
+            if (new_upto == size()) { m_chunk_info.zero_pending = 0x00; }
+            m_chunk_info.compute_checksum();
+            write_chunk_info();
+        }
+        m_zeroed_upto.store(new_upto, std::memory_order_release);
+    }
+
+    // Failure fails all the waiters, their writes are failed and the next write retries the zeroing
+    std::vector< folly::Promise< std::error_code > > done;
+    bool more{false};
+    {
+        std::unique_lock zlg{m_zero_mutex};
+        auto it = std::partition(m_zero_waiters.begin(), m_zero_waiters.end(),
+                                 [new_upto, &err](auto const& w) { return !err && (w.first > new_upto); });
+        for (auto i = it; i != m_zero_waiters.end(); ++i) {
+            done.push_back(std::move(i->second));
+        }
+        m_zero_waiters.erase(it, m_zero_waiters.end());
+        more = !m_zero_waiters.empty();
+        if (!more) { m_zero_inflight = false; }
+    }
+    for (auto& p : done) {
+        p.setValue(err);
+    }
+    if (more) { issue_zero(sync); }
+}
+
 void Chunk::write_chunk_info() {
     auto buf = hs_utils::iobuf_alloc(chunk_info::size, sisl::buftag::superblk, physical_dev()->align_size());
     auto cinfo = new (buf) chunk_info();
@@ -53,6 +175,84 @@ nlohmann::json Chunk::get_status([[maybe_unused]] int log_level) const {
     j["start_offset"] = start_offset();
     j["size"] = size();
     j["slot_alloced?"] = is_busy();
+
+    auto const u = usage();
+    j["usage"] = nlohmann::json{{"read_ios", u.read_ios},
+                                {"read_bytes", u.read_bytes},
+                                {"write_ios", u.write_ios},
+                                {"write_bytes", u.write_bytes},
+                                {"alloced_blks", u.alloced_blks},
+                                {"freed_blks", u.freed_blks},
+                                {"read_iops", u.read_iops},
+                                {"write_iops", u.write_iops},
+                                {"read_bytes_ps", u.read_bytes_ps},
+                                {"write_bytes_ps", u.write_bytes_ps},
+                                {"alloc_blks_ps", u.alloc_blks_ps},
+                                {"available_blks", u.available_blks},
+                                {"defrag_nblks", u.defrag_nblks},
+                                {"fragmentation", u.fragmentation}};
+
+    auto history = nlohmann::json::array();
+    {
+        std::unique_lock lg{m_usage_mtx};
+        for (auto const& s : m_usage_history) {
+            history.push_back(nlohmann::json{{"age_ms", get_elapsed_time_ms(s.time)},
+                                             {"available_blks", s.available_blks},
+                                             {"defrag_nblks", s.defrag_nblks}});
+        }
+    }
+    j["usage_history"] = std::move(history);
     return j;
 }
+
+chunk_usage Chunk::usage() const {
+    std::unique_lock lg{m_usage_mtx};
+    if (!m_usage_history.empty() &&
+        (get_elapsed_time_ms(m_usage_history.back().time) < HS_DYNAMIC_CONFIG(device->chunk_usage_sample_ms))) {
+        return m_usage;
+    }
+
+    usage_sample const s{.time = Clock::now(),
+                         .read_ios = m_read_ios.load(std::memory_order_relaxed),
+                         .read_bytes = m_read_bytes.load(std::memory_order_relaxed),
+                         .write_ios = m_write_ios.load(std::memory_order_relaxed),
+                         .write_bytes = m_write_bytes.load(std::memory_order_relaxed),
+                         .alloced_blks = m_alloced_blks.load(std::memory_order_relaxed),
+                         .available_blks = m_blk_allocator ? m_blk_allocator->available_blks() : 0,
+                         .defrag_nblks = (m_blk_allocator && m_blk_allocator->is_defrag_tracked())
+                             ? m_blk_allocator->get_defrag_nblks()
+                             : 0};
+
+    if (!m_usage_history.empty()) {
+        // Rate since the previous sample, averaged with the earlier ones (halving their weight at each sample)
+        auto const& prev = m_usage_history.back();
+        auto const secs = std::chrono::duration< double >(s.time - prev.time).count();
+        bool const first = (m_usage_history.size() == 1);
+        auto const smooth = [secs, first](double avg, uint64_t cur, uint64_t prev_cnt) {
+            auto const rate = (secs > 0) ? (s_cast< double >(cur - prev_cnt) / secs) : avg;
+            return first ? rate : ((avg + rate) / 2);
+        };
+        m_usage.read_iops = smooth(m_usage.read_iops, s.read_ios, prev.read_ios);
+        m_usage.write_iops = smooth(m_usage.write_iops, s.write_ios, prev.write_ios);
+        m_usage.read_bytes_ps = smooth(m_usage.read_bytes_ps, s.read_bytes, prev.read_bytes);
+        m_usage.write_bytes_ps = smooth(m_usage.write_bytes_ps, s.write_bytes, prev.write_bytes);
+        m_usage.alloc_blks_ps = smooth(m_usage.alloc_blks_ps, s.alloced_blks, prev.alloced_blks);
+    }
+    m_usage.read_ios = s.read_ios;
+    m_usage.read_bytes = s.read_bytes;
+    m_usage.write_ios = s.write_ios;
+    m_usage.write_bytes = s.write_bytes;
+    m_usage.alloced_blks = s.alloced_blks;
+    m_usage.freed_blks = m_freed_blks.load(std::memory_order_relaxed);
+    m_usage.available_blks = s.available_blks;
+    m_usage.defrag_nblks = s.defrag_nblks;
+    auto const used_blks = m_blk_allocator ? m_blk_allocator->get_used_blks() : 0;
+    m_usage.fragmentation = (used_blks == 0) ? 0 : (s_cast< double >(s.defrag_nblks) / used_blks);
+
+    m_usage_history.push_back(s);
+    while (m_usage_history.size() > std::max(HS_DYNAMIC_CONFIG(device->chunk_usage_history), 1u)) {
+        m_usage_history.pop_front();
+    }
+    return m_usage;
+}
 } // namespace homestore
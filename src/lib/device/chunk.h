@@ -13,6 +13,13 @@
  *
  *********************************************************************************/
 #pragma once
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include <folly/futures/Future.h>
+#include <homestore/vchunk.h>
 #include "device/physical_dev.hpp"
 
 namespace homestore {
@@ -21,6 +28,11 @@ class CP;
 class Chunk {
 private:
     std::mutex m_mgmt_mutex;
+    std::mutex m_zero_mutex;               // Serializes the advance of lazy zeroing watermark
+    std::atomic< uint64_t > m_zeroed_upto; // Offset within chunk upto which it is zeroed, size() if fully zeroed
+    bool m_zero_inflight{false};           // At most one zero io at a time, issued outside of m_zero_mutex
+    std::atomic< bool > m_compressed_blks; // Same as chunk_info::compressed_blks, read on every data read
+    std::vector< std::pair< uint64_t, folly::Promise< std::error_code > > > m_zero_waiters; // By offset in chunk
     chunk_info m_chunk_info;
     PhysicalDev* const m_pdev;
     const uint32_t m_chunk_slot;
@@ -28,6 +40,28 @@ private:
     uint32_t m_vdev_ordinal{0};
     shared< BlkAllocator > m_blk_allocator;
 
+    // Usage counters, bumped (relaxed) on every io and alloc/free of the chunk
+    std::atomic< uint64_t > m_read_ios{0};
+    std::atomic< uint64_t > m_read_bytes{0};
+    std::atomic< uint64_t > m_write_ios{0};
+    std::atomic< uint64_t > m_write_bytes{0};
+    std::atomic< uint64_t > m_alloced_blks{0};
+    std::atomic< uint64_t > m_freed_blks{0};
+
+    struct usage_sample {
+        Clock::time_point time;
+        uint64_t read_ios;
+        uint64_t read_bytes;
+        uint64_t write_ios;
+        uint64_t write_bytes;
+        uint64_t alloced_blks;
+        blk_num_t available_blks;
+        blk_num_t defrag_nblks;
+    };
+    mutable std::mutex m_usage_mtx;
+    mutable chunk_usage m_usage;                        // As of the latest sample
+    mutable std::deque< usage_sample > m_usage_history; // Recent samples, oldest first
+
 public:
     friend class DeviceManager;
 
@@ -64,12 +98,82 @@ public:
     const BlkAllocator* blk_allocator() const { return m_blk_allocator.get(); }
     BlkAllocator* blk_allocator_mutable() { return m_blk_allocator.get(); }
 
+    /// @brief Whether compressed blks could have been written to the chunk. It is never reset, until the chunk is freed
+    bool has_compressed_blks() const { return m_compressed_blks.load(std::memory_order_acquire); }
+
     ////////////// Setters /////////////////////
     void set_user_private(const sisl::blob& data);
+
+    /// @brief Persist that the chunk has compressed blks, to be done before any of them is written
+    void set_has_compressed_blks();
     void set_block_allocator(cshared< BlkAllocator >& blkalloc) { m_blk_allocator = blkalloc; }
     void set_vdev_ordinal(uint32_t vdev_ordinal) { m_vdev_ordinal = vdev_ordinal; }
 
+    ////////////// Usage /////////////////////
+    void record_read(uint64_t size) {
+        m_read_ios.fetch_add(1, std::memory_order_relaxed);
+        m_read_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    void record_write(uint64_t size) {
+        m_write_ios.fetch_add(1, std::memory_order_relaxed);
+        m_write_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    void record_alloc(uint64_t nblks) { m_alloced_blks.fetch_add(nblks, std::memory_order_relaxed); }
+    void record_free(uint64_t nblks) { m_freed_blks.fetch_add(nblks, std::memory_order_relaxed); }
+    uint64_t written_bytes() const { return m_write_bytes.load(std::memory_order_relaxed); }
+
+    /// @brief Usage of the chunk, sampled afresh if its latest sample is older than chunk_usage_sample_ms
+    chunk_usage usage() const;
+
+    ////////////// Lazy zeroing /////////////////////
+    /// @brief Mark the entire chunk as not zeroed. Actual zeroing happens upon write or in background
+    void start_lazy_zero();
+
+    bool is_zero_pending() const { return (m_zeroed_upto.load(std::memory_order_acquire) < size()); }
+    uint64_t zeroed_upto() const { return m_zeroed_upto.load(std::memory_order_acquire); }
+
+    /// @brief Zero the chunk from the current watermark past the offset_in_chunk (rounded up to the lazy zero step
+    /// size) and persist the new watermark. No-op if already zeroed upto that offset. Waiters which are covered by the
+    /// zeroing in flight are completed with it, others are zeroed for with the next zero io.
+    folly::Future< std::error_code > async_zero_upto(uint64_t offset_in_chunk);
+
+    /// @brief Same as above, for sync writes and background zeroing. Waits for a zeroing in flight suspending only the
+    /// fiber of the caller.
+    std::error_code zero_upto(uint64_t offset_in_chunk);
+
+    /// @brief Ensure the area which is about to be written is zeroed upto, so that background zeroing never
+    /// overwrites it. Called before every sync write to the chunk, it also accounts the write in the usage.
+    std::error_code prepare_write(uint64_t dev_offset, uint64_t size) {
+        record_write(size);
+        if (sisl_likely(!is_zero_pending())) { return std::error_code{}; }
+        return zero_upto(dev_offset - start_offset() + size);
+    }
+
+    /// @brief Same as above for async writes, which are to be issued only once the returned future completes. It is
+    /// ready right away, unless the chunk has to be zeroed upto the write first.
+    folly::Future< std::error_code > prepare_async_write(uint64_t dev_offset, uint64_t size) {
+        record_write(size);
+        if (sisl_likely(!is_zero_pending())) { return folly::makeFuture< std::error_code >(std::error_code{}); }
+        return async_zero_upto(dev_offset - start_offset() + size);
+    }
+
+    /// @brief How many bytes from dev_offset could be read from the device. Remaining bytes of the read is in the
+    /// area which is not zeroed yet and is expected to be served as zeros
+    uint64_t readable_size(uint64_t dev_offset, uint64_t size) const {
+        auto const zoff = start_offset() + zeroed_upto();
+        return (dev_offset >= zoff) ? 0 : std::min(size, zoff - dev_offset);
+    }
+
+    /// @brief readable_size of a read about to be issued, which is accounted in the usage
+    uint64_t prepare_read(uint64_t dev_offset, uint64_t size) {
+        record_read(size);
+        return readable_size(dev_offset, size);
+    }
+
 private:
     void write_chunk_info();
+    folly::Future< std::error_code > add_zero_waiter(uint64_t offset_in_chunk, bool sync);
+    void issue_zero(bool sync); // Expects m_zero_inflight to be set by the caller
+    void on_zeroed(uint64_t new_upto, std::error_code err, bool sync);
 };
 } // namespace homestore
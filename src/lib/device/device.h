@@ -14,6 +14,8 @@
  *********************************************************************************/
 #pragma once
 
+#include <chrono>
+#include <deque>
 #include <map>
 #include <vector>
 
@@ -180,11 +182,20 @@ public:
     uint64_t total_capacity(HSDevType dtype) const;
 
     shared< Chunk > create_chunk(HSDevType dev_type, uint32_t vdev_id, uint64_t chunk_size, const sisl::blob& data);
+
+    /// @brief Create a chunk of chunk_size for each of the private datas on the pdevs of the dev type and add them to
+    /// the vdev. Chunk infos and the vdev info are persisted together per pdev, so creating many chunks on a pdev costs
+    /// the super block writes of one. Batch is split across the pdevs if none of them has room for all of it. Returns
+    /// the chunks in the order of the private datas, fewer than them if the devices run out of room, and throws
+    /// std::out_of_range if none could be created.
+    std::vector< shared< Chunk > > create_chunks(HSDevType dev_type, uint32_t vdev_id, uint64_t chunk_size,
+                                                 const std::vector< sisl::blob >& datas);
     void remove_chunk(shared< Chunk > chunk);
     void remove_chunk_locked(shared< Chunk > chunk);
 
 private:
     void load_vdevs();
+    void register_io_buf_pool();
     int device_open_flags(const std::string& devname) const;
 
     std::vector< vdev_info > read_vdev_infos(const std::vector< PhysicalDev* >& pdevs);
@@ -197,6 +208,10 @@ private:
 // Chunk pool is used to get chunks when there is no space
 // and its cheaper compared to create a chunk on the fly.
 // Creating chunk on the fly causes sync write.
+//
+// Pool is kept filled upto its target, which is the pool capacity or the number of chunks consumed in the recent
+// window (whichever is higher, capped to max capacity), so that a burst of consumption doesn't drain it. If prezero is
+// set, chunks (including the ones released back to it) are zeroed by the producer before they are handed out.
 class ChunkPool {
 public:
     struct Params {
@@ -206,6 +221,9 @@ public:
         uint8_t hs_dev_type;
         uint32_t vdev_id;
         uint64_t chunk_size;
+        std::function< uint64_t() > max_capacity_cb;    // Max chunks the pool could grow to, upon bursts
+        std::function< uint32_t() > rate_window_sec_cb; // Window over which chunk consumption is observed
+        std::function< bool() > prezero_cb;
     };
 
     ChunkPool(DeviceManager& dmgr, Params&& param);
@@ -226,14 +244,21 @@ public:
     uint64_t capacity() { return m_params.pool_capacity; }
     uint64_t size() { return m_pool.size(); }
 
+    // Returns the number of chunks the pool is currently filled upto.
+    uint64_t target_size();
+
 private:
     // Producer thread.
     void producer();
+    uint64_t target_size_locked();
+    void prezero(shared< Chunk >& chunk);
 
 private:
     DeviceManager& m_dmgr;
     Params m_params;
     std::list< shared< Chunk > > m_pool;
+    std::list< shared< Chunk > > m_released; // Released chunks waiting to be zeroed by the producer
+    std::deque< std::chrono::steady_clock::time_point > m_dequeue_times; // Dequeues in the rate window
     uint32_t m_pool_capacity;
     std::condition_variable m_pool_cv;
     std::mutex m_pool_mutex;
@@ -12,6 +12,8 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <exception>
+#include <thread>
 #include <vector>
 
 #include <iomgr/iomgr.hpp>
@@ -27,6 +29,7 @@
 #include "device/physical_dev.hpp"
 #include "device/virtual_dev.hpp"
 #include "common/homestore_utils.hpp"
+#include "common/iobuf_pool.hpp"
 #include "common/homestore_assert.hpp"
 
 namespace homestore {
@@ -57,6 +60,33 @@ static bool is_hdd(const std::string& devname) {
     return false;
 }
 
+// Run the func for each index [0, n) on its own thread and wait for all of them to complete. Any exception thrown by a
+// func is rethrown on the caller thread after all threads are joined. Used to parallelize blocking device io at startup
+template < typename FuncT >
+static void parallel_for_each(size_t n, FuncT&& func) {
+    if (n <= 1) {
+        if (n == 1) { func(0); }
+        return;
+    }
+
+    std::vector< std::exception_ptr > excs(n);
+    std::vector< std::thread > threads;
+    threads.reserve(n);
+    for (size_t i{0}; i < n; ++i) {
+        threads.emplace_back([&func, &excs, i]() {
+            try {
+                func(i);
+            } catch (...) { excs[i] = std::current_exception(); }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    for (auto& e : excs) {
+        if (e) { std::rethrow_exception(e); }
+    }
+}
+
 static void populate_vdev_info(const vdev_parameters& vparam, uint32_t vdev_id,
                                const std::vector< PhysicalDev* >& pdevs, vdev_info* out_info);
 
@@ -138,6 +168,7 @@ void DeviceManager::format_devices() {
 
         hs_utils::iobuf_free(buf, sisl::buftag::superblk);
     }
+    register_io_buf_pool();
 }
 
 void DeviceManager::load_devices() {
@@ -151,17 +182,28 @@ void DeviceManager::load_devices() {
         m_boot_in_degraded_mode = true;
     }
 
-    for (const auto& d : m_dev_infos) {
-        first_block fblk = PhysicalDev::read_first_block(d.dev_name, device_open_flags(d.dev_name));
-        pdev_info_header* pinfo = &fblk.this_pdev_hdr;
+    // Read the first block and open all the devices in parallel, so that restart time doesn't grow with number of
+    // devices. Registration of the pdevs is done serially in the order of the devices provided.
+    std::vector< first_block > fblks(m_dev_infos.size());
+    std::vector< std::unique_ptr< PhysicalDev > > loaded_pdevs(m_dev_infos.size());
+    parallel_for_each(m_dev_infos.size(), [this, &fblks, &loaded_pdevs](size_t i) {
+        auto const& d = m_dev_infos[i];
+        fblks[i] = PhysicalDev::read_first_block(d.dev_name, device_open_flags(d.dev_name));
+        pdev_info_header* pinfo = &fblks[i].this_pdev_hdr;
 
         RELEASE_ASSERT_EQ(pinfo->get_system_uuid_str(), m_first_blk_hdr.get_system_uuid_str(),
                           "Device {} has uuid stamp different than this instance uuid. Perhaps device from other "
                           "homestore is provided?",
                           d.dev_name);
 
-        auto pdev = std::make_unique< PhysicalDev >(d, device_open_flags(d.dev_name), *pinfo);
-        LOGINFO("Loading Homestore from Device={} with first block as: [{}]", d.dev_name, fblk.to_string());
+        loaded_pdevs[i] = std::make_unique< PhysicalDev >(d, device_open_flags(d.dev_name), *pinfo);
+        LOGINFO("Loading Homestore from Device={} with first block as: [{}]", d.dev_name, fblks[i].to_string());
+    });
+
+    for (size_t i{0}; i < m_dev_infos.size(); ++i) {
+        auto const& d = m_dev_infos[i];
+        pdev_info_header* pinfo = &fblks[i].this_pdev_hdr;
+        auto pdev = std::move(loaded_pdevs[i]);
 
         auto it = m_pdevs_by_type.find(d.dev_type);
         if (it == m_pdevs_by_type.end()) {
@@ -172,11 +214,36 @@ void DeviceManager::load_devices() {
 
         m_all_pdevs[pinfo->pdev_id] = std::move(pdev);
     }
+    register_io_buf_pool();
 
     load_vdevs();
 }
 
+void DeviceManager::register_io_buf_pool() {
+    // Nearly all the small ios are from the slabs of the io buffer pool, so they are registered (if the device has an
+    // io_uring backend) with every device for the ios to skip pinning the pages, until the slab is released once idle.
+    // So are the pools of the numa nodes of the devices, which the buffers placed on their nodes are from.
+    auto const cb = [this](uint8_t* slab, uint64_t size) {
+        for (auto& pdev : m_all_pdevs) {
+            if (pdev) { pdev->register_io_buffer(slab, size); }
+        }
+    };
+    auto const release_cb = [this](uint8_t* slab, uint64_t) {
+        for (auto& pdev : m_all_pdevs) {
+            if (pdev) { pdev->unregister_io_buffer(slab); }
+        }
+    };
+    IOBufPool::instance().set_slab_cb(cb, release_cb);
+    for (auto& pdev : m_all_pdevs) {
+        if (pdev && (pdev->numa_node() >= 0)) { IOBufPool::instance(pdev->numa_node()).set_slab_cb(cb, release_cb); }
+    }
+}
+
 void DeviceManager::close_devices() {
+    IOBufPool::instance().set_slab_cb(nullptr);
+    for (auto& pdev : m_all_pdevs) {
+        if (pdev && (pdev->numa_node() >= 0)) { IOBufPool::instance(pdev->numa_node()).set_slab_cb(nullptr); }
+    }
     for (auto& pdev : m_all_pdevs) {
         if (pdev) { pdev->close_device(); }
     }
@@ -378,10 +445,20 @@ void DeviceManager::load_vdevs() {
 
     // There are some vdevs load their chunks in each of pdev
     if (m_vdevs.size()) {
+        // we might have some missing pdevs in the sparse_vector m_all_pdevs, so skip them
+        std::vector< PhysicalDev* > pdevs;
         for (auto& pdev : m_all_pdevs) {
-            // we might have some missing pdevs in the sparse_vector m_all_pdevs, so skip them
-            if (!pdev) continue;
-            pdev->load_chunks([this](cshared< Chunk >& chunk) -> bool {
+            if (pdev) { pdevs.push_back(pdev.get()); }
+        }
+
+        // Scan the chunk infos of all pdevs in parallel, but attach them to vdevs serially in the pdev order, so that
+        // chunk ordering within the vdev is same as before.
+        std::vector< std::vector< shared< Chunk > > > pdev_chunks(pdevs.size());
+        parallel_for_each(pdevs.size(),
+                          [&pdevs, &pdev_chunks](size_t i) { pdev_chunks[i] = pdevs[i]->read_chunks(); });
+
+        for (size_t i{0}; i < pdevs.size(); ++i) {
+            pdevs[i]->load_chunks(std::move(pdev_chunks[i]), [this](cshared< Chunk >& chunk) -> bool {
                 // Found a chunk for which vdev information is missing
                 if (m_vdevs[chunk->vdev_id()] == nullptr) {
                     LOGWARN("Found a chunk id={}, which is expected to be part of vdev_id={}, but that vdev "
@@ -407,46 +484,88 @@ void DeviceManager::load_vdevs() {
 
 shared< Chunk > DeviceManager::create_chunk(HSDevType dev_type, uint32_t vdev_id, uint64_t chunk_size,
                                             const sisl::blob& data) {
+    return create_chunks(dev_type, vdev_id, chunk_size, {data}).front();
+}
+
+std::vector< shared< Chunk > > DeviceManager::create_chunks(HSDevType dev_type, uint32_t vdev_id, uint64_t chunk_size,
+                                                            const std::vector< sisl::blob >& datas) {
     std::unique_lock lg{m_vdev_mutex};
     auto pdevs = pdevs_by_type_internal(dev_type);
-    auto chunk_id = m_chunk_id_bm.get_next_reset_bit(0u);
-    if (chunk_id == sisl::Bitset::npos) { throw std::out_of_range("System has no room for additional chunk"); }
-    m_chunk_id_bm.set_bit(chunk_id);
+    std::vector< uint32_t > chunk_ids;
+    chunk_ids.reserve(datas.size());
+    auto const release_chunk_ids = [this, &chunk_ids]() {
+        for (auto const id : chunk_ids) {
+            m_chunk_id_bm.reset_bit(id);
+        }
+    };
+    for (size_t i{0}; i < datas.size(); ++i) {
+        auto chunk_id = m_chunk_id_bm.get_next_reset_bit(0u);
+        if (chunk_id == sisl::Bitset::npos) {
+            release_chunk_ids();
+            throw std::out_of_range("System has no room for additional chunk");
+        }
+        m_chunk_id_bm.set_bit(chunk_id);
+        chunk_ids.push_back(chunk_id);
+    }
 
-    shared< Chunk > chunk;
-    PhysicalDev* pdev = nullptr;
-    // Create a chunk on any pdev of device type.
+    // Create the chunks on the pdevs of device type, all of the remaining ones together on a pdev which has room for
+    // all of them, else as many of them as it has room for one at a time. Ordinal added in add_chunk.
+    std::vector< shared< Chunk > > chunks;
+    std::vector< PhysicalDev* > used_pdevs;
+    size_t next{0};
     for (const auto& dev : pdevs) {
-        // Ordinal added in add_chunk.
-        chunk = dev->create_chunk(chunk_id, vdev_id, chunk_size, 0 /* ordinal */, data);
-        if (chunk != nullptr) {
-            pdev = dev;
-            break;
+        if (next == chunk_ids.size()) { break; }
+        auto const prev = next;
+        try {
+            auto c = dev->create_chunks(std::vector< uint32_t >(chunk_ids.begin() + next, chunk_ids.end()), vdev_id,
+                                        chunk_size, 0 /* ordinal */,
+                                        std::vector< sisl::blob >(datas.begin() + next, datas.end()));
+            chunks.insert(chunks.end(), c.begin(), c.end());
+            next = chunk_ids.size();
+        } catch (std::out_of_range const&) {
+            while (next < chunk_ids.size()) {
+                try {
+                    chunks.push_back(
+                        dev->create_chunks({chunk_ids[next]}, vdev_id, chunk_size, 0 /* ordinal */, {datas[next]})
+                            .front());
+                    ++next;
+                } catch (std::out_of_range const&) { break; }
+            }
         }
+        if (next != prev) { used_pdevs.push_back(dev); }
     }
 
-    if (!chunk) { throw std::out_of_range("Unable to create chunk on physical devices"); }
+    // Ids of the chunks which could not be created are given back
+    for (auto i = next; i < chunk_ids.size(); ++i) {
+        m_chunk_id_bm.reset_bit(chunk_ids[i]);
+    }
+    chunk_ids.resize(next);
+    if (chunks.empty()) { throw std::out_of_range("Unable to create chunk on physical devices"); }
 
     auto vdev = m_vdevs[vdev_id];
-    vdev->add_chunk(chunk, true /* fresh_chunk */);
-    m_chunks[chunk->chunk_id()] = chunk;
+    for (auto& chunk : chunks) {
+        vdev->add_chunk(chunk, true /* fresh_chunk */);
+        m_chunks[chunk->chunk_id()] = chunk;
+    }
 
-    auto buf = hs_utils::iobuf_alloc(vdev_info::size, sisl::buftag::superblk, pdev->align_size());
     auto vdev_info = vdev->info();
-    vdev_info.vdev_size += chunk_size;
-    vdev_info.num_primary_chunks++;
+    vdev_info.vdev_size += chunk_size * chunks.size();
+    vdev_info.num_primary_chunks += uint32_cast(chunks.size());
     vdev_info.compute_checksum();
 
-    // Update the vdev info.
+    // Update the vdev info, on each of the pdevs the chunks are created on.
     vdev->update_info(vdev_info);
-    std::memcpy(buf, &vdev_info, sizeof(vdev_info));
     uint64_t offset = hs_super_blk::vdev_sb_offset() + (vdev_id * vdev_info::size);
-    pdev->write_super_block(buf, vdev_info::size, offset);
-    hs_utils::iobuf_free(buf, sisl::buftag::superblk);
+    for (auto* pdev : used_pdevs) {
+        auto buf = hs_utils::iobuf_alloc(vdev_info::size, sisl::buftag::superblk, pdev->align_size());
+        std::memcpy(buf, &vdev_info, sizeof(vdev_info));
+        pdev->write_super_block(buf, vdev_info::size, offset);
+        hs_utils::iobuf_free(buf, sisl::buftag::superblk);
+    }
 
-    HS_LOG(DEBUG, device, "Created chunk_id={} dev_type={} vdev_id={} size={}", chunk_id, (uint8_t)dev_type, vdev_id,
-           chunk_size);
-    return chunk;
+    HS_LOG(DEBUG, device, "Created chunk_ids={} of {} requested dev_type={} vdev_id={} size={}",
+           fmt::join(chunk_ids, ","), datas.size(), (uint8_t)dev_type, vdev_id, chunk_size);
+    return chunks;
 }
 
 void DeviceManager::remove_chunk(shared< Chunk > chunk) {
@@ -639,31 +758,95 @@ void ChunkPool::start() {
     HS_LOG(INFO, device, "Starting chunk pool for vdev_id={}", m_params.vdev_id);
 }
 
+uint64_t ChunkPool::target_size() {
+    std::unique_lock< std::mutex > lk{m_pool_mutex};
+    return target_size_locked();
+}
+
+uint64_t ChunkPool::target_size_locked() {
+    auto const window = std::chrono::seconds{m_params.rate_window_sec_cb ? m_params.rate_window_sec_cb() : 0};
+    auto const now = std::chrono::steady_clock::now();
+    while (!m_dequeue_times.empty() && ((now - m_dequeue_times.front()) > window)) {
+        m_dequeue_times.pop_front();
+    }
+    auto const max_capacity =
+        std::max(m_params.max_capacity_cb ? m_params.max_capacity_cb() : 0ul, m_params.pool_capacity);
+    return std::min(std::max(uint64_cast(m_dequeue_times.size()), m_params.pool_capacity), max_capacity);
+}
+
+void ChunkPool::prezero(shared< Chunk >& chunk) {
+    if (auto err = chunk->physical_dev_mutable()->sync_write_zero(chunk->size(), chunk->start_offset()); err) {
+        // Not fatal, journal finds the end of log by crc mismatch anyway
+        HS_LOG(ERROR, device, "Zeroing of pool chunk_id={} failed, error={}", chunk->chunk_id(), err.message());
+    }
+}
+
 void ChunkPool::producer() {
     // Fill the chunk pool.
     while (true) {
-        // Wait until run is false or pool is less than half the capacity
-        // so that consumer have space to release unused chunks back to pool.
+        // Wait until run is false, there are released chunks to zero, or pool is less than half its target so that
+        // consumer have space to release unused chunks back to pool. Once woken up, it fills the pool upto its target.
         std::unique_lock< std::mutex > lk{m_pool_mutex};
         m_pool_cv.wait(lk, [this] {
             if (m_run_pool == false) return true;
-            if (m_pool.size() < (m_params.pool_capacity / 2)) return true;
+            if (!m_released.empty()) return true;
+            if (m_pool.size() < std::max(target_size_locked() / 2, 1ul)) return true;
             return false;
         });
 
+        while (m_run_pool) {
+            std::vector< shared< Chunk > > chunks;
+            if (!m_released.empty()) {
+                chunks.push_back(m_released.front());
+                m_released.pop_front();
+                lk.unlock();
+                prezero(chunks.front());
+                chunks.front()->set_user_private(m_params.init_private_data_cb());
+            } else if (auto const target = target_size_locked(); m_pool.size() < target) {
+                // All the chunks short of the target are created together, with the super block writes of one
+                auto const nchunks = target - m_pool.size();
+                lk.unlock();
+                // Private data cb could hand out the same buffer every time, so each one is copied
+                std::vector< std::vector< uint8_t > > private_bufs;
+                std::vector< sisl::blob > private_datas;
+                private_bufs.reserve(nchunks);
+                private_datas.reserve(nchunks);
+                for (uint64_t i{0}; i < nchunks; ++i) {
+                    auto const b = m_params.init_private_data_cb();
+                    auto& pbuf = private_bufs.emplace_back(b.cbytes(), b.cbytes() + b.size());
+                    private_datas.emplace_back(pbuf.data(), uint32_cast(pbuf.size()));
+                }
+                try {
+                    chunks = m_dmgr.create_chunks(static_cast< HSDevType >(m_params.hs_dev_type), m_params.vdev_id,
+                                                  m_params.chunk_size, private_datas);
+                } catch (std::out_of_range const& e) {
+                    HS_LOG(ERROR, device, "Unable to produce chunks to pool type={} vdev_id={} count={}, error={}",
+                           m_params.hs_dev_type, m_params.vdev_id, nchunks, e.what());
+                }
+                if (chunks.empty()) {
+                    // Devices are full, retry once a chunk is released back or after a while, instead of spinning
+                    lk.lock();
+                    m_pool_cv.wait_for(lk, std::chrono::seconds(1),
+                                       [this] { return !m_run_pool || !m_released.empty(); });
+                    continue;
+                }
+                for (auto& chunk : chunks) {
+                    if (m_params.prezero_cb && m_params.prezero_cb()) { prezero(chunk); }
+                    HS_LOG(TRACE, device, "Produced chunk to pool chunk_id={} type={} vdev_id={} size {}",
+                           chunk->chunk_id(), m_params.hs_dev_type, m_params.vdev_id, m_params.chunk_size);
+                }
+            } else {
+                break;
+            }
+            lk.lock();
+            m_pool.insert(m_pool.end(), chunks.begin(), chunks.end());
+            m_pool_cv.notify_all();
+        }
+
         if (!m_run_pool) {
             m_pool_halt.setValue();
             return;
         }
-
-        auto private_data = m_params.init_private_data_cb();
-        auto chunk = m_dmgr.create_chunk(static_cast< HSDevType >(m_params.hs_dev_type), m_params.vdev_id,
-                                         m_params.chunk_size, std::move(private_data));
-        RELEASE_ASSERT(chunk, "Cannot create chunk");
-        m_pool.push_back(chunk);
-        HS_LOG(TRACE, device, "Produced chunk to pool chunk_id={} type={} vdev_id={} size {}", chunk->chunk_id(),
-               m_params.hs_dev_type, m_params.vdev_id, m_params.chunk_size);
-        m_pool_cv.notify_one();
     }
 }
 
@@ -675,10 +858,11 @@ shared< Chunk > ChunkPool::dequeue() {
         m_pool_cv.wait(lk, [this] { return !m_pool.empty(); });
         chunk = m_pool.back();
         m_pool.pop_back();
+        m_dequeue_times.push_back(std::chrono::steady_clock::now());
     }
     RELEASE_ASSERT(chunk, "Chunk invalid");
     HS_LOG(TRACE, device, "Dequeue chunk {} from pool", chunk->chunk_id());
-    m_pool_cv.notify_one();
+    m_pool_cv.notify_all();
     return chunk;
 }
 
@@ -687,9 +871,14 @@ bool ChunkPool::enqueue(shared< Chunk >& chunk) {
     bool reuse = false;
     {
         std::unique_lock< std::mutex > lk{m_pool_mutex};
-        if (m_pool.size() < m_params.pool_capacity) {
-            chunk->set_user_private(m_params.init_private_data_cb());
-            m_pool.push_back(chunk);
+        if ((m_pool.size() + m_released.size()) < target_size_locked()) {
+            if (m_params.prezero_cb && m_params.prezero_cb()) {
+                // Producer zeroes it in background, before it is handed out again
+                m_released.push_back(chunk);
+            } else {
+                chunk->set_user_private(m_params.init_private_data_cb());
+                m_pool.push_back(chunk);
+            }
             reuse = true;
             HS_LOG(TRACE, device, "Enqueue chunk {} to pool", chunk->chunk_id());
         }
@@ -700,7 +889,7 @@ bool ChunkPool::enqueue(shared< Chunk >& chunk) {
         HS_LOG(TRACE, device, "Cache is full removing chunk {}", chunk->chunk_id());
         m_dmgr.remove_chunk(chunk);
     } else {
-        m_pool_cv.notify_one();
+        m_pool_cv.notify_all();
     }
     return reuse;
 }
@@ -15,10 +15,12 @@
  *********************************************************************************/
 #include <cassert>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <limits>
 #include <memory>
+#include <system_error>
 
 #include <sisl/logging/logging.h>
 #include <iomgr/iomgr_flip.hpp>
@@ -54,7 +56,10 @@ JournalVirtualDev::JournalVirtualDev(DeviceManager& dmgr, const vdev_info& vinfo
                                                       sizeof(JournalChunkPrivate)};
                               return private_blob;
                           },
-                          m_vdev_info.hs_dev_type, m_vdev_info.vdev_id, m_vdev_info.chunk_size});
+                          m_vdev_info.hs_dev_type, m_vdev_info.vdev_id, m_vdev_info.chunk_size,
+                          []() { return uint64_cast(HS_DYNAMIC_CONFIG(generic.journal_chunk_pool_max_capacity)); },
+                          []() { return HS_DYNAMIC_CONFIG(generic.journal_chunk_pool_rate_window_sec); },
+                          []() { return HS_DYNAMIC_CONFIG(generic.journal_chunk_pool_prezero); }});
 
     resource_mgr().register_journal_vdev_exceed_cb([this]([[maybe_unused]] int64_t dirty_buf_count, bool critical) {
         // either it is critical or non-critical, call cp_flush;
@@ -161,7 +166,7 @@ void JournalVirtualDev::release_chunk_to_pool(shared< Chunk > chunk) {
 
     // We ideally want to zero out chunks as chunks are reused after free across
     // logdev's. But zero out chunk is very expensive, We look at crc mismatches
-    // to know the end offset of the log dev during recovery.
+    // to know the end offset of the log dev during recovery. Pool zeroes them in background, if prezero is set.
     m_chunk_pool->enqueue(chunk);
     LOGINFOMOD(journalvdev, "Released chunk to pool {}", chunk->to_string());
 }
@@ -254,6 +259,7 @@ void JournalVirtualDev::Descriptor::append_chunk() {
 }
 
 off_t JournalVirtualDev::Descriptor::alloc_next_append_blk(size_t sz) {
+    std::unique_lock lg{m_chunks_mtx};
     // We currently assume size requested is less than chunk_size.
     auto chunk_size = m_vdev.info().chunk_size;
     RELEASE_ASSERT_LT(sz, chunk_size, "Size requested greater than chunk size");
@@ -309,6 +315,7 @@ bool JournalVirtualDev::Descriptor::validate_append_size(size_t req_sz) const {
 
 auto JournalVirtualDev::Descriptor::process_pwrite_offset(size_t len, off_t offset) {
     // convert logical offset to chunk and its offset
+    std::unique_lock lg{m_chunks_mtx};
     auto const chunk_details = offset_to_chunk(offset);
     auto const [chunk, _, offset_in_chunk] = chunk_details;
 
@@ -378,7 +385,7 @@ void JournalVirtualDev::Descriptor::sync_pwrite(const uint8_t* buf, size_t size,
     m_vdev.sync_write(r_cast< const char* >(buf), size, chunk, offset_in_chunk);
 }
 
-void JournalVirtualDev::Descriptor::sync_pwritev(const iovec* iov, int iovcnt, off_t offset) {
+void JournalVirtualDev::Descriptor::sync_pwritev(const iovec* iov, int iovcnt, off_t offset, bool fua) {
     auto const size = VirtualDev::get_len(iov, iovcnt);
 
     // if size is smaller than reserved size, it means write will never be overlapping start offset;
@@ -387,7 +394,7 @@ void JournalVirtualDev::Descriptor::sync_pwritev(const iovec* iov, int iovcnt, o
 
     m_reserved_sz -= size;
     auto const [chunk, _, offset_in_chunk] = process_pwrite_offset(size, offset);
-    m_vdev.sync_writev(iov, iovcnt, chunk, offset_in_chunk);
+    m_vdev.sync_writev(iov, iovcnt, chunk, offset_in_chunk, fua);
 }
 
 /////////////////////////////// Read Section //////////////////////////////////
@@ -426,9 +433,12 @@ int64_t JournalVirtualDev::Descriptor::sync_next_read(uint8_t* buf, size_t size_
 
     if (buf == nullptr) { return size_rd; }
 
-    auto ec = sync_pread(buf, size_rd, m_seek_cursor);
-    // TODO: Check if we can have tolerate this error and somehow start homestore without replaying or in degraded mode?
-    HS_REL_ASSERT(!ec, "Error in reading next stream of bytes, proceeding could cause some inconsistency, exiting");
+    if ((m_read_ahead_depth == 0) || !read_from_read_ahead(buf, size_rd)) {
+        auto ec = sync_pread(buf, size_rd, m_seek_cursor);
+        // TODO: Check if we can have tolerate this error and somehow start homestore without replaying or in degraded
+        // mode?
+        HS_REL_ASSERT(!ec, "Error in reading next stream of bytes, proceeding could cause some inconsistency, exiting");
+    }
 
     // Update seek cursor after read;
     m_seek_cursor += size_rd;
@@ -440,8 +450,111 @@ int64_t JournalVirtualDev::Descriptor::sync_next_read(uint8_t* buf, size_t size_
     return size_rd;
 }
 
+int64_t JournalVirtualDev::Descriptor::sync_read_at(off_t& cursor, uint8_t* buf, size_t size_rd) {
+    if (m_journal_chunks.empty() || (cursor >= m_end_offset)) { return -1; }
+
+    auto [chunk, _, offset_in_chunk] = locked_offset_to_chunk(cursor);
+    auto const end_of_chunk = m_vdev.get_end_of_chunk(chunk);
+    bool across_chunk{false};
+    if (size_rd >= s_cast< size_t >(end_of_chunk - offset_in_chunk)) {
+        size_rd = end_of_chunk - offset_in_chunk;
+        across_chunk = true;
+    }
+
+    if (size_rd != 0) {
+        if (auto ec = sync_pread(buf, size_rd, cursor); ec) { throw std::system_error(ec); }
+    }
+    cursor += size_rd;
+    if (across_chunk) { cursor += (chunk->size() - end_of_chunk); }
+    return size_rd;
+}
+
+void JournalVirtualDev::Descriptor::start_read_ahead(uint32_t depth, uint64_t read_size) {
+    discard_read_ahead();
+    m_read_ahead_depth = depth;
+    m_read_ahead_size = read_size;
+    fill_read_ahead();
+}
+
+void JournalVirtualDev::Descriptor::stop_read_ahead() {
+    discard_read_ahead();
+    m_read_ahead_depth = 0;
+}
+
+void JournalVirtualDev::Descriptor::discard_read_ahead() {
+    for (auto& ra : m_read_ahead_bufs) {
+        std::move(ra.fut).get();
+        hs_utils::iobuf_free(ra.buf, sisl::buftag::logread);
+    }
+    m_read_ahead_bufs.clear();
+    m_read_ahead_cursor = m_seek_cursor;
+}
+
+void JournalVirtualDev::Descriptor::fill_read_ahead() {
+    while ((m_read_ahead_bufs.size() < m_read_ahead_depth) && (m_read_ahead_cursor < m_end_offset)) {
+        // Same chunk boundary rules as sync_next_read, so that read aheads line up with what the reader asks for
+        auto [chunk, _, offset_in_chunk] = offset_to_chunk(m_read_ahead_cursor);
+        auto const end_of_chunk = m_vdev.get_end_of_chunk(chunk);
+        uint64_t const left_in_chunk = end_of_chunk - offset_in_chunk;
+        if (left_in_chunk == 0) {
+            m_read_ahead_cursor += (chunk->size() - end_of_chunk);
+            continue;
+        }
+
+        auto const size = std::min(m_read_ahead_size, left_in_chunk);
+        auto* buf = hs_utils::iobuf_alloc(size, sisl::buftag::logread, m_vdev.align_size());
+        auto fut = m_vdev.async_read(r_cast< char* >(buf), uint32_cast(size), chunk, offset_in_chunk);
+        m_read_ahead_bufs.push_back(read_ahead_buf{m_read_ahead_cursor, size, 0, buf, std::move(fut)});
+        LOGTRACEMOD(journalvdev, "Read ahead issued offset={} size={} chunk={} desc {}", m_read_ahead_cursor, size,
+                    chunk->chunk_id(), to_string());
+
+        m_read_ahead_cursor += size;
+        if (size == left_in_chunk) { m_read_ahead_cursor += (chunk->size() - end_of_chunk); }
+    }
+}
+
+bool JournalVirtualDev::Descriptor::read_from_read_ahead(uint8_t* buf, size_t size) {
+    if (m_read_ahead_bufs.empty() ||
+        ((m_read_ahead_bufs.front().offset + s_cast< off_t >(m_read_ahead_bufs.front().consumed)) != m_seek_cursor)) {
+        // Reader moved away from where we were reading ahead, restart from its cursor
+        discard_read_ahead();
+        fill_read_ahead();
+        if (m_read_ahead_bufs.empty()) { return false; }
+    }
+
+    size_t copied{0};
+    while (copied < size) {
+        if (m_read_ahead_bufs.empty()) { fill_read_ahead(); }
+        if (m_read_ahead_bufs.empty()) { break; }
+
+        auto& ra = m_read_ahead_bufs.front();
+        if ((ra.offset + s_cast< off_t >(ra.consumed)) != (m_seek_cursor + s_cast< off_t >(copied))) { break; }
+
+        auto const ec = std::move(ra.fut).get();
+        HS_REL_ASSERT(!ec, "Error in read ahead of next stream of bytes, proceeding could cause some inconsistency");
+        ra.fut = folly::makeFuture< std::error_code >(std::error_code{});
+
+        auto const sz = std::min(size - copied, ra.size - ra.consumed);
+        std::memcpy(buf + copied, ra.buf + ra.consumed, sz);
+        copied += sz;
+        ra.consumed += sz;
+        if (ra.consumed == ra.size) {
+            hs_utils::iobuf_free(ra.buf, sisl::buftag::logread);
+            m_read_ahead_bufs.pop_front();
+            fill_read_ahead();
+        }
+    }
+
+    if (copied < size) {
+        // Read ahead could not cover the entire request (can only happen at the boundaries), read the rest directly
+        auto const ec = sync_pread(buf + copied, size - copied, m_seek_cursor + copied);
+        HS_REL_ASSERT(!ec, "Error in reading next stream of bytes, proceeding could cause some inconsistency, exiting");
+    }
+    return true;
+}
+
 std::error_code JournalVirtualDev::Descriptor::sync_pread(uint8_t* buf, size_t size, off_t offset) {
-    auto [chunk, index, offset_in_chunk] = offset_to_chunk(offset);
+    auto [chunk, index, offset_in_chunk] = locked_offset_to_chunk(offset);
 
     // if the read count is acrossing chunk, only return what's left in this chunk
     if (chunk->size() - offset_in_chunk < size) {
@@ -454,9 +567,18 @@ std::error_code JournalVirtualDev::Descriptor::sync_pread(uint8_t* buf, size_t s
     return m_vdev.sync_read(r_cast< char* >(buf), size, chunk, offset_in_chunk);
 }
 
+folly::Future< std::error_code > JournalVirtualDev::Descriptor::async_pread(uint8_t* buf, size_t size, off_t offset) {
+    auto [chunk, index, offset_in_chunk] = locked_offset_to_chunk(offset);
+    if (chunk->size() - offset_in_chunk < size) { size = chunk->size() - offset_in_chunk; }
+
+    LOGTRACEMOD(journalvdev, "offset: 0x{} size: {} chunk: {} index: {} offset_in_chunk: 0x{} desc {}", to_hex(offset),
+                size, chunk->chunk_id(), index, to_hex(offset_in_chunk), to_string());
+    return m_vdev.async_read(r_cast< char* >(buf), uint32_cast(size), chunk, offset_in_chunk);
+}
+
 std::error_code JournalVirtualDev::Descriptor::sync_preadv(iovec* iov, int iovcnt, off_t offset) {
     uint64_t len = VirtualDev::get_len(iov, iovcnt);
-    auto [chunk, index, offset_in_chunk] = offset_to_chunk(offset);
+    auto [chunk, index, offset_in_chunk] = locked_offset_to_chunk(offset);
 
     if (chunk->size() - offset_in_chunk < len) {
         if (iovcnt > 1) {
@@ -566,6 +688,9 @@ void JournalVirtualDev::Descriptor::update_tail_offset(off_t tail) {
 }
 
 off_t JournalVirtualDev::Descriptor::truncate(off_t truncate_offset) {
+    // Chunks truncated are cleared and released to the pool once the lock is dropped, so that appends need not wait
+    std::vector< shared< Chunk > > released_chunks;
+    std::unique_lock lg{m_chunks_mtx};
     const off_t ds_off = data_start_offset();
     COUNTER_INCREMENT(m_vdev.m_metrics, vdev_truncate_count, 1);
     HS_PERIODIC_LOG(DEBUG, journalvdev, "truncating to logical offset: 0x{} desc {}", to_hex(truncate_offset),
@@ -654,7 +779,7 @@ off_t JournalVirtualDev::Descriptor::truncate(off_t truncate_offset) {
                        "Released chunk_id={} log_dev={} cover={} truncate_offset={} tail={} end_of_chunk={} desc {}",
                        chunk->chunk_id(), m_logdev_id, to_hex(cover_offset), to_hex(truncate_offset), to_hex(tail_off),
                        m_vdev.get_end_of_chunk(chunk), to_string());
-            m_vdev.release_chunk_to_pool(chunk);
+            released_chunks.push_back(std::move(chunk));
         } else {
             ++it;
         }
@@ -682,7 +807,13 @@ off_t JournalVirtualDev::Descriptor::truncate(off_t truncate_offset) {
 #endif
 
     HS_PERIODIC_LOG(DEBUG, journalvdev, "Truncate end truncate {} desc {}", to_hex(truncate_offset), to_string());
-    return data_start_offset();
+    const off_t new_start_offset = data_start_offset();
+    lg.unlock();
+
+    for (auto& chunk : released_chunks) {
+        m_vdev.release_chunk_to_pool(chunk);
+    }
+    return new_start_offset;
 }
 
 #if 0
@@ -740,6 +871,7 @@ std::tuple< shared< Chunk >, uint32_t, off_t > JournalVirtualDev::Descriptor::of
 }
 
 bool JournalVirtualDev::Descriptor::is_offset_at_last_chunk(off_t bytes_offset) {
+    std::unique_lock lg{m_chunks_mtx};
     auto [chunk, chunk_index, _] = offset_to_chunk(bytes_offset, false);
     if (chunk == nullptr) return true;
     if (chunk_index == m_journal_chunks.size() - 1) { return true; }
@@ -19,8 +19,10 @@
 #include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include <condition_variable>
+#include <deque>
 
 #include "device.h"
 #include "physical_dev.hpp"
@@ -66,9 +68,24 @@ public:
         bool m_truncate_done{false};
         uint64_t m_reserved_sz{0};                       // write size within chunk, used to check chunk boundary;
         std::vector< shared< Chunk > > m_journal_chunks; // Chunks part of this journal in order.
+        // Guards the chunks and the offsets against truncate, which runs in parallel to the appends
+        mutable std::mutex m_chunks_mtx;
         uint64_t m_total_size{0};                        // Total size of all chunks.
         off_t m_end_offset{0};        // Offset right to window. Never reduced. Increased in multiple of chunk size.
         bool m_end_offset_set{false}; // Adjust the m_end_offset only once during init.
+
+        // Read ahead state for sequential reads through sync_next_read (used during recovery)
+        struct read_ahead_buf {
+            off_t offset;      // Logical offset the read starts at
+            uint64_t size;     // Size of the read, it never crosses the chunk
+            uint64_t consumed; // Bytes already handed out to sync_next_read callers
+            uint8_t* buf;
+            folly::Future< std::error_code > fut;
+        };
+        std::deque< read_ahead_buf > m_read_ahead_bufs;
+        off_t m_read_ahead_cursor{0}; // Logical offset from which next read ahead is issued
+        uint32_t m_read_ahead_depth{0};
+        uint64_t m_read_ahead_size{0};
         friend class JournalVirtualDev;
 
     public:
@@ -147,7 +164,9 @@ public:
         /// @return : On success, the number of bytes written is returned, or -1 on error.
         void sync_pwrite(const uint8_t* buf, size_t size, off_t offset);
 
-        void sync_pwritev(const iovec* iov, int iovcnt, off_t offset);
+        /// @brief Same as sync_pwrite with a vector of buffers. If fua is set, it returns only after the buffers are
+        /// durable on the media, without needing a separate device cache flush.
+        void sync_pwritev(const iovec* iov, int iovcnt, off_t offset, bool fua = false);
 
         /**
          * @brief : read up to count bytes into the buffer starting at buf.
@@ -162,6 +181,33 @@ public:
          */
         int64_t sync_next_read(uint8_t* buf, size_t count_in);
 
+        /**
+         * @brief : Same as sync_next_read, but from the given cursor instead of the seek cursor of the descriptor, so
+         * that a reader could walk the journal without disturbing the descriptor's cursor or read ahead.
+         *
+         * @param cursor : in - offset to read from, out - offset to read next from (beginning of next chunk, if the
+         * read reached the end of the chunk)
+         *
+         * @return : number of bytes read, -1 if the cursor is past the end of the journal. Throws std::system_error
+         * upon read error.
+         */
+        int64_t sync_read_at(off_t& cursor, uint8_t* buf, size_t count_in);
+
+        /**
+         * @brief : Keep upto depth async reads of read_size each in flight ahead of the seek cursor, across chunk
+         * boundaries, so that subsequent sync_next_read calls are served from completed reads instead of a blocking
+         * read each. Any lseek to a different offset discards the read ahead and restarts it from the new cursor.
+         *
+         * @param depth : number of reads to keep in flight
+         * @param read_size : size of each read ahead
+         */
+        void start_read_ahead(uint32_t depth, uint64_t read_size);
+
+        /**
+         * @brief : Wait for all outstanding read aheads and release their buffers.
+         */
+        void stop_read_ahead();
+
         /**
          * @brief : reads up to count bytes at offset into the buffer starting at buf.
          * The curosr is not updated.
@@ -174,6 +220,18 @@ public:
          */
         std::error_code sync_pread(uint8_t* buf, size_t count_in, off_t offset);
 
+        /**
+         * @brief : async version of sync_pread, likewise truncates the read to the end of the chunk at offset.
+         * The curosr is not updated.
+         *
+         * @param buf : the buffer that points to the read out data.
+         * @param count : size of buffer
+         * @param offset : the start offset to do read
+         *
+         * @return : future with the error code of the read
+         */
+        folly::Future< std::error_code > async_pread(uint8_t* buf, size_t count_in, off_t offset);
+
         /**
          * @brief : read at offset and save output to iov.
          * We don't have a use case for external caller of preadv now, meaning iov will always have only 1 element;
@@ -339,6 +397,10 @@ public:
          */
         auto process_pwrite_offset(size_t len, off_t offset);
 
+        void fill_read_ahead();
+        void discard_read_ahead();
+        bool read_from_read_ahead(uint8_t* buf, size_t size);
+
         /**
          * @brief : convert logical offset in chunk to the physical device offset
          *
@@ -376,6 +438,10 @@ public:
 
         // Return the chunk, its index and offset in the chunk list.
         std::tuple< shared< Chunk >, uint32_t, off_t > offset_to_chunk(off_t log_offset, bool check = true) const;
+        std::tuple< shared< Chunk >, uint32_t, off_t > locked_offset_to_chunk(off_t log_offset) const {
+            std::unique_lock lg{m_chunks_mtx};
+            return offset_to_chunk(log_offset);
+        }
 
         bool validate_append_size(size_t count) const;
 
@@ -0,0 +1,88 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2023 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include "device/load_aware_chunk_selector.h"
+#include "device/physical_dev.hpp"
+#include "blkalloc/blk_allocator.h"
+#include "common/homestore_config.hpp"
+
+namespace homestore {
+void LoadAwareChunkSelector::add_chunk(cshared< Chunk >& chunk) { m_chunks.emplace_back(chunk); }
+
+void LoadAwareChunkSelector::foreach_chunks(std::function< void(cshared< Chunk >&) >&& cb) {
+    for (auto& chunk : m_chunks) {
+        cb(chunk);
+    }
+}
+
+cshared< Chunk > LoadAwareChunkSelector::select_chunk(blk_count_t nblks, const blk_alloc_hints&) {
+    if (m_chunks.empty()) { return nullptr; }
+
+    auto& c = *m_cached;
+    uint32_t exclude_idx{UINT32_MAX};
+    if ((c.chunk_idx < m_chunks.size()) && (c.remaining > 0)) {
+        auto const avail = m_chunks[c.chunk_idx]->blk_allocator()->available_blks();
+
+        // If available blks has not changed since we last returned this chunk, most likely the allocation on it
+        // failed and vdev is retrying. Skip this chunk on re-scoring, so that the retry lands on another chunk.
+        if ((avail >= nblks) && (avail != c.last_avail)) {
+            --c.remaining;
+            c.last_avail = avail;
+            return m_chunks[c.chunk_idx];
+        }
+        if (avail == c.last_avail) { exclude_idx = c.chunk_idx; }
+    }
+
+    c.chunk_idx = pick_best(nblks, exclude_idx);
+    c.remaining = HS_DYNAMIC_CONFIG(device->load_aware_chunk_refresh_count);
+    c.last_avail = m_chunks[c.chunk_idx]->blk_allocator()->available_blks();
+    return m_chunks[c.chunk_idx];
+}
+
+uint64_t LoadAwareChunkSelector::cost(Chunk const& chunk) const {
+    auto const* pdev = chunk.physical_dev();
+    auto const* ba = chunk.blk_allocator();
+    auto const total = std::max(ba->get_total_blks(), blk_num_t{1});
+    uint64_t const used_pct = ((total - std::min(ba->available_blks(), total)) * 100ul) / total;
+
+    return (HS_DYNAMIC_CONFIG(device->load_aware_qd_weight) * pdev->outstanding_ios()) +
+        (HS_DYNAMIC_CONFIG(device->load_aware_latency_weight) * (pdev->recent_write_latency_us() / 10)) +
+        (HS_DYNAMIC_CONFIG(device->load_aware_space_weight) * used_pct);
+}
+
+uint32_t LoadAwareChunkSelector::pick_best(blk_count_t nblks, uint32_t exclude_idx) const {
+    uint32_t best_idx{UINT32_MAX};
+    uint64_t best_cost{std::numeric_limits< uint64_t >::max()};
+    uint32_t fallback_idx{0};
+    blk_num_t fallback_avail{0};
+
+    for (uint32_t i{0}; i < m_chunks.size(); ++i) {
+        auto const avail = m_chunks[i]->blk_allocator()->available_blks();
+        if (avail > fallback_avail) {
+            fallback_idx = i;
+            fallback_avail = avail;
+        }
+        if ((i == exclude_idx) || (avail < nblks)) { continue; }
+
+        auto const c = cost(*m_chunks[i]);
+        if (c < best_cost) {
+            best_cost = c;
+            best_idx = i;
+        }
+    }
+
+    // If no chunk has enough space, return the one with most space, so that caller can attempt partial allocation
+    return (best_idx == UINT32_MAX) ? fallback_idx : best_idx;
+}
+} // namespace homestore
@@ -0,0 +1,60 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2023 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <homestore/chunk_selector.h>
+
+#include <limits>
+#include <vector>
+#include <folly/ThreadLocal.h>
+
+#include <homestore/vchunk.h>
+#include "device/chunk.h"
+
+namespace homestore {
+/*
+ * LoadAwareChunkSelector: Picks the chunk with the lowest cost, where cost is a weighted sum of outstanding ios and
+ * recent write latency of the pdev behind the chunk and the used space of the chunk. To keep the scoring off the hot
+ * path, every thread (reactor) caches its choice and re-scores only after a configured number of selections or when
+ * the cached chunk can't satisfy the allocation anymore.
+ */
+class LoadAwareChunkSelector : public ChunkSelector {
+public:
+    LoadAwareChunkSelector() = default;
+    LoadAwareChunkSelector(const LoadAwareChunkSelector&) = delete;
+    LoadAwareChunkSelector(LoadAwareChunkSelector&&) noexcept = delete;
+    LoadAwareChunkSelector& operator=(const LoadAwareChunkSelector&) = delete;
+    LoadAwareChunkSelector& operator=(LoadAwareChunkSelector&&) noexcept = delete;
+    ~LoadAwareChunkSelector() = default;
+
+    void add_chunk(cshared< Chunk >&) override;
+    cshared< Chunk > select_chunk(blk_count_t nblks, const blk_alloc_hints& hints) override;
+    void foreach_chunks(std::function< void(cshared< Chunk >&) >&& cb) override;
+
+private:
+    struct cached_choice {
+        uint32_t chunk_idx{UINT32_MAX};
+        uint32_t remaining{0};   // Number of selections left before we re-score
+        blk_num_t last_avail{0}; // Available blks of the chunk when it was last returned
+    };
+
+    uint64_t cost(Chunk const& chunk) const;
+    uint32_t pick_best(blk_count_t nblks, uint32_t exclude_idx) const;
+
+private:
+    std::vector< shared< Chunk > > m_chunks;
+    folly::ThreadLocal< cached_choice > m_cached;
+};
+} // namespace homestore
@@ -0,0 +1,179 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <boost/fiber/future.hpp>
+
+#include "common/homestore_config.hpp"
+#include "common/resource_mgr.hpp"
+#include "device/physical_dev.hpp"
+#include "device/pdev_io_scheduler.hpp"
+
+namespace homestore {
+PDevIOScheduler::PDevIOScheduler(PhysicalDevMetrics& metrics) : m_metrics{metrics} {}
+
+PDevIOScheduler::~PDevIOScheduler() {
+    std::vector< queued_io > pending;
+    bool timer_armed;
+    {
+        std::unique_lock lg{m_mtx};
+        m_stopping = true;
+        timer_armed = m_timer_armed;
+        for (auto& c : m_classes) {
+            std::move(c.queue.begin(), c.queue.end(), std::back_inserter(pending));
+            c.queue.clear();
+        }
+    }
+    if (timer_armed) { iomanager.cancel_timer(m_timer_hdl, true /* wait */); }
+
+    // Device is going away, nothing more could be issued on it
+    for (auto& q : pending) {
+        q.promise.setValue(std::make_error_code(std::errc::operation_canceled));
+    }
+}
+
+uint64_t PDevIOScheduler::limit_bytes_per_sec(size_t idx) {
+    if (idx == 2) { return cp_flush_limit_bytes_per_sec(); }
+    auto const mbps = (idx == 1) ? HS_DYNAMIC_CONFIG(device->recovery_io_limit_mbps)
+                                 : HS_DYNAMIC_CONFIG(device->background_io_limit_mbps);
+    return uint64_cast(mbps) * 1024 * 1024;
+}
+
+uint64_t PDevIOScheduler::cp_flush_limit_bytes_per_sec() {
+    auto const rate = uint64_cast(HS_DYNAMIC_CONFIG(device->cp_flush_io_limit_mbps)) * 1024 * 1024;
+    if (rate == 0) { return 0; }
+
+    // Past the relax pct, scale up the limit by (100 - relax pct) / (100 - dirty pct), so the cp flush keeps up with
+    // the dirty buffers as they near the limit, at which it is unlimited
+    auto const relax_pct = std::min(HS_DYNAMIC_CONFIG(device->cp_flush_io_relax_pct), 100u);
+    auto const dirty_pct = resource_mgr().dirty_buf_pct();
+    if (dirty_pct <= relax_pct) { return rate; }
+    if (dirty_pct >= 100) { return 0; }
+    return (rate * (100 - relax_pct)) / (100 - dirty_pct);
+}
+
+void PDevIOScheduler::refill(io_class& c, uint64_t rate) {
+    static constexpr uint64_t max_idle_us{10 * 1000 * 1000}; // Anything beyond fills the bucket anyways
+    auto const now = Clock::now();
+    auto const elapsed_us = std::min(get_elapsed_time_us(c.last_refill, now), max_idle_us);
+    auto const refill_bytes = s_cast< int64_t >((rate * elapsed_us) / (1000 * 1000));
+    if (refill_bytes == 0) { return; } // Keep accumulating the time until it is worth a byte
+
+    auto const burst =
+        std::max(s_cast< int64_t >((rate * HS_DYNAMIC_CONFIG(device->throttled_io_burst_ms)) / 1000), int64_t{1});
+    c.tokens = std::min(c.tokens + refill_bytes, burst);
+    c.last_refill = now;
+}
+
+folly::Future< std::error_code > PDevIOScheduler::schedule(io_priority_t prio, uint32_t size, bool part_of_batch,
+                                                           submit_fn_t&& submit) {
+    auto const idx = class_idx(prio);
+    auto const rate = limit_bytes_per_sec(idx);
+    if (rate == 0) { return submit(part_of_batch); }
+
+    std::unique_lock lg{m_mtx};
+    auto& c = m_classes[idx];
+    refill(c, rate);
+    if (c.queue.empty() && (c.tokens > 0)) {
+        c.tokens -= size;
+        lg.unlock();
+        return submit(part_of_batch);
+    }
+
+    auto& q = c.queue.emplace_back(queued_io{size, std::move(submit), folly::Promise< std::error_code >{},
+                                             Clock::now()});
+    auto f = q.promise.getFuture();
+    arm_timer();
+    COUNTER_INCREMENT(m_metrics, drive_throttled_ios, 1);
+    return f;
+}
+
+void PDevIOScheduler::wait_for_budget(io_priority_t prio, uint32_t size) {
+    auto const idx = class_idx(prio);
+    auto const rate = limit_bytes_per_sec(idx);
+    if (rate == 0) { return; }
+
+    // Queued in order with the async ios of the class, as a no-op the timer issues once it is its turn
+    folly::Future< std::error_code > f = folly::makeFuture< std::error_code >(std::error_code{});
+    {
+        std::unique_lock lg{m_mtx};
+        auto& c = m_classes[idx];
+        refill(c, rate);
+        if (m_stopping || (c.queue.empty() && (c.tokens > 0))) {
+            c.tokens -= size;
+            return;
+        }
+        auto& q = c.queue.emplace_back(
+            queued_io{size, [](bool) { return folly::makeFuture< std::error_code >(std::error_code{}); },
+                      folly::Promise< std::error_code >{}, Clock::now()});
+        f = q.promise.getFuture();
+        arm_timer();
+    }
+    COUNTER_INCREMENT(m_metrics, drive_throttled_ios, 1);
+
+    // Suspends only the fiber of the caller, the reactor keeps running the rest of its fibers and timers meanwhile
+    auto woken = std::make_shared< boost::fibers::promise< void > >();
+    auto woken_f = woken->get_future();
+    std::move(f).thenValue([woken](std::error_code) { woken->set_value(); });
+    woken_f.wait();
+}
+
+void PDevIOScheduler::drain() {
+    std::vector< std::pair< io_priority_t, queued_io > > ready;
+    {
+        std::unique_lock lg{m_mtx};
+        m_timer_armed = false;
+        if (m_stopping) { return; }
+
+        bool any_pending{false};
+        for (size_t idx{0}; idx < s_num_classes; ++idx) {
+            auto& c = m_classes[idx];
+            auto const rate = limit_bytes_per_sec(idx);
+            if (rate != 0) { refill(c, rate); }
+
+            // Limit could have been lifted since they were queued, in which case all of them can go
+            while (!c.queue.empty() && ((rate == 0) || (c.tokens > 0))) {
+                if (rate != 0) { c.tokens -= c.queue.front().size; }
+                ready.emplace_back(class_prio(idx), std::move(c.queue.front()));
+                c.queue.pop_front();
+            }
+            any_pending = any_pending || !c.queue.empty();
+        }
+        if (any_pending) { arm_timer(); }
+    }
+
+    for (auto& [prio, q] : ready) {
+        HISTOGRAM_OBSERVE(m_metrics, drive_throttled_wait_latency, get_elapsed_time_us(q.queued_time));
+        q.submit(false /* part_of_batch */)
+            .thenValue([p = std::move(q.promise), prio = prio](std::error_code ec) mutable {
+                // Completion runs the caller's continuation inline, keep any io it chains in the same class
+                io_priority_guard g{prio};
+                p.setValue(ec);
+            });
+    }
+}
+
+void PDevIOScheduler::arm_timer() {
+    if (m_timer_armed) { return; }
+    m_timer_armed = true;
+    m_timer_hdl = iomanager.schedule_global_timer(
+        uint64_cast(HS_DYNAMIC_CONFIG(device->throttled_io_drain_interval_us)) * 1000, false /* recurring */,
+        nullptr /* cookie */, iomgr::reactor_regex::all_worker, [this](void*) { drain(); },
+        false /* wait_to_schedule */);
+}
+} // namespace homestore
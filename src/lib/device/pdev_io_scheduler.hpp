@@ -0,0 +1,105 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <system_error>
+
+#include <folly/futures/Future.h>
+#include <iomgr/iomgr.hpp>
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+class PhysicalDevMetrics;
+
+/*
+ * PDevIOScheduler: Per physical device throttle of the non foreground priority classes. Each throttled class has a
+ * token bucket of bytes refilled at its configured rate (background_io_limit_mbps / recovery_io_limit_mbps /
+ * cp_flush_io_limit_mbps, the last relaxed as dirty buffers near their limit) and capped at throttled_io_burst_ms
+ * worth of it. An io is issued right away if its class has budget left (budget could
+ * go negative by the size of that io, so large ios are not starved) and no earlier io of the class is waiting,
+ * otherwise it is queued and issued in order by a timer, once the budget refills. Foreground ios never go through
+ * the scheduler.
+ *
+ * Ios issued by the timer and their completions run with the priority of their class, so follow up ios chained on
+ * completion (like the next buffer of a cp flush) stay in the same class.
+ */
+class PDevIOScheduler {
+public:
+    using submit_fn_t = std::function< folly::Future< std::error_code >(bool /* part_of_batch */) >;
+
+    explicit PDevIOScheduler(PhysicalDevMetrics& metrics);
+    PDevIOScheduler(const PDevIOScheduler&) = delete;
+    PDevIOScheduler(PDevIOScheduler&&) noexcept = delete;
+    PDevIOScheduler& operator=(const PDevIOScheduler&) = delete;
+    PDevIOScheduler& operator=(PDevIOScheduler&&) noexcept = delete;
+    ~PDevIOScheduler();
+
+    /**
+     * @brief Issue the io of given priority and size through submit, now or later depending on the budget of its
+     * class. part_of_batch is honored only if issued right away, queued ios are always issued on their own.
+     */
+    folly::Future< std::error_code > schedule(io_priority_t prio, uint32_t size, bool part_of_batch,
+                                              submit_fn_t&& submit);
+
+    /**
+     * @brief Suspend the caller of a sync io of given priority and size, until its class has budget for it. The sync
+     * io is queued in order with the async ios of its class and only the fiber of the caller waits for it, not the
+     * reactor.
+     */
+    void wait_for_budget(io_priority_t prio, uint32_t size);
+
+private:
+    static constexpr size_t s_num_classes{3}; // background, recovery and cp flush
+
+    struct queued_io {
+        uint32_t size;
+        submit_fn_t submit;
+        folly::Promise< std::error_code > promise;
+        Clock::time_point queued_time;
+    };
+
+    struct io_class {
+        int64_t tokens{0};
+        Clock::time_point last_refill{Clock::now()};
+        std::deque< queued_io > queue;
+    };
+
+    static size_t class_idx(io_priority_t prio) {
+        return (prio == io_priority_t::recovery) ? 1 : ((prio == io_priority_t::cp_flush) ? 2 : 0);
+    }
+    static io_priority_t class_prio(size_t idx) {
+        return (idx == 1) ? io_priority_t::recovery
+                          : ((idx == 2) ? io_priority_t::cp_flush : io_priority_t::background);
+    }
+    static uint64_t limit_bytes_per_sec(size_t idx);
+    static uint64_t cp_flush_limit_bytes_per_sec();
+    void refill(io_class& c, uint64_t rate);
+    void drain();
+    void arm_timer(); // Expects m_mtx to be held
+
+private:
+    PhysicalDevMetrics& m_metrics;
+    std::mutex m_mtx;
+    std::array< io_class, s_num_classes > m_classes;
+    iomgr::timer_handle_t m_timer_hdl{iomgr::null_timer_handle};
+    bool m_timer_armed{false};
+    bool m_stopping{false};
+};
+} // namespace homestore
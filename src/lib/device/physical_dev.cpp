@@ -18,12 +18,18 @@
 #include <stdexcept>
 #include <system_error>
 
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include <sys/stat.h>
+
 #include <folly/Exception.h>
 #include <iomgr/iomgr.hpp>
 #include <iomgr/iomgr_flip.hpp>
 #include <sisl/fds/utils.hpp>
 
 #include <homestore/homestore_decl.hpp>
+#include <homestore/probes.hpp>
 #include "device/chunk.h"
 #include "device/physical_dev.hpp"
 #include "device/device.h"
@@ -105,16 +111,42 @@ PhysicalDev::PhysicalDev(const dev_info& dinfo, int oflags, const pdev_info_head
                 in_bytes(m_dev_info.dev_size), in_bytes(m_devsize));
     }
 
-    LOGINFO("Device {} opened with dev_id={} size={}", m_devname, m_iodev->dev_id(), in_bytes(m_devsize));
+    if (HS_DYNAMIC_CONFIG(device->numa_aware_placement)) { m_numa_node = hs_utils::dev_numa_node(m_devname); }
+    LOGINFO("Device {} opened with dev_id={} size={} numa_node={}", m_devname, m_iodev->dev_id(), in_bytes(m_devsize),
+            m_numa_node);
 
     // Create stream instance for the reported number
     for (uint32_t i{0}; i < pinfo.dev_attr.num_streams; ++i) {
         m_streams.emplace_back(i);
     }
     m_super_blk_in_footer = m_pdev_info.mirror_super_block;
+
+    if (HS_DYNAMIC_CONFIG(device->use_io_uring)) {
+        UringDevBackend::params uparams;
+        uparams.queue_depth = HS_DYNAMIC_CONFIG(device->io_uring_queue_depth);
+        uparams.sqpoll = HS_DYNAMIC_CONFIG(device->io_uring_sqpoll);
+        uparams.sqpoll_idle_ms = HS_DYNAMIC_CONFIG(device->io_uring_sqpoll_idle_ms);
+        uparams.max_registered_bufs = HS_DYNAMIC_CONFIG(device->io_uring_max_registered_bufs);
+        uparams.write_streams = HS_DYNAMIC_CONFIG(device->use_write_streams);
+        m_uring = UringDevBackend::create(m_devname, oflags, uparams);
+    }
+
+    m_io_sched = std::make_unique< PDevIOScheduler >(m_metrics);
+    m_stream_metrics.resize(uint32_cast(max_write_streams()) + 1);
+    m_metrics.attach_gather_cb([this]() {
+        GAUGE_UPDATE(m_metrics, drive_inflight_ios, outstanding_ios());
+        GAUGE_UPDATE(m_metrics, drive_recent_write_latency_us, recent_write_latency_us());
+        GAUGE_UPDATE(m_metrics, drive_read_tail_latency_us, read_tail_latency_us());
+    });
 }
 
-PhysicalDev::~PhysicalDev() { close_device(); }
+PhysicalDev::~PhysicalDev() {
+    m_io_sched.reset();
+    m_uring.reset();
+    if (m_discard_fd >= 0) { ::close(m_discard_fd); }
+    if (m_fua_fd >= 0) { ::close(m_fua_fd); }
+    close_device();
+}
 
 void PhysicalDev::write_super_block(uint8_t const* buf, uint32_t sb_size, uint64_t offset) {
     auto err_c = m_drive_iface->sync_write(m_iodev.get(), c_charptr_cast(buf), sb_size, offset);
@@ -134,28 +166,142 @@ std::error_code PhysicalDev::read_super_block(uint8_t* buf, uint32_t sb_size, ui
 
 void PhysicalDev::close_device() { close_and_uncache_dev(m_devname, m_iodev); }
 
+__attribute__((no_sanitize_address)) static auto get_current_time() { return Clock::now(); }
+
+folly::Future< std::error_code > PhysicalDev::track_async_io(folly::Future< std::error_code >&& f, io_op_t op,
+                                                             uint32_t size, uint8_t write_stream) {
+    // All the histograms here are buffered per thread by sisl metrics, so recording on completion path is cheap
+    auto const start_time = get_current_time();
+    HS_PROBE(pdev_io_submit, m_devname.c_str(), s_cast< int >(op), size, write_stream);
+    PhysicalDevStreamMetrics* smetrics{nullptr};
+    if ((op == io_op_t::WRITE) && (write_stream < m_stream_metrics.size())) {
+        smetrics = m_stream_metrics[write_stream].get();
+        if (smetrics) {
+            COUNTER_INCREMENT(*smetrics, stream_write_count, 1);
+            HISTOGRAM_OBSERVE(*smetrics, stream_write_io_sizes, (((size - 1) / 1024) + 1));
+            smetrics->m_inflight_writes.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    m_outstanding_ios.fetch_add(1, std::memory_order_relaxed);
+
+    return std::move(f).thenValue([this, start_time, op, smetrics](std::error_code err) {
+        m_outstanding_ios.fetch_sub(1, std::memory_order_relaxed);
+        auto const lat = get_elapsed_time_us(start_time);
+        HS_PROBE(pdev_io_complete, m_devname.c_str(), s_cast< int >(op), lat, err.value());
+        switch (op) {
+        case io_op_t::WRITE: {
+            COUNTER_INCREMENT(m_metrics, drive_async_write_count, 1);
+            HISTOGRAM_OBSERVE(m_metrics, drive_async_write_latency, lat);
+            if (err) { COUNTER_INCREMENT(m_metrics, drive_write_errors, 1); }
+            if (smetrics) {
+                HISTOGRAM_OBSERVE(*smetrics, stream_write_latency, lat);
+                smetrics->m_inflight_writes.fetch_sub(1, std::memory_order_relaxed);
+            }
+
+            // Cheap exponential moving average (1/8 weight to latest). Racy updates are ok, its only a load hint
+            auto const avg = m_write_lat_ewma_us.load(std::memory_order_relaxed);
+            m_write_lat_ewma_us.store((avg * 7 + lat) / 8, std::memory_order_relaxed);
+            break;
+        }
+        case io_op_t::READ: {
+            COUNTER_INCREMENT(m_metrics, drive_async_read_count, 1);
+            HISTOGRAM_OBSERVE(m_metrics, drive_async_read_latency, lat);
+            if (err) { COUNTER_INCREMENT(m_metrics, drive_read_errors, 1); }
+
+            // Mean with 1/8 and mean deviation with 1/4 weight to latest, as the tcp rtt estimator
+            auto const avg = m_read_lat_ewma_us.load(std::memory_order_relaxed);
+            auto const dev = m_read_lat_dev_us.load(std::memory_order_relaxed);
+            auto const diff = (lat > avg) ? (lat - avg) : (avg - lat);
+            m_read_lat_ewma_us.store((avg * 7 + lat) / 8, std::memory_order_relaxed);
+            m_read_lat_dev_us.store((dev * 3 + diff) / 4, std::memory_order_relaxed);
+            break;
+        }
+        case io_op_t::FSYNC:
+            HISTOGRAM_OBSERVE(m_metrics, drive_fsync_latency, lat);
+            break;
+        }
+        return err;
+    });
+}
+
+void PhysicalDev::register_stream_writer(uint8_t write_stream, const std::string& vdev_name) {
+    std::unique_lock lg{m_chunk_op_mtx};
+    if (write_stream >= m_stream_metrics.size()) { return; }
+    if (m_stream_metrics[write_stream] == nullptr) {
+        auto const name = (write_stream == 0) ? fmt::format("{}_untagged", m_devname)
+                                              : fmt::format("{}_{}_stream{}", m_devname, vdev_name, write_stream);
+        m_stream_metrics[write_stream] = std::make_unique< PhysicalDevStreamMetrics >(name, &m_metrics);
+    }
+}
+
 folly::Future< std::error_code > PhysicalDev::async_write(const char* data, uint32_t size, uint64_t offset,
-                                                          bool part_of_batch) {
+                                                          bool part_of_batch, uint8_t write_stream) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        return m_io_sched->schedule(prio, size, part_of_batch, [this, data, size, offset, write_stream](bool pob) {
+            io_priority_guard g{io_priority_t::foreground}; // Budget is already accounted, issue it as is
+            return async_write(data, size, offset, pob, write_stream);
+        });
+    }
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
-    return m_drive_iface->async_write(m_iodev.get(), data, size, offset, part_of_batch);
+    if (m_uring) {
+        return track_async_io(m_uring->async_write(data, size, offset, part_of_batch, write_stream), io_op_t::WRITE,
+                              size, write_stream);
+    }
+    return track_async_io(m_drive_iface->async_write(m_iodev.get(), data, size, offset, part_of_batch),
+                          io_op_t::WRITE, size, write_stream);
 }
 
 folly::Future< std::error_code > PhysicalDev::async_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
-                                                           bool part_of_batch) {
+                                                           bool part_of_batch, uint8_t write_stream) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        // Caller's iov array need not outlive the call, only the buffers it points to do
+        std::vector< iovec > iovs(iov, iov + iovcnt);
+        return m_io_sched->schedule(prio, size, part_of_batch,
+                                    [this, iovs = std::move(iovs), size, offset, write_stream](bool pob) {
+                                        io_priority_guard g{io_priority_t::foreground};
+                                        return async_writev(iovs.data(), int_cast(iovs.size()), size, offset, pob,
+                                                            write_stream);
+                                    });
+    }
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
-    return m_drive_iface->async_writev(m_iodev.get(), iov, iovcnt, size, offset, part_of_batch);
+    if (m_uring) {
+        return track_async_io(m_uring->async_writev(iov, iovcnt, size, offset, part_of_batch, write_stream),
+                              io_op_t::WRITE, size, write_stream);
+    }
+    return track_async_io(m_drive_iface->async_writev(m_iodev.get(), iov, iovcnt, size, offset, part_of_batch),
+                          io_op_t::WRITE, size, write_stream);
 }
 
 folly::Future< std::error_code > PhysicalDev::async_read(char* data, uint32_t size, uint64_t offset,
                                                          bool part_of_batch) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        return m_io_sched->schedule(prio, size, part_of_batch, [this, data, size, offset](bool pob) {
+            io_priority_guard g{io_priority_t::foreground};
+            return async_read(data, size, offset, pob);
+        });
+    }
     HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
-    return m_drive_iface->async_read(m_iodev.get(), data, size, offset, part_of_batch);
+    if (m_uring) { return track_async_io(m_uring->async_read(data, size, offset, part_of_batch), io_op_t::READ); }
+    return track_async_io(m_drive_iface->async_read(m_iodev.get(), data, size, offset, part_of_batch),
+                          io_op_t::READ);
 }
 
 folly::Future< std::error_code > PhysicalDev::async_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
                                                           bool part_of_batch) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        std::vector< iovec > iovs(iov, iov + iovcnt);
+        return m_io_sched->schedule(prio, size, part_of_batch,
+                                    [this, iovs = std::move(iovs), size, offset](bool pob) mutable {
+                                        io_priority_guard g{io_priority_t::foreground};
+                                        return async_readv(iovs.data(), int_cast(iovs.size()), size, offset, pob);
+                                    });
+    }
     HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
-    return m_drive_iface->async_readv(m_iodev.get(), iov, iovcnt, size, offset, part_of_batch);
+    if (m_uring) {
+        return track_async_io(m_uring->async_readv(iov, iovcnt, size, offset, part_of_batch), io_op_t::READ);
+    }
+    return track_async_io(m_drive_iface->async_readv(m_iodev.get(), iov, iovcnt, size, offset, part_of_batch),
+                          io_op_t::READ);
 }
 
 folly::Future< std::error_code > PhysicalDev::async_write_zero(uint64_t size, uint64_t offset) {
@@ -172,11 +318,15 @@ folly::Future< std::error_code > PhysicalDev::async_write_zero(uint64_t size, ui
 }
 #endif
 
-folly::Future< std::error_code > PhysicalDev::queue_fsync() { return m_drive_iface->queue_fsync(m_iodev.get()); }
-
-__attribute__((no_sanitize_address)) static auto get_current_time() { return Clock::now(); }
+folly::Future< std::error_code > PhysicalDev::queue_fsync() {
+    if (m_uring) { return track_async_io(m_uring->queue_fsync(), io_op_t::FSYNC); }
+    return track_async_io(m_drive_iface->queue_fsync(m_iodev.get()), io_op_t::FSYNC);
+}
 
 std::error_code PhysicalDev::sync_write(const char* data, uint32_t size, uint64_t offset) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        m_io_sched->wait_for_budget(prio, size);
+    }
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
     COUNTER_INCREMENT(m_metrics, drive_sync_write_count, 1);
     auto const start_time = get_current_time();
@@ -186,6 +336,9 @@ std::error_code PhysicalDev::sync_write(const char* data, uint32_t size, uint64_
 }
 
 std::error_code PhysicalDev::sync_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset) {
+    if (auto const prio = thread_io_priority(); prio != io_priority_t::foreground) {
+        m_io_sched->wait_for_budget(prio, size);
+    }
     HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
     COUNTER_INCREMENT(m_metrics, drive_sync_write_count, 1);
     auto const start_time = Clock::now();
@@ -194,6 +347,55 @@ std::error_code PhysicalDev::sync_writev(const iovec* iov, int iovcnt, uint32_t
     return ret;
 }
 
+std::error_code PhysicalDev::sync_writev_fua(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset) {
+    if (m_fua_unsupported.load(std::memory_order_relaxed)) { return sync_writev(iov, iovcnt, size, offset); }
+
+    int fd;
+    {
+        std::unique_lock lg{m_discard_mtx};
+        if (m_fua_fd < 0) {
+            // Direct io, so that it stays coherent with the drive interface writes; files on tmpfs etc don't support
+            // it, for those a buffered fd with RWF_DSYNC gives the same durability.
+            m_fua_fd = ::open(m_devname.c_str(), O_RDWR | O_DIRECT);
+            if ((m_fua_fd < 0) && (errno == EINVAL)) { m_fua_fd = ::open(m_devname.c_str(), O_RDWR); }
+            if (m_fua_fd < 0) {
+                LOGWARN("Unable to open device {} for fua writes, error={}, using regular sync writes", m_devname,
+                        errno);
+                m_fua_unsupported.store(true, std::memory_order_relaxed);
+                return sync_writev(iov, iovcnt, size, offset);
+            }
+        }
+        fd = m_fua_fd;
+    }
+
+    HISTOGRAM_OBSERVE(m_metrics, write_io_sizes, (((size - 1) / 1024) + 1));
+    COUNTER_INCREMENT(m_metrics, drive_sync_write_count, 1);
+    auto const start_time = Clock::now();
+    auto const ret = ::pwritev2(fd, iov, iovcnt, s_cast< off_t >(offset), RWF_DSYNC);
+    if (ret < 0) {
+        auto const err = errno;
+        if ((err == EOPNOTSUPP) || (err == EINVAL)) {
+            LOGINFO("Device {} does not support RWF_DSYNC writes (error={}), using write + fdatasync", m_devname, err);
+            m_fua_unsupported.store(true, std::memory_order_relaxed);
+        } else {
+            COUNTER_INCREMENT(m_metrics, drive_write_errors, 1);
+            return std::error_code{err, std::system_category()};
+        }
+    } else if (s_cast< uint64_t >(ret) != size) {
+        COUNTER_INCREMENT(m_metrics, drive_write_errors, 1);
+        return std::make_error_code(std::errc::io_error);
+    } else {
+        COUNTER_INCREMENT(m_metrics, drive_fua_write_count, 1);
+        HISTOGRAM_OBSERVE(m_metrics, drive_write_latency, get_elapsed_time_us(start_time));
+        return std::error_code{};
+    }
+
+    // Fallback: regular write followed by a cache flush of the device
+    if (auto err = sync_writev(iov, iovcnt, size, offset); err) { return err; }
+    if (::fdatasync(fd) != 0) { return std::error_code{errno, std::system_category()}; }
+    return std::error_code{};
+}
+
 std::error_code PhysicalDev::sync_read(char* data, uint32_t size, uint64_t offset) {
     HISTOGRAM_OBSERVE(m_metrics, read_io_sizes, (((size - 1) / 1024) + 1));
     COUNTER_INCREMENT(m_metrics, drive_sync_read_count, 1);
@@ -216,7 +418,67 @@ std::error_code PhysicalDev::sync_write_zero(uint64_t size, uint64_t offset) {
     return m_drive_iface->sync_write_zero(m_iodev.get(), size, offset);
 }
 
-void PhysicalDev::submit_batch() { m_drive_iface->submit_batch(); }
+std::error_code PhysicalDev::sync_discard(uint64_t size, uint64_t offset) {
+    if (m_discard_unsupported.load(std::memory_order_relaxed)) {
+        return std::make_error_code(std::errc::operation_not_supported);
+    }
+
+    int fd;
+    {
+        std::unique_lock lg{m_discard_mtx};
+        if (m_discard_fd < 0) {
+            m_discard_fd = ::open(m_devname.c_str(), O_RDWR);
+            if (m_discard_fd < 0) {
+                auto const err = errno;
+                LOGWARN("Unable to open device {} for discard, error={}", m_devname, err);
+                return std::error_code{err, std::system_category()};
+            }
+        }
+        fd = m_discard_fd;
+    }
+
+    struct stat st;
+    bool const is_blkdev = (::fstat(fd, &st) == 0) && S_ISBLK(st.st_mode);
+
+    int ret;
+    if (is_blkdev) {
+        uint64_t range[2]{offset, size};
+        ret = ::ioctl(fd, BLKDISCARD, &range);
+    } else {
+        ret = ::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, s_cast< off_t >(offset),
+                          s_cast< off_t >(size));
+    }
+
+    if (ret != 0) {
+        auto const err = errno;
+        if ((err == EOPNOTSUPP) || (err == ENOTTY) || (err == EINVAL)) {
+            LOGINFO("Device {} does not support discard (error={}), disabling discards on it", m_devname, err);
+            m_discard_unsupported.store(true, std::memory_order_relaxed);
+            return std::make_error_code(std::errc::operation_not_supported);
+        }
+        COUNTER_INCREMENT(m_metrics, drive_write_errors, 1);
+        return std::error_code{err, std::system_category()};
+    }
+    COUNTER_INCREMENT(m_metrics, drive_discard_count, 1);
+    HISTOGRAM_OBSERVE(m_metrics, discard_io_sizes, (((size - 1) / 1024) + 1));
+    return std::error_code{};
+}
+
+void PhysicalDev::submit_batch() {
+    if (m_uring) {
+        m_uring->submit_batch();
+    } else {
+        m_drive_iface->submit_batch();
+    }
+}
+
+bool PhysicalDev::register_io_buffer(uint8_t* buf, uint64_t size) {
+    return m_uring ? m_uring->register_buffer(buf, size) : false;
+}
+
+void PhysicalDev::unregister_io_buffer(uint8_t* buf) {
+    if (m_uring) { m_uring->unregister_buffer(buf); }
+}
 
 //////////////////////////// Chunk Creation/Load related methods /////////////////////////////////////////
 void PhysicalDev::format_chunks() {
@@ -227,6 +489,20 @@ void PhysicalDev::format_chunks() {
 
 std::vector< shared< Chunk > > PhysicalDev::create_chunks(const std::vector< uint32_t >& chunk_ids, uint32_t vdev_id,
                                                           uint64_t size) {
+    return do_create_chunks(chunk_ids, vdev_id, size, std::nullopt /* ordinal in the order of chunk_ids */, {});
+}
+
+std::vector< shared< Chunk > > PhysicalDev::create_chunks(const std::vector< uint32_t >& chunk_ids, uint32_t vdev_id,
+                                                          uint64_t size, uint32_t ordinal,
+                                                          const std::vector< sisl::blob >& private_datas) {
+    HS_REL_ASSERT_EQ(chunk_ids.size(), private_datas.size(), "Private data expected for each of the chunks");
+    return do_create_chunks(chunk_ids, vdev_id, size, ordinal, private_datas);
+}
+
+std::vector< shared< Chunk > > PhysicalDev::do_create_chunks(const std::vector< uint32_t >& chunk_ids,
+                                                             uint32_t vdev_id, uint64_t size,
+                                                             std::optional< uint32_t > ordinal,
+                                                             const std::vector< sisl::blob >& private_datas) {
     std::vector< shared< Chunk > > ret_chunks;
     std::unique_lock lg{m_chunk_op_mtx};
     auto chunks_remaining = chunk_ids.size();
@@ -242,7 +518,8 @@ std::vector< shared< Chunk > > PhysicalDev::create_chunks(const std::vector< uin
             auto ptr = buf;
             for (auto cslot = b.start_bit; cslot < b.start_bit + b.nbits; ++cslot, ++cit, ptr += chunk_info::size) {
                 chunk_info* cinfo = new (ptr) chunk_info();
-                populate_chunk_info(cinfo, vdev_id, size, chunk_ids[cit], cit, {});
+                populate_chunk_info(cinfo, vdev_id, size, chunk_ids[cit], ordinal.value_or(cit),
+                                    private_datas.empty() ? sisl::blob{} : private_datas[cit]);
 
                 auto chunk = std::make_shared< Chunk >(this, *cinfo, cslot);
                 ret_chunks.push_back(chunk);
@@ -327,7 +604,17 @@ std::pair< uint64_t, uint64_t > get_next_contiguous_set_bit(const sisl::Bitset&
 }
 
 void PhysicalDev::load_chunks(std::function< bool(cshared< Chunk >&) >&& chunk_found_cb) {
+    load_chunks(read_chunks(), std::move(chunk_found_cb));
+}
+
+std::vector< shared< Chunk > > PhysicalDev::read_chunks() {
+    // Max size of a single read of chunk info area. Slots which are set within this span are read together, even if
+    // there are free slots in between, since one large read is much cheaper than many small ones on restart.
+    static constexpr uint64_t max_chunk_info_read_size{4 * 1024 * 1024};
+    static constexpr uint64_t max_slots_per_read{max_chunk_info_read_size / chunk_info::size};
+
     std::unique_lock lg{m_chunk_op_mtx};
+    std::vector< shared< Chunk > > chunks;
 
     // Read the chunk info bitmap area from super block and load them into in-memory bitmap of chunk slots
     auto buf_arr = make_byte_array(hs_super_blk::chunk_info_bitmap_size(m_dev_info), m_pdev_info.dev_attr.align_size,
@@ -336,19 +623,28 @@ void PhysicalDev::load_chunks(std::function< bool(cshared< Chunk >&) >&& chunk_f
     m_chunk_info_slots = std::make_unique< sisl::Bitset >(buf_arr);
 
     // Walk through each of the chunk info and create corresponding chunks
-
     uint64_t prev_bit = 0;
     do {
         auto const [b, nbits] = get_next_contiguous_set_bit(*m_chunk_info_slots, prev_bit);
         if (nbits == 0) { break; } // No more chunk slots are occupied
-        prev_bit = b + nbits;
 
+        // Extend the span to cover as many subsequent set runs as possible within the max read size
+        uint64_t span_end = b + nbits;
+        while (true) {
+            auto const [nb, nnbits] = get_next_contiguous_set_bit(*m_chunk_info_slots, span_end);
+            if ((nnbits == 0) || ((nb + nnbits - b) > max_slots_per_read)) { break; }
+            span_end = nb + nnbits;
+        }
+        prev_bit = span_end;
+
+        auto const nslots = span_end - b;
         auto buf =
-            hs_utils::iobuf_alloc(nbits * chunk_info::size, sisl::buftag::superblk, m_pdev_info.dev_attr.align_size);
-        read_super_block(buf, nbits * chunk_info::size, chunk_info_offset_nth(b));
+            hs_utils::iobuf_alloc(nslots * chunk_info::size, sisl::buftag::superblk, m_pdev_info.dev_attr.align_size);
+        read_super_block(buf, nslots * chunk_info::size, chunk_info_offset_nth(b));
         auto ptr = buf;
 
-        for (auto cslot = b; cslot < b + nbits; ++cslot, ptr += chunk_info::size) {
+        for (auto cslot = b; cslot < span_end; ++cslot, ptr += chunk_info::size) {
+            if (!m_chunk_info_slots->get_bitval(cslot)) { continue; }
             auto cinfo = r_cast< chunk_info* >(ptr);
 
             auto info_crc = cinfo->checksum;
@@ -360,14 +656,22 @@ void PhysicalDev::load_chunks(std::function< bool(cshared< Chunk >&) >&& chunk_f
                 RELEASE_ASSERT(false, "Checksum mismatch for chunk info in slot {}", cslot);
             }
             cinfo->checksum = info_crc;
-
-            auto chunk = std::make_shared< Chunk >(this, *cinfo, cslot);
-            m_chunk_data_area.insert(
-                ChunkInterval::right_open(cinfo->chunk_start_offset, cinfo->chunk_start_offset + cinfo->chunk_size));
-            if (chunk_found_cb(chunk)) { get_stream(chunk).m_chunks_map.insert(std::pair{cinfo->chunk_id, chunk}); }
+            chunks.emplace_back(std::make_shared< Chunk >(this, *cinfo, cslot));
         }
         hs_utils::iobuf_free(buf, sisl::buftag::superblk);
     } while (true);
+    return chunks;
+}
+
+void PhysicalDev::load_chunks(std::vector< shared< Chunk > >&& chunks,
+                              std::function< bool(cshared< Chunk >&) >&& chunk_found_cb) {
+    std::unique_lock lg{m_chunk_op_mtx};
+    for (auto& chunk : chunks) {
+        auto const& cinfo = chunk->info();
+        m_chunk_data_area.insert(
+            ChunkInterval::right_open(cinfo.chunk_start_offset, cinfo.chunk_start_offset + cinfo.chunk_size));
+        if (chunk_found_cb(chunk)) { get_stream(chunk).m_chunks_map.insert(std::pair{cinfo.chunk_id, chunk}); }
+    }
 }
 
 void PhysicalDev::remove_chunks(std::vector< shared< Chunk > >& chunks) {
@@ -13,6 +13,8 @@
  *
  *********************************************************************************/
 #pragma once
+#include <atomic>
+#include <optional>
 #include <vector>
 #include <string>
 #include "hs_super_blk.h"
@@ -31,6 +33,8 @@
 #include <homestore/homestore_decl.hpp>
 
 #include "hs_super_blk.h"
+#include "device/uring_dev_backend.hpp"
+#include "device/pdev_io_scheduler.hpp"
 SISL_LOGGING_DECL(device)
 
 namespace homestore {
@@ -38,6 +42,7 @@ class PhysicalDevMetrics : public sisl::MetricsGroupWrapper {
 public:
     explicit PhysicalDevMetrics(const std::string& devname) : sisl::MetricsGroupWrapper{"PhysicalDev", devname} {
         REGISTER_COUNTER(drive_sync_write_count, "Drive sync write count");
+        REGISTER_COUNTER(drive_fua_write_count, "Drive sync write count issued with fua");
         REGISTER_COUNTER(drive_sync_read_count, "Drive sync read count");
         REGISTER_COUNTER(drive_async_write_count, "Drive async write count");
         REGISTER_COUNTER(drive_async_read_count, "Drive async read count");
@@ -47,14 +52,30 @@ public:
         REGISTER_COUNTER(drive_write_errors, "Total drive write errors");
         REGISTER_COUNTER(drive_spurios_events, "Total number of spurious events per drive");
         REGISTER_COUNTER(drive_skipped_chunk_bm_writes, "Total number of skipped writes for chunk bitmap");
+        REGISTER_COUNTER(drive_discard_count, "Total number of discards issued to the drive");
+        REGISTER_COUNTER(drive_throttled_ios, "Total non foreground ios queued (or held) for lack of budget");
 
         REGISTER_HISTOGRAM(drive_write_latency, "BlkStore drive write latency in us");
         REGISTER_HISTOGRAM(drive_read_latency, "BlkStore drive read latency in us");
+        REGISTER_HISTOGRAM(drive_async_write_latency, "Drive async write latency in us", "drive_async_latency",
+                           {"io_op", "write"});
+        REGISTER_HISTOGRAM(drive_async_read_latency, "Drive async read latency in us", "drive_async_latency",
+                           {"io_op", "read"});
+        REGISTER_HISTOGRAM(drive_fsync_latency, "Drive fsync latency in us", "drive_async_latency",
+                           {"io_op", "fsync"});
+        REGISTER_HISTOGRAM(drive_throttled_wait_latency, "Time throttled ios waited for budget in us",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+
+        REGISTER_GAUGE(drive_inflight_ios, "Drive async ios submitted but not completed yet");
+        REGISTER_GAUGE(drive_recent_write_latency_us, "Drive moving average of recent async write latency");
+        REGISTER_GAUGE(drive_read_tail_latency_us, "Drive estimate of the tail latency of recent async reads");
 
         REGISTER_HISTOGRAM(write_io_sizes, "Write IO Sizes", "io_sizes", {"io_direction", "write"},
                            HistogramBucketsType(ExponentialOfTwoBuckets));
         REGISTER_HISTOGRAM(read_io_sizes, "Read IO Sizes", "io_sizes", {"io_direction", "read"},
                            HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(discard_io_sizes, "Discard IO Sizes", "io_sizes", {"io_direction", "discard"},
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
 
         register_me_to_farm();
     }
@@ -67,6 +88,32 @@ public:
     ~PhysicalDevMetrics() { deregister_me_from_farm(); }
 };
 
+// Breakdown of the drive writes per write stream, which is named after the vdev(s) which writes to that stream
+class PhysicalDevStreamMetrics : public sisl::MetricsGroup {
+public:
+    PhysicalDevStreamMetrics(const std::string& instance_name, PhysicalDevMetrics* parent) :
+            sisl::MetricsGroup{"PhysicalDevStream", instance_name} {
+        REGISTER_COUNTER(stream_write_count, "Drive async writes on this stream");
+        REGISTER_GAUGE(stream_inflight_writes, "Drive async writes on this stream not completed yet");
+        REGISTER_HISTOGRAM(stream_write_latency, "Drive async write latency in us on this stream");
+        REGISTER_HISTOGRAM(stream_write_io_sizes, "Write IO sizes on this stream",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+
+        register_me_to_parent(parent);
+        attach_gather_cb([this]() {
+            GAUGE_UPDATE(*this, stream_inflight_writes, m_inflight_writes.load(std::memory_order_relaxed));
+        });
+    }
+
+    PhysicalDevStreamMetrics(const PhysicalDevStreamMetrics&) = delete;
+    PhysicalDevStreamMetrics(PhysicalDevStreamMetrics&&) noexcept = delete;
+    PhysicalDevStreamMetrics& operator=(const PhysicalDevStreamMetrics&) = delete;
+    PhysicalDevStreamMetrics& operator=(PhysicalDevStreamMetrics&&) noexcept = delete;
+    ~PhysicalDevStreamMetrics() = default;
+
+    std::atomic< uint64_t > m_inflight_writes{0};
+};
+
 class Chunk;
 using ChunkIntervalSet = boost::icl::split_interval_set< uint64_t >;
 using ChunkInterval = ChunkIntervalSet::interval_type;
@@ -85,7 +132,10 @@ struct chunk_info {
     uint32_t chunk_ordinal{0};     // 32: Chunk ordinal within the vdev on this pdev
     uint8_t chunk_allocated{0x00}; // 36: Is chunk allocated or free
     uint16_t checksum{0};          // 37: checksum of this chunk info
-    uint8_t padding[25]{};         // 39: pad to make it 128 bytes total
+    uint8_t zero_pending{0x00};    // 39: Is chunk formatted lazily and zeroing is not completed yet
+    uint64_t zeroed_upto{0};       // 40: Offset within chunk upto which it is zeroed (or written), if zero_pending
+    uint8_t compressed_blks{0x00}; // 48: Has the data service ever written compressed blks to this chunk
+    uint8_t padding[15]{};         // 49: pad to make it 128 bytes total
     uint8_t chunk_selector_private[selector_private_size]{}; // 64: Chunk selector private area
     uint8_t user_private[user_private_size]{};               // 128: Opaque user of the chunk information
 
@@ -137,6 +187,19 @@ private:
     std::unique_ptr< sisl::Bitset > m_chunk_info_slots; // Slots to write the chunk info
     uint32_t m_chunk_sb_size{0};                        // Total size of the chunk sb at present
     std::unordered_set< uint64_t > m_chunk_start;       // Store and verify start offset of all chunks for debugging.
+    std::unique_ptr< UringDevBackend > m_uring;         // Optional io_uring submission path, nullptr if not in use
+    std::unique_ptr< PDevIOScheduler > m_io_sched;      // Throttles non foreground class ios
+    int m_numa_node{-1};                                // NUMA node the device is attached to, -1 if unknown
+    std::atomic< uint64_t > m_outstanding_ios{0};       // Async ios submitted but not completed yet
+    std::atomic< uint64_t > m_write_lat_ewma_us{0};     // Moving average of recent async write latency
+    std::atomic< uint64_t > m_read_lat_ewma_us{0};      // Moving average of recent async read latency
+    std::atomic< uint64_t > m_read_lat_dev_us{0};       // Moving average of its deviation from the above
+    std::vector< std::unique_ptr< PhysicalDevStreamMetrics > > m_stream_metrics; // Per write stream, index 0=untagged
+    std::mutex m_discard_mtx;                           // Serializes lazy open of the discard and fua fds
+    int m_discard_fd{-1};                               // Fd used to issue discards, opened upon first discard
+    std::atomic< bool > m_discard_unsupported{false};   // Device rejected discard, don't attempt it anymore
+    int m_fua_fd{-1};                                   // Direct io fd used for fua writes, opened upon first one
+    std::atomic< bool > m_fua_unsupported{false};       // Device rejected RWF_DSYNC, write and fdatasync instead
 
 public:
     PhysicalDev(const dev_info& dinfo, int oflags, const pdev_info_header& pinfo);
@@ -167,6 +230,21 @@ public:
     std::vector< shared< Chunk > > create_chunks(const std::vector< uint32_t >& chunk_ids, uint32_t vdev_id,
                                                  uint64_t size);
 
+    /// @brief Create multiple same sized chunks on this device, all of the same ordinal and each with its own private
+    /// data. Chunk infos are persisted with one super block write per contiguous run of free slots, followed by a
+    /// single write of the slot bitmap. In case of unavailable space it throws the std::out_of_range exception, but
+    /// cleans up any partially created chunks.
+    ///
+    /// @param chunk_ids: List of chunk ids to be created, expected to be system wide unique
+    /// @param vdev_id: Vdev these chunks should be part of.
+    /// @param size: Size of each chunk
+    /// @param ordinal: Ordinal of all the chunks
+    /// @param private_datas: data to be stored in private space of each chunk, in the order of chunk_ids
+    /// @return Vector of chunks that are created
+    std::vector< shared< Chunk > > create_chunks(const std::vector< uint32_t >& chunk_ids, uint32_t vdev_id,
+                                                 uint64_t size, uint32_t ordinal,
+                                                 const std::vector< sisl::blob >& private_datas);
+
     /// @brief Create a chunks on this device. In case of unavailable space it throws the std::out_of_range exception
     ///
     /// @param chunk_ids: Chunk ID for the chunk to be created. This ID is expected to be system wide unique
@@ -180,6 +258,13 @@ public:
                                  const sisl::blob& private_data = {});
 
     void load_chunks(std::function< bool(cshared< Chunk >&) >&& chunk_found_cb);
+
+    /// @brief Read the chunk slot bitmap and all the chunk infos of this device and build the chunks, without
+    /// attaching them to this pdev. Chunk infos of nearby slots are read in a single io. This can be called in
+    /// parallel across pdevs and then followed by load_chunks() with the returned chunks.
+    std::vector< shared< Chunk > > read_chunks();
+    void load_chunks(std::vector< shared< Chunk > >&& chunks,
+                     std::function< bool(cshared< Chunk >&) >&& chunk_found_cb);
     void remove_chunks(std::vector< shared< Chunk > >& chunks);
     void remove_chunk(cshared< Chunk >& chunk);
     void format_chunks();
@@ -197,12 +282,13 @@ public:
     iomgr::DriveInterface* drive_iface() const { return m_drive_iface; }
     uint32_t pdev_id() const { return m_pdev_info.pdev_id; }
     const std::string& get_devname() const { return m_devname; }
+    int numa_node() const { return m_numa_node; }
 
     /////////////////////////////////////// IO Methods //////////////////////////////////////////
     folly::Future< std::error_code > async_write(const char* data, uint32_t size, uint64_t offset,
-                                                 bool part_of_batch = false);
+                                                 bool part_of_batch = false, uint8_t write_stream = 0);
     folly::Future< std::error_code > async_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
-                                                  bool part_of_batch = false);
+                                                  bool part_of_batch = false, uint8_t write_stream = 0);
     folly::Future< std::error_code > async_read(char* data, uint32_t size, uint64_t offset, bool part_of_batch = false);
     folly::Future< std::error_code > async_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
                                                  bool part_of_batch = false);
@@ -211,11 +297,47 @@ public:
 
     std::error_code sync_write(const char* data, uint32_t size, uint64_t offset);
     std::error_code sync_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
+
+    /// @brief Synchronously write the buffers, returning only after they are durable on the media. It is issued as a
+    /// single pwritev2 with RWF_DSYNC (which the block layer turns into a FUA write), so that the caller need not
+    /// issue a separate cache flush. If the device doesn't support it, falls back to a regular write + fdatasync.
+    std::error_code sync_writev_fua(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
     std::error_code sync_read(char* data, uint32_t size, uint64_t offset);
     std::error_code sync_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset);
     std::error_code sync_write_zero(uint64_t size, uint64_t offset);
+
+    /// @brief Hint the device that the given range no longer holds valid data (BLKDISCARD on block devices, punch
+    /// hole on files). This is purely advisory, content of the range is undefined after this call.
+    /// @return Error if the discard failed. Once the device reports discard is not supported, subsequent calls are
+    /// no-ops returning operation_not_supported.
+    std::error_code sync_discard(uint64_t size, uint64_t offset);
     void submit_batch();
 
+    /// @brief Register a long lived io buffer with the device, so that ios on this buffer avoids per-io page pinning.
+    /// It is a no-op (returns false) if the device is not using io_uring submission path.
+    bool register_io_buffer(uint8_t* buf, uint64_t size);
+    void unregister_io_buffer(uint8_t* buf);
+    bool is_io_uring_enabled() const { return (m_uring != nullptr); }
+
+    /// @brief Number of device write streams (FDP placement ids) which writes could be tagged with. Stream 0 means
+    /// no placement hint. Returns 0 if write streams are not supported or not enabled.
+    uint8_t max_write_streams() const { return m_uring ? m_uring->max_write_streams() : 0; }
+
+    /// @brief Register a vdev as a writer of the given write stream, so that writes on the stream are accounted into a
+    /// separate metrics group named after the vdev. Expected to be called before any io is issued on the stream.
+    void register_stream_writer(uint8_t write_stream, const std::string& vdev_name);
+
+    /// @brief Load indicators of the device, used by load aware chunk selection
+    uint64_t outstanding_ios() const { return m_outstanding_ios.load(std::memory_order_relaxed); }
+    uint64_t recent_write_latency_us() const { return m_write_lat_ewma_us.load(std::memory_order_relaxed); }
+
+    /// @brief Estimate of the tail latency of recent async reads (mean + 4 * mean deviation, as the tcp rto), beyond
+    /// which a read is deemed slow, for instance to hedge it with a read off another replica
+    uint64_t read_tail_latency_us() const {
+        return m_read_lat_ewma_us.load(std::memory_order_relaxed) +
+            4 * m_read_lat_dev_us.load(std::memory_order_relaxed);
+    }
+
     ///////////// Parameters Getters ///////////////////////
     uint32_t optimal_page_size() const { return m_pdev_info.dev_attr.phys_page_size; }
     uint32_t align_size() const { return m_pdev_info.dev_attr.align_size; }
@@ -231,7 +353,13 @@ public:
     uint64_t chunk_info_offset_nth(uint32_t slot) const;
 
 private:
+    enum class io_op_t : uint8_t { READ, WRITE, FSYNC };
+    folly::Future< std::error_code > track_async_io(folly::Future< std::error_code >&& f, io_op_t op,
+                                                    uint32_t size = 0, uint8_t write_stream = 0);
     void do_remove_chunk(cshared< Chunk >& chunk);
+    std::vector< shared< Chunk > > do_create_chunks(const std::vector< uint32_t >& chunk_ids, uint32_t vdev_id,
+                                                    uint64_t size, std::optional< uint32_t > ordinal,
+                                                    const std::vector< sisl::blob >& private_datas);
     void populate_chunk_info(chunk_info* cinfo, uint32_t vdev_id, uint64_t size, uint32_t chunk_id, uint32_t ordinal,
                              const sisl::blob& private_data);
     void free_chunk_info(chunk_info* cinfo);
@@ -13,6 +13,8 @@
  *
  *********************************************************************************/
 #include "round_robin_chunk_selector.h"
+#include "device/physical_dev.hpp"
+#include "common/homestore_utils.hpp"
 
 namespace homestore {
 RoundRobinChunkSelector::RoundRobinChunkSelector(bool dynamic_chunk_add) : m_dynamic_chunk_add{dynamic_chunk_add} {
@@ -20,9 +22,27 @@ RoundRobinChunkSelector::RoundRobinChunkSelector(bool dynamic_chunk_add) : m_dyn
                       "Dynamically adding chunk to chunkselector is not supported, need RCU to make it thread safe");
 }
 
-void RoundRobinChunkSelector::add_chunk(cshared< Chunk >& chunk) { m_chunks.emplace_back(std::move(chunk)); }
+void RoundRobinChunkSelector::add_chunk(cshared< Chunk >& chunk) {
+    m_numa_chunks[chunk->physical_dev()->numa_node()].push_back(chunk);
+    m_chunks.emplace_back(std::move(chunk));
+}
+
+cshared< Chunk > RoundRobinChunkSelector::select_chunk(blk_count_t nblks, const blk_alloc_hints&) {
+    // If chunks are spread across numa nodes, prefer the chunks local to the node of the submitting thread, so that
+    // the io is done by the device attached to the same socket as the buffer. Local chunks without room for the
+    // allocation are skipped, once all of them are full the allocation goes to the remote ones.
+    if ((m_numa_chunks.size() > 1) && HS_DYNAMIC_CONFIG(device->numa_aware_placement)) {
+        auto const it = m_numa_chunks.find(hs_utils::cur_numa_node());
+        if (it != m_numa_chunks.end()) {
+            auto const& chunks = it->second;
+            for (size_t i{0}; i < chunks.size(); ++i) {
+                if (*m_next_numa_chunk_index >= chunks.size()) { *m_next_numa_chunk_index = 0; }
+                auto const& chunk = chunks[(*m_next_numa_chunk_index)++];
+                if (chunk->blk_allocator()->available_blks() >= nblks) { return chunk; }
+            }
+        }
+    }
 
-cshared< Chunk > RoundRobinChunkSelector::select_chunk(blk_count_t, const blk_alloc_hints&) {
     if (*m_next_chunk_index >= m_chunks.size()) { *m_next_chunk_index = 0; }
     return m_chunks[(*m_next_chunk_index)++];
 }
@@ -16,6 +16,7 @@
 
 #include <homestore/chunk_selector.h>
 
+#include <unordered_map>
 #include <vector>
 #include <folly/ThreadLocal.h>
 #include <sisl/logging/logging.h>
@@ -39,7 +40,9 @@ public:
 
 private:
     std::vector< shared< Chunk > > m_chunks;
+    std::unordered_map< int, std::vector< shared< Chunk > > > m_numa_chunks; // Chunks grouped by numa node of pdev
     folly::ThreadLocal< uint32_t > m_next_chunk_index;
+    folly::ThreadLocal< uint32_t > m_next_numa_chunk_index;
     bool m_dynamic_chunk_add; // Can we add chunk dynamically
 };
 
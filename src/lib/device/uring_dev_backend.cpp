@@ -0,0 +1,384 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <filesystem>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifndef NO_LIBURING
+#include <liburing.h>
+#else
+struct io_uring {};
+#endif
+
+#include <iomgr/iomgr.hpp>
+#include <sisl/logging/logging.h>
+
+#include "device/uring_dev_backend.hpp"
+#include "common/homestore_assert.hpp"
+
+SISL_LOGGING_DECL(device)
+
+namespace homestore {
+
+#ifndef NO_LIBURING
+struct UringDevBackend::uring_req {
+    folly::Promise< std::error_code > promise;
+    iomgr::io_fiber_t fiber{nullptr};
+    uint32_t size{0};
+};
+
+std::unique_ptr< UringDevBackend > UringDevBackend::create(const std::string& devname, int oflags, const params& p) {
+    // We open our own fd for the ring, since fixed files need to be registered with this ring alone and we don't want
+    // to depend on the internals of how iomgr opened the device.
+    int const fd = ::open(devname.c_str(), oflags, 0666);
+    if (fd < 0) {
+        LOGWARN("Unable to open device={} for io_uring, errno={}, falling back to default drive interface", devname,
+                errno);
+        return nullptr;
+    }
+
+    std::unique_ptr< UringDevBackend > backend{new UringDevBackend(devname, fd, p)};
+    if (!backend->init()) { return nullptr; }
+    return backend;
+}
+
+UringDevBackend::UringDevBackend(const std::string& devname, int fd, const params& p) :
+        m_devname{devname}, m_fd{fd}, m_params{p} {}
+
+#ifdef HAVE_URING_WRITE_STREAM
+static uint8_t discover_write_streams(const std::string& devname) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    auto const dev_path = fs::canonical(devname, ec);
+    if (ec) { return 0; }
+
+    // Partitions don't have queue attributes, they are on the parent disk
+    auto sys_path = fs::canonical(fs::path{"/sys/class/block"} / dev_path.filename(), ec);
+    if (ec) { return 0; }
+    if (!fs::exists(sys_path / "queue")) { sys_path = sys_path.parent_path(); }
+
+    std::ifstream ifs{sys_path / "queue" / "max_write_streams"};
+    uint32_t nstreams{0};
+    if (!ifs || !(ifs >> nstreams)) { return 0; }
+    return s_cast< uint8_t >(std::min(nstreams, uint32_cast(std::numeric_limits< uint8_t >::max())));
+}
+#endif
+
+bool UringDevBackend::init() {
+    m_ring = std::make_unique< io_uring >();
+
+    io_uring_params uparams;
+    std::memset(&uparams, 0, sizeof(uparams));
+    if (m_params.sqpoll) {
+        uparams.flags |= IORING_SETUP_SQPOLL;
+        uparams.sq_thread_idle = m_params.sqpoll_idle_ms;
+    }
+
+    auto ret = io_uring_queue_init_params(m_params.queue_depth, m_ring.get(), &uparams);
+    if ((ret < 0) && m_params.sqpoll) {
+        // SQPOLL needs privileges on older kernels, try without it before giving up on io_uring altogether
+        LOGWARN("io_uring init with SQPOLL failed for device={} ret={}, retrying without SQPOLL", m_devname, ret);
+        m_params.sqpoll = false;
+        std::memset(&uparams, 0, sizeof(uparams));
+        ret = io_uring_queue_init_params(m_params.queue_depth, m_ring.get(), &uparams);
+    }
+
+    if (ret < 0) {
+        LOGWARN("io_uring is not supported for device={} ret={}, falling back to default drive interface", m_devname,
+                ret);
+        m_ring.reset();
+        return false;
+    }
+
+    ret = io_uring_register_files(m_ring.get(), &m_fd, 1);
+    if (ret < 0) {
+        LOGWARN("io_uring fixed file registration failed for device={} ret={}, falling back to default drive interface",
+                m_devname, ret);
+        io_uring_queue_exit(m_ring.get());
+        m_ring.reset();
+        return false;
+    }
+
+    if (m_params.max_registered_bufs > 0) {
+        ret = io_uring_register_buffers_sparse(m_ring.get(), m_params.max_registered_bufs);
+        if (ret < 0) {
+            LOGWARN("io_uring sparse buffer registration failed for device={} ret={}, fixed buffers are disabled",
+                    m_devname, ret);
+        } else {
+            m_free_buf_slots.reserve(m_params.max_registered_bufs);
+            for (uint32_t i{m_params.max_registered_bufs}; i > 0; --i) {
+                m_free_buf_slots.push_back(i - 1);
+            }
+        }
+    }
+
+#ifdef HAVE_URING_WRITE_STREAM
+    if (m_params.write_streams) { m_max_write_streams = discover_write_streams(m_devname); }
+#endif
+
+    m_reaper_thread = std::thread([this]() { reap_completions(); });
+    LOGINFO("io_uring backend enabled for device={} queue_depth={} sqpoll={} registered_buf_slots={} write_streams={}",
+            m_devname, m_params.queue_depth, m_params.sqpoll, m_free_buf_slots.size(), m_max_write_streams);
+    return true;
+}
+
+UringDevBackend::~UringDevBackend() {
+    if (m_ring) {
+        m_stopping.store(true);
+        {
+            // Wake up the reaper with a nop, which carries no request. It has to make it to the ring, else the reaper
+            // could be waiting for a completion forever.
+            std::unique_lock lg{m_sq_mtx};
+            io_uring_sqe* sqe;
+            while ((sqe = io_uring_get_sqe(m_ring.get())) == nullptr) {
+                // Submission queue is full, flush whatever is queued so far and retry
+                io_uring_submit(m_ring.get());
+                m_unsubmitted = 0;
+            }
+            io_uring_prep_nop(sqe);
+            io_uring_sqe_set_data(sqe, nullptr);
+            io_uring_submit(m_ring.get());
+        }
+        if (m_reaper_thread.joinable()) { m_reaper_thread.join(); }
+        io_uring_queue_exit(m_ring.get());
+    }
+    if (m_fd >= 0) { ::close(m_fd); }
+}
+
+folly::Future< std::error_code > UringDevBackend::async_write(const char* data, uint32_t size, uint64_t offset,
+                                                              bool part_of_batch, uint8_t write_stream) {
+    return submit(IORING_OP_WRITE, data, nullptr, 0, size, offset, part_of_batch, write_stream);
+}
+
+folly::Future< std::error_code > UringDevBackend::async_writev(const iovec* iov, int iovcnt, uint32_t size,
+                                                               uint64_t offset, bool part_of_batch,
+                                                               uint8_t write_stream) {
+    if (iovcnt == 1) {
+        return submit(IORING_OP_WRITE, iov[0].iov_base, nullptr, 0, size, offset, part_of_batch, write_stream);
+    }
+    return submit(IORING_OP_WRITEV, nullptr, iov, iovcnt, size, offset, part_of_batch, write_stream);
+}
+
+folly::Future< std::error_code > UringDevBackend::async_read(char* data, uint32_t size, uint64_t offset,
+                                                             bool part_of_batch) {
+    return submit(IORING_OP_READ, data, nullptr, 0, size, offset, part_of_batch);
+}
+
+folly::Future< std::error_code > UringDevBackend::async_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
+                                                              bool part_of_batch) {
+    if (iovcnt == 1) { return submit(IORING_OP_READ, iov[0].iov_base, nullptr, 0, size, offset, part_of_batch); }
+    return submit(IORING_OP_READV, nullptr, iov, iovcnt, size, offset, part_of_batch);
+}
+
+folly::Future< std::error_code > UringDevBackend::queue_fsync() {
+    return submit(IORING_OP_FSYNC, nullptr, nullptr, 0, 0, 0, false /* part_of_batch */);
+}
+
+void UringDevBackend::submit_batch() {
+    std::unique_lock lg{m_sq_mtx};
+    if (m_unsubmitted) {
+        io_uring_submit(m_ring.get());
+        m_unsubmitted = 0;
+    }
+}
+
+folly::Future< std::error_code > UringDevBackend::submit(uint8_t opcode, const void* buf, const iovec* iov,
+                                                         int iovcnt, uint32_t size, uint64_t offset, bool part_of_batch,
+                                                         uint8_t write_stream) {
+    auto req = new uring_req();
+    req->size = size;
+    if (iomanager.am_i_io_reactor()) { req->fiber = iomanager.iofiber_self(); }
+    auto f = req->promise.getFuture();
+
+    int const buf_idx = ((opcode == IORING_OP_WRITE) || (opcode == IORING_OP_READ)) ? find_fixed_buf(buf, size) : -1;
+
+    {
+        std::unique_lock lg{m_sq_mtx};
+        io_uring_sqe* sqe;
+        while ((sqe = io_uring_get_sqe(m_ring.get())) == nullptr) {
+            // Submission queue is full, flush whatever is queued so far and retry
+            io_uring_submit(m_ring.get());
+            m_unsubmitted = 0;
+        }
+
+        switch (opcode) {
+        case IORING_OP_WRITE:
+            if (buf_idx >= 0) {
+                io_uring_prep_write_fixed(sqe, 0 /* fixed file index */, buf, size, offset, buf_idx);
+            } else {
+                io_uring_prep_write(sqe, 0 /* fixed file index */, buf, size, offset);
+            }
+            break;
+        case IORING_OP_READ:
+            if (buf_idx >= 0) {
+                io_uring_prep_read_fixed(sqe, 0 /* fixed file index */, const_cast< void* >(buf), size, offset,
+                                         buf_idx);
+            } else {
+                io_uring_prep_read(sqe, 0 /* fixed file index */, const_cast< void* >(buf), size, offset);
+            }
+            break;
+        case IORING_OP_WRITEV:
+            io_uring_prep_writev(sqe, 0 /* fixed file index */, iov, iovcnt, offset);
+            break;
+        case IORING_OP_READV:
+            io_uring_prep_readv(sqe, 0 /* fixed file index */, iov, iovcnt, offset);
+            break;
+        case IORING_OP_FSYNC:
+            io_uring_prep_fsync(sqe, 0 /* fixed file index */, 0);
+            break;
+        default:
+            HS_REL_ASSERT(false, "Unsupported io_uring opcode={}", opcode);
+        }
+        sqe->flags |= IOSQE_FIXED_FILE;
+#ifdef HAVE_URING_WRITE_STREAM
+        if ((write_stream != 0) && (write_stream <= m_max_write_streams)) { sqe->write_stream = write_stream; }
+#endif
+        io_uring_sqe_set_data(sqe, req);
+        m_outstanding.fetch_add(1, std::memory_order_relaxed);
+        if (buf_idx >= 0) { m_fixed_buf_ios.fetch_add(1, std::memory_order_relaxed); }
+
+        if (part_of_batch) {
+            ++m_unsubmitted;
+        } else {
+            io_uring_submit(m_ring.get());
+            m_unsubmitted = 0;
+        }
+    }
+    return f;
+}
+
+void UringDevBackend::reap_completions() {
+    bool woken_to_stop{false};
+    while (!woken_to_stop || (m_outstanding.load() != 0)) {
+        io_uring_cqe* cqe{nullptr};
+        auto ret = io_uring_wait_cqe(m_ring.get(), &cqe);
+        if (ret == -EINTR) { continue; }
+        if (ret < 0) {
+            LOGERROR("io_uring wait for completion failed on device={} ret={}", m_devname, ret);
+            if (m_stopping.load()) { break; }
+            continue;
+        }
+
+        auto req = r_cast< uring_req* >(io_uring_cqe_get_data(cqe));
+        auto const res = cqe->res;
+        io_uring_cqe_seen(m_ring.get(), cqe);
+
+        if (req == nullptr) {
+            // Nop to wakeup the reaper. Ios queued ahead of it could still be completing, they are reaped before exit
+            if (m_stopping.load()) { woken_to_stop = true; }
+            continue;
+        }
+        m_outstanding.fetch_sub(1, std::memory_order_relaxed);
+
+        std::error_code ec;
+        if (res < 0) {
+            ec = std::error_code(-res, std::system_category());
+        } else if (uint32_cast(res) != req->size) {
+            HS_LOG(ERROR, device, "Short io on device={} expected={} actual={}", m_devname, req->size, res);
+            ec = std::make_error_code(std::errc::io_error);
+        }
+
+        if (req->fiber != nullptr) {
+            // Complete the future on the fiber which issued the io, so that any continuation runs on the reactor
+            iomanager.run_on_forget(req->fiber, [req, ec]() {
+                req->promise.setValue(ec);
+                delete req;
+            });
+        } else {
+            req->promise.setValue(ec);
+            delete req;
+        }
+    }
+}
+
+int UringDevBackend::find_fixed_buf(const void* buf, uint32_t size) const {
+    std::unique_lock lg{m_buf_mtx};
+    if (m_reg_bufs.empty()) { return -1; }
+
+    auto const addr = r_cast< uintptr_t >(buf);
+    auto it = m_reg_bufs.upper_bound(addr);
+    if (it == m_reg_bufs.begin()) { return -1; }
+    --it;
+    return ((addr + size) <= (it->first + it->second.size)) ? s_cast< int >(it->second.index) : -1;
+}
+
+bool UringDevBackend::register_buffer(uint8_t* buf, uint64_t size) {
+    std::unique_lock lg{m_buf_mtx};
+    if (m_free_buf_slots.empty()) { return false; }
+
+    auto const slot = m_free_buf_slots.back();
+    iovec iov{buf, size};
+    __u64 tag{0};
+    auto const ret = io_uring_register_buffers_update_tag(m_ring.get(), slot, &iov, &tag, 1);
+    if (ret < 0) {
+        HS_LOG(WARN, device, "io_uring buffer registration on device={} failed ret={}", m_devname, ret);
+        return false;
+    }
+    m_free_buf_slots.pop_back();
+    m_reg_bufs.insert(std::pair{r_cast< uintptr_t >(buf), registered_buf{size, slot}});
+    return true;
+}
+
+void UringDevBackend::unregister_buffer(uint8_t* buf) {
+    std::unique_lock lg{m_buf_mtx};
+    auto it = m_reg_bufs.find(r_cast< uintptr_t >(buf));
+    if (it == m_reg_bufs.end()) { return; }
+
+    iovec iov{nullptr, 0};
+    __u64 tag{0};
+    io_uring_register_buffers_update_tag(m_ring.get(), it->second.index, &iov, &tag, 1);
+    m_free_buf_slots.push_back(it->second.index);
+    m_reg_bufs.erase(it);
+}
+
+#else
+struct UringDevBackend::uring_req {};
+
+std::unique_ptr< UringDevBackend > UringDevBackend::create(const std::string& devname, int, const params&) {
+    LOGWARN("Homestore is built without liburing, io_uring can't be enabled for device={}", devname);
+    return nullptr;
+}
+
+UringDevBackend::UringDevBackend(const std::string& devname, int fd, const params& p) :
+        m_devname{devname}, m_fd{fd}, m_params{p} {}
+UringDevBackend::~UringDevBackend() = default;
+bool UringDevBackend::init() { return false; }
+
+folly::Future< std::error_code > UringDevBackend::async_write(const char*, uint32_t, uint64_t, bool, uint8_t) {
+    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::operation_not_supported));
+}
+folly::Future< std::error_code > UringDevBackend::async_writev(const iovec*, int, uint32_t, uint64_t, bool,
+                                                               uint8_t) {
+    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::operation_not_supported));
+}
+folly::Future< std::error_code > UringDevBackend::async_read(char*, uint32_t, uint64_t, bool) {
+    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::operation_not_supported));
+}
+folly::Future< std::error_code > UringDevBackend::async_readv(iovec*, int, uint32_t, uint64_t, bool) {
+    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::operation_not_supported));
+}
+folly::Future< std::error_code > UringDevBackend::queue_fsync() {
+    return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::operation_not_supported));
+}
+void UringDevBackend::submit_batch() {}
+bool UringDevBackend::register_buffer(uint8_t*, uint64_t) { return false; }
+void UringDevBackend::unregister_buffer(uint8_t*) {}
+#endif
+
+} // namespace homestore
@@ -0,0 +1,120 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#include <sys/uio.h>
+#include <folly/futures/Future.h>
+#include <homestore/homestore_decl.hpp>
+
+struct io_uring;
+
+namespace homestore {
+
+/*
+ * UringDevBackend: An optional io_uring based submission path for a single PhysicalDev. It bypasses the generic
+ * iomgr drive interface for async reads and writes, registers the device fd as a fixed file and supports registering
+ * long lived buffers so that reads/writes of those buffers skip the per-io page pinning. Completions are reaped by a
+ * dedicated thread and handed back to the fiber which submitted the io (if it was submitted from an io reactor).
+ *
+ * If the kernel or the build does not support io_uring, create() returns nullptr and the caller is expected to fall
+ * back to the iomgr drive interface.
+ */
+class UringDevBackend {
+public:
+    struct params {
+        uint32_t queue_depth{512};
+        bool sqpoll{false};
+        uint32_t sqpoll_idle_ms{1000};
+        uint32_t max_registered_bufs{1024};
+        bool write_streams{false};
+    };
+
+    static std::unique_ptr< UringDevBackend > create(const std::string& devname, int oflags, const params& p);
+
+    UringDevBackend(const UringDevBackend&) = delete;
+    UringDevBackend(UringDevBackend&&) noexcept = delete;
+    UringDevBackend& operator=(const UringDevBackend&) = delete;
+    UringDevBackend& operator=(UringDevBackend&&) noexcept = delete;
+    ~UringDevBackend();
+
+    folly::Future< std::error_code > async_write(const char* data, uint32_t size, uint64_t offset, bool part_of_batch,
+                                                 uint8_t write_stream = 0);
+    folly::Future< std::error_code > async_writev(const iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
+                                                  bool part_of_batch, uint8_t write_stream = 0);
+    folly::Future< std::error_code > async_read(char* data, uint32_t size, uint64_t offset, bool part_of_batch);
+    folly::Future< std::error_code > async_readv(iovec* iov, int iovcnt, uint32_t size, uint64_t offset,
+                                                 bool part_of_batch);
+    folly::Future< std::error_code > queue_fsync();
+
+    /// @brief Submit all the ios which were queued with part_of_batch = true
+    void submit_batch();
+
+    /// @brief Register a long lived buffer with the ring, so that any single buffer read/write which falls entirely
+    /// within this region is issued as a fixed buffer io.
+    /// @return true if registered, false if registration table is full or kernel rejected it
+    bool register_buffer(uint8_t* buf, uint64_t size);
+    void unregister_buffer(uint8_t* buf);
+
+    /// @brief Number of write streams the device supports and which could be tagged on writes. 0 if not supported
+    uint8_t max_write_streams() const { return m_max_write_streams; }
+
+    uint64_t outstanding_ios() const { return m_outstanding.load(std::memory_order_relaxed); }
+    uint64_t fixed_buf_ios() const { return m_fixed_buf_ios.load(std::memory_order_relaxed); }
+
+private:
+    struct uring_req;
+    struct registered_buf {
+        uint64_t size;
+        uint32_t index;
+    };
+
+    UringDevBackend(const std::string& devname, int fd, const params& p);
+    bool init();
+
+    folly::Future< std::error_code > submit(uint8_t opcode, const void* buf, const iovec* iov, int iovcnt,
+                                            uint32_t size, uint64_t offset, bool part_of_batch,
+                                            uint8_t write_stream = 0);
+    int find_fixed_buf(const void* buf, uint32_t size) const;
+    void reap_completions();
+
+private:
+    std::string m_devname;
+    int m_fd{-1};
+    params m_params;
+    std::unique_ptr< io_uring > m_ring;
+    uint8_t m_max_write_streams{0};
+
+    std::mutex m_sq_mtx;       // io_uring submission queue is single producer, serialize all submitters
+    uint32_t m_unsubmitted{0}; // Number of sqes queued as part of batch, but not submitted yet
+
+    mutable std::mutex m_buf_mtx;
+    std::map< uintptr_t, registered_buf > m_reg_bufs; // Registered buffers keyed on start address
+    std::vector< uint32_t > m_free_buf_slots;         // Free slots in sparse registered buffer table
+
+    std::atomic< uint64_t > m_outstanding{0};
+    std::atomic< uint64_t > m_fixed_buf_ios{0};
+    std::atomic< bool > m_stopping{false};
+    std::thread m_reaper_thread;
+};
+} // namespace homestore
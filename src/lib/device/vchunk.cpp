@@ -29,6 +29,8 @@ blk_num_t VChunk::available_blks() const { return m_internal_chunk->blk_allocato
 
 blk_num_t VChunk::get_defrag_nblks() const { return m_internal_chunk->blk_allocator()->get_defrag_nblks(); }
 
+chunk_usage VChunk::get_usage() const { return m_internal_chunk->usage(); }
+
 uint32_t VChunk::get_pdev_id() const { return m_internal_chunk->physical_dev()->pdev_id(); }
 
 uint16_t VChunk::get_chunk_id() const { return m_internal_chunk->chunk_id(); }
@@ -0,0 +1,239 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "common/homestore_config.hpp"
+#include "device/virtual_dev.hpp"
+#include "device/vdev_fair_queue.hpp"
+
+namespace homestore {
+static std::atomic< uint64_t > s_next_queue_id{0};
+
+VDevFairQueue::VDevFairQueue(VirtualDevMetrics& metrics) :
+        m_metrics{metrics}, m_id{s_next_queue_id.fetch_add(1, std::memory_order_relaxed)} {}
+
+VDevFairQueue::~VDevFairQueue() {
+    std::vector< queued_io > pending;
+    {
+        std::unique_lock lg{m_mtx};
+        m_stopping = true;
+        for (auto& [_, ts] : m_tenants) {
+            std::move(ts.queue.begin(), ts.queue.end(), std::back_inserter(pending));
+            ts.queue.clear();
+        }
+        m_nqueued = 0;
+    }
+
+    // Device is going away, nothing more could be issued on it
+    for (auto& q : pending) {
+        q.promise.setValue(std::make_error_code(std::errc::operation_canceled));
+    }
+}
+
+uint32_t VDevFairQueue::effective_weight(tenant_state const& ts) {
+    return (ts.weight != 0) ? ts.weight : std::max(HS_DYNAMIC_CONFIG(device->fair_share_default_weight), 1u);
+}
+
+void VDevFairQueue::account(tenant_counters& tc, bool is_write, uint32_t size) {
+    if (is_write) {
+        tc.write_ios.fetch_add(1, std::memory_order_relaxed);
+        tc.write_bytes.fetch_add(size, std::memory_order_relaxed);
+    } else {
+        tc.read_ios.fetch_add(1, std::memory_order_relaxed);
+        tc.read_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+}
+
+bool VDevFairQueue::try_account_unqueued(bool is_write, uint32_t size) {
+    // Tags are of no use while nothing is queued, if queueing is enabled meanwhile the tenants simply start off at the
+    // current virtual time
+    if ((HS_DYNAMIC_CONFIG(device->fair_share_max_inflight_ios) != 0) || (m_nqueued.load() != 0)) { return false; }
+    account(caller_counters(), is_write, size);
+    return true;
+}
+
+VDevFairQueue::tenant_counters& VDevFairQueue::caller_counters() {
+    struct cached_counters {
+        uint64_t queue_id;
+        io_tenant_t tenant;
+        uint64_t gen;
+        std::shared_ptr< tenant_counters > counters; // Ios accounted after the tenant is removed are simply lost
+    };
+    static constexpr size_t max_cached{16};
+    static thread_local std::vector< cached_counters > t_cached;
+
+    auto const tenant = thread_io_tenant();
+    auto const gen = m_tenants_gen.load(std::memory_order_acquire);
+    auto it = std::find_if(t_cached.begin(), t_cached.end(), [this, tenant](cached_counters const& c) {
+        return (c.queue_id == m_id) && (c.tenant == tenant);
+    });
+    if ((it != t_cached.end()) && (it->gen == gen)) { return *it->counters; }
+
+    std::shared_ptr< tenant_counters > counters;
+    {
+        std::unique_lock lg{m_mtx};
+        counters = m_tenants[tenant].counters;
+    }
+    if (it != t_cached.end()) {
+        it->gen = gen;
+        it->counters = std::move(counters);
+        return *it->counters;
+    }
+
+    // Could be holding on to the counters of queues gone by now, start over once there are too many of them
+    if (t_cached.size() >= max_cached) { t_cached.clear(); }
+    return *t_cached.emplace_back(cached_counters{m_id, tenant, gen, std::move(counters)}).counters;
+}
+
+VDevFairQueue::admission_t VDevFairQueue::admit(bool is_write, uint32_t size) {
+    auto& ts = m_tenants[thread_io_tenant()];
+    account(*ts.counters, is_write, size);
+
+    // Tags are in units of 1/1024th of a byte per unit of weight, so that small ios of heavy tenants still advance
+    auto const start_tag = std::max(m_vtime, ts.finish_tag);
+    ts.finish_tag = start_tag + std::max((uint64_cast(size) << 10) / effective_weight(ts), uint64_t{1});
+
+    // Ios issued while queueing is disabled are not counted in flight, if it is enabled meanwhile they are simply
+    // not accounted for in the limit.
+    auto const max_inflight = HS_DYNAMIC_CONFIG(device->fair_share_max_inflight_ios);
+    if ((max_inflight == 0) && (m_nqueued == 0)) {
+        m_vtime = start_tag;
+        return admission_t::issue;
+    }
+
+    // Nothing is ever left queued with no io in flight to issue it on completion, so an io could go right away only if
+    // none is waiting ahead of it
+    if ((m_nqueued == 0) && (m_inflight < max_inflight)) {
+        m_vtime = start_tag;
+        ++m_inflight;
+        return admission_t::issue_tracked;
+    }
+
+    m_admitted = &ts;
+    m_admitted_start_tag = start_tag;
+    return admission_t::queue;
+}
+
+folly::Future< std::error_code > VDevFairQueue::enqueue(uint32_t size, submit_fn_t&& submit) {
+    auto& q = m_admitted->queue.emplace_back(queued_io{size, m_admitted_start_tag, std::move(submit),
+                                                       folly::Promise< std::error_code >{}, thread_io_priority(),
+                                                       Clock::now()});
+    auto f = q.promise.getFuture();
+    ++m_admitted->queued_ios;
+    ++m_nqueued;
+    m_admitted = nullptr;
+    COUNTER_INCREMENT(m_metrics, vdev_fair_queued_ios, 1);
+    return f;
+}
+
+void VDevFairQueue::account_sync(bool is_write, uint32_t size) { account(caller_counters(), is_write, size); }
+
+void VDevFairQueue::set_weight(io_tenant_t tenant, uint32_t weight) {
+    std::unique_lock lg{m_mtx};
+    m_tenants[tenant].weight = weight;
+}
+
+void VDevFairQueue::remove_tenant(io_tenant_t tenant) {
+    std::unique_lock lg{m_mtx};
+    if (auto it = m_tenants.find(tenant); (it != m_tenants.end()) && it->second.queue.empty()) {
+        m_tenants.erase(it);
+        m_tenants_gen.fetch_add(1, std::memory_order_release);
+    }
+}
+
+folly::Future< std::error_code > VDevFairQueue::track(folly::Future< std::error_code >&& f) {
+    return std::move(f).thenValue([this](std::error_code ec) {
+        on_io_completion();
+        return ec;
+    });
+}
+
+void VDevFairQueue::on_io_completion() {
+    std::vector< ready_io > ready;
+    {
+        std::unique_lock lg{m_mtx};
+        --m_inflight;
+        if (m_stopping) { return; }
+
+        // Limit could have been lifted since they were queued, in which case all of them can go
+        auto const max_inflight = HS_DYNAMIC_CONFIG(device->fair_share_max_inflight_ios);
+        while ((m_nqueued != 0) && ((max_inflight == 0) || (m_inflight < max_inflight))) {
+            io_tenant_t next_tenant{untagged_io_tenant};
+            tenant_state* next{nullptr};
+            for (auto& [tenant, ts] : m_tenants) {
+                if (!ts.queue.empty() &&
+                    ((next == nullptr) || (ts.queue.front().start_tag < next->queue.front().start_tag))) {
+                    next_tenant = tenant;
+                    next = &ts;
+                }
+            }
+
+            auto& q = next->queue.front();
+            auto const wait_us = get_elapsed_time_us(q.queued_time);
+            next->queue_wait_us += wait_us;
+            next->max_queue_wait_us = std::max(next->max_queue_wait_us, wait_us);
+            HISTOGRAM_OBSERVE(m_metrics, vdev_fair_queue_wait_us, wait_us);
+            m_vtime = std::max(m_vtime, q.start_tag);
+
+            ready.push_back(ready_io{next_tenant, std::move(q)});
+            next->queue.pop_front();
+            --m_nqueued;
+            ++m_inflight;
+        }
+    }
+    dispatch(ready);
+}
+
+void VDevFairQueue::dispatch(std::vector< ready_io >& ready) {
+    for (auto& r : ready) {
+        io_priority_guard pg{r.io.prio};
+        io_tenant_guard tg{r.tenant};
+        r.io.submit(false /* part_of_batch */)
+            .thenValue([this, p = std::move(r.io.promise), prio = r.io.prio,
+                        tenant = r.tenant](std::error_code ec) mutable {
+                on_io_completion();
+
+                // Completion runs the caller's continuation inline, keep any io it chains with the same tags
+                io_priority_guard pg{prio};
+                io_tenant_guard tg{tenant};
+                p.setValue(ec);
+            });
+    }
+}
+
+nlohmann::json VDevFairQueue::usage() const {
+    std::unique_lock lg{m_mtx};
+    nlohmann::json tenants_j = nlohmann::json::object();
+    for (auto const& [tenant, ts] : m_tenants) {
+        tenants_j[std::to_string(tenant)] = nlohmann::json{
+            {"weight", effective_weight(ts)},
+            {"read_ios", ts.counters->read_ios.load(std::memory_order_relaxed)},
+            {"read_bytes", ts.counters->read_bytes.load(std::memory_order_relaxed)},
+            {"write_ios", ts.counters->write_ios.load(std::memory_order_relaxed)},
+            {"write_bytes", ts.counters->write_bytes.load(std::memory_order_relaxed)},
+            {"queued_ios", ts.queued_ios},
+            {"queue_depth", ts.queue.size()},
+            {"avg_queue_wait_us", (ts.queued_ios == 0) ? uint64_t{0} : (ts.queue_wait_us / ts.queued_ios)},
+            {"max_queue_wait_us", ts.max_queue_wait_us}};
+    }
+    return nlohmann::json{
+        {"inflight_ios", m_inflight}, {"queued_ios", m_nqueued.load()}, {"tenants", std::move(tenants_j)}};
+}
+} // namespace homestore
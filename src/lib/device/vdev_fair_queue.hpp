@@ -0,0 +1,173 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <unordered_map>
+#include <vector>
+
+#include <folly/futures/Future.h>
+#include <nlohmann/json.hpp>
+#include <homestore/homestore_decl.hpp>
+
+namespace homestore {
+class VirtualDevMetrics;
+
+/*
+ * VDevFairQueue: Per virtual device accounting of the ios of each tenant (see io_tenant_guard) and weighted fair share
+ * of the device between them. Once fair_share_max_inflight_ios are in flight on the vdev, further ios are queued per
+ * tenant and issued, as the earlier ones complete, in the order of their start tags (start-time fair queueing): an io
+ * starts at the later of the virtual time (start tag of the io issued last) and the finish tag of the previous io of
+ * its tenant, and finishes size / weight after its start. So under contention, each backlogged tenant gets the bytes
+ * in proportion to its weight, while a tenant which was idle doesn't bank any credit to burst with later.
+ *
+ * Queued ios are always issued on their own (not part of batch) and they and their completions run with the priority
+ * and tenant of their submitter, so follow up ios chained on completion are accounted to the same tenant. Ios issued
+ * right away are not wrapped in any way, other than to count them in flight while the queueing is enabled. While the
+ * queueing is disabled (and nothing is left queued), ios are only accounted, to the counters of the tenant cached by
+ * each thread, without taking the lock.
+ */
+class VDevFairQueue {
+public:
+    using submit_fn_t = std::function< folly::Future< std::error_code >(bool /* part_of_batch */) >;
+
+    explicit VDevFairQueue(VirtualDevMetrics& metrics);
+    VDevFairQueue(const VDevFairQueue&) = delete;
+    VDevFairQueue(VDevFairQueue&&) noexcept = delete;
+    VDevFairQueue& operator=(const VDevFairQueue&) = delete;
+    VDevFairQueue& operator=(VDevFairQueue&&) noexcept = delete;
+    ~VDevFairQueue();
+
+    /**
+     * @brief Account the io to the tenant of the caller and issue it, now through issue_now or once it is its turn
+     * through the submit_fn_t returned by defer. defer is called only if the io is queued, so that anything the
+     * io refers to which need not outlive this call (like the iov array) is copied only then. part_of_batch is
+     * honored only if issued right away, queued ios are always issued on their own.
+     */
+    template < typename IssueFn, typename DeferFn >
+    folly::Future< std::error_code > schedule(bool is_write, uint32_t size, bool part_of_batch, IssueFn&& issue_now,
+                                              DeferFn&& defer) {
+        if (try_account_unqueued(is_write, size)) { return issue_now(part_of_batch); }
+
+        std::unique_lock lg{m_mtx};
+        switch (admit(is_write, size)) {
+        case admission_t::issue:
+            lg.unlock();
+            return issue_now(part_of_batch);
+        case admission_t::issue_tracked:
+            lg.unlock();
+            return track(issue_now(part_of_batch));
+        default:
+            return enqueue(size, defer());
+        }
+    }
+
+    /**
+     * @brief Same as above, for an io which refers to nothing that need not outlive this call
+     */
+    template < typename SubmitFn >
+    folly::Future< std::error_code > schedule(bool is_write, uint32_t size, bool part_of_batch, SubmitFn&& submit) {
+        return schedule(is_write, size, part_of_batch, submit, [&submit]() { return submit_fn_t{std::move(submit)}; });
+    }
+
+    /**
+     * @brief Account the sync io to the tenant of the caller. Sync ios are not queued, since they block the caller.
+     */
+    void account_sync(bool is_write, uint32_t size);
+
+    /**
+     * @brief Set the share of the tenant relative to the others, 0 resets it to fair_share_default_weight
+     */
+    void set_weight(io_tenant_t tenant, uint32_t weight);
+
+    /**
+     * @brief Drop the accounting and the weight of the tenant. Kept if it still has ios queued.
+     */
+    void remove_tenant(io_tenant_t tenant);
+
+    /**
+     * @brief Ios and bytes so far, ios queued and their wait, of each tenant
+     */
+    nlohmann::json usage() const;
+
+private:
+    enum class admission_t : uint8_t {
+        issue,         // Queueing is disabled, issue it as is
+        issue_tracked, // Issue it right away, tracking its completion to issue any ios queued meanwhile
+        queue          // Queue it behind the ios of other tenants with earlier start tags
+    };
+
+    struct queued_io {
+        uint32_t size;
+        uint64_t start_tag;
+        submit_fn_t submit;
+        folly::Promise< std::error_code > promise;
+        io_priority_t prio;
+        Clock::time_point queued_time;
+    };
+
+    // Updated without the lock, through the pointer cached by each thread (see caller_counters)
+    struct tenant_counters {
+        std::atomic< uint64_t > read_ios{0};
+        std::atomic< uint64_t > read_bytes{0};
+        std::atomic< uint64_t > write_ios{0};
+        std::atomic< uint64_t > write_bytes{0};
+    };
+
+    struct tenant_state {
+        uint32_t weight{0}; // 0 is fair_share_default_weight
+        uint64_t finish_tag{0};
+        std::deque< queued_io > queue;
+        std::shared_ptr< tenant_counters > counters{std::make_shared< tenant_counters >()};
+        uint64_t queued_ios{0};
+        uint64_t queue_wait_us{0};
+        uint64_t max_queue_wait_us{0};
+    };
+
+    struct ready_io {
+        io_tenant_t tenant;
+        queued_io io;
+    };
+
+    static uint32_t effective_weight(tenant_state const& ts);
+    static void account(tenant_counters& tc, bool is_write, uint32_t size);
+    bool try_account_unqueued(bool is_write, uint32_t size);
+    tenant_counters& caller_counters();
+    admission_t admit(bool is_write, uint32_t size); // Expects m_mtx to be held
+    folly::Future< std::error_code > enqueue(uint32_t size, submit_fn_t&& submit); // Expects m_mtx to be held
+    folly::Future< std::error_code > track(folly::Future< std::error_code >&& f);
+    void on_io_completion();
+    void dispatch(std::vector< ready_io >& ready);
+
+private:
+    VirtualDevMetrics& m_metrics;
+    uint64_t const m_id;                      // Unique across the queues of the process, to key the caches of threads
+    std::atomic< uint64_t > m_tenants_gen{0}; // Bumped on removal of tenants, to invalidate the caches of threads
+    mutable std::mutex m_mtx;
+    std::unordered_map< io_tenant_t, tenant_state > m_tenants;
+    tenant_state* m_admitted{nullptr}; // Tenant of the io last admitted, and the start tag assigned to it
+    uint64_t m_admitted_start_tag{0};
+    uint64_t m_vtime{0};
+    uint32_t m_inflight{0};
+    std::atomic< uint64_t > m_nqueued{0}; // Across all the tenants, updated only with m_mtx held
+    bool m_stopping{false};
+};
+} // namespace homestore
@@ -0,0 +1,263 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <limits.h>
+#include <set>
+
+#include <sisl/fds/buffer.hpp>
+
+#include <homestore/homestore.hpp>
+#include "device/chunk.h"
+#include "device/physical_dev.hpp"
+#include "device/virtual_dev.hpp"
+#include "device/vdev_io_batch.hpp"
+#include "common/homestore_assert.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/crash_simulator.hpp"
+
+SISL_LOGGING_DECL(device)
+
+namespace homestore {
+
+VDevIOBatch::VDevIOBatch(VirtualDev& vdev) : m_vdev{vdev} {}
+
+VDevIOBatch::~VDevIOBatch() {
+    if (!m_entries.empty()) { submit(); }
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_write(const char* buf, uint32_t size, BlkId const& bid) {
+    iovec iov{const_cast< char* >(buf), size};
+    return add(true /* is_write */, &iov, 1, size, bid);
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_writev(const iovec* iov, int iovcnt, BlkId const& bid) {
+    return add(true /* is_write */, iov, iovcnt, VirtualDev::get_len(iov, iovcnt), bid);
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_read(char* buf, uint32_t size, BlkId const& bid) {
+    iovec iov{buf, size};
+    return add(false /* is_write */, &iov, 1, size, bid);
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_readv(iovec* iov, int iovcnt, uint64_t size, BlkId const& bid) {
+    return add(false /* is_write */, iov, iovcnt, size, bid);
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_write(const char* buf, uint32_t size, MultiBlkId const& bid) {
+    if (bid.num_pieces() == 1) { return add_write(buf, size, bid.to_single_blkid()); }
+
+    uint32_t const blk_size = m_vdev.block_size();
+    std::vector< folly::Future< std::error_code > > futs;
+    futs.reserve(bid.num_pieces());
+
+    for (auto const b : bid.pieces()) {
+        uint32_t const sz = b.blk_count() * blk_size;
+        futs.emplace_back(add_write(buf, sz, b));
+        buf += sz;
+    }
+    return collect(futs);
+}
+
+folly::Future< std::error_code > VDevIOBatch::add_writev(const iovec* iov, int iovcnt, MultiBlkId const& bid) {
+    if (bid.num_pieces() == 1) { return add_writev(iov, iovcnt, bid.to_single_blkid()); }
+
+    uint32_t const blk_size = m_vdev.block_size();
+    std::vector< folly::Future< std::error_code > > futs;
+    futs.reserve(bid.num_pieces());
+
+    sisl::sg_iovs_t all_iovs(iov, iov + iovcnt);
+    sisl::sg_iterator sg_it{all_iovs};
+    for (auto const b : bid.pieces()) {
+        auto const iovs = sg_it.next_iovs(b.blk_count() * blk_size);
+        futs.emplace_back(add_writev(iovs.data(), s_cast< int >(iovs.size()), b));
+    }
+    return collect(futs);
+}
+
+folly::Future< std::error_code > VDevIOBatch::collect(std::vector< folly::Future< std::error_code > >& futs) {
+    return folly::collectAllUnsafe(futs).thenValue([](auto&& vf) {
+        for (auto const& err_c : vf) {
+            if (sisl_unlikely(err_c.value())) { return err_c.value(); }
+        }
+        return std::error_code{};
+    });
+}
+
+folly::Future< std::error_code > VDevIOBatch::add(bool is_write, const iovec* iov, int iovcnt, uint64_t size,
+                                                  BlkId const& bid) {
+    HS_DBG_ASSERT_EQ(bid.is_multi(), false, "io batch needs individual pieces of blkid - not MultiBlkid");
+
+#ifdef _PRERELEASE
+    if (is_write && hs()->crash_simulator().is_crashed()) {
+        return folly::makeFuture< std::error_code >(std::error_code());
+    }
+#endif
+
+    Chunk* chunk;
+    uint64_t const dev_offset = m_vdev.to_dev_offset(bid, &chunk);
+    if (sisl_unlikely(dev_offset == INVALID_DEV_OFFSET)) {
+        return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+    if (is_write) {
+        auto zf = chunk->prepare_async_write(dev_offset, size);
+        if (sisl_unlikely(!zf.isReady())) {
+            // Chunk has to be zeroed upto it first, it is issued on its own once the zeroing completes
+            return std::move(zf).thenValue([vdev = &m_vdev, pdev = chunk->physical_dev_mutable(),
+                                            iovs = std::vector< iovec >(iov, iov + iovcnt), size,
+                                            dev_offset](std::error_code err) {
+                if (err) { return folly::makeFuture< std::error_code >(std::move(err)); }
+                COUNTER_INCREMENT(vdev->m_metrics, vdev_write_count, 1);
+                COUNTER_INCREMENT(vdev->m_metrics, vdev_write_bytes, size);
+                return vdev->m_fair_queue.schedule(
+                    true /* is_write */, uint32_cast(size), false /* part_of_batch */,
+                    [vdev, pdev, &iovs, size, dev_offset](bool pob) {
+                        return pdev->async_writev(iovs.data(), s_cast< int >(iovs.size()), size, dev_offset, pob,
+                                                  vdev->write_stream(pdev));
+                    },
+                    [vdev, pdev, &iovs, size, dev_offset]() -> VDevFairQueue::submit_fn_t {
+                        return [vdev, pdev, iovs, size, dev_offset](bool pob) {
+                            return pdev->async_writev(iovs.data(), s_cast< int >(iovs.size()), size, dev_offset, pob,
+                                                      vdev->write_stream(pdev));
+                        };
+                    });
+            });
+        }
+        if (auto err = std::move(zf).value(); sisl_unlikely(err)) {
+            return folly::makeFuture< std::error_code >(std::move(err));
+        }
+    }
+
+    auto& e = m_entries.emplace_back();
+    e.is_write = is_write;
+    e.pdev = chunk->physical_dev_mutable();
+    e.dev_offset = dev_offset;
+    e.size = uint32_cast(size);
+    e.readable_size = is_write ? size : chunk->prepare_read(dev_offset, size);
+    e.iovs.assign(iov, iov + iovcnt);
+    return e.promise.getFuture();
+}
+
+void VDevIOBatch::submit(bool ring_doorbell) {
+    if (m_entries.empty()) { return; }
+
+    std::vector< io_entry* > sorted;
+    sorted.reserve(m_entries.size());
+    for (auto& e : m_entries) {
+        sorted.push_back(&e);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](io_entry const* a, io_entry const* b) {
+        if (a->pdev != b->pdev) { return a->pdev->pdev_id() < b->pdev->pdev_id(); }
+        if (a->is_write != b->is_write) { return a->is_write; }
+        return a->dev_offset < b->dev_offset;
+    });
+
+    uint64_t const max_coalesce_size = uint64_cast(HS_DYNAMIC_CONFIG(device->max_io_batch_coalesce_size_kb)) * 1024;
+    std::set< PhysicalDev* > pdevs;
+    std::vector< io_entry* > run;
+    uint64_t run_size{0};
+    size_t run_iovcnt{0};
+
+    for (auto* e : sorted) {
+        if (!run.empty()) {
+            auto const* last = run.back();
+            bool const adjacent = (last->pdev == e->pdev) && (last->is_write == e->is_write) &&
+                ((last->dev_offset + last->size) == e->dev_offset) && ((run_size + e->size) <= max_coalesce_size) &&
+                ((run_iovcnt + e->iovs.size()) <= IOV_MAX);
+            if (!adjacent) {
+                issue(run);
+                run.clear();
+                run_size = 0;
+                run_iovcnt = 0;
+            }
+        }
+        run.push_back(e);
+        run_size += e->size;
+        run_iovcnt += e->iovs.size();
+        pdevs.insert(e->pdev);
+    }
+    issue(run);
+
+    if (ring_doorbell) { VirtualDev::submit_batch(pdevs); }
+    m_entries.clear();
+}
+
+void VDevIOBatch::issue(std::vector< io_entry* > const& run) {
+    if (run.empty()) { return; }
+
+    auto* pdev = run.front()->pdev;
+    auto const dev_offset = run.front()->dev_offset;
+    bool const is_write = run.front()->is_write;
+
+    if (is_write) {
+        COUNTER_INCREMENT(m_vdev.m_metrics, vdev_write_count, 1);
+        if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
+            COUNTER_INCREMENT(m_vdev.m_metrics, unalign_writes, 1);
+        }
+    } else {
+        COUNTER_INCREMENT(m_vdev.m_metrics, vdev_read_count, 1);
+    }
+
+    // Merge the iovs of all adjacent ios into one vectored io and fan out the result to all of them. The merged io
+    // context has to outlive the io, since iovs could be referenced by the device until completion.
+    struct merged_io {
+        std::vector< iovec > iovs;
+        std::vector< folly::Promise< std::error_code > > promises;
+        uint64_t zero_from{UINT64_MAX}; // Offset within merged io from which it has to be zero filled (lazy format)
+    };
+    auto mio = std::make_shared< merged_io >();
+    uint32_t total_size{0};
+    for (auto* e : run) {
+        if ((e->readable_size < e->size) && (mio->zero_from == UINT64_MAX)) {
+            mio->zero_from = total_size + e->readable_size;
+        }
+        mio->iovs.insert(mio->iovs.end(), e->iovs.begin(), e->iovs.end());
+        mio->promises.push_back(std::move(e->promise));
+        total_size += e->size;
+    }
+    if (is_write) { COUNTER_INCREMENT(m_vdev.m_metrics, vdev_write_bytes, total_size); }
+
+    if (run.size() > 1) {
+        COUNTER_INCREMENT(m_vdev.m_metrics, vdev_coalesced_ios, run.size() - 1);
+        HS_LOG(TRACE, device, "Coalesced {} ios in device: {}, offset = {} total_size={}", run.size(),
+               pdev->pdev_id(), dev_offset, total_size);
+    }
+
+    auto f = m_vdev.m_fair_queue.schedule(
+        is_write, total_size, true /* part_of_batch */,
+        [pdev, mio, total_size, dev_offset, is_write, stream = m_vdev.write_stream(pdev)](bool pob) {
+            return is_write
+                ? pdev->async_writev(mio->iovs.data(), s_cast< int >(mio->iovs.size()), total_size, dev_offset, pob,
+                                     stream)
+                : pdev->async_readv(mio->iovs.data(), s_cast< int >(mio->iovs.size()), total_size, dev_offset, pob);
+        });
+    std::move(f).thenValue([mio](std::error_code ec) {
+        if (!ec && (mio->zero_from != UINT64_MAX)) {
+            uint64_t from = mio->zero_from;
+            for (auto& iov : mio->iovs) {
+                if (from >= iov.iov_len) {
+                    from -= iov.iov_len;
+                    continue;
+                }
+                std::memset(r_cast< uint8_t* >(iov.iov_base) + from, 0, iov.iov_len - from);
+                from = 0;
+            }
+        }
+        for (auto& p : mio->promises) {
+            p.setValue(ec);
+        }
+    });
+}
+} // namespace homestore
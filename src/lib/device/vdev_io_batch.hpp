@@ -0,0 +1,85 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+#include <sys/uio.h>
+#include <folly/futures/Future.h>
+#include <homestore/blk.h>
+
+namespace homestore {
+class VirtualDev;
+class PhysicalDev;
+
+/*
+ * VDevIOBatch: A batch of IOs on a VirtualDev, which is typically created on the stack of a fiber, filled with N
+ * IOs across different chunks and pdevs and then submitted once. On submit, the IOs are sorted per pdev by their
+ * device offset and IOs which are adjacent to each other (of the same type) are coalesced into a single vectored IO.
+ * Each pdev queue is then kicked only once, instead of a doorbell per IO.
+ *
+ * Futures returned by add_* methods are completed only after submit() is called. If the batch is destroyed without
+ * explicit submit, it submits the pending IOs on destruction.
+ */
+class VDevIOBatch {
+public:
+    explicit VDevIOBatch(VirtualDev& vdev);
+    VDevIOBatch(const VDevIOBatch&) = delete;
+    VDevIOBatch(VDevIOBatch&&) noexcept = delete;
+    VDevIOBatch& operator=(const VDevIOBatch&) = delete;
+    VDevIOBatch& operator=(VDevIOBatch&&) noexcept = delete;
+    ~VDevIOBatch();
+
+    folly::Future< std::error_code > add_write(const char* buf, uint32_t size, BlkId const& bid);
+    folly::Future< std::error_code > add_writev(const iovec* iov, int iovcnt, BlkId const& bid);
+    folly::Future< std::error_code > add_read(char* buf, uint32_t size, BlkId const& bid);
+    folly::Future< std::error_code > add_readv(iovec* iov, int iovcnt, uint64_t size, BlkId const& bid);
+
+    /// @brief Add a write of the buffer to all the pieces of the MultiBlkId. The buffer is split across the pieces in
+    /// the order of the pieces. Pieces which are physically contiguous are coalesced on submit.
+    folly::Future< std::error_code > add_write(const char* buf, uint32_t size, MultiBlkId const& bid);
+    folly::Future< std::error_code > add_writev(const iovec* iov, int iovcnt, MultiBlkId const& bid);
+
+    /// @brief Coalesce and submit all the IOs queued so far. The batch can be reused after submit.
+    /// @param ring_doorbell If false, IOs are queued on the pdevs, but the caller is expected to call submit_batch on
+    /// the vdev later.
+    void submit(bool ring_doorbell = true);
+
+    size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+private:
+    struct io_entry {
+        bool is_write;
+        PhysicalDev* pdev;
+        uint64_t dev_offset;
+        uint32_t size;
+        uint64_t readable_size; // For reads on lazily formatted chunk, bytes beyond this are to be zero filled
+        std::vector< iovec > iovs;
+        folly::Promise< std::error_code > promise;
+    };
+
+    folly::Future< std::error_code > add(bool is_write, const iovec* iov, int iovcnt, uint64_t size,
+                                         BlkId const& bid);
+    void issue(std::vector< io_entry* > const& run);
+    static folly::Future< std::error_code > collect(std::vector< folly::Future< std::error_code > >& futs);
+
+private:
+    VirtualDev& m_vdev;
+    std::vector< io_entry > m_entries;
+};
+} // namespace homestore
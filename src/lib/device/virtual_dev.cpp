@@ -13,10 +13,12 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <array>
 #include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <iterator>
 #include <limits>
@@ -29,24 +31,30 @@
 #include <vector>
 
 #include <sisl/fds/buffer.hpp>
+#include <sisl/fds/utils.hpp>
 #include <sisl/metrics/metrics.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/utility/atomic_counter.hpp>
 #include <iomgr/iomgr_flip.hpp>
 #include <homestore/homestore_decl.hpp>
+#include <homestore/probes.hpp>
 
 #include "device/chunk.h"
 #include "device/physical_dev.hpp"
 #include "device/device.h"
 #include "device/virtual_dev.hpp"
+#include "device/vdev_io_batch.hpp"
 #include "common/error.h"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_utils.hpp"
 #include "common/crash_simulator.hpp"
+#include "common/thread_affinity.hpp"
 #include "blkalloc/varsize_blk_allocator.h"
 #include "device/round_robin_chunk_selector.h"
+#include "device/load_aware_chunk_selector.h"
 #include "blkalloc/append_blk_allocator.h"
 #include "blkalloc/fixed_blk_allocator.h"
+#include "blkalloc/extent_blk_allocator.h"
 
 SISL_LOGGING_DECL(device)
 
@@ -77,6 +85,11 @@ static std::shared_ptr< BlkAllocator > create_blk_allocator(blk_allocator_type_t
                            std::string("append_chunk_") + std::to_string(unique_id)};
         return std::make_shared< AppendBlkAllocator >(cfg, is_init, unique_id);
     }
+    case blk_allocator_type_t::extent: {
+        BlkAllocConfig cfg{vblock_size, align_sz, size, is_auto_recovery,
+                           std::string("extent_chunk_") + std::to_string(unique_id)};
+        return std::make_shared< ExtentBlkAllocator >(cfg, is_init, unique_id);
+    }
     case blk_allocator_type_t::none:
     default:
         return nullptr;
@@ -90,6 +103,7 @@ VirtualDev::VirtualDev(DeviceManager& dmgr, vdev_info const& vinfo, vdev_event_c
         m_name{vinfo.name},
         m_event_cb{std::move(event_cb)},
         m_metrics{vinfo.name},
+        m_fair_queue{m_metrics},
         m_allocator_type{vinfo.alloc_type},
         m_chunk_selector_type{vinfo.chunk_sel_type},
         m_auto_recovery{is_auto_recovery} {
@@ -98,6 +112,10 @@ VirtualDev::VirtualDev(DeviceManager& dmgr, vdev_info const& vinfo, vdev_event_c
         m_chunk_selector = std::make_shared< RoundRobinChunkSelector >(false /* dynamically add chunk */);
         break;
     }
+    case chunk_selector_type_t::LOAD_AWARE: {
+        m_chunk_selector = std::make_shared< LoadAwareChunkSelector >();
+        break;
+    }
     case chunk_selector_type_t::CUSTOM: {
         HS_REL_ASSERT(custom_chunk_selector, "Expected custom chunk selector to be passed with selector_type=CUSTOM");
         m_chunk_selector = std::move(custom_chunk_selector);
@@ -111,6 +129,8 @@ VirtualDev::VirtualDev(DeviceManager& dmgr, vdev_info const& vinfo, vdev_event_c
     }
 }
 
+VirtualDev::~VirtualDev() { stop_lazy_zeroing(); }
+
 // TODO: Have an additional parameter for vdev to check if dynamic add chunk. If so, we need to take do an rcu for
 // m_all_chunks.
 void VirtualDev::add_chunk(cshared< Chunk >& chunk, bool is_fresh_chunk) {
@@ -121,9 +141,15 @@ void VirtualDev::add_chunk(cshared< Chunk >& chunk, bool is_fresh_chunk) {
     chunk->set_block_allocator(std::move(ba));
     // TODO: when vdev_ordinal is  used, revisit here to make sure it is set correctly;
     chunk->set_vdev_ordinal(m_total_chunk_num++);
-    m_pdevs.insert(chunk->physical_dev_mutable());
+    if (auto* pdev = chunk->physical_dev_mutable(); m_pdevs.insert(pdev).second) {
+        pdev->register_stream_writer(write_stream(pdev), m_vdev_info.get_name());
+        m_numa_node.store(pdevs_numa_node(), std::memory_order_relaxed);
+    }
     m_all_chunks[chunk->chunk_id()] = chunk;
     m_chunk_selector->add_chunk(chunk);
+
+    // Resume the zeroing of chunks which were formatted lazily, but not completed before restart
+    if (!is_fresh_chunk && chunk->is_zero_pending()) { start_lazy_zeroing(); }
 }
 
 void VirtualDev::remove_chunk(cshared< Chunk >& chunk) {
@@ -134,6 +160,16 @@ void VirtualDev::remove_chunk(cshared< Chunk >& chunk) {
 }
 
 folly::Future< std::error_code > VirtualDev::async_format() {
+    if (HS_DYNAMIC_CONFIG(device->lazy_format)) {
+        for (auto& [_, chunk] : m_all_chunks) {
+            LOGINFO("Lazy format of chunk: {}, size: {}, offset: {}", chunk->chunk_id(), in_bytes(chunk->size()),
+                    chunk->start_offset());
+            chunk->start_lazy_zero();
+        }
+        if (!m_all_chunks.empty()) { start_lazy_zeroing(); }
+        return folly::makeFuture< std::error_code >(std::error_code{});
+    }
+
     static thread_local std::vector< folly::Future< std::error_code > > s_futs;
     s_futs.clear();
 
@@ -151,6 +187,117 @@ folly::Future< std::error_code > VirtualDev::async_format() {
     });
 }
 
+void VirtualDev::start_lazy_zeroing() {
+    std::unique_lock lg{m_lazy_zero_mtx};
+    if (m_lazy_zero_stop) { return; }
+    if (m_lazy_zero_running) {
+        m_lazy_zero_rescan = true;
+        return;
+    }
+    if (m_lazy_zero_thread.joinable()) { m_lazy_zero_thread.join(); } // Previous round of zeroing completed
+    m_lazy_zero_running = true;
+    m_lazy_zero_thread = std::thread([this]() { lazy_zero_loop(); });
+}
+
+void VirtualDev::stop_lazy_zeroing() {
+    {
+        std::unique_lock lg{m_lazy_zero_mtx};
+        m_lazy_zero_stop = true;
+        m_lazy_zero_cv.notify_all();
+    }
+    if (m_lazy_zero_thread.joinable()) { m_lazy_zero_thread.join(); }
+}
+
+void VirtualDev::lazy_zero_loop() {
+    pin_thread(hs_thread_role_t::data_bg);
+    LOGINFO("Background zeroing of lazily formatted chunks of vdev={} started", m_name);
+    while (true) {
+        shared< Chunk > chunk;
+        {
+            std::unique_lock lg{m_mgmt_mutex};
+            for (auto const& [_, c] : m_all_chunks) {
+                if (c->is_zero_pending()) {
+                    chunk = c;
+                    break;
+                }
+            }
+        }
+
+        std::chrono::microseconds wait_time{0};
+        if (chunk != nullptr) {
+            auto const step_mb = HS_DYNAMIC_CONFIG(device->lazy_zero_step_size_mb);
+            auto const start_time = Clock::now();
+            auto const err = chunk->zero_upto(chunk->zeroed_upto() + 1); // Zeros one step from its watermark
+            if (err) {
+                wait_time = std::chrono::seconds{1}; // Back off and retry on error
+            } else {
+                // Throttle to the configured rate
+                auto const rate = std::max(HS_DYNAMIC_CONFIG(device->lazy_zero_rate_mbps), 1u);
+                auto const expected_us = (uint64_cast(step_mb) * 1000 * 1000) / rate;
+                auto const elapsed_us = get_elapsed_time_us(start_time);
+                if (expected_us > elapsed_us) { wait_time = std::chrono::microseconds{expected_us - elapsed_us}; }
+            }
+        }
+
+        std::unique_lock lg{m_lazy_zero_mtx};
+        if (chunk == nullptr) {
+            if (m_lazy_zero_rescan && !m_lazy_zero_stop) {
+                m_lazy_zero_rescan = false;
+                continue;
+            }
+            m_lazy_zero_running = false;
+            break;
+        }
+        if (m_lazy_zero_cv.wait_for(lg, wait_time, [this] { return m_lazy_zero_stop; })) {
+            m_lazy_zero_running = false;
+            break;
+        }
+    }
+    LOGINFO("Background zeroing of lazily formatted chunks of vdev={} stopped", m_name);
+}
+
+static void zero_fill_iovs(iovec* iov, int iovcnt, uint64_t from) {
+    for (int i{0}; i < iovcnt; ++i) {
+        if (from >= iov[i].iov_len) {
+            from -= iov[i].iov_len;
+            continue;
+        }
+        std::memset(r_cast< uint8_t* >(iov[i].iov_base) + from, 0, iov[i].iov_len - from);
+        from = 0;
+    }
+}
+
+std::error_code VirtualDev::sync_read_lazy_zeroed(Chunk* chunk, iovec* iov, int iovcnt, uint64_t size,
+                                                  uint64_t dev_offset) {
+    // Part of the read is beyond zeroed watermark, which was never written. Read whatever is below and zero the rest
+    auto const rsize = chunk->readable_size(dev_offset, size);
+    if (rsize > 0) {
+        auto const err = chunk->physical_dev_mutable()->sync_readv(iov, iovcnt, size, dev_offset);
+        if (err) { return err; }
+    }
+    zero_fill_iovs(iov, iovcnt, rsize);
+    return std::error_code{};
+}
+
+folly::Future< std::error_code > VirtualDev::async_read_lazy_zeroed(Chunk* chunk, iovec* iov, int iovcnt,
+                                                                    uint64_t size, uint64_t dev_offset,
+                                                                    bool part_of_batch) {
+    auto const rsize = chunk->readable_size(dev_offset, size);
+    if (rsize == 0) {
+        zero_fill_iovs(iov, iovcnt, 0);
+        return folly::makeFuture< std::error_code >(std::error_code{});
+    }
+
+    std::vector< iovec > iovs_copy(iov, iov + iovcnt);
+    auto f = (iovcnt == 1)
+        ? chunk->physical_dev_mutable()->async_read(r_cast< char* >(iov[0].iov_base), size, dev_offset, part_of_batch)
+        : chunk->physical_dev_mutable()->async_readv(iov, iovcnt, size, dev_offset, part_of_batch);
+    return std::move(f).thenValue([iovs = std::move(iovs_copy), rsize](std::error_code err) mutable {
+        if (!err) { zero_fill_iovs(iovs.data(), s_cast< int >(iovs.size()), rsize); }
+        return err;
+    });
+}
+
 bool VirtualDev::is_blk_alloced(BlkId const& blkid) const {
     return m_dmgr.get_chunk(blkid.chunk_num())->blk_allocator()->is_blk_alloced(blkid, true /* lock */);
 }
@@ -173,6 +320,63 @@ BlkAllocStatus VirtualDev::commit_blk(BlkId const& blkid) {
     return chunk->blk_allocator_mutable()->reserve_on_disk(blkid);
 }
 
+BlkAllocStatus VirtualDev::reserve_blk(BlkId const& blkid, std::vector< BlkId >& out_reserved) {
+    Chunk* chunk = m_dmgr.get_chunk_mutable(blkid.chunk_num());
+    if (!chunk) {
+        HS_LOG(ERROR, device, "fail to reserve_blk: bid {}", blkid.to_string());
+        return BlkAllocStatus::INVALID_DEV;
+    }
+    auto* allocator = chunk->blk_allocator_mutable();
+    auto const first_reserved = out_reserved.size();
+    auto status = BlkAllocStatus::SUCCESS;
+    for (blk_num_t b{blkid.blk_num()}; b < blkid.blk_num() + blkid.blk_count(); ++b) {
+        BlkId const bid{b, 1, blkid.chunk_num()};
+        if (allocator->is_blk_alloced(bid, true /* lock */)) { continue; }
+
+        // Reserved one blk at a time in both versions, so that a failure could be undone with free of the same blks
+        status = allocator->reserve_on_cache(bid);
+        if (status == BlkAllocStatus::SUCCESS) {
+            status = allocator->reserve_on_disk(bid);
+            if (status != BlkAllocStatus::SUCCESS) { allocator->free(bid); }
+        }
+        if (status != BlkAllocStatus::SUCCESS) { break; }
+
+        if ((out_reserved.size() > first_reserved) &&
+            (out_reserved.back().blk_num() + out_reserved.back().blk_count() == b) &&
+            (out_reserved.back().blk_count() < std::numeric_limits< blk_count_t >::max())) {
+            out_reserved.back() = BlkId{out_reserved.back().blk_num(),
+                                        s_cast< blk_count_t >(out_reserved.back().blk_count() + 1), blkid.chunk_num()};
+        } else {
+            out_reserved.push_back(bid);
+        }
+    }
+
+    if (status != BlkAllocStatus::SUCCESS) {
+        HS_LOG(ERROR, device, "fail to reserve_blk: bid {}", blkid.to_string());
+        for (auto i = first_reserved; i < out_reserved.size(); ++i) {
+            unreserve_blk(out_reserved[i]);
+        }
+        out_reserved.resize(first_reserved);
+    }
+    return status;
+}
+
+void VirtualDev::unreserve_blk(BlkId const& blkid) {
+    Chunk* chunk = m_dmgr.get_chunk_mutable(blkid.chunk_num());
+    if (!chunk) {
+        HS_LOG(ERROR, device, "fail to unreserve_blk: bid {}", blkid.to_string());
+        return;
+    }
+    auto* allocator = chunk->blk_allocator_mutable();
+    for (blk_num_t b{blkid.blk_num()}; b < blkid.blk_num() + blkid.blk_count(); ++b) {
+        allocator->free(BlkId{b, 1, blkid.chunk_num()});
+    }
+}
+
+blk_num_t VirtualDev::num_blks_of_chunk(chunk_num_t chunk_num) const {
+    return m_dmgr.get_chunk(chunk_num)->blk_allocator()->get_total_blks();
+}
+
 BlkAllocStatus VirtualDev::alloc_contiguous_blks(blk_count_t nblks, blk_alloc_hints const& hints, BlkId& out_blkid) {
     BlkAllocStatus ret;
     try {
@@ -200,6 +404,7 @@ BlkAllocStatus VirtualDev::alloc_contiguous_blks(blk_count_t nblks, blk_alloc_hi
 }
 
 BlkAllocStatus VirtualDev::alloc_blks(blk_count_t nblks, blk_alloc_hints const& hints, MultiBlkId& out_blkid) {
+    auto const start_time = Clock::now();
     try {
         // First select a chunk to allocate it from
         BlkAllocStatus status;
@@ -212,7 +417,21 @@ BlkAllocStatus VirtualDev::alloc_blks(blk_count_t nblks, blk_alloc_hints const&
             status = alloc_blks_from_chunk(nblks, hints, out_blkid, chunk);
             // don't look for other chunks because user wants allocation on chunk_id_hint only;
         } else {
-            do {
+            auto const alloc_done = [&hints](BlkAllocStatus s) {
+                return (s == BlkAllocStatus::SUCCESS) || ((s == BlkAllocStatus::PARTIAL) && hints.partial_alloc_ok);
+            };
+            bool tried_chunk{false};
+            status = BlkAllocStatus::SPACE_FULL;
+            if (hints.neighbor_blkid_hint) {
+                // Keep the blks of an object close to each other, by trying the chunk of its neighbor blk first
+                chunk = m_dmgr.get_chunk_mutable(hints.neighbor_blkid_hint->chunk_num());
+                if (chunk && (chunk->vdev_id() == m_vdev_info.vdev_id)) {
+                    status = alloc_blks_from_chunk(nblks, hints, out_blkid, chunk);
+                    tried_chunk = true;
+                }
+            }
+            while (!alloc_done(status) && (!tried_chunk || hints.can_look_for_other_chunk) &&
+                   (attempt < m_total_chunk_num)) {
                 chunk = m_chunk_selector->select_chunk(nblks, hints).get();
                 if (chunk == nullptr) {
                     status = BlkAllocStatus::SPACE_FULL;
@@ -220,11 +439,9 @@ BlkAllocStatus VirtualDev::alloc_blks(blk_count_t nblks, blk_alloc_hints const&
                 }
 
                 status = alloc_blks_from_chunk(nblks, hints, out_blkid, chunk);
-                if ((status == BlkAllocStatus::SUCCESS) || !hints.can_look_for_other_chunk ||
-                    (status == BlkAllocStatus::PARTIAL && hints.partial_alloc_ok)) {
-                    break;
-                }
-            } while (++attempt < m_total_chunk_num);
+                tried_chunk = true;
+                ++attempt;
+            }
         }
 
         if ((status != BlkAllocStatus::SUCCESS) && !((status == BlkAllocStatus::PARTIAL) && hints.partial_alloc_ok)) {
@@ -232,6 +449,7 @@ BlkAllocStatus VirtualDev::alloc_blks(blk_count_t nblks, blk_alloc_hints const&
             COUNTER_INCREMENT(m_metrics, vdev_num_alloc_failure, 1);
         }
 
+        HISTOGRAM_OBSERVE(m_metrics, vdev_alloc_latency_us, get_elapsed_time_us(start_time));
         return status;
     } catch (const std::exception& e) {
         LOGERROR("exception happened {}", e.what());
@@ -283,10 +501,172 @@ BlkAllocStatus VirtualDev::alloc_blks_from_chunk(blk_count_t nblks, blk_alloc_hi
         out_blkid = MultiBlkId{};
         status = BlkAllocStatus::FAILED;
     }
+    if ((status == BlkAllocStatus::SUCCESS) || (status == BlkAllocStatus::PARTIAL)) {
+        chunk->record_alloc(out_blkid.blk_count());
+    }
+    HS_PROBE(blk_alloc, chunk->chunk_id(), nblks, s_cast< int >(status));
+
+    return status;
+}
+
+BlkAllocStatus VirtualDev::alloc_blks(std::span< blk_count_t const > sizes, blk_alloc_hints const& hints,
+                                      std::vector< MultiBlkId >& out_blkids) {
+    out_blkids.reserve(out_blkids.size() + sizes.size());
+    size_t const start = out_blkids.size();
+    size_t ndone{0};
+
+    try {
+        Chunk* chunk{nullptr};
+        if (hints.chunk_id_hint) {
+            chunk = m_dmgr.get_chunk_mutable(*(hints.chunk_id_hint));
+            if (!chunk) return BlkAllocStatus::INVALID_DEV;
+        } else if (hints.neighbor_blkid_hint) {
+            chunk = m_dmgr.get_chunk_mutable(hints.neighbor_blkid_hint->chunk_num());
+            if (chunk && (chunk->vdev_id() != m_vdev_info.vdev_id)) { chunk = nullptr; }
+        }
+
+        blk_count_t total_nblks{0};
+        for (auto const nblks : sizes) {
+            total_nblks = s_cast< blk_count_t >(std::min(uint32_cast(total_nblks) + nblks,
+                                                         uint32_cast(std::numeric_limits< blk_count_t >::max())));
+        }
+        if (chunk == nullptr) { chunk = m_chunk_selector->select_chunk(total_nblks, hints).get(); }
+
+        if (chunk != nullptr) {
+#ifdef _PRERELEASE
+            if (!iomgr_flip::instance()->get_test_flip< uint32_t >("blk_allocation_flip", total_nblks,
+                                                                   chunk->vdev_id())) {
+                chunk->blk_allocator_mutable()->alloc_batch(sizes, hints, out_blkids);
+            }
+#else
+            chunk->blk_allocator_mutable()->alloc_batch(sizes, hints, out_blkids);
+#endif
+            ndone = out_blkids.size() - start;
+            for (size_t i{start}; i < out_blkids.size(); ++i) {
+                chunk->record_alloc(out_blkids[i].blk_count());
+            }
+        }
+    } catch (const std::exception& e) {
+        LOGERROR("exception happened {}", e.what());
+        assert(false);
+        return BlkAllocStatus::FAILED;
+    }
 
+    // Rest of them (if the chunk ran out of space midway) go through the regular path, which looks at other chunks.
+    // User wants allocation only on chunk_id_hint, there is nothing more to look at.
+    if (hints.chunk_id_hint && (ndone < sizes.size())) { return BlkAllocStatus::SPACE_FULL; }
+    for (; ndone < sizes.size(); ++ndone) {
+        MultiBlkId mbid;
+        auto const status = alloc_blks(sizes[ndone], hints, mbid);
+        if (status != BlkAllocStatus::SUCCESS) {
+            if (status == BlkAllocStatus::PARTIAL) { free_blk(mbid); }
+            return status;
+        }
+        out_blkids.push_back(mbid);
+    }
+    return BlkAllocStatus::SUCCESS;
+}
+
+BlkAllocStatus VirtualDev::alloc_striped_blks(blk_count_t nblks, blk_alloc_hints const& hints,
+                                              std::vector< MultiBlkId >& out_blkids) {
+    auto const min_blks = uint64_cast(HS_DYNAMIC_CONFIG(device->stripe_min_io_kb)) * 1024 / block_size();
+    auto const unit_blks = std::max(uint64_cast(HS_DYNAMIC_CONFIG(device->stripe_unit_kb)) * 1024 / block_size(),
+                                    uint64_cast(1));
+
+    // Chunk with the most room on each of the pdevs, roomiest first
+    std::vector< Chunk* > chunks;
+    if ((min_blks != 0) && (nblks >= min_blks) && !hints.chunk_id_hint && (m_pdevs.size() > 1)) {
+        std::map< PhysicalDev const*, Chunk* > pdev_chunks;
+        std::unique_lock lg{m_mgmt_mutex};
+        for (auto const& [_, chunk] : m_all_chunks) {
+            auto& c = pdev_chunks[chunk->physical_dev()];
+            if ((c == nullptr) ||
+                (chunk->blk_allocator()->available_blks() > c->blk_allocator()->available_blks())) {
+                c = chunk.get();
+            }
+        }
+        for (auto const& [_, c] : pdev_chunks) {
+            chunks.push_back(c);
+        }
+        std::sort(chunks.begin(), chunks.end(), [](Chunk const* a, Chunk const* b) {
+            return a->blk_allocator()->available_blks() > b->blk_allocator()->available_blks();
+        });
+    }
+
+    // Whole stripe units to each stripe, the first ones taking a unit more if they don't divide evenly
+    auto const nunits = (nblks + unit_blks - 1) / unit_blks;
+    auto const nstripes = std::min(uint64_cast(chunks.size()), nunits);
+    if (nstripes > 1) {
+        auto h = hints;
+        h.partial_alloc_ok = false;
+        size_t const start = out_blkids.size();
+        blk_count_t remain = nblks;
+        for (uint64_t s{0}; s < nstripes; ++s) {
+            auto const units = (nunits / nstripes) + ((s < (nunits % nstripes)) ? 1 : 0);
+            auto const part = s_cast< blk_count_t >(std::min(units * unit_blks, uint64_cast(remain)));
+            MultiBlkId mbid;
+            if (alloc_blks_from_chunk(part, h, mbid, chunks[s]) != BlkAllocStatus::SUCCESS) { break; }
+            out_blkids.push_back(mbid);
+            remain -= part;
+        }
+        if (remain == 0) {
+            COUNTER_INCREMENT(m_metrics, vdev_striped_allocs, 1);
+            return BlkAllocStatus::SUCCESS;
+        }
+
+        // One of the chunks is out of room for its stripe, free the rest and leave it to the chunk selector
+        for (size_t i{start}; i < out_blkids.size(); ++i) {
+            free_blk(out_blkids[i]);
+        }
+        out_blkids.resize(start);
+    }
+
+    MultiBlkId mbid;
+    auto const status = alloc_blks(nblks, hints, mbid);
+    if (status == BlkAllocStatus::SUCCESS) {
+        out_blkids.push_back(mbid);
+    } else if (status == BlkAllocStatus::PARTIAL) {
+        free_blk(mbid);
+    }
     return status;
 }
 
+void VirtualDev::free_blks(std::span< BlkId const > bids, VDevCPContext* vctx) {
+    if (vctx && (m_allocator_type != blk_allocator_type_t::append)) {
+        for (auto const& b : bids) {
+            free_blk(b, vctx);
+        }
+        return;
+    }
+
+    // Group the individual pieces per chunk, so that each allocator gets a single free_batch call
+    std::map< chunk_num_t, std::vector< BlkId > > per_chunk;
+    for (auto const& bid : bids) {
+        if (bid.is_multi()) {
+            MultiBlkId const& mbid = r_cast< MultiBlkId const& >(bid);
+            for (auto const b : mbid.pieces()) {
+                per_chunk[b.chunk_num()].push_back(b);
+            }
+        } else {
+            per_chunk[bid.chunk_num()].push_back(bid);
+        }
+    }
+    free_per_chunk(per_chunk);
+}
+
+void VirtualDev::free_per_chunk(std::map< chunk_num_t, std::vector< BlkId > > const& per_chunk) {
+    for (auto const& [chunk_num, chunk_bids] : per_chunk) {
+        auto chunk = m_dmgr.get_chunk_mutable(chunk_num);
+        // try to free a blk in a missing chunk, crash if it happens;
+        if (!chunk) HS_DBG_ASSERT(false, "chunk is missing for blkid {}", chunk_bids.front().to_string());
+        for (auto const& b : chunk_bids) {
+            HS_PROBE(blk_free, b.chunk_num(), b.blk_num(), b.blk_count());
+            chunk->record_free(b.blk_count());
+        }
+        chunk->blk_allocator_mutable()->free_batch(chunk_bids);
+    }
+}
+
 void VirtualDev::free_blk(BlkId const& bid, VDevCPContext* vctx) {
     auto do_free_action = [this](auto const& b, VDevCPContext* vctx) {
         if (vctx && (m_allocator_type != blk_allocator_type_t::append)) {
@@ -297,15 +677,16 @@ void VirtualDev::free_blk(BlkId const& bid, VDevCPContext* vctx) {
             // try to free a blk in a missing chunk, crash if it happens;
             if (!chunk) HS_DBG_ASSERT(false, "chunk is missing for blkid {}", b.to_string());
             BlkAllocator* allocator = chunk->blk_allocator_mutable();
+            HS_PROBE(blk_free, b.chunk_num(), b.blk_num(), b.blk_count());
+            chunk->record_free(b.blk_count());
             allocator->free(b);
         }
     };
 
     if (bid.is_multi()) {
         MultiBlkId const& mbid = r_cast< MultiBlkId const& >(bid);
-        auto it = mbid.iterate();
-        while (auto const b = it.next()) {
-            do_free_action(*b, vctx);
+        for (auto const b : mbid.pieces()) {
+            do_free_action(b, vctx);
         }
     } else {
         do_free_action(bid, vctx);
@@ -323,6 +704,24 @@ uint64_t VirtualDev::get_len(const iovec* iov, int iovcnt) {
 // for all writes functions, we don't expect to get invalid dev_offset, since we will never allocate blkid from missing
 // chunk(missing pdev);
 ////////////////////////// async write section //////////////////////////////////
+template < typename IssueFn, typename DeferFn >
+folly::Future< std::error_code > VirtualDev::when_zeroed(Chunk* chunk, uint64_t dev_offset, uint64_t size,
+                                                         IssueFn&& issue_now, DeferFn&& defer) {
+    auto zf = chunk->prepare_async_write(dev_offset, size);
+    if (sisl_likely(zf.isReady())) {
+        if (auto err = std::move(zf).value(); sisl_unlikely(err)) {
+            return folly::makeFuture< std::error_code >(std::move(err));
+        }
+        return issue_now();
+    }
+
+    // Issued on its own on completion of the zeroing, it could no longer be part of the caller's batch
+    return std::move(zf).thenValue([issue = defer()](std::error_code err) mutable {
+        if (err) { return folly::makeFuture< std::error_code >(std::move(err)); }
+        return issue();
+    });
+}
+
 folly::Future< std::error_code > VirtualDev::async_write(const char* buf, uint32_t size, BlkId const& bid,
                                                          bool part_of_batch) {
     HS_DBG_ASSERT_EQ(bid.is_multi(), false, "async_write needs individual pieces of blkid - not MultiBlkid");
@@ -341,10 +740,18 @@ folly::Future< std::error_code > VirtualDev::async_write(const char* buf, uint32
 
     HS_LOG(TRACE, device, "Writing in device: {}, offset = {}", pdev->pdev_id(), dev_offset);
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    return pdev->async_write(buf, size, dev_offset, part_of_batch);
+    auto const issue = [this, pdev, buf, size, dev_offset](bool batched) {
+        return m_fair_queue.schedule(true /* is_write */, size, batched, [this, pdev, buf, size, dev_offset](bool pob) {
+            return pdev->async_write(buf, size, dev_offset, pob, write_stream(pdev));
+        });
+    };
+    return when_zeroed(
+        chunk, dev_offset, size, [&]() { return issue(part_of_batch); },
+        [&]() { return [issue]() { return issue(false /* part_of_batch */); }; });
 }
 
 folly::Future< std::error_code > VirtualDev::async_write(const char* buf, uint32_t size, cshared< Chunk >& chunk,
@@ -361,10 +768,14 @@ folly::Future< std::error_code > VirtualDev::async_write(const char* buf, uint32
 
     HS_LOG(TRACE, device, "Writing in device: {}, offset = {}", pdev->pdev_id(), dev_offset);
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    return pdev->async_write(buf, size, dev_offset, false /* part_of_batch */);
+    auto const issue = [this, pdev, buf, size, dev_offset]() {
+        return pdev->async_write(buf, size, dev_offset, false /* part_of_batch */, write_stream(pdev));
+    };
+    return when_zeroed(chunk.get(), dev_offset, size, issue, [&issue]() { return issue; });
 }
 
 folly::Future< std::error_code > VirtualDev::async_writev(const iovec* iov, const int iovcnt, BlkId const& bid,
@@ -384,10 +795,29 @@ folly::Future< std::error_code > VirtualDev::async_writev(const iovec* iov, cons
 
     HS_LOG(TRACE, device, "Writing in device: {}, offset = {}", pdev->pdev_id(), dev_offset);
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    return pdev->async_writev(iov, iovcnt, size, dev_offset, part_of_batch);
+    auto const issue = [this, pdev, size, dev_offset](const iovec* iov, int iovcnt, bool part_of_batch) {
+        return m_fair_queue.schedule(
+            true /* is_write */, uint32_cast(size), part_of_batch,
+            [&](bool pob) { return pdev->async_writev(iov, iovcnt, size, dev_offset, pob, write_stream(pdev)); },
+            [&]() -> VDevFairQueue::submit_fn_t {
+                // Caller's iov array need not outlive the call, only the buffers it points to do
+                return [this, pdev, iovs = std::vector< iovec >(iov, iov + iovcnt), size, dev_offset](bool pob) {
+                    return pdev->async_writev(iovs.data(), int_cast(iovs.size()), size, dev_offset, pob,
+                                              write_stream(pdev));
+                };
+            });
+    };
+    return when_zeroed(
+        chunk, dev_offset, size, [&]() { return issue(iov, iovcnt, part_of_batch); },
+        [&]() {
+            return [issue, iovs = std::vector< iovec >(iov, iov + iovcnt)]() {
+                return issue(iovs.data(), int_cast(iovs.size()), false /* part_of_batch */);
+            };
+        });
 }
 
 folly::Future< std::error_code > VirtualDev::async_writev(const iovec* iov, const int iovcnt, cshared< Chunk >& chunk,
@@ -405,10 +835,42 @@ folly::Future< std::error_code > VirtualDev::async_writev(const iovec* iov, cons
 
     HS_LOG(TRACE, device, "Writing in device: {}, offset = {}", pdev->pdev_id(), dev_offset);
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
-    return pdev->async_writev(iov, iovcnt, size, dev_offset, false /* part_of_batch */);
+    return when_zeroed(
+        chunk.get(), dev_offset, size,
+        [&]() {
+            return pdev->async_writev(iov, iovcnt, size, dev_offset, false /* part_of_batch */, write_stream(pdev));
+        },
+        [&]() {
+            // Caller's iov array need not outlive the call, only the buffers it points to do
+            return [this, pdev, iovs = std::vector< iovec >(iov, iov + iovcnt), size, dev_offset]() {
+                return pdev->async_writev(iovs.data(), int_cast(iovs.size()), size, dev_offset,
+                                          false /* part_of_batch */, write_stream(pdev));
+            };
+        });
+}
+
+folly::Future< std::error_code > VirtualDev::async_write(const char* buf, uint32_t size, MultiBlkId const& bid,
+                                                         bool part_of_batch) {
+    if (bid.num_pieces() == 1) { return async_write(buf, size, bid.to_single_blkid(), part_of_batch); }
+
+    VDevIOBatch batch{*this};
+    auto f = batch.add_write(buf, size, bid);
+    batch.submit(!part_of_batch /* ring_doorbell */);
+    return f;
+}
+
+folly::Future< std::error_code > VirtualDev::async_writev(const iovec* iov, int iovcnt, MultiBlkId const& bid,
+                                                          bool part_of_batch) {
+    if (bid.num_pieces() == 1) { return async_writev(iov, iovcnt, bid.to_single_blkid(), part_of_batch); }
+
+    VDevIOBatch batch{*this};
+    auto f = batch.add_writev(iov, iovcnt, bid);
+    batch.submit(!part_of_batch /* ring_doorbell */);
+    return f;
 }
 
 ////////////////////////// sync write section //////////////////////////////////
@@ -424,6 +886,9 @@ std::error_code VirtualDev::sync_write(const char* buf, uint32_t size, BlkId con
     if (sisl_unlikely(dev_offset == INVALID_DEV_OFFSET)) {
         return std::make_error_code(std::errc::resource_unavailable_try_again);
     }
+    if (auto err = chunk->prepare_write(dev_offset, size); sisl_unlikely(err)) { return err; }
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
+    m_fair_queue.account_sync(true /* is_write */, size);
     return chunk->physical_dev_mutable()->sync_write(buf, size, dev_offset);
 }
 
@@ -436,6 +901,10 @@ std::error_code VirtualDev::sync_write(const char* buf, uint32_t size, cshared<
     if (sisl_unlikely(!is_chunk_available(chunk))) {
         return std::make_error_code(std::errc::resource_unavailable_try_again);
     }
+    if (auto err = chunk->prepare_write(chunk->start_offset() + offset_in_chunk, size); sisl_unlikely(err)) {
+        return err;
+    }
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     return chunk->physical_dev_mutable()->sync_write(buf, size, chunk->start_offset() + offset_in_chunk);
 }
 
@@ -452,18 +921,21 @@ std::error_code VirtualDev::sync_writev(const iovec* iov, int iovcnt, BlkId cons
         return std::make_error_code(std::errc::resource_unavailable_try_again);
     }
     auto const size = get_len(iov, iovcnt);
+    if (auto err = chunk->prepare_write(dev_offset, size); sisl_unlikely(err)) { return err; }
     auto* pdev = chunk->physical_dev_mutable();
 
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
+    m_fair_queue.account_sync(true /* is_write */, uint32_cast(size));
 
     return pdev->sync_writev(iov, iovcnt, size, dev_offset);
 }
 
 std::error_code VirtualDev::sync_writev(const iovec* iov, int iovcnt, cshared< Chunk >& chunk,
-                                        uint64_t offset_in_chunk) {
+                                        uint64_t offset_in_chunk, bool fua) {
 #ifdef _PRERELEASE
     if (hs()->crash_simulator().is_crashed()) { return std::error_code{}; }
 #endif
@@ -474,13 +946,16 @@ std::error_code VirtualDev::sync_writev(const iovec* iov, int iovcnt, cshared< C
 
     uint64_t const dev_offset = chunk->start_offset() + offset_in_chunk;
     auto const size = get_len(iov, iovcnt);
+    if (auto err = chunk->prepare_write(dev_offset, size); sisl_unlikely(err)) { return err; }
     auto* pdev = chunk->physical_dev_mutable();
 
     COUNTER_INCREMENT(m_metrics, vdev_write_count, 1);
+    COUNTER_INCREMENT(m_metrics, vdev_write_bytes, size);
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
 
+    if (fua) { return pdev->sync_writev_fua(iov, iovcnt, size, dev_offset); }
     return pdev->sync_writev(iov, iovcnt, size, dev_offset);
 }
 
@@ -496,7 +971,15 @@ folly::Future< std::error_code > VirtualDev::async_read(char* buf, uint64_t size
     if (sisl_unlikely(dev_offset == INVALID_DEV_OFFSET)) {
         return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
     }
-    return pchunk->physical_dev_mutable()->async_read(buf, size, dev_offset, part_of_batch);
+    bool const lazy_zeroed = (pchunk->prepare_read(dev_offset, size) < size);
+    return m_fair_queue.schedule(false /* is_write */, uint32_cast(size), part_of_batch,
+                                 [this, pchunk, buf, size, dev_offset, lazy_zeroed](bool pob) {
+                                     if (sisl_unlikely(lazy_zeroed)) {
+                                         iovec iov{buf, size};
+                                         return async_read_lazy_zeroed(pchunk, &iov, 1, size, dev_offset, pob);
+                                     }
+                                     return pchunk->physical_dev_mutable()->async_read(buf, size, dev_offset, pob);
+                                 });
 }
 
 folly::Future< std::error_code > VirtualDev::async_readv(iovec* iovs, int iovcnt, uint64_t size, BlkId const& bid,
@@ -508,7 +991,31 @@ folly::Future< std::error_code > VirtualDev::async_readv(iovec* iovs, int iovcnt
     if (sisl_unlikely(dev_offset == INVALID_DEV_OFFSET)) {
         return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
     }
-    return pchunk->physical_dev_mutable()->async_readv(iovs, iovcnt, size, dev_offset, part_of_batch);
+    bool const lazy_zeroed = (pchunk->prepare_read(dev_offset, size) < size);
+    auto submit = [this, pchunk, size, dev_offset, lazy_zeroed](iovec* iov, int cnt, bool pob) {
+        if (sisl_unlikely(lazy_zeroed)) { return async_read_lazy_zeroed(pchunk, iov, cnt, size, dev_offset, pob); }
+        return pchunk->physical_dev_mutable()->async_readv(iov, cnt, size, dev_offset, pob);
+    };
+    return m_fair_queue.schedule(
+        false /* is_write */, uint32_cast(size), part_of_batch, [&](bool pob) { return submit(iovs, iovcnt, pob); },
+        [&]() -> VDevFairQueue::submit_fn_t {
+            return [submit, iov_copy = std::vector< iovec >(iovs, iovs + iovcnt)](bool pob) mutable {
+                return submit(iov_copy.data(), int_cast(iov_copy.size()), pob);
+            };
+        });
+}
+
+folly::Future< std::error_code > VirtualDev::async_read(char* buf, uint32_t size, cshared< Chunk >& chunk,
+                                                        uint64_t offset_in_chunk) {
+    if (sisl_unlikely(!is_chunk_available(chunk))) {
+        return folly::makeFuture< std::error_code >(std::make_error_code(std::errc::resource_unavailable_try_again));
+    }
+    uint64_t const dev_offset = chunk->start_offset() + offset_in_chunk;
+    if (sisl_unlikely(chunk->prepare_read(dev_offset, size) < size)) {
+        iovec iov{buf, size};
+        return async_read_lazy_zeroed(chunk.get(), &iov, 1, size, dev_offset, false /* part_of_batch */);
+    }
+    return chunk->physical_dev_mutable()->async_read(buf, size, dev_offset, false /* part_of_batch */);
 }
 
 ////////////////////////////////////////// sync read section ////////////////////////////////////////////
@@ -520,6 +1027,11 @@ std::error_code VirtualDev::sync_read(char* buf, uint32_t size, BlkId const& bid
     if (sisl_unlikely(dev_offset == INVALID_DEV_OFFSET)) {
         return std::make_error_code(std::errc::resource_unavailable_try_again);
     }
+    m_fair_queue.account_sync(false /* is_write */, size);
+    if (sisl_unlikely(chunk->prepare_read(dev_offset, size) < size)) {
+        iovec iov{buf, size};
+        return sync_read_lazy_zeroed(chunk, &iov, 1, size, dev_offset);
+    }
     return chunk->physical_dev_mutable()->sync_read(buf, size, dev_offset);
 }
 
@@ -527,7 +1039,12 @@ std::error_code VirtualDev::sync_read(char* buf, uint32_t size, cshared< Chunk >
     if (sisl_unlikely(!is_chunk_available(chunk))) {
         return std::make_error_code(std::errc::resource_unavailable_try_again);
     }
-    return chunk->physical_dev_mutable()->sync_read(buf, size, chunk->start_offset() + offset_in_chunk);
+    uint64_t const dev_offset = chunk->start_offset() + offset_in_chunk;
+    if (sisl_unlikely(chunk->prepare_read(dev_offset, size) < size)) {
+        iovec iov{buf, size};
+        return sync_read_lazy_zeroed(chunk.get(), &iov, 1, size, dev_offset);
+    }
+    return chunk->physical_dev_mutable()->sync_read(buf, size, dev_offset);
 }
 
 std::error_code VirtualDev::sync_readv(iovec* iov, int iovcnt, BlkId const& bid) {
@@ -545,7 +1062,11 @@ std::error_code VirtualDev::sync_readv(iovec* iov, int iovcnt, BlkId const& bid)
     if (sisl_unlikely(!hs_utils::mod_aligned_sz(dev_offset, pdev->align_size()))) {
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
+    m_fair_queue.account_sync(false /* is_write */, uint32_cast(size));
 
+    if (sisl_unlikely(chunk->prepare_read(dev_offset, size) < size)) {
+        return sync_read_lazy_zeroed(chunk, iov, iovcnt, size, dev_offset);
+    }
     return pdev->sync_readv(iov, iovcnt, size, dev_offset);
 }
 
@@ -562,6 +1083,9 @@ std::error_code VirtualDev::sync_readv(iovec* iov, int iovcnt, cshared< Chunk >&
         COUNTER_INCREMENT(m_metrics, unalign_writes, 1);
     }
 
+    if (sisl_unlikely(chunk->prepare_read(dev_offset, size) < size)) {
+        return sync_read_lazy_zeroed(chunk.get(), iov, iovcnt, size, dev_offset);
+    }
     return pdev->sync_readv(iov, iovcnt, size, dev_offset);
 }
 
@@ -589,10 +1113,19 @@ folly::Future< std::error_code > VirtualDev::queue_fsync_pdevs() {
     }
 }
 
-void VirtualDev::submit_batch() {
-    // It is enough to submit batch on first pdev, since all pdevs are expected to be under same drive interfaces
-    auto* pdev = *(m_pdevs.begin());
-    return pdev->submit_batch();
+void VirtualDev::submit_batch() { submit_batch(m_pdevs); }
+
+void VirtualDev::submit_batch(const std::set< PhysicalDev* >& pdevs) {
+    // Pdevs which share the same drive interface have a common per-thread queue, it is enough to submit it once. But
+    // pdevs using their own io_uring have their own queues, which needs to be submitted individually.
+    std::set< iomgr::DriveInterface* > submitted_ifaces;
+    for (auto* pdev : pdevs) {
+        if (pdev->is_io_uring_enabled()) {
+            pdev->submit_batch();
+        } else if (submitted_ifaces.insert(pdev->drive_iface()).second) {
+            pdev->submit_batch();
+        }
+    }
 }
 
 uint64_t VirtualDev::available_blks() const {
@@ -611,6 +1144,14 @@ uint64_t VirtualDev::used_size() const {
     return (alloc_cnt * block_size());
 }
 
+uint64_t VirtualDev::written_bytes() const {
+    uint64_t bytes{0};
+    for (auto& [_, chunk] : m_all_chunks) {
+        bytes += chunk->written_bytes();
+    }
+    return bytes;
+}
+
 std::map< uint16_t, shared< Chunk > > VirtualDev::get_chunks() const { return m_all_chunks; }
 
 bool VirtualDev::is_blk_exist(MultiBlkId const& b) const {
@@ -636,6 +1177,20 @@ nlohmann::json VirtualDev::get_status(int log_level) const {
 }
 
 uint32_t VirtualDev::align_size() const { return m_dmgr.align_size(static_cast< HSDevType >(m_vdev_info.hs_dev_type)); }
+uint8_t VirtualDev::write_stream(PhysicalDev const* pdev) const {
+    auto const nstreams = pdev->max_write_streams();
+    return (nstreams == 0) ? 0 : s_cast< uint8_t >((m_vdev_info.vdev_id % nstreams) + 1);
+}
+
+int VirtualDev::pdevs_numa_node() const {
+    int node{-1};
+    for (auto const* pdev : m_pdevs) {
+        if ((pdev->numa_node() == -1) || ((node != -1) && (node != pdev->numa_node()))) { return -1; }
+        node = pdev->numa_node();
+    }
+    return node;
+}
+
 uint32_t VirtualDev::optimal_page_size() const {
     return m_dmgr.optimal_page_size(static_cast< HSDevType >(m_vdev_info.hs_dev_type));
 }
@@ -680,15 +1235,96 @@ void VirtualDev::cp_flush(VDevCPContext* v_cp_ctx) {
     m_chunk_selector->foreach_chunks(
         [this, cp](cshared< Chunk >& chunk) { chunk->blk_allocator_mutable()->cp_flush(cp); });
 
+    // Free log of this cp is sorted once by chunk and blk. Each allocator then gets all of its frees as a single batch
+    // in blk order, which lets it apply them to the bitmap taking each portion once (instead of once per free) and
+    // discard coalesces the adjacent frees in a single pass.
+    std::vector< BlkId > free_log;
+    for (auto const& b : v_cp_ctx->m_free_blkid_list) {
+        free_log.push_back(b);
+    }
+    std::sort(free_log.begin(), free_log.end(), [](BlkId const& a, BlkId const& b) {
+        return (a.chunk_num() != b.chunk_num()) ? (a.chunk_num() < b.chunk_num()) : (a.blk_num() < b.blk_num());
+    });
+
+    // Discard has to complete before blks are returned to allocator, otherwise a discard could race with a new write
+    // on a reallocated blk.
+    if (HS_DYNAMIC_CONFIG(device->discard_on_free)) { discard_freed_blks(free_log); }
+
     // All of the blkids which were captured in the current vdev cp context will now be freed and hence available for
     // allocation on the new CP dirty collection session which is ongoing
-    for (auto const& b : v_cp_ctx->m_free_blkid_list) {
-        auto chunk = m_dmgr.get_chunk_mutable(b.chunk_num());
+    size_t start{0};
+    while (start < free_log.size()) {
+        auto const chunk_num = free_log[start].chunk_num();
+        auto end = start + 1;
+        while ((end < free_log.size()) && (free_log[end].chunk_num() == chunk_num)) {
+            ++end;
+        }
+
+        auto chunk = m_dmgr.get_chunk_mutable(chunk_num);
         // try to free a blk in a missing chunk, crash if it happens;
-        if (!chunk) HS_DBG_ASSERT(false, "chunk is missing for blkid {}", b.to_string());
-        BlkAllocator* allocator = chunk->blk_allocator_mutable();
-        allocator->free(b);
+        if (!chunk) HS_DBG_ASSERT(false, "chunk is missing for blkid {}", free_log[start].to_string());
+        for (auto i{start}; i < end; ++i) {
+            chunk->record_free(free_log[i].blk_count());
+        }
+        chunk->blk_allocator_mutable()->free_batch(std::span< BlkId const >{free_log.data() + start, end - start});
+        start = end;
+    }
+}
+
+void VirtualDev::discard_freed_blks(std::vector< BlkId > const& sorted_frees) {
+    if (sorted_frees.empty()) { return; }
+
+    uint64_t const blk_size = block_size();
+    uint64_t const min_size = uint64_cast(HS_DYNAMIC_CONFIG(device->discard_min_size_kb)) * 1024;
+    uint64_t const max_io_size =
+        std::max(uint64_cast(HS_DYNAMIC_CONFIG(device->discard_max_io_size_mb)) * 1024 * 1024, blk_size);
+    uint64_t budget = uint64_cast(HS_DYNAMIC_CONFIG(device->discard_max_mb_per_cp)) * 1024 * 1024;
+
+    auto do_discard = [&](chunk_num_t chunk_num, uint64_t start_blk, uint64_t nblks) {
+        uint64_t size = nblks * blk_size;
+        auto chunk = m_dmgr.get_chunk_mutable(chunk_num);
+        if (!chunk || (size < min_size) || (budget < size)) {
+            COUNTER_INCREMENT(m_metrics, vdev_discard_skipped_bytes, size);
+            return;
+        }
+        budget -= size;
+
+        auto* pdev = chunk->physical_dev_mutable();
+        uint64_t offset = chunk->start_offset() + (start_blk * blk_size);
+        while (size > 0) {
+            auto const this_size = std::min(size, max_io_size);
+            auto const err = pdev->sync_discard(this_size, offset);
+            if (err) {
+                if (err != std::errc::operation_not_supported) {
+                    HS_LOG(WARN, device, "Discard of offset={} size={} on pdev={} failed, error={}", offset,
+                           this_size, pdev->get_devname(), err.message());
+                }
+                COUNTER_INCREMENT(m_metrics, vdev_discard_skipped_bytes, size);
+                return;
+            }
+            COUNTER_INCREMENT(m_metrics, vdev_discard_count, 1);
+            COUNTER_INCREMENT(m_metrics, vdev_discard_bytes, this_size);
+            offset += this_size;
+            size -= this_size;
+        }
+    };
+
+    // Coalesce the adjacent freed blks of each chunk into a single range
+    auto cur_chunk = sorted_frees[0].chunk_num();
+    uint64_t cur_start = sorted_frees[0].blk_num();
+    uint64_t cur_end = cur_start + sorted_frees[0].blk_count();
+    for (size_t i{1}; i < sorted_frees.size(); ++i) {
+        auto const& r = sorted_frees[i];
+        if ((r.chunk_num() == cur_chunk) && (r.blk_num() <= cur_end)) {
+            cur_end = std::max(cur_end, uint64_cast(r.blk_num()) + r.blk_count());
+            continue;
+        }
+        do_discard(cur_chunk, cur_start, cur_end - cur_start);
+        cur_chunk = r.chunk_num();
+        cur_start = r.blk_num();
+        cur_end = cur_start + r.blk_count();
     }
+    do_discard(cur_chunk, cur_start, cur_end - cur_start);
 }
 
 // sync-ops during cp_flush, so return 100;
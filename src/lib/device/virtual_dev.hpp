@@ -15,13 +15,16 @@
 #pragma once
 
 #include <atomic>
+#include <condition_variable>
 #include <functional>
 #include <limits>
 #include <memory>
 #include <map>
 #include <mutex>
+#include <span>
 #include <string>
 #include <system_error>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
@@ -35,6 +38,7 @@
 #include <homestore/checkpoint/cp_mgr.hpp>
 #include <homestore/homestore_decl.hpp>
 #include "device/device.h"
+#include "device/vdev_fair_queue.hpp"
 #include <homestore/chunk_selector.h>
 
 namespace homestore {
@@ -47,6 +51,7 @@ public:
     explicit VirtualDevMetrics(const char* const inst_name) : sisl::MetricsGroupWrapper{"VirtualDev", inst_name} {
         REGISTER_COUNTER(vdev_read_count, "vdev total read cnt");
         REGISTER_COUNTER(vdev_write_count, "vdev total write cnt");
+        REGISTER_COUNTER(vdev_write_bytes, "vdev total bytes written to devices");
         REGISTER_COUNTER(vdev_truncate_count, "vdev total truncate cnt");
         REGISTER_COUNTER(vdev_high_watermark_count, "vdev total high watermark cnt");
         REGISTER_COUNTER(vdev_num_alloc_failure, "vdev blk alloc failure cnt");
@@ -54,6 +59,16 @@ public:
         REGISTER_COUNTER(default_chunk_allocation_cnt, "default chunk allocation count");
         REGISTER_COUNTER(random_chunk_allocation_cnt,
                          "random chunk allocation count"); // ideally it should be zero for hdd
+        REGISTER_COUNTER(vdev_coalesced_ios, "vdev ios saved by coalescing adjacent ios");
+        REGISTER_COUNTER(vdev_discard_count, "vdev discards issued on freed blks");
+        REGISTER_COUNTER(vdev_discard_bytes, "vdev bytes discarded on freed blks");
+        REGISTER_COUNTER(vdev_discard_skipped_bytes, "vdev freed bytes not discarded due to size or rate limits");
+        REGISTER_COUNTER(vdev_striped_allocs, "vdev allocations striped across pdevs");
+        REGISTER_COUNTER(vdev_fair_queued_ios, "vdev ios queued for their fair share of the vdev");
+        REGISTER_HISTOGRAM(vdev_alloc_latency_us, "vdev blk alloc latency (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(vdev_fair_queue_wait_us, "vdev time ios queued for their fair share (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
         register_me_to_farm();
     }
 
@@ -84,15 +99,19 @@ using vdev_event_cb_t = std::function< void(VirtualDev&, vdev_event_t, const std
 class VDevCPContext;
 
 class VirtualDev {
+    friend class VDevIOBatch;
+
 protected:
     vdev_info m_vdev_info;      // This device block info
     DeviceManager& m_dmgr;      // Device Manager back pointer
     std::string m_name;         // Name of the vdev
     vdev_event_cb_t m_event_cb; // Callback registered for any events
     VirtualDevMetrics m_metrics;
+    VDevFairQueue m_fair_queue; // Per tenant accounting and fair share of the async ios addressed by blkid
 
-    std::mutex m_mgmt_mutex;          // Any mutex taken for management operations (like adding/removing chunks).
-    std::set< PhysicalDev* > m_pdevs; // PDevs this vdev is working on
+    std::mutex m_mgmt_mutex;            // Any mutex taken for management operations (like adding/removing chunks).
+    std::set< PhysicalDev* > m_pdevs;   // PDevs this vdev is working on
+    std::atomic< int > m_numa_node{-1}; // Common numa node of m_pdevs, looked up for every buffer placed on it
     std::map< uint16_t, shared< Chunk > > m_all_chunks; // All chunks part of this vdev
     uint64_t m_total_chunk_num{0};                      // Total number of chunks
     std::shared_ptr< ChunkSelector > m_chunk_selector;  // Instance of chunk selector
@@ -100,6 +119,13 @@ protected:
     chunk_selector_type_t m_chunk_selector_type;
     bool m_auto_recovery;
 
+    std::mutex m_lazy_zero_mtx;             // Protects the state of background zeroing thread
+    std::condition_variable m_lazy_zero_cv; // To wake up throttled background zeroing thread on stop
+    std::thread m_lazy_zero_thread;         // Background zeroing of lazily formatted chunks
+    bool m_lazy_zero_running{false};
+    bool m_lazy_zero_stop{false};
+    bool m_lazy_zero_rescan{false}; // New chunks were marked for zeroing while the thread was running
+
 public:
     VirtualDev(DeviceManager& dmgr, const vdev_info& vinfo, vdev_event_cb_t event_cb, bool is_auto_recovery,
                shared< ChunkSelector > custom_chunk_selector = nullptr);
@@ -108,7 +134,7 @@ public:
     VirtualDev& operator=(VirtualDev const& other) = delete;
     VirtualDev(VirtualDev&&) noexcept = delete;
     VirtualDev& operator=(VirtualDev&&) noexcept = delete;
-    virtual ~VirtualDev() = default;
+    virtual ~VirtualDev();
 
     /// @brief Run any initialization of the vdev after recovery or first time.
     virtual void init() {}
@@ -125,7 +151,8 @@ public:
     virtual void remove_chunk(cshared< Chunk >& chunk);
 
     /// @brief Formats the vdev asynchronously by zeroing the entire vdev. It will use underlying physical device
-    /// capabilities to zero them if fast zero is possible, otherwise will zero block by block
+    /// capabilities to zero them if fast zero is possible, otherwise will zero block by block. If lazy format is
+    /// enabled, it only marks the chunks as not zeroed and returns immediately; zeroing happens in background
     /// @param cb Callback after formatting is completed.
     virtual folly::Future< std::error_code > async_format();
 
@@ -148,6 +175,27 @@ public:
     virtual BlkAllocStatus alloc_blks(blk_count_t nblks, blk_alloc_hints const& hints,
                                       std::vector< BlkId >& out_blkids);
 
+    /// @brief Allocates a separate MultiBlkId for each of the sizes, with the same hints. Chunk is selected once for
+    /// the whole batch, so that the allocator can serve it with one pass over its cache. Only the sizes which
+    /// couldn't be served from that chunk go through the regular alloc_blks path.
+    /// @param sizes : Number of blocks for each of the blkids to allocate
+    /// @param hints : Hints about block allocation, applied to every blkid of the batch
+    /// @param out_blkids : Allocated blkids are appended here, in the same order as sizes
+    /// @return BlkAllocStatus : SUCCESS only if all of the sizes are allocated.
+    virtual BlkAllocStatus alloc_blks(std::span< blk_count_t const > sizes, blk_alloc_hints const& hints,
+                                      std::vector< MultiBlkId >& out_blkids);
+
+    /// @brief Allocates nblks striped (RAID-0 style) across chunks on different pdevs, if it is large enough (atleast
+    /// stripe_min_io_kb) and the vdev spans multiple pdevs. It is split in whole stripe units (stripe_unit_kb) into
+    /// a contiguous part of the data on each of the pdevs, which BlkDataService writes in parallel in one batch.
+    /// Otherwise (or if the striped allocation fails) it is allocated as a single MultiBlkId as usual.
+    /// @param nblks : Number of blocks to allocate
+    /// @param hints : Hints about block allocation, chunk_id_hint disables the striping
+    /// @param out_blkids : Allocated blkids are appended here, one per stripe in the order of the data
+    /// @return BlkAllocStatus : SUCCESS only if all of nblks are allocated.
+    BlkAllocStatus alloc_striped_blks(blk_count_t nblks, blk_alloc_hints const& hints,
+                                      std::vector< MultiBlkId >& out_blkids);
+
     /// @brief Checks if a given block id is allocated in the in-memory version of the blk allocator
     /// @param blkid : BlkId to check for allocation
     /// @return true or false
@@ -162,8 +210,27 @@ public:
     /// @return Allocation Status
     virtual BlkAllocStatus commit_blk(BlkId const& blkid);
 
+    /// @brief Marks the blkid allocated in both the in-memory and on-disk version of the blk allocator, when its data
+    /// is copied as is from another replica, instead of being allocated with alloc_blk. Blks of it which are already
+    /// allocated are left as is. Either all the blks are reserved or, on failure, none of them.
+    /// @param blkid BlkId to reserve.
+    /// @param out_reserved Runs of the blks which were not allocated before and are reserved by this call, to be
+    /// released with unreserve_blk if the data copied into them is given up on.
+    /// @return Allocation Status
+    BlkAllocStatus reserve_blk(BlkId const& blkid, std::vector< BlkId >& out_reserved);
+
+    /// @brief Releases the blkid reserved by reserve_blk right away, in both versions of the blk allocator.
+    void unreserve_blk(BlkId const& blkid);
+
+    /// @brief Number of blks of the given chunk of this vdev
+    blk_num_t num_blks_of_chunk(chunk_num_t chunk_num) const;
+
     virtual void free_blk(BlkId const& b, VDevCPContext* vctx = nullptr);
 
+    /// @brief Frees a batch of blkids (could be MultiBlkIds), grouping them per chunk so that each allocator takes
+    /// its locks once for the whole batch. If vctx is provided, they are deferred to the cp flush, same as free_blk
+    virtual void free_blks(std::span< BlkId const > bids, VDevCPContext* vctx = nullptr);
+
     /////////////////////// Write API related methods /////////////////////////////
     /// @brief Asynchornously write the buffer to the device on a given blkid
     /// @param buf : Buffer to write data from
@@ -192,6 +259,19 @@ public:
     folly::Future< std::error_code > async_writev(const iovec* iov, const int iovcnt, cshared< Chunk >& chunk,
                                                   uint64_t offset_in_chunk);
 
+    /// @brief Asynchronously write the buffer across all pieces of the MultiBlkId. Pieces which are physically
+    /// contiguous within a chunk are coalesced into a single device io.
+    /// @param buf : Buffer to write data from, which is split across the pieces in the order of the pieces
+    /// @param size : Size of the buffer
+    /// @param bid : MultiBlkId which was previously allocated.
+    /// @param part_of_batch : Is this write part of batch io. If true, caller is expected to call submit_batch at
+    /// the end of the batch.
+    /// @return future< std::error_code > Future result of success or first failure among all pieces
+    folly::Future< std::error_code > async_write(const char* buf, uint32_t size, MultiBlkId const& bid,
+                                                 bool part_of_batch = false);
+    folly::Future< std::error_code > async_writev(const iovec* iov, int iovcnt, MultiBlkId const& bid,
+                                                  bool part_of_batch = false);
+
     /// @brief Synchronously write the buffer to the blkid
     /// @param buf : Buffer to write data from
     /// @param size : Size of the buffer
@@ -210,7 +290,9 @@ public:
     std::error_code sync_writev(const iovec* iov, int iovcnt, BlkId const& bid);
 
     // TODO: This needs to be removed once Journal starting to use AppendBlkAllocator
-    std::error_code sync_writev(const iovec* iov, int iovcnt, cshared< Chunk >& chunk, uint64_t offset_in_chunk);
+    // If fua is set, returns only after the data is durable on the media (see PhysicalDev::sync_writev_fua)
+    std::error_code sync_writev(const iovec* iov, int iovcnt, cshared< Chunk >& chunk, uint64_t offset_in_chunk,
+                                bool fua = false);
 
     /////////////////////// Read API related methods /////////////////////////////
 
@@ -234,6 +316,10 @@ public:
     folly::Future< std::error_code > async_readv(iovec* iovs, int iovcnt, uint64_t size, BlkId const& bid,
                                                  bool part_of_batch = false);
 
+    // TODO: This needs to be removed once Journal starting to use AppendBlkAllocator
+    folly::Future< std::error_code > async_read(char* buf, uint32_t size, cshared< Chunk >& chunk,
+                                                uint64_t offset_in_chunk);
+
     /// @brief Synchronously read the data for a given BlkId.
     /// @param buf : Buffer to read data to
     /// @param size : Size of the buffer
@@ -263,6 +349,9 @@ public:
     /// @brief Submit the batch of IOs previously queued as part of async read/write APIs.
     void submit_batch();
 
+    /// @brief Submit the batch of IOs queued on the given set of pdevs, ringing each distinct queue only once.
+    static void submit_batch(const std::set< PhysicalDev* >& pdevs);
+
     ////////////////////// Checkpointing related methods ///////////////////////////
     /// @brief
     ///
@@ -278,6 +367,7 @@ public:
     virtual uint64_t available_blks() const;
     virtual uint64_t size() const { return m_vdev_info.vdev_size; }
     virtual uint64_t used_size() const;
+    uint64_t written_bytes() const; // Written to all its chunks, since start
     virtual uint64_t num_chunks() const { return m_vdev_info.num_primary_chunks; }
     virtual uint32_t block_size() const { return m_vdev_info.blk_size; }
     virtual vdev_info info() const { return m_vdev_info; }
@@ -289,6 +379,13 @@ public:
 
     uint32_t align_size() const;
     uint32_t optimal_page_size() const;
+
+    /// @brief Device write stream this vdev's writes on the given pdev are tagged with, so that each vdev lands on its
+    /// own reclaim unit. 0 if the pdev doesn't support write streams.
+    uint8_t write_stream(PhysicalDev const* pdev) const;
+
+    /// @brief NUMA node all the pdevs of this vdev are attached to. -1 if unknown or if pdevs span multiple nodes
+    int numa_node() const { return m_numa_node.load(std::memory_order_relaxed); }
     uint32_t atomic_page_size() const;
 
     static uint64_t get_len(const iovec* iov, int iovcnt);
@@ -300,11 +397,37 @@ public:
     ///////////////////////// Meta operations on vdev ////////////////////////
     void update_vdev_private(const sisl::blob& data);
 
+    ///////////////////////// Per tenant share of the vdev ////////////////////////
+    /// @brief Set the share of the ios of the tenant (see io_tenant_guard) relative to the other tenants, once the
+    /// vdev is contended (fair_share_max_inflight_ios). 0 resets it to fair_share_default_weight.
+    void set_io_tenant_weight(io_tenant_t tenant, uint32_t weight) { m_fair_queue.set_weight(tenant, weight); }
+
+    /// @brief Drop the accounting of the tenant, when it is gone
+    void remove_io_tenant(io_tenant_t tenant) { m_fair_queue.remove_tenant(tenant); }
+
+    /// @brief Ios and bytes read and written so far by each tenant, and the ios queued for their share
+    nlohmann::json io_tenant_usage() const { return m_fair_queue.usage(); }
+
 private:
     uint64_t to_dev_offset(BlkId const& b, Chunk** chunk) const;
     bool is_chunk_available(cshared< Chunk >& chunk) const;
+    std::error_code sync_read_lazy_zeroed(Chunk* chunk, iovec* iov, int iovcnt, uint64_t size, uint64_t dev_offset);
+    folly::Future< std::error_code > async_read_lazy_zeroed(Chunk* chunk, iovec* iov, int iovcnt, uint64_t size,
+                                                            uint64_t dev_offset, bool part_of_batch);
+    /// Issues the write once its area of the chunk is zeroed, right away unless the chunk has to be lazily zeroed upto
+    /// it first. defer is called only then, for an issue fn owning anything the write refers to which need not outlive
+    /// this call.
+    template < typename IssueFn, typename DeferFn >
+    folly::Future< std::error_code > when_zeroed(Chunk* chunk, uint64_t dev_offset, uint64_t size, IssueFn&& issue_now,
+                                                 DeferFn&& defer);
+    void start_lazy_zeroing();
+    void stop_lazy_zeroing();
+    void lazy_zero_loop();
+    void discard_freed_blks(std::vector< BlkId > const& sorted_frees);
+    void free_per_chunk(std::map< chunk_num_t, std::vector< BlkId > > const& per_chunk);
     BlkAllocStatus alloc_blks_from_chunk(blk_count_t nblks, blk_alloc_hints const& hints, MultiBlkId& out_blkid,
                                          Chunk* chunk);
+    int pdevs_numa_node() const; // Expects m_mgmt_mutex to be held
 };
 
 // place holder for future needs in which components underlying virtualdev needs cp flush context;
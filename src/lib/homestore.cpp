@@ -13,14 +13,23 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <cstdint>
+#include <functional>
+#include <future>
 #include <mutex>
+#include <numeric>
 #include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <boost/intrusive_ptr.hpp>
 
 #include <sisl/fds/malloc_helper.hpp>
 #include <sisl/fds/buffer.hpp>
 #include <sisl/logging/logging.h>
+#include <sisl/metrics/metrics.hpp>
 #include <sisl/cache/lru_evictor.hpp>
 
 #include <homestore/blkdata_service.hpp>
@@ -29,6 +38,7 @@
 #include <homestore/index_service.hpp>
 #include <homestore/homestore.hpp>
 #include <homestore/checkpoint/cp_mgr.hpp>
+#include <homestore/tracer.hpp>
 
 #include "index/wb_cache.hpp"
 #include "common/homestore_utils.hpp"
@@ -99,6 +109,8 @@ HomeStore& HomeStore::with_crash_simulator(std::function< void(void) > cb) {
 #endif
 
 bool HomeStore::start(const hs_input_params& input, hs_before_services_starting_cb_t svcs_starting_cb) {
+    m_start_time = Clock::now();
+    m_start_phases.clear();
     auto& hs_config = HomeStoreStaticConfig::instance();
     hs_config.input = input;
 
@@ -148,10 +160,14 @@ bool HomeStore::start(const hs_input_params& input, hs_before_services_starting_
         }
     }
     m_cp_mgr = std::make_unique< CPManager >();
+    auto const dev_load_start = Clock::now();
+    add_start_phase("services", m_start_time, dev_load_start);
     m_dev_mgr = std::make_unique< DeviceManager >(input.devices, bind_this(HomeStore::create_vdev_cb, 2));
 
     if (!m_dev_mgr->is_first_time_boot()) {
         m_dev_mgr->load_devices();
+        m_dev_load_ms = get_elapsed_time_ms(dev_load_start);
+        add_start_phase("devices", dev_load_start, Clock::now());
         if (input.has_fast_dev()) {
             hs_utils::set_btree_mempool_size(m_dev_mgr->atomic_page_size({HSDevType::Fast}));
         } else {
@@ -160,11 +176,13 @@ bool HomeStore::start(const hs_input_params& input, hs_before_services_starting_
         do_start();
         return false;
     } else {
+        add_start_phase("devices", dev_load_start, Clock::now());
         return true;
     }
 }
 
 void HomeStore::format_and_start(std::map< uint32_t, hs_format_params >&& format_opts) {
+    auto const format_start = Clock::now();
     std::map< HSDevType, float > total_pct_by_type = {{HSDevType::Fast, 0.0f}, {HSDevType::Data, 0.0f}};
     // Accumulate total percentage of services on each device type
     for (const auto& [svc_type, fparams] : format_opts) {
@@ -215,14 +233,15 @@ void HomeStore::format_and_start(std::map< uint32_t, hs_format_params >&& format
         } else if ((svc_type & HS_SERVICE::INDEX) && has_index_service()) {
             m_index_service->create_vdev(pct_to_size(fparams.size_pct, fparams.dev_type), fparams.dev_type,
                                          fparams.num_chunks);
-        } else if ((svc_type & HS_SERVICE::DATA) && has_data_service()) {
+        } else if (((svc_type & HS_SERVICE::DATA) && has_data_service()) ||
+                   ((svc_type & HS_SERVICE::REPLICATION) && has_repl_data_service())) {
+            uint64_t const fast_tier_size =
+                ((fparams.fast_tier_size_pct > 0) && HomeStoreStaticConfig::instance().input.has_fast_dev())
+                ? pct_to_size(fparams.fast_tier_size_pct, HSDevType::Fast)
+                : 0;
             m_data_service->create_vdev(pct_to_size(fparams.size_pct, fparams.dev_type), fparams.dev_type,
                                         fparams.block_size, fparams.alloc_type, fparams.chunk_sel_type,
-                                        fparams.num_chunks);
-        } else if ((svc_type & HS_SERVICE::REPLICATION) && has_repl_data_service()) {
-            m_data_service->create_vdev(pct_to_size(fparams.size_pct, fparams.dev_type), fparams.dev_type,
-                                        fparams.block_size, fparams.alloc_type, fparams.chunk_sel_type,
-                                        fparams.num_chunks);
+                                        fparams.num_chunks, fast_tier_size);
         }
     }
 
@@ -233,40 +252,260 @@ void HomeStore::format_and_start(std::map< uint32_t, hs_format_params >&& format
             HS_REL_ASSERT(!err, "IO error during format of vdev, error={}", err.message());
         }
     }
+    add_start_phase("format", format_start, Clock::now());
     do_start();
 }
 
+namespace {
+// Step of homestore start, which is run only after the steps it depends on are done
+struct start_step {
+    std::string name;
+    std::vector< std::string > deps;
+    std::function< void() > start;
+};
+
+using start_times_t = std::vector< std::pair< std::string, uint64_t > >;
+
+struct step_time {
+    Clock::time_point start;
+    Clock::time_point end;
+};
+
+// Runs the steps in the order of their dependencies, each step on a thread of its own if parallel (as soon as the
+// steps it depends on are done), and returns when each of them started and ended. Failure of a step is rethrown once
+// all the steps not depending on it are done.
+std::vector< step_time > run_start_steps(std::vector< start_step > const& steps, bool parallel) {
+    std::unordered_map< std::string, size_t > idx_of;
+    std::unordered_map< std::string, std::vector< std::string > > dag;
+    for (size_t i{0}; i < steps.size(); ++i) {
+        idx_of[steps[i].name] = i;
+        dag[steps[i].name];
+    }
+    for (auto const& step : steps) {
+        for (auto const& dep : step.deps) {
+            HS_REL_ASSERT(idx_of.contains(dep), "Start step={} depends on step={} which is not there", step.name, dep);
+            dag[dep].push_back(step.name);
+        }
+    }
+    std::vector< std::string > order;
+    HS_REL_ASSERT(!hs_utils::topological_sort(dag, order), "Dependencies of the homestore start steps form a cycle");
+
+    std::vector< step_time > times(steps.size());
+    if (!parallel) {
+        for (auto const& name : order) {
+            auto const idx = idx_of[name];
+            times[idx].start = Clock::now();
+            steps[idx].start();
+            times[idx].end = Clock::now();
+        }
+    } else {
+        std::vector< std::promise< void > > done(steps.size());
+        std::vector< std::shared_future< void > > done_futs;
+        for (auto& p : done) {
+            done_futs.push_back(p.get_future().share());
+        }
+
+        std::vector< std::thread > threads;
+        for (size_t i{0}; i < steps.size(); ++i) {
+            threads.emplace_back([&steps, &idx_of, &done, &done_futs, &times, i]() {
+                try {
+                    for (auto const& dep : steps[i].deps) {
+                        done_futs[idx_of.at(dep)].get(); // Rethrows the failure of the dependency
+                    }
+                    times[i].start = Clock::now();
+                    steps[i].start();
+                    times[i].end = Clock::now();
+                    done[i].set_value();
+                } catch (...) { done[i].set_exception(std::current_exception()); }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (auto& f : done_futs) {
+            f.get();
+        }
+    }
+
+    return times;
+}
+
+nlohmann::json start_times_json(start_times_t const& times) {
+    nlohmann::json j;
+    for (auto const& [name, ms] : times) {
+        j[name] = ms;
+    }
+    return j;
+}
+
+nlohmann::json start_phases_json(std::vector< hs_start_phase > const& phases) {
+    nlohmann::json j = nlohmann::json::array();
+    for (auto const& p : phases) {
+        j.push_back(nlohmann::json{{"name", p.name}, {"start_ms", p.start_ms}, {"took_ms", p.took_ms}});
+    }
+    return j;
+}
+
+class HomeStoreStartMetrics : public sisl::MetricsGroup {
+public:
+    HomeStoreStartMetrics() : sisl::MetricsGroup("homestore_start", "homestore_start") {
+        REGISTER_GAUGE(start_total_ms, "Time from HomeStore::start till it is ready to take io, on this boot");
+        REGISTER_GAUGE(start_devices_ms, "Time discovering and loading the devices took on this boot");
+        REGISTER_GAUGE(start_format_ms, "Time formatting the devices took, on first boot");
+        REGISTER_GAUGE(start_meta_ms, "Time meta service (replaying the superblks) took to start on this boot");
+        REGISTER_GAUGE(start_cp_ms, "Time cp manager took to start on this boot");
+        REGISTER_GAUGE(start_index_ms, "Time index service (index recovery) took to start on this boot");
+        REGISTER_GAUGE(start_data_ms, "Time data service took to start on this boot");
+        REGISTER_GAUGE(start_repl_load_ms, "Time loading the repl devs took on this boot");
+        REGISTER_GAUGE(start_log_ms, "Time log service (log replay) took to start on this boot");
+        REGISTER_GAUGE(start_repl_ms, "Time starting the repl devs (joining raft groups) took on this boot");
+        register_me_to_farm();
+    }
+
+    HomeStoreStartMetrics(const HomeStoreStartMetrics&) = delete;
+    HomeStoreStartMetrics& operator=(const HomeStoreStartMetrics&) = delete;
+    ~HomeStoreStartMetrics() { deregister_me_from_farm(); }
+
+    void update(std::string const& phase, uint64_t ms) {
+        auto& metrics = *this;
+        if (phase == "total") {
+            GAUGE_UPDATE(metrics, start_total_ms, ms);
+        } else if (phase == "devices") {
+            GAUGE_UPDATE(metrics, start_devices_ms, ms);
+        } else if (phase == "format") {
+            GAUGE_UPDATE(metrics, start_format_ms, ms);
+        } else if (phase == "meta") {
+            GAUGE_UPDATE(metrics, start_meta_ms, ms);
+        } else if (phase == "cp") {
+            GAUGE_UPDATE(metrics, start_cp_ms, ms);
+        } else if (phase == "index") {
+            GAUGE_UPDATE(metrics, start_index_ms, ms);
+        } else if (phase == "data") {
+            GAUGE_UPDATE(metrics, start_data_ms, ms);
+        } else if (phase == "repl_load") {
+            GAUGE_UPDATE(metrics, start_repl_load_ms, ms);
+        } else if (phase == "log") {
+            GAUGE_UPDATE(metrics, start_log_ms, ms);
+        } else if (phase == "repl") {
+            GAUGE_UPDATE(metrics, start_repl_ms, ms);
+        }
+    }
+};
+
+// Outlives the restarts of homestore, so the gauges are of the latest boot
+HomeStoreStartMetrics& start_metrics() {
+    static HomeStoreStartMetrics s_metrics;
+    return s_metrics;
+}
+} // namespace
+
+void HomeStore::add_start_phase(std::string const& name, Clock::time_point phase_start, Clock::time_point phase_end) {
+    m_start_phases.push_back(hs_start_phase{.name = name,
+                                            .start_ms = get_elapsed_time_us(m_start_time, phase_start) / 1000,
+                                            .took_ms = get_elapsed_time_us(phase_start, phase_end) / 1000});
+    start_metrics().update(name, m_start_phases.back().took_ms);
+}
+
 void HomeStore::do_start() {
     const auto& inp_params = HomeStoreStaticConfig::instance().input;
 
     uint64_t cache_size = resource_mgr().get_cache_size();
-    m_evictor = std::make_shared< sisl::LRUEvictor >(cache_size, 1000);
-
-    if (m_before_services_starting_cb) { m_before_services_starting_cb(); }
+    // Index has a cache of its own (IndexNodeCache), evictor is for the rest of the caches
+    uint64_t const evictor_size =
+        has_index_service() ? (cache_size - resource_mgr().get_index_cache_size()) : cache_size;
+    m_evictor = std::make_shared< sisl::LRUEvictor >(evictor_size, 1000);
+
+    if (m_before_services_starting_cb) {
+        auto const cb_start = Clock::now();
+        m_before_services_starting_cb();
+        add_start_phase("before_services_cb", cb_start, Clock::now());
+    }
 
     LOGINFO("HomeStore starting first_time_boot?={} dynamic_config_version={}, cache_size={}, static_config: {}",
             m_dev_mgr->is_first_time_boot(), HS_DYNAMIC_CONFIG(version), cache_size,
             HomeStoreStaticConfig::instance().to_json().dump(4));
 
-    m_meta_service->start(m_dev_mgr->is_first_time_boot());
-    m_cp_mgr->start(is_first_time_boot());
-
-    if (has_index_service()) { m_index_service->start(); }
+    // Meta service replays the superblks of all the services, beyond which they recover independent of each other
+    // but for the log stores, which are replayed into the repl devs and the consumers (committing into the index)
+    bool const log_waits_for_index = has_index_service() && HS_DYNAMIC_CONFIG(generic.log_recovery_waits_for_index);
+    std::vector< start_step > steps;
+    steps.push_back({"meta", {}, [this]() { m_meta_service->start(m_dev_mgr->is_first_time_boot()); }});
+    steps.push_back({"cp", {"meta"}, [this]() { m_cp_mgr->start(is_first_time_boot()); }});
+    if (has_index_service()) {
+        steps.push_back({"index", {"cp"}, [this]() { m_index_service->start(); }});
+    }
 
     if (has_repl_data_service()) {
-        s_cast< GenericReplService* >(m_repl_service.get())->start(); // Replservice starts logstore & data service
+        auto* repl_svc = s_cast< GenericReplService* >(m_repl_service.get());
+        steps.push_back({"data", {"cp"}, [this]() { m_data_service->start(); }});
+        // Listeners of the repl devs are created as they are loaded, ahead of the log replay into them
+        std::vector< std::string > load_deps{"cp"};
+        if (log_waits_for_index) { load_deps.push_back("index"); }
+        steps.push_back({"repl_load", std::move(load_deps), [repl_svc]() { repl_svc->load_repl_devs(); }});
+        steps.push_back({"log", {"repl_load", "data"}, [this]() { m_log_service->start(is_first_time_boot()); }});
+
+        std::vector< std::string > repl_deps{"log"};
+        if (has_index_service()) { repl_deps.push_back("index"); }
+        steps.push_back({"repl", std::move(repl_deps), [repl_svc]() { repl_svc->start_repl_devs(); }});
     } else {
-        if (has_data_service()) { m_data_service->start(); }
+        if (has_data_service()) {
+            steps.push_back({"data", {"cp"}, [this]() { m_data_service->start(); }});
+        }
         if (has_log_service() && inp_params.auto_recovery) {
             // In case of custom recovery, let consumer starts the recovery and it is consumer module's responsibilities
             // to start log store
-            m_log_service->start(is_first_time_boot() /* format */);
+            std::vector< std::string > log_deps{"cp"};
+            if (has_data_service()) { log_deps.push_back("data"); }
+            if (log_waits_for_index) { log_deps.push_back("index"); }
+            steps.push_back({"log", std::move(log_deps), [this]() { m_log_service->start(is_first_time_boot()); }});
         }
     }
 
+    auto const start_time = Clock::now();
+    auto const step_times = run_start_steps(steps, HS_DYNAMIC_CONFIG(generic.parallel_service_start));
+
+    // Phases of the services in the order they started, which is not the order of the steps when started in parallel
+    std::vector< size_t > step_order(steps.size());
+    std::iota(step_order.begin(), step_order.end(), 0);
+    std::sort(step_order.begin(), step_order.end(),
+              [&step_times](size_t a, size_t b) { return step_times[a].start < step_times[b].start; });
+    for (auto const i : step_order) {
+        add_start_phase(steps[i].name, step_times[i].start, step_times[i].end);
+    }
+
+    m_svc_start_times_ms.clear();
+    if (!m_dev_mgr->is_first_time_boot()) { m_svc_start_times_ms.emplace_back("devices", m_dev_load_ms); }
+    for (size_t i{0}; i < steps.size(); ++i) {
+        m_svc_start_times_ms.emplace_back(steps[i].name,
+                                          get_elapsed_time_us(step_times[i].start, step_times[i].end) / 1000);
+    }
+    LOGINFO("HomeStore services started in {} ms, time taken by each: {}", get_elapsed_time_ms(start_time),
+            start_times_json(m_svc_start_times_ms).dump());
+    m_status_mgr->register_status_cb("HomeStore", [this](int) {
+        return nlohmann::json{{"service_start_ms", start_times_json(m_svc_start_times_ms)},
+                              {"start_phases", start_phases_json(m_start_phases)},
+                              {"start_total_ms", m_start_total_ms}};
+    });
+    m_status_mgr->register_status_cb("Capacity",
+                                     [this](int verbosity) { return m_resource_mgr->capacity_status(verbosity); });
+    if (has_data_service()) {
+        m_status_mgr->register_status_cb("IOTenants", [this](int) { return m_data_service->io_tenant_usage(); });
+    }
+    m_status_mgr->register_status_cb("Tracer", [](int verbosity) {
+        return nlohmann::json{{"sample_every", HS_DYNAMIC_CONFIG(generic.trace_sample_every)},
+                              {"traces", Tracer::dump((verbosity > 0) ? 256 : 16)}};
+    });
+
+    auto const ready_start = Clock::now();
     m_cp_mgr->start_timer();
 
     m_resource_mgr->start(m_dev_mgr->total_capacity());
+    auto const ready_time = Clock::now();
+    add_start_phase("ready", ready_start, ready_time);
+    m_start_total_ms = get_elapsed_time_us(m_start_time, ready_time) / 1000;
+    start_metrics().update("total", m_start_total_ms);
+    LOGINFO("HomeStore is ready to take io in {} ms since start, phases: {}", m_start_total_ms,
+            start_phases_json(m_start_phases).dump());
     m_init_done = true;
 }
 
@@ -446,6 +685,20 @@ nlohmann::json hs_input_params::to_json() const {
     return json;
 }
 
+std::vector< vdev_capacity_rate > HomeStore::capacity_rates(bool recent) const {
+    return m_resource_mgr->capacity_rates(recent);
+}
+
+nlohmann::json vdev_capacity_rate::to_json() const {
+    return nlohmann::json{{"name", name},
+                          {"size", size},
+                          {"used_size", used_size},
+                          {"write_bytes_ps", write_bytes_ps},
+                          {"used_bytes_ps", used_bytes_ps},
+                          {"secs_to_full", secs_to_full},
+                          {"is_journal", is_journal}};
+}
+
 nlohmann::json hs_engine_config::to_json() const {
     nlohmann::json json;
     json["max_chunks"] = max_chunks;
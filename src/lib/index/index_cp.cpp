@@ -31,20 +31,7 @@ void IndexCPContext::add_to_txn_journal(uint32_t index_ordinal, const IndexBuffe
     auto record_size = txn_record::size_for_num_ids(created_bufs.size() + freed_bufs.size() + (left_child_buf ? 1 : 0) +
                                                     (parent_buf ? 1 : 0));
     std::unique_lock< iomgr::FiberManagerLib::mutex > lg{m_txn_journal_mtx};
-    if (m_txn_journal_buf.bytes() == nullptr) {
-        m_txn_journal_buf =
-            std::move(sisl::io_blob_safe{std::max(sizeof(txn_journal), 512ul), 512, sisl::buftag::metablk});
-        txn_journal* tj = new (m_txn_journal_buf.bytes()) txn_journal();
-        tj->cp_id = id();
-    }
-
-    txn_journal* tj = r_cast< txn_journal* >(m_txn_journal_buf.bytes());
-    if (m_txn_journal_buf.size() < tj->size + record_size) {
-        m_txn_journal_buf.buf_realloc(m_txn_journal_buf.size() + std::max(tj->size + record_size, 512u), 512,
-                                      sisl::buftag::metablk);
-        tj = r_cast< txn_journal* >(m_txn_journal_buf.bytes());
-    }
-
+    txn_journal* tj = reserve_journal(record_size);
     {
         auto rec = tj->append_record(index_ordinal);
         if (parent_buf) {
@@ -61,6 +48,83 @@ void IndexCPContext::add_to_txn_journal(uint32_t index_ordinal, const IndexBuffe
     }
 }
 
+// Makes room for size bytes after the records in the journal, creating the journal if not already. Expects the caller
+// to hold the journal lock.
+IndexCPContext::txn_journal* IndexCPContext::reserve_journal(uint32_t size) {
+    if (m_txn_journal_buf.bytes() == nullptr) {
+        m_txn_journal_buf =
+            std::move(sisl::io_blob_safe{std::max(sizeof(txn_journal), 512ul), 512, sisl::buftag::metablk});
+        txn_journal* tj = new (m_txn_journal_buf.bytes()) txn_journal();
+        tj->cp_id = id();
+    }
+
+    txn_journal* tj = r_cast< txn_journal* >(m_txn_journal_buf.bytes());
+    if (m_txn_journal_buf.size() < tj->size + size) {
+        m_txn_journal_buf.buf_realloc(m_txn_journal_buf.size() + std::max(tj->size + size, 512u), 512,
+                                      sisl::buftag::metablk);
+        tj = r_cast< txn_journal* >(m_txn_journal_buf.bytes());
+    }
+    return tj;
+}
+
+void IndexCPContext::add_deltas_to_journal(node_delta_map_t const& deltas) {
+    if (deltas.empty()) { return; }
+
+    uint32_t section_size{sizeof(delta_journal)};
+    for (auto const& [_, d] : deltas) {
+        section_size += sizeof(delta_record) + uint32_cast(d.ranges.size());
+    }
+
+    std::unique_lock< iomgr::FiberManagerLib::mutex > lg{m_txn_journal_mtx};
+    txn_journal* tj = reserve_journal(section_size);
+
+    // Delta section is not part of tj->size, so that txn records are parsed as is
+    uint8_t* cur_ptr = uintptr_cast(tj) + tj->size;
+    delta_journal* dj = new (cur_ptr) delta_journal();
+    dj->cp_id = id();
+    cur_ptr += sizeof(delta_journal);
+    for (auto const& [blkid, d] : deltas) {
+        delta_record* rec = new (cur_ptr) delta_record();
+        rec->blkid = std::make_pair(blkid.blk_num(), blkid.chunk_num());
+        rec->cp_id = d.cp_id;
+        rec->ranges_size = uint32_cast(d.ranges.size());
+        rec->blk_count = blkid.blk_count();
+        cur_ptr += sizeof(delta_record);
+        std::memcpy(cur_ptr, d.ranges.data(), d.ranges.size());
+        cur_ptr += d.ranges.size();
+        ++dj->num_deltas;
+    }
+    dj->size = section_size;
+}
+
+IndexCPContext::node_delta_map_t IndexCPContext::recover_deltas(sisl::byte_view sb) {
+    node_delta_map_t deltas;
+    if ((sb.bytes() == nullptr) || (sb.size() < sizeof(txn_journal))) { return deltas; }
+
+    txn_journal const* tj = r_cast< txn_journal const* >(sb.bytes());
+    if (tj->size + sizeof(delta_journal) > sb.size()) { return deltas; }
+
+    // Bytes past the records are either a delta section of the same cp or left over from the buffer allocation
+    delta_journal const* dj = r_cast< delta_journal const* >(sb.bytes() + tj->size);
+    bool const has_blk_count = (dj->magic == delta_journal_magic);
+    if ((!has_blk_count && (dj->magic != delta_journal_magic_v0)) || (dj->cp_id != tj->cp_id) ||
+        (tj->size + dj->size > sb.size())) {
+        return deltas;
+    }
+
+    uint8_t const* cur_ptr = r_cast< uint8_t const* >(dj) + sizeof(delta_journal);
+    for (uint32_t i{0}; i < dj->num_deltas; ++i) {
+        delta_record const* rec = r_cast< delta_record const* >(cur_ptr);
+        cur_ptr += has_blk_count ? sizeof(delta_record) : (sizeof(delta_record) - sizeof(blk_count_t));
+        auto const nblks = has_blk_count ? rec->blk_count : blk_count_t{1};
+        auto& d = deltas[BlkId{rec->blkid.first, nblks, rec->blkid.second}];
+        d.cp_id = rec->cp_id;
+        d.ranges.assign(cur_ptr, cur_ptr + rec->ranges_size);
+        cur_ptr += rec->ranges_size;
+    }
+    return deltas;
+}
+
 void IndexCPContext::add_to_dirty_list(const IndexBufferPtr& buf) {
     m_dirty_buf_list.push_back(buf);
     buf->set_state(index_buf_state_t::DIRTY);
@@ -169,7 +233,8 @@ std::map< BlkId, IndexBufferPtr > IndexCPContext::recover(sisl::byte_view sb) {
         HS_DBG_ASSERT_LT(tj->cp_id, id(), "Persisted cp in wb txn journal is more than current cp");
         return {};
     }
-    HS_DBG_ASSERT_GT(tj->num_txns, 0, "Invalid txn_journal, num_txns is zero");
+    // Journal could carry only the deltas of the cp
+    if (tj->num_txns == 0) { return {}; }
     HS_DBG_ASSERT_GT(tj->size, 0, "Invalid txn_journal, size of records is zero");
 
     std::map< BlkId, IndexBufferPtr > buf_map;
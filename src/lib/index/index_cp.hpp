@@ -15,6 +15,8 @@
  *********************************************************************************/
 #pragma once
 #include <atomic>
+#include <unordered_map>
+#include <vector>
 #include <sisl/fds/concurrent_insert_vector.hpp>
 #include <homestore/blk.h>
 #include <homestore/index/index_internal.hpp>
@@ -40,7 +42,7 @@ public:
         uint8_t has_inplace_child : 1;
         uint8_t is_parent_meta : 1; // Is the parent buffer a meta buffer
         uint8_t reserved1 : 5;
-        uint8_t reserved{0};
+        uint8_t node_blk_count{0}; // Blks of each node of the table, 0 (as in the records of older versions) is 1
         uint32_t index_ordinal;
         compact_blkid_t ids[1]; // C++ std probhits 0 size array
 
@@ -59,6 +61,13 @@ public:
         uint32_t size() const { return sizeof(txn_record) - (total_ids() - 1) * sizeof(compact_blkid_t); }
         static uint32_t size_for_num_ids(uint8_t n) { return sizeof(txn_record) + (n - 1) * sizeof(compact_blkid_t); }
         void append(op_t op, BlkId const& blk) {
+            if (!is_parent_meta || (op != op_t::parent_inplace)) {
+                // All the nodes of a table are of the same size
+                DEBUG_ASSERT_LE(blk.blk_count(), 0xff, "Node of too many blks for txn record");
+                DEBUG_ASSERT((node_blk_count == 0) || (node_blk_count == blk.blk_count()),
+                             "Nodes of different sizes in same txn record");
+                node_blk_count = s_cast< uint8_t >(blk.blk_count());
+            }
             if (op == op_t::parent_inplace) {
                 DEBUG_ASSERT(has_inplace_parent == 0x0, "Duplicate inplace parent in same txn record");
                 has_inplace_parent = 0x1;
@@ -78,7 +87,7 @@ public:
 
         BlkId blk_id(uint8_t idx) const {
             DEBUG_ASSERT_LT(idx, total_ids(), "Index out of bounds");
-            return BlkId{ids[idx].first, (blk_count_t)1u, ids[idx].second};
+            return BlkId{ids[idx].first, s_cast< blk_count_t >(std::max(node_blk_count, uint8_t{1})), ids[idx].second};
         }
     };
 
@@ -104,8 +113,39 @@ public:
             return append_guard(this, ordinal);
         }
     };
+
+    // Section of deltas which follows the txn records in the journal. Each delta brings the on-disk image of a leaf
+    // node, which was not rewritten, upto the image of the cp in the delta.
+    static constexpr uint64_t delta_journal_magic{0xDE17AB1E0DE17A01};
+    static constexpr uint64_t delta_journal_magic_v0{0xDE17AB1E0DE17A00}; // Records without blk_count, of 1 blk nodes
+    struct delta_journal {
+        uint64_t magic{delta_journal_magic};
+        cp_id_t cp_id;
+        uint32_t num_deltas{0};
+        uint32_t size{sizeof(delta_journal)}; // Total size including this header
+    };
+
+    struct delta_record {
+        compact_blkid_t blkid;
+        cp_id_t cp_id;       // Modified cp id of the node image after applying this delta
+        uint32_t ranges_size; // Size of the ranges following this header
+        blk_count_t blk_count; // Of the node, not in the records of delta_journal_magic_v0
+    };
+
+    struct delta_range {
+        uint32_t offset;
+        uint32_t len; // Followed by len bytes of the node at offset
+    };
 #pragma pack()
 
+    // In memory form of a delta, ranges are serialized as delta_range each followed by its bytes
+    struct node_delta {
+        cp_id_t cp_id;
+        cp_id_t retire_cp_id{-1}; // Once the node is rewritten or freed, delta is journaled upto this cp
+        std::vector< uint8_t > ranges;
+    };
+    using node_delta_map_t = std::unordered_map< BlkId, node_delta >;
+
 public:
     std::atomic< uint64_t > m_num_nodes_added{0};
     std::atomic< uint64_t > m_num_nodes_removed{0};
@@ -117,6 +157,15 @@ public:
     iomgr::FiberManagerLib::mutex m_txn_journal_mtx;
     sisl::io_blob_safe m_txn_journal_buf;
 
+    // Flush stats of each index table (by ordinal) in this cp, updated as the bufs are flushed (under flush lock)
+    struct table_flush_stats {
+        uint64_t num_nodes{0};
+        uint64_t flushed_bytes{0};
+        Clock::time_point last_flushed_time;
+    };
+    std::unordered_map< uint32_t, table_flush_stats > m_table_flush_stats;
+    Clock::time_point m_flush_start_time;
+
 public:
     IndexCPContext(CP* cp);
     virtual ~IndexCPContext() = default;
@@ -129,6 +178,12 @@ public:
 
     sisl::io_blob_safe const& journal_buf() const { return m_txn_journal_buf; }
 
+    /// @brief Append the deltas after the txn records of the journal. Expected to be called once, at cp flush
+    void add_deltas_to_journal(node_delta_map_t const& deltas);
+
+    /// @brief Get the deltas of the journal, irrespective of whether the cp of the journal had completed
+    static node_delta_map_t recover_deltas(sisl::byte_view sb);
+
     void add_to_dirty_list(const IndexBufferPtr& buf);
     bool any_dirty_buffers() const;
     void prepare_flush_iteration();
@@ -137,6 +192,7 @@ public:
     std::string to_string_with_dags();
 
 private:
+    txn_journal* reserve_journal(uint32_t size);
     void check_cycle();
     void check_cycle_recurse(IndexBufferPtr buf, std::set< IndexBuffer* >& visited) const;
     void check_wait_for_leaders();
@@ -157,6 +213,10 @@ public:
     void cp_cleanup(CP* cp) override;
     int cp_progress_percent() override;
 
+    // Index entries persisted in a cp point to data blks allocated upto it, which have to be durable in the data
+    // service allocators by then
+    std::vector< cp_consumer_t > cp_flush_depends_on() const override { return {cp_consumer_t::BLK_DATA_SVC}; }
+
 private:
     IndexWBCache* m_wb_cache;
 };
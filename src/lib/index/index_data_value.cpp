@@ -0,0 +1,98 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+
+#include <sisl/fds/buffer.hpp>
+#include <homestore/blkdata_service.hpp>
+#include <homestore/homestore.hpp>
+#include <homestore/index/index_data_value.hpp>
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+
+namespace homestore {
+void IndexDataValue::set(bool is_inline, uint32_t data_size, uint8_t const* bytes, uint32_t nbytes) {
+    m_bytes.resize(sizeof(value_hdr) + nbytes);
+    auto h = r_cast< value_hdr* >(m_bytes.data());
+    h->is_inline = is_inline ? 1 : 0;
+    h->data_size = data_size;
+    std::memcpy(m_bytes.data() + sizeof(value_hdr), bytes, nbytes);
+}
+
+folly::Future< std::error_code > IndexDataValue::write(uint8_t const* data, uint32_t size, IndexDataValue& out_value) {
+    if (size <= HS_DYNAMIC_CONFIG(btree.index_inline_value_max_bytes)) {
+        out_value.set(true /* is_inline */, size, data, size);
+        return folly::makeFuture< std::error_code >(std::error_code{});
+    }
+
+    // Data service writes whole blks, so the tail of the last blk is padded
+    auto& svc = data_service();
+    auto const io_size = sisl::round_up(size, svc.get_blk_size());
+    auto buf = hs_utils::iobuf_alloc(io_size, sisl::buftag::data, svc.get_align_size());
+    std::memcpy(buf, data, size);
+    std::memset(buf + size, 0, io_size - size);
+
+    sisl::sg_list sgs;
+    sgs.size = io_size;
+    sgs.iovs.emplace_back(iovec{.iov_base = buf, .iov_len = io_size});
+    auto blkid = std::make_shared< MultiBlkId >();
+    return svc.async_alloc_write(sgs, blk_alloc_hints{}, *blkid)
+        .thenValue([buf, blkid, size, &out_value](std::error_code err) {
+            hs_utils::iobuf_free(buf, sisl::buftag::data);
+            if (!err) {
+                auto const b = blkid->serialize();
+                out_value.set(false /* is_inline */, size, b.cbytes(), b.size());
+            }
+            return err;
+        });
+}
+
+folly::Future< std::error_code > IndexDataValue::read(uint8_t* buf) const {
+    auto const size = data_size();
+    if (is_inline()) {
+        std::memcpy(buf, m_bytes.data() + sizeof(value_hdr), size);
+        return folly::makeFuture< std::error_code >(std::error_code{});
+    }
+
+    auto& svc = data_service();
+    auto const io_size = sisl::round_up(size, svc.get_blk_size());
+    auto io_buf = hs_utils::iobuf_alloc(io_size, sisl::buftag::data, svc.get_align_size());
+    return svc.async_read(blkid(), io_buf, io_size).thenValue([io_buf, buf, size](std::error_code err) {
+        if (!err) { std::memcpy(buf, io_buf, size); }
+        hs_utils::iobuf_free(io_buf, sisl::buftag::data);
+        return err;
+    });
+}
+
+folly::Future< std::error_code > IndexDataValue::free_data() const {
+    if (m_bytes.empty() || is_inline()) { return folly::makeFuture< std::error_code >(std::error_code{}); }
+    return data_service().async_free_blk(blkid());
+}
+
+MultiBlkId IndexDataValue::blkid() const {
+    MultiBlkId bid;
+    if (!m_bytes.empty() && !is_inline()) {
+        bid.deserialize(sisl::blob{m_bytes.data() + sizeof(value_hdr), uint32_cast(m_bytes.size() - sizeof(value_hdr))},
+                        true);
+    }
+    return bid;
+}
+
+std::string IndexDataValue::to_string() const {
+    if (m_bytes.empty()) { return "empty"; }
+    return is_inline() ? fmt::format("inline size={}", data_size())
+                       : fmt::format("size={} blkid={}", data_size(), blkid().to_string());
+}
+} // namespace homestore
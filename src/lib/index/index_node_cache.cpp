@@ -0,0 +1,276 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+
+#include <homestore/btree/detail/btree_node.hpp>
+#include <homestore/homestore.hpp>
+#include "common/homestore_config.hpp"
+#include "common/resource_mgr.hpp"
+#include "index_node_cache.hpp"
+
+namespace homestore {
+static uint32_t round_up_to_pow2(uint32_t n) {
+    uint32_t p{1};
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+IndexNodeCache::IndexNodeCache(uint64_t capacity_bytes, uint32_t blk_size, uint32_t nshards) :
+        m_shards(round_up_to_pow2(std::max(nshards, 1u))), m_blk_size{blk_size} {
+    set_capacity(capacity_bytes);
+}
+
+IndexNodeCache::~IndexNodeCache() {
+    uint64_t bytes{0};
+    for (auto const& s : m_shards) {
+        bytes += s.bytes;
+    }
+    // Homestore is being destroyed itself (along with resource mgr) otherwise
+    if (bytes && HomeStore::safe_instance()) { resource_mgr().dec_mem_usage(mem_consumer_t::index_cache, bytes); }
+}
+
+void IndexNodeCache::set_capacity(uint64_t capacity_bytes) {
+    auto const shard_capacity = std::max(capacity_bytes / m_shards.size(), uint64_cast(m_blk_size));
+    m_shard_capacity.store(shard_capacity);
+    m_small_q_capacity.store(std::max(shard_capacity * HS_DYNAMIC_CONFIG(cache.index_cache_small_queue_pct) / 100,
+                                      uint64_cast(m_blk_size)));
+    m_ghost_capacity.store(shard_capacity / m_blk_size);
+
+    for (auto& s : m_shards) {
+        std::unique_lock lg{s.mtx};
+        evict_if_needed(s);
+    }
+}
+
+BlkId IndexNodeCache::blkid_of(BtreeNodePtr const& node) {
+    return static_cast< IndexBtreeNode* >(node.get())->m_idx_buf->m_blkid;
+}
+
+bool IndexNodeCache::insert(BtreeNodePtr const& node) {
+    auto const blkid = blkid_of(node);
+    auto& s = shard_of(blkid);
+    std::unique_lock lg{s.mtx};
+    if (s.map.count(blkid)) { return false; }
+    admit(s, node);
+    evict_if_needed(s);
+    return true;
+}
+
+void IndexNodeCache::upsert(BtreeNodePtr const& node) {
+    auto const blkid = blkid_of(node);
+    auto& s = shard_of(blkid);
+    std::unique_lock lg{s.mtx};
+    if (auto it = s.map.find(blkid); it != s.map.end()) {
+        it->second->node = node; // Same blkid is of the same size
+        return;
+    }
+    admit(s, node);
+    evict_if_needed(s);
+}
+
+bool IndexNodeCache::get(BlkId const& blkid, BtreeNodePtr& node) {
+    auto& s = shard_of(blkid);
+    bool found{false};
+    {
+        std::unique_lock lg{s.mtx};
+        if (auto it = s.map.find(blkid); it != s.map.end()) {
+            auto& e = *(it->second);
+            if (!e.in_main && (e.freq == 0)) { ++s.gen; }
+            if (e.freq < max_freq) { ++e.freq; }
+            node = e.node;
+            found = true;
+        }
+    }
+    if (!found) {
+        COUNTER_INCREMENT(m_metrics, index_cache_misses, 1);
+        return false;
+    }
+    COUNTER_INCREMENT(m_metrics, index_cache_hits, 1);
+    return true;
+}
+
+bool IndexNodeCache::exists(BlkId const& blkid) {
+    auto& s = shard_of(blkid);
+    std::unique_lock lg{s.mtx};
+    return (s.map.count(blkid) != 0);
+}
+
+bool IndexNodeCache::remove(BlkId const& blkid, BtreeNodePtr& node) {
+    auto& s = shard_of(blkid);
+    std::unique_lock lg{s.mtx};
+    auto it = s.map.find(blkid);
+    if (it == s.map.end()) { return false; }
+
+    auto const eit = it->second;
+    node = std::move(eit->node);
+    s.map.erase(it);
+    remove_entry(s, eit, blkid);
+    return true;
+}
+
+uint64_t IndexNodeCache::num_nodes() const {
+    uint64_t n{0};
+    for (auto const& s : m_shards) {
+        std::unique_lock lg{s.mtx};
+        n += s.map.size();
+    }
+    return n;
+}
+
+// Each shard contributes its share of the hottest, so that the shards are locked only to copy out their candidates,
+// and only the shards whose candidates changed since the last call. Nodes on probation, not accessed since they were
+// admitted, are not hot. Access frequency of the nodes counts only towards their order, a shard whose nodes were
+// merely accessed since keeps its earlier order.
+std::vector< BlkId > IndexNodeCache::hot_blkids(uint32_t max_nodes) {
+    auto const hotter = [](hot_node const& a, hot_node const& b) {
+        return (a.level != b.level) ? (a.level > b.level) : (a.freq > b.freq);
+    };
+
+    if (max_nodes == 0) { return {}; }
+    std::vector< hot_node > hot;
+    auto const per_shard = (max_nodes + m_shards.size() - 1) / m_shards.size();
+    std::vector< hot_node > nodes;
+    for (auto& s : m_shards) {
+        nodes.clear();
+        uint64_t gen;
+        {
+            std::unique_lock lg{s.mtx};
+            if ((s.hot_gen == s.gen) && (s.hot_max == per_shard)) {
+                hot.insert(hot.end(), s.hot.begin(), s.hot.end());
+                continue;
+            }
+            gen = s.gen;
+            for (auto const* q : {&s.main_q, &s.small_q}) {
+                for (auto const& e : *q) {
+                    if ((!e.in_main && (e.freq == 0)) || e.node->is_node_deleted()) { continue; }
+                    nodes.push_back(hot_node{e.node->level(), e.freq, blkid_of(e.node)});
+                }
+            }
+        }
+        auto const n = std::min(per_shard, nodes.size());
+        std::partial_sort(nodes.begin(), nodes.begin() + n, nodes.end(), hotter);
+        nodes.resize(n);
+        hot.insert(hot.end(), nodes.begin(), nodes.end());
+
+        std::unique_lock lg{s.mtx};
+        if (s.gen == gen) {
+            s.hot = nodes;
+            s.hot_gen = gen;
+            s.hot_max = per_shard;
+        }
+    }
+
+    std::sort(hot.begin(), hot.end(), hotter);
+    if (hot.size() > max_nodes) { hot.resize(max_nodes); }
+    std::vector< BlkId > blkids;
+    blkids.reserve(hot.size());
+    for (auto const& h : hot) {
+        blkids.push_back(h.blkid);
+    }
+    return blkids;
+}
+
+void IndexNodeCache::admit(shard& s, BtreeNodePtr const& node) {
+    auto const blkid = blkid_of(node);
+    bool const ghost_hit = (s.ghost.erase(blkid) != 0);
+    if (ghost_hit) { COUNTER_INCREMENT(m_metrics, index_cache_ghost_hits, 1); }
+
+    entry e{node, 0, (ghost_hit || !node->is_leaf())};
+    if (!node->is_leaf()) { e.freq = s_cast< uint8_t >(std::min(node->level(), uint16_t{max_freq})); }
+    if (e.in_main) { ++s.gen; }
+    auto& q = e.in_main ? s.main_q : s.small_q;
+    q.push_back(std::move(e));
+    s.map.emplace(blkid, std::prev(q.end()));
+    s.bytes += size_of(blkid);
+    resource_mgr().inc_mem_usage(mem_consumer_t::index_cache, size_of(blkid));
+    if (!q.back().in_main) { s.small_q_bytes += size_of(blkid); }
+}
+
+void IndexNodeCache::remove_entry(shard& s, entry_list_t::iterator eit, BlkId const& blkid) {
+    auto const size = size_of(blkid);
+    s.bytes -= size;
+    resource_mgr().dec_mem_usage(mem_consumer_t::index_cache, size);
+    if (eit->in_main || (eit->freq > 0)) { ++s.gen; }
+    if (eit->in_main) {
+        s.main_q.erase(eit);
+    } else {
+        s.small_q_bytes -= size;
+        s.small_q.erase(eit);
+    }
+}
+
+// Evicts from the small queue while it is over its share (or main is empty), else from main. If none of the nodes
+// looked at in a queue could be evicted, the other one is tried, failing which the shard is left above its capacity
+// until a later insert, which carries on from the candidates passed over (moved to the back of their queue).
+void IndexNodeCache::evict_if_needed(shard& s) {
+    auto const shard_capacity = m_shard_capacity.load(std::memory_order_relaxed);
+    auto const small_q_capacity = m_small_q_capacity.load(std::memory_order_relaxed);
+    while (s.bytes > shard_capacity) {
+        uint32_t budget{max_evict_scan};
+        bool const from_small = (s.small_q_bytes >= small_q_capacity) || s.main_q.empty();
+        auto& first = from_small ? s.small_q : s.main_q;
+        auto& second = from_small ? s.main_q : s.small_q;
+        if (!evict_one(s, first, budget) && !evict_one(s, second, budget)) { break; }
+    }
+}
+
+bool IndexNodeCache::evict_one(shard& s, entry_list_t& q, uint32_t& budget) {
+    bool const is_small = (&q == &s.small_q);
+    for (; (budget > 0) && !q.empty(); --budget) {
+        auto it = q.begin();
+        auto& e = *it;
+        if (e.freq > 0) {
+            if (is_small) {
+                // Accessed again while on probation, so it moves to main
+                e.freq = 0;
+                e.in_main = true;
+                s.small_q_bytes -= size_of(blkid_of(e.node));
+                s.main_q.splice(s.main_q.end(), q, it);
+            } else {
+                --e.freq;
+                q.splice(q.end(), q, it);
+            }
+            continue;
+        }
+
+        auto const* inode = static_cast< IndexBtreeNode const* >(e.node.get());
+        if (!e.node->m_refcount.test_le(1) || !inode->m_idx_buf->is_clean()) {
+            COUNTER_INCREMENT(m_metrics, index_cache_evict_skipped, 1);
+            q.splice(q.end(), q, it);
+            continue;
+        }
+
+        auto const blkid = inode->m_idx_buf->m_blkid;
+        if (is_small) { add_ghost(s, blkid); }
+        s.map.erase(blkid);
+        remove_entry(s, it, blkid);
+        COUNTER_INCREMENT(m_metrics, index_cache_evictions, 1);
+        return true;
+    }
+    return false;
+}
+
+// Ghost holds as many keys as the shard holds nodes of the blk size. Keys readmitted are left in the order queue, so it
+// is trimmed a little earlier than exact, which is fine for what is a hint.
+void IndexNodeCache::add_ghost(shard& s, BlkId const& blkid) {
+    if (s.ghost.insert(blkid).second) { s.ghost_q.push_back(blkid); }
+    while (s.ghost_q.size() > m_ghost_capacity.load(std::memory_order_relaxed)) {
+        s.ghost.erase(s.ghost_q.front());
+        s.ghost_q.pop_front();
+    }
+}
+} // namespace homestore
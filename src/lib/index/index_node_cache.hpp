@@ -0,0 +1,151 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <sisl/metrics/metrics.hpp>
+#include <homestore/blk.h>
+#include <homestore/index/index_internal.hpp>
+
+namespace homestore {
+class IndexNodeCacheMetrics : public sisl::MetricsGroup {
+public:
+    explicit IndexNodeCacheMetrics() : sisl::MetricsGroup("IndexNodeCache", "IndexNodeCache") {
+        REGISTER_COUNTER(index_cache_hits, "Number of btree node lookups found in the cache");
+        REGISTER_COUNTER(index_cache_misses, "Number of btree node lookups which had to read the node");
+        REGISTER_COUNTER(index_cache_ghost_hits, "Number of nodes readmitted after being evicted on probation");
+        REGISTER_COUNTER(index_cache_evictions, "Number of btree nodes evicted from the cache");
+        REGISTER_COUNTER(index_cache_evict_skipped, "Number of eviction candidates skipped for being in use or dirty");
+        register_me_to_farm();
+    }
+
+    IndexNodeCacheMetrics(const IndexNodeCacheMetrics&) = delete;
+    IndexNodeCacheMetrics(IndexNodeCacheMetrics&&) noexcept = delete;
+    IndexNodeCacheMetrics& operator=(const IndexNodeCacheMetrics&) = delete;
+    IndexNodeCacheMetrics& operator=(IndexNodeCacheMetrics&&) noexcept = delete;
+    ~IndexNodeCacheMetrics() { deregister_me_from_farm(); }
+};
+
+//
+// IndexNodeCache caches the btree nodes of all the index tables by their blkid, in shards (by hash of the blkid), each
+// with its own lock and its own share of the capacity. Eviction within a shard is S3-FIFO: a new node is on probation
+// in a small FIFO queue, from where it is evicted unless it was accessed again, in which case it moves to the main
+// queue. Main queue is a FIFO with a few bits of access frequency, each pass of eviction over a node takes one of them
+// off before it is evicted. Keys evicted on probation are remembered (ghost), so that they are readmitted straight into
+// main. Hence a range query, which touches each of its leaves only once, churns only the small queue.
+//
+// Interior nodes are admitted straight into main, with a frequency of as many passes as their level, so that the upper
+// levels (which every lookup goes through) stay cached over the leaves. A node is evicted only if no one other than the
+// cache holds it and its buffer is clean, else it is passed over. Each node evicted looks at no more than
+// max_evict_scan candidates, so a shard full of nodes in use (or dirty) stays over its capacity for a while, rather
+// than being scanned through under its lock on every insert.
+//
+// Nodes could be of different sizes (a multiple of the index blk size, as per their blkid), so the capacity of the
+// shards and their small queue is in bytes. Capacity follows the memory quota of the index cache in ResourceMgr, which
+// shrinks it while the other consumers of the cache memory grow.
+//
+class IndexNodeCache {
+public:
+    IndexNodeCache(uint64_t capacity_bytes, uint32_t blk_size, uint32_t nshards);
+    IndexNodeCache(IndexNodeCache const&) = delete;
+    IndexNodeCache(IndexNodeCache&&) noexcept = delete;
+    IndexNodeCache& operator=(IndexNodeCache const&) = delete;
+    IndexNodeCache& operator=(IndexNodeCache&&) noexcept = delete;
+    ~IndexNodeCache();
+
+    /// @brief Add the node, returns false if a node of the same blkid is in the cache already
+    bool insert(BtreeNodePtr const& node);
+
+    /// @brief Add the node or replace the one of the same blkid
+    void upsert(BtreeNodePtr const& node);
+
+    bool get(BlkId const& blkid, BtreeNodePtr& node);
+
+    /// @brief Check if the node is cached, without counting it as an access
+    bool exists(BlkId const& blkid);
+
+    bool remove(BlkId const& blkid, BtreeNodePtr& node);
+
+    uint64_t num_nodes() const;
+
+    /// @brief Blkids of upto max_nodes of the hottest nodes, upper levels first and then by their access frequency.
+    /// Each shard keeps its hottest as of the last call, which is looked for again only if its main queue changed.
+    std::vector< BlkId > hot_blkids(uint32_t max_nodes);
+
+    /// @brief Resize the cache, evicting from each of the shards whatever is over its new capacity
+    void set_capacity(uint64_t capacity_bytes);
+
+private:
+    static constexpr uint8_t max_freq{3};
+    static constexpr uint32_t max_evict_scan{32};
+
+    struct entry {
+        BtreeNodePtr node;
+        uint8_t freq{0};
+        bool in_main{false};
+    };
+    using entry_list_t = std::list< entry >;
+
+    struct hot_node {
+        uint16_t level;
+        uint8_t freq;
+        BlkId blkid;
+    };
+
+    struct shard {
+        mutable std::mutex mtx;
+        std::unordered_map< BlkId, entry_list_t::iterator > map;
+        entry_list_t small_q;
+        entry_list_t main_q;
+        uint64_t bytes{0}; // Size of all the nodes in the shard
+        uint64_t small_q_bytes{0};
+        std::unordered_set< BlkId > ghost;
+        std::deque< BlkId > ghost_q; // Order of the keys in ghost, oldest first
+
+        // Bumped on every change to the nodes which could be hot (in main, or accessed again on probation), hot is of
+        // the shard as of hot_gen
+        uint64_t gen{0};
+        uint64_t hot_gen{~0ull};
+        size_t hot_max{0};
+        std::vector< hot_node > hot;
+    };
+
+    static BlkId blkid_of(BtreeNodePtr const& node);
+    uint64_t size_of(BlkId const& blkid) const { return uint64_cast(blkid.blk_count()) * m_blk_size; }
+    shard& shard_of(BlkId const& blkid) { return m_shards[std::hash< BlkId >()(blkid) & (m_shards.size() - 1)]; }
+
+    void admit(shard& s, BtreeNodePtr const& node);
+    void evict_if_needed(shard& s);
+    bool evict_one(shard& s, entry_list_t& q, uint32_t& budget);
+    void add_ghost(shard& s, BlkId const& blkid);
+    void remove_entry(shard& s, entry_list_t::iterator eit, BlkId const& blkid);
+
+private:
+    std::vector< shard > m_shards;
+    uint32_t m_blk_size;
+    std::atomic< uint64_t > m_shard_capacity; // In bytes
+    std::atomic< uint64_t > m_small_q_capacity;
+    std::atomic< uint64_t > m_ghost_capacity; // In number of keys
+    IndexNodeCacheMetrics m_metrics;
+};
+} // namespace homestore
@@ -19,8 +19,10 @@
 #include <homestore/btree/detail/btree_node.hpp>
 #include "index/wb_cache.hpp"
 #include "index/index_cp.hpp"
+#include "common/homestore_config.hpp"
 #include "common/homestore_utils.hpp"
 #include "common/homestore_assert.hpp"
+#include "common/resource_mgr.hpp"
 #include "device/virtual_dev.hpp"
 #include "device/physical_dev.hpp"
 #include "device/chunk.h"
@@ -41,6 +43,11 @@ IndexService::IndexService(std::unique_ptr< IndexServiceCallbacks > cbs) : m_svc
         "wb_cache",
         [this](meta_blk* mblk, sisl::byte_view buf, size_t size) { m_wbcache_sb = std::pair{mblk, std::move(buf)}; },
         nullptr);
+
+    meta_service().register_handler(
+        "index_warmup",
+        [this](meta_blk* mblk, sisl::byte_view buf, size_t size) { m_warmup_sb = std::pair{mblk, std::move(buf)}; },
+        nullptr);
 }
 
 void IndexService::create_vdev(uint64_t size, HSDevType devType, uint32_t num_chunks) {
@@ -53,7 +60,9 @@ void IndexService::create_vdev(uint64_t size, HSDevType devType, uint32_t num_ch
                                                     .num_chunks = num_chunks,
                                                     .blk_size = atomic_page_size,
                                                     .dev_type = devType,
-                                                    .alloc_type = blk_allocator_type_t::fixed,
+                                                    .alloc_type = HS_DYNAMIC_CONFIG(btree.index_mixed_node_sizes)
+                                                        ? blk_allocator_type_t::extent
+                                                        : blk_allocator_type_t::fixed,
                                                     .chunk_sel_type = chunk_selector_type_t::ROUND_ROBIN,
                                                     .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
                                                     .context_data = vdev_ctx.to_blob()});
@@ -77,11 +86,31 @@ void IndexService::itable_meta_blk_found(const sisl::byte_view& buf, void* meta_
 
 void IndexService::start() {
     // Start Writeback cache
-    m_wb_cache = std::make_unique< IndexWBCache >(m_vdev, std::move(m_wbcache_sb), hs()->evictor(),
-                                                  hs()->device_mgr()->atomic_page_size(HSDevType::Fast));
+    auto wb_cache = std::make_unique< IndexWBCache >(m_vdev, std::move(m_wbcache_sb), std::move(m_warmup_sb),
+                                                     hs()->device_mgr()->atomic_page_size(HSDevType::Fast));
+    auto* wb = wb_cache.get();
+    m_wb_cache = std::move(wb_cache);
+
+    // Nodes found to be repaired by the recovery are repaired on their first access, the rest are repaired in the
+    // background, so that the index serves without waiting for all of them.
+    std::unique_lock lg(m_index_map_mtx);
+    for (auto const& [_, tbl] : m_index_map) {
+        if (tbl->num_pending_repairs() == 0) { continue; }
+        LOGINFO("Index table ordinal={} has {} nodes to be repaired", tbl->ordinal(), tbl->num_pending_repairs());
+        m_repair_threads.emplace_back([tbl]() { tbl->repair_pending_nodes(); });
+    }
+
+    // Hot nodes of before the restart are read back in the background, ahead of the foreground reads finding them
+    wb->start_warmup();
 }
 
-void IndexService::stop() { m_wb_cache.reset(); }
+void IndexService::stop() {
+    for (auto& t : m_repair_threads) {
+        t.join();
+    }
+    m_repair_threads.clear();
+    m_wb_cache.reset();
+}
 
 void IndexService::add_index_table(const std::shared_ptr< IndexTableBase >& tbl) {
     std::unique_lock lg(m_index_map_mtx);
@@ -119,6 +148,16 @@ void IndexService::repair_index_root(uint32_t ordinal, IndexBufferPtr const& roo
 
 uint32_t IndexService::node_size() const { return m_vdev->atomic_page_size(); }
 
+bool IndexService::is_node_size_supported(uint32_t node_size) const {
+    auto const blk_size = m_vdev->block_size();
+    if ((node_size == 0) || (node_size % blk_size != 0)) { return false; }
+    // Fixed allocator could only allocate one blk at a time
+    return (node_size == blk_size) ||
+        (s_cast< blk_allocator_type_t >(m_vdev->info().alloc_type) != blk_allocator_type_t::fixed);
+}
+
+void IndexService::throttle_writer() { resource_mgr().throttle_dirty_buf_writer(); }
+
 uint64_t IndexService::used_size() const {
     auto size{0};
     std::unique_lock lg{m_index_map_mtx};
@@ -129,8 +168,8 @@ uint64_t IndexService::used_size() const {
 }
 
 /////////////////////// IndexBuffer methods //////////////////////////
-IndexBuffer::IndexBuffer(BlkId blkid, uint32_t buf_size, uint32_t align_size) :
-        m_blkid{blkid}, m_bytes{hs_utils::iobuf_alloc(buf_size, sisl::buftag::btree_node, align_size)} {}
+IndexBuffer::IndexBuffer(BlkId blkid, uint32_t buf_size, uint32_t align_size, int numa_node) :
+        m_blkid{blkid}, m_bytes{hs_utils::iobuf_alloc(buf_size, sisl::buftag::btree_node, align_size, numa_node)} {}
 
 IndexBuffer::IndexBuffer(uint8_t* raw_bytes, BlkId blkid) : m_blkid(blkid), m_bytes{raw_bytes} {}
 
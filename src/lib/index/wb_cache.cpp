@@ -13,6 +13,13 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+
 #include <sisl/fds/thread_vector.hpp>
 #include <homestore/btree/detail/btree_node.hpp>
 #include <homestore/index_service.hpp>
@@ -24,7 +31,9 @@
 #include "wb_cache.hpp"
 #include "index_cp.hpp"
 #include "device/virtual_dev.hpp"
+#include "device/vdev_io_batch.hpp"
 #include "common/resource_mgr.hpp"
+#include "common/thread_affinity.hpp"
 
 #ifdef _PRERELEASE
 #include "common/crash_simulator.hpp"
@@ -36,68 +45,134 @@ namespace homestore {
 
 IndexWBCacheBase& wb_cache() { return index_service().wb_cache(); }
 
+// How often cache_flush_threads is checked to start the flush threads added to it
+static constexpr uint64_t flush_threads_resize_check_ms{1000};
+
 IndexWBCache::IndexWBCache(const std::shared_ptr< VirtualDev >& vdev, std::pair< meta_blk*, sisl::byte_view > sb,
-                           const std::shared_ptr< sisl::Evictor >& evictor, uint32_t node_size) :
+                           std::pair< meta_blk*, sisl::byte_view > warmup_sb, uint32_t node_size) :
         m_vdev{vdev},
-        m_cache{evictor, 100000, node_size,
-                [](const BtreeNodePtr& node) -> BlkId {
-                    return static_cast< IndexBtreeNode* >(node.get())->m_idx_buf->m_blkid;
-                },
-                [](const sisl::CacheRecord& rec) -> bool {
-                    const auto& hnode = (sisl::SingleEntryHashNode< BtreeNodePtr >&)rec;
-                    return (hnode.m_value->m_refcount.test_le(1));
-                }},
+        m_cache{resource_mgr().get_index_cache_size(), node_size, HS_DYNAMIC_CONFIG(cache.index_cache_shards)},
         m_node_size{node_size},
-        m_meta_blk{sb.first} {
-    start_flush_threads();
+        m_meta_blk{sb.first},
+        m_delta_mode{HS_DYNAMIC_CONFIG(btree.index_delta_max_pct) > 0},
+        m_warmup_meta_blk{warmup_sb.first} {
+    m_num_flush_fibers = s_cast< size_t >(std::max(1, HS_DYNAMIC_CONFIG(generic.cache_flush_threads)));
+    start_flush_threads(m_num_flush_fibers);
+    {
+        std::unique_lock lg{m_flush_threads_mtx};
+        m_flush_threads_cv.wait(lg, [this] { return (m_started_flush_fibers.size() == m_num_flush_fibers); });
+        m_cp_flush_fibers = m_started_flush_fibers;
+    }
+    m_flush_threads_timer = iomanager.schedule_global_timer(
+        flush_threads_resize_check_ms * 1000 * 1000, true /* recurring */, nullptr /* cookie */,
+        iomgr::reactor_regex::all_worker, [this](void*) { resize_flush_threads(); }, true /* wait_to_schedule */);
+
+    // Deltas are applied on every node read, so they are loaded irrespective of the journal being of a completed cp
+    m_deltas = IndexCPContext::recover_deltas(sb.second);
+    for (auto const& [_, d] : m_deltas) {
+        m_delta_bytes += d.ranges.size();
+    }
 
     // We need to register the consumer first before recovery, so that recovery can use the cp_ctx created to add/track
     // recovered new nodes.
     cp_mgr().register_consumer(cp_consumer_t::INDEX_SVC, std::move(std::make_unique< IndexCPCallbacks >(this)));
     recover(std::move(sb.second));
+
+    auto const& warmup_buf = warmup_sb.second;
+    if ((warmup_buf.size() >= sizeof(index_warmup_sb)) && (HS_DYNAMIC_CONFIG(btree.index_warmup_max_nodes) > 0)) {
+        auto const* wsb = r_cast< index_warmup_sb const* >(warmup_buf.bytes());
+        if ((wsb->magic == index_warmup_sb::warmup_magic) &&
+            (warmup_buf.size() >= sizeof(index_warmup_sb) + uint64_cast(wsb->num_nodes) * sizeof(bnodeid_t))) {
+            m_warmup_ids.resize(wsb->num_nodes);
+            std::memcpy(m_warmup_ids.data(), warmup_buf.bytes() + sizeof(index_warmup_sb),
+                        m_warmup_ids.size() * sizeof(bnodeid_t));
+        } else {
+            LOGWARNMOD(wbcache, "Ignoring the index warm up superblk, magic={} size={}", wsb->magic,
+                       warmup_buf.size());
+        }
+    }
+
+    resource_mgr().register_mem_quota_cb(mem_consumer_t::index_cache, [this](uint64_t quota) {
+        m_cache.set_capacity(quota);
+        if (resource_mgr().mem_usage(mem_consumer_t::index_cache) > quota) { release_warm_bufs(false /* idle_only */); }
+    });
 }
 
-void IndexWBCache::start_flush_threads() {
-    // Start WBCache flush threads
-    struct Context {
-        std::condition_variable cv;
-        std::mutex mtx;
-        int32_t thread_cnt{0};
-    };
-    auto ctx = std::make_shared< Context >();
-    auto nthreads = std::max(1, HS_DYNAMIC_CONFIG(generic.cache_flush_threads));
+IndexWBCache::~IndexWBCache() {
+    if (HomeStore::safe_instance()) { resource_mgr().unregister_mem_quota_cb(mem_consumer_t::index_cache); }
 
-    for (int32_t i{0}; i < nthreads; ++i) {
+    // Flush threads being started refer to the cache as they come up
+    if (m_flush_threads_timer != iomgr::null_timer_handle) { iomanager.cancel_timer(m_flush_threads_timer); }
+    {
+        std::unique_lock lg{m_flush_threads_mtx};
+        m_flush_threads_cv.wait(lg, [this] { return (m_started_flush_fibers.size() == m_flush_threads_requested); });
+    }
+
+    // Read aheads refer to the cache on completion, wait for them to drain
+    m_warmup_stopped.store(true);
+    while (m_prefetch_outstanding.load() != 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+    }
+    if (HomeStore::safe_instance()) { release_warm_bufs(false /* idle_only */); }
+}
+
+// Starts the flush threads upto nthreads, without waiting for them to come up. They are never stopped, the ones beyond
+// cache_flush_threads lowered later are merely left idle.
+void IndexWBCache::start_flush_threads(size_t nthreads) {
+    size_t first;
+    {
+        std::unique_lock lg{m_flush_threads_mtx};
+        if (nthreads <= m_flush_threads_requested) { return; }
+        first = m_flush_threads_requested;
+        m_flush_threads_requested = nthreads;
+    }
+    LOGINFOMOD(wbcache, "Starting index flush threads {} upto {}", first, nthreads);
+
+    for (size_t i{first}; i < nthreads; ++i) {
         iomanager.create_reactor("index_cp_flush" + std::to_string(i), iomgr::INTERRUPT_LOOP, 1u,
-                                 [this, ctx](bool is_started) {
+                                 [this](bool is_started) {
                                      if (is_started) {
+                                         pin_thread(hs_thread_role_t::index_flush);
+                                         // Everything flushed from these reactors is cp work, throttle it as such
+                                         thread_io_priority() = io_priority_t::cp_flush;
                                          {
-                                             std::unique_lock< std::mutex > lk{ctx->mtx};
-                                             m_cp_flush_fibers.push_back(iomanager.iofiber_self());
-                                             ++(ctx->thread_cnt);
+                                             std::unique_lock lg{m_flush_threads_mtx};
+                                             m_started_flush_fibers.push_back(iomanager.iofiber_self());
                                          }
-                                         ctx->cv.notify_one();
+                                         m_flush_threads_cv.notify_all();
                                      }
                                  });
     }
+}
 
-    {
-        std::unique_lock< std::mutex > lk{ctx->mtx};
-        ctx->cv.wait(lk, [ctx, nthreads] { return (ctx->thread_cnt == nthreads); });
-    }
+// Runs on the resize timer, off the cp path, as starting a reactor takes a while
+void IndexWBCache::resize_flush_threads() {
+    start_flush_threads(s_cast< size_t >(std::max(1, HS_DYNAMIC_CONFIG(generic.cache_flush_threads))));
 }
 
-BtreeNodePtr IndexWBCache::alloc_buf(node_initializer_t&& node_initializer) {
+size_t IndexWBCache::num_flush_threads() {
+    std::unique_lock lg{m_flush_threads_mtx};
+    return m_started_flush_fibers.size();
+}
+
+uint32_t IndexWBCache::buf_size(IndexBufferPtr const& buf) const {
+    // Meta buffers are accounted as a node of the blk size
+    return buf->is_meta_buf() ? m_node_size : buf_size(buf->m_blkid);
+}
+
+BtreeNodePtr IndexWBCache::alloc_buf(uint32_t node_size, node_initializer_t&& node_initializer) {
+    HS_DBG_ASSERT_EQ(node_size % m_node_size, 0, "Node size is not a multiple of index blk size");
     auto cpg = cp_mgr().cp_guard();
     auto cp_ctx = r_cast< IndexCPContext* >(cpg.context(cp_consumer_t::INDEX_SVC));
 
-    // Alloc a block of data from underlying vdev
+    // Alloc the blks of the node from underlying vdev, size of the node is implied by its blkid from here on
     BlkId blkid;
-    auto ret = m_vdev->alloc_contiguous_blks(1, blk_alloc_hints{}, blkid);
+    auto ret = m_vdev->alloc_contiguous_blks(node_size / m_node_size, blk_alloc_hints{}, blkid);
     if (ret != BlkAllocStatus::SUCCESS) { return nullptr; }
 
     // Alloc buffer and initialize the node
-    auto idx_buf = std::make_shared< IndexBuffer >(blkid, m_node_size, m_vdev->align_size());
+    drop_warm_buf(blkid); // Image of a node freed before the restart
+    auto idx_buf = std::make_shared< IndexBuffer >(blkid, node_size, m_vdev->align_size(), m_vdev->numa_node());
     idx_buf->m_created_cp_id = cpg->id();
     idx_buf->m_dirtied_cp_id = cpg->id();
     auto node = node_initializer(idx_buf);
@@ -114,22 +189,32 @@ BtreeNodePtr IndexWBCache::alloc_buf(node_initializer_t&& node_initializer) {
 }
 
 void IndexWBCache::write_buf(const BtreeNodePtr& node, const IndexBufferPtr& buf, CPContext* cp_ctx) {
+    drop_warm_buf(buf->m_blkid);
     // TODO upsert always returns false even if it succeeds.
     if (node != nullptr) { m_cache.upsert(node); }
     r_cast< IndexCPContext* >(cp_ctx)->add_to_dirty_list(buf);
-    resource_mgr().inc_dirty_buf_size(m_node_size);
+    resource_mgr().inc_dirty_buf_size(buf_size(buf));
 }
 
-void IndexWBCache::read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) {
+bool IndexWBCache::read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) {
     auto const blkid = BlkId{id};
 
 retry:
     // Check if the blkid is already in cache, if not load and put it into the cache
-    if (m_cache.get(blkid, node)) { return; }
-
-    // Read the buffer from virtual device
-    auto idx_buf = std::make_shared< IndexBuffer >(blkid, m_node_size, m_vdev->align_size());
-    m_vdev->sync_read(r_cast< char* >(idx_buf->raw_buffer()), m_node_size, blkid);
+    if (m_cache.get(blkid, node)) { return true; }
+
+    // Read the buffer from virtual device, unless the warm up has read it already
+    auto idx_buf = take_warm_buf(blkid);
+    if (idx_buf == nullptr) {
+        auto const size = buf_size(blkid);
+        idx_buf = std::make_shared< IndexBuffer >(blkid, size, m_vdev->align_size(), m_vdev->numa_node());
+        // On a sync io capable fiber, this suspends only the fiber until the read completes
+        if (auto const err = m_vdev->sync_read(r_cast< char* >(idx_buf->raw_buffer()), size, blkid); err) {
+            throw std::system_error(err, fmt::format("Failed to read btree node blkid={}", blkid.to_string()));
+        }
+    }
+    if (m_delta_mode && BtreeNode::identify_leaf_node(idx_buf->raw_buffer())) { save_disk_image(idx_buf); }
+    apply_delta(blkid, idx_buf->raw_buffer());
 
     // Create the btree node out of buffer
     node = node_initializer(idx_buf);
@@ -140,6 +225,51 @@ retry:
         // There is a race between 2 concurrent reads from vdev and other party won the race. Re-read from cache
         goto retry;
     }
+
+    // Any read ahead of this node still in flight started before this read, so it is not to be trusted
+    if (m_prefetch_outstanding.load() != 0) {
+        std::unique_lock lg{m_prefetch_mtx};
+        m_prefetching.erase(blkid);
+    }
+    return false;
+}
+
+uint32_t IndexWBCache::prefetch_window() const { return HS_DYNAMIC_CONFIG(btree.index_readahead_nodes); }
+
+void IndexWBCache::prefetch_bufs(std::vector< bnodeid_t > const& ids, node_initializer_t&& node_initializer) {
+    auto const initializer = std::make_shared< node_initializer_t >(std::move(node_initializer));
+    for (auto const id : ids) {
+        auto const blkid = BlkId{id};
+        if (m_cache.exists(blkid)) { continue; }
+
+        // Counted before it is tracked, so that read_buf or free_buf seeing no read ahead outstanding can skip the lock
+        ++m_prefetch_outstanding;
+        {
+            std::unique_lock lg{m_prefetch_mtx};
+            if (!m_prefetching.insert(blkid).second) { // Already being read ahead
+                --m_prefetch_outstanding;
+                continue;
+            }
+        }
+
+        auto const size = buf_size(blkid);
+        auto idx_buf = std::make_shared< IndexBuffer >(blkid, size, m_vdev->align_size(), m_vdev->numa_node());
+        m_vdev->async_read(r_cast< char* >(idx_buf->raw_buffer()), size, blkid)
+            .thenValue([this, idx_buf, initializer](std::error_code err) {
+                {
+                    // Node is added to the cache under the lock, so that a free_buf of it cannot be missed
+                    std::unique_lock lg{m_prefetch_mtx};
+                    if ((m_prefetching.erase(idx_buf->m_blkid) != 0) && !err) {
+                        if (m_delta_mode && BtreeNode::identify_leaf_node(idx_buf->raw_buffer())) {
+                            save_disk_image(idx_buf);
+                        }
+                        apply_delta(idx_buf->m_blkid, idx_buf->raw_buffer());
+                        m_cache.insert((*initializer)(idx_buf));
+                    }
+                }
+                --m_prefetch_outstanding;
+            });
+    }
 }
 
 bool IndexWBCache::get_writable_buf(const BtreeNodePtr& node, CPContext* context) {
@@ -158,9 +288,12 @@ bool IndexWBCache::get_writable_buf(const BtreeNodePtr& node, CPContext* context
                          "Buffer is dirty, but its dirtied_cp_id is neither current nor previous cp id");
 
         // If its not clean, we do deep copy.
-        auto new_buf = std::make_shared< IndexBuffer >(idx_buf->m_blkid, m_node_size, m_vdev->align_size());
+        auto const size = buf_size(idx_buf->m_blkid);
+        auto new_buf =
+            std::make_shared< IndexBuffer >(idx_buf->m_blkid, size, m_vdev->align_size(), m_vdev->numa_node());
         new_buf->m_created_cp_id = idx_buf->m_created_cp_id;
-        std::memcpy(new_buf->raw_buffer(), idx_buf->raw_buffer(), m_node_size);
+        new_buf->m_disk_image = idx_buf->m_disk_image;
+        std::memcpy(new_buf->raw_buffer(), idx_buf->raw_buffer(), size);
 
         node->update_phys_buf(new_buf->raw_buffer());
         LOGTRACEMOD(wbcache, "cp={} cur_buf={} for node={} is dirtied by cp={} copying new_buf={}", icp_ctx->id(),
@@ -266,6 +399,22 @@ void IndexWBCache::transact_bufs(uint32_t index_ordinal, IndexBufferPtr const& p
                                 freed_node_bufs);
 }
 
+void IndexWBCache::transact_new_bufs(uint32_t index_ordinal, IndexBufferPtr const& up_buf,
+                                     IndexBufferPtrList const& new_bufs, CPContext* cp_ctx) {
+    // A txn record holds upto 255 ids, including the up_buf
+    static constexpr size_t max_new_per_record{250};
+    IndexCPContext* icp_ctx = r_cast< IndexCPContext* >(cp_ctx);
+
+    for (size_t start{0}; start < new_bufs.size(); start += max_new_per_record) {
+        IndexBufferPtrList chunk{new_bufs.begin() + start,
+                                 new_bufs.begin() + std::min(start + max_new_per_record, new_bufs.size())};
+        for (auto const& buf : chunk) {
+            link_buf(up_buf, buf, true /* is_sibling_link */, cp_ctx);
+        }
+        icp_ctx->add_to_txn_journal(index_ordinal, nullptr, up_buf, chunk, {});
+    }
+}
+
 void IndexWBCache::link_buf(IndexBufferPtr const& up_buf, IndexBufferPtr const& down_buf, bool is_sibling_link,
                             CPContext* cp_ctx) {
     HS_DBG_ASSERT_NE((void*)up_buf->m_up_buffer.get(), (void*)down_buf.get(), "Cyclic dependency detected");
@@ -345,14 +494,281 @@ void IndexWBCache::link_buf(IndexBufferPtr const& up_buf, IndexBufferPtr const&
 }
 
 void IndexWBCache::free_buf(const IndexBufferPtr& buf, CPContext* cp_ctx) {
+    drop_warm_buf(buf->m_blkid);
+    if (m_prefetch_outstanding.load() != 0) {
+        std::unique_lock lg{m_prefetch_mtx};
+        m_prefetching.erase(buf->m_blkid);
+    }
+
     BtreeNodePtr node;
     bool done = m_cache.remove(buf->m_blkid, node);
     HS_REL_ASSERT_EQ(done, true, "Race on cache removal of btree blkid?");
 
-    resource_mgr().inc_free_blk(m_node_size);
+    {
+        std::unique_lock lg{m_delta_mtx};
+        if (auto it = m_deltas.find(buf->m_blkid); it != m_deltas.end()) { it->second.retire_cp_id = cp_ctx->id(); }
+    }
+
+    resource_mgr().inc_free_blk(buf_size(buf->m_blkid));
     m_vdev->free_blk(buf->m_blkid, s_cast< VDevCPContext* >(cp_ctx));
 }
 
+//////////////////// Warm up section /////////////////////////////////
+// Persisted along with every cp which flushes the index, so an idle index is left with the list of its last flush
+void IndexWBCache::persist_hot_nodes() {
+    release_warm_bufs(true /* idle_only */);
+
+    auto const max_nodes = HS_DYNAMIC_CONFIG(btree.index_warmup_max_nodes);
+    if ((max_nodes == 0) && (m_warmup_meta_blk == nullptr)) { return; }
+
+    // Rewritten only if the hot nodes changed since the last cp, as is mostly the case with a cache which has settled
+    auto blkids = m_cache.hot_blkids(max_nodes);
+    if (m_warmup_meta_blk && (blkids == m_persisted_hot)) { return; }
+    std::vector< uint8_t > buf(sizeof(index_warmup_sb) + blkids.size() * sizeof(bnodeid_t));
+    index_warmup_sb wsb;
+    wsb.num_nodes = uint32_cast(blkids.size());
+    std::memcpy(buf.data(), &wsb, sizeof(wsb));
+    auto* ids = r_cast< bnodeid_t* >(buf.data() + sizeof(index_warmup_sb));
+    for (auto const& blkid : blkids) {
+        *ids++ = blkid.to_integer();
+    }
+
+    if (m_warmup_meta_blk) {
+        meta_service().update_sub_sb(buf.data(), buf.size(), m_warmup_meta_blk);
+    } else {
+        meta_service().add_sub_sb("index_warmup", buf.data(), buf.size(), m_warmup_meta_blk);
+    }
+    m_persisted_hot = std::move(blkids);
+}
+
+void IndexWBCache::start_warmup() {
+    if (m_warmup_ids.empty()) { return; }
+    LOGINFOMOD(wbcache, "Warming up the index cache with {} hot nodes of the last cp", m_warmup_ids.size());
+    m_warmup_start = Clock::now();
+    warmup_next_batch();
+}
+
+// Each batch is read once the previous completes, so that the warm up holds only a few reads ahead of the foreground
+// reads on the device. Completion of the last read of a batch issues the next one, before it is counted off as
+// outstanding, so the destructor waiting for the reads to drain cannot miss them.
+void IndexWBCache::warmup_next_batch() {
+    std::vector< IndexBufferPtr > bufs;
+    {
+        std::unique_lock lg{m_warmup_mtx};
+        auto const batch = std::max(HS_DYNAMIC_CONFIG(btree.index_warmup_batch_nodes), 1u);
+
+        // Images held count against the index cache, so no more are read once it is at its quota
+        bool const at_quota = (resource_mgr().mem_usage(mem_consumer_t::index_cache) >=
+                               resource_mgr().mem_quota(mem_consumer_t::index_cache));
+        while ((m_warmup_next < m_warmup_ids.size()) && (bufs.size() < batch) && !m_warmup_stopped.load() &&
+               !at_quota) {
+            auto const blkid = BlkId{m_warmup_ids[m_warmup_next++]};
+            if (m_cache.exists(blkid) || !m_warm_bufs.emplace(blkid, nullptr).second) { continue; }
+            bufs.push_back(
+                std::make_shared< IndexBuffer >(blkid, buf_size(blkid), m_vdev->align_size(), m_vdev->numa_node()));
+        }
+        m_num_warm_bufs.store(m_warm_bufs.size());
+
+        if (bufs.empty()) {
+            LOGINFOMOD(wbcache, "Index cache warm up read {} nodes in {} ms, {} of them yet to be accessed{}",
+                       m_num_warmed.load(), get_elapsed_time_ms(m_warmup_start), m_warm_bufs.size(),
+                       at_quota ? ", stopped at the memory quota of the index cache" : "");
+            m_warmup_ids = std::vector< bnodeid_t >{};
+            m_warmup_next = 0;
+            m_warmup_done = true;
+            m_warmup_end = Clock::now();
+            return;
+        }
+    }
+
+    m_prefetch_outstanding.fetch_add(uint32_cast(bufs.size()));
+    auto const pending = std::make_shared< std::atomic< uint32_t > >(uint32_cast(bufs.size()));
+    for (auto& idx_buf : bufs) {
+        m_vdev->async_read(r_cast< char* >(idx_buf->raw_buffer()), buf_size(idx_buf->m_blkid), idx_buf->m_blkid)
+            .thenValue([this, idx_buf, pending](std::error_code err) {
+                {
+                    std::unique_lock lg{m_warmup_mtx};
+                    // Taken off meanwhile if the node was read, written or freed, the image is to be dropped then
+                    if (auto it = m_warm_bufs.find(idx_buf->m_blkid); it != m_warm_bufs.end()) {
+                        if (err) {
+                            erase_warm_buf(it);
+                        } else {
+                            it->second = idx_buf;
+                            auto const size = buf_size(idx_buf->m_blkid);
+                            m_warm_bytes += size;
+                            resource_mgr().inc_mem_usage(mem_consumer_t::index_cache, size);
+                            ++m_num_warmed;
+                        }
+                    }
+                }
+                if (pending->fetch_sub(1) == 1) { warmup_next_batch(); }
+                --m_prefetch_outstanding;
+            });
+    }
+}
+
+IndexBufferPtr IndexWBCache::take_warm_buf(BlkId const& blkid) {
+    if (m_num_warm_bufs.load(std::memory_order_relaxed) == 0) { return nullptr; }
+    std::unique_lock lg{m_warmup_mtx};
+    auto it = m_warm_bufs.find(blkid);
+    if (it == m_warm_bufs.end()) { return nullptr; }
+
+    // A read still in flight is left to be dropped on its completion, the node is read again. Image taken is
+    // accounted by the cache from here on.
+    auto buf = it->second;
+    erase_warm_buf(it);
+    return buf;
+}
+
+void IndexWBCache::drop_warm_buf(BlkId const& blkid) {
+    if (m_num_warm_bufs.load(std::memory_order_relaxed) == 0) { return; }
+    std::unique_lock lg{m_warmup_mtx};
+    if (auto it = m_warm_bufs.find(blkid); it != m_warm_bufs.end()) { erase_warm_buf(it); }
+}
+
+void IndexWBCache::erase_warm_buf(std::unordered_map< BlkId, IndexBufferPtr >::iterator it) {
+    if (it->second) {
+        auto const size = buf_size(it->first);
+        m_warm_bytes -= size;
+        resource_mgr().dec_mem_usage(mem_consumer_t::index_cache, size);
+    }
+    m_warm_bufs.erase(it);
+    m_num_warm_bufs.store(m_warm_bufs.size());
+}
+
+// Images not read since the warm up completed are let go after index_warmup_hold_secs, or right away if the index
+// cache needs the memory (which also stops the warm up). Reads in flight are dropped on their completion.
+void IndexWBCache::release_warm_bufs(bool idle_only) {
+    if (m_num_warm_bufs.load(std::memory_order_relaxed) == 0) { return; }
+    std::unique_lock lg{m_warmup_mtx};
+    if (idle_only &&
+        (!m_warmup_done ||
+         (get_elapsed_time_ms(m_warmup_end) < HS_DYNAMIC_CONFIG(btree.index_warmup_hold_secs) * 1000ull))) {
+        return;
+    }
+    if (!idle_only) { m_warmup_stopped.store(true); }
+
+    auto const nbufs = m_warm_bufs.size();
+    auto const nbytes = m_warm_bytes;
+    for (auto it = m_warm_bufs.begin(); it != m_warm_bufs.end();) {
+        erase_warm_buf(it++);
+    }
+    LOGINFOMOD(wbcache, "Released {} nodes ({} bytes) read by the warm up, which were not accessed", nbufs, nbytes);
+}
+
+//////////////////// Delta Related section /////////////////////////////////
+// Decides for each dirty buf of the cp, whether to persist it as a delta against its on-disk image or write in full
+// and then adds all the outstanding deltas to the journal of the cp.
+void IndexWBCache::build_delta_journal(IndexCPContext* cp_ctx) {
+    std::unique_lock lg{m_delta_mtx};
+    if (!m_delta_mode && m_deltas.empty()) { return; }
+
+    // Deltas of the nodes rewritten or freed in the earlier cps are no longer needed, as those cps are completed
+    for (auto it = m_deltas.begin(); it != m_deltas.end();) {
+        if ((it->second.retire_cp_id != -1) && (it->second.retire_cp_id < cp_ctx->id())) {
+            m_delta_bytes -= it->second.ranges.size();
+            it = m_deltas.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    auto const max_delta_pct = HS_DYNAMIC_CONFIG(btree.index_delta_max_pct);
+    auto const max_journal_bytes = uint64_cast(HS_DYNAMIC_CONFIG(btree.index_delta_journal_max_kb)) * 1024;
+    uint32_t num_deltas{0};
+    std::vector< uint8_t > ranges;
+    cp_ctx->m_dirty_buf_list.foreach_entry([&](IndexBufferPtr buf) {
+        buf->m_delta_flushed = false;
+        if (buf->is_meta_buf()) { return; }
+
+        auto it = m_deltas.find(buf->m_blkid);
+        auto const prev_size = (it != m_deltas.end()) ? it->second.ranges.size() : 0;
+        if (is_delta_candidate(buf, cp_ctx) && compute_delta(buf, buf_size(buf) * max_delta_pct / 100, ranges) &&
+            (m_delta_bytes - prev_size + ranges.size() <= max_journal_bytes)) {
+            if (it == m_deltas.end()) { it = m_deltas.emplace(buf->m_blkid, IndexCPContext::node_delta{}).first; }
+            m_delta_bytes = m_delta_bytes - prev_size + ranges.size();
+            it->second.cp_id = cp_ctx->id();
+            it->second.retire_cp_id = -1;
+            it->second.ranges = std::move(ranges);
+            buf->m_delta_flushed = true;
+            ++num_deltas;
+        } else if (it != m_deltas.end()) {
+            // Node is written in full, its earlier delta is journaled one last time, in case this cp doesn't complete
+            it->second.retire_cp_id = cp_ctx->id();
+        }
+        ranges.clear();
+    });
+
+    cp_ctx->add_deltas_to_journal(m_deltas);
+    CP_PERIODIC_LOG(DEBUG, cp_ctx->id(), "Persisting {} nodes as delta, total deltas in journal={} size={}",
+                    num_deltas, m_deltas.size(), m_delta_bytes);
+}
+
+// Only the leaf nodes modified in place, which are not part of any structural change in this cp (and so not needed
+// by recovery of the cp) are persisted as deltas.
+bool IndexWBCache::is_delta_candidate(IndexBufferPtr const& buf, IndexCPContext const* cp_ctx) const {
+#ifdef _PRERELEASE
+    if (buf->m_crash_flag_on) { return false; }
+#endif
+    return m_delta_mode && (buf->m_disk_image != nullptr) && !buf->m_node_freed &&
+        (buf->m_created_cp_id < cp_ctx->id()) && (buf->m_up_buffer == nullptr) &&
+        buf->m_wait_for_down_buffers.testz() && BtreeNode::identify_leaf_node(buf->raw_buffer());
+}
+
+// Diffs the buffer against its on-disk image in blocks, adjacent differing blocks merged into one range. Returns false
+// if the serialized ranges exceed max_size.
+bool IndexWBCache::compute_delta(IndexBufferPtr const& buf, uint32_t max_size, std::vector< uint8_t >& ranges) const {
+    static constexpr uint32_t diff_blk_size{32};
+    auto const size = buf_size(buf->m_blkid);
+    uint8_t const* cur = buf->raw_buffer();
+    uint8_t const* disk = buf->m_disk_image.get();
+    auto const blk_differs = [&](uint32_t off) {
+        return std::memcmp(cur + off, disk + off, std::min(diff_blk_size, size - off)) != 0;
+    };
+
+    uint32_t off{0};
+    while (off < size) {
+        if (!blk_differs(off)) {
+            off += diff_blk_size;
+            continue;
+        }
+        uint32_t end{off + diff_blk_size};
+        while ((end < size) && blk_differs(end)) {
+            end += diff_blk_size;
+        }
+        end = std::min(end, size);
+
+        IndexCPContext::delta_range const r{off, end - off};
+        if (ranges.size() + sizeof(r) + r.len > max_size) { return false; }
+        ranges.insert(ranges.end(), r_cast< uint8_t const* >(&r), r_cast< uint8_t const* >(&r) + sizeof(r));
+        ranges.insert(ranges.end(), cur + off, cur + end);
+        off = end;
+    }
+    return true;
+}
+
+// Brings the node read from disk upto its delta, unless the node on disk was written after the delta
+void IndexWBCache::apply_delta(BlkId const& blkid, uint8_t* bytes) {
+    std::unique_lock lg{m_delta_mtx};
+    auto it = m_deltas.find(blkid);
+    if ((it == m_deltas.end()) || (BtreeNode::get_modified_cp_id(bytes) >= it->second.cp_id)) { return; }
+
+    auto const& ranges = it->second.ranges;
+    for (size_t off{0}; off < ranges.size();) {
+        IndexCPContext::delta_range r;
+        std::memcpy(&r, ranges.data() + off, sizeof(r));
+        off += sizeof(r);
+        std::memcpy(bytes + r.offset, ranges.data() + off, r.len);
+        off += r.len;
+    }
+}
+
+void IndexWBCache::save_disk_image(IndexBufferPtr const& buf) {
+    auto const size = buf_size(buf->m_blkid);
+    if (buf->m_disk_image == nullptr) { buf->m_disk_image = std::shared_ptr< uint8_t[] >(new uint8_t[size]); }
+    std::memcpy(buf->m_disk_image.get(), buf->raw_buffer(), size);
+}
+
 //////////////////// Recovery Related section /////////////////////////////////
 void IndexWBCache::recover(sisl::byte_view sb) {
     // If sb is empty, its possible a first time boot.
@@ -364,11 +780,41 @@ void IndexWBCache::recover(sisl::byte_view sb) {
     auto icp_ctx = r_cast< IndexCPContext* >(cpg.context(cp_consumer_t::INDEX_SVC));
     std::map< BlkId, IndexBufferPtr > bufs = icp_ctx->recover(std::move(sb));
 
+    // Index tables do not share any node, so the buffers of each table are recovered in parallel to the others. Repairs
+    // are only queued up to the table, which does them lazily after recovery (see IndexTable::repair_node), so that
+    // none of the blks are allocated before all the tables have decided which of the blks to keep.
+    std::vector< std::vector< IndexBufferPtr > > table_bufs;
+    {
+        std::unordered_map< uint32_t, size_t > ordinal_idx;
+        for (auto const& [_, buf] : bufs) {
+            auto const [it, inserted] = ordinal_idx.try_emplace(buf->m_index_ordinal, table_bufs.size());
+            if (inserted) { table_bufs.emplace_back(); }
+            table_bufs[it->second].push_back(buf);
+        }
+    }
+
+    std::atomic< size_t > next_table{0};
+    std::vector< std::thread > workers;
+    auto const nworkers = std::min(table_bufs.size(), size_t{std::max(std::thread::hardware_concurrency(), 1u)});
+    for (size_t w{0}; w < nworkers; ++w) {
+        workers.emplace_back([this, &table_bufs, &next_table, icp_ctx, recovery_cpg = cpg]() mutable {
+            recovery_cpg.get(); // Nested cp guards of this thread are to be on the cp being recovered
+            for (auto t = next_table.fetch_add(1); t < table_bufs.size(); t = next_table.fetch_add(1)) {
+                recover_table_bufs(icp_ctx, table_bufs[t]);
+            }
+        });
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void IndexWBCache::recover_table_bufs(IndexCPContext* icp_ctx, std::vector< IndexBufferPtr > const& bufs) {
     // With all the buffers recovered, we first make the decision of which blk to keep and which blk to free. This
     // is needed so that subsequent repair can do blk allocation and shouldn't incorrectly allocate the blks which
     // are going to be committed later.
     std::vector< IndexBufferPtr > new_bufs;
-    for (auto const& [_, buf] : bufs) {
+    for (auto const& buf : bufs) {
         if (buf->m_node_freed) {
             // If the node was freed according txn records, we need to check if up_buf node was also written
             if (was_node_committed(buf->m_up_buffer)) {
@@ -430,9 +876,12 @@ bool IndexWBCache::was_node_committed(IndexBufferPtr const& buf) {
     // All down_buf has indicated that they have seen this up buffer, now its time to repair them.
     if (buf->m_bytes == nullptr) {
         // Read the btree node and get its modified cp_id
-        buf->m_bytes = hs_utils::iobuf_alloc(m_node_size, sisl::buftag::btree_node, m_vdev->align_size());
-        m_vdev->sync_read(r_cast< char* >(buf->m_bytes), m_node_size, buf->blkid());
-        if (!BtreeNode::is_valid_node(sisl::blob{buf->m_bytes, m_node_size})) { return false; }
+        auto const size = buf_size(buf->blkid());
+        buf->m_bytes =
+            hs_utils::iobuf_alloc(size, sisl::buftag::btree_node, m_vdev->align_size(), m_vdev->numa_node());
+        m_vdev->sync_read(r_cast< char* >(buf->m_bytes), size, buf->blkid());
+        if (!BtreeNode::is_valid_node(sisl::blob{buf->m_bytes, size})) { return false; }
+        apply_delta(buf->blkid(), buf->m_bytes);
 
         buf->m_dirtied_cp_id = BtreeNode::get_modified_cp_id(buf->m_bytes);
     }
@@ -448,6 +897,9 @@ folly::Future< bool > IndexWBCache::async_cp_flush(IndexCPContext* cp_ctx) {
         return folly::makeFuture< bool >(true); // nothing to flush
     }
 
+    // Persist the small changes of leaf nodes as deltas in journal, so they are not rewritten
+    build_delta_journal(cp_ctx);
+
     // First thing is to flush the new_blks created as part of the CP.
     auto const& journal_buf = cp_ctx->journal_buf();
     if (journal_buf.size() != 0) {
@@ -457,24 +909,65 @@ folly::Future< bool > IndexWBCache::async_cp_flush(IndexCPContext* cp_ctx) {
             meta_service().add_sub_sb("wb_cache", journal_buf.cbytes(), journal_buf.size(), m_meta_blk);
         }
     }
+    persist_hot_nodes();
 
     cp_ctx->prepare_flush_iteration();
+    cp_ctx->m_flush_start_time = Clock::now();
 
-    for (auto& fiber : m_cp_flush_fibers) {
-        iomanager.run_on_forget(fiber, [this, cp_ctx]() {
+    // cache_flush_threads could be changed since the last cp, to give flushing more threads while catching up etc. The
+    // ones the resize timer started since then join in. The previous cp is completely flushed by now, so the fibers
+    // are not used by any completion.
+    {
+        std::unique_lock lg{m_flush_threads_mtx};
+        if (m_started_flush_fibers.size() > m_cp_flush_fibers.size()) { m_cp_flush_fibers = m_started_flush_fibers; }
+    }
+    m_num_flush_fibers = std::min(s_cast< size_t >(std::max(1, HS_DYNAMIC_CONFIG(generic.cache_flush_threads))),
+                                  m_cp_flush_fibers.size());
+
+    for (size_t i{0}; i < m_num_flush_fibers; ++i) {
+        iomanager.run_on_forget(m_cp_flush_fibers[i], [this, cp_ctx]() {
             IndexBufferPtrList buf_list;
             get_next_bufs(cp_ctx, resource_mgr().get_dirty_buf_qd(), buf_list);
+            if (!buf_list.empty()) { flush_bufs(cp_ctx, std::move(buf_list)); }
+        });
+    }
+    return std::move(cp_ctx->get_future());
+}
 
-            for (auto& buf : buf_list) {
-                do_flush_one_buf(cp_ctx, buf, true);
+// Flushes all the bufs as one io batch, so that the bufs which are adjacent on the device (like the siblings created
+// by splits in this cp) are written as one writev. Completion of the batch then picks the bufs which are ready next.
+void IndexWBCache::flush_bufs(IndexCPContext* cp_ctx, IndexBufferPtrList bufs) {
+    VDevIOBatch batch{*m_vdev};
+    std::vector< folly::Future< std::error_code > > write_futs;
+    IndexBufferPtrList written_bufs;
+    IndexBufferPtrList skipped_bufs;
+    for (auto& buf : bufs) {
+        auto write_fut = do_flush_one_buf(cp_ctx, buf, batch);
+        if (write_fut) {
+            write_futs.emplace_back(std::move(*write_fut));
+            written_bufs.emplace_back(std::move(buf));
+        } else {
+            skipped_bufs.emplace_back(std::move(buf));
+        }
+    }
+    batch.submit();
+
+    if (!write_futs.empty()) {
+        folly::collectAllUnsafe(write_futs).thenValue([cp_ctx, written_bufs = std::move(written_bufs)](auto) {
+            auto& pthis = s_cast< IndexWBCache& >(wb_cache());
+            if (pthis.m_delta_mode) {
+                for (auto const& buf : written_bufs) {
+                    if (BtreeNode::identify_leaf_node(buf->raw_buffer())) { pthis.save_disk_image(buf); }
+                }
             }
-            m_vdev->submit_batch();
+            pthis.process_write_completion(cp_ctx, written_bufs);
         });
     }
-    return std::move(cp_ctx->get_future());
+    if (!skipped_bufs.empty()) { process_write_completion(cp_ctx, skipped_bufs); }
 }
 
-void IndexWBCache::do_flush_one_buf(IndexCPContext* cp_ctx, IndexBufferPtr const& buf, bool part_of_batch) {
+std::optional< folly::Future< std::error_code > >
+IndexWBCache::do_flush_one_buf(IndexCPContext* cp_ctx, IndexBufferPtr const& buf, VDevIOBatch& batch) {
     LOGTRACEMOD(wbcache, "cp {} buf {}", cp_ctx->id(), buf->to_string());
     buf->set_state(index_buf_state_t::FLUSHING);
 
@@ -490,68 +983,109 @@ void IndexWBCache::do_flush_one_buf(IndexCPContext* cp_ctx, IndexBufferPtr const
                     buf->to_string());
         auto const& sb = r_cast< MetaIndexBuffer* >(buf.get())->m_sb;
         meta_service().update_sub_sb(buf->m_bytes, sb.size(), sb.meta_blk());
-        process_write_completion(cp_ctx, buf);
+        return std::nullopt;
     } else if (buf->m_node_freed) {
         LOGTRACEMOD(wbcache, "Not flushing buf {} as it was freed, its here for merely dependency", cp_ctx->id(),
                     buf->to_string());
-        process_write_completion(cp_ctx, buf);
+        return std::nullopt;
+    } else if (buf->m_delta_flushed) {
+        LOGTRACEMOD(wbcache, "Not flushing cp {} buf {} as it is persisted as delta in journal", cp_ctx->id(),
+                    buf->to_string());
+        return std::nullopt;
     } else {
         LOGTRACEMOD(wbcache, "flushing cp {} buf {} info: {}", cp_ctx->id(), buf->to_string(),
                     BtreeNode::to_string_buf(buf->raw_buffer()));
-        m_vdev->async_write(r_cast< const char* >(buf->raw_buffer()), m_node_size, buf->m_blkid, part_of_batch)
-            .thenValue([buf, cp_ctx](auto) {
-                auto& pthis = s_cast< IndexWBCache& >(wb_cache()); // Avoiding more than 16 bytes capture
-                pthis.process_write_completion(cp_ctx, buf);
-            });
-
-        if (!part_of_batch) { m_vdev->submit_batch(); }
+        return batch.add_write(r_cast< const char* >(buf->raw_buffer()), buf_size(buf->m_blkid), buf->m_blkid);
     }
 }
 
-void IndexWBCache::process_write_completion(IndexCPContext* cp_ctx, IndexBufferPtr const& buf) {
-    LOGTRACEMOD(wbcache, "cp {} buf {}", cp_ctx->id(), buf->to_string());
-    resource_mgr().dec_dirty_buf_size(m_node_size);
-    auto [next_buf, has_more] = on_buf_flush_done(cp_ctx, buf);
-    if (next_buf) {
-        do_flush_one_buf(cp_ctx, next_buf, false);
-    } else if (!has_more) {
+void IndexWBCache::process_write_completion(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs) {
+    LOGTRACEMOD(wbcache, "cp {} completed {} bufs", cp_ctx->id(), bufs.size());
+    uint32_t dirty_size{0};
+    for (auto const& buf : bufs) {
+        dirty_size += buf_size(buf);
+    }
+    resource_mgr().dec_dirty_buf_size(dirty_size);
+
+    IndexBufferPtrList next_bufs;
+    if (on_bufs_flush_done(cp_ctx, bufs, next_bufs)) {
+        if (next_bufs.empty()) { return; }
+
+        // Issue the next bufs from a flush fiber rather than the completion, spreading them across the fibers, so the
+        // independent dependency chains progress in parallel
+        auto& fiber =
+            m_cp_flush_fibers[m_next_flush_fiber.fetch_add(1, std::memory_order_relaxed) % m_num_flush_fibers];
+        iomanager.run_on_forget(fiber, [this, cp_ctx, next_bufs = std::move(next_bufs)]() mutable {
+            flush_bufs(cp_ctx, std::move(next_bufs));
+        });
+    } else {
         // We are done flushing the buffers, We flush the vdev to persist the vdev bitmaps and free blks
         // Pick a CP Manager blocking IO fiber to execute the cp flush of vdev
+        report_table_flush_stats(cp_ctx);
         iomanager.run_on_forget(cp_mgr().pick_blocking_io_fiber(), [this, cp_ctx]() {
             LOGTRACEMOD(wbcache, "Initiating CP flush");
+            io_priority_guard g{io_priority_t::cp_flush};
             m_vdev->cp_flush(cp_ctx); // This is a blocking io call
             cp_ctx->complete(true);
         });
     }
 }
 
-std::pair< IndexBufferPtr, bool > IndexWBCache::on_buf_flush_done(IndexCPContext* cp_ctx, IndexBufferPtr const& buf) {
-    if (m_cp_flush_fibers.size() > 1) {
+void IndexWBCache::report_table_flush_stats(IndexCPContext* cp_ctx) {
+    for (auto const& [ordinal, stats] : cp_ctx->m_table_flush_stats) {
+        auto tbl = index_service().get_index_table(ordinal);
+        if (tbl == nullptr) { continue; } // Destroyed meanwhile
+        auto& metrics = tbl->index_metrics();
+        HISTOGRAM_OBSERVE(metrics, index_cp_dirty_nodes, stats.num_nodes);
+        HISTOGRAM_OBSERVE(metrics, index_cp_flush_bytes, stats.flushed_bytes);
+        HISTOGRAM_OBSERVE(metrics, index_cp_flush_latency_us,
+                          get_elapsed_time_us(cp_ctx->m_flush_start_time, stats.last_flushed_time));
+    }
+}
+
+bool IndexWBCache::on_bufs_flush_done(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs,
+                                      IndexBufferPtrList& next_bufs) {
+    if (m_num_flush_fibers > 1) {
         std::unique_lock lg(m_flush_mtx);
-        return on_buf_flush_done_internal(cp_ctx, buf);
+        return on_bufs_flush_done_internal(cp_ctx, bufs, next_bufs);
     } else {
-        return on_buf_flush_done_internal(cp_ctx, buf);
+        return on_bufs_flush_done_internal(cp_ctx, bufs, next_bufs);
     }
 }
 
-std::pair< IndexBufferPtr, bool > IndexWBCache::on_buf_flush_done_internal(IndexCPContext* cp_ctx,
-                                                                           IndexBufferPtr const& buf) {
-    IndexBufferPtrList buf_list;
+// Marks the bufs clean and collects for each of them, either its up buffer if it was the last one it waited for or
+// else the next dirty buf. Returns false if these were the last dirty bufs of the cp.
+bool IndexWBCache::on_bufs_flush_done_internal(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs,
+                                               IndexBufferPtrList& next_bufs) {
+    bool has_more{true};
+    auto const now = Clock::now();
+    for (auto const& buf : bufs) {
 #ifndef NDEBUG
-    buf->m_down_buffers.clear();
+        buf->m_down_buffers.clear();
 #endif
-    buf->set_state(index_buf_state_t::CLEAN);
+        buf->set_state(index_buf_state_t::CLEAN);
+        if (!buf->is_meta_buf() && !buf->m_node_freed) {
+            auto& stats = cp_ctx->m_table_flush_stats[buf->m_index_ordinal];
+            ++stats.num_nodes;
+            if (!buf->m_delta_flushed) {
+                auto const bytes = buf_size(buf->m_blkid);
+                stats.flushed_bytes += bytes;
+                cp_ctx->add_flushed_bytes(bytes);
+            }
+            stats.last_flushed_time = now;
+        }
 
-    if (cp_ctx->m_dirty_buf_count.decrement_testz()) {
-        return std::make_pair(nullptr, false);
-    } else {
-        get_next_bufs_internal(cp_ctx, 1u, buf, buf_list);
-        return std::make_pair((buf_list.size() ? buf_list[0] : nullptr), true);
+        if (cp_ctx->m_dirty_buf_count.decrement_testz()) {
+            has_more = false;
+        } else {
+            get_next_bufs_internal(cp_ctx, 1u, buf, next_bufs);
+        }
     }
+    return has_more;
 }
 
 void IndexWBCache::get_next_bufs(IndexCPContext* cp_ctx, uint32_t max_count, IndexBufferPtrList& bufs) {
-    if (m_cp_flush_fibers.size() > 1) {
+    if (m_num_flush_fibers > 1) {
         std::unique_lock lg(m_flush_mtx);
         get_next_bufs_internal(cp_ctx, max_count, nullptr, bufs);
     } else {
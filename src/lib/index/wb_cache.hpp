@@ -14,45 +14,114 @@
  *
  *********************************************************************************/
 #pragma once
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <iomgr/iomgr.hpp>
 #include <homestore/index/wb_cache_base.hpp>
 #include <homestore/index/index_internal.hpp>
-#include <sisl/cache/simple_cache.hpp>
 #include "index/index_cp.hpp"
+#include "index/index_node_cache.hpp"
 
 namespace sisl {
 template < typename T >
 class ThreadVector;
-
-class Evictor;
 } // namespace sisl
 
 namespace homestore {
 class VirtualDev;
+class VDevIOBatch;
+
+#pragma pack(1)
+// Blkids of the hottest nodes of the cache as of the last cp, read back into the cache on restart
+struct index_warmup_sb {
+    static constexpr uint64_t warmup_magic{0xa7b1e4c0};
+    static constexpr uint32_t warmup_version{0x1};
+
+    uint64_t magic{warmup_magic};
+    uint32_t version{warmup_version};
+    uint32_t num_nodes{0}; // Followed by the bnodeid_t of each of the nodes
+};
+#pragma pack()
 
 class IndexWBCache : public IndexWBCacheBase {
 private:
     std::shared_ptr< VirtualDev > m_vdev;
-    sisl::SimpleCache< BlkId, BtreeNodePtr > m_cache;
-    uint32_t m_node_size;
-    std::vector< iomgr::io_fiber_t > m_cp_flush_fibers;
+    IndexNodeCache m_cache;
+    uint32_t m_node_size; // Index blk size, nodes are of one or more blks
+    std::vector< iomgr::io_fiber_t > m_cp_flush_fibers; // Started as of the cp, of which the cp flushing uses first n
+    size_t m_num_flush_fibers{0};                      // Fibers the cp being flushed uses (cache_flush_threads)
+
+    // Flush threads are started by the resize timer as cache_flush_threads is raised, and join m_cp_flush_fibers on the
+    // next cp once they are up, so that the cp never waits for them
+    std::mutex m_flush_threads_mtx;
+    std::condition_variable m_flush_threads_cv;
+    size_t m_flush_threads_requested{0};
+    std::vector< iomgr::io_fiber_t > m_started_flush_fibers;
+    iomgr::timer_handle_t m_flush_threads_timer{iomgr::null_timer_handle};
+    std::atomic< uint32_t > m_next_flush_fiber{0};     // Round robin of the fibers to flush the next ready bufs
     std::mutex m_flush_mtx;
     void* m_meta_blk;
 
+    // Delta mode: deltas of the leaf nodes whose on-disk image is behind, carried in every cp journal until the node is
+    // rewritten or freed.
+    bool m_delta_mode{false};
+    std::mutex m_delta_mtx;
+    IndexCPContext::node_delta_map_t m_deltas;
+    uint64_t m_delta_bytes{0};
+
+    // Blkids being read ahead. A read which completes after its id is taken off (read by read_buf or freed meanwhile)
+    // is dropped, since it could be stale by then.
+    std::mutex m_prefetch_mtx;
+    std::unordered_set< BlkId > m_prefetching;
+    std::atomic< uint32_t > m_prefetch_outstanding{0};
+
+    // Warm up: hot nodes of the last cp are read back in the background on restart. Only an index table could create
+    // its nodes, so the images read are held until the node is first read. An image is dropped if its node is written
+    // or freed meanwhile, which keeps it same as the node on the device. Reads in flight have a null image. Images
+    // are counted in the memory usage of the index cache, the warm up stops once it is at its quota, and the ones not
+    // read within index_warmup_hold_secs of the warm up completing (or once the quota shrinks) are released.
+    void* m_warmup_meta_blk{nullptr};
+    std::mutex m_warmup_mtx;
+    std::vector< bnodeid_t > m_warmup_ids;
+    size_t m_warmup_next{0};
+    std::unordered_map< BlkId, IndexBufferPtr > m_warm_bufs;
+    std::atomic< size_t > m_num_warm_bufs{0}; // Size of m_warm_bufs, so that it is looked up only while warming up
+    uint64_t m_warm_bytes{0};                  // Of the images read, in m_warm_bufs
+    std::atomic< uint32_t > m_num_warmed{0};
+    std::atomic< bool > m_warmup_stopped{false};
+    bool m_warmup_done{false};
+    Clock::time_point m_warmup_start;
+    Clock::time_point m_warmup_end;
+    std::vector< BlkId > m_persisted_hot; // Hot nodes as of the last persist_hot_nodes
+
 public:
     IndexWBCache(const std::shared_ptr< VirtualDev >& vdev, std::pair< meta_blk*, sisl::byte_view > sb,
-                 const std::shared_ptr< sisl::Evictor >& evictor, uint32_t node_size);
+                 std::pair< meta_blk*, sisl::byte_view > warmup_sb, uint32_t node_size);
+    ~IndexWBCache() override;
 
-    BtreeNodePtr alloc_buf(node_initializer_t&& node_initializer) override;
+    BtreeNodePtr alloc_buf(uint32_t node_size, node_initializer_t&& node_initializer) override;
     void write_buf(const BtreeNodePtr& node, const IndexBufferPtr& buf, CPContext* cp_ctx) override;
-    void read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) override;
+    bool read_buf(bnodeid_t id, BtreeNodePtr& node, node_initializer_t&& node_initializer) override;
+    void prefetch_bufs(std::vector< bnodeid_t > const& ids, node_initializer_t&& node_initializer) override;
+    uint32_t prefetch_window() const override;
+    uint32_t num_warmed_bufs() const override { return m_num_warmed.load(); }
+
+    /// @brief Flush threads started so far, flushing of the cps uses cache_flush_threads of them
+    size_t num_flush_threads();
 
     bool get_writable_buf(const BtreeNodePtr& node, CPContext* context) override;
     void transact_bufs(uint32_t index_ordinal, IndexBufferPtr const& parent_buf, IndexBufferPtr const& child_buf,
                        IndexBufferPtrList const& new_node_bufs, IndexBufferPtrList const& freed_node_bufs,
                        CPContext* cp_ctx) override;
+    void transact_new_bufs(uint32_t index_ordinal, IndexBufferPtr const& up_buf, IndexBufferPtrList const& new_bufs,
+                           CPContext* cp_ctx) override;
     void free_buf(const IndexBufferPtr& buf, CPContext* cp_ctx) override;
     bool refresh_meta_buf(shared< MetaIndexBuffer >& meta_buf, CPContext* cp_ctx) override;
 
@@ -61,20 +130,45 @@ public:
     IndexBufferPtr copy_buffer(const IndexBufferPtr& cur_buf, const CPContext* cp_ctx) const;
     void recover(sisl::byte_view sb);
 
+    /// @brief Start reading the hot nodes of the last cp before restart into the cache, in the background
+    void start_warmup();
+
 private:
-    void start_flush_threads();
+    void start_flush_threads(size_t nthreads);
+    void resize_flush_threads();
     void recover_new_nodes(sisl::byte_view sb);
-    void process_write_completion(IndexCPContext* cp_ctx, IndexBufferPtr const& pbuf);
-    void do_flush_one_buf(IndexCPContext* cp_ctx, IndexBufferPtr const& buf, bool part_of_batch);
+    void flush_bufs(IndexCPContext* cp_ctx, IndexBufferPtrList bufs);
+    void process_write_completion(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs);
+    void report_table_flush_stats(IndexCPContext* cp_ctx);
+    std::optional< folly::Future< std::error_code > > do_flush_one_buf(IndexCPContext* cp_ctx,
+                                                                       IndexBufferPtr const& buf, VDevIOBatch& batch);
     void link_buf(IndexBufferPtr const& up, IndexBufferPtr const& down, bool is_sibling_link, CPContext* cp_ctx);
 
-    std::pair< IndexBufferPtr, bool > on_buf_flush_done(IndexCPContext* cp_ctx, IndexBufferPtr const& buf);
-    std::pair< IndexBufferPtr, bool > on_buf_flush_done_internal(IndexCPContext* cp_ctx, IndexBufferPtr const& buf);
+    bool on_bufs_flush_done(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs, IndexBufferPtrList& next_bufs);
+    bool on_bufs_flush_done_internal(IndexCPContext* cp_ctx, IndexBufferPtrList const& bufs,
+                                     IndexBufferPtrList& next_bufs);
 
     void get_next_bufs(IndexCPContext* cp_ctx, uint32_t max_count, IndexBufferPtrList& bufs);
     void get_next_bufs_internal(IndexCPContext* cp_ctx, uint32_t max_count, IndexBufferPtr const& prev_flushed_buf,
                                 IndexBufferPtrList& bufs);
 
+    void persist_hot_nodes();
+    void warmup_next_batch();
+    IndexBufferPtr take_warm_buf(BlkId const& blkid);
+    void drop_warm_buf(BlkId const& blkid);
+    void erase_warm_buf(std::unordered_map< BlkId, IndexBufferPtr >::iterator it); // Expects m_warmup_mtx to be held
+    void release_warm_bufs(bool idle_only);
+
+    void build_delta_journal(IndexCPContext* cp_ctx);
+    bool is_delta_candidate(IndexBufferPtr const& buf, IndexCPContext const* cp_ctx) const;
+    bool compute_delta(IndexBufferPtr const& buf, uint32_t max_size, std::vector< uint8_t >& ranges) const;
+    void apply_delta(BlkId const& blkid, uint8_t* bytes);
+    void save_disk_image(IndexBufferPtr const& buf);
+
+    uint32_t buf_size(BlkId const& blkid) const { return m_node_size * blkid.blk_count(); }
+    uint32_t buf_size(IndexBufferPtr const& buf) const;
+
+    void recover_table_bufs(IndexCPContext* icp_ctx, std::vector< IndexBufferPtr > const& bufs);
     void process_up_buf(IndexBufferPtr const& buf, bool do_repair);
     bool was_node_committed(IndexBufferPtr const& buf);
 };
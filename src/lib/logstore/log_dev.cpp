@@ -16,7 +16,10 @@
 #include <algorithm>
 #include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <iterator>
+#include <system_error>
+#include <thread>
 
 #include <sisl/fds/vector_pool.hpp>
 #include <iomgr/iomgr_flip.hpp>
@@ -24,6 +27,7 @@
 #include <homestore/logstore_service.hpp>
 #include <homestore/meta_service.hpp>
 #include <homestore/homestore.hpp>
+#include <homestore/probes.hpp>
 
 #include "log_dev.hpp"
 #include "device/journal_vdev.hpp"
@@ -41,9 +45,15 @@ SISL_LOGGING_DECL(logstore)
     HS_PERIODIC_DETAILED_LOG(level, logstore, "log_dev", m_logdev_id, , , msg, __VA_ARGS__)
 
 static bool has_data_service() { return HomeStore::instance()->has_data_service(); }
+
+// Context of a rollback marker record, which holds on to its payload until it is flushed
+struct rollback_marker_ctx {
+    rollback_marker marker;
+    std::function< void() > done_cb;
+};
 // static BlkDataService& data_service() { return HomeStore::instance()->data_service(); }
 
-LogDev::LogDev(const logdev_id_t id, JournalVirtualDev* vdev) : m_logdev_id{id}, m_vdev(vdev) {
+LogDev::LogDev(const logdev_id_t id, JournalVirtualDev* vdev) : m_logdev_id{id}, m_vdev(vdev), m_metrics{id} {
     m_flush_size_multiple = HS_DYNAMIC_CONFIG(logstore->flush_size_multiple_logdev);
     // Each logdev has one journal descriptor.
     m_vdev_jd = m_vdev->open(m_logdev_id);
@@ -57,9 +67,9 @@ void LogDev::start(bool format) {
     THIS_LOGDEV_LOG(INFO, "Initializing logdev with flush size multiple={}", m_flush_size_multiple);
 
     for (uint32_t i = 0; i < max_log_group; ++i) {
-        m_log_group_pool[i].start(m_flush_size_multiple, m_vdev->align_size());
+        m_log_group_pool[i].start(m_flush_size_multiple, m_vdev->align_size(), m_vdev->numa_node());
     }
-    m_log_records = std::make_unique< sisl::StreamTracker< log_record > >();
+    m_log_records = std::make_unique< LogRecordTracker< log_record > >("LogDevRecords");
     m_stopped = false;
 
     // First read the info block
@@ -85,6 +95,8 @@ void LogDev::start(bool format) {
         m_log_records->reinit(m_log_idx);
         m_last_flush_idx = m_log_idx - 1;
     }
+    m_last_prepared_idx = m_last_flush_idx;
+    m_last_prepared_crc = m_last_crc;
 
     start_timer();
     handle_unopened_log_stores(format);
@@ -95,6 +107,7 @@ void LogDev::start(bool format) {
         if (!format) {
             for (auto& p : m_id_logstore_map) {
                 auto& lstore{p.second.log_store};
+                if (lstore) { lstore->drain_log_found_workers(); }
                 if (lstore && lstore->get_log_replay_done_cb()) {
                     lstore->get_log_replay_done_cb()(lstore, lstore->seq_num() - 1);
                     lstore->truncate(lstore->truncated_upto());
@@ -137,8 +150,15 @@ void LogDev::stop() {
     m_pending_flush_size.store(0);
     m_is_flushing.store(false);
     m_last_flush_idx = -1;
+    m_last_prepared_idx = -1;
     m_last_truncate_idx = -1;
     m_last_crc = INVALID_CRC32_VALUE;
+    m_last_prepared_crc = INVALID_CRC32_VALUE;
+    m_preparing_group = false;
+    m_completing_groups = false;
+    m_inflight_groups.store(0);
+    m_log_group_issue_seq = 0;
+    m_log_group_complete_seq = 0;
     if (m_block_flush_q != nullptr) {
         sisl::VectorPool< flush_blocked_callback >::free(m_block_flush_q, false /* no_cache */);
     }
@@ -158,6 +178,7 @@ void LogDev::destroy() {
 void LogDev::start_timer() {
     // Currently only tests set it to 0.
     if (HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) == 0) { return; }
+    if (HS_DYNAMIC_CONFIG(logstore.shared_flush_timer)) { return; } // Service timer flushes it, once it is queued
 
     iomanager.run_on_wait(logstore_service().flush_thread(), [this]() {
         m_flush_timer_hdl = iomanager.schedule_thread_timer(HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) * 1000,
@@ -166,6 +187,17 @@ void LogDev::start_timer() {
     });
 }
 
+void LogDev::on_shared_flush_timer() {
+    // Cleared before the flush, so that appends racing with it queue it again, if not done below anyway
+    m_shared_flush_queued.store(false, std::memory_order_release);
+    if (m_stopped) { return; }
+    flush_if_needed();
+    if ((m_pending_flush_size.load(std::memory_order_relaxed) > 0) &&
+        !m_shared_flush_queued.exchange(true, std::memory_order_acq_rel)) {
+        logstore_service().queue_shared_flush(m_logdev_id);
+    }
+}
+
 void LogDev::stop_timer() {
     if (m_flush_timer_hdl != iomgr::null_timer_handle) {
         // cancel the timer
@@ -181,8 +213,47 @@ void LogDev::do_load(const off_t device_cursor) {
 
     THIS_LOGDEV_LOG(TRACE, "LogDev::do_load start log_dev={} ", m_logdev_id);
 
+    // Groups are read and validated by the decoder thread ahead of this one, which calls back their records in order.
+    // Decoder stops at the same group this loop breaks at (end of stream or the first group being truncated already).
+    if (HS_DYNAMIC_CONFIG(logstore.rollback_marker_in_log)) { load_rollback_markers(device_cursor); }
+
+    auto const decode_ahead = HS_DYNAMIC_CONFIG(logstore.recovery_decode_ahead_groups);
+    auto const load_start_idx = m_log_idx.load();
+    std::mutex decoded_mtx;
+    std::condition_variable decoded_cv;
+    std::deque< std::pair< sisl::byte_view, off_t > > decoded;
+    std::thread decoder;
+    if (decode_ahead > 0) {
+        decoder = std::thread([&]() {
+            bool first{true};
+            bool last{false};
+            while (!last) {
+                off_t dev_offset{0};
+                auto b = lstream.next_group(&dev_offset);
+                last = (b.size() == 0) ||
+                    (first && (r_cast< const log_group_header* >(b.bytes())->start_idx() < load_start_idx));
+                first = false;
+
+                std::unique_lock lk{decoded_mtx};
+                decoded_cv.wait(lk, [&] { return decoded.size() < decode_ahead; });
+                decoded.emplace_back(std::move(b), dev_offset);
+                decoded_cv.notify_all();
+            }
+        });
+    }
+    auto const next_group = [&](off_t* dev_offset) -> sisl::byte_view {
+        if (!decoder.joinable()) { return lstream.next_group(dev_offset); }
+        std::unique_lock lk{decoded_mtx};
+        decoded_cv.wait(lk, [&] { return !decoded.empty(); });
+        auto [b, off] = std::move(decoded.front());
+        decoded.pop_front();
+        decoded_cv.notify_all();
+        *dev_offset = off;
+        return b;
+    };
+
     do {
-        const auto buf = lstream.next_group(&group_dev_offset);
+        const auto buf = next_group(&group_dev_offset);
         if (buf.size() == 0) {
             THIS_LOGDEV_LOG(INFO, "LogDev loaded log_idx in range of [{} - {}]", loaded_from, m_log_idx - 1);
             break;
@@ -191,6 +262,7 @@ void LogDev::do_load(const off_t device_cursor) {
         auto* header = r_cast< const log_group_header* >(buf.bytes());
         if (loaded_from == -1 && header->start_idx() < m_log_idx) {
             // log dev is truncated completely
+            if (decoder.joinable()) { decoder.join(); }
             assert_next_pages(lstream);
             THIS_LOGDEV_LOG(INFO, "LogDev loaded log_idx in range of [{} - {}]", loaded_from, m_log_idx - 1);
             break;
@@ -199,6 +271,7 @@ void LogDev::do_load(const off_t device_cursor) {
         THIS_LOGDEV_LOG(INFO, "Found log group header offset=0x{} header {}", to_hex(group_dev_offset), *header);
         HS_REL_ASSERT_EQ(header->start_idx(), m_log_idx.load(), "log indx is not the expected one");
         if (loaded_from == -1) { loaded_from = header->start_idx(); }
+        index_group(header->start_idx(), group_dev_offset);
 
         // Loop through each record within the log group and do a callback
         decltype(header->nrecords()) i{0};
@@ -215,7 +288,10 @@ void LogDev::do_load(const off_t device_cursor) {
             b.set_size(rec->size);
             if (m_last_truncate_idx == -1) { m_last_truncate_idx = header->start_idx() + i; }
             // Validate if the id is present in rollback info
-            if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
+            if (rec->store_seq_num == rollback_marker_seq_num) {
+                // Applied ahead of the replay already, see load_rollback_markers
+                if (i + 1 == header->nrecords()) { complete_flush_batch(flush_ld_key); }
+            } else if (m_logdev_meta.is_rolled_back(rec->store_id, header->start_idx() + i)) {
                 THIS_LOGDEV_LOG(DEBUG,
                                 "logstore_id[{}] log_idx={}, lsn={} has been rolledback, not notifying the logstore",
                                 rec->store_id, (header->start_idx() + i), rec->store_seq_num);
@@ -232,6 +308,7 @@ void LogDev::do_load(const off_t device_cursor) {
         m_log_idx = header->start_idx() + i;
         m_last_crc = header->cur_grp_crc;
     } while (true);
+    if (decoder.joinable()) { decoder.join(); }
 
     // Update the tail offset with where we finally end up loading, so that new append entries can be written from
     // here.
@@ -239,6 +316,34 @@ void LogDev::do_load(const off_t device_cursor) {
     THIS_LOGDEV_LOG(TRACE, "LogDev::do_load end {} ", m_logdev_id);
 }
 
+// Rollback markers apply to the records before them, which replay would have called back by the time it finds them,
+// so they are collected into the rollback info upfront, by a scan of the journal through a bounded window.
+void LogDev::load_rollback_markers(off_t device_cursor) {
+    log_group_scanner scanner{m_vdev_jd, m_vdev->align_size(), HS_DYNAMIC_CONFIG(logstore.bulk_read_size),
+                              device_cursor};
+    uint32_t nmarkers{0};
+    while (scanner.next()) {
+        auto const* header = scanner.header();
+        if ((scanner.groups_scanned() == 1) && (header->start_idx() < m_log_idx.load())) { break; }
+        for (uint32_t n{0}; n < header->nrecords(); ++n) {
+            auto [rec, data] = scanner.record(n);
+            if (rec.store_seq_num != rollback_marker_seq_num) { continue; }
+
+            auto const* marker = r_cast< const rollback_marker* >(data.bytes());
+            HS_REL_ASSERT_EQ(marker->magic, rollback_marker::ROLLBACK_MARKER_MAGIC,
+                             "Rollback marker magic mismatch at log_idx={}", header->start_idx() + n);
+            // Marker could be in the superblk as well, if it was persisted since the marker was flushed
+            if (!m_logdev_meta.is_rolled_back(rec.store_id, marker->idx_range.first) ||
+                !m_logdev_meta.is_rolled_back(rec.store_id, marker->idx_range.second)) {
+                m_logdev_meta.add_rollback_record(rec.store_id, marker->idx_range, false /* persist_now */);
+            }
+            ++nmarkers;
+        }
+    }
+    THIS_LOGDEV_LOG(INFO, "Found {} rollback markers in {} log groups, scan ended with: {}", nmarkers,
+                    scanner.groups_scanned(), scanner.end_reason());
+}
+
 void LogDev::assert_next_pages(log_stream_reader& lstream) {
     THIS_LOGDEV_LOG(INFO,
                     "Logdev reached offset, which has invalid header, because of end of stream. Validating if it is "
@@ -247,6 +352,12 @@ void LogDev::assert_next_pages(log_stream_reader& lstream) {
         const auto buf = lstream.group_in_next_page();
         if (buf.size() != 0) {
             auto* header = r_cast< const log_group_header* >(buf.bytes());
+            if ((max_inflight_log_groups() > 1) && (header->start_idx() >= m_log_idx.load(std::memory_order_acquire))) {
+                // Groups are written concurrently, so a later group could have made it to the device while an earlier
+                // one didn't. None of its records were completed (completion is in order), so it is just discarded.
+                THIS_LOGDEV_LOG(INFO, "Ignoring log group written ahead of the end of log, header: {}", *header);
+                continue;
+            }
             HS_REL_ASSERT_GT(m_log_idx.load(std::memory_order_acquire), header->start_idx(),
                              "Found a header with future log_idx after reaching end of log. Hence rbuf which was read "
                              "must have been corrupted, logdev id {} Header: {}",
@@ -256,15 +367,21 @@ void LogDev::assert_next_pages(log_stream_reader& lstream) {
 }
 
 int64_t LogDev::append_async(const logstore_id_t store_id, const logstore_seq_num_t seq_num, const sisl::io_blob& data,
-                             void* cb_context, bool flush_wait) {
+                             void* cb_context, bool flush_wait, log_serialize_cb_t&& serializer) {
     auto prev_size = m_pending_flush_size.fetch_add(data.size(), std::memory_order_relaxed);
     const auto idx = m_log_idx.fetch_add(1, std::memory_order_acq_rel);
-    auto threshold_size = LogDev::flush_data_threshold_size();
-    m_log_records->create(idx, store_id, seq_num, data, cb_context);
+    auto threshold_size = flush_threshold();
+    m_log_records->create(idx, store_id, seq_num, data, cb_context, std::move(serializer));
+    if (HS_DYNAMIC_CONFIG(logstore.shared_flush_timer) && !m_shared_flush_queued.load(std::memory_order_relaxed) &&
+        !m_shared_flush_queued.exchange(true, std::memory_order_acq_rel)) {
+        logstore_service().queue_shared_flush(m_logdev_id);
+    }
 
+    // Flush could be in progress, but if the pipeline has room, next group could still be issued along with it
     if (flush_wait ||
         ((prev_size < threshold_size && ((prev_size + data.size()) >= threshold_size) &&
-          !m_is_flushing.load(std::memory_order_relaxed)))) {
+          (!m_is_flushing.load(std::memory_order_relaxed) ||
+           (m_inflight_groups.load(std::memory_order_relaxed) < max_inflight_log_groups()))))) {
         flush_if_needed(flush_wait ? 1 : -1);
     }
     return idx;
@@ -282,21 +399,42 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
     // THIS_LOGDEV_LOG(TRACE, "Logdev read log group header {}", *header);
     HS_REL_ASSERT_EQ(header->magic_word(), LOG_GROUP_HDR_MAGIC, "Log header corrupted with magic mismatch! {} {}",
                      m_logdev_id, *header);
-    HS_REL_ASSERT_EQ(header->get_version(), log_group_header::header_version, "Log header version mismatch!  {} {}",
+    HS_REL_ASSERT_LE(header->get_version(), log_group_header::header_version, "Log header version mismatch!  {} {}",
                      m_logdev_id, *header);
     HS_REL_ASSERT_LE(header->start_idx(), key.idx, "log key offset does not match with log_idx {} }{}", m_logdev_id,
                      *header);
     HS_REL_ASSERT_GT((header->start_idx() + header->nrecords()), key.idx,
                      "log key offset does not match with log_idx {} {}", m_logdev_id, *header);
+    if (header->is_compressed()) {
+        // Records of a compressed group are known only upon decompressing the whole of it
+        auto group_buf = buf;
+        if (header->total_size() > initial_read_size) {
+            auto const total_size = sisl::round_up(header->total_size(), m_vdev->align_size());
+            group_buf = sisl::make_byte_array(total_size, m_vdev->align_size(), sisl::buftag::logread);
+            std::memcpy(group_buf->bytes(), buf->cbytes(), initial_read_size);
+            ec = m_vdev_jd->sync_pread(group_buf->bytes() + initial_read_size, total_size - initial_read_size,
+                                       key.dev_offset + initial_read_size);
+            if (ec) {
+                LOGERROR("Failed to read from journal vdev log_dev={} {} {}", m_logdev_id, ec.value(), ec.message());
+                return {};
+            }
+            header = r_cast< const log_group_header* >(group_buf->cbytes());
+        }
+        HS_REL_ASSERT_EQ(header->this_group_crc(), header->compute_crc(), "CRC mismatch on read data");
+
+        log_buffer const group{LogGroup::decompress(header, m_vdev->align_size())};
+        auto const* rec = r_cast< const log_group_header* >(group.bytes())->nth_record(key.idx - header->start_log_idx);
+        return_record_header =
+            serialized_log_record(rec->size, rec->offset, rec->get_inlined(), rec->store_seq_num, rec->store_id);
+        return record_in_group(group, key.idx);
+    }
     HS_LOG_ASSERT_GE(header->total_size(), header->_inline_data_offset(), "Inconsistent size data in log group {} {}",
                      m_logdev_id, *header);
 
     // We can only do crc match in read if we have read all the blocks. We don't want to aggressively read more data
     // than we need to just to compare CRC for read operation. It can be done during recovery.
     if (header->total_size() <= initial_read_size) {
-        crc32_t const crc = crc32_ieee(init_crc32, (buf->cbytes() + sizeof(log_group_header)),
-                                       header->total_size() - sizeof(log_group_header));
-        HS_REL_ASSERT_EQ(header->this_group_crc(), crc, "CRC mismatch on read data");
+        HS_REL_ASSERT_EQ(header->this_group_crc(), header->compute_crc(), "CRC mismatch on read data");
     }
     auto record_header = header->nth_record(key.idx - header->start_log_idx);
     uint32_t const data_offset = (record_header->offset + (record_header->get_inlined() ? 0 : header->oob_data_offset));
@@ -320,6 +458,57 @@ log_buffer LogDev::read(const logdev_key& key, serialized_log_record& return_rec
     return ret_view;
 }
 
+folly::Future< log_buffer > LogDev::read_group_async(off_t dev_offset) {
+    auto buf = sisl::make_byte_array(initial_read_size, m_flush_size_multiple, sisl::buftag::logread);
+    return m_vdev_jd->async_pread(buf->bytes(), initial_read_size, dev_offset)
+        .thenValue([this, buf, dev_offset](std::error_code ec) {
+            if (ec) {
+                LOGERROR("Failed to read log group log_dev={} {} {}", m_logdev_id, ec.value(), ec.message());
+                throw std::system_error(ec);
+            }
+            auto* header = r_cast< const log_group_header* >(buf->cbytes());
+            HS_REL_ASSERT_EQ(header->magic_word(), LOG_GROUP_HDR_MAGIC,
+                             "Log header corrupted with magic mismatch! {} {}", m_logdev_id, *header);
+            HS_REL_ASSERT_LE(header->get_version(), log_group_header::header_version,
+                             "Log header version mismatch!  {} {}", m_logdev_id, *header);
+            if (header->total_size() <= initial_read_size) { return folly::makeFuture< sisl::byte_array >(buf); }
+
+            // Read the rest of the group into a buffer large enough for the whole group, right after the first part
+            auto const total_size = sisl::round_up(header->total_size(), m_vdev->align_size());
+            auto full_buf = sisl::make_byte_array(total_size, m_vdev->align_size(), sisl::buftag::logread);
+            std::memcpy(full_buf->bytes(), buf->cbytes(), initial_read_size);
+            return m_vdev_jd
+                ->async_pread(full_buf->bytes() + initial_read_size, total_size - initial_read_size,
+                              dev_offset + initial_read_size)
+                .thenValue([this, full_buf](std::error_code ec) {
+                    if (ec) {
+                        LOGERROR("Failed to read log group log_dev={} {} {}", m_logdev_id, ec.value(), ec.message());
+                        throw std::system_error(ec);
+                    }
+                    return full_buf;
+                });
+        })
+        .thenValue([this](sisl::byte_array buf) {
+            auto* header = r_cast< const log_group_header* >(buf->cbytes());
+            HS_REL_ASSERT_EQ(header->this_group_crc(), header->compute_crc(), "CRC mismatch on read of log group");
+            if (header->is_compressed()) { return log_buffer{LogGroup::decompress(header, m_vdev->align_size())}; }
+            return log_buffer{buf, 0, header->total_size()};
+        });
+}
+
+log_buffer LogDev::record_in_group(const log_buffer& group_buf, logid_t idx) {
+    auto* header = r_cast< const log_group_header* >(group_buf.bytes());
+    HS_DBG_ASSERT((idx >= header->start_idx()) && (idx < header->start_idx() + header->nrecords()),
+                  "log idx {} is not in the group {}", idx, *header);
+    auto const* rec = header->nth_record(idx - header->start_idx());
+    uint32_t const data_offset = (rec->offset + (rec->get_inlined() ? 0 : header->oob_data_offset));
+
+    log_buffer b = group_buf;
+    b.move_forward(data_offset);
+    b.set_size(rec->size);
+    return b;
+}
+
 logstore_id_t LogDev::reserve_store_id() {
     std::unique_lock lg{m_meta_mutex};
     return m_logdev_meta.reserve_store(true /* persist_now */);
@@ -354,7 +543,8 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
 
     assert(estimated_records > 0);
     auto* lg = make_log_group(static_cast< uint32_t >(estimated_records));
-    m_log_records->foreach_contiguous_active(m_last_flush_idx + 1,
+    // Groups in flight are not completed yet, so the next group starts right after the last prepared one
+    m_log_records->foreach_contiguous_active(m_last_prepared_idx + 1,
                                              [&](int64_t idx, int64_t, log_record& record) -> bool {
                                                  if (lg->add_record(record, idx)) {
                                                      flushing_upto_idx = idx;
@@ -364,10 +554,20 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
                                                  }
                                              });
 
-    lg->finish(m_logdev_id, get_prev_crc());
+    lg->finish(m_logdev_id, m_last_prepared_crc);
     if (sisl_unlikely(flushing_upto_idx == -1)) { return nullptr; }
-    lg->m_flush_log_idx_from = m_last_flush_idx + 1;
+#ifdef _PRERELEASE
+    if (iomgr_flip::instance()->test_flip("logdev_write_v0_group_header")) { lg->downgrade_to_v0(); }
+#endif
+    lg->m_flush_log_idx_from = m_last_prepared_idx + 1;
     lg->m_flush_log_idx_upto = flushing_upto_idx;
+    m_last_prepared_idx = flushing_upto_idx;
+    m_last_prepared_crc = lg->header()->cur_grp_crc;
+    if (lg->header()->is_compressed()) {
+        COUNTER_INCREMENT(logstore_service().m_metrics, logdev_compressed_groups, 1);
+        HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_compress_ratio_percent,
+                          uint64_cast(lg->header()->total_size()) * 100 / lg->header()->uncompressed_total_size());
+    }
     HS_DBG_ASSERT_GE(lg->m_flush_log_idx_upto, lg->m_flush_log_idx_from, "log indx upto is smaller then log indx from");
 
     HS_DBG_ASSERT_GT(lg->header()->oob_data_offset, 0);
@@ -378,6 +578,7 @@ LogGroup* LogDev::prepare_flush(const int32_t estimated_records) {
 
 bool LogDev::can_flush_in_this_thread() {
     if (iomanager.am_i_io_reactor() && (iomanager.iofiber_self() == logstore_service().flush_thread())) { return true; }
+    if (HS_DYNAMIC_CONFIG(logstore.flush_by_appender)) { return iomanager.am_i_io_reactor(); }
     return (!HS_DYNAMIC_CONFIG(logstore.flush_only_in_dedicated_thread) && iomanager.am_i_worker_reactor());
 }
 
@@ -387,63 +588,103 @@ bool LogDev::can_flush_in_this_thread() {
 bool LogDev::flush_if_needed(int64_t threshold_size) {
     // If after adding the record size, if we have enough to flush or if its been too much time before we actually
     // flushed, attempt to flush by setting the atomic bool variable.
-    if (threshold_size < 0) { threshold_size = LogDev::flush_data_threshold_size(); }
+    if (threshold_size < 0) { threshold_size = flush_threshold(); }
 
     const auto elapsed_time = get_elapsed_time_us(m_last_flush_time);
+    const auto flush_window = flush_window_us();
     auto const pending_sz = m_pending_flush_size.load(std::memory_order_relaxed);
     bool const flush_by_size = (pending_sz >= threshold_size);
-    bool const flush_by_time =
-        !flush_by_size && pending_sz && (elapsed_time > HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
+    bool const flush_by_time = !flush_by_size && pending_sz && (elapsed_time > flush_window);
 
     if (flush_by_size || flush_by_time) {
         // First off, check if we can flush in this thread itself, if not, schedule it into different thread
         if (!can_flush_in_this_thread()) {
+            COUNTER_INCREMENT(logstore_service().m_metrics, logdev_flush_thread_hops, 1);
             iomanager.run_on_forget(logstore_service().flush_thread(),
                                     [this, threshold_size]() { flush_if_needed(threshold_size); });
             return false;
         }
 
-        bool expected_flushing{false};
-        if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
-            return false;
-        }
+        if (!try_begin_group_prepare()) { return false; }
         THIS_LOGDEV_LOG(TRACE,
                         "Flushing now because either pending_size={} is greater than data_threshold={} or "
-                        "elapsed time since last flush={} us is greater than max_time_between_flush={} us",
-                        pending_sz, threshold_size, elapsed_time,
-                        HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us));
-
-        m_last_flush_time = Clock::now();
-        // We were able to win the flushing competition and now we gather all the flush data and reserve a slot.
-        auto new_idx = m_log_idx.load(std::memory_order_relaxed) - 1;
-        if (m_last_flush_idx >= new_idx) {
-            THIS_LOGDEV_LOG(TRACE, "Log idx {} is just flushed", new_idx);
-            unlock_flush(false);
-            return false;
-        }
+                        "elapsed time since last flush={} us is greater than flush_window={} us",
+                        pending_sz, threshold_size, elapsed_time, flush_window);
 
-        auto* lg = prepare_flush(new_idx - m_last_flush_idx + 4); // Estimate 4 more extra in case of parallel writes
-        if (sisl_unlikely(!lg)) {
-            THIS_LOGDEV_LOG(TRACE, "Log idx {} last_flush_idx {} prepare flush failed", new_idx, m_last_flush_idx);
-            unlock_flush(false);
-            return false;
-        }
-        auto sz = m_pending_flush_size.fetch_sub(lg->actual_data_size(), std::memory_order_relaxed);
-        HS_REL_ASSERT_GE((sz - lg->actual_data_size()), 0, "size {} lg size{}", sz, lg->actual_data_size());
-
-        off_t offset = m_vdev_jd->alloc_next_append_blk(lg->header()->total_size());
-        lg->m_log_dev_offset = offset;
-        HS_REL_ASSERT_NE(lg->m_log_dev_offset, INVALID_OFFSET, "log dev is full");
-        THIS_LOGDEV_LOG(TRACE, "Flushing log group data size={} at offset=0x{} log_group={}", lg->actual_data_size(),
-                        to_hex(offset), *lg);
-        // THIS_LOGDEV_LOG(DEBUG, "Log Group: {}", *lg);
-        do_flush(lg);
+        auto* lg = reserve_flush_group(elapsed_time);
+        if (!lg) { return false; }
+        do_flush(lg); // Prepare of the group ends once its write is issued, so that offsets are allocated in order
         return true;
     } else {
         return false;
     }
 }
 
+// Once the group prepare is begun, gathers the pending records into a group, allocates its journal offset and reserves
+// its slot in the flush pipeline. Returns nullptr (ending the prepare) if there is nothing to flush.
+LogGroup* LogDev::reserve_flush_group(uint64_t elapsed_time) {
+    m_last_flush_time = Clock::now();
+    // We were able to win the flushing competition and now we gather all the flush data and reserve a slot.
+    auto new_idx = m_log_idx.load(std::memory_order_relaxed) - 1;
+    if (m_last_prepared_idx >= new_idx) {
+        THIS_LOGDEV_LOG(TRACE, "Log idx {} is just flushed", new_idx);
+        end_group_prepare(false /* issued */);
+        return nullptr;
+    }
+
+    // Estimate 4 more extra in case of parallel writes
+    auto* lg = prepare_flush(new_idx - m_last_prepared_idx + 4);
+    if (sisl_unlikely(!lg)) {
+        THIS_LOGDEV_LOG(TRACE, "Log idx {} last_prepared_idx {} prepare flush failed", new_idx, m_last_prepared_idx);
+        end_group_prepare(false /* issued */);
+        return nullptr;
+    }
+    auto sz = m_pending_flush_size.fetch_sub(lg->actual_data_size(), std::memory_order_relaxed);
+    HS_REL_ASSERT_GE((sz - lg->actual_data_size()), 0, "size {} lg size{}", sz, lg->actual_data_size());
+    update_arrival_rate(lg->actual_data_size(), elapsed_time);
+
+    off_t offset = m_vdev_jd->alloc_next_append_blk(lg->header()->total_size());
+    lg->m_log_dev_offset = offset;
+    HS_REL_ASSERT_NE(lg->m_log_dev_offset, INVALID_OFFSET, "log dev is full");
+    THIS_LOGDEV_LOG(TRACE, "Flushing log group data size={} at offset=0x{} log_group={}", lg->actual_data_size(),
+                    to_hex(offset), *lg);
+    // THIS_LOGDEV_LOG(DEBUG, "Log Group: {}", *lg);
+    {
+        std::unique_lock lk{m_flush_pipeline_mtx};
+        ++m_log_group_issue_seq;
+        auto const ninflight = m_inflight_groups.fetch_add(1, std::memory_order_relaxed) + 1;
+        HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_inflight_groups, ninflight);
+    }
+    return lg;
+}
+
+bool LogDev::try_flush_sync_in_caller() {
+    // Only when idle, so that it neither waits for the groups in flight nor holds the pipeline while they complete
+    if (m_inflight_groups.load(std::memory_order_relaxed) != 0) { return false; }
+    if (!try_begin_group_prepare()) { return false; }
+    if (m_inflight_groups.load(std::memory_order_relaxed) != 0) {
+        end_group_prepare(false /* issued */);
+        return false;
+    }
+
+    auto* lg = reserve_flush_group(get_elapsed_time_us(m_last_flush_time));
+    if (!lg) { return false; }
+
+    HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_records_distribution, lg->nrecords());
+    HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_size_distribution, lg->actual_data_size());
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_records, lg->nrecords());
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_bytes, lg->actual_data_size());
+    COUNTER_INCREMENT(logstore_service().m_metrics, logdev_sync_fast_path_flushes, 1);
+
+    // FUA write makes the group durable on return, no separate cache flush of the device is needed
+    lg->m_flush_issue_time = Clock::now();
+    HS_PROBE(logdev_flush_start, m_logdev_id, lg->nrecords(), lg->actual_data_size());
+    m_vdev_jd->sync_pwritev(lg->iovecs().data(), int_cast(lg->iovecs().size()), lg->m_log_dev_offset, true /* fua */);
+    end_group_prepare(true /* issued */);
+    on_flush_completion(lg);
+    return true;
+}
+
 void LogDev::do_flush(LogGroup* lg) {
 #ifdef _PRERELEASE
     if (iomgr_flip::instance()->delay_flip< int >(
@@ -464,16 +705,134 @@ void LogDev::do_flush(LogGroup* lg) {
 void LogDev::do_flush_write(LogGroup* lg) {
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_records_distribution, lg->nrecords());
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_size_distribution, lg->actual_data_size());
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_records, lg->nrecords());
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_bytes, lg->actual_data_size());
     THIS_LOGDEV_LOG(TRACE, "vdev offset={} log group total size={}", lg->m_log_dev_offset, lg->header()->total_size());
 
     // write log
+    lg->m_flush_issue_time = Clock::now();
+    HS_PROBE(logdev_flush_start, m_logdev_id, lg->nrecords(), lg->actual_data_size());
     m_vdev_jd->async_pwritev(lg->iovecs().data(), int_cast(lg->iovecs().size()), lg->m_log_dev_offset)
         .thenValue([this, lg](auto) { on_flush_completion(lg); });
+    end_group_prepare(true /* issued */);
+}
+
+int64_t LogDev::flush_threshold() const {
+    if (!adaptive_flush_enabled()) { return flush_data_threshold_size(); }
+
+    // Flush once pending size is what we expect to arrive within the flush window. A lightly loaded logdev hence
+    // gets a threshold of a byte, which flushes the record on arrival, while a busy one batches up to the max size.
+    auto const expected = (m_arrival_rate_bps.load(std::memory_order_relaxed) * flush_window_us()) / 1000000;
+    return s_cast< int64_t >(std::clamp(expected, uint64_cast(1), HS_DYNAMIC_CONFIG(logstore.adaptive_flush_max_size)));
+}
+
+uint64_t LogDev::flush_window_us() const {
+    if (!adaptive_flush_enabled()) { return HS_DYNAMIC_CONFIG(logstore.max_time_between_flush_us); }
+
+    // Whatever is left of the target latency after the write itself, is how long a record can wait to be batched
+    auto const target = HS_DYNAMIC_CONFIG(logstore.adaptive_flush_target_latency_us);
+    auto const lat = m_flush_lat_ewma_us.load(std::memory_order_relaxed);
+    return (target > lat) ? (target - lat) : 0;
+}
+
+void LogDev::update_arrival_rate(uint64_t size, uint64_t elapsed_us) {
+    if (!adaptive_flush_enabled()) { return; }
+
+    // Only the flusher which won the prepare updates it, so a load and store is enough
+    auto const sample = (size * 1000000) / std::max(elapsed_us, uint64_cast(1));
+    auto const cur = m_arrival_rate_bps.load(std::memory_order_relaxed);
+    m_arrival_rate_bps.store(cur ? (cur * 7 + sample) / 8 : sample, std::memory_order_relaxed);
+}
+
+bool LogDev::try_begin_group_prepare() {
+    std::unique_lock lk{m_flush_pipeline_mtx};
+    if (m_preparing_group) { return false; }
+
+    if (m_inflight_groups.load(std::memory_order_relaxed) == 0) {
+        bool expected_flushing{false};
+        if (!m_is_flushing.compare_exchange_strong(expected_flushing, true, std::memory_order_acq_rel)) {
+            return false;
+        }
+    } else {
+        // Pipeline holds the flush lock already. It doesn't grow beyond its limit or while someone is waiting for the
+        // flush lock, completion of the inflight groups flushes the rest in those cases.
+        if (m_inflight_groups.load(std::memory_order_relaxed) >= max_inflight_log_groups()) { return false; }
+        std::unique_lock qlk{m_block_flush_q_mutex};
+        if (m_block_flush_q != nullptr) { return false; }
+    }
+    m_preparing_group = true;
+    return true;
+}
+
+void LogDev::end_group_prepare(bool issued) {
+    bool release_flush_lock;
+    {
+        std::unique_lock lk{m_flush_pipeline_mtx};
+        m_preparing_group = false;
+        release_flush_lock = (m_inflight_groups.load(std::memory_order_relaxed) == 0);
+    }
+
+    if (release_flush_lock) {
+        unlock_flush(issued /* do_flush */);
+    } else if (issued) {
+        // Issue the next group along with the ones in flight, if there is enough to flush already
+        flush_if_needed();
+    }
 }
 
 void LogDev::on_flush_completion(LogGroup* lg) {
     lg->m_flush_finish_time = Clock::now();
+    HS_PROBE(logdev_flush_end, m_logdev_id, lg->nrecords(),
+             get_elapsed_time_us(lg->m_flush_issue_time, lg->m_flush_finish_time));
+    {
+        std::unique_lock lk{m_flush_pipeline_mtx};
+        lg->m_write_done = true;
+
+        // Groups are completed in the order issued. If another thread is at it, it picks this one when its turn comes.
+        if (m_completing_groups) { return; }
+        m_completing_groups = true;
+    }
+
+    bool release_flush_lock{false};
+    while (true) {
+        LogGroup* oldest{nullptr};
+        {
+            std::unique_lock lk{m_flush_pipeline_mtx};
+            if (m_log_group_complete_seq < m_log_group_issue_seq) {
+                auto& g = m_log_group_pool[m_log_group_complete_seq % max_log_group];
+                if (g.m_write_done) { oldest = &g; }
+            }
+            if (oldest == nullptr) {
+                m_completing_groups = false;
+                release_flush_lock = (m_inflight_groups.load(std::memory_order_relaxed) == 0) && !m_preparing_group;
+                break;
+            }
+        }
+
+        complete_flushed_group(oldest);
+        {
+            std::unique_lock lk{m_flush_pipeline_mtx};
+            oldest->m_write_done = false;
+            ++m_log_group_complete_seq;
+            m_inflight_groups.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    if (release_flush_lock) {
+        unlock_flush();
+    } else {
+        flush_if_needed(); // A slot in the pipeline is free now
+    }
+}
+
+void LogDev::complete_flushed_group(LogGroup* lg) {
     lg->m_post_flush_msg_rcvd_time = Clock::now();
+    if (adaptive_flush_enabled()) {
+        // Ewma with weight of 1/8 to the new sample. Only the completer (one at a time) updates it.
+        auto const lat = get_elapsed_time_us(lg->m_flush_issue_time, lg->m_flush_finish_time);
+        auto const cur = m_flush_lat_ewma_us.load(std::memory_order_relaxed);
+        m_flush_lat_ewma_us.store(cur ? (cur * 7 + lat) / 8 : lat, std::memory_order_relaxed);
+    }
     THIS_LOGDEV_LOG(TRACE, "Flush completed for logid[{} - {}]", lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto);
 
     m_log_records->complete(lg->m_flush_log_idx_from, lg->m_flush_log_idx_upto);
@@ -484,18 +843,36 @@ void LogDev::on_flush_completion(LogGroup* lg) {
     auto from_indx = lg->m_flush_log_idx_from;
     auto upto_indx = lg->m_flush_log_idx_upto;
     auto dev_offset = lg->m_log_dev_offset;
+    index_group(from_indx, dev_offset);
+    uint64_t record_wait_us{0};
     for (auto idx = from_indx; idx <= upto_indx; ++idx) {
         auto& record = m_log_records->at(idx);
+        auto const wait_us = get_elapsed_time_us(record.append_time, lg->m_flush_issue_time);
+        HISTOGRAM_OBSERVE(m_metrics, logdev_record_flush_wait_us, wait_us);
+        record_wait_us += wait_us;
+        if (record.seq_num == rollback_marker_seq_num) {
+            on_rollback_marker_flushed(record.store_id, record.context, flush_ld_key, upto_indx - idx);
+            continue;
+        }
         on_io_completion(record.store_id, logdev_key{idx, dev_offset}, flush_ld_key, upto_indx - idx, record.context);
     }
     lg->m_post_flush_process_done_time = Clock::now();
 
+    auto const write_us = get_elapsed_time_us(lg->m_flush_issue_time, lg->m_flush_finish_time);
+    auto const completion_us = get_elapsed_time_us(lg->m_post_flush_msg_rcvd_time, lg->m_post_flush_process_done_time);
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_write_us, write_us);
+    HISTOGRAM_OBSERVE(m_metrics, logdev_group_completion_us, completion_us);
+    m_group_stats.groups.fetch_add(1, std::memory_order_relaxed);
+    m_group_stats.records.fetch_add(upto_indx - from_indx + 1, std::memory_order_relaxed);
+    m_group_stats.bytes.fetch_add(lg->actual_data_size(), std::memory_order_relaxed);
+    m_group_stats.record_wait_us.fetch_add(record_wait_us, std::memory_order_relaxed);
+    m_group_stats.write_us.fetch_add(write_us, std::memory_order_relaxed);
+    m_group_stats.completion_us.fetch_add(completion_us, std::memory_order_relaxed);
+
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_flush_done_msg_time_ns,
                       get_elapsed_time_us(lg->m_flush_finish_time, lg->m_post_flush_msg_rcvd_time));
     HISTOGRAM_OBSERVE(logstore_service().m_metrics, logdev_post_flush_processing_latency,
                       get_elapsed_time_us(lg->m_post_flush_msg_rcvd_time, lg->m_post_flush_process_done_time));
-    free_log_group(lg);
-    unlock_flush();
 }
 
 bool LogDev::run_under_flush_lock(const flush_blocked_callback& cb) {
@@ -605,6 +982,7 @@ uint64_t LogDev::truncate(const logdev_key& key) {
             // We can remove the rollback records of those upto which logid is getting truncated
             m_logdev_meta.remove_rollback_record_upto(key.idx, false /* persist_now */);
             THIS_LOGDEV_LOG(DEBUG, "LogDev::truncate remove rollback {}", key.idx);
+            m_logdev_meta.set_group_index(trim_group_index(key.idx));
             m_logdev_meta.persist();
 #ifdef _PRERELEASE
             if (garbage_collect && iomgr_flip::instance()->test_flip("logdev_abort_after_garbage")) {
@@ -618,6 +996,58 @@ uint64_t LogDev::truncate(const logdev_key& key) {
     return num_records_to_truncate;
 }
 
+void LogDev::index_group(logid_t start_idx, off_t dev_offset) {
+    auto const interval = HS_DYNAMIC_CONFIG(logstore.group_index_interval);
+    if (interval == 0) { return; }
+
+    std::unique_lock lg{m_group_index_mtx};
+    if (m_group_index.empty() || (++m_groups_since_indexed >= interval)) {
+        m_group_index.insert_or_assign(start_idx, dev_offset);
+        m_groups_since_indexed = 0;
+    }
+}
+
+std::map< logid_t, off_t > LogDev::trim_group_index(logid_t upto_idx) {
+    std::unique_lock lg{m_group_index_mtx};
+    m_group_index.erase(m_group_index.begin(), m_group_index.upper_bound(upto_idx));
+    return m_group_index;
+}
+
+off_t LogDev::group_offset_of(logid_t idx) {
+    off_t from_offset;
+    logid_t start_idx;
+    {
+        std::unique_lock lg{m_meta_mutex};
+        from_offset = m_logdev_meta.get_start_dev_offset();
+        start_idx = m_logdev_meta.get_start_log_idx();
+    }
+    if (idx < start_idx) { return INVALID_OFFSET; }
+
+    {
+        // Entries below the start idx are of the groups truncated already, which could be left in the persisted index
+        // if the truncation crashed before writing it.
+        std::unique_lock lg{m_group_index_mtx};
+        if (auto it = m_group_index.upper_bound(idx); it != m_group_index.begin()) {
+            if (--it; it->first >= start_idx) { from_offset = it->second; }
+        }
+    }
+
+    log_group_scanner scanner{m_vdev_jd, m_vdev->align_size(), HS_DYNAMIC_CONFIG(logstore.bulk_read_size),
+                              from_offset};
+    while (scanner.next()) {
+        auto const* header = scanner.header();
+        if (idx < header->start_idx()) { break; }
+        if (idx < header->start_idx() + header->nrecords()) { return scanner.dev_offset(); }
+    }
+    return INVALID_OFFSET;
+}
+
+void LogDev::group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie) {
+    m_logdev_meta.group_index_super_blk_found(buf, meta_cookie);
+    std::unique_lock lg{m_group_index_mtx};
+    m_group_index.merge(m_logdev_meta.group_index());
+}
+
 void LogDev::update_store_superblk(logstore_id_t store_id, const logstore_superblk& lsb, bool persist_now) {
     std::unique_lock lg{m_meta_mutex};
     m_logdev_meta.update_store_superblk(store_id, lsb, persist_now);
@@ -628,6 +1058,15 @@ void LogDev::rollback(logstore_id_t store_id, logid_range_t id_range) {
     m_logdev_meta.add_rollback_record(store_id, id_range, true);
 }
 
+void LogDev::rollback_async(logstore_id_t store_id, logid_range_t id_range, std::function< void() > done_cb) {
+    auto* ctx = new rollback_marker_ctx{rollback_marker{.idx_range = id_range}, std::move(done_cb)};
+    THIS_LOGDEV_LOG(DEBUG, "Writing rollback marker of logstore_id[{}] log_idx=[{} - {}]", store_id, id_range.first,
+                    id_range.second);
+    append_async(store_id, rollback_marker_seq_num,
+                 sisl::io_blob{uintptr_cast(&ctx->marker), uint32_cast(sizeof(rollback_marker)), false}, ctx,
+                 true /* flush_wait */);
+}
+
 /////////////////////////////// LogStore Section ///////////////////////////////////////
 
 void LogDev::handle_unopened_log_stores(bool format) {
@@ -653,6 +1092,11 @@ void LogDev::handle_unopened_log_stores(bool format) {
     }
 }
 
+size_t LogDev::num_log_stores() const {
+    folly::SharedMutexWritePriority::ReadHolder holder(m_store_map_mtx);
+    return m_id_logstore_map.size();
+}
+
 std::shared_ptr< HomeLogStore > LogDev::create_new_log_store(bool append_mode) {
     auto const store_id = reserve_store_id();
     std::shared_ptr< HomeLogStore > lstore;
@@ -693,26 +1137,23 @@ void LogDev::remove_log_store(logstore_id_t store_id) {
     unreserve_store_id(store_id);
 }
 
-void LogDev::device_truncate_under_lock(const std::shared_ptr< truncate_req > treq) {
-    run_under_flush_lock([this, treq]() {
-        iomanager.run_on_forget(logstore_service().truncate_thread(), [this, treq]() {
-            const logdev_key trunc_upto = do_device_truncate(treq->dry_run);
-            bool done{false};
-            if (treq->cb || treq->wait_till_done) {
-                {
-                    std::lock_guard< std::mutex > lk{treq->mtx};
-                    done = (--treq->trunc_outstanding == 0);
-                    treq->m_trunc_upto_result[m_logdev_id] = trunc_upto;
-                }
+void LogDev::device_truncate_async(const std::shared_ptr< truncate_req > treq) {
+    // Safe point is computed from the snapshots of truncation info of the stores and the journal descriptor guards its
+    // chunks against the appends on its own, so the flush is not locked. Truncations are serialized by the thread.
+    iomanager.run_on_forget(logstore_service().truncate_thread(), [this, treq]() {
+        const logdev_key trunc_upto = m_stopped ? logdev_key::out_of_bound_ld_key() : do_device_truncate(treq->dry_run);
+        bool done{false};
+        if (treq->cb || treq->wait_till_done) {
+            {
+                std::lock_guard< std::mutex > lk{treq->mtx};
+                done = (--treq->trunc_outstanding == 0);
+                treq->m_trunc_upto_result[m_logdev_id] = trunc_upto;
             }
-            if (done) {
-                if (treq->cb) { treq->cb(treq->m_trunc_upto_result); }
-                if (treq->wait_till_done) { treq->cv.notify_one(); }
-            }
-
-            unlock_flush();
-        });
-        return false; // Do not release the flush lock yet, the scheduler will unlock it.
+        }
+        if (done) {
+            if (treq->cb) { treq->cb(treq->m_trunc_upto_result); }
+            if (treq->wait_till_done) { treq->cv.notify_one(); }
+        }
     });
 }
 
@@ -794,6 +1235,31 @@ void LogDev::on_batch_completion(HomeLogStore* log_store, uint32_t nremaining_in
     }
 }
 
+// Ends the batch for the stores participated in it, when its last record is not of any store (or not called back)
+void LogDev::complete_flush_batch(logdev_key flush_ld_key) {
+    for (auto& l : s_cur_flush_batch_stores) {
+        l->on_batch_completion(flush_ld_key);
+    }
+    s_cur_flush_batch_stores.clear();
+    m_last_flush_info.clear();
+}
+
+void LogDev::on_rollback_marker_flushed(logstore_id_t store_id, void* ctx, logdev_key flush_ld_key,
+                                        uint32_t nremaining_in_batch) {
+    auto* mctx = r_cast< rollback_marker_ctx* >(ctx);
+    {
+        // Flushed marker is what makes the rollback durable. Superblk has it too, so that it is persisted upon the next
+        // truncation, even if the marker is truncated by it.
+        std::unique_lock lg{m_meta_mutex};
+        m_logdev_meta.add_rollback_record(store_id, mctx->marker.idx_range, false /* persist_now */);
+    }
+    iomanager.run_on_forget(logstore_service().truncate_thread(), [mctx]() {
+        if (mctx->done_cb) { mctx->done_cb(); }
+        delete mctx;
+    });
+    if (nremaining_in_batch == 0) { complete_flush_batch(flush_ld_key); }
+}
+
 logdev_key LogDev::do_device_truncate(bool dry_run) {
     static thread_local std::vector< std::shared_ptr< HomeLogStore > > m_min_trunc_stores;
     static thread_local std::vector< std::shared_ptr< HomeLogStore > > m_non_participating_stores;
@@ -808,7 +1274,7 @@ logdev_key LogDev::do_device_truncate(bool dry_run) {
         folly::SharedMutexWritePriority::ReadHolder holder(m_store_map_mtx);
         for (auto& id_logstore : m_id_logstore_map) {
             auto& store_ptr = id_logstore.second.log_store;
-            const auto& trunc_info = store_ptr->pre_device_truncation();
+            const auto trunc_info = store_ptr->pre_device_truncation();
 
             if (!trunc_info.pending_dev_truncation && !trunc_info.active_writes_not_part_of_truncation) {
                 // This log store neither has any pending device truncation nor active logstore io going on for now.
@@ -819,7 +1285,7 @@ logdev_key LogDev::do_device_truncate(bool dry_run) {
             }
 
             fmt::format_to(std::back_inserter(dbg_str), "[{}:{}:{}:{}:{}] ", store_ptr->get_store_id(),
-                           trunc_info.seq_num.load(), trunc_info.ld_key.idx, trunc_info.pending_dev_truncation,
+                           trunc_info.seq_num, trunc_info.ld_key.idx, trunc_info.pending_dev_truncation,
                            trunc_info.active_writes_not_part_of_truncation);
             if (trunc_info.ld_key.idx > min_safe_ld_key.idx) { continue; }
 
@@ -891,8 +1357,31 @@ nlohmann::json LogDev::get_status(int verbosity) const {
     // Logdev status
     js["current_log_idx"] = m_log_idx.load(std::memory_order_relaxed);
     js["last_flush_log_idx"] = m_last_flush_idx;
+    js["inflight_log_groups"] = m_inflight_groups.load(std::memory_order_relaxed);
+    js["flush_threshold_size"] = flush_threshold();
+    js["flush_window_us"] = flush_window_us();
+    if (adaptive_flush_enabled()) {
+        js["flush_arrival_rate_bps"] = m_arrival_rate_bps.load(std::memory_order_relaxed);
+        js["flush_write_latency_us"] = m_flush_lat_ewma_us.load(std::memory_order_relaxed);
+    }
     js["last_truncate_log_idx"] = m_last_truncate_idx;
+    if (m_log_records) { js["log_records_mem_bytes"] = m_log_records->memory_bytes(); }
+    {
+        std::unique_lock lg{m_group_index_mtx};
+        js["group_index_entries"] = m_group_index.size();
+    }
     js["time_since_last_log_flush_ns"] = get_elapsed_time_ns(m_last_flush_time);
+    if (auto const ngroups = m_group_stats.groups.load(std::memory_order_relaxed); ngroups != 0) {
+        auto const nrecords = std::max(m_group_stats.records.load(std::memory_order_relaxed), uint64_cast(1));
+        nlohmann::json gjs;
+        gjs["groups_flushed"] = ngroups;
+        gjs["avg_records_per_group"] = nrecords / ngroups;
+        gjs["avg_bytes_per_group"] = m_group_stats.bytes.load(std::memory_order_relaxed) / ngroups;
+        gjs["avg_record_flush_wait_us"] = m_group_stats.record_wait_us.load(std::memory_order_relaxed) / nrecords;
+        gjs["avg_group_write_us"] = m_group_stats.write_us.load(std::memory_order_relaxed) / ngroups;
+        gjs["avg_group_completion_us"] = m_group_stats.completion_us.load(std::memory_order_relaxed) / ngroups;
+        js["group_commit"] = std::move(gjs);
+    }
     if (verbosity == 2) {
         js["logdev_stopped?"] = m_stopped;
         js["is_log_flushing_now?"] = m_is_flushing.load(std::memory_order_relaxed);
@@ -911,7 +1400,10 @@ nlohmann::json LogDev::get_status(int verbosity) const {
 }
 
 /////////////////////////////// LogDevMetadata Section ///////////////////////////////////////
-LogDevMetadata::LogDevMetadata() : m_sb{logdev_sb_meta_name}, m_rollback_sb{logdev_rollback_sb_meta_name} {}
+LogDevMetadata::LogDevMetadata() :
+        m_sb{logdev_sb_meta_name},
+        m_rollback_sb{logdev_rollback_sb_meta_name},
+        m_group_index_sb{logdev_group_index_sb_meta_name} {}
 
 logdev_superblk* LogDevMetadata::create(logdev_id_t id) {
     logdev_superblk* sb = m_sb.create(logdev_sb_size_needed(0));
@@ -930,6 +1422,7 @@ logdev_superblk* LogDevMetadata::create(logdev_id_t id) {
 }
 
 void LogDevMetadata::destroy() {
+    m_group_index_sb.destroy();
     m_rollback_sb.destroy();
     m_sb.destroy();
 }
@@ -954,6 +1447,14 @@ void LogDevMetadata::rollback_super_blk_found(const sisl::byte_view& buf, void*
                      "Rollback sb version mismatch");
 }
 
+void LogDevMetadata::group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie) {
+    m_group_index_sb.load(buf, meta_cookie);
+    HS_REL_ASSERT_EQ(m_group_index_sb->get_magic(), group_index_superblk::GROUP_INDEX_SB_MAGIC,
+                     "Group index sb magic mismatch");
+    HS_REL_ASSERT_EQ(m_group_index_sb->get_version(), group_index_superblk::GROUP_INDEX_SB_VERSION,
+                     "Group index sb version mismatch");
+}
+
 std::vector< std::pair< logstore_id_t, logstore_superblk > > LogDevMetadata::load() {
     std::vector< std::pair< logstore_id_t, logstore_superblk > > ret_list;
     ret_list.reserve(1024);
@@ -1009,6 +1510,10 @@ void LogDevMetadata::persist() {
         m_rollback_sb.write();
         m_rollback_info_dirty = false;
     }
+    if (m_group_index_dirty) {
+        m_group_index_sb.write();
+        m_group_index_dirty = false;
+    }
 }
 
 void LogDevMetadata::unreserve_store(logstore_id_t store_id, bool persist_now) {
@@ -1163,4 +1668,26 @@ bool LogDevMetadata::resize_rollback_sb_if_needed() {
         return false;
     }
 }
+
+// Index is rewritten as a whole, it is sparse enough to not be worth updating in place. Logdevs created before the
+// index existed get their superblk upon the first set.
+void LogDevMetadata::set_group_index(const std::map< logid_t, off_t >& index) {
+    m_group_index_sb.create(group_index_superblk::size_needed(uint32_cast(index.size())));
+    m_group_index_sb->logdev_id = m_sb->logdev_id;
+    for (auto const& [start_idx, dev_offset] : index) {
+        m_group_index_sb->add_entry(start_idx, dev_offset);
+    }
+    m_group_index_dirty = true;
+}
+
+std::map< logid_t, off_t > LogDevMetadata::group_index() const {
+    std::map< logid_t, off_t > index;
+    if (m_group_index_sb.is_empty()) { return index; }
+
+    for (uint32_t i{0}; i < m_group_index_sb->num_entries; ++i) {
+        auto const& e = m_group_index_sb->at(i);
+        index.emplace(e.start_idx, e.dev_offset);
+    }
+    return index;
+}
 } // namespace homestore
@@ -15,6 +15,7 @@
  *********************************************************************************/
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstdint>
 #include <functional>
@@ -28,12 +29,13 @@
 
 #include <boost/intrusive_ptr.hpp>
 #include <sisl/fds/id_reserver.hpp>
-#include <sisl/fds/stream_tracker.hpp>
 #include <sisl/fds/buffer.hpp>
 #include <folly/futures/SharedPromise.h>
 #include <fmt/format.h>
 #include <sisl/logging/logging.h>
+#include <sisl/metrics/metrics.hpp>
 
+#include <homestore/logstore/log_record_tracker.hpp>
 #include <homestore/logstore/log_store_internal.hpp>
 #include <homestore/superblk_handler.hpp>
 #include "common/homestore_config.hpp"
@@ -46,8 +48,9 @@ static constexpr uint32_t LOG_GROUP_HDR_MAGIC{0xF00D1E};
 static constexpr uint32_t LOG_GROUP_FOOTER_MAGIC{0xB00D1E};
 static constexpr uint32_t dma_address_boundary{512}; // Mininum size the dma/writes to be aligned with
 static constexpr uint32_t initial_read_size{4096};
-// logdev doesn't support concurrent writes. There can only be 2 active log groups.
-static constexpr uint32_t max_log_group{2};
+// Max log groups a logdev could have in flight at once (logstore.max_inflight_log_groups is capped to this), groups are
+// written concurrently but completed in order.
+static constexpr uint32_t max_log_group{8};
 
 // clang-format off
 /*
@@ -97,9 +100,17 @@ struct log_record {
     void* context;
     logstore_id_t store_id;
     logstore_seq_num_t seq_num;
-
-    log_record(const logstore_id_t& sid, const logstore_seq_num_t snum, const sisl::io_blob& d, void* const ctx) :
-            data{d}, context{ctx}, store_id{sid}, seq_num{snum} {}
+    log_serialize_cb_t serializer; // If set, data has only the size and this serializes it into the log group
+    Clock::time_point append_time; // Time of append, to track how long it waited to be flushed
+
+    log_record(const logstore_id_t& sid, const logstore_seq_num_t snum, const sisl::io_blob& d, void* const ctx,
+               log_serialize_cb_t&& s = nullptr) :
+            data{d},
+            context{ctx},
+            store_id{sid},
+            seq_num{snum},
+            serializer{std::move(s)},
+            append_time{Clock::now()} {}
     log_record(const log_record&) = delete;
     log_record& operator=(const log_record&) = delete;
     log_record(log_record&&) noexcept = delete;
@@ -121,10 +132,16 @@ struct log_record {
 };
 
 /************************************* Log Group Section ************************************/
-/* This structure represents a group commit log header */
+/* This structure represents a group commit log header. When the group is compressed, everything after the header is
+ * stored compressed, followed by a footer of its own, and group_size, footer_offset and crc are of the group as stored,
+ * while rest of the offsets are within the group once decompressed.
+ *
+ * Groups written by earlier versions are still decoded on recovery: version 0 header ends at logdev_id (no compression
+ * fields, records follow right after it) and versions 0 and 1 crc the whole group after the header in one go. */
 #pragma pack(1)
 struct log_group_header {
-    static constexpr uint8_t header_version{0};
+    static constexpr uint8_t header_version{2};
+    static constexpr uint8_t compression_version{1}; // First version with the compression fields
 
     uint32_t magic;
     uint32_t version;
@@ -137,6 +154,8 @@ struct log_group_header {
     crc32_t prev_grp_crc;        // Checksum of the previous group that was written
     crc32_t cur_grp_crc;         // Checksum of the current group record
     logdev_id_t logdev_id;       // Logdev id
+    uint32_t compressed_size;    // Size of compressed data following this header, 0 if the group is not compressed
+    uint32_t uncompressed_size;  // Total size of this group including this header, before compression
 
     log_group_header() : magic{LOG_GROUP_HDR_MAGIC}, version{header_version} {}
     log_group_header(const log_group_header&) = delete;
@@ -151,7 +170,7 @@ struct log_group_header {
 
     const uint8_t* inline_area() const { return (reinterpret_cast< const uint8_t* >(this) + inline_data_offset); }
     const uint8_t* oob_area() const { return (reinterpret_cast< const uint8_t* >(this) + oob_data_offset); }
-    const uint8_t* record_area() const { return (reinterpret_cast< const uint8_t* >(this) + sizeof(log_group_header)); }
+    const uint8_t* record_area() const { return (reinterpret_cast< const uint8_t* >(this) + header_size()); }
 
     const serialized_log_record* nth_record(const uint32_t n) const {
         return reinterpret_cast< const serialized_log_record* >(record_area() + (sizeof(serialized_log_record) * n));
@@ -173,6 +192,22 @@ struct log_group_header {
     crc32_t this_group_crc() const { return cur_grp_crc; }
     crc32_t prev_group_crc() const { return prev_grp_crc; }
     uint32_t _inline_data_offset() const { return inline_data_offset; }
+    bool is_compressed() const { return ((get_version() >= compression_version) && (compressed_size != 0)); }
+    uint32_t compressed_data_size() const { return is_compressed() ? compressed_size : 0; }
+    uint32_t uncompressed_total_size() const { return is_compressed() ? uncompressed_size : group_size; }
+
+    // Size of the header as laid out in the version it was written with
+    uint32_t header_size() const {
+        return (get_version() >= compression_version)
+            ? sizeof(log_group_header)
+            : (sizeof(log_group_header) - sizeof(compressed_size) - sizeof(uncompressed_size));
+    }
+
+    // Crc of the group, which is expected to follow this header in memory. Crc of a group which is not compressed is
+    // of its inline area, chained with its record slots and then with the crc of its out of band area (including the
+    // footer), so that the writer could compute it as the records are added. Compressed group is crc'd as stored, as
+    // is a group of earlier versions.
+    crc32_t compute_crc() const;
 };
 #pragma pack()
 
@@ -196,10 +231,11 @@ struct fmt::formatter< homestore::log_group_header > {
         return fmt::format_to(
             ctx.out(),
             "magic = {} version={} n_log_records = {} start_log_idx = {} group_size = {} inline_data_offset = {} "
-            "oob_data_offset = {} prev_grp_crc = {} cur_grp_crc = {} logdev = {}",
+            "oob_data_offset = {} prev_grp_crc = {} cur_grp_crc = {} logdev = {} compressed_size = {} "
+            "uncompressed_size = {}",
             header.magic, header.version, header.n_log_records, header.start_log_idx, header.group_size,
             header.inline_data_offset, header.oob_data_offset, header.prev_grp_crc, header.cur_grp_crc,
-            header.logdev_id);
+            header.logdev_id, header.compressed_data_size(), header.uncompressed_total_size());
     }
 };
 
@@ -248,15 +284,23 @@ public:
     LogGroup& operator=(LogGroup&&) noexcept = delete;
     ~LogGroup() = default;
 
-    void start(const uint64_t flush_size_multiple, const uint32_t align_size);
+    void start(const uint64_t flush_size_multiple, const uint32_t align_size, const int numa_node = -1);
     void stop();
     void reset(const uint32_t max_records);
-    void create_overflow_buf(const uint32_t min_needed);
+    void add_overflow_buf(const uint32_t min_needed);
     bool add_record(log_record& record, const int64_t log_idx);
     bool can_accomodate(const log_record& record) const { return (m_nrecords <= m_max_records); }
 
     const iovec_array& finish(logdev_id_t logdev_id, const crc32_t prev_crc);
-    crc32_t compute_crc();
+    crc32_t compute_crc(const uint32_t header_size = sizeof(log_group_header));
+#ifdef _PRERELEASE
+    // Rewrites the finished group as header version 0 would have, to test the recovery of journals of that version
+    void downgrade_to_v0();
+#endif
+
+    // Builds the group as it was before compression (header followed by the decompressed data), from the compressed
+    // group read from the device
+    static sisl::byte_array decompress(const log_group_header* header, const uint32_t align_size);
 
     log_group_header* header() { return reinterpret_cast< log_group_header* >(m_cur_log_buf); }
     const log_group_header* header() const { return reinterpret_cast< const log_group_header* >(m_cur_log_buf); }
@@ -272,14 +316,29 @@ public:
 
     sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_log_buf;
     sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_footer_buf;
-    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_overflow_log_buf;
-
-    uint8_t* m_cur_log_buf;
-    uint32_t m_cur_buf_len;
+    int m_numa_node{-1}; // NUMA node of the journal device, log buffers are allocated preferably from this node
+    // Once m_log_buf is full, inline area continues into overflow buffers, chained as the next iovecs
+    std::vector< sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > > m_overflow_bufs;
+    // Group is gathered into m_compress_src_buf (if it spans more than one iovec) and compressed into m_compress_buf
+    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::compression > m_compress_src_buf;
+    sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite > m_compress_buf;
+    uint32_t m_compress_src_buf_len{0};
+    uint32_t m_compress_buf_len{0};
+
+    // Running crcs of the inline and out of band areas, updated as records are added, so that finish need not go
+    // through all of the group data to compute its crc
+    crc32_t m_inline_crc{init_crc32};
+    crc32_t m_oob_crc{init_crc32};
+
+    uint8_t* m_cur_log_buf;       // Buffer with the header and record slots
+    uint8_t* m_inline_buf;        // Buffer with the tail of inline area, m_cur_log_buf or the last overflow buffer
+    uint32_t m_cur_buf_len;       // Size of m_inline_buf
+    uint32_t m_inline_buf_offset; // Offset within the group, where m_inline_buf starts
+    uint32_t m_n_inline_iovs;     // iovecs [0, m_n_inline_iovs) carry the inline area, the rest are oob records
     uint32_t m_footer_buf_len;
 
     serialized_log_record* m_record_slots;
-    uint32_t m_inline_data_pos;
+    uint32_t m_inline_data_pos; // Offset within the group, where next inline record goes
     uint32_t m_oob_data_pos;
 
     uint32_t m_nrecords{0};
@@ -293,13 +352,19 @@ public:
     off_t m_log_dev_offset;
 
     uint64_t m_flush_multiple_size{0};
+    Clock::time_point m_flush_issue_time;             // Time at which journal write is issued
     Clock::time_point m_flush_finish_time;            // Time at which flush is completed
     Clock::time_point m_post_flush_msg_rcvd_time;     // Time at which flush done message delivered
     Clock::time_point m_post_flush_process_done_time; // Time at which entire log group cb is called
+    bool m_write_done{false}; // Write is completed, but group is yet to be completed in order (under pipeline mtx)
 
 private:
     log_group_footer* add_and_get_footer();
     bool new_iovec_for_footer() const;
+    bool compress();
+    uint32_t inline_space_left() const { return m_inline_buf_offset + m_cur_buf_len - m_inline_data_pos; }
+    uint8_t* inline_data_ptr() const { return m_inline_buf + (m_inline_data_pos - m_inline_buf_offset); }
+    void copy_inline(const uint8_t* data, uint32_t size);
 };
 } // namespace homestore
 
@@ -486,6 +551,57 @@ struct rollback_superblk {
         r.idx_range = idx_range;
     }
 };
+
+struct group_index_entry {
+    logid_t start_idx;
+    off_t dev_offset;
+};
+
+// Sparse index of the log groups in the journal (see LogDev::group_offset_of), as of the last truncation
+struct group_index_superblk {
+    static constexpr uint32_t GROUP_INDEX_SB_MAGIC{0xDABAF1DE};
+    static constexpr uint32_t GROUP_INDEX_SB_VERSION{1};
+
+    uint32_t magic{GROUP_INDEX_SB_MAGIC};
+    uint32_t version{GROUP_INDEX_SB_VERSION};
+    logdev_id_t logdev_id{0};
+    uint32_t num_entries{0};
+
+    uint32_t get_magic() const { return magic; }
+    uint32_t get_version() const { return version; }
+
+    static uint32_t size_needed(uint32_t nentries) {
+        return sizeof(group_index_superblk) + (nentries * sizeof(group_index_entry));
+    }
+
+    group_index_entry& at(uint32_t idx) {
+        auto e = r_cast< group_index_entry* >(uintptr_cast(this) + sizeof(group_index_superblk));
+        return e[idx];
+    }
+    const group_index_entry& at(uint32_t idx) const {
+        auto e = r_cast< const group_index_entry* >(r_cast< const uint8_t* >(this) + sizeof(group_index_superblk));
+        return e[idx];
+    }
+
+    void add_entry(logid_t start_idx, off_t dev_offset) {
+        group_index_entry& e = at(num_entries++);
+        e.start_idx = start_idx;
+        e.dev_offset = dev_offset;
+    }
+};
+#pragma pack()
+
+// Record which rolls back the log idx range of its store, written in the log stream by LogDev::rollback_async with the
+// reserved seq num rollback_marker_seq_num. Records found before it in the range are skipped upon replay.
+static constexpr logstore_seq_num_t rollback_marker_seq_num{std::numeric_limits< logstore_seq_num_t >::min() + 1};
+
+#pragma pack(1)
+struct rollback_marker {
+    static constexpr uint32_t ROLLBACK_MARKER_MAGIC{0xDABAF0BA};
+
+    uint32_t magic{ROLLBACK_MARKER_MAGIC};
+    logid_range_t idx_range;
+};
 #pragma pack()
 
 // This class represents the metadata of logdev providing methods to change/access log dev super block.
@@ -528,8 +644,13 @@ public:
     uint32_t num_rollback_records(logstore_id_t store_id) const;
     bool is_rolled_back(logstore_id_t store_id, logid_t logid) const;
 
+    // Group index is written upon the next persist
+    void set_group_index(const std::map< logid_t, off_t >& index);
+    std::map< logid_t, off_t > group_index() const;
+
     void logdev_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
     void rollback_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
+    void group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
 
 private:
     bool resize_logdev_sb_if_needed();
@@ -549,6 +670,8 @@ private:
     std::set< logstore_id_t > m_store_info;
     std::multimap< logstore_id_t, logid_range_t > m_rollback_info;
     bool m_rollback_info_dirty{false};
+    superblk< group_index_superblk > m_group_index_sb;
+    bool m_group_index_dirty{false};
 };
 
 class HomeStore;
@@ -563,7 +686,7 @@ public:
     log_stream_reader& operator=(const log_stream_reader&) = delete;
     log_stream_reader(log_stream_reader&&) noexcept = delete;
     log_stream_reader& operator=(log_stream_reader&&) noexcept = delete;
-    ~log_stream_reader() = default;
+    ~log_stream_reader();
 
     sisl::byte_view next_group(off_t* out_dev_offset);
     sisl::byte_view group_in_next_page();
@@ -581,6 +704,55 @@ private:
     uint64_t m_read_size_multiple;
 };
 
+/*
+ * log_group_scanner: Walks the log groups of a journal descriptor from the given offset for diagnostics, without the
+ * stores or the logdev being opened or replayed. Unlike log_stream_reader used by the recovery, it leaves the seek
+ * cursor and read ahead of the descriptor as is, holds only one read window in memory (or one group, if bigger than
+ * the window), and decodes the records of a group only when asked for. Scan stops at the first group which doesn't
+ * validate (magic, logdev id, crc chain, footer or crc), with the reason in end_reason().
+ */
+class log_group_scanner {
+public:
+    log_group_scanner(shared< JournalVirtualDev::Descriptor > vdev_jd, uint32_t align_size, uint64_t window_size,
+                      off_t from_offset);
+    log_group_scanner(const log_group_scanner&) = delete;
+    log_group_scanner& operator=(const log_group_scanner&) = delete;
+    log_group_scanner(log_group_scanner&&) noexcept = delete;
+    log_group_scanner& operator=(log_group_scanner&&) noexcept = delete;
+    ~log_group_scanner() = default;
+
+    // Moves to the next group, false if the scan has ended
+    bool next();
+
+    // Header of the current group, as stored (compressed groups are decompressed only to access their records)
+    const log_group_header* header() const { return m_header; }
+    off_t dev_offset() const { return m_cur_offset; }
+
+    // Decodes the nth record of the current group, along with its data (a view into the group buffer)
+    std::pair< serialized_log_record, log_buffer > record(uint32_t n);
+
+    const std::string& end_reason() const { return m_end_reason; }
+    uint64_t groups_scanned() const { return m_ngroups; }
+
+private:
+    bool ensure(uint64_t nbytes, bool skip_to_next_chunk);
+    bool end_scan(std::string reason);
+
+private:
+    shared< JournalVirtualDev::Descriptor > m_vdev_jd;
+    uint32_t m_align_size;
+    uint64_t m_window_size;
+    sisl::byte_array m_window;
+    off_t m_window_offset{0}; // Journal offset of the first byte of the window
+    uint64_t m_window_len{0}; // Valid bytes in the window
+    off_t m_cur_offset;       // Journal offset of the current group
+    const log_group_header* m_header{nullptr};
+    log_buffer m_group; // Current group as a whole (decompressed), filled upon first record access
+    crc32_t m_prev_crc{0};
+    uint64_t m_ngroups{0};
+    std::string m_end_reason;
+};
+
 struct logstore_info {
     std::shared_ptr< HomeLogStore > log_store;
     bool append_mode;
@@ -596,8 +768,31 @@ struct truncate_req {
     int trunc_outstanding{0};
 };
 
+// Per logdev view of the group commit: how big the groups are and where the time of a record goes, from append to
+// its completion callback.
+class LogDevMetrics : public sisl::MetricsGroup {
+public:
+    explicit LogDevMetrics(logdev_id_t id) : sisl::MetricsGroup("LogDev", fmt::format("logdev_{}", id)) {
+        REGISTER_HISTOGRAM(logdev_group_records, "Num records in a flushed log group",
+                           HistogramBucketsType(LinearUpto128Buckets));
+        REGISTER_HISTOGRAM(logdev_group_bytes, "Data size of a flushed log group",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(logdev_record_flush_wait_us, "Time a record waits from append to its group write issue");
+        REGISTER_HISTOGRAM(logdev_group_write_us, "Device write time of a log group");
+        REGISTER_HISTOGRAM(logdev_group_completion_us, "Time to call the completion callbacks of a log group");
+        register_me_to_farm();
+    }
+
+    LogDevMetrics(const LogDevMetrics&) = delete;
+    LogDevMetrics(LogDevMetrics&&) noexcept = delete;
+    LogDevMetrics& operator=(const LogDevMetrics&) = delete;
+    LogDevMetrics& operator=(LogDevMetrics&&) noexcept = delete;
+    ~LogDevMetrics() { deregister_me_from_farm(); }
+};
+
 static std::string const logdev_sb_meta_name{"Logdev_sb"};
 static std::string const logdev_rollback_sb_meta_name{"Logdev_rollback_sb"};
+static std::string const logdev_group_index_sb_meta_name{"Logdev_group_index_sb"};
 
 class LogDev : public std::enable_shared_from_this< LogDev > {
     friend class HomeLogStore;
@@ -615,6 +810,12 @@ public:
         return HS_DYNAMIC_CONFIG(logstore.flush_threshold_size) - sizeof(log_group_header);
     }
 
+    static inline uint32_t max_inflight_log_groups() {
+        return std::clamp(HS_DYNAMIC_CONFIG(logstore.max_inflight_log_groups), 1u, max_log_group);
+    }
+
+    static inline bool adaptive_flush_enabled() { return HS_DYNAMIC_CONFIG(logstore.adaptive_flush_enabled); }
+
     LogDev(logdev_id_t logdev_id, JournalVirtualDev* vdev);
     LogDev(const LogDev&) = delete;
     LogDev& operator=(const LogDev&) = delete;
@@ -654,6 +855,12 @@ public:
      */
     void stop_timer();
 
+    /**
+     * @brief Called by the shared flush timer of the service, when this logdev is queued to it (upon append). Flushes
+     * if needed and queues itself again, if there are still records pending flush.
+     */
+    void on_shared_flush_timer();
+
     /**
      * @brief Append the data to the log device asynchronously. The buffer that is passed is expected to be valid, till
      * the append callback is done.
@@ -664,11 +871,13 @@ public:
      * structure which could be 8K
      * @param cb_context Context to put upon a callback once append is. Upon completion the registered callback is
      * called.
+     * @param serializer [OPTIONAL] If provided, data carries only the size and the record is serialized by it in place,
+     * into the log group buffer at the time of flush.
      *
      * @return logid_t : log_idx of the log of the data.
      */
     logid_t append_async(logstore_id_t store_id, logstore_seq_num_t seq_num, const sisl::io_blob& data,
-                         void* cb_context, bool flush_wait = false);
+                         void* cb_context, bool flush_wait = false, log_serialize_cb_t&& serializer = nullptr);
 
     /**
      * @brief Read the log id from the device offset
@@ -684,6 +893,19 @@ public:
      */
     log_buffer read(const logdev_key& key, serialized_log_record& record_header);
 
+    /**
+     * @brief Read the entire log group at the given device offset asynchronously, validating its crc.
+     *
+     * @param dev_offset device offset of the group, as in the logdev_key of any of its records
+     * @return future of the buffer of the group. It fails with std::system_error upon read error.
+     */
+    folly::Future< log_buffer > read_group_async(off_t dev_offset);
+
+    /**
+     * @brief Get the record of given log idx within the group read by read_group_async, as a view into its buffer.
+     */
+    static log_buffer record_in_group(const log_buffer& group_buf, logid_t idx);
+
     /**
      * @brief Load the data from the blkstore starting with offset. This method loads data in bulk and then call
      * the registered logfound_cb with key and buffer. NOTE: This method is not thread safe. It is expected to be called
@@ -759,6 +981,17 @@ public:
      */
     void rollback(logstore_id_t store_id, logid_range_t id_range);
 
+    /**
+     * @brief Rollback the logid range specific to the given store id, by writing a rollback marker record into the log
+     * stream instead of persisting it in the rollback superblk. Records appended after this call are after the marker
+     * and so are not rolled back.
+     *
+     * @param store_id : Store id whose logids are to be rolled back or invalidated
+     * @param id_range : Log id range to rollback/invalidate
+     * @param done_cb : Called in the truncate thread, once the marker is flushed
+     */
+    void rollback_async(logstore_id_t store_id, logid_range_t id_range, std::function< void() > done_cb);
+
     void update_store_superblk(logstore_id_t idx, const logstore_superblk& meta, bool persist_now);
 
     nlohmann::json dump_log_store(const log_dump_req& dum_req);
@@ -766,6 +999,24 @@ public:
 
     bool flush_if_needed(int64_t threshold_size = -1);
 
+    /**
+     * @brief Fast path of the sync writes. If the logdev is idle (no group in flight or being prepared), flush the
+     * pending records as a group in the caller's thread, written with FUA, and complete them before returning.
+     *
+     * @return true if flushed, false if logdev is busy, in which case caller needs to flush it the regular way.
+     */
+    bool try_flush_sync_in_caller();
+
+    /**
+     * @brief Journal offset of the log group containing the given log idx. The journal is scanned forward from the
+     * closest group at or before the idx in the sparse group index, instead of from the start of the journal.
+     *
+     * @return Offset of the group, INVALID_OFFSET if the idx is truncated or not flushed yet.
+     * Throws: std::system_error if the journal couldn't be read
+     */
+    off_t group_offset_of(logid_t idx);
+    void group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie);
+
     bool is_aligned_buf_needed(size_t size) const {
         return (log_record::is_size_inlineable(size, m_flush_size_multiple) == false);
     }
@@ -790,21 +1041,25 @@ public:
     void on_logfound(logstore_id_t id, logstore_seq_num_t seq_num, logdev_key ld_key, logdev_key flush_ld_key,
                      log_buffer buf, uint32_t nremaining_in_batch);
     void on_batch_completion(HomeLogStore* log_store, uint32_t nremaining_in_batch, logdev_key flush_ld_key);
+    void complete_flush_batch(logdev_key flush_ld_key);
+    void on_rollback_marker_flushed(logstore_id_t store_id, void* ctx, logdev_key flush_ld_key,
+                                    uint32_t nremaining_in_batch);
 
     /**
-     * Truncates the device under lock.
+     * Truncates the device in the background.
      *
-     * This function is responsible for truncating the device based on the provided truncate request.
-     * The truncation operation is performed under a lock to ensure thread safety.
+     * This function is responsible for truncating the device based on the provided truncate request. The truncation
+     * runs in the truncate thread, without locking the flush, so appends and flushes go on in parallel to it.
      *
      * @param treq The truncate request to be processed.
      */
-    void device_truncate_under_lock(const std::shared_ptr< truncate_req > treq);
+    void device_truncate_async(const std::shared_ptr< truncate_req > treq);
 
     void handle_unopened_log_stores(bool format);
     logdev_id_t get_id() { return m_logdev_id; }
     shared< JournalVirtualDev::Descriptor > get_journal_descriptor() const { return m_vdev_jd; }
     bool is_stopped() { return m_stopped; }
+    size_t num_log_stores() const;
 
     // bool ready_for_truncate() const { return m_vdev_jd->ready_for_truncate(); }
 
@@ -830,20 +1085,31 @@ private:
      */
     logdev_key do_device_truncate(bool dry_run = false);
 
+    // Groups are issued and completed in order, so the pool is used as a ring. Slot of the next group is free as long
+    // as less than max_log_group groups are in flight.
     LogGroup* make_log_group(uint32_t estimated_records) {
-        m_log_group_pool[m_log_group_idx].reset(estimated_records);
-        return &m_log_group_pool[m_log_group_idx];
+        auto& lg = m_log_group_pool[m_log_group_issue_seq % max_log_group];
+        lg.reset(estimated_records);
+        return &lg;
     }
 
-    void free_log_group(LogGroup* lg) { m_log_group_idx = !m_log_group_idx; }
-
     LogGroup* prepare_flush(int32_t estimated_record);
+    bool try_begin_group_prepare();
+    void end_group_prepare(bool issued);
+    LogGroup* reserve_flush_group(uint64_t elapsed_time);
 
     void do_flush(LogGroup* lg);
     void do_flush_write(LogGroup* lg);
     void flush_by_size(uint32_t min_threshold, uint32_t new_record_size = 0, logid_t new_idx = -1);
     void on_flush_completion(LogGroup* lg);
+    void complete_flushed_group(LogGroup* lg);
+    int64_t flush_threshold() const;
+    uint64_t flush_window_us() const;
+    void update_arrival_rate(uint64_t size, uint64_t elapsed_us);
     void do_load(off_t offset);
+    void load_rollback_markers(off_t device_cursor);
+    void index_group(logid_t start_idx, off_t dev_offset);
+    std::map< logid_t, off_t > trim_group_index(logid_t upto_idx);
 
 #if 0
     log_group_header* read_validate_header(uint8_t* buf, uint32_t size, bool* read_more);
@@ -856,8 +1122,7 @@ private:
     bool get_flush_status();
 
 private:
-    std::unique_ptr< sisl::StreamTracker< log_record > >
-        m_log_records;                              // The container which stores all in-memory log records
+    std::unique_ptr< LogRecordTracker< log_record > > m_log_records; // In-memory log records, by log idx
     std::atomic< logid_t > m_log_idx{0};            // Generator of log idx
     std::atomic< int64_t > m_pending_flush_size{0}; // How much flushable logs are pending
     std::atomic< bool > m_is_flushing{false}; // Is LogDev currently flushing (so far supports one flusher at a time)
@@ -876,11 +1141,36 @@ private:
     std::multimap< logid_t, logstore_id_t > m_garbage_store_ids;
     Clock::time_point m_last_flush_time;
 
-    logid_t m_last_flush_idx{-1}; // Track last flushed, last device offset and truncated log idx
+    // Adaptive flush state (see adaptive_flush_enabled), exponentially weighted moving averages of the append rate
+    // seen by the flusher and the device write latency of a log group
+    std::atomic< uint64_t > m_arrival_rate_bps{0};
+    std::atomic< uint64_t > m_flush_lat_ewma_us{0};
+
+    // Group commit stats, histograms of them in m_metrics and the totals for the summary in get_status. Only the
+    // completer (one at a time) updates them, atomics only to read them without a lock.
+    LogDevMetrics m_metrics;
+    struct {
+        std::atomic< uint64_t > groups{0};
+        std::atomic< uint64_t > records{0};
+        std::atomic< uint64_t > bytes{0};
+        std::atomic< uint64_t > record_wait_us{0};
+        std::atomic< uint64_t > write_us{0};
+        std::atomic< uint64_t > completion_us{0};
+    } m_group_stats;
+
+    // Sparse index of the start log idx of every group_index_interval'th group to its offset in the journal, from
+    // replay and the groups flushed since. Persisted along with the logdev meta upon truncation.
+    mutable std::mutex m_group_index_mtx;
+    std::map< logid_t, off_t > m_group_index;
+    uint32_t m_groups_since_indexed{0};
+
+    logid_t m_last_flush_idx{-1};    // Track last flushed, last device offset and truncated log idx
+    logid_t m_last_prepared_idx{-1}; // Last log idx put into a group, ahead of m_last_flush_idx by inflight groups
     off_t m_last_flush_dev_offset{0};
     logid_t m_last_truncate_idx{-1};
 
     crc32_t m_last_crc{INVALID_CRC32_VALUE};
+    crc32_t m_last_prepared_crc{INVALID_CRC32_VALUE}; // Crc of the last group prepared, prev crc of the next one
     log_append_comp_callback m_append_comp_cb{nullptr};
     log_found_callback m_logfound_cb{nullptr};
     store_found_callback m_store_found_cb{nullptr};
@@ -900,10 +1190,19 @@ private:
 
     // Pool for creating log group
     LogGroup m_log_group_pool[max_log_group];
-    uint32_t m_log_group_idx{0};
+
+    // Pipelined flush: one group is prepared at a time and upto max_inflight_log_groups are in flight. Flush lock
+    // (m_is_flushing) is held on behalf of all of them, i.e. as long as a group is being prepared or in flight.
+    std::mutex m_flush_pipeline_mtx;
+    bool m_preparing_group{false};                  // A flusher is preparing and issuing the next group
+    bool m_completing_groups{false};                // A thread is completing the written groups in order
+    std::atomic< uint32_t > m_inflight_groups{0};   // Groups issued but not completed yet
+    uint64_t m_log_group_issue_seq{0};              // Total groups issued, next group is at this slot of the pool
+    uint64_t m_log_group_complete_seq{0};           // Total groups completed
     std::atomic< bool > m_flush_status = false;
     // Timer handle
     iomgr::timer_handle_t m_flush_timer_hdl{iomgr::null_timer_handle};
+    std::atomic< bool > m_shared_flush_queued{false}; // Queued to the shared flush timer of the service
 
 }; // LogDev
 
@@ -15,21 +15,26 @@
  *********************************************************************************/
 #include <cstring>
 
+#include <sisl/fds/compress.hpp>
 #include <homestore/logstore/log_store.hpp>
+#include "common/homestore_config.hpp"
 #include "common/homestore_assert.hpp"
+#include "common/homestore_utils.hpp"
 #include "log_dev.hpp"
 
 namespace homestore {
 SISL_LOGGING_DECL(logstore)
 
 LogGroup::LogGroup() = default;
-void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_size) {
+void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_size, const int numa_node) {
     m_iovecs.reserve(estimated_iovs);
     m_flush_multiple_size = flush_multiple_size;
+    m_numa_node = numa_node;
 
     // TO DO: Might need to differentiate based on data or fast type
     m_cur_buf_len = sisl::round_up(inline_log_buf_size, flush_multiple_size);
     m_log_buf = sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(align_size, m_cur_buf_len);
+    hs_utils::bind_to_numa_node(m_log_buf.get(), m_cur_buf_len, m_numa_node);
 
     m_footer_buf_len = sisl::round_up(sizeof(log_group_footer), flush_multiple_size);
     m_footer_buf =
@@ -38,38 +43,66 @@ void LogGroup::start(const uint64_t flush_multiple_size, const uint32_t align_si
 
 void LogGroup::stop() {
     m_log_buf.reset();
-    m_overflow_log_buf.reset();
+    m_overflow_bufs.clear();
     m_footer_buf.reset();
+    m_compress_src_buf.reset();
+    m_compress_buf.reset();
+    m_compress_src_buf_len = 0;
+    m_compress_buf_len = 0;
 }
 
 void LogGroup::reset(const uint32_t max_records) {
     m_cur_buf_len = sisl::round_up(inline_log_buf_size, m_flush_multiple_size);
     m_cur_log_buf = m_log_buf.get();
+    m_inline_buf = m_cur_log_buf;
+    m_inline_buf_offset = 0;
+    m_n_inline_iovs = 1;
+    m_max_records = std::min(max_records, max_records_in_a_batch);
     m_record_slots = reinterpret_cast< serialized_log_record* >(m_cur_log_buf + sizeof(log_group_header));
-    m_inline_data_pos = sizeof(log_group_header) + (sizeof(serialized_log_record) * max_records);
+    m_inline_data_pos = sizeof(log_group_header) + (sizeof(serialized_log_record) * m_max_records);
     m_oob_data_pos = 0;
 
-    m_overflow_log_buf = nullptr;
+    m_overflow_bufs.clear();
+    m_inline_crc = init_crc32;
+    m_oob_crc = init_crc32;
     m_nrecords = 0;
-    m_max_records = std::min(max_records, max_records_in_a_batch);
     m_actual_data_size = 0;
 
     m_iovecs.clear();
     m_iovecs.emplace_back(static_cast< void* >(m_cur_log_buf), m_inline_data_pos);
 }
 
-void LogGroup::create_overflow_buf(const uint32_t min_needed) {
-    auto const new_len = sisl::round_up(std::max(min_needed, m_cur_buf_len * 2), m_flush_multiple_size);
+void LogGroup::add_overflow_buf(const uint32_t min_needed) {
+    // Current buffer is written in full (its size is flush size aligned), so that the inline area stays contiguous on
+    // the device and the records already placed need not be moved. Any unused tail just becomes a gap in inline area.
+    m_inline_crc = crc32_ieee(m_inline_crc, inline_data_ptr(), inline_space_left());
+    m_iovecs[m_n_inline_iovs - 1].iov_len = m_cur_buf_len;
+    m_inline_buf_offset += m_cur_buf_len;
+    m_inline_data_pos = m_inline_buf_offset;
+
+    auto const new_len = sisl::round_up(std::max(min_needed, m_cur_buf_len), m_flush_multiple_size);
     auto new_buf =
         sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(m_flush_multiple_size, new_len);
-    std::memcpy(s_cast< void* >(new_buf.get()), s_cast< const void* >(m_cur_log_buf), m_cur_buf_len);
-
-    m_overflow_log_buf = std::move(new_buf);
-    m_cur_log_buf = m_overflow_log_buf.get();
+    hs_utils::bind_to_numa_node(new_buf.get(), new_len, m_numa_node);
+    m_inline_buf = new_buf.get();
     m_cur_buf_len = new_len;
-    m_record_slots = r_cast< serialized_log_record* >(m_cur_log_buf + sizeof(log_group_header));
+    m_overflow_bufs.emplace_back(std::move(new_buf));
+
+    m_iovecs.emplace(m_iovecs.begin() + m_n_inline_iovs, static_cast< void* >(m_inline_buf), 0);
+    ++m_n_inline_iovs;
+}
 
-    m_iovecs[0].iov_base = m_cur_log_buf;
+void LogGroup::copy_inline(const uint8_t* data, uint32_t size) {
+    // Record could straddle the overflow buffers, as its offset within the group is what is looked up on read
+    while (size) {
+        if (inline_space_left() == 0) { add_overflow_buf(size); }
+        auto const n = std::min(size, inline_space_left());
+        std::memcpy(s_cast< void* >(inline_data_ptr()), s_cast< const void* >(data), n);
+        m_inline_crc = crc32_ieee(m_inline_crc, data, n);
+        m_inline_data_pos += n;
+        data += n;
+        size -= n;
+    }
 }
 
 bool LogGroup::add_record(log_record& record, const int64_t log_idx) {
@@ -81,9 +114,6 @@ bool LogGroup::add_record(log_record& record, const int64_t log_idx) {
     }
 
     m_actual_data_size += record.data.size();
-    if ((m_inline_data_pos + record.data.size()) >= m_cur_buf_len) {
-        create_overflow_buf(m_inline_data_pos + record.data.size());
-    }
 
     // We use log_idx reference in the header as we expect each slot record is in order.
     if (m_nrecords == 0) { header()->start_log_idx = log_idx; }
@@ -94,18 +124,27 @@ bool LogGroup::add_record(log_record& record, const int64_t log_idx) {
     m_record_slots[m_nrecords].size = record.data.size();
     m_record_slots[m_nrecords].store_id = record.store_id;
     m_record_slots[m_nrecords].store_seq_num = record.seq_num;
-    if (record.is_inlineable(m_flush_multiple_size)) {
+    if (record.serializer) {
+        // Serialized in place, so it needs to be contiguous within a buffer
+        if (inline_space_left() < record.data.size()) { add_overflow_buf(record.data.size()); }
         m_record_slots[m_nrecords].offset = m_inline_data_pos;
         m_record_slots[m_nrecords].set_inlined(true);
-        std::memcpy(s_cast< void* >(m_cur_log_buf + m_inline_data_pos), s_cast< const void* >(record.data.cbytes()),
-                    record.data.size());
+        record.serializer(inline_data_ptr(), record.data.size());
+        record.serializer = nullptr; // Record is prepared only once, release whatever it holds right away
+        m_inline_crc = crc32_ieee(m_inline_crc, inline_data_ptr(), record.data.size());
         m_inline_data_pos += record.data.size();
-        m_iovecs[0].iov_len = m_inline_data_pos;
+        m_iovecs[m_n_inline_iovs - 1].iov_len = m_inline_data_pos - m_inline_buf_offset;
+    } else if (record.is_inlineable(m_flush_multiple_size)) {
+        m_record_slots[m_nrecords].offset = m_inline_data_pos;
+        m_record_slots[m_nrecords].set_inlined(true);
+        copy_inline(record.data.cbytes(), record.data.size());
+        m_iovecs[m_n_inline_iovs - 1].iov_len = m_inline_data_pos - m_inline_buf_offset;
     } else {
         // We do not round it now, it will be rounded during finish
         m_record_slots[m_nrecords].offset = m_oob_data_pos;
         m_record_slots[m_nrecords].set_inlined(false);
         m_iovecs.emplace_back(s_cast< void* >(record.data.bytes()), record.data.size());
+        m_oob_crc = crc32_ieee(m_oob_crc, record.data.cbytes(), record.data.size());
         m_oob_data_pos += record.data.size();
     }
     ++m_nrecords;
@@ -114,21 +153,29 @@ bool LogGroup::add_record(log_record& record, const int64_t log_idx) {
 }
 
 bool LogGroup::new_iovec_for_footer() const {
-    return ((m_inline_data_pos + sizeof(log_group_footer)) >= m_cur_buf_len || m_oob_data_pos != 0);
+    return ((inline_space_left() <= sizeof(log_group_footer)) || m_oob_data_pos != 0);
 }
 
 const iovec_array& LogGroup::finish(logdev_id_t logdev_id, const crc32_t prev_crc) {
     // add footer
+    bool const footer_inline = !new_iovec_for_footer();
     auto footer = add_and_get_footer();
+    footer->start_log_idx = header()->start_log_idx;
 
-    m_iovecs[0].iov_len = sisl::round_up(m_iovecs[0].iov_len, m_flush_multiple_size);
+    // Remainder of running crcs: tail of the inline area (with the footer, if it is inline) and the footer otherwise
+    auto& inline_tail_iov = m_iovecs[m_n_inline_iovs - 1];
+    inline_tail_iov.iov_len = sisl::round_up(inline_tail_iov.iov_len, m_flush_multiple_size);
+    m_inline_crc = crc32_ieee(m_inline_crc, inline_data_ptr(),
+                              m_inline_buf_offset + inline_tail_iov.iov_len - m_inline_data_pos);
+    if (!footer_inline) { m_oob_crc = crc32_ieee(m_oob_crc, m_footer_buf.get(), m_footer_buf_len); }
 
     log_group_header* hdr = new (header()) log_group_header{};
     hdr->logdev_id = logdev_id;
     hdr->n_log_records = m_nrecords;
     hdr->prev_grp_crc = prev_crc;
     hdr->inline_data_offset = sizeof(log_group_header) + (m_max_records * sizeof(serialized_log_record));
-    hdr->oob_data_offset = m_iovecs[0].iov_len;
+    hdr->oob_data_offset = m_inline_buf_offset + inline_tail_iov.iov_len;
+    hdr->compressed_size = 0;
     if (new_iovec_for_footer()) {
         hdr->footer_offset = hdr->oob_data_offset + m_oob_data_pos;
         hdr->group_size = hdr->footer_offset + m_footer_buf_len;
@@ -146,12 +193,110 @@ const iovec_array& LogGroup::finish(logdev_id_t logdev_id, const crc32_t prev_cr
     HS_DBG_ASSERT_EQ(hdr->group_size, len, "length is not same");
 #endif
 
-    footer->start_log_idx = hdr->start_log_idx;
-    hdr->cur_grp_crc = compute_crc();
+    hdr->uncompressed_size = hdr->group_size;
+    bool const compressed = HS_DYNAMIC_CONFIG(logstore.compress_log_group) &&
+        (hdr->group_size >= HS_DYNAMIC_CONFIG(logstore.compress_log_group_min_size)) && compress();
+    if (compressed) {
+        hdr->cur_grp_crc = compute_crc();
+        std::memcpy(m_compress_buf.get(), s_cast< const void* >(hdr), sizeof(log_group_header));
+    } else {
+        // Only the record slots are left to be crc'd, see log_group_header::compute_crc
+        crc32_t crc = crc32_ieee(m_inline_crc, hdr->record_area(), hdr->inline_data_offset - sizeof(log_group_header));
+        hdr->cur_grp_crc = crc32_ieee(crc, r_cast< const unsigned char* >(&m_oob_crc), sizeof(m_oob_crc));
+    }
 
     return m_iovecs;
 }
 
+bool LogGroup::compress() {
+    auto* hdr = header();
+    uint32_t const src_size = hdr->group_size - sizeof(log_group_header);
+
+    // Compressor needs the group contiguous, so it is gathered unless it is all in the first buffer
+    const uint8_t* src;
+    if (m_iovecs.size() == 1) {
+        src = s_cast< const uint8_t* >(m_iovecs[0].iov_base) + sizeof(log_group_header);
+    } else {
+        if (m_compress_src_buf_len < src_size) {
+            m_compress_src_buf_len = sisl::round_up(src_size, m_flush_multiple_size);
+            m_compress_src_buf = sisl::aligned_unique_ptr< uint8_t, sisl::buftag::compression >::make_sized(
+                m_flush_multiple_size, m_compress_src_buf_len);
+        }
+        uint8_t* dst = m_compress_src_buf.get();
+        std::memcpy(dst, s_cast< const uint8_t* >(m_iovecs[0].iov_base) + sizeof(log_group_header),
+                    m_iovecs[0].iov_len - sizeof(log_group_header));
+        dst += m_iovecs[0].iov_len - sizeof(log_group_header);
+        for (size_t i{1}; i < m_iovecs.size(); ++i) {
+            std::memcpy(dst, m_iovecs[i].iov_base, m_iovecs[i].iov_len);
+            dst += m_iovecs[i].iov_len;
+        }
+        src = m_compress_src_buf.get();
+    }
+
+    size_t compressed_size = sisl::Compress::max_compress_len(src_size);
+    uint32_t const max_len = sisl::round_up(sizeof(log_group_header) + compressed_size, m_flush_multiple_size);
+    if (m_compress_buf_len < max_len) {
+        m_compress_buf_len = max_len;
+        m_compress_buf = sisl::aligned_unique_ptr< uint8_t, sisl::buftag::logwrite >::make_sized(m_flush_multiple_size,
+                                                                                                 m_compress_buf_len);
+        hs_utils::bind_to_numa_node(m_compress_buf.get(), m_compress_buf_len, m_numa_node);
+    }
+    auto const ret = sisl::Compress::compress(r_cast< const char* >(src),
+                                              r_cast< char* >(m_compress_buf.get() + sizeof(log_group_header)),
+                                              src_size, &compressed_size);
+    if (ret != 0) {
+        LOGERRORMOD(logstore, "Failed to compress log group of size={}, ret={}, writing it uncompressed",
+                    hdr->group_size, ret);
+        return false;
+    }
+
+    // Not worth it, unless it saves at least a flush multiple of the device writes
+    uint32_t const stored_len = sisl::round_up(sizeof(log_group_header) + compressed_size, m_flush_multiple_size);
+    if ((stored_len + m_footer_buf_len) >= hdr->group_size) { return false; }
+    std::memset(m_compress_buf.get() + sizeof(log_group_header) + compressed_size, 0,
+                stored_len - sizeof(log_group_header) - compressed_size);
+
+    // Footer of the compressed group follows the compressed data, so that a partially written group is still caught.
+    // It is written only now, as original footer (if it is in m_footer_buf) is already compressed.
+    auto* footer = new (m_footer_buf.get()) log_group_footer();
+    footer->start_log_idx = hdr->start_log_idx;
+
+    hdr->compressed_size = uint32_cast(compressed_size);
+    hdr->footer_offset = stored_len;
+    hdr->group_size = stored_len + m_footer_buf_len;
+
+    m_iovecs.clear();
+    m_iovecs.emplace_back(static_cast< void* >(m_compress_buf.get()), stored_len);
+    m_iovecs.emplace_back(static_cast< void* >(m_footer_buf.get()), m_footer_buf_len);
+    return true;
+}
+
+crc32_t log_group_header::compute_crc() const {
+    if (is_compressed() || (get_version() < header_version)) {
+        return crc32_ieee(init_crc32, record_area(), group_size - header_size());
+    }
+
+    crc32_t crc = crc32_ieee(init_crc32, inline_area(), oob_data_offset - inline_data_offset);
+    crc = crc32_ieee(crc, record_area(), inline_data_offset - header_size());
+    crc32_t const oob_crc = crc32_ieee(init_crc32, oob_area(), group_size - oob_data_offset);
+    return crc32_ieee(crc, r_cast< const unsigned char* >(&oob_crc), sizeof(oob_crc));
+}
+
+sisl::byte_array LogGroup::decompress(const log_group_header* header, const uint32_t align_size) {
+    auto buf = hs_utils::make_byte_array(header->uncompressed_size, true /* aligned */, sisl::buftag::logread,
+                                         align_size);
+    std::memcpy(buf->bytes(), s_cast< const void* >(header), sizeof(log_group_header));
+
+    size_t decompressed_size = header->uncompressed_size - sizeof(log_group_header);
+    auto const ret = sisl::Compress::decompress(r_cast< const char* >(header) + sizeof(log_group_header),
+                                                r_cast< char* >(buf->bytes() + sizeof(log_group_header)),
+                                                header->compressed_size, &decompressed_size);
+    HS_REL_ASSERT_EQ(ret, 0, "Failed to decompress log group {}", *header);
+    HS_REL_ASSERT_EQ(decompressed_size, header->uncompressed_size - sizeof(log_group_header),
+                     "Decompressed size mismatch of log group {}", *header);
+    return buf;
+}
+
 log_group_footer* LogGroup::add_and_get_footer() {
     log_group_footer* footer;
     if (new_iovec_for_footer()) {
@@ -159,16 +304,15 @@ log_group_footer* LogGroup::add_and_get_footer() {
         m_iovecs.emplace_back(static_cast< void* >(m_footer_buf.get()), m_footer_buf_len);
         footer = new (m_footer_buf.get()) log_group_footer();
     } else {
-        footer = new ((void*)((uint8_t*)m_iovecs[0].iov_base + m_inline_data_pos)) log_group_footer();
-        m_iovecs[0].iov_len += sizeof(log_group_footer);
+        footer = new (s_cast< void* >(inline_data_ptr())) log_group_footer();
+        m_iovecs[m_n_inline_iovs - 1].iov_len += sizeof(log_group_footer);
     }
     return footer;
 }
 
-crc32_t LogGroup::compute_crc() {
-    crc32_t crc =
-        crc32_ieee(init_crc32, static_cast< const unsigned char* >(m_iovecs[0].iov_base) + sizeof(log_group_header),
-                   m_iovecs[0].iov_len - sizeof(log_group_header));
+crc32_t LogGroup::compute_crc(const uint32_t header_size) {
+    crc32_t crc = crc32_ieee(init_crc32, static_cast< const unsigned char* >(m_iovecs[0].iov_base) + header_size,
+                             m_iovecs[0].iov_len - header_size);
     for (size_t i{1}; i < m_iovecs.size(); ++i) {
         crc = crc32_ieee(crc, static_cast< const unsigned char* >(m_iovecs[i].iov_base), m_iovecs[i].iov_len);
     }
@@ -176,4 +320,17 @@ crc32_t LogGroup::compute_crc() {
     return crc;
 }
 
+#ifdef _PRERELEASE
+void LogGroup::downgrade_to_v0() {
+    auto* hdr = header();
+    if (hdr->is_compressed()) { return; }
+
+    // Record slots follow the shorter header, inline records are at their offsets from the header start either way
+    hdr->version = 0;
+    std::memmove(m_cur_log_buf + hdr->header_size(), m_cur_log_buf + sizeof(log_group_header),
+                 hdr->inline_data_offset - sizeof(log_group_header));
+    m_record_slots = reinterpret_cast< serialized_log_record* >(m_cur_log_buf + hdr->header_size());
+    hdr->cur_grp_crc = compute_crc(hdr->header_size());
+}
+#endif
 } // namespace homestore
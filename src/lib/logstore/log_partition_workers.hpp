@@ -0,0 +1,115 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+#include <sisl/utility/thread_factory.hpp>
+
+#include <homestore/logstore/log_store_internal.hpp>
+
+namespace homestore {
+//
+// LogPartitionWorkers calls back the records of a log store on a pool of threads, each record on the worker of its
+// partition, so that records of the same partition are called back in the order they are dispatched, while those of
+// different partitions are called back concurrently. Queue of a worker is bounded, dispatch waits for the worker to
+// catch up once it is full, so that the buffers held are bounded too.
+//
+class LogPartitionWorkers {
+public:
+    using record_cb_t = std::function< void(logstore_seq_num_t, log_buffer) >;
+    static constexpr size_t max_queued_per_worker{1024};
+
+    LogPartitionWorkers(std::string const& name, uint32_t nworkers, record_cb_t cb) : m_cb{std::move(cb)} {
+        m_workers.reserve(std::max(nworkers, 1u));
+        for (uint32_t w{0}; w < std::max(nworkers, 1u); ++w) {
+            m_workers.push_back(std::make_unique< worker >());
+        }
+        for (uint32_t w{0}; w < m_workers.size(); ++w) {
+            m_workers[w]->thr = sisl::named_thread(fmt::format("{}_rp{}", name, w),
+                                                   [this, wk = m_workers[w].get()]() { run(*wk); });
+        }
+    }
+    LogPartitionWorkers(const LogPartitionWorkers&) = delete;
+    LogPartitionWorkers(LogPartitionWorkers&&) noexcept = delete;
+    LogPartitionWorkers& operator=(const LogPartitionWorkers&) = delete;
+    LogPartitionWorkers& operator=(LogPartitionWorkers&&) noexcept = delete;
+    ~LogPartitionWorkers() { drain(); }
+
+    void dispatch(uint64_t partition, logstore_seq_num_t seq_num, log_buffer buf) {
+        auto& wk = *m_workers[partition % m_workers.size()];
+        std::unique_lock lg{wk.mtx};
+        wk.cv.wait(lg, [&wk]() { return wk.records.size() < max_queued_per_worker; });
+        wk.records.emplace_back(seq_num, std::move(buf));
+        if (wk.records.size() == 1) { wk.cv.notify_all(); }
+    }
+
+    /// @brief Wait for all the records dispatched to be called back and stop the workers
+    void drain() {
+        for (auto& wk : m_workers) {
+            {
+                std::unique_lock lg{wk->mtx};
+                wk->stopping = true;
+            }
+            wk->cv.notify_all();
+        }
+        for (auto& wk : m_workers) {
+            if (wk->thr.joinable()) { wk->thr.join(); }
+        }
+    }
+
+    uint32_t num_workers() const { return uint32_cast(m_workers.size()); }
+
+private:
+    struct worker {
+        std::mutex mtx;
+        std::condition_variable cv; // Waited on by the worker when it is empty and by dispatch when it is full
+        std::deque< std::pair< logstore_seq_num_t, log_buffer > > records;
+        bool stopping{false};
+        std::thread thr;
+    };
+
+    void run(worker& wk) {
+        std::unique_lock lg{wk.mtx};
+        while (true) {
+            wk.cv.wait(lg, [&wk]() { return !wk.records.empty() || wk.stopping; });
+            if (wk.records.empty()) { break; }
+
+            auto [seq_num, buf] = std::move(wk.records.front());
+            wk.records.pop_front();
+            if (wk.records.size() == max_queued_per_worker - 1) { wk.cv.notify_all(); }
+            lg.unlock();
+            m_cb(seq_num, std::move(buf));
+            lg.lock();
+        }
+    }
+
+private:
+    record_cb_t m_cb;
+    std::vector< std::unique_ptr< worker > > m_workers;
+};
+} // namespace homestore
@@ -13,7 +13,9 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <cstring>
 #include <iterator>
+#include <map>
 #include <string>
 
 #include <fmt/format.h>
@@ -23,7 +25,10 @@
 #include <homestore/homestore.hpp>
 #include <homestore/logstore_service.hpp>
 #include "common/homestore_assert.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/resource_mgr.hpp"
 #include "log_dev.hpp"
+#include "log_partition_workers.hpp"
 
 namespace homestore {
 SISL_LOGGING_DECL(logstore)
@@ -47,6 +52,13 @@ HomeLogStore::HomeLogStore(std::shared_ptr< LogDev > logdev, logstore_id_t id, b
     THIS_LOGSTORE_LOG(TRACE, "m_safe_truncation_boundary.ld_key={}", m_safe_truncation_boundary.ld_key);
 }
 
+HomeLogStore::~HomeLogStore() {
+    // Homestore is being destroyed itself (along with resource mgr) otherwise
+    if (m_tail_cache_size && HomeStore::safe_instance()) {
+        resource_mgr().dec_mem_usage(mem_consumer_t::log_tail_cache, m_tail_cache_size);
+    }
+}
+
 bool HomeLogStore::write_sync(logstore_seq_num_t seq_num, const sisl::io_blob& b) {
     HS_LOG_ASSERT((!iomanager.am_i_worker_reactor()), "Sync can not be done in worker reactor thread");
 
@@ -58,6 +70,9 @@ bool HomeLogStore::write_sync(logstore_seq_num_t seq_num, const sisl::io_blob& b
         bool ret{false};
     };
     auto ctx = std::make_shared< Context >();
+
+    // Sync io in an io reactor would stall the other ios on it, so the fast path is only for non reactor threads
+    bool const fast_path = HS_DYNAMIC_CONFIG(logstore.sync_write_fast_path) && !iomanager.am_i_io_reactor();
     this->write_async(
         seq_num, b, nullptr,
         [seq_num, this, ctx](homestore::logstore_seq_num_t seq_num_cb, [[maybe_unused]] const sisl::io_blob& b,
@@ -70,7 +85,8 @@ bool HomeLogStore::write_sync(logstore_seq_num_t seq_num, const sisl::io_blob& b
             }
             ctx->write_cv.notify_one();
         },
-        true /* flush_wait */);
+        !fast_path /* flush_wait */);
+    if (fast_path && !m_logdev->try_flush_sync_in_caller()) { m_logdev->flush_if_needed(1); }
 
     {
         std::unique_lock< std::mutex > lk{ctx->write_mutex};
@@ -84,6 +100,7 @@ void HomeLogStore::write_async(logstore_req* req, const log_req_comp_cb_t& cb) {
     HS_LOG_ASSERT((cb || m_comp_cb), "Expected either cb is not null or default cb registered");
     req->cb = (cb ? cb : m_comp_cb);
     req->start_time = Clock::now();
+    req->trace_id = Tracer::current();
     if (req->seq_num == 0) {
         m_safe_truncation_boundary.ld_key = m_logdev->get_last_flush_ld_key();
         THIS_LOGSTORE_LOG(TRACE, "m_safe_truncation_boundary.ld_key={}", m_safe_truncation_boundary.ld_key);
@@ -100,7 +117,8 @@ void HomeLogStore::write_async(logstore_req* req, const log_req_comp_cb_t& cb) {
     m_records.create(req->seq_num);
     COUNTER_INCREMENT(m_metrics, logstore_append_count, 1);
     HISTOGRAM_OBSERVE(m_metrics, logstore_record_size, req->data.size());
-    m_logdev->append_async(m_store_id, req->seq_num, req->data, static_cast< void* >(req), req->flush_wait);
+    m_logdev->append_async(m_store_id, req->seq_num, req->data, static_cast< void* >(req), req->flush_wait,
+                           std::move(req->serializer));
 }
 
 void HomeLogStore::write_async(logstore_seq_num_t seq_num, const sisl::io_blob& b, void* cookie,
@@ -116,6 +134,25 @@ void HomeLogStore::write_async(logstore_seq_num_t seq_num, const sisl::io_blob&
     });
 }
 
+void HomeLogStore::write_async(logstore_seq_num_t seq_num, uint32_t size, log_serialize_cb_t&& serializer,
+                               void* cookie, const log_write_comp_cb_t& cb, bool flush_wait) {
+    auto* req = logstore_req::make(this, seq_num, sisl::io_blob{nullptr, size, false}, true /* is_write_req */);
+    req->cookie = cookie;
+    req->flush_wait = flush_wait;
+    req->serializer = std::move(serializer);
+
+    write_async(req, [cb](logstore_req* req, logdev_key written_lkey) {
+        if (cb) { cb(req->seq_num, req->data, written_lkey, req->cookie); }
+        logstore_req::free(req);
+    });
+}
+
+logstore_seq_num_t HomeLogStore::append_sync(const sisl::io_blob& b) {
+    HS_DBG_ASSERT_EQ(m_append_mode, true, "append_sync can be called only on append only mode");
+    const auto seq_num = m_seq_num.fetch_add(1, std::memory_order_acq_rel);
+    return write_sync(seq_num, b) ? seq_num : invalid_lsn();
+}
+
 logstore_seq_num_t HomeLogStore::append_async(const sisl::io_blob& b, void* cookie, const log_write_comp_cb_t& cb) {
     HS_DBG_ASSERT_EQ(m_append_mode, true, "append_async can be called only on append only mode");
     const auto seq_num = m_seq_num.fetch_add(1, std::memory_order_acq_rel);
@@ -123,6 +160,14 @@ logstore_seq_num_t HomeLogStore::append_async(const sisl::io_blob& b, void* cook
     return seq_num;
 }
 
+logstore_seq_num_t HomeLogStore::append_async(uint32_t size, log_serialize_cb_t&& serializer, void* cookie,
+                                              const log_write_comp_cb_t& cb) {
+    HS_DBG_ASSERT_EQ(m_append_mode, true, "append_async can be called only on append only mode");
+    const auto seq_num = m_seq_num.fetch_add(1, std::memory_order_acq_rel);
+    write_async(seq_num, size, std::move(serializer), cookie, cb);
+    return seq_num;
+}
+
 log_buffer HomeLogStore::read_sync(logstore_seq_num_t seq_num) {
     // If seq_num has not been flushed yet, but issued, then we flush them before reading
     auto const s = m_records.status(seq_num);
@@ -134,6 +179,7 @@ log_buffer HomeLogStore::read_sync(logstore_seq_num_t seq_num) {
         flush_sync(seq_num);
     }
 
+    if (auto b = read_tail_cache(seq_num); b) { return std::move(*b); }
     const auto record = m_records.at(seq_num);
     const logdev_key ld_key = record.m_dev_key;
     if (!ld_key.is_valid()) {
@@ -150,6 +196,64 @@ log_buffer HomeLogStore::read_sync(logstore_seq_num_t seq_num) {
     HISTOGRAM_OBSERVE(m_metrics, logstore_read_latency, get_elapsed_time_us(start_time));
     return b;
 }
+
+folly::Future< std::vector< log_buffer > > HomeLogStore::read_range_async(logstore_seq_num_t start_seq_num,
+                                                                         logstore_seq_num_t end_seq_num) {
+    auto const s = m_records.status(start_seq_num);
+    if (s.is_out_of_range || s.is_hole) { throw std::out_of_range("key not valid"); }
+    if (end_seq_num <= start_seq_num) { return folly::makeFuture(std::vector< log_buffer >{}); }
+
+    // If any of the range is not flushed yet, but issued, then we flush them before reading
+    if (!s.is_completed || (get_contiguous_completed_seq_num(start_seq_num) < end_seq_num - 1)) {
+        THIS_LOGSTORE_LOG(TRACE, "Reading lsn={}:[{}-{}) before flushed, doing flush first", m_store_id, start_seq_num,
+                          end_seq_num);
+        flush_sync(std::min(end_seq_num - 1, std::max(start_seq_num, get_contiguous_issued_seq_num(start_seq_num))));
+    }
+    end_seq_num = std::min(end_seq_num, std::max(start_seq_num, get_contiguous_completed_seq_num(start_seq_num)) + 1);
+
+    struct range_ctx {
+        std::vector< log_buffer > bufs;
+        // dev_offset of the group -> list of (position in the range, log idx within the logdev)
+        std::map< off_t, std::vector< std::pair< size_t, logid_t > > > groups;
+    };
+    auto ctx = std::make_shared< range_ctx >();
+    ctx->bufs.resize(end_seq_num - start_seq_num);
+
+    for (auto seq_num = start_seq_num; seq_num < end_seq_num; ++seq_num) {
+        auto const pos = s_cast< size_t >(seq_num - start_seq_num);
+        if (auto b = read_tail_cache(seq_num); b) {
+            ctx->bufs[pos] = std::move(*b);
+            continue;
+        }
+        const logdev_key ld_key = m_records.at(seq_num).m_dev_key;
+        if (!ld_key.is_valid()) {
+            THIS_LOGSTORE_LOG(ERROR, "ld_key not valid {}", seq_num);
+            throw std::out_of_range("key not valid");
+        }
+        ctx->groups[ld_key.dev_offset].emplace_back(pos, ld_key.idx);
+    }
+    if (ctx->groups.empty()) { return folly::makeFuture(std::move(ctx->bufs)); }
+
+    const auto start_time = Clock::now();
+    COUNTER_INCREMENT(m_metrics, logstore_read_count, ctx->groups.size());
+    std::vector< folly::Future< folly::Unit > > futs;
+    futs.reserve(ctx->groups.size());
+    for (auto const& [dev_offset, recs] : ctx->groups) {
+        futs.emplace_back(m_logdev->read_group_async(dev_offset).thenValue([ctx, &recs](log_buffer group_buf) {
+            for (auto const& [pos, idx] : recs) {
+                ctx->bufs[pos] = LogDev::record_in_group(group_buf, idx);
+            }
+        }));
+    }
+    return folly::collectAllUnsafe(futs).thenValue(
+        [this, ctx, start_time](std::vector< folly::Try< folly::Unit > > results) {
+            HISTOGRAM_OBSERVE(m_metrics, logstore_read_latency, get_elapsed_time_us(start_time));
+            for (auto& r : results) {
+                r.throwUnlessValue();
+            }
+            return std::move(ctx->bufs);
+        });
+}
 #if 0
 void HomeLogStore::read_async(logstore_req* req, const log_found_cb_t& cb) {
     HS_LOG_ASSERT( ((cb != nullptr) || (m_comp_cb != nullptr)),
@@ -184,7 +288,9 @@ void HomeLogStore::on_write_completion(logstore_req* req, const logdev_key& ld_k
     // Update the maximum lsn we have seen for this batch for this store, it is needed to create truncation barrier
     m_flush_batch_max_lsn = std::max(m_flush_batch_max_lsn, req->seq_num);
     HISTOGRAM_OBSERVE(m_metrics, logstore_append_latency, get_elapsed_time_us(req->start_time));
+    Tracer::record(req->trace_id, "logstore_append", req->start_time, uint64_cast(req->seq_num));
     auto lsn = req->seq_num;
+    if (req->data.cbytes() != nullptr) { cache_tail(lsn, req->data); }
     (req->cb) ? req->cb(req, ld_key) : m_comp_cb(req, ld_key);
 
     if (m_sync_flush_waiter_lsn.load() == lsn) {
@@ -210,13 +316,34 @@ void HomeLogStore::on_log_found(logstore_seq_num_t seq_num, const logdev_key& ld
         THIS_LOGSTORE_LOG(TRACE, "Log lsn={} is already truncated on per device, ignoring", seq_num);
         return;
     }
-    if (m_found_cb != nullptr) m_found_cb(seq_num, buf, nullptr);
+    if (m_found_partition_fn != nullptr) {
+        if (m_found_workers == nullptr) {
+            m_found_workers = std::make_unique< LogPartitionWorkers >(
+                fmt::format("lstore{}", m_store_id), HS_DYNAMIC_CONFIG(logstore.replay_partition_workers),
+                [this](logstore_seq_num_t lsn, log_buffer b) { m_found_cb(lsn, std::move(b), nullptr); });
+        }
+        m_found_workers->dispatch(m_found_partition_fn(seq_num, buf), seq_num, std::move(buf));
+    } else if (m_found_cb != nullptr) {
+        m_found_cb(seq_num, buf, nullptr);
+    }
+}
+
+void HomeLogStore::register_log_found_cb(const log_found_cb_t& cb, const log_partition_fn_t& partition_fn) {
+    m_found_cb = cb;
+    m_found_partition_fn = partition_fn;
+}
+
+void HomeLogStore::drain_log_found_workers() {
+    if (m_found_workers == nullptr) { return; }
+    m_found_workers->drain();
+    m_found_workers.reset();
 }
 
 void HomeLogStore::on_batch_completion(const logdev_key& flush_batch_ld_key) {
     assert(m_flush_batch_max_lsn != std::numeric_limits< logstore_seq_num_t >::min());
 
     // Create a new truncation barrier for this completion key
+    std::unique_lock lg{m_trunc_mtx};
     if (m_truncation_barriers.size() && (m_truncation_barriers.back().seq_num >= m_flush_batch_max_lsn)) {
         m_truncation_barriers.back().ld_key = flush_batch_ld_key;
     } else {
@@ -246,17 +373,14 @@ void HomeLogStore::truncate(logstore_seq_num_t upto_seq_num, bool in_memory_trun
     }
 #endif
 
-    // First try to block the flushing of logdevice and if we are successfully able to do, then
-    auto shared_this = shared_from_this();
-    m_logdev->run_under_flush_lock([shared_this, upto_seq_num]() {
-        shared_this->do_truncate(upto_seq_num);
-        return true;
-    });
+    // Flushes completing in parallel only add barriers beyond what is truncated, so it need not block the flush
+    do_truncate(upto_seq_num);
 }
 
-// NOTE: This method assumes the flush lock is already acquired by the caller
 void HomeLogStore::do_truncate(logstore_seq_num_t upto_seq_num) {
+    std::unique_lock lg{m_trunc_mtx};
     m_records.truncate(upto_seq_num);
+    trim_tail_cache(upto_seq_num, false /* from_tail */);
     m_safe_truncation_boundary.seq_num.store(upto_seq_num, std::memory_order_release);
 
     // Need to update the superblock with meta, we don't persist yet, will be done as part of log dev truncation
@@ -284,23 +408,25 @@ void HomeLogStore::do_truncate(logstore_seq_num_t upto_seq_num) {
     m_truncation_barriers.erase(m_truncation_barriers.begin(), m_truncation_barriers.begin() + ind + 1);
 }
 
-// NOTE: This method assumes the flush lock is already acquired by the caller
-const truncation_info& HomeLogStore::pre_device_truncation() {
+truncation_snapshot HomeLogStore::pre_device_truncation() {
+    std::unique_lock lg{m_trunc_mtx};
     m_safe_truncation_boundary.active_writes_not_part_of_truncation = (m_truncation_barriers.size() > 0);
-    return m_safe_truncation_boundary;
+    return truncation_snapshot{m_safe_truncation_boundary.ld_key,
+                               m_safe_truncation_boundary.seq_num.load(std::memory_order_acquire),
+                               m_safe_truncation_boundary.pending_dev_truncation,
+                               m_safe_truncation_boundary.active_writes_not_part_of_truncation};
 }
 
-// NOTE: This method assumes the flush lock is already acquired by the caller
 void HomeLogStore::post_device_truncation(const logdev_key& trunc_upto_loc) {
+    std::unique_lock lg{m_trunc_mtx};
     if (trunc_upto_loc.idx >= m_safe_truncation_boundary.ld_key.idx) {
-        // This method is expected to be called always with this
         m_safe_truncation_boundary.pending_dev_truncation = false;
         m_safe_truncation_boundary.ld_key = trunc_upto_loc;
         THIS_LOGSTORE_LOG(TRACE, "m_safe_truncation_boundary.ld_key={}", m_safe_truncation_boundary.ld_key);
     } else {
-        HS_REL_ASSERT(0,
-                      "We expect post_device_truncation to be called only for logstores which has min of all "
-                      "truncation boundaries");
+        // Store is truncated further since the snapshot was taken, which is left pending for next device truncation
+        THIS_LOGSTORE_LOG(DEBUG, "Store truncated upto {} while device truncation upto {} was on, still pending",
+                          m_safe_truncation_boundary.ld_key, trunc_upto_loc);
     }
 }
 
@@ -379,8 +505,59 @@ nlohmann::json HomeLogStore::dump_log_store(const log_dump_req& dump_req) {
     return json_dump;
 }
 
+void HomeLogStore::cache_tail(logstore_seq_num_t seq_num, const sisl::io_blob& data) {
+    auto const max_size = HS_DYNAMIC_CONFIG(logstore.tail_cache_size_per_store);
+    if ((max_size == 0) || (data.size() > max_size)) { return; }
+
+    auto arr = hs_utils::make_byte_array(data.size(), false /* is_aligned_needed */, sisl::buftag::logread, 0);
+    std::memcpy(voidptr_cast(arr->bytes()), data.cbytes(), data.size());
+
+    std::unique_lock lg{m_tail_cache_mtx};
+    if (auto it = m_tail_cache.find(seq_num); it != m_tail_cache.end()) {
+        // Rewritten after a rollback
+        m_tail_cache_size -= it->second.size();
+        resource_mgr().dec_mem_usage(mem_consumer_t::log_tail_cache, it->second.size());
+        m_tail_cache.erase(it);
+    }
+    m_tail_cache.emplace(seq_num, log_buffer{arr, 0, data.size()});
+    m_tail_cache_size += data.size();
+    resource_mgr().inc_mem_usage(mem_consumer_t::log_tail_cache, data.size());
+
+    // Tail caches of all the stores together are within their memory quota, the store adding to it gives up its oldest
+    while ((m_tail_cache_size > max_size) ||
+           (!m_tail_cache.empty() && !resource_mgr().can_add_mem(mem_consumer_t::log_tail_cache, 0))) {
+        auto const sz = m_tail_cache.begin()->second.size();
+        m_tail_cache_size -= sz;
+        m_tail_cache.erase(m_tail_cache.begin());
+        resource_mgr().dec_mem_usage(mem_consumer_t::log_tail_cache, sz);
+    }
+}
+
+std::optional< log_buffer > HomeLogStore::read_tail_cache(logstore_seq_num_t seq_num) {
+    std::unique_lock lg{m_tail_cache_mtx};
+    auto const it = m_tail_cache.find(seq_num);
+    if (it == m_tail_cache.end()) { return std::nullopt; }
+    COUNTER_INCREMENT(m_metrics, logstore_tail_cache_hit_count, 1);
+    return it->second;
+}
+
+void HomeLogStore::trim_tail_cache(logstore_seq_num_t seq_num, bool from_tail) {
+    std::unique_lock lg{m_tail_cache_mtx};
+    auto const first = from_tail ? m_tail_cache.upper_bound(seq_num) : m_tail_cache.begin();
+    auto const last = from_tail ? m_tail_cache.end() : m_tail_cache.upper_bound(seq_num);
+    uint64_t trimmed{0};
+    for (auto it = first; it != last; ++it) {
+        trimmed += it->second.size();
+    }
+    m_tail_cache_size -= trimmed;
+    m_tail_cache.erase(first, last);
+    if (trimmed) { resource_mgr().dec_mem_usage(mem_consumer_t::log_tail_cache, trimmed); }
+}
+
 void HomeLogStore::foreach (int64_t start_idx, const std::function< bool(logstore_seq_num_t, log_buffer) >& cb) {
     m_records.foreach_all_completed(start_idx, [&](int64_t cur_idx, homestore::logstore_record& record) -> bool {
+        if (auto b = read_tail_cache(cur_idx); b) { return cb(cur_idx, std::move(*b)); }
+
         // do a sync read
         serialized_log_record header;
         auto log_buf = m_logdev->read(record.m_dev_key, header);
@@ -388,6 +565,17 @@ void HomeLogStore::foreach (int64_t start_idx, const std::function< bool(logstor
     });
 }
 
+void HomeLogStore::foreach_partitioned(int64_t start_idx, const log_partition_fn_t& partition_fn,
+                                       const std::function< void(logstore_seq_num_t, log_buffer) >& cb) {
+    LogPartitionWorkers workers{fmt::format("lstore{}_it", m_store_id),
+                                HS_DYNAMIC_CONFIG(logstore.replay_partition_workers), cb};
+    foreach (start_idx, [&workers, &partition_fn](logstore_seq_num_t seq_num, log_buffer buf) -> bool {
+        workers.dispatch(partition_fn(seq_num, buf), seq_num, std::move(buf));
+        return true;
+    });
+    workers.drain();
+}
+
 logstore_seq_num_t HomeLogStore::get_contiguous_issued_seq_num(logstore_seq_num_t from) const {
     return (logstore_seq_num_t)m_records.active_upto(from + 1);
 }
@@ -451,21 +639,23 @@ uint64_t HomeLogStore::rollback_async(logstore_seq_num_t to_lsn, on_rollback_cb_
     logid_range_t logid_range = std::make_pair(m_records.at(to_lsn + 1).m_dev_key.idx,
                                                m_records.at(from_lsn).m_dev_key.idx); // Get the logid range to rollback
     m_records.rollback(to_lsn); // Rollback all bitset records and from here on, we can't access any lsns beyond to_lsn
+    trim_tail_cache(to_lsn, true /* from_tail */);
+
+    if (HS_DYNAMIC_CONFIG(logstore.rollback_marker_in_log)) {
+        // None of the lsns of this store are in flight, so the barriers can be removed right away. Marker is appended
+        // before this returns, so it is ahead of the subsequent appends in the log stream and doesn't roll them back.
+        remove_rolled_back_barriers(to_lsn);
+        m_logdev->rollback_async(m_store_id, logid_range, [to_lsn, comp_cb = std::move(cb)]() {
+            if (comp_cb) { comp_cb(to_lsn); }
+        });
+        return from_lsn - to_lsn;
+    }
 
     m_logdev->run_under_flush_lock([logid_range, to_lsn, this, comp_cb = std::move(cb)]() {
         iomanager.run_on_forget(logstore_service().truncate_thread(), [logid_range, to_lsn, this, comp_cb]() {
             // Rollback the log_ids in the range, for this log store (which persists this info in its superblk)
             m_logdev->rollback(m_store_id, logid_range);
-
-            // Remove all truncation barriers on rolled back lsns
-            for (auto it = std::rbegin(m_truncation_barriers); it != std::rend(m_truncation_barriers); ++it) {
-                if (it->seq_num > to_lsn) {
-                    m_truncation_barriers.erase(std::next(it).base());
-                } else {
-                    break;
-                }
-            }
-            m_flush_batch_max_lsn = invalid_lsn(); // Reset the flush batch for next batch.
+            remove_rolled_back_barriers(to_lsn);
             if (comp_cb) { comp_cb(to_lsn); }
             m_logdev->unlock_flush();
         });
@@ -475,6 +665,19 @@ uint64_t HomeLogStore::rollback_async(logstore_seq_num_t to_lsn, on_rollback_cb_
     return from_lsn - to_lsn;
 }
 
+void HomeLogStore::remove_rolled_back_barriers(logstore_seq_num_t to_lsn) {
+    // Remove all truncation barriers on rolled back lsns
+    std::unique_lock lg{m_trunc_mtx};
+    for (auto it = std::rbegin(m_truncation_barriers); it != std::rend(m_truncation_barriers); ++it) {
+        if (it->seq_num > to_lsn) {
+            m_truncation_barriers.erase(std::next(it).base());
+        } else {
+            break;
+        }
+    }
+    m_flush_batch_max_lsn = invalid_lsn(); // Reset the flush batch for next batch.
+}
+
 nlohmann::json HomeLogStore::get_status(int verbosity) const {
     nlohmann::json js;
     js["append_mode"] = m_append_mode;
@@ -485,6 +688,7 @@ nlohmann::json HomeLogStore::get_status(int verbosity) const {
     js["truncation_pending_on_device?"] = m_safe_truncation_boundary.pending_dev_truncation;
     js["truncation_parallel_to_writes?"] = m_safe_truncation_boundary.active_writes_not_part_of_truncation;
     js["logstore_records"] = m_records.get_status(verbosity);
+    js["logstore_records_mem_bytes"] = m_records.memory_bytes();
     js["logstore_sb_first_lsn"] = m_logdev->log_dev_meta().store_superblk(m_store_id).m_first_seq_num;
     return js;
 }
@@ -13,8 +13,10 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <iterator>
 #include <string>
+#include <thread>
 
 #include <fmt/format.h>
 #include <iomgr/iomgr.hpp>
@@ -27,6 +29,7 @@
 
 #include "common/homestore_assert.hpp"
 #include "common/homestore_status_mgr.hpp"
+#include "common/thread_affinity.hpp"
 #include "device/journal_vdev.hpp"
 #include "device/physical_dev.hpp"
 #include "log_dev.hpp"
@@ -52,6 +55,13 @@ LogStoreService::LogStoreService() : m_sb{"LogStoreServiceSB"} {
         },
         nullptr, true, std::optional< meta_subtype_vec_t >({logdev_sb_meta_name}));
 
+    meta_service().register_handler(
+        logdev_group_index_sb_meta_name,
+        [this](meta_blk* mblk, sisl::byte_view buf, size_t size) {
+            group_index_super_blk_found(std::move(buf), voidptr_cast(mblk));
+        },
+        nullptr, true, std::optional< meta_subtype_vec_t >({logdev_sb_meta_name}));
+
     meta_service().register_handler(
         "LogStoreServiceSB",
         [this](meta_blk* mblk, sisl::byte_view buf, size_t size) { on_meta_blk_found(std::move(buf), (void*)mblk); },
@@ -61,6 +71,12 @@ LogStoreService::LogStoreService() : m_sb{"LogStoreServiceSB"} {
 void LogStoreService::on_meta_blk_found(const sisl::byte_view& buf, void* meta_cookie) {
     m_sb.load(buf, meta_cookie);
     HS_REL_ASSERT_EQ(m_sb->magic, logstore_service_sb_magic, "Invalid log service metablk, magic mismatch");
+    if (m_sb->version == 0x1) {
+        // Version 1 had no shared logdevs, it is persisted in the new layout upon next update of it
+        auto const last_logdev_id = m_sb->m_last_logdev_id;
+        m_sb.resize(sizeof(logstore_service_super_block));
+        m_sb->m_last_logdev_id = last_logdev_id;
+    }
     HS_REL_ASSERT_EQ(m_sb->version, logstore_service_sb_version, "Invalid version of log service metablk");
 }
 
@@ -113,14 +129,55 @@ void LogStoreService::start(bool format) {
 
     // Create an truncate thread loop which handles truncation which does sync IO
     start_threads();
+    start_shared_flush_timer();
+
+    // Shared logdevs are owned by the service, so they are opened even if none of its log stores are opened yet
+    for (uint32_t i{0}; i < m_sb->m_num_shared_logdevs; ++i) {
+        m_unopened_logdev.erase(m_sb->m_shared_logdevs[i]);
+    }
 
+    if (format) {
+        for (auto& [logdev_id, logdev] : m_id_logdev_map) {
+            logdev->start(format);
+        }
+        return;
+    }
+
+    // Replay the logdevs concurrently, each thread picking the next logdev to replay, so that recovery of a node with
+    // many logdevs is bound by the device and not by the time to replay them one after the other.
+    std::vector< shared< LogDev > > logdevs;
+    logdevs.reserve(m_id_logdev_map.size());
     for (auto& [logdev_id, logdev] : m_id_logdev_map) {
-        logdev->start(format);
+        logdevs.push_back(logdev);
+    }
+    auto const nthreads =
+        std::min(logdevs.size(), size_t{std::max(HS_DYNAMIC_CONFIG(logstore.recovery_parallel_logdevs), 1u)});
+    if (nthreads <= 1) {
+        for (auto& logdev : logdevs) {
+            logdev->start(format);
+        }
+        return;
+    }
+
+    std::atomic< size_t > next{0};
+    std::vector< std::thread > threads;
+    threads.reserve(nthreads);
+    for (size_t i{0}; i < nthreads; ++i) {
+        threads.emplace_back([&logdevs, &next, format]() {
+            for (auto idx = next.fetch_add(1); idx < logdevs.size(); idx = next.fetch_add(1)) {
+                logdevs[idx]->start(format);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
     }
+    HS_LOG(INFO, logstore, "Replayed {} logdevs with {} threads", logdevs.size(), nthreads);
 }
 
 void LogStoreService::stop() {
     // device_truncate(nullptr, true, false);
+    stop_shared_flush_timer();
     for (auto& [id, logdev] : m_id_logdev_map) {
         logdev->stop();
     }
@@ -168,6 +225,12 @@ void LogStoreService::destroy_log_dev(logdev_id_t logdev_id) {
     logdev->destroy();
 
     m_id_logdev_map.erase(it);
+    auto* const shared_end = m_sb->m_shared_logdevs + m_sb->m_num_shared_logdevs;
+    if (auto const sit = std::find(m_sb->m_shared_logdevs, shared_end, logdev_id); sit != shared_end) {
+        std::copy(sit + 1, shared_end, sit);
+        --(m_sb->m_num_shared_logdevs);
+        m_sb.write();
+    }
     COUNTER_DECREMENT(m_metrics, logdevs_count, 1);
     HS_LOG(INFO, logstore, "Removed log_dev={}", logdev_id);
 }
@@ -264,6 +327,20 @@ void LogStoreService::rollback_super_blk_found(const sisl::byte_view& buf, void*
     }
 }
 
+void LogStoreService::group_index_super_blk_found(const sisl::byte_view& buf, void* meta_cookie) {
+    superblk< group_index_superblk > group_index_sb;
+    group_index_sb.load(buf, meta_cookie);
+    {
+        folly::SharedMutexWritePriority::WriteHolder holder(m_logdev_map_mtx);
+        auto id = group_index_sb->logdev_id;
+        HS_LOG(DEBUG, logstore, "Log dev group index superblk found logdev={}", id);
+        const auto it = m_id_logdev_map.find(id);
+        HS_REL_ASSERT((it != m_id_logdev_map.end()),
+                      "found a group_index_super_blk of logdev id {}, but the logdev with id {} doesnt exist", id);
+        it->second->group_index_super_blk_found(buf, meta_cookie);
+    }
+}
+
 std::shared_ptr< HomeLogStore > LogStoreService::create_new_log_store(logdev_id_t logdev_id, bool append_mode) {
     folly::SharedMutexWritePriority::WriteHolder holder(m_logdev_map_mtx);
     COUNTER_INCREMENT(m_metrics, logstores_count, 1);
@@ -272,6 +349,30 @@ std::shared_ptr< HomeLogStore > LogStoreService::create_new_log_store(logdev_id_
     return it->second->create_new_log_store(append_mode);
 }
 
+std::shared_ptr< HomeLogStore > LogStoreService::create_new_shared_log_store(bool append_mode) {
+    folly::SharedMutexWritePriority::WriteHolder holder(m_logdev_map_mtx);
+    shared< LogDev > logdev;
+    auto const pool_size = std::clamp(HS_DYNAMIC_CONFIG(logstore.shared_logdev_pool_size), 1u, max_shared_logdevs);
+    if (m_sb->m_num_shared_logdevs < pool_size) {
+        auto const logdev_id = get_next_logdev_id();
+        logdev = create_new_logdev_internal(logdev_id);
+        logdev->start(true /* format */);
+        m_sb->m_shared_logdevs[m_sb->m_num_shared_logdevs++] = logdev_id;
+        m_sb.write();
+        COUNTER_INCREMENT(m_metrics, logdevs_count, 1);
+        HS_LOG(INFO, logstore, "Created shared log_dev={}, shared logdevs={}", logdev_id, m_sb->m_num_shared_logdevs);
+    } else {
+        for (uint32_t i{0}; i < m_sb->m_num_shared_logdevs; ++i) {
+            auto const it = m_id_logdev_map.find(m_sb->m_shared_logdevs[i]);
+            if (it == m_id_logdev_map.end()) { continue; }
+            if (!logdev || (it->second->num_log_stores() < logdev->num_log_stores())) { logdev = it->second; }
+        }
+        HS_REL_ASSERT(logdev, "None of the shared logdevs is found");
+    }
+    COUNTER_INCREMENT(m_metrics, logstores_count, 1);
+    return logdev->create_new_log_store(append_mode);
+}
+
 folly::Future< shared< HomeLogStore > > LogStoreService::open_log_store(logdev_id_t logdev_id, logstore_id_t store_id,
                                                                         bool append_mode) {
     folly::SharedMutexWritePriority::ReadHolder holder(m_logdev_map_mtx);
@@ -290,6 +391,36 @@ void LogStoreService::remove_log_store(logdev_id_t logdev_id, logstore_id_t stor
     COUNTER_DECREMENT(m_metrics, logstores_count, 1);
 }
 
+std::shared_ptr< StripedLogStore >
+LogStoreService::create_new_striped_log_store(const std::vector< logdev_id_t >& logdev_ids, bool append_mode) {
+    // Stripes are always written with the seq nums striped log store maps to them, so they are not in append mode
+    auto striped = std::make_shared< StripedLogStore >(uint32_cast(logdev_ids.size()), append_mode);
+    for (uint32_t idx{0}; idx < logdev_ids.size(); ++idx) {
+        striped->set_stripe(idx, create_new_log_store(logdev_ids[idx], false /* append_mode */));
+    }
+    return striped;
+}
+
+folly::Future< shared< StripedLogStore > >
+LogStoreService::open_striped_log_store(const std::vector< StripedLogStore::stripe_id_t >& stripe_ids,
+                                        bool append_mode) {
+    auto striped = std::make_shared< StripedLogStore >(uint32_cast(stripe_ids.size()), append_mode);
+    std::vector< folly::Future< folly::Unit > > futs;
+    futs.reserve(stripe_ids.size());
+    for (uint32_t idx{0}; idx < stripe_ids.size(); ++idx) {
+        // Each stripe is installed as soon as it is opened, since its replay could start before others are opened
+        futs.emplace_back(open_log_store(stripe_ids[idx].first, stripe_ids[idx].second, false /* append_mode */)
+                              .thenValue([striped, idx](auto store) { striped->set_stripe(idx, std::move(store)); }));
+    }
+    return folly::collectAllUnsafe(futs).thenValue([striped](auto&&) { return striped; });
+}
+
+void LogStoreService::remove_striped_log_store(const std::vector< StripedLogStore::stripe_id_t >& stripe_ids) {
+    for (auto const& [logdev_id, store_id] : stripe_ids) {
+        remove_log_store(logdev_id, store_id);
+    }
+}
+
 void LogStoreService::device_truncate(const device_truncate_cb_t& cb, bool wait_till_done, bool dry_run) {
     const auto treq = std::make_shared< truncate_req >();
     treq->wait_till_done = wait_till_done;
@@ -297,9 +428,9 @@ void LogStoreService::device_truncate(const device_truncate_cb_t& cb, bool wait_
     treq->cb = cb;
     if (treq->wait_till_done) { treq->trunc_outstanding = m_id_logdev_map.size(); }
 
-    // TODO: make device_truncate_under_lock return future and do collectAllFutures;
+    // TODO: make device_truncate_async return future and do collectAllFutures;
     for (auto& [id, logdev] : m_id_logdev_map) {
-        logdev->device_truncate_under_lock(treq);
+        logdev->device_truncate_async(treq);
     }
 
     if (treq->wait_till_done) {
@@ -314,6 +445,59 @@ void LogStoreService::flush_if_needed() {
     }
 }
 
+std::vector< logdev_id_t > LogStoreService::shared_logdevs() {
+    folly::SharedMutexWritePriority::ReadHolder holder(m_logdev_map_mtx);
+    return std::vector< logdev_id_t >(m_sb->m_shared_logdevs, m_sb->m_shared_logdevs + m_sb->m_num_shared_logdevs);
+}
+
+void LogStoreService::queue_shared_flush(logdev_id_t logdev_id) {
+    std::unique_lock lg{m_shared_flush_mtx};
+    m_shared_flush_queue.push_back(logdev_id);
+}
+
+void LogStoreService::start_shared_flush_timer() {
+    // Currently only tests set the frequency to 0.
+    if (HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) == 0) { return; }
+    if (!HS_DYNAMIC_CONFIG(logstore.shared_flush_timer)) { return; }
+    iomanager.run_on_wait(flush_thread(), [this]() {
+        m_shared_flush_timer_hdl = iomanager.schedule_thread_timer(
+            HS_DYNAMIC_CONFIG(logstore.flush_timer_frequency_us) * 1000, true /* recurring */, nullptr /* cookie */,
+            [this](void*) { on_shared_flush_timer(); });
+    });
+}
+
+void LogStoreService::stop_shared_flush_timer() {
+    if (m_shared_flush_timer_hdl != iomgr::null_timer_handle) {
+        iomanager.run_on_wait(flush_thread(), [this]() {
+            iomanager.cancel_timer(m_shared_flush_timer_hdl, true);
+            m_shared_flush_timer_hdl = iomgr::null_timer_handle;
+        });
+    }
+    std::unique_lock lg{m_shared_flush_mtx};
+    m_shared_flush_queue.clear();
+}
+
+void LogStoreService::on_shared_flush_timer() {
+    // Only the logdevs queued upto now are visited in this tick, in the order they are queued. The ones still pending
+    // after the flush queue themselves again at the end, so that every logdev gets its turn in each tick.
+    std::vector< logdev_id_t > queued;
+    {
+        std::unique_lock lg{m_shared_flush_mtx};
+        queued.swap(m_shared_flush_queue);
+    }
+    if (queued.empty()) { return; }
+    HISTOGRAM_OBSERVE(m_metrics, logdev_shared_flush_queue_len, queued.size());
+
+    for (auto const logdev_id : queued) {
+        shared< LogDev > logdev;
+        {
+            folly::SharedMutexWritePriority::ReadHolder holder(m_logdev_map_mtx);
+            if (auto const it = m_id_logdev_map.find(logdev_id); it != m_id_logdev_map.end()) { logdev = it->second; }
+        }
+        if (logdev) { logdev->on_shared_flush_timer(); }
+    }
+}
+
 void LogStoreService::start_threads() {
     struct Context {
         std::condition_variable cv;
@@ -326,6 +510,7 @@ void LogStoreService::start_threads() {
     iomanager.create_reactor("log_flush_thread", iomgr::TIGHT_LOOP | iomgr::ADAPTIVE_LOOP, 1 /* num_fibers */,
                              [this, ctx](bool is_started) {
                                  if (is_started) {
+                                     pin_thread(hs_thread_role_t::logstore);
                                      m_flush_fiber = iomanager.iofiber_self();
                                      {
                                          std::unique_lock< std::mutex > lk{ctx->mtx};
@@ -339,6 +524,7 @@ void LogStoreService::start_threads() {
     iomanager.create_reactor("logstore_truncater", iomgr::INTERRUPT_LOOP, 2 /* num_fibers */,
                              [this, ctx](bool is_started) {
                                  if (is_started) {
+                                     pin_thread(hs_thread_role_t::logstore);
                                      m_truncate_fiber = iomanager.sync_io_capable_fibers()[0];
                                      {
                                          std::unique_lock< std::mutex > lk{ctx->mtx};
@@ -368,6 +554,79 @@ nlohmann::json LogStoreService::dump_log_store(const log_dump_req& dump_req) {
     return json_dump;
 }
 
+nlohmann::json LogStoreService::dump_journal(logdev_id_t logdev_id, const log_dump_req& dump_req, uint64_t max_groups,
+                                             logid_t from_log_idx) {
+    shared< LogDev > logdev;
+    {
+        folly::SharedMutexWritePriority::ReadHolder holder(m_logdev_map_mtx);
+        if (auto const it = m_id_logdev_map.find(logdev_id); it != m_id_logdev_map.end()) { logdev = it->second; }
+    }
+    nlohmann::json js;
+    if (logdev == nullptr) {
+        js["error"] = fmt::format("logdev {} doesn't exist", logdev_id);
+        return js;
+    }
+
+    auto start_offset = logdev->log_dev_meta().get_start_dev_offset();
+    if (from_log_idx >= 0) {
+        try {
+            start_offset = logdev->group_offset_of(from_log_idx);
+        } catch (const std::system_error&) { start_offset = INVALID_OFFSET; }
+        if (start_offset == INVALID_OFFSET) {
+            js["error"] = fmt::format("log_idx {} is not found in the journal of logdev {}", from_log_idx, logdev_id);
+            return js;
+        }
+    }
+    log_group_scanner scanner{logdev->get_journal_descriptor(), m_logdev_vdev->align_size(),
+                              HS_DYNAMIC_CONFIG(logstore.bulk_read_size), start_offset};
+    auto groups = nlohmann::json::array();
+    std::string scan_end;
+    try {
+        while ((scanner.groups_scanned() < max_groups) && scanner.next()) {
+            auto const* header = scanner.header();
+            nlohmann::json gjs;
+            gjs["dev_offset"] = scanner.dev_offset();
+            gjs["version"] = header->get_version();
+            gjs["start_log_idx"] = header->start_idx();
+            gjs["nrecords"] = header->nrecords();
+            gjs["group_size"] = header->total_size();
+            gjs["compressed"] = header->is_compressed();
+            gjs["crc"] = header->this_group_crc();
+
+            auto records = nlohmann::json::array();
+            for (uint32_t n{0}; n < header->nrecords(); ++n) {
+                auto [rec, data] = scanner.record(n);
+                bool const in_range =
+                    (rec.store_seq_num >= dump_req.start_seq_num) && (rec.store_seq_num <= dump_req.end_seq_num);
+                if (!in_range || (dump_req.log_store && (rec.store_id != dump_req.log_store->get_store_id()))) {
+                    continue;
+                }
+
+                nlohmann::json rjs;
+                rjs["log_idx"] = header->start_idx() + n;
+                rjs["store_id"] = s_cast< logstore_id_t >(rec.store_id);
+                rjs["store_seq_num"] = s_cast< int64_t >(rec.store_seq_num);
+                rjs["size"] = s_cast< uint32_t >(rec.size);
+                rjs["is_inlined"] = rec.get_inlined();
+                if (dump_req.verbosity_level == log_dump_verbosity::CONTENT) {
+                    const std::vector< uint8_t > bv(data.bytes(), data.bytes() + data.size());
+                    rjs["content"] = nlohmann::json::binary_t(bv);
+                }
+                records.emplace_back(std::move(rjs));
+            }
+            gjs["records"] = std::move(records);
+            groups.emplace_back(std::move(gjs));
+        }
+        scan_end = scanner.end_reason().empty() ? "reached max groups" : scanner.end_reason();
+    } catch (const std::system_error& e) { scan_end = fmt::format("read error: {}", e.what()); }
+
+    js["logdev_id"] = logdev_id;
+    js["start_offset"] = start_offset;
+    js["groups"] = std::move(groups);
+    js["scan_end"] = std::move(scan_end);
+    return js;
+}
+
 nlohmann::json LogStoreService::get_status(const int verbosity) const {
     nlohmann::json js;
     for (auto& [id, logdev] : m_id_logdev_map) {
@@ -383,16 +642,26 @@ uint32_t LogStoreService::total_size() const { return m_logdev_vdev->size(); }
 LogStoreServiceMetrics::LogStoreServiceMetrics() : sisl::MetricsGroup("LogStores", "AllLogStores") {
     REGISTER_COUNTER(logdevs_count, "Total number of log devs", sisl::_publish_as::publish_as_gauge);
     REGISTER_COUNTER(logstores_count, "Total number of log stores", sisl::_publish_as::publish_as_gauge);
+    REGISTER_COUNTER(logdev_flush_thread_hops, "Total number of flushes handed off to the dedicated flush thread");
+    REGISTER_COUNTER(logdev_sync_fast_path_flushes, "Total number of sync writes flushed inline with a fua write");
     REGISTER_COUNTER(logstore_append_count, "Total number of append requests to log stores", "logstore_op_count",
                      {"op", "write"});
     REGISTER_COUNTER(logstore_read_count, "Total number of read requests to log stores", "logstore_op_count",
                      {"op", "read"});
+    REGISTER_COUNTER(logstore_tail_cache_hit_count, "Total number of log store reads served from its tail cache");
     REGISTER_HISTOGRAM(logstore_append_latency, "Logstore append latency", "logstore_op_latency", {"op", "write"});
     REGISTER_HISTOGRAM(logstore_read_latency, "Logstore read latency", "logstore_op_latency", {"op", "read"});
     REGISTER_HISTOGRAM(logdev_flush_size_distribution, "Distribution of flush data size",
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_records_distribution, "Distribution of num records to flush",
                        HistogramBucketsType(LinearUpto128Buckets));
+    REGISTER_HISTOGRAM(logdev_flush_inflight_groups, "Distribution of log groups in flight upon issuing a group",
+                       HistogramBucketsType(LinearUpto128Buckets));
+    REGISTER_HISTOGRAM(logdev_shared_flush_queue_len, "Distribution of logdevs visited in a tick of shared flush timer",
+                       HistogramBucketsType(ExponentialOfTwoBuckets));
+    REGISTER_COUNTER(logdev_compressed_groups, "Total number of log groups written compressed");
+    REGISTER_HISTOGRAM(logdev_compress_ratio_percent, "Distribution of compressed size percent of log groups",
+                       HistogramBucketsType(LinearUpto128Buckets));
     REGISTER_HISTOGRAM(logstore_record_size, "Distribution of log record size",
                        HistogramBucketsType(ExponentialOfTwoBuckets));
     REGISTER_HISTOGRAM(logdev_flush_done_msg_time_ns, "Logdev flush completion msg time in ns");
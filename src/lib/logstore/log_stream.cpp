@@ -32,8 +32,15 @@ log_stream_reader::log_stream_reader(off_t device_cursor, JournalVirtualDev* vde
     // We set the journal descriptor seek_cursor here so that
     // sync_next_read reads from the seek_cursor.
     m_vdev_jd->lseek(m_first_group_cursor);
+
+    if (auto const depth = HS_DYNAMIC_CONFIG(logstore.recovery_read_ahead_depth); depth > 0) {
+        m_vdev_jd->start_read_ahead(
+            depth, uint64_cast(sisl::round_up(HS_DYNAMIC_CONFIG(logstore.bulk_read_size), m_read_size_multiple)));
+    }
 }
 
+log_stream_reader::~log_stream_reader() { m_vdev_jd->stop_read_ahead(); }
+
 sisl::byte_view log_stream_reader::next_group(off_t* out_dev_offset) {
     const uint64_t bulk_read_size =
         uint64_cast(sisl::round_up(HS_DYNAMIC_CONFIG(logstore.bulk_read_size), m_read_size_multiple));
@@ -70,6 +77,10 @@ read_again:
         return ret_buf;
     }
 
+    // Groups of earlier versions are still decoded (see log_group_header), but not of any later one
+    HS_REL_ASSERT_LE(header->get_version(), log_group_header::header_version,
+                     "Log header version mismatch {} log_dev={}", *header, m_vdev_jd->logdev_id());
+
     if (header->logdev_id != m_vdev_jd->logdev_id()) {
         LOGINFOMOD(logstore, "Entries found for different logdev {} at pos {}, must have come to end of log_dev={}",
                    header->logdev_id, m_vdev_jd->dev_offset(m_cur_read_bytes), m_vdev_jd->logdev_id());
@@ -131,9 +142,7 @@ read_again:
     HS_DBG_ASSERT_EQ(footer->version, log_group_footer::footer_version, "Log footer version mismatch");
 
     // verify crc with data
-    const crc32_t cur_crc =
-        crc32_ieee(init_crc32, s_cast< const uint8_t* >(m_cur_log_buf.bytes()) + sizeof(log_group_header),
-                   (header->total_size() - sizeof(log_group_header)));
+    const crc32_t cur_crc = header->compute_crc();
     if (cur_crc != header->cur_grp_crc) {
         /* This is a valid entry so crc should match */
         LOGERROR("crc doesn't match {} log_dev={}", m_vdev_jd->dev_offset(m_cur_read_bytes), m_vdev_jd->logdev_id());
@@ -149,7 +158,9 @@ read_again:
     // store cur crc in prev crc
     m_prev_crc = cur_crc;
 
-    ret_buf = m_cur_log_buf;
+    // Compressed group is handed out decompressed, as if it was written that way
+    ret_buf = header->is_compressed() ? sisl::byte_view{LogGroup::decompress(header, m_vdev->align_size())}
+                                      : m_cur_log_buf;
     *out_dev_offset = m_vdev_jd->dev_offset(m_cur_read_bytes);
     m_cur_read_bytes += header->total_size();
     m_cur_log_buf.move_forward(header->total_size());
@@ -186,4 +197,102 @@ sisl::byte_view log_stream_reader::read_next_bytes(uint64_t nbytes, bool& end_of
                 sz_read, nbytes, prev_pos, m_vdev_jd->seeked_pos(), m_vdev_jd->logdev_id());
     return sisl::byte_view{out_buf};
 }
+
+log_group_scanner::log_group_scanner(shared< JournalVirtualDev::Descriptor > vdev_jd, uint32_t align_size,
+                                     uint64_t window_size, off_t from_offset) :
+        m_vdev_jd{std::move(vdev_jd)},
+        m_align_size{align_size},
+        m_window_size{sisl::round_up(std::max(window_size, uint64_cast(align_size)), align_size)},
+        m_window_offset{from_offset},
+        m_cur_offset{from_offset} {}
+
+bool log_group_scanner::next() {
+    if (!m_end_reason.empty()) { return false; }
+    if (m_header != nullptr) {
+        m_cur_offset += m_header->total_size();
+        m_header = nullptr;
+        m_group = log_buffer{};
+    }
+
+    if (!ensure(sizeof(log_group_header), true /* skip_to_next_chunk */)) {
+        return end_scan("reached end of journal");
+    }
+    auto const* header = r_cast< const log_group_header* >(m_window->cbytes() + (m_cur_offset - m_window_offset));
+    if (header->magic_word() != LOG_GROUP_HDR_MAGIC) { return end_scan("no log group header magic"); }
+    if (header->get_version() > log_group_header::header_version) {
+        return end_scan(fmt::format("log group header of unknown version={}", header->get_version()));
+    }
+    if (header->logdev_id != m_vdev_jd->logdev_id()) {
+        return end_scan(fmt::format("log group of another logdev={}", header->logdev_id));
+    }
+    if ((m_prev_crc != 0) && (header->prev_group_crc() != m_prev_crc)) { return end_scan("crc chain is broken"); }
+    if (header->total_size() < header->header_size()) { return end_scan("invalid log group size"); }
+
+    auto const group_size = header->total_size();
+    if (!ensure(group_size, false /* skip_to_next_chunk */)) {
+        return end_scan("log group is cut short by end of chunk");
+    }
+    header = r_cast< const log_group_header* >(m_window->cbytes() + (m_cur_offset - m_window_offset));
+
+    auto const* footer = r_cast< const log_group_footer* >(r_cast< const uint8_t* >(header) + header->footer_offset);
+    if ((header->footer_offset + sizeof(log_group_footer) > group_size) || (footer->magic != LOG_GROUP_FOOTER_MAGIC) ||
+        (footer->start_log_idx != header->start_log_idx)) {
+        return end_scan("log group is not completely written");
+    }
+    if (header->compute_crc() != header->this_group_crc()) { return end_scan("log group crc mismatch"); }
+
+    m_prev_crc = header->this_group_crc();
+    m_header = header;
+    ++m_ngroups;
+    return true;
+}
+
+std::pair< serialized_log_record, log_buffer > log_group_scanner::record(uint32_t n) {
+    HS_REL_ASSERT(m_header != nullptr, "No current log group to read the record from");
+    HS_REL_ASSERT_LT(n, m_header->nrecords(), "Record {} is not in the log group {}", n, *m_header);
+    if (m_group.size() == 0) {
+        m_group = m_header->is_compressed()
+            ? log_buffer{LogGroup::decompress(m_header, m_align_size)}
+            : log_buffer{m_window, uint32_cast(m_cur_offset - m_window_offset), m_header->total_size()};
+    }
+    auto const* rec = r_cast< const log_group_header* >(m_group.bytes())->nth_record(n);
+    return {serialized_log_record{rec->size, rec->offset, rec->get_inlined(), rec->store_seq_num, rec->store_id},
+            LogDev::record_in_group(m_group, m_header->start_idx() + n)};
+}
+
+// Makes sure nbytes from the current group offset are in the window, reading them in from the journal if needed.
+// Groups don't span chunks, so if the chunk doesn't have nbytes left, next group (if skip_to_next_chunk) is at the
+// beginning of next chunk.
+bool log_group_scanner::ensure(uint64_t nbytes, bool skip_to_next_chunk) {
+    while (m_cur_offset + s_cast< off_t >(nbytes) > m_window_offset + s_cast< off_t >(m_window_len)) {
+        auto const read_size = sisl::round_up(std::max(nbytes, m_window_size), m_align_size);
+        // Records handed out earlier are views into the window, don't overwrite it if they are still held
+        if (!m_window || (m_window.use_count() > 1) || (m_window->size() < read_size)) {
+            m_window = hs_utils::make_byte_array(read_size, true, sisl::buftag::logread, m_align_size);
+        }
+
+        off_t next_offset = m_cur_offset;
+        auto const nread = m_vdev_jd->sync_read_at(next_offset, m_window->bytes(), read_size);
+        if (nread < 0) { return false; }
+        m_window_offset = m_cur_offset;
+        m_window_len = uint64_cast(nread);
+        if (m_window_len < nbytes) {
+            // Rest of the chunk is not enough to hold it, so move on to the next chunk
+            if (!skip_to_next_chunk || (next_offset == m_cur_offset)) { return false; }
+            m_cur_offset = next_offset;
+            m_window_offset = next_offset;
+            m_window_len = 0;
+        }
+    }
+    return true;
+}
+
+bool log_group_scanner::end_scan(std::string reason) {
+    LOGINFOMOD(logstore, "Log group scan of log_dev={} ended at offset={} after {} groups: {}",
+               m_vdev_jd->logdev_id(), m_cur_offset, m_ngroups, reason);
+    m_end_reason = std::move(reason);
+    m_header = nullptr;
+    m_group = log_buffer{};
+    return false;
+}
 } // namespace homestore
@@ -0,0 +1,183 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <vector>
+
+#include <homestore/logstore/striped_log_store.hpp>
+#include "common/homestore_assert.hpp"
+#include "log_dev.hpp"
+
+namespace homestore {
+SISL_LOGGING_DECL(logstore)
+
+StripedLogStore::StripedLogStore(uint32_t nstripes, bool append_mode) :
+        m_nstripes{nstripes}, m_append_mode{append_mode}, m_stripes(nstripes), m_stripe_last_replayed(nstripes, -1) {
+    HS_REL_ASSERT_GT(nstripes, 0, "Striped log store needs at least one stripe");
+}
+
+void StripedLogStore::set_stripe(uint32_t idx, shared< HomeLogStore > store) {
+    store->register_log_found_cb([this, idx](logstore_seq_num_t stripe_seq_num, log_buffer buf, void*) {
+        on_stripe_log_found(idx, stripe_seq_num, std::move(buf));
+    });
+    store->register_log_replay_done_cb([this, idx](shared< HomeLogStore >, logstore_seq_num_t last_stripe_seq_num) {
+        on_stripe_replay_done(idx, last_stripe_seq_num);
+    });
+    m_stripes[idx] = std::move(store);
+}
+
+void StripedLogStore::write_async(logstore_seq_num_t seq_num, const sisl::io_blob& b, void* cookie,
+                                  const log_write_comp_cb_t& cb, bool flush_wait) {
+    m_stripes[stripe_of(seq_num)]->write_async(
+        to_stripe_seq_num(seq_num), b, cookie,
+        [seq_num, cb](logstore_seq_num_t, sisl::io_blob& b, logdev_key ld_key, void* cookie) {
+            if (cb) { cb(seq_num, b, ld_key, cookie); }
+        },
+        flush_wait);
+}
+
+logstore_seq_num_t StripedLogStore::append_async(const sisl::io_blob& b, void* cookie,
+                                                 const log_write_comp_cb_t& completion_cb) {
+    HS_DBG_ASSERT_EQ(m_append_mode, true, "append_async can be called only on append only mode");
+    const auto seq_num = m_seq_num.fetch_add(1, std::memory_order_acq_rel);
+    write_async(seq_num, b, cookie, completion_cb);
+    return seq_num;
+}
+
+log_buffer StripedLogStore::read_sync(logstore_seq_num_t seq_num) {
+    return m_stripes[stripe_of(seq_num)]->read_sync(to_stripe_seq_num(seq_num));
+}
+
+void StripedLogStore::flush_sync(logstore_seq_num_t upto_seq_num) {
+    for (uint32_t idx{0}; idx < m_nstripes; ++idx) {
+        if (upto_seq_num == invalid_lsn()) {
+            m_stripes[idx]->flush_sync();
+        } else if (auto const upto = stripe_seq_num_upto(idx, upto_seq_num); upto >= 0) {
+            m_stripes[idx]->flush_sync(upto);
+        }
+    }
+}
+
+void StripedLogStore::truncate(logstore_seq_num_t upto_seq_num, bool in_memory_truncate_only) {
+    for (uint32_t idx{0}; idx < m_nstripes; ++idx) {
+        if (auto const upto = stripe_seq_num_upto(idx, upto_seq_num); upto >= 0) {
+            m_stripes[idx]->truncate(upto, in_memory_truncate_only);
+        }
+    }
+}
+
+// Seq num n is covered if its stripe covers (n / K), so the first one not covered is the smallest of the first ones
+// not covered by each stripe.
+logstore_seq_num_t
+StripedLogStore::merge_contiguous(const std::function< logstore_seq_num_t(uint32_t) >& stripe_upto) const {
+    auto first_missing = std::numeric_limits< logstore_seq_num_t >::max();
+    for (uint32_t idx{0}; idx < m_nstripes; ++idx) {
+        first_missing = std::min(first_missing, to_seq_num(idx, stripe_upto(idx) + 1));
+    }
+    return first_missing - 1;
+}
+
+logstore_seq_num_t StripedLogStore::get_contiguous_completed_seq_num(logstore_seq_num_t from) const {
+    return merge_contiguous([this, from](uint32_t idx) {
+        return m_stripes[idx]->get_contiguous_completed_seq_num(stripe_seq_num_upto(idx, from));
+    });
+}
+
+logstore_seq_num_t StripedLogStore::get_contiguous_issued_seq_num(logstore_seq_num_t from) const {
+    return merge_contiguous([this, from](uint32_t idx) {
+        return m_stripes[idx]->get_contiguous_issued_seq_num(stripe_seq_num_upto(idx, from));
+    });
+}
+
+logstore_seq_num_t StripedLogStore::truncated_upto() const {
+    return merge_contiguous([this](uint32_t idx) { return m_stripes[idx]->truncated_upto(); });
+}
+
+std::vector< StripedLogStore::stripe_id_t > StripedLogStore::stripe_ids() const {
+    std::vector< stripe_id_t > ids;
+    ids.reserve(m_nstripes);
+    for (auto const& s : m_stripes) {
+        ids.emplace_back(s->get_logdev()->get_id(), s->get_store_id());
+    }
+    return ids;
+}
+
+nlohmann::json StripedLogStore::get_status(int verbosity) const {
+    nlohmann::json js;
+    js["num_stripes"] = m_nstripes;
+    js["append_mode"] = m_append_mode;
+    js["seq_num"] = seq_num();
+    js["truncated_upto"] = truncated_upto();
+    auto stripes = nlohmann::json::array();
+    for (auto const& s : m_stripes) {
+        stripes.push_back(s->get_status(verbosity));
+    }
+    js["stripes"] = std::move(stripes);
+    return js;
+}
+
+void StripedLogStore::on_stripe_log_found(uint32_t idx, logstore_seq_num_t stripe_seq_num, log_buffer buf) {
+    auto const seq_num = to_seq_num(idx, stripe_seq_num);
+    std::unique_lock lg{m_replay_mtx};
+    m_replayed.insert_or_assign(seq_num, std::move(buf));
+}
+
+void StripedLogStore::on_stripe_replay_done(uint32_t idx, logstore_seq_num_t last_stripe_seq_num) {
+    std::map< logstore_seq_num_t, log_buffer > replayed;
+    {
+        std::unique_lock lg{m_replay_mtx};
+        m_stripe_last_replayed[idx] = last_stripe_seq_num;
+        if (++m_nstripes_replayed < m_nstripes) { return; }
+        replayed.swap(m_replayed);
+    }
+
+    // Stripes are flushed independently, so a crash could leave a seq num on one stripe while an earlier one never
+    // made it to its stripe. Replay stops at the first seq num missing and the ones after it are rolled back from their
+    // stripes, as they were never contiguous.
+    std::vector< logstore_seq_num_t > truncated(m_nstripes);
+    for (uint32_t i{0}; i < m_nstripes; ++i) {
+        truncated[i] = m_stripes[i]->truncated_upto();
+    }
+    auto const is_present = [&](logstore_seq_num_t seq_num) {
+        return (to_stripe_seq_num(seq_num) <= truncated[stripe_of(seq_num)]) || replayed.contains(seq_num);
+    };
+    auto last_seq_num = truncated_upto();
+    while (is_present(last_seq_num + 1)) {
+        ++last_seq_num;
+    }
+
+    if (auto const it = replayed.upper_bound(last_seq_num); it != replayed.end()) {
+        LOGWARNMOD(logstore, "Striped log store replay found lsn={} missing, dropping {} records after it upto lsn={}",
+                   last_seq_num + 1, std::distance(it, replayed.end()), replayed.rbegin()->first);
+        replayed.erase(it, replayed.end());
+        for (uint32_t i{0}; i < m_nstripes; ++i) {
+            auto const upto = std::max(stripe_seq_num_upto(i, last_seq_num), truncated[i]);
+            if (m_stripe_last_replayed[i] > upto) { m_stripes[i]->rollback_async(upto, nullptr); }
+        }
+    }
+
+    LOGINFOMOD(logstore, "Striped log store replay of {} stripes done, found {} records upto lsn={}", m_nstripes,
+               replayed.size(), last_seq_num);
+    atomic_update_max(m_seq_num, last_seq_num + 1, std::memory_order_acq_rel);
+    if (m_found_cb) {
+        for (auto& [seq_num, buf] : replayed) {
+            m_found_cb(seq_num, buf, nullptr);
+        }
+    }
+    if (m_replay_done_cb) { m_replay_done_cb(last_seq_num); }
+}
+} // namespace homestore
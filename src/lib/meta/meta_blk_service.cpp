@@ -13,7 +13,9 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <cstdint>
 #include <cstring>
 #include <iterator>
@@ -21,6 +23,7 @@
 #include <memory>
 #include <mutex>
 #include <system_error>
+#include <utility>
 
 #include <sisl/fds/compress.hpp>
 #include <sisl/fds/utils.hpp>
@@ -33,11 +36,13 @@
 #include "common/homestore_flip.hpp"
 #include "common/homestore_utils.hpp"
 #include "common/crash_simulator.hpp"
+#include "common/thread_affinity.hpp"
 #include "device/device.h"
 #include "device/virtual_dev.hpp"
 #include "device/physical_dev.hpp"
 #include "blkalloc/blk_allocator.h"
 #include "meta_sb.hpp"
+#include "meta_log_store.hpp"
 
 SISL_LOGGING_DECL(metablk)
 
@@ -47,6 +52,8 @@ MetaBlkService& meta_service() { return hs()->meta_service(); }
 
 MetaBlkService::MetaBlkService(const char* name) : m_metrics{name} { m_last_mblk_id = std::make_unique< BlkId >(); }
 
+MetaBlkService::~MetaBlkService() = default;
+
 void MetaBlkService::create_vdev(uint64_t size, HSDevType devType, uint32_t num_chunks) {
     const auto phys_page_size = hs()->device_mgr()->optimal_page_size(devType);
 
@@ -101,12 +108,66 @@ void MetaBlkService::start(bool need_format) {
         load_ssb();
         scan_meta_blks();
     }
+    load_meta_log();
     recover();
+    start_sb_write_thread();
+}
+
+void MetaBlkService::start_sb_write_thread() {
+    struct Context {
+        std::condition_variable cv;
+        std::mutex mtx;
+        bool started{false};
+    };
+    auto ctx = std::make_shared< Context >();
+
+    m_sb_write_fiber = nullptr;
+    iomanager.create_reactor("meta_sb_writer", iomgr::INTERRUPT_LOOP, 2 /* num_fibers */, [this, ctx](bool is_started) {
+        if (is_started) {
+            pin_thread(hs_thread_role_t::meta);
+            m_sb_write_fiber = iomanager.sync_io_capable_fibers()[0];
+            {
+                std::unique_lock< std::mutex > lk{ctx->mtx};
+                ctx->started = true;
+            }
+            ctx->cv.notify_one();
+        }
+    });
+    {
+        std::unique_lock< std::mutex > lk{ctx->mtx};
+        ctx->cv.wait(lk, [ctx] { return ctx->started; });
+    }
+}
+
+void MetaBlkService::load_meta_log() {
+    register_handler(std::string{MetaLogStore::anchor_type}, nullptr, nullptr);
+
+    std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+    m_log = std::make_unique< MetaLogStore >(*this);
+    auto const& anchor_bids = m_sub_info[std::string{MetaLogStore::anchor_type}].meta_bids;
+    HS_REL_ASSERT_LE(anchor_bids.size(), 1u, "more than one meta log anchor found");
+    m_log->load(anchor_bids.empty() ? nullptr : m_meta_blks[*anchor_bids.begin()]);
+}
+
+void MetaBlkService::schedule_meta_log_compaction() {
+    if (!m_sb_write_fiber || !m_log->needs_compaction() || std::exchange(m_log_compaction_scheduled, true)) { return; }
+    iomanager.run_on_forget(m_sb_write_fiber, [this]() {
+        std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+        m_log_compaction_scheduled = false;
+        if (m_log) { m_log->compact(); }
+    });
 }
 
 void MetaBlkService::stop() {
+    // Whatever is requested by now is written before the meta blks go away
+    write_pending_sbs();
     {
         std::lock_guard< decltype(m_shutdown_mtx) > lg_shutdown{m_shutdown_mtx};
+        {
+            // Its anchor is a meta blk, which is freed next
+            std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+            m_log.reset();
+        }
         cache_clear();
 
         {
@@ -131,6 +192,11 @@ void MetaBlkService::cache_clear() {
 
     m_meta_blks.clear();
     m_ovf_blk_hdrs.clear();
+
+    std::unique_lock clg{m_ctx_cache_mtx};
+    m_ctx_cache.clear();
+    m_ctx_cache_lru.clear();
+    m_ctx_cache_size = 0;
 }
 
 void MetaBlkService::read(const BlkId& bid, uint8_t* dest, size_t sz) const {
@@ -230,13 +296,29 @@ bool MetaBlkService::scan_and_load_meta_blks(meta_blk_map_t& meta_blks, ovf_hdr_
     auto prev_meta_bid = m_ssb->bid;
     auto self_recover{false};
 
+    // Meta blks and their overflow hdrs are mostly allocated one after the other, read the blks following the one
+    // needed along with it (within its chunk) and serve the next ones from it, if they are among them
+    auto const chunks = m_sb_vdev->get_chunks();
+    auto const read_ahead_blks = std::max(HS_DYNAMIC_CONFIG(metablk.scan_read_ahead_blks), 1u);
+    auto* ra_buf = hs_utils::iobuf_alloc(read_ahead_blks * block_size(), sisl::buftag::metablk, align_size());
+    BlkId ra_bid;
+    auto read_blk = [&](BlkId const& b, uint8_t* dest) {
+        if (!ra_bid.is_valid() || (ra_bid.chunk_num() != b.chunk_num()) || (b.blk_num() < ra_bid.blk_num()) ||
+            (b.blk_num() >= ra_bid.blk_num() + ra_bid.blk_count())) {
+            auto const it = chunks.find(b.chunk_num());
+            auto const chunk_blks = (it == chunks.end()) ? (b.blk_num() + 1) : (it->second->size() / block_size());
+            auto const nblks = std::min(uint64_cast(read_ahead_blks), std::max(chunk_blks - b.blk_num(), uint64_t{1}));
+            ra_bid = BlkId{b.blk_num(), s_cast< blk_count_t >(nblks), b.chunk_num()};
+            read(ra_bid, ra_buf, nblks * block_size());
+        }
+        std::memcpy(dest, ra_buf + (b.blk_num() - ra_bid.blk_num()) * block_size(), block_size());
+    };
+
     while (bid.is_valid()) {
         *last_mblk_id = bid;
 
-        // TODO: add a new API in blkstore read to by pass cache;
-        // e.g. take caller's read buf to avoid this extra memory copy;
         auto* mblk = r_cast< meta_blk* >(hs_utils::iobuf_alloc(block_size(), sisl::buftag::metablk, align_size()));
-        read(bid, uintptr_cast(mblk), block_size());
+        read_blk(bid, uintptr_cast(mblk));
 
         // add meta blk to cache;
         meta_blks[bid.to_integer()] = mblk;
@@ -295,7 +377,7 @@ bool MetaBlkService::scan_and_load_meta_blks(meta_blk_map_t& meta_blks, ovf_hdr_
             // ovf blk header occupies whole blk;
             auto* ovf_hdr =
                 r_cast< meta_blk_ovf_hdr* >(hs_utils::iobuf_alloc(block_size(), sisl::buftag::metablk, align_size()));
-            read(obid, uintptr_cast(ovf_hdr), block_size());
+            read_blk(obid, uintptr_cast(ovf_hdr));
 
             // verify self bid
             HS_REL_ASSERT_EQ(ovf_hdr->h.bid.to_integer(), obid.to_integer(), "Corrupted self-bid: {}/{}",
@@ -351,6 +433,7 @@ bool MetaBlkService::scan_and_load_meta_blks(meta_blk_map_t& meta_blks, ovf_hdr_
         bid = mblk->hdr.h.next_bid;
     }
 
+    hs_utils::iobuf_free(ra_buf, sisl::buftag::metablk);
     return self_recover;
 }
 
@@ -371,7 +454,7 @@ void MetaBlkService::deregister_handler(meta_sub_type type) {
 
 void MetaBlkService::register_handler(meta_sub_type type, const meta_blk_found_cb_t& cb,
                                       const meta_blk_recover_comp_cb_t& comp_cb, bool do_crc,
-                                      std::optional< meta_subtype_vec_t > deps) {
+                                      std::optional< meta_subtype_vec_t > deps, bool log_structured) {
     std::lock_guard< decltype(m_meta_mtx) > lk(m_meta_mtx);
     HS_REL_ASSERT_LT(type.length(), MAX_SUBSYS_TYPE_LEN, "type len: {} should not exceed len: {}", type.length(),
                      MAX_SUBSYS_TYPE_LEN);
@@ -388,6 +471,7 @@ void MetaBlkService::register_handler(meta_sub_type type, const meta_blk_found_c
     m_sub_info[type].cb = cb;
     m_sub_info[type].comp_cb = comp_cb;
     m_sub_info[type].do_crc = do_crc ? 1 : 0;
+    m_sub_info[type].log_structured = log_structured;
     if (deps.has_value()) {
         m_sub_info[type].has_deps = true;
         for (auto const& x : deps.value()) {
@@ -398,13 +482,26 @@ void MetaBlkService::register_handler(meta_sub_type type, const meta_blk_found_c
 }
 
 void MetaBlkService::add_sub_sb(meta_sub_type type, const uint8_t* context_data, uint64_t sz, void*& cookie) {
+    write_pending_sbs();
     std::lock_guard< decltype(m_meta_mtx) > lg(m_meta_mtx);
+    add_sub_sb_internal(type, context_data, sz, cookie);
+}
+
+void MetaBlkService::add_sub_sb_internal(meta_sub_type type, const uint8_t* context_data, uint64_t sz,
+                                         void*& cookie) {
     HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
     HS_REL_ASSERT_LT(type.length(), MAX_SUBSYS_TYPE_LEN, "type len: {} should not exceed len: {}", type.length(),
                      MAX_SUBSYS_TYPE_LEN);
     // not allowing add sub sb before registration
     HS_REL_ASSERT(m_sub_info.find(type) != m_sub_info.end(), "[type={}] not registered yet!", type);
 
+    if (m_sub_info[type].log_structured) {
+        cookie = voidptr_cast(m_log->add(type, context_data, sz));
+        HS_LOG(DEBUG, metablk, "[type={}], added to meta log, sz: {}", type, sz);
+        schedule_meta_log_compaction();
+        return;
+    }
+
     BlkId meta_bid;
     alloc_meta_blk(meta_bid);
 
@@ -659,8 +756,12 @@ void MetaBlkService::write_meta_blk_ovf(BlkId& out_obid, const uint8_t* context_
 
 void MetaBlkService::write_meta_blk_internal(meta_blk* mblk, const uint8_t* context_data, uint64_t sz) {
     auto data_sz = sz;
+    const auto it_info = m_sub_info.find(mblk->hdr.h.type);
+    auto* info = (it_info == m_sub_info.end()) ? nullptr : &(it_info->second);
+
     // start compression
-    if (HS_DYNAMIC_CONFIG(metablk.compress_feature_on) && (sz >= min_compress_size())) {
+    if (HS_DYNAMIC_CONFIG(metablk.compress_feature_on) && (sz >= min_compress_size()) &&
+        !skip_compress(info, context_data, sz)) {
         // TO DO: Might need to differentiate based on data or fast type
         const uint64_t max_dst_size = sisl::round_up(sisl::Compress::max_compress_len(sz), align_size());
         if (max_dst_size <= max_compress_memory_size()) {
@@ -679,7 +780,9 @@ void MetaBlkService::write_meta_blk_internal(meta_blk* mblk, const uint8_t* cont
                 HS_REL_ASSERT(false, "failed to compress");
             }
             const uint32_t ratio_percent = uint32_cast(uint64_cast(compressed_size) * 100 / sz);
-            if (ratio_percent <= HS_DYNAMIC_CONFIG(metablk.compress_ratio_limit)) {
+            const bool within_limit = (ratio_percent <= HS_DYNAMIC_CONFIG(metablk.compress_ratio_limit));
+            track_compress_ratio(info, ratio_percent, within_limit);
+            if (within_limit) {
                 COUNTER_INCREMENT(m_metrics, compress_success_cnt, 1);
                 HISTOGRAM_OBSERVE(m_metrics, compress_ratio_percent, ratio_percent);
                 mblk->hdr.h.compressed = 1;
@@ -745,6 +848,12 @@ void MetaBlkService::write_meta_blk_internal(meta_blk* mblk, const uint8_t* cont
     // write meta blk;
     write_meta_blk_to_disk(mblk);
 
+    if (mblk->hdr.h.ovf_bid.is_valid()) {
+        cache_context(mblk, context_data, data_sz);
+    } else {
+        uncache_context(mblk->hdr.h.bid);
+    }
+
 #ifdef _PRERELEASE
     if (hs()->crash_simulator().crash_if_flip_set("write_sb_abort")) { return; }
 #endif
@@ -795,8 +904,18 @@ void MetaBlkService::_cookie_sanity_check(const void* cookie) const {
 // 3. free old ovf_bid if there is any
 //
 void MetaBlkService::update_sub_sb(const uint8_t* context_data, uint64_t sz, void* cookie) {
+    write_pending_sbs(); // Pending updates of this sb are older, they shouldn't overwrite this one later
     std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+    update_sub_sb_internal(context_data, sz, cookie);
+}
+
+void MetaBlkService::update_sub_sb_internal(const uint8_t* context_data, uint64_t sz, void* cookie) {
     HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
+    if (MetaLogStore::is_log_entry(cookie)) {
+        m_log->update(s_cast< meta_log_entry* >(cookie), context_data, sz);
+        schedule_meta_log_compaction();
+        return;
+    }
 
 #ifdef _PRERELEASE
     _cookie_sanity_check(cookie);
@@ -861,12 +980,102 @@ void MetaBlkService::update_sub_sb(const uint8_t* context_data, uint64_t sz, voi
 #endif
 }
 
+folly::Future< void* > MetaBlkService::async_add_sub_sb(meta_sub_type type, const uint8_t* context_data, uint64_t sz) {
+    return queue_sb_write(std::move(type), nullptr, context_data, sz);
+}
+
+folly::Future< bool > MetaBlkService::async_update_sub_sb(const uint8_t* context_data, uint64_t sz, void* cookie) {
+    HS_DBG_ASSERT(cookie != nullptr, "async update of a sub sb which is not added");
+    return queue_sb_write(meta_sub_type{}, cookie, context_data, sz).thenValue([](void*) { return true; });
+}
+
+folly::Future< void* > MetaBlkService::queue_sb_write(meta_sub_type type, void* cookie, const uint8_t* context_data,
+                                                      uint64_t sz) {
+    HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
+    COUNTER_INCREMENT(m_metrics, async_sb_writes_cnt, 1);
+
+    // Copy is aligned, so that the write of an overflow chain doesn't need another one
+    sisl::io_blob_safe buf{uint32_cast(sz), align_size(), sisl::buftag::metablk};
+    std::memcpy(buf.bytes(), context_data, sz);
+
+    folly::Promise< void* > promise;
+    auto f = promise.getFuture();
+    bool schedule{false};
+    {
+        std::unique_lock lg{m_pending_mtx};
+        auto it = (cookie == nullptr)
+            ? m_pending_writes.end()
+            : std::find_if(m_pending_writes.begin(), m_pending_writes.end(),
+                           [cookie](pending_sb_write const& w) { return w.cookie == cookie; });
+        if (it != m_pending_writes.end()) {
+            // Only the latest content of the sb matters, write it once for all of them
+            it->buf = std::move(buf);
+            it->promises.emplace_back(std::move(promise));
+            COUNTER_INCREMENT(m_metrics, async_sb_merged_cnt, 1);
+        } else {
+            auto& w = m_pending_writes.emplace_back(pending_sb_write{std::move(type), cookie, std::move(buf), {}});
+            w.promises.emplace_back(std::move(promise));
+        }
+        schedule = !std::exchange(m_pending_writes_scheduled, true);
+    }
+
+    if (schedule) {
+        if (m_sb_write_fiber) {
+            iomanager.run_on_forget(m_sb_write_fiber, [this]() { write_pending_sbs(); });
+        } else {
+            write_pending_sbs();
+        }
+    }
+    return f;
+}
+
+void MetaBlkService::write_pending_sbs() {
+    {
+        std::unique_lock plg{m_pending_mtx};
+        if (m_pending_writes.empty()) { return; }
+    }
+
+    std::vector< pending_sb_write > writes;
+    {
+        std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+        {
+            std::unique_lock plg{m_pending_mtx};
+            if (m_pending_writes.empty()) { return; }
+            writes.swap(m_pending_writes);
+            m_pending_writes_scheduled = false;
+        }
+
+        // All of them are written holding the meta lock throughout, instead of acquiring it for each sb
+        HISTOGRAM_OBSERVE(m_metrics, async_sb_batch_size, writes.size());
+        for (auto& w : writes) {
+            if (w.cookie == nullptr) {
+                add_sub_sb_internal(w.type, w.buf.cbytes(), w.buf.size(), w.cookie);
+            } else {
+                update_sub_sb_internal(w.buf.cbytes(), w.buf.size(), w.cookie);
+            }
+        }
+    }
+
+    // Outside the lock, continuations of the callers could call back into meta service
+    for (auto& w : writes) {
+        for (auto& p : w.promises) {
+            p.setValue(w.cookie);
+        }
+    }
+}
+
 std::error_condition MetaBlkService::remove_sub_sb(void* cookie) {
+    write_pending_sbs();
     std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+    HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
+    if (MetaLogStore::is_log_entry(cookie)) {
+        m_log->remove(s_cast< meta_log_entry* >(cookie));
+        schedule_meta_log_compaction();
+        return no_error;
+    }
 #ifdef _PRERELEASE
     _cookie_sanity_check(cookie);
 #endif
-    HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
     meta_blk* rm_blk = s_cast< meta_blk* >(cookie);
     const BlkId rm_bid = rm_blk->hdr.h.bid;
     const auto type = rm_blk->hdr.h.type;
@@ -995,6 +1204,7 @@ void MetaBlkService::free_ovf_blk_chain(const BlkId& obid) {
 
 void MetaBlkService::free_meta_blk(meta_blk* mblk) {
     HS_LOG(DEBUG, metablk, "[type={}], freeing blk id: {}", mblk->hdr.h.type, mblk->hdr.h.bid.to_string());
+    uncache_context(mblk->hdr.h.bid);
 
     m_sb_vdev->free_blk(mblk->hdr.h.bid);
 
@@ -1054,6 +1264,8 @@ sisl::byte_array MetaBlkService::read_sub_sb_internal(const meta_blk* mblk) cons
         // read through the ovf blk chain to get the buffer;
         // all the context data was stored in ovf blk chain, nothing in meta blk context data portion;
         //
+        if (auto cached = cached_context_of(mblk); cached) { return cached; }
+
         // TO DO: Might need to address alignment based on data or fast type
         buf =
             hs_utils::make_byte_array(mblk->hdr.h.context_sz, true /* aligned */, sisl::buftag::metablk, align_size());
@@ -1099,10 +1311,102 @@ sisl::byte_array MetaBlkService::read_sub_sb_internal(const meta_blk* mblk) cons
 
         HS_REL_ASSERT_EQ(read_offset, total_sz, "[type={}], incorrect data read from disk: {}, total_sz: {}",
                          mblk->hdr.h.type, read_offset, total_sz);
+        cache_context(mblk, buf->cbytes(), total_sz);
     }
     return buf;
 }
 
+sisl::byte_array MetaBlkService::cached_context_of(const meta_blk* mblk) const {
+    std::unique_lock lg{m_ctx_cache_mtx};
+    const auto it = m_ctx_cache.find(mblk->hdr.h.bid.to_integer());
+    if ((it == m_ctx_cache.end()) || (it->second.gen_cnt != mblk->hdr.h.gen_cnt) ||
+        (it->second.buf->size() != mblk->hdr.h.context_sz)) {
+        COUNTER_INCREMENT(m_metrics, context_cache_misses, 1);
+        return nullptr;
+    }
+    m_ctx_cache_lru.splice(m_ctx_cache_lru.begin(), m_ctx_cache_lru, it->second.lru_it);
+    COUNTER_INCREMENT(m_metrics, context_cache_hits, 1);
+
+    auto buf =
+        hs_utils::make_byte_array(mblk->hdr.h.context_sz, true /* aligned */, sisl::buftag::metablk, align_size());
+    std::memcpy(buf->bytes(), it->second.buf->cbytes(), mblk->hdr.h.context_sz);
+    return buf;
+}
+
+void MetaBlkService::cache_context(const meta_blk* mblk, const uint8_t* data, uint64_t sz) const {
+    const uint64_t limit = HS_DYNAMIC_CONFIG(metablk.context_cache_size_mb) * uint64_cast(1024) * 1024;
+    uncache_context(mblk->hdr.h.bid);
+    if (sz > limit / 4) { return; }
+
+    auto buf = hs_utils::make_byte_array(sz, false /* aligned */, sisl::buftag::metablk, align_size());
+    std::memcpy(buf->bytes(), data, sz);
+
+    std::unique_lock lg{m_ctx_cache_mtx};
+    const auto id = mblk->hdr.h.bid.to_integer();
+    m_ctx_cache_lru.push_front(id);
+    m_ctx_cache.emplace(id, cached_context{mblk->hdr.h.gen_cnt, std::move(buf), m_ctx_cache_lru.begin()});
+    m_ctx_cache_size += sz;
+    while (m_ctx_cache_size > limit) {
+        const auto it = m_ctx_cache.find(m_ctx_cache_lru.back());
+        m_ctx_cache_size -= it->second.buf->size();
+        m_ctx_cache.erase(it);
+        m_ctx_cache_lru.pop_back();
+    }
+}
+
+void MetaBlkService::uncache_context(const BlkId& bid) const {
+    std::unique_lock lg{m_ctx_cache_mtx};
+    const auto it = m_ctx_cache.find(bid.to_integer());
+    if (it == m_ctx_cache.end()) { return; }
+    m_ctx_cache_size -= it->second.buf->size();
+    m_ctx_cache_lru.erase(it->second.lru_it);
+    m_ctx_cache.erase(it);
+}
+
+std::vector< sisl::byte_array > MetaBlkService::read_sub_sbs(std::vector< meta_blk* > const& mblks) const {
+    std::vector< sisl::byte_array > bufs;
+    std::vector< folly::Future< std::error_code > > futs;
+    bufs.reserve(mblks.size());
+    for (auto const* mblk : mblks) {
+        if (mblk->hdr.h.context_sz <= meta_blk_context_sz()) {
+            bufs.emplace_back(read_sub_sb_internal(mblk)); // Inline, nothing to read
+            continue;
+        }
+
+        auto& buf = bufs.emplace_back(
+            hs_utils::make_byte_array(mblk->hdr.h.context_sz, true /* aligned */, sisl::buftag::metablk, align_size()));
+        uint64_t const total_sz = mblk->hdr.h.context_sz;
+        uint64_t read_offset{0};
+        auto obid = mblk->hdr.h.ovf_bid;
+        while (read_offset < total_sz) {
+            HS_REL_ASSERT_EQ(obid.is_valid(), true, "[type={}], corrupted ovf_bid: {}", mblk->hdr.h.type,
+                             obid.to_string());
+            const auto* ovf_hdr = m_ovf_blk_hdrs.find(obid.to_integer())->second;
+            uint64_t read_offset_in_this_ovf{0};
+            const auto* data_bid = ovf_hdr->get_data_bid();
+            for (decltype(ovf_hdr->h.nbids) i{0}; i < ovf_hdr->h.nbids; ++i) {
+                uint64_t const read_sz_per_db = (i < ovf_hdr->h.nbids - 1)
+                    ? data_bid[i].blk_count() * block_size()
+                    : (ovf_hdr->h.context_sz - read_offset_in_this_ovf);
+                futs.emplace_back(m_sb_vdev->async_read(r_cast< char* >(buf->bytes() + read_offset),
+                                                        sisl::round_up(read_sz_per_db, align_size()), data_bid[i]));
+                read_offset_in_this_ovf += read_sz_per_db;
+                read_offset += read_sz_per_db;
+            }
+            obid = ovf_hdr->h.next_bid;
+        }
+        HS_REL_ASSERT_EQ(read_offset, total_sz, "[type={}], incorrect data read from disk: {}, total_sz: {}",
+                         mblk->hdr.h.type, read_offset, total_sz);
+    }
+
+    if (!futs.empty()) {
+        for (auto const& t : folly::collectAllUnsafe(futs).get()) {
+            HS_REL_ASSERT(t.hasValue() && !t.value(), "error in reading meta blk data during recovery");
+        }
+    }
+    return bufs;
+}
+
 // m_meta_mtx is used for concurrency between add/remove/update APIs and shutdown threads;
 // m_shutdown_mtx is used for concurrency between recover and shutdown threads;
 //
@@ -1128,12 +1432,41 @@ void MetaBlkService::recover(bool do_comp_cb) {
         auto& reg_info = x.second;
         if (!reg_info.has_deps) { recover_meta_sub_type(do_comp_cb, x.first); }
     }
+
+    // Sub types registered later read theirs with read_sub_sb
+    m_log->drop_recovered();
 }
 
 void MetaBlkService::recover_meta_sub_type(bool do_comp_cb, const meta_sub_type& sub_type) {
+    // Data of a batch of meta blks is read in parallel, after which they are called back one by one in order. Sub
+    // types with thousands of sbs (one per repl dev or index table) then don't wait on a read per sb.
+    auto const batch_size = std::max(HS_DYNAMIC_CONFIG(metablk.recovery_read_batch), 1u);
+    std::vector< meta_blk* > batch;
+    auto recover_batch = [this, &batch]() {
+        auto bufs = read_sub_sbs(batch);
+        for (size_t i{0}; i < batch.size(); ++i) {
+            recover_meta_block(batch[i], std::move(bufs[i]));
+        }
+        batch.clear();
+    };
+
     for (const auto& m : m_sub_info[sub_type].meta_bids) {
-        auto mblk = m_meta_blks[m];
-        recover_meta_block(mblk);
+        auto* mblk = m_meta_blks[m];
+        if (is_lazy_loaded(mblk)) {
+            // Nothing is read, consumer loads it with load_sub_sb when it needs it
+            auto& cb = m_sub_info[sub_type].cb;
+            if (cb) { cb(mblk, sisl::byte_view{}, 0); }
+            COUNTER_INCREMENT(m_metrics, lazy_load_skipped_cnt, 1);
+            continue;
+        }
+        batch.push_back(mblk);
+        if (batch.size() >= batch_size) { recover_batch(); }
+    }
+    if (!batch.empty()) { recover_batch(); }
+
+    // Content of the log structured ones is read already by the replay of the log
+    for (auto& [e, buf] : m_log->take_recovered(sub_type)) {
+        recover_meta_block(r_cast< meta_blk* >(e), std::move(buf));
     }
 
     if (do_comp_cb && m_sub_info[sub_type].comp_cb) {
@@ -1142,8 +1475,9 @@ void MetaBlkService::recover_meta_sub_type(bool do_comp_cb, const meta_sub_type&
     }
 }
 
-void MetaBlkService::recover_meta_block(meta_blk* mblk) {
-    auto buf = read_sub_sb_internal(mblk);
+void MetaBlkService::recover_meta_block(meta_blk* mblk) { recover_meta_block(mblk, read_sub_sb_internal(mblk)); }
+
+void MetaBlkService::recover_meta_block(meta_blk* mblk, sisl::byte_array buf) {
     // found a meta blk and callback to sub system;
     const auto itr = m_sub_info.find(mblk->hdr.h.type);
     if (itr != std::end(m_sub_info)) {
@@ -1161,33 +1495,7 @@ void MetaBlkService::recover_meta_block(meta_blk* mblk) {
         if (cb) { // cb could be nullptr because client want to get its superblock via read api;
             // decompress if necessary
             if (mblk->hdr.h.compressed) {
-                // HS_DBG_ASSERT_GE(mblk->hdr.h.context_sz, META_BLK_CONTEXT_SZ);
-                // TO DO: Might need to address alignment based on data or fast type
-                auto decompressed_buf{hs_utils::make_byte_array(mblk->hdr.h.src_context_sz, true /* aligned */,
-                                                                sisl::buftag::compression, align_size())};
-                size_t decompressed_size = mblk->hdr.h.src_context_sz;
-                const auto ret{sisl::Compress::decompress(r_cast< const char* >(buf->cbytes()),
-                                                          r_cast< char* >(decompressed_buf->bytes()),
-                                                          mblk->hdr.h.compressed_sz, &decompressed_size)};
-                if (ret != 0) {
-                    LOGERROR("[type={}], negative result: {} from decompress trying to decompress the "
-                             "data. compressed_sz: {}, src_context_sz: {}",
-                             mblk->hdr.h.type, ret, uint64_cast(mblk->hdr.h.compressed_sz),
-                             uint64_cast(mblk->hdr.h.src_context_sz));
-                    HS_REL_ASSERT(false, "failed to decompress");
-                } else {
-                    // decompressed_size must equal to input sz before compress
-                    HS_REL_ASSERT_EQ(uint64_cast(mblk->hdr.h.src_context_sz),
-                                     uint64_cast(decompressed_size)); /* since decompressed_size is >=0 it
-                                                                         is safe to cast to uint64_t */
-                    HS_LOG(DEBUG, metablk,
-                           "[type={}] Successfully decompressed, compressed_sz: {}, src_context_sz: {}, "
-                           "decompressed_size: {}",
-                           mblk->hdr.h.type, uint64_cast(mblk->hdr.h.compressed_sz),
-                           uint64_cast(mblk->hdr.h.src_context_sz), decompressed_size);
-                }
-
-                cb(mblk, decompressed_buf, mblk->hdr.h.src_context_sz);
+                cb(mblk, decompress_context(mblk, buf), mblk->hdr.h.src_context_sz);
             } else {
                 // There is use case that cb could be nullptr because client want to get its superblock via
                 // read api;
@@ -1207,6 +1515,66 @@ void MetaBlkService::recover_meta_block(meta_blk* mblk) {
     }
 }
 
+sisl::byte_array MetaBlkService::decompress_context(const meta_blk* mblk, const sisl::byte_array& buf) const {
+    // HS_DBG_ASSERT_GE(mblk->hdr.h.context_sz, META_BLK_CONTEXT_SZ);
+    // TO DO: Might need to address alignment based on data or fast type
+    auto decompressed_buf{hs_utils::make_byte_array(mblk->hdr.h.src_context_sz, true /* aligned */,
+                                                    sisl::buftag::compression, align_size())};
+    size_t decompressed_size = mblk->hdr.h.src_context_sz;
+    const auto ret{sisl::Compress::decompress(r_cast< const char* >(buf->cbytes()),
+                                              r_cast< char* >(decompressed_buf->bytes()),
+                                              mblk->hdr.h.compressed_sz, &decompressed_size)};
+    if (ret != 0) {
+        LOGERROR("[type={}], negative result: {} from decompress trying to decompress the "
+                 "data. compressed_sz: {}, src_context_sz: {}",
+                 mblk->hdr.h.type, ret, uint64_cast(mblk->hdr.h.compressed_sz),
+                 uint64_cast(mblk->hdr.h.src_context_sz));
+        HS_REL_ASSERT(false, "failed to decompress");
+    } else {
+        // decompressed_size must equal to input sz before compress
+        HS_REL_ASSERT_EQ(uint64_cast(mblk->hdr.h.src_context_sz),
+                         uint64_cast(decompressed_size)); /* since decompressed_size is >=0 it
+                                                             is safe to cast to uint64_t */
+        HS_LOG(DEBUG, metablk,
+               "[type={}] Successfully decompressed, compressed_sz: {}, src_context_sz: {}, "
+               "decompressed_size: {}",
+               mblk->hdr.h.type, uint64_cast(mblk->hdr.h.compressed_sz),
+               uint64_cast(mblk->hdr.h.src_context_sz), decompressed_size);
+    }
+    return decompressed_buf;
+}
+
+bool MetaBlkService::is_lazy_loaded(const meta_blk* mblk) const {
+    const auto it = m_sub_info.find(mblk->hdr.h.type);
+    if ((it == m_sub_info.end()) || (it->second.lazy_load_min_sz == 0)) { return false; }
+    const uint64_t sz = mblk->hdr.h.compressed ? mblk->hdr.h.src_context_sz : mblk->hdr.h.context_sz;
+    return (sz >= it->second.lazy_load_min_sz);
+}
+
+void MetaBlkService::enable_lazy_load(meta_sub_type type, uint64_t min_size) {
+    std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+    const auto it = m_sub_info.find(type);
+    HS_REL_ASSERT(it != m_sub_info.end(), "[type={}] lazy load enabled before it is registered", type);
+    it->second.lazy_load_min_sz = min_size;
+}
+
+sisl::byte_array MetaBlkService::load_sub_sb(const void* cookie) {
+    write_pending_sbs();
+    std::lock_guard< decltype(m_meta_mtx) > lg{m_meta_mtx};
+    HS_REL_ASSERT_EQ(m_inited, true, "accessing metablk store before init is not allowed.");
+    if (MetaLogStore::is_log_entry(cookie)) { return m_log->read(s_cast< const meta_log_entry* >(cookie)); }
+
+    const auto* mblk = s_cast< const meta_blk* >(cookie);
+    auto buf = read_sub_sb_internal(mblk);
+    const auto it = m_sub_info.find(mblk->hdr.h.type);
+    if ((it != m_sub_info.end()) && it->second.do_crc) {
+        const auto crc = crc32_ieee(init_crc32, buf->cbytes(), mblk->hdr.h.context_sz);
+        HS_REL_ASSERT_EQ(crc, uint32_cast(mblk->hdr.h.crc), "CRC mismatch: {}/{}, meta_blk details: {}", crc,
+                         uint32_cast(mblk->hdr.h.crc), mblk->hdr.h.to_string());
+    }
+    return mblk->hdr.h.compressed ? decompress_context(mblk, buf) : buf;
+}
+
 //
 // Acquire lock in read is to avoid same client issue update/remove/read on same cookie concurrently (though it
 // should not happen in normal case).
@@ -1236,12 +1604,18 @@ void MetaBlkService::read_sub_sb(meta_sub_type type) {
         it_s->second.cb(mblk, buf, mblk->hdr.h.context_sz);
     }
 
+    for (auto* e : m_log->entries_of(type)) {
+        HS_REL_ASSERT_EQ(it_s->second.cb.operator bool(), true);
+        it_s->second.cb(r_cast< meta_blk* >(e), m_log->read(e), e->hdr.h.context_sz);
+    }
+
     // if is allowed if consumer doesn't care about complete cb, e.g. consumer knows how many mblks it is
     // expecting;
     if (it_s->second.comp_cb) { it_s->second.comp_cb(true); }
 }
 
 uint64_t MetaBlkService::meta_size(const void* cookie) const {
+    if (MetaLogStore::is_log_entry(cookie)) { return m_log->size_of(s_cast< const meta_log_entry* >(cookie)); }
     const auto* mblk = s_cast< const meta_blk* >(cookie);
     size_t nblks{1}; // meta blk itself;
     auto obid = mblk->hdr.h.ovf_bid;
@@ -1261,6 +1635,46 @@ uint64_t MetaBlkService::meta_size(const void* cookie) const {
 
 bool MetaBlkService::get_skip_hdr_check() const { return HS_DYNAMIC_CONFIG(metablk.skip_header_size_check); }
 
+bool MetaBlkService::skip_compress(MetaSubRegInfo* info, const uint8_t* context_data, uint64_t sz) {
+    if (info && (info->compress_skips > 0)) {
+        --info->compress_skips;
+        COUNTER_INCREMENT(m_metrics, compress_skip_type_cnt, 1);
+        return true;
+    }
+
+    // A sample of a large sb tells whether compressing the whole of it is worth it, for much less cpu
+    const uint64_t sample_sz = HS_DYNAMIC_CONFIG(metablk.compress_sample_size_kb) * uint64_cast(1024);
+    if ((sample_sz == 0) || (sz < 4 * sample_sz)) { return false; }
+
+    const uint64_t max_dst_size = sisl::round_up(sisl::Compress::max_compress_len(sample_sz), align_size());
+    if (max_dst_size > m_compress_info.size()) {
+        free_compress_buf();
+        alloc_compress_buf(max_dst_size);
+    }
+    size_t compressed_size = max_dst_size;
+    const auto ret = sisl::Compress::compress(r_cast< const char* >(context_data),
+                                              r_cast< char* >(m_compress_info.bytes()), sample_sz, &compressed_size);
+    if (ret != 0) { return false; } // Whole of it is attempted, which fails loudly
+
+    const uint32_t ratio_percent = uint32_cast(uint64_cast(compressed_size) * 100 / sample_sz);
+    if (ratio_percent <= HS_DYNAMIC_CONFIG(metablk.compress_ratio_limit)) { return false; }
+
+    HS_PERIODIC_LOG(INFO, metablk, "Bypass compress because percent ratio: {} of a sample is exceeding limit: {}",
+                    ratio_percent, HS_DYNAMIC_CONFIG(metablk.compress_ratio_limit));
+    COUNTER_INCREMENT(m_metrics, compress_backoff_sample_cnt, 1);
+    track_compress_ratio(info, ratio_percent, false /* compressed */);
+    return true;
+}
+
+void MetaBlkService::track_compress_ratio(MetaSubRegInfo* info, uint32_t ratio_percent, bool compressed) {
+    if (info == nullptr) { return; }
+    info->compress_ratio_pct =
+        (info->compress_ratio_pct == 0) ? ratio_percent : ((info->compress_ratio_pct * 3) + ratio_percent) / 4;
+
+    // Type stays incompressible for a while, its next writes don't pay for finding it again
+    info->compress_skips = compressed ? 0 : HS_DYNAMIC_CONFIG(metablk.compress_skip_writes);
+}
+
 uint64_t MetaBlkService::min_compress_size() const {
     return HS_DYNAMIC_CONFIG(metablk.min_compress_size_mb) * uint64_cast(1024) * 1024;
 }
@@ -0,0 +1,304 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <sisl/fds/utils.hpp>
+
+#include <homestore/homestore.hpp>
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "device/virtual_dev.hpp"
+#include "meta_log_store.hpp"
+
+SISL_LOGGING_DECL(metablk)
+
+namespace homestore {
+
+MetaLogStore::~MetaLogStore() {
+    for (auto& [id, e] : m_entries) {
+        delete e;
+    }
+}
+
+void MetaLogStore::load(meta_blk* anchor_mblk) {
+    if (anchor_mblk == nullptr) { return; }
+    m_anchor = voidptr_cast(anchor_mblk);
+
+    auto const buf = m_mbs.read_sub_sb_internal(anchor_mblk);
+    auto const* anchor = r_cast< meta_log_anchor const* >(buf->cbytes());
+    HS_REL_ASSERT_EQ(anchor->magic, META_LOG_ANCHOR_MAGIC, "meta log anchor is corrupted");
+    m_last_seg_seq = anchor->last_seg_seq;
+
+    for (uint32_t i{0}; i < anchor->nsegs; ++i) {
+        auto& seg = m_segs.emplace_back(segment{anchor->segs()[i].bid, anchor->segs()[i].seq});
+        auto const status = m_mbs.m_sb_vdev->commit_blk(seg.bid);
+        HS_REL_ASSERT_EQ(status, BlkAllocStatus::SUCCESS, "failed to commit meta log segment {}",
+                         seg.bid.to_string());
+        replay_segment(seg);
+    }
+
+    // Live blks are known only once all of the records are replayed
+    for (auto const& [id, e] : m_entries) {
+        segment_of(e->hdr.h.bid).live_blks += e->hdr.h.bid.blk_count();
+    }
+    HS_LOG(INFO, metablk, "meta log loaded with segments={} sbs={} last_seq={}", m_segs.size(), m_entries.size(),
+           m_last_seq);
+}
+
+void MetaLogStore::replay_segment(segment& seg) {
+    auto const bs = m_mbs.block_size();
+    auto const nblks = seg.bid.blk_count();
+    auto* buf = hs_utils::iobuf_alloc(uint64_cast(nblks) * bs, sisl::buftag::metablk, m_mbs.align_size());
+    m_mbs.read(seg.bid, buf, uint64_cast(nblks) * bs);
+
+    uint32_t off{0};
+    while (off < nblks) {
+        auto* rec = r_cast< meta_log_rec_hdr* >(buf + uint64_cast(off) * bs);
+        if ((rec->magic != META_LOG_REC_MAGIC) || (rec->seg_seq != seg.seq) || (rec->nblks == 0) ||
+            (off + rec->nblks > nblks) ||
+            (sizeof(meta_log_rec_hdr) + rec->context_sz > uint64_cast(rec->nblks) * bs)) {
+            break;
+        }
+        auto const crc = rec->crc;
+        rec->crc = 0;
+        auto const rec_sz = sizeof(meta_log_rec_hdr) + rec->context_sz;
+        if (crc32_ieee(init_crc32, r_cast< uint8_t const* >(rec), rec_sz) != crc) {
+            HS_LOG(INFO, metablk, "meta log segment {} ends at a torn record at blk {}", seg.bid.to_string(), off);
+            break;
+        }
+
+        m_last_seq = std::max(m_last_seq, rec->seq);
+        m_next_id = std::max(m_next_id, rec->id + 1);
+        if (rec->removed) {
+            auto const it = m_entries.find(rec->id);
+            if (it != m_entries.end()) {
+                delete it->second;
+                m_entries.erase(it);
+            }
+            m_recovered.erase(rec->id);
+        } else {
+            auto& e = m_entries[rec->id];
+            if (e == nullptr) {
+                e = new meta_log_entry{};
+                e->hdr.h.magic = META_LOG_ENTRY_MAGIC;
+                e->hdr.h.version = META_LOG_VERSION;
+                e->id = rec->id;
+                std::strncpy(e->hdr.h.type, rec->type, MAX_SUBSYS_TYPE_LEN - 1);
+            }
+            auto const* data = r_cast< uint8_t const* >(rec) + sizeof(meta_log_rec_hdr);
+            e->seq = rec->seq;
+            e->hdr.h.bid = BlkId{seg.bid.blk_num() + off, s_cast< blk_count_t >(rec->nblks), seg.bid.chunk_num()};
+            e->hdr.h.context_sz = rec->context_sz;
+            e->hdr.h.crc = crc32_ieee(init_crc32, data, rec->context_sz);
+            e->hdr.h.gen_cnt += 1;
+
+            auto content = hs_utils::make_byte_array(rec->context_sz, false /* aligned */, sisl::buftag::metablk,
+                                                     m_mbs.align_size());
+            std::memcpy(content->bytes(), data, rec->context_sz);
+            m_recovered[rec->id] = std::move(content);
+        }
+        off += rec->nblks;
+    }
+    seg.used_blks = off;
+    hs_utils::iobuf_free(buf, sisl::buftag::metablk);
+}
+
+meta_log_entry* MetaLogStore::add(meta_sub_type const& type, uint8_t const* context_data, uint64_t sz) {
+    auto* e = new meta_log_entry{};
+    e->hdr.h.magic = META_LOG_ENTRY_MAGIC;
+    e->hdr.h.version = META_LOG_VERSION;
+    e->id = m_next_id++;
+    std::strncpy(e->hdr.h.type, type.c_str(), MAX_SUBSYS_TYPE_LEN - 1);
+
+    append(e, context_data, sz, false /* removed */);
+    m_entries.emplace(e->id, e);
+    return e;
+}
+
+void MetaLogStore::update(meta_log_entry* e, uint8_t const* context_data, uint64_t sz) {
+    HS_DBG_ASSERT(m_entries.count(e->id), "[type={}] update of meta log sb {} which is not found", e->hdr.h.type,
+                  e->id);
+    append(e, context_data, sz, false /* removed */);
+}
+
+void MetaLogStore::remove(meta_log_entry* e) {
+    HS_DBG_ASSERT(m_entries.count(e->id), "[type={}] remove of meta log sb {} which is not found", e->hdr.h.type,
+                  e->id);
+    append(e, nullptr, 0, true /* removed */);
+    m_entries.erase(e->id);
+    m_recovered.erase(e->id);
+    delete e;
+}
+
+void MetaLogStore::append(meta_log_entry* e, uint8_t const* context_data, uint64_t sz, bool removed) {
+    auto const bs = m_mbs.block_size();
+    auto const nblks = uint32_cast(sisl::round_up(sizeof(meta_log_rec_hdr) + sz, bs) / bs);
+    if (m_segs.empty() || (m_segs.back().used_blks + nblks > m_segs.back().bid.blk_count())) { open_segment(nblks); }
+    auto& seg = m_segs.back();
+
+    auto* buf = hs_utils::iobuf_alloc(uint64_cast(nblks) * bs, sisl::buftag::metablk, m_mbs.align_size());
+    auto* rec = r_cast< meta_log_rec_hdr* >(buf);
+    std::memset(buf, 0, sizeof(meta_log_rec_hdr));
+    rec->magic = META_LOG_REC_MAGIC;
+    rec->version = META_LOG_VERSION;
+    rec->seg_seq = seg.seq;
+    rec->seq = ++m_last_seq;
+    rec->id = e->id;
+    rec->context_sz = sz;
+    rec->nblks = nblks;
+    rec->removed = removed ? 1 : 0;
+    std::strncpy(rec->type, e->hdr.h.type, MAX_SUBSYS_TYPE_LEN - 1);
+    if (sz) { std::memcpy(buf + sizeof(meta_log_rec_hdr), context_data, sz); }
+    rec->crc = crc32_ieee(init_crc32, buf, sizeof(meta_log_rec_hdr) + sz);
+
+    BlkId const rec_bid{seg.bid.blk_num() + seg.used_blks, s_cast< blk_count_t >(nblks), seg.bid.chunk_num()};
+    auto const error = m_mbs.m_sb_vdev->sync_write(r_cast< const char* >(buf), uint64_cast(nblks) * bs, rec_bid);
+    HS_REL_ASSERT(!error.value(), "[type={}] error {} writing meta log record at {}", e->hdr.h.type, error.value(),
+                  rec_bid.to_string());
+    hs_utils::iobuf_free(buf, sisl::buftag::metablk);
+    seg.used_blks += nblks;
+
+    // Record it replaces is not live anymore, a tombstone isn't either, since the oldest segment is compacted first
+    if (e->hdr.h.bid.is_valid()) { segment_of(e->hdr.h.bid).live_blks -= e->hdr.h.bid.blk_count(); }
+    if (!removed) {
+        seg.live_blks += nblks;
+        e->seq = rec->seq;
+        e->hdr.h.bid = rec_bid;
+        e->hdr.h.context_sz = sz;
+        e->hdr.h.crc = crc32_ieee(init_crc32, context_data, sz);
+        e->hdr.h.gen_cnt += 1;
+    }
+}
+
+void MetaLogStore::open_segment(uint32_t min_blks) {
+    auto const nblks = std::max(HS_DYNAMIC_CONFIG(metablk.log_segment_blks), min_blks);
+    HS_REL_ASSERT_LE(nblks, std::numeric_limits< blk_count_t >::max(), "meta log record of {} blks is too large",
+                     min_blks);
+
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    BlkId bid;
+    auto const status = m_mbs.m_sb_vdev->alloc_contiguous_blks(s_cast< blk_count_t >(nblks), hints, bid);
+    HS_REL_ASSERT_EQ(status, BlkAllocStatus::SUCCESS, "failed to allocate meta log segment of {} blks", nblks);
+
+    // Anchor has it before any record in it is acked
+    m_segs.emplace_back(segment{bid, ++m_last_seg_seq});
+    write_anchor();
+    HS_LOG(DEBUG, metablk, "meta log segment {} opened with seq={}", bid.to_string(), m_last_seg_seq);
+}
+
+void MetaLogStore::write_anchor() {
+    auto const sz = sizeof(meta_log_anchor) + (m_segs.size() * sizeof(meta_log_anchor_seg));
+    sisl::io_blob_safe buf{uint32_cast(sz), m_mbs.align_size(), sisl::buftag::metablk};
+    std::memset(buf.bytes(), 0, sz);
+    auto* anchor = r_cast< meta_log_anchor* >(buf.bytes());
+    anchor->magic = META_LOG_ANCHOR_MAGIC;
+    anchor->version = META_LOG_VERSION;
+    anchor->last_seg_seq = m_last_seg_seq;
+    anchor->nsegs = uint32_cast(m_segs.size());
+    for (size_t i{0}; i < m_segs.size(); ++i) {
+        anchor->segs_mutable()[i] = meta_log_anchor_seg{m_segs[i].bid, m_segs[i].seq};
+    }
+
+    if (m_anchor == nullptr) {
+        m_mbs.add_sub_sb_internal(std::string{anchor_type}, buf.cbytes(), sz, m_anchor);
+    } else {
+        m_mbs.update_sub_sb_internal(buf.cbytes(), sz, m_anchor);
+    }
+}
+
+sisl::byte_array MetaLogStore::read(meta_log_entry const* e) const {
+    auto const bs = m_mbs.block_size();
+    auto const rec_sz = uint64_cast(e->hdr.h.bid.blk_count()) * bs;
+    auto* buf = hs_utils::iobuf_alloc(rec_sz, sisl::buftag::metablk, m_mbs.align_size());
+    m_mbs.read(e->hdr.h.bid, buf, rec_sz);
+
+    auto const* rec = r_cast< meta_log_rec_hdr const* >(buf);
+    HS_REL_ASSERT((rec->magic == META_LOG_REC_MAGIC) && (rec->id == e->id) && (rec->seq == e->seq),
+                  "[type={}] meta log record at {} is not of sb {}", e->hdr.h.type, e->hdr.h.bid.to_string(), e->id);
+    auto content = hs_utils::make_byte_array(rec->context_sz, false /* aligned */, sisl::buftag::metablk,
+                                             m_mbs.align_size());
+    std::memcpy(content->bytes(), buf + sizeof(meta_log_rec_hdr), rec->context_sz);
+    hs_utils::iobuf_free(buf, sisl::buftag::metablk);
+    return content;
+}
+
+std::vector< meta_log_entry* > MetaLogStore::entries_of(meta_sub_type const& type) const {
+    std::vector< meta_log_entry* > ret;
+    for (auto const& [id, e] : m_entries) {
+        if (type == e->hdr.h.type) { ret.push_back(e); }
+    }
+    std::sort(ret.begin(), ret.end(), [](auto const* a, auto const* b) { return a->id < b->id; });
+    return ret;
+}
+
+std::vector< std::pair< meta_log_entry*, sisl::byte_array > >
+MetaLogStore::take_recovered(meta_sub_type const& type) {
+    std::vector< std::pair< meta_log_entry*, sisl::byte_array > > ret;
+    for (auto* e : entries_of(type)) {
+        auto const it = m_recovered.find(e->id);
+        if (it == m_recovered.end()) { continue; }
+        ret.emplace_back(e, std::move(it->second));
+        m_recovered.erase(it);
+    }
+    return ret;
+}
+
+uint64_t MetaLogStore::size_of(meta_log_entry const* e) const {
+    return uint64_cast(e->hdr.h.bid.blk_count()) * m_mbs.block_size();
+}
+
+bool MetaLogStore::needs_compaction() const {
+    if (m_segs.size() < 2) { return false; }
+    uint64_t total_blks{0};
+    uint64_t live_blks{0};
+    for (auto const& seg : m_segs) {
+        total_blks += seg.bid.blk_count();
+        live_blks += seg.live_blks;
+    }
+    return (live_blks * 100) < (total_blks * HS_DYNAMIC_CONFIG(metablk.log_compact_live_pct));
+}
+
+void MetaLogStore::compact() {
+    // Bounded by a pass over the segments, a segment which is all live only moves to the head
+    for (auto n = m_segs.size(); (n > 0) && needs_compaction(); --n) {
+        auto const oldest = m_segs.front();
+        uint64_t moved{0};
+        for (auto& [id, e] : m_entries) {
+            if (!oldest.has(e->hdr.h.bid)) { continue; }
+            auto const content = m_recovered.count(id) ? m_recovered[id] : read(e);
+            append(e, content->cbytes(), e->hdr.h.context_sz, false /* removed */);
+            ++moved;
+        }
+
+        // Records moved out are written by now, so that a crash before here replays them from either of the segments
+        m_segs.pop_front();
+        write_anchor();
+        m_mbs.m_sb_vdev->free_blk(oldest.bid);
+        HS_LOG(INFO, metablk, "meta log segment {} seq={} compacted, sbs moved={}, segments={}", oldest.bid.to_string(),
+               oldest.seq, moved, m_segs.size());
+    }
+}
+
+MetaLogStore::segment& MetaLogStore::segment_of(BlkId const& b) {
+    auto const it = std::find_if(m_segs.begin(), m_segs.end(), [&b](segment const& s) { return s.has(b); });
+    HS_REL_ASSERT(it != m_segs.end(), "meta log record {} is not in any of the segments", b.to_string());
+    return *it;
+}
+} // namespace homestore
@@ -0,0 +1,179 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <sisl/fds/buffer.hpp>
+#include <homestore/blk.h>
+#include <homestore/meta_service.hpp>
+#include "meta_sb.hpp"
+
+namespace homestore {
+static constexpr uint32_t META_LOG_ENTRY_MAGIC{0xCEEDF00D};
+static constexpr uint32_t META_LOG_REC_MAGIC{0xF00DBEED};
+static constexpr uint32_t META_LOG_ANCHOR_MAGIC{0xF00DCEED};
+static constexpr uint32_t META_LOG_VERSION{0x1};
+
+// clang-format off
+/*
+ * Meta Log Layout Description:
+ * Sbs of log structured sub types are not linked in the meta blk chain. Each add/update/remove of them is appended as a
+ * record to the current segment, a contiguous run of blks, and the latest record of a sb is the sb. Segments are
+ * listed in an anchor, which is a regular sub sb in the meta blk chain and is written only when a segment is opened or
+ * freed.
+ *
+ *      |--------|           |--------------------------------------|      |-----------------------------|
+ *      | Anchor | --------> | rec | rec | rec (multi blk) | rec |  | ---> | rec | rec | tombstone | ... |
+ *      |--------|           |--------------------------------------|      |-----------------------------|
+ *                                     Oldest segment                           Current segment
+ *
+ * A record is blk aligned, its header followed by the sb. Replay walks the segments in order and stops in a segment at
+ * the first record which is not of it (stale data of an earlier use of its blks) or fails its crc (torn write).
+ * Compaction rewrites the live records of the oldest segment to the current one and frees it.
+ */
+// clang-format on
+
+#pragma pack(1)
+struct meta_log_rec_hdr {
+    uint32_t magic;
+    uint32_t version;
+    crc32_t crc;      // of the header (with crc as 0) and the sb
+    uint64_t seg_seq; // seq of the segment it is written to
+    uint64_t seq;     // seq of the record, across segments
+    uint64_t id;      // of the sb
+    uint64_t context_sz;
+    uint32_t nblks;  // blks of the record
+    uint8_t removed; // tombstone of the sb, context is empty
+    uint8_t pad[3];
+    char type[MAX_SUBSYS_TYPE_LEN];
+};
+
+struct meta_log_anchor_seg {
+    BlkId bid;
+    uint64_t seq;
+};
+
+struct meta_log_anchor {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t last_seg_seq; // Seq of a new segment is always above any of the segments its blks were part of before
+    uint32_t nsegs;
+    uint8_t pad[4];
+
+    // NOTE: nsegs of meta_log_anchor_seg start immediately after this structure, in the order of their seq
+    meta_log_anchor_seg const* segs() const {
+        return r_cast< meta_log_anchor_seg const* >(r_cast< uint8_t const* >(this) + sizeof(meta_log_anchor));
+    }
+    meta_log_anchor_seg* segs_mutable() {
+        return r_cast< meta_log_anchor_seg* >(r_cast< uint8_t* >(this) + sizeof(meta_log_anchor));
+    }
+};
+
+// Cookie of a log structured sb, in-memory only. It starts with a meta blk hdr, so that it is passed to the callbacks
+// and is told apart from a meta blk by its magic. hdr.h.bid is of the latest record of the sb.
+struct meta_log_entry {
+    meta_blk_hdr hdr;
+    uint64_t id;
+    uint64_t seq;
+};
+#pragma pack()
+
+class MetaBlkService;
+
+//
+// MetaLogStore is the log structured backend of MetaBlkService, for sub types with many sbs which are updated often,
+// where appending to a segment is cheaper than the in-place write of a meta blk and its overflow chain. Caller
+// (MetaBlkService) holds the meta lock for all of the calls.
+//
+class MetaLogStore {
+public:
+    static constexpr std::string_view anchor_type{"meta_log_store"};
+
+    explicit MetaLogStore(MetaBlkService& mbs) : m_mbs{mbs} {}
+    MetaLogStore(MetaLogStore const&) = delete;
+    MetaLogStore& operator=(MetaLogStore const&) = delete;
+    ~MetaLogStore();
+
+    static bool is_log_entry(void const* cookie) {
+        return s_cast< meta_log_entry const* >(cookie)->hdr.h.magic == META_LOG_ENTRY_MAGIC;
+    }
+
+    /**
+     * @brief : load the segments from the anchor (if there is one) and replay them, keeping the latest of each sb and
+     * its content, until it is taken or dropped
+     */
+    void load(meta_blk* anchor_mblk);
+
+    meta_log_entry* add(meta_sub_type const& type, uint8_t const* context_data, uint64_t sz);
+    void update(meta_log_entry* e, uint8_t const* context_data, uint64_t sz);
+    void remove(meta_log_entry* e);
+
+    sisl::byte_array read(meta_log_entry const* e) const;
+    std::vector< meta_log_entry* > entries_of(meta_sub_type const& type) const;
+
+    /**
+     * @brief : entries of the type with their content read by replay, which lets go of it
+     */
+    std::vector< std::pair< meta_log_entry*, sisl::byte_array > > take_recovered(meta_sub_type const& type);
+    void drop_recovered() { m_recovered.clear(); }
+
+    uint64_t size_of(meta_log_entry const* e) const;
+
+    bool needs_compaction() const;
+
+    /**
+     * @brief : compact the oldest segment until the live blks are above the threshold: its live records are appended
+     * again, the anchor is updated without it and then its blks are freed
+     */
+    void compact();
+
+private:
+    struct segment {
+        BlkId bid;
+        uint64_t seq;
+        uint32_t used_blks{0};
+        uint64_t live_blks{0};
+
+        bool has(BlkId const& b) const {
+            return (b.chunk_num() == bid.chunk_num()) && (b.blk_num() >= bid.blk_num()) &&
+                (b.blk_num() < bid.blk_num() + bid.blk_count());
+        }
+    };
+
+    void append(meta_log_entry* e, uint8_t const* context_data, uint64_t sz, bool removed);
+    void open_segment(uint32_t min_blks);
+    void write_anchor();
+    void replay_segment(segment& seg);
+    segment& segment_of(BlkId const& b);
+
+private:
+    MetaBlkService& m_mbs;
+    void* m_anchor{nullptr}; // Cookie of the anchor sb
+    std::deque< segment > m_segs;
+    std::unordered_map< uint64_t, meta_log_entry* > m_entries; // By id
+    std::unordered_map< uint64_t, sisl::byte_array > m_recovered;
+    uint64_t m_next_id{1};
+    uint64_t m_last_seq{0};
+    uint64_t m_last_seg_seq{0};
+};
+} // namespace homestore
@@ -92,6 +92,10 @@ struct MetaSubRegInfo {
     meta_blk_found_cb_t cb{nullptr};
     meta_blk_recover_comp_cb_t comp_cb{nullptr};
     bool has_deps{false};
+    bool log_structured{false}; // new sbs are added to the meta log
+    uint32_t compress_ratio_pct{0}; // moving avg of the ratio its sbs are compressed to, 0 until one is compressed
+    uint32_t compress_skips{0};     // writes yet to skip compression, since its sbs are found to be incompressible
+    uint64_t lazy_load_min_sz{0};   // sbs of at least this size are not read at recovery, 0 to read all of them
 };
 
 // meta blk super block put as 1st block in the block chain;
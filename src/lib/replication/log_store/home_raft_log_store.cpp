@@ -17,6 +17,7 @@
 #include "storage_engine_buffer.h"
 #include <sisl/fds/utils.hpp>
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include <homestore/homestore.hpp>
 
 using namespace homestore;
@@ -86,18 +87,45 @@ void HomeRaftLogStore::truncate(uint32_t num_reserved_cnt, repl_lsn_t compact_ls
 
         REPL_STORE_LOG(INFO, "LogDev={}: Truncating log entries from {} to {}, compact_lsn={}, last_lsn={}",
                        m_logdev_id, start_lsn, truncate_lsn, compact_lsn, last_lsn);
-        m_log_store->truncate(truncate_lsn);
+        truncate_store(s_cast< store_lsn_t >(truncate_lsn));
     }
 }
 
+void HomeRaftLogStore::truncate_upto(repl_lsn_t upto_lsn) {
+    // Last entry is always kept, so that the log store knows the index to continue from
+    auto const truncate_lsn = std::min(to_store_lsn(upto_lsn), to_store_lsn(last_index()) - 1);
+    if (truncate_lsn <= m_log_store->truncated_upto()) { return; }
+
+    REPL_STORE_LOG(DEBUG, "LogDev={}: Truncating log entries upto {}, upto_lsn={}", m_logdev_id, truncate_lsn,
+                   upto_lsn);
+    truncate_store(truncate_lsn);
+}
+
+void HomeRaftLogStore::truncate_store(store_lsn_t truncate_lsn) {
+    m_log_store->truncate(truncate_lsn);
+
+    // Runs which end before the new start are not needed anymore
+    std::unique_lock lg{m_term_mtx};
+    auto it = m_term_runs.upper_bound(truncate_lsn + 1);
+    if (it != m_term_runs.begin()) { m_term_runs.erase(m_term_runs.begin(), std::prev(it)); }
+}
+
 HomeRaftLogStore::HomeRaftLogStore(logdev_id_t logdev_id, logstore_id_t logstore_id, log_found_cb_t const& log_found_cb,
                                    log_replay_done_cb_t const& log_replay_done_cb) {
     m_dummy_log_entry = nuraft::cs_new< nuraft::log_entry >(0, nuraft::buffer::alloc(0), nuraft::log_val_type::app_log);
 
     if (logstore_id == UINT32_MAX) {
-        m_logdev_id = logstore_service().create_new_logdev();
-        m_log_store = logstore_service().create_new_log_store(m_logdev_id, true);
-        if (!m_log_store) { throw std::runtime_error("Failed to create log store"); }
+        if (HS_DYNAMIC_CONFIG(consensus.share_raft_logdevs)) {
+            // Journal of the group is interleaved with the ones of the other groups of the shared logdev, each one
+            // replayed by its own log store
+            m_log_store = logstore_service().create_new_shared_log_store(true /* append_mode */);
+            if (!m_log_store) { throw std::runtime_error("Failed to create log store"); }
+            m_logdev_id = m_log_store->get_logdev()->get_id();
+        } else {
+            m_logdev_id = logstore_service().create_new_logdev();
+            m_log_store = logstore_service().create_new_log_store(m_logdev_id, true);
+            if (!m_log_store) { throw std::runtime_error("Failed to create log store"); }
+        }
         m_logstore_id = m_log_store->get_store_id();
         LOGDEBUGMOD(replication, "Opened new home log_dev={} log_store={}", m_logdev_id, m_logstore_id);
     } else {
@@ -111,7 +139,11 @@ HomeRaftLogStore::HomeRaftLogStore(logdev_id_t logdev_id, logstore_id_t logstore
                                      m_log_store = std::move(log_store);
                                      DEBUG_ASSERT_EQ(m_logstore_id, m_log_store->get_store_id(),
                                                      "Mismatch in passed and create logstore id");
-                                     m_log_store->register_log_found_cb(log_found_cb);
+                                     m_log_store->register_log_found_cb(
+                                         [this, log_found_cb](logstore_seq_num_t lsn, log_buffer buf, void* ctx) {
+                                             record_term(lsn, extract_term(buf));
+                                             if (log_found_cb) { log_found_cb(lsn, buf, ctx); }
+                                         });
                                      m_log_store->register_log_replay_done_cb(log_replay_done_cb);
                                      REPL_STORE_LOG(DEBUG, "Home Log store created/opened successfully");
                                  });
@@ -163,6 +195,7 @@ ulong HomeRaftLogStore::append(nuraft::ptr< nuraft::log_entry >& entry) {
     auto const next_seq =
         m_log_store->append_async(sisl::io_blob{buf->data_begin(), uint32_cast(buf->size()), false /* is_aligned */},
                                   nullptr /* cookie */, [buf](int64_t, sisl::io_blob&, logdev_key, void*) {});
+    record_term(next_seq, entry->get_term());
     return to_repl_lsn(next_seq);
 }
 
@@ -170,13 +203,16 @@ void HomeRaftLogStore::write_at(ulong index, nuraft::ptr< nuraft::log_entry >& e
     auto buf = entry->serialize();
 
     m_log_store->rollback_async(to_store_lsn(index) - 1, nullptr);
+    drop_terms_from(to_store_lsn(index));
 
     // we need to reset the durable lsn, because its ok to set to lower number as it will be updated on next flush
     // calls, but it is dangerous to set higher number.
     m_last_durable_lsn = -1;
 
-    m_log_store->append_async(sisl::io_blob{buf->data_begin(), uint32_cast(buf->size()), false /* is_aligned */},
-                              nullptr /* cookie */, [buf](int64_t, sisl::io_blob&, logdev_key, void*) {});
+    auto const seq =
+        m_log_store->append_async(sisl::io_blob{buf->data_begin(), uint32_cast(buf->size()), false /* is_aligned */},
+                                  nullptr /* cookie */, [buf](int64_t, sisl::io_blob&, logdev_key, void*) {});
+    record_term(seq, entry->get_term());
 }
 
 void HomeRaftLogStore::end_of_append_batch(ulong start, ulong cnt) {
@@ -187,11 +223,11 @@ void HomeRaftLogStore::end_of_append_batch(ulong start, ulong cnt) {
 
 nuraft::ptr< std::vector< nuraft::ptr< nuraft::log_entry > > > HomeRaftLogStore::log_entries(ulong start, ulong end) {
     auto out_vec = std::make_shared< std::vector< nuraft::ptr< nuraft::log_entry > > >();
-    m_log_store->foreach (to_store_lsn(start), [end, &out_vec](store_lsn_t cur, const log_buffer& entry) -> bool {
-        bool ret = (cur < to_store_lsn(end) - 1);
-        if (cur < to_store_lsn(end)) { out_vec->emplace_back(to_nuraft_log_entry(entry)); }
-        return ret;
-    });
+    auto const entries = m_log_store->read_range_async(to_store_lsn(start), to_store_lsn(end)).get();
+    out_vec->reserve(entries.size());
+    for (auto const& entry : entries) {
+        out_vec->emplace_back(to_nuraft_log_entry(entry));
+    }
     return out_vec;
 }
 
@@ -208,6 +244,10 @@ nuraft::ptr< nuraft::log_entry > HomeRaftLogStore::entry_at(ulong index) {
 }
 
 ulong HomeRaftLogStore::term_at(ulong index) {
+    if (index >= start_index()) {
+        if (auto const term = lookup_term(to_store_lsn(index)); term) { return *term; }
+    }
+
     ulong term;
     try {
         auto log_bytes = m_log_store->read_sync(to_store_lsn(index));
@@ -220,34 +260,28 @@ ulong HomeRaftLogStore::term_at(ulong index) {
 }
 
 raft_buf_ptr_t HomeRaftLogStore::pack(ulong index, int32_t cnt) {
-    static constexpr size_t estimated_record_size = 128;
-    size_t estimated_size = cnt * estimated_record_size + sizeof(uint32_t);
-
     //   << Format >>
     // # records (N)        4 bytes
     // +---
     // | log length (X)     4 bytes
     // | log data           X bytes
     // +--- repeat N
-    raft_buf_ptr_t out_buf = nuraft::buffer::alloc(estimated_size);
-    out_buf->put(cnt);
-
-    int32_t remain_cnt = cnt;
-    m_log_store->foreach (
-        to_store_lsn(index),
-        [this, &out_buf, &remain_cnt]([[maybe_unused]] store_lsn_t cur, const log_buffer& entry) mutable -> bool {
-            if (remain_cnt-- > 0) {
-                size_t avail_size = out_buf->size() - out_buf->pos();
-                if (avail_size < entry.size()) {
-                    avail_size += std::max(out_buf->size() * 2, (size_t)entry.size());
-                    out_buf = nuraft::buffer::expand(*out_buf, avail_size);
-                }
-                REPL_STORE_LOG(TRACE, "packing lsn={} of size={}, avail_size in buffer={}", to_repl_lsn(cur),
-                               entry.size(), avail_size);
-                out_buf->put(entry.bytes(), entry.size());
-            }
-            return (remain_cnt > 0);
-        });
+    //
+    // Log data is the entry as stored in the log store, which is the serialized nuraft log entry. All of the range is
+    // read in one go, by log groups, and then gathered into a buffer of the exact size, without expanding it.
+    auto const entries = m_log_store->read_range_async(to_store_lsn(index), to_store_lsn(index) + cnt).get();
+    size_t total_size{sizeof(uint32_t)};
+    for (auto const& entry : entries) {
+        total_size += sizeof(uint32_t) + entry.size();
+    }
+
+    raft_buf_ptr_t out_buf = nuraft::buffer::alloc(total_size);
+    out_buf->put(s_cast< int32_t >(entries.size()));
+    for (auto const& entry : entries) {
+        REPL_STORE_LOG(TRACE, "packing lsn={} of size={}", to_repl_lsn(index), entry.size());
+        out_buf->put(entry.bytes(), entry.size());
+        ++index;
+    }
     return out_buf;
 }
 
@@ -259,6 +293,7 @@ void HomeRaftLogStore::apply_pack(ulong index, nuraft::buffer& pack) {
     if (index < slot) {
         // We are asked to apply/insert data behind next slot, so we must rollback before index and then append
         m_log_store->rollback_async(to_store_lsn(index) - 1, nullptr);
+        drop_terms_from(to_store_lsn(index));
     } else if (index > slot) {
         // We are asked to apply/insert data after next slot, so we need to fill in with dummy entries upto the slot
         // before append the entries
@@ -271,13 +306,14 @@ void HomeRaftLogStore::apply_pack(ulong index, nuraft::buffer& pack) {
         }
     }
 
+    // Packed entries are already serialized as the log store keeps them, so they are appended as is from the pack,
+    // which stays valid until all of them are flushed together below.
     for (int i{0}; i < num_entries; ++i) {
         size_t entry_len;
         auto* entry = pack.get_bytes(entry_len);
-        sisl::blob b{entry, uint32_cast(entry_len)};
-
-        auto nle = to_nuraft_log_entry(b);
-        this->append(nle);
+        auto const seq = m_log_store->append_async(sisl::io_blob{entry, uint32_cast(entry_len), false /* is_aligned */},
+                                                   nullptr /* cookie */, nullptr /* completion_cb */);
+        record_term(seq, *r_cast< uint64_t const* >(entry));
         REPL_STORE_LOG(TRACE, "unpacking nth_entry={} of size={}, lsn={}", i + 1, entry_len, slot + i);
     }
     this->end_of_append_batch(slot, num_entries);
@@ -316,6 +352,31 @@ ulong HomeRaftLogStore::last_durable_index() {
     return to_repl_lsn(m_last_durable_lsn);
 }
 
+void HomeRaftLogStore::record_term(store_lsn_t lsn, uint64_t term) {
+    std::unique_lock lg{m_term_mtx};
+    if (lsn <= m_term_upto) {
+        // Overwritten without a rollback before, terms from it are not valid anymore
+        m_term_runs.erase(m_term_runs.lower_bound(lsn), m_term_runs.end());
+    } else if (!m_term_runs.empty() && (lsn != m_term_upto + 1)) {
+        // Terms of the entries in between are not known, which the index can't tell apart from the run before
+        m_term_runs.clear();
+    }
+    if (m_term_runs.empty() || (m_term_runs.rbegin()->second != term)) { m_term_runs.emplace(lsn, term); }
+    m_term_upto = lsn;
+}
+
+void HomeRaftLogStore::drop_terms_from(store_lsn_t lsn) {
+    std::unique_lock lg{m_term_mtx};
+    m_term_runs.erase(m_term_runs.lower_bound(lsn), m_term_runs.end());
+    m_term_upto = m_term_runs.empty() ? -1 : std::min(m_term_upto, lsn - 1);
+}
+
+std::optional< uint64_t > HomeRaftLogStore::lookup_term(store_lsn_t lsn) const {
+    std::unique_lock lg{m_term_mtx};
+    if (m_term_runs.empty() || (lsn < m_term_runs.begin()->first) || (lsn > m_term_upto)) { return std::nullopt; }
+    return std::prev(m_term_runs.upper_bound(lsn))->second;
+}
+
 void HomeRaftLogStore::wait_for_log_store_ready() { m_log_store_future.wait(); }
 
 } // namespace homestore
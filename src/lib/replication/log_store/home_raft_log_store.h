@@ -14,6 +14,10 @@
  *********************************************************************************/
 #pragma once
 
+#include <map>
+#include <mutex>
+#include <optional>
+
 #include <homestore/replication/repl_decls.h>
 #include <homestore/logstore_service.hpp>
 
@@ -190,8 +194,21 @@ public:
      */
     void truncate(uint32_t num_reserved_cnt, repl_lsn_t compact_lsn);
 
+    /**
+     * Truncates the log store upto the lsn, if there is anything before it
+     *
+     * @param upto_lsn LSN upto which (including) the log entries are not needed anymore
+     */
+    void truncate_upto(repl_lsn_t upto_lsn);
+
     void wait_for_log_store_ready();
 
+private:
+    void truncate_store(store_lsn_t truncate_lsn);
+    void record_term(store_lsn_t lsn, uint64_t term);
+    void drop_terms_from(store_lsn_t lsn);
+    std::optional< uint64_t > lookup_term(store_lsn_t lsn) const;
+
 private:
     logstore_id_t m_logstore_id;
     logdev_id_t m_logdev_id;
@@ -199,5 +216,11 @@ private:
     nuraft::ptr< nuraft::log_entry > m_dummy_log_entry;
     store_lsn_t m_last_durable_lsn{-1};
     folly::Future< folly::Unit > m_log_store_future;
+
+    // Terms of the entries, run length encoded by the lsn each run starts at, so that term_at doesn't read the entry.
+    // It is in memory only, built by the replay of the log store and then by the appends.
+    mutable std::mutex m_term_mtx;
+    std::map< store_lsn_t, uint64_t > m_term_runs;
+    store_lsn_t m_term_upto{-1}; // Last lsn which the term is indexed for
 };
 } // namespace homestore
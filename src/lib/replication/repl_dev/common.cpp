@@ -1,20 +1,182 @@
-#include <boost/smart_ptr/intrusive_ref_counter.hpp>
+#include <unordered_map>
+#include <vector>
+
 #include <sisl/grpc/generic_service.hpp>
 #include <sisl/grpc/rpc_call.hpp>
 #include <homestore/blkdata_service.hpp>
+#include <homestore/homestore.hpp>
 #include <homestore/replication/repl_dev.h>
 #include <common/homestore_config.hpp>
+#include <common/resource_mgr.hpp>
 #include "replication/repl_dev/common.h"
 #include <libnuraft/nuraft.hxx>
 
 namespace homestore {
 
+static thread_local bool t_req_pool_closed{false};
+
+// Requests, fb builders and raft journal bufs kept for reuse by a thread (reactor), so that steady-state replication
+// doesn't go to the heap for them. Whatever is released goes to the pool of the releasing thread, which need not be
+// the one which took it.
+class repl_req_pool {
+public:
+    static repl_req_pool* instance() {
+        if (t_req_pool_closed) { return nullptr; } // Thread is exiting and the pool is gone already
+        static thread_local repl_req_pool s_pool;
+        return &s_pool;
+    }
+
+    ~repl_req_pool() {
+        t_req_pool_closed = true;
+        for (auto* req : m_reqs) {
+            delete req;
+        }
+        if (m_journal_buf_bytes && HomeStore::safe_instance()) {
+            resource_mgr().dec_mem_usage(mem_consumer_t::repl_reqs, m_journal_buf_bytes);
+        }
+    }
+
+    repl_req_ctx* take_req() {
+        if (m_reqs.empty()) { return nullptr; }
+        auto* req = m_reqs.back();
+        m_reqs.pop_back();
+        return req;
+    }
+
+    bool put_req(repl_req_ctx* req) {
+        if (m_reqs.size() >= HS_DYNAMIC_CONFIG(consensus.repl_req_pool_size)) { return false; }
+        m_reqs.push_back(req);
+        return true;
+    }
+
+    std::unique_ptr< flatbuffers::FlatBufferBuilder > take_fb_builder() {
+        if (m_fb_builders.empty()) { return std::make_unique< flatbuffers::FlatBufferBuilder >(); }
+        auto builder = std::move(m_fb_builders.back());
+        m_fb_builders.pop_back();
+        return builder;
+    }
+
+    void put_fb_builder(std::unique_ptr< flatbuffers::FlatBufferBuilder > builder) {
+        if (m_fb_builders.size() >= HS_DYNAMIC_CONFIG(consensus.repl_req_pool_size)) { return; }
+        builder->Clear(); // Keeps its buffer
+        m_fb_builders.push_back(std::move(builder));
+    }
+
+    // Raft journal bufs are of the exact size of the entry, which is mostly the same for all the writes
+    raft_buf_ptr_t take_journal_buf(uint32_t size) {
+        if (auto it = m_journal_bufs.find(size); (it != m_journal_bufs.end()) && !it->second.empty()) {
+            auto buf = std::move(it->second.back());
+            it->second.pop_back();
+            --m_num_journal_bufs;
+            m_journal_buf_bytes -= size;
+            resource_mgr().dec_mem_usage(mem_consumer_t::repl_reqs, size);
+            buf->pos(0);
+            return buf;
+        }
+        return nuraft::buffer::alloc(size);
+    }
+
+    // Pooled bufs of all the threads together are within the memory quota of repl reqs
+    void put_journal_buf(raft_buf_ptr_t buf) {
+        if (m_num_journal_bufs >= HS_DYNAMIC_CONFIG(consensus.repl_req_pool_size)) { return; }
+        auto const size = uint32_cast(buf->size());
+        if (!resource_mgr().can_add_mem(mem_consumer_t::repl_reqs, size)) { return; }
+        resource_mgr().inc_mem_usage(mem_consumer_t::repl_reqs, size);
+        m_journal_bufs[size].push_back(std::move(buf));
+        ++m_num_journal_bufs;
+        m_journal_buf_bytes += size;
+    }
+
+private:
+    std::vector< repl_req_ctx* > m_reqs;
+    std::vector< std::unique_ptr< flatbuffers::FlatBufferBuilder > > m_fb_builders;
+    std::unordered_map< uint32_t, std::vector< raft_buf_ptr_t > > m_journal_bufs; // By size
+    uint32_t m_num_journal_bufs{0};
+    uint64_t m_journal_buf_bytes{0};
+};
+
+repl_req_ptr_t repl_req_ctx::make_pooled() {
+    auto* pool = repl_req_pool::instance();
+    auto* req = pool ? pool->take_req() : nullptr;
+    if (req) {
+        req->m_start_time = Clock::now();
+    } else {
+        req = new repl_req_ctx{};
+        req->m_pooled = true;
+    }
+    return repl_req_ptr_t{req};
+}
+
+void repl_req_ctx::free_req(repl_req_ctx* req) {
+    auto* pool = req->m_pooled ? repl_req_pool::instance() : nullptr;
+    if (pool) {
+        req->reset();
+        if (pool->put_req(req)) { return; }
+    }
+    delete req;
+}
+
+void repl_req_ctx::reset() {
+    release_journal_buf();
+    release_fb_builder();
+    m_rkey = repl_key{};
+    m_header = sisl::blob{};
+    m_key = sisl::blob{};
+    m_lsn = -1;
+    m_is_proposer = false;
+    m_op_code = journal_type_t::HS_DATA_INLINED;
+    m_local_blkid = MultiBlkId{};
+    m_remote_blkid = RemoteBlkId{};
+    m_data = nullptr;
+    m_data_size = 0;
+    m_is_jentry_localize_pending = false;
+    m_state.store(uint32_cast(repl_req_state_t::INIT));
+    m_trace_id = invalid_trace_id;
+    for (auto& t : m_stage_us) {
+        t.store(0, std::memory_order_relaxed);
+    }
+    m_buf_for_unaligned_data = sisl::io_blob_safe{};
+    m_wire_buf = sisl::io_blob_safe{};
+    m_pushed_data = nullptr;
+    m_fetched_data = sisl::GenericClientResponse{};
+    m_pkts.clear();
+    m_data_received_promise = folly::Promise< folly::Unit >{};
+    m_data_written_promise = folly::SharedPromise< folly::Unit >{};
+}
+
+void repl_req_ctx::release_journal_buf() {
+    if (m_journal_entry) {
+        m_journal_entry->~repl_journal_entry();
+        m_journal_entry = nullptr;
+    }
+    // Raft buf is reused only if raft (its log entry) or the follower's rpc doesn't hold it anymore
+    if (auto* buf = std::get_if< raft_buf_ptr_t >(&m_journal_buf); buf && *buf && (buf->use_count() == 1)) {
+        if (auto* pool = repl_req_pool::instance(); pool) { pool->put_journal_buf(std::move(*buf)); }
+    }
+    m_journal_buf = std::unique_ptr< uint8_t[] >{};
+}
+
+flatbuffers::FlatBufferBuilder& repl_req_ctx::create_fb_builder() {
+    if (!m_fb_builder) {
+        auto* pool = repl_req_pool::instance();
+        m_fb_builder = pool ? pool->take_fb_builder() : std::make_unique< flatbuffers::FlatBufferBuilder >();
+    }
+    return *m_fb_builder;
+}
+
+void repl_req_ctx::release_fb_builder() {
+    if (!m_fb_builder) { return; }
+    if (auto* pool = repl_req_pool::instance(); pool) { pool->put_fb_builder(std::move(m_fb_builder)); }
+    m_fb_builder.reset();
+}
+
 void repl_req_ctx::init(repl_key rkey, journal_type_t op_code, bool is_proposer, sisl::blob const& user_header,
                         sisl::blob const& key, uint32_t data_size) {
     m_rkey = std::move(rkey);
 #ifndef NDEBUG
     if (data_size > 0) {
-        DEBUG_ASSERT_EQ(op_code, journal_type_t::HS_DATA_LINKED, "Calling wrong init method");
+        DEBUG_ASSERT((op_code == journal_type_t::HS_DATA_LINKED) || (op_code == journal_type_t::HS_DATA_EMBEDDED),
+                     "Calling wrong init method");
     } else {
         DEBUG_ASSERT_NE(op_code, journal_type_t::HS_DATA_LINKED, "Calling wrong init method");
     }
@@ -23,25 +185,44 @@ void repl_req_ctx::init(repl_key rkey, journal_type_t op_code, bool is_proposer,
     m_is_proposer = is_proposer;
     m_header = user_header;
     m_key = key;
+    m_data_size = data_size;
     m_is_jentry_localize_pending = (!is_proposer && (data_size > 0)); // Pending on the applier and with linked data
 }
 
 repl_req_ctx::~repl_req_ctx() {
-    if (m_journal_entry) { m_journal_entry->~repl_journal_entry(); }
+    release_journal_buf();
+    release_fb_builder();
+}
+
+static blkid_format_t journal_blkid_format() {
+    return HS_DYNAMIC_CONFIG(consensus.journal_compact_blkid) ? blkid_format_t::compact : blkid_format_t::fixed;
 }
 
 void repl_req_ctx::create_journal_entry(bool is_raft_buf, int32_t server_id) {
-    uint32_t val_size = has_linked_data() ? m_local_blkid.serialized_size() : 0;
+    // Value of a raft journal entry is a slot for the largest blkid, so that followers localize it in place. A compact
+    // blkid of linked data takes only its own size, the followers with a larger one rewrite the entry instead.
+    auto const format = journal_blkid_format();
+    uint32_t val_size{0};
+    if (has_linked_data()) {
+        val_size = (is_raft_buf && (has_embedded_data() || (format == blkid_format_t::fixed)))
+            ? MultiBlkId::max_serialized_size(format)
+            : m_local_blkid.serialized_size(format);
+    }
+    if (has_embedded_data()) { val_size += m_data_size; }
     uint32_t entry_size = sizeof(repl_journal_entry) + m_header.size() + m_key.size() + val_size;
 
     if (is_raft_buf) {
-        m_journal_buf = nuraft::buffer::alloc(entry_size);
+        auto* pool = repl_req_pool::instance();
+        m_journal_buf = pool ? pool->take_journal_buf(entry_size) : nuraft::buffer::alloc(entry_size);
         m_journal_entry = new (raft_journal_buf()->data_begin()) repl_journal_entry();
     } else {
         m_journal_buf = std::unique_ptr< uint8_t[] >(new uint8_t[entry_size]);
         m_journal_entry = new (raw_journal_buf()) repl_journal_entry();
     }
 
+    if (format == blkid_format_t::fixed) {
+        m_journal_entry->minor_version = repl_journal_entry::JOURNAL_ENTRY_MINOR_COMPACT_BLKID - 1;
+    }
     m_journal_entry->code = m_op_code;
     m_journal_entry->server_id = server_id;
     m_journal_entry->dsn = m_rkey.dsn;
@@ -61,14 +242,23 @@ void repl_req_ctx::create_journal_entry(bool is_raft_buf, int32_t server_id) {
     }
 
     if (has_linked_data()) {
-        auto const b = m_local_blkid.serialize();
-        std::memcpy(raw_ptr, b.cbytes(), b.size());
+        auto const slot_size = val_size - (has_embedded_data() ? m_data_size : 0);
+        auto const blkid_size = m_local_blkid.serialize_to(raw_ptr, format);
+        std::memset(raw_ptr + blkid_size, 0, slot_size - blkid_size);
+        if (has_embedded_data()) { std::memcpy(raw_ptr + slot_size, m_data, m_data_size); }
     }
 }
 
 uint32_t repl_req_ctx::journal_entry_size() const {
-    return sizeof(repl_journal_entry) + m_header.size() + m_key.size() +
-        (has_linked_data() ? m_local_blkid.serialized_size() : 0);
+    uint32_t val_size{0};
+    if (m_journal_entry) {
+        val_size = m_journal_entry->value_size; // Could be a slot larger than the blkid
+    } else if (has_embedded_data()) {
+        val_size = MultiBlkId::max_serialized_size(journal_blkid_format()) + m_data_size;
+    } else if (has_linked_data()) {
+        val_size = m_local_blkid.serialized_size(journal_blkid_format());
+    }
+    return sizeof(repl_journal_entry) + m_header.size() + m_key.size() + val_size;
 }
 
 void repl_req_ctx::change_raft_journal_buf(raft_buf_ptr_t new_buf, bool adjust_hdr_key) {
@@ -144,7 +334,52 @@ bool repl_req_ctx::save_fetched_data(sisl::GenericClientResponse const& fetched_
     return true;
 }
 
-void repl_req_ctx::add_state(repl_req_state_t s) { m_state.fetch_or(uint32_cast(s)); }
+bool repl_req_ctx::save_decompressed_data(sisl::io_blob_safe&& buf) {
+    if (!add_state_if_not_already(repl_req_state_t::DATA_RECEIVED)) { return false; }
+
+    m_buf_for_unaligned_data = std::move(buf);
+    m_data = m_buf_for_unaligned_data.cbytes();
+    m_data_received_promise.setValue();
+    return true;
+}
+
+bool repl_req_ctx::save_embedded_data(sisl::sg_list const& data) {
+    if (!add_state_if_not_already(repl_req_state_t::DATA_RECEIVED)) { return false; }
+
+    // Padded upto the blk, so that it can be written as is
+    auto const buf_size = sisl::round_up(data.size, data_service().get_blk_size());
+    m_buf_for_unaligned_data = std::move(sisl::io_blob_safe(buf_size, data_service().get_align_size()));
+    uint8_t* ptr = m_buf_for_unaligned_data.bytes();
+    for (auto const& iov : data.iovs) {
+        std::memcpy(ptr, iov.iov_base, iov.iov_len);
+        ptr += iov.iov_len;
+    }
+    std::memset(ptr, 0, buf_size - data.size);
+    m_data = m_buf_for_unaligned_data.cbytes();
+    m_data_received_promise.setValue();
+    return true;
+}
+
+void repl_req_ctx::add_state(repl_req_state_t s) {
+    m_state.fetch_or(uint32_cast(s));
+    if (s == repl_req_state_t::DATA_WRITTEN) {
+        mark_stage(repl_req_stage_t::DATA_WRITTEN);
+    } else if (s == repl_req_state_t::LOG_FLUSHED) {
+        mark_stage(repl_req_stage_t::LOG_FLUSHED);
+    }
+}
+
+void repl_req_ctx::mark_stage(repl_req_stage_t s) {
+    // Atleast 1us, as 0 is for the stages not reached yet
+    m_stage_us[s_cast< size_t >(s)].store(std::max(get_elapsed_time_us(m_start_time), uint64_t{1}),
+                                          std::memory_order_relaxed);
+
+    // Span of each stage is from the start of the request, the same as its stage latency
+    static constexpr std::array< char const*, s_cast< size_t >(repl_req_stage_t::COUNT) > stage_spans{
+        "repl_proposed", "repl_data_pushed", "repl_log_flushed", "repl_committed", "repl_commit_done",
+        "repl_data_written"};
+    Tracer::record(m_trace_id, stage_spans[s_cast< size_t >(s)], m_start_time, uint64_cast(m_lsn));
+}
 
 bool repl_req_ctx::add_state_if_not_already(repl_req_state_t s) {
     bool changed{false};
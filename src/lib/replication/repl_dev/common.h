@@ -27,7 +27,9 @@ namespace homestore {
 #pragma pack(1)
 struct repl_journal_entry {
     static constexpr uint16_t JOURNAL_ENTRY_MAJOR = 1;
-    static constexpr uint16_t JOURNAL_ENTRY_MINOR = 1;
+    static constexpr uint16_t JOURNAL_ENTRY_MINOR = 3; // 2: Value of linked data is a slot for the largest blkid
+                                                       // 3: Blkid in the value is compact encoded
+    static constexpr uint16_t JOURNAL_ENTRY_MINOR_COMPACT_BLKID = 3;
 
     // Major and minor version. For each major version underlying structures could change. Minor versions can only add
     // fields, not change any existing fields.
@@ -42,6 +44,10 @@ struct repl_journal_entry {
     uint32_t value_size;
     // Followed by user_header, then key, then MultiBlkId/value
 
+    blkid_format_t blkid_format() const {
+        return (minor_version >= JOURNAL_ENTRY_MINOR_COMPACT_BLKID) ? blkid_format_t::compact : blkid_format_t::fixed;
+    }
+
     std::string to_string() const {
         return fmt::format("version={}.{}, code={}, server_id={}, dsn={}, header_size={}, key_size={}, value_size={}",
                            major_version, minor_version, enum_name(code), server_id, dsn, user_header_size, key_size,
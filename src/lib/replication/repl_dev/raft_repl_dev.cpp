@@ -1,3 +1,9 @@
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <mutex>
+#include <utility>
+
 #include <flatbuffers/idl.h>
 #include <flatbuffers/minireflect.h>
 #include <folly/executors/InlineExecutor.h>
@@ -12,18 +18,24 @@
 #include <homestore/blkdata_service.hpp>
 #include <homestore/logstore_service.hpp>
 #include <homestore/superblk_handler.hpp>
+#include <homestore/probes.hpp>
 
 #include "common/homestore_assert.hpp"
 #include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/resource_mgr.hpp"
 // #include "common/homestore_flip.hpp"
 #include "replication/service/raft_repl_service.h"
 #include "replication/repl_dev/raft_repl_dev.h"
 #include "device/device.h"
+#include "blkdata_svc/blk_compress.hpp"
 #include "push_data_rpc_generated.h"
 #include "fetch_data_rpc_generated.h"
+#include "raft_config_sb_generated.h"
 
 namespace homestore {
 std::atomic< uint64_t > RaftReplDev::s_next_group_ordinal{1};
+static std::array< uint8_t, 4096 > const s_push_data_pad{}; // Zeros sent to align the data in push data rpc
 
 RaftReplDev::RaftReplDev(RaftReplService& svc, superblk< raft_repl_dev_superblk >&& rd_sb, bool load_existing) :
         m_repl_svc{svc},
@@ -93,8 +105,21 @@ RaftReplDev::RaftReplDev(RaftReplService& svc, superblk< raft_repl_dev_superblk
             on_push_data_received(rpc_data);
         }
     });
+    m_msg_mgr.bind_data_service_request(
+        PUSH_DATA_BATCH, m_group_id, [this](intrusive< sisl::GenericRpcData >& rpc_data) {
+            if (iomgr_flip::instance()->delay_flip("slow_down_data_channel", [this, rpc_data]() mutable {
+                    RD_LOGI("Resuming after slow down data channel flip");
+                    on_push_data_batch_received(rpc_data);
+                })) {
+                RD_LOGI("Slow down data channel flip is enabled, scheduling to call later");
+            } else {
+                on_push_data_batch_received(rpc_data);
+            }
+        });
 #else
     m_msg_mgr.bind_data_service_request(PUSH_DATA, m_group_id, bind_this(RaftReplDev::on_push_data_received, 1));
+    m_msg_mgr.bind_data_service_request(PUSH_DATA_BATCH, m_group_id,
+                                        bind_this(RaftReplDev::on_push_data_batch_received, 1));
 #endif
 
     m_msg_mgr.bind_data_service_request(FETCH_DATA, m_group_id, bind_this(RaftReplDev::on_fetch_data_received, 1));
@@ -117,7 +142,7 @@ folly::SemiFuture< ReplServiceError > RaftReplDev::destroy_group() {
     m_stage.update([](auto* stage) { *stage = repl_dev_stage_t::DESTROYING; });
 
     // Propose to the group to destroy
-    auto rreq = repl_req_ptr_t(new repl_req_ctx{});
+    auto rreq = repl_req_ctx::make_pooled();
     rreq->init(repl_key{}, journal_type_t::HS_CTRL_DESTROY, true, sisl::blob{}, sisl::blob{}, 0);
 
     auto err = m_state_machine->propose_to_raft(std::move(rreq));
@@ -130,8 +155,6 @@ folly::SemiFuture< ReplServiceError > RaftReplDev::destroy_group() {
     return m_destroy_promise.getSemiFuture();
 }
 
-void RaftReplDev::use_config(json_superblk raft_config_sb) { m_raft_config_sb = std::move(raft_config_sb); }
-
 void RaftReplDev::on_create_snapshot(nuraft::snapshot& s, nuraft::async_result< bool >::handler_type& when_done) {
     RD_LOG(DEBUG, "create_snapshot last_idx={}/term={}", s.get_last_log_idx(), s.get_last_log_term());
     repl_snapshot snapshot{.last_log_idx_ = s.get_last_log_idx(), .last_log_term_ = s.get_last_log_term()};
@@ -144,10 +167,277 @@ void RaftReplDev::on_create_snapshot(nuraft::snapshot& s, nuraft::async_result<
     if (when_done) { when_done(ret_val, null_except); }
 }
 
+int RaftReplDev::read_snapshot_obj(nuraft::snapshot& s, void*& user_ctx, uint64_t obj_id, raft_buf_ptr_t& data_out,
+                                   bool& is_last_obj) {
+    auto* ctx = r_cast< snapshot_read_ctx* >(user_ctx);
+    if (ctx == nullptr) {
+        auto chunks = m_listener->snapshot_data_chunks();
+        if (chunks.empty()) {
+            // No native snapshot, an empty object which the receiver ignores
+            data_out = nuraft::buffer::alloc(sizeof(int));
+            data_out->put(0);
+            is_last_obj = true;
+            return 0;
+        }
+
+        ctx = new snapshot_read_ctx{};
+        ctx->layout.blks_per_obj =
+            std::max(HS_DYNAMIC_CONFIG(consensus.snapshot_obj_size_mb) * 1024 * 1024 / get_blk_size(), 1u);
+        for (auto const chunk : chunks) {
+            ctx->layout.chunk_blks.push_back(data_service().num_blks_of_chunk(chunk));
+        }
+        ctx->layout.chunks = std::move(chunks);
+        user_ctx = ctx;
+        RD_LOGI("Sending native snapshot last_idx={} of chunks={} in data objs={}", s.get_last_log_idx(),
+                ctx->layout.chunks.size(), ctx->layout.num_data_objs());
+    }
+
+    auto const& layout = ctx->layout;
+    is_last_obj = false;
+    if (obj_id == 0) {
+        data_out = nuraft::buffer::alloc(sizeof(snapshot_manifest) + layout.chunks.size() * sizeof(blk_num_t));
+        auto* manifest = new (data_out->data_begin()) snapshot_manifest{};
+        manifest->last_log_idx = s.get_last_log_idx();
+        manifest->blk_size = get_blk_size();
+        manifest->blks_per_obj = layout.blks_per_obj;
+        manifest->nchunks = uint32_cast(layout.chunks.size());
+        std::copy(layout.chunk_blks.begin(), layout.chunk_blks.end(), manifest->chunk_blks_mutable());
+    } else if (layout.is_data_obj(obj_id)) {
+        auto it = ctx->prefetched.find(obj_id);
+        auto f = (it != ctx->prefetched.end()) ? std::move(it->second) : read_snapshot_data_obj(layout, obj_id);
+        ctx->prefetched.clear();
+
+        // Next one is read while this one is being sent
+        if (layout.is_data_obj(obj_id + 1)) {
+            ctx->prefetched.emplace(obj_id + 1, read_snapshot_data_obj(layout, obj_id + 1));
+        }
+        data_out = std::move(f).get();
+        if (data_out == nullptr) {
+            RD_LOGE("Failed to read data obj={} of native snapshot last_idx={}", obj_id, s.get_last_log_idx());
+            return -1;
+        }
+    } else {
+        repl_snapshot const snapshot{.last_log_idx_ = s.get_last_log_idx(), .last_log_term_ = s.get_last_log_term()};
+        sisl::io_blob_safe obj;
+        m_listener->read_snapshot_obj(snapshot, obj_id - layout.num_data_objs() - 1, obj, is_last_obj);
+        data_out = nuraft::buffer::alloc(obj.size());
+        if (obj.size()) { std::memcpy(data_out->data_begin(), obj.cbytes(), obj.size()); }
+    }
+    COUNTER_INCREMENT(m_metrics, snapshot_read_objs_cnt, 1);
+    return 0;
+}
+
+void RaftReplDev::free_snapshot_ctx(void*& user_ctx) {
+    // A read ahead still in flight owns its buffers, so it is fine to let go of it
+    delete r_cast< snapshot_read_ctx* >(user_ctx);
+    user_ctx = nullptr;
+}
+
+folly::Future< raft_buf_ptr_t > RaftReplDev::read_snapshot_data_obj(snapshot_layout const& layout, uint64_t obj_id) {
+    auto const [chunk_idx, start_blk, nblks] = layout.data_obj(obj_id);
+    auto const chunk = layout.chunks[chunk_idx];
+
+    // Blks allocated as of now, which could be more than as of the snapshot. It doesn't matter, as these are only
+    // reserved on the receiver and the log entries after the snapshot are committed on top of them anyways.
+    std::vector< snapshot_blk_run > runs;
+    uint32_t data_blks{0};
+    for (blk_num_t b{start_blk}; b < start_blk + nblks; ++b) {
+        if (!data_service().is_blk_alloced(BlkId{b, 1, chunk})) { continue; }
+        if (!runs.empty() && (runs.back().blk_num + runs.back().nblks == b) &&
+            (runs.back().nblks < std::numeric_limits< blk_count_t >::max())) {
+            ++runs.back().nblks;
+        } else {
+            runs.push_back(snapshot_blk_run{.blk_num = b, .nblks = 1});
+        }
+        ++data_blks;
+    }
+
+    auto const hdr_size = sizeof(snapshot_data_obj_hdr) + runs.size() * sizeof(snapshot_blk_run);
+    auto const data_size = data_blks * get_blk_size();
+    auto buf = nuraft::buffer::alloc(hdr_size + data_size);
+    auto* hdr = new (buf->data_begin()) snapshot_data_obj_hdr{
+        .chunk_idx = chunk_idx, .start_blk = start_blk, .nblks = nblks, .nruns = uint32_cast(runs.size())};
+    std::copy(runs.begin(), runs.end(), hdr->runs_mutable());
+    COUNTER_INCREMENT(m_metrics, snapshot_data_blks_cnt, data_blks);
+    if (data_size == 0) { return folly::makeFuture< raft_buf_ptr_t >(std::move(buf)); }
+
+    // All the runs are read as one batch, into an aligned buffer, which is then copied after the header
+    auto* data = iomanager.iobuf_alloc(get_blk_size(), data_size);
+    std::vector< std::pair< MultiBlkId, sisl::sg_list > > reqs;
+    uint64_t offset{0};
+    for (auto const& r : runs) {
+        sisl::sg_list sgs;
+        sgs.size = r.nblks * get_blk_size();
+        sgs.iovs.emplace_back(iovec{.iov_base = data + offset, .iov_len = sgs.size});
+        offset += sgs.size;
+        reqs.emplace_back(MultiBlkId{r.blk_num, r.nblks, chunk}, std::move(sgs));
+    }
+
+    // Sending a snapshot to a new replica, not to be done at the cost of ios of this replica's own consumer
+    io_priority_guard g{io_priority_t::recovery};
+    io_tenant_guard tg{io_tenant()};
+    auto f = data_service().async_read(reqs);
+    return std::move(f).thenValue(
+        [this, reqs = std::move(reqs), buf = std::move(buf), data, hdr_size, data_size](auto&& ec) -> raft_buf_ptr_t {
+            if (!ec) { std::memcpy(buf->data_begin() + hdr_size, data, data_size); }
+            iomanager.iobuf_free(data);
+            if (ec) {
+                COUNTER_INCREMENT(m_metrics, read_err_cnt, 1);
+                return nullptr;
+            }
+            return buf;
+        });
+}
+
+void RaftReplDev::save_snapshot_obj(nuraft::snapshot& s, uint64_t& obj_id, nuraft::buffer& data, bool is_first_obj,
+                                    bool is_last_obj) {
+    auto& ctx = m_snapshot_write_ctx;
+    if (is_first_obj && (obj_id == 0) && ctx && (ctx->last_log_idx == s.get_last_log_idx()) && !ctx->done &&
+        (ctx->next_obj_id > 0)) {
+        // Same snapshot sent again, resume from where it stopped
+        RD_LOGI("Resuming native snapshot last_idx={} from obj={}", s.get_last_log_idx(), ctx->next_obj_id);
+        obj_id = ctx->next_obj_id;
+        return;
+    }
+
+    if (obj_id == 0) {
+        auto const* manifest = r_cast< snapshot_manifest const* >(data.data_begin());
+        if ((data.size() < sizeof(snapshot_manifest)) ||
+            (manifest->magic != snapshot_manifest::SNAPSHOT_MANIFEST_MAGIC)) {
+            // Sender has no native snapshot, nothing to write
+            RD_LOGW("Received snapshot last_idx={} which is not a native snapshot", s.get_last_log_idx());
+            ctx.reset();
+            obj_id = 1;
+            return;
+        }
+        if (data.size() != sizeof(snapshot_manifest) + uint64_cast(manifest->nchunks) * sizeof(blk_num_t)) {
+            RD_LOGE("Manifest of native snapshot last_idx={} of size={} doesn't match its chunks={}, will be asked "
+                    "again",
+                    s.get_last_log_idx(), data.size(), manifest->nchunks);
+            return;
+        }
+
+        // NOTE: Blks reserved by a snapshot which was not completed, if any, are left allocated
+        ctx = std::make_unique< snapshot_write_ctx >();
+        ctx->last_log_idx = s.get_last_log_idx();
+        ctx->layout.chunks = m_listener->snapshot_data_chunks();
+        ctx->layout.blks_per_obj = manifest->blks_per_obj;
+        ctx->layout.chunk_blks.assign(manifest->chunk_blks(), manifest->chunk_blks() + manifest->nchunks);
+        RD_REL_ASSERT_EQ(manifest->blk_size, get_blk_size(), "Mismatched blk size of native snapshot");
+        RD_REL_ASSERT_EQ(ctx->layout.chunks.size(), manifest->nchunks, "Mismatched chunks of native snapshot");
+        for (uint32_t i{0}; i < manifest->nchunks; ++i) {
+            RD_REL_ASSERT_GE(data_service().num_blks_of_chunk(ctx->layout.chunks[i]), ctx->layout.chunk_blks[i],
+                             "Chunk of native snapshot is larger than the local chunk");
+        }
+        RD_LOGI("Receiving native snapshot last_idx={} of chunks={} in data objs={}", s.get_last_log_idx(),
+                manifest->nchunks, ctx->layout.num_data_objs());
+    } else if (ctx == nullptr) {
+        // Objects of a snapshot which is not native
+        ++obj_id;
+        return;
+    } else if (ctx->layout.is_data_obj(obj_id)) {
+        if (!write_snapshot_data_obj(ctx->layout, obj_id, data)) {
+            RD_LOGE("Failed to write data obj={} of native snapshot last_idx={}, will be asked again", obj_id,
+                    s.get_last_log_idx());
+            return;
+        }
+    } else if (data.size() > 0) {
+        repl_snapshot const snapshot{.last_log_idx_ = s.get_last_log_idx(), .last_log_term_ = s.get_last_log_term()};
+        m_listener->write_snapshot_obj(snapshot, obj_id - ctx->layout.num_data_objs() - 1,
+                                       sisl::blob{data.data_begin(), uint32_cast(data.size())});
+    }
+
+    COUNTER_INCREMENT(m_metrics, snapshot_write_objs_cnt, 1);
+    ++obj_id;
+    ctx->next_obj_id = obj_id;
+    if (is_last_obj) { ctx->done = true; }
+}
+
+bool RaftReplDev::write_snapshot_data_obj(snapshot_layout const& layout, uint64_t obj_id, nuraft::buffer& data) {
+    if (!layout.is_valid_data_obj(obj_id, data.data_begin(), data.size(), get_blk_size())) {
+        RD_LOGE("Invalid data obj={} of size={} in native snapshot, ignoring it", obj_id, data.size());
+        COUNTER_INCREMENT(m_metrics, write_err_cnt, 1);
+        return false;
+    }
+    auto const* hdr = r_cast< snapshot_data_obj_hdr const* >(data.data_begin());
+    auto const chunk = layout.chunks[hdr->chunk_idx];
+    auto const data_size = data.size() - hdr->size();
+    if (data_size == 0) { return true; }
+
+    // Data in the raft buffer is not aligned for the write
+    auto* aligned = iomanager.iobuf_alloc(get_blk_size(), data_size);
+    std::memcpy(aligned, data.data_begin() + hdr->size(), data_size);
+
+    std::vector< folly::Future< std::error_code > > futs;
+    std::vector< BlkId > reserved;
+    uint64_t offset{0};
+    bool success{true};
+    io_tenant_guard tg{io_tenant()};
+    for (uint32_t i{0}; i < hdr->nruns; ++i) {
+        auto const& r = hdr->runs()[i];
+        MultiBlkId const bid{r.blk_num, r.nblks, chunk};
+        if (data_service().reserve_blk(bid, reserved) != BlkAllocStatus::SUCCESS) {
+            success = false;
+            break;
+        }
+        futs.emplace_back(data_service().async_write(r_cast< char const* >(aligned + offset), r.nblks * get_blk_size(),
+                                                     bid, true /* part_of_batch */));
+        offset += r.nblks * get_blk_size();
+    }
+    data_service().submit_io_batch();
+
+    for (auto const& t : folly::collectAllUnsafe(futs).get()) {
+        if (t.hasException() || t.value()) { success = false; }
+    }
+    iomanager.iobuf_free(aligned);
+    if (!success) {
+        // Obj is asked for again, blks reserved by it are released so that they don't stay allocated if it never is
+        for (auto const& b : reserved) {
+            data_service().unreserve_blk(b);
+        }
+        COUNTER_INCREMENT(m_metrics, write_err_cnt, 1);
+        return false;
+    }
+    COUNTER_INCREMENT(m_metrics, snapshot_data_blks_cnt, offset / get_blk_size());
+    return true;
+}
+
+bool RaftReplDev::apply_snapshot(nuraft::snapshot& s) {
+    auto& ctx = m_snapshot_write_ctx;
+    if (!ctx || !ctx->done || (ctx->last_log_idx != s.get_last_log_idx())) {
+        RD_LOGW("Snapshot last_idx={} is not a native snapshot received fully, can't be applied", s.get_last_log_idx());
+        return false;
+    }
+
+    repl_snapshot const snapshot{.last_log_idx_ = s.get_last_log_idx(), .last_log_term_ = s.get_last_log_term()};
+    m_listener->on_snapshot_applied(snapshot);
+    m_commit_upto_lsn.store(s_cast< repl_lsn_t >(s.get_last_log_idx()));
+    m_last_snapshot = nuraft::cs_new< nuraft::snapshot >(s.get_last_log_idx(), s.get_last_log_term(),
+                                                         s.get_last_config(), s.size(), s.get_type());
+    ctx.reset();
+    RD_LOGI("Applied native snapshot last_idx={}/term={}", s.get_last_log_idx(), s.get_last_log_term());
+    return true;
+}
+
 void RaftReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const& key, sisl::sg_list const& data,
                                     repl_req_ptr_t rreq) {
-    if (!rreq) { auto rreq = repl_req_ptr_t(new repl_req_ctx{}); }
+    if (!rreq) { rreq = repl_req_ctx::make_pooled(); }
+
+    // Journal is filling up faster than it is truncated, the write is deferred by a timer so that the proposers slow
+    // down gradually. Caller is never blocked, it could be a reactor, nor is raft, appending under its lock.
+    if (auto const delay_us = hs()->resource_mgr().throttle_journal_writer(); delay_us > 0) {
+        iomanager.schedule_global_timer(delay_us * 1000, false /* recurring */, nullptr /* cookie */,
+                                        iomgr::reactor_regex::all_worker,
+                                        [this, rd = shared_from_this(), header, key, data, rreq](void*) {
+                                            do_async_alloc_write(header, key, data, rreq);
+                                        });
+        return;
+    }
+    do_async_alloc_write(header, key, data, rreq);
+}
 
+void RaftReplDev::do_async_alloc_write(sisl::blob const& header, sisl::blob const& key, sisl::sg_list const& data,
+                                       repl_req_ptr_t rreq) {
     auto const guard = m_stage.access();
     if (auto const stage = *guard.get(); stage != repl_dev_stage_t::ACTIVE) {
         RD_LOGW("Raft channel: Not ready to accept writes, stage={}", enum_name(stage));
@@ -157,18 +447,31 @@ void RaftReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const&
         return;
     }
 
+    note_activity();
+    auto code = journal_type_t::HS_DATA_INLINED;
+    if (data.size > 0) {
+        // Small data goes along with the journal entry, saving the data channel round trip to the followers
+        code = (data.size <= HS_DYNAMIC_CONFIG(consensus.embed_data_max_size)) ? journal_type_t::HS_DATA_EMBEDDED
+                                                                                : journal_type_t::HS_DATA_LINKED;
+    }
     rreq->init(repl_key{.server_id = server_id(), .term = raft_server()->get_term(), .dsn = m_next_dsn.fetch_add(1)},
-               data.size ? journal_type_t::HS_DATA_LINKED : journal_type_t::HS_DATA_INLINED, true /* is_proposer */,
-               header, key, data.size);
+               code, true /* is_proposer */, header, key, data.size);
+    rreq->set_trace_id(Tracer::sample());
+    TraceScope trace_scope{rreq->trace_id()};
 
     // Add the request to the repl_dev_rreq map, it will be accessed throughout the life cycle of this request
     auto const [it, happened] = m_repl_key_req_map.emplace(rreq->rkey(), rreq);
     RD_DBG_ASSERT(happened, "Duplicate repl_key={} found in the map", rreq->rkey().to_string());
 
-    // If it is header only entry, directly propose to the raft
-    if (rreq->has_linked_data()) {
+    if (rreq->has_embedded_data()) {
+        rreq->save_embedded_data(data);
+        COUNTER_INCREMENT(m_metrics, embedded_data_cnt, 1);
+    } else if (rreq->has_linked_data()) {
         push_data_to_all_followers(rreq, data);
+    }
 
+    // If it is header only entry, directly propose to the raft
+    if (rreq->has_linked_data()) {
         // Step 1: Alloc Blkid
         auto const status = rreq->alloc_local_blks(m_listener, data.size);
         if (status != ReplServiceError::OK) {
@@ -177,16 +480,44 @@ void RaftReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const&
             return;
         }
 
-        // Write the data
-        data_service().async_write(data, rreq->local_blkid()).thenValue([this, rreq](auto&& err) {
-            if (err) {
-                HS_DBG_ASSERT(false, "Error in writing data, err_code={}", err.value());
-                handle_error(rreq, ReplServiceError::DRIVE_WRITE_ERROR);
-            } else {
-                auto raft_status = m_state_machine->propose_to_raft(rreq);
-                if (raft_status != ReplServiceError::OK) { handle_error(rreq, raft_status); }
-            }
-        });
+        // Write the data. Journal entry is either proposed along with it, in which case commit waits for the write (see
+        // RaftStateMachine::commit_ext), or once it is written.
+        auto const overlap = HS_DYNAMIC_CONFIG(consensus.leader_overlap_data_write);
+        auto write_data = [this, rreq, overlap, data]() {
+            io_tenant_guard tg{io_tenant()};
+            data_service().async_write(data, rreq->local_blkid()).thenValue([this, rreq, overlap](auto&& err) {
+                if (err) {
+                    // Entry which is proposed already can't be taken back, its commit would point to blks without data
+                    RD_REL_ASSERT(!overlap, "Error in writing data of proposed rreq=[{}], err_code={}",
+                                  rreq->to_compact_string(), err.value());
+                    HS_DBG_ASSERT(false, "Error in writing data, err_code={}", err.value());
+                    handle_error(rreq, ReplServiceError::DRIVE_WRITE_ERROR);
+                    return;
+                }
+
+                rreq->add_state(repl_req_state_t::DATA_WRITTEN);
+                rreq->m_data_written_promise.setValue();
+                if (!overlap) {
+                    auto raft_status = m_state_machine->propose_to_raft(rreq);
+                    if (raft_status != ReplServiceError::OK) { handle_error(rreq, raft_status); }
+                }
+            });
+        };
+#ifdef _PRERELEASE
+        if (iomgr_flip::instance()->delay_flip("simulate_leader_data_write_delay", write_data)) {
+            RD_LOGD("Simulate leader data write delay flip is enabled, writing data of rreq=[{}] later",
+                    rreq->to_compact_string());
+        } else {
+            write_data();
+        }
+#else
+        write_data();
+#endif
+
+        if (overlap) {
+            auto raft_status = m_state_machine->propose_to_raft(rreq);
+            if (raft_status != ReplServiceError::OK) { handle_error(rreq, raft_status); }
+        }
     } else {
         RD_LOGD("Skipping data channel send since value size is 0");
         rreq->add_state(repl_req_state_t::DATA_WRITTEN);
@@ -196,16 +527,35 @@ void RaftReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const&
 }
 
 void RaftReplDev::push_data_to_all_followers(repl_req_ptr_t rreq, sisl::sg_list const& data) {
+    if (data.size < HS_DYNAMIC_CONFIG(consensus.push_data_batch_size_kb) * 1024ul) {
+        add_to_push_batch(std::move(rreq), data);
+        return;
+    }
+
     auto& builder = rreq->create_fb_builder();
+    auto const compressed_size = compress_data_for_wire(data, rreq->wire_buf());
 
     // Prepare the rpc request packet with all repl_reqs details
-    builder.FinishSizePrefixed(
-        CreatePushDataRequest(builder, server_id(), rreq->term(), rreq->dsn(),
-                              builder.CreateVector(rreq->header().cbytes(), rreq->header().size()),
-                              builder.CreateVector(rreq->key().cbytes(), rreq->key().size()), data.size));
+    builder.FinishSizePrefixed(CreatePushDataRequest(
+        builder, server_id(), rreq->term(), rreq->dsn(),
+        builder.CreateVector(rreq->header().cbytes(), rreq->header().size()),
+        builder.CreateVector(rreq->key().cbytes(), rreq->key().size()), data.size, compressed_size));
 
-    rreq->m_pkts = sisl::io_blob::sg_list_to_ioblob_list(data);
+    if (compressed_size > 0) {
+        rreq->m_pkts = sisl::io_blob_list_t{sisl::io_blob{rreq->wire_buf().bytes(), compressed_size, false}};
+    } else {
+        rreq->m_pkts = sisl::io_blob::sg_list_to_ioblob_list(data);
+    }
     rreq->m_pkts.insert(rreq->m_pkts.begin(), sisl::io_blob{builder.GetBufferPointer(), builder.GetSize(), false});
+    if ((compressed_size == 0) && HS_DYNAMIC_CONFIG(consensus.push_data_aligned)) {
+        // Zero copy on the receiver is possible only if data is aligned within the rpc buffer
+        auto const align = data_service().get_align_size();
+        if (auto const pad = (align - (builder.GetSize() % align)) % align; pad > 0) {
+            RD_REL_ASSERT_LE(pad, s_push_data_pad.size(), "Data service align size is larger than the pad buffer");
+            rreq->m_pkts.insert(rreq->m_pkts.begin() + 1,
+                                sisl::io_blob{const_cast< uint8_t* >(s_push_data_pad.data()), pad, false});
+        }
+    }
 
     /*RD_LOGI("Data Channel: Pushing data to all followers: rreq=[{}] data=[{}]", rreq->to_string(),
            flatbuffers::FlatBufferToString(builder.GetBufferPointer() + sizeof(flatbuffers::uoffset_t),
@@ -225,8 +575,179 @@ void RaftReplDev::push_data_to_all_followers(repl_req_ptr_t rreq, sisl::sg_list
             }
             // Release the buffer which holds the packets
             RD_LOGD("Data Channel: Data push completed for rreq=[{}]", rreq->to_compact_string());
+            rreq->mark_stage(repl_req_stage_t::DATA_PUSHED);
             rreq->release_fb_builder();
             rreq->m_pkts.clear();
+            rreq->wire_buf() = sisl::io_blob_safe{};
+        });
+}
+
+uint32_t RaftReplDev::compress_data_for_wire(sisl::sg_list const& data, sisl::io_blob_safe& out) {
+    auto const min_size = HS_DYNAMIC_CONFIG(consensus.data_wire_compress_min_size);
+    if ((min_size == 0) || (data.size < min_size)) { return 0; }
+
+    auto const compressed_size = compress_for_wire(data.iovs, uint32_cast(data.size), out);
+    if (compressed_size > 0) {
+        COUNTER_INCREMENT(m_metrics, data_wire_compressed_cnt, 1);
+        COUNTER_INCREMENT(m_metrics, data_wire_saved_bytes, data.size - compressed_size);
+    }
+    return compressed_size;
+}
+
+void RaftReplDev::add_to_push_batch(repl_req_ptr_t rreq, sisl::sg_list const& data) {
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > full_batch;
+    {
+        std::unique_lock lg{m_push_batch_mtx};
+        m_push_batch.emplace_back(std::move(rreq), data);
+        m_push_batch_size += data.size;
+        if (m_push_batch_size >= HS_DYNAMIC_CONFIG(consensus.push_data_batch_size_kb) * 1024ul) {
+            full_batch = std::move(m_push_batch);
+            m_push_batch.clear();
+            m_push_batch_size = 0;
+            ++m_push_batch_gen;
+        } else if (m_push_batch.size() == 1) {
+            // First write of the batch, the timer sends the batch if it doesn't fill up by then
+            iomanager.schedule_global_timer(HS_DYNAMIC_CONFIG(consensus.push_data_batch_delay_us) * 1000,
+                                            false /* recurring */, nullptr, iomgr::reactor_regex::random_worker,
+                                            [rd = weak_from_this(), gen = m_push_batch_gen](void*) {
+                                                if (auto rdev = rd.lock()) { rdev->flush_push_batch(gen); }
+                                            });
+        }
+    }
+    if (!full_batch.empty()) { send_push_batch(std::move(full_batch)); }
+}
+
+void RaftReplDev::flush_push_batch(uint64_t gen) {
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch;
+    {
+        std::unique_lock lg{m_push_batch_mtx};
+        if ((gen != m_push_batch_gen) || m_push_batch.empty()) { return; } // Batch has filled up and was sent already
+        batch = std::move(m_push_batch);
+        m_push_batch.clear();
+        m_push_batch_size = 0;
+        ++m_push_batch_gen;
+    }
+    send_push_batch(std::move(batch));
+}
+
+void RaftReplDev::send_push_batch(std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch) {
+    auto builder = std::make_shared< flatbuffers::FlatBufferBuilder >();
+    std::vector< flatbuffers::Offset< PushDataEntry > > entries;
+    entries.reserve(batch.size());
+    for (auto const& [rreq, data] : batch) {
+        entries.push_back(CreatePushDataEntry(*builder, rreq->term(), rreq->dsn(),
+                                              builder->CreateVector(rreq->header().cbytes(), rreq->header().size()),
+                                              builder->CreateVector(rreq->key().cbytes(), rreq->key().size()),
+                                              data.size));
+    }
+    builder->FinishSizePrefixed(CreatePushDataBatchRequest(*builder, server_id(), builder->CreateVector(entries)));
+
+    // Packets are held until the send completes, as the rreq holds them for a single push
+    auto pkts = std::make_shared< sisl::io_blob_list_t >();
+    pkts->emplace_back(builder->GetBufferPointer(), builder->GetSize(), false);
+    if (HS_DYNAMIC_CONFIG(consensus.push_data_aligned)) {
+        auto const align = data_service().get_align_size();
+        if (auto const pad = (align - (builder->GetSize() % align)) % align; pad > 0) {
+            RD_REL_ASSERT_LE(pad, s_push_data_pad.size(), "Data service align size is larger than the pad buffer");
+            pkts->emplace_back(const_cast< uint8_t* >(s_push_data_pad.data()), pad, false);
+        }
+    }
+    for (auto const& [rreq, data] : batch) {
+        auto const data_pkts = sisl::io_blob::sg_list_to_ioblob_list(data);
+        pkts->insert(pkts->end(), data_pkts.begin(), data_pkts.end());
+    }
+
+    RD_LOGD("Data Channel: Pushing batch of {} writes to all followers", batch.size());
+    COUNTER_INCREMENT(m_metrics, push_batch_cnt, 1);
+    COUNTER_INCREMENT(m_metrics, push_batch_entries_cnt, batch.size());
+
+    group_msg_service()
+        ->data_service_request_unidirectional(nuraft_mesg::role_regex::ALL, PUSH_DATA_BATCH, *pkts)
+        .via(&folly::InlineExecutor::instance())
+        .thenValue([this, builder, pkts, batch = std::move(batch)](auto e) {
+            if (e.hasError()) {
+                RD_LOGE("Data Channel: Error in pushing batch of {} writes to all followers: error={}", batch.size(),
+                        e.error());
+                for (auto const& [rreq, data] : batch) {
+                    handle_error(rreq, RaftReplService::to_repl_error(e.error()));
+                }
+                return;
+            }
+            RD_LOGD("Data Channel: Data push completed for batch of {} writes", batch.size());
+            for (auto const& [rreq, data] : batch) {
+                rreq->mark_stage(repl_req_stage_t::DATA_PUSHED);
+            }
+            builder->Release();
+        });
+}
+
+void RaftReplDev::on_push_data_batch_received(intrusive< sisl::GenericRpcData >& rpc_data) {
+    auto const& incoming_buf = rpc_data->request_blob();
+    auto batch_req = GetSizePrefixedPushDataBatchRequest(incoming_buf.cbytes());
+
+    // Data of the entries is at the tail in their order, sender could have padded the header in between
+    uint64_t total_size{0};
+    for (auto const entry : *batch_req->entries()) {
+        total_size += entry->data_size();
+    }
+    HS_DBG_ASSERT_GE(incoming_buf.size(), total_size, "Size mismatch of data size vs buffer size");
+    auto data_offset = incoming_buf.size() - total_size;
+
+    uint32_t nwrites{0};
+    for (auto const entry : *batch_req->entries()) {
+        auto const data = incoming_buf.cbytes() + data_offset;
+        data_offset += entry->data_size();
+
+        repl_key rkey{.server_id = batch_req->issuer_replica_id(), .term = entry->raft_term(), .dsn = entry->dsn()};
+#ifdef _PRERELEASE
+        if (iomgr_flip::instance()->test_flip("drop_push_data_request")) {
+            LOGINFO("Data Channel: Flip is enabled, skip a write of push data batch to simulate fetch remote data, "
+                    "rkey={}",
+                    rkey.to_string());
+            continue;
+        }
+#endif
+
+        auto rreq = applier_create_req(rkey, journal_type_t::HS_DATA_LINKED,
+                                       sisl::blob{entry->user_header()->Data(), entry->user_header()->size()},
+                                       sisl::blob{entry->user_key()->Data(), entry->user_key()->size()},
+                                       entry->data_size(), true /* is_data_channel */);
+        if (rreq == nullptr) {
+            RD_LOG(ERROR,
+                   "Data Channel: Creating rreq on applier has failed, will ignore the push and let Raft channel send "
+                   "trigger a fetch explicitly if needed. rkey={}",
+                   rkey.to_string());
+            continue;
+        }
+
+        // Every rreq of the batch holds the rpc data, which is let go once all of them are done with it
+        if (!rreq->save_pushed_data(rpc_data, data, entry->data_size())) {
+            RD_LOGD("Data Channel: Data already received for rreq=[{}], ignoring this data", rreq->to_compact_string());
+            continue;
+        }
+        write_pushed_data(rreq, entry->data_size(), true /* part_of_batch */);
+        ++nwrites;
+    }
+
+    // Writes of the whole batch are queued to the device together
+    if (nwrites > 0) { data_service().submit_io_batch(); }
+}
+
+void RaftReplDev::write_pushed_data(repl_req_ptr_t rreq, uint32_t data_size, bool part_of_batch) {
+    // Schedule a write and upon completion, mark the data as written.
+    io_tenant_guard tg{io_tenant()};
+    data_service()
+        .async_write(r_cast< const char* >(rreq->data()), data_size, rreq->local_blkid(), part_of_batch)
+        .thenValue([this, rreq](auto&& err) {
+            if (err) {
+                COUNTER_INCREMENT(m_metrics, write_err_cnt, 1);
+                RD_DBG_ASSERT(false, "Error in writing data, error_code={}", err.value());
+                handle_error(rreq, ReplServiceError::DRIVE_WRITE_ERROR);
+            } else {
+                rreq->add_state(repl_req_state_t::DATA_WRITTEN);
+                rreq->m_data_written_promise.setValue();
+                RD_LOGD("Data Channel: Data Write completed rreq=[{}]", rreq->to_compact_string());
+            }
         });
 }
 
@@ -235,7 +756,11 @@ void RaftReplDev::on_push_data_received(intrusive< sisl::GenericRpcData >& rpc_d
     auto const fb_size =
         flatbuffers::ReadScalar< flatbuffers::uoffset_t >(incoming_buf.cbytes()) + sizeof(flatbuffers::uoffset_t);
     auto push_req = GetSizePrefixedPushDataRequest(incoming_buf.cbytes());
-    HS_DBG_ASSERT_EQ(fb_size + push_req->data_size(), incoming_buf.size(), "Size mismatch of data size vs buffer size");
+    auto const wire_size = (push_req->compressed_size() > 0) ? push_req->compressed_size() : push_req->data_size();
+    HS_DBG_ASSERT_GE(incoming_buf.size(), fb_size + wire_size, "Size mismatch of data size vs buffer size");
+
+    // Data is always at the tail, sender could have padded the header in between to have the data aligned
+    auto const data_offset = incoming_buf.size() - wire_size;
 
     sisl::blob header = sisl::blob{push_req->user_header()->Data(), push_req->user_header()->size()};
     sisl::blob key = sisl::blob{push_req->user_key()->Data(), push_req->user_key()->size()};
@@ -260,31 +785,36 @@ void RaftReplDev::on_push_data_received(intrusive< sisl::GenericRpcData >& rpc_d
         return;
     }
 
-    if (!rreq->save_pushed_data(rpc_data, incoming_buf.cbytes() + fb_size, push_req->data_size())) {
+    if (push_req->compressed_size() > 0) {
+        if (rreq->has_state(repl_req_state_t::DATA_RECEIVED)) {
+            RD_LOGD("Data Channel: Data already received for rreq=[{}], ignoring this data", rreq->to_compact_string());
+            return;
+        }
+
+        // Decompressed into a buffer of the request, rpc buffer is let go right away
+        sisl::io_blob_safe buf(push_req->data_size(), data_service().get_align_size());
+        if (decompress_from_wire(incoming_buf.cbytes() + data_offset, push_req->compressed_size(), buf.bytes(),
+                                 push_req->data_size())) {
+            RD_LOGE("Data Channel: Decompression of pushed data failed for rreq=[{}], data will be fetched instead",
+                    rreq->to_compact_string());
+            return;
+        }
+        if (!rreq->save_decompressed_data(std::move(buf))) {
+            RD_LOGD("Data Channel: Data already received for rreq=[{}], ignoring this data", rreq->to_compact_string());
+            return;
+        }
+    } else if (!rreq->save_pushed_data(rpc_data, incoming_buf.cbytes() + data_offset, push_req->data_size())) {
         RD_LOGD("Data Channel: Data already received for rreq=[{}], ignoring this data", rreq->to_compact_string());
         return;
     }
 
-    // Schedule a write and upon completion, mark the data as written.
-    data_service()
-        .async_write(r_cast< const char* >(rreq->data()), push_req->data_size(), rreq->local_blkid())
-        .thenValue([this, rreq](auto&& err) {
-            if (err) {
-                COUNTER_INCREMENT(m_metrics, write_err_cnt, 1);
-                RD_DBG_ASSERT(false, "Error in writing data, error_code={}", err.value());
-                handle_error(rreq, ReplServiceError::DRIVE_WRITE_ERROR);
-            } else {
-                rreq->add_state(repl_req_state_t::DATA_WRITTEN);
-                rreq->m_data_written_promise.setValue();
-                RD_LOGD("Data Channel: Data Write completed rreq=[{}]", rreq->to_compact_string());
-            }
-        });
+    write_pushed_data(rreq, push_req->data_size(), false /* part_of_batch */);
 }
 
 repl_req_ptr_t RaftReplDev::applier_create_req(repl_key const& rkey, journal_type_t code, sisl::blob const& user_header,
                                                sisl::blob const& key, uint32_t data_size,
                                                [[maybe_unused]] bool is_data_channel) {
-    auto const [it, happened] = m_repl_key_req_map.try_emplace(rkey, repl_req_ptr_t(new repl_req_ctx()));
+    auto const [it, happened] = m_repl_key_req_map.try_emplace(rkey, repl_req_ctx::make_pooled());
     RD_DBG_ASSERT((it != m_repl_key_req_map.end()), "Unexpected error in map_repl_key_to_req");
     auto rreq = it->second;
 
@@ -459,7 +989,7 @@ void RaftReplDev::check_and_fetch_remote_data(std::vector< repl_req_ptr_t > rreq
 
         auto const size = rreq->remote_blkid().blkid.blk_count() * get_blk_size();
         if ((total_size_to_fetch + size) >= max_batch_size) {
-            fetch_data_from_remote(std::move(next_batch_rreqs));
+            queue_fetch(std::move(next_batch_rreqs), next_fetch_target(originator));
             next_batch_rreqs.clear();
             total_size_to_fetch = 0;
         }
@@ -467,18 +997,73 @@ void RaftReplDev::check_and_fetch_remote_data(std::vector< repl_req_ptr_t > rreq
         total_size_to_fetch += size;
         next_batch_rreqs.emplace_back(rreq);
     }
-    fetch_data_from_remote(std::move(next_batch_rreqs));
+    queue_fetch(std::move(next_batch_rreqs), next_fetch_target(originator));
 }
 
-void RaftReplDev::fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs) {
+void RaftReplDev::queue_fetch(std::vector< repl_req_ptr_t > rreqs, int32_t target, bool front,
+                              bool accept_compressed) {
     if (rreqs.size() == 0) { return; }
+    {
+        std::unique_lock lg{m_fetch_mtx};
+        if (front) {
+            m_pending_fetches.emplace_front(pending_fetch{std::move(rreqs), target, accept_compressed});
+        } else {
+            m_pending_fetches.emplace_back(pending_fetch{std::move(rreqs), target, accept_compressed});
+        }
+    }
+    issue_pending_fetches();
+}
+
+void RaftReplDev::issue_pending_fetches() {
+    auto const max_inflight = std::max(HS_DYNAMIC_CONFIG(consensus.data_fetch_max_inflight), 1u);
+    std::unique_lock lg{m_fetch_mtx};
+    while (!m_pending_fetches.empty() && (m_fetch_inflight < max_inflight)) {
+        auto f = std::move(m_pending_fetches.front());
+        m_pending_fetches.pop_front();
+        ++m_fetch_inflight;
+
+        // Completion of the fetch could be inline, which issues the next ones itself
+        lg.unlock();
+        fetch_data_from_remote(std::move(f.rreqs), f.target, f.accept_compressed);
+        lg.lock();
+    }
+}
+
+void RaftReplDev::on_fetch_done() {
+    {
+        std::unique_lock lg{m_fetch_mtx};
+        --m_fetch_inflight;
+    }
+    issue_pending_fetches();
+}
+
+int32_t RaftReplDev::next_fetch_target(int32_t originator) {
+    if (!HS_DYNAMIC_CONFIG(consensus.data_fetch_from_peers)) { return originator; }
+
+    // Any of the peers could have written the data by now, the originator is only the one sure to have it
+    std::vector< int32_t > peers;
+    for (auto const& srv : raft_server()->get_config()->get_servers()) {
+        if (srv && (srv->get_id() != server_id())) { peers.push_back(srv->get_id()); }
+    }
+    if (peers.empty()) { return originator; }
+
+    std::unique_lock lg{m_fetch_mtx};
+    return peers[m_fetch_next_peer++ % peers.size()];
+}
+
+void RaftReplDev::fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs, int32_t target,
+                                         bool accept_compressed) {
+    if (rreqs.size() == 0) {
+        on_fetch_done();
+        return;
+    }
 
     std::vector<::flatbuffers::Offset< RequestEntry > > entries;
     entries.reserve(rreqs.size());
 
     shared< flatbuffers::FlatBufferBuilder > builder = std::make_shared< flatbuffers::FlatBufferBuilder >();
     RD_LOGD("Data Channel : FetchData from remote: rreq.size={}, my server_id={}", rreqs.size(), server_id());
-    auto const& originator = rreqs.front()->remote_blkid().server_id;
+    auto const originator = rreqs.front()->remote_blkid().server_id;
 
     for (auto const& rreq : rreqs) {
         entries.push_back(CreateRequestEntry(*builder, rreq->lsn(), rreq->term(), rreq->dsn(),
@@ -497,21 +1082,35 @@ void RaftReplDev::fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs) {
                 rreq->to_compact_string(), rreq->remote_blkid().blkid.to_string(), server_id());
     }
 
-    builder->FinishSizePrefixed(
-        CreateFetchData(*builder, CreateFetchDataRequest(*builder, builder->CreateVector(entries))));
+    // Originator sends the data compressed only if asked to, so that a requester which doesn't know of it gets it as is
+    accept_compressed = accept_compressed && (HS_DYNAMIC_CONFIG(consensus.data_wire_compress_min_size) > 0);
+    builder->FinishSizePrefixed(CreateFetchData(
+        *builder, CreateFetchDataRequest(*builder, builder->CreateVector(entries), accept_compressed)));
 
     COUNTER_INCREMENT(m_metrics, fetch_rreq_cnt, 1);
     COUNTER_INCREMENT(m_metrics, fetch_total_entries_cnt, rreqs.size());
+    if (target != originator) { COUNTER_INCREMENT(m_metrics, fetch_peer_cnt, 1); }
 
     // leader can change, on the receiving side, we need to check if the leader is still the one who originated the
     // blkid;
     group_msg_service()
         ->data_service_request_bidirectional(
-            originator, FETCH_DATA,
+            target, FETCH_DATA,
             sisl::io_blob_list_t{
                 sisl::io_blob{builder->GetBufferPointer(), builder->GetSize(), false /* is_aligned */}})
         .via(&folly::InlineExecutor::instance())
-        .thenValue([this, builder, rreqs = std::move(rreqs)](auto response) {
+        .thenValue([this, builder, target, originator, accept_compressed,
+                    rreqs = std::move(rreqs)](auto response) mutable {
+            if ((target != originator) && (!response || (response.value().response_blob().size() == 0))) {
+                // Peer doesn't have (all of) the data written, originator always has it
+                RD_LOGD("Data Channel: FetchData from peer={} couldn't be served, fetching from originator={}", target,
+                        originator);
+                COUNTER_INCREMENT(m_metrics, fetch_peer_fallback_cnt, 1);
+                queue_fetch(std::move(rreqs), originator, true /* front */, accept_compressed);
+                on_fetch_done();
+                return;
+            }
+
             if (!response) {
                 // if we are here, it means the original who sent the log entries are down.
                 // we need to handle error and when the other member becomes leader, it will resend the log entries;
@@ -531,21 +1130,27 @@ void RaftReplDev::fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs) {
                     }
                 }
                 COUNTER_INCREMENT(m_metrics, fetch_err_cnt, 1);
+                on_fetch_done();
                 return;
             }
 
             builder->Release();
 
-            iomanager.run_on_forget(iomgr::reactor_regex::random_worker,
-                                    [this, r = std::move(response.value()), rreqs = std::move(rreqs)]() {
-                                        handle_fetch_data_response(std::move(r), std::move(rreqs));
-                                    });
+            iomanager.run_on_forget(
+                iomgr::reactor_regex::random_worker,
+                [this, r = std::move(response.value()), rreqs = std::move(rreqs), accept_compressed]() {
+                    handle_fetch_data_response(std::move(r), std::move(rreqs), accept_compressed);
+                });
+
+            // Next fetch is issued while the data of this one is written
+            on_fetch_done();
         });
 }
 
 void RaftReplDev::on_fetch_data_received(intrusive< sisl::GenericRpcData >& rpc_data) {
     auto const& incoming_buf = rpc_data->request_blob();
     auto fetch_req = GetSizePrefixedFetchData(incoming_buf.cbytes());
+    bool const compress = fetch_req->request()->accept_compressed();
 
     RD_LOGD("Data Channel: FetchData received: fetch_req.size={}", fetch_req->request()->entries()->size());
 
@@ -554,41 +1159,78 @@ void RaftReplDev::on_fetch_data_received(intrusive< sisl::GenericRpcData >& rpc_
     sgs_vec.reserve(fetch_req->request()->entries()->size());
     futs.reserve(fetch_req->request()->entries()->size());
 
+    // Blkid to read each of the entries from, with the size of the data as at the originator, once it is written
+    struct fetch_read {
+        MultiBlkId blkid;
+        uint32_t size;
+        folly::Future< folly::Unit > written;
+    };
+    std::vector< fetch_read > reads;
+    reads.reserve(fetch_req->request()->entries()->size());
     for (auto const& req : *(fetch_req->request()->entries())) {
         auto const& lsn = req->lsn();
         auto const& originator = req->blkid_originator();
         auto const& remote_blkid = req->remote_blkid();
 
-        // release this assert if in the future we want to fetch from non-originator;
-        RD_REL_ASSERT_EQ(originator, server_id(),
-                         "Not expect to receive fetch data from remote when I am not the originator of this request");
-
-        // fetch data based on the remote_blkid
-        if (originator == server_id()) {
-            // We are the originator of the blkid, read data locally;
-            MultiBlkId local_blkid;
-
-            // convert remote_blkid serialized data to local blkid
-            local_blkid.deserialize(sisl::blob{remote_blkid->Data(), remote_blkid->size()}, true /* copy */);
-
-            RD_LOGD("Data Channel: FetchData received: dsn={} lsn={} my_blkid={}", req->dsn(), lsn,
-                    local_blkid.to_string());
+        // convert remote_blkid serialized data to local blkid
+        MultiBlkId blkid;
+        blkid.deserialize(sisl::blob{remote_blkid->Data(), remote_blkid->size()}, true /* copy */);
+        auto const total_size = blkid.blk_count() * get_blk_size();
+
+        if (originator != server_id()) {
+            // Requester fetches from a peer, which serves it only if it has the data of the entry written already
+            auto const rreq = repl_key_to_req(repl_key{.server_id = originator, .term = req->raft_term(),
+                                                       .dsn = req->dsn()});
+            if ((rreq == nullptr) || !rreq->has_state(repl_req_state_t::DATA_WRITTEN)) {
+                RD_LOGD("Data Channel: FetchData received for dsn={} lsn={} which is not written here, requester "
+                        "will fetch from originator={}",
+                        req->dsn(), lsn, originator);
+                rpc_data->send_response(nuraft_mesg::io_blob_list_t{});
+                return;
+            }
+            blkid = rreq->local_blkid();
+        } else if (!is_blkid_of_lsn(lsn, blkid)) {
+            // Blks could have been freed and reused since the requester learnt of them
+            RD_LOGD("Data Channel: FetchData received for lsn={} blkid={}, which is not of the lsn anymore", lsn,
+                    blkid.to_string());
+            rpc_data->send_response(nuraft_mesg::io_blob_list_t{});
+            return;
+        } else if (auto const rreq =
+                       repl_key_to_req(repl_key{.server_id = originator, .term = req->raft_term(), .dsn = req->dsn()});
+                   (rreq != nullptr) && rreq->has_linked_data() && !rreq->has_state(repl_req_state_t::DATA_WRITTEN)) {
+            // Entry of this replica could be proposed while its data is still being written
+            // (consensus.leader_overlap_data_write), it is served once written
+            RD_LOGD("Data Channel: FetchData received for dsn={} lsn={} before its data is written, waiting for it",
+                    req->dsn(), lsn);
+            COUNTER_INCREMENT(m_metrics, fetch_wait_data_write_cnt, 1);
+            reads.push_back(fetch_read{std::move(blkid), total_size, rreq->m_data_written_promise.getFuture()});
+            continue;
+        }
 
-            // prepare the sgs data buffer to read into;
-            auto const total_size = local_blkid.blk_count() * get_blk_size();
-            sisl::sg_list sgs;
-            sgs.size = total_size;
-            sgs.iovs.emplace_back(
-                iovec{.iov_base = iomanager.iobuf_alloc(get_blk_size(), total_size), .iov_len = total_size});
+        RD_LOGD("Data Channel: FetchData received: dsn={} lsn={} my_blkid={}", req->dsn(), lsn, blkid.to_string());
+        reads.push_back(fetch_read{std::move(blkid), total_size, folly::makeFuture()});
+    }
 
-            // accumulate the sgs for later use (send back to the requester));
-            sgs_vec.push_back(sgs);
-            futs.emplace_back(async_read(local_blkid, sgs, total_size));
-        }
+    for (auto& r : reads) {
+        auto const total_size = r.size;
+        // prepare the sgs data buffer to read into;
+        sisl::sg_list sgs;
+        sgs.size = total_size;
+        sgs.iovs.emplace_back(iovec{.iov_base = hs_utils::iobuf_alloc(total_size, sisl::buftag::data, get_blk_size()),
+                                    .iov_len = total_size});
+
+        // accumulate the sgs for later use (send back to the requester));
+        sgs_vec.push_back(sgs);
+        futs.emplace_back(
+            std::move(r.written).thenValue([this, blkid = std::move(r.blkid), sgs, total_size](auto&&) mutable {
+                // Serving a lagging follower, not to be done at the cost of ios of this replica's own consumer
+                io_priority_guard g{io_priority_t::recovery};
+                return async_read(blkid, sgs, total_size);
+            }));
     }
 
     folly::collectAllUnsafe(futs).thenValue(
-        [this, rpc_data = std::move(rpc_data), sgs_vec = std::move(sgs_vec)](auto&& vf) {
+        [this, rpc_data = std::move(rpc_data), sgs_vec = std::move(sgs_vec), compress](auto&& vf) {
             for (auto const& err_c : vf) {
                 if (sisl_unlikely(err_c.value())) {
                     COUNTER_INCREMENT(m_metrics, read_err_cnt, 1);
@@ -603,15 +1245,41 @@ void RaftReplDev::on_fetch_data_received(intrusive< sisl::GenericRpcData >& rpc_
 
             // now prepare the io_blob_list to response back to requester;
             nuraft_mesg::io_blob_list_t pkts = sisl::io_blob_list_t{};
-            for (auto const& sgs : sgs_vec) {
-                auto const ret = sisl::io_blob::sg_list_to_ioblob_list(sgs);
-                pkts.insert(pkts.end(), ret.begin(), ret.end());
+            auto builder = std::make_shared< flatbuffers::FlatBufferBuilder >();
+            auto cbufs = std::make_shared< std::vector< sisl::io_blob_safe > >(sgs_vec.size());
+            std::vector< uint32_t > csizes(sgs_vec.size(), 0);
+            if (compress) {
+                // Requester is told which of the entries that follow are compressed, by a response in front of them
+                auto const* req_entries =
+                    GetSizePrefixedFetchData(rpc_data->request_blob().cbytes())->request()->entries();
+                std::vector<::flatbuffers::Offset< ResponseEntry > > entries;
+                entries.reserve(sgs_vec.size());
+                for (uint32_t i{0}; i < sgs_vec.size(); ++i) {
+                    auto const* req = req_entries->Get(i);
+                    csizes[i] = compress_data_for_wire(sgs_vec[i], (*cbufs)[i]);
+                    entries.push_back(CreateResponseEntry(*builder, req->lsn(), req->dsn(), req->raft_term(),
+                                                          uint32_cast(sgs_vec[i].size), csizes[i]));
+                }
+                builder->FinishSizePrefixed(
+                    CreateFetchData(*builder, 0 /* request */,
+                                    CreateFetchDataResponse(*builder, server_id(), builder->CreateVector(entries))));
+                pkts.push_back(sisl::io_blob{builder->GetBufferPointer(), builder->GetSize(), false});
+            }
+            for (uint32_t i{0}; i < sgs_vec.size(); ++i) {
+                if (csizes[i] > 0) {
+                    pkts.push_back(sisl::io_blob{(*cbufs)[i].bytes(), csizes[i], false});
+                } else {
+                    auto const ret = sisl::io_blob::sg_list_to_ioblob_list(sgs_vec[i]);
+                    pkts.insert(pkts.end(), ret.begin(), ret.end());
+                }
             }
 
-            rpc_data->set_comp_cb([sgs_vec = std::move(sgs_vec)](boost::intrusive_ptr< sisl::GenericRpcData >&) {
+            // Response header and the compressed bufs are let go along with the cb
+            rpc_data->set_comp_cb([sgs_vec = std::move(sgs_vec), builder,
+                                   cbufs](boost::intrusive_ptr< sisl::GenericRpcData >&) {
                 for (auto const& sgs : sgs_vec) {
                     for (auto const& iov : sgs.iovs) {
-                        iomanager.iobuf_free(reinterpret_cast< uint8_t* >(iov.iov_base));
+                        hs_utils::iobuf_free(reinterpret_cast< uint8_t* >(iov.iov_base), sisl::buftag::data);
                     }
                 }
             });
@@ -620,8 +1288,8 @@ void RaftReplDev::on_fetch_data_received(intrusive< sisl::GenericRpcData >& rpc_
         });
 }
 
-void RaftReplDev::handle_fetch_data_response(sisl::GenericClientResponse response,
-                                             std::vector< repl_req_ptr_t > rreqs) {
+void RaftReplDev::handle_fetch_data_response(sisl::GenericClientResponse response, std::vector< repl_req_ptr_t > rreqs,
+                                             bool accept_compressed) {
     auto resp_blob = response.response_blob();
     auto raw_data = resp_blob.cbytes();
     auto total_size = resp_blob.size();
@@ -633,10 +1301,41 @@ void RaftReplDev::handle_fetch_data_response(sisl::GenericClientResponse respons
 
     RD_LOGD("Data Channel: FetchData completed for {} requests", rreqs.size());
 
-    for (auto const& rreq : rreqs) {
+    // Data of the entries is preceded by the response telling which of them are compressed, if it was asked for
+    flatbuffers::Vector< flatbuffers::Offset< ResponseEntry > > const* resp_entries{nullptr};
+    if (accept_compressed) {
+        auto const fb_size =
+            flatbuffers::ReadScalar< flatbuffers::uoffset_t >(raw_data) + sizeof(flatbuffers::uoffset_t);
+        resp_entries = GetSizePrefixedFetchData(raw_data)->response()->entries();
+        RD_REL_ASSERT_EQ(resp_entries->size(), rreqs.size(), "Entries in FetchData response mismatch the request");
+        raw_data += fb_size;
+        total_size -= fb_size;
+    }
+
+    std::vector< repl_req_ptr_t > refetch_rreqs;
+    for (uint32_t i{0}; i < rreqs.size(); ++i) {
+        auto const& rreq = rreqs[i];
         auto const data_size = rreq->remote_blkid().blkid.blk_count() * get_blk_size();
+        auto const compressed_size = resp_entries ? resp_entries->Get(i)->compressed_size() : 0u;
+
+        bool saved{false};
+        if (compressed_size == 0) {
+            saved = rreq->save_fetched_data(response, raw_data, data_size);
+        } else if (!rreq->has_state(repl_req_state_t::DATA_RECEIVED)) {
+            sisl::io_blob_safe buf(data_size, data_service().get_align_size());
+            if (decompress_from_wire(raw_data, compressed_size, buf.bytes(), data_size)) {
+                RD_LOGE("Data Channel: Decompression of fetched data failed for rreq=[{}], fetching it uncompressed",
+                        rreq->to_compact_string());
+                COUNTER_INCREMENT(m_metrics, fetch_decompress_err_cnt, 1);
+                refetch_rreqs.push_back(rreq);
+                raw_data += compressed_size;
+                total_size -= compressed_size;
+                continue;
+            }
+            saved = rreq->save_decompressed_data(std::move(buf));
+        }
 
-        if (!rreq->save_fetched_data(response, raw_data, data_size)) {
+        if (!saved) {
             RD_DBG_ASSERT(rreq->local_blkid().is_valid(), "Invalid blkid for rreq={}", rreq->to_compact_string());
             auto const local_size = rreq->local_blkid().blk_count() * get_blk_size();
             RD_DBG_ASSERT_EQ(data_size, local_size, "Data size mismatch for rreq={} remote size: {}, local size: {}",
@@ -645,8 +1344,11 @@ void RaftReplDev::handle_fetch_data_response(sisl::GenericClientResponse respons
             RD_LOGD("Data Channel: Data already received for rreq=[{}], skip and move on to next rreq.",
                     rreq->to_compact_string());
         } else {
+            io_priority_guard g{io_priority_t::recovery};
+            io_tenant_guard tg{io_tenant()};
             data_service()
-                .async_write(r_cast< const char* >(rreq->data()), data_size, rreq->local_blkid())
+                .async_write(r_cast< const char* >(rreq->data()), data_size, rreq->local_blkid(),
+                             true /* part_of_batch */)
                 .thenValue([this, rreq](auto&& err) {
                     RD_REL_ASSERT(!err,
                                   "Error in writing data"); // TODO: Find a way to return error to the Listener
@@ -657,14 +1359,26 @@ void RaftReplDev::handle_fetch_data_response(sisl::GenericClientResponse respons
             RD_LOGD("Data Channel: Data fetched from remote: rreq=[{}], data_size: {}, total_size: {}, local_blkid: {}",
                     rreq->to_compact_string(), data_size, total_size, rreq->local_blkid().to_string());
         }
-        raw_data += data_size;
-        total_size -= data_size;
+        auto const wire_size = (compressed_size > 0) ? compressed_size : data_size;
+        raw_data += wire_size;
+        total_size -= wire_size;
     }
 
     RD_DBG_ASSERT_EQ(total_size, 0, "Total size mismatch, some data is not consumed");
+
+    // Writes of all the entries, straight from the response buffer, are queued to the device together
+    data_service().submit_io_batch();
+
+    // Originator always has the data, whichever peer it was fetched from
+    if (!refetch_rreqs.empty()) {
+        auto const originator = refetch_rreqs.front()->remote_blkid().server_id;
+        queue_fetch(std::move(refetch_rreqs), originator, true /* front */, false /* accept_compressed */);
+    }
 }
 
-void RaftReplDev::handle_commit(repl_req_ptr_t rreq) {
+void RaftReplDev::handle_commit(repl_req_ptr_t rreq, bool can_batch) {
+    rreq->mark_stage(repl_req_stage_t::COMMITTED);
+    HS_PROBE(repl_commit, rreq->lsn(), rreq->dsn());
     if (rreq->local_blkid().is_valid()) {
         if (data_service().commit_blk(rreq->local_blkid()) != BlkAllocStatus::SUCCESS) {
             if (hs()->device_mgr()->is_boot_in_degraded_mode() && m_log_store_replay_done)
@@ -683,18 +1397,123 @@ void RaftReplDev::handle_commit(repl_req_ptr_t rreq) {
     }
 
     RD_LOGD("Raft channel: Commit rreq=[{}]", rreq->to_compact_string());
+    if (can_batch && apply_in_parallel(rreq)) { return; }
+
+    // Rest of the commits are applied in order with all of the ones before
+    wait_for_parallel_applies();
     if (rreq->op_code() == journal_type_t::HS_CTRL_DESTROY) {
+        flush_commit_batch();
         leave();
+    } else if (auto const max_batch = HS_DYNAMIC_CONFIG(consensus.commit_batch_max_entries);
+               can_batch && (max_batch > 1)) {
+        // Raft applies all the entries upto its target commit index in one go, which ends the batch
+        m_commit_batch.push_back(rreq);
+        if ((m_commit_batch.size() >= max_batch) ||
+            (uint64_cast(rreq->lsn()) >= raft_server()->get_target_committed_log_idx())) {
+            flush_commit_batch();
+        }
+        return;
     } else {
+        flush_commit_batch();
+        TraceScope trace_scope{rreq->trace_id()};
         m_listener->on_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq->local_blkid(), rreq);
     }
+    commit_done(rreq);
+}
+
+void RaftReplDev::flush_commit_batch() {
+    if (m_commit_batch.empty()) { return; }
+
+    std::vector< repl_commit_record > records;
+    records.reserve(m_commit_batch.size());
+    for (auto const& rreq : m_commit_batch) {
+        records.push_back(repl_commit_record{.lsn = rreq->lsn(),
+                                             .header = rreq->header(),
+                                             .key = rreq->key(),
+                                             .blkids = rreq->local_blkid(),
+                                             .ctx = rreq});
+    }
+    m_listener->on_commit_batch(records);
+
+    for (auto const& rreq : m_commit_batch) {
+        commit_done(rreq);
+    }
+    m_commit_batch.clear();
+}
+
+bool RaftReplDev::apply_in_parallel(repl_req_ptr_t const& rreq) {
+    if (!m_repl_svc.has_commit_threads() || (rreq->op_code() == journal_type_t::HS_CTRL_DESTROY)) { return false; }
+
+    auto const order_key = m_listener->commit_order_key(rreq->header(), rreq->key());
+    if (!order_key) { return false; }
+    auto fiber = m_repl_svc.commit_fiber(*order_key);
+
+    // Batch collected so far could have entries of the same key, which are to be applied before
+    flush_commit_batch();
+    {
+        std::unique_lock lg{m_apply_mtx};
+        m_applying.insert(rreq->lsn());
+        m_last_dispatched_lsn = rreq->lsn();
+    }
+
+    // Repl dev is kept alive upto the apply, which could still be queued on the fiber while the service stops
+    iomanager.run_on_forget(fiber, [this, rd = shared_from_this(), rreq]() {
+        {
+            TraceScope trace_scope{rreq->trace_id()};
+            m_listener->on_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq->local_blkid(), rreq);
+        }
+        report_stage_latencies(rreq);
+        if (!rreq->is_proposer()) { rreq->clear(); }
+
+        // Commit lsn moves upto the lowest lsn which is still being applied, as raft resumes from it on a restart
+        std::unique_lock lg{m_apply_mtx};
+        m_applying.erase(rreq->lsn());
+        auto const upto = m_applying.empty() ? m_last_dispatched_lsn : (*m_applying.begin() - 1);
+        if (upto > m_commit_upto_lsn.load()) { m_commit_upto_lsn.store(upto); }
+        if (m_applying.empty()) { m_apply_cv.notify_all(); }
+        lg.unlock();
+        notify_read_waiters();
+    });
+    return true;
+}
 
+void RaftReplDev::wait_for_parallel_applies() {
+    std::unique_lock lg{m_apply_mtx};
+    m_apply_cv.wait(lg, [this] { return m_applying.empty(); });
+}
+
+void RaftReplDev::commit_done(repl_req_ptr_t const& rreq) {
+    // Commit lsn moves only once listener has the entry, as raft resumes from it on a restart
     auto prev_lsn = m_commit_upto_lsn.exchange(rreq->lsn());
     RD_DBG_ASSERT_GT(rreq->lsn(), prev_lsn, "Out of order commit of lsns, it is not expected in RaftReplDev");
+    notify_read_waiters();
+    report_stage_latencies(rreq);
 
     if (!rreq->is_proposer()) { rreq->clear(); }
 }
 
+void RaftReplDev::report_stage_latencies(repl_req_ptr_t const& rreq) {
+    rreq->mark_stage(repl_req_stage_t::COMMIT_DONE);
+
+    // Stages reached by now, data push on the proposer could still complete after the commit, which is left out
+    auto const observe = [&rreq](repl_req_stage_t s, auto&& fn) {
+        if (auto const t = rreq->stage_time_us(s); t) { fn(t); }
+    };
+    observe(repl_req_stage_t::PROPOSED,
+            [this](uint64_t t) { HISTOGRAM_OBSERVE(m_metrics, rreq_propose_latency_us, t); });
+    observe(repl_req_stage_t::DATA_PUSHED,
+            [this](uint64_t t) { HISTOGRAM_OBSERVE(m_metrics, rreq_data_push_latency_us, t); });
+    observe(repl_req_stage_t::LOG_FLUSHED,
+            [this](uint64_t t) { HISTOGRAM_OBSERVE(m_metrics, rreq_log_flush_latency_us, t); });
+    observe(repl_req_stage_t::COMMITTED,
+            [this](uint64_t t) { HISTOGRAM_OBSERVE(m_metrics, rreq_raft_commit_latency_us, t); });
+    observe(repl_req_stage_t::DATA_WRITTEN,
+            [this](uint64_t t) { HISTOGRAM_OBSERVE(m_metrics, rreq_data_write_latency_us, t); });
+    auto const committed = rreq->stage_time_us(repl_req_stage_t::COMMITTED);
+    auto const done = rreq->stage_time_us(repl_req_stage_t::COMMIT_DONE);
+    if (committed) { HISTOGRAM_OBSERVE(m_metrics, rreq_commit_cb_latency_us, done - std::min(committed, done)); }
+}
+
 void RaftReplDev::handle_error(repl_req_ptr_t const& rreq, ReplServiceError err) {
     if (err == ReplServiceError::OK) { return; }
 
@@ -706,7 +1525,7 @@ void RaftReplDev::handle_error(repl_req_ptr_t const& rreq, ReplServiceError err)
     // Remove from the map and thus its no longer accessible from applier_create_req
     m_repl_key_req_map.erase(rreq->rkey());
 
-    if (rreq->op_code() == journal_type_t::HS_DATA_INLINED) {
+    if ((rreq->op_code() == journal_type_t::HS_DATA_INLINED) || rreq->has_embedded_data()) {
         // Free the blks which is allocated already
         RD_LOGE("Raft Channel: Error in processing rreq=[{}] error={}", rreq->to_compact_string(), err);
         if (rreq->has_state(repl_req_state_t::BLK_ALLOCATED)) {
@@ -745,9 +1564,206 @@ repl_req_ptr_t RaftReplDev::repl_key_to_req(repl_key const& rkey) const {
 
 folly::Future< std::error_code > RaftReplDev::async_read(MultiBlkId const& bid, sisl::sg_list& sgs, uint32_t size,
                                                          bool part_of_batch) {
+    io_tenant_guard tg{io_tenant()};
     return data_service().async_read(bid, sgs, size, part_of_batch);
 }
 
+// Shared by the local and the remote read of a hedged read, the first of them to succeed completes it
+struct RaftReplDev::hedged_read_ctx {
+    hedged_read_ctx(sisl::sg_list const& s, uint32_t sz, uint32_t align) :
+            sgs{s}, size{sz}, local_buf{hs_utils::iobuf_alloc(sz, sisl::buftag::data, align)} {}
+    ~hedged_read_ctx() { hs_utils::iobuf_free(local_buf, sisl::buftag::data); }
+
+    // Remote read is to be issued, if it isn't already and the read is not done yet
+    bool start_remote() {
+        std::unique_lock lg{mtx};
+        if (completed || remote_issued) { return false; }
+        remote_issued = true;
+        ++outstanding;
+        return true;
+    }
+
+    // Completes the read with the data if the read is the first to succeed, or with the error if all of them failed
+    bool done(std::error_code err, uint8_t const* data) {
+        {
+            std::unique_lock lg{mtx};
+            --outstanding;
+            if (completed || (err && (outstanding > 0))) { return false; }
+            completed = true;
+        }
+        if (!err) {
+            uint32_t offset{0};
+            for (auto const& iov : sgs.iovs) {
+                if (offset >= size) { break; }
+                auto const len = std::min(uint32_cast(iov.iov_len), size - offset);
+                std::memcpy(iov.iov_base, data + offset, len);
+                offset += len;
+            }
+        }
+        promise.setValue(err);
+        return !err;
+    }
+
+    // Timer to issue the remote read, which is cancelled if the local read is done before
+    void cancel_timer() {
+        iomgr::timer_handle_t hdl{iomgr::null_timer_handle};
+        {
+            std::unique_lock lg{mtx};
+            std::swap(hdl, timer_hdl);
+        }
+        if (hdl != iomgr::null_timer_handle) { iomanager.cancel_timer(hdl); }
+    }
+
+    sisl::sg_list sgs;
+    uint32_t size;
+    uint8_t* local_buf;
+    folly::Promise< std::error_code > promise;
+
+    std::mutex mtx;
+    iomgr::timer_handle_t timer_hdl{iomgr::null_timer_handle};
+    bool completed{false};
+    bool remote_issued{false};
+    uint32_t outstanding{1}; // Reads not done yet
+};
+
+folly::Future< std::error_code > RaftReplDev::async_read_hedged(MultiBlkId const& blkid, sisl::sg_list& sgs,
+                                                                uint32_t size, RemoteBlkId const& remote,
+                                                                int64_t lsn) {
+    // Replica serves the whole blks of its blkid as is, so data compressed on either side is not hedged
+    auto const blk_size = get_blk_size();
+    if (!HS_DYNAMIC_CONFIG(consensus.hedged_read_enabled) || (remote.server_id == server_id()) || (lsn <= 0) ||
+        !remote.blkid.is_valid() || (size > blkid.blk_count() * blk_size) ||
+        (size > remote.blkid.blk_count() * blk_size)) {
+        return async_read(blkid, sgs, size);
+    }
+
+    auto ctx = std::make_shared< hedged_read_ctx >(sgs, size, blk_size);
+    auto fut = ctx->promise.getFuture();
+
+    // Tail latency is of the drive as a whole, the slowest few reads of it are the ones hedged
+    auto const delay_us =
+        std::max(data_service().read_tail_latency_us(blkid), HS_DYNAMIC_CONFIG(consensus.hedged_read_min_delay_us));
+    auto const hdl = iomanager.schedule_global_timer(
+        delay_us * 1000, false /* recurring */, nullptr, iomgr::reactor_regex::random_worker,
+        [rd = weak_from_this(), ctx, remote, lsn](void*) {
+            auto rdev = rd.lock();
+            if (rdev && ctx->start_remote()) { rdev->hedge_read_from_remote(ctx, remote, lsn); }
+        });
+    {
+        std::unique_lock lg{ctx->mtx};
+        if (!ctx->remote_issued) { ctx->timer_hdl = hdl; }
+    }
+
+    auto issue_local = [this, ctx, blkid, remote, lsn, tenant = io_tenant()]() {
+        io_tenant_guard tg{tenant};
+        data_service().async_read(blkid, ctx->local_buf, ctx->size).thenValue([this, ctx, remote, lsn](auto err) {
+            if (err) {
+                COUNTER_INCREMENT(m_metrics, read_err_cnt, 1);
+                // Failed read is hedged right away, if it isn't already
+                if (ctx->start_remote()) { hedge_read_from_remote(ctx, remote, lsn); }
+            }
+            if (ctx->done(err, ctx->local_buf)) { ctx->cancel_timer(); }
+        });
+    };
+#ifdef _PRERELEASE
+    if (iomgr_flip::instance()->delay_flip("simulate_hedged_read_local_delay", issue_local)) { return fut; }
+#endif
+    issue_local();
+    return fut;
+}
+
+void RaftReplDev::hedge_read_from_remote(shared< hedged_read_ctx > ctx, RemoteBlkId const& remote, int64_t lsn) {
+    COUNTER_INCREMENT(m_metrics, hedged_read_cnt, 1);
+
+    // Entry of the replica's own blkid, which it reads as is once it validates the blkid is still of the lsn
+    auto builder = std::make_shared< flatbuffers::FlatBufferBuilder >();
+    std::vector<::flatbuffers::Offset< RequestEntry > > entries{CreateRequestEntry(
+        *builder, lsn, 0 /* raft_term */, 0 /* dsn */, 0 /* user_header */, 0 /* user_key */, remote.server_id,
+        builder->CreateVector(remote.blkid.serialize().cbytes(), remote.blkid.serialized_size()))};
+    builder->FinishSizePrefixed(
+        CreateFetchData(*builder, CreateFetchDataRequest(*builder, builder->CreateVector(entries))));
+
+    group_msg_service()
+        ->data_service_request_bidirectional(
+            remote.server_id, FETCH_DATA,
+            sisl::io_blob_list_t{
+                sisl::io_blob{builder->GetBufferPointer(), builder->GetSize(), false /* is_aligned */}})
+        .via(&folly::InlineExecutor::instance())
+        .thenValue([this, builder, ctx, server_id = remote.server_id](auto response) {
+            if (!response || (response.value().response_blob().size() < ctx->size)) {
+                RD_LOGD("Data Channel: Hedged read from replica={} failed", server_id);
+                ctx->done(std::make_error_code(std::errc::io_error), nullptr);
+                return;
+            }
+            if (ctx->done(std::error_code{}, response.value().response_blob().cbytes())) {
+                COUNTER_INCREMENT(m_metrics, hedged_read_remote_cnt, 1);
+            }
+        });
+}
+
+// Data of the entry at lsn, which this replica originated, is still at the blkid: the entry in the log is of the blkid
+// and the blks are not freed since. Entry which is truncated from the log can't be told apart from another entry which
+// the blks were freed and reallocated to since, so it is not served and the requester has to catch up otherwise.
+bool RaftReplDev::is_blkid_of_lsn(int64_t lsn, MultiBlkId const& blkid) {
+    if (!data_service().is_blk_alloced(blkid)) { return false; }
+    if ((lsn <= 0) || (uint64_cast(lsn) < m_data_journal->start_index()) ||
+        (uint64_cast(lsn) >= m_data_journal->next_slot())) {
+        return false;
+    }
+
+    auto const lentry = m_data_journal->entry_at(uint64_cast(lsn));
+    if ((lentry == nullptr) || (lentry->get_val_type() != nuraft::log_val_type::app_log)) { return false; }
+    auto const* jentry = r_cast< repl_journal_entry const* >(lentry->get_buf().data_begin());
+    if ((jentry->server_id != server_id()) || (jentry->value_size == 0) ||
+        ((jentry->code != journal_type_t::HS_DATA_LINKED) && (jentry->code != journal_type_t::HS_DATA_EMBEDDED))) {
+        return false;
+    }
+
+    MultiBlkId entry_blkid;
+    entry_blkid.deserialize(sisl::blob{r_cast< uint8_t const* >(jentry) + sizeof(repl_journal_entry) +
+                                           jentry->user_header_size + jentry->key_size,
+                                       jentry->value_size},
+                            jentry->blkid_format());
+    return (entry_blkid == blkid);
+}
+
+AsyncReplResult<> RaftReplDev::wait_for_consistent_read(repl_read_consistency_t consistency) {
+    if ((consistency == repl_read_consistency_t::LOCAL) || is_leader()) { return make_async_success<>(); }
+    if (consistency == repl_read_consistency_t::LEADER) { return make_async_error<>(ReplServiceError::NOT_LEADER); }
+
+    // Commit lsn of the leader is as of its last append/heartbeat, which is recent only while it is alive
+    if (!raft_server()->is_leader_alive()) { return make_async_error<>(ReplServiceError::NOT_LEADER); }
+    auto const target_lsn = s_cast< repl_lsn_t >(raft_server()->get_leader_committed_log_idx());
+    COUNTER_INCREMENT(m_metrics, follower_read_cnt, 1);
+    if (m_commit_upto_lsn.load() >= target_lsn) { return make_async_success<>(); }
+
+    std::unique_lock lg{m_read_waiters_mtx};
+    if (m_commit_upto_lsn.load() >= target_lsn) { return make_async_success<>(); } // Committed, before we took lock
+    COUNTER_INCREMENT(m_metrics, follower_read_wait_cnt, 1);
+    auto [p, sf] = folly::makePromiseContract< ReplResult< folly::Unit > >();
+    m_read_waiters.emplace(target_lsn, std::move(p));
+    return std::move(sf)
+        .within(std::chrono::milliseconds(HS_DYNAMIC_CONFIG(consensus.follower_read_max_wait_ms)))
+        .deferError(folly::tag_t< folly::FutureTimeout >{}, [](auto const&) {
+            return ReplResult< folly::Unit >(folly::makeUnexpected(ReplServiceError::TIMEOUT));
+        });
+}
+
+void RaftReplDev::notify_read_waiters() {
+    std::vector< folly::Promise< ReplResult< folly::Unit > > > ready;
+    {
+        std::unique_lock lg{m_read_waiters_mtx};
+        auto const upto = m_commit_upto_lsn.load();
+        while (!m_read_waiters.empty() && (m_read_waiters.begin()->first <= upto)) {
+            ready.push_back(std::move(m_read_waiters.begin()->second));
+            m_read_waiters.erase(m_read_waiters.begin());
+        }
+    }
+    for (auto& p : ready) {
+        p.setValue(folly::Unit{});
+    }
+}
+
 void RaftReplDev::async_free_blks(int64_t, MultiBlkId const& bid) {
     // TODO: For timeline consistency required, we should retain the blkid that is changed and write that to another
     // journal.
@@ -789,28 +1805,7 @@ nuraft_mesg::repl_service_ctx* RaftReplDev::group_msg_service() { return m_repl_
 nuraft::raft_server* RaftReplDev::raft_server() { return m_repl_svc_ctx->_server; }
 
 ///////////////////////////////////  Config Serialize/Deserialize Section ////////////////////////////////////
-static nlohmann::json serialize_server_config(std::list< nuraft::ptr< nuraft::srv_config > > const& server_list) {
-    auto servers = nlohmann::json::array();
-    for (auto const& server_conf : server_list) {
-        if (!server_conf) { continue; }
-        servers.push_back(nlohmann::json{{"id", server_conf->get_id()},
-                                         {"dc_id", server_conf->get_dc_id()},
-                                         {"endpoint", server_conf->get_endpoint()},
-                                         {"aux", server_conf->get_aux()},
-                                         {"learner", server_conf->is_learner()},
-                                         {"priority", server_conf->get_priority()}});
-    }
-    return servers;
-}
-
-static nlohmann::json serialize_cluster_config(const nuraft::cluster_config& config) {
-    return nlohmann::json{{"log_idx", config.get_log_idx()},
-                          {"prev_log_idx", config.get_prev_log_idx()},
-                          {"eventual_consistency", config.is_async_replication()},
-                          {"user_ctx", config.get_user_ctx()},
-                          {"servers", serialize_server_config(config.get_servers())}};
-}
-
+// Raft config superblks written by the older versions are msgpack json, which is converted on the next save
 static nuraft::ptr< nuraft::srv_config > deserialize_server_config(nlohmann::json const& server) {
     DEBUG_ASSERT(server.contains("id"), "Missing field")
     auto const id = static_cast< int32_t >(server["id"]);
@@ -850,44 +1845,127 @@ nuraft::ptr< nuraft::cluster_config > deserialize_cluster_config(nlohmann::json
     return raft_config;
 }
 
-nuraft::ptr< nuraft::cluster_config > RaftReplDev::load_config() {
+static bool is_fb_raft_config(std::vector< uint8_t > const& raft_config) {
+    if ((raft_config.size() < flatbuffers::FileIdentifierLength + sizeof(flatbuffers::uoffset_t)) ||
+        !RaftConfigSbBufferHasIdentifier(raft_config.data())) {
+        return false;
+    }
+    flatbuffers::Verifier verifier{raft_config.data(), raft_config.size()};
+    RELEASE_ASSERT(VerifyRaftConfigSbBuffer(verifier), "Corrupted raft_config superblk");
+    return true;
+}
+
+static nlohmann::json load_json_raft_config(std::vector< uint8_t > const& raft_config) {
+    try {
+        return nlohmann::json::from_msgpack(raft_config);
+    } catch (nlohmann::json::exception const& e) {
+        DEBUG_ASSERT(false, "Failed to load json raft_config superblk, error={}", e.what());
+        return nlohmann::json{};
+    }
+}
+
+std::string RaftReplDev::config_group_id(std::vector< uint8_t > const& raft_config) {
+    if (is_fb_raft_config(raft_config)) {
+        auto const gid = GetRaftConfigSb(raft_config.data())->group_id();
+        return gid ? gid->str() : std::string{};
+    }
+
+    auto const js = load_json_raft_config(raft_config);
+    DEBUG_ASSERT(js.contains("group_id"), "Missing group_id field in raft_config superblk");
+    return js.value("group_id", std::string{});
+}
+
+RaftReplDev::raft_config_data RaftReplDev::decode_raft_config(std::vector< uint8_t > const& raft_config) {
+    raft_config_data cfg;
+    if (is_fb_raft_config(raft_config)) {
+        auto const sb = GetRaftConfigSb(raft_config.data());
+        if (sb->group_id()) { cfg.group_id = sb->group_id()->str(); }
+        if (sb->cluster_config() && (sb->cluster_config()->size() > 0)) {
+            cfg.config_buf = nuraft::buffer::alloc(sb->cluster_config()->size());
+            std::memcpy(cfg.config_buf->data_begin(), sb->cluster_config()->data(), sb->cluster_config()->size());
+        }
+        cfg.has_state = sb->has_state();
+        cfg.term = sb->term();
+        cfg.voted_for = sb->voted_for();
+        return cfg;
+    }
+
+    auto js = load_json_raft_config(raft_config);
+    cfg.group_id = js.value("group_id", std::string{});
+    if (js.contains("config")) { cfg.config_buf = deserialize_cluster_config(js["config"])->serialize(); }
+    if (js.contains("state") && !js["state"].empty()) {
+        try {
+            cfg.term = uint64_cast(js["state"]["term"]);
+            cfg.voted_for = static_cast< int32_t >(js["state"]["voted_for"]);
+            cfg.has_state = true;
+        } catch (std::out_of_range const&) {
+            LOGWARN("State data was not in the expected format [group_id={}]!", cfg.group_id)
+        }
+    }
+    return cfg;
+}
+
+void RaftReplDev::use_config(binary_superblk raft_config_sb) {
     std::unique_lock lg{m_config_mtx};
-    auto& js = *m_raft_config_sb;
+    m_raft_config_sb = std::move(raft_config_sb);
+    auto const& data = *m_raft_config_sb;
+    if (data.empty()) {
+        // Newly created group, persist its group id right away for the recovery to find it
+        write_raft_config_sb();
+        return;
+    }
+
+    auto cfg = decode_raft_config(data);
+    m_raft_config_buf = std::move(cfg.config_buf);
+    m_has_raft_state = cfg.has_state;
+    m_raft_term = cfg.term;
+    m_raft_voted_for = cfg.voted_for;
+}
+
+void RaftReplDev::write_raft_config_sb() {
+    flatbuffers::FlatBufferBuilder builder;
+    auto const gid = builder.CreateString(boost::uuids::to_string(m_group_id));
+    flatbuffers::Offset< flatbuffers::Vector< uint8_t > > conf;
+    if (m_raft_config_buf) { conf = builder.CreateVector(m_raft_config_buf->data_begin(), m_raft_config_buf->size()); }
+    builder.Finish(CreateRaftConfigSb(builder, gid, m_raft_term, m_raft_voted_for, m_has_raft_state, conf),
+                   RaftConfigSbIdentifier());
 
-    if (!js.contains("config")) {
+    m_raft_config_sb->assign(builder.GetBufferPointer(), builder.GetBufferPointer() + builder.GetSize());
+    m_raft_config_sb.write();
+}
+
+nuraft::ptr< nuraft::cluster_config > RaftReplDev::load_config() {
+    std::unique_lock lg{m_config_mtx};
+    if (!m_raft_config_buf) {
         auto cluster_conf = nuraft::cs_new< nuraft::cluster_config >();
         cluster_conf->get_servers().push_back(
             nuraft::cs_new< nuraft::srv_config >(m_raft_server_id, my_replica_id_str()));
-        js["config"] = serialize_cluster_config(*cluster_conf);
+        m_raft_config_buf = cluster_conf->serialize();
     }
-    return deserialize_cluster_config(js["config"]);
+    m_raft_config_buf->pos(0);
+    return nuraft::cluster_config::deserialize(*m_raft_config_buf);
 }
 
 void RaftReplDev::save_config(const nuraft::cluster_config& config) {
     std::unique_lock lg{m_config_mtx};
-    (*m_raft_config_sb)["config"] = serialize_cluster_config(config);
-    m_raft_config_sb.write();
+    m_raft_config_buf = config.serialize();
+    write_raft_config_sb();
 }
 
 void RaftReplDev::save_state(const nuraft::srv_state& state) {
     std::unique_lock lg{m_config_mtx};
-    (*m_raft_config_sb)["state"] = nlohmann::json{{"term", state.get_term()}, {"voted_for", state.get_voted_for()}};
-    m_raft_config_sb.write();
+    m_raft_term = state.get_term();
+    m_raft_voted_for = state.get_voted_for();
+    m_has_raft_state = true;
+    write_raft_config_sb();
 }
 
 nuraft::ptr< nuraft::srv_state > RaftReplDev::read_state() {
     std::unique_lock lg{m_config_mtx};
-    auto& js = *m_raft_config_sb;
     auto state = nuraft::cs_new< nuraft::srv_state >();
-    if (js["state"].empty()) {
-        js["state"] = nlohmann::json{{"term", state->get_term()}, {"voted_for", state->get_voted_for()}};
-    } else {
-        try {
-            state->set_term(uint64_cast(js["state"]["term"]));
-            state->set_voted_for(static_cast< int >(js["state"]["voted_for"]));
-        } catch (std::out_of_range const&) {
-            LOGWARN("State data was not in the expected format [group_id={}]!", m_group_id)
-        }
+    if (m_has_raft_state) {
+        state->set_term(m_raft_term);
+        state->set_voted_for(m_raft_voted_for);
     }
     return state;
 }
@@ -913,7 +1991,17 @@ void RaftReplDev::permanent_destroy() {
     m_rd_sb.destroy();
     m_raft_config_sb.destroy();
     m_data_journal->remove_store();
-    logstore_service().destroy_log_dev(m_data_journal->logdev_id());
+
+    // Shared logdev lives on with the journals of the other groups, so the stores of this group are removed by
+    // themselves instead
+    auto const shared = logstore_service().shared_logdevs();
+    if (std::find(shared.begin(), shared.end(), m_data_journal->logdev_id()) == shared.end()) {
+        logstore_service().destroy_log_dev(m_data_journal->logdev_id());
+    } else if (m_free_blks_journal) {
+        logstore_service().remove_log_store(m_data_journal->logdev_id(), m_free_blks_journal->get_store_id());
+        m_free_blks_journal.reset();
+    }
+    data_service().remove_io_tenant(io_tenant());
     m_stage.update([](auto* stage) { *stage = repl_dev_stage_t::PERMANENT_DESTROYED; });
 }
 
@@ -943,9 +2031,18 @@ std::pair< bool, nuraft::cb_func::ReturnCode > RaftReplDev::handle_raft_event(nu
         auto raft_req = r_cast< nuraft::req_msg* >(param->ctx);
         auto const& entries = raft_req->log_entries();
 
+        // Heartbeats coming in far less often than the regular period are of a quiesced leader, waited for as long
+        // even if this follower is not idle for long enough itself (like after a restart)
+        auto const prev_msg_time = m_last_leader_msg.exchange(Clock::now());
+        if (entries.empty() && !m_quiesced.load() && (HS_DYNAMIC_CONFIG(consensus.quiesce_idle_ms) != 0) &&
+            (get_elapsed_time_ms(prev_msg_time) > 2 * uint64_cast(HS_DYNAMIC_CONFIG(consensus.heartbeat_period_ms)))) {
+            set_quiesced(true);
+        }
+
         if (!entries.empty()) {
             RD_LOGT("Raft channel: Received {} append entries on follower from leader, localizing them",
                     entries.size());
+            note_activity();
 
             auto reqs = sisl::VectorPool< repl_req_ptr_t >::alloc();
             for (auto& entry : entries) {
@@ -976,18 +2073,114 @@ std::pair< bool, nuraft::cb_func::ReturnCode > RaftReplDev::handle_raft_event(nu
 void RaftReplDev::flush_durable_commit_lsn() {
     auto const lsn = m_commit_upto_lsn.load();
     std::unique_lock lg{m_sb_mtx};
+    if (m_rd_sb->durable_commit_lsn == lsn) { return; } // Not moved since the last flush or CP
+
+    // Queued, so that the sbs of all the groups are written in one pass and merged with a pending CP write of the sb
     m_rd_sb->durable_commit_lsn = lsn;
-    m_rd_sb.write();
+    m_rd_sb.async_write().thenValue([](bool) {});
+}
+
+void RaftReplDev::check_quiesce() {
+    auto const idle_ms = HS_DYNAMIC_CONFIG(consensus.quiesce_idle_ms);
+    if (idle_ms == 0) {
+        if (m_quiesced.load()) { set_quiesced(false); }
+        return;
+    }
+    if (*m_stage.access().get() != repl_dev_stage_t::ACTIVE) { return; }
+
+    // Quiescing is driven by the leader. Followers quiesce after half of the idle time, so that they already wait
+    // longer for heartbeats by the time their leader sends them less often. Leader quiesces only once all the
+    // followers have been caught up and responsive for the whole idle time since, by when each one of them has gone
+    // without new entries for half of it. Any of them lagging behind or silent (like one which restarted) has the
+    // leader back to the regular heartbeats, until they all are steady again.
+    auto idle_since = m_last_activity.load();
+    auto const leader = is_leader();
+    if (leader && !std::exchange(m_quiesce_checked_as_leader, true)) {
+        m_followers_steady_since = Clock::now(); // Followers are seen by this leader only from now on
+    }
+    m_quiesce_checked_as_leader = leader;
+    if (leader) {
+        auto const factor = std::max(HS_DYNAMIC_CONFIG(consensus.quiesce_heartbeat_factor), 1u);
+        auto const max_resp_age_us = (uint64_cast(HS_DYNAMIC_CONFIG(consensus.heartbeat_period_ms)) * factor +
+                                      HS_DYNAMIC_CONFIG(consensus.elect_to_high_ms)) *
+            1000;
+        auto const leader_idx = raft_server()->get_last_log_idx();
+        for (auto const& p : get_replication_status()) {
+            if ((p.replication_idx_ < leader_idx) || (p.last_succ_resp_us_ > max_resp_age_us)) {
+                m_followers_steady_since = Clock::now();
+                if (m_quiesced.load()) { set_quiesced(false); }
+                return;
+            }
+        }
+        idle_since = std::max(idle_since, m_followers_steady_since);
+    }
+
+    if (m_quiesced.load()) { return; }
+    auto const quiesce_after_ms = leader ? idle_ms : idle_ms / 2;
+    if (get_elapsed_time_ms(idle_since) >= quiesce_after_ms) { set_quiesced(true); }
+}
+
+void RaftReplDev::note_activity() {
+    m_last_activity.store(Clock::now());
+    if (m_quiesced.load()) { set_quiesced(false); }
+}
+
+void RaftReplDev::set_quiesced(bool quiesce) {
+    std::unique_lock lg{m_params_mtx};
+    if ((m_quiesced.load() == quiesce) || (raft_server() == nullptr)) { return; }
+
+    auto const factor = quiesce ? std::max(HS_DYNAMIC_CONFIG(consensus.quiesce_heartbeat_factor), 1u) : 1u;
+    auto params = raft_server()->get_current_params();
+    params.heart_beat_interval_ = HS_DYNAMIC_CONFIG(consensus.heartbeat_period_ms) * factor;
+    params.election_timeout_lower_bound_ = HS_DYNAMIC_CONFIG(consensus.elect_to_low_ms) * factor;
+    params.election_timeout_upper_bound_ = HS_DYNAMIC_CONFIG(consensus.elect_to_high_ms) * factor;
+    raft_server()->update_params(params);
+    m_quiesced.store(quiesce);
+
+    if (quiesce) { COUNTER_INCREMENT(m_metrics, quiesce_cnt, 1); }
+    RD_LOGD("Group is {} heartbeat_period={}ms", quiesce ? "quiesced for being idle," : "active again,",
+            params.heart_beat_interval_);
+}
+
+void RaftReplDev::adapt_append_batch() {
+    if ((raft_server() == nullptr) || (*m_stage.access().get() != repl_dev_stage_t::ACTIVE)) { return; }
+
+    bool lagging{false};
+    if (HS_DYNAMIC_CONFIG(consensus.adaptive_append_batch) && is_leader()) {
+        // Followers which didn't respond for a while are down or partitioned, larger batches don't help them
+        auto const max_resp_age_us = uint64_cast(HS_DYNAMIC_CONFIG(consensus.elect_to_high_ms)) * 1000;
+        auto const leader_idx = raft_server()->get_last_log_idx();
+        uint64_t max_lag{0};
+        for (auto const& p : get_replication_status()) {
+            if ((p.last_succ_resp_us_ > max_resp_age_us) || (p.replication_idx_ >= leader_idx)) { continue; }
+            max_lag = std::max(max_lag, leader_idx - p.replication_idx_);
+        }
+
+        // Raised above the hi threshold, lowered below the lo threshold, so that it doesn't flip on every check
+        auto const threshold = m_lagging_append_batch ? HS_DYNAMIC_CONFIG(consensus.stale_log_gap_lo_threshold)
+                                                      : HS_DYNAMIC_CONFIG(consensus.stale_log_gap_hi_threshold);
+        lagging = (max_lag > uint64_cast(std::max(threshold, 0)));
+    }
+    if (lagging == m_lagging_append_batch) { return; }
+
+    std::unique_lock lg{m_params_mtx};
+    auto params = raft_server()->get_current_params();
+    params.max_append_size_ = lagging ? HS_DYNAMIC_CONFIG(consensus.lagging_append_batch_size)
+                                      : HS_DYNAMIC_CONFIG(consensus.max_append_batch_size);
+    raft_server()->update_params(params);
+    m_lagging_append_batch = lagging;
+    RD_LOGI("Append batch size is set to {} as followers are {}", params.max_append_size_,
+            lagging ? "lagging" : "caught up");
 }
 
 ///////////////////////////////////  Private metohds ////////////////////////////////////
-void RaftReplDev::cp_flush(CP*) {
+folly::Future< bool > RaftReplDev::cp_flush(CP*) {
     auto const lsn = m_commit_upto_lsn.load();
     auto const clsn = m_compact_lsn.load();
 
     if (lsn == m_last_flushed_commit_lsn) {
         // Not dirtied since last flush ignore
-        return;
+        return folly::makeFuture< bool >(true);
     }
 
     std::unique_lock lg{m_sb_mtx};
@@ -995,21 +2188,60 @@ void RaftReplDev::cp_flush(CP*) {
     m_rd_sb->durable_commit_lsn = lsn;
     m_rd_sb->checkpoint_lsn = lsn;
     m_rd_sb->last_applied_dsn = m_next_dsn.load();
-    m_rd_sb.write();
     m_last_flushed_commit_lsn = lsn;
+    return m_rd_sb.async_write().thenValue([this, lsn](bool success) {
+        if (success) { m_cp_truncate_lsn.store(lsn); }
+        return success;
+    });
+}
+
+void RaftReplDev::truncate(uint32_t num_reserved_entries) {
+    if (HS_DYNAMIC_CONFIG(consensus.cp_driven_log_truncation)) {
+        m_data_journal->truncate_upto(cp_truncate_barrier());
+    } else {
+        m_data_journal->truncate(num_reserved_entries, m_compact_lsn.load());
+    }
 }
 
-void RaftReplDev::cp_cleanup(CP*) {}
+repl_lsn_t RaftReplDev::cp_truncate_barrier() const {
+    // Entries after the last snapshot are kept, so that a follower which can't be sent the entries it needs is always
+    // caught up by a snapshot which covers them
+    auto const snp = m_last_snapshot;
+    auto lsn = std::min(m_cp_truncate_lsn.load(), snp ? s_cast< repl_lsn_t >(snp->get_last_log_idx()) : 0);
+    if ((lsn == 0) || !is_leader()) { return lsn; }
+
+    // Entries which a lagging follower is yet to be sent are kept, unless it is too far behind, in which case it is
+    // anyways caught up by a snapshot
+    auto const max_lag = uint64_cast(HS_DYNAMIC_CONFIG(consensus.cp_truncate_max_follower_lag));
+    auto const floor_lsn = (uint64_cast(lsn) > max_lag) ? s_cast< repl_lsn_t >(lsn - max_lag) : 0;
+    for (auto const& p : get_replication_status()) {
+        lsn = std::min(lsn, std::max(s_cast< repl_lsn_t >(p.replication_idx_), floor_lsn));
+    }
+    return lsn;
+}
+
+void RaftReplDev::cp_cleanup(CP*) {
+    if (HS_DYNAMIC_CONFIG(consensus.cp_driven_log_truncation)) {
+        // Log upto the CP is not needed for recovery anymore, once the whole CP is done. Truncate it right away
+        // instead of at the next audit.
+        iomanager.run_on_forget(logstore_service().truncate_thread(),
+                                [rd = shared_from_this()]() { rd->truncate(0 /* num_reserved_entries */); });
+    }
+}
 
 void RaftReplDev::gc_repl_reqs() {
     std::vector< int64_t > expired_keys;
-    m_state_machine->iterate_repl_reqs([this, &expired_keys](auto key, auto rreq) {
+    auto const timeout_sec = HS_DYNAMIC_CONFIG(consensus.repl_req_timeout_sec);
+    m_state_machine->iterate_aged_repl_reqs(timeout_sec, [this, &expired_keys](auto key, auto rreq) {
         if (rreq->is_proposer()) {
             // don't clean up proposer's request
             return;
         }
 
-        if (rreq->is_expired()) {
+        if (!rreq->is_expired()) {
+            // Not quite expired as of now, visit it again later
+            m_state_machine->track_req_age(rreq->created_time(), key);
+        } else {
             expired_keys.push_back(key);
             RD_LOGD("rreq=[{}] is expired, cleaning up", rreq->to_compact_string());
 
@@ -1071,12 +2303,12 @@ void RaftReplDev::on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx
 
     repl_key const rkey{.server_id = jentry->server_id, .term = lentry->get_term(), .dsn = jentry->dsn};
 
-    auto const [it, happened] = m_repl_key_req_map.try_emplace(rkey, repl_req_ptr_t(new repl_req_ctx()));
+    auto const [it, happened] = m_repl_key_req_map.try_emplace(rkey, repl_req_ctx::make_pooled());
     RD_DBG_ASSERT((it != m_repl_key_req_map.end()), "Unexpected error in map_repl_key_to_req");
     auto rreq = it->second;
     RD_DBG_ASSERT(happened, "rreq already exists for rkey={}", rkey.to_string());
     MultiBlkId entry_blkid;
-    entry_blkid.deserialize(entry_to_val(jentry), true /* copy */);
+    entry_blkid.deserialize(entry_to_val(jentry), jentry->blkid_format());
     rreq->init(rkey, jentry->code, false /* is_proposer */, entry_to_hdr(jentry), entry_to_key(jentry),
                (entry_blkid.blk_count() * get_blk_size()));
     rreq->set_local_blkid(entry_blkid);
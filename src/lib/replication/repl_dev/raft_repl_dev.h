@@ -1,6 +1,12 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <libnuraft/ptr.hxx>
 #include <nuraft_mesg/nuraft_mesg.hpp>
@@ -12,6 +18,7 @@
 #include <homestore/logstore/log_store.hpp>
 #include "replication/repl_dev/common.h"
 #include "replication/repl_dev/raft_state_machine.h"
+#include "replication/repl_dev/raft_snapshot.h"
 #include "replication/log_store/repl_log_store.h"
 
 namespace homestore {
@@ -37,6 +44,12 @@ ENUM(repl_dev_stage_t, uint8_t, INIT, ACTIVE, DESTROYING, DESTROYED, PERMANENT_D
 class RaftReplDevMetrics : public sisl::MetricsGroup {
 public:
     explicit RaftReplDevMetrics(const char* inst_name) : sisl::MetricsGroup("RaftReplDev", inst_name) {
+        REGISTER_COUNTER(commit_wait_data_write_cnt, "total commits of the leader which waited for its data write",
+                         "commit_wait_data_write_cnt", {"op", "commit"});
+        REGISTER_COUNTER(fetch_wait_data_write_cnt, "total fetches served by the leader once its data write is done",
+                         "fetch_wait_data_write_cnt", {"op", "fetch"});
+        REGISTER_COUNTER(embedded_data_cnt, "total writes with the data embedded in the journal entry",
+                         "embedded_data_cnt", {"op", "write"});
         REGISTER_COUNTER(read_err_cnt, "total read error count", "read_err_cnt", {"op", "read"});
         REGISTER_COUNTER(write_err_cnt, "total write error count", "write_err_cnt", {"op", "write"});
         REGISTER_COUNTER(fetch_err_cnt, "total fetch data error count", "fetch_err_cnt", {"op", "fetch"});
@@ -46,6 +59,54 @@ public:
         REGISTER_COUNTER(fetch_total_entries_cnt, "total fetch total entries count", "fetch_total_entries_cnt",
                          {"op", "fetch"});
 
+        REGISTER_COUNTER(fetch_peer_cnt, "total fetch data from peers other than originator", "fetch_peer_cnt",
+                         {"op", "fetch"});
+        REGISTER_COUNTER(fetch_peer_fallback_cnt, "total fetch data from peers retried from originator",
+                         "fetch_peer_fallback_cnt", {"op", "fetch"});
+        REGISTER_COUNTER(fetch_decompress_err_cnt, "total fetched data which failed to decompress, fetched again",
+                         "fetch_decompress_err_cnt", {"op", "fetch"});
+
+        REGISTER_COUNTER(follower_read_cnt, "total reads served as follower", "follower_read_cnt", {"op", "read"});
+        REGISTER_COUNTER(follower_read_wait_cnt, "total follower reads which waited for commits",
+                         "follower_read_wait_cnt", {"op", "read"});
+        REGISTER_COUNTER(hedged_read_cnt, "total reads which fetched the data from another replica too",
+                         "hedged_read_cnt", {"op", "read"});
+        REGISTER_COUNTER(hedged_read_remote_cnt, "total hedged reads served by the other replica",
+                         "hedged_read_remote_cnt", {"op", "read"});
+
+        REGISTER_COUNTER(snapshot_read_objs_cnt, "total native snapshot objs read to send", "snapshot_read_objs_cnt",
+                         {"op", "snapshot"});
+        REGISTER_COUNTER(snapshot_write_objs_cnt, "total native snapshot objs received and written",
+                         "snapshot_write_objs_cnt", {"op", "snapshot"});
+        REGISTER_COUNTER(snapshot_data_blks_cnt, "total blks sent or written in native snapshot data objs",
+                         "snapshot_data_blks_cnt", {"op", "snapshot"});
+
+        // Time from the creation of a request to each stage of it (see repl_req_stage_t), except commit which is from
+        // the time it was committed by raft
+        REGISTER_HISTOGRAM(rreq_propose_latency_us, "Time for a request to be proposed to raft (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(rreq_data_push_latency_us, "Time for data of a request to be pushed to followers (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(rreq_log_flush_latency_us, "Time for journal entry of a request to be durable (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(rreq_raft_commit_latency_us, "Time for a request to be committed by raft (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(rreq_commit_cb_latency_us, "Time for listener to be done with the commit of a request (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+        REGISTER_HISTOGRAM(rreq_data_write_latency_us, "Time for data of a request to be written locally (us)",
+                           HistogramBucketsType(ExponentialOfTwoBuckets));
+
+        REGISTER_COUNTER(quiesce_cnt, "total times the group was quiesced for being idle", "quiesce_cnt");
+
+        REGISTER_COUNTER(data_wire_compressed_cnt, "total push and fetch data sent compressed",
+                         "data_wire_compressed_cnt");
+        REGISTER_COUNTER(data_wire_saved_bytes, "total bytes of push and fetch data saved by compressing them",
+                         "data_wire_saved_bytes");
+
+        REGISTER_COUNTER(push_batch_cnt, "total push data batches", "push_batch_cnt", {"op", "push"});
+        REGISTER_COUNTER(push_batch_entries_cnt, "total writes pushed in batches", "push_batch_entries_cnt",
+                         {"op", "push"});
+
         register_me_to_farm();
     }
 
@@ -76,13 +137,19 @@ private:
 
     std::mutex m_config_mtx;
     superblk< raft_repl_dev_superblk > m_rd_sb;        // Superblk where we store the state machine etc
-    json_superblk m_raft_config_sb;                    // Raft Context and Config data information stored
+    binary_superblk m_raft_config_sb;                  // Raft Context and Config data, as RaftConfigSb flatbuffer
+    nuraft::ptr< nuraft::buffer > m_raft_config_buf;   // Cluster config as serialized by nuraft, nullptr if not saved
+    bool m_has_raft_state{false};                      // Raft state (term and voted_for) saved yet
+    uint64_t m_raft_term{0};
+    int32_t m_raft_voted_for{-1};
     mutable folly::SharedMutexWritePriority m_sb_lock; // Lock to protect staged sb and persisting sb
     raft_repl_dev_superblk m_sb_in_mem;                // Cached version which is used to read and for staging
 
     std::atomic< repl_lsn_t > m_commit_upto_lsn{0}; // LSN which was lastly written, to track flushes
     std::atomic< repl_lsn_t > m_compact_lsn{0};     // LSN upto which it was compacted, it is used to track where to
 
+    std::atomic< repl_lsn_t > m_cp_truncate_lsn{0}; // LSN upto which the effects are persisted by the last CP
+
     std::mutex m_sb_mtx; // Lock to protect the repl dev superblock
 
     repl_lsn_t m_last_flushed_commit_lsn{0}; // LSN upto which it was flushed to persistent store
@@ -95,9 +162,50 @@ private:
     bool m_resync_mode{false};
     Clock::time_point m_destroyed_time;
     folly::Promise< ReplServiceError > m_destroy_promise;
+
+    // Small writes waiting to be pushed to followers in one rpc (see consensus.push_data_batch_size_kb)
+    std::mutex m_push_batch_mtx;
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > m_push_batch;
+    uint64_t m_push_batch_size{0};
+    uint64_t m_push_batch_gen{0}; // Bumped on every send, so that the timer of a batch sent already does nothing
+
+    std::vector< repl_req_ptr_t > m_commit_batch; // Committed, yet to be passed to listener, only on commit thread
+
+    // Lsns of the commits being applied in parallel on the commit threads of the service
+    std::mutex m_apply_mtx;
+    std::condition_variable m_apply_cv;
+    std::set< repl_lsn_t > m_applying;
+    repl_lsn_t m_last_dispatched_lsn{0};
+
+    // LEASE reads waiting for commits to reach the lsn they need
+    std::mutex m_read_waiters_mtx;
+    std::multimap< repl_lsn_t, folly::Promise< ReplResult< folly::Unit > > > m_read_waiters;
+
+    // Data fetch batches, with the peer to fetch them from, waiting for one of the data_fetch_max_inflight slots
+    struct pending_fetch {
+        std::vector< repl_req_ptr_t > rreqs;
+        int32_t target;
+        bool accept_compressed; // Off to fetch again the data which failed to decompress
+    };
+    std::mutex m_fetch_mtx;
+    std::deque< pending_fetch > m_pending_fetches;
+    uint32_t m_fetch_inflight{0};
+    uint32_t m_fetch_next_peer{0};
+
+    // Idle groups are quiesced, with longer heartbeat period and election timeouts (see consensus.quiesce_idle_ms)
+    // and leader sends larger append batches while a follower is lagging (see consensus.adaptive_append_batch)
+    std::mutex m_params_mtx; // Serializes the updates of raft params
+    std::atomic< bool > m_quiesced{false};
+    std::atomic< Clock::time_point > m_last_activity{Clock::now()}; // Time of the last new log entry
+    std::atomic< Clock::time_point > m_last_leader_msg{Clock::now()}; // Time of the last append or heartbeat received
+    Clock::time_point m_followers_steady_since{Clock::now()};         // All caught up and responsive, on the leader
+    bool m_quiesce_checked_as_leader{false};
+    bool m_lagging_append_batch{false};
+
     RaftReplDevMetrics m_metrics;
 
     nuraft::ptr< nuraft::snapshot > m_last_snapshot{nullptr};
+    std::unique_ptr< snapshot_write_ctx > m_snapshot_write_ctx; // Native snapshot being received, only on nuraft thread
 
     static std::atomic< uint64_t > s_next_group_ordinal;
     bool m_log_store_replay_done{false};
@@ -116,6 +224,9 @@ public:
                            repl_req_ptr_t ctx) override;
     folly::Future< std::error_code > async_read(MultiBlkId const& blkid, sisl::sg_list& sgs, uint32_t size,
                                                 bool part_of_batch = false) override;
+    folly::Future< std::error_code > async_read_hedged(MultiBlkId const& blkid, sisl::sg_list& sgs, uint32_t size,
+                                                       RemoteBlkId const& remote, int64_t lsn) override;
+    AsyncReplResult<> wait_for_consistent_read(repl_read_consistency_t consistency) override;
     void async_free_blks(int64_t lsn, MultiBlkId const& blkid) override;
     AsyncReplResult<> become_leader() override;
     bool is_leader() const override;
@@ -126,6 +237,7 @@ public:
     std::string rdev_name() const { return m_rdev_name; }
     std::string my_replica_id_str() const { return boost::uuids::to_string(m_my_repl_id); }
     uint32_t get_blk_size() const override;
+    io_tenant_t io_tenant() const override { return m_rd_sb->group_ordinal; }
     repl_lsn_t get_last_commit_lsn() const { return m_commit_upto_lsn.load(); }
     bool is_destroy_pending() const;
     bool is_destroyed() const;
@@ -136,14 +248,25 @@ public:
     nuraft::raft_server* raft_server();
 
     //////////////// Methods needed for other Raft classes to access /////////////////
-    void use_config(json_superblk raft_config_sb);
-    void handle_commit(repl_req_ptr_t rreq);
+    void use_config(binary_superblk raft_config_sb);
+    static std::string config_group_id(std::vector< uint8_t > const& raft_config);
+
+    // Raft config and state in the raft_config superblk, of either of its formats
+    struct raft_config_data {
+        std::string group_id;
+        nuraft::ptr< nuraft::buffer > config_buf; // Cluster config as serialized by nuraft, nullptr if not saved
+        bool has_state{false};                    // Raft state (term and voted_for) saved yet
+        uint64_t term{0};
+        int32_t voted_for{-1};
+    };
+    static raft_config_data decode_raft_config(std::vector< uint8_t > const& raft_config);
+    void handle_commit(repl_req_ptr_t rreq, bool can_batch = false);
     repl_req_ptr_t repl_key_to_req(repl_key const& rkey) const;
     repl_req_ptr_t applier_create_req(repl_key const& rkey, journal_type_t code, sisl::blob const& user_header,
                                       sisl::blob const& key, uint32_t data_size, bool is_data_channel);
     folly::Future< folly::Unit > notify_after_data_written(std::vector< repl_req_ptr_t >* rreqs);
     void check_and_fetch_remote_data(std::vector< repl_req_ptr_t > rreqs);
-    void cp_flush(CP* cp);
+    folly::Future< bool > cp_flush(CP* cp);
     void cp_cleanup(CP* cp);
     void become_ready();
 
@@ -165,13 +288,43 @@ public:
     void on_create_snapshot(nuraft::snapshot& s, nuraft::async_result< bool >::handler_type& when_done);
 
     /**
-     * Truncates the replication log by providing a specified number of reserved entries.
+     * \brief Reads an object of a snapshot to send to a new replica, as a native snapshot (see
+     * ReplDevListener::snapshot_data_chunks).
+     *
+     * Manifest of the chunks is obj 0, followed by the allocated blks of the chunks read as data objs (each one read
+     * ahead while the previous one is sent), followed by the objs of the listener.
+     *
+     * \param s The snapshot being sent.
+     * \param user_ctx Context of the snapshot across the reads, created by the first read.
+     * \param obj_id Id of the object to read.
+     * \param data_out Object read.
+     * \param is_last_obj Set if it is the last object.
+     * \return 0 on success, -1 if the object could not be read.
+     */
+    int read_snapshot_obj(nuraft::snapshot& s, void*& user_ctx, uint64_t obj_id, raft_buf_ptr_t& data_out,
+                          bool& is_last_obj);
+    void free_snapshot_ctx(void*& user_ctx);
+
+    /**
+     * \brief Writes an object of a snapshot read by read_snapshot_obj, on the new replica. Data objs are written as is
+     * to the same blks of the local chunks, which are reserved in the blk allocator, bypassing raft.
+     *
+     * \param s The snapshot being received.
+     * \param obj_id Id of the object, updated to the id of the next object it needs. A snapshot sent again
+     * resumes from the object it stopped at.
+     * \param data Object to write.
+     */
+    void save_snapshot_obj(nuraft::snapshot& s, uint64_t& obj_id, nuraft::buffer& data, bool is_first_obj,
+                           bool is_last_obj);
+    bool apply_snapshot(nuraft::snapshot& s);
+
+    /**
+     * Truncates the replication log by providing a specified number of reserved entries. With cp driven truncation,
+     * it is truncated upto the lsn of the last CP instead (see cp_truncate_barrier) and the entries are not reserved.
      *
      * @param num_reserved_entries The number of reserved entries of the replication log.
      */
-    void truncate(uint32_t num_reserved_entries) {
-        m_data_journal->truncate(num_reserved_entries, m_compact_lsn.load());
-    }
+    void truncate(uint32_t num_reserved_entries);
 
     nuraft::ptr< nuraft::snapshot > get_last_snapshot() { return m_last_snapshot; }
 
@@ -184,6 +337,23 @@ public:
      */
     void flush_durable_commit_lsn();
 
+    /**
+     * LSN upto which the log can be truncated: all of it is applied and persisted by the last CP and covered by the
+     * last snapshot, except what the lagging followers are yet to be sent, upto consensus.cp_truncate_max_follower_lag
+     * entries.
+     */
+    repl_lsn_t cp_truncate_barrier() const;
+
+    /**
+     * Quiesce the group if it has been idle for long enough, called periodically by the service
+     */
+    void check_quiesce();
+
+    /**
+     * Adapt the append batch size of the leader to the lag of its followers, called periodically by the service
+     */
+    void adapt_append_batch();
+
 protected:
     //////////////// All nuraft::state_mgr overrides ///////////////////////
     nuraft::ptr< nuraft::cluster_config > load_config() override;
@@ -203,15 +373,44 @@ protected:
                                                                      nuraft::cb_func::Param*) override;
 
 private:
+    struct hedged_read_ctx;
+
     shared< nuraft::log_store > data_journal() { return m_data_journal; }
+    void write_raft_config_sb(); // Persist the raft config and state, with m_config_mtx held
     void push_data_to_all_followers(repl_req_ptr_t rreq, sisl::sg_list const& data);
     void on_push_data_received(intrusive< sisl::GenericRpcData >& rpc_data);
+    void add_to_push_batch(repl_req_ptr_t rreq, sisl::sg_list const& data);
+    void flush_push_batch(uint64_t gen);
+    void send_push_batch(std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch);
+    void on_push_data_batch_received(intrusive< sisl::GenericRpcData >& rpc_data);
+    void write_pushed_data(repl_req_ptr_t rreq, uint32_t data_size, bool part_of_batch);
+    uint32_t compress_data_for_wire(sisl::sg_list const& data, sisl::io_blob_safe& out);
     void on_fetch_data_received(intrusive< sisl::GenericRpcData >& rpc_data);
-    void fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs);
-    void handle_fetch_data_response(sisl::GenericClientResponse response, std::vector< repl_req_ptr_t > rreqs);
+    void queue_fetch(std::vector< repl_req_ptr_t > rreqs, int32_t target, bool front = false,
+                     bool accept_compressed = true);
+    void issue_pending_fetches();
+    void on_fetch_done();
+    int32_t next_fetch_target(int32_t originator);
+    void fetch_data_from_remote(std::vector< repl_req_ptr_t > rreqs, int32_t target, bool accept_compressed);
+    void handle_fetch_data_response(sisl::GenericClientResponse response, std::vector< repl_req_ptr_t > rreqs,
+                                    bool accept_compressed);
+    void hedge_read_from_remote(shared< hedged_read_ctx > ctx, RemoteBlkId const& remote, int64_t lsn);
+    bool is_blkid_of_lsn(int64_t lsn, MultiBlkId const& blkid);
     bool is_resync_mode() { return m_resync_mode; }
+    void do_async_alloc_write(sisl::blob const& header, sisl::blob const& key, sisl::sg_list const& data,
+                              repl_req_ptr_t rreq);
     void handle_error(repl_req_ptr_t const& rreq, ReplServiceError err);
+    void flush_commit_batch();
+    bool apply_in_parallel(repl_req_ptr_t const& rreq);
+    void wait_for_parallel_applies();
+    void commit_done(repl_req_ptr_t const& rreq);
+    void notify_read_waiters();
+    void report_stage_latencies(repl_req_ptr_t const& rreq);
+    void note_activity();
+    void set_quiesced(bool quiesce);
     bool wait_for_data_receive(std::vector< repl_req_ptr_t > const& rreqs, uint64_t timeout_ms);
+    folly::Future< raft_buf_ptr_t > read_snapshot_data_obj(snapshot_layout const& layout, uint64_t obj_id);
+    bool write_snapshot_data_obj(snapshot_layout const& layout, uint64_t obj_id, nuraft::buffer& data);
     void on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx);
 };
 
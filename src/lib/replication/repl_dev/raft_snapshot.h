@@ -0,0 +1,145 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <folly/futures/Future.h>
+#include <sisl/fds/utils.hpp>
+#include <homestore/blk.h>
+
+namespace nuraft {
+class buffer;
+}
+
+namespace homestore {
+
+// clang-format off
+/*
+ * Objects of a HomeStore native snapshot (see ReplDevListener::snapshot_data_chunks), by obj_id:
+ *
+ *  |----------|---------------------------------------------------------|--------------------------------|
+ *  | Manifest | Data objs of chunk 0 | Data objs of chunk 1 | ...         | Objs of listener (index etc)   |
+ *  |----------|---------------------------------------------------------|--------------------------------|
+ *     obj 0       obj 1 ... obj num_data_objs()                              obj num_data_objs() + 1 ...
+ *
+ * Each data obj covers upto blks_per_obj blks of a chunk: its header, the runs of allocated blks in it and then the
+ * data of all the runs. Blks which are not allocated are not sent.
+ */
+// clang-format on
+
+#pragma pack(1)
+struct snapshot_manifest {
+    static constexpr uint32_t SNAPSHOT_MANIFEST_MAGIC{0xD5A9F00D};
+    static constexpr uint32_t SNAPSHOT_MANIFEST_VERSION{1};
+
+    uint32_t magic{SNAPSHOT_MANIFEST_MAGIC};
+    uint32_t version{SNAPSHOT_MANIFEST_VERSION};
+    uint64_t last_log_idx;
+    uint32_t blk_size;
+    uint32_t blks_per_obj;
+    uint32_t nchunks;
+
+    // NOTE: nchunks of blk_num_t, blks of each of the chunks, start immediately after this structure
+    blk_num_t const* chunk_blks() const {
+        return r_cast< blk_num_t const* >(r_cast< uint8_t const* >(this) + sizeof(snapshot_manifest));
+    }
+    blk_num_t* chunk_blks_mutable() {
+        return r_cast< blk_num_t* >(r_cast< uint8_t* >(this) + sizeof(snapshot_manifest));
+    }
+    uint32_t size() const { return sizeof(snapshot_manifest) + nchunks * sizeof(blk_num_t); }
+};
+
+struct snapshot_blk_run {
+    blk_num_t blk_num;
+    blk_count_t nblks;
+};
+
+struct snapshot_data_obj_hdr {
+    uint32_t chunk_idx; // Position of the chunk in snapshot_data_chunks
+    blk_num_t start_blk;
+    blk_num_t nblks;
+    uint32_t nruns;
+
+    // NOTE: nruns of snapshot_blk_run start immediately after this structure, followed by the data of all of them
+    snapshot_blk_run const* runs() const {
+        return r_cast< snapshot_blk_run const* >(r_cast< uint8_t const* >(this) + sizeof(snapshot_data_obj_hdr));
+    }
+    snapshot_blk_run* runs_mutable() {
+        return r_cast< snapshot_blk_run* >(r_cast< uint8_t* >(this) + sizeof(snapshot_data_obj_hdr));
+    }
+    uint32_t size() const { return sizeof(snapshot_data_obj_hdr) + nruns * sizeof(snapshot_blk_run); }
+};
+#pragma pack()
+
+// Chunks of a native snapshot and how they are split into data objs, same on the sender and the receiver
+struct snapshot_layout {
+    std::vector< chunk_num_t > chunks;
+    std::vector< blk_num_t > chunk_blks;
+    uint32_t blks_per_obj{0};
+
+    uint64_t num_data_objs() const {
+        uint64_t n{0};
+        for (auto const nblks : chunk_blks) {
+            n += (nblks + blks_per_obj - 1) / blks_per_obj;
+        }
+        return n;
+    }
+
+    bool is_data_obj(uint64_t obj_id) const { return (obj_id > 0) && (obj_id <= num_data_objs()); }
+
+    /// @brief Chunk idx, start blk and number of blks of the data obj
+    std::tuple< uint32_t, blk_num_t, blk_num_t > data_obj(uint64_t obj_id) const {
+        uint64_t seq = obj_id - 1;
+        for (uint32_t idx{0}; idx < chunk_blks.size(); ++idx) {
+            uint64_t const nobjs = (chunk_blks[idx] + blks_per_obj - 1) / blks_per_obj;
+            if (seq < nobjs) {
+                blk_num_t const start = uint32_cast(seq * blks_per_obj);
+                return {idx, start, std::min(blks_per_obj, chunk_blks[idx] - start)};
+            }
+            seq -= nobjs;
+        }
+        return {uint32_cast(chunk_blks.size()), 0, 0};
+    }
+
+    /// @brief Checks the data obj received is the one of obj_id, with its runs in order within its blks and followed by
+    /// exactly their data, so that nothing outside of it is ever reserved or written
+    bool is_valid_data_obj(uint64_t obj_id, uint8_t const* data, uint64_t size, uint32_t blk_size) const {
+        if (!is_data_obj(obj_id) || (size < sizeof(snapshot_data_obj_hdr))) { return false; }
+        auto const* hdr = r_cast< snapshot_data_obj_hdr const* >(data);
+        uint64_t const hdr_size = sizeof(snapshot_data_obj_hdr) + uint64_cast(hdr->nruns) * sizeof(snapshot_blk_run);
+        if (size < hdr_size) { return false; }
+
+        auto const [chunk_idx, start_blk, nblks] = data_obj(obj_id);
+        if ((hdr->chunk_idx != chunk_idx) || (hdr->start_blk != start_blk) || (hdr->nblks != nblks)) { return false; }
+
+        uint64_t next_blk{start_blk};
+        uint64_t data_blks{0};
+        for (uint32_t i{0}; i < hdr->nruns; ++i) {
+            snapshot_blk_run const r = hdr->runs()[i];
+            if ((r.nblks == 0) || (r.blk_num < next_blk) || (uint64_cast(r.blk_num) + r.nblks > start_blk + nblks)) {
+                return false;
+            }
+            next_blk = uint64_cast(r.blk_num) + r.nblks;
+            data_blks += r.nblks;
+        }
+        return (size - hdr_size) == data_blks * blk_size;
+    }
+};
+
+// Context of a native snapshot being sent, kept by nuraft across the reads of its objects
+struct snapshot_read_ctx {
+    snapshot_layout layout;
+    std::map< uint64_t, folly::Future< std::shared_ptr< nuraft::buffer > > > prefetched; // By obj_id
+};
+
+// Progress of a native snapshot being received, so that it resumes from the obj it stopped at when sent again
+struct snapshot_write_ctx {
+    uint64_t last_log_idx{0};
+    snapshot_layout layout;
+    uint64_t next_obj_id{0};
+    bool done{false};
+};
+
+} // namespace homestore
@@ -1,3 +1,5 @@
+#include <tuple>
+
 #include <iomgr/iomgr_timer.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/fds/utils.hpp>
@@ -34,6 +36,7 @@ ReplServiceError RaftStateMachine::propose_to_raft(repl_req_ptr_t rreq) {
 
     auto* vec = sisl::VectorPool< raft_buf_ptr_t >::alloc();
     vec->push_back(rreq->raft_journal_buf());
+    rreq->mark_stage(repl_req_stage_t::PROPOSED);
 
     auto append_status = m_rd.raft_server()->append_entries(*vec);
     sisl::VectorPool< raft_buf_ptr_t >::free(vec);
@@ -77,8 +80,9 @@ repl_req_ptr_t RaftStateMachine::localize_journal_entry_prepare(nuraft::log_entr
     // blkid with this new one
     repl_req_ptr_t rreq;
     if ((jentry->code == journal_type_t::HS_DATA_LINKED) && (jentry->value_size > 0)) {
+        auto const format = jentry->blkid_format();
         MultiBlkId entry_blkid;
-        entry_blkid.deserialize(entry_to_val(jentry), true /* copy */);
+        entry_blkid.deserialize(entry_to_val(jentry), format);
 
         rreq = m_rd.applier_create_req(rkey, jentry->code, entry_to_hdr(jentry), entry_to_key(jentry),
                                        (entry_blkid.blk_count() * m_rd.get_blk_size()), false /* is_data_channel */);
@@ -86,24 +90,46 @@ repl_req_ptr_t RaftStateMachine::localize_journal_entry_prepare(nuraft::log_entr
 
         rreq->set_remote_blkid(RemoteBlkId{jentry->server_id, entry_blkid});
 
-        auto const local_size = rreq->local_blkid().serialized_size();
-        auto const remote_size = entry_blkid.serialized_size();
-        auto const size_before_value = lentry.get_buf().size() - jentry->value_size;
+        // Proposer reserves the value for the largest fixed blkid (JOURNAL_ENTRY_MINOR 2 onwards), so the local blkid,
+        // which could have more pieces than the remote one, is patched in place. Rest of the value is zeroed, as the
+        // fixed blkid is deserialized from all of it. A compact blkid takes only the size of the proposer's, so the
+        // entry is rewritten with room for the local one, if it is larger.
+        auto const local_size = rreq->local_blkid().serialized_size(format);
+        auto const prefix_size = sizeof(repl_journal_entry) + jentry->user_header_size + jentry->key_size;
+        if (local_size > jentry->value_size) {
+            RELEASE_ASSERT(format == blkid_format_t::compact,
+                           "Journal entry of rkey={} from an older proposer has no room for the local blkid={}",
+                           rkey.to_string(), rreq->local_blkid().to_string());
+            auto new_buf = nuraft::buffer::alloc(prefix_size + local_size);
+            std::memcpy(new_buf->data_begin(), jentry, prefix_size);
+            lentry.change_buf(new_buf);
+            jentry = r_cast< repl_journal_entry* >(lentry.get_buf().data_begin());
+            jentry->value_size = local_size;
+        }
+        uint8_t* blkid_location = uintptr_cast(jentry) + prefix_size;
+        auto const blkid_size = rreq->local_blkid().serialize_to(blkid_location, format);
+        std::memset(blkid_location + blkid_size, 0, jentry->value_size - blkid_size);
+    } else if (jentry->code == journal_type_t::HS_DATA_EMBEDDED) {
+        // Value is the slot for the blkid followed by the data, which is written right away as it is here already
+        auto const format = jentry->blkid_format();
+        auto const slot_size = MultiBlkId::max_serialized_size(format);
+        RELEASE_ASSERT_GT(jentry->value_size, slot_size, "Journal entry of rkey={} has no embedded data",
+                          rkey.to_string());
+        auto const data_size = jentry->value_size - slot_size;
+        rreq = m_rd.applier_create_req(rkey, jentry->code, entry_to_hdr(jentry), entry_to_key(jentry), data_size,
+                                       false /* is_data_channel */);
+        if (rreq == nullptr) { goto out; }
 
-        // It is possible that serialized size of the blkid allocated could be different (even though it
-        // allocates the same size as remote), because we support scatterred writes on different physical blocks. In
-        // that case, we need to completely prepare a new journal_entry buffer and assign that buffer to log_entry
-        if (local_size > remote_size) {
-            DEBUG_ASSERT(false, "We don't support different count of local blkid and remote blkid yet");
-            raft_buf_ptr_t new_buf = nuraft::buffer::alloc(lentry.get_buf().size() + local_size - remote_size);
+        uint8_t* blkid_location = uintptr_cast(entry_to_val(jentry).cbytes());
+        auto const blkid_size = rreq->local_blkid().serialize_to(blkid_location, format);
+        std::memset(blkid_location + blkid_size, 0, slot_size - blkid_size);
 
-            std::memcpy(new_buf->data_begin(), lentry.get_buf().data_begin(), size_before_value);
-            jentry = r_cast< repl_journal_entry* >(new_buf->data_begin());
-            // lentry.change_buf(std::move(new_buf));
+        sisl::sg_list embedded;
+        embedded.size = data_size;
+        embedded.iovs.emplace_back(iovec{.iov_base = blkid_location + slot_size, .iov_len = data_size});
+        if (rreq->save_embedded_data(embedded)) {
+            m_rd.write_pushed_data(rreq, sisl::round_up(data_size, m_rd.get_blk_size()), false /* part_of_batch */);
         }
-
-        uint8_t* blkid_location = uintptr_cast(lentry.get_buf().data_begin()) + size_before_value;
-        std::memcpy(blkid_location, rreq->local_blkid().serialize().cbytes(), local_size);
     } else {
         rreq = m_rd.applier_create_req(rkey, jentry->code, entry_to_hdr(jentry), entry_to_key(jentry),
                                        jentry->value_size, false /* is_data_channel */);
@@ -187,22 +213,78 @@ raft_buf_ptr_t RaftStateMachine::commit_ext(nuraft::state_machine::ext_op_params
     RD_LOGD("Raft channel: Received Commit message lsn {} store {} logdev {} size {}", lsn,
             m_rd.m_data_journal->logstore_id(), m_rd.m_data_journal->logdev_id(), params.data->size());
     repl_req_ptr_t rreq = lsn_to_req(lsn);
-    if (!rreq) { RD_LOGD("Raft channel got null rreq"); }
+    if (!rreq) {
+        // Entry of raft itself (like the noop of a new leader), could be the last of the round of commits
+        RD_LOGD("Raft channel got null rreq");
+        m_rd.flush_commit_batch();
+        return m_success_ptr;
+    }
     RD_LOGD("Raft channel: Received Commit message rreq=[{}]", rreq->to_compact_string());
     if (rreq->is_proposer()) {
         // This is the time to ensure flushing of journal happens in the proposer
         if (m_rd.m_data_journal->last_durable_index() < uint64_cast(lsn)) { m_rd.m_data_journal->flush(); }
         rreq->add_state(repl_req_state_t::LOG_FLUSHED);
+
+        // Proposer could have proposed along with writing the data (consensus.leader_overlap_data_write), which is
+        // mostly done by the time the followers ack. Commits are in the order of lsn, so it is waited for here.
+        if (rreq->has_linked_data() && !rreq->has_state(repl_req_state_t::DATA_WRITTEN)) {
+            COUNTER_INCREMENT(m_rd.m_metrics, commit_wait_data_write_cnt, 1);
+            rreq->m_data_written_promise.getFuture().wait();
+        }
+        RD_REL_ASSERT(!rreq->has_linked_data() || rreq->has_state(repl_req_state_t::DATA_WRITTEN),
+                      "Committing rreq=[{}] before its data is written", rreq->to_compact_string());
     }
 
-    m_rd.handle_commit(rreq);
+    m_rd.handle_commit(rreq, true /* can_batch */);
 
     return m_success_ptr;
 }
 
-void RaftStateMachine::iterate_repl_reqs(std::function< void(int64_t, repl_req_ptr_t rreq) > const& cb) {
-    for (auto [key, rreq] : m_lsn_req_map) {
-        cb(key, rreq);
+void RaftStateMachine::commit_config(const nuraft::ulong log_idx, nuraft::ptr< nuraft::cluster_config >&) {
+    // Round of commits could end on the config entry, so the entries batched before it are not left waiting for the
+    // next round
+    RD_LOGD("Raft channel: Commit config lsn {}", log_idx);
+    m_rd.flush_commit_batch();
+}
+
+static uint64_t to_age_bucket(Clock::time_point t) {
+    return uint64_cast(std::chrono::duration_cast< std::chrono::seconds >(t.time_since_epoch()).count());
+}
+
+void RaftStateMachine::track_req_age(Clock::time_point created_time, int64_t lsn) {
+    std::unique_lock lg{m_req_age_mtx};
+    auto& runs = m_req_age_buckets[to_age_bucket(created_time)];
+    if (!runs.empty() && (runs.back().second == lsn)) {
+        ++runs.back().second; // Lsns of a follower are mostly linked in order
+    } else {
+        runs.emplace_back(lsn, lsn + 1);
+    }
+}
+
+void RaftStateMachine::iterate_aged_repl_reqs(uint32_t age_sec,
+                                              std::function< void(int64_t, repl_req_ptr_t rreq) > const& cb) {
+    std::vector< std::tuple< uint64_t, int64_t, int64_t > > aged_runs;
+    auto const now = to_age_bucket(Clock::now());
+    {
+        std::unique_lock lg{m_req_age_mtx};
+        while (!m_req_age_buckets.empty() && (m_req_age_buckets.begin()->first + age_sec < now)) {
+            auto const& [bucket, runs] = *m_req_age_buckets.begin();
+            for (auto const& [start, end] : runs) {
+                aged_runs.emplace_back(bucket, start, end);
+            }
+            m_req_age_buckets.erase(m_req_age_buckets.begin());
+        }
+    }
+
+    // Reqs which are committed by now are not in the map anymore and the ones created later than the run, which have
+    // got the lsn since, are tracked of their own
+    for (auto const& [bucket, start, end] : aged_runs) {
+        for (auto lsn = start; lsn < end; ++lsn) {
+            auto const it = m_lsn_req_map.find(lsn);
+            if ((it != m_lsn_req_map.cend()) && (to_age_bucket(it->second->created_time()) <= bucket)) {
+                cb(lsn, it->second);
+            }
+        }
     }
 }
 
@@ -218,6 +300,7 @@ void RaftStateMachine::unlink_lsn_to_req(int64_t lsn) {
 void RaftStateMachine::link_lsn_to_req(repl_req_ptr_t rreq, int64_t lsn) {
     rreq->set_lsn(lsn);
     rreq->add_state(repl_req_state_t::LOG_RECEIVED);
+    if (!rreq->is_proposer()) { track_req_age(rreq->created_time(), lsn); }
     [[maybe_unused]] auto r = m_lsn_req_map.insert(lsn, std::move(rreq));
     RD_DBG_ASSERT_EQ(r.second, true, "lsn={} already in precommit list", lsn);
 }
@@ -239,6 +322,22 @@ void RaftStateMachine::create_snapshot(nuraft::snapshot& s, nuraft::async_result
     m_rd.on_create_snapshot(s, when_done);
 }
 
+bool RaftStateMachine::apply_snapshot(nuraft::snapshot& s) { return m_rd.apply_snapshot(s); }
+
+int RaftStateMachine::read_logical_snp_obj(nuraft::snapshot& s, void*& user_snp_ctx, nuraft::ulong obj_id,
+                                           raft_buf_ptr_t& data_out, bool& is_last_obj) {
+    return m_rd.read_snapshot_obj(s, user_snp_ctx, obj_id, data_out, is_last_obj);
+}
+
+void RaftStateMachine::save_logical_snp_obj(nuraft::snapshot& s, nuraft::ulong& obj_id, nuraft::buffer& data,
+                                            bool is_first_obj, bool is_last_obj) {
+    uint64_t id{obj_id};
+    m_rd.save_snapshot_obj(s, id, data, is_first_obj, is_last_obj);
+    obj_id = id;
+}
+
+void RaftStateMachine::free_user_snp_ctx(void*& user_snp_ctx) { m_rd.free_snapshot_ctx(user_snp_ctx); }
+
 std::string RaftStateMachine::rdev_name() const { return m_rd.rdev_name(); }
 
 nuraft::ptr< nuraft::snapshot > RaftStateMachine::last_snapshot() { return m_rd.get_last_snapshot(); }
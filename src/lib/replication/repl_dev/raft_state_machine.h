@@ -2,6 +2,8 @@
 
 #include <vector>
 #include <functional>
+#include <map>
+#include <mutex>
 #include <iomgr/iomgr.hpp>
 #include <folly/concurrency/ConcurrentHashMap.h>
 #include <sisl/utility/enum.hpp>
@@ -98,6 +100,11 @@ private:
     // iomgr::timer_handle_t m_wait_blkid_write_timer_hdl{iomgr::null_timer_handle};
     bool m_resync_mode{false};
 
+    // Runs [start, end) of lsns of the reqs (other than the proposer's), by the second they were created in, so that gc
+    // visits only the reqs old enough to be expired, each of them once
+    std::mutex m_req_age_mtx;
+    std::map< uint64_t, std::vector< std::pair< int64_t, int64_t > > > m_req_age_buckets;
+
 public:
     RaftStateMachine(RaftReplDev& rd);
     ~RaftStateMachine() override = default;
@@ -108,10 +115,16 @@ public:
     uint64_t last_commit_index() override;
     raft_buf_ptr_t pre_commit_ext(const nuraft::state_machine::ext_op_params& params) override;
     raft_buf_ptr_t commit_ext(const nuraft::state_machine::ext_op_params& params) override;
+    void commit_config(const nuraft::ulong log_idx, nuraft::ptr< nuraft::cluster_config >& new_conf) override;
     void rollback(uint64_t lsn, nuraft::buffer&) override { LOGCRITICAL("Unimplemented rollback on: [{}]", lsn); }
     void become_ready();
 
-    bool apply_snapshot(nuraft::snapshot&) override { return false; }
+    bool apply_snapshot(nuraft::snapshot& s) override;
+    int read_logical_snp_obj(nuraft::snapshot& s, void*& user_snp_ctx, nuraft::ulong obj_id,
+                             raft_buf_ptr_t& data_out, bool& is_last_obj) override;
+    void save_logical_snp_obj(nuraft::snapshot& s, nuraft::ulong& obj_id, nuraft::buffer& data,
+                              bool is_first_obj, bool is_last_obj) override;
+    void free_user_snp_ctx(void*& user_snp_ctx) override;
 
     void create_snapshot(nuraft::snapshot& s, nuraft::async_result< bool >::handler_type& when_done) override;
     nuraft::ptr< nuraft::snapshot > last_snapshot() override;
@@ -125,7 +138,10 @@ public:
     repl_req_ptr_t lsn_to_req(int64_t lsn);
     nuraft_mesg::repl_service_ctx* group_msg_service();
 
-    void iterate_repl_reqs(std::function< void(int64_t, repl_req_ptr_t rreq) > const& cb);
+    /// @brief Calls cb for each of the linked reqs (other than the proposer's) created more than age_sec ago, which
+    /// are no longer tracked after that. cb calls track_req_age for a req to be visited again later.
+    void iterate_aged_repl_reqs(uint32_t age_sec, std::function< void(int64_t, repl_req_ptr_t rreq) > const& cb);
+    void track_req_age(Clock::time_point created_time, int64_t lsn);
 
     std::string rdev_name() const;
 
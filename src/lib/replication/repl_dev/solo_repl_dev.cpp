@@ -1,10 +1,14 @@
+#include <cstring>
+
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 #include "replication/repl_dev/solo_repl_dev.h"
 #include "replication/repl_dev/common.h"
 #include <homestore/blkdata_service.hpp>
 #include <homestore/logstore_service.hpp>
 #include <homestore/superblk_handler.hpp>
+#include <iomgr/iomgr_timer.hpp>
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 
 namespace homestore {
 SoloReplDev::SoloReplDev(superblk< repl_dev_superblk >&& rd_sb, bool load_existing) :
@@ -29,10 +33,12 @@ SoloReplDev::SoloReplDev(superblk< repl_dev_superblk >&& rd_sb, bool load_existi
 
 void SoloReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const& key, sisl::sg_list const& value,
                                     repl_req_ptr_t rreq) {
-    if (!rreq) { auto rreq = repl_req_ptr_t(new repl_req_ctx{}); }
+    if (!rreq) { rreq = repl_req_ctx::make_pooled(); }
     rreq->init(repl_key{.server_id = 0, .term = 1, .dsn = 1},
                value.size ? journal_type_t::HS_DATA_LINKED : journal_type_t::HS_DATA_INLINED, true, header, key,
                value.size);
+    rreq->set_trace_id(Tracer::sample());
+    TraceScope trace_scope{rreq->trace_id()};
 
     // If it is header only entry, directly write to the journal
     if (rreq->has_linked_data()) {
@@ -40,31 +46,114 @@ void SoloReplDev::async_alloc_write(sisl::blob const& header, sisl::blob const&
         auto const status = rreq->alloc_local_blks(m_listener, value.size);
         HS_REL_ASSERT_EQ(status, ReplServiceError::OK, "Error in allocating local blks");
 
+        if (HS_DYNAMIC_CONFIG(consensus.solo_write_batch_size) > 1) {
+            add_to_write_batch(std::move(rreq), value);
+            return;
+        }
+
         // Write the data
+        io_tenant_guard tg{io_tenant()};
         data_service().async_write(value, rreq->local_blkid()).thenValue([this, rreq = std::move(rreq)](auto&& err) {
             HS_REL_ASSERT(!err, "Error in writing data"); // TODO: Find a way to return error to the Listener
             write_journal(std::move(rreq));
         });
+    } else if (HS_DYNAMIC_CONFIG(consensus.solo_write_batch_size) > 1) {
+        add_to_write_batch(std::move(rreq), sisl::sg_list{});
     } else {
         write_journal(std::move(rreq));
     }
 }
 
+void SoloReplDev::add_to_write_batch(repl_req_ptr_t rreq, sisl::sg_list const& value) {
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > full_batch;
+    {
+        std::unique_lock lg{m_write_batch_mtx};
+        m_write_batch.emplace_back(std::move(rreq), value);
+        if (m_write_batch.size() >= HS_DYNAMIC_CONFIG(consensus.solo_write_batch_size)) {
+            full_batch = std::move(m_write_batch);
+            m_write_batch.clear();
+            ++m_write_batch_gen;
+        } else if (m_write_batch.size() == 1) {
+            // First write of the batch, the timer writes the batch if it doesn't fill up by then
+            iomanager.schedule_global_timer(HS_DYNAMIC_CONFIG(consensus.solo_write_batch_delay_us) * 1000,
+                                            false /* recurring */, nullptr, iomgr::reactor_regex::random_worker,
+                                            [rd = weak_from_this(), gen = m_write_batch_gen](void*) {
+                                                if (auto rdev = rd.lock()) { rdev->flush_write_batch(gen); }
+                                            });
+        }
+    }
+    if (!full_batch.empty()) { write_batch(std::move(full_batch)); }
+}
+
+void SoloReplDev::flush_write_batch(uint64_t gen) {
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch;
+    {
+        std::unique_lock lg{m_write_batch_mtx};
+        if ((gen != m_write_batch_gen) || m_write_batch.empty()) { return; } // Batch has filled up and was written
+        batch = std::move(m_write_batch);
+        m_write_batch.clear();
+        ++m_write_batch_gen;
+    }
+    write_batch(std::move(batch));
+}
+
+void SoloReplDev::write_batch(std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch) {
+    // Data of all the writes is submitted to the drive together, then their journal entries are appended back to back
+    // so that they go in the same log flush, and their completions are called together once all of them are durable
+    std::vector< folly::Future< std::error_code > > futs;
+    futs.reserve(batch.size());
+    io_tenant_guard tg{io_tenant()};
+    for (auto const& [rreq, value] : batch) {
+        if (rreq->has_linked_data()) {
+            futs.emplace_back(data_service().async_write(value, rreq->local_blkid(), true /* part_of_batch */));
+        }
+    }
+    if (!futs.empty()) { data_service().submit_io_batch(); }
+
+    folly::collectAllUnsafe(futs).thenValue([this, batch = std::move(batch)](auto&& results) {
+        for (auto const& res : results) {
+            HS_REL_ASSERT(!res.value(), "Error in writing data"); // TODO: Find a way to return error to the Listener
+        }
+
+        auto pending = std::make_shared< std::atomic< uint32_t > >(uint32_cast(batch.size()));
+        auto written = std::make_shared< std::vector< std::pair< repl_req_ptr_t, int64_t > > >(batch.size());
+        for (size_t i{0}; i < batch.size(); ++i) {
+            auto& rreq = batch[i].first;
+            rreq->create_journal_entry(false /* raft_buf */, 1);
+            m_data_journal->append_async(
+                sisl::io_blob{rreq->raw_journal_buf(), rreq->journal_entry_size(), false /* is_aligned */},
+                nullptr /* cookie */,
+                [this, rreq, i, pending, written](int64_t lsn, sisl::io_blob&, homestore::logdev_key, void*) {
+                    (*written)[i] = {rreq, lsn};
+                    if (pending->fetch_sub(1) != 1) { return; }
+                    for (auto const& [r, l] : *written) {
+                        on_journal_written(r, l);
+                    }
+                });
+        }
+    });
+}
+
 void SoloReplDev::write_journal(repl_req_ptr_t rreq) {
     rreq->create_journal_entry(false /* raft_buf */, 1);
+    TraceScope trace_scope{rreq->trace_id()};
 
     m_data_journal->append_async(
         sisl::io_blob{rreq->raw_journal_buf(), rreq->journal_entry_size(), false /* is_aligned */},
-        nullptr /* cookie */, [this, rreq](int64_t lsn, sisl::io_blob&, homestore::logdev_key, void*) mutable {
-            rreq->set_lsn(lsn);
-            m_listener->on_pre_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq);
+        nullptr /* cookie */,
+        [this, rreq](int64_t lsn, sisl::io_blob&, homestore::logdev_key, void*) { on_journal_written(rreq, lsn); });
+}
 
-            auto cur_lsn = m_commit_upto.load();
-            if (cur_lsn < lsn) { m_commit_upto.compare_exchange_strong(cur_lsn, lsn); }
+void SoloReplDev::on_journal_written(repl_req_ptr_t const& rreq, int64_t lsn) {
+    rreq->set_lsn(lsn);
+    TraceScope trace_scope{rreq->trace_id()};
+    m_listener->on_pre_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq);
 
-            data_service().commit_blk(rreq->local_blkid());
-            m_listener->on_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq->local_blkid(), rreq);
-        });
+    auto cur_lsn = m_commit_upto.load();
+    if (cur_lsn < lsn) { m_commit_upto.compare_exchange_strong(cur_lsn, lsn); }
+
+    data_service().commit_blk(rreq->local_blkid());
+    m_listener->on_commit(rreq->lsn(), rreq->header(), rreq->key(), rreq->local_blkid(), rreq);
 }
 
 void SoloReplDev::on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx) {
@@ -87,7 +176,7 @@ void SoloReplDev::on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx
 
     sisl::blob value_blob{raw_ptr, remain_size};
     MultiBlkId blkid;
-    if (remain_size) { blkid.deserialize(value_blob, true /* copy */); }
+    if (remain_size) { blkid.deserialize(value_blob, entry->blkid_format()); }
 
     m_listener->on_pre_commit(lsn, header, key, nullptr);
 
@@ -99,6 +188,7 @@ void SoloReplDev::on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx
 
 folly::Future< std::error_code > SoloReplDev::async_read(MultiBlkId const& bid, sisl::sg_list& sgs, uint32_t size,
                                                          bool part_of_batch) {
+    io_tenant_guard tg{io_tenant()};
     return data_service().async_read(bid, sgs, size, part_of_batch);
 }
 
@@ -106,6 +196,13 @@ void SoloReplDev::async_free_blks(int64_t, MultiBlkId const& bid) { data_service
 
 uint32_t SoloReplDev::get_blk_size() const { return data_service().get_blk_size(); }
 
+io_tenant_t SoloReplDev::io_tenant() const {
+    // Solo groups have no ordinal, leading bytes of the (random) group id are as unique
+    io_tenant_t tenant;
+    std::memcpy(&tenant, m_group_id.data, sizeof(tenant));
+    return (tenant == untagged_io_tenant) ? io_tenant_t{1} : tenant;
+}
+
 void SoloReplDev::cp_flush(CP*) {
     auto lsn = m_commit_upto.load();
     m_rd_sb->durable_commit_lsn = lsn;
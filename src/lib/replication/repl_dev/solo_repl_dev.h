@@ -27,7 +27,7 @@
 namespace homestore {
 class CP;
 
-class SoloReplDev : public ReplDev {
+class SoloReplDev : public ReplDev, public std::enable_shared_from_this< SoloReplDev > {
 private:
     logdev_id_t m_logdev_id;
     std::shared_ptr< HomeLogStore > m_data_journal;
@@ -35,6 +35,11 @@ private:
     uuid_t m_group_id;
     std::atomic< logstore_seq_num_t > m_commit_upto{-1};
 
+    // Writes waiting to be written together (see consensus.solo_write_batch_size)
+    std::mutex m_write_batch_mtx;
+    std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > m_write_batch;
+    uint64_t m_write_batch_gen{0}; // Bumped on every flush, so that the timer of a batch flushed already does nothing
+
 public:
     SoloReplDev(superblk< repl_dev_superblk >&& rd_sb, bool load_existing);
     virtual ~SoloReplDev() = default;
@@ -57,12 +62,17 @@ public:
     uuid_t group_id() const override { return m_group_id; }
 
     uint32_t get_blk_size() const override;
+    io_tenant_t io_tenant() const override;
 
     void cp_flush(CP* cp);
     void cp_cleanup(CP* cp);
 
 private:
     void write_journal(repl_req_ptr_t rreq);
+    void on_journal_written(repl_req_ptr_t const& rreq, int64_t lsn);
+    void add_to_write_batch(repl_req_ptr_t rreq, sisl::sg_list const& value);
+    void flush_write_batch(uint64_t gen);
+    void write_batch(std::vector< std::pair< repl_req_ptr_t, sisl::sg_list > > batch);
     void on_log_found(logstore_seq_num_t lsn, log_buffer buf, void* ctx);
 };
 
@@ -81,15 +81,14 @@ hs_stats GenericReplService::get_cap_stats() const {
 ///////////////////// SoloReplService specializations and CP Callbacks /////////////////////////////
 SoloReplService::SoloReplService(cshared< ReplApplication >& repl_app) : GenericReplService{repl_app} {}
 
-void SoloReplService::start() {
+void SoloReplService::load_repl_devs() {
     for (auto const& [buf, mblk] : m_sb_bufs) {
         load_repl_dev(buf, voidptr_cast(mblk));
     }
     m_sb_bufs.clear();
+}
 
-    hs()->data_service().start();
-    hs()->logstore_service().start(hs()->is_first_time_boot());
-
+void SoloReplService::start_repl_devs() {
     // Register to CP to flush the super blk and truncate the logstore
     hs()->cp_mgr().register_consumer(cp_consumer_t::REPLICATION_SVC, std::make_unique< SoloReplServiceCPHandler >());
 }
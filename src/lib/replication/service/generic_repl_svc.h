@@ -33,6 +33,7 @@ namespace homestore {
 
 static std::string const PUSH_DATA{"push_data"};
 static std::string const FETCH_DATA{"fetch_data"};
+static std::string const PUSH_DATA_BATCH{"push_data_batch"};
 
 struct repl_dev_superblk;
 class GenericReplService : public ReplicationService {
@@ -47,7 +48,12 @@ public:
     static std::shared_ptr< GenericReplService > create(cshared< ReplApplication >& repl_app);
 
     GenericReplService(cshared< ReplApplication >& repl_app);
-    virtual void start() = 0;
+
+    /// @brief Homestore starts the service in two phases, with the data and log store services started in between:
+    /// load_repl_devs creates the repl devs (opening their log stores), which the log store recovery then replays
+    /// into, and start_repl_devs brings them up (joins the raft groups), once the services they commit into are up.
+    virtual void load_repl_devs() = 0;
+    virtual void start_repl_devs() = 0;
     virtual void stop();
     meta_sub_type get_meta_blk_name() const override { return "repl_dev"; }
 
@@ -66,7 +72,8 @@ protected:
 class SoloReplService : public GenericReplService {
 public:
     SoloReplService(cshared< ReplApplication >& repl_app);
-    void start() override;
+    void load_repl_devs() override;
+    void start_repl_devs() override;
     void stop() override;
 
     AsyncReplResult< shared< ReplDev > > create_repl_dev(group_id_t group_id,
@@ -86,6 +93,12 @@ public:
     folly::Future< bool > cp_flush(CP* cp) override;
     void cp_cleanup(CP* cp) override;
     int cp_progress_percent() override;
+
+    // Checkpoint lsn persisted in a cp has everything upto it in index and data service durable, so they have to be
+    // done with the cp before
+    std::vector< cp_consumer_t > cp_flush_depends_on() const override {
+        return {cp_consumer_t::INDEX_SVC, cp_consumer_t::BLK_DATA_SVC};
+    }
 };
 
 extern ReplicationService& repl_service();
@@ -21,6 +21,7 @@
 #include <homestore/logstore_service.hpp>
 #include "common/homestore_config.hpp"
 #include "common/homestore_assert.hpp"
+#include "common/thread_affinity.hpp"
 #include "replication/service/raft_repl_service.h"
 #include "replication/repl_dev/raft_repl_dev.h"
 
@@ -69,7 +70,7 @@ RaftReplService::RaftReplService(cshared< ReplApplication >& repl_app) : Generic
         nullptr, false, std::optional< meta_subtype_vec_t >({get_meta_blk_name()}));
 }
 
-void RaftReplService::start() {
+void RaftReplService::load_repl_devs() {
     // Step 1: Initialize the Nuraft messaging service, which starts the nuraft service
     m_my_uuid = m_repl_app->get_my_repl_id();
     auto params = nuraft_mesg::Manager::Params{
@@ -121,11 +122,15 @@ void RaftReplService::start() {
     }
     m_config_sb_bufs.clear();
 
-    // Step 5: Start the data and logstore service now. This step is essential before we can ask Raft to join groups etc
-    hs()->data_service().start();
-    hs()->logstore_service().start(hs()->is_first_time_boot());
+    // Step 5: Start the threads to apply commits in parallel on (if configured), before any of the commits come in
+    start_commit_threads();
+}
+
+void RaftReplService::start_repl_devs() {
+    // Step 6: Data and logstore services are started by homestore by now (log stores of the repl devs loaded above are
+    // replayed). This step is essential before we can ask Raft to join groups etc
 
-    // Step 6: Iterate all the repl dev and ask each one of the join the raft group.
+    // Step 7: Iterate all the repl dev and ask each one of the join the raft group.
     for (auto it = m_rd_map.begin(); it != m_rd_map.end();) {
         auto rdev = std::dynamic_pointer_cast< RaftReplDev >(it->second);
         rdev->wait_for_logstore_ready();
@@ -136,10 +141,10 @@ void RaftReplService::start() {
         }
     }
 
-    // Step 7: Register to CPManager to ensure we can flush the superblk.
+    // Step 8: Register to CPManager to ensure we can flush the superblk.
     hs()->cp_mgr().register_consumer(cp_consumer_t::REPLICATION_SVC, std::make_unique< RaftReplServiceCPHandler >());
 
-    // Step 8: Start a reaper thread which wakes up time-to-time and fetches pending data or cleans up old requests etc
+    // Step 9: Start a reaper thread which wakes up time-to-time and fetches pending data or cleans up old requests etc
     start_reaper_thread();
 
     // Delete any unopened logstores.
@@ -148,17 +153,18 @@ void RaftReplService::start() {
 
 void RaftReplService::stop() {
     stop_reaper_thread();
+
+    // Raft servers are stopped first, so that no commit is dispatched to the commit fibers once they are stopped. The
+    // ones dispatched by then are applied before the fibers stop.
     GenericReplService::stop();
     m_msg_mgr.reset();
+    stop_commit_threads();
     hs()->logstore_service().stop();
 }
 
 void RaftReplService::raft_group_config_found(sisl::byte_view const& buf, void* meta_cookie) {
-    json_superblk group_config;
-    auto& js = group_config.load(buf, meta_cookie);
-
-    DEBUG_ASSERT(js.contains("group_id"), "Missing group_id field in raft_config superblk");
-    std::string gid_str = js["group_id"];
+    binary_superblk group_config;
+    std::string gid_str = RaftReplDev::config_group_id(group_config.load(buf, meta_cookie));
     RELEASE_ASSERT(!gid_str.empty(), "Invalid raft_group config found");
 
     boost::uuids::string_generator gen;
@@ -203,11 +209,8 @@ shared< nuraft_mesg::mesg_state_mgr > RaftReplService::create_state_mgr(int32_t
     // Create a new instance of Raft ReplDev (which is the state manager this method is looking for)
     auto rdev = std::make_shared< RaftReplDev >(*this, std::move(rd_sb), false /* load_existing */);
 
-    // Create a raft config for this repl_dev and assign it to the repl_dev
-    auto raft_config_sb = json_superblk{get_meta_blk_name() + "_raft_config"};
-    (*raft_config_sb)["group_id"] = boost::uuids::to_string(group_id);
-    raft_config_sb.write();
-    rdev->use_config(std::move(raft_config_sb));
+    // Create a raft config for this repl_dev and assign it to the repl_dev, which persists it with its group_id
+    rdev->use_config(binary_superblk{get_meta_blk_name() + "_raft_config"});
 
     // Attach the listener to the raft
     auto listener = m_repl_app->create_repl_dev_listener(group_id);
@@ -333,6 +336,7 @@ void RaftReplService::start_reaper_thread() {
     auto f = p.getFuture();
     iomanager.create_reactor("repl_svc_reaper", iomgr::INTERRUPT_LOOP, 1u, [this, &p](bool is_started) mutable {
         if (is_started) {
+            pin_thread(hs_thread_role_t::repl);
             m_reaper_fiber = iomanager.iofiber_self();
 
             // Schedule the rdev garbage collector timer
@@ -355,17 +359,49 @@ void RaftReplService::start_reaper_thread() {
                 HS_DYNAMIC_CONFIG(consensus.flush_durable_commit_interval_ms) * 1000 * 1000, true /* recurring */,
                 nullptr, [this](void*) { flush_durable_commit_lsn(); });
 
+            // Tune raft params of the groups to their load (quiesce, append batch), every few heartbeats
+            m_rdev_tune_timer_hdl = iomanager.schedule_thread_timer(
+                uint64_cast(HS_DYNAMIC_CONFIG(consensus.heartbeat_period_ms)) * 4 * 1000 * 1000,
+                true /* recurring */, nullptr, [this](void*) { tune_repl_devs(); });
+
             p.setValue();
         } else {
             // Cancel all recurring timers started
             iomanager.cancel_timer(m_rdev_gc_timer_hdl, true /* wait */);
             iomanager.cancel_timer(m_rdev_fetch_timer_hdl, true /* wait */);
             iomanager.cancel_timer(m_flush_durable_commit_timer_hdl, true /* wait */);
+            iomanager.cancel_timer(m_rdev_tune_timer_hdl, true /* wait */);
         }
     });
     std::move(f).get();
 }
 
+void RaftReplService::start_commit_threads() {
+    auto const nthreads = HS_DYNAMIC_CONFIG(consensus.commit_apply_threads);
+    m_commit_fibers.resize(nthreads);
+    for (uint32_t i{0}; i < nthreads; ++i) {
+        folly::Promise< folly::Unit > p;
+        auto f = p.getFuture();
+        iomanager.create_reactor(fmt::format("repl_commit_{}", i), iomgr::INTERRUPT_LOOP, 1u,
+                                 [this, i, &p](bool is_started) mutable {
+                                     if (is_started) {
+                                         pin_thread(hs_thread_role_t::repl);
+                                         m_commit_fibers[i] = iomanager.iofiber_self();
+                                         p.setValue();
+                                     }
+                                 });
+        std::move(f).get();
+    }
+}
+
+void RaftReplService::stop_commit_threads() {
+    // Commits queued already are applied before the thread stops
+    for (auto const& fiber : m_commit_fibers) {
+        iomanager.run_on_wait(fiber, [] { iomanager.stop_io_loop(); });
+    }
+    m_commit_fibers.clear();
+}
+
 void RaftReplService::stop_reaper_thread() {
     iomanager.run_on_wait(m_reaper_fiber, [] { iomanager.stop_io_loop(); });
 }
@@ -427,13 +463,25 @@ void RaftReplService::flush_durable_commit_lsn() {
     }
 }
 
+void RaftReplService::tune_repl_devs() {
+    std::shared_lock lg(m_rd_map_mtx);
+    for (auto& [group_id, rdev] : m_rd_map) {
+        auto raft_rdev = std::dynamic_pointer_cast< RaftReplDev >(rdev);
+        raft_rdev->check_quiesce();
+        raft_rdev->adapt_append_batch();
+    }
+}
+
 ///////////////////// RaftReplService CP Callbacks /////////////////////////////
 std::unique_ptr< CPContext > RaftReplServiceCPHandler::on_switchover_cp(CP* cur_cp, CP* new_cp) { return nullptr; }
 
 folly::Future< bool > RaftReplServiceCPHandler::cp_flush(CP* cp) {
-    repl_service().iterate_repl_devs(
-        [cp](cshared< ReplDev >& repl_dev) { std::static_pointer_cast< RaftReplDev >(repl_dev)->cp_flush(cp); });
-    return folly::makeFuture< bool >(true);
+    // Sbs of all the repl devs are written together in one pass of meta service, instead of one after the other
+    std::vector< folly::Future< bool > > futs;
+    repl_service().iterate_repl_devs([cp, &futs](cshared< ReplDev >& repl_dev) {
+        futs.emplace_back(std::static_pointer_cast< RaftReplDev >(repl_dev)->cp_flush(cp));
+    });
+    return folly::collectAllUnsafe(futs).thenValue([](auto&&) { return true; });
 }
 
 void RaftReplServiceCPHandler::cp_cleanup(CP* cp) {
@@ -46,7 +46,9 @@ private:
     iomgr::timer_handle_t m_rdev_fetch_timer_hdl;
     iomgr::timer_handle_t m_rdev_gc_timer_hdl;
     iomgr::timer_handle_t m_flush_durable_commit_timer_hdl;
+    iomgr::timer_handle_t m_rdev_tune_timer_hdl;
     iomgr::io_fiber_t m_reaper_fiber;
+    std::vector< iomgr::io_fiber_t > m_commit_fibers; // Fibers to apply commits in parallel on
 
 public:
     RaftReplService(cshared< ReplApplication >& repl_app);
@@ -60,9 +62,18 @@ public:
     nuraft_mesg::Manager& msg_manager() { return *m_msg_mgr; }
     void add_to_fetch_queue(cshared< RaftReplDev >& rdev, std::vector< repl_req_ptr_t > rreqs);
 
+    /// @brief Whether commits are applied in parallel, on commit threads (consensus.commit_apply_threads)
+    bool has_commit_threads() const { return !m_commit_fibers.empty(); }
+
+    /// @brief Commit thread for the commits of the given ordering key
+    iomgr::io_fiber_t commit_fiber(uint64_t order_key) const {
+        return m_commit_fibers[order_key % m_commit_fibers.size()];
+    }
+
 protected:
     ///////////////////// Overrides of GenericReplService ////////////////////
-    void start() override;
+    void load_repl_devs() override;
+    void start_repl_devs() override;
     void stop() override;
 
     AsyncReplResult< shared< ReplDev > > create_repl_dev(group_id_t group_id,
@@ -76,10 +87,13 @@ private:
     void raft_group_config_found(sisl::byte_view const& buf, void* meta_cookie);
     void start_reaper_thread();
     void stop_reaper_thread();
+    void start_commit_threads();
+    void stop_commit_threads();
     void fetch_pending_data();
     void gc_repl_devs();
     void gc_repl_reqs();
     void flush_durable_commit_lsn();
+    void tune_repl_devs();
 
 };
 
@@ -93,6 +107,12 @@ public:
     folly::Future< bool > cp_flush(CP* cp) override;
     void cp_cleanup(CP* cp) override;
     int cp_progress_percent() override;
+
+    // Checkpoint lsn persisted in a cp has everything upto it in index and data service durable, so they have to be
+    // done with the cp before
+    std::vector< cp_consumer_t > cp_flush_depends_on() const override {
+        return {cp_consumer_t::INDEX_SVC, cp_consumer_t::BLK_DATA_SVC};
+    }
 };
 
 } // namespace homestore
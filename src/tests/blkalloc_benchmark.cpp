@@ -0,0 +1,262 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "test_common/homestore_test_common.hpp"
+#include "common/homestore_config.hpp"
+#include "blkalloc/fixed_blk_allocator.h"
+#include "blkalloc/varsize_blk_allocator.h"
+#include "blkalloc/append_blk_allocator.h"
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+std::vector< std::string > test_common::HSTestHelper::s_dev_names;
+SISL_OPTIONS_ENABLE(logging, blkalloc_benchmark, iomgr, test_common_setup)
+
+SISL_OPTION_GROUP(blkalloc_benchmark,
+                  (num_blks, "", "num_blks", "number of blks in the allocator",
+                   ::cxxopts::value< uint32_t >()->default_value("1048576"), "number"),
+                  (live_window, "", "live_window",
+                   "number of blkids each thread keeps allocated before it starts freeing them at random",
+                   ::cxxopts::value< uint32_t >()->default_value("1024"), "number"))
+
+/*
+ * Every iteration allocates a blkid (and once the thread's live window is full, frees a random one of its own), on an
+ * allocator which is prefilled to the given fill level. So the allocator stays at steady state around the fill level
+ * and time per iteration is the cost of an alloc + free pair.
+ *
+ * Args: {size distribution, fill pct}
+ */
+ENUM(alloc_type_t, uint8_t, VARSIZE, FIXED, APPEND);
+ENUM(size_dist_t, uint8_t, SINGLE, SLAB, UNIFORM);
+
+static std::unique_ptr< BlkAllocator > s_allocator;
+static std::mutex s_append_reset_mtx;
+static uint16_t s_append_id{0};
+static uint64_t s_start_allocs{0};
+static uint64_t s_start_direct_allocs{0};
+
+static thread_local std::default_random_engine s_re{std::random_device{}()};
+
+static blk_count_t gen_size(size_dist_t dist) {
+    switch (dist) {
+    case size_dist_t::SLAB:
+        // Exactly the slab sizes, which blk cache serves without split/merge
+        return blk_count_t{1} << std::uniform_int_distribution< uint32_t >{0, 6}(s_re);
+    case size_dist_t::UNIFORM:
+        return s_cast< blk_count_t >(std::uniform_int_distribution< uint32_t >{1, 64}(s_re));
+    case size_dist_t::SINGLE:
+    default:
+        return 1;
+    }
+}
+
+// Counters in metrics json are keyed by their name (along with description), so look it up by prefix
+static uint64_t counter_value(nlohmann::json const& j, std::string const& name) {
+    if (j.is_object()) {
+        for (auto const& [key, val] : j.items()) {
+            bool const match = (key == name) || (key.rfind(name + " ", 0) == 0);
+            if (match && val.is_number()) { return val.get< uint64_t >(); }
+            if (auto const v = counter_value(val, name); v != 0) { return v; }
+        }
+    }
+    return 0;
+}
+
+static std::pair< uint64_t, uint64_t > varsize_cache_counters() {
+    auto* va = dynamic_cast< VarsizeBlkAllocator* >(s_allocator.get());
+    if (va == nullptr) { return {0, 0}; }
+    auto const j = va->get_metrics_in_json();
+    return {counter_value(j, "num_alloc"), counter_value(j, "num_blks_alloc_direct")};
+}
+
+static BlkAllocStatus do_alloc(alloc_type_t type, blk_count_t nblks, bool is_contiguous, MultiBlkId& out_bid) {
+    blk_alloc_hints hints;
+    hints.is_contiguous = is_contiguous;
+    if (type == alloc_type_t::FIXED) {
+        BlkId bid;
+        auto const status = s_allocator->alloc(1, hints, bid);
+        if (status == BlkAllocStatus::SUCCESS) { out_bid = MultiBlkId{bid}; }
+        return status;
+    }
+    return s_allocator->alloc(nblks, hints, out_bid);
+}
+
+static void do_free(alloc_type_t type, MultiBlkId const& bid) {
+    if (type == alloc_type_t::FIXED) {
+        s_allocator->free(bid.to_single_blkid());
+    } else {
+        s_allocator->free(bid);
+    }
+}
+
+template < alloc_type_t Type >
+static void bm_setup(benchmark::State const& state) {
+    auto const nblks = SISL_OPTIONS["num_blks"].as< uint32_t >();
+    uint64_t const size = uint64_cast(nblks) * 4096;
+    switch (Type) {
+    case alloc_type_t::VARSIZE: {
+        VarsizeBlkAllocConfig cfg{4096, 4096, 4096, size, false, "bench_varsize", true /* use_slabs */};
+        s_allocator = std::make_unique< VarsizeBlkAllocator >(cfg, true, 0);
+        break;
+    }
+    case alloc_type_t::FIXED: {
+        BlkAllocConfig cfg{4096, 4096, size, false, "bench_fixed"};
+        s_allocator = std::make_unique< FixedBlkAllocator >(cfg, true, 0);
+        break;
+    }
+    case alloc_type_t::APPEND:
+    default: {
+        // Append allocator registers with meta service by its id, so every run needs a new one
+        BlkAllocConfig cfg{4096, 4096, size, false};
+        s_allocator = std::make_unique< AppendBlkAllocator >(cfg, true, ++s_append_id);
+        break;
+    }
+    }
+
+    // Prefill to the fill level. These blks stay allocated for the whole run.
+    auto const dist = s_cast< size_dist_t >(state.range(0));
+    auto const fill_nblks = (uint64_cast(nblks) * uint64_cast(state.range(1))) / 100;
+    while (s_allocator->get_used_blks() < fill_nblks) {
+        MultiBlkId bid;
+        if (do_alloc(Type, gen_size(dist), true, bid) != BlkAllocStatus::SUCCESS) { break; }
+    }
+    std::tie(s_start_allocs, s_start_direct_allocs) = varsize_cache_counters();
+    LOGINFO("Benchmark {} prefilled used_blks={} of total_blks={}", Type, s_allocator->get_used_blks(), nblks);
+}
+
+static void bm_teardown(benchmark::State const&) { s_allocator.reset(); }
+
+template < alloc_type_t Type >
+static void bm_alloc_free(benchmark::State& state) {
+    auto const dist = s_cast< size_dist_t >(state.range(0));
+    bool const is_contiguous = (dist != size_dist_t::UNIFORM);
+    auto const live_window = SISL_OPTIONS["live_window"].as< uint32_t >();
+
+    std::vector< MultiBlkId > live;
+    live.reserve(live_window + 1);
+    uint64_t nallocs{0};
+    uint64_t nfailures{0};
+    uint64_t npieces{0};
+
+    for ([[maybe_unused]] auto _ : state) {
+        MultiBlkId bid;
+        auto const status = do_alloc(Type, gen_size(dist), is_contiguous, bid);
+        ++nallocs;
+        if (status == BlkAllocStatus::SUCCESS) {
+            npieces += bid.num_pieces();
+            live.push_back(bid);
+        } else if (Type == alloc_type_t::APPEND) {
+            // Append allocator never reuses freed blks, so reclaim the whole chunk once it is full. Nothing is written
+            // to these blks, so an alloc racing with the reset is harmless here
+            state.PauseTiming();
+            {
+                std::unique_lock lg{s_append_reset_mtx};
+                if (s_allocator->available_blks() < 64) { s_cast< AppendBlkAllocator* >(s_allocator.get())->reset(); }
+            }
+            live.clear();
+            state.ResumeTiming();
+        } else {
+            ++nfailures;
+        }
+
+        if (live.size() > live_window) {
+            auto const idx = std::uniform_int_distribution< size_t >{0, live.size() - 1}(s_re);
+            do_free(Type, live[idx]);
+            live[idx] = live.back();
+            live.pop_back();
+        }
+    }
+
+    for (auto const& b : live) {
+        do_free(Type, b);
+    }
+
+    state.SetItemsProcessed(nallocs);
+    state.counters["fail_pct"] =
+        benchmark::Counter(nallocs ? (100.0 * nfailures) / nallocs : 0.0, benchmark::Counter::kAvgThreads);
+    state.counters["pieces_per_alloc"] = benchmark::Counter(
+        (nallocs > nfailures) ? double(npieces) / (nallocs - nfailures) : 0.0, benchmark::Counter::kAvgThreads);
+
+    if ((Type == alloc_type_t::VARSIZE) && (state.thread_index() == 0)) {
+        // Allocs which couldn't be served by the FreeBlkCacheQueue had to go directly to the bitmap. Counters are of
+        // the allocator and so are for all threads, hence reported only by one thread.
+        auto const [allocs, direct] = varsize_cache_counters();
+        auto const nallocs_all = allocs - s_start_allocs;
+        auto const ndirect = direct - s_start_direct_allocs;
+        state.counters["cache_hit_pct"] = nallocs_all ? 100.0 - ((100.0 * ndirect) / nallocs_all) : 0.0;
+    }
+}
+
+static void varsize_args(benchmark::internal::Benchmark* b) {
+    for (auto const dist : {size_dist_t::SINGLE, size_dist_t::SLAB, size_dist_t::UNIFORM}) {
+        for (auto const fill_pct : {0, 50, 90}) {
+            b->Args({s_cast< int64_t >(dist), fill_pct});
+        }
+    }
+    b->ArgNames({"size_dist", "fill_pct"});
+}
+
+static void fixed_args(benchmark::internal::Benchmark* b) {
+    for (auto const fill_pct : {0, 50, 90}) {
+        b->Args({s_cast< int64_t >(size_dist_t::SINGLE), fill_pct});
+    }
+    b->ArgNames({"size_dist", "fill_pct"});
+}
+
+static void append_args(benchmark::internal::Benchmark* b) {
+    for (auto const dist : {size_dist_t::SINGLE, size_dist_t::SLAB}) {
+        b->Args({s_cast< int64_t >(dist), 0});
+    }
+    b->ArgNames({"size_dist", "fill_pct"});
+}
+
+#define BLKALLOC_BENCHMARK(TYPE, ARGS)                                                                                 \
+    BENCHMARK(bm_alloc_free< alloc_type_t::TYPE >)                                                                    \
+        ->Setup(bm_setup< alloc_type_t::TYPE >)                                                                       \
+        ->Teardown(bm_teardown)                                                                                        \
+        ->Apply(ARGS)                                                                                                  \
+        ->ThreadRange(1, 8)                                                                                            \
+        ->UseRealTime()                                                                                                \
+        ->Name(#TYPE);
+
+BLKALLOC_BENCHMARK(VARSIZE, varsize_args)
+BLKALLOC_BENCHMARK(FIXED, fixed_args)
+BLKALLOC_BENCHMARK(APPEND, append_args)
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, blkalloc_benchmark, iomgr, test_common_setup);
+    sisl::logging::SetLogger("blkalloc_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%t] %v");
+
+    // Append allocator persists its superblk through meta service, rest of the allocators don't need homestore
+    test_common::HSTestHelper::start_homestore("blkalloc_benchmark", {{HS_SERVICE::META, {.size_pct = 10.0}}});
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    test_common::HSTestHelper::shutdown_homestore();
+    return 0;
+}
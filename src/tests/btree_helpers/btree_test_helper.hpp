@@ -62,6 +62,7 @@ struct BtreeTestHelper {
         m_operations["range_put"] = std::bind(&BtreeTestHelper::range_put_random, this);
         m_operations["range_remove"] = std::bind(&BtreeTestHelper::range_remove_existing_random, this);
         m_operations["query"] = std::bind(&BtreeTestHelper::query_random, this);
+        m_operations["get"] = std::bind(&BtreeTestHelper::get_random, this);
     }
 
     void TearDown() {}
@@ -235,8 +236,8 @@ public:
         do_range_remove(start_k, end_k, true /* only_existing */);
     }
 
-    void range_remove_any(uint32_t start_k, uint32_t end_k) {
-        do_range_remove(start_k, end_k, false /* removing_all_existing */);
+    void range_remove_any(uint32_t start_k, uint32_t end_k, bool free_subtrees = false) {
+        do_range_remove(start_k, end_k, false /* removing_all_existing */, free_subtrees);
     }
 
     ////////////////////// All query operation variants ///////////////////////////////
@@ -297,6 +298,34 @@ public:
         do_query(start_k, end_k, 79);
     }
 
+    // Visits the range through the streaming query in pages of batch_size, each of which the visitor stops after
+    // stop_after entries, resuming from where it stopped
+    void do_visit_query(uint32_t start_k, uint32_t end_k, uint32_t batch_size, uint32_t stop_after) {
+        std::vector< std::pair< K, V > > visited;
+        BtreeQueryRequest< K > qreq{BtreeKeyRange< K >{K{start_k}, true, K{end_k}, true},
+                                    BtreeQueryType::SWEEP_NON_INTRUSIVE_PAGINATION_QUERY, batch_size};
+        btree_status_t ret;
+        do {
+            uint32_t n{0};
+            ret = m_bt->query(qreq, [&visited, &n, stop_after](BtreeKey const& k, BtreeValue const& v) {
+                visited.emplace_back(s_cast< K const& >(k), s_cast< V const& >(v));
+                return (++n < stop_after);
+            });
+        } while (ret == btree_status_t::has_more);
+        ASSERT_EQ(ret, btree_status_t::success) << "Expected success on streaming query";
+
+        m_shadow_map.guard().lock();
+        ASSERT_EQ(visited.size(), m_shadow_map.num_elems_in_range(start_k, end_k))
+            << "Streaming query visited incorrect number of entries";
+        auto it = m_shadow_map.map_const().lower_bound(K{start_k});
+        for (size_t idx{0}; idx < visited.size(); ++idx, ++it) {
+            ASSERT_EQ(visited[idx].first.compare(it->first), 0) << "Streaming query visited key out of order";
+            ASSERT_EQ(visited[idx].second, it->second)
+                << "Streaming query doesn't return correct data for key=" << it->first << " idx=" << idx;
+        }
+        m_shadow_map.guard().unlock();
+    }
+
     ////////////////////// All get operation variants ///////////////////////////////
     void get_all() const {
         m_shadow_map.foreach ([this](K key, V value) {
@@ -325,6 +354,12 @@ public:
         }
     }
 
+    void get_random() {
+        auto const [k, end_k] = m_shadow_map.pick_random_non_working_keys(1);
+        get_specific(k);
+        m_shadow_map.remove_keys_from_working(k, end_k);
+    }
+
     void get_any(uint32_t start_k, uint32_t end_k) const {
         auto out_k = std::make_unique< K >();
         auto out_v = std::make_unique< V >();
@@ -400,11 +435,12 @@ private:
         if (expect_success) { m_shadow_map.put_and_check(key, value, *existing_v, done); }
     }
 
-    void do_range_remove(uint64_t start_k, uint64_t end_k, bool all_existing) {
+    void do_range_remove(uint64_t start_k, uint64_t end_k, bool all_existing, bool free_subtrees = false) {
         K start_key = K{start_k};
         K end_key = K{end_k};
 
         auto rreq = BtreeRangeRemoveRequest< K >{BtreeKeyRange< K >{start_key, true, end_key, true}};
+        rreq.m_free_subtrees = free_subtrees;
         rreq.enable_route_tracing();
         auto const ret = m_bt->remove(rreq);
 
@@ -199,6 +199,12 @@ public:
     // Add 8 bytes for preamble.
     static uint32_t get_max_size() { return g_max_keysize + 8; }
 
+    // Preamble is the key in hex, which is all that compare looks at
+    static uint32_t normalized_prefix(const sisl::blob& b) {
+        std::string const preamble{r_cast< const char* >(b.cbytes()), std::min(uint32_cast(b.size()), 8u)};
+        return uint32_cast(std::stoul(preamble, nullptr, 16));
+    }
+
     int compare(const BtreeKey& o) const override {
         const TestVarLenKey& other = s_cast< const TestVarLenKey& >(o);
         if (m_key < other.m_key) {
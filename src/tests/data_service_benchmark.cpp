@@ -0,0 +1,298 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/blkdata_service.hpp>
+#include "test_common/homestore_test_common.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Drives a timed mix of async_alloc_write / async_read / async_free_blk //
+//  against the data service with qdepth ios outstanding per io thread.   //
+//  Devices are the default file backed ones or --device_list.            //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+std::vector< std::string > test_common::HSTestHelper::s_dev_names;
+
+SISL_OPTIONS_ENABLE(logging, data_service_benchmark, iomgr, test_common_setup)
+SISL_OPTION_GROUP(data_service_benchmark,
+                  (run_time_secs, "", "run_time_secs", "duration of the measured run in seconds",
+                   ::cxxopts::value< uint32_t >()->default_value("30"), "seconds"),
+                  (io_sizes_kb, "", "io_sizes_kb", "io sizes (in KB) picked at random for every io",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("4,16,64"), "size [...]"),
+                  (read_pct, "", "read_pct", "pct of ios which are reads, rest are writes",
+                   ::cxxopts::value< uint32_t >()->default_value("50"), "0-100"),
+                  (fill_pct, "", "fill_pct",
+                   "pct of data capacity kept written, beyond which every write first frees an earlier write",
+                   ::cxxopts::value< uint32_t >()->default_value("70"), "0-100"));
+
+ENUM(bench_op_t, uint8_t, write, read, free);
+
+class DataSvcBench {
+public:
+    DataSvcBench() {
+        for (auto const kb : SISL_OPTIONS["io_sizes_kb"].as< std::vector< uint32_t > >()) {
+            m_io_sizes.push_back(sisl::round_up(kb * 1024, data_service().get_blk_size()));
+        }
+        RELEASE_ASSERT(!m_io_sizes.empty(), "No io sizes given");
+        auto const max_size = *std::max_element(m_io_sizes.begin(), m_io_sizes.end());
+
+        // Content is not verified, so all the ios share a write source and a read scratch buffer
+        m_write_buf = iomanager.iobuf_alloc(data_service().get_align_size(), max_size);
+        test_common::HSTestHelper::fill_data_buf(m_write_buf, max_size);
+        m_read_buf = iomanager.iobuf_alloc(data_service().get_align_size(), max_size);
+        m_fill_limit = (data_service().get_total_capacity() * SISL_OPTIONS["fill_pct"].as< uint32_t >()) / 100;
+    }
+
+    DataSvcBench(const DataSvcBench&) = delete;
+    DataSvcBench& operator=(const DataSvcBench&) = delete;
+    DataSvcBench(DataSvcBench&&) noexcept = delete;
+    DataSvcBench& operator=(DataSvcBench&&) noexcept = delete;
+
+    ~DataSvcBench() {
+        iomanager.iobuf_free(m_write_buf);
+        iomanager.iobuf_free(m_read_buf);
+    }
+
+    void run(benchmark::State& state) {
+        m_end_time = Clock::now() + std::chrono::seconds(SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+        auto const start_time = Clock::now();
+        iomanager.run_on_wait(iomgr::reactor_regex::all_io, [this]() {
+            for (uint32_t i{0}; i < m_qdepth; ++i) {
+                issue_io();
+            }
+        });
+
+        {
+            std::unique_lock lg{m_done_mtx};
+            m_done_cv.wait(lg, [this]() { return (m_outstanding.load() == 0); });
+        }
+        report(state, get_elapsed_time_us(start_time));
+    }
+
+private:
+    struct thread_stats {
+        std::array< std::vector< uint64_t >, 3 > lat_us; // Indexed by bench_op_t
+        std::array< uint64_t, 3 > bytes{0, 0, 0};
+        std::array< uint64_t, 3 > errors{0, 0, 0};
+    };
+
+    struct live_blk {
+        MultiBlkId bid;
+        uint32_t size;
+    };
+
+    // Stats are per io thread, so that recording the completions doesn't serialize them
+    thread_stats& my_stats() {
+        static thread_local thread_stats* s_stats{nullptr};
+        if (s_stats == nullptr) {
+            std::unique_lock lg{m_live_mtx};
+            s_stats = m_all_stats.emplace_back(std::make_unique< thread_stats >()).get();
+        }
+        return *s_stats;
+    }
+
+    void record(bench_op_t op, uint32_t size, Clock::time_point start_time, std::error_code ec) {
+        auto& st = my_stats();
+        auto const idx = s_cast< size_t >(op);
+        st.lat_us[idx].push_back(get_elapsed_time_us(start_time));
+        if (ec) {
+            ++st.errors[idx];
+        } else {
+            st.bytes[idx] += size;
+        }
+    }
+
+    void issue_io() {
+        if (Clock::now() >= m_end_time) { return; }
+        m_outstanding.fetch_add(1, std::memory_order_acq_rel);
+
+        static thread_local std::default_random_engine s_re{std::random_device{}()};
+        std::uniform_int_distribution< uint32_t > pct_dist{0, 99};
+        bool const do_read = (pct_dist(s_re) < m_read_pct);
+
+        std::optional< live_blk > victim;
+        {
+            std::unique_lock lg{m_live_mtx};
+            if (!m_live_blks.empty() && (do_read || (m_live_bytes >= m_fill_limit))) {
+                std::uniform_int_distribution< size_t > blk_dist{0, m_live_blks.size() - 1};
+                auto const i = blk_dist(s_re);
+                victim = m_live_blks[i];
+                if (!do_read) {
+                    // Steady state, make room for the write by freeing an earlier one
+                    m_live_blks[i] = m_live_blks.back();
+                    m_live_blks.pop_back();
+                    m_live_bytes -= victim->size;
+                }
+            }
+        }
+
+        if (do_read && victim) {
+            do_read_io(*victim);
+        } else {
+            if (victim) { do_free_io(*victim); }
+            std::uniform_int_distribution< size_t > size_dist{0, m_io_sizes.size() - 1};
+            do_write_io(m_io_sizes[size_dist(s_re)]);
+        }
+    }
+
+    void do_write_io(uint32_t size) {
+        sisl::sg_list sgs;
+        sgs.size = size;
+        sgs.iovs.emplace_back(iovec{.iov_base = m_write_buf, .iov_len = size});
+
+        auto bid = std::make_shared< MultiBlkId >();
+        auto const start_time = Clock::now();
+        data_service().async_alloc_write(sgs, blk_alloc_hints{}, *bid).thenValue([this, bid, size,
+                                                                                   start_time](auto&& ec) {
+            record(bench_op_t::write, size, start_time, ec);
+            if (!ec) {
+                std::unique_lock lg{m_live_mtx};
+                m_live_blks.push_back(live_blk{*bid, size});
+                m_live_bytes += size;
+            }
+            on_io_completion();
+        });
+    }
+
+    void do_read_io(live_blk const& lb) {
+        sisl::sg_list sgs;
+        sgs.size = lb.size;
+        sgs.iovs.emplace_back(iovec{.iov_base = m_read_buf, .iov_len = lb.size});
+
+        auto const start_time = Clock::now();
+        data_service().async_read(lb.bid, sgs, lb.size).thenValue([this, size = lb.size, start_time](auto&& ec) {
+            record(bench_op_t::read, size, start_time, ec);
+            on_io_completion();
+        });
+    }
+
+    void do_free_io(live_blk const& lb) {
+        // Frees don't count against the qdepth, they are just timed
+        auto const start_time = Clock::now();
+        data_service().async_free_blk(lb.bid).thenValue([this, size = lb.size, start_time](auto&& ec) {
+            record(bench_op_t::free, size, start_time, ec);
+        });
+    }
+
+    void on_io_completion() {
+        issue_io();
+        if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock lg{m_done_mtx};
+            m_done_cv.notify_all();
+        }
+    }
+
+    static uint64_t percentile(std::vector< uint64_t > const& sorted, double pct) {
+        if (sorted.empty()) { return 0; }
+        auto const idx = std::min(s_cast< size_t >((pct * sorted.size()) / 100.0), sorted.size() - 1);
+        return sorted[idx];
+    }
+
+    void report(benchmark::State& state, uint64_t elapsed_us) {
+        auto const elapsed_sec = std::max(elapsed_us, uint64_t{1}) / (1000.0 * 1000.0);
+        std::unique_lock lg{m_live_mtx};
+        for (size_t op{0}; op < 3; ++op) {
+            std::vector< uint64_t > lats;
+            uint64_t bytes{0};
+            uint64_t errors{0};
+            for (auto const& st : m_all_stats) {
+                lats.insert(lats.end(), st->lat_us[op].begin(), st->lat_us[op].end());
+                bytes += st->bytes[op];
+                errors += st->errors[op];
+            }
+            std::sort(lats.begin(), lats.end());
+
+            auto const name = enum_name(s_cast< bench_op_t >(op));
+            auto const iops = lats.size() / elapsed_sec;
+            auto const mbps = bytes / (elapsed_sec * 1024 * 1024);
+            state.counters[fmt::format("{}_iops", name)] = iops;
+            state.counters[fmt::format("{}_MBps", name)] = mbps;
+            state.counters[fmt::format("{}_p50_us", name)] = percentile(lats, 50.0);
+            state.counters[fmt::format("{}_p99_us", name)] = percentile(lats, 99.0);
+            state.counters[fmt::format("{}_p999_us", name)] = percentile(lats, 99.9);
+            LOGINFO("{}: ios={} errors={} iops={:.0f} bw={:.2f}MB/s lat_us p50={} p90={} p99={} p99.9={} max={}", name,
+                    lats.size(), errors, iops, mbps, percentile(lats, 50.0), percentile(lats, 90.0),
+                    percentile(lats, 99.0), percentile(lats, 99.9), lats.empty() ? 0 : lats.back());
+        }
+    }
+
+private:
+    std::vector< uint32_t > m_io_sizes;
+    uint32_t const m_qdepth{SISL_OPTIONS["qdepth"].as< uint32_t >()};
+    uint32_t const m_read_pct{SISL_OPTIONS["read_pct"].as< uint32_t >()};
+    uint8_t* m_write_buf{nullptr};
+    uint8_t* m_read_buf{nullptr};
+    uint64_t m_fill_limit{0};
+    Clock::time_point m_end_time;
+
+    std::mutex m_live_mtx;
+    std::vector< live_blk > m_live_blks; // Written blks, which reads and frees pick from
+    uint64_t m_live_bytes{0};
+    std::vector< std::unique_ptr< thread_stats > > m_all_stats;
+
+    std::atomic< int64_t > m_outstanding{0};
+    std::mutex m_done_mtx;
+    std::condition_variable m_done_cv;
+};
+
+static void test_data_service_mix(benchmark::State& state) {
+    auto bench = std::make_unique< DataSvcBench >();
+    for (auto _ : state) { // Loops upto iteration count
+        bench->run(state);
+    }
+}
+
+static void setup() {
+    test_common::HSTestHelper::start_homestore(
+        "data_service_benchmark", {{HS_SERVICE::META, {.size_pct = 5.0}}, {HS_SERVICE::DATA, {.size_pct = 80.0}}});
+}
+
+static void teardown() { test_common::HSTestHelper::shutdown_homestore(); }
+
+BENCHMARK(test_data_service_mix)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, data_service_benchmark, iomgr, test_common_setup)
+    sisl::logging::SetLogger("data_service_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    setup();
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    LOGINFO("Metrics: {}", sisl::MetricsFarm::getInstance().get_result_in_json()["BlkDataService"].dump(4));
+    teardown();
+}
@@ -0,0 +1,370 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/logstore_service.hpp>
+#include <homestore/logstore/log_store.hpp>
+#include "test_common/homestore_test_common.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Drives a timed mix of append_async / read_range_async with qdepth ops //
+//  outstanding per io thread, plus append_sync from sync_threads, across //
+//  num_logdevs x stores_per_logdev append mode log stores. Optionally    //
+//  injects truncation and rollback of a (quiesced) store every           //
+//  fault_interval_ms. Prints the percentiles of each op at the end.      //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+std::vector< std::string > test_common::HSTestHelper::s_dev_names;
+
+SISL_OPTIONS_ENABLE(logging, log_store_mix_benchmark, iomgr, test_common_setup)
+SISL_OPTION_GROUP(log_store_mix_benchmark,
+                  (run_time_secs, "", "run_time_secs", "duration of the measured run in seconds",
+                   ::cxxopts::value< uint32_t >()->default_value("30"), "seconds"),
+                  (num_logdevs, "", "num_logdevs", "number of logdevs",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (stores_per_logdev, "", "stores_per_logdev", "number of log stores on each logdev",
+                   ::cxxopts::value< uint32_t >()->default_value("2"), "number"),
+                  (record_sizes, "", "record_sizes", "record sizes (in bytes) picked at random for every append",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("64,512,4096"), "size [...]"),
+                  (read_pct, "", "read_pct", "pct of async ops which are reads, rest are appends",
+                   ::cxxopts::value< uint32_t >()->default_value("20"), "0-100"),
+                  (sync_threads, "", "sync_threads", "number of threads doing append_sync back to back",
+                   ::cxxopts::value< uint32_t >()->default_value("1"), "number"),
+                  (inject_faults, "", "inject_faults", "periodically truncate or rollback a store during the run",
+                   ::cxxopts::value< bool >()->default_value("false"), "true or false"),
+                  (fault_interval_ms, "", "fault_interval_ms", "interval between the injected truncation/rollback",
+                   ::cxxopts::value< uint32_t >()->default_value("100"), "ms"),
+                  (rollback_max, "", "rollback_max", "max number of records to rollback at a time",
+                   ::cxxopts::value< uint32_t >()->default_value("16"), "number"));
+
+ENUM(bench_op_t, uint8_t, append, append_sync, read, truncate, rollback);
+static constexpr size_t num_bench_ops{5};
+
+class LogStoreMixBench {
+public:
+    LogStoreMixBench() {
+        for (auto const sz : SISL_OPTIONS["record_sizes"].as< std::vector< uint32_t > >()) {
+            m_record_sizes.push_back(std::max(sz, 1u));
+        }
+        RELEASE_ASSERT(!m_record_sizes.empty(), "No record sizes given");
+
+        // Content is not verified, so all the appends share a source buffer
+        m_data.resize(*std::max_element(m_record_sizes.begin(), m_record_sizes.end()), 'x');
+
+        auto const nlogdevs = SISL_OPTIONS["num_logdevs"].as< uint32_t >();
+        auto const nstores = SISL_OPTIONS["stores_per_logdev"].as< uint32_t >();
+        for (uint32_t d{0}; d < nlogdevs; ++d) {
+            auto const logdev_id = logstore_service().create_new_logdev();
+            for (uint32_t s{0}; s < nstores; ++s) {
+                m_stores.emplace_back(std::make_unique< store_ctx >(
+                    logstore_service().create_new_log_store(logdev_id, true /* append_mode */)));
+            }
+        }
+        RELEASE_ASSERT(!m_stores.empty(), "No log stores to run on");
+    }
+
+    LogStoreMixBench(const LogStoreMixBench&) = delete;
+    LogStoreMixBench& operator=(const LogStoreMixBench&) = delete;
+    LogStoreMixBench(LogStoreMixBench&&) noexcept = delete;
+    LogStoreMixBench& operator=(LogStoreMixBench&&) noexcept = delete;
+    ~LogStoreMixBench() = default;
+
+    void run(benchmark::State& state) {
+        m_end_time = Clock::now() + std::chrono::seconds(SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+        auto const start_time = Clock::now();
+        iomanager.run_on_wait(iomgr::reactor_regex::all_io, [this]() {
+            for (uint32_t i{0}; i < m_qdepth; ++i) {
+                issue_op();
+            }
+        });
+
+        // append_sync can't be done on a worker reactor, so they are driven by plain threads
+        std::vector< std::thread > threads;
+        for (uint32_t t{0}; t < SISL_OPTIONS["sync_threads"].as< uint32_t >(); ++t) {
+            threads.emplace_back([this]() { sync_appender(); });
+        }
+        if (SISL_OPTIONS["inject_faults"].as< bool >()) {
+            threads.emplace_back([this]() { fault_injector(); });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+
+        {
+            std::unique_lock lg{m_done_mtx};
+            m_done_cv.wait(lg, [this]() { return (m_outstanding.load() == 0); });
+        }
+        report(state, get_elapsed_time_us(start_time));
+    }
+
+private:
+    struct thread_stats {
+        std::array< std::vector< uint64_t >, num_bench_ops > lat_us; // Indexed by bench_op_t
+        std::array< uint64_t, num_bench_ops > bytes{};
+    };
+
+    // Truncation and rollback are done on a store with nothing in flight on it. Ops take a ref on the store before
+    // checking if it is paused, while fault injector pauses it before waiting for the refs to drain.
+    struct store_ctx {
+        explicit store_ctx(shared< HomeLogStore > s) : store{std::move(s)} {}
+
+        shared< HomeLogStore > store;
+        std::atomic< int64_t > inflight{0};
+        std::atomic< bool > paused{false};
+    };
+
+    thread_stats& my_stats() {
+        static thread_local thread_stats* s_stats{nullptr};
+        if (s_stats == nullptr) {
+            std::unique_lock lg{m_stats_mtx};
+            s_stats = m_all_stats.emplace_back(std::make_unique< thread_stats >()).get();
+        }
+        return *s_stats;
+    }
+
+    void record(bench_op_t op, uint64_t bytes, Clock::time_point start_time) {
+        auto& st = my_stats();
+        auto const idx = s_cast< size_t >(op);
+        st.lat_us[idx].push_back(get_elapsed_time_us(start_time));
+        st.bytes[idx] += bytes;
+    }
+
+    static std::default_random_engine& rand_engine() {
+        static thread_local std::default_random_engine s_re{std::random_device{}()};
+        return s_re;
+    }
+
+    // Picks a random store which is not paused and takes a ref on it, nullptr if all of them are paused
+    store_ctx* acquire_store() {
+        std::uniform_int_distribution< size_t > dist{0, m_stores.size() - 1};
+        auto const start = dist(rand_engine());
+        for (size_t i{0}; i < m_stores.size(); ++i) {
+            auto* ctx = m_stores[(start + i) % m_stores.size()].get();
+            ctx->inflight.fetch_add(1);
+            if (!ctx->paused.load()) { return ctx; }
+            ctx->inflight.fetch_sub(1);
+        }
+        return nullptr;
+    }
+
+    uint32_t pick_record_size() {
+        std::uniform_int_distribution< size_t > dist{0, m_record_sizes.size() - 1};
+        return m_record_sizes[dist(rand_engine())];
+    }
+
+    void issue_op() {
+        if (Clock::now() >= m_end_time) { return; }
+        auto* ctx = acquire_store();
+        if (ctx == nullptr) {
+            // Single store which is paused, fault injector reissues it upon resume
+            m_parked.fetch_add(1);
+            return;
+        }
+        m_outstanding.fetch_add(1, std::memory_order_acq_rel);
+
+        std::uniform_int_distribution< uint32_t > pct_dist{0, 99};
+        auto const completed = ctx->store->get_contiguous_completed_seq_num(-1);
+        auto const truncated = ctx->store->truncated_upto();
+        if ((pct_dist(rand_engine()) < m_read_pct) && (completed > truncated)) {
+            std::uniform_int_distribution< logstore_seq_num_t > lsn_dist{truncated + 1, completed};
+            do_read(ctx, lsn_dist(rand_engine()));
+        } else {
+            do_append(ctx);
+        }
+    }
+
+    void do_append(store_ctx* ctx) {
+        auto const size = pick_record_size();
+        auto const start_time = Clock::now();
+        ctx->store->append_async(sisl::io_blob{r_cast< uint8_t* >(m_data.data()), size, false}, nullptr,
+                                 [this, ctx, size, start_time](logstore_seq_num_t, sisl::io_blob&, logdev_key, void*) {
+                                     record(bench_op_t::append, size, start_time);
+                                     on_op_completion(ctx);
+                                 });
+    }
+
+    void do_read(store_ctx* ctx, logstore_seq_num_t lsn) {
+        auto const start_time = Clock::now();
+        ctx->store->read_range_async(lsn, lsn + 1).thenValue([this, ctx, start_time](std::vector< log_buffer > bufs) {
+            record(bench_op_t::read, bufs.empty() ? 0 : bufs[0].size(), start_time);
+            on_op_completion(ctx);
+        });
+    }
+
+    void on_op_completion(store_ctx* ctx) {
+        ctx->inflight.fetch_sub(1);
+        issue_op();
+        if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock lg{m_done_mtx};
+            m_done_cv.notify_all();
+        }
+    }
+
+    void sync_appender() {
+        while (Clock::now() < m_end_time) {
+            auto* ctx = acquire_store();
+            if (ctx == nullptr) {
+                std::this_thread::yield();
+                continue;
+            }
+            auto const size = pick_record_size();
+            auto const start_time = Clock::now();
+            ctx->store->append_sync(sisl::io_blob{r_cast< uint8_t* >(m_data.data()), size, false});
+            record(bench_op_t::append_sync, size, start_time);
+            ctx->inflight.fetch_sub(1);
+        }
+    }
+
+    void fault_injector() {
+        auto const interval = std::chrono::milliseconds(SISL_OPTIONS["fault_interval_ms"].as< uint32_t >());
+        auto const rollback_max = std::max(SISL_OPTIONS["rollback_max"].as< uint32_t >(), 1u);
+        while (Clock::now() < m_end_time) {
+            std::this_thread::sleep_for(interval);
+            std::uniform_int_distribution< size_t > store_dist{0, m_stores.size() - 1};
+            auto& ctx = *m_stores[store_dist(rand_engine())];
+
+            ctx.paused.store(true);
+            while (ctx.inflight.load() != 0) {
+                std::this_thread::yield();
+            }
+
+            auto const completed = ctx.store->get_contiguous_completed_seq_num(-1);
+            auto const truncated = ctx.store->truncated_upto();
+            auto const start_time = Clock::now();
+            if (completed > truncated + 1) {
+                std::uniform_int_distribution< uint32_t > coin{0, 1};
+                if (coin(rand_engine()) == 0) {
+                    // Truncate about half of what is there, leaving the rest for reads
+                    ctx.store->truncate(truncated + ((completed - truncated) / 2));
+                    record(bench_op_t::truncate, 0, start_time);
+                } else {
+                    auto const nrollback =
+                        std::min(s_cast< logstore_seq_num_t >(rollback_max), completed - truncated - 1);
+                    std::promise< void > p;
+                    ctx.store->rollback_async(completed - nrollback, [&p](logstore_seq_num_t) { p.set_value(); });
+                    p.get_future().get();
+                    record(bench_op_t::rollback, 0, start_time);
+                }
+            }
+
+            ctx.paused.store(false);
+            for (auto n = m_parked.exchange(0); n > 0; --n) {
+                iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [this]() { issue_op(); });
+            }
+        }
+    }
+
+    static uint64_t percentile(std::vector< uint64_t > const& sorted, double pct) {
+        if (sorted.empty()) { return 0; }
+        auto const idx = std::min(s_cast< size_t >((pct * sorted.size()) / 100.0), sorted.size() - 1);
+        return sorted[idx];
+    }
+
+    void report(benchmark::State& state, uint64_t elapsed_us) {
+        auto const elapsed_sec = std::max(elapsed_us, uint64_t{1}) / (1000.0 * 1000.0);
+        std::unique_lock lg{m_stats_mtx};
+        for (size_t op{0}; op < num_bench_ops; ++op) {
+            std::vector< uint64_t > lats;
+            uint64_t bytes{0};
+            for (auto const& st : m_all_stats) {
+                lats.insert(lats.end(), st->lat_us[op].begin(), st->lat_us[op].end());
+                bytes += st->bytes[op];
+            }
+            if (lats.empty()) { continue; }
+            std::sort(lats.begin(), lats.end());
+
+            auto const name = enum_name(s_cast< bench_op_t >(op));
+            auto const ops = lats.size() / elapsed_sec;
+            auto const mbps = bytes / (elapsed_sec * 1024 * 1024);
+            state.counters[fmt::format("{}_ops", name)] = ops;
+            state.counters[fmt::format("{}_p50_us", name)] = percentile(lats, 50.0);
+            state.counters[fmt::format("{}_p99_us", name)] = percentile(lats, 99.0);
+            state.counters[fmt::format("{}_p999_us", name)] = percentile(lats, 99.9);
+            LOGINFO("{}: count={} ops/s={:.0f} bw={:.2f}MB/s lat_us p50={} p90={} p99={} p99.9={} max={}", name,
+                    lats.size(), ops, mbps, percentile(lats, 50.0), percentile(lats, 90.0), percentile(lats, 99.0),
+                    percentile(lats, 99.9), lats.back());
+        }
+    }
+
+private:
+    std::vector< uint32_t > m_record_sizes;
+    std::string m_data;
+    std::vector< std::unique_ptr< store_ctx > > m_stores;
+    uint32_t const m_qdepth{SISL_OPTIONS["qdepth"].as< uint32_t >()};
+    uint32_t const m_read_pct{SISL_OPTIONS["read_pct"].as< uint32_t >()};
+    Clock::time_point m_end_time;
+
+    std::mutex m_stats_mtx;
+    std::vector< std::unique_ptr< thread_stats > > m_all_stats;
+
+    std::atomic< int64_t > m_outstanding{0};
+    std::atomic< uint32_t > m_parked{0}; // Ops not issued since all stores were paused
+    std::mutex m_done_mtx;
+    std::condition_variable m_done_cv;
+};
+
+static void test_log_store_mix(benchmark::State& state) {
+    auto bench = std::make_unique< LogStoreMixBench >();
+    for (auto _ : state) { // Loops upto iteration count
+        bench->run(state);
+    }
+}
+
+static void setup() {
+    test_common::HSTestHelper::start_homestore(
+        "log_store_mix_benchmark", {{HS_SERVICE::META, {.size_pct = 5.0}}, {HS_SERVICE::LOG, {.size_pct = 87.0}}});
+}
+
+static void teardown() { test_common::HSTestHelper::shutdown_homestore(); }
+
+BENCHMARK(test_log_store_mix)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, log_store_mix_benchmark, iomgr, test_common_setup)
+    sisl::logging::SetLogger("log_store_mix_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    setup();
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    auto metrics = sisl::MetricsFarm::getInstance().get_result_in_json();
+    LOGINFO("Metrics: {}", metrics["LogStores"].dump(4));
+    LOGINFO("LogDev Metrics: {}", metrics["LogDev"].dump(4));
+    teardown();
+}
@@ -0,0 +1,296 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <sisl/options/options.h>
+#include <sisl/logging/logging.h>
+
+#include <homestore/btree/mem_btree.hpp>
+#include <homestore/btree/detail/simple_node.hpp>
+#include <homestore/btree/detail/varlen_node.hpp>
+#include <homestore/btree/detail/prefix_node.hpp>
+#include "btree_helpers/btree_test_kvs.hpp"
+
+using namespace homestore;
+SISL_LOGGING_DEF(btree)
+SISL_LOGGING_INIT(btree)
+
+SISL_OPTIONS_ENABLE(logging, mem_btree_benchmark)
+SISL_OPTION_GROUP(mem_btree_benchmark,
+                  (num_entries, "", "num_entries", "number of keys in the key space",
+                   ::cxxopts::value< uint32_t >()->default_value("100000"), "number"),
+                  (query_batch, "", "query_batch", "number of entries read by each range query",
+                   ::cxxopts::value< uint32_t >()->default_value("100"), "number"),
+                  (zipf_theta, "", "zipf_theta", "skew of the zipfian key distribution",
+                   ::cxxopts::value< double >()->default_value("0.99"), "number"),
+                  (latency_sample, "", "latency_sample", "measure latency of every nth op",
+                   ::cxxopts::value< uint32_t >()->default_value("16"), "number"))
+
+struct FixedLenBtree {
+    using BtreeType = MemBtree< TestFixedKey, TestFixedValue >;
+    using KeyType = TestFixedKey;
+    using ValueType = TestFixedValue;
+    static constexpr btree_node_type leaf_node_type = btree_node_type::FIXED;
+    static constexpr btree_node_type interior_node_type = btree_node_type::FIXED;
+};
+
+struct VarKeySizeBtree {
+    using BtreeType = MemBtree< TestVarLenKey, TestFixedValue >;
+    using KeyType = TestVarLenKey;
+    using ValueType = TestFixedValue;
+    static constexpr btree_node_type leaf_node_type = btree_node_type::VAR_KEY;
+    static constexpr btree_node_type interior_node_type = btree_node_type::VAR_KEY;
+};
+
+struct VarObjSizeBtree {
+    using BtreeType = MemBtree< TestVarLenKey, TestVarLenValue >;
+    using KeyType = TestVarLenKey;
+    using ValueType = TestVarLenValue;
+    static constexpr btree_node_type leaf_node_type = btree_node_type::VAR_OBJECT;
+    static constexpr btree_node_type interior_node_type = btree_node_type::VAR_OBJECT;
+};
+
+struct PrefixIntervalBtree {
+    using BtreeType = MemBtree< TestIntervalKey, TestIntervalValue >;
+    using KeyType = TestIntervalKey;
+    using ValueType = TestIntervalValue;
+    static constexpr btree_node_type leaf_node_type = btree_node_type::PREFIX;
+    static constexpr btree_node_type interior_node_type = btree_node_type::FIXED;
+};
+
+static constexpr uint32_t g_node_size{4096};
+
+enum class key_dist_t : uint8_t { SEQUENTIAL = 0, UNIFORM = 1, ZIPFIAN = 2 };
+enum class bench_op_t : uint8_t { PUT, GET, RANGE_QUERY, REMOVE };
+
+// Zipfian over [0, n) as in "Quickly Generating Billion-Record Synthetic Databases" (Gray et al), with the ranks
+// scattered over the key space so that the hot keys are not all in the same few leaves
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta) :
+            m_n{n}, m_theta{theta}, m_alpha{1.0 / (1.0 - theta)}, m_zetan{zeta(n, theta)} {
+        m_eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta(2, theta) / m_zetan);
+    }
+
+    template < typename RE >
+    uint64_t operator()(RE& re) {
+        double const u = m_uniform(re);
+        double const uz = u * m_zetan;
+        uint64_t rank;
+        if (uz < 1.0) {
+            rank = 0;
+        } else if (uz < 1.0 + std::pow(0.5, m_theta)) {
+            rank = 1;
+        } else {
+            rank = std::min(m_n - 1, s_cast< uint64_t >(m_n * std::pow(m_eta * u - m_eta + 1.0, m_alpha)));
+        }
+        return (rank * 0x9E3779B97F4A7C15ull) % m_n;
+    }
+
+private:
+    static double zeta(uint64_t n, double theta) {
+        double sum{0};
+        for (uint64_t i{1}; i <= n; ++i) {
+            sum += 1.0 / std::pow(double(i), theta);
+        }
+        return sum;
+    }
+
+private:
+    uint64_t const m_n;
+    double const m_theta;
+    double const m_alpha;
+    double const m_zetan;
+    double m_eta;
+    std::uniform_real_distribution< double > m_uniform{0.0, 1.0};
+};
+
+// Key generator of a thread, sequential keys of the threads are interleaved so that together they sweep the key space
+class KeyGenerator {
+public:
+    KeyGenerator(key_dist_t dist, uint64_t n, uint32_t thread_idx, uint32_t num_threads) :
+            m_dist{dist},
+            m_n{n},
+            m_next{thread_idx},
+            m_stride{num_threads},
+            m_re{std::random_device{}()},
+            m_uniform{0, n - 1},
+            m_zipf{n, SISL_OPTIONS["zipf_theta"].as< double >()} {}
+
+    uint64_t next() {
+        switch (m_dist) {
+        case key_dist_t::SEQUENTIAL: {
+            auto const k = m_next % m_n;
+            m_next += m_stride;
+            return k;
+        }
+        case key_dist_t::UNIFORM:
+            return m_uniform(m_re);
+        case key_dist_t::ZIPFIAN:
+        default:
+            return m_zipf(m_re);
+        }
+    }
+
+private:
+    key_dist_t const m_dist;
+    uint64_t const m_n;
+    uint64_t m_next;
+    uint64_t const m_stride;
+    std::default_random_engine m_re;
+    std::uniform_int_distribution< uint64_t > m_uniform;
+    ZipfianGenerator m_zipf;
+};
+
+// Tree is shared by all the threads of a run, thread 0 builds it before the timed loop and destroys it after, both of
+// which google benchmark fences with a barrier across the threads
+template < typename TestType >
+struct MemBtreeBenchmark {
+    using K = typename TestType::KeyType;
+    using V = typename TestType::ValueType;
+    static inline std::unique_ptr< typename TestType::BtreeType > s_bt;
+
+    static void setup(bench_op_t op) {
+        BtreeConfig cfg{g_node_size};
+        cfg.m_leaf_node_type = TestType::leaf_node_type;
+        cfg.m_int_node_type = TestType::interior_node_type;
+        s_bt = std::make_unique< typename TestType::BtreeType >(cfg);
+
+        // Puts start with an empty tree, to measure the splits as well, rest of the ops start with all the keys
+        if (op == bench_op_t::PUT) { return; }
+        auto const n = SISL_OPTIONS["num_entries"].as< uint32_t >();
+        for (uint64_t k{0}; k < n; ++k) {
+            K key{k};
+            V value = V::generate_rand();
+            auto req = BtreeSinglePutRequest{&key, &value, btree_put_type::UPSERT};
+            s_bt->put(req);
+        }
+    }
+
+    static void teardown() { s_bt.reset(); }
+
+    // Returns if the op found/changed an entry
+    static bool run_op(bench_op_t op, uint64_t k, V const& value, uint32_t query_batch) {
+        K key{k};
+        switch (op) {
+        case bench_op_t::PUT: {
+            auto req = BtreeSinglePutRequest{&key, &value, btree_put_type::UPSERT};
+            return (s_bt->put(req) == btree_status_t::success);
+        }
+        case bench_op_t::GET: {
+            V out_v;
+            auto req = BtreeSingleGetRequest{&key, &out_v};
+            return (s_bt->get(req) == btree_status_t::success);
+        }
+        case bench_op_t::RANGE_QUERY: {
+            std::vector< std::pair< K, V > > out_vector;
+            out_vector.reserve(query_batch);
+            BtreeQueryRequest< K > qreq{BtreeKeyRange< K >{key, true, K{k + query_batch - 1}, true},
+                                        BtreeQueryType::SWEEP_NON_INTRUSIVE_PAGINATION_QUERY, query_batch};
+            s_bt->query(qreq, out_vector);
+            benchmark::DoNotOptimize(out_vector.data());
+            return !out_vector.empty();
+        }
+        case bench_op_t::REMOVE:
+        default: {
+            V out_v;
+            auto req = BtreeSingleRemoveRequest{&key, &out_v};
+            return (s_bt->remove(req) == btree_status_t::success);
+        }
+        }
+    }
+};
+
+static double percentile_us(std::vector< uint64_t >& lat_ns, double pct) {
+    if (lat_ns.empty()) { return 0; }
+    auto const idx = std::min(lat_ns.size() - 1, s_cast< size_t >(lat_ns.size() * pct / 100.0));
+    std::nth_element(lat_ns.begin(), lat_ns.begin() + idx, lat_ns.end());
+    return lat_ns[idx] / 1000.0;
+}
+
+template < typename TestType, bench_op_t Op >
+void BM_MemBtree(benchmark::State& state) {
+    using B = MemBtreeBenchmark< TestType >;
+    using V = typename TestType::ValueType;
+    auto const dist = s_cast< key_dist_t >(state.range(0));
+    auto const n = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    auto const query_batch = SISL_OPTIONS["query_batch"].as< uint32_t >();
+    auto const sample = std::max(1u, SISL_OPTIONS["latency_sample"].as< uint32_t >());
+
+    if (state.thread_index() == 0) { B::setup(Op); }
+
+    KeyGenerator kgen{dist, n, uint32_cast(state.thread_index()), uint32_cast(state.threads())};
+    V const value = V::generate_rand();
+    std::vector< uint64_t > lat_ns;
+    uint64_t nops{0};
+    uint64_t nhits{0};
+
+    for (auto _ : state) {
+        auto const k = kgen.next();
+        if ((nops++ % sample) == 0) {
+            auto const start = std::chrono::steady_clock::now();
+            nhits += B::run_op(Op, k, value, query_batch);
+            lat_ns.push_back(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() -
+                                                                                    start)
+                                 .count());
+        } else {
+            nhits += B::run_op(Op, k, value, query_batch);
+        }
+    }
+
+    state.SetItemsProcessed(nops);
+    state.counters["hit_pct"] = benchmark::Counter(nops ? (100.0 * nhits / nops) : 0, benchmark::Counter::kAvgThreads);
+    state.counters["p50_us"] = benchmark::Counter(percentile_us(lat_ns, 50), benchmark::Counter::kAvgThreads);
+    state.counters["p99_us"] = benchmark::Counter(percentile_us(lat_ns, 99), benchmark::Counter::kAvgThreads);
+    state.counters["p999_us"] = benchmark::Counter(percentile_us(lat_ns, 99.9), benchmark::Counter::kAvgThreads);
+
+    if (state.thread_index() == 0) { B::teardown(); }
+}
+
+#define MEM_BTREE_BENCHMARK(BTREE_TYPE, OP)                                                                            \
+    BENCHMARK_TEMPLATE(BM_MemBtree, BTREE_TYPE, bench_op_t::OP)                                                        \
+        ->ArgName("dist")                                                                                              \
+        ->DenseRange(s_cast< int64_t >(key_dist_t::SEQUENTIAL), s_cast< int64_t >(key_dist_t::ZIPFIAN))                \
+        ->ThreadRange(1, 8)                                                                                            \
+        ->UseRealTime()                                                                                                \
+        ->Name(#BTREE_TYPE "/" #OP);
+
+#define MEM_BTREE_BENCHMARK_ALL_OPS(BTREE_TYPE)                                                                        \
+    MEM_BTREE_BENCHMARK(BTREE_TYPE, PUT)                                                                               \
+    MEM_BTREE_BENCHMARK(BTREE_TYPE, GET)                                                                               \
+    MEM_BTREE_BENCHMARK(BTREE_TYPE, RANGE_QUERY)                                                                       \
+    MEM_BTREE_BENCHMARK(BTREE_TYPE, REMOVE)
+
+MEM_BTREE_BENCHMARK_ALL_OPS(FixedLenBtree)
+MEM_BTREE_BENCHMARK_ALL_OPS(VarKeySizeBtree)
+MEM_BTREE_BENCHMARK_ALL_OPS(VarObjSizeBtree)
+MEM_BTREE_BENCHMARK_ALL_OPS(PrefixIntervalBtree)
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, mem_btree_benchmark);
+    sisl::logging::SetLogger("mem_btree_benchmark");
+    LOGINFO("Node lock tracking is {}", btree_track_node_locks ? "on" : "off");
+    spdlog::set_pattern("[%D %T%z] [%^%L%$] [%t] %v");
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,259 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <folly/futures/Future.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+#include <homestore/homestore.hpp>
+#include <homestore/meta_service.hpp>
+#include "test_common/homestore_test_common.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Times add / update / remove of sub sbs through the meta service, by   //
+//  payload size, sync or through the async (batched) apis, with or       //
+//  without compression. Then times recovery of the meta service on a     //
+//  restart, by the number of meta blks it has to recover.                //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+std::vector< std::string > test_common::HSTestHelper::s_dev_names;
+
+SISL_OPTIONS_ENABLE(logging, meta_blk_benchmark, iomgr, test_common_setup)
+SISL_OPTION_GROUP(meta_blk_benchmark,
+                  (payload_sizes_kb, "", "payload_sizes_kb",
+                   "sizes (in KB) of the sbs, beyond a blk of which they are written with overflow chains",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("1,16,256,4096"), "size [...]"),
+                  (num_sbs, "", "num_sbs", "sbs added, updated and then removed for every payload size",
+                   ::cxxopts::value< uint32_t >()->default_value("256"), "number"),
+                  (num_updates, "", "num_updates", "updates of each of the sbs",
+                   ::cxxopts::value< uint32_t >()->default_value("8"), "number"),
+                  (async, "", "async", "add and update through the async apis, so that they are batched",
+                   ::cxxopts::value< bool >()->default_value("false"), "true or false"),
+                  (compress, "", "compress", "compress the sbs (of at least min_compress_size_mb)",
+                   ::cxxopts::value< bool >()->default_value("false"), "true or false"),
+                  (compressible, "", "compressible", "content of the sbs compresses well, random otherwise",
+                   ::cxxopts::value< bool >()->default_value("true"), "true or false"),
+                  (recovery_sbs, "", "recovery_sbs", "number of sbs recovered on each of the restarts",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("1000,10000"), "number [...]"));
+
+ENUM(meta_op_t, uint8_t, add, update, remove);
+
+static constexpr std::string_view bench_type{"MetaBlkBench"};
+static test_common::HSTestHelper::test_token s_token;
+static std::vector< void* > s_recovered; // Cookies of the sbs found on a restart
+
+static void register_bench_handler() {
+    meta_service().register_handler(
+        std::string{bench_type}, [](meta_blk* mblk, sisl::byte_view, size_t) { s_recovered.push_back(mblk); },
+        nullptr);
+}
+
+static uint64_t percentile(std::vector< uint64_t > const& sorted, double pct) {
+    if (sorted.empty()) { return 0; }
+    auto const idx = std::min(s_cast< size_t >((pct * sorted.size()) / 100.0), sorted.size() - 1);
+    return sorted[idx];
+}
+
+class MetaBlkBench {
+public:
+    explicit MetaBlkBench(uint32_t payload_size) : m_payload_size{payload_size} {
+        m_buf = iomanager.iobuf_alloc(meta_service().align_size(), m_payload_size);
+        if (SISL_OPTIONS["compressible"].as< bool >()) {
+            // Runs of the same byte, which any codec compresses
+            for (uint32_t i{0}; i < m_payload_size; ++i) {
+                m_buf[i] = s_cast< uint8_t >((i / 512) % 26 + 'a');
+            }
+        } else {
+            test_common::HSTestHelper::fill_data_buf(m_buf, m_payload_size);
+        }
+        m_cookies.resize(SISL_OPTIONS["num_sbs"].as< uint32_t >(), nullptr);
+    }
+
+    MetaBlkBench(const MetaBlkBench&) = delete;
+    MetaBlkBench& operator=(const MetaBlkBench&) = delete;
+    ~MetaBlkBench() { iomanager.iobuf_free(m_buf); }
+
+    void run(benchmark::State& state) {
+        auto const async = SISL_OPTIONS["async"].as< bool >();
+        auto const elapsed_add = timed(meta_op_t::add, async, [this](uint32_t i) { return add(i); });
+        uint64_t elapsed_update{0};
+        for (uint32_t u{0}; u < SISL_OPTIONS["num_updates"].as< uint32_t >(); ++u) {
+            elapsed_update += timed(meta_op_t::update, async, [this](uint32_t i) { return update(i); });
+        }
+        auto const elapsed_remove = timed(meta_op_t::remove, false /* async */, [this](uint32_t i) {
+            meta_service().remove_sub_sb(m_cookies[i]);
+            return folly::makeFuture();
+        });
+        report(state, {elapsed_add, elapsed_update, elapsed_remove});
+    }
+
+private:
+    // Runs op on each of the sbs, either waiting for each one or issuing all of them and waiting for them together
+    template < typename OpT >
+    uint64_t timed(meta_op_t op, bool async, OpT&& op_fn) {
+        std::vector< folly::Future< folly::Unit > > futs;
+        auto const start_time = Clock::now();
+        for (uint32_t i{0}; i < m_cookies.size(); ++i) {
+            auto const op_start = Clock::now();
+            if (async) {
+                futs.emplace_back(op_fn(i).thenValue([this, op, op_start](auto&&) {
+                    m_lat_us[s_cast< size_t >(op)].push_back(get_elapsed_time_us(op_start));
+                }));
+            } else {
+                op_fn(i).wait();
+                m_lat_us[s_cast< size_t >(op)].push_back(get_elapsed_time_us(op_start));
+            }
+        }
+        folly::collectAllUnsafe(futs).get();
+        return get_elapsed_time_us(start_time);
+    }
+
+    folly::Future< folly::Unit > add(uint32_t i) {
+        if (!SISL_OPTIONS["async"].as< bool >()) {
+            meta_service().add_sub_sb(std::string{bench_type}, m_buf, m_payload_size, m_cookies[i]);
+            return folly::makeFuture();
+        }
+        return meta_service()
+            .async_add_sub_sb(std::string{bench_type}, m_buf, m_payload_size)
+            .thenValue([this, i](void* cookie) { m_cookies[i] = cookie; });
+    }
+
+    folly::Future< folly::Unit > update(uint32_t i) {
+        if (!SISL_OPTIONS["async"].as< bool >()) {
+            meta_service().update_sub_sb(m_buf, m_payload_size, m_cookies[i]);
+            return folly::makeFuture();
+        }
+        return meta_service().async_update_sub_sb(m_buf, m_payload_size, m_cookies[i]).thenValue([](bool) {});
+    }
+
+    void report(benchmark::State& state, std::array< uint64_t, 3 > const& elapsed_us) {
+        for (size_t op{0}; op < 3; ++op) {
+            auto& lats = m_lat_us[op];
+            std::sort(lats.begin(), lats.end());
+            auto const name = enum_name(s_cast< meta_op_t >(op));
+            auto const ops_per_sec = lats.size() / (std::max(elapsed_us[op], uint64_t{1}) / (1000.0 * 1000.0));
+            state.counters[fmt::format("{}_per_sec", name)] = ops_per_sec;
+            state.counters[fmt::format("{}_p50_us", name)] = percentile(lats, 50.0);
+            state.counters[fmt::format("{}_p99_us", name)] = percentile(lats, 99.0);
+            LOGINFO("payload={}KB {}: ops={} ops/sec={:.0f} lat_us p50={} p90={} p99={} max={}",
+                    m_payload_size / 1024, name, lats.size(), ops_per_sec, percentile(lats, 50.0),
+                    percentile(lats, 90.0), percentile(lats, 99.0), lats.empty() ? 0 : lats.back());
+        }
+    }
+
+private:
+    uint32_t const m_payload_size;
+    uint8_t* m_buf{nullptr};
+    std::vector< void* > m_cookies;
+    std::array< std::vector< uint64_t >, 3 > m_lat_us; // Indexed by meta_op_t, ops complete on one thread at a time
+};
+
+static void test_meta_ops(benchmark::State& state) {
+    auto bench = std::make_unique< MetaBlkBench >(s_cast< uint32_t >(state.range(0)) * 1024);
+    for (auto _ : state) { // Loops upto iteration count
+        bench->run(state);
+    }
+}
+
+static void test_meta_recovery(benchmark::State& state) {
+    auto const num_sbs = s_cast< uint32_t >(state.range(0));
+    auto const sz = meta_service().meta_blk_context_sz(); // Inline, so that it is the number of meta blks that counts
+    auto* buf = iomanager.iobuf_alloc(meta_service().align_size(), sz);
+    test_common::HSTestHelper::fill_data_buf(buf, sz);
+    for (uint32_t i{0}; i < num_sbs; ++i) {
+        void* cookie{nullptr};
+        meta_service().add_sub_sb(std::string{bench_type}, buf, sz, cookie);
+    }
+    iomanager.iobuf_free(buf);
+
+    for (auto _ : state) { // Loops upto iteration count
+        Clock::time_point start_time;
+        s_recovered.clear();
+        s_token.cb_ = [&start_time]() {
+            register_bench_handler();
+            start_time = Clock::now(); // Services, meta service the first of them, start right after
+        };
+        test_common::HSTestHelper::restart_homestore(s_token, 1 /* shutdown_delay_sec */);
+        auto const recovery_ms = get_elapsed_time_ms(start_time);
+        state.counters["recovery_ms"] = recovery_ms;
+        LOGINFO("recovery of {} meta blks took {} ms", num_sbs, recovery_ms);
+    }
+
+    // Next number of sbs starts from a clean meta service
+    for (auto* cookie : s_recovered) {
+        meta_service().remove_sub_sb(cookie);
+    }
+    s_recovered.clear();
+}
+
+static void setup() {
+    s_token = test_common::HSTestHelper::start_homestore("meta_blk_benchmark", {{HS_SERVICE::META, {.size_pct = 85.0}}},
+                                                         register_bench_handler);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.metablk.compress_feature_on = SISL_OPTIONS["compress"].as< bool >();
+        HS_SETTINGS_FACTORY().save();
+    });
+}
+
+static void teardown() { test_common::HSTestHelper::shutdown_homestore(); }
+
+static void payload_args(benchmark::internal::Benchmark* b) {
+    for (auto const kb : SISL_OPTIONS["payload_sizes_kb"].as< std::vector< uint32_t > >()) {
+        b->Arg(kb);
+    }
+}
+
+static void recovery_args(benchmark::internal::Benchmark* b) {
+    for (auto const n : SISL_OPTIONS["recovery_sbs"].as< std::vector< uint32_t > >()) {
+        b->Arg(n);
+    }
+}
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, meta_blk_benchmark, iomgr, test_common_setup)
+    sisl::logging::SetLogger("meta_blk_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    setup();
+    // Args are from the options, which are loaded only by now
+    ::benchmark::RegisterBenchmark("test_meta_ops", test_meta_ops)
+        ->Apply(payload_args)
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+    ::benchmark::RegisterBenchmark("test_meta_recovery", test_meta_recovery)
+        ->Apply(recovery_args)
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+    LOGINFO("Metrics: {}", sisl::MetricsFarm::getInstance().get_result_in_json()["MetaService"].dump(4));
+    teardown();
+}
@@ -0,0 +1,309 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+#include <folly/executors/GlobalExecutor.h>
+#include <gtest/gtest.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/blk.h>
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/blkdata_service.hpp>
+#include <homestore/replication_service.hpp>
+#include <homestore/replication/repl_dev.h>
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "test_common/bench_common.hpp"
+#include "test_common/hs_repl_test_common.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Measures the write path of RaftReplDev: spawns --replicas processes   //
+//  with num_groups raft groups among them and keeps concurrency          //
+//  async_alloc_writes outstanding on every group, from the replica which //
+//  leads it, for the run time. Each replica reports the commits of the   //
+//  groups it leads: throughput, commit latency percentiles and when the  //
+//  data push, journal flush, raft commit and local data write were done  //
+//  (from the start of the write).                                        //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS, nuraft_mesg)
+
+SISL_OPTION_GROUP(raft_repl_benchmark,
+                  (num_groups, "", "num_groups", "number of raft groups across the replicas",
+                   ::cxxopts::value< uint32_t >()->default_value("1"), "number"),
+                  (concurrency, "", "concurrency", "writes outstanding per group",
+                   ::cxxopts::value< uint32_t >()->default_value("32"), "number"),
+                  (value_sizes_kb, "", "value_sizes_kb", "value sizes (in KB) picked at random for every write",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("4"), "size [...]"),
+                  (run_time_secs, "", "run_time_secs", "duration of the measured run in seconds",
+                   ::cxxopts::value< uint32_t >()->default_value("30"), "seconds"));
+
+SISL_OPTIONS_ENABLE(logging, raft_repl_benchmark, iomgr, config, test_common_setup, test_repl_common_setup)
+
+static std::unique_ptr< test_common::HSReplTestHelper > g_helper;
+
+// Points of a write reported, from the start of its replication request
+ENUM(write_stage_t, uint8_t,
+     commit,      // Listener is called with the commit
+     data_pushed, // Data is pushed to all the followers
+     log_flushed, // Journal entry is durable on the leader
+     committed,   // Raft committed the entry, after the majority acked it
+     data_written // Data is written locally
+);
+static constexpr size_t num_stages{5};
+
+struct bench_req : public repl_req_ctx {
+    uint64_t seq_num;
+    sisl::sg_list write_sgs;
+
+    bench_req(uint64_t seq, uint8_t* buf, uint32_t size) : seq_num{seq} {
+        write_sgs.size = size;
+        write_sgs.iovs.emplace_back(iovec{.iov_base = buf, .iov_len = size});
+    }
+
+    sisl::blob header_blob() { return sisl::blob{uintptr_cast(&seq_num), sizeof(uint64_t)}; }
+};
+
+class BenchListener : public ReplDevListener {
+public:
+    struct stats {
+        std::array< std::vector< uint64_t >, num_stages > lat_us;
+        uint64_t bytes{0};
+        uint64_t errors{0};
+    };
+
+    BenchListener(std::vector< uint32_t > const& value_sizes, uint8_t* write_buf) :
+            m_value_sizes{value_sizes}, m_write_buf{write_buf} {}
+
+    /// @brief Keep concurrency writes outstanding until end_time. Returns once all of them are done.
+    void run(Clock::time_point end_time, uint32_t concurrency) {
+        m_end_time = end_time;
+        m_outstanding.add(concurrency);
+        for (uint32_t i{0}; i < concurrency; ++i) {
+            m_outstanding.reissue([this]() { do_write(); });
+        }
+        m_outstanding.wait();
+    }
+
+    uint64_t num_commits() const { return m_num_commits.load(); }
+    stats const& get_stats() const { return m_stats; }
+
+    ///////////////////////////// ReplDevListener /////////////////////////////
+    void on_commit(int64_t lsn, sisl::blob const&, sisl::blob const&, MultiBlkId const& blkids,
+                   cintrusive< repl_req_ctx >& ctx) override {
+        // Data is never read back, so its blks are freed right away to keep the run from filling up the devices
+        repl_dev()->async_free_blks(lsn, blkids);
+        m_num_commits.fetch_add(1, std::memory_order_relaxed);
+
+        intrusive< bench_req > req;
+        if (ctx && ctx->is_proposer()) { req = boost::dynamic_pointer_cast< bench_req >(ctx); }
+        if (req == nullptr) { return; } // Follower or replay
+
+        {
+            std::unique_lock lg{m_stats_mtx};
+            auto& lat = m_stats.lat_us;
+            lat[s_cast< size_t >(write_stage_t::commit)].push_back(get_elapsed_time_us(req->created_time()));
+            record(write_stage_t::data_pushed, req->stage_time_us(repl_req_stage_t::DATA_PUSHED));
+            record(write_stage_t::log_flushed, req->stage_time_us(repl_req_stage_t::LOG_FLUSHED));
+            record(write_stage_t::committed, req->stage_time_us(repl_req_stage_t::COMMITTED));
+            record(write_stage_t::data_written, req->stage_time_us(repl_req_stage_t::DATA_WRITTEN));
+            m_stats.bytes += req->write_sgs.size;
+        }
+        write_done();
+    }
+
+    bool on_pre_commit(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {
+        return true;
+    }
+
+    void on_rollback(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {}
+
+    void on_error(ReplServiceError error, sisl::blob const&, sisl::blob const&,
+                  cintrusive< repl_req_ctx >& ctx) override {
+        LOGERROR("Write failed with error={}", enum_name(error));
+        if (boost::dynamic_pointer_cast< bench_req >(ctx)) {
+            {
+                std::unique_lock lg{m_stats_mtx};
+                ++m_stats.errors;
+            }
+            write_done();
+        }
+    }
+
+    ReplResult< blk_alloc_hints > get_blk_alloc_hints(sisl::blob const&, uint32_t) override {
+        return blk_alloc_hints{};
+    }
+
+    AsyncReplResult<> create_snapshot(repl_snapshot&) override { return make_async_success<>(); }
+    void on_destroy() override {}
+
+private:
+    // Stages not reached (0) are of the writes whose data is embedded in the journal entry, which has no push
+    void record(write_stage_t stage, uint64_t us) {
+        if (us != 0) { m_stats.lat_us[s_cast< size_t >(stage)].push_back(us); }
+    }
+
+    void do_write() {
+        static thread_local std::default_random_engine s_re{std::random_device{}()};
+        std::uniform_int_distribution< size_t > size_dist{0, m_value_sizes.size() - 1};
+        auto req = intrusive< bench_req >(new bench_req(m_next_seq.fetch_add(1, std::memory_order_relaxed),
+                                                        m_write_buf, m_value_sizes[size_dist(s_re)]));
+        repl_dev()->async_alloc_write(req->header_blob(), sisl::blob{}, req->write_sgs, req);
+    }
+
+    void write_done() {
+        if (Clock::now() < m_end_time) {
+            m_outstanding.reissue([this]() { do_write(); });
+        } else {
+            m_outstanding.done();
+        }
+    }
+
+private:
+    std::vector< uint32_t > const& m_value_sizes;
+    uint8_t* m_write_buf;
+
+    Clock::time_point m_end_time;
+    std::atomic< uint64_t > m_next_seq{0};
+    std::atomic< uint64_t > m_num_commits{0};
+
+    std::mutex m_stats_mtx;
+    stats m_stats;
+
+    test_common::OutstandingOps m_outstanding;
+};
+
+static void report(std::vector< shared< BenchListener > > const& led, uint64_t elapsed_us) {
+    auto const elapsed_sec = test_common::elapsed_secs(elapsed_us);
+    BenchListener::stats all;
+    for (auto const& l : led) {
+        auto const& st = l->get_stats();
+        for (size_t s{0}; s < num_stages; ++s) {
+            all.lat_us[s].insert(all.lat_us[s].end(), st.lat_us[s].begin(), st.lat_us[s].end());
+        }
+        all.bytes += st.bytes;
+        all.errors += st.errors;
+    }
+
+    auto const ncommits = all.lat_us[s_cast< size_t >(write_stage_t::commit)].size();
+    LOGINFO("Replica={} led {} groups: commits={} errors={} commits/sec={:.0f} MB/sec={:.1f} in {:.1f} secs",
+            g_helper->replica_num(), led.size(), ncommits, all.errors, ncommits / elapsed_sec,
+            all.bytes / (1024.0 * 1024.0) / elapsed_sec, elapsed_sec);
+    for (size_t s{0}; s < num_stages; ++s) {
+        test_common::report_latencies(enum_name(s_cast< write_stage_t >(s)), all.lat_us[s]);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    // Save the args for the replicas spawned
+    std::vector< std::string > args;
+    for (int i = 0; i < argc; ++i) {
+        args.emplace_back(argv[i]);
+    }
+    char** orig_argv = argv;
+
+    SISL_OPTIONS_LOAD(argc, argv, logging, raft_repl_benchmark, iomgr, config, test_common_setup,
+                      test_repl_common_setup);
+
+    // Leaders stay until the end, so that the whole run is of the same leaders
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.consensus.leadership_expiry_ms = -1; // -1 means never expires;
+        s.generic.repl_dev_cleanup_interval_sec = 0;
+    });
+    HS_SETTINGS_FACTORY().save();
+    FLAGS_folly_global_cpu_executor_threads = 4;
+
+    g_helper = std::make_unique< test_common::HSReplTestHelper >("raft_repl_benchmark", args, orig_argv);
+    g_helper->setup();
+
+    std::vector< uint32_t > value_sizes;
+    auto const blk_size = hs()->data_service().get_blk_size();
+    for (auto const kb : SISL_OPTIONS["value_sizes_kb"].as< std::vector< uint32_t > >()) {
+        value_sizes.push_back(sisl::round_up(kb * 1024, blk_size));
+    }
+    RELEASE_ASSERT(!value_sizes.empty(), "No value sizes given");
+
+    // Content is not verified, so all the writes share a source buffer
+    auto const max_size = *std::max_element(value_sizes.begin(), value_sizes.end());
+    auto* write_buf = iomanager.iobuf_alloc(hs()->data_service().get_align_size(), max_size);
+    test_common::HSTestHelper::fill_data_buf(write_buf, max_size);
+
+    std::vector< shared< BenchListener > > listeners;
+    for (uint32_t g{0}; g < SISL_OPTIONS["num_groups"].as< uint32_t >(); ++g) {
+        listeners.push_back(std::make_shared< BenchListener >(value_sizes, write_buf));
+        g_helper->register_listener(listeners.back());
+    }
+    g_helper->sync_for_test_start();
+
+    // Each replica drives the groups it leads
+    std::vector< shared< BenchListener > > led;
+    for (auto const& l : listeners) {
+        while (l->repl_dev() == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        }
+        while (l->repl_dev()->get_leader_id().is_nil()) {
+            LOGINFO("Waiting for leader to be elected");
+            std::this_thread::sleep_for(std::chrono::milliseconds{500});
+        }
+        if (l->repl_dev()->is_leader()) { led.push_back(l); }
+    }
+
+    auto const concurrency = SISL_OPTIONS["concurrency"].as< uint32_t >();
+    LOGINFO("Replica={} writing to {} groups it leads, concurrency={} value_sizes={} for {} secs",
+            g_helper->replica_num(), led.size(), concurrency, fmt::join(value_sizes, ","),
+            SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+    auto const start_time = Clock::now();
+    auto const end_time = start_time + std::chrono::seconds(SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+    std::vector< std::thread > runners;
+    for (auto const& l : led) {
+        runners.emplace_back([&l, end_time, concurrency]() { l->run(end_time, concurrency); });
+    }
+    for (auto& t : runners) {
+        t.join();
+    }
+    auto const elapsed_us = get_elapsed_time_us(start_time);
+    if (!led.empty()) { report(led, elapsed_us); }
+
+    g_helper->sync_for_verify_start();
+    uint64_t ncommits{0};
+    for (auto const& l : listeners) {
+        ncommits += l->num_commits();
+    }
+    LOGINFO("Replica={} applied {} commits across all groups", g_helper->replica_num(), ncommits);
+
+    g_helper->sync_for_cleanup_start();
+    iomanager.iobuf_free(write_buf);
+    led.clear();
+    listeners.clear();
+    g_helper->teardown();
+    return 0;
+}
@@ -0,0 +1,356 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <boost/intrusive_ptr.hpp>
+#include <iomgr/io_environment.hpp>
+#include <iomgr/iomgr_flip.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+#include <homestore/blk.h>
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/index_service.hpp>
+#include <homestore/index/index_table.hpp>
+#include <homestore/meta_service.hpp>
+#include <homestore/replication_service.hpp>
+#include <homestore/replication/repl_dev.h>
+#include <homestore/checkpoint/cp_mgr.hpp>
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "common/crash_simulator.hpp"
+#include "test_common/homestore_test_common.hpp"
+#include "btree_helpers/btree_test_kvs.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Builds the state of a solo repl dev (journal entries since the last  //
+//  cp, the index nodes they dirtied and meta blks), crashes at one of    //
+//  the crash points, restarts and reports the time each recovery phase   //
+//  took (device load, meta scan, log replay, index and repl recovery).   //
+//  Crash points other than clean need a prerelease build.                //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+RCU_REGISTER_INIT
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+std::vector< std::string > test_common::HSTestHelper::s_dev_names;
+
+SISL_OPTIONS_ENABLE(logging, recovery_benchmark, iomgr, test_common_setup)
+SISL_OPTION_GROUP(recovery_benchmark,
+                  (journal_entries, "", "journal_entries", "repl dev writes since the last cp, replayed on recovery",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("10000,100000"), "number [...]"),
+                  (meta_sbs, "", "meta_sbs", "meta blks added besides the ones of the services",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("0,10000"), "number [...]"),
+                  (crash_points, "", "crash_points",
+                   "clean (shutdown), no_cp (crash with all the state since the last cp), index_flush (crash while the "
+                   "cp flushes the index) or after_cp (crash right after a cp)",
+                   ::cxxopts::value< std::vector< std::string > >()->default_value("clean,no_cp,index_flush,after_cp"),
+                   "point [...]"),
+                  (value_size_kb, "", "value_size_kb",
+                   "size (in KB) of the data of every write, which are all kept, so they need to fit in the devices",
+                   ::cxxopts::value< uint32_t >()->default_value("4"), "size"));
+
+ENUM(crash_point_t, uint8_t, clean, no_cp, index_flush, after_cp);
+
+using LsnIndexTable = IndexTable< TestFixedKey, TestFixedValue >;
+
+static constexpr std::string_view bench_type{"RecoveryBench"};
+static test_common::HSTestHelper::test_token s_token;
+static std::vector< std::string > s_crash_points;
+static Clock::time_point s_svcs_start_time; // Services start right after the before_services cb
+
+#ifdef _PRERELEASE
+// Crash is signalled here by the crash simulator, instead of restarting right away, so that the restart is timed
+static std::mutex s_crash_mtx;
+static std::condition_variable s_crash_cv;
+static bool s_crashed{false};
+#endif
+
+struct bench_req : public repl_req_ctx {
+    uint64_t key_id;
+    sisl::sg_list write_sgs;
+
+    sisl::blob key_blob() { return sisl::blob{uintptr_cast(&key_id), sizeof(uint64_t)}; }
+};
+
+// Upserts the key of every commit to the index, with the value of its lsn
+class RecoveryDB : public ReplDevListener {
+public:
+    void on_commit(int64_t lsn, sisl::blob const&, sisl::blob const& key, MultiBlkId const&,
+                   cintrusive< repl_req_ctx >& ctx) override {
+        TestFixedKey const k{*r_cast< uint64_t const* >(key.cbytes())};
+        TestFixedValue const v{uint32_cast(lsn)};
+        BtreeSinglePutRequest preq{&k, &v, btree_put_type::UPSERT};
+        auto const ret = m_index->put(preq);
+        RELEASE_ASSERT_EQ(ret, btree_status_t::success, "Index put failed for lsn={}", lsn);
+
+        if (ctx == nullptr) {
+            m_num_replayed.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            m_runner->next_task();
+        }
+    }
+
+    bool on_pre_commit(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {
+        return true;
+    }
+    void on_rollback(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {}
+    void on_error(ReplServiceError error, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {
+        RELEASE_ASSERT(false, "Write failed with error={}", enum_name(error));
+    }
+    ReplResult< blk_alloc_hints > get_blk_alloc_hints(sisl::blob const&, uint32_t) override {
+        return blk_alloc_hints{};
+    }
+    AsyncReplResult<> create_snapshot(repl_snapshot&) override { return make_async_success<>(); }
+    void on_destroy() override {}
+
+    void set_index(shared< LsnIndexTable > index) { m_index = std::move(index); }
+    shared< LsnIndexTable > const& index() const { return m_index; }
+    uint64_t num_replayed() const { return m_num_replayed.load(); }
+    void reset_replayed() { m_num_replayed.store(0); }
+
+    void write(uint64_t num_entries, uint32_t size) {
+        auto* buf = iomanager.iobuf_alloc(hs()->data_service().get_align_size(), size);
+        test_common::HSTestHelper::fill_data_buf(buf, size);
+
+        std::atomic< uint64_t > next_key{0};
+        m_runner = std::make_unique< test_common::Runner >(num_entries);
+        m_runner->set_task([this, buf, size, &next_key]() {
+            auto req = intrusive< bench_req >(new bench_req());
+            req->key_id = next_key.fetch_add(1);
+            req->write_sgs.size = size;
+            req->write_sgs.iovs.emplace_back(iovec{.iov_base = buf, .iov_len = size});
+            // Key doubles up as the header
+            repl_dev()->async_alloc_write(req->key_blob(), req->key_blob(), req->write_sgs, req);
+        });
+        m_runner->execute().get();
+        m_runner.reset();
+        iomanager.iobuf_free(buf);
+    }
+
+private:
+    shared< LsnIndexTable > m_index;
+    std::unique_ptr< test_common::Runner > m_runner;
+    std::atomic< uint64_t > m_num_replayed{0};
+};
+
+static shared< RecoveryDB > s_db;
+
+static BtreeConfig index_cfg() {
+    auto cfg = BtreeConfig(hs()->index_service().node_size());
+    cfg.m_leaf_node_type = btree_node_type::FIXED;
+    return cfg;
+}
+
+class RecoveryIndexCallbacks : public IndexServiceCallbacks {
+public:
+    shared< IndexTableBase > on_index_table_found(superblk< index_table_sb >&& sb) override {
+        s_db->set_index(std::make_shared< LsnIndexTable >(std::move(sb), index_cfg()));
+        return s_db->index();
+    }
+};
+
+class SoloApplication : public ReplApplication {
+public:
+    repl_impl_type get_impl_type() const override { return repl_impl_type::solo; }
+    bool need_timeline_consistency() const { return true; }
+    shared< ReplDevListener > create_repl_dev_listener(group_id_t) override { return s_db; }
+    std::pair< std::string, uint16_t > lookup_peer(replica_id_t) const override { return std::make_pair("", 0u); }
+    replica_id_t get_my_repl_id() const override { return m_my_id; }
+
+private:
+    replica_id_t m_my_id{hs_utils::gen_random_uuid()};
+};
+
+static void before_services_start() {
+    meta_service().register_handler(std::string{bench_type}, [](meta_blk*, sisl::byte_view, size_t) {}, nullptr);
+#ifdef _PRERELEASE
+    hs()->with_crash_simulator([]() {
+        std::unique_lock lg{s_crash_mtx};
+        s_crashed = true;
+        s_crash_cv.notify_all();
+    });
+#endif
+    s_svcs_start_time = Clock::now();
+}
+
+static void build_state(uint32_t num_entries, uint32_t num_sbs) {
+    s_db = std::make_shared< RecoveryDB >();
+    s_token = test_common::HSTestHelper::start_homestore(
+        "recovery_benchmark",
+        {{HS_SERVICE::META, {.size_pct = 10.0}},
+         {HS_SERVICE::REPLICATION, {.size_pct = 50.0, .repl_app = std::make_unique< SoloApplication >()}},
+         {HS_SERVICE::LOG,
+          {.size_pct = 20.0, .chunk_size = 32 * 1024 * 1024, .vdev_size_type = vdev_size_type_t::VDEV_SIZE_DYNAMIC}},
+         {HS_SERVICE::INDEX, {.size_pct = 10.0, .index_svc_cbs = new RecoveryIndexCallbacks()}}},
+        before_services_start);
+
+    s_db->set_index(std::make_shared< LsnIndexTable >(hs_utils::gen_random_uuid(), hs_utils::gen_random_uuid(),
+                                                        0 /* user_sb_size */, index_cfg()));
+    hs()->index_service().add_index_table(s_db->index());
+    auto rdev = hs()->repl_service().create_repl_dev(hs_utils::gen_random_uuid(), {}).get().value();
+
+    auto const sz = meta_service().meta_blk_context_sz(); // Inline, so that it is the number of meta blks that counts
+    auto* buf = iomanager.iobuf_alloc(meta_service().align_size(), sz);
+    test_common::HSTestHelper::fill_data_buf(buf, sz);
+    for (uint32_t i{0}; i < num_sbs; ++i) {
+        void* cookie{nullptr};
+        meta_service().add_sub_sb(std::string{bench_type}, buf, sz, cookie);
+    }
+    iomanager.iobuf_free(buf);
+
+    // Writes are all since the cp at the end of the format, with the ones beyond it flushed only on the crash point
+    auto const start_time = Clock::now();
+    s_db->write(num_entries, SISL_OPTIONS["value_size_kb"].as< uint32_t >() * 1024);
+    LOGINFO("Wrote {} journal entries in {} ms", num_entries, get_elapsed_time_ms(start_time));
+}
+
+#ifdef _PRERELEASE
+static void wait_for_crash() {
+    std::unique_lock lg{s_crash_mtx};
+    if (!s_crash_cv.wait_for(lg, std::chrono::seconds{60}, []() { return s_crashed; })) {
+        // No split was flushed by the cp, crash after it instead
+        LOGWARN("Crash point was not hit within 60 secs, crashing now");
+        lg.unlock();
+        hs()->crash_simulator().crash();
+    }
+}
+#endif
+
+static void crash(crash_point_t point) {
+    if (point == crash_point_t::clean) { return; } // Restart shuts down
+#ifdef _PRERELEASE
+    {
+        std::unique_lock lg{s_crash_mtx};
+        s_crashed = false;
+    }
+    if (point == crash_point_t::index_flush) {
+        flip::FlipClient fc{iomgr_flip::instance()};
+        flip::FlipCondition null_cond;
+        flip::FlipFrequency freq;
+        freq.set_count(1);
+        freq.set_percent(100);
+        fc.inject_noreturn_flip("crash_flush_on_split_at_parent", {null_cond}, freq);
+        hs()->cp_mgr().trigger_cp_flush(true /* force */);
+        wait_for_crash();
+        return;
+    }
+
+    if (point == crash_point_t::after_cp) { hs()->cp_mgr().trigger_cp_flush(true /* force */).get(); }
+    hs()->crash_simulator().crash();
+    wait_for_crash();
+#else
+    RELEASE_ASSERT(false, "Crash point={} needs a prerelease build", enum_name(point));
+#endif
+}
+
+static void test_recovery(benchmark::State& state) {
+    auto const num_entries = s_cast< uint32_t >(state.range(0));
+    auto const num_sbs = s_cast< uint32_t >(state.range(1));
+    auto point = crash_point_t::clean;
+    auto const& point_name = s_crash_points[state.range(2)];
+    for (uint8_t p{0}; p <= s_cast< uint8_t >(crash_point_t::after_cp); ++p) {
+        if (enum_name(s_cast< crash_point_t >(p)) == point_name) { point = s_cast< crash_point_t >(p); }
+    }
+
+    for (auto _ : state) { // Loops upto iteration count
+        state.PauseTiming();
+        build_state(num_entries, num_sbs);
+        crash(point);
+        s_db->reset_replayed();
+        state.ResumeTiming();
+
+        auto const restart_start = Clock::now();
+        s_token.params(HS_SERVICE::INDEX).index_svc_cbs = new RecoveryIndexCallbacks();
+        test_common::HSTestHelper::restart_homestore(s_token, 0 /* shutdown_delay_sec */);
+        auto const restart_ms = get_elapsed_time_ms(restart_start);
+        auto const start_ms = get_elapsed_time_ms(s_svcs_start_time);
+
+        std::string phases;
+        for (auto const& [name, ms] : hs()->service_start_times_ms()) {
+            state.counters[fmt::format("{}_ms", name)] = ms;
+            fmt::format_to(std::back_inserter(phases), "{}={} ", name, ms);
+        }
+        state.counters["start_ms"] = start_ms;
+        state.counters["restart_ms"] = restart_ms;
+        state.counters["replayed"] = s_db->num_replayed();
+        LOGINFO("crash_point={} journal_entries={} meta_sbs={}: replayed={} restart={} ms (services start={} ms) "
+                "phases(ms): {}",
+                point_name, num_entries, num_sbs, s_db->num_replayed(), restart_ms, start_ms, phases);
+
+        state.PauseTiming();
+        s_db->set_index(nullptr);
+        test_common::HSTestHelper::shutdown_homestore();
+        s_db.reset();
+        state.ResumeTiming();
+    }
+}
+
+static void recovery_args(benchmark::internal::Benchmark* b) {
+    std::vector< int64_t > entries;
+    for (auto const n : SISL_OPTIONS["journal_entries"].as< std::vector< uint32_t > >()) {
+        entries.push_back(n);
+    }
+    std::vector< int64_t > sbs;
+    for (auto const n : SISL_OPTIONS["meta_sbs"].as< std::vector< uint32_t > >()) {
+        sbs.push_back(n);
+    }
+    std::vector< int64_t > points;
+    for (size_t i{0}; i < s_crash_points.size(); ++i) {
+        points.push_back(s_cast< int64_t >(i));
+    }
+    b->ArgsProduct({entries, sbs, points})->ArgNames({"journal_entries", "meta_sbs", "crash_point"});
+}
+
+int main(int argc, char** argv) {
+    SISL_OPTIONS_LOAD(argc, argv, logging, recovery_benchmark, iomgr, test_common_setup)
+    sisl::logging::SetLogger("recovery_benchmark");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    s_crash_points = SISL_OPTIONS["crash_points"].as< std::vector< std::string > >();
+    for (auto const& name : s_crash_points) {
+        bool known{false};
+        for (uint8_t p{0}; p <= s_cast< uint8_t >(crash_point_t::after_cp); ++p) {
+            known = known || (enum_name(s_cast< crash_point_t >(p)) == name);
+        }
+        RELEASE_ASSERT(known, "Unknown crash point={}", name);
+    }
+
+    // Cps only at the crash points, so that the journal and the dirty index nodes are all of the writes
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.generic.cp_timer_us = 3600ul * 1000 * 1000;
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    // Args are from the options, which are loaded only by now
+    ::benchmark::RegisterBenchmark("test_recovery", test_recovery)
+        ->Apply(recovery_args)
+        ->Iterations(1)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+    ::benchmark::Initialize(&argc, argv);
+    ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -0,0 +1,675 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/intrusive_ptr.hpp>
+#include <folly/executors/GlobalExecutor.h>
+#include <gtest/gtest.h>
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/blk.h>
+#include <homestore/homestore.hpp>
+#include <homestore/homestore_decl.hpp>
+#include <homestore/blkdata_service.hpp>
+#include <homestore/index_service.hpp>
+#include <homestore/index/index_table.hpp>
+#include <homestore/replication_service.hpp>
+#include <homestore/replication/repl_dev.h>
+#include "common/homestore_config.hpp"
+#include "common/homestore_utils.hpp"
+#include "test_common/bench_common.hpp"
+#include "test_common/hs_repl_test_common.hpp"
+#include "btree_helpers/btree_test_kvs.hpp"
+
+////////////////////////////////////////////////////////////////////////////
+//                                                                        //
+//  Drives a YCSB style workload through the whole stack: every write     //
+//  goes through ReplDev (solo or raft), the data to the data service and //
+//  on commit the key to blkid mapping to an IndexTable. Reads look up    //
+//  the index and read the data. Keeps qdepth ops outstanding per io      //
+//  thread for the run time, after loading num_records keys, and reports  //
+//  the latency of every op along with the time spent in each layer.      //
+//                                                                        //
+//  raft mode spawns --replicas processes, the leader runs the workload.  //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS, nuraft_mesg)
+
+SISL_OPTION_GROUP(repl_workload_driver,
+                  (repl_impl, "", "repl_impl", "replication underneath: solo or raft",
+                   ::cxxopts::value< std::string >()->default_value("solo"), "solo|raft"),
+                  (workload, "", "workload", "YCSB core workload a-f, or custom to run the given mix",
+                   ::cxxopts::value< std::string >()->default_value("a"), "a|b|c|d|e|f|custom"),
+                  (mix, "", "mix", "pct of read, update, insert, scan and read-modify-write ops (overrides workload)",
+                   ::cxxopts::value< std::vector< uint32_t > >(), "read,update,insert,scan,rmw"),
+                  (distribution, "", "distribution", "key distribution, default is of the workload",
+                   ::cxxopts::value< std::string >(), "uniform|zipfian|latest"),
+                  (zipf_theta, "", "zipf_theta", "skew of the zipfian and latest distributions, in (0, 1)",
+                   ::cxxopts::value< double >()->default_value("0.99"), "theta"),
+                  (num_records, "", "num_records", "number of keys loaded ahead of the run",
+                   ::cxxopts::value< uint64_t >()->default_value("100000"), "number"),
+                  (value_sizes_kb, "", "value_sizes_kb", "value sizes (in KB) picked at random for every write",
+                   ::cxxopts::value< std::vector< uint32_t > >()->default_value("4"), "size [...]"),
+                  (max_scan_len, "", "max_scan_len", "scans are of upto these many keys",
+                   ::cxxopts::value< uint32_t >()->default_value("100"), "number"),
+                  (run_time_secs, "", "run_time_secs", "duration of the measured run in seconds",
+                   ::cxxopts::value< uint32_t >()->default_value("30"), "seconds"));
+
+SISL_OPTIONS_ENABLE(logging, repl_workload_driver, iomgr, config, test_common_setup, test_repl_common_setup)
+
+static std::unique_ptr< test_common::HSReplTestHelper > g_helper;
+
+ENUM(ycsb_op_t, uint8_t, read, update, insert, scan, rmw);
+
+// Layers an op spends its time in. Stages of a write are from the start of its replication request, so they overlap
+// (data and log are part of commit), while the ones of a read are one after the other.
+ENUM(op_stage_t, uint8_t,
+     total,  // End to end
+     index,  // Index lookup, query or put (on commit)
+     data,   // Data read, or data written locally for a write
+     log,    // Journal entry of a write is durable
+     commit  // Write is committed, that is replicated
+);
+
+static constexpr size_t num_ops{5};
+static constexpr size_t num_stages{5};
+
+// Value of the index, the blks of the data of a key
+class BlkIdValue : public BtreeValue {
+public:
+    BlkIdValue() = default;
+    BlkIdValue(MultiBlkId const& blkid) : BtreeValue(), m_blkid{blkid} {}
+    BlkIdValue(BlkIdValue const& other) = default;
+    BlkIdValue(sisl::blob const& b, bool copy) : BtreeValue() { deserialize(b, copy); }
+    BlkIdValue& operator=(BlkIdValue const& other) = default;
+    ~BlkIdValue() override = default;
+
+    sisl::blob serialize() const override { return m_blkid.serialize(); }
+    uint32_t serialized_size() const override { return m_blkid.serialized_size(); }
+    static uint32_t get_fixed_size() { return 0; }
+    void deserialize(sisl::blob const& b, bool copy) override { m_blkid.deserialize(b, copy); }
+    std::string to_string() const override { return m_blkid.to_string(); }
+
+    MultiBlkId const& blkid() const { return m_blkid; }
+
+private:
+    MultiBlkId m_blkid;
+};
+
+using WorkloadIndexTable = IndexTable< TestFixedKey, BlkIdValue >;
+
+// Zipfian over [0, n) as in YCSB (Gray et al, "Quickly generating billion-record synthetic databases")
+class ZipfianGenerator {
+public:
+    ZipfianGenerator(uint64_t n, double theta) : m_n{n} {
+        RELEASE_ASSERT((theta > 0.0) && (theta < 1.0), "zipf_theta={} is not in (0, 1)", theta);
+        for (uint64_t i{1}; i <= n; ++i) {
+            m_zetan += 1.0 / std::pow(s_cast< double >(i), theta);
+        }
+        m_alpha = 1.0 / (1.0 - theta);
+        m_half_pow_theta = std::pow(0.5, theta);
+        m_eta = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - (1.0 + m_half_pow_theta) / m_zetan);
+    }
+
+    uint64_t next(std::default_random_engine& re) const {
+        std::uniform_real_distribution< double > u_dist{0.0, 1.0};
+        auto const u = u_dist(re);
+        auto const uz = u * m_zetan;
+        if (uz < 1.0) { return 0; }
+        if (uz < 1.0 + m_half_pow_theta) { return 1; }
+        return std::min(m_n - 1, s_cast< uint64_t >(m_n * std::pow(m_eta * u - m_eta + 1.0, m_alpha)));
+    }
+
+private:
+    uint64_t m_n;
+    double m_zetan{0.0};
+    double m_alpha;
+    double m_half_pow_theta;
+    double m_eta;
+};
+
+struct workload_op {
+    ycsb_op_t op;
+    uint64_t key;
+    Clock::time_point start_time;
+};
+
+struct workload_req : public repl_req_ctx {
+    struct journal_header {
+        uint32_t op;
+        uint32_t value_size;
+    };
+
+    workload_op wop;
+    journal_header jheader;
+    uint64_t key_id;
+    sisl::sg_list write_sgs;
+
+    workload_req(workload_op const& o, uint8_t* buf, uint32_t size) :
+            wop{o}, jheader{s_cast< uint32_t >(o.op), size}, key_id{o.key} {
+        write_sgs.size = size;
+        write_sgs.iovs.emplace_back(iovec{.iov_base = buf, .iov_len = size});
+    }
+
+    sisl::blob header_blob() { return sisl::blob(uintptr_cast(&jheader), sizeof(journal_header)); }
+    sisl::blob key_blob() { return sisl::blob{uintptr_cast(&key_id), sizeof(uint64_t)}; }
+};
+
+class WorkloadDriver : public ReplDevListener {
+public:
+    struct op_mix {
+        std::array< uint32_t, num_ops > pct; // Indexed by ycsb_op_t
+        std::string distribution;
+    };
+
+    WorkloadDriver() {
+        // Core workloads of YCSB, E scans short ranges and D reads the latest inserts
+        static const std::map< std::string, op_mix > s_workloads{{"a", {{50, 50, 0, 0, 0}, "zipfian"}},
+                                                                 {"b", {{95, 5, 0, 0, 0}, "zipfian"}},
+                                                                 {"c", {{100, 0, 0, 0, 0}, "zipfian"}},
+                                                                 {"d", {{95, 0, 5, 0, 0}, "latest"}},
+                                                                 {"e", {{0, 0, 5, 95, 0}, "zipfian"}},
+                                                                 {"f", {{50, 0, 0, 0, 50}, "zipfian"}},
+                                                                 {"custom", {{50, 50, 0, 0, 0}, "uniform"}}};
+        auto const& name = SISL_OPTIONS["workload"].as< std::string >();
+        auto const it = s_workloads.find(name);
+        RELEASE_ASSERT(it != s_workloads.end(), "Unknown workload={}", name);
+        m_mix = it->second;
+        if (SISL_OPTIONS.count("mix")) {
+            auto const pcts = SISL_OPTIONS["mix"].as< std::vector< uint32_t > >();
+            RELEASE_ASSERT_EQ(pcts.size(), num_ops, "mix is to be read,update,insert,scan,rmw pcts");
+            std::copy(pcts.begin(), pcts.end(), m_mix.pct.begin());
+        }
+        if (SISL_OPTIONS.count("distribution")) {
+            m_mix.distribution = SISL_OPTIONS["distribution"].as< std::string >();
+        }
+        uint32_t total_pct{0};
+        for (auto const p : m_mix.pct) {
+            total_pct += p;
+        }
+        RELEASE_ASSERT_EQ(total_pct, 100u, "Pcts of the mix don't add upto 100");
+        RELEASE_ASSERT(m_mix.distribution == "uniform" || m_mix.distribution == "zipfian" ||
+                           m_mix.distribution == "latest",
+                       "Unknown distribution={}", m_mix.distribution);
+        RELEASE_ASSERT_GT(m_num_records, 1u, "Need atleast 2 records");
+    }
+
+    WorkloadDriver(const WorkloadDriver&) = delete;
+    WorkloadDriver& operator=(const WorkloadDriver&) = delete;
+    WorkloadDriver(WorkloadDriver&&) noexcept = delete;
+    WorkloadDriver& operator=(WorkloadDriver&&) noexcept = delete;
+
+    ~WorkloadDriver() override {
+        if (m_write_buf) { iomanager.iobuf_free(m_write_buf); }
+        if (m_read_buf) { iomanager.iobuf_free(m_read_buf); }
+    }
+
+    /// @brief Create the index and the io buffers, once homestore is started. Index has to be there ahead of the
+    /// first commit, that is before the repl dev is created on the followers.
+    void init() {
+        auto cfg = BtreeConfig(hs()->index_service().node_size());
+        cfg.m_leaf_node_type = btree_node_type::VAR_VALUE;
+        cfg.m_int_node_type = btree_node_type::FIXED;
+        m_index = std::make_shared< WorkloadIndexTable >(hs_utils::gen_random_uuid(), hs_utils::gen_random_uuid(),
+                                                         0 /* user_sb_size */, cfg);
+        hs()->index_service().add_index_table(m_index);
+
+        m_blk_size = hs()->data_service().get_blk_size();
+        for (auto const kb : SISL_OPTIONS["value_sizes_kb"].as< std::vector< uint32_t > >()) {
+            m_value_sizes.push_back(sisl::round_up(kb * 1024, m_blk_size));
+        }
+        RELEASE_ASSERT(!m_value_sizes.empty(), "No value sizes given");
+        m_max_value_size = *std::max_element(m_value_sizes.begin(), m_value_sizes.end());
+
+        // Content is not verified, so all the ops share a write source and a read scratch buffer
+        auto const align = hs()->data_service().get_align_size();
+        m_write_buf = iomanager.iobuf_alloc(align, m_max_value_size);
+        test_common::HSTestHelper::fill_data_buf(m_write_buf, m_max_value_size);
+        m_read_buf = iomanager.iobuf_alloc(align, m_max_value_size);
+        m_zipf = std::make_unique< ZipfianGenerator >(m_num_records, SISL_OPTIONS["zipf_theta"].as< double >());
+    }
+
+    void load() {
+        LOGINFO("Loading {} records", m_num_records);
+        auto const start_time = Clock::now();
+        run_phase(false /* measure */);
+        LOGINFO("Loaded {} records in {} ms", m_num_keys.load(), get_elapsed_time_ms(start_time));
+    }
+
+    void run() {
+        LOGINFO("Running workload={} mix(read,update,insert,scan,rmw)={} distribution={} for {} secs",
+                SISL_OPTIONS["workload"].as< std::string >(), fmt::join(m_mix.pct, ","), m_mix.distribution,
+                SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+        m_end_time = Clock::now() + std::chrono::seconds(SISL_OPTIONS["run_time_secs"].as< uint32_t >());
+        auto const start_time = Clock::now();
+        run_phase(true /* measure */);
+        report(get_elapsed_time_us(start_time));
+    }
+
+    uint64_t num_commits() const { return m_num_commits.load(); }
+
+    ///////////////////////////// ReplDevListener /////////////////////////////
+    void on_commit(int64_t lsn, sisl::blob const&, sisl::blob const& key, MultiBlkId const& blkids,
+                   cintrusive< repl_req_ctx >& ctx) override {
+        intrusive< workload_req > req;
+        if (ctx && ctx->is_proposer()) { req = boost::dynamic_pointer_cast< workload_req >(ctx); }
+        auto const commit_us = req ? get_elapsed_time_us(req->created_time()) : 0;
+
+        TestFixedKey const k{*r_cast< uint64_t const* >(key.cbytes())};
+        BlkIdValue const v{blkids};
+        BlkIdValue existing;
+        auto const index_start = Clock::now();
+        BtreeSinglePutRequest preq{&k, &v, btree_put_type::UPSERT, &existing};
+        auto const ret = m_index->put(preq);
+        RELEASE_ASSERT_EQ(ret, btree_status_t::success, "Index put failed for lsn={}", lsn);
+        auto const index_us = get_elapsed_time_us(index_start);
+
+        // Blks of the value replaced are freed once the commit is durable
+        if (existing.blkid().is_valid()) { repl_dev()->async_free_blks(lsn, existing.blkid()); }
+        m_num_commits.fetch_add(1, std::memory_order_relaxed);
+
+        if (req == nullptr) { return; } // Follower or replay
+        auto const op = req->wop.op;
+        record_stage(op, op_stage_t::index, index_us);
+        record_stage(op, op_stage_t::commit, commit_us);
+        // Stages not reached (0) are of the writes which came as data embedded in the journal entry
+        if (auto const us = req->stage_time_us(repl_req_stage_t::DATA_WRITTEN); us != 0) {
+            record_stage(op, op_stage_t::data, us);
+        }
+        if (auto const us = req->stage_time_us(repl_req_stage_t::LOG_FLUSHED); us != 0) {
+            record_stage(op, op_stage_t::log, us);
+        }
+        finish_op(req->wop, true /* success */);
+    }
+
+    std::optional< uint64_t > commit_order_key(sisl::blob const&, sisl::blob const& key) override {
+        return *r_cast< uint64_t const* >(key.cbytes());
+    }
+
+    bool on_pre_commit(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {
+        return true;
+    }
+
+    void on_rollback(int64_t, sisl::blob const&, sisl::blob const&, cintrusive< repl_req_ctx >&) override {}
+
+    void on_error(ReplServiceError error, sisl::blob const&, sisl::blob const&,
+                  cintrusive< repl_req_ctx >& ctx) override {
+        LOGERROR("Write failed with error={}", enum_name(error));
+        if (auto req = boost::dynamic_pointer_cast< workload_req >(ctx)) { finish_op(req->wop, false /* success */); }
+    }
+
+    ReplResult< blk_alloc_hints > get_blk_alloc_hints(sisl::blob const&, uint32_t) override {
+        return blk_alloc_hints{};
+    }
+
+    AsyncReplResult<> create_snapshot(repl_snapshot&) override { return make_async_success<>(); }
+    void on_destroy() override {}
+
+private:
+    struct thread_stats {
+        std::array< std::array< std::vector< uint64_t >, num_stages >, num_ops > lat_us; // By op and by stage
+        std::array< uint64_t, num_ops > errors{};
+        std::array< uint64_t, num_ops > not_found{};
+    };
+
+    // Stats are per thread, so that recording the completions doesn't serialize them
+    thread_stats& my_stats() {
+        static thread_local thread_stats* s_stats{nullptr};
+        if (s_stats == nullptr) {
+            std::unique_lock lg{m_stats_mtx};
+            s_stats = m_all_stats.emplace_back(std::make_unique< thread_stats >()).get();
+        }
+        return *s_stats;
+    }
+
+    void record_stage(ycsb_op_t op, op_stage_t stage, uint64_t lat_us) {
+        if (!m_measure) { return; }
+        my_stats().lat_us[s_cast< size_t >(op)][s_cast< size_t >(stage)].push_back(lat_us);
+    }
+
+    static std::default_random_engine& my_re() {
+        static thread_local std::default_random_engine s_re{std::random_device{}()};
+        return s_re;
+    }
+
+    void run_phase(bool measure) {
+        m_measure = measure;
+        iomanager.run_on_wait(iomgr::reactor_regex::all_io, [this]() {
+            for (uint32_t i{0}; i < m_qdepth; ++i) {
+                auto o = next_op();
+                if (!o) { break; }
+                m_outstanding.add();
+                do_op(*o);
+            }
+        });
+        m_outstanding.wait();
+    }
+
+    std::optional< workload_op > next_op() {
+        if (!m_measure) {
+            auto const key = m_next_key.fetch_add(1, std::memory_order_relaxed);
+            if (key >= m_num_records) {
+                m_next_key.fetch_sub(1, std::memory_order_relaxed);
+                return std::nullopt;
+            }
+            return workload_op{ycsb_op_t::insert, key};
+        }
+        if (Clock::now() >= m_end_time) { return std::nullopt; }
+
+        std::uniform_int_distribution< uint32_t > pct_dist{0, 99};
+        auto pct = pct_dist(my_re());
+        size_t op{0};
+        while (pct >= m_mix.pct[op]) {
+            pct -= m_mix.pct[op++];
+        }
+        if (s_cast< ycsb_op_t >(op) == ycsb_op_t::insert) {
+            return workload_op{ycsb_op_t::insert, m_next_key.fetch_add(1, std::memory_order_relaxed)};
+        }
+        return workload_op{s_cast< ycsb_op_t >(op), pick_key()};
+    }
+
+    // Key of an existing record. Inserts are counted as they complete, so a key inserted just now could be missed.
+    uint64_t pick_key() {
+        auto const nkeys = std::max(m_num_keys.load(std::memory_order_relaxed), uint64_t{1});
+        if (m_mix.distribution == "uniform") {
+            std::uniform_int_distribution< uint64_t > key_dist{0, nkeys - 1};
+            return key_dist(my_re());
+        } else if (m_mix.distribution == "latest") {
+            return nkeys - 1 - std::min(m_zipf->next(my_re()), nkeys - 1);
+        }
+        // Scrambled, so that the popular keys are spread across the key space instead of at its start
+        return fnv_hash(m_zipf->next(my_re())) % nkeys;
+    }
+
+    static uint64_t fnv_hash(uint64_t v) {
+        uint64_t h{0xcbf29ce484222325};
+        for (uint32_t i{0}; i < sizeof(uint64_t); ++i) {
+            h = (h ^ (v & 0xff)) * 0x100000001b3;
+            v >>= 8;
+        }
+        return h;
+    }
+
+    void do_op(workload_op o) {
+        o.start_time = Clock::now();
+        switch (o.op) {
+        case ycsb_op_t::read:
+        case ycsb_op_t::rmw:
+            do_read(o);
+            break;
+        case ycsb_op_t::scan:
+            do_scan(o);
+            break;
+        default:
+            do_write(o);
+            break;
+        }
+    }
+
+    void do_write(workload_op const& o) {
+        std::uniform_int_distribution< size_t > size_dist{0, m_value_sizes.size() - 1};
+        auto req = intrusive< workload_req >(new workload_req(o, m_write_buf, m_value_sizes[size_dist(my_re())]));
+        repl_dev()->async_alloc_write(req->header_blob(), req->key_blob(), req->write_sgs, req);
+    }
+
+    void do_read(workload_op const& o) {
+        TestFixedKey const k{o.key};
+        BlkIdValue v;
+        auto const index_start = Clock::now();
+        BtreeSingleGetRequest greq{&k, &v};
+        auto const ret = m_index->get(greq);
+        record_stage(o.op, op_stage_t::index, get_elapsed_time_us(index_start));
+        if (ret != btree_status_t::success) {
+            if (m_measure) { ++my_stats().not_found[s_cast< size_t >(o.op)]; }
+            if (o.op == ycsb_op_t::rmw) {
+                do_write(o); // Read of a rmw not found still writes
+            } else {
+                finish_op(o, true /* success */);
+            }
+            return;
+        }
+
+        auto const size = v.blkid().blk_count() * m_blk_size;
+        sisl::sg_list sgs;
+        sgs.size = size;
+        sgs.iovs.emplace_back(iovec{.iov_base = m_read_buf, .iov_len = size});
+        auto const data_start = Clock::now();
+        repl_dev()->async_read(v.blkid(), sgs, size).thenValue([this, o, data_start](auto&& ec) {
+            record_stage(o.op, op_stage_t::data, get_elapsed_time_us(data_start));
+            if (!ec && (o.op == ycsb_op_t::rmw)) {
+                do_write(o);
+            } else {
+                finish_op(o, !ec);
+            }
+        });
+    }
+
+    void do_scan(workload_op const& o) {
+        std::uniform_int_distribution< uint32_t > len_dist{1, m_max_scan_len};
+        auto const index_start = Clock::now();
+        BtreeQueryRequest< TestFixedKey > qreq{
+            BtreeKeyRange< TestFixedKey >{TestFixedKey{o.key}, true, TestFixedKey{UINT64_MAX}, true},
+            BtreeQueryType::SWEEP_NON_INTRUSIVE_PAGINATION_QUERY, len_dist(my_re())};
+        std::vector< std::pair< TestFixedKey, BlkIdValue > > out_vector;
+        auto const ret = m_index->query(qreq, out_vector);
+        record_stage(o.op, op_stage_t::index, get_elapsed_time_us(index_start));
+        if ((ret != btree_status_t::success) && (ret != btree_status_t::has_more)) {
+            finish_op(o, false /* success */);
+            return;
+        }
+
+        auto const data_start = Clock::now();
+        std::vector< folly::Future< std::error_code > > futs;
+        for (auto const& [k, v] : out_vector) {
+            auto const size = v.blkid().blk_count() * m_blk_size;
+            sisl::sg_list sgs;
+            sgs.size = size;
+            sgs.iovs.emplace_back(iovec{.iov_base = m_read_buf, .iov_len = size});
+            futs.emplace_back(repl_dev()->async_read(v.blkid(), sgs, size));
+        }
+        folly::collectAllUnsafe(futs).thenValue([this, o, data_start](auto&& vf) {
+            record_stage(o.op, op_stage_t::data, get_elapsed_time_us(data_start));
+            bool success{true};
+            for (auto const& t : vf) {
+                if (t.hasException() || t.value()) { success = false; }
+            }
+            finish_op(o, success);
+        });
+    }
+
+    void finish_op(workload_op const& o, bool success) {
+        auto const idx = s_cast< size_t >(o.op);
+        if (m_measure) {
+            auto& st = my_stats();
+            st.lat_us[idx][s_cast< size_t >(op_stage_t::total)].push_back(get_elapsed_time_us(o.start_time));
+            if (!success) { ++st.errors[idx]; }
+        }
+        if ((o.op == ycsb_op_t::insert) && success) { m_num_keys.fetch_add(1, std::memory_order_relaxed); }
+
+        if (auto next = next_op()) {
+            m_outstanding.reissue([this, n = *next]() { do_op(n); });
+        } else {
+            m_outstanding.done();
+        }
+    }
+
+    void report(uint64_t elapsed_us) {
+        auto const elapsed_sec = test_common::elapsed_secs(elapsed_us);
+        std::unique_lock lg{m_stats_mtx};
+        uint64_t total_ops{0};
+        for (size_t op{0}; op < num_ops; ++op) {
+            uint64_t errors{0};
+            uint64_t not_found{0};
+            for (auto const& st : m_all_stats) {
+                errors += st->errors[op];
+                not_found += st->not_found[op];
+            }
+
+            for (size_t stage{0}; stage < num_stages; ++stage) {
+                std::vector< uint64_t > lats;
+                for (auto const& st : m_all_stats) {
+                    lats.insert(lats.end(), st->lat_us[op][stage].begin(), st->lat_us[op][stage].end());
+                }
+                if ((stage == s_cast< size_t >(op_stage_t::total)) && !lats.empty()) {
+                    total_ops += lats.size();
+                    LOGINFO("{}: ops={} errors={} not_found={} ops/sec={:.0f}", enum_name(s_cast< ycsb_op_t >(op)),
+                            lats.size(), errors, not_found, lats.size() / elapsed_sec);
+                }
+                test_common::report_latencies(enum_name(s_cast< op_stage_t >(stage)), lats);
+            }
+        }
+        LOGINFO("All: ops={} ops/sec={:.0f} in {:.1f} secs", total_ops, total_ops / elapsed_sec, elapsed_sec);
+    }
+
+private:
+    op_mix m_mix;
+    uint64_t const m_num_records{SISL_OPTIONS["num_records"].as< uint64_t >()};
+    uint32_t const m_max_scan_len{SISL_OPTIONS["max_scan_len"].as< uint32_t >()};
+    uint32_t const m_qdepth{SISL_OPTIONS["qdepth"].as< uint32_t >()};
+    std::unique_ptr< ZipfianGenerator > m_zipf;
+
+    shared< WorkloadIndexTable > m_index;
+    uint32_t m_blk_size{0};
+    std::vector< uint32_t > m_value_sizes;
+    uint32_t m_max_value_size{0};
+    uint8_t* m_write_buf{nullptr};
+    uint8_t* m_read_buf{nullptr};
+
+    std::atomic< bool > m_measure{false};
+    Clock::time_point m_end_time;
+    std::atomic< uint64_t > m_next_key{0}; // Key of the next insert
+    std::atomic< uint64_t > m_num_keys{0}; // Inserts completed
+    std::atomic< uint64_t > m_num_commits{0};
+
+    std::mutex m_stats_mtx;
+    std::vector< std::unique_ptr< thread_stats > > m_all_stats;
+
+    test_common::OutstandingOps m_outstanding;
+};
+
+class SoloApplication : public ReplApplication {
+public:
+    SoloApplication(shared< WorkloadDriver > driver) : m_driver{std::move(driver)} {}
+    ~SoloApplication() override = default;
+
+    repl_impl_type get_impl_type() const override { return repl_impl_type::solo; }
+    bool need_timeline_consistency() const { return true; }
+    shared< ReplDevListener > create_repl_dev_listener(group_id_t) override { return m_driver; }
+    std::pair< std::string, uint16_t > lookup_peer(replica_id_t) const override { return std::make_pair("", 0u); }
+    replica_id_t get_my_repl_id() const override { return m_my_id; }
+
+private:
+    shared< WorkloadDriver > m_driver;
+    replica_id_t m_my_id{hs_utils::gen_random_uuid()};
+};
+
+static void run_solo() {
+    auto driver = std::make_shared< WorkloadDriver >();
+    test_common::HSTestHelper::start_homestore(
+        "repl_workload_driver",
+        {{HS_SERVICE::META, {.size_pct = 5.0}},
+         {HS_SERVICE::REPLICATION, {.size_pct = 60.0, .repl_app = std::make_unique< SoloApplication >(driver)}},
+         {HS_SERVICE::LOG,
+          {.size_pct = 22.0, .chunk_size = 32 * 1024 * 1024, .vdev_size_type = vdev_size_type_t::VDEV_SIZE_DYNAMIC}},
+         {HS_SERVICE::INDEX, {.size_pct = 10.0, .index_svc_cbs = new IndexServiceCallbacks()}}});
+    driver->init();
+    auto rdev = hs()->repl_service().create_repl_dev(hs_utils::gen_random_uuid(), {}).get().value();
+
+    driver->load();
+    driver->run();
+    rdev.reset();
+    driver.reset();
+    test_common::HSTestHelper::shutdown_homestore();
+}
+
+static void run_raft(std::vector< std::string > const& args, char** argv) {
+    // Leader stays until the end, so that the whole run is of a single leader
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.consensus.leadership_expiry_ms = -1; // -1 means never expires;
+        s.generic.repl_dev_cleanup_interval_sec = 0;
+    });
+    HS_SETTINGS_FACTORY().save();
+    FLAGS_folly_global_cpu_executor_threads = 4;
+
+    g_helper = std::make_unique< test_common::HSReplTestHelper >("repl_workload_driver", args, argv);
+    g_helper->with_index_service(10.0, []() { return new IndexServiceCallbacks(); });
+    g_helper->setup();
+
+    auto driver = std::make_shared< WorkloadDriver >();
+    driver->init();
+    g_helper->register_listener(driver);
+    g_helper->sync_for_test_start();
+
+    while (driver->repl_dev() == nullptr) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+    auto leader_id = driver->repl_dev()->get_leader_id();
+    while (leader_id.is_nil()) {
+        LOGINFO("Waiting for leader to be elected");
+        std::this_thread::sleep_for(std::chrono::milliseconds{500});
+        leader_id = driver->repl_dev()->get_leader_id();
+    }
+
+    if (leader_id == g_helper->my_replica_id()) {
+        driver->load();
+        driver->run();
+    }
+    g_helper->sync_for_verify_start();
+    LOGINFO("Replica={} applied {} commits", g_helper->replica_num(), driver->num_commits());
+
+    g_helper->sync_for_cleanup_start();
+    driver.reset();
+    g_helper->teardown();
+}
+
+int main(int argc, char* argv[]) {
+    // Save the args for the replicas spawned in raft mode
+    std::vector< std::string > args;
+    for (int i = 0; i < argc; ++i) {
+        args.emplace_back(argv[i]);
+    }
+    char** orig_argv = argv;
+
+    SISL_OPTIONS_LOAD(argc, argv, logging, repl_workload_driver, iomgr, config, test_common_setup,
+                      test_repl_common_setup);
+
+    auto const& impl = SISL_OPTIONS["repl_impl"].as< std::string >();
+    if (impl == "raft") {
+        run_raft(args, orig_argv);
+    } else {
+        RELEASE_ASSERT(impl == "solo", "Unknown repl_impl={}", impl);
+        sisl::logging::SetLogger("repl_workload_driver");
+        spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+        run_solo();
+    }
+    return 0;
+}
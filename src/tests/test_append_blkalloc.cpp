@@ -16,16 +16,21 @@
 #include <algorithm>
 #include <atomic>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
 #include <functional>
 #include <iostream>
 #include <limits>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <random>
 #include <thread>
 #include <vector>
 
+#include <folly/ScopeGuard.h>
+
 #include <gtest/gtest.h>
 #include <sisl/logging/logging.h>
 #include <sisl/options/options.h>
@@ -155,6 +160,134 @@ public:
             });
     }
 
+    ////////////////////////////// Append gc: consumer of the data service keeping an index of its blkids /////////////
+    struct gc_entry {
+        MultiBlkId bid;
+        uint64_t pattern;
+    };
+
+    void set_gc_settings(uint64_t interval_ms, uint32_t min_freeable_pct, uint32_t max_io_size_kb) {
+        HS_SETTINGS_FACTORY().modifiable_settings([&](auto& s) {
+            s.generic.data_gc_interval_ms = interval_ms;
+            s.generic.data_gc_min_freeable_pct = min_freeable_pct;
+            s.generic.data_gc_max_io_size_kb = max_io_size_kb;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Synchronous write of the given nblks, filled with the pattern, on chunk_hint if any
+    MultiBlkId write_blks(blk_count_t nblks, uint64_t pattern, std::optional< chunk_num_t > chunk_hint) {
+        auto const size = uint64_cast(nblks) * inst().get_blk_size();
+        sisl::sg_list sg;
+        sg.size = size;
+        sg.iovs.push_back(iovec{iomanager.iobuf_alloc(512, size), size});
+        test_common::HSTestHelper::fill_data_buf(r_cast< uint8_t* >(sg.iovs[0].iov_base), size, pattern);
+
+        blk_alloc_hints hints;
+        hints.chunk_id_hint = chunk_hint;
+        MultiBlkId bid;
+        auto f = folly::makeFuture< std::error_code >(std::error_code{});
+        iomanager.run_on_wait(iomgr::reactor_regex::random_worker, [&]() {
+            f = inst().async_alloc_write(sg, hints, bid, false /* part_of_batch */);
+        });
+        RELEASE_ASSERT(!std::move(f).get(), "Write failure");
+        free(sg);
+        return bid;
+    }
+
+    void read_verify(gc_entry const& e) {
+        auto const size = uint64_cast(e.bid.blk_count()) * inst().get_blk_size();
+        sisl::sg_list sg;
+        sg.size = size;
+        sg.iovs.push_back(iovec{iomanager.iobuf_alloc(512, size), size});
+
+        auto f = folly::makeFuture< std::error_code >(std::error_code{});
+        iomanager.run_on_wait(iomgr::reactor_regex::random_worker,
+                              [&]() { f = inst().async_read(e.bid, sg, sg.size); });
+        RELEASE_ASSERT(!std::move(f).get(), "Read failure on blkid={}", e.bid.to_string());
+        test_common::HSTestHelper::validate_data_buf(r_cast< uint8_t const* >(sg.iovs[0].iov_base), size, e.pattern);
+        free(sg);
+    }
+
+    void free_blks(MultiBlkId const& bid) {
+        auto f = folly::makeFuture< std::error_code >(std::error_code{});
+        iomanager.run_on_wait(iomgr::reactor_regex::random_worker, [&]() { f = inst().async_free_blk(bid); });
+        RELEASE_ASSERT(!std::move(f).get(), "Failed to free blkid={}", bid.to_string());
+    }
+
+    // Fills a chunk with ~16 blkids and frees every other one of them (except the last, whose free would just move the
+    // append offset back), so that about half the chunk is freeable. Returns the chunk.
+    chunk_num_t fill_chunk_and_free_half() {
+        auto const first = write_blks(1, 1, std::nullopt);
+        auto const chunk = first.chunk_num();
+        auto const chunk_nblks = inst().num_blks_of_chunk(chunk);
+        auto const io_nblks = s_cast< blk_count_t >(std::clamp(chunk_nblks / 16, 1u, 64u));
+        m_gc_index.push_back(gc_entry{first, 1});
+        for (uint64_t i{0}; i < (chunk_nblks - 1) / io_nblks; ++i) {
+            m_gc_index.push_back(gc_entry{write_blks(io_nblks, i + 2, chunk), i + 2});
+        }
+
+        std::vector< gc_entry > live;
+        for (size_t i{0}; i < m_gc_index.size(); ++i) {
+            if ((i % 2 == 0) && (i + 1 < m_gc_index.size())) {
+                free_blks(m_gc_index[i].bid);
+                m_freed.push_back(m_gc_index[i].bid);
+            } else {
+                live.push_back(m_gc_index[i]);
+            }
+        }
+        m_gc_index = std::move(live);
+        LOGINFO("Filled chunk={} of nblks={} with {} blkids of nblks={}, freed={} of them", chunk, chunk_nblks,
+                m_gc_index.size() + m_freed.size(), io_nblks, m_freed.size());
+        return chunk;
+    }
+
+    std::vector< MultiBlkId > gc_live_blks(chunk_num_t chunk) {
+        std::unique_lock lg{m_gc_mtx};
+        std::vector< MultiBlkId > bids;
+        for (auto const& e : m_gc_index) {
+            if (e.bid.chunk_num() == chunk) { bids.push_back(e.bid); }
+        }
+        return bids;
+    }
+
+    bool gc_relocate(std::vector< std::pair< MultiBlkId, MultiBlkId > > const& relocations) {
+        std::unique_lock lg{m_gc_mtx};
+        for (auto const& [old_bid, new_bid] : relocations) {
+            auto it = std::find_if(m_gc_index.begin(), m_gc_index.end(),
+                                   [&old_bid](gc_entry const& e) { return e.bid == old_bid; });
+            RELEASE_ASSERT(it != m_gc_index.end(), "gc relocated blkid={} which is not live", old_bid.to_string());
+            RELEASE_ASSERT_EQ(new_bid.blk_count(), old_bid.blk_count(), "gc relocated blkid to a different size");
+            it->bid = new_bid;
+        }
+        ++m_num_relocated;
+        return true;
+    }
+
+    // Waits for the blks of the chunk to be reclaimed by gc, which resets the append offset of the chunk
+    bool wait_for_reclaim(MultiBlkId const& old_bid, std::chrono::milliseconds timeout) {
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        while (inst().is_blk_alloced(old_bid.to_single_blkid())) {
+            if (std::chrono::steady_clock::now() > deadline) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        }
+        return true;
+    }
+
+    void verify_relocated(chunk_num_t victim) {
+        std::unique_lock lg{m_gc_mtx};
+        for (auto const& e : m_gc_index) {
+            ASSERT_NE(e.bid.chunk_num(), victim) << "Live blkid=" << e.bid.to_string() << " not relocated by gc";
+            read_verify(e);
+        }
+    }
+
+protected:
+    std::mutex m_gc_mtx;
+    std::vector< gc_entry > m_gc_index; // Live blkids of the consumer along with the data pattern they are written with
+    std::vector< MultiBlkId > m_freed;
+    uint32_t m_num_relocated{0};
+
 private:
     //
     // call this api when caller needs the write buffer and blkids;
@@ -277,6 +410,122 @@ TEST_F(AppendBlkAllocatorTest, TestWriteThenRecovey) {
     LOGINFO("Step 9: do shutdown. ");
 }
 
+TEST_F(AppendBlkAllocatorTest, TestAppendGCRelocatesLiveBlks) {
+    set_gc_settings(100 /* interval_ms */, 30 /* min_freeable_pct */, 1024 /* max_io_size_kb */);
+    auto reset_settings = folly::makeGuard([this]() { set_gc_settings(60000, 50, 1024); });
+
+    LOGINFO("Step 1: Fill a chunk and free half of it");
+    auto const victim = fill_chunk_and_free_half();
+    auto const victim_first_blk = m_gc_index.front().bid;
+
+    LOGINFO("Step 2: Start gc and wait for it to reclaim chunk={}", victim);
+    inst().start_append_gc([this](chunk_num_t c) { return gc_live_blks(c); },
+                           [this](chunk_num_t, auto const& relocations) { return gc_relocate(relocations); });
+    ASSERT_TRUE(wait_for_reclaim(victim_first_blk, std::chrono::seconds{30})) << "gc didn't reclaim chunk=" << victim;
+    inst().stop_append_gc();
+    ASSERT_EQ(m_num_relocated, 1u);
+
+    LOGINFO("Step 3: Live blks read back from where they are relocated, freed and live blks of victim are reclaimed");
+    verify_relocated(victim);
+    for (auto const& bid : m_freed) {
+        ASSERT_FALSE(inst().is_blk_alloced(bid.to_single_blkid())) << "Freed blkid=" << bid.to_string();
+    }
+
+    LOGINFO("Step 4: Reclaimed chunk is reused by new writes");
+    auto const bid = write_blks(1, 1000, victim);
+    ASSERT_EQ(bid.chunk_num(), victim);
+    read_verify(gc_entry{bid, 1000});
+}
+
+TEST_F(AppendBlkAllocatorTest, TestAppendGCStopDuringRelocation) {
+    set_gc_settings(100 /* interval_ms */, 30 /* min_freeable_pct */, 1024 /* max_io_size_kb */);
+    auto reset_settings = folly::makeGuard([this]() { set_gc_settings(60000, 50, 1024); });
+
+    auto const victim = fill_chunk_and_free_half();
+    auto const victim_first_blk = m_gc_index.front().bid;
+
+    // Consumer holds up the switch over to the relocated blkids, until the gc is asked to stop
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool in_relocate{false};
+    bool release{false};
+    inst().start_append_gc([this](chunk_num_t c) { return gc_live_blks(c); },
+                           [&, this](chunk_num_t, auto const& relocations) {
+                               std::unique_lock lg{mtx};
+                               in_relocate = true;
+                               cv.notify_all();
+                               cv.wait(lg, [&release]() { return release; });
+                               return gc_relocate(relocations);
+                           });
+
+    LOGINFO("Step 1: Wait for gc of chunk={} to reach relocation", victim);
+    {
+        std::unique_lock lg{mtx};
+        ASSERT_TRUE(cv.wait_for(lg, std::chrono::seconds{30}, [&in_relocate]() { return in_relocate; }));
+    }
+
+    LOGINFO("Step 2: Stop gc while relocation is in flight, it is expected to wait for it");
+    std::atomic< bool > stopped{false};
+    std::thread stopper{[this, &stopped]() {
+        inst().stop_append_gc();
+        stopped = true;
+    }};
+    std::this_thread::sleep_for(std::chrono::milliseconds{500});
+    ASSERT_FALSE(stopped.load());
+    {
+        std::unique_lock lg{mtx};
+        release = true;
+        cv.notify_all();
+    }
+    stopper.join();
+    ASSERT_TRUE(stopped.load());
+
+    LOGINFO("Step 3: Relocation accepted before stop is complete, victim is reclaimed");
+    ASSERT_EQ(m_num_relocated, 1u);
+    ASSERT_FALSE(inst().is_blk_alloced(victim_first_blk.to_single_blkid()));
+    verify_relocated(victim);
+}
+
+#ifdef _PRERELEASE
+TEST_F(AppendBlkAllocatorTest, TestAppendGCStopDuringCopy) {
+    // One blkid per copy batch, so that gc checks for stop between every blkid it copies
+    set_gc_settings(100 /* interval_ms */, 30 /* min_freeable_pct */, 4 /* max_io_size_kb */);
+    auto reset_settings = folly::makeGuard([this]() { set_gc_settings(60000, 50, 1024); });
+
+    auto const victim = fill_chunk_and_free_half();
+    auto const live = m_gc_index;
+    ASSERT_GT(live.size(), 2u);
+
+    // Every read of the copy is delayed by 500ms, so it is still copying when stopped
+    flip::FlipClient* fc = iomgr_flip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(1000);
+    freq.set_percent(100);
+    fc->inject_delay_flip("simulate_drive_delay",
+                          {fc->create_condition("devname", flip::Operator::DONT_CARE, std::string("")),
+                           fc->create_condition("op_type", flip::Operator::EQUAL, std::string("READ")),
+                           fc->create_condition("reactor_id", flip::Operator::DONT_CARE, 0)},
+                          freq, 500000);
+
+    inst().start_append_gc([this](chunk_num_t c) { return gc_live_blks(c); },
+                           [this](chunk_num_t, auto const& relocations) { return gc_relocate(relocations); });
+    std::this_thread::sleep_for(std::chrono::milliseconds{700});
+
+    LOGINFO("Step 1: Stop gc in the middle of copying live blks of chunk={}", victim);
+    inst().stop_append_gc();
+    fc->remove_flip("simulate_drive_delay");
+
+    LOGINFO("Step 2: Copy is discarded, the victim is left as is and consumer index is untouched");
+    ASSERT_EQ(m_num_relocated, 0u);
+    ASSERT_EQ(m_gc_index.size(), live.size());
+    for (size_t i{0}; i < live.size(); ++i) {
+        ASSERT_EQ(m_gc_index[i].bid, live[i].bid);
+        ASSERT_TRUE(inst().is_blk_alloced(live[i].bid.to_single_blkid()));
+        read_verify(live[i]);
+    }
+}
+#endif
+
 SISL_OPTION_GROUP(test_append_blkalloc,
                   (run_time, "", "run_time", "running time in seconds",
                    ::cxxopts::value< uint64_t >()->default_value("30"), "number"));
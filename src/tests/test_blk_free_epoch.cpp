@@ -0,0 +1,138 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "blkdata_svc/blk_free_epoch.hpp"
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+SISL_OPTIONS_ENABLE(logging, test_blk_free_epoch)
+
+class BlkFreeEpochTest : public testing::Test {
+public:
+    virtual void SetUp() override {
+        m_epoch = std::make_unique< BlkFreeEpoch >([this](std::vector< pending_free_t >&& frees) {
+            m_num_batches.fetch_add(1);
+            for (auto& f : frees) {
+                m_num_released.fetch_add(1);
+                f.promise.setValue(std::error_code{});
+            }
+        });
+    }
+
+    folly::Future< std::error_code > free(blk_num_t blk_num) {
+        folly::Promise< std::error_code > p;
+        auto f = p.getFuture();
+        m_epoch->defer_free(MultiBlkId{blk_num, 1, 0}, std::move(p));
+        return f;
+    }
+
+protected:
+    std::unique_ptr< BlkFreeEpoch > m_epoch;
+    std::atomic< uint64_t > m_num_released{0};
+    std::atomic< uint64_t > m_num_batches{0};
+};
+
+TEST_F(BlkFreeEpochTest, FreeWithNoReaders) {
+    auto f = free(10);
+    ASSERT_TRUE(f.isReady()) << "free with no reads in flight should be released inline";
+    ASSERT_EQ(m_num_released.load(), 1);
+    ASSERT_EQ(m_epoch->num_pending_frees(), 0);
+}
+
+TEST_F(BlkFreeEpochTest, FreeWaitsOnEarlierReaders) {
+    auto const r1 = m_epoch->enter();
+    auto const r2 = m_epoch->enter();
+    auto f1 = free(10);
+    auto f2 = free(20);
+    ASSERT_FALSE(f1.isReady()) << "free released while a read before it is pending";
+
+    // Reader entering after the first free should not hold it back
+    auto const r3 = m_epoch->enter();
+    m_epoch->exit(r1);
+    ASSERT_FALSE(f1.isReady()) << "free released while a read before it is pending";
+    m_epoch->exit(r2);
+    ASSERT_TRUE(f1.isReady()) << "free not released after all earlier reads are done";
+    m_epoch->exit(r3);
+    ASSERT_TRUE(f2.isReady()) << "free not released after all reads are done";
+    ASSERT_EQ(m_epoch->num_pending_frees(), 0);
+}
+
+TEST_F(BlkFreeEpochTest, FreesReleasedInBatch) {
+    auto const r = m_epoch->enter();
+    std::vector< folly::Future< std::error_code > > futs;
+    for (blk_num_t b{0}; b < 16; ++b) {
+        futs.emplace_back(free(b));
+    }
+    auto const nbatches = m_num_batches.load();
+    m_epoch->exit(r);
+    ASSERT_EQ(m_num_released.load(), 16);
+    ASSERT_EQ(m_num_batches.load(), nbatches + 1) << "frees waiting on the same read expected to be one batch";
+}
+
+TEST_F(BlkFreeEpochTest, ThreadedReadsAndFrees) {
+    auto const num_threads = SISL_OPTIONS["num_threads"].as< uint32_t >();
+    auto const num_iters = SISL_OPTIONS["num_iters"].as< uint32_t >();
+    std::atomic< uint64_t > num_freed{0};
+
+    std::vector< std::thread > threads;
+    for (uint32_t t{0}; t < num_threads; ++t) {
+        threads.emplace_back([this, t, num_iters, &num_freed]() {
+            std::default_random_engine re{t};
+            for (uint32_t i{0}; i < num_iters; ++i) {
+                auto const r = m_epoch->enter();
+                auto f = free(i);
+                // Free issued while this thread's own read is in flight, can't be released until the read exits
+                ASSERT_FALSE(f.isReady()) << "free released while a read before it is pending";
+                if (std::uniform_int_distribution< uint32_t >{0, 3}(re) == 0) { std::this_thread::yield(); }
+                m_epoch->exit(r);
+                std::move(f).thenValue([&num_freed](auto&&) { num_freed.fetch_add(1); });
+            }
+        });
+    }
+    for (auto& th : threads) {
+        th.join();
+    }
+
+    ASSERT_EQ(m_epoch->num_pending_frees(), 0) << "frees left pending after all reads are done";
+    ASSERT_EQ(num_freed.load(), uint64_cast(num_threads) * num_iters);
+}
+
+SISL_OPTION_GROUP(test_blk_free_epoch,
+                  (num_threads, "", "num_threads", "number of threads",
+                   ::cxxopts::value< uint32_t >()->default_value("8"), "number"),
+                  (num_iters, "", "num_iters", "number of read/free iterations per thread",
+                   ::cxxopts::value< uint32_t >()->default_value("10000"), "number"));
+
+int main(int argc, char* argv[]) {
+    int parsed_argc{argc};
+    ::testing::InitGoogleTest(&parsed_argc, argv);
+    SISL_OPTIONS_LOAD(parsed_argc, argv, logging, test_blk_free_epoch);
+    sisl::logging::SetLogger("test_blk_free_epoch");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    const auto ret{RUN_ALL_TESTS()};
+    return ret;
+}
@@ -151,6 +151,31 @@ TEST_F(BlkReadTrackerTest, TestInsertWithWaiter) {
     get_inst()->remove(b);
 }
 
+/*
+ * A read spanning many records, spread across the shards, with waiter on a blkid which covers all of it.
+ * waiter should be called only once every record of the read is removed, irrespective of number of shards.
+ * */
+TEST_F(BlkReadTrackerTest, TestWaiterAcrossShards) {
+    for (uint32_t const num_shards : {1u, 4u, 32u}) {
+        auto tracker = std::make_unique< BlkReadTracker >(num_shards);
+        BlkId r1{3, 100, 1};
+        BlkId r2{60, 40, 1};
+        tracker->insert(r1);
+        tracker->insert(r2);
+
+        bool called{false};
+        tracker->wait_on(MultiBlkId{0, 128, 1}, [&called]() {
+            LOGMSG_ASSERT_EQ(called, false, "not expecting wait_on callback to be called more than once!");
+            called = true;
+        });
+
+        tracker->remove(r1);
+        ASSERT_EQ(called, false) << "waiter called while read is pending, num_shards=" << num_shards;
+        tracker->remove(r2);
+        ASSERT_EQ(called, true) << "waiter not called after all reads are done, num_shards=" << num_shards;
+    }
+}
+
 /*
  * free same blkid as read.
  * free bid callback should be called after read completes
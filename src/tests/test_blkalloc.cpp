@@ -14,6 +14,7 @@
  *
  *********************************************************************************/
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <cassert>
 #include <cstdint>
@@ -23,6 +24,7 @@
 #include <memory>
 #include <mutex>
 #include <random>
+#include <string>
 #include <thread>
 #include <vector>
 
@@ -40,6 +42,8 @@
 #include "common/homestore_config.hpp"
 #include "blkalloc/fixed_blk_allocator.h"
 #include "blkalloc/varsize_blk_allocator.h"
+#include "blkalloc/extent_blk_allocator.h"
+#include "blkalloc/compressed_blk_set.h"
 
 SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
 
@@ -673,6 +677,166 @@ TEST_F(VarsizeBlkAllocatorTest, alloc_free_var_contiguous_unirandsize_without_sl
     alloc_free_var_contiguous_unirandsize(this);
 }
 
+TEST_F(VarsizeBlkAllocatorTest, alloc_free_var_contiguous_resize_sweepers) {
+    auto const set_sweepers = [](uint32_t n) {
+        HS_SETTINGS_FACTORY().modifiable_settings([n](auto& s) { s.blkallocator.num_slab_sweeper_threads = n; });
+        HS_SETTINGS_FACTORY().save();
+        // Pool is resized by the first sweeper thread within a second
+        std::this_thread::sleep_for(std::chrono::milliseconds{1500});
+    };
+
+    create_allocator();
+    LOGINFO("Grow the sweeper threads while the slabs are refilled");
+    set_sweepers(6);
+    ASSERT_EQ(VarsizeBlkAllocator::num_sweeper_threads(), 6u);
+    alloc_free_var_contiguous_unirandsize(this);
+
+    LOGINFO("Shrink them to one, which refills the slabs of the allocator by itself");
+    set_sweepers(1);
+    ASSERT_EQ(VarsizeBlkAllocator::num_sweeper_threads(), 1u);
+    alloc_free_var_contiguous_unirandsize(this);
+    set_sweepers(2);
+    ASSERT_EQ(VarsizeBlkAllocator::num_sweeper_threads(), 2u);
+}
+
+namespace {
+uint64_t counter_value(nlohmann::json const& j, std::string const& name) {
+    if (j.is_object()) {
+        for (auto const& [key, val] : j.items()) {
+            bool const match = (key == name) || (key.rfind(name + " ", 0) == 0);
+            if (match && val.is_number()) { return val.get< uint64_t >(); }
+            if (auto const v = counter_value(val, name); v != 0) { return v; }
+        }
+    }
+    return 0;
+}
+
+void alloc_free_var_magazines(VarsizeBlkAllocatorTest* const block_test_pointer, const uint32_t magazine_size) {
+    auto const saved_magazine_size = HS_DYNAMIC_CONFIG(blkallocator.thread_magazine_size);
+    HS_SETTINGS_FACTORY().modifiable_settings(
+        [magazine_size](auto& s) { s.blkallocator.thread_magazine_size = magazine_size; });
+    HS_SETTINGS_FACTORY().save();
+    block_test_pointer->create_allocator();
+    auto& allocator = *block_test_pointer->m_allocator;
+
+    // Owner of each blk, to catch a blk being handed out while it is already alloced
+    const uint32_t total_blks{block_test_pointer->m_total_count};
+    std::vector< std::atomic< bool > > owned(total_blks);
+    std::atomic< bool > failed{false};
+    auto const take = [&](BlkId const& bid) {
+        for (blk_num_t n{bid.blk_num()}; n < bid.blk_num() + bid.blk_count(); ++n) {
+            if ((n >= total_blks) || owned[n].exchange(true)) {
+                LOGERROR("blk={} of bid={} is handed out twice", n, bid.to_string());
+                failed = true;
+            }
+        }
+    };
+    auto const give_back = [&](BlkId const& bid) {
+        for (blk_num_t n{bid.blk_num()}; n < bid.blk_num() + bid.blk_count(); ++n) {
+            owned[n].store(false);
+        }
+        allocator.free(bid);
+    };
+
+    // Frees handed over to other threads, so that a thread frees blks refilled into some other thread's magazine
+    std::mutex handoff_mtx;
+    std::vector< BlkId > handoff;
+
+    const auto nthreads{
+        std::clamp< uint32_t >(std::thread::hardware_concurrency(), 2, SISL_OPTIONS["num_threads"].as< uint32_t >())};
+    // Each burst refills the magazine few times and freeing it back spills it, as it exceeds twice the magazine size
+    const uint32_t burst{3 * std::max(magazine_size, 4u) + 1};
+    const uint64_t rounds{std::max< uint64_t >(SISL_OPTIONS["iters"].as< uint64_t >() / (nthreads * burst), 16)};
+    LOGINFO("Alloc/free slab sized blks in bursts of {} for {} rounds in {} threads with magazine size={}", burst,
+            rounds, nthreads, magazine_size);
+
+    std::vector< std::thread > threads;
+    for (uint32_t t{0}; t < nthreads; ++t) {
+        threads.emplace_back([&]() {
+            blk_alloc_hints hints;
+            hints.is_contiguous = true;
+            std::vector< BlkId > bids;
+            for (uint64_t r{0}; (r < rounds) && !failed; ++r) {
+                const blk_count_t nblks{static_cast< blk_count_t >(1) << (r % 4)};
+                bids.clear();
+                for (uint32_t i{0}; i < burst; ++i) {
+                    BlkId bid;
+                    if (allocator.alloc(nblks, hints, bid) != BlkAllocStatus::SUCCESS) {
+                        LOGERROR("Failed to alloc nblks={} in round={}", nblks, r);
+                        failed = true;
+                        break;
+                    }
+                    take(bid);
+                    bids.push_back(bid);
+                }
+
+                // Free half of them on this thread and hand over the rest to be freed by some other thread
+                const auto half = bids.size() / 2;
+                std::vector< BlkId > others;
+                {
+                    std::scoped_lock< std::mutex > lock{handoff_mtx};
+                    handoff.insert(handoff.end(), bids.begin() + half, bids.end());
+                    const auto n = std::min(handoff.size(), bids.size() - half);
+                    others.assign(handoff.end() - n, handoff.end());
+                    handoff.resize(handoff.size() - n);
+                }
+                for (size_t i{0}; i < half; ++i) {
+                    give_back(bids[i]);
+                }
+                for (auto const& bid : others) {
+                    give_back(bid);
+                }
+            }
+            // Exits with the freed blks still in its magazine, which are to be spilled back to the shared cache
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_FALSE(failed);
+    for (auto const& bid : handoff) {
+        give_back(bid);
+    }
+    ASSERT_EQ(allocator.get_used_blks(), 0u) << "Used blks count mismatch after all blks are freed";
+
+    auto const metrics = allocator.get_metrics_in_json();
+    LOGINFO("Magazine allocs={} refills={} spills={}", counter_value(metrics, "num_magazine_alloc"),
+            counter_value(metrics, "num_magazine_refills"), counter_value(metrics, "num_magazine_spills"));
+    if (magazine_size == 0) {
+        ASSERT_EQ(counter_value(metrics, "num_magazine_alloc"), 0u);
+        ASSERT_EQ(counter_value(metrics, "num_magazine_refills"), 0u);
+        ASSERT_EQ(counter_value(metrics, "num_magazine_spills"), 0u);
+    } else {
+        ASSERT_GT(counter_value(metrics, "num_magazine_alloc"), 0u);
+        ASSERT_GT(counter_value(metrics, "num_magazine_refills"), 0u);
+        ASSERT_GT(counter_value(metrics, "num_magazine_spills"), 0u);
+    }
+
+    LOGINFO("Alloc all the blks, none of them should be stranded in the magazines of the exited threads");
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    uint64_t nalloced{0};
+    for (const blk_count_t nblks : std::array< blk_count_t, 4 >{8, 4, 2, 1}) {
+        BlkId bid;
+        while (allocator.alloc(nblks, hints, bid) == BlkAllocStatus::SUCCESS) {
+            take(bid);
+            nalloced += bid.blk_count();
+        }
+    }
+    ASSERT_FALSE(failed);
+    ASSERT_EQ(nalloced, total_blks) << "Blks leaked after the threads exited";
+    ASSERT_EQ(allocator.get_used_blks(), total_blks);
+
+    HS_SETTINGS_FACTORY().modifiable_settings(
+        [saved_magazine_size](auto& s) { s.blkallocator.thread_magazine_size = saved_magazine_size; });
+    HS_SETTINGS_FACTORY().save();
+}
+} // namespace
+
+TEST_F(VarsizeBlkAllocatorTest, alloc_free_var_magazines_in_parallel) { alloc_free_var_magazines(this, 4); }
+
+TEST_F(VarsizeBlkAllocatorTest, alloc_free_var_magazines_disabled) { alloc_free_var_magazines(this, 0); }
+
 namespace {
 void alloc_free_var_contiguous_roundrandsize(VarsizeBlkAllocatorTest* const block_test_pointer) {
     const auto nthreads{
@@ -871,6 +1035,180 @@ TEST_F(VarsizeBlkAllocatorTest, alloc_var_scatter_direct_unirandsize_without_sla
     alloc_var_scatter_direct_unirandsize(this);
 }
 #endif
+struct ExtentBlkAllocatorTest : public ::testing::Test {
+    static constexpr blk_num_t s_total_blks{64 * 1024};
+    std::unique_ptr< ExtentBlkAllocator > m_allocator;
+
+    virtual void SetUp() override {
+        HomeStoreDynamicConfig::init_settings_default();
+        BlkAllocConfig cfg{4096, 4096, static_cast< uint64_t >(s_total_blks) * 4096, false, "extent_test"};
+        m_allocator = std::make_unique< ExtentBlkAllocator >(cfg, true, 0);
+    }
+
+    MultiBlkId alloc(blk_count_t nblks, bool is_contiguous, BlkAllocStatus exp_status = BlkAllocStatus::SUCCESS) {
+        blk_alloc_hints hints;
+        hints.is_contiguous = is_contiguous;
+        MultiBlkId mbid;
+        EXPECT_EQ(m_allocator->alloc(nblks, hints, mbid), exp_status);
+        if (exp_status == BlkAllocStatus::SUCCESS) {
+            EXPECT_EQ(mbid.blk_count(), nblks);
+            EXPECT_TRUE(m_allocator->is_blk_alloced(mbid));
+        }
+        return mbid;
+    }
+};
+
+TEST_F(ExtentBlkAllocatorTest, alloc_free_merge) {
+    LOGINFO("Step 1: Allocate the entire chunk in contiguous 256 blk pieces");
+    std::vector< MultiBlkId > bids;
+    for (blk_num_t i{0}; i < s_total_blks / 256; ++i) {
+        bids.push_back(alloc(256, true /* is_contiguous */));
+        ASSERT_EQ(bids.back().num_pieces(), 1u);
+    }
+    ASSERT_EQ(m_allocator->available_blks(), 0u);
+    alloc(1, true /* is_contiguous */, BlkAllocStatus::FAILED);
+
+    LOGINFO("Step 2: Free every alternate piece, which should leave as many disjoint free extents");
+    for (size_t i{0}; i < bids.size(); i += 2) {
+        m_allocator->free(bids[i]);
+    }
+    ASSERT_EQ(m_allocator->num_free_extents(), bids.size() / 2);
+    ASSERT_EQ(m_allocator->largest_free_extent(), 256u);
+    alloc(512, true /* is_contiguous */, BlkAllocStatus::FAILED);
+
+    LOGINFO("Step 3: Non contiguous alloc of 512 blks should be split across 2 largest extents");
+    auto const scattered = alloc(512, false /* is_contiguous */);
+    ASSERT_EQ(scattered.num_pieces(), 2u);
+    m_allocator->free(scattered);
+
+    LOGINFO("Step 4: Free the rest and validate everything merges back into a single extent");
+    for (size_t i{1}; i < bids.size(); i += 2) {
+        m_allocator->free(bids[i]);
+    }
+    ASSERT_EQ(m_allocator->available_blks(), s_total_blks);
+    ASSERT_EQ(m_allocator->num_free_extents(), 1u);
+    ASSERT_EQ(m_allocator->largest_free_extent(), s_total_blks);
+    ASSERT_EQ(m_allocator->get_defrag_nblks(), 0u);
+}
+
+TEST_F(ExtentBlkAllocatorTest, best_fit_and_reserve) {
+    auto const a = alloc(100, true /* is_contiguous */);
+    [[maybe_unused]] auto const b = alloc(10, true /* is_contiguous */);
+    auto const c = alloc(1000, true /* is_contiguous */);
+    [[maybe_unused]] auto const d = alloc(10, true /* is_contiguous */);
+    m_allocator->free(a);
+    m_allocator->free(c);
+
+    LOGINFO("Best fit should pick the 100 blk hole for 50 blks, instead of the 1000 blk one");
+    auto const e = alloc(50, true /* is_contiguous */);
+    ASSERT_EQ(e.to_single_blkid().blk_num(), a.to_single_blkid().blk_num());
+
+    LOGINFO("Reserve on cache should carve out the range from the free extents");
+    auto const free_before = m_allocator->available_blks();
+    BlkId const rsvd{c.to_single_blkid().blk_num() + 10, 20, 0};
+    ASSERT_EQ(m_allocator->reserve_on_cache(rsvd), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(m_allocator->available_blks(), free_before - 20);
+    ASSERT_TRUE(m_allocator->is_blk_alloced(rsvd));
+    ASSERT_FALSE(m_allocator->is_blk_alloced(c.to_single_blkid()));
+}
+
+TEST_F(ExtentBlkAllocatorTest, neighbor_hint) {
+    auto const a = alloc(10, true /* is_contiguous */);
+    auto const hole1 = alloc(200, true /* is_contiguous */);
+    [[maybe_unused]] auto const b = alloc(10, true /* is_contiguous */);
+    auto const hole2 = alloc(60, true /* is_contiguous */);
+    [[maybe_unused]] auto const c = alloc(10, true /* is_contiguous */);
+    m_allocator->free(hole1);
+    m_allocator->free(hole2);
+
+    LOGINFO("Without hint, best fit should pick the 60 blk hole for 50 blks");
+    auto const d = alloc(50, true /* is_contiguous */);
+    ASSERT_EQ(d.to_single_blkid().blk_num(), hole2.to_single_blkid().blk_num());
+    m_allocator->free(d);
+
+    LOGINFO("With neighbor hint, it should be placed right after the neighbor, even though it is not the best fit");
+    blk_alloc_hints hints;
+    hints.neighbor_blkid_hint = a.to_single_blkid();
+    MultiBlkId e;
+    ASSERT_EQ(m_allocator->alloc(50, hints, e), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(e.to_single_blkid().blk_num(), a.to_single_blkid().blk_num() + a.blk_count());
+}
+
+TEST_F(ExtentBlkAllocatorTest, alloc_free_batch) {
+    LOGINFO("Allocate a batch of blkids of different sizes in one call");
+    std::vector< blk_count_t > const sizes{8, 16, 32, 64, 128};
+    blk_alloc_hints hints;
+    hints.is_contiguous = true;
+    std::vector< MultiBlkId > bids;
+    ASSERT_EQ(m_allocator->alloc_batch(sizes, hints, bids), BlkAllocStatus::SUCCESS);
+    ASSERT_EQ(bids.size(), sizes.size());
+    blk_num_t total{0};
+    for (size_t i{0}; i < sizes.size(); ++i) {
+        ASSERT_EQ(bids[i].blk_count(), sizes[i]);
+        ASSERT_TRUE(m_allocator->is_blk_alloced(bids[i]));
+        total += sizes[i];
+    }
+    ASSERT_EQ(m_allocator->get_used_blks(), total);
+
+    LOGINFO("Free all of them in one batch and they should merge back into a single free extent");
+    std::vector< BlkId > pieces;
+    for (auto const& b : bids) {
+        pieces.push_back(b.to_single_blkid());
+    }
+    m_allocator->free_batch(pieces);
+    ASSERT_EQ(m_allocator->get_used_blks(), 0u);
+    ASSERT_EQ(m_allocator->num_free_extents(), 1u);
+    ASSERT_EQ(m_allocator->largest_free_extent(), s_total_blks);
+}
+
+TEST(CompressedBlkSetTest, add_remove_pop) {
+    // Two full containers and a short last one
+    blk_num_t const total_blks{2 * CompressedBlkSet::container_nblks + 1000};
+    CompressedBlkSet set{total_blks};
+    boost::dynamic_bitset<> expected(total_blks);
+
+    LOGINFO("Step 1: Fully free set should cost close to no memory");
+    set.add_range(0, total_blks);
+    expected.set();
+    ASSERT_EQ(set.size(), total_blks);
+    ASSERT_LT(set.mem_bytes(), 4096u);
+
+    LOGINFO("Step 2: Pop half of the blks and remove random ones, so containers go through all representations");
+    for (blk_num_t i{0}; i < total_blks / 2; ++i) {
+        auto const b = set.pop();
+        ASSERT_TRUE(b.has_value());
+        ASSERT_TRUE(expected[*b]) << "Popped blk=" << *b << " which is not a member";
+        expected.reset(*b);
+    }
+    std::uniform_int_distribution< blk_num_t > rand_blk{0, total_blks - 1};
+    for (uint32_t i{0}; i < 20000; ++i) {
+        auto const b = rand_blk(g_re);
+        ASSERT_EQ(set.remove(b), expected[b]);
+        expected.reset(b);
+    }
+    ASSERT_EQ(set.size(), expected.count());
+
+    LOGINFO("Step 3: Add back random blks and validate membership of every blk");
+    for (uint32_t i{0}; i < 50000; ++i) {
+        auto const b = rand_blk(g_re);
+        ASSERT_EQ(set.add(b), !expected[b]);
+        expected.set(b);
+    }
+    ASSERT_EQ(set.size(), expected.count());
+    for (blk_num_t b{0}; b < total_blks; ++b) {
+        ASSERT_EQ(set.contains(b), expected[b]) << "Membership mismatch for blk=" << b;
+    }
+
+    LOGINFO("Step 4: Drain the set, memory should go back to close to nothing");
+    while (auto const b = set.pop()) {
+        ASSERT_TRUE(expected[*b]);
+        expected.reset(*b);
+    }
+    ASSERT_EQ(expected.count(), 0u);
+    ASSERT_EQ(set.size(), 0u);
+    ASSERT_LT(set.mem_bytes(), 4096u);
+}
+
 template < typename T >
 std::shared_ptr< cxxopts::Value > opt_default(const char* val) {
     return ::cxxopts::value< T >()->default_value(val);
@@ -889,6 +1227,10 @@ int main(int argc, char* argv[]) {
     SISL_OPTIONS_LOAD(argc, argv, ENABLED_OPTIONS)
     sisl::logging::SetLogger("test_blkalloc");
     spdlog::set_pattern("[%D %T%z] [%^%l%$] [%t] %v");
+
+    // Sweeps fan out to iomanager workers, which this test doesn't start
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.blkallocator.num_sweep_workers = 1; });
+    HS_SETTINGS_FACTORY().save();
     const int result{RUN_ALL_TESTS()};
     return result;
 }
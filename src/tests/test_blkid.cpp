@@ -103,6 +103,67 @@ TEST(BlkIdTest, MultiBlkIdTest) {
     ASSERT_EQ(mb1, mb2);
 }
 
+TEST(BlkIdTest, MultiBlkIdPieces) {
+    MultiBlkId mb1;
+    ASSERT_EQ(mb1.pieces().begin(), mb1.pieces().end());
+    ASSERT_EQ(mb1.blk_count(), 0);
+
+    std::array< BlkId, 4 > abs{BlkId{10, 5, 1}, BlkId{20, 8, 1}, BlkId{30, 1, 1}, BlkId{60, 9, 1}};
+    for (auto const& b : abs) {
+        mb1.add(b);
+    }
+    uint32_t i{0};
+    for (auto const b : mb1.pieces()) {
+        ASSERT_EQ(b, abs[i++]);
+    }
+    ASSERT_EQ(i, abs.size());
+    ASSERT_EQ(mb1.blk_count(), 23);
+
+    LOGINFO("A copy is a copy of the bytes, pieces and all");
+    MultiBlkId mb2;
+    std::memcpy(&mb2, &mb1, sizeof(MultiBlkId));
+    ASSERT_EQ(mb2, mb1);
+    ASSERT_EQ(mb2.num_pieces(), 4);
+    ASSERT_EQ(mb2.piece(3), abs[3]);
+}
+
+TEST(BlkIdTest, MultiBlkIdCompactSerialization) {
+    std::array< uint8_t, 128 > buf;
+    MultiBlkId mb1;
+    ASSERT_EQ(mb1.serialize_to(buf.data(), blkid_format_t::compact), 1u);
+    MultiBlkId mb2{5, 6, 2};
+    mb2.deserialize(sisl::blob{buf.data(), 1}, blkid_format_t::compact);
+    ASSERT_EQ(mb2.is_valid(), false);
+
+    LOGINFO("Fragmented blkid of nearby pieces, either side of the first, is a fraction of the fixed size");
+    mb1.add(100000, 5, 3);
+    std::array< BlkId, 5 > abs{BlkId{100010, 8, 3}, BlkId{99990, 1, 3}, BlkId{100300, 200, 3},
+                               BlkId{5, 65535, 3}, BlkId{0x7fffffff, 1, 3}};
+    for (auto const& b : abs) {
+        mb1.add(b);
+    }
+    auto const sz = mb1.serialize_to(buf.data(), blkid_format_t::compact);
+    ASSERT_EQ(sz, mb1.serialized_size(blkid_format_t::compact));
+    ASSERT_LT(sz, mb1.serialized_size(blkid_format_t::fixed));
+    ASSERT_LE(sz, MultiBlkId::max_serialized_size(blkid_format_t::compact));
+
+    // Trailing bytes, like the rest of a slot in the journal entry, are ignored
+    std::memset(buf.data() + sz, 0xff, buf.size() - sz);
+    mb2.deserialize(sisl::blob{buf.data(), uint32_cast(buf.size())}, blkid_format_t::compact);
+    ASSERT_EQ(mb2.num_pieces(), mb1.num_pieces());
+    auto it1 = mb1.iterate();
+    auto it2 = mb2.iterate();
+    while (auto b = it1.next()) {
+        ASSERT_EQ(*b, *it2.next());
+    }
+
+    LOGINFO("Fixed format is the same as serialize()");
+    ASSERT_EQ(mb1.serialize_to(buf.data(), blkid_format_t::fixed), mb1.serialized_size());
+    MultiBlkId mb3;
+    mb3.deserialize(sisl::blob{buf.data(), mb1.serialized_size()}, blkid_format_t::fixed);
+    ASSERT_EQ(mb3, mb1);
+}
+
 TEST(BlkIdTest, MultiBlkIdInMap) {
     std::map< MultiBlkId, int > m1;
     std::unordered_map< MultiBlkId, int > m2;
@@ -23,6 +23,7 @@
 #include <homestore/btree/detail/simple_node.hpp>
 #include <homestore/btree/detail/varlen_node.hpp>
 #include <homestore/btree/detail/prefix_node.hpp>
+#include <homestore/btree/detail/compact_node.hpp>
 #include "btree_helpers/btree_test_kvs.hpp"
 
 static constexpr uint32_t g_node_size{4096};
@@ -63,6 +64,12 @@ struct PrefixIntervalBtreeTest {
     using ValueType = TestIntervalValue;
 };
 
+struct CompactNodeTest {
+    using NodeType = CompactNode< TestFixedKey, TestFixedValue >;
+    using KeyType = TestFixedKey;
+    using ValueType = TestFixedValue;
+};
+
 template < typename TestType >
 struct NodeTest : public testing::Test {
     using T = TestType;
@@ -327,7 +334,7 @@ private:
 };
 
 using NodeTypes = testing::Types< FixedLenNodeTest, VarKeySizeNodeTest, VarValueSizeNodeTest, VarObjSizeNodeTest,
-                                  PrefixIntervalBtreeTest >;
+                                  PrefixIntervalBtreeTest, CompactNodeTest >;
 TYPED_TEST_SUITE(NodeTest, NodeTypes);
 
 TYPED_TEST(NodeTest, SequentialInsert) {
@@ -398,6 +405,30 @@ TYPED_TEST(NodeTest, Update) {
     this->validate_get_all();
 }
 
+TYPED_TEST(NodeTest, IncrementalChecksum) {
+    this->put_list({0, 1, 2, g_max_keys / 2, g_max_keys / 2 + 1, g_max_keys / 2 - 1});
+    this->m_node1->set_checksum();
+    ASSERT_EQ(this->m_node1->verify_node(), true) << "Checksum mismatch after put";
+
+    // Updates in place keep the checksum up, which has to be the same as computing it all over
+    this->update(1);
+    this->update(g_max_keys / 2);
+    this->m_node1->set_checksum();
+    auto const incr_csum = this->m_node1->checksum();
+    ASSERT_EQ(this->m_node1->verify_node(), true) << "Checksum mismatch after update";
+
+    this->remove(0);
+    this->m_node1->set_checksum();
+    ASSERT_EQ(this->m_node1->verify_node(), true) << "Checksum mismatch after remove";
+    ASSERT_NE(this->m_node1->checksum(), incr_csum);
+
+    // Corruption of the data area is caught
+    auto* data = this->m_node1_buf.get() + sizeof(persistent_hdr_t);
+    data[0] ^= 0x1;
+    ASSERT_EQ(this->m_node1->verify_node(), false) << "Corrupted node passed checksum";
+    data[0] ^= 0x1;
+}
+
 TYPED_TEST(NodeTest, RandomInsertRemoveUpdate) {
     uint32_t num_inserted{0};
     while (this->has_room()) {
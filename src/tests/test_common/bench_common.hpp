@@ -0,0 +1,84 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+/*
+ * Shared by the benchmarks which keep a number of ops outstanding for the run time and report their latencies
+ *
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#include <iomgr/io_environment.hpp>
+#include <sisl/logging/logging.h>
+
+namespace test_common {
+
+// Latency at pct percentile of the sorted latencies, 0 if there are none
+inline uint64_t percentile(std::vector< uint64_t > const& sorted, double pct) {
+    if (sorted.empty()) { return 0; }
+    auto const idx = std::min(static_cast< size_t >((pct * sorted.size()) / 100.0), sorted.size() - 1);
+    return sorted[idx];
+}
+
+// Sorts the latencies and logs their percentiles, nothing if there are none
+inline void report_latencies(std::string_view name, std::vector< uint64_t >& lats) {
+    if (lats.empty()) { return; }
+    std::sort(lats.begin(), lats.end());
+    LOGINFO("    {:<12} lat_us p50={} p90={} p99={} p99.9={} max={}", name, percentile(lats, 50.0),
+            percentile(lats, 90.0), percentile(lats, 99.0), percentile(lats, 99.9), lats.back());
+}
+
+inline double elapsed_secs(uint64_t elapsed_us) { return std::max(elapsed_us, uint64_t{1}) / (1000.0 * 1000.0); }
+
+/*
+ * Ops outstanding: each op completed either issues the next one in its place or is done, wait() returns once all of
+ * them are done.
+ */
+class OutstandingOps {
+public:
+    void add(uint32_t count = 1) { m_outstanding.fetch_add(count, std::memory_order_acq_rel); }
+
+    // Next op is issued on an io thread, as the op could be completing on the commit thread
+    void reissue(std::function< void() > issue_fn) {
+        iomanager.run_on_forget(iomgr::reactor_regex::random_worker, std::move(issue_fn));
+    }
+
+    void done() {
+        if (m_outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::unique_lock lg{m_done_mtx};
+            m_done_cv.notify_all();
+        }
+    }
+
+    void wait() {
+        std::unique_lock lg{m_done_mtx};
+        m_done_cv.wait(lg, [this]() { return (m_outstanding.load() == 0); });
+    }
+
+private:
+    std::atomic< int64_t > m_outstanding{0};
+    std::mutex m_done_mtx;
+    std::condition_variable m_done_cv;
+};
+} // namespace test_common
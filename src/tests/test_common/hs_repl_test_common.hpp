@@ -19,6 +19,7 @@
 #pragma once
 #include <mutex>
 #include <condition_variable>
+#include <functional>
 #include <map>
 #include <set>
 #include <boost/process.hpp>
@@ -136,6 +137,13 @@ public:
     HSReplTestHelper(std::string const& name, std::vector< std::string > const& args, char** argv) :
             name_{name}, args_{args}, argv_{argv} {}
 
+    /// @brief Start the index service too, of size_pct of the fast device, with the callbacks created by cbs_factory
+    /// on every start and restart. Needs to be called ahead of setup().
+    void with_index_service(float size_pct, std::function< IndexServiceCallbacks*() > cbs_factory) {
+        index_size_pct_ = size_pct;
+        index_cbs_factory_ = std::move(cbs_factory);
+    }
+
     void setup() {
         replica_num_ = SISL_OPTIONS["replica_num"].as< uint16_t >();
         sisl::logging::SetLogger(name_ + std::string("_replica_") + std::to_string(replica_num_));
@@ -210,12 +218,16 @@ public:
         folly_ = std::make_unique< folly::Init >(&tmp_argc, &argv_, true);
 
         LOGINFO("Starting Homestore replica={}", replica_num_);
-        m_token = test_common::HSTestHelper::start_homestore(
-            name_ + std::to_string(replica_num_),
-            {{HS_SERVICE::META, {.size_pct = 5.0}},
-             {HS_SERVICE::REPLICATION, {.size_pct = 60.0, .repl_app = std::make_unique< TestReplApplication >(*this)}},
-             {HS_SERVICE::LOG, {.size_pct = 20.0}}},
-            nullptr /*hs_before_svc_start_cb*/, dev_list_);
+        std::map< uint32_t, test_common::HSTestHelper::test_params > svc_params{
+            {HS_SERVICE::META, {.size_pct = 5.0}},
+            {HS_SERVICE::REPLICATION, {.size_pct = 60.0, .repl_app = std::make_unique< TestReplApplication >(*this)}},
+            {HS_SERVICE::LOG, {.size_pct = 20.0}}};
+        if (index_cbs_factory_) {
+            svc_params[HS_SERVICE::INDEX] = {.size_pct = index_size_pct_, .index_svc_cbs = index_cbs_factory_()};
+        }
+        m_token = test_common::HSTestHelper::start_homestore(name_ + std::to_string(replica_num_),
+                                                             std::move(svc_params), nullptr /*hs_before_svc_start_cb*/,
+                                                             dev_list_);
     }
 
     void teardown() {
@@ -233,6 +245,7 @@ public:
 
     void restart(uint32_t shutdown_delay_secs = 5u) {
         m_token.params(HS_SERVICE::REPLICATION).repl_app = std::make_unique< TestReplApplication >(*this);
+        if (index_cbs_factory_) { m_token.params(HS_SERVICE::INDEX).index_svc_cbs = index_cbs_factory_(); }
         test_common::HSTestHelper::restart_homestore(m_token, shutdown_delay_secs);
     }
 
@@ -240,6 +253,7 @@ public:
         exclusive_replica([this]() {
             LOGINFO("Restarting Homestore replica={}", replica_num_);
             m_token.params(HS_SERVICE::REPLICATION).repl_app = std::make_unique< TestReplApplication >(*this);
+            if (index_cbs_factory_) { m_token.params(HS_SERVICE::INDEX).index_svc_cbs = index_cbs_factory_(); }
             test_common::HSTestHelper::restart_homestore(m_token, 5u /* shutdown_delay_secs */);
         });
     }
@@ -343,6 +357,8 @@ private:
     char** argv_;
 
     std::vector< homestore::dev_info > dev_list_;
+    float index_size_pct_{0};
+    std::function< IndexServiceCallbacks*() > index_cbs_factory_;
 
     boost::process::group proc_grp_;
     std::unique_ptr< bip::shared_memory_object > shm_;
@@ -23,6 +23,7 @@
 #include <homestore/meta_service.hpp>
 #include <homestore/checkpoint/cp_mgr.hpp>
 #include <homestore/checkpoint/cp.hpp>
+#include "common/homestore_config.hpp"
 #include "test_common/homestore_test_common.hpp"
 
 using namespace homestore;
@@ -75,22 +76,71 @@ public:
     folly::Future< bool > cp_flush(CP* cp) override {
         auto ctx = s_cast< TestCPContext* >(cp->context(cp_consumer_t::HS_CLIENT));
         ctx->validate(cp->id());
-        return folly::makeFuture< bool >(true);
+        {
+            std::unique_lock lg{m_mtx};
+            m_flushed_cps.push_back(cp->id());
+        }
+        if (m_flush_delay_ms == 0) { return folly::makeFuture< bool >(true); }
+
+        // Slow consumer, completes the flush later from another thread
+        auto promise = std::make_shared< folly::Promise< bool > >();
+        auto fut = promise->getFuture();
+        std::thread([promise, delay = m_flush_delay_ms]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds{delay});
+            promise->setValue(true);
+        }).detach();
+        return fut;
     }
 
     void cp_cleanup(CP* cp) override {}
 
     int cp_progress_percent() override { return 100; }
+
+    bool supports_overlapped_flush() const override { return m_overlap; }
+
+    uint32_t cp_flush_interval() const override { return m_flush_interval; }
+
+    void cp_carry_over(CP* cp, CP*) override {
+        std::unique_lock lg{m_mtx};
+        m_carried_cps.push_back(cp->id());
+    }
+
+    std::vector< cp_id_t > carried_cps() const {
+        std::unique_lock lg{m_mtx};
+        return m_carried_cps;
+    }
+
+    std::vector< cp_id_t > flushed_cps() const {
+        std::unique_lock lg{m_mtx};
+        return m_flushed_cps;
+    }
+
+public:
+    bool m_overlap{false};
+    uint32_t m_flush_delay_ms{0};
+    uint32_t m_flush_interval{1};
+
+private:
+    mutable std::mutex m_mtx;
+    std::vector< cp_id_t > m_flushed_cps;
+    std::vector< cp_id_t > m_carried_cps;
 };
 
 class TestCPMgr : public ::testing::Test {
 public:
     void SetUp() override {
         test_common::HSTestHelper::start_homestore("test_cp", {{HS_SERVICE::META, {.size_pct = 85.0}}});
-        hs()->cp_mgr().register_consumer(cp_consumer_t::HS_CLIENT, std::move(std::make_unique< TestCPCallbacks >()));
+        auto cbs = std::make_unique< TestCPCallbacks >();
+        m_cbs = cbs.get();
+        hs()->cp_mgr().register_consumer(cp_consumer_t::HS_CLIENT, std::move(cbs));
     }
     void TearDown() override { test_common::HSTestHelper::shutdown_homestore(); }
 
+protected:
+    TestCPCallbacks* m_cbs{nullptr};
+
+public:
+
     void simulate_io() {
         iomanager.run_on_forget(iomgr::reactor_regex::least_busy_worker, [this]() {
             auto cur_cp = homestore::hs()->cp_mgr().cp_guard();
@@ -173,6 +223,61 @@ TEST_F(TestCPMgr, cp_start_and_flush) {
     this->trigger_cp(true /* wait */);
 }
 
+TEST_F(TestCPMgr, overlapped_cp_flush) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.cp_overlap_flush = true; });
+    HS_SETTINGS_FACTORY().save();
+    m_cbs->m_overlap = true;
+    m_cbs->m_flush_delay_ms = 500;
+
+    auto nrecords = SISL_OPTIONS["num_records"].as< uint32_t >();
+    LOGINFO("Step 1: Simulate IO on cp session for {} records and trigger a cp with slow flush", nrecords);
+    for (uint32_t i{0}; i < nrecords; ++i) {
+        this->simulate_io();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    auto fut1 = homestore::hs()->cp_mgr().trigger_cp_flush(false /* force */);
+
+    LOGINFO("Step 2: Simulate IO and trigger the next cp (unforced) while the previous one is flushing");
+    for (uint32_t i{0}; i < nrecords; ++i) {
+        this->simulate_io();
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    auto fut2 = homestore::hs()->cp_mgr().trigger_cp_flush(false /* force */);
+
+    LOGINFO("Step 3: Both cps should be flushed, in order");
+    ASSERT_EQ(std::move(fut1).get(), true) << "First CP flush failed";
+    ASSERT_EQ(std::move(fut2).get(), true) << "Overlapped CP was not triggered or failed";
+
+    auto const cps = m_cbs->flushed_cps();
+    ASSERT_GE(cps.size(), 2u) << "Expected both cps to be flushed by the consumer";
+    ASSERT_TRUE(std::is_sorted(cps.begin(), cps.end())) << "Consumer flushed the cps out of order";
+
+    m_cbs->m_flush_delay_ms = 0;
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.cp_overlap_flush = false; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(TestCPMgr, consumer_flush_interval) {
+    m_cbs->m_flush_interval = 2;
+
+    LOGINFO("Step 1: Trigger 4 cps with consumer flushing every 2nd cp");
+    for (uint32_t i{0}; i < 4; ++i) {
+        this->simulate_io();
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+        this->trigger_cp(true /* wait */);
+    }
+
+    LOGINFO("Step 2: Consumer should've flushed 2 of them and carried the rest over");
+    auto const flushed = m_cbs->flushed_cps();
+    auto const carried = m_cbs->carried_cps();
+    ASSERT_EQ(flushed.size(), 2u) << "Consumer flushed unexpected number of cps";
+    ASSERT_EQ(carried.size(), 2u) << "Consumer carried over unexpected number of cps";
+    for (uint32_t i{0}; i < 2; ++i) {
+        ASSERT_EQ(carried[i] + 1, flushed[i]) << "Skipped cp was not followed by a flushed cp";
+    }
+    m_cbs->m_flush_interval = 1;
+}
+
 int main(int argc, char* argv[]) {
     int parsed_argc = argc;
     ::testing::InitGoogleTest(&parsed_argc, argv);
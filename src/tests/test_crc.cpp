@@ -0,0 +1,117 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/homestore_decl.hpp>
+#include <homestore/crc.h>
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+using namespace homestore;
+
+// Crcs a bit at a time, from the definition, to check the table driven (NO_ISAL) or isa-l ones against
+namespace {
+uint16_t ref_crc16_t10dif(uint16_t seed, const unsigned char* buf, uint64_t len) {
+    uint32_t rem = seed;
+    for (uint64_t i{0}; i < len; ++i) {
+        rem ^= (uint32_t{buf[i]} << 8);
+        for (uint32_t j{0}; j < 8; ++j) {
+            rem <<= 1;
+            if (rem & 0x10000) { rem ^= 0x8bb7; }
+        }
+    }
+    return s_cast< uint16_t >(rem);
+}
+
+uint32_t ref_crc32_ieee(uint32_t seed, const unsigned char* buf, uint64_t len) {
+    uint64_t rem = ~seed;
+    for (uint64_t i{0}; i < len; ++i) {
+        rem ^= (uint64_t{buf[i]} << 24);
+        for (uint32_t j{0}; j < 8; ++j) {
+            rem <<= 1;
+            if (rem & 0x100000000ull) { rem ^= 0x04C11DB7; }
+        }
+    }
+    return ~uint32_cast(rem);
+}
+
+uint32_t ref_crc32_iscsi(const unsigned char* buf, uint64_t len, uint32_t init_crc) {
+    uint32_t crc = init_crc;
+    for (uint64_t i{0}; i < len; ++i) {
+        crc ^= buf[i];
+        for (uint32_t j{0}; j < 8; ++j) {
+            crc = (crc & 1) ? ((crc >> 1) ^ 0x82F63B78) : (crc >> 1);
+        }
+    }
+    return crc;
+}
+} // namespace
+
+TEST(CrcTest, CheckValues) {
+    auto const* check = r_cast< const unsigned char* >("123456789");
+    ASSERT_EQ(crc16_t10dif(0, check, 9), 0xD0DB);
+    ASSERT_EQ(crc32_ieee(0, check, 9), 0xFC891918u);
+    ASSERT_EQ(crc32_iscsi(const_cast< unsigned char* >(check), 9, 0xFFFFFFFF) ^ 0xFFFFFFFF, 0xE3069283u);
+}
+
+TEST(CrcTest, MatchesReferenceOnRandomBuffers) {
+    std::mt19937_64 re{0x5eed};
+    std::vector< unsigned char > buf(64 * 1024 + 16);
+    for (auto& b : buf) {
+        b = s_cast< unsigned char >(re());
+    }
+
+    // Offsets and lengths which are not multiples of the slices, along with the seeds
+    std::uniform_int_distribution< size_t > off_dist{0, 15};
+    std::uniform_int_distribution< size_t > len_dist{0, 64 * 1024};
+    for (uint32_t iter{0}; iter < 2000; ++iter) {
+        auto const off = off_dist(re);
+        auto const len = (iter < 64) ? size_t{iter} : len_dist(re);
+        auto* p = buf.data() + off;
+        auto const seed = uint32_cast(re());
+
+        ASSERT_EQ(crc16_t10dif(s_cast< uint16_t >(seed), p, len), ref_crc16_t10dif(s_cast< uint16_t >(seed), p, len))
+            << "off=" << off << " len=" << len;
+        ASSERT_EQ(crc32_ieee(seed, p, len), ref_crc32_ieee(seed, p, len)) << "off=" << off << " len=" << len;
+        ASSERT_EQ(crc32_iscsi(p, s_cast< int >(len), seed), ref_crc32_iscsi(p, len, seed))
+            << "off=" << off << " len=" << len;
+    }
+}
+
+TEST(CrcTest, ShiftMatchesZeroBytes) {
+    std::mt19937_64 re{0x5eed};
+    std::vector< unsigned char > zeros(8192, 0);
+    for (uint32_t iter{0}; iter < 100; ++iter) {
+        auto const crc = uint32_cast(re());
+        auto const len = re() % zeros.size();
+        ASSERT_EQ(crc32c_shift(crc, len), crc32_iscsi(zeros.data(), s_cast< int >(len), crc)) << "len=" << len;
+    }
+}
+
+SISL_OPTIONS_ENABLE(logging)
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    SISL_OPTIONS_LOAD(argc, argv, logging)
+    sisl::logging::SetLogger("test_crc");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+    return RUN_ALL_TESTS();
+}
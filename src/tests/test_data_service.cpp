@@ -13,6 +13,11 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
 #include <vector>
 #include <iostream>
 #include <filesystem>
@@ -28,6 +33,8 @@
 #include <gtest/gtest.h>
 #include <iomgr/iomgr_flip.hpp>
 #include <folly/concurrency/ConcurrentHashMap.h>
+#include <folly/ScopeGuard.h>
+#include <sisl/cache/lru_evictor.hpp>
 
 #include <homestore/blk.h>
 #include <homestore/homestore.hpp>
@@ -35,14 +42,24 @@
 #include "device/device.h"
 #include "device/physical_dev.hpp"
 #include "device/virtual_dev.hpp"
+#include "device/vdev_fair_queue.hpp"
+#include "device/pdev_io_scheduler.hpp"
 #include "device/chunk.h"
 #include "common/homestore_config.hpp"
 #include "common/homestore_assert.hpp"
 #include "blkalloc/blk_allocator.h"
+#include "blkdata_svc/blk_compress.hpp"
+#include "blkdata_svc/blk_read_cache.hpp"
 #include "test_common/bits_generator.hpp"
 #include "test_common/homestore_test_common.hpp"
 
 #include <homestore/blkdata_service.hpp>
+#include <homestore/blkdata_stream_writer.hpp>
+#include <homestore/index/index_data_value.hpp>
+#include <homestore/index/index_table.hpp>
+#include <homestore/index_service.hpp>
+#include "common/homestore_utils.hpp"
+#include "btree_helpers/btree_test_kvs.hpp"
 
 ////////////////////////////////////////////////////////////////////////////
 //                                                                        //
@@ -77,6 +94,22 @@ VENUM(DataSvcOp_t, uint8_t, async_alloc_write = 1, async_read = 2, async_free =
 typedef std::function< void(std::error_condition err, std::shared_ptr< std::vector< BlkId > > out_bids) >
     after_write_cb_t;
 
+// Counters in metrics json are keyed by their name (along with description), so look it up by prefix
+static uint64_t counter_value(nlohmann::json const& j, std::string const& name) {
+    if (j.is_object()) {
+        for (auto const& [key, val] : j.items()) {
+            bool const match = (key == name) || (key.rfind(name + " ", 0) == 0);
+            if (match && val.is_number()) { return val.get< uint64_t >(); }
+            if (auto const v = counter_value(val, name); v != 0) { return v; }
+        }
+    }
+    return 0;
+}
+
+static uint64_t read_cache_counter(std::string const& name) {
+    return counter_value(sisl::MetricsFarm::getInstance().get_result_in_json()["BlkReadCache"], name);
+}
+
 class BlkDataServiceTest : public testing::Test {
 public:
     BlkDataService& inst() { return homestore::data_service(); }
@@ -243,6 +276,173 @@ public:
             });
     }
 
+    // Write num_ios buffers separately and read all of them back in a single vectorized read. If num_tenants is set,
+    // writes are tagged round robin with tenants 1 to num_tenants.
+    void write_io_batch_read_verify(const uint64_t io_size, uint32_t num_ios, uint32_t num_tenants = 0) {
+        auto sg_write_vec = std::make_shared< std::vector< std::shared_ptr< sisl::sg_list > > >();
+        auto blkid_vec = std::make_shared< std::vector< MultiBlkId > >(num_ios);
+        std::vector< folly::Future< std::error_code > > futs;
+        for (uint32_t i{0}; i < num_ios; ++i) {
+            io_tenant_guard g{(num_tenants == 0) ? untagged_io_tenant : io_tenant_t{(i % num_tenants) + 1}};
+            sg_write_vec->emplace_back(std::make_shared< sisl::sg_list >());
+            futs.emplace_back(write_sgs(io_size, sg_write_vec->back(), 1 /* num_iovs */, (*blkid_vec)[i]));
+        }
+
+        auto read_reqs = std::make_shared< std::vector< std::pair< MultiBlkId, sisl::sg_list > > >();
+        folly::collectAllUnsafe(futs)
+            .thenValue([this, blkid_vec, read_reqs](auto&& vf) {
+                for (size_t i{0}; i < vf.size(); ++i) {
+                    RELEASE_ASSERT(!vf[i].value(), "Write error");
+                    sisl::sg_list sg;
+                    struct iovec iov;
+                    iov.iov_len = (*blkid_vec)[i].blk_count() * inst().get_blk_size();
+                    iov.iov_base = iomanager.iobuf_alloc(512, iov.iov_len);
+                    sg.iovs.push_back(iov);
+                    sg.size = iov.iov_len;
+                    read_reqs->emplace_back((*blkid_vec)[i], std::move(sg));
+                }
+
+                LOGINFO("Step 2: async read on {} blkids in one call", read_reqs->size());
+                return inst().async_read(*read_reqs);
+            })
+            .thenValue([this, sg_write_vec, read_reqs](auto&& err) {
+                RELEASE_ASSERT(!err, "Read error");
+                for (size_t i{0}; i < read_reqs->size(); ++i) {
+                    auto& sg_read = (*read_reqs)[i].second;
+                    RELEASE_ASSERT(test_common::HSTestHelper::compare(sg_read, *(*sg_write_vec)[i]),
+                                   "Batch read after write data mismatch");
+                    free(sg_read);
+                    free(*(*sg_write_vec)[i]);
+                }
+
+                LOGINFO("Read completed;");
+                this->finish_and_notify();
+            });
+    }
+
+    // Write io_size in num_iovs through the striped alloc write, read every stripe back in one batch into a single
+    // buffer and free all of them
+    void striped_write_read_verify(const uint64_t io_size, uint32_t num_iovs, uint32_t expected_min_stripes) {
+        auto sg_write_ptr = std::make_shared< sisl::sg_list >();
+        for (uint32_t i{0}; i < num_iovs; ++i) {
+            struct iovec iov;
+            iov.iov_len = io_size / num_iovs;
+            iov.iov_base = iomanager.iobuf_alloc(512, iov.iov_len);
+            test_common::HSTestHelper::fill_data_buf(r_cast< uint8_t* >(iov.iov_base), iov.iov_len, i + 1);
+            sg_write_ptr->iovs.push_back(iov);
+            sg_write_ptr->size += iov.iov_len;
+        }
+
+        auto blkid_vec = std::make_shared< std::vector< MultiBlkId > >();
+        auto read_buf = r_cast< uint8_t* >(iomanager.iobuf_alloc(512, io_size));
+        auto read_reqs = std::make_shared< std::vector< std::pair< MultiBlkId, sisl::sg_list > > >();
+        inst()
+            .async_alloc_write(*sg_write_ptr, blk_alloc_hints{}, *blkid_vec)
+            .thenValue([this, blkid_vec, read_reqs, read_buf, io_size, expected_min_stripes](auto&& err) {
+                RELEASE_ASSERT(!err, "Striped write error");
+                LOGINFO("Striped write completed on {} stripes", blkid_vec->size());
+                RELEASE_ASSERT_GE(blkid_vec->size(), expected_min_stripes, "Write is not striped across pdevs");
+
+                uint64_t offset{0};
+                for (auto const& bid : *blkid_vec) {
+                    RELEASE_ASSERT(inst().commit_blk(bid) == BlkAllocStatus::SUCCESS, "Commit of stripe failed");
+                    sisl::sg_list sg;
+                    sg.size = bid.blk_count() * inst().get_blk_size();
+                    sg.iovs.push_back(iovec{read_buf + offset, sg.size});
+                    offset += sg.size;
+                    read_reqs->emplace_back(bid, std::move(sg));
+                }
+                RELEASE_ASSERT_EQ(offset, io_size, "Stripes don't add up to the size written");
+
+                LOGINFO("Step 2: read back {} stripes in one batch", read_reqs->size());
+                return inst().async_read(*read_reqs);
+            })
+            .thenValue([this, sg_write_ptr, blkid_vec, read_buf](auto&& err) {
+                RELEASE_ASSERT(!err, "Read error");
+
+                // Compare with the read buffer sliced the same way as the written one
+                sisl::sg_list sg_read;
+                for (auto const& iov : sg_write_ptr->iovs) {
+                    sg_read.iovs.push_back(iovec{read_buf + sg_read.size, iov.iov_len});
+                    sg_read.size += iov.iov_len;
+                }
+                RELEASE_ASSERT(test_common::HSTestHelper::compare(sg_read, *sg_write_ptr),
+                               "Striped read after write data mismatch");
+                iomanager.iobuf_free(read_buf);
+                free(*sg_write_ptr);
+
+                std::vector< folly::Future< std::error_code > > futs;
+                for (auto const& bid : *blkid_vec) {
+                    futs.emplace_back(inst().async_free_blk(bid));
+                }
+                return folly::collectAllUnsafe(futs);
+            })
+            .thenValue([this](auto&& vf) {
+                for (auto const& f : vf) {
+                    RELEASE_ASSERT(!f.value(), "Free of stripe failed");
+                }
+                LOGINFO("Stripes freed;");
+                this->finish_and_notify();
+            });
+    }
+
+    // Stream num_pieces pieces of an object through a stream writer and read every piece back by its blkids
+    void stream_write_read_verify(const uint64_t piece_size, uint32_t num_pieces, uint32_t max_inflight) {
+        auto writer = inst().open_stream_writer(blk_alloc_hints{}, max_inflight);
+        auto sg_write_vec = std::make_shared< std::vector< sisl::sg_list > >(num_pieces);
+        std::vector< folly::Future< std::error_code > > futs;
+        for (uint32_t i{0}; i < num_pieces; ++i) {
+            auto& sg = (*sg_write_vec)[i];
+            struct iovec iov;
+            iov.iov_len = piece_size;
+            iov.iov_base = iomanager.iobuf_alloc(512, piece_size);
+            test_common::HSTestHelper::fill_data_buf(r_cast< uint8_t* >(iov.iov_base), iov.iov_len, i + 1);
+            sg.iovs.push_back(iov);
+            sg.size = piece_size;
+            futs.emplace_back(writer->append(sg));
+        }
+        RELEASE_ASSERT_EQ(writer->appended_size(), piece_size * num_pieces, "Stream appended size mismatch");
+
+        auto blkid_vec = std::make_shared< std::vector< MultiBlkId > >();
+        auto read_reqs = std::make_shared< std::vector< std::pair< MultiBlkId, sisl::sg_list > > >();
+        folly::collectAllUnsafe(futs)
+            .thenValue([writer, blkid_vec](auto&& vf) {
+                for (auto const& f : vf) {
+                    RELEASE_ASSERT(!f.value(), "Stream append error");
+                }
+                return writer->close(*blkid_vec);
+            })
+            .thenValue([this, writer, blkid_vec, read_reqs, piece_size](auto&& err) {
+                RELEASE_ASSERT(!err, "Stream close error");
+                for (auto const& bid : *blkid_vec) {
+                    RELEASE_ASSERT(bid.is_valid(), "Invalid blkid of a streamed piece");
+                    sisl::sg_list sg;
+                    struct iovec iov;
+                    iov.iov_len = piece_size;
+                    iov.iov_base = iomanager.iobuf_alloc(512, iov.iov_len);
+                    sg.iovs.push_back(iov);
+                    sg.size = iov.iov_len;
+                    read_reqs->emplace_back(bid, std::move(sg));
+                }
+                LOGINFO("Step 2: read back {} streamed pieces", read_reqs->size());
+                return inst().async_read(*read_reqs);
+            })
+            .thenValue([this, sg_write_vec, read_reqs](auto&& err) {
+                RELEASE_ASSERT(!err, "Read error");
+                RELEASE_ASSERT_EQ(read_reqs->size(), sg_write_vec->size(), "Streamed pieces count mismatch");
+                for (size_t i{0}; i < read_reqs->size(); ++i) {
+                    auto& sg_read = (*read_reqs)[i].second;
+                    RELEASE_ASSERT(test_common::HSTestHelper::compare(sg_read, (*sg_write_vec)[i]),
+                                   "Streamed piece data mismatch");
+                    free(sg_read);
+                    free((*sg_write_vec)[i]);
+                }
+
+                LOGINFO("Read completed;");
+                this->finish_and_notify();
+            });
+    }
+
     void write_and_restart_with_missing_data_drive(const uint64_t io_size) {
         vdev_info vinfo;
         auto data_vdev = inst().open_vdev(vinfo, true);
@@ -663,6 +863,72 @@ private:
         return fut;
     }
 
+    // Write nblks filled with the pattern and wait for it, to newly allocated blks if bids is empty, else over them
+    sisl::sg_list write_pattern_and_wait(MultiBlkId& bids, uint32_t nblks, uint64_t pattern) {
+        sisl::sg_list sg;
+        sg.size = nblks * inst().get_blk_size();
+        sg.iovs.push_back(iovec{.iov_base = iomanager.iobuf_alloc(512, sg.size), .iov_len = sg.size});
+        test_common::HSTestHelper::fill_data_buf(uintptr_cast(sg.iovs[0].iov_base), sg.size, pattern);
+        if (bids.is_valid()) {
+            RELEASE_ASSERT(!inst().async_write(sg, bids, false /* part_of_batch */).get(), "Overwrite error");
+        } else {
+            auto fut = inst().async_alloc_write(sg, blk_alloc_hints{}, bids, false /* part_of_batch */);
+            inst().commit_blk(bids);
+            RELEASE_ASSERT(!std::move(fut).get(), "Write error");
+        }
+        return sg;
+    }
+
+    // Read the blks back and compare them with what was written, returns the error of the read
+    std::error_code read_and_compare(MultiBlkId const& bids, sisl::sg_list const& written) {
+        sisl::sg_list sg;
+        sg.size = written.size;
+        sg.iovs.push_back(iovec{.iov_base = iomanager.iobuf_alloc(512, sg.size), .iov_len = sg.size});
+        auto const err = inst().async_read(bids, sg, sg.size).get();
+        if (!err) { RELEASE_ASSERT(test_common::HSTestHelper::compare(sg, written), "Read data mismatch"); }
+        free(sg);
+        return err;
+    }
+
+    void restart_with_csum_enabled(bool enabled) {
+        HS_SETTINGS_FACTORY().modifiable_settings([enabled](auto& s) { s.generic.data_csum_enabled = enabled; });
+        HS_SETTINGS_FACTORY().save();
+        test_common::HSTestHelper::restart_homestore(m_token);
+    }
+
+    void set_compress_writes(bool enabled) {
+        HS_SETTINGS_FACTORY().modifiable_settings([enabled](auto& s) { s.generic.data_compress_writes = enabled; });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Read back the compressed blks in full, a prefix of them and in a batch, compared against what was written
+    void verify_compressed_read(MultiBlkId const& bids, sisl::sg_list const& written) {
+        ASSERT_FALSE(read_and_compare(bids, written));
+
+        sisl::sg_list prefix;
+        prefix.size = inst().get_blk_size();
+        prefix.iovs.push_back(iovec{.iov_base = written.iovs[0].iov_base, .iov_len = prefix.size});
+        ASSERT_FALSE(read_and_compare(bids, prefix));
+
+        std::vector< std::pair< MultiBlkId, sisl::sg_list > > reqs;
+        reqs.emplace_back(bids, sisl::sg_list{});
+        auto& sg = reqs.back().second;
+        sg.size = written.size;
+        sg.iovs.push_back(iovec{.iov_base = iomanager.iobuf_alloc(512, sg.size), .iov_len = sg.size});
+        ASSERT_FALSE(inst().async_read(reqs).get());
+        ASSERT_TRUE(test_common::HSTestHelper::compare(sg, written));
+        free(sg);
+    }
+
+    void restart_with_read_cache_enabled(bool enabled, bool csum_enabled = false) {
+        HS_SETTINGS_FACTORY().modifiable_settings([enabled, csum_enabled](auto& s) {
+            s.generic.data_read_cache_enabled = enabled;
+            s.generic.data_csum_enabled = csum_enabled;
+        });
+        HS_SETTINGS_FACTORY().save();
+        test_common::HSTestHelper::restart_homestore(m_token);
+    }
+
     void verify_read_blk_crc(sisl::sg_list& sg, std::vector< uint64_t > read_crc_vec) {
         auto const blk_size = inst().get_blk_size();
         auto const blk_count = sg.iovs[0].iov_len / blk_size;
@@ -883,6 +1149,560 @@ TEST_F(BlkDataServiceTest, TestWriteThenReadVerify) {
     LOGINFO("Step 4: I/O completed, do shutdown.");
 }
 
+TEST_F(BlkDataServiceTest, TestWriteThenBatchReadVerify) {
+    auto io_size = 16 * Ki;
+    uint32_t const num_ios = 8;
+    LOGINFO("Step 1: run on worker thread to schedule {} writes of {} Bytes.", num_ios, io_size);
+    iomanager.run_on_forget(iomgr::reactor_regex::random_worker,
+                            [this, io_size]() { this->write_io_batch_read_verify(io_size, num_ios); });
+
+    LOGINFO("Step 3: Wait for I/O to complete.");
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 4: I/O completed, do shutdown.");
+}
+
+TEST_F(BlkDataServiceTest, TestStripedWriteThenBatchReadVerify) {
+    // Large enough to be striped across all the pdevs with the default stripe settings, in iovs which don't line up
+    // with the stripes
+    auto io_size = 3 * Mi;
+    uint32_t const num_iovs = 4;
+    uint32_t const min_stripes = (SISL_OPTIONS["num_devs"].as< uint32_t >() > 1) ? 2 : 1;
+    LOGINFO("Step 1: run on worker thread to schedule striped write of {} Bytes.", io_size);
+    iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [this, io_size, min_stripes]() {
+        this->striped_write_read_verify(io_size, num_iovs, min_stripes);
+    });
+
+    LOGINFO("Step 3: Wait for I/O to complete.");
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 4: I/O completed, do shutdown.");
+}
+
+TEST_F(BlkDataServiceTest, TestReserveBlkReleasesOnlyWhatItReserved) {
+    LOGINFO("Step 1: Allocate a blk, to reserve a range of blks starting at it as a snapshot copy does");
+    MultiBlkId allocated;
+    blk_alloc_hints hints;
+    ASSERT_TRUE(inst().alloc_blks(inst().get_blk_size(), hints, allocated) == BlkAllocStatus::SUCCESS);
+    ASSERT_TRUE(inst().commit_blk(allocated) == BlkAllocStatus::SUCCESS);
+    blk_count_t const nblks = 8;
+    BlkId const range{allocated.blk_num(), nblks, allocated.chunk_num()};
+    uint32_t num_free{0};
+    for (blk_num_t b{range.blk_num()}; b < range.blk_num() + nblks; ++b) {
+        if (!inst().is_blk_alloced(BlkId{b, 1, range.chunk_num()})) { ++num_free; }
+    }
+    ASSERT_GT(num_free, 0u);
+
+    LOGINFO("Step 2: Reserve the range, only the {} blks which were free are reported as reserved", num_free);
+    std::vector< BlkId > reserved;
+    ASSERT_TRUE(inst().reserve_blk(range, reserved) == BlkAllocStatus::SUCCESS);
+    uint32_t num_reserved{0};
+    for (auto const& r : reserved) {
+        ASSERT_FALSE((allocated.blk_num() >= r.blk_num()) && (allocated.blk_num() < r.blk_num() + r.blk_count()))
+            << "Blk allocated before the reserve is not expected to be reported as reserved";
+        num_reserved += r.blk_count();
+    }
+    ASSERT_EQ(num_reserved, num_free);
+    for (blk_num_t b{range.blk_num()}; b < range.blk_num() + nblks; ++b) {
+        ASSERT_TRUE(inst().is_blk_alloced(BlkId{b, 1, range.chunk_num()}));
+    }
+
+    LOGINFO("Step 3: Release what was reserved, as a failed snapshot obj write does, the allocated blk stays");
+    for (auto const& r : reserved) {
+        inst().unreserve_blk(r);
+    }
+    ASSERT_TRUE(inst().is_blk_alloced(BlkId{allocated.blk_num(), 1, allocated.chunk_num()}));
+    for (auto const& r : reserved) {
+        for (blk_num_t b{r.blk_num()}; b < r.blk_num() + r.blk_count(); ++b) {
+            ASSERT_FALSE(inst().is_blk_alloced(BlkId{b, 1, r.chunk_num()}));
+        }
+    }
+}
+
+TEST_F(BlkDataServiceTest, TestCsumVerifiedAcrossRestart) {
+    LOGINFO("Step 1: Restart with data csums enabled");
+    restart_with_csum_enabled(true);
+    auto guard = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.data_csum_enabled = false; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    LOGINFO("Step 2: Write blks and read them back verified");
+    uint32_t const num_ios{16};
+    std::vector< MultiBlkId > bids(num_ios);
+    std::vector< sisl::sg_list > sgs;
+    for (uint32_t i{0}; i < num_ios; ++i) {
+        sgs.push_back(write_pattern_and_wait(bids[i], 1 + (i % 4), 0xc5c5000000000000 + i));
+        ASSERT_FALSE(read_and_compare(bids[i], sgs[i]));
+    }
+
+    LOGINFO("Step 3: Persist the csums on cp, restart and read them back verified against the recovered csums");
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    restart_with_csum_enabled(true);
+    for (uint32_t i{0}; i < num_ios; ++i) {
+        ASSERT_FALSE(read_and_compare(bids[i], sgs[i]));
+    }
+
+    LOGINFO("Step 4: Overwrite half of them, csums left dirty after the last cp are persisted on clean shutdown");
+    for (uint32_t i{0}; i < num_ios; i += 2) {
+        free(sgs[i]);
+        sgs[i] = write_pattern_and_wait(bids[i], bids[i].blk_count(), 0x5c5c000000000000 + i);
+    }
+    restart_with_csum_enabled(true);
+    for (uint32_t i{0}; i < num_ios; ++i) {
+        ASSERT_FALSE(read_and_compare(bids[i], sgs[i]));
+        free(sgs[i]);
+    }
+}
+
+#ifdef _PRERELEASE
+TEST_F(BlkDataServiceTest, TestCsumStaleAfterCrashIsRelearned) {
+    LOGINFO("Step 1: Restart with data csums enabled, write blks and persist their csums on cp");
+    restart_with_csum_enabled(true);
+    auto guard = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.data_csum_enabled = false; });
+        HS_SETTINGS_FACTORY().save();
+    });
+    MultiBlkId overwritten;
+    MultiBlkId untouched;
+    auto sg_overwritten = write_pattern_and_wait(overwritten, 2, 0xc5c5c5c5c5c5c5c5);
+    auto sg_untouched = write_pattern_and_wait(untouched, 2, 0x5c5c5c5c5c5c5c5c);
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Overwrite a blk in place and restart as if crashed before its new csum was persisted");
+    flip::FlipClient* fc = iomgr_flip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(2000000);
+    freq.set_percent(100);
+    fc->inject_noreturn_flip("blk_csum_skip_cp_flush", {}, freq);
+    freq.set_count(1);
+    fc->inject_noreturn_flip("blk_csum_skip_clean_shutdown", {}, freq);
+
+    free(sg_overwritten);
+    sg_overwritten = write_pattern_and_wait(overwritten, overwritten.blk_count(), 0xa5a5a5a5a5a5a5a5);
+    restart_with_csum_enabled(true);
+    fc->remove_flip("blk_csum_skip_cp_flush");
+
+    LOGINFO("Step 3: Stale csum of the overwritten blk doesn't fail the read, it is relearned");
+    ASSERT_FALSE(read_and_compare(overwritten, sg_overwritten));
+    ASSERT_FALSE(read_and_compare(untouched, sg_untouched));
+
+    LOGINFO("Step 4: Relearned csum is persisted and verified after a clean restart");
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    restart_with_csum_enabled(true);
+    ASSERT_FALSE(read_and_compare(overwritten, sg_overwritten));
+    ASSERT_FALSE(read_and_compare(untouched, sg_untouched));
+    free(sg_overwritten);
+    free(sg_untouched);
+}
+#endif
+
+TEST(BlkReadCacheTest, HitMissAndEviction) {
+    uint32_t const blk_size{4096};
+    uint32_t const max_cached_blks{4};
+    auto evictor = std::make_shared< sisl::LRUEvictor >(max_cached_blks * blk_size, 1 /* num_partitions */);
+    BlkReadCache cache{evictor, blk_size};
+
+    auto buf = std::make_unique< uint8_t[] >(2 * blk_size);
+    auto const fill = [&buf, blk_size](uint8_t pattern) { std::memset(buf.get(), pattern, 2 * blk_size); };
+    iovec const iov{buf.get(), 2 * blk_size};
+
+    LOGINFO("Step 1: Blks not inserted miss, inserted hit with the data inserted");
+    BlkId const bid{16, 2, 1};
+    ASSERT_FALSE(cache.read(bid, &iov, 1, iov.iov_len));
+    fill(0xa5);
+    cache.insert(bid, &iov, 1, iov.iov_len);
+    fill(0);
+    ASSERT_TRUE(cache.read(bid, &iov, 1, iov.iov_len));
+    ASSERT_TRUE(std::all_of(buf.get(), buf.get() + iov.iov_len, [](uint8_t b) { return b == 0xa5; }));
+
+    LOGINFO("Step 2: Blks are cached individually, a read on only some of them hits and the rest misses");
+    iovec const blk_iov{buf.get(), blk_size};
+    ASSERT_TRUE(cache.read(BlkId{17, 1, 1}, &blk_iov, 1, blk_size));
+    ASSERT_FALSE(cache.read(BlkId{17, 2, 1}, &iov, 1, iov.iov_len));
+    ASSERT_FALSE(cache.read(BlkId{16, 2, 2}, &iov, 1, iov.iov_len));
+    ASSERT_FALSE(cache.read(bid, &blk_iov, 1, blk_size)) << "Read shorter than the blks is not served from cache";
+
+    LOGINFO("Step 3: Invalidated blks miss");
+    cache.invalidate(MultiBlkId{17, 1, 1});
+    ASSERT_TRUE(cache.read(BlkId{16, 1, 1}, &blk_iov, 1, blk_size));
+    ASSERT_FALSE(cache.read(BlkId{17, 1, 1}, &blk_iov, 1, blk_size));
+
+    LOGINFO("Step 4: Inserting more blks than the evictor holds evicts the least recently used ones");
+    for (blk_num_t b{100}; b < 100 + 4 * max_cached_blks; ++b) {
+        cache.insert(BlkId{b, 1, 1}, &blk_iov, 1, blk_size);
+    }
+    uint32_t nhits{0};
+    for (blk_num_t b{100}; b < 100 + 4 * max_cached_blks; ++b) {
+        if (cache.read(BlkId{b, 1, 1}, &blk_iov, 1, blk_size)) { ++nhits; }
+    }
+    ASSERT_LE(nhits, max_cached_blks);
+    ASSERT_FALSE(cache.read(BlkId{16, 1, 1}, &blk_iov, 1, blk_size));
+    ASSERT_FALSE(cache.read(BlkId{100, 1, 1}, &blk_iov, 1, blk_size));
+    cache.insert(BlkId{200, 1, 1}, &blk_iov, 1, blk_size);
+    ASSERT_TRUE(cache.read(BlkId{200, 1, 1}, &blk_iov, 1, blk_size));
+}
+
+TEST(BlkWriteStampsTest, WrittenSince) {
+    BlkWriteStamps stamps;
+    auto const before = stamps.now();
+    ASSERT_FALSE(stamps.written_since(BlkId{10, 4, 1}, before));
+
+    stamps.on_write(MultiBlkId{12, 1, 1});
+    auto const after = stamps.now();
+    ASSERT_GT(after, before);
+    ASSERT_TRUE(stamps.written_since(BlkId{10, 4, 1}, before));
+    ASSERT_TRUE(stamps.written_since(BlkId{12, 1, 1}, before));
+    ASSERT_FALSE(stamps.written_since(BlkId{12, 1, 1}, after)) << "Write before the stamp is seen as written since";
+    ASSERT_FALSE(stamps.written_since(BlkId{12, 1, 2}, before)) << "Write to another chunk is seen as written";
+}
+
+TEST_F(BlkDataServiceTest, TestReadCacheHitMissAndInvalidate) {
+    LOGINFO("Step 1: Restart with the read cache enabled");
+    restart_with_read_cache_enabled(true);
+    auto guard = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.data_read_cache_enabled = false; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    LOGINFO("Step 2: First read of the written blks misses and caches them, next read hits");
+    MultiBlkId bids;
+    auto sg = write_pattern_and_wait(bids, 4, 0xc5c5c5c5c5c5c5c5);
+    auto misses = read_cache_counter("read_cache_misses");
+    auto const hits = read_cache_counter("read_cache_hits");
+    auto const inserted = read_cache_counter("read_cache_blks_inserted");
+    ASSERT_FALSE(read_and_compare(bids, sg));
+    ASSERT_EQ(read_cache_counter("read_cache_misses"), misses + 1);
+    ASSERT_EQ(read_cache_counter("read_cache_blks_inserted"), inserted + bids.blk_count());
+    ASSERT_FALSE(read_and_compare(bids, sg));
+    ASSERT_EQ(read_cache_counter("read_cache_hits"), hits + 1);
+
+    LOGINFO("Step 3: Overwrite invalidates the cached blks, read after it gets what is written");
+    auto invalidated = read_cache_counter("read_cache_blks_invalidated");
+    free(sg);
+    sg = write_pattern_and_wait(bids, bids.blk_count(), 0x5c5c5c5c5c5c5c5c);
+    ASSERT_GE(read_cache_counter("read_cache_blks_invalidated"), invalidated + bids.blk_count());
+    misses = read_cache_counter("read_cache_misses");
+    ASSERT_FALSE(read_and_compare(bids, sg));
+    ASSERT_EQ(read_cache_counter("read_cache_misses"), misses + 1);
+    ASSERT_FALSE(read_and_compare(bids, sg));
+
+    LOGINFO("Step 4: Free invalidates the cached blks");
+    invalidated = read_cache_counter("read_cache_blks_invalidated");
+    ASSERT_FALSE(inst().async_free_blk(bids).get());
+    ASSERT_EQ(read_cache_counter("read_cache_blks_invalidated"), invalidated + bids.blk_count());
+    free(sg);
+}
+
+TEST(BlkCompressTest, BlksRoundTrip) {
+    uint32_t const blk_size{4096};
+    uint32_t const size{8 * blk_size};
+    auto data = std::make_unique< uint8_t[] >(size);
+    test_common::HSTestHelper::fill_data_buf(data.get(), size, 0xa5a5a5a5a5a5a5a5);
+    sisl::sg_iovs_t const iovs{iovec{data.get(), size / 2}, iovec{data.get() + size / 2, size / 2}};
+
+    LOGINFO("Step 1: Compressed blks are detected and decompressed only at the blks they are bound to");
+    auto const [cbuf, csize] = compress_to_blks(iovs, size, blk_size, 512);
+    ASSERT_NE(cbuf, nullptr);
+    ASSERT_LT(csize, size);
+    ASSERT_EQ(csize % blk_size, 0);
+    BlkId const first_blk{100, 1, 1};
+    bind_compressed_blks(cbuf, first_blk);
+    iovec const raw_iov{cbuf, csize};
+    ASSERT_TRUE(is_compressed_blks(&raw_iov, 1, first_blk));
+    ASSERT_FALSE(is_compressed_blks(&raw_iov, 1, BlkId{101, 1, 1})) << "Copy of compressed blks taken for one";
+    ASSERT_FALSE(is_compressed_blks(&raw_iov, 1, BlkId{100, 1, 2})) << "Copy of compressed blks taken for one";
+
+    auto out = std::make_unique< uint8_t[] >(size);
+    sisl::sg_iovs_t const out_iovs{iovec{out.get(), size}};
+    ASSERT_FALSE(decompress_from_blks(cbuf, csize, first_blk, out_iovs, size));
+    ASSERT_EQ(std::memcmp(out.get(), data.get(), size), 0);
+    ASSERT_TRUE(decompress_from_blks(cbuf, csize, BlkId{101, 1, 1}, out_iovs, size));
+
+    LOGINFO("Step 2: Prefix of the data is decompressed into multiple iovs");
+    std::memset(out.get(), 0, size);
+    sisl::sg_iovs_t const prefix_iovs{iovec{out.get(), 100}, iovec{out.get() + 100, blk_size}};
+    ASSERT_FALSE(decompress_from_blks(cbuf, csize, first_blk, prefix_iovs, blk_size + 100));
+    ASSERT_EQ(std::memcmp(out.get(), data.get(), blk_size + 100), 0);
+    ASSERT_TRUE(std::all_of(out.get() + blk_size + 100, out.get() + size, [](uint8_t b) { return b == 0; }));
+
+    LOGINFO("Step 3: Rebound blks are detected only at their new location");
+    ASSERT_FALSE(rebind_compressed_blks(cbuf, csize, BlkId{101, 1, 1}, BlkId{200, 1, 3}));
+    ASSERT_TRUE(rebind_compressed_blks(cbuf, csize, first_blk, BlkId{200, 1, 3}));
+    ASSERT_FALSE(is_compressed_blks(&raw_iov, 1, first_blk));
+    ASSERT_TRUE(is_compressed_blks(&raw_iov, 1, BlkId{200, 1, 3}));
+
+    LOGINFO("Step 4: A corrupted header is not taken for one");
+    r_cast< compressed_blk_hdr* >(cbuf)->orig_size += 1;
+    ASSERT_FALSE(is_compressed_blks(&raw_iov, 1, BlkId{200, 1, 3}));
+    hs_utils::iobuf_free(cbuf, sisl::buftag::data);
+
+    LOGINFO("Step 5: Data which doesn't save a blk is not compressed");
+    std::mt19937_64 re{0x5eed};
+    std::generate(r_cast< uint64_t* >(data.get()), r_cast< uint64_t* >(data.get() + size), re);
+    ASSERT_EQ(compress_to_blks(iovs, size, blk_size, 512).first, nullptr);
+    ASSERT_EQ(compress_to_blks(sisl::sg_iovs_t{iovec{data.get(), blk_size}}, blk_size, blk_size, 512).first, nullptr);
+}
+
+TEST(BlkCompressTest, WireRoundTrip) {
+    uint32_t const size{64 * 1024};
+    auto data = std::make_unique< uint8_t[] >(size);
+    test_common::HSTestHelper::fill_data_buf(data.get(), size);
+    sisl::sg_iovs_t const iovs{iovec{data.get(), 1000}, iovec{data.get() + 1000, size - 1000}};
+
+    sisl::io_blob_safe wire;
+    auto const csize = compress_for_wire(iovs, size, wire);
+    ASSERT_GT(csize, 0);
+    ASSERT_LE(csize, size - (size / 8));
+
+    auto out = std::make_unique< uint8_t[] >(size);
+    ASSERT_FALSE(decompress_from_wire(wire.cbytes(), csize, out.get(), size));
+    ASSERT_EQ(std::memcmp(out.get(), data.get(), size), 0);
+    ASSERT_TRUE(decompress_from_wire(wire.cbytes(), csize, out.get(), size - 8)) << "Size mismatch not caught";
+
+    std::mt19937_64 re{0x5eed};
+    std::generate(r_cast< uint64_t* >(data.get()), r_cast< uint64_t* >(data.get() + size), re);
+    ASSERT_EQ(compress_for_wire(iovs, size, wire), 0);
+}
+
+TEST_F(BlkDataServiceTest, TestCompressedWriteReadBack) {
+    LOGINFO("Step 1: Raw image of compressed blks written before compression is on, is read back as is");
+    auto guard = folly::makeGuard([this]() { set_compress_writes(false); });
+    uint32_t const nblks{16};
+    auto const blk_size = inst().get_blk_size();
+    MultiBlkId image_bids;
+    auto sg_image = write_pattern_and_wait(image_bids, nblks, 0);
+    {
+        auto data = std::make_unique< uint8_t[] >(nblks * blk_size);
+        test_common::HSTestHelper::fill_data_buf(data.get(), nblks * blk_size, 0xc5c5c5c5c5c5c5c5);
+        auto const [cbuf, csize] =
+            compress_to_blks(sisl::sg_iovs_t{iovec{data.get(), nblks * blk_size}}, nblks * blk_size, blk_size, 512);
+        ASSERT_NE(cbuf, nullptr);
+        bind_compressed_blks(cbuf, BlkId{image_bids.blk_num() + 1, 1, image_bids.chunk_num()});
+        std::memcpy(sg_image.iovs[0].iov_base, cbuf, csize);
+        hs_utils::iobuf_free(cbuf, sisl::buftag::data);
+    }
+    ASSERT_FALSE(inst().async_write(sg_image, image_bids, false /* part_of_batch */).get());
+    ASSERT_FALSE(read_and_compare(image_bids, sg_image));
+
+    LOGINFO("Step 2: Compressed writes take fewer blks and are read back in full, as prefix and in batch");
+    set_compress_writes(true);
+    std::vector< MultiBlkId > bids(4);
+    std::vector< sisl::sg_list > sgs;
+    for (uint32_t i{0}; i < bids.size(); ++i) {
+        sgs.push_back(write_pattern_and_wait(bids[i], nblks, 0xc5c5000000000000 + i));
+        ASSERT_LT(bids[i].blk_count(), nblks) << "Data is not written compressed";
+        verify_compressed_read(bids[i], sgs[i]);
+    }
+
+    LOGINFO("Step 3: Raw image, whose header names other blks, is still read as is");
+    ASSERT_FALSE(read_and_compare(image_bids, sg_image));
+
+    LOGINFO("Step 4: Compressed blks are read back after restart and with compression turned off");
+    set_compress_writes(false);
+    restart_with_read_cache_enabled(false);
+    for (uint32_t i{0}; i < bids.size(); ++i) {
+        verify_compressed_read(bids[i], sgs[i]);
+    }
+    ASSERT_FALSE(read_and_compare(image_bids, sg_image));
+
+    LOGINFO("Step 5: Compressed blks are read verified against their csum and through the read cache");
+    restart_with_read_cache_enabled(true, true /* csum_enabled */);
+    auto cache_guard = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.generic.data_read_cache_enabled = false;
+            s.generic.data_csum_enabled = false;
+        });
+        HS_SETTINGS_FACTORY().save();
+    });
+    set_compress_writes(true);
+    MultiBlkId csum_bids;
+    auto sg_csum = write_pattern_and_wait(csum_bids, nblks, 0x5c5c5c5c5c5c5c5c);
+    ASSERT_LT(csum_bids.blk_count(), nblks);
+    auto const hits = read_cache_counter("read_cache_hits");
+    for (uint32_t i{0}; i < 2; ++i) {
+        verify_compressed_read(csum_bids, sg_csum);
+        verify_compressed_read(bids[0], sgs[0]);
+    }
+    ASSERT_GT(read_cache_counter("read_cache_hits"), hits);
+
+    free(sg_csum);
+    free(sg_image);
+    for (auto& sg : sgs) {
+        free(sg);
+    }
+}
+
+#ifdef _PRERELEASE
+TEST_F(BlkDataServiceTest, TestReadRacingOverwriteIsNotCached) {
+    LOGINFO("Step 1: Restart with the read cache and data csums enabled");
+    restart_with_read_cache_enabled(true, true /* csum_enabled */);
+    auto guard = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.generic.data_read_cache_enabled = false;
+            s.generic.data_csum_enabled = false;
+        });
+        HS_SETTINGS_FACTORY().save();
+    });
+    MultiBlkId bids;
+    auto sg_old = write_pattern_and_wait(bids, 4, 0xc5c5c5c5c5c5c5c5);
+
+    LOGINFO("Step 2: Delay a read of the blks and overwrite them before the read completes");
+    sisl::sg_list sg_read;
+    sg_read.size = sg_old.size;
+    sg_read.iovs.push_back(iovec{.iov_base = iomanager.iobuf_alloc(512, sg_read.size), .iov_len = sg_read.size});
+    add_read_delay();
+    auto read_fut = inst().async_read(bids, sg_read, sg_read.size);
+    auto sg_new = write_pattern_and_wait(bids, bids.blk_count(), 0x5c5c5c5c5c5c5c5c);
+
+    LOGINFO("Step 3: Racing read is neither failed on the csum nor leaves what it read in the cache");
+    ASSERT_FALSE(std::move(read_fut).get());
+    ASSERT_TRUE(test_common::HSTestHelper::compare(sg_read, sg_old) ||
+                test_common::HSTestHelper::compare(sg_read, sg_new));
+    ASSERT_FALSE(read_and_compare(bids, sg_new));
+    ASSERT_FALSE(read_and_compare(bids, sg_new));
+    free(sg_read);
+    free(sg_old);
+    free(sg_new);
+}
+#endif
+
+TEST_F(BlkDataServiceTest, TestFairShareAcrossTenants) {
+    auto const io_size = 16 * Ki;
+    uint32_t const num_ios = 32;
+    LOGINFO("Step 1: Limit the data vdev to 2 ios in flight, for writes of 2 tenants of weights 1:3 to queue");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.fair_share_max_inflight_ios = 2; });
+    HS_SETTINGS_FACTORY().save();
+    inst().set_io_tenant_weight(1, 100);
+    inst().set_io_tenant_weight(2, 300);
+    auto reset_fair_share = folly::makeGuard([this]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.fair_share_max_inflight_ios = 0; });
+        HS_SETTINGS_FACTORY().save();
+        inst().remove_io_tenant(1);
+        inst().remove_io_tenant(2);
+    });
+
+    LOGINFO("Step 2: Write {} buffers of {} Bytes alternately as each tenant and read them back", num_ios, io_size);
+    iomanager.run_on_forget(iomgr::reactor_regex::random_worker,
+                            [this, io_size]() { this->write_io_batch_read_verify(io_size, num_ios, 2); });
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 3: Every write is accounted to its tenant and all queued ios are issued");
+    auto const usage = inst().io_tenant_usage();
+    LOGINFO("IO tenant usage: {}", usage.dump());
+    ASSERT_EQ(usage["queued_ios"].get< uint64_t >(), 0u);
+    uint64_t queued{0};
+    for (uint32_t tenant{1}; tenant <= 2; ++tenant) {
+        auto const& t = usage["tenants"][std::to_string(tenant)];
+        ASSERT_EQ(t["weight"].get< uint32_t >(), (tenant == 1) ? 100u : 300u);
+        ASSERT_EQ(t["write_bytes"].get< uint64_t >(), (num_ios / 2) * io_size);
+        ASSERT_EQ(t["queue_depth"].get< uint64_t >(), 0u);
+        queued += t["queued_ios"].get< uint64_t >();
+    }
+    ASSERT_GT(queued, 0u) << "Writes submitted together beyond the limit are expected to be queued";
+
+    LOGINFO("Step 4: Backlog both tenants behind 2 ios in flight on a queue completing them one at a time");
+    VirtualDevMetrics metrics{"test_fair_queue"};
+    std::vector< io_tenant_t > issue_order;
+    std::deque< folly::Promise< std::error_code > > inflight;
+    uint32_t num_done{0};
+    {
+        VDevFairQueue fq{metrics};
+        fq.set_weight(1, 100);
+        fq.set_weight(2, 300);
+        auto const submit = [&issue_order, &inflight](bool) {
+            issue_order.push_back(thread_io_tenant());
+            return inflight.emplace_back().getFuture();
+        };
+        auto const schedule = [&fq, &submit, &num_done, io_size]() {
+            fq.schedule(true /* is_write */, io_size, false /* part_of_batch */, submit)
+                .thenValue([&num_done](std::error_code) { ++num_done; });
+        };
+
+        for (uint32_t i{0}; i < 2; ++i) {
+            schedule();
+        }
+        for (uint32_t i{0}; i < num_ios / 2; ++i) {
+            for (io_tenant_t tenant{1}; tenant <= 2; ++tenant) {
+                io_tenant_guard tg{tenant};
+                schedule();
+            }
+        }
+        ASSERT_EQ(issue_order.size(), 2u) << "Only the ios within the limit are expected to be issued right away";
+
+        while (!inflight.empty()) {
+            auto p = std::move(inflight.front());
+            inflight.pop_front();
+            p.setValue(std::error_code{});
+        }
+    }
+    ASSERT_EQ(num_done, num_ios + 2);
+    ASSERT_EQ(issue_order.size(), num_ios + 2);
+
+    // Both start at the same virtual time, so of the first 8 queued ios issued, 6 are of the tenant of weight 3 and 2
+    // are of the tenant of weight 1
+    auto const first = issue_order.begin() + 2;
+    ASSERT_EQ(std::count(first, first + 8, io_tenant_t{1}), 2);
+    ASSERT_EQ(std::count(first, first + 8, io_tenant_t{2}), 6);
+}
+
+TEST_F(BlkDataServiceTest, TestThrottledSyncIoSuspendsOnlyItsFiber) {
+    uint32_t const io_size = 64 * Ki;
+    uint32_t const num_ios = 8;
+    LOGINFO("Step 1: Limit the background ios to 1MB/s, so that {} ios of {} Bytes wait for well beyond the burst",
+            num_ios, io_size);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.background_io_limit_mbps = 1; });
+    HS_SETTINGS_FACTORY().save();
+    auto reset_limit = folly::makeGuard([]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.device.background_io_limit_mbps = 0; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    LOGINFO("Step 2: Wait for the budget of the ios on the sync io fiber, while posting work to the reactor");
+    PhysicalDevMetrics metrics{"test_pdev_io_scheduler"};
+    PDevIOScheduler sched{metrics};
+    bool waits_done{false};
+    bool reactor_ran_before_waits_done{false};
+    uint32_t num_finished{0}; // Both fibers run on the same reactor, the last one to finish notifies
+    auto const start = Clock::now();
+    iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [&, io_size]() {
+        auto const main_fiber = iomanager.iofiber_self();
+        iomanager.run_on_forget(iomanager.sync_io_capable_fibers()[0], [&, main_fiber, io_size]() {
+            // Runs only once the sync io fiber yields the reactor, i.e. after all the waits if they blocked it
+            iomanager.run_on_forget(main_fiber, [&]() {
+                reactor_ran_before_waits_done = !waits_done;
+                if (++num_finished == 2) { this->finish_and_notify(); }
+            });
+            for (uint32_t i{0}; i < num_ios; ++i) {
+                sched.wait_for_budget(io_priority_t::background, io_size);
+            }
+            waits_done = true;
+            if (++num_finished == 2) { this->finish_and_notify(); }
+        });
+    });
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 3: Waits are paced at the limit and the reactor kept running other work meanwhile");
+    // All but the first io wait for their budget to refill, at 1MB/s
+    auto const min_wait_ms = ((num_ios - 1) * io_size * 1000ull) / Mi;
+    ASSERT_GE(get_elapsed_time_ms(start), min_wait_ms / 2);
+    ASSERT_TRUE(reactor_ran_before_waits_done) << "Reactor is expected to run other work while the sync io waits";
+}
+
+TEST_F(BlkDataServiceTest, TestStreamWriteThenReadVerify) {
+    auto piece_size = 32 * Ki;
+    uint32_t const num_pieces = 16;
+    LOGINFO("Step 1: run on worker thread to stream {} pieces of {} Bytes.", num_pieces, piece_size);
+    iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [this, piece_size]() {
+        this->stream_write_read_verify(piece_size, num_pieces, 2 /* max_inflight */);
+    });
+
+    LOGINFO("Step 3: Wait for I/O to complete.");
+    wait_for_all_io_complete();
+
+    LOGINFO("Step 4: I/O completed, do shutdown.");
+}
+
 // Free_blk test, no read involved;
 TEST_F(BlkDataServiceTest, TestWriteThenFreeBlk) {
     // start io in worker thread;
@@ -926,6 +1746,128 @@ TEST_F(BlkDataServiceTest, TestWriteReadThenFreeBeforeReadComp) {
     LOGINFO("Step 5: I/O completed, do shutdown.");
 }
 
+class IndexDataValueTest : public testing::Test {
+public:
+    using DataIndexTable = IndexTable< TestFixedKey, IndexDataValue >;
+    static constexpr uint32_t inline_max{128};
+
+    void SetUp() override {
+        m_token = test_common::HSTestHelper::start_homestore(
+            "test_data_service",
+            {{HS_SERVICE::META, {.size_pct = 5.0}},
+             {HS_SERVICE::DATA, {.size_pct = 60.0}},
+             {HS_SERVICE::INDEX, {.size_pct = 20.0, .index_svc_cbs = new IndexServiceCallbacks()}}});
+
+        auto cfg = BtreeConfig(hs()->index_service().node_size());
+        cfg.m_leaf_node_type = btree_node_type::VAR_VALUE;
+        cfg.m_int_node_type = btree_node_type::FIXED;
+        m_index = std::make_shared< DataIndexTable >(hs_utils::gen_random_uuid(), hs_utils::gen_random_uuid(),
+                                                     0 /* user_sb_size */, cfg);
+        hs()->index_service().add_index_table(m_index);
+    }
+
+    void TearDown() override {
+        m_index.reset();
+        test_common::HSTestHelper::shutdown_homestore();
+    }
+
+    /// @brief Writes the payload of the size as the value of the key, freeing the blks of the value it replaces
+    void put(uint64_t key, uint32_t size) {
+        auto& data = m_shadow[key];
+        data.resize(size);
+        std::generate(data.begin(), data.end(), [i = key * 131 + size]() mutable { return s_cast< uint8_t >(i++); });
+
+        IndexDataValue value;
+        ASSERT_FALSE(run_io([&]() { return IndexDataValue::write(data.data(), size, value); }))
+            << "Write of the value failed for key=" << key;
+        ASSERT_EQ(value.is_inline(), size <= inline_max);
+
+        TestFixedKey const k{key};
+        IndexDataValue existing;
+        BtreeSinglePutRequest preq{&k, &value, btree_put_type::UPSERT, &existing};
+        ASSERT_EQ(m_index->put(preq), btree_status_t::success) << "Index put failed for key=" << key;
+        ASSERT_FALSE(run_io([&existing]() { return existing.free_data(); }))
+            << "Free of the replaced value failed for key=" << key;
+    }
+
+    /// @brief Looks the key up in the index and reads its payload, inline or from the data service
+    void get_verify(uint64_t key) {
+        auto const& data = m_shadow[key];
+        TestFixedKey const k{key};
+        IndexDataValue value;
+        BtreeSingleGetRequest greq{&k, &value};
+        ASSERT_EQ(m_index->get(greq), btree_status_t::success) << "Index get failed for key=" << key;
+        ASSERT_EQ(value.data_size(), data.size());
+        ASSERT_EQ(value.is_inline(), data.size() <= inline_max);
+        if (!value.is_inline()) { ASSERT_TRUE(value.blkid().is_valid()); }
+
+        std::vector< uint8_t > read_data(value.data_size());
+        ASSERT_FALSE(run_io([&]() { return value.read(read_data.data()); })) << "Read failed for key=" << key;
+        ASSERT_EQ(read_data, data) << "Payload read back is not what was written for key=" << key;
+    }
+
+    void remove(uint64_t key) {
+        TestFixedKey const k{key};
+        IndexDataValue existing;
+        BtreeSingleRemoveRequest rreq{&k, &existing};
+        ASSERT_EQ(m_index->remove(rreq), btree_status_t::success) << "Index remove failed for key=" << key;
+        ASSERT_EQ(existing.data_size(), m_shadow[key].size());
+        ASSERT_FALSE(run_io([&existing]() { return existing.free_data(); }));
+        m_shadow.erase(key);
+    }
+
+private:
+    // Runs the async io on an io thread and waits for it
+    static std::error_code run_io(std::function< folly::Future< std::error_code >() > io) {
+        folly::Promise< std::error_code > promise;
+        auto fut = promise.getFuture();
+        iomanager.run_on_forget(iomgr::reactor_regex::random_worker, [&]() {
+            io().thenValue([&promise](std::error_code err) { promise.setValue(err); });
+        });
+        return std::move(fut).get();
+    }
+
+protected:
+    test_common::HSTestHelper::test_token m_token;
+    shared< DataIndexTable > m_index;
+    std::map< uint64_t, std::vector< uint8_t > > m_shadow;
+};
+
+TEST_F(IndexDataValueTest, InlineAndSpill) {
+    auto const prev_inline_max = HS_DYNAMIC_CONFIG(btree.index_inline_value_max_bytes);
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.btree.index_inline_value_max_bytes = inline_max; });
+    HS_SETTINGS_FACTORY().save();
+    auto settings_guard = folly::makeGuard([prev_inline_max] {
+        HS_SETTINGS_FACTORY().modifiable_settings(
+            [prev_inline_max](auto& s) { s.btree.index_inline_value_max_bytes = prev_inline_max; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    auto const blk_size = data_service().get_blk_size();
+    std::vector< uint32_t > const sizes{1u, inline_max, inline_max + 1, 3 * blk_size + 17};
+
+    LOGINFO("Step 1: Put a payload of each size under a key of its own and read them back through the index");
+    for (uint64_t key{0}; key < sizes.size(); ++key) {
+        this->put(key, sizes[key]);
+    }
+    for (uint64_t key{0}; key < sizes.size(); ++key) {
+        this->get_verify(key);
+    }
+
+    LOGINFO("Step 2: Rewrite every key with a payload of another size, spilling over or moving back inline");
+    for (uint64_t key{0}; key < sizes.size(); ++key) {
+        this->put(key, sizes[(key + 2) % sizes.size()]);
+    }
+    for (uint64_t key{0}; key < sizes.size(); ++key) {
+        this->get_verify(key);
+    }
+
+    LOGINFO("Step 3: Remove the keys, along with the blks of their payloads");
+    for (uint64_t key{0}; key < sizes.size(); ++key) {
+        this->remove(key);
+    }
+}
+
 /**
  * @brief Tests the random read-write-free load functionality of the BlkDataService.
  *  Random write, read-verify, free blks;
@@ -13,26 +13,36 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <thread>
 
+#include <folly/ScopeGuard.h>
+#include <folly/futures/Future.h>
 #include <gtest/gtest.h>
 #include <iomgr/io_environment.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/options/options.h>
 
+#include <homestore/vchunk.h>
+#include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
 #include "device/chunk.h"
 
 #include "device/device.h"
 #include "device/physical_dev.hpp"
 #include "device/virtual_dev.hpp"
+#include "device/vdev_io_batch.hpp"
 
 using namespace homestore;
 SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
@@ -134,6 +144,55 @@ public:
             }
         }
     }
+
+    void set_lazy_format(bool lazy, uint32_t step_mb, uint32_t rate_mbps) {
+        HS_SETTINGS_FACTORY().modifiable_settings([lazy, step_mb, rate_mbps](auto& s) {
+            s.device.lazy_format = lazy;
+            s.device.lazy_zero_step_size_mb = step_mb;
+            s.device.lazy_zero_rate_mbps = rate_mbps;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    // Vdev of a chunk per pdev, whose chunks are filled with garbage directly on the pdev before it is formatted
+    shared< VirtualDev > create_garbage_filled_vdev(std::string const& name, uint64_t chunk_size) {
+        auto vdev =
+            m_dmgr->create_vdev(homestore::vdev_parameters{.vdev_name = name,
+                                                           .vdev_size = m_pdevs.size() * chunk_size,
+                                                           .num_chunks = uint32_cast(m_pdevs.size()),
+                                                           .blk_size = 4096,
+                                                           .dev_type = HSDevType::Data,
+                                                           .alloc_type = blk_allocator_type_t::none,
+                                                           .chunk_sel_type = chunk_selector_type_t::NONE,
+                                                           .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
+                                                           .context_data = sisl::blob{}});
+        static constexpr uint32_t fill_size = 1024 * 1024;
+        auto buf = iomanager.iobuf_alloc(m_pdevs[0]->align_size(), fill_size);
+        std::memset(buf, 0xA5, fill_size);
+        for (auto const& [_, chunk] : vdev->get_chunks()) {
+            for (uint64_t off{0}; off < chunk->size(); off += fill_size) {
+                auto const sz = uint32_cast(std::min(uint64_cast(fill_size), chunk->size() - off));
+                HS_REL_ASSERT(!chunk->physical_dev_mutable()->sync_write(r_cast< const char* >(buf), sz,
+                                                                          chunk->start_offset() + off),
+                              "garbage fill of chunk={} failed", chunk->chunk_id());
+            }
+        }
+        iomanager.iobuf_free(buf);
+        return vdev;
+    }
+
+    static bool is_zeros(uint8_t const* buf, uint64_t size) {
+        return std::all_of(buf, buf + size, [](uint8_t b) { return (b == 0); });
+    }
+
+    static bool wait_for(std::function< bool() > const& cond, std::chrono::seconds timeout) {
+        auto const deadline = std::chrono::steady_clock::now() + timeout;
+        while (!cond()) {
+            if (std::chrono::steady_clock::now() > deadline) { return false; }
+            std::this_thread::sleep_for(std::chrono::milliseconds{20});
+        }
+        return true;
+    }
 };
 
 TEST_F(DeviceMgrTest, StripedVDevCreation) {
@@ -255,6 +314,322 @@ TEST_F(DeviceMgrTest, CreateChunk) {
     vdev.reset();
 }
 
+TEST_F(DeviceMgrTest, CreateChunksBatch) {
+    uint64_t avail_size{0};
+    for (auto& pdev : m_pdevs) {
+        avail_size += pdev->data_size();
+    }
+
+    auto vdev =
+        m_dmgr->create_vdev(homestore::vdev_parameters{.vdev_name = "test_vdev",
+                                                       .size_type = vdev_size_type_t::VDEV_SIZE_DYNAMIC,
+                                                       .vdev_size = avail_size,
+                                                       .num_chunks = 0,
+                                                       .blk_size = 512,
+                                                       .chunk_size = 512 * 1024,
+                                                       .dev_type = HSDevType::Data,
+                                                       .alloc_type = blk_allocator_type_t::none,
+                                                       .chunk_sel_type = chunk_selector_type_t::NONE,
+                                                       .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
+                                                       .context_data = sisl::blob{}});
+
+    static constexpr uint32_t num_chunks{24};
+    LOGINFO("Creating {} chunks together, each with its own private data", num_chunks);
+    std::vector< uint64_t > privates(num_chunks);
+    std::vector< sisl::blob > datas;
+    for (uint32_t i{0}; i < num_chunks; ++i) {
+        privates[i] = 0xC0FFEE00 + i;
+        datas.emplace_back(r_cast< uint8_t* >(&privates[i]), uint32_cast(sizeof(uint64_t)));
+    }
+    auto const chunks = m_dmgr->create_chunks(HSDevType::Data, vdev->info().vdev_id, 512 * 1024, datas);
+    ASSERT_EQ(chunks.size(), num_chunks);
+    ASSERT_EQ(vdev->info().num_primary_chunks, num_chunks);
+    ASSERT_EQ(vdev->info().vdev_size, num_chunks * 512 * 1024ul);
+
+    std::unordered_map< uint32_t, uint64_t > private_of;
+    std::unordered_set< uint64_t > chunk_start;
+    for (uint32_t i{0}; i < num_chunks; ++i) {
+        private_of[chunks[i]->chunk_id()] = privates[i];
+        auto [_, inserted] = chunk_start.insert(chunks[i]->info().chunk_start_offset);
+        ASSERT_EQ(inserted, true) << "chunk start duplicate " << chunks[i]->info().chunk_start_offset;
+    }
+
+    LOGINFO("Restart and validate the chunks and their private data are persisted");
+    auto const vdev_id = vdev->info().vdev_id;
+    vdev.reset();
+    this->restart();
+    auto chunk_vec = m_dmgr->get_chunks();
+    ASSERT_EQ(chunk_vec.size(), num_chunks);
+    for (const auto& chunk : chunk_vec) {
+        ASSERT_EQ(chunk->vdev_id(), vdev_id);
+        ASSERT_EQ(*r_cast< uint64_t const* >(chunk->info().get_user_private()), private_of[chunk->chunk_id()])
+            << "Private data mismatch for chunk " << chunk->chunk_id();
+    }
+    ASSERT_EQ(m_vdevs[0]->info().num_primary_chunks, num_chunks);
+}
+
+TEST_F(DeviceMgrTest, CreateChunksBatchAcrossPdevs) {
+    uint64_t avail_size{0};
+    for (auto& pdev : m_pdevs) {
+        avail_size += pdev->data_size();
+    }
+
+    static constexpr uint64_t chunk_size{256 * 1024 * 1024};
+    auto vdev =
+        m_dmgr->create_vdev(homestore::vdev_parameters{.vdev_name = "test_vdev",
+                                                       .size_type = vdev_size_type_t::VDEV_SIZE_DYNAMIC,
+                                                       .vdev_size = avail_size,
+                                                       .num_chunks = 0,
+                                                       .blk_size = 512,
+                                                       .chunk_size = chunk_size,
+                                                       .dev_type = HSDevType::Data,
+                                                       .alloc_type = blk_allocator_type_t::none,
+                                                       .chunk_sel_type = chunk_selector_type_t::NONE,
+                                                       .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
+                                                       .context_data = sisl::blob{}});
+
+    // No pdev has room for the whole batch, nor do all of them together
+    auto const num_chunks = uint32_cast(m_pdevs.size() * (m_pdevs[0]->data_size() / chunk_size + 1));
+    LOGINFO("Creating {} chunks of size={} together on {} pdevs", num_chunks, chunk_size, m_pdevs.size());
+    std::vector< uint64_t > privates(num_chunks);
+    std::vector< sisl::blob > datas;
+    for (uint32_t i{0}; i < num_chunks; ++i) {
+        privates[i] = 0xC0FFEE00 + i;
+        datas.emplace_back(r_cast< uint8_t* >(&privates[i]), uint32_cast(sizeof(uint64_t)));
+    }
+    auto const chunks = m_dmgr->create_chunks(HSDevType::Data, vdev->info().vdev_id, chunk_size, datas);
+    ASSERT_GT(chunks.size(), 0u);
+    ASSERT_LT(chunks.size(), num_chunks);
+    ASSERT_EQ(vdev->info().num_primary_chunks, chunks.size());
+
+    std::unordered_map< uint32_t, uint64_t > private_of;
+    std::unordered_set< const PhysicalDev* > chunk_pdevs;
+    for (uint32_t i{0}; i < chunks.size(); ++i) {
+        private_of[chunks[i]->chunk_id()] = privates[i];
+        chunk_pdevs.insert(chunks[i]->physical_dev());
+    }
+    ASSERT_EQ(chunk_pdevs.size(), m_pdevs.size()) << "Batch is expected to be split across all the pdevs";
+
+    LOGINFO("Devices are full, further batches are expected to fail");
+    ASSERT_THROW(m_dmgr->create_chunks(HSDevType::Data, vdev->info().vdev_id, chunk_size, {datas[0]}),
+                 std::out_of_range);
+
+    LOGINFO("Restart and validate the chunks on all the pdevs and their private data are persisted");
+    auto const num_created = uint32_cast(chunks.size());
+    vdev.reset();
+    this->restart();
+    auto chunk_vec = m_dmgr->get_chunks();
+    ASSERT_EQ(chunk_vec.size(), num_created);
+    for (const auto& chunk : chunk_vec) {
+        ASSERT_EQ(*r_cast< uint64_t const* >(chunk->info().get_user_private()), private_of[chunk->chunk_id()])
+            << "Private data mismatch for chunk " << chunk->chunk_id();
+    }
+    ASSERT_EQ(m_vdevs[0]->info().num_primary_chunks, num_created);
+}
+
+TEST_F(DeviceMgrTest, ChunkUsage) {
+    auto const set_sample_ms = [](uint32_t ms) {
+        HS_SETTINGS_FACTORY().modifiable_settings([ms](auto& s) { s.device.chunk_usage_sample_ms = ms; });
+        HS_SETTINGS_FACTORY().save();
+    };
+
+    auto vdev =
+        m_dmgr->create_vdev(homestore::vdev_parameters{.vdev_name = "test_vdev_usage",
+                                                       .vdev_size = m_pdevs.size() * 64 * 1024 * 1024,
+                                                       .num_chunks = uint32_cast(m_pdevs.size()),
+                                                       .blk_size = 4096,
+                                                       .dev_type = HSDevType::Data,
+                                                       .alloc_type = blk_allocator_type_t::none,
+                                                       .chunk_sel_type = chunk_selector_type_t::NONE,
+                                                       .multi_pdev_opts = vdev_multi_pdev_opts_t::ALL_PDEV_STRIPED,
+                                                       .context_data = sisl::blob{}});
+    auto chunk = vdev->get_chunks().begin()->second;
+    VChunk vchunk{chunk};
+
+    LOGINFO("Step 1: Sample the chunk before any io, every lookup sampling afresh");
+    set_sample_ms(0);
+    auto u = vchunk.get_usage();
+    ASSERT_EQ(u.write_ios, 0u);
+    ASSERT_EQ(u.read_ios, 0u);
+    ASSERT_EQ(u.available_blks, chunk->blk_allocator()->available_blks());
+
+    LOGINFO("Step 2: Account writes, reads and allocs, the way VirtualDev does before issuing them");
+    for (uint64_t i{0}; i < 8; ++i) {
+        ASSERT_FALSE(chunk->prepare_write(chunk->start_offset() + (i * 4096), 4096));
+    }
+    for (uint64_t i{0}; i < 4; ++i) {
+        ASSERT_EQ(chunk->prepare_read(chunk->start_offset() + (i * 4096), 4096), 4096u);
+    }
+    chunk->record_alloc(8);
+    chunk->record_free(2);
+    std::this_thread::sleep_for(std::chrono::milliseconds{10});
+
+    u = vchunk.get_usage();
+    ASSERT_EQ(u.write_ios, 8u);
+    ASSERT_EQ(u.write_bytes, 8u * 4096);
+    ASSERT_EQ(u.read_ios, 4u);
+    ASSERT_EQ(u.read_bytes, 4u * 4096);
+    ASSERT_EQ(u.alloced_blks, 8u);
+    ASSERT_EQ(u.freed_blks, 2u);
+    ASSERT_GT(u.write_iops, 0.0);
+    ASSERT_GT(u.read_bytes_ps, 0.0);
+    ASSERT_GT(u.alloc_blks_ps, 0.0);
+
+    LOGINFO("Step 3: Lookups within the sample interval return the latest sample");
+    set_sample_ms(60 * 1000);
+    ASSERT_FALSE(chunk->prepare_write(chunk->start_offset(), 4096));
+    ASSERT_EQ(vchunk.get_usage().write_ios, 8u);
+
+    auto const status = chunk->get_status(0);
+    ASSERT_EQ(status["usage"]["write_ios"].get< uint64_t >(), 8u);
+    ASSERT_EQ(status["usage_history"].size(), 2u);
+
+    set_sample_ms(1000);
+    vdev.reset();
+}
+
+TEST_F(DeviceMgrTest, LazyFormatReadsZeros) {
+    static constexpr uint64_t Mi{1024 * 1024};
+    static constexpr uint32_t blk_size{4096};
+    static constexpr uint64_t watermark{16 * Mi};
+
+    // Steps are large and slow enough, that background zeroing doesn't get past the first chunk during the test
+    set_lazy_format(true, 16 /* step_mb */, 1 /* rate_mbps */);
+    auto reset_settings = folly::makeGuard([this]() { set_lazy_format(false, 64, 256); });
+
+    LOGINFO("Step 1: Fill the chunks with garbage and format the vdev lazily");
+    auto vdev = create_garbage_filled_vdev("test_vdev_lazy", 64 * Mi);
+    ASSERT_GT(vdev->get_chunks().size(), 1u) << "Test needs more than one chunk";
+    ASSERT_FALSE(vdev->async_format().get());
+    auto chunk = vdev->get_chunks().rbegin()->second; // Background zeroing starts with the lowest chunk
+    ASSERT_TRUE(chunk->is_zero_pending());
+    ASSERT_EQ(chunk->zeroed_upto(), 0u);
+
+    auto* pdev = chunk->physical_dev_mutable();
+    auto rbuf = iomanager.iobuf_alloc(pdev->align_size(), 8 * blk_size);
+    auto wbuf = iomanager.iobuf_alloc(pdev->align_size(), blk_size);
+
+    LOGINFO("Step 2: Reads beyond the zeroed watermark are served as zeros, both sync and async");
+    std::memset(rbuf, 0xFF, 8 * blk_size);
+    ASSERT_FALSE(vdev->sync_read(r_cast< char* >(rbuf), 2 * blk_size, chunk, 32 * Mi));
+    ASSERT_TRUE(is_zeros(rbuf, 2 * blk_size));
+
+    std::memset(rbuf, 0xFF, 8 * blk_size);
+    auto f = folly::makeFuture< std::error_code >(std::error_code{});
+    iomanager.run_on_wait(iomgr::reactor_regex::random_worker,
+                          [&]() { f = vdev->async_read(r_cast< char* >(rbuf), 2 * blk_size, chunk, 32 * Mi); });
+    ASSERT_FALSE(std::move(f).get());
+    ASSERT_TRUE(is_zeros(rbuf, 2 * blk_size));
+
+    LOGINFO("Step 3: Zero the chunk upto {} and write a blk just below it", in_bytes(watermark));
+    ASSERT_FALSE(chunk->zero_upto(watermark));
+    ASSERT_EQ(chunk->zeroed_upto(), watermark);
+    std::memset(wbuf, 0x3C, blk_size);
+    ASSERT_FALSE(pdev->sync_write(r_cast< const char* >(wbuf), blk_size, chunk->start_offset() + watermark - blk_size));
+
+    LOGINFO("Step 4: Adjacent reads across the watermark are merged into one io, zero filled from the watermark");
+    auto const wm_blk = uint32_cast(watermark / blk_size);
+    std::memset(rbuf, 0xFF, 8 * blk_size);
+    std::vector< folly::Future< std::error_code > > futs;
+    iomanager.run_on_wait(iomgr::reactor_regex::random_worker, [&]() {
+        VDevIOBatch batch{*vdev};
+        futs.push_back(batch.add_read(r_cast< char* >(rbuf), blk_size, BlkId{wm_blk - 1, 1, chunk->chunk_id()}));
+        futs.push_back(
+            batch.add_read(r_cast< char* >(rbuf + blk_size), blk_size, BlkId{wm_blk, 1, chunk->chunk_id()}));
+        futs.push_back(batch.add_read(r_cast< char* >(rbuf + 2 * blk_size), 2 * blk_size,
+                                      BlkId{wm_blk + 1, 2, chunk->chunk_id()}));
+        batch.submit();
+    });
+    for (auto& t : folly::collectAll(futs).get()) {
+        ASSERT_FALSE(t.value());
+    }
+    ASSERT_EQ(std::memcmp(rbuf, wbuf, blk_size), 0) << "Blk below the watermark is to be read from the device";
+    ASSERT_TRUE(is_zeros(rbuf + blk_size, 3 * blk_size)) << "Blks beyond the watermark are to be zeros";
+
+    LOGINFO("Step 5: Single read straddling the watermark is zero filled from the watermark");
+    std::memset(rbuf, 0xFF, 8 * blk_size);
+    futs.clear();
+    iomanager.run_on_wait(iomgr::reactor_regex::random_worker, [&]() {
+        VDevIOBatch batch{*vdev};
+        futs.push_back(
+            batch.add_read(r_cast< char* >(rbuf), 4 * blk_size, BlkId{wm_blk - 1, 4, chunk->chunk_id()}));
+        batch.submit();
+    });
+    ASSERT_FALSE(futs[0].get());
+    ASSERT_EQ(std::memcmp(rbuf, wbuf, blk_size), 0);
+    ASSERT_TRUE(is_zeros(rbuf + blk_size, 3 * blk_size));
+
+    std::memset(rbuf, 0xFF, 8 * blk_size);
+    ASSERT_FALSE(vdev->sync_read(r_cast< char* >(rbuf), 4 * blk_size, chunk, watermark - blk_size));
+    ASSERT_EQ(std::memcmp(rbuf, wbuf, blk_size), 0);
+    ASSERT_TRUE(is_zeros(rbuf + blk_size, 3 * blk_size));
+
+    iomanager.iobuf_free(rbuf);
+    iomanager.iobuf_free(wbuf);
+    chunk.reset();
+    vdev.reset();
+}
+
+TEST_F(DeviceMgrTest, LazyZeroResumesAfterRestart) {
+    static constexpr uint64_t Mi{1024 * 1024};
+    static constexpr uint64_t chunk_size{8 * Mi};
+
+    // Each step of background zeroing is 1MB, throttled to 4MB/s, so a chunk takes about 2 secs to be zeroed
+    set_lazy_format(true, 1 /* step_mb */, 4 /* rate_mbps */);
+    auto reset_settings = folly::makeGuard([this]() { set_lazy_format(false, 64, 256); });
+
+    LOGINFO("Step 1: Fill the chunks with garbage, format the vdev lazily and let background zeroing start");
+    auto vdev = create_garbage_filled_vdev("test_vdev_lazy_restart", chunk_size);
+    ASSERT_FALSE(vdev->async_format().get());
+    auto const first_chunk_id = vdev->get_chunks().begin()->first;
+    std::this_thread::sleep_for(std::chrono::milliseconds{600});
+
+    auto const zeroed_before = vdev->get_chunks().begin()->second->zeroed_upto();
+    LOGINFO("Step 2: Restart in the middle of background zeroing, chunk={} zeroed upto={}", first_chunk_id,
+            in_bytes(zeroed_before));
+    ASSERT_GT(zeroed_before, 0u);
+    ASSERT_LT(zeroed_before, chunk_size);
+    m_vdevs.clear();
+    vdev.reset();
+    this->restart();
+
+    LOGINFO("Step 3: Watermark is persisted and reads beyond it are still zeros");
+    ASSERT_EQ(m_vdevs.size(), 1u);
+    vdev = m_vdevs[0];
+    auto const& chunks = vdev->get_chunks();
+    ASSERT_GE(chunks.at(first_chunk_id)->zeroed_upto(), zeroed_before);
+    for (auto const& [_, chunk] : chunks) {
+        ASSERT_TRUE(chunk->is_zero_pending() || (chunk->chunk_id() == first_chunk_id));
+    }
+
+    auto last_chunk = chunks.rbegin()->second;
+    auto* pdev = last_chunk->physical_dev_mutable();
+    auto rbuf = iomanager.iobuf_alloc(pdev->align_size(), Mi);
+    std::memset(rbuf, 0xFF, Mi);
+    ASSERT_FALSE(vdev->sync_read(r_cast< char* >(rbuf), Mi, last_chunk, chunk_size - Mi));
+    ASSERT_TRUE(is_zeros(rbuf, Mi));
+
+    LOGINFO("Step 4: Zeroing resumes from the watermark and completes, garbage is wiped from the devices");
+    set_lazy_format(true, 1 /* step_mb */, 1000 /* rate_mbps */);
+    auto const all_zeroed = [&chunks]() {
+        return std::none_of(chunks.begin(), chunks.end(), [](auto const& c) { return c.second->is_zero_pending(); });
+    };
+    ASSERT_TRUE(wait_for(all_zeroed, std::chrono::seconds{30}));
+
+    for (auto const& [_, chunk] : chunks) {
+        for (uint64_t off{0}; off < chunk->size(); off += Mi) {
+            std::memset(rbuf, 0xFF, Mi);
+            auto* cpdev = chunk->physical_dev_mutable();
+            ASSERT_FALSE(cpdev->sync_read(r_cast< char* >(rbuf), Mi, chunk->start_offset() + off));
+            ASSERT_TRUE(is_zeros(rbuf, Mi)) << "chunk=" << chunk->chunk_id() << " offset=" << off;
+        }
+    }
+
+    iomanager.iobuf_free(rbuf);
+    last_chunk.reset();
+    vdev.reset();
+}
+
 int main(int argc, char* argv[]) {
     SISL_OPTIONS_LOAD(argc, argv, logging, test_device_manager, iomgr);
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,10 +1,12 @@
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <folly/ScopeGuard.h>
 #include <gtest/gtest.h>
 #include <iomgr/io_environment.hpp>
 #include <homestore/homestore.hpp>
 
+#include "common/homestore_config.hpp"
 #include "test_common/homestore_test_common.hpp"
 #include "replication/log_store/home_raft_log_store.h"
 
@@ -121,9 +123,10 @@ public:
 
         if (m_next_lsn > m_start_lsn) { validate_log(m_rls->last_entry(), m_next_lsn - 1); }
 
-        // Do invidivual get validation
+        // Do invidivual get validation, term of which is from the term index of the store
         for (uint64_t lsn = m_start_lsn; lsn < uint64_cast(m_next_lsn); ++lsn) {
             validate_log(m_rls->entry_at(lsn), lsn);
+            ASSERT_EQ(m_rls->term_at(lsn), expected_term(lsn)) << "Term index mismatch at lsn=" << lsn;
         }
 
         // Do bulk get validation as well.
@@ -144,12 +147,16 @@ private:
         return nuraft::cs_new< nuraft::log_entry >(term, buf);
     }
 
-    void validate_log(const nuraft::ptr< nuraft::log_entry >& le, int64_t lsn) {
-        uint64_t expected_term;
+    uint64_t expected_term(int64_t lsn) {
+        uint64_t term;
         std::stringstream ss;
         ss << std::hex << m_shadow_log[lsn - 1].substr(0, 8);
-        ss >> expected_term;
-        ASSERT_EQ(le->get_term(), expected_term) << "Term mismatch at lsn=" << lsn;
+        ss >> term;
+        return term;
+    }
+
+    void validate_log(const nuraft::ptr< nuraft::log_entry >& le, int64_t lsn) {
+        ASSERT_EQ(le->get_term(), expected_term(lsn)) << "Term mismatch at lsn=" << lsn;
 
         nuraft::buffer& buf = le->get_buf();
         buf.pos(0);
@@ -188,26 +195,52 @@ public:
     void restart() {
         m_leader_store.m_rls.reset();
         m_follower_store.m_rls.reset();
+        for (auto& s : m_shared_stores) {
+            s->m_rls.reset();
+        }
 
         m_token.cb_ = [this]() {
             m_leader_store.m_rls =
                 std::make_unique< HomeRaftLogStore >(m_leader_store.m_logdev_id, m_leader_store.m_store_id);
             m_follower_store.m_rls =
                 std::make_unique< HomeRaftLogStore >(m_follower_store.m_logdev_id, m_follower_store.m_store_id);
+            for (auto& s : m_shared_stores) {
+                s->m_rls = std::make_unique< HomeRaftLogStore >(s->m_logdev_id, s->m_store_id);
+            }
         };
 
         test_common::HSTestHelper::restart_homestore(m_token);
     }
 
+    // Raft log stores created with consensus.share_raft_logdevs on, returns the logdev of each of them
+    std::vector< logdev_id_t > create_shared_stores(uint32_t count) {
+        std::vector< logdev_id_t > logdev_ids;
+        for (uint32_t i{0}; i < count; ++i) {
+            auto& s = m_shared_stores.emplace_back(std::make_unique< RaftLogStoreClient >());
+            s->m_rls = std::make_unique< HomeRaftLogStore >();
+            s->m_store_id = s->m_rls->logstore_id();
+            s->m_logdev_id = s->m_rls->logdev_id();
+            logdev_ids.push_back(s->m_logdev_id);
+        }
+        return logdev_ids;
+    }
+
+    void remove_shared_store(uint32_t idx) {
+        m_shared_stores[idx]->m_rls->remove_store();
+        m_shared_stores.erase(m_shared_stores.begin() + idx);
+    }
+
     virtual void TearDown() override {
         m_leader_store.m_rls.reset();
         m_follower_store.m_rls.reset();
+        m_shared_stores.clear();
         test_common::HSTestHelper::shutdown_homestore();
     }
 
 protected:
     RaftLogStoreClient m_leader_store;
     RaftLogStoreClient m_follower_store;
+    std::vector< std::unique_ptr< RaftLogStoreClient > > m_shared_stores;
     test_common::HSTestHelper::test_token m_token;
 };
 
@@ -259,6 +292,61 @@ TEST_F(TestRaftLogStore, lifecycle_test) {
     this->m_follower_store.append_read_test(nrecords); // total_records in follower = 4000
 }
 
+TEST_F(TestRaftLogStore, shared_logdev_test) {
+    auto nrecords = SISL_OPTIONS["num_records"].as< uint32_t >();
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.consensus.share_raft_logdevs = true;
+        s.logstore.shared_logdev_pool_size = 1;
+    });
+    HS_SETTINGS_FACTORY().save();
+    auto settings_guard = folly::makeGuard([] {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.consensus.share_raft_logdevs = false;
+            s.logstore.shared_logdev_pool_size = 8;
+        });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    LOGINFO("Step 1: Create the journals of 3 groups, all on the one shared logdev");
+    auto const logdev_ids = this->create_shared_stores(3);
+    auto const shared = logstore_service().shared_logdevs();
+    ASSERT_EQ(shared.size(), 1u);
+    for (auto const id : logdev_ids) {
+        ASSERT_EQ(id, shared[0]) << "Raft log store is not created on the shared logdev";
+    }
+
+    LOGINFO("Step 2: Interleave the appends of the groups, compact and rollback some of them");
+    for (uint32_t round{0}; round < 4; ++round) {
+        for (auto& s : this->m_shared_stores) {
+            s->append_read_test(nrecords / 4);
+        }
+    }
+    this->m_shared_stores[0]->compact_test(this->m_shared_stores[0]->total_records() / 2);
+    this->m_shared_stores[1]->rollback_test();
+    for (auto& s : this->m_shared_stores) {
+        s->validate_all_logs();
+    }
+
+    LOGINFO("Step 3: Restart homestore and validate each group replays only its own entries");
+    this->restart();
+    ASSERT_EQ(logstore_service().shared_logdevs(), shared);
+    for (auto& s : this->m_shared_stores) {
+        s->validate_all_logs();
+    }
+
+    LOGINFO("Step 4: Remove the journal of one group, the others on the logdev live on");
+    this->remove_shared_store(1);
+    for (auto& s : this->m_shared_stores) {
+        s->append_read_test(nrecords / 4);
+    }
+    this->restart();
+    ASSERT_EQ(logstore_service().shared_logdevs(), shared);
+    for (auto& s : this->m_shared_stores) {
+        s->validate_all_logs();
+        s->append_read_test(nrecords / 4);
+    }
+}
+
 SISL_OPTIONS_ENABLE(logging, test_home_raft_log_store, iomgr, test_common_setup)
 SISL_OPTION_GROUP(test_home_raft_log_store,
                   (num_records, "", "num_records", "number of record to test",
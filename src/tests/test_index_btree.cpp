@@ -13,12 +13,18 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <chrono>
+#include <thread>
+
 #include <gtest/gtest.h>
 #include <boost/uuid/random_generator.hpp>
+#include <folly/ScopeGuard.h>
 
 #include <sisl/utility/enum.hpp>
 #include "common/homestore_config.hpp"
 #include "common/resource_mgr.hpp"
+#include "index/index_node_cache.hpp"
+#include "index/wb_cache.hpp"
 #include "test_common/homestore_test_common.hpp"
 #include "test_common/range_scheduler.hpp"
 #include "btree_helpers/btree_test_helper.hpp"
@@ -248,6 +254,465 @@ TYPED_TEST(BtreeTest, RandomRemove) {
     this->get_all();
 }
 
+TYPED_TEST(BtreeTest, PinnedUpperLevels) {
+    // Replace the table with the one which keeps its top 2 levels pinned
+    hs()->index_service().remove_index_table(this->m_bt);
+    this->destroy_btree();
+    this->m_cfg.m_pinned_levels = 2;
+    this->m_bt = std::make_shared< typename TestFixture::T::BtreeType >(boost::uuids::random_generator()(),
+                                                                        boost::uuids::random_generator()(), 0,
+                                                                        this->m_cfg);
+    hs()->index_service().add_index_table(this->m_bt);
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    std::vector< uint32_t > vec(num_entries);
+    iota(vec.begin(), vec.end(), 0);
+    std::random_shuffle(vec.begin(), vec.end());
+    LOGINFO("Step 1: Do random insert for {} entries", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(vec[i], btree_put_type::INSERT);
+    }
+    this->get_all();
+
+    LOGINFO("Step 2: Remove every 3rd entry, so that pinned nodes are merged and freed");
+    for (uint32_t i{0}; i < num_entries; i += 3) {
+        this->remove_one(i);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 3: Validate all the entries through the pinned levels");
+    this->get_all();
+    this->query_all_paginate(80);
+}
+
+TYPED_TEST(BtreeTest, ResizeFlushThreads) {
+    auto* wbc = dynamic_cast< IndexWBCache* >(&hs()->index_service().wb_cache());
+    ASSERT_NE(wbc, nullptr);
+    auto const prev_threads = HS_DYNAMIC_CONFIG(generic.cache_flush_threads);
+    auto const initial_threads = s_cast< size_t >(std::max(prev_threads, 1));
+    ASSERT_EQ(wbc->num_flush_threads(), initial_threads);
+
+    auto const set_flush_threads = [](int32_t n) {
+        HS_SETTINGS_FACTORY().modifiable_settings([n](auto& s) { s.generic.cache_flush_threads = n; });
+        HS_SETTINGS_FACTORY().save();
+        // Threads added are started by the resize timer within a second
+        std::this_thread::sleep_for(std::chrono::milliseconds{2000});
+    };
+    auto settings_guard = folly::makeGuard([prev_threads] {
+        HS_SETTINGS_FACTORY().modifiable_settings(
+            [prev_threads](auto& s) { s.generic.cache_flush_threads = prev_threads; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Raise the flush threads to {} and flush a cp across them", initial_threads + 3);
+    set_flush_threads(s_cast< int32_t >(initial_threads + 3));
+    ASSERT_EQ(wbc->num_flush_threads(), initial_threads + 3);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->get_all();
+
+    LOGINFO("Step 2: Lower them to 1, the ones beyond it are left idle");
+    set_flush_threads(1);
+    ASSERT_EQ(wbc->num_flush_threads(), initial_threads + 3);
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->remove_one(i);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->get_all();
+
+    LOGINFO("Step 3: Validate after restart");
+    this->restart_homestore();
+    this->get_all();
+}
+
+TYPED_TEST(BtreeTest, LargerNodeSize) {
+    auto const node_size = 2 * hs()->index_service().node_size();
+    auto cfg = BtreeConfig(node_size);
+    if (!hs()->index_service().is_node_size_supported(node_size)) {
+        LOGINFO("Index vdev does not support node size={}, expect the table creation to fail", node_size);
+        ASSERT_THROW((std::make_shared< typename TestFixture::T::BtreeType >(boost::uuids::random_generator()(),
+                                                                            boost::uuids::random_generator()(), 0,
+                                                                            cfg)),
+                     std::runtime_error);
+
+        // Recreate homestore with the index vdev of mixed node sizes
+        LOGINFO("Restart homestore with mixed node sizes in the index vdev");
+        this->TearDown();
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.btree.index_mixed_node_sizes = true; });
+        HS_SETTINGS_FACTORY().save();
+        this->SetUp();
+    }
+    auto reset_mixed = folly::makeGuard([]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.btree.index_mixed_node_sizes = false; });
+        HS_SETTINGS_FACTORY().save();
+    });
+    ASSERT_TRUE(hs()->index_service().is_node_size_supported(node_size)) << "Larger node size not supported";
+
+    // Replace the table with the one of 2 blks per node, alongside the tables of 1 blk per node
+    hs()->index_service().remove_index_table(this->m_bt);
+    this->destroy_btree();
+    this->m_cfg = cfg;
+    this->m_bt = std::make_shared< typename TestFixture::T::BtreeType >(boost::uuids::random_generator()(),
+                                                                        boost::uuids::random_generator()(), 0,
+                                                                        this->m_cfg);
+    hs()->index_service().add_index_table(this->m_bt);
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Do forward sequential insert for {} entries", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Remove every other entry and validate");
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->remove_one(i);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->get_all();
+    this->query_all_paginate(80);
+
+    LOGINFO("Step 3: Restart homestore and validate the nodes of 2 blks recovered");
+    this->restart_homestore();
+    this->get_all();
+    this->query_all_paginate(80);
+}
+
+TYPED_TEST(BtreeTest, BulkLoad) {
+    using K = typename TestFixture::K;
+    using V = typename TestFixture::V;
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Bulk load even keys upto {}", num_entries);
+    uint32_t next{0};
+    auto const ret = this->m_bt->bulk_load([this, &next, num_entries](K& key, V& value) {
+        if (next >= num_entries) { return false; }
+        key = K{next};
+        value = V::generate_rand();
+        this->m_shadow_map.put_and_check(key, value, value, true /* expected_success */);
+        next += 2;
+        return true;
+    });
+    ASSERT_EQ(ret, btree_status_t::success) << "Bulk load failed";
+    this->get_all();
+    this->query_all_paginate(80);
+
+    LOGINFO("Step 2: Bulk load on a non-empty index is rejected");
+    ASSERT_EQ(this->m_bt->bulk_load([](K&, V&) { return false; }), btree_status_t::not_supported);
+
+    LOGINFO("Step 3: Insert the odd keys in between, so that packed nodes are split");
+    for (uint32_t i{1}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    this->print(std::string("bulk_before.txt"));
+
+    LOGINFO("Step 4: Flush, restart homestore and validate all the entries");
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    this->print(std::string("bulk_after.txt"));
+    this->compare_files("bulk_before.txt", "bulk_after.txt");
+    this->get_all();
+}
+
+TYPED_TEST(BtreeTest, ReadAheadQuery) {
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Do forward sequential insert for {} entries and flush them", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Restart homestore, so that the queries read ahead the leaves from the device");
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    this->query_all_paginate(200);
+    this->do_query(num_entries / 4, num_entries / 2, UINT32_MAX);
+
+    LOGINFO("Step 3: Remove every other entry while reading ahead and validate");
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->remove_one(i);
+        if ((i % 1000) == 0) { this->do_query(i, std::min(i + 500, num_entries - 1), 100); }
+    }
+    this->query_all_paginate(80);
+}
+
+TYPED_TEST(BtreeTest, SnapshotQuery) {
+    using K = typename TestFixture::K;
+    using V = typename TestFixture::V;
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Insert every other key upto {} and take a snapshot", num_entries);
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    auto const expected = this->m_shadow_map.map_const();
+    auto snap = this->m_bt->take_snapshot();
+
+    LOGINFO("Step 2: Remove and insert keys across the tree, with the nodes split and merged, and flush");
+    for (uint32_t i{0}; i < num_entries; i += 6) {
+        this->remove_one(i);
+    }
+    for (uint32_t i{1}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 3: Query of the snapshot sees none of the writes after it, while the index sees all of them");
+    auto const query_snapshot = [this, &snap, num_entries](uint32_t batch_size) {
+        std::vector< std::pair< K, V > > out;
+        BtreeQueryRequest< K > qreq{BtreeKeyRange< K >{K{0}, true, K{num_entries - 1}, true},
+                                    BtreeQueryType::SWEEP_NON_INTRUSIVE_PAGINATION_QUERY, batch_size};
+        btree_status_t ret;
+        do {
+            ret = this->m_bt->query_snapshot(*snap, qreq, out);
+        } while (ret == btree_status_t::has_more);
+        EXPECT_EQ(ret, btree_status_t::success);
+        return out;
+    };
+    auto const out = query_snapshot(100);
+    ASSERT_EQ(out.size(), expected.size());
+    auto it = expected.begin();
+    for (auto const& [k, v] : out) {
+        ASSERT_EQ(k.compare(it->first), 0) << "Snapshot query returned key=" << k << " expected=" << it->first;
+        ASSERT_EQ(v, it->second) << "Snapshot query returned incorrect data for key=" << k;
+        ++it;
+    }
+    this->do_query(0, num_entries - 1, 75);
+
+    LOGINFO("Step 4: Release the snapshot, which drops the images of the nodes");
+    snap.reset();
+    for (uint32_t i{1}; i < num_entries; i += 4) {
+        this->remove_one(i);
+    }
+    this->query_all_paginate(80);
+}
+
+TYPED_TEST(BtreeTest, CacheWarmupAfterRestart) {
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Insert {} entries, read them and flush, so that the hot nodes are persisted", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    this->get_all();
+    this->get_all();
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Restart homestore, the hot nodes are read back into the cache in the background");
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    ASSERT_GT(hs()->index_service().wb_cache().num_warmed_bufs(), 0u) << "No nodes warmed up after restart";
+    this->get_all();
+
+    LOGINFO("Step 3: Update the warmed up nodes and validate them across another restart");
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->remove_one(i);
+    }
+    this->get_all();
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    this->get_all();
+    this->query_all_paginate(80);
+}
+
+// Leaf node with a clean buffer of its own, as the index table creates them, to add to a node cache directly
+static BtreeNodePtr make_cache_node(blk_num_t blk_num, BtreeConfig const& cfg) {
+    auto buf = std::make_shared< IndexBuffer >(BlkId{blk_num, 1, 0}, cfg.node_size(), 512);
+    BtreeNode* n = new SimpleNode< TestFixedKey, TestFixedValue >(buf->raw_buffer(), blk_num, true, true, cfg);
+    static_cast< IndexBtreeNode* >(n)->attach_buf(buf);
+    return BtreeNodePtr{n};
+}
+
+TYPED_TEST(BtreeTest, NodeCacheScanKeepsHotNodes) {
+    // Cache of its own, single shard of 16 nodes
+    uint32_t const cap_nodes{16};
+    IndexNodeCache cache{uint64_cast(cap_nodes) * this->m_cfg.node_size(), this->m_cfg.node_size(), 1};
+
+    LOGINFO("Step 1: Add a node and access it again, so that it is hot");
+    BtreeNodePtr node;
+    ASSERT_TRUE(cache.insert(make_cache_node(0, this->m_cfg)));
+    ASSERT_TRUE(cache.get(BlkId{0, 1, 0}, node));
+    node.reset();
+
+    LOGINFO("Step 2: Scan through many more nodes than the cache holds, each accessed only once");
+    for (blk_num_t b{1}; b <= 20 * cap_nodes; ++b) {
+        ASSERT_TRUE(cache.insert(make_cache_node(b, this->m_cfg)));
+        ASSERT_LE(cache.num_nodes(), cap_nodes) << "Cache grew over its capacity with nothing held";
+    }
+    ASSERT_TRUE(cache.get(BlkId{0, 1, 0}, node)) << "Hot node evicted by the scan";
+}
+
+TYPED_TEST(BtreeTest, NodeCacheHeldNodesNotEvicted) {
+    uint32_t const cap_nodes{16};
+    IndexNodeCache cache{uint64_cast(cap_nodes) * this->m_cfg.node_size(), this->m_cfg.node_size(), 1};
+
+    LOGINFO("Step 1: Add many more nodes than the cache holds, every other one held and the rest dirty");
+    std::vector< BtreeNodePtr > held;
+    std::vector< IndexBufferPtr > dirty;
+    for (blk_num_t b{0}; b < 8 * cap_nodes; ++b) {
+        auto node = make_cache_node(b, this->m_cfg);
+        if (b % 2) {
+            held.push_back(node);
+        } else {
+            dirty.push_back(static_cast< IndexBtreeNode* >(node.get())->m_idx_buf);
+            dirty.back()->set_state(index_buf_state_t::DIRTY);
+        }
+        ASSERT_TRUE(cache.insert(node));
+    }
+    ASSERT_EQ(cache.num_nodes(), 8 * cap_nodes) << "Node in use or dirty was evicted";
+
+    LOGINFO("Step 2: Release and clean them all, the cache shrinks back to its capacity as more nodes are added");
+    held.clear();
+    for (auto& buf : dirty) {
+        buf->set_state(index_buf_state_t::CLEAN);
+    }
+    dirty.clear();
+    for (blk_num_t b{8 * cap_nodes}; b < 16 * cap_nodes; ++b) {
+        ASSERT_TRUE(cache.insert(make_cache_node(b, this->m_cfg)));
+    }
+    ASSERT_LE(cache.num_nodes(), cap_nodes) << "Cache not back within its capacity once the nodes are released";
+}
+
+TYPED_TEST(BtreeTest, AsyncGetFromReactor) {
+    using K = typename TestFixture::K;
+    using V = typename TestFixture::V;
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Do forward sequential insert for {} entries and flush them", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+
+    LOGINFO("Step 2: Issue async gets on cold cache from the main fiber of a reactor, which should not block it");
+    const auto num_gets = std::min(num_entries, 1000u);
+    std::vector< K > keys;
+    std::vector< V > values(num_gets);
+    std::vector< std::unique_ptr< BtreeSingleGetRequest > > reqs;
+    for (uint32_t i{0}; i < num_gets; ++i) {
+        keys.emplace_back(i);
+    }
+    for (uint32_t i{0}; i < num_gets; ++i) {
+        reqs.push_back(std::make_unique< BtreeSingleGetRequest >(&keys[i], &values[i]));
+    }
+
+    std::vector< folly::Future< btree_status_t > > futs;
+    iomanager.run_on_wait(iomgr::reactor_regex::random_worker, [this, &reqs, &futs]() {
+        for (auto& req : reqs) {
+            futs.push_back(this->m_bt->async_get(*req));
+        }
+    });
+    auto const results = folly::collectAllUnsafe(futs).get();
+    for (uint32_t i{0}; i < num_gets; ++i) {
+        ASSERT_EQ(results[i].value(), btree_status_t::success) << "Missing key " << i << " in btree";
+        this->m_shadow_map.validate_data(keys[i], values[i]);
+    }
+}
+
+TYPED_TEST(BtreeTest, BatchPutRemove) {
+    using K = typename TestFixture::K;
+    using V = typename TestFixture::V;
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    static constexpr uint32_t batch_size{500};
+    std::vector< K > keys;
+    std::vector< V > values;
+    for (uint32_t i{0}; i < num_entries; i += 3) {
+        keys.emplace_back(i);
+        values.push_back(V::generate_rand());
+    }
+
+    auto const do_batch_put = [this, &keys, &values](btree_put_type put_type, bool expected_success) {
+        for (size_t start{0}; start < keys.size(); start += batch_size) {
+            auto const end = std::min(start + batch_size, keys.size());
+            std::vector< const BtreeKey* > bkeys;
+            std::vector< const BtreeValue* > bvalues;
+            for (auto i = start; i < end; ++i) {
+                bkeys.push_back(&keys[i]);
+                bvalues.push_back(&values[i]);
+            }
+            BtreeBatchPutRequest< K > req{std::move(bkeys), std::move(bvalues), put_type};
+            ASSERT_EQ(this->m_bt->put(req), btree_status_t::success) << "Batch put failed";
+            ASSERT_EQ(req.num_failed(), expected_success ? 0 : end - start) << "Unexpected failed keys in batch put";
+            if (expected_success) {
+                for (auto i = start; i < end; ++i) {
+                    this->m_shadow_map.put_and_check(keys[i], values[i], values[i], true /* expected_success */);
+                }
+            }
+        }
+    };
+
+    LOGINFO("Step 1: Batch insert every 3rd key upto {}", num_entries);
+    do_batch_put(btree_put_type::INSERT, true);
+    this->get_all();
+    this->query_all_paginate(80);
+
+    LOGINFO("Step 2: Batch insert of the same keys should fail on all of them");
+    do_batch_put(btree_put_type::INSERT, false);
+
+    LOGINFO("Step 3: Insert the keys in between one at a time and then batch remove all the batch inserted keys");
+    for (uint32_t i{1}; i < num_entries; i += 3) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    std::vector< const BtreeKey* > bkeys;
+    for (auto const& k : keys) {
+        bkeys.push_back(&k);
+    }
+    BtreeBatchRemoveRequest< K > rreq{std::move(bkeys)};
+    ASSERT_EQ(this->m_bt->remove(rreq), btree_status_t::success) << "Batch remove failed";
+    ASSERT_EQ(rreq.num_failed(), 0u) << "Batch remove did not find some of the keys";
+    for (auto const& k : keys) {
+        this->m_shadow_map.erase(k);
+    }
+    this->get_all();
+    this->query_all_paginate(80);
+
+    LOGINFO("Step 4: Flush, restart and validate");
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    this->get_all();
+}
+
+TYPED_TEST(BtreeTest, BatchGet) {
+    using K = typename TestFixture::K;
+    using V = typename TestFixture::V;
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Insert every other key upto {}", num_entries);
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+
+    LOGINFO("Step 2: Batch get all the keys in a random order and validate against the shadow map");
+    std::vector< K > keys;
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        keys.emplace_back(i);
+    }
+    std::shuffle(keys.begin(), keys.end(), g_re);
+    std::vector< V > values(keys.size());
+
+    std::vector< const BtreeKey* > bkeys;
+    std::vector< BtreeValue* > bvalues;
+    for (size_t i{0}; i < keys.size(); ++i) {
+        bkeys.push_back(&keys[i]);
+        bvalues.push_back(&values[i]);
+    }
+    BtreeBatchGetRequest< K > req{std::move(bkeys), std::move(bvalues)};
+    ASSERT_EQ(this->m_bt->get(req), btree_status_t::success) << "Batch get failed";
+    ASSERT_EQ(req.num_failed(), num_entries / 2) << "Unexpected number of keys not found in batch get";
+    for (size_t i{0}; i < keys.size(); ++i) {
+        ASSERT_EQ(req.is_found(i), this->m_shadow_map.exists(keys[i])) << "Batch get mismatch for key=" << keys[i];
+        if (req.is_found(i)) { this->m_shadow_map.validate_data(keys[i], values[i]); }
+    }
+}
+
 TYPED_TEST(BtreeTest, RangeUpdate) {
     LOGINFO("RangeUpdate test start");
     // Forward sequential insert
@@ -309,6 +774,46 @@ TYPED_TEST(BtreeTest, CpFlush) {
     LOGINFO("CpFlush test end");
 }
 
+TYPED_TEST(BtreeTest, DeltaCpFlush) {
+    LOGINFO("DeltaCpFlush test start");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.btree.index_delta_max_pct = 50;
+        HS_SETTINGS_FACTORY().save();
+    });
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Do forward sequential insert for {} entries and flush them in full", num_entries);
+    for (uint32_t i = 0; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Update a few entries across the leaves over multiple cps, so they are persisted as deltas");
+    for (uint32_t iter = 0; iter < 3; ++iter) {
+        for (uint32_t i = iter; i < num_entries; i += 100) {
+            this->put(i, btree_put_type::UPDATE);
+        }
+        test_common::HSTestHelper::trigger_cp(true /* wait */);
+    }
+    this->do_query(0, num_entries - 1, 75);
+    this->print(std::string("delta_before.txt"));
+
+    LOGINFO("Step 3: Restart homestore and validate the nodes are read with their deltas");
+    this->restart_homestore();
+    std::this_thread::sleep_for(std::chrono::seconds{1});
+    this->print(std::string("delta_after.txt"));
+    this->do_query(0, num_entries - 1, 1000);
+    this->compare_files("delta_before.txt", "delta_after.txt");
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.btree.index_delta_max_pct = 0;
+        HS_SETTINGS_FACTORY().save();
+    });
+    LOGINFO("DeltaCpFlush test end");
+}
+
 TYPED_TEST(BtreeTest, MultipleCpFlush) {
     LOGINFO("MultipleCpFlush test start");
 
@@ -419,6 +924,68 @@ TYPED_TEST(BtreeTest, ThreadedCpFlush) {
     LOGINFO("ThreadedCpFlush test end");
 }
 
+#ifdef _PRERELEASE
+TYPED_TEST(BtreeTest, RepairAfterCrashedSplit) {
+    // Crash stops the writes, homestore is restarted by the test once the cp has hit it
+    std::mutex crash_mtx;
+    std::condition_variable crash_cv;
+    bool crashed{false};
+    this->m_token.cb() = [&]() {
+        hs()->with_crash_simulator([&]() {
+            std::unique_lock lg{crash_mtx};
+            crashed = true;
+            crash_cv.notify_all();
+        });
+    };
+    this->restart_homestore();
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    uint32_t const part1 = num_entries / 2;
+    LOGINFO("Step 1: Insert [0, {}) and flush them", part1);
+    for (uint32_t i{0}; i < part1; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+
+    LOGINFO("Step 2: Insert [{}, {}) and crash the cp while it flushes the parent of a split", part1, num_entries);
+    this->set_flip_point("crash_flush_on_split_at_parent");
+    for (uint32_t i{part1}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    test_common::HSTestHelper::trigger_cp(false /* wait */);
+    {
+        std::unique_lock lg{crash_mtx};
+        if (!crash_cv.wait_for(lg, std::chrono::seconds{60}, [&crashed]() { return crashed; })) {
+            LOGWARN("No split was flushed by the cp within 60 secs, crashing now");
+            lg.unlock();
+            hs()->crash_simulator().crash();
+        }
+    }
+    this->reset_flip_point("crash_flush_on_split_at_parent");
+
+    // Part of the crashed cp could be on the disk, so only the entries flushed before it are validated
+    LOGINFO("Step 3: Restart and read the entries flushed before the crash, while the nodes are repaired");
+    this->m_token.cb() = nullptr;
+    this->restart_homestore();
+    LOGINFO("Recovery left {} nodes to be repaired", this->m_bt->num_pending_repairs());
+    this->m_shadow_map.range_erase(typename TestFixture::K{part1}, typename TestFixture::K{num_entries - 1});
+    this->get_all();
+    this->do_query(0, part1 - 1, 75);
+
+    for (uint32_t i{0}; (this->m_bt->num_pending_repairs() != 0) && (i < 600); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds{100});
+    }
+    ASSERT_EQ(this->m_bt->num_pending_repairs(), 0u) << "Nodes are not repaired by the background repair";
+
+    LOGINFO("Step 4: Flush the repairs, restart and validate again");
+    test_common::HSTestHelper::trigger_cp(true /* wait */);
+    this->restart_homestore();
+    ASSERT_EQ(this->m_bt->num_pending_repairs(), 0u) << "Repairs are not persisted by the cp";
+    this->get_all();
+    this->do_query(0, part1 - 1, 75);
+}
+#endif
+
 template < typename TestType >
 
 struct BtreeConcurrentTest : public BtreeTestHelper< TestType >, public ::testing::Test {
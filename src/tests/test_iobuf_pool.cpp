@@ -0,0 +1,182 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/homestore_decl.hpp>
+#include "common/iobuf_pool.hpp"
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+using namespace homestore;
+
+struct IOBufPoolTest : public ::testing::Test {
+protected:
+    static constexpr uint32_t max_slabs{8};
+
+    void SetUp() override { m_pool = std::make_unique< IOBufPool >(max_slabs, false /* huge_pages */, 16); }
+    void TearDown() override { m_pool.reset(); }
+
+    std::unique_ptr< IOBufPool > m_pool;
+};
+
+TEST_F(IOBufPoolTest, SizeClasses) {
+    std::set< uint8_t* > bufs;
+    for (size_t size{512}; size <= IOBufPool::max_class_size; size *= 2) {
+        auto* buf = m_pool->alloc(size, 512);
+        ASSERT_NE(buf, nullptr) << "size=" << size;
+        ASSERT_EQ(r_cast< uintptr_t >(buf) % std::max(size, IOBufPool::min_class_size), 0u) << "size=" << size;
+        ASSERT_TRUE(m_pool->is_pooled(buf));
+        ASSERT_TRUE(bufs.insert(buf).second);
+    }
+
+    LOGINFO("Sizes beyond the largest class and alignments beyond the class size are not served");
+    ASSERT_EQ(m_pool->alloc(IOBufPool::max_class_size + 1, 512), nullptr);
+    ASSERT_EQ(m_pool->alloc(4096, 8192), nullptr);
+    ASSERT_EQ(m_pool->alloc(4096, 3000), nullptr);
+
+    for (auto* buf : bufs) {
+        ASSERT_TRUE(m_pool->free(buf));
+    }
+
+    LOGINFO("Buffers not from the pool are left to the caller");
+    auto* other = r_cast< uint8_t* >(std::aligned_alloc(4096, 4096));
+    ASSERT_FALSE(m_pool->is_pooled(other));
+    ASSERT_FALSE(m_pool->free(other));
+    std::free(other);
+}
+
+TEST_F(IOBufPoolTest, ReuseAndCap) {
+    LOGINFO("Freed buffers are reused before a new slab is allocated");
+    auto* buf = m_pool->alloc(8192, 4096);
+    ASSERT_NE(buf, nullptr);
+    ASSERT_TRUE(m_pool->free(buf));
+    ASSERT_EQ(m_pool->alloc(8192, 4096), buf);
+    ASSERT_TRUE(m_pool->free(buf));
+    ASSERT_EQ(m_pool->num_slabs(), 1u);
+
+    LOGINFO("Pool serves upto its max slabs, beyond which allocs are left to the caller");
+    std::vector< uint8_t* > bufs;
+    while (auto* b = m_pool->alloc(IOBufPool::max_class_size, 4096)) {
+        bufs.push_back(b);
+    }
+    ASSERT_EQ(m_pool->num_slabs(), max_slabs);
+    ASSERT_EQ(bufs.size(), (max_slabs - 1) * (IOBufPool::slab_size / IOBufPool::max_class_size));
+
+    std::vector< uint8_t* > slabs;
+    m_pool->set_slab_cb([&slabs](uint8_t* slab, uint64_t size) {
+        ASSERT_EQ(size, IOBufPool::slab_size);
+        slabs.push_back(slab);
+    });
+    ASSERT_EQ(slabs.size(), max_slabs);
+    m_pool->set_slab_cb(nullptr);
+
+    for (auto* b : bufs) {
+        ASSERT_TRUE(m_pool->free(b));
+    }
+}
+
+TEST_F(IOBufPoolTest, ReleaseIdleSlabs) {
+    std::vector< uint8_t* > released;
+    m_pool->set_slab_cb([](uint8_t*, uint64_t) {},
+                        [&released](uint8_t* slab, uint64_t) { released.push_back(slab); });
+
+    LOGINFO("Allocate all the slabs and free the buffers, the first check only notes what stayed free since");
+    std::vector< uint8_t* > bufs;
+    while (auto* b = m_pool->alloc(IOBufPool::max_class_size, 4096)) {
+        bufs.push_back(b);
+    }
+    ASSERT_EQ(m_pool->num_slabs(), max_slabs);
+    for (auto* b : bufs) {
+        ASSERT_TRUE(m_pool->free(b));
+    }
+    bufs.clear();
+    ASSERT_EQ(m_pool->release_idle_slabs(0), 0u) << "Buffers were all in use during the last period";
+
+    LOGINFO("Slabs with all their buffers free are released, the one with the buffers cached by the thread is kept");
+    auto const nreleased = m_pool->release_idle_slabs(0);
+    ASSERT_GT(nreleased, 0u);
+    ASSERT_EQ(released.size(), nreleased);
+    ASSERT_EQ(m_pool->num_slabs(), max_slabs - nreleased);
+    for (auto* slab : released) {
+        ASSERT_FALSE(m_pool->is_pooled(slab)) << "Released slab is still looked up as of the pool";
+    }
+
+    LOGINFO("Check is not done again before the idle period");
+    ASSERT_EQ(m_pool->release_idle_slabs(60 * 1000), 0u);
+
+    LOGINFO("Pool grows back upto its max slabs as needed");
+    while (auto* b = m_pool->alloc(IOBufPool::max_class_size, 4096)) {
+        ASSERT_TRUE(m_pool->is_pooled(b));
+        bufs.push_back(b);
+    }
+    ASSERT_EQ(m_pool->num_slabs(), max_slabs);
+    for (auto* b : bufs) {
+        ASSERT_TRUE(m_pool->free(b));
+    }
+    m_pool->set_slab_cb(nullptr);
+}
+
+TEST_F(IOBufPoolTest, ConcurrentAllocFree) {
+    static constexpr uint32_t nthreads{8};
+    std::vector< std::thread > threads;
+    for (uint32_t t{0}; t < nthreads; ++t) {
+        threads.emplace_back([this, t]() {
+            std::mt19937 re{t};
+            std::uniform_int_distribution< size_t > size_dist{1, IOBufPool::max_class_size};
+            std::vector< std::pair< uint8_t*, size_t > > bufs;
+            for (uint32_t iter{0}; iter < 1000; ++iter) {
+                for (uint32_t i{0}; i < 16; ++i) {
+                    auto const size = size_dist(re);
+                    auto* buf = m_pool->alloc(size, 4096);
+                    if (buf == nullptr) { continue; }
+                    std::memset(buf, s_cast< int >(t), size);
+                    bufs.emplace_back(buf, size);
+                }
+                for (auto const& [buf, size] : bufs) {
+                    // No other thread was handed the buffer meanwhile
+                    ASSERT_EQ(buf[0], s_cast< uint8_t >(t));
+                    ASSERT_EQ(buf[size - 1], s_cast< uint8_t >(t));
+                    ASSERT_TRUE(m_pool->free(buf));
+                }
+                bufs.clear();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+    ASSERT_LE(m_pool->num_slabs(), max_slabs);
+}
+
+SISL_OPTIONS_ENABLE(logging)
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    SISL_OPTIONS_LOAD(argc, argv, logging)
+    sisl::logging::SetLogger("test_iobuf_pool");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+    return RUN_ALL_TESTS();
+}
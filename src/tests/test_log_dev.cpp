@@ -14,6 +14,7 @@
  *
  *********************************************************************************/
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
@@ -23,8 +24,10 @@
 #include <memory>
 #include <mutex>
 #include <random>
+#include <thread>
 #include <vector>
 
+#include <folly/ScopeGuard.h>
 #include <gtest/gtest.h>
 #include <iomgr/io_environment.hpp>
 #include <sisl/logging/logging.h>
@@ -35,6 +38,8 @@
 #include <homestore/logstore_service.hpp>
 #include "common/homestore_utils.hpp"
 #include "common/homestore_assert.hpp"
+#include "common/homestore_config.hpp"
+#include "common/resource_mgr.hpp"
 #include "logstore/log_dev.hpp"
 #include "test_common/homestore_test_common.hpp"
 
@@ -274,11 +279,808 @@ TEST_F(LogDevTest, WriteSyncThenRead) {
             read_verify(log_store, i);
         }
 
+        // Every sync write is a group of its own
+        auto const js = logstore_service().get_logdev(logdev_id)->get_status(0);
+        ASSERT_TRUE(js.contains("group_commit"));
+        ASSERT_GE(js["group_commit"]["groups_flushed"].get< uint64_t >(), count);
+        ASSERT_GE(js["group_commit"]["avg_records_per_group"].get< uint64_t >(), 1);
+
         logstore_service().remove_log_store(logdev_id, store_id);
         LOGINFO("Remove logstore -> i {}", store_id);
     }
 }
 
+TEST_F(LogDevTest, SyncWriteFastPath) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.sync_write_fast_path = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, true /* append_mode */);
+
+    // Idle logdev, each of them is flushed inline in this thread
+    const logstore_seq_num_t nseq{50};
+    for (logstore_seq_num_t lsn{0}; lsn < nseq; ++lsn) {
+        bool io_memory{false};
+        auto* d = prepare_data(lsn, io_memory);
+        ASSERT_EQ(log_store->append_sync({uintptr_cast(d), d->total_size(), false}), lsn);
+        ASSERT_EQ(log_store->get_contiguous_completed_seq_num(-1), lsn) << "append_sync returned before completion";
+        if (io_memory) {
+            iomanager.iobuf_free(uintptr_cast(d));
+        } else {
+            std::free(voidptr_cast(d));
+        }
+    }
+
+    // Concurrent ones find the logdev busy at times and take the regular path instead
+    const logstore_seq_num_t nthreads{4};
+    const logstore_seq_num_t nper_thread{50};
+    std::vector< std::thread > writers;
+    for (logstore_seq_num_t t{0}; t < nthreads; ++t) {
+        writers.emplace_back([this, &log_store, t, nseq, nthreads, nper_thread]() {
+            for (logstore_seq_num_t i{0}; i < nper_thread; ++i) {
+                insert_sync(log_store, nseq + (i * nthreads) + t);
+            }
+        });
+    }
+    for (auto& w : writers) {
+        w.join();
+    }
+
+    const logstore_seq_num_t count = nseq + (nthreads * nper_thread);
+    ASSERT_EQ(log_store->get_contiguous_completed_seq_num(-1), count - 1);
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.sync_write_fast_path = false; });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Restart homestore and validate the records written by the fast path are recovered");
+    auto const store_id = log_store->get_store_id();
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, true /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+}
+
+TEST_F(LogDevTest, DumpJournal) {
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const logstore_seq_num_t count{100};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        insert_sync(log_store, lsn);
+    }
+
+    auto js = logstore_service().dump_journal(logdev_id, log_dump_req{log_dump_verbosity::CONTENT});
+    LOGINFO("Journal scan of {} groups ended with: {}", js["groups"].size(), js["scan_end"].get< std::string >());
+    logstore_seq_num_t expected{0};
+    for (auto const& g : js["groups"]) {
+        for (auto const& r : g["records"]) {
+            ASSERT_EQ(r["store_id"].get< logstore_id_t >(), log_store->get_store_id());
+            ASSERT_EQ(r["store_seq_num"].get< logstore_seq_num_t >(), expected);
+            auto const& content = r["content"].get_binary();
+            ASSERT_EQ(content.size(), r["size"].get< uint32_t >());
+            validate_data(log_store, r_cast< const test_log_data* >(content.data()), expected);
+            ++expected;
+        }
+    }
+    ASSERT_EQ(expected, count) << "Journal scan didn't find all the records";
+
+    // Bounded by the number of groups and filtered by the seq num range
+    js = logstore_service().dump_journal(logdev_id, log_dump_req{log_dump_verbosity::HEADER, nullptr, 10, 19}, 5);
+    ASSERT_EQ(js["groups"].size(), 5);
+    ASSERT_EQ(js["scan_end"].get< std::string >(), "reached max groups");
+    for (auto const& g : js["groups"]) {
+        for (auto const& r : g["records"]) {
+            ASSERT_FALSE(r.contains("content"));
+        }
+    }
+
+    // Scan doesn't disturb the regular reads
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+}
+
+TEST_F(LogDevTest, GroupIndexSeek) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.group_index_interval = 4; });
+    HS_SETTINGS_FACTORY().save();
+
+    auto logdev_id = logstore_service().create_new_logdev();
+    auto logdev = logstore_service().get_logdev(logdev_id);
+    s_max_flush_multiple = logdev->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const logstore_seq_num_t count{100};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        insert_sync(log_store, lsn);
+    }
+    ASSERT_GT(logdev->get_status(0)["group_index_entries"].get< uint64_t >(), 1);
+
+    // Every log idx is found in the group of the journal scan which holds it
+    const auto validate_seek = [&](logid_t from_idx) {
+        auto const js = logstore_service().dump_journal(logdev_id, log_dump_req{log_dump_verbosity::HEADER});
+        for (auto const& g : js["groups"]) {
+            auto const start_idx = g["start_log_idx"].get< logid_t >();
+            for (logid_t idx{start_idx}; idx < start_idx + g["nrecords"].get< logid_t >(); ++idx) {
+                if (idx < from_idx) { continue; }
+                ASSERT_EQ(logdev->group_offset_of(idx), g["dev_offset"].get< off_t >()) << "log_idx=" << idx;
+            }
+        }
+    };
+    validate_seek(0);
+    ASSERT_EQ(logdev->group_offset_of(count + 10), INVALID_OFFSET);
+
+    auto js = logstore_service().dump_journal(logdev_id, log_dump_req{log_dump_verbosity::HEADER}, 1, 50);
+    ASSERT_EQ(js["groups"].size(), 1);
+    ASSERT_EQ(js["groups"][0]["dev_offset"].get< off_t >(), logdev->group_offset_of(50));
+
+    // Truncated groups are dropped from the index, which is persisted along with the truncation
+    log_store->truncate(49);
+    logstore_service().device_truncate(nullptr /* cb */, true /* wait_till_done */);
+    ASSERT_EQ(logdev->group_offset_of(10), INVALID_OFFSET);
+    validate_seek(50);
+
+    LOGINFO("Restart homestore and validate the seek after the index is loaded back");
+    auto const store_id = log_store->get_store_id();
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    logdev = logstore_service().get_logdev(logdev_id);
+    validate_seek(50);
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.group_index_interval = 64; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(LogDevTest, PipelinedFlushCompletesInOrder) {
+    // Most appends are worth a flush, so that as many groups as allowed are in flight. Timer flushes what is left.
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.max_inflight_log_groups = 8;
+        s.logstore.flush_threshold_size = 512;
+        s.logstore.flush_timer_frequency_us = 500;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+
+    const logstore_seq_num_t count{500};
+    std::atomic< logstore_seq_num_t > next_expected{0};
+    std::atomic< int64_t > last_log_idx{-1};
+    std::mutex mtx;
+    std::condition_variable cv;
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        bool io_memory{false};
+        auto* d = prepare_data(lsn, io_memory);
+        log_store->write_async(
+            lsn, {uintptr_cast(d), d->total_size(), false}, nullptr,
+            [&, io_memory](logstore_seq_num_t seq_num, sisl::io_blob& b, logdev_key ld_key, void*) {
+                ASSERT_EQ(seq_num, next_expected.load()) << "Writes completed out of order";
+                ASSERT_GT(ld_key.idx, last_log_idx.load()) << "Log idx completed out of order";
+                last_log_idx = ld_key.idx;
+                if (io_memory) {
+                    iomanager.iobuf_free(b.bytes());
+                } else {
+                    std::free(voidptr_cast(b.bytes()));
+                }
+                if (++next_expected == count) {
+                    std::unique_lock lock(mtx);
+                    cv.notify_one();
+                }
+            });
+    }
+
+    {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [&] { return next_expected.load() == count; });
+    }
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.logstore.max_inflight_log_groups = 4;
+        s.logstore.flush_threshold_size = 64;
+        s.logstore.flush_timer_frequency_us = 0;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Restart homestore and validate the pipelined log groups are recovered in full");
+    auto const store_id = log_store->get_store_id();
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+}
+
+TEST_F(LogDevTest, InPlaceSerializedRecords) {
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+
+    // Every other record is serialized in place and the rest are copied. Some of them are bigger than the log group
+    // buffer, so that inline area of a group spans its overflow buffers.
+    const logstore_seq_num_t count{200};
+    std::atomic< logstore_seq_num_t > ncompleted{0};
+    std::mutex mtx;
+    std::condition_variable cv;
+    auto const on_done = [&]() {
+        if (++ncompleted == count) {
+            std::unique_lock lock(mtx);
+            cv.notify_one();
+        }
+    };
+
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        uint32_t const sz = (lsn % 7 == 0) ? (3 * LogGroup::inline_log_buf_size + 1 + lsn) : (100 + lsn);
+        if (lsn % 2 == 0) {
+            log_store->write_async(
+                lsn, sizeof(test_log_data) + sz,
+                [lsn, sz](uint8_t* buf, uint32_t size) {
+                    ASSERT_EQ(size, sizeof(test_log_data) + sz);
+                    auto* d = new (buf) test_log_data();
+                    d->size = sz;
+                    std::memset(voidptr_cast(d->get_data()), static_cast< char >((lsn % 94) + 33), sz);
+                },
+                nullptr, [&](logstore_seq_num_t, sisl::io_blob&, logdev_key, void*) { on_done(); });
+        } else {
+            bool io_memory{false};
+            auto* d = prepare_data(lsn, io_memory, sz);
+            log_store->write_async(
+                lsn, {uintptr_cast(d), d->total_size(), false}, nullptr,
+                [&, io_memory](logstore_seq_num_t, sisl::io_blob& b, logdev_key, void*) {
+                    if (io_memory) {
+                        iomanager.iobuf_free(b.bytes());
+                    } else {
+                        std::free(voidptr_cast(b.bytes()));
+                    }
+                    on_done();
+                });
+        }
+    }
+    log_store->flush_sync(count - 1);
+
+    {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [&] { return ncompleted.load() == count; });
+    }
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+
+    LOGINFO("Restart homestore and validate the records are recovered");
+    auto const store_id = log_store->get_store_id();
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+}
+
+TEST_F(LogDevTest, ReadRange) {
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const auto store_id = log_store->get_store_id();
+
+    const logstore_seq_num_t count{300};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        insert_sync(log_store, lsn, (lsn % 11 == 0) ? 3 * LogGroup::inline_log_buf_size : 0);
+    }
+
+    // Restart so that the range is read from the device and not from the tail cache
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+
+    auto const verify_range = [&](logstore_seq_num_t start, logstore_seq_num_t end, size_t expected_count) {
+        auto const bufs = log_store->read_range_async(start, end).get();
+        ASSERT_EQ(bufs.size(), expected_count) << "Range [" << start << "-" << end << ") count mismatch";
+        for (size_t i{0}; i < bufs.size(); ++i) {
+            auto* d = r_cast< test_log_data const* >(bufs[i].bytes());
+            ASSERT_EQ(d->total_size(), bufs[i].size()) << "Size Mismatch for lsn=" << start + i;
+            validate_data(log_store, d, start + i);
+        }
+    };
+    verify_range(0, count, count);
+    verify_range(17, 18, 1);
+    verify_range(100, 250, 150);
+    LOGINFO("Range beyond the last written lsn is cut short");
+    verify_range(200, count + 50, count - 200);
+
+    log_store->truncate(99);
+    ASSERT_THROW(log_store->read_range_async(50, 150), std::out_of_range);
+    logstore_service().remove_log_store(logdev_id, store_id);
+}
+
+TEST_F(LogDevTest, PartitionedReplay) {
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const auto store_id = log_store->get_store_id();
+
+    const logstore_seq_num_t count{500};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        insert_sync(log_store, lsn);
+    }
+
+    static constexpr uint64_t nparts{7};
+    auto const partition_of = [](logstore_seq_num_t seq_num, const log_buffer&) -> uint64_t {
+        return uint64_cast(seq_num) % nparts;
+    };
+    // Each partition is called back by a single worker, so its list is not touched concurrently
+    std::vector< std::vector< logstore_seq_num_t > > found(nparts);
+    std::atomic< logstore_seq_num_t > nfound{0};
+    logstore_seq_num_t nfound_at_done{-1};
+
+    LOGINFO("Restart homestore and replay the records of each partition on the workers");
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            store->register_log_found_cb(
+                [&](logstore_seq_num_t seq_num, log_buffer buf, void*) {
+                    auto* d = r_cast< test_log_data const* >(buf.bytes());
+                    EXPECT_EQ(d->total_size(), buf.size()) << "Size Mismatch for lsn=" << seq_num;
+                    found[uint64_cast(seq_num) % nparts].push_back(seq_num);
+                    ++nfound;
+                },
+                partition_of);
+            store->register_log_replay_done_cb(
+                [&](shared< HomeLogStore >, logstore_seq_num_t) { nfound_at_done = nfound.load(); });
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+
+    auto const verify_found = [&]() {
+        for (uint64_t part{0}; part < nparts; ++part) {
+            ASSERT_EQ(found[part].size(), (count - part + nparts - 1) / nparts) << "Partition " << part;
+            for (size_t i{0}; i < found[part].size(); ++i) {
+                ASSERT_EQ(found[part][i], s_cast< logstore_seq_num_t >(part + i * nparts)) << "Out of order";
+            }
+        }
+    };
+    ASSERT_EQ(nfound_at_done, count) << "Replay done before all the records are called back";
+    verify_found();
+
+    LOGINFO("Iterate the records of each partition on the workers");
+    for (auto& f : found) {
+        f.clear();
+    }
+    log_store->foreach_partitioned(0, partition_of, [&](logstore_seq_num_t seq_num, log_buffer buf) {
+        validate_data(log_store, r_cast< test_log_data const* >(buf.bytes()), seq_num);
+        found[uint64_cast(seq_num) % nparts].push_back(seq_num);
+    });
+    verify_found();
+    logstore_service().remove_log_store(logdev_id, store_id);
+}
+
+TEST_F(LogDevTest, CompressedLogGroups) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.compress_log_group = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const auto store_id = log_store->get_store_id();
+
+    // Records are written without waiting for each other, so that there are many of them in a group to compress
+    const logstore_seq_num_t count{500};
+    std::atomic< logstore_seq_num_t > ncompleted{0};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        bool io_memory{false};
+        auto* d = prepare_data(lsn, io_memory);
+        log_store->write_async(lsn, {uintptr_cast(d), d->total_size(), false}, nullptr,
+                               [&, io_memory](logstore_seq_num_t, sisl::io_blob& b, logdev_key, void*) {
+                                   if (io_memory) {
+                                       iomanager.iobuf_free(b.bytes());
+                                   } else {
+                                       std::free(voidptr_cast(b.bytes()));
+                                   }
+                                   ++ncompleted;
+                               });
+    }
+    log_store->flush_sync(count - 1);
+    while (ncompleted.load() != count) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    LOGINFO("Restart homestore and validate the records are recovered and read from compressed groups");
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+    auto const bufs = log_store->read_range_async(0, count).get();
+    ASSERT_EQ(bufs.size(), s_cast< size_t >(count));
+    for (size_t i{0}; i < bufs.size(); ++i) {
+        validate_data(log_store, r_cast< test_log_data const* >(bufs[i].bytes()), i);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.compress_log_group = false; });
+    HS_SETTINGS_FACTORY().save();
+    logstore_service().remove_log_store(logdev_id, store_id);
+}
+
+#ifdef _PRERELEASE
+TEST_F(LogDevTest, ReplayV0LogGroups) {
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    const auto store_id = log_store->get_store_id();
+
+    LOGINFO("Write the first half of the records in groups with version 0 header, rest with the current one");
+    flip::FlipClient* fc = iomgr_flip::client_instance();
+    flip::FlipFrequency freq;
+    freq.set_count(2000000);
+    freq.set_percent(100);
+    fc->inject_noreturn_flip("logdev_write_v0_group_header", {}, freq);
+
+    const logstore_seq_num_t count{200};
+    logstore_seq_num_t lsn{0};
+    kickstart_inserts(log_store, lsn, count / 2);
+    fc->remove_flip("logdev_write_v0_group_header");
+    kickstart_inserts(log_store, lsn, count / 2);
+
+    auto js = logstore_service().dump_journal(logdev_id, log_dump_req{log_dump_verbosity::HEADER});
+    uint32_t nv0_groups{0};
+    for (auto const& g : js["groups"]) {
+        if (g["version"].get< uint32_t >() == 0) { ++nv0_groups; }
+    }
+    ASSERT_GT(nv0_groups, 0u) << "No group was written with version 0 header";
+    ASSERT_LT(nv0_groups, js["groups"].size()) << "No group was written with the current header";
+
+    LOGINFO("Restart homestore and validate all the records are replayed and read back");
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        logstore_service().open_logdev(logdev_id);
+        logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+            log_store = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+
+    ASSERT_EQ(log_store->get_contiguous_completed_seq_num(-1), count - 1);
+    for (lsn = 0; lsn < count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+    auto const bufs = log_store->read_range_async(0, count).get();
+    ASSERT_EQ(bufs.size(), s_cast< size_t >(count));
+    for (size_t i{0}; i < bufs.size(); ++i) {
+        validate_data(log_store, r_cast< test_log_data const* >(bufs[i].bytes()), i);
+    }
+    logstore_service().remove_log_store(logdev_id, store_id);
+}
+#endif
+
+TEST_F(LogDevTest, StripedLogStore) {
+    std::vector< logdev_id_t > logdev_ids;
+    for (uint32_t i{0}; i < 3; ++i) {
+        logdev_ids.push_back(logstore_service().create_new_logdev());
+    }
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_ids[0])->get_flush_size_multiple();
+    auto striped = logstore_service().create_new_striped_log_store(logdev_ids, true /* append_mode */);
+    ASSERT_EQ(striped->num_stripes(), 3u);
+
+    const logstore_seq_num_t count{100};
+    std::atomic< logstore_seq_num_t > ncompleted{0};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        bool io_memory{false};
+        auto* d = prepare_data(lsn, io_memory);
+        auto const seq_num = striped->append_async(
+            {uintptr_cast(d), d->total_size(), false}, nullptr,
+            [&, io_memory](logstore_seq_num_t, sisl::io_blob& b, logdev_key, void*) {
+                if (io_memory) {
+                    iomanager.iobuf_free(b.bytes());
+                } else {
+                    std::free(voidptr_cast(b.bytes()));
+                }
+                ++ncompleted;
+            });
+        ASSERT_EQ(seq_num, lsn);
+    }
+    striped->flush_sync();
+    while (ncompleted.load() != count) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(striped->get_contiguous_completed_seq_num(-1), count - 1);
+
+    auto const verify = [&](shared< StripedLogStore > const& store) {
+        for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+            auto b = store->read_sync(lsn);
+            auto* d = r_cast< test_log_data const* >(b.bytes());
+            ASSERT_EQ(d->total_size(), b.size()) << "Size Mismatch for lsn=" << lsn;
+            validate_data(store->stripes()[lsn % store->num_stripes()], d, lsn);
+        }
+    };
+    verify(striped);
+
+    LOGINFO("Restart homestore and validate the stripes are replayed in the order of seq num");
+    auto const stripe_ids = striped->stripe_ids();
+    striped.reset();
+    logstore_seq_num_t next_found{0};
+    logstore_seq_num_t replayed_upto{-1};
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        for (auto const& id : logdev_ids) {
+            logstore_service().open_logdev(id);
+        }
+        logstore_service().open_striped_log_store(stripe_ids, true /* append_mode */).thenValue([&](auto store) {
+            store->register_log_found_cb([&](logstore_seq_num_t seq_num, log_buffer, void*) {
+                EXPECT_EQ(seq_num, next_found) << "Replayed out of order";
+                ++next_found;
+            });
+            store->register_log_replay_done_cb([&](logstore_seq_num_t last) { replayed_upto = last; });
+            striped = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    ASSERT_EQ(next_found, count);
+    ASSERT_EQ(replayed_upto, count - 1);
+    ASSERT_EQ(striped->seq_num(), count);
+    verify(striped);
+
+    logstore_service().remove_striped_log_store(stripe_ids);
+}
+
+TEST_F(LogDevTest, StripedLogStoreReplayStopsAtHole) {
+    std::vector< logdev_id_t > logdev_ids;
+    for (uint32_t i{0}; i < 3; ++i) {
+        logdev_ids.push_back(logstore_service().create_new_logdev());
+    }
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_ids[0])->get_flush_size_multiple();
+    auto striped = logstore_service().create_new_striped_log_store(logdev_ids, false /* append_mode */);
+
+    // A seq num of one stripe not made it to the log, while the later ones did on the other stripes
+    const logstore_seq_num_t count{10};
+    const logstore_seq_num_t hole{7};
+    std::atomic< logstore_seq_num_t > ncompleted{0};
+    auto const write = [&](logstore_seq_num_t lsn) {
+        bool io_memory{false};
+        auto* d = prepare_data(lsn, io_memory);
+        striped->write_async(lsn, {uintptr_cast(d), d->total_size(), false}, nullptr,
+                             [&, io_memory](logstore_seq_num_t, sisl::io_blob& b, logdev_key, void*) {
+                                 if (io_memory) {
+                                     iomanager.iobuf_free(b.bytes());
+                                 } else {
+                                     std::free(voidptr_cast(b.bytes()));
+                                 }
+                                 ++ncompleted;
+                             });
+    };
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        if (lsn != hole) { write(lsn); }
+    }
+    striped->flush_sync();
+    while (ncompleted.load() != count - 1) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    LOGINFO("Restart homestore and validate the replay stops at the hole");
+    auto const stripe_ids = striped->stripe_ids();
+    striped.reset();
+    logstore_seq_num_t next_found{0};
+    logstore_seq_num_t replayed_upto{-1};
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        for (auto const& id : logdev_ids) {
+            logstore_service().open_logdev(id);
+        }
+        logstore_service().open_striped_log_store(stripe_ids, false /* append_mode */).thenValue([&](auto store) {
+            store->register_log_found_cb([&](logstore_seq_num_t seq_num, log_buffer, void*) {
+                EXPECT_EQ(seq_num, next_found) << "Replayed out of order";
+                ++next_found;
+            });
+            store->register_log_replay_done_cb([&](logstore_seq_num_t last) { replayed_upto = last; });
+            striped = store;
+            p.set_value(true);
+        });
+    });
+    p.get_future().get();
+    ASSERT_EQ(next_found, hole) << "Records after the hole are not expected to be replayed";
+    ASSERT_EQ(replayed_upto, hole - 1);
+    ASSERT_EQ(striped->seq_num(), hole);
+
+    LOGINFO("Records after the hole were rolled back, so the seq nums from the hole on can be written again");
+    ncompleted = 0;
+    for (logstore_seq_num_t lsn{hole}; lsn < count; ++lsn) {
+        write(lsn);
+    }
+    striped->flush_sync();
+    while (ncompleted.load() != count - hole) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    ASSERT_EQ(striped->get_contiguous_completed_seq_num(-1), count - 1);
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        auto b = striped->read_sync(lsn);
+        auto* d = r_cast< test_log_data const* >(b.bytes());
+        ASSERT_EQ(d->total_size(), b.size()) << "Size Mismatch for lsn=" << lsn;
+        validate_data(striped->stripes()[lsn % striped->num_stripes()], d, lsn);
+    }
+
+    logstore_service().remove_striped_log_store(stripe_ids);
+}
+
+TEST_F(LogDevTest, SharedLogStores) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.shared_logdev_pool_size = 2; });
+    HS_SETTINGS_FACTORY().save();
+
+    const uint32_t nstores{6};
+    std::vector< shared< HomeLogStore > > stores;
+    std::map< logdev_id_t, uint32_t > stores_per_logdev;
+    for (uint32_t i{0}; i < nstores; ++i) {
+        stores.push_back(logstore_service().create_new_shared_log_store(false /* append_mode */));
+        ++stores_per_logdev[stores.back()->get_logdev()->get_id()];
+    }
+    s_max_flush_multiple = stores[0]->get_logdev()->get_flush_size_multiple();
+    auto const shared_ids = logstore_service().shared_logdevs();
+    ASSERT_EQ(shared_ids.size(), 2u);
+    ASSERT_EQ(stores_per_logdev.size(), 2u);
+    for (auto const& [logdev_id, n] : stores_per_logdev) {
+        ASSERT_EQ(n, nstores / 2) << "Log stores are not spread evenly across shared logdevs";
+    }
+
+    const logstore_seq_num_t count{20};
+    for (auto& store : stores) {
+        for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+            insert_sync(store, lsn);
+        }
+    }
+
+    LOGINFO("Restart homestore and validate the shared logdevs are opened by the service itself");
+    std::vector< std::pair< logdev_id_t, logstore_id_t > > ids;
+    for (auto& store : stores) {
+        ids.emplace_back(store->get_logdev()->get_id(), store->get_store_id());
+    }
+    stores.clear();
+    std::mutex stores_mtx;
+    std::promise< bool > p;
+    start_homestore(true /* restart */, [&]() {
+        std::vector< folly::Future< folly::Unit > > futs;
+        for (auto const& [logdev_id, store_id] : ids) {
+            futs.emplace_back(logstore_service()
+                                  .open_log_store(logdev_id, store_id, false /* append_mode */)
+                                  .thenValue([&](auto store) {
+                                      std::unique_lock lg{stores_mtx};
+                                      stores.push_back(store);
+                                  }));
+        }
+        folly::collectAllUnsafe(futs).thenValue([&p](auto&&) { p.set_value(true); });
+    });
+    p.get_future().get();
+    ASSERT_EQ(logstore_service().shared_logdevs(), shared_ids);
+
+    for (auto& store : stores) {
+        for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+            read_verify(store, lsn);
+        }
+        logstore_service().remove_log_store(store->get_logdev()->get_id(), store->get_store_id());
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.shared_logdev_pool_size = 8; });
+    HS_SETTINGS_FACTORY().save();
+}
+
+TEST_F(LogDevTest, MemQuota) {
+    auto& rm = hs()->resource_mgr();
+    auto settings_guard = folly::makeGuard([&rm] {
+        rm.unregister_mem_quota_cb(mem_consumer_t::repl_reqs);
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.resource_limits.repl_req_mem_percent = 5; });
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    LOGINFO("Step 1: Index cache quota shrinks as the others use more, down to its min");
+    auto const index_size = rm.get_index_cache_size();
+    auto const min_size = (index_size * HS_DYNAMIC_CONFIG(resource_limits.index_cache_min_pct)) / 100;
+    auto const base_quota = rm.mem_quota(mem_consumer_t::index_cache);
+    ASSERT_GT(base_quota, min_size);
+    auto const taken = (base_quota - min_size) / 2;
+    rm.inc_mem_usage(mem_consumer_t::repl_reqs, taken);
+    ASSERT_EQ(rm.mem_quota(mem_consumer_t::index_cache), base_quota - taken);
+    rm.inc_mem_usage(mem_consumer_t::repl_reqs, index_size);
+    ASSERT_EQ(rm.mem_quota(mem_consumer_t::index_cache), min_size);
+    rm.dec_mem_usage(mem_consumer_t::repl_reqs, index_size + taken);
+    ASSERT_EQ(rm.mem_quota(mem_consumer_t::index_cache), base_quota);
+
+    LOGINFO("Step 2: Consumer is resized upon rebalance only if its quota has changed");
+    std::vector< uint64_t > resized;
+    rm.register_mem_quota_cb(mem_consumer_t::repl_reqs, [&resized](uint64_t quota) { resized.push_back(quota); });
+    rm.rebalance_mem();
+    ASSERT_EQ(resized.size(), 1u);
+    ASSERT_EQ(resized.back(), rm.mem_quota(mem_consumer_t::repl_reqs));
+    rm.rebalance_mem();
+    ASSERT_EQ(resized.size(), 1u) << "Consumer resized though its quota is unchanged";
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.resource_limits.repl_req_mem_percent = 10; });
+    HS_SETTINGS_FACTORY().save();
+    rm.rebalance_mem();
+    ASSERT_EQ(resized.size(), 2u);
+    ASSERT_EQ(resized.back(), rm.mem_quota(mem_consumer_t::repl_reqs));
+    ASSERT_GT(resized[1], resized[0]);
+
+    LOGINFO("Step 3: Log store doesn't cache its tail beyond the quota of the tail caches");
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    auto const tail_quota = rm.mem_quota(mem_consumer_t::log_tail_cache);
+    auto const filler = tail_quota - std::min(rm.mem_usage(mem_consumer_t::log_tail_cache), tail_quota);
+    rm.inc_mem_usage(mem_consumer_t::log_tail_cache, filler);
+    auto const full_usage = rm.mem_usage(mem_consumer_t::log_tail_cache);
+
+    const logstore_seq_num_t count{20};
+    for (logstore_seq_num_t lsn{0}; lsn < count; ++lsn) {
+        insert_sync(log_store, lsn);
+        ASSERT_LE(rm.mem_usage(mem_consumer_t::log_tail_cache), full_usage) << "Tail cache is over its quota";
+    }
+
+    LOGINFO("Step 4: Log store caches its tail again once there is room, and gives it up once truncated");
+    rm.dec_mem_usage(mem_consumer_t::log_tail_cache, filler);
+    auto const free_usage = rm.mem_usage(mem_consumer_t::log_tail_cache);
+    for (logstore_seq_num_t lsn{count}; lsn < 2 * count; ++lsn) {
+        insert_sync(log_store, lsn);
+    }
+    ASSERT_GT(rm.mem_usage(mem_consumer_t::log_tail_cache), free_usage);
+    for (logstore_seq_num_t lsn{0}; lsn < 2 * count; ++lsn) {
+        read_verify(log_store, lsn);
+    }
+
+    log_store->truncate(2 * count - 1);
+    ASSERT_LE(rm.mem_usage(mem_consumer_t::log_tail_cache), free_usage);
+
+    logstore_service().remove_log_store(logdev_id, log_store->get_store_id());
+    log_store.reset();
+    logstore_service().destroy_log_dev(logdev_id);
+}
+
 TEST_F(LogDevTest, Rollback) {
     LOGINFO("Step 1: Create a single logstore to start rollback test");
     auto logdev_id = logstore_service().create_new_logdev();
@@ -343,6 +1145,54 @@ TEST_F(LogDevTest, Rollback) {
     rollback_records_validate(log_store, 0 /* expected_count */);
 }
 
+TEST_F(LogDevTest, RollbackMarker) {
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.rollback_marker_in_log = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    auto logdev_id = logstore_service().create_new_logdev();
+    s_max_flush_multiple = logstore_service().get_logdev(logdev_id)->get_flush_size_multiple();
+    auto log_store = logstore_service().create_new_log_store(logdev_id, false);
+    auto store_id = log_store->get_store_id();
+
+    auto restart = [&]() {
+        std::promise< bool > p;
+        start_homestore(true /* restart */, [&]() {
+            logstore_service().open_logdev(logdev_id);
+            logstore_service().open_log_store(logdev_id, store_id, false /* append_mode */).thenValue([&](auto store) {
+                log_store = store;
+                p.set_value(true);
+            });
+        });
+        p.get_future().get();
+    };
+
+    logstore_seq_num_t cur_lsn = 0;
+    kickstart_inserts(log_store, cur_lsn, 200);
+    rollback_validate(log_store, cur_lsn, 50); // Last entry = 149
+    kickstart_inserts(log_store, cur_lsn, 25); // Last entry = 174
+    rollback_validate(log_store, cur_lsn, 75); // Last entry = 99
+    kickstart_inserts(log_store, cur_lsn, 25); // Last entry = 124
+
+    LOGINFO("Restart homestore without truncation, so that rollbacks are found only from the markers in the journal");
+    restart();
+    ASSERT_EQ(log_store->get_contiguous_completed_seq_num(-1), cur_lsn - 1) << "Rolled back lsns are replayed";
+    read_all_verify(log_store);
+    rollback_records_validate(log_store, 2 /* expected_count */);
+
+    kickstart_inserts(log_store, cur_lsn, 25); // Last entry = 149
+    rollback_validate(log_store, cur_lsn, 75); // Last entry = 74
+    kickstart_inserts(log_store, cur_lsn, 25); // Last entry = 99
+    truncate_validate(log_store);
+    restart();
+    ASSERT_EQ(log_store->get_contiguous_completed_seq_num(-1), cur_lsn - 1);
+    kickstart_inserts(log_store, cur_lsn, 25);
+    truncate_validate(log_store);
+    rollback_records_validate(log_store, 0 /* expected_count */);
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.logstore.rollback_marker_in_log = false; });
+    HS_SETTINGS_FACTORY().save();
+}
+
 TEST_F(LogDevTest, CreateRemoveLogDev) {
     auto num_logdev = SISL_OPTIONS["num_logdevs"].as< uint32_t >();
     std::vector< std::shared_ptr< HomeLogStore > > log_stores;
@@ -0,0 +1,148 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <gtest/gtest.h>
+
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+#include <homestore/logstore/log_record_tracker.hpp>
+
+using namespace homestore;
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+SISL_OPTIONS_ENABLE(logging, test_log_record_tracker)
+SISL_OPTION_GROUP(test_log_record_tracker,
+                  (num_records, "", "num_records", "number of records to create in parallel",
+                   ::cxxopts::value< uint32_t >()->default_value("20000"), "number"));
+
+namespace {
+struct test_record {
+    static inline std::atomic< int64_t > s_alive{0};
+
+    explicit test_record(int64_t v) : val{v} { ++s_alive; }
+    test_record(const test_record&) = delete;
+    test_record& operator=(const test_record&) = delete;
+    ~test_record() { --s_alive; }
+
+    int64_t val;
+};
+
+using tracker_t = LogRecordTracker< test_record, 64 >;
+} // namespace
+
+TEST(LogRecordTrackerTest, CreateCompleteAndStatus) {
+    tracker_t t{"test", -1};
+    for (int64_t i{0}; i < 200; ++i) {
+        t.create(i, i * 10);
+    }
+    EXPECT_EQ(t.active_upto(), 199);
+    EXPECT_EQ(t.completed_upto(), -1);
+    EXPECT_TRUE(t.status(5).is_active);
+    EXPECT_TRUE(t.status(200).is_hole);
+
+    t.complete(0, 99);
+    t.update(150, [](test_record& r) {
+        r.val = -1;
+        return true;
+    });
+    EXPECT_EQ(t.completed_upto(), 99);
+    EXPECT_EQ(t.completed_upto(150), 150);
+    EXPECT_TRUE(t.status(150).is_completed);
+    EXPECT_EQ(t.at(150).val, -1);
+    EXPECT_EQ(t.at(70).val, 700);
+    EXPECT_THROW(t.at(300), std::out_of_range);
+
+    int64_t count{0};
+    t.foreach_all_completed(90, [&count](int64_t, test_record&) { return ++count > 0; });
+    EXPECT_EQ(count, 11);
+}
+
+TEST(LogRecordTrackerTest, TruncateRollbackAndMemory) {
+    {
+        tracker_t t{"test", 9};
+        EXPECT_TRUE(t.status(9).is_out_of_range);
+        auto const empty_bytes = t.memory_bytes();
+        for (int64_t i{10}; i < 500; ++i) {
+            t.create_and_complete(i, i);
+        }
+        auto const full_bytes = t.memory_bytes();
+        EXPECT_GT(full_bytes, empty_bytes);
+        EXPECT_EQ(test_record::s_alive.load(), 490);
+
+        t.truncate(299);
+        EXPECT_TRUE(t.status(299).is_out_of_range);
+        EXPECT_EQ(t.at(300).val, 300);
+        EXPECT_LT(t.memory_bytes(), full_bytes);
+        EXPECT_EQ(test_record::s_alive.load(), 200);
+
+        t.rollback(349);
+        EXPECT_TRUE(t.status(350).is_hole);
+        EXPECT_EQ(t.active_upto(), 349);
+        EXPECT_EQ(test_record::s_alive.load(), 50);
+
+        t.create(350, 1);
+        EXPECT_EQ(t.active_upto(300), 350);
+        EXPECT_EQ(t.completed_upto(300), 349);
+
+        t.reinit(1000);
+        EXPECT_EQ(test_record::s_alive.load(), 0);
+        EXPECT_TRUE(t.status(999).is_out_of_range);
+        t.create(1000, 1);
+    }
+    EXPECT_EQ(test_record::s_alive.load(), 0);
+}
+
+TEST(LogRecordTrackerTest, ParallelCreateAndTruncate) {
+    tracker_t t{"test", -1};
+    const auto nrecords = s_cast< int64_t >(SISL_OPTIONS["num_records"].as< uint32_t >());
+    std::atomic< int64_t > next{0};
+    std::vector< std::thread > writers;
+    for (uint32_t w{0}; w < 4; ++w) {
+        writers.emplace_back([&t, &next, nrecords]() {
+            for (auto i = next.fetch_add(1); i < nrecords; i = next.fetch_add(1)) {
+                t.create_and_complete(i, i);
+            }
+        });
+    }
+
+    std::thread truncator([&t, nrecords]() {
+        while (t.completed_upto() < nrecords - 1) {
+            auto const upto = t.completed_upto();
+            if (upto > 0) { t.truncate(upto - 1); }
+        }
+    });
+
+    for (auto& w : writers) {
+        w.join();
+    }
+    truncator.join();
+    EXPECT_EQ(t.completed_upto(), nrecords - 1);
+    EXPECT_EQ(t.at(nrecords - 1).val, nrecords - 1);
+}
+
+int main(int argc, char* argv[]) {
+    int parsed_argc{argc};
+    ::testing::InitGoogleTest(&parsed_argc, argv);
+    SISL_OPTIONS_LOAD(parsed_argc, argv, logging, test_log_record_tracker);
+    sisl::logging::SetLogger("test_log_record_tracker");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+
+    return RUN_ALL_TESTS();
+}
@@ -1006,6 +1006,74 @@ TEST_F(LogStoreTest, BurstSeqInsertAndTruncateInParallel) {
 }
 #endif
 
+TEST_F(LogStoreTest, TruncateInParallelToInsertsAndFlushThenRecover) {
+    const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
+    const auto iterations = SISL_OPTIONS["iterations"].as< uint32_t >();
+
+    for (uint32_t iteration{0}; iteration < iterations; ++iteration) {
+        LOGINFO("Iteration {}", iteration);
+        LOGINFO("Step 1: Reinit the num records to start random write test");
+        this->init(num_records);
+
+#ifdef _PRERELEASE
+        LOGINFO("Step 2: Delay some of the regular flushes, so that truncation finds log groups inflight");
+        flip::FlipClient* fc = iomgr_flip::client_instance();
+        flip::FlipFrequency freq;
+        freq.set_count(10);
+        freq.set_percent(50);
+
+        flip::FlipCondition dont_care_cond;
+        fc->create_condition("", flip::Operator::DONT_CARE, (int)1, &dont_care_cond);
+        fc->inject_delay_flip("simulate_log_flush_delay", {dont_care_cond}, freq, 20000); // Delay by 20ms
+#endif
+
+        LOGINFO("Step 3: Issue random inserts within a batch of 10 with q depth of 500");
+        this->kickstart_inserts(10, 500);
+
+        LOGINFO("Step 4: In parallel to inserts, repeatedly flush and truncate upto what is completed");
+        uint32_t trunc_attempt{0};
+        uint64_t nrecords_waiting_to_complete{0};
+        uint64_t nrecords_waiting_to_issue{0};
+        do {
+            std::this_thread::sleep_for(std::chrono::microseconds(1000));
+            if (trunc_attempt % 2 == 0) { this->flush(); }
+            this->truncate_validate(true /* is_parallel_to_write */);
+            ++trunc_attempt;
+            {
+                std::unique_lock< std::mutex > lock{m_pending_mtx};
+                nrecords_waiting_to_complete = this->m_nrecords_waiting_to_complete;
+                nrecords_waiting_to_issue = this->m_nrecords_waiting_to_issue;
+            }
+        } while ((nrecords_waiting_to_complete > 0) || (nrecords_waiting_to_issue > 0));
+        LOGINFO("Truncation has been issued and validated {} times while inserts were inflight", trunc_attempt);
+
+        LOGINFO("Step 5: Wait for the Inserts to complete");
+        this->wait_for_inserts();
+#ifdef _PRERELEASE
+        fc->remove_flip("simulate_log_flush_delay");
+#endif
+
+        LOGINFO("Step 6: Read and iterate all the records which are not truncated to validate them");
+        this->read_validate(true);
+        this->iterate_validate(true);
+
+        LOGINFO("Step 7: Restart homestore and validate the replay honours the truncation done in parallel");
+        SampleDB::instance().start_homestore(true /* restart */);
+        this->recovery_validate();
+        this->init(num_records);
+
+        LOGINFO("Step 8: Read and iterate all the recovered records to validate them");
+        this->read_validate(true);
+        this->iterate_validate(true);
+
+        LOGINFO("Step 9: Issue more inserts after restart and truncate all of them");
+        this->kickstart_inserts(10, 500);
+        this->wait_for_inserts();
+        this->read_validate(true);
+        this->truncate_validate();
+    }
+}
+
 TEST_F(LogStoreTest, RandInsertsWithHoles) {
     const auto num_records = SISL_OPTIONS["num_records"].as< uint32_t >();
     const auto iterations = SISL_OPTIONS["iterations"].as< uint32_t >();
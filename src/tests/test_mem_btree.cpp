@@ -84,6 +84,14 @@ struct VarObjSizeBtreeTest {
     static constexpr btree_node_type interior_node_type = btree_node_type::VAR_OBJECT;
 };
 
+struct CompactBtreeTest {
+    using BtreeType = MemBtree< TestFixedKey, TestFixedValue >;
+    using KeyType = TestFixedKey;
+    using ValueType = TestFixedValue;
+    static constexpr btree_node_type leaf_node_type = btree_node_type::COMPACT;
+    static constexpr btree_node_type interior_node_type = btree_node_type::FIXED;
+};
+
 struct PrefixIntervalBtreeTest {
     using BtreeType = MemBtree< TestIntervalKey, TestIntervalValue >;
     using KeyType = TestIntervalKey;
@@ -108,7 +116,7 @@ struct BtreeTest : public BtreeTestHelper< TestType >, public ::testing::Test {
 
 // TODO Enable PrefixIntervalBtreeTest later
 using BtreeTypes = testing::Types< /* PrefixIntervalBtreeTest, */ FixedLenBtreeTest, VarKeySizeBtreeTest,
-                                   VarValueSizeBtreeTest, VarObjSizeBtreeTest >;
+                                   VarValueSizeBtreeTest, VarObjSizeBtreeTest, CompactBtreeTest >;
 TYPED_TEST_SUITE(BtreeTest, BtreeTypes);
 
 TYPED_TEST(BtreeTest, SequentialInsert) {
@@ -210,6 +218,51 @@ TYPED_TEST(BtreeTest, RangeUpdate) {
     this->do_query(0, num_entries - 1, 75);
 }
 
+TYPED_TEST(BtreeTest, StreamingQuery) {
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Insert every other key upto {}", num_entries);
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+
+    LOGINFO("Step 2: Visit all entries in pages of 50, with and without the visitor stopping early");
+    this->do_visit_query(0, num_entries - 1, 50, UINT32_MAX);
+    this->do_visit_query(0, num_entries - 1, 50, 7);
+    this->do_visit_query(0, num_entries - 1, UINT32_MAX, 1);
+
+    LOGINFO("Step 3: Visit sub ranges, starting and ending on keys not in the btree");
+    this->do_visit_query(num_entries / 4 + 1, num_entries / 2 + 1, 13, 5);
+    this->do_visit_query(num_entries + 10, num_entries + 100, 10, 10);
+}
+
+TYPED_TEST(BtreeTest, LeafFilterGets) {
+    this->m_cfg.m_leaf_filters = true;
+    this->m_bt = std::make_shared< typename TestFixture::T::BtreeType >(this->m_cfg);
+
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    LOGINFO("Step 1: Insert every other key upto {}", num_entries);
+    for (uint32_t i{0}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+
+    LOGINFO("Step 2: Get all keys twice, misses of the second round are answered by the leaf filters");
+    for (uint32_t round{0}; round < 2; ++round) {
+        for (uint32_t i{0}; i < num_entries; ++i) {
+            this->get_specific(i);
+        }
+    }
+
+    LOGINFO("Step 3: Insert the missing keys, remove a range and validate that the filters don't hide any key");
+    for (uint32_t i{1}; i < num_entries; i += 2) {
+        this->put(i, btree_put_type::INSERT);
+    }
+    this->range_remove_any(num_entries / 4, num_entries / 2);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->get_specific(i);
+    }
+    this->get_all();
+}
+
 TYPED_TEST(BtreeTest, SimpleRemoveRange) {
     // Forward sequential insert
     const auto num_entries = 20;
@@ -283,6 +336,29 @@ TYPED_TEST(BtreeTest, RandomRemoveRange) {
     this->query_all();
 }
 
+TYPED_TEST(BtreeTest, RemoveRangeFreeingSubtrees) {
+    const auto num_entries = SISL_OPTIONS["num_entries"].as< uint32_t >();
+    const auto num_iters = SISL_OPTIONS["num_iters"].as< uint32_t >();
+
+    LOGINFO("Step 1: Do forward sequential insert for {} entries", num_entries);
+    for (uint32_t i{0}; i < num_entries; ++i) {
+        this->put(i, btree_put_type::INSERT);
+    }
+
+    LOGINFO("Step 2: Remove the middle half in one range, freeing the subtrees within it");
+    this->range_remove_any(num_entries / 4, (num_entries / 4) * 3, true /* free_subtrees */);
+    this->query_all();
+
+    static thread_local std::uniform_int_distribution< uint32_t > s_rand_key_generator{0, num_entries};
+    LOGINFO("Step 3: Do range remove freeing subtrees for maximum of {} iterations", num_iters);
+    for (uint32_t i{0}; (i < num_iters) && this->m_shadow_map.size(); ++i) {
+        uint32_t key1 = s_rand_key_generator(g_re);
+        uint32_t key2 = s_rand_key_generator(g_re);
+        this->range_remove_any(std::min(key1, key2), std::max(key1, key2), true /* free_subtrees */);
+    }
+    this->query_all();
+}
+
 template < typename TestType >
 struct BtreeConcurrentTest : public BtreeTestHelper< TestType >, public ::testing::Test {
     using T = TestType;
@@ -322,6 +398,19 @@ TYPED_TEST(BtreeConcurrentTest, ConcurrentAllOps) {
     this->multi_op_execute(ops);
 }
 
+TYPED_TEST(BtreeConcurrentTest, ConcurrentOptimisticGets) {
+    this->m_cfg.m_optimistic_reads = true;
+    this->m_bt = std::make_shared< typename TestFixture::T::BtreeType >(this->m_cfg);
+
+    std::vector< std::string > input_ops = {"put:30", "remove:20", "get:50"};
+    if (SISL_OPTIONS.count("operation_list")) {
+        input_ops = SISL_OPTIONS["operation_list"].as< std::vector< std::string > >();
+    }
+    auto ops = this->build_op_list(input_ops);
+
+    this->multi_op_execute(ops);
+}
+
 int main(int argc, char* argv[]) {
     ::testing::InitGoogleTest(&argc, argv);
     SISL_OPTIONS_LOAD(argc, argv, logging, test_mem_btree)
@@ -749,6 +749,178 @@ TEST_F(VMetaBlkMgrTest, single_read_test) {
     this->shutdown();
 }
 
+TEST_F(VMetaBlkMgrTest, async_update_test) {
+    mtype = "Test_Async_Update";
+    reset_counters();
+    m_start_time = Clock::now();
+    this->register_client();
+
+    static constexpr uint32_t num_sbs{8};
+    static constexpr uint32_t num_rounds{4};
+    for (uint32_t i{0}; i < num_sbs; ++i) {
+        EXPECT_GT(this->do_sb_write(false), uint64_cast(0));
+    }
+
+    // Several updates of each sb in flight at once, only the last one of each should be found after recovery
+    std::vector< folly::Future< bool > > update_futs;
+    for (uint32_t r{0}; r < num_rounds; ++r) {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        for (auto& [bid, sb] : m_write_sbs) {
+            auto const sz = rand_size(false /* overflow */);
+            uint8_t* buf = iomanager.iobuf_alloc(512, sz);
+            gen_rand_buf(buf, sz);
+            update_futs.emplace_back(m_mbm->async_update_sub_sb(buf, sz, sb.cookie));
+            sb.str = md5_sum(r_cast< const char* >(buf), sz);
+            iomanager.iobuf_free(buf); // Copied by the time it returns
+        }
+    }
+
+    // Sb added asynchronously along with the pending updates
+    auto const sz = rand_size(false /* overflow */);
+    uint8_t* buf = iomanager.iobuf_alloc(512, sz);
+    gen_rand_buf(buf, sz);
+    auto add_fut = m_mbm->async_add_sub_sb(mtype, buf, sz);
+    auto const add_str = md5_sum(r_cast< const char* >(buf), sz);
+    iomanager.iobuf_free(buf);
+
+    for (auto& f : update_futs) {
+        EXPECT_TRUE(std::move(f).get());
+    }
+    void* cookie = std::move(add_fut).get();
+    ASSERT_NE(cookie, nullptr);
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        auto const bid = s_cast< const meta_blk* >(cookie)->hdr.h.bid.to_integer();
+        m_write_sbs[bid].cookie = cookie;
+        m_write_sbs[bid].str = add_str;
+    }
+
+    this->recover_with_on_complete();
+    this->validate();
+    this->shutdown();
+}
+
+TEST_F(VMetaBlkMgrTest, log_structured_test) {
+    mtype = "Test_Log_Structured";
+    reset_counters();
+
+    // Small segments, so that updates fill up several of them and the older ones are compacted
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.metablk.log_segment_blks = 8;
+        HS_SETTINGS_FACTORY().save();
+    });
+
+    // Each sb starts with its index, which is what it is found by after recovery
+    std::map< uint32_t, std::string > found;
+    auto register_log_client = [this, &found]() {
+        m_mbm = &(meta_service());
+        m_mbm->deregister_handler(mtype);
+        m_mbm->register_handler(
+            mtype,
+            [this, &found](meta_blk* mblk, sisl::byte_view buf, size_t size) {
+                ASSERT_NE(mblk, nullptr);
+                std::unique_lock< std::mutex > lg{m_mtx};
+                found[*r_cast< const uint32_t* >(buf.bytes())] = md5_sum(r_cast< const char* >(buf.bytes()), size);
+            },
+            nullptr, true /* do_crc */, std::nullopt, true /* log_structured */);
+    };
+    register_log_client();
+
+    static constexpr uint32_t num_sbs{16};
+    static constexpr uint32_t num_rounds{32};
+    std::vector< void* > cookies(num_sbs, nullptr);
+    std::map< uint32_t, std::string > expected;
+    auto write_sb = [this, &cookies, &expected](uint32_t i) {
+        auto const sz = std::max(rand_size(false /* overflow */), uint32_cast(sizeof(uint32_t)));
+        uint8_t* buf = iomanager.iobuf_alloc(512, sz);
+        gen_rand_buf(buf, sz);
+        *r_cast< uint32_t* >(buf) = i;
+        if (cookies[i] == nullptr) {
+            m_mbm->add_sub_sb(mtype, buf, sz, cookies[i]);
+        } else {
+            m_mbm->update_sub_sb(buf, sz, cookies[i]);
+        }
+        expected[i] = md5_sum(r_cast< const char* >(buf), sz);
+        iomanager.iobuf_free(buf);
+    };
+
+    for (uint32_t r{0}; r < num_rounds; ++r) {
+        for (uint32_t i{0}; i < num_sbs; ++i) {
+            write_sb(i);
+        }
+    }
+
+    // Removed ones are not found after recovery, even though the older records of them could still be in the log
+    for (uint32_t i{0}; i < num_sbs; i += 4) {
+        EXPECT_FALSE(m_mbm->remove_sub_sb(cookies[i]));
+        expected.erase(i);
+    }
+
+    m_token.cb_ = register_log_client;
+    test_common::HSTestHelper::restart_homestore(m_token);
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        EXPECT_EQ(found, expected);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.metablk.log_segment_blks = 256;
+        HS_SETTINGS_FACTORY().save();
+    });
+    this->shutdown();
+}
+
+TEST_F(VMetaBlkMgrTest, lazy_load_test) {
+    mtype = "Test_Lazy_Load";
+    reset_counters();
+    static constexpr uint64_t lazy_min_size{64 * 1024};
+
+    // Sbs are told apart by their size after recovery, small one is inline and large one is in overflow blks
+    std::map< uint64_t, std::pair< void*, size_t > > found; // By the size it is written with
+    auto register_lazy_client = [this, &found]() {
+        m_mbm = &(meta_service());
+        m_mbm->deregister_handler(mtype);
+        m_mbm->register_handler(
+            mtype,
+            [this, &found](meta_blk* mblk, sisl::byte_view, size_t size) {
+                std::unique_lock< std::mutex > lg{m_mtx};
+                auto const sz = mblk->hdr.h.compressed ? mblk->hdr.h.src_context_sz : mblk->hdr.h.context_sz;
+                found[sz] = std::make_pair(voidptr_cast(mblk), size);
+            },
+            nullptr);
+        m_mbm->enable_lazy_load(mtype, lazy_min_size);
+    };
+    register_lazy_client();
+
+    std::map< uint64_t, std::string > expected;
+    for (uint64_t const sz : {uint64_cast(512), 4 * lazy_min_size}) {
+        uint8_t* buf = iomanager.iobuf_alloc(512, sz);
+        gen_rand_buf(buf, sz);
+        void* cookie{nullptr};
+        m_mbm->add_sub_sb(mtype, buf, sz, cookie);
+        expected[sz] = md5_sum(r_cast< const char* >(buf), sz);
+
+        // Read back from the context cache for the large one
+        auto const loaded = m_mbm->load_sub_sb(cookie);
+        EXPECT_EQ(md5_sum(r_cast< const char* >(loaded->cbytes()), sz), expected[sz]);
+        iomanager.iobuf_free(buf);
+    }
+
+    m_token.cb_ = register_lazy_client;
+    test_common::HSTestHelper::restart_homestore(m_token);
+    {
+        std::unique_lock< std::mutex > lg{m_mtx};
+        ASSERT_EQ(found.size(), expected.size());
+        for (auto const& [sz, str] : expected) {
+            auto const [cookie, cb_size] = found[sz];
+            EXPECT_EQ(cb_size, (sz >= lazy_min_size) ? 0 : sz); // Large one is called back without its context
+            auto const loaded = m_mbm->load_sub_sb(cookie);
+            EXPECT_EQ(md5_sum(r_cast< const char* >(loaded->cbytes()), sz), str);
+        }
+    }
+    this->shutdown();
+}
+
 TEST_F(VMetaBlkMgrTest, random_dependency_test) {
     reset_counters();
     m_start_time = Clock::now();
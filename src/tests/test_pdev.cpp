@@ -16,18 +16,24 @@
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <random>
+#include <vector>
+
+#include <folly/ScopeGuard.h>
+#include <folly/futures/Future.h>
 
 #include <gtest/gtest.h>
 #include <iomgr/io_environment.hpp>
 #include <sisl/logging/logging.h>
 #include <sisl/options/options.h>
 
+#include "common/homestore_config.hpp"
 #include "device/chunk.h"
 
 #include "device/device.h"
@@ -255,6 +261,117 @@ TEST_F(PDevTest, RandomChunkOpsWithRestart) {
             num_removed, available_size);
 }
 
+TEST_F(PDevTest, IoUringReadWriteBatch) {
+    // Small queue depth, so that batches overflow the submission queue and ios are left in flight at shutdown
+    static constexpr uint32_t queue_depth = 8;
+    static constexpr uint32_t nios = 4 * queue_depth;
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.device.use_io_uring = true;
+        s.device.io_uring_queue_depth = queue_depth;
+    });
+    HS_SETTINGS_FACTORY().save();
+    auto reset_settings = folly::makeGuard([]() {
+        HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+            s.device.use_io_uring = false;
+            s.device.io_uring_queue_depth = 512;
+        });
+        HS_SETTINGS_FACTORY().save();
+    });
+    restart();
+
+    if (!m_first_data_pdev->is_io_uring_enabled()) {
+#ifdef NO_LIBURING
+        LOGINFO("Built without liburing, device should have fallen back to the drive interface");
+#endif
+        GTEST_SKIP() << "io_uring is not available, device uses the drive interface";
+    }
+
+    auto chunk = m_first_data_pdev->create_chunk(0u, 0u, m_first_data_pdev->data_size() / 4, 0u);
+    auto const align = m_first_data_pdev->align_size();
+    auto const io_size = m_first_data_pdev->optimal_page_size();
+    auto const base = chunk->start_offset();
+
+    auto wbuf = iomanager.iobuf_alloc(align, io_size * nios);
+    auto rbuf = iomanager.iobuf_alloc(align, io_size * nios);
+    for (uint32_t i{0}; i < io_size * nios; ++i) {
+        wbuf[i] = s_cast< uint8_t >(i % 251);
+    }
+    auto const verify = [&](uint32_t off, uint32_t size) { return (std::memcmp(wbuf + off, rbuf + off, size) == 0); };
+
+    LOGINFO("Step 1: Single write and read back");
+    ASSERT_FALSE(m_first_data_pdev->async_write(r_cast< char* >(wbuf), io_size, base).get());
+    ASSERT_FALSE(m_first_data_pdev->async_read(r_cast< char* >(rbuf), io_size, base).get());
+    ASSERT_TRUE(verify(0, io_size));
+
+    LOGINFO("Step 2: Vectored write and read back");
+    std::vector< iovec > iovs;
+    for (uint32_t i{0}; i < 4; ++i) {
+        iovs.push_back(iovec{wbuf + (i * io_size), io_size});
+    }
+    ASSERT_FALSE(m_first_data_pdev->async_writev(iovs.data(), 4, io_size * 4, base).get());
+    for (uint32_t i{0}; i < 4; ++i) {
+        iovs[i].iov_base = rbuf + (i * io_size);
+    }
+    std::memset(rbuf, 0, io_size * 4);
+    ASSERT_FALSE(m_first_data_pdev->async_readv(iovs.data(), 4, io_size * 4, base).get());
+    ASSERT_TRUE(verify(0, io_size * 4));
+
+    LOGINFO("Step 3: Batch of {} writes and reads, more than the queue depth={}", nios, queue_depth);
+    std::vector< folly::Future< std::error_code > > futs;
+    for (uint32_t i{0}; i < nios; ++i) {
+        futs.push_back(m_first_data_pdev->async_write(r_cast< char* >(wbuf + (i * io_size)), io_size,
+                                                      base + (i * io_size), true /* part_of_batch */));
+    }
+    m_first_data_pdev->submit_batch();
+    for (auto& ec : folly::collectAll(futs).get()) {
+        ASSERT_FALSE(ec.value());
+    }
+    ASSERT_FALSE(m_first_data_pdev->queue_fsync().get());
+
+    futs.clear();
+    std::memset(rbuf, 0, io_size * nios);
+    for (uint32_t i{0}; i < nios; ++i) {
+        futs.push_back(m_first_data_pdev->async_read(r_cast< char* >(rbuf + (i * io_size)), io_size,
+                                                     base + (i * io_size), true /* part_of_batch */));
+    }
+    m_first_data_pdev->submit_batch();
+    for (auto& ec : folly::collectAll(futs).get()) {
+        ASSERT_FALSE(ec.value());
+    }
+    ASSERT_TRUE(verify(0, io_size * nios));
+
+    LOGINFO("Step 4: Read into a registered buffer is issued as a fixed buffer io");
+    if (m_first_data_pdev->register_io_buffer(rbuf, io_size * nios)) {
+        std::memset(rbuf, 0, io_size * nios);
+        ASSERT_FALSE(m_first_data_pdev->async_read(r_cast< char* >(rbuf), io_size * nios, base).get());
+        ASSERT_TRUE(verify(0, io_size * nios));
+        m_first_data_pdev->unregister_io_buffer(rbuf);
+    } else {
+        LOGINFO("Buffer registration is not supported by the kernel, skipping fixed buffer io");
+    }
+
+    LOGINFO("Step 5: Shutdown with a full submission queue of unsubmitted ios, which are to complete before exit");
+    futs.clear();
+    for (uint32_t i{0}; i < queue_depth; ++i) {
+        futs.push_back(m_first_data_pdev->async_write(r_cast< char* >(wbuf + (i * io_size)), io_size,
+                                                      base + (i * io_size), true /* part_of_batch */));
+    }
+    chunk.reset();
+    restart();
+    for (auto& f : futs) {
+        ASSERT_TRUE(f.isReady());
+        ASSERT_FALSE(f.value());
+    }
+
+    ASSERT_EQ(m_data_chunks.size(), 1u) << "Chunk is expected to be loaded after restart";
+    std::memset(rbuf, 0, io_size * queue_depth);
+    ASSERT_FALSE(m_first_data_pdev->async_read(r_cast< char* >(rbuf), io_size * queue_depth, base).get());
+    ASSERT_TRUE(verify(0, io_size * queue_depth));
+    iomanager.iobuf_free(wbuf);
+    iomanager.iobuf_free(rbuf);
+}
+
 int main(int argc, char* argv[]) {
     SISL_OPTIONS_LOAD(argc, argv, logging, test_pdev, iomgr);
     ::testing::InitGoogleTest(&argc, argv);
@@ -79,6 +79,7 @@ public:
         uint64_t data_size_;
         uint64_t data_pattern_;
         MultiBlkId blkid_;
+        RemoteBlkId remote_blkid_; // Blkid of the data at the originator, to hedge the reads with
     };
 
     struct test_req : public repl_req_ctx {
@@ -121,8 +122,11 @@ public:
 
         auto jheader = r_cast< test_req::journal_header const* >(header.cbytes());
         Key k{.id_ = *(r_cast< uint64_t const* >(key.cbytes()))};
-        Value v{
-            .lsn_ = lsn, .data_size_ = jheader->data_size, .data_pattern_ = jheader->data_pattern, .blkid_ = blkids};
+        Value v{.lsn_ = lsn,
+                .data_size_ = jheader->data_size,
+                .data_pattern_ = jheader->data_pattern,
+                .blkid_ = blkids,
+                .remote_blkid_ = ctx->remote_blkid()};
 
         LOGINFOMOD(replication, "[Replica={}] Received commit on lsn={} dsn={} key={} value[blkid={} pattern={}]",
                    g_helper->replica_num(), lsn, ctx->dsn(), k.id_, v.blkid_.to_string(), v.data_pattern_);
@@ -136,6 +140,15 @@ public:
         if (ctx->is_proposer()) { g_helper->runner().next_task(); }
     }
 
+    void on_commit_batch(std::span< repl_commit_record const > records) override {
+        batched_commit_count_.fetch_add(records.size());
+        ReplDevListener::on_commit_batch(records);
+    }
+
+    std::optional< uint64_t > commit_order_key(sisl::blob const&, sisl::blob const& key) override {
+        return *(r_cast< uint64_t const* >(key.cbytes())); // Every write is of a key of its own
+    }
+
     bool on_pre_commit(int64_t lsn, const sisl::blob& header, const sisl::blob& key,
                        cintrusive< repl_req_ctx >& ctx) override {
         LOGINFOMOD(replication, "[Replica={}] Received pre-commit on lsn={} dsn={}", g_helper->replica_num(), lsn,
@@ -181,13 +194,13 @@ public:
         repl_dev()->async_alloc_write(req->header_blob(), req->key_blob(), req->write_sgs, req);
     }
 
-    void validate_db_data() {
+    void validate_db_data(bool hedged = false) {
         g_helper->runner().set_num_tasks(inmem_db_.size());
 
         LOGINFOMOD(replication, "[{}]: Total {} keys committed, validating them",
                    boost::uuids::to_string(repl_dev()->group_id()), inmem_db_.size());
         auto it = inmem_db_.begin();
-        g_helper->runner().set_task([this, &it]() {
+        g_helper->runner().set_task([this, &it, hedged]() {
             Key k;
             Value v;
             {
@@ -200,7 +213,10 @@ public:
                 auto block_size = SISL_OPTIONS["block_size"].as< uint32_t >();
                 auto read_sgs = test_common::HSTestHelper::create_sgs(v.data_size_, block_size);
 
-                repl_dev()->async_read(v.blkid_, read_sgs, v.data_size_).thenValue([read_sgs, k, v](auto const ec) {
+                auto fut = hedged
+                    ? repl_dev()->async_read_hedged(v.blkid_, read_sgs, v.data_size_, v.remote_blkid_, v.lsn_)
+                    : repl_dev()->async_read(v.blkid_, read_sgs, v.data_size_);
+                std::move(fut).thenValue([read_sgs, k, v](auto const ec) {
                     LOGINFOMOD(replication, "Validating key={} value[blkid={} pattern={}]", k.id_, v.blkid_.to_string(),
                                v.data_pattern_);
                     RELEASE_ASSERT(!ec, "Read of blkid={} for key={} error={}", v.blkid_.to_string(), k.id_,
@@ -224,6 +240,8 @@ public:
         return commit_count_;
     }
 
+    uint64_t db_batched_commit_count() const { return batched_commit_count_.load(); }
+
     uint64_t db_size() const {
         std::shared_lock lk(db_mtx_);
         return inmem_db_.size();
@@ -232,6 +250,7 @@ public:
 private:
     std::map< Key, Value > inmem_db_;
     uint64_t commit_count_{0};
+    std::atomic< uint64_t > batched_commit_count_{0};
     std::shared_mutex db_mtx_;
 };
 
@@ -287,9 +306,9 @@ public:
         LOGINFO("Replica={} has received {} commits as expected", g_helper->replica_num(), total_writes);
     }
 
-    void validate_data() {
+    void validate_data(bool hedged = false) {
         for (auto const& db : dbs_) {
-            db->validate_db_data();
+            db->validate_db_data(hedged);
         }
     }
 
@@ -434,6 +453,18 @@ protected:
 #endif
 };
 
+// Counters in metrics json are keyed by their name (along with description), so look it up by prefix
+static uint64_t counter_value(nlohmann::json const& j, std::string const& name) {
+    if (j.is_object()) {
+        for (auto const& [key, val] : j.items()) {
+            bool const match = (key == name) || (key.rfind(name + " ", 0) == 0);
+            if (match && val.is_number()) { return val.get< uint64_t >(); }
+            if (auto const v = counter_value(val, name); v != 0) { return v; }
+        }
+    }
+    return 0;
+}
+
 TEST_F(RaftReplDevTest, Write_Restart_Write) {
     LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
     g_helper->sync_for_test_start();
@@ -461,6 +492,36 @@ TEST_F(RaftReplDevTest, Write_Restart_Write) {
     g_helper->sync_for_cleanup_start();
 }
 
+TEST_F(RaftReplDevTest, Write_Compact_Blkid_Restart) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    uint64_t entries_per_attempt = SISL_OPTIONS["num_io"].as< uint64_t >();
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+
+    LOGINFO("Write the journal entries with compact blkids, after the ones with the fixed encoding");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.journal_compact_blkid = true; });
+    HS_SETTINGS_FACTORY().save();
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    this->validate_data();
+    g_helper->sync_for_cleanup_start();
+
+    LOGINFO("Restart all the homestore replicas, which replay the entries of both the encodings");
+    g_helper->restart();
+    g_helper->sync_for_test_start();
+    this->assign_leader(0);
+
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+    LOGINFO("Validate all data written (including pre-restart data) by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.journal_compact_blkid = false; });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+}
+
 #ifdef _PRERELEASE
 TEST_F(RaftReplDevTest, Follower_Fetch_OnActive_ReplicaGroup) {
     LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
@@ -520,7 +581,239 @@ TEST_F(RaftReplDevTest, Follower_Incremental_Resync) {
     g_helper->sync_for_cleanup_start();
 }
 
+TEST_F(RaftReplDevTest, Write_Commit_Batch) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the commits to be passed to listener in batches");
+    uint32_t prev_max{0};
+    HS_SETTINGS_FACTORY().modifiable_settings([&prev_max](auto& s) {
+        prev_max = s.consensus.commit_batch_max_entries;
+        s.consensus.commit_batch_max_entries = 16;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    auto const prev_batched = pick_one_db()->db_batched_commit_count();
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+    ASSERT_GT(pick_one_db()->db_batched_commit_count(), prev_batched) << "Commits were not passed in batches";
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([prev_max](auto& s) {
+        s.consensus.commit_batch_max_entries = prev_max; //
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, Write_Parallel_Commit) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the commits to be applied in parallel, which takes effect on a restart");
+    uint32_t prev_threads{0};
+    HS_SETTINGS_FACTORY().modifiable_settings([&prev_threads](auto& s) {
+        prev_threads = s.consensus.commit_apply_threads;
+        s.consensus.commit_apply_threads = 4;
+    });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+
+    g_helper->restart();
+    g_helper->sync_for_test_start();
+    this->assign_leader(0);
+
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([prev_threads](auto& s) {
+        s.consensus.commit_apply_threads = prev_threads; //
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, Write_Embedded_Data) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the data of the writes to be embedded in the journal entries");
+    uint32_t prev_max{0};
+    HS_SETTINGS_FACTORY().modifiable_settings([&prev_max](auto& s) {
+        prev_max = s.consensus.embed_data_max_size;
+        s.consensus.embed_data_max_size = SISL_OPTIONS["block_size"].as< uint32_t >();
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([prev_max](auto& s) {
+        s.consensus.embed_data_max_size = prev_max; //
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, Write_Wire_Compressed_Data) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the data of the writes to be compressed when pushed to and fetched by the followers");
+    uint32_t prev_min{0};
+    HS_SETTINGS_FACTORY().modifiable_settings([&prev_min](auto& s) {
+        prev_min = s.consensus.data_wire_compress_min_size;
+        s.consensus.data_wire_compress_min_size = SISL_OPTIONS["block_size"].as< uint32_t >();
+    });
+    HS_SETTINGS_FACTORY().save();
+
+#ifdef _PRERELEASE
+    if (g_helper->replica_num() != 0) {
+        LOGINFO("Set flip to drop some of the pushes, so that their data is fetched");
+        set_basic_flip("drop_push_data_request", 10);
+    }
+#endif
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([prev_min](auto& s) {
+        s.consensus.data_wire_compress_min_size = prev_min; //
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, Follower_Read) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    auto rdev = pick_one_db()->repl_dev();
+    auto const lease = rdev->wait_for_consistent_read(repl_read_consistency_t::LEASE).get();
+    ASSERT_FALSE(lease.hasError()) << "Lease read failed with error=" << enum_name(lease.error());
+
+    auto const leader_only = rdev->wait_for_consistent_read(repl_read_consistency_t::LEADER).get();
+    if (rdev->is_leader()) {
+        ASSERT_FALSE(leader_only.hasError()) << "Leader read failed on leader";
+    } else {
+        ASSERT_TRUE(leader_only.hasError()) << "Leader read is expected to be failed on follower";
+        ASSERT_EQ(leader_only.error(), ReplServiceError::NOT_LEADER);
+    }
+
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, Hedged_Read) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    this->write_on_leader(SISL_OPTIONS["num_io"].as< uint64_t >(), true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data reading them hedged, which followers fetch from the leader if local read is slow");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.consensus.hedged_read_enabled = true;
+        s.consensus.hedged_read_min_delay_us = 0;
+    });
+    HS_SETTINGS_FACTORY().save();
 #ifdef _PRERELEASE
+    // Local reads of the followers are held back, so that the leader is the one to serve them
+    if (g_helper->replica_num() != 0) {
+        set_delay_flip("simulate_hedged_read_local_delay", 200000 /* 200ms */, 2000000 /* count */);
+    }
+#endif
+    this->validate_data(true /* hedged */);
+
+    auto rdev = std::dynamic_pointer_cast< RaftReplDev >(dbs_[0]->repl_dev());
+    auto const metrics = rdev->m_metrics.get_result_in_json(true);
+    auto const nhedged = counter_value(metrics, "hedged_read_cnt");
+    auto const nremote = counter_value(metrics, "hedged_read_remote_cnt");
+    LOGINFO("Hedged reads={} served by the leader={}", nhedged, nremote);
+    if (g_helper->replica_num() == 0) {
+        // Leader has the data itself, its reads are never hedged
+        ASSERT_EQ(nhedged, 0u);
+    } else {
+#ifdef _PRERELEASE
+        ASSERT_GT(nhedged, 0u) << "No read was hedged, though the local reads were held back";
+        ASSERT_GT(nremote, 0u) << "No hedged read was served by the leader, though the local reads were held back";
+        m_fc.remove_flip("simulate_hedged_read_local_delay");
+#endif
+        ASSERT_LE(nremote, nhedged);
+    }
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) {
+        s.consensus.hedged_read_enabled = false;
+        s.consensus.hedged_read_min_delay_us = 2000;
+    });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+}
+
+#ifdef _PRERELEASE
+TEST_F(RaftReplDevTest, Leader_Overlap_Data_Write) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    static constexpr uint32_t num_entries{10};
+    uint64_t prev_wait_data_ms{0};
+    HS_SETTINGS_FACTORY().modifiable_settings([&prev_wait_data_ms](auto& s) {
+        s.consensus.leader_overlap_data_write = true;
+        prev_wait_data_ms = s.consensus.wait_data_write_timer_ms;
+        s.consensus.wait_data_write_timer_ms = 100;
+    });
+    HS_SETTINGS_FACTORY().save();
+
+    if (g_helper->replica_num() == 0) {
+        LOGINFO("Hold back the data writes of the leader, while their entries are proposed and replicated");
+        set_delay_flip("simulate_leader_data_write_delay", 1000000 /* 1s */, num_entries);
+    } else {
+        LOGINFO("Drop the data pushed, so that followers fetch it from the leader while it is still being written");
+        set_basic_flip("drop_push_data_request", num_entries);
+    }
+    this->write_on_leader(num_entries, true /* wait_for_commit */);
+
+    g_helper->sync_for_verify_start();
+    if (g_helper->replica_num() == 0) {
+        auto rdev = std::dynamic_pointer_cast< RaftReplDev >(dbs_[0]->repl_dev());
+        auto const metrics = rdev->m_metrics.get_result_in_json(true);
+        auto const ncommit_waits = counter_value(metrics, "commit_wait_data_write_cnt");
+        auto const nfetch_waits = counter_value(metrics, "fetch_wait_data_write_cnt");
+        LOGINFO("Commits which waited for data write={}, fetches which waited for it={}", ncommit_waits, nfetch_waits);
+        ASSERT_GT(ncommit_waits, 0u) << "No commit waited for the data write, though the writes were held back";
+        ASSERT_GT(nfetch_waits, 0u) << "No fetch was deferred to the data write, though the writes were held back";
+        m_fc.remove_flip("simulate_leader_data_write_delay");
+    }
+
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([prev_wait_data_ms](auto& s) {
+        s.consensus.leader_overlap_data_write = false;
+        s.consensus.wait_data_write_timer_ms = prev_wait_data_ms;
+    });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+}
+
 TEST_F(RaftReplDevTest, Follower_Reject_Append) {
     LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
     g_helper->sync_for_test_start();
@@ -644,6 +937,117 @@ TEST_F(RaftReplDevTest, Snapshot_and_Compact) {
     g_helper->sync_for_cleanup_start();
 }
 
+TEST(RaftSnapshotTest, Validate_Data_Obj) {
+    uint32_t const blk_size = 4096;
+    snapshot_layout layout;
+    layout.chunks = {1, 2};
+    layout.chunk_blks = {100, 30};
+    layout.blks_per_obj = 64;
+    ASSERT_EQ(layout.num_data_objs(), 3u);
+
+    // Second obj of the first chunk, blks 64-99, with 2 runs of allocated blks and their data
+    auto const make_obj = [blk_size](std::vector< snapshot_blk_run > const& runs, uint32_t data_blks) {
+        std::vector< uint8_t > buf(sizeof(snapshot_data_obj_hdr) + runs.size() * sizeof(snapshot_blk_run) +
+                                   data_blks * blk_size);
+        auto* hdr = new (buf.data())
+            snapshot_data_obj_hdr{.chunk_idx = 0, .start_blk = 64, .nblks = 36, .nruns = uint32_cast(runs.size())};
+        std::copy(runs.begin(), runs.end(), hdr->runs_mutable());
+        return buf;
+    };
+    auto const valid = [&layout, blk_size](std::vector< uint8_t > const& buf, uint64_t obj_id = 2) {
+        return layout.is_valid_data_obj(obj_id, buf.data(), buf.size(), blk_size);
+    };
+    std::vector< snapshot_blk_run > const runs{{.blk_num = 64, .nblks = 2}, {.blk_num = 90, .nblks = 10}};
+    auto obj = make_obj(runs, 12);
+    ASSERT_TRUE(valid(obj));
+
+    LOGINFO("Obj which is not of its obj_id, or is cut short anywhere, is rejected");
+    ASSERT_FALSE(valid(obj, 1));
+    ASSERT_FALSE(valid(obj, 4));
+    ASSERT_FALSE(valid(std::vector< uint8_t >(obj.begin(), obj.begin() + sizeof(snapshot_data_obj_hdr) - 1)));
+    ASSERT_FALSE(valid(std::vector< uint8_t >(obj.begin(), obj.begin() + sizeof(snapshot_data_obj_hdr) + 1)));
+    ASSERT_FALSE(valid(std::vector< uint8_t >(obj.begin(), obj.end() - blk_size)));
+    ASSERT_FALSE(valid(make_obj(runs, 13)));
+
+    LOGINFO("Runs which are outside of the blks of the obj, empty or out of order are rejected");
+    ASSERT_FALSE(valid(make_obj({{.blk_num = 60, .nblks = 6}}, 6)));
+    ASSERT_FALSE(valid(make_obj({{.blk_num = 95, .nblks = 6}}, 6)));
+    ASSERT_FALSE(valid(make_obj({{.blk_num = 70, .nblks = 0}}, 0)));
+    ASSERT_FALSE(valid(make_obj({{.blk_num = 90, .nblks = 10}, {.blk_num = 64, .nblks = 2}}, 12)));
+    ASSERT_FALSE(valid(make_obj({{.blk_num = 64, .nblks = 4}, {.blk_num = 66, .nblks = 2}}, 6)));
+}
+
+TEST_F(RaftReplDevTest, CP_Driven_Truncation) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the raft log to be truncated upto the last CP");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.cp_driven_log_truncation = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    uint64_t entries_per_attempt = SISL_OPTIONS["num_io"].as< uint64_t >();
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+
+    LOGINFO("Flush a CP, which truncates the log upto it");
+    homestore::hs()->cp_mgr().trigger_cp_flush(true /* force */).get();
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+    g_helper->sync_for_cleanup_start();
+
+    LOGINFO("Restart all the homestore replicas, which recover from the truncated log");
+    g_helper->restart();
+    g_helper->sync_for_test_start();
+    this->assign_leader(0);
+
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+    LOGINFO("Validate all data written (including pre-restart data) by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.cp_driven_log_truncation = false; });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+}
+
+TEST_F(RaftReplDevTest, CP_Driven_Truncation_Lagging_Follower) {
+    LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
+    g_helper->sync_for_test_start();
+
+    LOGINFO("Set the raft log to be truncated upto the last CP");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.cp_driven_log_truncation = true; });
+    HS_SETTINGS_FACTORY().save();
+
+    uint64_t entries_per_attempt = SISL_OPTIONS["num_io"].as< uint64_t >();
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+
+    LOGINFO("Restart replica=2, so that it lags behind the writes and CPs on the leader meanwhile");
+    this->restart_replica(2, 10 /* shutdown_delay_sec */);
+    this->write_on_leader(entries_per_attempt, true /* wait_for_commit */);
+
+    if (g_helper->replica_num() == 0) {
+        homestore::hs()->cp_mgr().trigger_cp_flush(true /* force */).get();
+        auto rdev = std::dynamic_pointer_cast< RaftReplDev >(dbs_[0]->repl_dev());
+        auto const snp = rdev->get_last_snapshot();
+        auto const snp_idx = snp ? s_cast< repl_lsn_t >(snp->get_last_log_idx()) : 0;
+        LOGINFO("Truncation barrier={} last snapshot idx={}", rdev->cp_truncate_barrier(), snp_idx);
+        ASSERT_LE(rdev->cp_truncate_barrier(), snp_idx) << "Log is truncated beyond the last snapshot";
+
+        // Truncation is queued on the truncate thread once the CP is done, nothing after the snapshot is dropped
+        std::this_thread::sleep_for(std::chrono::seconds{1});
+        ASSERT_LE(s_cast< repl_lsn_t >(rdev->data_journal()->start_index()), snp_idx + 1)
+            << "Log entries after the last snapshot are truncated";
+    }
+
+    g_helper->sync_for_verify_start();
+    LOGINFO("Validate all data written so far by reading them");
+    this->validate_data();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.cp_driven_log_truncation = false; });
+    HS_SETTINGS_FACTORY().save();
+    g_helper->sync_for_cleanup_start();
+}
+
 TEST_F(RaftReplDevTest, RemoveReplDev) {
     LOGINFO("Homestore replica={} setup completed", g_helper->replica_num());
 
@@ -724,6 +1128,55 @@ TEST_F(RaftReplDevTest, GCReplReqs) {
 }
 #endif
 
+// Raft config superblks written by the older versions are msgpack json, which still has to be loaded
+TEST(RaftConfigSb, Load_Json_Format) {
+    auto const server_json = [](int32_t id) {
+        return nlohmann::json{{"id", id},
+                              {"dc_id", 0},
+                              {"endpoint", fmt::format("replica-{}", id)},
+                              {"aux", "aux"},
+                              {"learner", id == 3},
+                              {"priority", 1}};
+    };
+    nlohmann::json js{{"group_id", "8c7a3c5e-2d1b-4c9e-9f00-3a6f4b1d2e10"},
+                      {"config",
+                       {{"log_idx", 42},
+                        {"prev_log_idx", 40},
+                        {"eventual_consistency", false},
+                        {"user_ctx", "ctx"},
+                        {"servers", {server_json(1), server_json(2), server_json(3)}}}},
+                      {"state", {{"term", 7}, {"voted_for", 2}}}};
+
+    auto cfg = RaftReplDev::decode_raft_config(nlohmann::json::to_msgpack(js));
+    ASSERT_EQ(cfg.group_id, "8c7a3c5e-2d1b-4c9e-9f00-3a6f4b1d2e10");
+    ASSERT_EQ(RaftReplDev::config_group_id(nlohmann::json::to_msgpack(js)), cfg.group_id);
+    ASSERT_TRUE(cfg.has_state);
+    ASSERT_EQ(cfg.term, 7u);
+    ASSERT_EQ(cfg.voted_for, 2);
+
+    ASSERT_NE(cfg.config_buf, nullptr);
+    cfg.config_buf->pos(0);
+    auto const conf = nuraft::cluster_config::deserialize(*cfg.config_buf);
+    ASSERT_EQ(conf->get_log_idx(), 42u);
+    ASSERT_EQ(conf->get_prev_log_idx(), 40u);
+    ASSERT_EQ(conf->get_user_ctx(), "ctx");
+    ASSERT_EQ(conf->get_servers().size(), 3u);
+    int32_t id{1};
+    for (auto const& srv : conf->get_servers()) {
+        ASSERT_EQ(srv->get_id(), id);
+        ASSERT_EQ(srv->get_endpoint(), fmt::format("replica-{}", id));
+        ASSERT_EQ(srv->is_learner(), id == 3);
+        ++id;
+    }
+
+    LOGINFO("Group created by the older version, with neither the config nor the state saved yet");
+    auto const empty_cfg =
+        RaftReplDev::decode_raft_config(nlohmann::json::to_msgpack(nlohmann::json{{"group_id", cfg.group_id}}));
+    ASSERT_EQ(empty_cfg.group_id, cfg.group_id);
+    ASSERT_EQ(empty_cfg.config_buf, nullptr);
+    ASSERT_FALSE(empty_cfg.has_state);
+}
+
 int main(int argc, char* argv[]) {
     int parsed_argc = argc;
     char** orig_argv = argv;
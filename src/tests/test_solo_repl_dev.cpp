@@ -13,6 +13,9 @@
  * specific language governing permissions and limitations under the License.
  *
  *********************************************************************************/
+#include <algorithm>
+#include <set>
+#include <string>
 #include <vector>
 #include <iostream>
 #include <filesystem>
@@ -34,6 +37,7 @@
 #include "common/homestore_config.hpp"
 #include "common/homestore_assert.hpp"
 #include "common/homestore_utils.hpp"
+#include "common/resource_mgr.hpp"
 #include "test_common/homestore_test_common.hpp"
 #include "replication/service/generic_repl_svc.h"
 #include "replication/repl_dev/solo_repl_dev.h"
@@ -298,6 +302,90 @@ TEST_F(SoloReplDevTest, TestHeaderOnly) {
     this->m_task_waiter.start([this]() { this->restart(); }).get();
 }
 
+TEST_F(SoloReplDevTest, TestBatchedWrites) {
+    LOGINFO("Step 1: write in batches, both data and header only writes");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.solo_write_batch_size = 8; });
+    HS_SETTINGS_FACTORY().save();
+
+    this->m_io_runner.set_task([this]() {
+        uint32_t nblks = rand() % 4;
+        this->write_io(rand() % 64 + 8, nblks * g_block_size, g_block_size);
+    });
+    this->m_io_runner.execute().get();
+
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.consensus.solo_write_batch_size = 0; });
+    HS_SETTINGS_FACTORY().save();
+
+    LOGINFO("Step 2: Restart homestore and validate replay data.");
+    this->m_task_waiter.start([this]() { this->restart(); }).get();
+}
+
+TEST_F(SoloReplDevTest, TestCapacityRates) {
+    LOGINFO("Step 1: Sample the capacity of the vdevs around the writes");
+    hs()->resource_mgr().sample_capacity();
+    this->m_io_runner.set_task([this]() { this->write_io(0u, g_block_size * (rand() % 4 + 1), g_block_size); });
+    this->m_io_runner.execute().get();
+    hs()->resource_mgr().sample_capacity();
+
+    LOGINFO("Step 2: Data and journal vdevs are written to and grow over the window");
+    auto const rates = hs()->capacity_rates();
+    auto const data_it = std::find_if(rates.begin(), rates.end(), [](auto const& r) { return r.name == "blkdata"; });
+    ASSERT_NE(data_it, rates.end()) << "No rates of the data vdev";
+    ASSERT_GT(data_it->write_bytes_ps, 0.0);
+    ASSERT_GT(data_it->used_bytes_ps, 0.0);
+    ASSERT_GT(data_it->secs_to_full, 0u);
+
+    auto const journal_it = std::find_if(rates.begin(), rates.end(), [](auto const& r) { return r.is_journal; });
+    ASSERT_NE(journal_it, rates.end()) << "No rates of the journal vdev";
+    ASSERT_GT(journal_it->write_bytes_ps, 0.0);
+
+    auto const status = hs()->resource_mgr().capacity_status(1);
+    LOGINFO("Capacity status: {}", status.dump());
+    ASSERT_GE(status["samples"].size(), 2u);
+    ASSERT_EQ(status["window"]["vdevs"].size(), rates.size());
+}
+
+TEST_F(SoloReplDevTest, TestServiceStartTimes) {
+    this->m_io_runner.set_task([this]() { this->write_io(0u, g_block_size, g_block_size); });
+    this->m_io_runner.execute().get();
+
+    LOGINFO("Step 1: Restart homestore with the services started in the order of their dependencies, one by one");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.parallel_service_start = false; });
+    HS_SETTINGS_FACTORY().save();
+    this->m_task_waiter.start([this]() { this->restart(); }).get();
+    auto serial_times = hs()->service_start_times_ms();
+
+    LOGINFO("Step 2: Restart homestore with the independent services started concurrently");
+    HS_SETTINGS_FACTORY().modifiable_settings([](auto& s) { s.generic.parallel_service_start = true; });
+    HS_SETTINGS_FACTORY().save();
+    this->m_task_waiter.start([this]() { this->restart(); }).get();
+    auto parallel_times = hs()->service_start_times_ms();
+
+    std::set< std::string > const expected{"meta", "cp", "data", "repl_load", "log", "repl"};
+    for (auto const& times : {serial_times, parallel_times}) {
+        std::set< std::string > started;
+        for (auto const& [svc, ms] : times) {
+            LOGINFO("Service={} took {} ms to start", svc, ms);
+            started.insert(svc);
+        }
+        ASSERT_EQ(started, expected) << "Not all the services are timed";
+    }
+
+    LOGINFO("Step 3: All the phases of the start are recorded, in the order they started");
+    std::set< std::string > phases;
+    uint64_t prev_start_ms{0};
+    for (auto const& p : hs()->start_phases()) {
+        LOGINFO("Start phase={} started at {} ms, took {} ms", p.name, p.start_ms, p.took_ms);
+        ASSERT_GE(p.start_ms, prev_start_ms) << "Phase=" << p.name << " is out of order";
+        ASSERT_LE(p.start_ms + p.took_ms, hs()->start_total_ms());
+        prev_start_ms = p.start_ms;
+        phases.insert(p.name);
+    }
+    for (auto const& name : {"services", "devices", "meta", "cp", "data", "repl_load", "log", "repl", "ready"}) {
+        ASSERT_TRUE(phases.contains(name)) << "No start phase=" << name;
+    }
+}
+
 SISL_OPTION_GROUP(test_solo_repl_dev,
                   (block_size, "", "block_size", "block size to io",
                    ::cxxopts::value< uint32_t >()->default_value("4096"), "number"));
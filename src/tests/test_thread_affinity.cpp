@@ -0,0 +1,105 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <sched.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include "common/homestore_config.hpp"
+#include "common/thread_affinity.hpp"
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+using namespace homestore;
+
+struct ThreadAffinityTest : public ::testing::Test {
+protected:
+    void set_cpus(std::string const& background, std::string const& meta) {
+        HS_SETTINGS_FACTORY().modifiable_settings([&background, &meta](auto& s) {
+            s.affinity.background_cpus = background;
+            s.affinity.meta_cpus = meta;
+        });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    void TearDown() override { set_cpus("", ""); }
+
+    // Cpus a new thread of the role is pinned to
+    static std::vector< uint32_t > pinned_cpus(hs_thread_role_t role) {
+        std::vector< uint32_t > cpus;
+        std::thread t{[role, &cpus]() {
+            pin_thread(role);
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            ASSERT_EQ(::sched_getaffinity(0, sizeof(set), &set), 0);
+            for (uint32_t cpu{0}; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+            }
+        }};
+        t.join();
+        return cpus;
+    }
+};
+
+TEST_F(ThreadAffinityTest, ParseCpuList) {
+    ASSERT_EQ(parse_cpu_list("3"), (std::vector< uint32_t >{3}));
+    ASSERT_EQ(parse_cpu_list("2-5"), (std::vector< uint32_t >{2, 3, 4, 5}));
+    ASSERT_EQ(parse_cpu_list(" 7, 1-2 ,2,1 "), (std::vector< uint32_t >{1, 2, 7}));
+    ASSERT_TRUE(parse_cpu_list("").empty());
+
+    LOGINFO("Lists with anything not a cpu, range or node are not valid as a whole");
+    ASSERT_TRUE(parse_cpu_list("1,x").empty());
+    ASSERT_TRUE(parse_cpu_list("5-2").empty());
+    ASSERT_TRUE(parse_cpu_list("1-").empty());
+    ASSERT_TRUE(parse_cpu_list("-1").empty());
+    ASSERT_TRUE(parse_cpu_list("node").empty());
+    ASSERT_TRUE(parse_cpu_list("node100000").empty());
+}
+
+TEST_F(ThreadAffinityTest, PinByRole) {
+    auto const all_cpus = pinned_cpus(hs_thread_role_t::meta);
+    ASSERT_FALSE(all_cpus.empty());
+
+    LOGINFO("Threads of every role are pinned to the background cpus");
+    set_cpus("0", "");
+    ASSERT_EQ(pinned_cpus(hs_thread_role_t::logstore), (std::vector< uint32_t >{0}));
+    ASSERT_EQ(pinned_cpus(hs_thread_role_t::meta), (std::vector< uint32_t >{0}));
+
+    if (all_cpus.size() > 1) {
+        LOGINFO("Cpus of the role override the background ones");
+        auto const cpu = all_cpus.back();
+        set_cpus("0", std::to_string(cpu));
+        ASSERT_EQ(pinned_cpus(hs_thread_role_t::meta), (std::vector< uint32_t >{cpu}));
+        ASSERT_EQ(pinned_cpus(hs_thread_role_t::cp), (std::vector< uint32_t >{0}));
+    }
+
+    LOGINFO("Invalid cpus leave the thread where it is");
+    set_cpus("x", "");
+    ASSERT_EQ(pinned_cpus(hs_thread_role_t::cp), all_cpus);
+}
+
+SISL_OPTIONS_ENABLE(logging)
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    SISL_OPTIONS_LOAD(argc, argv, logging)
+    sisl::logging::SetLogger("test_thread_affinity");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,142 @@
+/*********************************************************************************
+ * Modifications Copyright 2017-2019 eBay Inc.
+ *
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *    https://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed
+ * under the License is distributed on an "AS IS" BASIS, WITHOUT WARRANTIES OR
+ * CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ *
+ *********************************************************************************/
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <sisl/logging/logging.h>
+#include <sisl/options/options.h>
+
+#include <homestore/tracer.hpp>
+#include "common/homestore_config.hpp"
+
+SISL_LOGGING_INIT(HOMESTORE_LOG_MODS)
+
+using namespace homestore;
+
+struct TracerTest : public ::testing::Test {
+protected:
+    void set_sample_every(uint32_t n) {
+        HS_SETTINGS_FACTORY().modifiable_settings([n](auto& s) { s.generic.trace_sample_every = n; });
+        HS_SETTINGS_FACTORY().save();
+    }
+
+    void TearDown() override {
+        set_sample_every(0);
+        Tracer::set_export_cb(nullptr);
+    }
+
+    static nlohmann::json find_trace(nlohmann::json const& traces, trace_id_t id) {
+        auto const id_str = fmt::format("{:016x}", id);
+        for (auto const& t : traces) {
+            if (t["trace_id"] == id_str) { return t; }
+        }
+        return nlohmann::json{};
+    }
+};
+
+TEST_F(TracerTest, Sampling) {
+    set_sample_every(0);
+    for (uint32_t i{0}; i < 100; ++i) {
+        ASSERT_EQ(Tracer::sample(), invalid_trace_id);
+    }
+
+    LOGINFO("Every 4th request on a thread is sampled, each with a trace id of its own");
+    set_sample_every(4);
+    std::vector< trace_id_t > ids;
+    for (uint32_t i{0}; i < 100; ++i) {
+        if (auto const id = Tracer::sample(); id != invalid_trace_id) { ids.push_back(id); }
+    }
+    ASSERT_EQ(ids.size(), 25u);
+    std::sort(ids.begin(), ids.end());
+    ASSERT_EQ(std::unique(ids.begin(), ids.end()), ids.end());
+}
+
+TEST_F(TracerTest, SpansAcrossThreads) {
+    set_sample_every(1);
+    std::atomic< uint32_t > exported{0};
+    Tracer::set_export_cb([&exported](trace_span const& span) {
+        ASSERT_NE(span.trace_id, invalid_trace_id);
+        ASSERT_LE(span.start_ns, span.end_ns);
+        ++exported;
+    });
+
+    auto const id = Tracer::sample();
+    ASSERT_NE(id, invalid_trace_id);
+    auto const start_time = Clock::now();
+    {
+        TraceScope scope{id};
+        ASSERT_EQ(Tracer::current(), id);
+        TraceSpan span{"outer", 1};
+        std::this_thread::sleep_for(std::chrono::milliseconds{1});
+
+        // Async part of the path records against the id carried along to the other thread
+        std::thread t{[id]() {
+            ASSERT_EQ(Tracer::current(), invalid_trace_id);
+            TraceScope inner_scope{id};
+            TraceSpan inner{"inner", 2};
+        }};
+        t.join();
+    }
+    Tracer::record(id, "completion", start_time, 3);
+    ASSERT_EQ(Tracer::current(), invalid_trace_id);
+
+    LOGINFO("Spans not of a sampled request are not recorded");
+    { TraceSpan untraced{"untraced"}; }
+    Tracer::record(invalid_trace_id, "untraced", start_time);
+    ASSERT_EQ(exported.load(), 3u);
+
+    auto const trace = find_trace(Tracer::dump(16), id);
+    ASSERT_FALSE(trace.is_null()) << "Trace not found in the dump";
+    auto const& spans = trace["spans"];
+    ASSERT_EQ(spans.size(), 3u);
+    // In the order of their start
+    ASSERT_EQ(spans[0]["name"], "completion");
+    ASSERT_EQ(spans[1]["name"], "outer");
+    ASSERT_EQ(spans[2]["name"], "inner");
+    ASSERT_NE(spans[1]["thread"], spans[2]["thread"]);
+    ASSERT_GE(trace["duration_us"].get< uint64_t >(), spans[1]["duration_us"].get< uint64_t >());
+}
+
+TEST_F(TracerTest, RingOverwritesOldest) {
+    set_sample_every(1);
+    auto const nspans = HS_DYNAMIC_CONFIG(generic->trace_ring_spans);
+    std::vector< trace_id_t > ids;
+    std::thread t{[&ids, nspans]() {
+        for (uint32_t i{0}; i < 2 * nspans; ++i) {
+            ids.push_back(Tracer::sample());
+            Tracer::record(ids.back(), "op", Clock::now(), i);
+        }
+    }};
+    t.join();
+
+    auto const traces = Tracer::dump(4 * nspans);
+    ASSERT_TRUE(find_trace(traces, ids.front()).is_null()) << "Oldest span is expected to be overwritten";
+    ASSERT_FALSE(find_trace(traces, ids.back()).is_null()) << "Latest span is expected in the dump";
+    ASSERT_EQ(Tracer::dump(1).size(), 1u);
+}
+
+SISL_OPTIONS_ENABLE(logging)
+int main(int argc, char* argv[]) {
+    ::testing::InitGoogleTest(&argc, argv);
+    SISL_OPTIONS_LOAD(argc, argv, logging)
+    sisl::logging::SetLogger("test_tracer");
+    spdlog::set_pattern("[%D %T%z] [%^%l%$] [%n] [%t] %v");
+    return RUN_ALL_TESTS();
+}